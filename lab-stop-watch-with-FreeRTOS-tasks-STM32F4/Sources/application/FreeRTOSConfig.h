@@ -45,8 +45,9 @@
  *----------------------------------------------------------*/
 
 #define configUSE_PREEMPTION                    1
-#define configUSE_TICKLESS_IDLE                 0
-#define configCPU_CLOCK_HZ                      MCU_CPU_CLOCK_FREQ_IN_MHZ
+#define configUSE_TICKLESS_IDLE                 2 /* vPortSuppressTicksAndSleep() in rtos_wrapper_FreeRTOS.c */
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP   2
+#define configCPU_CLOCK_HZ                      MCU_CPU_CLOCK_FREQ_IN_HZ
 #define configTICK_RATE_HZ                      ((TickType_t)1000)
 #define configMAX_PRIORITIES                    8
 #define configMINIMAL_STACK_SIZE                UINT16_C(128)
@@ -74,6 +75,14 @@
 #define configTOTAL_HEAP_SIZE                   0 //((size_t)(10 * 1024)) /*??? should be 0 */
 #define configAPPLICATION_ALLOCATED_HEAP        0
 
+/*
+ * Sizing of the RTOS object arena (see rtos_task_alloc() and
+ * rtos_timer_alloc() in rtos_wrapper_FreeRTOS.c):
+ */
+#define configAPP_MAX_NUM_TASKS                 3
+#define configAPP_MAX_NUM_TIMERS                1
+#define configAPP_RTOS_OBJECTS_SRAM_BUDGET      (12 * 1024)
+
 /* Hook function related definitions. */
 #define configUSE_IDLE_HOOK                     0
 #define configUSE_TICK_HOOK                     0
@@ -13,20 +13,21 @@
 #include <building-blocks/io_utils.h>
 #include <building-blocks/rtos_wrapper.h>
 #include <building-blocks/memory_protection_unit.h>
+#include <building-blocks/hw_timer_driver.h>
+#include <building-blocks/system_clocks.h>
 #include <stddef.h>
 #include <ctype.h>
 
-/**
- * stopwatch buttons polling period in milliseconds
- */
-#define POLL_STOPWATCH_BUTTONS_PERIOD_MS	10
-
 /**
  * stopwatch update period in milliseconds
  */
 #define UPDATE_STOPWATCH_PERIOD_MS	100
 
-C_ASSERT(UPDATE_STOPWATCH_PERIOD_MS % POLL_STOPWATCH_BUTTONS_PERIOD_MS == 0);
+/**
+ * Period of the hardware timer that is the stopwatch's time base. It only
+ * determines how often the timer's ISR runs to extend its counter.
+ */
+#define STOPWATCH_TIMER_PERIOD_MS	1000
 
 /*
  * Bit masks for updating stopwatch display cells:
@@ -36,9 +37,24 @@ C_ASSERT(UPDATE_STOPWATCH_PERIOD_MS % POLL_STOPWATCH_BUTTONS_PERIOD_MS == 0);
 #define HOURS_CHANGED_MASK	0x4
 
 /**
- * State variables of a stopwatch object
+ * State variables of a stopwatch object. Elapsed time is measured with the
+ * hardware timer, so it does not depend on when the updater task runs; the
+ * updater task only renders it.
  */
 struct stopwatch {
+	/**
+	 * Time accumulated in previous start/stop intervals, in microseconds
+	 */
+	uint64_t accumulated_us;
+
+	/**
+	 * Hardware timer time latched when the stopwatch was last started
+	 */
+	uint64_t start_time_us;
+
+	/*
+	 * Last rendered elapsed time:
+	 */
 	uint8_t hours;
 	uint8_t minutes;
 	uint8_t seconds;
@@ -50,6 +66,11 @@ static struct stopwatch g_stopwatch = {
 		.running = false
 };
 
+/**
+ * Release schedule of the stopwatch updater task
+ */
+static struct rtos_period g_stopwatch_updater_period;
+
 /**
  * Task creation parameters:
  */
@@ -59,13 +80,6 @@ struct task_params {
     void *arg;
 };
 
-/**
- * Task instances
- */
-static struct rtos_task g_stop_watch_buttons_reader_task;
-static struct rtos_task g_stop_watch_updater_task;
-static struct rtos_task g_console_task;
-
 static void update_stopwatch_display(uint32_t update_mask)
 {
 	console_lock();
@@ -101,6 +115,8 @@ static void reset_stopwatch(void)
 	struct mpu_region_descriptor old_region;
 
     set_private_data_region(&g_stopwatch, sizeof(g_stopwatch), READ_WRITE, &old_region);
+	g_stopwatch.accumulated_us = 0;
+	g_stopwatch.start_time_us = hw_timer_get_time_us(&g_hw_timer0);
 	g_stopwatch.hours = 0;
     g_stopwatch.minutes = 0;
 	g_stopwatch.seconds = 0;
@@ -133,18 +149,28 @@ static void init_stopwatch(void)
  * will represent pressing the stopwatch 'restart button'. Pressing the 'S' key
  * will represent pressing the stopwatch 'start/stop button'.
  *
- * @pre: This function is expected to run every 10 milliseconds.
+ * It blocks the calling task until a key is pressed on the serial console.
+ * Start and stop times are latched from the hardware timer as soon as the key
+ * press is received.
  */
 static void read_stopwatch_buttons(void)
 {
 	int c;
+	uint64_t now_us;
 	struct mpu_region_descriptor old_region;
 
-	c = console_getchar_non_blocking();
+	c = console_getchar();
+	now_us = hw_timer_get_time_us(&g_hw_timer0);
 	c = tolower(c);
     set_private_data_region(&g_stopwatch, sizeof(g_stopwatch), READ_WRITE, &old_region);
 	if (c == 's') {
-		g_stopwatch.running = !g_stopwatch.running;
+		if (g_stopwatch.running) {
+			g_stopwatch.accumulated_us += now_us - g_stopwatch.start_time_us;
+			g_stopwatch.running = false;
+		} else {
+			g_stopwatch.start_time_us = now_us;
+			g_stopwatch.running = true;
+		}
 	} else if (c == 'r') {
 		reset_stopwatch();
 	    update_stopwatch_display(HOURS_CHANGED_MASK | MINUTES_CHANGED_MASK | SECONDS_CHANGED_MASK);
@@ -154,9 +180,8 @@ static void read_stopwatch_buttons(void)
 }
 
 /**
- * Increment the stopwatch counters and updates the stopwatch display accordingly.
- *
- * @pre: This function is expected to run every 100 milliseconds.
+ * Computes the stopwatch's elapsed time from the hardware timer and updates
+ * the stopwatch display accordingly.
  */
 static void update_stopwatch(void)
 {
@@ -164,34 +189,40 @@ static void update_stopwatch(void)
 	struct mpu_region_descriptor old_region;
 
 	D_ASSERT(g_stopwatch.running);
+
+	uint64_t elapsed_ms = (g_stopwatch.accumulated_us +
+	                       (hw_timer_get_time_us(&g_hw_timer0) -
+	                        g_stopwatch.start_time_us)) / 1000;
+	uint32_t total_seconds = (uint32_t)(elapsed_ms / 1000);
+	uint8_t seconds = total_seconds % 60;
+	uint8_t minutes = (total_seconds / 60) % 60;
+	uint8_t hours = (total_seconds / 3600) % 100;
+
     set_private_data_region(&g_stopwatch, sizeof(g_stopwatch), READ_WRITE, &old_region);
-    g_stopwatch.milliseconds += 100;
-    if (g_stopwatch.milliseconds == 1000) {
-        g_stopwatch.milliseconds = 0;
+	if (seconds != g_stopwatch.seconds) {
         update_mask |= SECONDS_CHANGED_MASK;
-        g_stopwatch.seconds ++;
-        if (g_stopwatch.seconds == 60) {
-            g_stopwatch.seconds = 0;
-            update_mask |= MINUTES_CHANGED_MASK;
-			g_stopwatch.minutes ++;
-			if (g_stopwatch.minutes == 60) {
-                g_stopwatch.minutes = 0;
-				update_mask |= HOURS_CHANGED_MASK;
-				g_stopwatch.hours ++;
-				if (g_stopwatch.hours == 100) {
-					g_stopwatch.hours = 0;
-				}
-			}
-		}
 	}
 
+	if (minutes != g_stopwatch.minutes) {
+        update_mask |= MINUTES_CHANGED_MASK;
+	}
+
+	if (hours != g_stopwatch.hours) {
+        update_mask |= HOURS_CHANGED_MASK;
+	}
+
+	g_stopwatch.milliseconds = (uint16_t)(elapsed_ms % 1000);
+	g_stopwatch.seconds = seconds;
+	g_stopwatch.minutes = minutes;
+	g_stopwatch.hours = hours;
     restore_private_data_region(&old_region);
 	update_stopwatch_display(update_mask);
 }
 
 
 /**
- * Task function to read the stop watch buttons periodically
+ * Task function to read the stop watch buttons. It sleeps until the UART
+ * receive interrupt delivers a key press.
  */
 static void stop_watch_buttons_reader_task_func(void *arg)
 {
@@ -199,24 +230,44 @@ static void stop_watch_buttons_reader_task_func(void *arg)
 
     for ( ; ; ) {
     	read_stopwatch_buttons();
-        rtos_task_delay(POLL_STOPWATCH_BUTTONS_PERIOD_MS);
     }
 }
 
 
 /**
- * Task function to update the stop watch periodically
+ * Displays the release jitter and overruns of the stopwatch updater task
+ */
+static void update_period_stats_display(const struct rtos_period *period_p)
+{
+	console_lock();
+    console_pos_printf(14, 20, 0,
+                       "Updater jitter: max %u ms  Overruns: %u  ",
+                       period_p->prd_max_release_jitter_ticks * MS_PER_TIMER_TICK,
+                       period_p->prd_overruns);
+	console_unlock();
+}
+
+
+/**
+ * Task function to render the stop watch periodically. It is released at
+ * fixed multiples of UPDATE_STOPWATCH_PERIOD_MS, so the display refresh rate
+ * does not drift (the elapsed time itself comes from the hardware timer).
  */
 static void stop_watch_updater_task_func(void *arg)
 {
     D_ASSERT(arg == NULL);
 
+    rtos_period_init(&g_stopwatch_updater_period, UPDATE_STOPWATCH_PERIOD_MS);
     for ( ; ; ) {
+        rtos_period_wait(&g_stopwatch_updater_period);
     	if (g_stopwatch.running) {
 			update_stopwatch();
     	}
 
-        rtos_task_delay(UPDATE_STOPWATCH_PERIOD_MS);
+        if (g_stopwatch_updater_period.prd_releases %
+            (1000 / UPDATE_STOPWATCH_PERIOD_MS) == 0) {
+            update_period_stats_display(&g_stopwatch_updater_period);
+        }
     }
 }
 
@@ -247,8 +298,9 @@ int main(void)
     for (unsigned int i = 0; i < 100000; i++)
         ;
     gpio_activate_output_pin(&g_led_pin); //???
-    console_init(&g_console_task);
+    console_init(rtos_task_alloc());
     gpio_deactivate_output_pin(&g_led_pin); //???
+    hw_timer_init(&g_hw_timer0, STOPWATCH_TIMER_PERIOD_MS, NULL, NULL);
 
     /*
      * Display greeting:
@@ -257,19 +309,29 @@ int main(void)
     console_printf("Stop Watch with FreeRTOS tasks  (built " __DATE__ " " __TIME__ ")\n"
 		   "Buttons: s - start/stop    r - reset\n");
 
+    struct flash_access_config flash_config;
+
+    system_clocks_get_flash_config(&flash_config);
+    console_printf("Flash: %u wait states at %u MHz, prefetch %s, "
+                   "I-cache %s, D-cache %s\n",
+                   flash_config.wait_states, MCU_CPU_CLOCK_FREQ_IN_MHZ,
+                   flash_config.prefetch_enabled ? "on" : "off",
+                   flash_config.instruction_cache_enabled ? "on" : "off",
+                   flash_config.data_cache_enabled ? "on" : "off");
+
     init_stopwatch();
 
     /*
      * Create other tasks:
      */
 
-    rtos_task_create(&g_stop_watch_buttons_reader_task,
+    rtos_task_create(rtos_task_alloc(),
 		     "Stop watch buttons reader task",
 		     stop_watch_buttons_reader_task_func,
 		     NULL,
 		     HIGHEST_APP_TASK_PRIORITY);
 
-    rtos_task_create(&g_stop_watch_updater_task,
+    rtos_task_create(rtos_task_alloc(),
 		     "Stop watch updater task",
 		     stop_watch_updater_task_func,
 		     NULL,
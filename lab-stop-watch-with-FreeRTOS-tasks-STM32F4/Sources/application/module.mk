@@ -12,6 +12,14 @@ programs   += $(local_pgm)
 sources    += $(local_src)
 libraries +=
 
-$(local_pgm): $(local_objs) $(libraries)
-	$(CC) $(LDFLAGS) $+ -o $@
+#
+# NOTE: The linker script includes mpu_layout.ld from the current (obj)
+# directory
+#
+$(local_pgm): $(local_objs) $(libraries) mpu_layout.ld
+	$(CC) $(LDFLAGS) $(filter-out %.ld,$+) -o $@
+	NM=$(NM) perl $(BASE_DIR)../scripts/sram_budget_report.pl $@
+
+mpu_layout.ld: $(local_objs) $(libraries)
+	OBJDUMP=$(OBJDUMP) perl $(BASE_DIR)../scripts/mpu_layout_planner.pl $+ > $@
 
@@ -9,6 +9,174 @@
 #include <stdint.h>
 #include <MCU/STM32F401/stm32f401xe.h>
 #include "io_utils.h"
+#include "microcontroller.h"
+#include "compile_time_checks.h"
+
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+#include "mem_utils.h"
+#include <stddef.h>
+
+/**
+ * Number of flash wait states needed for a given HCLK frequency, for VDD in
+ * the 2.7V - 3.6V range (one wait state for every 30MHz after the first
+ * 30MHz, as per the STM32F401 reference manual)
+ */
+#define FLASH_WAIT_STATES(_hclk_freq_in_mhz)   (((_hclk_freq_in_mhz) - 1) / 30)
+
+C_ASSERT(FLASH_WAIT_STATES(MCU_CPU_CLOCK_FREQ_IN_MHZ) <= 2);
+
+/**
+ * HSI oscillator frequency
+ */
+#define HSI_CLOCK_FREQ_IN_HZ    UINT32_C(16000000)
+
+/**
+ * Clock settings for each clock profile
+ */
+static const struct clock_profile_settings {
+    /**
+     * PLLP division factor, or 0 if SYSCLK is the HSI and the PLL is off
+     */
+    uint8_t pllp_divider;
+
+    /**
+     * APB1 prescaler (RCC_CFGR_PPRE1_DIVx, already shifted)
+     */
+    uint32_t ppre1_value;
+
+    /**
+     * Resulting clock frequencies
+     */
+    struct clock_freqs freqs;
+} g_clock_profile_settings[] = {
+    [CLOCK_PROFILE_PERFORMANCE] = {
+        .pllp_divider = 4,
+        .ppre1_value = RCC_CFGR_PPRE1_DIV2,
+        .freqs = {
+            .cpu_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ,
+            .apb1_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ / 2,
+            .apb1_timer_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ,
+            .apb2_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ,
+        },
+    },
+
+    [CLOCK_PROFILE_BALANCED] = {
+        .pllp_divider = 8,
+        .ppre1_value = RCC_CFGR_PPRE1_DIV1,
+        .freqs = {
+            .cpu_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ / 2,
+            .apb1_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ / 2,
+            .apb1_timer_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ / 2,
+            .apb2_clock_freq_in_hz = MCU_CPU_CLOCK_FREQ_IN_HZ / 2,
+        },
+    },
+
+    [CLOCK_PROFILE_LOW_POWER] = {
+        .pllp_divider = 0,
+        .ppre1_value = RCC_CFGR_PPRE1_DIV1,
+        .freqs = {
+            .cpu_clock_freq_in_hz = HSI_CLOCK_FREQ_IN_HZ,
+            .apb1_clock_freq_in_hz = HSI_CLOCK_FREQ_IN_HZ,
+            .apb1_timer_clock_freq_in_hz = HSI_CLOCK_FREQ_IN_HZ,
+            .apb2_clock_freq_in_hz = HSI_CLOCK_FREQ_IN_HZ,
+        },
+    },
+};
+
+C_ASSERT(ARRAY_SIZE(g_clock_profile_settings) == NUM_CLOCK_PROFILES);
+
+/**
+ * State of the system clocks
+ *
+ * NOTE: system_clocks_init() is called before C global variables are
+ * initialized, and it always sets up the clocks for
+ * CLOCK_PROFILE_PERFORMANCE, so that is the initial value here.
+ */
+static struct system_clocks {
+    /**
+     * Current clock profile
+     */
+    enum clock_profiles current_profile;
+
+    /**
+     * List of registered clock change notifiers
+     */
+    struct clock_change_notifier *notifiers_head_p;
+} g_system_clocks = {
+    .current_profile = CLOCK_PROFILE_PERFORMANCE,
+    .notifiers_head_p = NULL,
+};
+
+
+/**
+ * Sets the flash wait states for the given HCLK frequency, and waits for
+ * the new number of wait states to be in effect. When raising the HCLK
+ * frequency, this must be called before switching to the new frequency.
+ * When lowering it, after.
+ */
+static void flash_set_wait_states(uint32_t hclk_freq_in_hz)
+{
+    uint32_t reg_value;
+    uint32_t wait_states = FLASH_WAIT_STATES(hclk_freq_in_hz / 1000000);
+
+    reg_value = FLASH->ACR;
+    SET_BIT_FIELD(reg_value, FLASH_ACR_LATENCY_Msk, FLASH_ACR_LATENCY_Pos,
+                  wait_states);
+    FLASH->ACR = reg_value;
+    do {
+        reg_value = FLASH->ACR;
+    } while (GET_BIT_FIELD(reg_value, FLASH_ACR_LATENCY_Msk,
+                           FLASH_ACR_LATENCY_Pos) != wait_states);
+}
+
+
+/**
+ * Configures the flash wait states for the HCLK frequency and enables the
+ * ART accelerator (instruction and data caches) and the instruction
+ * prefetch buffer. It must be called before the system clock is switched
+ * to the PLL, as the wait states need to be increased before raising the
+ * HCLK frequency.
+ */
+static void flash_accelerator_init(void)
+{
+    uint32_t reg_value;
+
+    /*
+     * The caches can only be reset while they are disabled:
+     */
+    reg_value = FLASH->ACR;
+    reg_value &= ~(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+    FLASH->ACR = reg_value;
+    FLASH->ACR = reg_value | FLASH_ACR_ICRST | FLASH_ACR_DCRST;
+    FLASH->ACR = reg_value;
+
+    reg_value |= FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+    FLASH->ACR = reg_value;
+
+    flash_set_wait_states(MCU_CPU_CLOCK_FREQ_IN_HZ);
+}
+
+
+/**
+ * Switches SYSCLK to the given clock source and waits for the switch to
+ * take effect
+ *
+ * @param sw_value  RCC_CFGR_SW_xxx value (already shifted)
+ * @param sws_value matching RCC_CFGR_SWS_xxx value (already shifted)
+ */
+static void sysclk_switch(uint32_t sw_value, uint32_t sws_value)
+{
+    uint32_t reg_value;
+
+    reg_value = RCC->CFGR;
+    reg_value = (reg_value & ~RCC_CFGR_SW_Msk) | sw_value;
+    RCC->CFGR = reg_value;
+    do {
+        reg_value = RCC->CFGR;
+    } while ((reg_value & RCC_CFGR_SWS_Msk) != sws_value);
+}
+
 
 /**
   * @brief  System Clock Configuration
@@ -45,18 +213,16 @@ static void pll_init(void)
     SET_BIT_FIELD(reg_value, RCC_CR_HSITRIM_Msk, RCC_CR_HSITRIM_Pos, 0x10);
     RCC->CR = reg_value;
 
-    /* Set FLASH latency */
-    reg_value = FLASH->ACR;
-    SET_BIT_FIELD(reg_value, FLASH_ACR_LATENCY_Msk, FLASH_ACR_LATENCY_Pos,
-                  FLASH_ACR_LATENCY_2WS);
-    FLASH->ACR = reg_value;
+    /* Set FLASH latency, and enable ART accelerator and prefetch */
+    flash_accelerator_init();
 
     /* Main PLL configuration and activation using HSI as clock source */
     reg_value = RCC->PLLCFGR;
     reg_value &= ~RCC_PLLCFGR_PLLSRC; /* select HSI as source */
     SET_BIT_FIELD(reg_value, RCC_PLLCFGR_PLLM_Msk, RCC_PLLCFGR_PLLM_Pos, 16);
     SET_BIT_FIELD(reg_value, RCC_PLLCFGR_PLLN_Msk, RCC_PLLCFGR_PLLN_Pos, 336);
-    SET_BIT_FIELD(reg_value, RCC_PLLCFGR_PLLP_Msk, RCC_PLLCFGR_PLLP_Pos, 4);
+    SET_BIT_FIELD(reg_value, RCC_PLLCFGR_PLLP_Msk, RCC_PLLCFGR_PLLP_Pos,
+                  4 / 2 - 1); /* PLLP field encoding: 1 -> /4 */
     SET_BIT_FIELD(reg_value, RCC_PLLCFGR_PLLQ_Msk, RCC_PLLCFGR_PLLQ_Pos, 7);
     RCC->PLLCFGR = reg_value;
 
@@ -72,25 +238,20 @@ static void pll_init(void)
 
     /* Sysclk activation on the main PLL and AHB */
     reg_value = RCC->CFGR;
-    SET_BIT_FIELD(reg_value, RCC_CFGR_HPRE_Msk, RCC_CFGR_HPRE_Pos, RCC_CFGR_HPRE_DIV1);
+    reg_value = (reg_value & ~RCC_CFGR_HPRE_Msk) | RCC_CFGR_HPRE_DIV1;
     RCC->CFGR = reg_value;
 
-    /* Select PLL as system clock */
+    /*
+     * Set APB1 and APB2 prescalers (before switching to the PLL, as APB1
+     * cannot run faster than 42MHz):
+     */
     reg_value = RCC->CFGR;
-    SET_BIT_FIELD(reg_value, RCC_CFGR_SW_Msk, RCC_CFGR_SW_Pos, RCC_CFGR_SW_PLL);
+    reg_value &= ~(RCC_CFGR_PPRE1_Msk | RCC_CFGR_PPRE2_Msk);
+    reg_value |= RCC_CFGR_PPRE1_DIV2 | RCC_CFGR_PPRE2_DIV1;
     RCC->CFGR = reg_value;
-    do {
-        reg_value = RCC->CFGR;
-    } while (GET_BIT_FIELD(reg_value, RCC_CFGR_SWS_Msk, RCC_CFGR_SWS_Pos) !=
-	     RCC_CFGR_SWS_PLL);
 
-    /* Set APB1 and APB2 prescalers */
-    reg_value = RCC->CFGR;
-    SET_BIT_FIELD(reg_value, RCC_CFGR_PPRE1_Msk, RCC_CFGR_PPRE1_Pos,
-	          RCC_CFGR_PPRE1_DIV2);
-    SET_BIT_FIELD(reg_value, RCC_CFGR_PPRE2_Msk, RCC_CFGR_PPRE2_Pos,
-	          RCC_CFGR_PPRE2_DIV1);
-    RCC->CFGR = reg_value;
+    /* Select PLL as system clock */
+    sysclk_switch(RCC_CFGR_SW_PLL, RCC_CFGR_SWS_PLL);
 }
 
 
@@ -126,3 +287,149 @@ void system_clocks_init(void)
     pll_init();
 }
 
+
+/**
+ * Gets the flash access configuration currently in effect
+ *
+ * @param config_p  Area where the configuration is to be returned
+ */
+void system_clocks_get_flash_config(struct flash_access_config *config_p)
+{
+    uint32_t reg_value = FLASH->ACR;
+
+    config_p->wait_states = GET_BIT_FIELD(reg_value, FLASH_ACR_LATENCY_Msk,
+                                          FLASH_ACR_LATENCY_Pos);
+    config_p->prefetch_enabled = (reg_value & FLASH_ACR_PRFTEN) != 0;
+    config_p->instruction_cache_enabled = (reg_value & FLASH_ACR_ICEN) != 0;
+    config_p->data_cache_enabled = (reg_value & FLASH_ACR_DCEN) != 0;
+}
+
+
+/**
+ * Switches the system clocks to the given clock profile, and notifies
+ * the registered clock change notifiers, so that they can re-time their
+ * peripherals (baud rates, timer prescalers, etc) for the new bus
+ * frequencies.
+ *
+ * The USB/SDIO clock (PLLQ output) is not affected by the profile, but it
+ * is not available in CLOCK_PROFILE_LOW_POWER, as the PLL is turned off.
+ *
+ * NOTE: The clock switch and the notifier callbacks run with interrupts
+ * disabled, so that no ISR runs with peripherals timed for the wrong
+ * frequency. A byte being transmitted by a UART during the switch may be
+ * garbled.
+ *
+ * @param profile   New clock profile
+ */
+void system_clocks_set_profile(enum clock_profiles profile)
+{
+    uint32_t reg_value;
+
+    D_ASSERT(profile < NUM_CLOCK_PROFILES);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+    enum clock_profiles old_profile = g_system_clocks.current_profile;
+
+    if (profile == old_profile) {
+        restore_cpu_interrupts(int_mask);
+        return;
+    }
+
+    const struct clock_profile_settings *settings_p =
+        &g_clock_profile_settings[profile];
+    uint32_t old_cpu_clock_freq_in_hz =
+        g_clock_profile_settings[old_profile].freqs.cpu_clock_freq_in_hz;
+
+    if (settings_p->freqs.cpu_clock_freq_in_hz > old_cpu_clock_freq_in_hz) {
+        flash_set_wait_states(settings_p->freqs.cpu_clock_freq_in_hz);
+    }
+
+    /*
+     * Run from HSI while the PLL is reconfigured:
+     */
+    sysclk_switch(RCC_CFGR_SW_HSI, RCC_CFGR_SWS_HSI);
+    RCC->CR &= ~RCC_CR_PLLON;
+    do {
+        reg_value = RCC->CR;
+    } while ((reg_value & RCC_CR_PLLRDY) != 0);
+
+    reg_value = RCC->CFGR;
+    reg_value = (reg_value & ~RCC_CFGR_PPRE1_Msk) | settings_p->ppre1_value;
+    RCC->CFGR = reg_value;
+
+    if (settings_p->pllp_divider != 0) {
+        /*
+         * PLLP field encoding: 0 -> /2, 1 -> /4, 2 -> /6, 3 -> /8
+         */
+        reg_value = RCC->PLLCFGR;
+        SET_BIT_FIELD(reg_value, RCC_PLLCFGR_PLLP_Msk, RCC_PLLCFGR_PLLP_Pos,
+                      settings_p->pllp_divider / 2 - 1);
+        RCC->PLLCFGR = reg_value;
+
+        RCC->CR |= RCC_CR_PLLON;
+        do {
+            reg_value = RCC->CR;
+        } while ((reg_value & RCC_CR_PLLRDY) == 0);
+
+        sysclk_switch(RCC_CFGR_SW_PLL, RCC_CFGR_SWS_PLL);
+    }
+
+    if (settings_p->freqs.cpu_clock_freq_in_hz < old_cpu_clock_freq_in_hz) {
+        flash_set_wait_states(settings_p->freqs.cpu_clock_freq_in_hz);
+    }
+
+    g_system_clocks.current_profile = profile;
+
+    for (struct clock_change_notifier *notifier_p = g_system_clocks.notifiers_head_p;
+         notifier_p != NULL;
+         notifier_p = notifier_p->next_p) {
+        D_ASSERT(notifier_p->signature == CLOCK_CHANGE_NOTIFIER_SIGNATURE);
+        notifier_p->callback_p(&settings_p->freqs, notifier_p->callback_arg);
+    }
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Returns the current clock profile
+ */
+enum clock_profiles system_clocks_get_profile(void)
+{
+    return g_system_clocks.current_profile;
+}
+
+
+/**
+ * Returns the clock frequencies of the current clock profile
+ */
+const struct clock_freqs *system_clocks_get_freqs(void)
+{
+    return &g_clock_profile_settings[g_system_clocks.current_profile].freqs;
+}
+
+
+/**
+ * Registers a clock change notifier. Its callback will be invoked, with
+ * interrupts disabled, every time that the clock profile changes.
+ *
+ * @param notifier_p    Pointer to the notifier (it must not be on the stack)
+ * @param callback_p    Callback function
+ * @param callback_arg  Argument to be passed to the callback function
+ */
+void clock_change_notifier_register(struct clock_change_notifier *notifier_p,
+                                    clock_change_callback_t *callback_p,
+                                    void *callback_arg)
+{
+    D_ASSERT(callback_p != NULL);
+
+    notifier_p->signature = CLOCK_CHANGE_NOTIFIER_SIGNATURE;
+    notifier_p->callback_p = callback_p;
+    notifier_p->callback_arg = callback_arg;
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    notifier_p->next_p = g_system_clocks.notifiers_head_p;
+    g_system_clocks.notifiers_head_p = notifier_p;
+    restore_cpu_interrupts(int_mask);
+}
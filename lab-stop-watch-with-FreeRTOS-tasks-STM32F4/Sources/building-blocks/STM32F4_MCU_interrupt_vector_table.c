@@ -179,7 +179,7 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM1_UP_TIM10_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM1_TRG_COM_TIM11_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM1_CC_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM2_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM2_IRQn)] = tim2_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM3_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM4_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(I2C1_EV_IRQn)] = unexpected_irq_handler,
@@ -189,13 +189,13 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     [IRQ_NUMBER_TO_VECTOR_NUMBER(SPI1_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(SPI2_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(USART1_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(USART2_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(USART2_IRQn)] = usart2_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(EXTI15_10_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(RTC_Alarm_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(OTG_FS_WKUP_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA1_Stream7_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(SDIO_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM5_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(TIM5_IRQn)] = tim5_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(SPI3_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA2_Stream0_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA2_Stream1_IRQn)] = unexpected_irq_handler,
@@ -9,6 +9,7 @@
 #include "microcontroller.h"
 #include "runtime_checks.h"
 #include "time_utils.h"
+#include "io_utils.h"
 
 /**
  * Interrupts disabled stats variables
@@ -264,6 +265,90 @@ atomic_fetch_xor_uint32(volatile uint32_t *counter_p, uint32_t value)
 }
 
 
+/**
+ * Atomically replaces the 32-bit value stored in *value_p with 'new_value',
+ * if it is equal to 'old_value'.
+ *
+ * @param   value_p: Pointer to the value to be updated.
+ *
+ * @param   old_value: Expected current value.
+ *
+ * @param   new_value: Value to be stored.
+ *
+ * @return  true, if the value was replaced
+ * @return  false, if the current value was not 'old_value'
+ */
+bool
+atomic_compare_and_swap_uint32(volatile uint32_t *value_p,
+                               uint32_t old_value,
+                               uint32_t new_value)
+{
+#if (__CORTEX_M >= 0x03)
+    do {
+        if (__LDREXW(value_p) != old_value) {
+            __CLREX();
+            return false;
+        }
+    } while (__STREXW(new_value, value_p) != 0);
+
+    return true;
+#else
+    bool swapped = false;
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    if (*value_p == old_value) {
+        *value_p = new_value;
+        swapped = true;
+    }
+
+    restore_cpu_interrupts(old_primask);
+    return swapped;
+#endif
+}
+
+
+/**
+ * Atomically sets a bit in a 32-bit bit vector
+ *
+ * @param   bit_vector_p: Pointer to the bit vector.
+ *
+ * @param   bit_index: Index of the bit to set.
+ *
+ * @return  true, if the bit was clear before
+ * @return  false, if the bit was already set
+ */
+bool
+atomic_test_and_set_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index)
+{
+    D_ASSERT(bit_index < 32);
+
+    uint32_t old_value = atomic_fetch_or_uint32(bit_vector_p, BIT(bit_index));
+
+    return (old_value & BIT(bit_index)) == 0;
+}
+
+
+/**
+ * Atomically clears a bit in a 32-bit bit vector
+ *
+ * @param   bit_vector_p: Pointer to the bit vector.
+ *
+ * @param   bit_index: Index of the bit to clear.
+ *
+ * @return  true, if the bit was set before
+ * @return  false, if the bit was already clear
+ */
+bool
+atomic_test_and_clear_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index)
+{
+    D_ASSERT(bit_index < 32);
+
+    uint32_t old_value = atomic_fetch_and_uint32(bit_vector_p, ~BIT(bit_index));
+
+    return (old_value & BIT(bit_index)) != 0;
+}
+
+
 /**
  * Increments atomically the 16-bit value stored in *counter_p, and returns the
  * original value.
@@ -330,6 +415,72 @@ atomic_fetch_sub_uint16(volatile uint16_t *counter_p, uint16_t value)
 }
 
 
+/**
+ * Atomically "or" the 16-bit value stored in *counter_p with 'value',
+ * and returns the original value.
+ *
+ * @param   counter_p: Pointer to the value to be updated.
+ *
+ * @param   value: Mask to "or" with.
+ *
+ * @return  value of *counter_p prior to the update.
+ */
+uint16_t
+atomic_fetch_or_uint16(volatile uint16_t *counter_p, uint16_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    uint16_t old_value;
+
+    do {
+    old_value = __LDREXH(counter_p);
+    } while (__STREXH(old_value | value, counter_p) != 0);
+
+    return old_value;
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint16_t old_value = *counter_p;
+
+    *counter_p |= value;
+
+    restore_cpu_interrupts(old_primask);
+    return old_value;
+#endif
+}
+
+
+/**
+ * Atomically "and" the 16-bit value stored in *counter_p with 'value',
+ * and returns the original value.
+ *
+ * @param   counter_p: Pointer to the value to be updated.
+ *
+ * @param   value: Mask to "and" with.
+ *
+ * @return  value of *counter_p prior to the update.
+ */
+uint16_t
+atomic_fetch_and_uint16(volatile uint16_t *counter_p, uint16_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    uint16_t old_value;
+
+    do {
+    old_value = __LDREXH(counter_p);
+    } while (__STREXH(old_value & value, counter_p) != 0);
+
+    return old_value;
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint16_t old_value = *counter_p;
+
+    *counter_p &= value;
+
+    restore_cpu_interrupts(old_primask);
+    return old_value;
+#endif
+}
+
+
 /**
  * Increments atomically the 8-bit value stored in *counter_p, and returns the
  * original value.
@@ -9,7 +9,9 @@
 #define SOURCES_BUILDING_BLOCKS_ATOMIC_UTILS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "compile_time_checks.h"
+#include "microcontroller.h"
 
 #define ATOMIC_POST_INCREMENT_UINT32(_counter_p) \
         atomic_fetch_add_uint32(_counter_p, 1)
@@ -51,12 +53,95 @@ uint32_t atomic_fetch_or_uint32(volatile uint32_t *counter_p, uint32_t value);
 
 uint32_t atomic_fetch_xor_uint32(volatile uint32_t *counter_p, uint32_t value);
 
+bool atomic_compare_and_swap_uint32(volatile uint32_t *value_p,
+                                    uint32_t old_value,
+                                    uint32_t new_value);
+
+bool atomic_test_and_set_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index);
+
+bool atomic_test_and_clear_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index);
+
 uint16_t atomic_fetch_add_uint16(volatile uint16_t *counter_p, uint16_t value);
 
 uint16_t atomic_fetch_sub_uint16(volatile uint16_t *counter_p, uint16_t value);
 
+uint16_t atomic_fetch_or_uint16(volatile uint16_t *counter_p, uint16_t value);
+
+uint16_t atomic_fetch_and_uint16(volatile uint16_t *counter_p, uint16_t value);
+
 uint8_t atomic_fetch_add_uint8(volatile uint8_t *counter_p, uint8_t value);
 
 uint8_t atomic_fetch_sub_uint8(volatile uint8_t *counter_p, uint8_t value);
 
+#if (__CORTEX_M >= 0x03)
+/**
+ * Sets a bit of a word in a bit-band region (typically a peripheral
+ * register), with a single store to the bit's bit-band alias. Unlike a
+ * read-modify-write of the word, it needs no lock and cannot race with
+ * updates of other bits of the word from ISRs.
+ *
+ * @param word_p    Pointer to the word (must be in a bit-band region)
+ * @param bit_index Index of the bit in the word
+ */
+static inline void bit_band_set_bit(volatile uint32_t *word_p, uint8_t bit_index)
+{
+    *BIT_BAND_ALIAS_ADDRESS(word_p, bit_index) = 1;
+}
+
+
+/**
+ * Clears a bit of a word in a bit-band region (typically a peripheral
+ * register), with a single store to the bit's bit-band alias.
+ *
+ * @param word_p    Pointer to the word (must be in a bit-band region)
+ * @param bit_index Index of the bit in the word
+ */
+static inline void bit_band_clear_bit(volatile uint32_t *word_p, uint8_t bit_index)
+{
+    *BIT_BAND_ALIAS_ADDRESS(word_p, bit_index) = 0;
+}
+#endif
+
+
+/**
+ * Atomically sets a flag bit of a halfword. If the halfword is in a bit-band
+ * region, this is a single store to the bit's bit-band alias. Otherwise, it
+ * falls back to atomic_fetch_or_uint16().
+ *
+ * @param flags_p   Pointer to the halfword
+ * @param flag_mask Mask of the flag (it must have a single bit set)
+ */
+static inline void atomic_set_flag_uint16(volatile uint16_t *flags_p, uint16_t flag_mask)
+{
+#if (__CORTEX_M >= 0x03)
+    if (IS_BIT_BAND_ADDRESS(flags_p)) {
+        *BIT_BAND_ALIAS_ADDRESS(flags_p, __builtin_ctz(flag_mask)) = 1;
+        return;
+    }
+#endif
+
+    (void)atomic_fetch_or_uint16(flags_p, flag_mask);
+}
+
+
+/**
+ * Atomically clears a flag bit of a halfword. If the halfword is in a
+ * bit-band region, this is a single store to the bit's bit-band alias.
+ * Otherwise, it falls back to atomic_fetch_and_uint16().
+ *
+ * @param flags_p   Pointer to the halfword
+ * @param flag_mask Mask of the flag (it must have a single bit set)
+ */
+static inline void atomic_clear_flag_uint16(volatile uint16_t *flags_p, uint16_t flag_mask)
+{
+#if (__CORTEX_M >= 0x03)
+    if (IS_BIT_BAND_ADDRESS(flags_p)) {
+        *BIT_BAND_ALIAS_ADDRESS(flags_p, __builtin_ctz(flag_mask)) = 0;
+        return;
+    }
+#endif
+
+    (void)atomic_fetch_and_uint16(flags_p, ~flag_mask);
+}
+
 #endif /* SOURCES_BUILDING_BLOCKS_ATOMIC_UTILS_H_ */
@@ -26,15 +26,11 @@ void init_event_set(struct event_set *event_set_p)
  */
 bool is_event_set_empty(const struct event_set *event_set_p) {
 
-	/*
-	 * NOTE: We need to do a type cast to remove the const, since
-	 * atomic_fecth_or_uint32() changes the first arg. However, since or-ing
-	 * with 0 is a "no-op" the value of the set stays the same.
-	 */
-    uint32_t old_event_set =
-        atomic_fetch_or_uint32((uint32_t *)&event_set_p->elements, 0x0);
-
-    return (old_event_set == 0x0);
+    /*
+     * A single aligned 32-bit load is atomic, so there is no need to
+     * go through an atomic read-modify-write:
+     */
+    return (event_set_p->elements == 0x0);
 }
 
 
@@ -52,13 +48,8 @@ bool is_event_set_empty(const struct event_set *event_set_p) {
 bool test_and_set_event(struct event_set *event_set_p,
                         uint8_t event_index)
 {
-    uint32_t old_event_set;
-
     D_ASSERT(event_index < MAX_NUM_EVENTS);
-    old_event_set = atomic_fetch_or_uint32(&event_set_p->elements,
-    		                               BIT(event_index));
-
-    return (old_event_set & BIT(event_index)) == 0;
+    return atomic_test_and_set_bit(&event_set_p->elements, event_index);
 }
 
 
@@ -75,13 +66,7 @@ bool test_and_set_event(struct event_set *event_set_p,
 bool test_and_clear_event(struct event_set *event_set_p,
                           uint8_t event_index)
 {
-    uint32_t old_event_set;
-
     D_ASSERT(event_index < MAX_NUM_EVENTS);
-    old_event_set = atomic_fetch_and_uint32(
-                            &event_set_p->elements,
-                            ~BIT(event_index));
-
-    return (old_event_set & BIT(event_index)) != 0;
+    return atomic_test_and_clear_bit(&event_set_p->elements, event_index);
 }
 
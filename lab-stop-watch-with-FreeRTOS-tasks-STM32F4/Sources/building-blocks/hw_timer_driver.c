@@ -0,0 +1,275 @@
+/**
+ * @file hw_timer.c
+ *
+ * Hardware timer driver implementation
+ *
+ * The timer counts at 1 MHz and fires its interrupt once per period. The
+ * number of periods elapsed, kept by the ISR, together with the counter
+ * value, give a 64-bit microsecond time since the timer was initialized.
+ *
+ * @author German Rivera
+ */
+#include "hw_timer_driver.h"
+#include "io_utils.h"
+#include "arm_cmsis.h"
+#include "atomic_utils.h"
+#include "time_utils.h"
+#include "interrupt_vector_table.h"
+#include "rtos_wrapper.h"
+#include "system_clocks.h"
+#include <stddef.h>
+
+/**
+ * Frequency of the timer's counter: 1 MHz (1 count per microsecond)
+ */
+#define HW_TIMER_FREQ_IN_HZ   UINT32_C(1000000)
+
+/**
+ * Timers on APB1 are clocked at twice the APB1 clock frequency, since the
+ * APB1 prescaler is not 1 (for CLOCK_PROFILE_PERFORMANCE)
+ */
+#define HW_TIMER_SOURCE_CLOCK_FREQ_IN_HZ  (2 * APB1_CLOCK_FREQ_IN_HZ)
+
+C_ASSERT(HW_TIMER_SOURCE_CLOCK_FREQ_IN_HZ % HW_TIMER_FREQ_IN_HZ == 0);
+
+/**
+ * Mutable data of the hardware timer device (to be placed in SRAM)
+ */
+struct hw_timer_device_var {
+    /**
+     * Flag indicating if hw_timer_init() has been called for this device
+     */
+    bool initialized;
+
+    /**
+     * Timer period in microseconds
+     */
+    uint32_t period_us;
+
+    /**
+     * Number of timer periods elapsed since the timer was initialized
+     */
+    volatile uint32_t periods_elapsed;
+
+    /**
+     * Pointer to callback function to be invoked every time that the timer
+     * fires
+     */
+    hw_timer_callback_t *callback_func;
+
+    /**
+     * Argument to be passed to the callback function
+     */
+    void *callback_arg;
+
+    /**
+     * Notifier to re-time the timer when the clock profile changes
+     */
+    struct clock_change_notifier clock_change_notifier;
+};
+
+static struct hw_timer_device_var g_hw_timer0_var;
+
+/**
+ * Single instance of the hardware timer device (TIM2 peripheral in the
+ * STM32F401, as TIM5 is the idle timer):
+ */
+const struct hw_timer_device g_hw_timer0 = {
+	.signature = HW_TIMER_SIGNATURE,
+	.mmio_registers_p = TIM2,
+	.rcc_apb1enr_mask = RCC_APB1ENR_TIM2EN,
+	.irq_number = TIM2_IRQn,
+	.var_p = &g_hw_timer0_var,
+};
+
+
+/**
+ * Re-programs the prescaler of a timer on APB1, for the given APB1 timer
+ * clock frequency, without losing the current count. This is done by
+ * forcing an update event, with update interrupts disabled for it (URS),
+ * to load the new prescaler value right away, and then restoring the
+ * counter, which the update event resets.
+ *
+ * @param tim_regs_p                    Pointer to the timer's registers
+ * @param apb1_timer_clock_freq_in_hz   New APB1 timer clock frequency
+ * @param counter_freq_in_hz            Timer counter frequency
+ */
+void hw_timer_set_prescaler(TIM_TypeDef *tim_regs_p,
+                            uint32_t apb1_timer_clock_freq_in_hz,
+                            uint32_t counter_freq_in_hz)
+{
+    D_ASSERT(apb1_timer_clock_freq_in_hz % counter_freq_in_hz == 0);
+
+    uint32_t saved_cr1 = READ_MMIO_REGISTER(&tim_regs_p->CR1);
+    uint32_t saved_counter = READ_MMIO_REGISTER(&tim_regs_p->CNT);
+
+    WRITE_MMIO_REGISTER(&tim_regs_p->CR1, saved_cr1 | TIM_CR1_URS);
+    WRITE_MMIO_REGISTER(&tim_regs_p->PSC,
+                        apb1_timer_clock_freq_in_hz / counter_freq_in_hz - 1);
+    WRITE_MMIO_REGISTER(&tim_regs_p->EGR, TIM_EGR_UG);
+    WRITE_MMIO_REGISTER(&tim_regs_p->CNT, saved_counter);
+    WRITE_MMIO_REGISTER(&tim_regs_p->CR1, saved_cr1);
+}
+
+
+/**
+ * Clock change notifier callback for a hardware timer. It keeps the timer
+ * counting at HW_TIMER_FREQ_IN_HZ.
+ */
+static void hw_timer_clock_change_callback(const struct clock_freqs *new_freqs_p,
+                                           void *arg)
+{
+    const struct hw_timer_device *const hw_timer_p = arg;
+
+    D_ASSERT(hw_timer_p->signature == HW_TIMER_SIGNATURE);
+    hw_timer_set_prescaler(hw_timer_p->mmio_registers_p,
+                           new_freqs_p->apb1_timer_clock_freq_in_hz,
+                           HW_TIMER_FREQ_IN_HZ);
+}
+
+
+/**
+ * Initializes a hardware timer device
+ *
+ * @param hw_timer_p 			Pointer to the hardware timer device
+ * @param timer_period_ms		Firing period for the timer in milliseconds
+ * @param timer_callback_func	Pointer to callback function to invoke when
+ * 								the timer fires
+ * @param timer_callback_arg	Argument to be passed to the callback fucntion
+ */
+void hw_timer_init(const struct hw_timer_device *hw_timer_p,
+				   uint16_t timer_period_ms,
+		           hw_timer_callback_t *timer_callback_func,
+				   void *timer_callback_arg)
+{
+    TIM_TypeDef *tim_regs_p = hw_timer_p->mmio_registers_p;
+    struct hw_timer_device_var *hw_timer_var_p = hw_timer_p->var_p;
+
+	D_ASSERT(hw_timer_p->signature == HW_TIMER_SIGNATURE);
+	D_ASSERT(!hw_timer_var_p->initialized);
+    D_ASSERT(timer_period_ms != 0);
+
+	hw_timer_var_p->initialized = true;
+	hw_timer_var_p->period_us = (uint32_t)timer_period_ms * 1000;
+	hw_timer_var_p->periods_elapsed = 0;
+	hw_timer_var_p->callback_func = timer_callback_func;
+	hw_timer_var_p->callback_arg = timer_callback_arg;
+
+	/*
+	 * Enable clock for the timer peripheral:
+	 */
+	bit_band_set_bit(&RCC->APB1ENR, __builtin_ctz(hw_timer_p->rcc_apb1enr_mask));
+
+	/*
+	 * Disable the timer before configuring it (up-counting mode):
+	 */
+	WRITE_MMIO_REGISTER(&tim_regs_p->CR1, 0);
+	WRITE_MMIO_REGISTER(&tim_regs_p->DIER, 0);
+
+	/*
+	 * Count microseconds, and reload every timer period:
+	 */
+	WRITE_MMIO_REGISTER(&tim_regs_p->PSC,
+	                    system_clocks_get_freqs()->apb1_timer_clock_freq_in_hz /
+	                    HW_TIMER_FREQ_IN_HZ - 1);
+	WRITE_MMIO_REGISTER(&tim_regs_p->ARR, hw_timer_var_p->period_us - 1);
+
+	/*
+	 * Force an update event to load the prescaler value and reset the
+	 * counter, and clear the flags it sets:
+	 */
+	WRITE_MMIO_REGISTER(&tim_regs_p->EGR, TIM_EGR_UG);
+	WRITE_MMIO_REGISTER(&tim_regs_p->SR, 0);
+
+    /*
+     * Enable interrupt generation on update (counter reload) events:
+     */
+	WRITE_MMIO_REGISTER(&tim_regs_p->DIER, TIM_DIER_UIE);
+
+	/*
+	 * Enable interrupt in the interrupt controller (NVIC):
+	 */
+    NVIC_SetPriority(hw_timer_p->irq_number, HW_TIMER_INTERRUPT_PRIORITY);
+    NVIC_ClearPendingIRQ(hw_timer_p->irq_number);
+    NVIC_EnableIRQ(hw_timer_p->irq_number);
+
+    /*
+     * Enable the timer:
+     */
+	WRITE_MMIO_REGISTER(&tim_regs_p->CR1, TIM_CR1_CEN);
+
+    clock_change_notifier_register(&hw_timer_var_p->clock_change_notifier,
+                                   hw_timer_clock_change_callback,
+                                   (void *)hw_timer_p);
+}
+
+
+/**
+ * Returns the time elapsed since a hardware timer was initialized, with
+ * microsecond resolution. It can be called from tasks and ISRs.
+ *
+ * @param hw_timer_p 			Pointer to the hardware timer device
+ *
+ * @return time in microseconds
+ */
+uint64_t hw_timer_get_time_us(const struct hw_timer_device *hw_timer_p)
+{
+    TIM_TypeDef *tim_regs_p = hw_timer_p->mmio_registers_p;
+    struct hw_timer_device_var *hw_timer_var_p = hw_timer_p->var_p;
+
+	D_ASSERT(hw_timer_var_p->initialized);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+    uint32_t periods = hw_timer_var_p->periods_elapsed;
+    uint32_t count = READ_MMIO_REGISTER(&tim_regs_p->CNT);
+
+    if (READ_MMIO_REGISTER(&tim_regs_p->SR) & TIM_SR_UIF) {
+        /*
+         * The counter reloaded, but the ISR has not run yet to account for
+         * it. Re-read the counter, as the first read may be from before the
+         * reload:
+         */
+        count = READ_MMIO_REGISTER(&tim_regs_p->CNT);
+        periods ++;
+    }
+
+    restore_cpu_interrupts(int_mask);
+    return (uint64_t)periods * hw_timer_var_p->period_us + count;
+}
+
+
+static void hw_timer_irq_handler(const struct hw_timer_device *hw_timer_p)
+{
+    TIM_TypeDef *tim_regs_p = hw_timer_p->mmio_registers_p;
+    struct hw_timer_device_var *hw_timer_var_p = hw_timer_p->var_p;
+
+	D_ASSERT(hw_timer_var_p->initialized);
+
+	/*
+     * Clear interrupt source and account for the elapsed period, with
+     * interrupts disabled, so that hw_timer_get_time_us() never sees one
+     * without the other:
+     */
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    WRITE_MMIO_REGISTER(&tim_regs_p->SR, ~TIM_SR_UIF);
+    hw_timer_var_p->periods_elapsed ++;
+    restore_cpu_interrupts(int_mask);
+
+	if (hw_timer_var_p->callback_func != NULL) {
+		hw_timer_var_p->callback_func(hw_timer_var_p->callback_arg);
+	}
+}
+
+
+/**
+ * ISR for the hardware timer interrupt
+ */
+void tim2_irq_handler(void)
+{
+	D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+	rtos_enter_isr();
+	hw_timer_irq_handler(&g_hw_timer0);
+	rtos_exit_isr();
+}
@@ -24,7 +24,17 @@ struct hw_timer_device {
     /**
      * Pointer to MMIO registers for the device
      */
-    LPTMR_Type *mmio_registers_p;
+    TIM_TypeDef *mmio_registers_p;
+
+    /**
+     * Bit mask of the device's clock enable bit in RCC->APB1ENR
+     */
+    uint32_t rcc_apb1enr_mask;
+
+    /**
+     * IRQ number of the device's interrupt
+     */
+    IRQn_Type irq_number;
 
     /**
      * Pointer to device data in SRAM
@@ -38,6 +48,12 @@ void hw_timer_init(const struct hw_timer_device *hw_timer_p,
 		           hw_timer_callback_t *timer_callback_func,
 				   void *timer_callback_arg);
 
+uint64_t hw_timer_get_time_us(const struct hw_timer_device *hw_timer_p);
+
+void hw_timer_set_prescaler(TIM_TypeDef *tim_regs_p,
+                            uint32_t apb1_timer_clock_freq_in_hz,
+                            uint32_t counter_freq_in_hz);
+
 extern const struct hw_timer_device g_hw_timer0;
 
 #endif /* SOURCES_BUILDING_BLOCKS_HW_TIMER_DRIVER_H_ */
@@ -70,6 +70,12 @@ void SysTick_Handler(void);
 
 void lptmr0_irq_handler(void);
 
+void usart2_irq_handler(void);
+
+void tim5_irq_handler(void);
+
+void tim2_irq_handler(void);
+
 extern isr_function_t *const g_interrupt_vector_table[];
 
 #endif /* SOURCES_BUILDING_BLOCKS_INTERRUPT_VECTOR_TABLE_H_ */
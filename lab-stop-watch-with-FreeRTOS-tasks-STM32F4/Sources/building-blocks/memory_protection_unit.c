@@ -20,6 +20,43 @@
 #define LAST_ADDRESS(_first_addr, _size) \
         ((void *)((uintptr_t)(_first_addr) + (_size) - 1))
 
+/**
+ * MemManage fault status register (MMFSR) bits, in the CFSR
+ */
+#define MMFSR_IACCVIOL      BIT(0)
+#define MMFSR_DACCVIOL      BIT(1)
+#define MMFSR_MUNSTKERR     BIT(3)
+#define MMFSR_MSTKERR       BIT(4)
+#define MMFSR_MLSPERR       BIT(5)
+#define MMFSR_MMARVALID     BIT(7)
+
+C_ASSERT((MPU_FAULT_LOG_NUM_ENTRIES & (MPU_FAULT_LOG_NUM_ENTRIES - 1)) == 0);
+
+/**
+ * MPU fault telemetry state: a log of the most recent faults and a table of
+ * fault counts per code location
+ */
+struct mpu_fault_telemetry {
+    bool enabled;
+
+    /**
+     * Total number of faults recorded. The log entry of fault i is
+     * log[i % MPU_FAULT_LOG_NUM_ENTRIES].
+     */
+    uint32_t num_faults;
+
+    struct mpu_fault_record log[MPU_FAULT_LOG_NUM_ENTRIES];
+
+    uint32_t num_sites;
+
+    struct mpu_fault_site sites[MPU_FAULT_MAX_NUM_SITES];
+
+    /**
+     * Number of faults from code locations that did not fit in sites[]
+     */
+    uint32_t untracked_sites_count;
+};
+
 enum arm_mpu_read_write_permissions {
      NO_ACCESS = 0x0,
      PRIVILEGED_READ_WRITE_UNPRIVILEGED_NO_ACCESS = 0x1,
@@ -49,6 +86,13 @@ struct mpu_device_var {
     bool return_from_fault_enabled;
     uint8_t num_regions;
     uint8_t num_defined_global_regions;
+
+    /**
+     * Thread regions saved by the last save_thread_mpu_regions() call, which
+     * match the contents of the thread region descriptors of the MPU, until
+     * the next restore_thread_mpu_regions() call. NULL otherwise.
+     */
+    const struct thread_regions *switched_out_thread_regions_p;
 };
 
 static struct mpu_device_var g_mpu_var = {
@@ -57,6 +101,11 @@ static struct mpu_device_var g_mpu_var = {
     .return_from_fault_enabled = false,
     .num_regions = 0,
     .num_defined_global_regions = 0,
+    .switched_out_thread_regions_p = NULL,
+};
+
+static struct mpu_fault_telemetry g_mpu_fault_telemetry = {
+    .enabled = false,
 };
 
 static const struct mpu_device g_mpu = {
@@ -173,26 +222,12 @@ static void define_rounded_mpu_region(
     uint32_t old_primask;
     uint32_t reg_value;
 
-    old_primask = disable_cpu_interrupts();
-
 #if 0
     emergency_printf(
     	"%s:%d: rounded_down_first_address 0x%x, rounded_up_region_size 0x%x, subregions_disabled 0x%x\r\n",
         __func__, __LINE__, rounded_down_first_address, rounded_region_size, subregions_disabled_mask);
 #endif
 
-    /*
-     * Disable region before configuring it:
-     */
-    mpu_regs_p->RNR = region_id;
-    reg_value = mpu_regs_p->RASR;
-    reg_value &= ~MPU_RASR_ENABLE_Msk;
-    mpu_regs_p->RASR = reg_value;
-
-    /*
-     * Configure region:
-     */
-    mpu_regs_p->RBAR = (uintptr_t)rounded_down_first_address;
     reg_value = 0;
     SET_BIT_FIELD(reg_value, MPU_RASR_SIZE_Msk, MPU_RASR_SIZE_Pos,
                   encoded_region_size);
@@ -213,6 +248,30 @@ static void define_rounded_mpu_region(
     }
 
     reg_value |= MPU_RASR_ENABLE_Msk;
+
+    old_primask = disable_cpu_interrupts();
+
+    /*
+     * If the region is already configured as requested, as when nested
+     * calls set the private data region for the same object, there is
+     * nothing to reprogram:
+     */
+    mpu_regs_p->RNR = region_id;
+    if ((mpu_regs_p->RBAR & MPU_RBAR_ADDR_Msk) == (uintptr_t)rounded_down_first_address &&
+        mpu_regs_p->RASR == reg_value) {
+        restore_cpu_interrupts(old_primask);
+        return;
+    }
+
+    /*
+     * Disable region before configuring it:
+     */
+    mpu_regs_p->RASR = mpu_regs_p->RASR & ~MPU_RASR_ENABLE_Msk;
+
+    /*
+     * Configure region:
+     */
+    mpu_regs_p->RBAR = (uintptr_t)rounded_down_first_address;
     mpu_regs_p->RASR = reg_value;
 
     memory_barrier();
@@ -467,27 +526,84 @@ static void restore_mpu_region_descriptor(
     MPU_Type *const mpu_regs_p = g_mpu.mmio_regs_p;
 
     mpu_regs_p->RNR = region_id;
+
+    /*
+     * Nested set/restore pairs for the same region restore the descriptor
+     * that is already loaded:
+     */
+    if (mpu_regs_p->RBAR == saved_region_p->rbar_value &&
+        mpu_regs_p->RASR == saved_region_p->rasr_value) {
+        return;
+    }
+
     mpu_regs_p->RBAR = saved_region_p->rbar_value;
     mpu_regs_p->RASR = saved_region_p->rasr_value;
     memory_barrier();
 }
 
 
+/**
+ * Loads an MPU region descriptor from a saved copy, if it differs from the
+ * currently loaded one. The region is selected with the VALID and REGION
+ * fields of RBAR, instead of with a separate write to RNR.
+ *
+ * NOTE: The caller is expected to issue a memory barrier after loading all
+ * the region descriptors it needs to load.
+ *
+ * @param region_id         MPU region to load
+ * @param saved_region_p    Saved region descriptor to load
+ * @param loaded_region_p   Copy of the currently loaded region descriptor,
+ *                          or NULL if unknown
+ */
+static inline void load_mpu_region_descriptor_if_changed(
+      enum mpu_region_id region_id,
+      const struct mpu_region_descriptor *saved_region_p,
+      const struct mpu_region_descriptor *loaded_region_p)
+{
+    MPU_Type *const mpu_regs_p = g_mpu.mmio_regs_p;
+
+    if (loaded_region_p != NULL &&
+        loaded_region_p->rbar_value == saved_region_p->rbar_value &&
+        loaded_region_p->rasr_value == saved_region_p->rasr_value) {
+        return;
+    }
+
+    mpu_regs_p->RBAR = (saved_region_p->rbar_value &
+                        ~(MPU_RBAR_VALID_Msk | MPU_RBAR_REGION_Msk)) |
+                       MPU_RBAR_VALID_Msk | region_id;
+    mpu_regs_p->RASR = saved_region_p->rasr_value;
+}
+
+
 void restore_thread_mpu_regions(const struct thread_regions *thread_regions_p)
 {
     struct mpu_device_var *const mpu_var_p = g_mpu.var_p;
+    const struct thread_regions *loaded_regions_p =
+        mpu_var_p->switched_out_thread_regions_p;
 
     D_ASSERT(mpu_var_p->initialized);
 
-    restore_mpu_region_descriptor(THREAD_STACK_DATA_REGION,
-                                  &thread_regions_p->stack_region);
-
-    restore_mpu_region_descriptor(PRIVATE_DATA_REGION,
-                                  &thread_regions_p->private_data_region);
-
-    restore_mpu_region_descriptor(PRIVATE_CODE_REGION,
-                                  &thread_regions_p->private_code_region);
+    /*
+     * Only the region descriptors that differ between the switched-out
+     * thread and the switched-in thread need to be written:
+     */
+    mpu_var_p->switched_out_thread_regions_p = NULL;
+    load_mpu_region_descriptor_if_changed(
+        THREAD_STACK_DATA_REGION,
+        &thread_regions_p->stack_region,
+        loaded_regions_p != NULL ? &loaded_regions_p->stack_region : NULL);
+
+    load_mpu_region_descriptor_if_changed(
+        PRIVATE_DATA_REGION,
+        &thread_regions_p->private_data_region,
+        loaded_regions_p != NULL ? &loaded_regions_p->private_data_region : NULL);
+
+    load_mpu_region_descriptor_if_changed(
+        PRIVATE_CODE_REGION,
+        &thread_regions_p->private_code_region,
+        loaded_regions_p != NULL ? &loaded_regions_p->private_code_region : NULL);
 
+    memory_barrier();
     (void)set_writable_background_region(
             thread_regions_p->writable_background_region_enabled);
 }
@@ -532,6 +648,8 @@ void save_thread_mpu_regions(struct thread_regions *thread_regions_p)
     save_mpu_region_descriptor(PRIVATE_CODE_REGION,
                                    &thread_regions_p->private_code_region);
 
+    mpu_var_p->switched_out_thread_regions_p = thread_regions_p;
+
     /*
      * NOTE: We return leaving the background region enabled for writing
      * so that the rest of the context switch logic in the RTOS code
@@ -585,6 +703,15 @@ bool set_writable_background_region(bool enabled)
     old_enabled = (GET_BIT_FIELD(reg_value, MPU_RASR_AP_Msk, MPU_RASR_AP_Pos) ==
                    PRIVILEGED_READ_WRITE_UNPRIVILEGED_READ_ONLY);
 
+    /*
+     * Skip the RASR write and the memory barrier if the region already has
+     * the requested permissions, which is common for nested calls:
+     */
+    if (old_enabled == enabled) {
+        restore_cpu_interrupts(old_primask);
+        return old_enabled;
+    }
+
     if (enabled) {
         read_write_permissions = PRIVILEGED_READ_WRITE_UNPRIVILEGED_READ_ONLY;
     } else {
@@ -713,6 +840,181 @@ static void dump_mpu_region_descriptors(void)
 
 }
 
+/**
+ * Enables or disables the MPU fault telemetry. While enabled, MemManage
+ * faults caused by data accesses are not fatal: they are recorded and the
+ * background region is made writable for the interrupted code, so that the
+ * faulting access succeeds when it is retried. This allows collecting the
+ * MPU violations of a system under load, without stopping it.
+ *
+ * NOTE: Once the background region has been made writable, further
+ * violations of the interrupted code are not caught, until the code makes
+ * the background region read-only again. Faults that cannot be fixed by
+ * making the background region writable are still fatal.
+ */
+void mpu_set_fault_telemetry(bool enabled)
+{
+    bool old_writable = set_writable_background_region(true);
+
+    g_mpu_fault_telemetry.enabled = enabled;
+    if (enabled) {
+        /*
+         * Take MemManage faults, instead of escalating them to HardFault:
+         */
+        SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
+    }
+
+    (void)set_writable_background_region(old_writable);
+}
+
+
+/**
+ * Records an MPU fault in the MPU fault telemetry
+ *
+ * NOTE: It must be called from MemoryManagement_Handler(), with the
+ * background region writable.
+ */
+static void mpu_record_fault(uintptr_t fault_addr, uintptr_t pc,
+                             const struct rtos_task *task_p)
+{
+    struct mpu_fault_telemetry *telemetry_p = &g_mpu_fault_telemetry;
+    struct mpu_fault_record *record_p =
+        &telemetry_p->log[telemetry_p->num_faults % MPU_FAULT_LOG_NUM_ENTRIES];
+    uint32_t i;
+
+    record_p->fault_addr = fault_addr;
+    record_p->pc = pc;
+    record_p->task_p = task_p;
+    record_p->timestamp_ticks = rtos_get_ticks_since_boot();
+    telemetry_p->num_faults ++;
+
+    for (i = 0; i < telemetry_p->num_sites; i ++) {
+        if (telemetry_p->sites[i].pc == pc) {
+            break;
+        }
+    }
+
+    if (i == telemetry_p->num_sites) {
+        if (i == MPU_FAULT_MAX_NUM_SITES) {
+            telemetry_p->untracked_sites_count ++;
+            return;
+        }
+
+        telemetry_p->sites[i].pc = pc;
+        telemetry_p->sites[i].count = 0;
+        telemetry_p->num_sites ++;
+    }
+
+    telemetry_p->sites[i].count ++;
+    telemetry_p->sites[i].last_fault_addr = fault_addr;
+}
+
+
+/**
+ * Handles a MemManage fault in the non-fatal mode of the MPU fault telemetry
+ *
+ * @return true, if the fault was recorded and the interrupted code can be
+ *         resumed
+ * @return false, if the fault is to be treated as fatal
+ */
+static bool mpu_handle_fault_non_fatal(uintptr_t pc,
+                                       const struct rtos_task *task_p)
+{
+    uint32_t mmfsr = SCB->CFSR & SCB_CFSR_MEMFAULTSR_Msk;
+
+    if (!g_mpu_fault_telemetry.enabled ||
+        (mmfsr & (MMFSR_DACCVIOL | MMFSR_MMARVALID)) !=
+            (MMFSR_DACCVIOL | MMFSR_MMARVALID) ||
+        (mmfsr & (MMFSR_IACCVIOL | MMFSR_MUNSTKERR | MMFSR_MSTKERR |
+                  MMFSR_MLSPERR)) != 0) {
+        return false;
+    }
+
+    uintptr_t fault_addr = SCB->MMFAR;
+
+    /*
+     * If the background region was already writable, retrying the access
+     * would fault again:
+     */
+    if (set_writable_background_region(true)) {
+        return false;
+    }
+
+    mpu_record_fault(fault_addr, pc, task_p);
+
+    /*
+     * Clear the MMFSR bits (they are write-1-to-clear):
+     */
+    SCB->CFSR = mmfsr;
+    return true;
+}
+
+
+/**
+ * Gets the most recent MPU faults recorded by the MPU fault telemetry
+ *
+ * @param records_p         Area where the records are to be returned, most
+ *                          recent first
+ * @param max_num_records   Capacity of records_p
+ * @param num_faults_p      Area where the total number of faults recorded
+ *                          since boot is to be returned
+ *
+ * @return number of records returned
+ */
+uint32_t mpu_get_fault_records(struct mpu_fault_record *records_p,
+                               uint32_t max_num_records,
+                               uint32_t *num_faults_p)
+{
+    struct mpu_fault_telemetry *telemetry_p = &g_mpu_fault_telemetry;
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t num_faults = telemetry_p->num_faults;
+    uint32_t num_records = num_faults < MPU_FAULT_LOG_NUM_ENTRIES ?
+                               num_faults : MPU_FAULT_LOG_NUM_ENTRIES;
+
+    if (num_records > max_num_records) {
+        num_records = max_num_records;
+    }
+
+    for (uint32_t i = 0; i < num_records; i ++) {
+        records_p[i] =
+            telemetry_p->log[(num_faults - 1 - i) % MPU_FAULT_LOG_NUM_ENTRIES];
+    }
+
+    restore_cpu_interrupts(old_primask);
+    *num_faults_p = num_faults;
+    return num_records;
+}
+
+
+/**
+ * Gets the fault counts per code location recorded by the MPU fault
+ * telemetry
+ *
+ * @param sites_p           Area where the code locations are to be returned
+ * @param max_num_sites     Capacity of sites_p
+ *
+ * @return number of code locations returned
+ */
+uint32_t mpu_get_fault_sites(struct mpu_fault_site *sites_p,
+                             uint32_t max_num_sites)
+{
+    struct mpu_fault_telemetry *telemetry_p = &g_mpu_fault_telemetry;
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t num_sites = telemetry_p->num_sites;
+
+    if (num_sites > max_num_sites) {
+        num_sites = max_num_sites;
+    }
+
+    for (uint32_t i = 0; i < num_sites; i ++) {
+        sites_p[i] = telemetry_p->sites[i];
+    }
+
+    restore_cpu_interrupts(old_primask);
+    return num_sites;
+}
+
+
 void MemoryManagement_Handler(void)
 {
     const void *pc_at_exception;
@@ -726,10 +1028,6 @@ void MemoryManagement_Handler(void)
     CAPTURE_ARM_LR_REGISTER(return_address);
     CAPTURE_ARM_FRAME_POINTER_REGISTER(frame_pointer);
 
-    mpu_disable();
-    emergency_printf("\n*** Hard fault exception ***\n");
-    dump_mpu_region_descriptors();
-
     if (return_address == CPU_EXC_RETURN_TO_THREAD_MODE_USING_PSP ||
         return_address == CPU_EXC_RETURN_TO_THREAD_MODE_USING_PSP_FPU) {
         /*
@@ -754,6 +1052,14 @@ void MemoryManagement_Handler(void)
         task_p = NULL;
     }
 
+    if (mpu_handle_fault_non_fatal((uintptr_t)pc_at_exception, task_p)) {
+        return;
+    }
+
+    mpu_disable();
+    emergency_printf("\n*** Hard fault exception ***\n");
+    dump_mpu_region_descriptors();
+
     bool found_prev_stack_frame = find_previous_stack_frame(NULL,
 							    __stack_end__,
 							    &frame_pointer,
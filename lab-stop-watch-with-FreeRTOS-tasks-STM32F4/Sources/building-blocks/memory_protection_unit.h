@@ -37,6 +37,19 @@
 #define REGION_ALIGNMENT(_type)		MPU_REGION_ALIGNMENT
 #endif
 
+/**
+ * Places a global data object in its own MPU slot, instead of aligning (and
+ * padding) it to a power-of-2 size with REGION_ALIGNMENT(). The slots are
+ * planned at link time by scripts/mpu_layout_planner.pl, which aligns each
+ * object only to the subregion size of the smallest MPU region that covers
+ * it, and packs smaller objects in the subregions left unused.
+ *
+ * NOTE: The objects are placed in the .data output section, so they can have
+ * initializers.
+ */
+#define MPU_PROTECTED_DATA(_name) \
+        __attribute__ ((section(".mpu_protected_data." #_name)))
+
 /**
  * MPU regions assignment
  */
@@ -80,6 +93,57 @@ struct thread_regions {
 	bool writable_background_region_enabled;
 };
 
+/**
+ * Number of entries of the MPU fault log (must be a power of 2)
+ */
+#define MPU_FAULT_LOG_NUM_ENTRIES   32
+
+/**
+ * Maximum number of distinct code locations tracked by the MPU fault
+ * telemetry
+ */
+#define MPU_FAULT_MAX_NUM_SITES     16
+
+struct rtos_task;
+
+/**
+ * MPU fault recorded by the MPU fault telemetry
+ */
+struct mpu_fault_record {
+    /**
+     * Data address whose access caused the fault
+     */
+    uintptr_t fault_addr;
+
+    /**
+     * Address of the instruction that caused the fault
+     */
+    uintptr_t pc;
+
+    /**
+     * Task that caused the fault, or NULL for an ISR
+     */
+    const struct rtos_task *task_p;
+
+    /**
+     * RTOS tick count when the fault happened
+     */
+    uint32_t timestamp_ticks;
+};
+
+/**
+ * Code location that caused MPU faults, and how many
+ */
+struct mpu_fault_site {
+    uintptr_t pc;
+    uint32_t count;
+
+    /**
+     * Data address of the last fault caused by this code location
+     */
+    uintptr_t last_fault_addr;
+};
+
 enum data_region_permissions {
 	PERM_NONE = 0,
 	READ_ONLY,
@@ -141,4 +205,13 @@ void set_private_data_region(void *start_addr, size_t size,
 		                     enum data_region_permissions permissions,
 		                     struct mpu_region_descriptor *old_region_p);
 
+void mpu_set_fault_telemetry(bool enabled);
+
+uint32_t mpu_get_fault_records(struct mpu_fault_record *records_p,
+                               uint32_t max_num_records,
+                               uint32_t *num_faults_p);
+
+uint32_t mpu_get_fault_sites(struct mpu_fault_site *sites_p,
+                             uint32_t max_num_sites);
+
 #endif /* SOURCES_BUILDING_BLOCKS_MEMORY_PROTECTION_UNIT_H_ */
@@ -72,17 +72,19 @@ static void enable_pin_port_clock(pin_port_t pin_port)
 
     if (g_pin_ports_enabled[pin_port]) {
 	restore_cpu_interrupts(int_mask);
+	return;
     }
 
     g_pin_ports_enabled[pin_port] = true;
     restore_cpu_interrupts(int_mask);
 
     /*
-     * Enable clock for corresponding GPIO port peripheral:
+     * Enable clock for corresponding GPIO port peripheral. RCC is in the
+     * peripheral bit-band region, so the port's enable bit is set with a
+     * single store, instead of a read-modify-write of AHB1ENR that could
+     * race with other drivers enabling their clocks:
      */
-    reg_value = RCC->AHB1ENR;
-    reg_value |= ahb1enr_masks[pin_port];
-    RCC->AHB1ENR = reg_value;
+    bit_band_set_bit(&RCC->AHB1ENR, __builtin_ctz(ahb1enr_masks[pin_port]));
 
     do {
 	reg_value = RCC->AHB1ENR;
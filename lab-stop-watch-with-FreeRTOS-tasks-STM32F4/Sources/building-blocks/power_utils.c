@@ -9,6 +9,39 @@
 #include "power_utils.h"
 #include <building-blocks/io_utils.h>
 #include <building-blocks/arm_cmsis.h>
+#include <building-blocks/microcontroller.h>
+#include <building-blocks/runtime_checks.h>
+#include <building-blocks/atomic_utils.h>
+#include <building-blocks/interrupt_vector_table.h>
+#include <building-blocks/hw_timer_driver.h>
+#include <building-blocks/system_clocks.h>
+#include <stddef.h>
+
+/**
+ * Timer used to keep track of time while the RTOS tick is suppressed during
+ * idle periods. TIM5 is a 32-bit timer that keeps counting in Sleep mode,
+ * so it can both measure the time slept and wake up the CPU.
+ */
+#define IDLE_TIMER              TIM5
+#define IDLE_TIMER_IRQ_NUM      TIM5_IRQn
+
+/**
+ * Frequency of the idle timer's counter: 1 MHz (1 count per microsecond)
+ */
+#define IDLE_TIMER_FREQ_IN_HZ   UINT32_C(1000000)
+
+/**
+ * Timers on APB1 are clocked at twice the APB1 clock frequency, since the
+ * APB1 prescaler is not 1
+ */
+#define IDLE_TIMER_SOURCE_CLOCK_FREQ_IN_HZ  (2 * APB1_CLOCK_FREQ_IN_HZ)
+
+C_ASSERT(IDLE_TIMER_SOURCE_CLOCK_FREQ_IN_HZ % IDLE_TIMER_FREQ_IN_HZ == 0);
+
+/**
+ * Notifier to re-time the idle timer when the clock profile changes
+ */
+static struct clock_change_notifier g_idle_timer_clock_change_notifier;
 
 /**
  * Stops the calling CPU core
@@ -23,3 +56,98 @@ void stop_cpu(void)
 	__WFI();
 }
 
+
+/**
+ * Clock change notifier callback for the idle timer. It keeps the idle
+ * timer counting microseconds, without losing the current count.
+ */
+static void idle_timer_clock_change_callback(const struct clock_freqs *new_freqs_p,
+                                             void *arg)
+{
+    D_ASSERT(arg == NULL);
+    hw_timer_set_prescaler(IDLE_TIMER, new_freqs_p->apb1_timer_clock_freq_in_hz,
+                           IDLE_TIMER_FREQ_IN_HZ);
+}
+
+
+/**
+ * Initializes the idle timer as a free-running 32-bit microsecond counter.
+ * Its wakeup (compare) interrupt is enabled in the NVIC, but it only fires
+ * while armed by idle_timer_set_wakeup().
+ */
+void idle_timer_init(void)
+{
+    /*
+     * Enable clock for the timer:
+     */
+    bit_band_set_bit(&RCC->APB1ENR, RCC_APB1ENR_TIM5EN_Pos);
+
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->CR1, 0);
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->DIER, 0);
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->PSC,
+                        system_clocks_get_freqs()->apb1_timer_clock_freq_in_hz /
+                        IDLE_TIMER_FREQ_IN_HZ - 1);
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->ARR, UINT32_MAX);
+
+    /*
+     * Force an update event to load the prescaler value, and clear the
+     * flags it sets:
+     */
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->EGR, TIM_EGR_UG);
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->SR, 0);
+
+    NVIC_SetPriority(IDLE_TIMER_IRQ_NUM, HW_TIMER_INTERRUPT_PRIORITY);
+    NVIC_ClearPendingIRQ(IDLE_TIMER_IRQ_NUM);
+    NVIC_EnableIRQ(IDLE_TIMER_IRQ_NUM);
+
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->CR1, TIM_CR1_CEN);
+
+    clock_change_notifier_register(&g_idle_timer_clock_change_notifier,
+                                   idle_timer_clock_change_callback, NULL);
+}
+
+
+/**
+ * Returns the current value of the idle timer's microsecond counter
+ */
+uint32_t idle_timer_read_us(void)
+{
+    return READ_MMIO_REGISTER(&IDLE_TIMER->CNT);
+}
+
+
+/**
+ * Arms the idle timer to raise its interrupt when its counter reaches the
+ * given value, to wake up the CPU from stop_cpu().
+ *
+ * @param wakeup_time_us value of the idle timer's counter at which to wake up
+ */
+void idle_timer_set_wakeup(uint32_t wakeup_time_us)
+{
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->CCR1, wakeup_time_us);
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->SR, ~TIM_SR_CC1IF);
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->DIER, TIM_DIER_CC1IE);
+}
+
+
+/**
+ * Disarms the idle timer's wakeup interrupt, and discards it if it already
+ * fired while interrupts were disabled.
+ */
+void idle_timer_cancel_wakeup(void)
+{
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->DIER, 0);
+    WRITE_MMIO_REGISTER(&IDLE_TIMER->SR, ~TIM_SR_CC1IF);
+    NVIC_ClearPendingIRQ(IDLE_TIMER_IRQ_NUM);
+}
+
+
+/**
+ * Idle timer interrupt handler. The wakeup interrupt is normally taken and
+ * discarded with interrupts disabled (see idle_timer_cancel_wakeup()), so
+ * this only needs to clear the interrupt condition.
+ */
+void tim5_irq_handler(void)
+{
+    idle_timer_cancel_wakeup();
+}
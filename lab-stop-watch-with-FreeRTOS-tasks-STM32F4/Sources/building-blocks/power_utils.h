@@ -8,8 +8,18 @@
 #ifndef SOURCES_BUILDING_BLOCKS_POWER_UTILS_H_
 #define SOURCES_BUILDING_BLOCKS_POWER_UTILS_H_
 
+#include <stdint.h>
+
 void stop_cpu(void);
 
 void enable_deep_sleep(void);
 
+void idle_timer_init(void);
+
+uint32_t idle_timer_read_us(void);
+
+void idle_timer_set_wakeup(uint32_t wakeup_time_us);
+
+void idle_timer_cancel_wakeup(void);
+
 #endif /* SOURCES_BUILDING_BLOCKS_POWER_UTILS_H_ */
@@ -21,6 +21,12 @@
 #include "mem_utils.h"
 #include "memory_protection_unit.h"
 
+/**
+ * RTOS backend this wrapper is built for. Code shared by labs that run on
+ * different RTOSes can test this at compile time.
+ */
+#define RTOS_BACKEND_FREERTOS   1
+
 /**
  * For FreeRTOS, lower number means lower priority.
  */
@@ -55,6 +61,59 @@ C_ASSERT(APP_TASK_STACK_SIZE >= configMINIMAL_STACK_SIZE);
 #define MILLISECONDS_TO_TICKS(_milli_secs) \
         ((uint32_t)HOW_MANY(_milli_secs, MS_PER_TIMER_TICK))
 
+/**
+ * Frequency of the RTOS tick interrupt (ticks per second)
+ */
+#define RTOS_TICK_RATE_HZ   configTICK_RATE_HZ
+
+/**
+ * Convert a number of RTOS tick interrupt ticks (as returned by
+ * rtos_get_ticks_since_boot()) to milliseconds
+ */
+#define RTOS_TICKS_TO_MILLISECONDS(_ticks) \
+        ((uint32_t)(((uint64_t)(_ticks) * 1000) / RTOS_TICK_RATE_HZ))
+
+/**
+ * Task priority arithmetic that does not depend on the RTOS's priority
+ * ordering. For FreeRTOS, higher number means higher priority:
+ * - RTOS_TASK_PRIORITY_LOWER(): priority _levels below _prio
+ * - RTOS_TASK_PRIORITY_HIGHER(): priority _levels above _prio
+ * - RTOS_TASK_PRIORITY_IS_AT_LEAST(): _prio is the same as or higher
+ *   than _ref_prio
+ * - RTOS_TASK_PRIORITY_IS_AT_MOST(): _prio is the same as or lower than
+ *   _ref_prio
+ */
+#define RTOS_TASK_PRIORITY_LOWER(_prio, _levels)    ((_prio) - (_levels))
+#define RTOS_TASK_PRIORITY_HIGHER(_prio, _levels)   ((_prio) + (_levels))
+#define RTOS_TASK_PRIORITY_IS_AT_LEAST(_prio, _ref_prio) \
+        ((_prio) >= (_ref_prio))
+#define RTOS_TASK_PRIORITY_IS_AT_MOST(_prio, _ref_prio) \
+        ((_prio) <= (_ref_prio))
+
+/**
+ * Maximum count of an RTOS semaphore. Semaphores are counting semaphores,
+ * as for uCOS-III, so that signals are not lost when a semaphore is
+ * signaled more than once before its waiter runs.
+ */
+#define RTOS_SEMAPHORE_MAX_COUNT    UINT16_MAX
+
+/**
+ * Number of application task and timer objects in the RTOS object arena.
+ * All RTOS objects are statically allocated from this arena, whose size is
+ * set at compile time by the application in FreeRTOSConfig.h.
+ */
+#define RTOS_MAX_NUM_APP_TASKS  configAPP_MAX_NUM_TASKS
+#define RTOS_MAX_NUM_TIMERS     configAPP_MAX_NUM_TIMERS
+
+/**
+ * Maximum SRAM (in bytes) that the RTOS object arena can take (including
+ * the FreeRTOS idle and timer tasks)
+ */
+#define RTOS_OBJECTS_SRAM_BUDGET    configAPP_RTOS_OBJECTS_SRAM_BUDGET
+
+C_ASSERT(RTOS_MAX_NUM_APP_TASKS != 0);
+C_ASSERT(RTOS_MAX_NUM_TIMERS != 0);
+
 /**
  * Wrapper for an RTOS task object
  */
@@ -127,10 +186,83 @@ struct rtos_semaphore
     StaticSemaphore_t sem_os_semaphore_var;
 
     /**
-     * Handle returned by xSemaphoreCreateBinaryStatic() or
-     * xSemaphoreCreateCountingStatic()
+     * Handle returned by xSemaphoreCreateCountingStatic()
      */
     SemaphoreHandle_t sem_os_semaphore_handle;
+
+    /**
+     * Number of tasks blocked on the semaphore (see
+     * rtos_semaphore_broadcast())
+     */
+    volatile uint16_t sem_waiters_count;
+};
+
+/**
+ * Wrapper for a single-waiter signal. It is a cheaper alternative to an
+ * rtos_semaphore, for the case where only one known task ever waits on it,
+ * as it is backed by the waiter task's built-in semaphore (see
+ * rtos_task_semaphore_wait()). Signals are counted, as for a counting
+ * semaphore.
+ *
+ * NOTE: Since a task has only one built-in semaphore, a task must not wait
+ * on more than one rtos_signal, and must not be passed to
+ * rtos_task_semaphore_signal().
+ */
+struct rtos_signal
+{
+#   define      SIGNAL_SIGNATURE  GEN_SIGNATURE('S', 'I', 'G', 'N')
+    uint32_t    sig_signature;
+
+    /**
+     * Task that waits on the signal, or NULL, if it is not known yet, in
+     * which case it is the first task that calls rtos_signal_wait().
+     */
+    struct rtos_task *volatile sig_waiter_task_p;
+
+    /**
+     * Number of times the signal was signaled before the waiter task was
+     * known
+     */
+    volatile uint32_t sig_early_count;
+};
+
+/**
+ * Release schedule of a periodic task, for rtos_period_wait(). Releases are
+ * at fixed multiples of the period from the first release, so that the
+ * time the task takes to do its work does not accumulate as drift.
+ */
+struct rtos_period
+{
+#   define      PERIOD_SIGNATURE  GEN_SIGNATURE('P', 'R', 'D', 'S')
+    uint32_t    prd_signature;
+
+    /**
+     * Period in ticks
+     */
+    TickType_t  prd_period_ticks;
+
+    /**
+     * Tick count of the last scheduled release
+     */
+    TickType_t  prd_last_release_ticks;
+
+    /**
+     * Number of releases so far
+     */
+    uint32_t    prd_releases;
+
+    /**
+     * Number of times the task called rtos_period_wait() after its next
+     * release time had already passed (the work took longer than a period)
+     */
+    uint32_t    prd_overruns;
+
+    /**
+     * Longest and total delay, in ticks, between a scheduled release and the
+     * task actually running after it
+     */
+    uint32_t    prd_max_release_jitter_ticks;
+    uint32_t    prd_total_release_jitter_ticks;
 };
 
 struct rtos_timer;
@@ -175,6 +307,10 @@ void rtos_scheduler_start(void);
 
 void rtos_tick_timer_init(void);
 
+struct rtos_task *rtos_task_alloc(void);
+
+struct rtos_timer *rtos_timer_alloc(void);
+
 void rtos_task_create(struct rtos_task *rtos_task_p,
                       const char *task_name_p,
                       rtos_task_function_t *task_function_p,
@@ -187,8 +323,14 @@ struct rtos_task *rtos_task_self(void);
 
 void rtos_task_change_self_priority(rtos_task_priority_t new_task_prio);
 
+void rtos_task_exit(void);
+
 void rtos_task_delay(uint32_t ms);
 
+void rtos_period_init(struct rtos_period *rtos_period_p, uint32_t period_ms);
+
+void rtos_period_wait(struct rtos_period *rtos_period_p);
+
 void rtos_task_semaphore_wait(void);
 
 void rtos_task_semaphore_signal(struct rtos_task *rtos_task_p);
@@ -208,6 +350,8 @@ void rtos_semaphore_init(struct rtos_semaphore *rtos_semaphore_p,
 
 void rtos_semaphore_wait(struct rtos_semaphore *rtos_semaphore_p);
 
+bool rtos_semaphore_try_wait(struct rtos_semaphore *rtos_semaphore_p);
+
 bool rtos_semaphore_wait_timeout(struct rtos_semaphore *rtos_semaphore_p,
 		                         uint32_t timeout_ms);
 
@@ -215,6 +359,16 @@ void rtos_semaphore_signal(struct rtos_semaphore *rtos_semaphore_p);
 
 void rtos_semaphore_broadcast(struct rtos_semaphore *rtos_semaphore_p);
 
+void rtos_signal_init(struct rtos_signal *rtos_signal_p,
+                      struct rtos_task *waiter_task_p);
+
+void rtos_signal_wait(struct rtos_signal *rtos_signal_p);
+
+bool rtos_signal_wait_timeout(struct rtos_signal *rtos_signal_p,
+                              uint32_t timeout_ms);
+
+void rtos_signal_signal(struct rtos_signal *rtos_signal_p);
+
 void rtos_timer_init(struct rtos_timer *rtos_timer_p,
                      const char *timer_name_p,
                      uint32_t milliseconds,
@@ -232,8 +386,46 @@ void rtos_enter_isr(void);
 
 void rtos_exit_isr(void);
 
-uint32_t rtos_get_ticks_since_boot(void);
+void rtos_enter_trusted_isr(void);
 
-uint32_t rtos_get_time_since_boot(void);
+void rtos_exit_trusted_isr(void);
+
+uint64_t rtos_get_idle_task_cpu_cycles(void);
+
+/*
+ * Fast paths inlined into their callers
+ */
+
+/**
+ * Returns the priority of the calling task. It must be called from a task.
+ *
+ * @return task priority (higher number means higher priority)
+ */
+static inline rtos_task_priority_t rtos_task_get_current_priority(void)
+{
+    return uxTaskPriorityGet(NULL);
+}
+
+
+/**
+ * Return time since boot in ticks. It can be called from ISRs.
+ */
+static inline uint32_t rtos_get_ticks_since_boot(void)
+{
+    if (CALLER_IS_THREAD()) {
+        return xTaskGetTickCount();
+    } else {
+        return xTaskGetTickCountFromISR();
+    }
+}
+
+
+/**
+ * Return time since boot in seconds
+ */
+static inline uint32_t rtos_get_time_since_boot(void)
+{
+    return rtos_get_ticks_since_boot() / RTOS_TICK_RATE_HZ;
+}
 
 #endif /*  __RTOS_WRAPPER_H */
@@ -13,6 +13,8 @@
 #include "runtime_log.h"
 #include <stddef.h>
 #include "memory_protection_unit.h"
+#include "power_utils.h"
+#include "system_clocks.h"
 
 #pragma GCC diagnostic ignored "-Wmissing-prototypes"
 
@@ -39,12 +41,193 @@ static BaseType_t g_rtos_task_context_switch_required = pdFALSE;
  */
 static bool g_interrupted_background_region_writable_state[MCU_NUM_INTERRUPT_PRIORITIES];
 
+/**
+ * Number of entries of the task arena reserved for the FreeRTOS idle and
+ * timer tasks
+ */
+#define RTOS_NUM_KERNEL_TASKS   2
+
+#define RTOS_IDLE_TASK_INDEX    (RTOS_MAX_NUM_APP_TASKS)
+#define RTOS_TIMER_TASK_INDEX   (RTOS_MAX_NUM_APP_TASKS + 1)
+
+/**
+ * RTOS object arena: all task objects (stack and TCB) and timer objects are
+ * statically allocated from these arrays, so that SRAM usage for RTOS
+ * objects is known at build time, and there is no heap.
+ */
+static struct rtos_task g_rtos_task_arena[RTOS_MAX_NUM_APP_TASKS + RTOS_NUM_KERNEL_TASKS];
+static struct rtos_timer g_rtos_timer_arena[RTOS_MAX_NUM_TIMERS];
+
+C_ASSERT(sizeof(g_rtos_task_arena) + sizeof(g_rtos_timer_arena) <=
+         RTOS_OBJECTS_SRAM_BUDGET);
+
+/**
+ * Number of entries allocated from the arena arrays so far (objects are
+ * never freed)
+ */
+static uint8_t g_rtos_num_tasks_allocated = 0;
+static uint8_t g_rtos_num_timers_allocated = 0;
+
+#if configUSE_TICKLESS_IDLE == 2
+/**
+ * Duration of an RTOS tick in microseconds
+ */
+#define RTOS_TICK_PERIOD_US     (UINT32_C(1000000) / configTICK_RATE_HZ)
+
+/**
+ * Maximum number of ticks that can be suppressed at once, so that the idle
+ * timer's wakeup time does not wrap around
+ */
+#define TICKLESS_IDLE_MAX_SUPPRESSED_TICKS  ((TickType_t)(60 * configTICK_RATE_HZ))
+
+C_ASSERT(configCPU_CLOCK_HZ % configTICK_RATE_HZ == 0);
+C_ASSERT(RTOS_TICK_PERIOD_US * configTICK_RATE_HZ == UINT32_C(1000000));
+#endif
+
+/**
+ * Notifier to re-time SysTick when the clock profile changes
+ */
+static struct clock_change_notifier g_systick_clock_change_notifier;
+
+/**
+ * CPU cycles the idle task has spent with the CPU sleeping in
+ * vPortSuppressTicksAndSleep(), at the CPU clock frequency of each sleep
+ * (see rtos_get_idle_task_cpu_cycles())
+ */
+static uint64_t g_rtos_idle_sleep_cpu_cycles = 0;
+
+
+/**
+ * Clock change notifier callback for SysTick. It keeps the RTOS tick
+ * period when the CPU clock frequency changes. It is called with
+ * interrupts disabled. The current tick period gets restarted.
+ */
+static void rtos_systick_clock_change_callback(const struct clock_freqs *new_freqs_p,
+                                               void *arg)
+{
+    D_ASSERT(arg == NULL);
+    if ((SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) == 0) {
+        /*
+         * The scheduler has not been started yet:
+         */
+        return;
+    }
+
+    SysTick->LOAD = new_freqs_p->cpu_clock_freq_in_hz / configTICK_RATE_HZ - 1;
+    SysTick->VAL = 0;
+}
+
+
 /**
  * Initializes RTOS
  */
 void rtos_init(void)
 {
+#if configUSE_TICKLESS_IDLE == 2
+    idle_timer_init();
+#endif
+
+    clock_change_notifier_register(&g_systick_clock_change_notifier,
+                                   rtos_systick_clock_change_callback, NULL);
+}
+
+
+#if configUSE_TICKLESS_IDLE == 2
+/**
+ * Called by the FreeRTOS idle task, with the scheduler suspended, when no
+ * task is expected to be ready for at least configEXPECTED_IDLE_TIME_BEFORE_SLEEP
+ * ticks. It stops the SysTick timer and sleeps until the next task is due,
+ * or until an interrupt happens, whatever comes first.
+ *
+ * The time actually slept is measured with the idle timer, which keeps
+ * counting in Sleep mode, rather than with the stopped SysTick. The
+ * sub-tick remainder is carried over into the first SysTick period after
+ * waking up, so suppressed ticks do not make the RTOS tick count drift.
+ *
+ * @param expected_idle_ticks number of ticks until the next task is due
+ */
+void vPortSuppressTicksAndSleep(TickType_t expected_idle_ticks)
+{
+    uint32_t old_primask;
+    uint32_t start_time_us;
+    uint32_t elapsed_us;
+    uint32_t slept_us;
+    uint32_t next_tick_us;
+    TickType_t elapsed_ticks;
+    uint32_t cpu_clock_freq_in_hz = system_clocks_get_freqs()->cpu_clock_freq_in_hz;
+    uint32_t cpu_clock_freq_in_mhz = cpu_clock_freq_in_hz / 1000000;
+
+    if (expected_idle_ticks > TICKLESS_IDLE_MAX_SUPPRESSED_TICKS) {
+        expected_idle_ticks = TICKLESS_IDLE_MAX_SUPPRESSED_TICKS;
+    }
+
+    old_primask = disable_cpu_interrupts();
+
+    /*
+     * A task may have been made ready by an interrupt, since the idle task
+     * decided to call this function, or a tick may be pending:
+     */
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep ||
+        (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0) {
+        restore_cpu_interrupts(old_primask);
+        return;
+    }
+
+    /*
+     * Stop SysTick and account for the part of the current tick period
+     * that had already elapsed. This is derived from the time left until
+     * the next tick, as the current period may be shorter than LOAD, if
+     * it is the first one after a previous tickless sleep:
+     */
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    start_time_us = idle_timer_read_us();
+    elapsed_us = RTOS_TICK_PERIOD_US - SysTick->VAL / cpu_clock_freq_in_mhz;
+    if (elapsed_us == 0) {
+        elapsed_us = 1;
+    }
+
+    idle_timer_set_wakeup(start_time_us +
+                          expected_idle_ticks * RTOS_TICK_PERIOD_US - elapsed_us);
+
+    /*
+     * Interrupts are disabled, but a pending interrupt still wakes up the
+     * CPU. It is serviced after the tick count has been corrected below:
+     */
+    __DSB();
+    stop_cpu();
+    __ISB();
+
+    slept_us = idle_timer_read_us() - start_time_us;
+    elapsed_us += slept_us;
+    idle_timer_cancel_wakeup();
+    g_rtos_idle_sleep_cpu_cycles += (uint64_t)slept_us * cpu_clock_freq_in_mhz;
+
+    elapsed_ticks = elapsed_us / RTOS_TICK_PERIOD_US;
+    if (elapsed_ticks >= expected_idle_ticks) {
+        /*
+         * The last tick must be delivered by the SysTick interrupt, so that
+         * the tasks that are due get unblocked:
+         */
+        elapsed_ticks = expected_idle_ticks - 1;
+        next_tick_us = 1;
+    } else {
+        next_tick_us = RTOS_TICK_PERIOD_US - (elapsed_us % RTOS_TICK_PERIOD_US);
+    }
+
+    /*
+     * Restart SysTick so that the next tick fires at the next tick
+     * boundary. Writing LOAD again after enabling SysTick does not affect
+     * the current period, only the ones after it:
+     */
+    SysTick->LOAD = next_tick_us * cpu_clock_freq_in_mhz - 1;
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = cpu_clock_freq_in_hz / configTICK_RATE_HZ - 1;
+
+    vTaskStepTick(elapsed_ticks);
+    restore_cpu_interrupts(old_primask);
 }
+#endif
 
 
 /**
@@ -98,6 +281,109 @@ void rtos_exit_isr(void)
 }
 
 
+/**
+ * Notify RTOS that we are entering a trusted ISR. Unlike rtos_enter_isr(),
+ * the background region is left writable for the whole ISR, so entering and
+ * exiting the ISR takes one change of the background region's permissions
+ * each, at most. It is meant for short, high-rate ISRs whose code is trusted
+ * not to corrupt global data.
+ */
+void rtos_enter_trusted_isr(void)
+{
+	D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+	bool old_writable = set_writable_background_region(true);
+    uint_fast8_t prev_nested_ISR_count = ATOMIC_POST_INCREMENT_UINT8(&g_nested_ISR_count);
+
+    D_ASSERT(prev_nested_ISR_count < MCU_NUM_INTERRUPT_PRIORITIES);
+    g_interrupted_background_region_writable_state[prev_nested_ISR_count] = old_writable;
+}
+
+
+/**
+ * Notify RTOS that we are exiting a trusted ISR
+ */
+void rtos_exit_trusted_isr(void)
+{
+	D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    uint_fast8_t prev_nested_ISR_count = ATOMIC_POST_DECREMENT_UINT8(&g_nested_ISR_count);
+
+    D_ASSERT(prev_nested_ISR_count >= 1);
+    if (prev_nested_ISR_count == 1) {
+        portEND_SWITCHING_ISR(g_rtos_task_context_switch_required);
+        g_rtos_task_context_switch_required = pdFALSE;
+    }
+
+    (void)set_writable_background_region(
+    	g_interrupted_background_region_writable_state[prev_nested_ISR_count - 1]);
+}
+
+
+/**
+ * Allocates a task object from the RTOS object arena. Task objects are never
+ * freed, so running out of them is a configuration error (see
+ * configAPP_MAX_NUM_TASKS).
+ *
+ * @return pointer to the task object, to be passed to rtos_task_create()
+ */
+struct rtos_task *rtos_task_alloc(void)
+{
+    struct rtos_task *rtos_task_p = NULL;
+
+    bool old_writable = set_writable_background_region(true);
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    if (g_rtos_num_tasks_allocated < RTOS_MAX_NUM_APP_TASKS) {
+        rtos_task_p = &g_rtos_task_arena[g_rtos_num_tasks_allocated];
+        g_rtos_num_tasks_allocated ++;
+    }
+
+    restore_cpu_interrupts(old_primask);
+    (void)set_writable_background_region(old_writable);
+
+    if (rtos_task_p == NULL) {
+        error_t error = CAPTURE_ERROR("RTOS task arena exhausted",
+                                      RTOS_MAX_NUM_APP_TASKS, 0);
+        fatal_error_handler(error);
+    }
+
+    return rtos_task_p;
+}
+
+
+/**
+ * Allocates a timer object from the RTOS object arena. Timer objects are
+ * never freed, so running out of them is a configuration error (see
+ * configAPP_MAX_NUM_TIMERS).
+ *
+ * @return pointer to the timer object, to be passed to rtos_timer_init()
+ */
+struct rtos_timer *rtos_timer_alloc(void)
+{
+    struct rtos_timer *rtos_timer_p = NULL;
+
+    bool old_writable = set_writable_background_region(true);
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    if (g_rtos_num_timers_allocated < RTOS_MAX_NUM_TIMERS) {
+        rtos_timer_p = &g_rtos_timer_arena[g_rtos_num_timers_allocated];
+        g_rtos_num_timers_allocated ++;
+    }
+
+    restore_cpu_interrupts(old_primask);
+    (void)set_writable_background_region(old_writable);
+
+    if (rtos_timer_p == NULL) {
+        error_t error = CAPTURE_ERROR("RTOS timer arena exhausted",
+                                      RTOS_MAX_NUM_TIMERS, 0);
+        fatal_error_handler(error);
+    }
+
+    return rtos_timer_p;
+}
+
+
 /**
  * Create an RTOS-level task
  */
@@ -191,6 +477,23 @@ void rtos_task_change_self_priority(rtos_task_priority_t new_task_prio)
 }
 
 
+/**
+ * Terminates the calling task. The task's object is not returned to the
+ * RTOS object arena, as objects are never freed.
+ */
+void rtos_task_exit(void)
+{
+    struct rtos_task *rtos_task_p = rtos_task_get_current();
+
+    (void)set_writable_background_region(true);
+    rtos_task_p->tsk_created = false;
+    vTaskDelete(NULL);
+
+    /*Unreachable*/
+    D_ASSERT(false);
+}
+
+
 /**
  * Delays the current task a given number of milliseconds
  */
@@ -202,13 +505,98 @@ void rtos_task_delay(uint32_t ms)
 
 
 /**
- * Block calling task on its built-in semaphore
+ * Initializes the release schedule of a periodic task. The first release
+ * is one period from now.
+ *
+ * @param rtos_period_p Pointer to the period object
+ * @param period_ms     Period in milliseconds (multiple of MS_PER_TIMER_TICK)
+ */
+void rtos_period_init(struct rtos_period *rtos_period_p, uint32_t period_ms)
+{
+    D_ASSERT(period_ms != 0 && period_ms % MS_PER_TIMER_TICK == 0);
+
+	bool old_writable = set_writable_background_region(true);
+    rtos_period_p->prd_signature = PERIOD_SIGNATURE;
+    rtos_period_p->prd_period_ticks = period_ms / MS_PER_TIMER_TICK;
+    rtos_period_p->prd_last_release_ticks = xTaskGetTickCount();
+    rtos_period_p->prd_releases = 0;
+    rtos_period_p->prd_overruns = 0;
+    rtos_period_p->prd_max_release_jitter_ticks = 0;
+    rtos_period_p->prd_total_release_jitter_ticks = 0;
+    (void)set_writable_background_region(old_writable);
+}
+
+
+/**
+ * Blocks the calling task until its next periodic release, and records the
+ * release jitter. If the next release time has already passed, it counts an
+ * overrun and returns right away, so that missed releases are made up.
+ *
+ * @param rtos_period_p Pointer to the period object
+ */
+void rtos_period_wait(struct rtos_period *rtos_period_p)
+{
+    D_ASSERT(rtos_period_p->prd_signature == PERIOD_SIGNATURE);
+    D_ASSERT(CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+	bool old_writable = set_writable_background_region(true);
+    TickType_t next_release_ticks = rtos_period_p->prd_last_release_ticks +
+                                    rtos_period_p->prd_period_ticks;
+
+    if ((int32_t)(xTaskGetTickCount() - next_release_ticks) >= 0) {
+        rtos_period_p->prd_overruns ++;
+    }
+
+    /*
+     * vTaskDelayUntil() advances prd_last_release_ticks by one period:
+     */
+    vTaskDelayUntil(&rtos_period_p->prd_last_release_ticks,
+                    rtos_period_p->prd_period_ticks);
+
+    uint32_t jitter_ticks = xTaskGetTickCount() -
+                            rtos_period_p->prd_last_release_ticks;
+
+    rtos_period_p->prd_releases ++;
+    rtos_period_p->prd_total_release_jitter_ticks += jitter_ticks;
+    if (jitter_ticks > rtos_period_p->prd_max_release_jitter_ticks) {
+        rtos_period_p->prd_max_release_jitter_ticks = jitter_ticks;
+    }
+
+    (void)set_writable_background_region(old_writable);
+}
+
+
+/**
+ * Block calling task on its built-in semaphore, which for FreeRTOS is the
+ * task's notification value, used as a counting semaphore
  */
 void rtos_task_semaphore_wait(void)
 {
-    error_t error = CAPTURE_ERROR("function not supported for FreeRTOS", rtos_task_semaphore_wait, 0);
-    /* TODO: Implement this using ulTaskNotifyTake() */
-    fatal_error_handler(error);
+    D_ASSERT(CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+	bool old_writable = set_writable_background_region(true);
+    (void)ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    (void)set_writable_background_region(old_writable);
+}
+
+
+/**
+ * Block calling task on its built-in semaphore, with a timeout
+ *
+ * @return true, if the semaphore was signaled
+ * @return false, if the wait timed out
+ */
+static bool rtos_task_semaphore_wait_timeout(uint32_t timeout_ms)
+{
+    uint32_t notification_value;
+
+    D_ASSERT(CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+	bool old_writable = set_writable_background_region(true);
+    notification_value = ulTaskNotifyTake(pdFALSE, MILLISECONDS_TO_TICKS(timeout_ms));
+    (void)set_writable_background_region(old_writable);
+
+    return notification_value != 0;
 }
 
 
@@ -217,11 +605,17 @@ void rtos_task_semaphore_wait(void)
  */
 void rtos_task_semaphore_signal(struct rtos_task *rtos_task_p)
 {
-    error_t error = CAPTURE_ERROR("function not supported for FreeRTOS" ,
-    		                      rtos_task_semaphore_signal, rtos_task_p);
+    D_ASSERT(rtos_task_p->tsk_signature == TASK_SIGNATURE);
+    D_ASSERT(rtos_task_p->tsk_created);
 
-    /* TODO: Implement this using ulTaskNotifyGive() */
-    fatal_error_handler(error);
+	bool old_writable = set_writable_background_region(true);
+    if (CALLER_IS_THREAD()) {
+        (void)xTaskNotifyGive(rtos_task_p->tsk_handle);
+    } else {
+        vTaskNotifyGiveFromISR(rtos_task_p->tsk_handle,
+                               &g_rtos_task_context_switch_required);
+    }
+    (void)set_writable_background_region(old_writable);
 }
 
 
@@ -317,16 +711,11 @@ void rtos_semaphore_init(struct rtos_semaphore *rtos_semaphore_p,
     D_ASSERT(rtos_semaphore_p != NULL);
     rtos_semaphore_p->sem_signature = SEMAPHORE_SIGNATURE;
     rtos_semaphore_p->sem_name = semaphore_name_p;
-    if (initial_count == 0) {
-	rtos_semaphore_p->sem_os_semaphore_handle =
-	   xSemaphoreCreateBinaryStatic(
-		&rtos_semaphore_p->sem_os_semaphore_var);
-    } else {
-	rtos_semaphore_p->sem_os_semaphore_handle =
-	    xSemaphoreCreateCountingStatic(
-		initial_count, initial_count,
-		&rtos_semaphore_p->sem_os_semaphore_var);
-    }
+    rtos_semaphore_p->sem_waiters_count = 0;
+    D_ASSERT(initial_count <= RTOS_SEMAPHORE_MAX_COUNT);
+    rtos_semaphore_p->sem_os_semaphore_handle =
+        xSemaphoreCreateCountingStatic(RTOS_SEMAPHORE_MAX_COUNT, initial_count,
+                                       &rtos_semaphore_p->sem_os_semaphore_var);
 
     (void)set_writable_background_region(old_writable);
 
@@ -346,8 +735,10 @@ void rtos_semaphore_wait(struct rtos_semaphore *rtos_semaphore_p)
     D_ASSERT(CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
 
 	bool old_writable = set_writable_background_region(true);
+    (void)ATOMIC_POST_INCREMENT_UINT16(&rtos_semaphore_p->sem_waiters_count);
     rtos_status = xSemaphoreTake(rtos_semaphore_p->sem_os_semaphore_handle,
 	                         portMAX_DELAY);
+    (void)ATOMIC_POST_DECREMENT_UINT16(&rtos_semaphore_p->sem_waiters_count);
     (void)set_writable_background_region(old_writable);
 
     if (rtos_status != pdPASS) {
@@ -357,6 +748,32 @@ void rtos_semaphore_wait(struct rtos_semaphore *rtos_semaphore_p)
 }
 
 
+/**
+ * Takes an RTOS-level semaphore, if it is available, without blocking.
+ * It can be called from ISRs.
+ *
+ * @return true, if the semaphore was taken
+ * @return false, if the semaphore count was 0
+ */
+bool rtos_semaphore_try_wait(struct rtos_semaphore *rtos_semaphore_p)
+{
+    BaseType_t rtos_status;
+
+    D_ASSERT(rtos_semaphore_p->sem_signature == SEMAPHORE_SIGNATURE);
+
+	bool old_writable = set_writable_background_region(true);
+    if (CALLER_IS_THREAD()) {
+        rtos_status = xSemaphoreTake(rtos_semaphore_p->sem_os_semaphore_handle, 0);
+    } else {
+        rtos_status = xSemaphoreTakeFromISR(rtos_semaphore_p->sem_os_semaphore_handle,
+                                            &g_rtos_task_context_switch_required);
+    }
+    (void)set_writable_background_region(old_writable);
+
+    return rtos_status == pdPASS;
+}
+
+
 /**
  * Waits with timeout on an RTOS-level semaphore
  *
@@ -375,8 +792,10 @@ bool rtos_semaphore_wait_timeout(struct rtos_semaphore *rtos_semaphore_p,
     D_ASSERT(CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
 
 	bool old_writable = set_writable_background_region(true);
+    (void)ATOMIC_POST_INCREMENT_UINT16(&rtos_semaphore_p->sem_waiters_count);
     rtos_status = xSemaphoreTake(rtos_semaphore_p->sem_os_semaphore_handle,
-                                 timeout_ms / MS_PER_TIMER_TICK);
+                                 MILLISECONDS_TO_TICKS(timeout_ms));
+    (void)ATOMIC_POST_DECREMENT_UINT16(&rtos_semaphore_p->sem_waiters_count);
     (void)set_writable_background_region(old_writable);
 
     return rtos_status == pdPASS;
@@ -401,14 +820,30 @@ void rtos_semaphore_signal(struct rtos_semaphore *rtos_semaphore_p)
 
 
 /**
- * Broadcast an RTOS-level semaphore. It wakes up all waiters
+ * Broadcast an RTOS-level semaphore. It wakes up all waiters. It can be
+ * called from ISRs.
+ *
+ * NOTE: FreeRTOS has no "post all" operation, so the semaphore is given
+ * once for each task blocked on it. A waiter that times out at the same
+ * time leaves an extra count behind, so waiters must re-check the
+ * condition they wait for, after being woken up.
  */
 void rtos_semaphore_broadcast(struct rtos_semaphore *rtos_semaphore_p)
 {
-    error_t error = CAPTURE_ERROR("function not supported for FreeRTOS",
-    		                      rtos_semaphore_broadcast, rtos_semaphore_p);
+    D_ASSERT(rtos_semaphore_p->sem_signature == SEMAPHORE_SIGNATURE);
 
-    fatal_error_handler(error);
+	bool old_writable = set_writable_background_region(true);
+    uint_fast16_t num_waiters = rtos_semaphore_p->sem_waiters_count;
+
+    for (uint_fast16_t i = 0; i < num_waiters; i ++) {
+        if (CALLER_IS_THREAD()) {
+            (void)xSemaphoreGive(rtos_semaphore_p->sem_os_semaphore_handle);
+        } else {
+            (void)xSemaphoreGiveFromISR(rtos_semaphore_p->sem_os_semaphore_handle,
+                                        &g_rtos_task_context_switch_required);
+        }
+    }
+    (void)set_writable_background_region(old_writable);
 }
 
 
@@ -422,6 +857,108 @@ static void rtos_timer_internal_callback(TimerHandle_t xTimer)
 }
 
 
+/**
+ * Initializes a single-waiter signal
+ *
+ * @param rtos_signal_p pointer to the signal object
+ * @param waiter_task_p task that waits on the signal, or NULL, if it is not
+ *        known yet. In that case, the first task that calls
+ *        rtos_signal_wait() becomes the waiter task.
+ */
+void rtos_signal_init(struct rtos_signal *rtos_signal_p,
+                      struct rtos_task *waiter_task_p)
+{
+    D_ASSERT(rtos_signal_p != NULL);
+    D_ASSERT(waiter_task_p == NULL ||
+             waiter_task_p->tsk_signature == TASK_SIGNATURE);
+
+    rtos_signal_p->sig_signature = SIGNAL_SIGNATURE;
+    rtos_signal_p->sig_waiter_task_p = waiter_task_p;
+    rtos_signal_p->sig_early_count = 0;
+}
+
+
+/**
+ * Makes the calling task the waiter task of a single-waiter signal, if the
+ * waiter task was not known yet. Signals sent before that are transferred
+ * to the task's built-in semaphore.
+ */
+static void rtos_signal_set_waiter(struct rtos_signal *rtos_signal_p)
+{
+    struct rtos_task *const task_p = rtos_task_self();
+    uint32_t early_count;
+
+    D_ASSERT(rtos_signal_p->sig_signature == SIGNAL_SIGNATURE);
+    if (rtos_signal_p->sig_waiter_task_p == task_p) {
+        return;
+    }
+
+    D_ASSERT(rtos_signal_p->sig_waiter_task_p == NULL);
+    uint32_t old_primask = disable_cpu_interrupts();
+    rtos_signal_p->sig_waiter_task_p = task_p;
+    early_count = rtos_signal_p->sig_early_count;
+    rtos_signal_p->sig_early_count = 0;
+    restore_cpu_interrupts(old_primask);
+
+    for ( ; early_count != 0; early_count --) {
+        rtos_task_semaphore_signal(task_p);
+    }
+}
+
+
+/**
+ * Waits on a single-waiter signal. It must always be called by the same
+ * task.
+ */
+void rtos_signal_wait(struct rtos_signal *rtos_signal_p)
+{
+    rtos_signal_set_waiter(rtos_signal_p);
+    rtos_task_semaphore_wait();
+}
+
+
+/**
+ * Waits on a single-waiter signal, with a timeout. It must always be called
+ * by the same task.
+ *
+ * @return true, if the signal was signaled
+ * @return false, if the wait timed out
+ */
+bool rtos_signal_wait_timeout(struct rtos_signal *rtos_signal_p,
+                              uint32_t timeout_ms)
+{
+    rtos_signal_set_waiter(rtos_signal_p);
+    return rtos_task_semaphore_wait_timeout(timeout_ms);
+}
+
+
+/**
+ * Signals a single-waiter signal. It can be called from a task or from an
+ * ISR.
+ */
+void rtos_signal_signal(struct rtos_signal *rtos_signal_p)
+{
+    struct rtos_task *task_p;
+
+    D_ASSERT(rtos_signal_p->sig_signature == SIGNAL_SIGNATURE);
+    task_p = rtos_signal_p->sig_waiter_task_p;
+    if (task_p == NULL) {
+        uint32_t old_primask = disable_cpu_interrupts();
+
+        task_p = rtos_signal_p->sig_waiter_task_p;
+        if (task_p == NULL) {
+            rtos_signal_p->sig_early_count ++;
+            restore_cpu_interrupts(old_primask);
+            return;
+        }
+
+        restore_cpu_interrupts(old_primask);
+    }
+
+    rtos_task_semaphore_signal(task_p);
+}
+
+
 /**
  * Initializes an RTOS-level timer
  */
@@ -521,48 +1058,44 @@ void rtos_task_check_stack(struct rtos_task *task_p)
     }
 }
 
-/**
- * Return Time since boot in ticks
+/*
+ *  Callbacks invoked from FreeRTOS
  */
-uint32_t rtos_get_ticks_since_boot(void)
-{
-    return xTaskGetTickCount();
-}
-
 
 /**
- * Return Time since boot in seconds
+ * Returns the CPU cycles the idle task has spent with the CPU sleeping,
+ * since boot. Unlike for uCOS-III, this does not include the few cycles
+ * the idle task runs between sleeps, as it is measured by the tickless idle
+ * hook, rather than at context switches.
  */
-uint32_t rtos_get_time_since_boot(void)
+uint64_t rtos_get_idle_task_cpu_cycles(void)
 {
-    return rtos_get_ticks_since_boot() / configTICK_RATE_HZ;
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint64_t cycles = g_rtos_idle_sleep_cpu_cycles;
+
+    restore_cpu_interrupts(old_primask);
+    return cycles;
 }
 
-/*
- *  Callbacks invoked from FreeRTOS
- */
 
 void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer,
 								   StackType_t **ppxIdleTaskStackBuffer,
 								   uint32_t *pulIdleTaskStackSize )
 {
-	static struct rtos_task idle_task;
+	struct rtos_task *const idle_task_p = &g_rtos_task_arena[RTOS_IDLE_TASK_INDEX];
 
-	*ppxIdleTaskTCBBuffer = &idle_task.tsk_tcb;
-	*ppxIdleTaskStackBuffer = idle_task.tsk_stack;
-	*pulIdleTaskStackSize =
-		sizeof(idle_task.tsk_stack) / sizeof(idle_task.tsk_stack[0]);
+	*ppxIdleTaskTCBBuffer = &idle_task_p->tsk_tcb;
+	*ppxIdleTaskStackBuffer = idle_task_p->tsk_stack;
+	*pulIdleTaskStackSize = ARRAY_SIZE(idle_task_p->tsk_stack);
 }
 
 void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer,
 		                            StackType_t **ppxTimerTaskStackBuffer,
 									uint32_t *pulTimerTaskStackSize)
 {
-	static struct rtos_task timer_task;
-
-	*ppxTimerTaskTCBBuffer = &timer_task.tsk_tcb;
-	*ppxTimerTaskStackBuffer = timer_task.tsk_stack;
-	*pulTimerTaskStackSize =
-		sizeof(timer_task.tsk_stack) / sizeof(timer_task.tsk_stack[0]);
+	struct rtos_task *const timer_task_p = &g_rtos_task_arena[RTOS_TIMER_TASK_INDEX];
 
+	*ppxTimerTaskTCBBuffer = &timer_task_p->tsk_tcb;
+	*ppxTimerTaskStackBuffer = timer_task_p->tsk_stack;
+	*pulTimerTaskStackSize = ARRAY_SIZE(timer_task_p->tsk_stack);
 }
@@ -46,9 +46,9 @@ struct serial_console {
      * Mutex to serialize access to the serial console from multiple tasks
      */
     struct rtos_mutex mutex;
-} __attribute__ ((aligned(2 * MPU_REGION_ALIGNMENT)));
+};
 
-static struct serial_console g_console = {
+static struct serial_console g_console MPU_PROTECTED_DATA(g_console) = {
     .initialized = false,
     .do_async_output = false,
     .current_attributes = CONSOLE_ATTR_NORMAL,
@@ -9,7 +9,116 @@
 #define SOURCES_BUILDING_BLOCKS_SYSTEM_CLOCKS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "runtime_checks.h"
+
+/**
+ * Flash access configuration
+ */
+struct flash_access_config {
+    /**
+     * Number of wait states for flash reads
+     */
+    uint8_t wait_states;
+
+    /**
+     * Flag indicating if the instruction prefetch buffer is enabled
+     */
+    bool prefetch_enabled;
+
+    /**
+     * Flag indicating if the flash instruction cache is enabled
+     */
+    bool instruction_cache_enabled;
+
+    /**
+     * Flag indicating if the flash data cache is enabled
+     */
+    bool data_cache_enabled;
+};
+
+/**
+ * Clock profiles
+ */
+enum clock_profiles {
+    /*
+     * Maximum CPU clock: SYSCLK from the PLL at MCU_CPU_CLOCK_FREQ_IN_HZ
+     */
+    CLOCK_PROFILE_PERFORMANCE = 0,
+
+    /*
+     * SYSCLK from the PLL at half of MCU_CPU_CLOCK_FREQ_IN_HZ. The APB1
+     * peripherals keep the same clock frequency as with
+     * CLOCK_PROFILE_PERFORMANCE.
+     */
+    CLOCK_PROFILE_BALANCED,
+
+    /*
+     * SYSCLK from the HSI oscillator, with the PLL off
+     */
+    CLOCK_PROFILE_LOW_POWER,
+
+    NUM_CLOCK_PROFILES
+};
+
+/**
+ * Clock frequencies for a clock profile
+ */
+struct clock_freqs {
+    /**
+     * CPU (HCLK) clock frequency
+     */
+    uint32_t cpu_clock_freq_in_hz;
+
+    /**
+     * APB1 peripheral clock frequency
+     */
+    uint32_t apb1_clock_freq_in_hz;
+
+    /**
+     * Clock frequency of the timers on APB1 (twice the APB1 clock, if the
+     * APB1 prescaler is not 1)
+     */
+    uint32_t apb1_timer_clock_freq_in_hz;
+
+    /**
+     * APB2 peripheral clock frequency
+     */
+    uint32_t apb2_clock_freq_in_hz;
+};
+
+struct clock_change_notifier;
+
+/**
+ * Signature of clock change notifier callbacks
+ */
+typedef void clock_change_callback_t(const struct clock_freqs *new_freqs_p,
+                                     void *arg);
+
+/**
+ * Clock change notifier, for drivers that need to re-time their
+ * peripherals when the clock profile changes
+ */
+struct clock_change_notifier {
+#   define CLOCK_CHANGE_NOTIFIER_SIGNATURE  GEN_SIGNATURE('C', 'L', 'K', 'N')
+    uint32_t signature;
+    clock_change_callback_t *callback_p;
+    void *callback_arg;
+    struct clock_change_notifier *next_p;
+};
 
 void system_clocks_init(void);
 
+void system_clocks_get_flash_config(struct flash_access_config *config_p);
+
+void system_clocks_set_profile(enum clock_profiles profile);
+
+enum clock_profiles system_clocks_get_profile(void);
+
+const struct clock_freqs *system_clocks_get_freqs(void);
+
+void clock_change_notifier_register(struct clock_change_notifier *notifier_p,
+                                    clock_change_callback_t *callback_p,
+                                    void *callback_arg);
+
 #endif /* SOURCES_BUILDING_BLOCKS_SYSTEM_CLOCKS_H_ */
@@ -9,6 +9,7 @@
 #include "runtime_checks.h"
 #include "microcontroller.h"
 #include "atomic_utils.h"
+#include "system_clocks.h"
 
 
 /**
@@ -91,7 +92,8 @@ uint32_t cpu_clock_cycles_diff(uint32_t begin_cycles, uint32_t end_cycles)
  */
 void delay_us(uint32_t us)
 {
-	uint32_t iterations_per_us = MCU_CPU_CLOCK_FREQ_IN_MHZ / 4;
+	uint32_t iterations_per_us =
+		system_clocks_get_freqs()->cpu_clock_freq_in_hz / 1000000 / 4;
 	register uint32_t n = us * iterations_per_us;
 
 	D_ASSERT(us < 1000);
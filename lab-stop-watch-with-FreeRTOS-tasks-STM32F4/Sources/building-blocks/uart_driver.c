@@ -12,6 +12,8 @@
 #include "mem_utils.h"
 #include "byte_ring_buffer.h"
 #include "interrupt_vector_table.h"
+#include "rtos_wrapper.h"
+#include "system_clocks.h"
 
 /**
  * Serial communication parameters for the serial port used as the console
@@ -19,6 +21,14 @@
  */
 #define UART_RECEIVE_QUEUE_SIZE_IN_BYTES    UINT16_C(16)
 
+/*
+ * Compile-time configuration options:
+ *
+ * UART_RX_ISR_TRUSTED: run the UART Rx ISR as a trusted ISR (see
+ * rtos_enter_trusted_isr()), as it runs once per byte received
+ */
+#define UART_RX_ISR_TRUSTED
+
 /**
  * Non-const fields of a UART device (to be placed in SRAM)
  */
@@ -31,6 +41,8 @@ struct uart_device_var {
     uint8_t urt_tx_fifo_size;
     uint8_t urt_rx_fifo_size;
     bool urt_fifos_enabled;
+    uint32_t urt_baud_rate;
+    struct clock_change_notifier urt_clock_change_notifier;
 };
 
 
@@ -65,7 +77,7 @@ const struct uart_device g_uart_devices[] =
 				      PIN_ALTERNATE_FUNCTION7),
         .urt_mmio_clock_gate_reg_p = &RCC->APB1ENR,
         .urt_mmio_clock_gate_mask = RCC_APB1ENR_USART2EN,
-	.urt_source_clock_freq_in_hz = APB1_CLOCK_FREQ_IN_HZ,
+	.urt_apb2_clocked = false,
         .urt_irq_num = USART2_IRQn,
     },
 };
@@ -78,48 +90,39 @@ static void uart_set_baud_rate(
     const struct uart_device *uart_device_p,
     uint32_t baud_rate)
 {
-    uint32_t reg_value;
-    uint8_t usartdiv_int_part;
-    uint16_t usartdiv_fraction_part;
+    const struct clock_freqs *freqs_p = system_clocks_get_freqs();
     USART_TypeDef *const uart_mmio_registers_p = uart_device_p->urt_mmio_regs_p;
+    uint32_t source_clock_freq_in_hz =
+        uart_device_p->urt_apb2_clocked ? freqs_p->apb2_clock_freq_in_hz
+                                        : freqs_p->apb1_clock_freq_in_hz;
 
-    D_ASSERT(baud_rate == 115200);
+    D_ASSERT(baud_rate != 0);
 
     /*
-     * Calculate values of BRR fields assuming oversampling of 16 (OVER8 == 0):
-     * (See section 30.4.4, table 190 of STM32F4xx reference manual)
+     * With oversampling of 16 (OVER8 == 0), USARTDIV = f / (16 * baud), and
+     * BRR holds USARTDIV in fixed point, with a 4-bit fraction. So, BRR is
+     * f / baud, rounded to the nearest integer.
+     * (See section 30.4.4 of STM32F4xx reference manual)
      */
-    if (uart_device_p->urt_source_clock_freq_in_hz == UINT32_C(42000000)) {
-	usartdiv_int_part = 22;
-	usartdiv_fraction_part = 8125;
-    } else if (uart_device_p->urt_source_clock_freq_in_hz == UINT32_C(84000000)) {
-	usartdiv_int_part = 45;
-	usartdiv_fraction_part = 5625;
-    } else {
-	D_ASSERT(false);
-    }
+    uint32_t brr_value = (source_clock_freq_in_hz + baud_rate / 2) / baud_rate;
 
-    D_ASSERT(usartdiv_fraction_part > 999 && usartdiv_fraction_part <= 9999);
-    uint16_t encoded_int_part = usartdiv_int_part;
-    uint8_t encoded_fraction_part = (16 * (uint32_t)usartdiv_fraction_part) / 10000;
-    if ((16 * (uint32_t)usartdiv_fraction_part) % 10000 > 5000) {
-        encoded_fraction_part++;
-    }
+    D_ASSERT(brr_value >= BIT(4) &&
+             brr_value <= (USART_BRR_DIV_Mantissa_Msk | USART_BRR_DIV_Fraction_Msk));
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->BRR, brr_value);
+}
 
-    if (encoded_fraction_part > 0xf) {
-	encoded_int_part += (encoded_fraction_part >> 4);
-	encoded_fraction_part &= 0xf;
-    }
 
-    D_ASSERT(encoded_int_part < BIT(12));
-    D_ASSERT(encoded_fraction_part < BIT(4));
+/**
+ * Clock change notifier callback for a UART. It recalculates the baud rate
+ * settings for the new peripheral clock frequency.
+ */
+static void uart_clock_change_callback(const struct clock_freqs *new_freqs_p,
+                                       void *arg)
+{
+    const struct uart_device *const uart_device_p = arg;
 
-    reg_value = 0;
-    SET_BIT_FIELD(reg_value, USART_BRR_DIV_Mantissa_Msk,
-	          USART_BRR_DIV_Mantissa_Pos, encoded_int_part);
-    SET_BIT_FIELD(reg_value, USART_BRR_DIV_Fraction_Msk,
-	          USART_BRR_DIV_Fraction_Pos, encoded_fraction_part);
-    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->BRR, reg_value);
+    D_ASSERT(uart_device_p->urt_signature == UART_DEVICE_SIGNATURE);
+    uart_set_baud_rate(uart_device_p, uart_device_p->urt_var_p->urt_baud_rate);
 }
 
 
@@ -139,6 +142,10 @@ void uart_init(
     D_ASSERT(uart_var_p != NULL);
     D_ASSERT(!uart_var_p->urt_initialized);
 
+    byte_ring_buffer_init(&uart_var_p->urt_receive_queue,
+                          uart_var_p->urt_receive_queue_data,
+                          sizeof uart_var_p->urt_receive_queue_data);
+
     /*
      * Only the default transmission mode is supported for now
      * (8-bit mode, no parity, 1 stop bit)
@@ -148,9 +155,8 @@ void uart_init(
     /*
      * Enable clock for the UART:
      */
-    reg_value = READ_MMIO_REGISTER(uart_device_p->urt_mmio_clock_gate_reg_p);
-    reg_value |= uart_device_p->urt_mmio_clock_gate_mask;
-    WRITE_MMIO_REGISTER(uart_device_p->urt_mmio_clock_gate_reg_p, reg_value);
+    bit_band_set_bit(uart_device_p->urt_mmio_clock_gate_reg_p,
+                     __builtin_ctz(uart_device_p->urt_mmio_clock_gate_mask));
 
     /*
      * Disable UART's transmitter and receiver, while UART is being
@@ -184,13 +190,25 @@ void uart_init(
     /*
     * Calculate baud rate settings:
     */
+    uart_var_p->urt_baud_rate = baud_rate;
     uart_set_baud_rate(uart_device_p, baud_rate);
+    clock_change_notifier_register(&uart_var_p->urt_clock_change_notifier,
+                                   uart_clock_change_callback,
+                                   (void *)uart_device_p);
+
+    /*
+     * Enable interrupts in the interrupt controller (NVIC):
+     */
+    NVIC_SetPriority(uart_device_p->urt_irq_num, UART_INTERRUPT_PRIORITY);
+    NVIC_ClearPendingIRQ(uart_device_p->urt_irq_num);
+    NVIC_EnableIRQ(uart_device_p->urt_irq_num);
 
     /*
-     * Enable UART's transmitter and receiver:
+     * Enable UART's transmitter and receiver, and the receive interrupt.
+     * The RXNE interrupt is also raised for the overrun (ORE) condition:
      */
     reg_value = uart_mmio_registers_p->CR1;
-    reg_value |= USART_CR1_UE;
+    reg_value |= (USART_CR1_UE | USART_CR1_RXNEIE);
     uart_mmio_registers_p->CR1 = reg_value;
 
     uart_var_p->urt_initialized = true;
@@ -225,6 +243,22 @@ void uart_putchar(const struct uart_device *uart_device_p, uint8_t c)
 }
 
 
+/**
+ * Receive a character from a UART serial port, blocking the caller until
+ * a character is received.
+ *
+ * @return: byte received
+ */
+uint8_t uart_getchar(const struct uart_device *uart_device_p)
+{
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+
+    D_ASSERT(uart_var_p->urt_initialized);
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+    return byte_ring_buffer_read(&uart_var_p->urt_receive_queue);
+}
+
+
 /**
  * Reads the next character received on the console UART, if any.
  *
@@ -255,3 +289,73 @@ int uart_getchar_non_blocking(const struct uart_device *uart_device_p)
         return -1;
     }
 }
+
+
+/**
+ * Handles the receive interrupt of a UART.
+ *
+ * The STM32F4 USART has no receive FIFO, only a one-byte data register, so
+ * a byte must be drained on every RXNE interrupt. If a byte arrives before
+ * the previous one was read, ORE is set and the new byte is lost. Reading
+ * SR followed by DR clears RXNE, ORE, NE and FE.
+ */
+static void uart_rx_irq_handler(const struct uart_device *uart_device_p)
+{
+    uint32_t status;
+    uint8_t byte_received;
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    USART_TypeDef *uart_mmio_registers_p = uart_device_p->urt_mmio_regs_p;
+
+    D_ASSERT(uart_var_p != NULL);
+    D_ASSERT(uart_var_p->urt_initialized);
+
+    status = READ_MMIO_REGISTER(&uart_mmio_registers_p->SR);
+    if ((status & (USART_SR_RXNE | USART_SR_ORE)) == 0) {
+        return;
+    }
+
+    byte_received = READ_MMIO_REGISTER(&uart_mmio_registers_p->DR);
+
+    if (status & USART_SR_ORE) {
+        /*
+         * The byte in DR is still valid, but at least one byte after it
+         * was lost:
+         */
+        uart_var_p->urt_errors ++;
+        uart_var_p->urt_received_bytes_dropped ++;
+    }
+
+    if (status & (USART_SR_NE | USART_SR_FE)) {
+        /*
+         * Discard the byte, as it was received with noise or a framing
+         * error:
+         */
+        uart_var_p->urt_errors ++;
+        uart_var_p->urt_received_bytes_dropped ++;
+        return;
+    }
+
+    if (!byte_ring_buffer_write_non_blocking(&uart_var_p->urt_receive_queue,
+                                             byte_received)) {
+        uart_var_p->urt_received_bytes_dropped ++;
+    }
+}
+
+
+/**
+ * USART2 interrupt handler
+ */
+void usart2_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+#   ifdef UART_RX_ISR_TRUSTED
+    rtos_enter_trusted_isr();
+    uart_rx_irq_handler(&g_uart_devices[0]);
+    rtos_exit_trusted_isr();
+#   else
+    rtos_enter_isr();
+    uart_rx_irq_handler(&g_uart_devices[0]);
+    rtos_exit_isr();
+#   endif
+}
@@ -9,6 +9,7 @@
 #define SOURCES_BUILDING_BLOCKS_UART_DRIVER_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "runtime_checks.h"
 #include "microcontroller.h"
 #include "pin_config.h"
@@ -30,7 +31,7 @@ struct uart_device {
     struct pin_info urt_rx_pin;
     volatile uint32_t *urt_mmio_clock_gate_reg_p;
     uint32_t urt_mmio_clock_gate_mask;
-    uint32_t urt_source_clock_freq_in_hz;
+    bool urt_apb2_clocked; /* clocked by APB2 instead of APB1 */
     IRQn_Type urt_irq_num;
 };
 
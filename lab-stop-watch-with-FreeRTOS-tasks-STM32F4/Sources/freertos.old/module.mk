@@ -6,7 +6,6 @@
 
 local_src := $(subdirectory)/croutine.c \
              $(subdirectory)/event_groups.c \
-             $(subdirectory)/heap_4.c \
              $(subdirectory)/list.c \
              $(subdirectory)/queue.c \
              $(subdirectory)/tasks.c \
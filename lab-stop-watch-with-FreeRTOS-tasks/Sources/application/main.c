@@ -11,8 +11,8 @@
 #include <building-blocks/compile_time_checks.h>
 #include <building-blocks/rtos_wrapper.h>
 #include <building-blocks/memory_protection_unit.h>
+#include <building-blocks/button_input.h>
 #include <stddef.h>
-#include <ctype.h>
 
 //???
 #include "fsl_debug_console.h"
@@ -20,18 +20,11 @@
 #include "pin_mux.h"
 //???
 
-/**
- * stopwatch buttons polling period in milliseconds
- */
-#define POLL_STOPWATCH_BUTTONS_PERIOD_MS	10
-
 /**
  * stopwatch update period in milliseconds
  */
 #define UPDATE_STOPWATCH_PERIOD_MS	100
 
-C_ASSERT(UPDATE_STOPWATCH_PERIOD_MS % POLL_STOPWATCH_BUTTONS_PERIOD_MS == 0);
-
 /*
  * Bit masks for updating stopwatch display cells:
  */
@@ -48,6 +41,17 @@ struct stopwatch {
 	uint8_t seconds;
 	uint16_t milliseconds;
 	volatile bool running;
+
+	/**
+	 * RTOS tick count when the stopwatch was last started
+	 */
+	uint32_t start_ticks;
+
+	/**
+	 * Ticks accumulated in previous runs, before the stopwatch was last
+	 * stopped
+	 */
+	uint32_t accumulated_ticks;
 };
 
 static struct stopwatch g_stopwatch = {
@@ -109,6 +113,7 @@ static void reset_stopwatch(void)
     g_stopwatch.minutes = 0;
 	g_stopwatch.seconds = 0;
 	g_stopwatch.milliseconds = 0;
+	g_stopwatch.accumulated_ticks = 0;
     restore_private_data_region(&old_region);
 }
 
@@ -132,33 +137,40 @@ static void init_stopwatch(void)
 
 /**
  * Reads the stopwatch buttons.
- * For the purpose of this lab, we will be using  serial console input to simulate
- * input from the stop watch buttons. Pressing the 'R' key on the serial console
- * will represent pressing the stopwatch 'restart button'. Pressing the 'S' key
- * will represent pressing the stopwatch 'start/stop button'.
- *
- * @pre: This function is expected to run every 10 milliseconds.
+ * It blocks the calling task until a button press event is received from the
+ * button input service. Pressing SW2 represents pressing the stopwatch
+ * 'start/stop button' and pressing SW3 represents pressing the stopwatch
+ * 'restart button'. Start and stop times are the times at which the button
+ * presses were detected, not the times at which this function gets to run.
  */
 static void read_stopwatch_buttons(void)
 {
-	int c;
+	struct button_input_event event;
 	struct mpu_region_descriptor old_region;
 
-	c = console_getchar_non_blocking();
-	c = tolower(c);
+	button_input_wait_event(&event);
     set_private_data_region(&g_stopwatch, sizeof(g_stopwatch), READ_WRITE, &old_region);
-	if (c == 's' || c == ' ') {
-		g_stopwatch.running = !g_stopwatch.running;
-	} else if (c == 'r') {
+	if (event.button == BUTTON_INPUT_SW2) {
+		if (g_stopwatch.running) {
+			g_stopwatch.accumulated_ticks +=
+				RTOS_TICKS_DELTA(g_stopwatch.start_ticks, event.timestamp_ticks);
+			g_stopwatch.running = false;
+		} else {
+			g_stopwatch.start_ticks = event.timestamp_ticks;
+			g_stopwatch.running = true;
+		}
+	} else if (event.button == BUTTON_INPUT_SW3) {
 		reset_stopwatch();
 	    update_stopwatch_display(HOURS_CHANGED_MASK | MINUTES_CHANGED_MASK | SECONDS_CHANGED_MASK);
+		g_stopwatch.start_ticks = event.timestamp_ticks;
 		g_stopwatch.running = true;
 	}
     restore_private_data_region(&old_region);
 }
 
 /**
- * Increment the stopwatch counters and updates the stopwatch display accordingly.
+ * Computes the stopwatch's elapsed time from the RTOS tick count and updates
+ * the stopwatch display accordingly.
  *
  * @pre: This function is expected to run every 100 milliseconds.
  */
@@ -168,34 +180,41 @@ static void update_stopwatch(void)
 	struct mpu_region_descriptor old_region;
 
 	D_ASSERT(g_stopwatch.running);
+
+	uint32_t elapsed_ms = (g_stopwatch.accumulated_ticks +
+	                       RTOS_TICKS_DELTA(g_stopwatch.start_ticks,
+	                                        rtos_get_ticks_since_boot())) *
+	                      MS_PER_TIMER_TICK;
+	uint32_t total_seconds = elapsed_ms / 1000;
+	uint8_t seconds = total_seconds % 60;
+	uint8_t minutes = (total_seconds / 60) % 60;
+	uint8_t hours = (total_seconds / 3600) % 100;
+
     set_private_data_region(&g_stopwatch, sizeof(g_stopwatch), READ_WRITE, &old_region);
-    g_stopwatch.milliseconds += 100;
-    if (g_stopwatch.milliseconds == 1000) {
-        g_stopwatch.milliseconds = 0;
+	if (seconds != g_stopwatch.seconds) {
         update_mask |= SECONDS_CHANGED_MASK;
-        g_stopwatch.seconds ++;
-        if (g_stopwatch.seconds == 60) {
-            g_stopwatch.seconds = 0;
-            update_mask |= MINUTES_CHANGED_MASK;
-			g_stopwatch.minutes ++;
-			if (g_stopwatch.minutes == 60) {
-                g_stopwatch.minutes = 0;
-				update_mask |= HOURS_CHANGED_MASK;
-				g_stopwatch.hours ++;
-				if (g_stopwatch.hours == 100) {
-					g_stopwatch.hours = 0;
-				}
-			}
-		}
 	}
 
+	if (minutes != g_stopwatch.minutes) {
+        update_mask |= MINUTES_CHANGED_MASK;
+	}
+
+	if (hours != g_stopwatch.hours) {
+        update_mask |= HOURS_CHANGED_MASK;
+	}
+
+	g_stopwatch.milliseconds = (uint16_t)(elapsed_ms % 1000);
+	g_stopwatch.seconds = seconds;
+	g_stopwatch.minutes = minutes;
+	g_stopwatch.hours = hours;
     restore_private_data_region(&old_region);
 	update_stopwatch_display(update_mask);
 }
 
 
 /**
- * Task function to read the stop watch buttons periodically
+ * Task function to read the stop watch buttons. It only runs when a button
+ * is pressed.
  */
 static void stop_watch_buttons_reader_task_func(void *arg)
 {
@@ -203,7 +222,6 @@ static void stop_watch_buttons_reader_task_func(void *arg)
 
     for ( ; ; ) {
     	read_stopwatch_buttons();
-        rtos_task_delay(POLL_STOPWATCH_BUTTONS_PERIOD_MS);
     }
 }
 
@@ -239,18 +257,19 @@ int main(void)
 	pin_config_init();
 #else
 	BOARD_InitPins();
-	BOARD_InitDebugConsole();
+	pin_config_init();
     mpu_enable();
 #endif
 
 	console_init(&g_console_task);
+	button_input_init();
 
 	/*
 	 * Display greeting:
 	 */
 	console_clear();
 	console_printf("Stop Watch with FreeRTOS tasks  (built " __DATE__ " " __TIME__ ")\n"
-	    	       "Buttons: s or <space> - start/stop    r - reset\n");
+	    	       "Buttons: SW2 - start/stop    SW3 - reset\n");
 
 	init_stopwatch();
 
@@ -20,6 +20,7 @@ endif
 
 BASE_DIR := $(dir $(CURDIR))
 SOURCE_DIR := $(BASE_DIR)Sources
+SHARED_DIR := $(abspath $(BASE_DIR)..)
 GIT_COMMIT := $(shell git describe --always --dirty)
 
 #
@@ -83,9 +84,10 @@ source-to-object = $(subst .c,.o,$(filter %.c,$1)) \
 		   $(subst .s,.o,$(filter %.s,$1))
 
 # $(subdirectory)
-subdirectory = $(patsubst $(SOURCE_DIR)/%/module.mk,%,	\
-		 $(word					\
-		   $(words $(MAKEFILE_LIST)),$(MAKEFILE_LIST)))
+subdirectory = $(patsubst $(SHARED_DIR)/%/module.mk,%,	\
+		 $(patsubst $(SOURCE_DIR)/%/module.mk,%,	\
+		   $(word					\
+		     $(words $(MAKEFILE_LIST)),$(MAKEFILE_LIST))))
 
 # $(call make-library, library-name, source-file-list)
 define make-library
@@ -101,6 +103,13 @@ modules      := building-blocks \
 		sdk \
 		application
 
+#
+# NOTE: shared modules live in $(SHARED_DIR), outside of this lab, and
+# must be included before the application module, which links all the
+# libraries
+#
+shared_modules := shared-building-blocks
+
 #
 # NOTE: 'programs' is populated by included
 # Applications/*/module.mk makefiles
@@ -127,6 +136,8 @@ bin_files = 	$(subst .elf,.bin,$(programs))
 lst_files = 	$(subst .elf,.lst,$(programs))
 
 include_dirs := $(SOURCE_DIR) \
+	        $(SOURCE_DIR)/building-blocks \
+	        $(SHARED_DIR)/shared-building-blocks \
 	        $(SOURCE_DIR)/application \
 	        $(SOURCE_DIR)/freertos \
 	        $(SOURCE_DIR)/freertos/portable \
@@ -185,7 +196,7 @@ LDFLAGS = 	$(MCFLAGS) -nostartfiles -T$(LDSCRIPT) \
 		#-nostdlib -v
 
 vpath %.h $(include_dirs)
-vpath %.c $(SOURCE_DIR)
+vpath %.c $(SOURCE_DIR) $(SHARED_DIR)
 vpath %.s $(SOURCE_DIR)
 
 MKDIR := mkdir -p
@@ -195,13 +206,14 @@ SED   := sed
 TEST  := test
 
 create-output-directories :=				\
-	$(shell for f in $(modules);			\
+	$(shell for f in $(modules) $(shared_modules);	\
 		do					\
 		  $(TEST) -d $$f || $(MKDIR) $$f;	\
 		done)
 
 all:
 
+include $(patsubst %,$(SHARED_DIR)/%/module.mk,$(shared_modules))
 include $(patsubst %,$(SOURCE_DIR)/%/module.mk,$(modules))
 
 .PHONY: all
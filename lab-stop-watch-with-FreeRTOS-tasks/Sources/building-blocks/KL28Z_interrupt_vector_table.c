@@ -108,7 +108,11 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     /*
      * Interrupts external to the Cortex-M core
      */
+#ifdef UART_TX_USE_DMA
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA0_04_IRQn)] = lpuart0_tx_dma_irq_handler,
+#else
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA0_04_IRQn)] = unexpected_irq_handler,
+#endif
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA0_15_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA0_26_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA0_37_IRQn)] = unexpected_irq_handler,
@@ -120,16 +124,16 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LPIT0_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LPSPI0_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LPSPI1_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(LPUART0_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(LPUART0_IRQn)] = lpuart0_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LPUART1_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LPI2C0_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LPI2C1_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(Reserved32_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(PORTA_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(PORTA_IRQn)] = porta_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(PORTB_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(PORTC_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(PORTD_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(PORTE_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(PORTE_IRQn)] = porte_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LLWU0_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(I2S0_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(USB0_IRQn)] = unexpected_irq_handler,
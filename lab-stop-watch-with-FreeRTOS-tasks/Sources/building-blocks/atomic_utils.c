@@ -9,6 +9,7 @@
 #include "microcontroller.h"
 #include "runtime_checks.h"
 #include "time_utils.h"
+#include "io_utils.h"
 
 /**
  * Interrupts disabled stats variables
@@ -98,6 +99,39 @@ restore_cpu_interrupts(uint32_t old_primask)
     *code_addr = g_interrupts_disabled_stats.longest_interrupts_disabled_code_addr;
  }
 
+#if (__CORTEX_M < 0x03)
+/**
+ * Enters the critical section of an atomic primitive on Cortex-M0/M0+, which
+ * lacks exclusive-access instructions (and the KL28Z has no SEMA42 hardware
+ * semaphore). Unlike disable_cpu_interrupts(), it is inlined and does no
+ * interrupts-disabled accounting, as the critical section is only a
+ * load-modify-store. No ISB is needed, as CPSID takes effect on the next
+ * instruction.
+ *
+ * @return  Original value of the CPU PRIMASK register
+ */
+static inline uint32_t atomic_section_enter(void)
+{
+    uint32_t old_primask = __get_PRIMASK();
+
+    __disable_irq();
+    return old_primask;
+}
+
+
+/**
+ * Leaves the critical section of an atomic primitive, restoring PRIMASK to
+ * the value it had before atomic_section_enter(), so that atomic primitives
+ * can also be used with interrupts already disabled
+ *
+ * @param   old_primask: Value returned by atomic_section_enter()
+ */
+static inline void atomic_section_exit(uint32_t old_primask)
+{
+    __set_PRIMASK(old_primask);
+}
+#endif
+
 
 /**
  * Increments atomically the 32-bit value stored in *counter_p, and returns the
@@ -121,12 +155,12 @@ atomic_fetch_add_uint32(volatile uint32_t *counter_p, uint32_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint32_t old_value = *counter_p;
 
     *counter_p += value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
@@ -154,12 +188,12 @@ atomic_fetch_sub_uint32(volatile uint32_t *counter_p, uint32_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint32_t old_value = *counter_p;
 
     *counter_p -= value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
@@ -187,12 +221,12 @@ atomic_fetch_and_uint32(volatile uint32_t *counter_p, uint32_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint32_t old_value = *counter_p;
 
     *counter_p &= value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
@@ -220,12 +254,12 @@ atomic_fetch_or_uint32(volatile uint32_t *counter_p, uint32_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint32_t old_value = *counter_p;
 
     *counter_p |= value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
@@ -253,17 +287,101 @@ atomic_fetch_xor_uint32(volatile uint32_t *counter_p, uint32_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint32_t old_value = *counter_p;
 
     *counter_p ^= value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
 
 
+/**
+ * Atomically replaces the 32-bit value stored in *value_p with 'new_value',
+ * if it is equal to 'old_value'.
+ *
+ * @param   value_p: Pointer to the value to be updated.
+ *
+ * @param   old_value: Expected current value.
+ *
+ * @param   new_value: Value to be stored.
+ *
+ * @return  true, if the value was replaced
+ * @return  false, if the current value was not 'old_value'
+ */
+bool
+atomic_compare_and_swap_uint32(volatile uint32_t *value_p,
+                               uint32_t old_value,
+                               uint32_t new_value)
+{
+#if (__CORTEX_M >= 0x03)
+    do {
+        if (__LDREXW(value_p) != old_value) {
+            __CLREX();
+            return false;
+        }
+    } while (__STREXW(new_value, value_p) != 0);
+
+    return true;
+#else
+    bool swapped = false;
+    uint32_t old_primask = atomic_section_enter();
+
+    if (*value_p == old_value) {
+        *value_p = new_value;
+        swapped = true;
+    }
+
+    atomic_section_exit(old_primask);
+    return swapped;
+#endif
+}
+
+
+/**
+ * Atomically sets a bit in a 32-bit bit vector
+ *
+ * @param   bit_vector_p: Pointer to the bit vector.
+ *
+ * @param   bit_index: Index of the bit to set.
+ *
+ * @return  true, if the bit was clear before
+ * @return  false, if the bit was already set
+ */
+bool
+atomic_test_and_set_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index)
+{
+    D_ASSERT(bit_index < 32);
+
+    uint32_t old_value = atomic_fetch_or_uint32(bit_vector_p, BIT(bit_index));
+
+    return (old_value & BIT(bit_index)) == 0;
+}
+
+
+/**
+ * Atomically clears a bit in a 32-bit bit vector
+ *
+ * @param   bit_vector_p: Pointer to the bit vector.
+ *
+ * @param   bit_index: Index of the bit to clear.
+ *
+ * @return  true, if the bit was set before
+ * @return  false, if the bit was already clear
+ */
+bool
+atomic_test_and_clear_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index)
+{
+    D_ASSERT(bit_index < 32);
+
+    uint32_t old_value = atomic_fetch_and_uint32(bit_vector_p, ~BIT(bit_index));
+
+    return (old_value & BIT(bit_index)) != 0;
+}
+
+
 /**
  * Increments atomically the 16-bit value stored in *counter_p, and returns the
  * original value.
@@ -286,12 +404,12 @@ atomic_fetch_add_uint16(volatile uint16_t *counter_p, uint16_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint16_t old_value = *counter_p;
 
     *counter_p += value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
@@ -319,12 +437,12 @@ atomic_fetch_sub_uint16(volatile uint16_t *counter_p, uint16_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint16_t old_value = *counter_p;
 
     *counter_p -= value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
@@ -352,12 +470,12 @@ atomic_fetch_add_uint8(volatile uint8_t *counter_p, uint8_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint8_t old_value = *counter_p;
 
     *counter_p += value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
@@ -385,12 +503,12 @@ atomic_fetch_sub_uint8(volatile uint8_t *counter_p, uint8_t value)
 
     return old_value;
 #else
-    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_primask = atomic_section_enter();
     uint8_t old_value = *counter_p;
 
     *counter_p -= value;
 
-    restore_cpu_interrupts(old_primask);
+    atomic_section_exit(old_primask);
     return old_value;
 #endif
 }
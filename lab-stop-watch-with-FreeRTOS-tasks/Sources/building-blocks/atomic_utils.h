@@ -9,6 +9,7 @@
 #define SOURCES_BUILDING_BLOCKS_ATOMIC_UTILS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "compile_time_checks.h"
 
 #define ATOMIC_POST_INCREMENT_UINT32(_counter_p) \
@@ -51,6 +52,14 @@ uint32_t atomic_fetch_or_uint32(volatile uint32_t *counter_p, uint32_t value);
 
 uint32_t atomic_fetch_xor_uint32(volatile uint32_t *counter_p, uint32_t value);
 
+bool atomic_compare_and_swap_uint32(volatile uint32_t *value_p,
+                                    uint32_t old_value,
+                                    uint32_t new_value);
+
+bool atomic_test_and_set_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index);
+
+bool atomic_test_and_clear_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index);
+
 uint16_t atomic_fetch_add_uint16(volatile uint16_t *counter_p, uint16_t value);
 
 uint16_t atomic_fetch_sub_uint16(volatile uint16_t *counter_p, uint16_t value);
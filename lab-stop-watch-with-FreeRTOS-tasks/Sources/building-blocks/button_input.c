@@ -0,0 +1,305 @@
+/**
+ * @file button_input.c
+ *
+ * Push button input service implementation
+ *
+ * @author German Rivera
+ */
+#include "button_input.h"
+#include "gpio_driver.h"
+#include "pin_config.h"
+#include "rtos_wrapper.h"
+#include "atomic_utils.h"
+#include "mem_utils.h"
+#include "runtime_checks.h"
+#include "memory_protection_unit.h"
+#include "interrupt_vector_table.h"
+
+/**
+ * Const fields of a push button (to be placed in flash)
+ */
+struct button_input_button {
+    const char *name_p;
+
+    /**
+     * GPIO input pin the button is connected to
+     */
+    struct gpio_pin pin;
+
+    /**
+     * IRQ number for the pin port of the button
+     */
+    IRQn_Type irq_number;
+};
+
+/**
+ * Push buttons of the FRDM-KL28Z board. They are active low.
+ */
+static const struct button_input_button g_buttons[] = {
+    [BUTTON_INPUT_SW2] = {
+        .name_p = "SW2",
+        .pin = GPIO_PIN_INITIALIZER(PIN_PORT_A, 4, PIN_FUNCTION_ALT1, false),
+        .irq_number = PORTA_IRQn,
+    },
+
+    [BUTTON_INPUT_SW3] = {
+        .name_p = "SW3",
+        .pin = GPIO_PIN_INITIALIZER(PIN_PORT_E, 4, PIN_FUNCTION_ALT1, false),
+        .irq_number = PORTE_IRQn,
+    },
+};
+
+C_ASSERT(ARRAY_SIZE(g_buttons) == BUTTON_INPUT_NUM_BUTTONS);
+
+/**
+ * State variables of the button input service
+ */
+struct button_input {
+    bool initialized;
+
+    /**
+     * One-shot debounce timer for each button
+     */
+    struct rtos_timer debounce_timers[BUTTON_INPUT_NUM_BUTTONS];
+
+    /**
+     * Circular queue of button press events. Entry
+     * (index % BUTTON_INPUT_EVENT_QUEUE_SIZE) is the next entry to fill for
+     * write_index, or the next entry to consume for read_index.
+     */
+    struct button_input_event events[BUTTON_INPUT_EVENT_QUEUE_SIZE];
+    uint32_t write_index;
+    uint32_t read_index;
+
+    /**
+     * Semaphore signaled when an event is queued. As it is a binary
+     * semaphore, several events may be queued per signal.
+     */
+    struct rtos_semaphore events_semaphore;
+
+    /**
+     * Number of button presses not queued because the queue was full
+     */
+    uint32_t dropped_events_count;
+};
+
+static struct button_input g_button_input;
+
+
+/**
+ * Returns the pin interrupt type that detects presses of a button
+ */
+static enum gpio_pin_irq_type button_input_press_irq_type(
+    const struct button_input_button *button_p)
+{
+    return button_p->pin.pin_is_active_high ? GPIO_PIN_IRQ_ON_RISING_EDGE :
+                                              GPIO_PIN_IRQ_ON_FALLING_EDGE;
+}
+
+
+/**
+ * Tells if a button is currently pressed
+ */
+static bool button_input_is_pressed(const struct button_input_button *button_p)
+{
+    return gpio_read_input_pin(&button_p->pin) ==
+           (bool)button_p->pin.pin_is_active_high;
+}
+
+
+/**
+ * Callback of the debounce timer of a button. It runs in the RTOS timer
+ * task. The button's pin interrupt is only re-enabled once the button is
+ * seen released, so that holding a button down is reported as one press,
+ * and the bounce of its contacts is not reported at all.
+ */
+static void button_input_debounce_timer_callback(struct rtos_timer *rtos_timer_p,
+                                                 void *arg)
+{
+    const struct button_input_button *button_p = arg;
+
+    if (button_input_is_pressed(button_p)) {
+        rtos_timer_start(rtos_timer_p);
+        return;
+    }
+
+    gpio_enable_pin_irq(&button_p->pin, button_input_press_irq_type(button_p));
+}
+
+
+/**
+ * Queues a button press event and wakes up the consumer
+ *
+ * NOTE: This function must be called from the pin port ISR.
+ */
+static void button_input_queue_event(enum button_input_buttons button,
+                                     uint32_t timestamp_ticks)
+{
+    struct button_input *const button_input_p = &g_button_input;
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (button_input_p->write_index - button_input_p->read_index ==
+        BUTTON_INPUT_EVENT_QUEUE_SIZE) {
+        button_input_p->dropped_events_count ++;
+        restore_cpu_interrupts(int_mask);
+        return;
+    }
+
+    struct button_input_event *event_p =
+        &button_input_p->events[button_input_p->write_index &
+                                (BUTTON_INPUT_EVENT_QUEUE_SIZE - 1)];
+
+    event_p->button = button;
+    event_p->timestamp_ticks = timestamp_ticks;
+    button_input_p->write_index ++;
+    restore_cpu_interrupts(int_mask);
+
+    rtos_semaphore_signal(&button_input_p->events_semaphore);
+}
+
+
+/**
+ * Common ISR for the pin ports the buttons are connected to. A press is
+ * reported on its first edge; the button's pin interrupt is then disabled
+ * until the debounce timer sees the button released.
+ *
+ * @param pin_port  pin port whose interrupt fired
+ */
+static void button_input_port_irq_handler(pin_port_t pin_port)
+{
+    struct button_input *const button_input_p = &g_button_input;
+
+    rtos_enter_isr();
+
+    bool old_writable = set_writable_background_region(true);
+    uint32_t timestamp_ticks = rtos_get_ticks_since_boot();
+    uint32_t reg_value = READ_MMIO_REGISTER(&g_pin_port_regs[pin_port]->ISFR);
+
+    D_ASSERT(button_input_p->initialized);
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_buttons); i ++) {
+        const struct gpio_pin *pin_p = &g_buttons[i].pin;
+
+        if (pin_p->pin_info.pin_port != pin_port ||
+            (reg_value & pin_p->pin_bit_mask) == 0) {
+            continue;
+        }
+
+        gpio_disable_pin_irq(pin_p);
+        gpio_clear_pin_irq(pin_p);
+        button_input_queue_event((enum button_input_buttons)i, timestamp_ticks);
+        rtos_timer_start(&button_input_p->debounce_timers[i]);
+    }
+
+    (void)set_writable_background_region(old_writable);
+    rtos_exit_isr();
+}
+
+
+/**
+ * ISR for the PORTA pin interrupts
+ */
+void porta_irq_handler(void)
+{
+    button_input_port_irq_handler(PIN_PORT_A);
+}
+
+
+/**
+ * ISR for the PORTE pin interrupts
+ */
+void porte_irq_handler(void)
+{
+    button_input_port_irq_handler(PIN_PORT_E);
+}
+
+
+/**
+ * Initializes the button input service. The clocks of the pin ports must
+ * have been enabled by pin_config_init().
+ */
+void button_input_init(void)
+{
+    struct button_input *const button_input_p = &g_button_input;
+    bool old_writable = set_writable_background_region(true);
+
+    D_ASSERT(!button_input_p->initialized);
+    button_input_p->write_index = 0;
+    button_input_p->read_index = 0;
+    button_input_p->dropped_events_count = 0;
+    rtos_semaphore_init(&button_input_p->events_semaphore,
+                        "button events semaphore", 0);
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_buttons); i ++) {
+        const struct button_input_button *button_p = &g_buttons[i];
+
+        /*
+         * Button pins need the pull-up resistor, as the buttons connect
+         * them to ground when pressed. The passive input filter removes
+         * glitches shorter than the switch bounce:
+         */
+        gpio_configure_pin(&button_p->pin,
+                           PORT_PCR_PE_MASK | PORT_PCR_PS_MASK | PORT_PCR_PFE_MASK,
+                           false);
+        rtos_timer_init(&button_input_p->debounce_timers[i],
+                        button_p->name_p,
+                        BUTTON_INPUT_DEBOUNCE_MS,
+                        false,
+                        button_input_debounce_timer_callback,
+                        (void *)button_p);
+        gpio_enable_pin_irq(&button_p->pin, button_input_press_irq_type(button_p));
+    }
+
+    button_input_p->initialized = true;
+    (void)set_writable_background_region(old_writable);
+
+    /*
+     * Enable the pin port interrupts in the interrupt controller (NVIC):
+     */
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_buttons); i ++) {
+        IRQn_Type irq_number = g_buttons[i].irq_number;
+
+        NVIC_SetPriority(irq_number, GPIO_PIN_INTERRUPT_PRIORITY);
+        NVIC_ClearPendingIRQ(irq_number);
+        NVIC_EnableIRQ(irq_number);
+    }
+}
+
+
+/**
+ * Waits for the next button press event
+ *
+ * @param event_p   Area where the event is returned
+ */
+void button_input_wait_event(struct button_input_event *event_p)
+{
+    struct button_input *const button_input_p = &g_button_input;
+
+    D_ASSERT(button_input_p->initialized);
+    for ( ; ; ) {
+        bool old_writable = set_writable_background_region(true);
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        if (button_input_p->read_index != button_input_p->write_index) {
+            *event_p = button_input_p->events[button_input_p->read_index &
+                                              (BUTTON_INPUT_EVENT_QUEUE_SIZE - 1)];
+            button_input_p->read_index ++;
+            restore_cpu_interrupts(int_mask);
+            (void)set_writable_background_region(old_writable);
+            break;
+        }
+
+        restore_cpu_interrupts(int_mask);
+        (void)set_writable_background_region(old_writable);
+        rtos_semaphore_wait(&button_input_p->events_semaphore);
+    }
+}
+
+
+/**
+ * Returns the number of button presses dropped because the event queue was
+ * full
+ */
+uint32_t button_input_get_dropped_events_count(void)
+{
+    return g_button_input.dropped_events_count;
+}
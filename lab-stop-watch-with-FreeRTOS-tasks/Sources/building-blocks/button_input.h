@@ -0,0 +1,65 @@
+/**
+ * @file button_input.h
+ *
+ * Push button input service interface
+ *
+ * Button presses are detected by GPIO pin interrupts, instead of polling.
+ * After each press, the button's pin interrupt stays disabled until a
+ * debounce timer sees the button released, so that contact bounce on press
+ * or on release is not reported as additional presses. Each press is queued
+ * with the time at which its first edge was seen, so the consumer reacts to
+ * the exact edge time even if it runs later.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_BUTTON_INPUT_H_
+#define SOURCES_BUILDING_BLOCKS_BUTTON_INPUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compile_time_checks.h"
+
+/**
+ * Debounce interval in milliseconds: a button is sampled this long after a
+ * press is detected, and then every interval, until it is seen released
+ */
+#define BUTTON_INPUT_DEBOUNCE_MS            20
+
+/**
+ * Number of entries of the button press event queue (must be a power of 2)
+ */
+#define BUTTON_INPUT_EVENT_QUEUE_SIZE       8
+
+C_ASSERT((BUTTON_INPUT_EVENT_QUEUE_SIZE & (BUTTON_INPUT_EVENT_QUEUE_SIZE - 1)) == 0);
+
+/**
+ * Push buttons of the board
+ */
+enum button_input_buttons {
+    BUTTON_INPUT_SW2 = 0,
+    BUTTON_INPUT_SW3,
+    BUTTON_INPUT_NUM_BUTTONS
+};
+
+/**
+ * Button press event
+ */
+struct button_input_event {
+    /**
+     * Button pressed
+     */
+    enum button_input_buttons button;
+
+    /**
+     * RTOS tick count when the press was detected
+     */
+    uint32_t timestamp_ticks;
+};
+
+void button_input_init(void);
+
+void button_input_wait_event(struct button_input_event *event_p);
+
+uint32_t button_input_get_dropped_events_count(void);
+
+#endif /* SOURCES_BUILDING_BLOCKS_BUTTON_INPUT_H_ */
@@ -1,7 +1,8 @@
 /**
  * @file event_set.c
  *
- * Primitives to atomically add and remove events to an event set
+ * Primitives to atomically add and remove events to an event set, and to
+ * block a task until events are added to it
  *
  * @author: German Rivera
  */
@@ -16,6 +17,8 @@
 void init_event_set(struct event_set *event_set_p)
 {
     event_set_p->elements = 0x0;
+    rtos_event_group_init(&event_set_p->waiters_event_group,
+                          "event set waiters");
 }
 
 
@@ -26,22 +29,19 @@ void init_event_set(struct event_set *event_set_p)
  */
 bool is_event_set_empty(const struct event_set *event_set_p) {
 
-	/*
-	 * NOTE: We need to do a type cast to remove the const, since
-	 * atomic_fecth_or_uint32() changes the first arg. However, since or-ing
-	 * with 0 is a "no-op" the value of the set stays the same.
-	 */
-    uint32_t old_event_set =
-        atomic_fetch_or_uint32((uint32_t *)&event_set_p->elements, 0x0);
-
-    return (old_event_set == 0x0);
+    /*
+     * A single aligned 32-bit load is atomic, so there is no need to
+     * go through an atomic read-modify-write:
+     */
+    return (event_set_p->elements == 0x0);
 }
 
 
 /**
  * Add an event to the event set, if not already in it.
  * Otherwise, it does not add it again (as sets in mathematics cannot
- * have duplicates).
+ * have duplicates). If the event is added, tasks waiting for it are woken
+ * up. It can be called from an ISR.
  *
  * @param event_set_p pointer to the event set
  * @param event_index Index of the event to add to the event set
@@ -52,13 +52,21 @@ bool is_event_set_empty(const struct event_set *event_set_p) {
 bool test_and_set_event(struct event_set *event_set_p,
                         uint8_t event_index)
 {
-    uint32_t old_event_set;
-
     D_ASSERT(event_index < MAX_NUM_EVENTS);
-    old_event_set = atomic_fetch_or_uint32(&event_set_p->elements,
-    		                               BIT(event_index));
+    if (atomic_test_and_set_bit(&event_set_p->elements, event_index)) {
+        /*
+         * The event must be in the set before waiters are woken up, as
+         * they look for events in the bit vector, not in the event group:
+         */
+        if (event_index < MAX_NUM_WAITABLE_EVENTS) {
+            rtos_event_group_set_bits(&event_set_p->waiters_event_group,
+                                      BIT(event_index));
+        }
+
+        return true;
+    }
 
-    return (old_event_set & BIT(event_index)) == 0;
+    return false;
 }
 
 
@@ -75,13 +83,99 @@ bool test_and_set_event(struct event_set *event_set_p,
 bool test_and_clear_event(struct event_set *event_set_p,
                           uint8_t event_index)
 {
-    uint32_t old_event_set;
-
     D_ASSERT(event_index < MAX_NUM_EVENTS);
-    old_event_set = atomic_fetch_and_uint32(
-                            &event_set_p->elements,
-                            ~BIT(event_index));
+    return atomic_test_and_clear_bit(&event_set_p->elements, event_index);
+}
+
+
+/**
+ * Common logic of event_set_wait_any() and event_set_wait_all().
+ *
+ * Event group bits may be left set by events that were removed from the set
+ * since, so they are cleared before the bit vector is sampled. An event
+ * added after the sampling sets its bit again, after the clearing, so its
+ * wakeup cannot be missed.
+ *
+ * NOTE: Bits are cleared for all waiters, so only one task at a time is
+ * expected to wait for a given event.
+ */
+static uint32_t event_set_wait(struct event_set *event_set_p,
+                               uint32_t events_mask,
+                               bool wait_all,
+                               uint32_t timeout_ms)
+{
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+
+    D_ASSERT(events_mask != 0 && events_mask < BIT(MAX_NUM_WAITABLE_EVENTS));
+    for ( ; ; ) {
+        rtos_event_group_clear_bits(&event_set_p->waiters_event_group,
+                                    events_mask);
+
+        uint32_t events = event_set_p->elements & events_mask;
+
+        if (wait_all ? events == events_mask : events != 0) {
+            return events;
+        }
+
+        uint32_t remaining_ms = RTOS_WAIT_FOREVER;
+
+        if (timeout_ms != RTOS_WAIT_FOREVER) {
+            uint32_t elapsed_ms =
+                RTOS_TICKS_DELTA(start_ticks, rtos_get_ticks_since_boot()) *
+                MS_PER_TIMER_TICK;
 
-    return (old_event_set & BIT(event_index)) != 0;
+            if (elapsed_ms >= timeout_ms) {
+                return events;
+            }
+
+            remaining_ms = timeout_ms - elapsed_ms;
+        }
+
+        /*
+         * Wait for any of the events still missing, and sample the set again:
+         */
+        (void)rtos_event_group_wait_bits(&event_set_p->waiters_event_group,
+                                         events_mask & ~events,
+                                         false,
+                                         remaining_ms);
+    }
 }
 
+
+/**
+ * Blocks the calling task until any of the given events is in the event set,
+ * or the timeout expires. Events are not removed from the set.
+ *
+ * @param event_set_p   pointer to the event set
+ * @param events_mask   bit mask of the events to wait for. Only events lower
+ *                      than MAX_NUM_WAITABLE_EVENTS can be waited for.
+ * @param timeout_ms    timeout in milliseconds or RTOS_WAIT_FOREVER
+ *
+ * @return events from events_mask that are in the set (0 if timed out)
+ */
+uint32_t event_set_wait_any(struct event_set *event_set_p,
+                            uint32_t events_mask,
+                            uint32_t timeout_ms)
+{
+    return event_set_wait(event_set_p, events_mask, false, timeout_ms);
+}
+
+
+/**
+ * Blocks the calling task until all the given events are in the event set,
+ * or the timeout expires. Events are not removed from the set.
+ *
+ * @param event_set_p   pointer to the event set
+ * @param events_mask   bit mask of the events to wait for. Only events lower
+ *                      than MAX_NUM_WAITABLE_EVENTS can be waited for.
+ * @param timeout_ms    timeout in milliseconds or RTOS_WAIT_FOREVER
+ *
+ * @return events from events_mask that are in the set (events_mask, unless
+ * timed out)
+ */
+uint32_t event_set_wait_all(struct event_set *event_set_p,
+                            uint32_t events_mask,
+                            uint32_t timeout_ms)
+{
+    return event_set_wait(event_set_p, events_mask, true, timeout_ms);
+}
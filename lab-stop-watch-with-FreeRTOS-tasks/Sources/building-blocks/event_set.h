@@ -1,7 +1,8 @@
 /**
  * @file event_set.h
  *
- * Primitives to atomically add and remove events to an event set
+ * Primitives to atomically add and remove events to an event set, and to
+ * block a task until events are added to it
  *
  * @author: German Rivera
  */
@@ -10,9 +11,16 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "rtos_wrapper.h"
 
 #define MAX_NUM_EVENTS (sizeof(uint32_t) * 8)
 
+/**
+ * Number of events that tasks can wait for (events 0 to
+ * MAX_NUM_WAITABLE_EVENTS - 1)
+ */
+#define MAX_NUM_WAITABLE_EVENTS RTOS_EVENT_GROUP_NUM_BITS
+
 /**
  * Event set representation
  */
@@ -22,6 +30,12 @@ struct event_set {
      * Bit i is on in the bit vector, if event i is in the event set.
      */
     volatile uint32_t elements;
+
+    /**
+     * RTOS event group used to wake up the tasks waiting for events.
+     * It is only a wakeup hint: the bit vector above is the actual set.
+     */
+    struct rtos_event_group waiters_event_group;
 };
 
 void init_event_set(struct event_set *event_set_p);
@@ -34,4 +48,12 @@ bool test_and_set_event(struct event_set *event_set_p,
 bool test_and_clear_event(struct event_set *event_set_p,
                           uint8_t event_index);
 
+uint32_t event_set_wait_any(struct event_set *event_set_p,
+                            uint32_t events_mask,
+                            uint32_t timeout_ms);
+
+uint32_t event_set_wait_all(struct event_set *event_set_p,
+                            uint32_t events_mask,
+                            uint32_t timeout_ms);
+
 #endif /* SOURCES_BUILDING_BLOCKS_EVENT_SET_H_ */
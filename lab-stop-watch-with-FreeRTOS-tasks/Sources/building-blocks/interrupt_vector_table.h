@@ -22,6 +22,8 @@
 
 #define ACCELEROMETER_INTERRUPT_PRIORITY		(MCU_HIGHEST_INTERRUPT_PRIORITY + 2)
 
+#define GPIO_PIN_INTERRUPT_PRIORITY             (MCU_HIGHEST_INTERRUPT_PRIORITY + 2)
+
 #define UART_INTERRUPT_PRIORITY                 (MCU_LOWEST_INTERRUPT_PRIORITY)
 
 /**
@@ -64,6 +66,14 @@ void SysTick_Handler(void);
 
 void lptmr0_irq_handler(void);
 
+void porta_irq_handler(void);
+
+void porte_irq_handler(void);
+
+void lpuart0_irq_handler(void);
+
+void lpuart0_tx_dma_irq_handler(void);
+
 extern isr_function_t *const g_interrupt_vector_table[];
 
 #endif /* SOURCES_BUILDING_BLOCKS_INTERRUPT_VECTOR_TABLE_H_ */
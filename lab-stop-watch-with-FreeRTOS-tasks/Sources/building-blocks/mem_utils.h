@@ -22,6 +22,8 @@
 
 #define ROUND_DOWN(_m, _n)    (((_m) / (_n)) * (_n))
 
+#define IS_POWER_OF_2(_x)   ((_x) != 0 && ((_x) & ((_x) - 1)) == 0)
+
 /**
  * Given pointer to a struct '_enclosed_struc_p' that is contained in
  * another struct 'enclosing_struct_type', as field '_enclosing_struct_field',
@@ -39,10 +41,44 @@
  */
 #define RAM_FUNC __attribute__ ((section (".ram_functions")))
 
+/*
+ * Implementations of mem_checksum(), in increasing order of speed and of
+ * flash space taken by their lookup tables:
+ */
+#define MEM_CHECKSUM_CRC_BITWISE        0   /* no tables */
+#define MEM_CHECKSUM_CRC_NIBBLE_TABLE   1   /* 64 bytes */
+#define MEM_CHECKSUM_CRC_BYTE_TABLE     2   /* 1 KiB */
+#define MEM_CHECKSUM_CRC_SLICE_BY_4     3   /* 4 KiB */
+#define MEM_CHECKSUM_CRC_SLICE_BY_8     4   /* 8 KiB */
+
+/**
+ * Implementation of mem_checksum() to build, chosen by flash budget
+ */
+#ifndef MEM_CHECKSUM_CRC_ALGORITHM
+#define MEM_CHECKSUM_CRC_ALGORITHM      MEM_CHECKSUM_CRC_SLICE_BY_4
+#endif
+
+/**
+ * Number of 256-entry lookup tables used by the selected implementation
+ */
+#if MEM_CHECKSUM_CRC_ALGORITHM == MEM_CHECKSUM_CRC_SLICE_BY_8
+#define MEM_CHECKSUM_CRC_NUM_TABLES     8
+#elif MEM_CHECKSUM_CRC_ALGORITHM == MEM_CHECKSUM_CRC_SLICE_BY_4
+#define MEM_CHECKSUM_CRC_NUM_TABLES     4
+#else
+#define MEM_CHECKSUM_CRC_NUM_TABLES     1
+#endif
+
 uint32_t mem_checksum(const void *start_addr, uint32_t size);
 
+uint32_t mem_checksum_bitwise(const void *start_addr, uint32_t size);
+
 void memcpy32(uint32_t *dst, const uint32_t *src, uint32_t size);
 
 void memset32(uint32_t *dst, uint_fast8_t byte_value, uint32_t size);
 
+void mem_copy(void *dst, const void *src, size_t size);
+
+void mem_fill(void *dst, uint8_t byte_value, size_t size);
+
 #endif /* SOURCES_BUILDING_BLOCKS_MEM_UTILS_H_ */
@@ -5,21 +5,22 @@
 #
 
 local_src := $(subdirectory)/atomic_utils.c \
-             $(subdirectory)/byte_ring_buffer.c \
+             $(subdirectory)/button_input.c \
              $(subdirectory)/cortex_m_startup.c \
-             $(subdirectory)/cpu_reset_counter.c \
              $(subdirectory)/event_set.c \
+             $(subdirectory)/gpio_driver.c \
              $(subdirectory)/hw_timer_driver.c \
 	     $(subdirectory)/$(MCU_CHIP)_interrupt_vector_table.c \
              $(subdirectory)/memory_protection_unit.c \
              $(subdirectory)/mem_utils.c \
+             $(subdirectory)/pin_config.c \
              $(subdirectory)/power_utils.c \
-             $(subdirectory)/printf_utils.c \
              $(subdirectory)/rtos_wrapper_FreeRTOS.c \
              $(subdirectory)/runtime_checks.c \
              $(subdirectory)/serial_console.c \
              $(subdirectory)/stack_trace.c \
              $(subdirectory)/time_utils.c \
+             $(subdirectory)/uart_driver.c \
              $(subdirectory)/watchdog.c
 
 $(eval $(call make-library, $(subdirectory)/building-blocks.a, $(local_src)))
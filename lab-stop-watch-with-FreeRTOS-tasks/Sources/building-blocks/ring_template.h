@@ -0,0 +1,120 @@
+/**
+ * @file ring_template.h
+ *
+ * Template for fixed-size rings (circular queues), whose element type and
+ * capacity are fixed at compile time
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_RING_TEMPLATE_H_
+#define SOURCES_BUILDING_BLOCKS_RING_TEMPLATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+#include "mem_utils.h"
+
+/**
+ * Declares a ring type, 'struct _name', of up to _num_entries elements of
+ * type _elem_type, and its accessor functions:
+ * - _name_init(ring_p)
+ * - _name_length(ring_p)
+ * - _name_is_empty(ring_p)
+ * - _name_is_full(ring_p)
+ * - _name_put(ring_p, elem): adds an element at the tail, if not full
+ * - _name_get(ring_p, elem_p): removes the element at the head, if not empty
+ * - _name_peek(ring_p): returns a pointer to the element at the head
+ *
+ * The ring keeps free-running counts of the elements added and removed,
+ * so that full and empty rings are told apart without a separate length
+ * field. As _num_entries must be a power of 2, the position of an element
+ * in the ring is its count masked with a constant, and all bounds checks
+ * against _num_entries are constant-folded by the compiler.
+ *
+ * NOTE: The accessor functions do not serialize concurrent accesses. The
+ * caller must do so (for example, by disabling interrupts).
+ *
+ * Usage: DECLARE_RING_TYPE(my_ring, struct foo *, 16);
+ */
+#define DECLARE_RING_TYPE(_name, _elem_type, _num_entries) \
+    struct _name {                                                          \
+        /*                                                                  \
+         * Free-running counts of elements added and removed                \
+         */                                                                 \
+        uint16_t write_count;                                               \
+        uint16_t read_count;                                                \
+        _elem_type entries[_num_entries];                                   \
+    };                                                                      \
+                                                                            \
+    static inline void _name##_init(struct _name *ring_p)                   \
+    {                                                                       \
+        ring_p->write_count = 0;                                            \
+        ring_p->read_count = 0;                                             \
+    }                                                                       \
+                                                                            \
+    static inline uint_fast16_t _name##_length(const struct _name *ring_p)  \
+    {                                                                       \
+        uint_fast16_t length =                                              \
+            (uint16_t)(ring_p->write_count - ring_p->read_count);           \
+                                                                            \
+        D_ASSERT(length <= (_num_entries));                                 \
+        return length;                                                      \
+    }                                                                       \
+                                                                            \
+    static inline bool _name##_is_empty(const struct _name *ring_p)         \
+    {                                                                       \
+        return ring_p->write_count == ring_p->read_count;                   \
+    }                                                                       \
+                                                                            \
+    static inline bool _name##_is_full(const struct _name *ring_p)          \
+    {                                                                       \
+        return _name##_length(ring_p) == (_num_entries);                    \
+    }                                                                       \
+                                                                            \
+    static inline bool _name##_put(struct _name *ring_p, _elem_type elem)   \
+    {                                                                       \
+        if (_name##_is_full(ring_p)) {                                      \
+            return false;                                                   \
+        }                                                                   \
+                                                                            \
+        ring_p->entries[ring_p->write_count & ((_num_entries) - 1)] = elem; \
+        ring_p->write_count ++;                                             \
+        return true;                                                        \
+    }                                                                       \
+                                                                            \
+    static inline bool _name##_get(struct _name *ring_p,                    \
+                                   _elem_type *elem_p)                      \
+    {                                                                       \
+        if (_name##_is_empty(ring_p)) {                                     \
+            return false;                                                   \
+        }                                                                   \
+                                                                            \
+        *elem_p = ring_p->entries[ring_p->read_count & ((_num_entries) - 1)]; \
+        ring_p->read_count ++;                                              \
+        return true;                                                        \
+    }                                                                       \
+                                                                            \
+    static inline _elem_type *_name##_peek(struct _name *ring_p)            \
+    {                                                                       \
+        D_ASSERT(!_name##_is_empty(ring_p));                                \
+        return &ring_p->entries[ring_p->read_count & ((_num_entries) - 1)]; \
+    }                                                                       \
+                                                                            \
+    C_ASSERT(IS_POWER_OF_2(_num_entries) && (_num_entries) <= INT16_MAX)
+
+/**
+ * Rounds up a ring capacity to the next power of 2. Capacities larger than
+ * 256 give 0, which DECLARE_RING_TYPE() rejects.
+ */
+#define RING_NUM_ENTRIES(_min_entries) \
+        ((_min_entries) <= 2 ? 2 :                  \
+         (_min_entries) <= 4 ? 4 :                  \
+         (_min_entries) <= 8 ? 8 :                  \
+         (_min_entries) <= 16 ? 16 :                \
+         (_min_entries) <= 32 ? 32 :                \
+         (_min_entries) <= 64 ? 64 :                \
+         (_min_entries) <= 128 ? 128 :              \
+         (_min_entries) <= 256 ? 256 : 0)
+
+#endif /* SOURCES_BUILDING_BLOCKS_RING_TEMPLATE_H_ */
@@ -16,6 +16,7 @@
 #include <semphr.h>
 #include <queue.h>
 #include <timers.h>
+#include <event_groups.h>
 #include "compile_time_checks.h"
 #include "runtime_checks.h"
 #include "mem_utils.h"
@@ -55,6 +56,19 @@ C_ASSERT(APP_TASK_STACK_SIZE >= configMINIMAL_STACK_SIZE);
 #define MILLISECONDS_TO_TICKS(_milli_secs) \
         ((uint32_t)HOW_MANY(_milli_secs, MS_PER_TIMER_TICK))
 
+/**
+ * Timeout value that means to wait forever
+ */
+#define RTOS_WAIT_FOREVER   UINT32_MAX
+
+/**
+ * Number of usable bits in an RTOS event group. FreeRTOS reserves the top
+ * 8 bits of the 32-bit EventBits_t for its own use.
+ */
+#define RTOS_EVENT_GROUP_NUM_BITS   24
+
+C_ASSERT(configUSE_16_BIT_TICKS == 0);
+
 /**
  * Wrapper for an RTOS task object
  */
@@ -124,6 +138,18 @@ struct rtos_semaphore
     SemaphoreHandle_t sem_os_semaphore; /* returned by xSemaphoreCreateCounting() */
 };
 
+/**
+ * Wrapper for an RTOS event group object
+ */
+struct rtos_event_group
+{
+#   define      EVENT_GROUP_SIGNATURE  GEN_SIGNATURE('E', 'V', 'G', 'R')
+    uint32_t    evg_signature;
+    const char *evg_name;
+
+    EventGroupHandle_t evg_os_event_group; /* returned by xEventGroupCreate() */
+};
+
 struct rtos_timer;
 
 /**
@@ -200,6 +226,20 @@ void rtos_semaphore_signal(struct rtos_semaphore *rtos_semaphore_p);
 
 void rtos_semaphore_broadcast(struct rtos_semaphore *rtos_semaphore_p);
 
+void rtos_event_group_init(struct rtos_event_group *rtos_event_group_p,
+                           const char *event_group_name_p);
+
+void rtos_event_group_set_bits(struct rtos_event_group *rtos_event_group_p,
+                               uint32_t bits_mask);
+
+void rtos_event_group_clear_bits(struct rtos_event_group *rtos_event_group_p,
+                                 uint32_t bits_mask);
+
+uint32_t rtos_event_group_wait_bits(struct rtos_event_group *rtos_event_group_p,
+                                    uint32_t bits_mask,
+                                    bool wait_all,
+                                    uint32_t timeout_ms);
+
 void rtos_timer_init(struct rtos_timer *rtos_timer_p,
                      const char *timer_name_p,
                      uint32_t milliseconds,
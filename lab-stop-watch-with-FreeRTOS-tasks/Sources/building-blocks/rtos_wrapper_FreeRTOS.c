@@ -8,6 +8,7 @@
 
 #include "rtos_wrapper.h"
 #include "atomic_utils.h"
+#include "io_utils.h"
 #include "mem_utils.h"
 #include "microcontroller.h"
 #include "runtime_log.h"
@@ -406,6 +407,113 @@ void rtos_semaphore_broadcast(struct rtos_semaphore *rtos_semaphore_p)
 }
 
 
+/**
+ * Initializes an RTOS-level event group, with all its bits cleared
+ */
+void rtos_event_group_init(struct rtos_event_group *rtos_event_group_p,
+                           const char *event_group_name_p)
+{
+	bool old_writable = set_writable_background_region(true);
+
+    D_ASSERT(rtos_event_group_p != NULL);
+    rtos_event_group_p->evg_signature = EVENT_GROUP_SIGNATURE;
+    rtos_event_group_p->evg_name = event_group_name_p;
+    rtos_event_group_p->evg_os_event_group = xEventGroupCreate();
+
+    (void)set_writable_background_region(old_writable);
+
+    D_ASSERT(rtos_event_group_p->evg_os_event_group != NULL);
+}
+
+
+/**
+ * Sets bits of an RTOS-level event group. It wakes up all waiters whose
+ * wait condition is met. It can be called from an ISR.
+ *
+ * NOTE: When called from an ISR, FreeRTOS defers the setting of the bits to
+ * the timer task.
+ */
+void rtos_event_group_set_bits(struct rtos_event_group *rtos_event_group_p,
+                               uint32_t bits_mask)
+{
+    BaseType_t rtos_status = pdPASS;
+    error_t error;
+
+    D_ASSERT(rtos_event_group_p->evg_signature == EVENT_GROUP_SIGNATURE);
+    D_ASSERT(bits_mask != 0 && bits_mask < BIT(RTOS_EVENT_GROUP_NUM_BITS));
+
+	bool old_writable = set_writable_background_region(true);
+    if (CALLER_IS_THREAD()) {
+        (void)xEventGroupSetBits(rtos_event_group_p->evg_os_event_group,
+                                 bits_mask);
+    } else {
+        rtos_status = xEventGroupSetBitsFromISR(
+                        rtos_event_group_p->evg_os_event_group,
+                        bits_mask,
+                        &g_rtos_task_context_switch_required);
+    }
+    (void)set_writable_background_region(old_writable);
+
+    if (rtos_status != pdPASS) {
+        error = CAPTURE_ERROR("xEventGroupSetBitsFromISR() failed", rtos_status,
+                              rtos_event_group_p);
+        fatal_error_handler(error);
+    }
+}
+
+
+/**
+ * Clears bits of an RTOS-level event group
+ */
+void rtos_event_group_clear_bits(struct rtos_event_group *rtos_event_group_p,
+                                 uint32_t bits_mask)
+{
+    D_ASSERT(rtos_event_group_p->evg_signature == EVENT_GROUP_SIGNATURE);
+    D_ASSERT(bits_mask < BIT(RTOS_EVENT_GROUP_NUM_BITS));
+    D_ASSERT(CALLER_IS_THREAD());
+
+	bool old_writable = set_writable_background_region(true);
+    (void)xEventGroupClearBits(rtos_event_group_p->evg_os_event_group, bits_mask);
+    (void)set_writable_background_region(old_writable);
+}
+
+
+/**
+ * Waits with timeout for bits of an RTOS-level event group to be set.
+ * The bits are not cleared when the wait completes.
+ *
+ * @param rtos_event_group_p    pointer to the event group
+ * @param bits_mask             bits to wait for
+ * @param wait_all              true to wait for all bits in bits_mask,
+ *                              false to wait for any of them
+ * @param timeout_ms            timeout in milliseconds or RTOS_WAIT_FOREVER
+ *
+ * @return bits of the event group when the wait completed or timed out
+ */
+uint32_t rtos_event_group_wait_bits(struct rtos_event_group *rtos_event_group_p,
+                                    uint32_t bits_mask,
+                                    bool wait_all,
+                                    uint32_t timeout_ms)
+{
+    EventBits_t bits;
+
+    D_ASSERT(rtos_event_group_p->evg_signature == EVENT_GROUP_SIGNATURE);
+    D_ASSERT(bits_mask != 0 && bits_mask < BIT(RTOS_EVENT_GROUP_NUM_BITS));
+    D_ASSERT(CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+	bool old_writable = set_writable_background_region(true);
+    bits = xEventGroupWaitBits(rtos_event_group_p->evg_os_event_group,
+                               bits_mask,
+                               pdFALSE,
+                               wait_all ? pdTRUE : pdFALSE,
+                               timeout_ms == RTOS_WAIT_FOREVER ?
+                                   portMAX_DELAY : timeout_ms / MS_PER_TIMER_TICK);
+    (void)set_writable_background_region(old_writable);
+
+    return bits;
+}
+
+
 static void rtos_timer_internal_callback(TimerHandle_t xTimer)
 {
     struct rtos_timer *rtos_timer_p = pvTimerGetTimerID(xTimer);
@@ -449,7 +557,7 @@ void rtos_timer_init(struct rtos_timer *rtos_timer_p,
 
 
 /**
- * Starts an RTOS-level timer
+ * Starts an RTOS-level timer. It can be called from an ISR.
  */
 void rtos_timer_start(struct rtos_timer *rtos_timer_p)
 {
@@ -458,7 +566,12 @@ void rtos_timer_start(struct rtos_timer *rtos_timer_p)
 
     D_ASSERT(rtos_timer_p->tmr_signature == TIMER_SIGNATURE);
 	bool old_writable = set_writable_background_region(true);
-    rtos_status = xTimerStart(rtos_timer_p->tmr_os_timer, portMAX_DELAY);
+    if (CALLER_IS_THREAD()) {
+        rtos_status = xTimerStart(rtos_timer_p->tmr_os_timer, portMAX_DELAY);
+    } else {
+        rtos_status = xTimerStartFromISR(rtos_timer_p->tmr_os_timer,
+                                         &g_rtos_task_context_switch_required);
+    }
     (void)set_writable_background_region(old_writable);
 
     if (rtos_status != pdPASS) {
@@ -516,6 +629,10 @@ void rtos_task_check_stack(struct rtos_task *task_p)
  */
 uint32_t rtos_get_ticks_since_boot(void)
 {
+    if (!CALLER_IS_THREAD()) {
+        return xTaskGetTickCountFromISR();
+    }
+
     return xTaskGetTickCount();
 }
 
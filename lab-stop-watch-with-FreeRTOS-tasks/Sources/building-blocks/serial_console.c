@@ -15,14 +15,6 @@
 #include "printf_utils.h"
 #include "memory_protection_unit.h"
 
-#include "fsl_lpuart.h" //??? TODO
-#define uart_putchar(_uart_device_p, _c) \
-	do { \
-		uint8_t _x = (_c); \
-		LPUART_WriteBlocking(LPUART0, &_x, 1); \
-	} while (0)
-//???
-
 /**
  * Baud rate for the console UART
  */
@@ -61,7 +53,7 @@ static struct serial_console g_console = {
     .do_async_output = false,
     .current_attributes = CONSOLE_ATTR_NORMAL,
     .saved_attributes = CONSOLE_ATTR_INVALID,
-    //.uart_device_p = &g_uart_devices[0], //??? TODO
+    .uart_device_p = &g_uart_devices[0],
 };
 
 /*
@@ -109,7 +101,11 @@ static void console_output_task_func(void *arg)
     D_ASSERT(g_console.do_async_output);
     for ( ; ; ) {
         c = byte_ring_buffer_read(&g_console.output_buffer);
-        console_uart_putchar(c);
+        if (c == '\n') {
+            uart_putchar_with_interrupts(g_console.uart_device_p, '\r');
+        }
+
+        uart_putchar_with_interrupts(g_console.uart_device_p, c);
     }
 }
 
@@ -120,9 +116,6 @@ static void console_output_task_func(void *arg)
  *@param console_output_task_p pointer to an RTOS task object to be
  *       used to create a task to handle console output. Use NULL
  *       if asynchronous console output is not wanted.
- *
- * NOTE: For now we leverage KSDK code for the UART initialization.
- * In the future, we will write our own code for this.
  */
 void console_init(struct rtos_task *console_output_task_p)
 {
@@ -130,9 +123,7 @@ void console_init(struct rtos_task *console_output_task_p)
 
     D_ASSERT(!g_console.initialized);
 
-#if 0 //??? TODO
     uart_init(g_console.uart_device_p, CONSOLE_UART_BAUD, UART_DEFAULT_MODE);
-#endif
 
     rtos_mutex_init(&g_console.mutex, "serial console mutex");
     set_private_data_region(&g_console, sizeof(g_console), READ_WRITE, &old_region);
@@ -519,20 +510,5 @@ int console_getchar(void)
 int console_getchar_non_blocking(void)
 {
     D_ASSERT(g_console.initialized);
-#if 0 // TODO???
     return uart_getchar_non_blocking(g_console.uart_device_p);
-#else
-    struct mpu_region_descriptor old_region;
-    int c;
-
-    set_private_data_region(LPUART0, sizeof(*LPUART0), READ_ONLY, &old_region);
-    if (LPUART0->STAT & LPUART_STAT_RDRF_MASK) {
-    	c = (LPUART0->DATA & 0xff);
-    } else {
-    	c =-1;
-    }
-
-    restore_private_data_region(&old_region);
-    return c;
-#endif
 }
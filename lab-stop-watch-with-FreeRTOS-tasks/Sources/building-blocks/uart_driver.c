@@ -0,0 +1,874 @@
+/**
+ * @file uart_driver.c
+ *
+ * LPUART driver implementation
+ *
+ * Received bytes are moved from the Rx FIFO to the receive queue by the
+ * LPUART interrupt handler, and bytes to transmit are moved from the
+ * transmit queue to the Tx FIFO by the LPUART interrupt handler or, if
+ * UART_TX_USE_DMA is defined, by an eDMA channel. The FIFO watermarks are
+ * set so that each interrupt moves several bytes, instead of one.
+ *
+ * @author German Rivera
+ */
+#include "uart_driver.h"
+#include "atomic_utils.h"
+#include "compile_time_checks.h"
+#include "io_utils.h"
+#include "runtime_checks.h"
+#include "mem_utils.h"
+#include "byte_ring_buffer.h"
+#include "ring_template.h"
+#include "rtos_wrapper.h"
+#include "interrupt_vector_table.h"
+#include "memory_protection_unit.h"
+#include "arm_cmsis.h"
+
+/**
+ * Size of the receive queue filled by the LPUART interrupt handler
+ */
+#define UART_RECEIVE_QUEUE_SIZE_IN_BYTES    UINT16_C(16)
+
+/**
+ * Size of the transmit queue drained by the LPUART interrupt handler or by
+ * the Tx DMA channel
+ */
+#define UART_TRANSMIT_QUEUE_SIZE_IN_BYTES   UINT16_C(64)
+
+/**
+ * Oversampling ratio of the LPUART receiver (4 .. 32)
+ */
+#define UART_OVERSAMPLING_RATIO             16
+
+/**
+ * PCC PCS field value that selects FIRCDIV3_CLK as the LPUART functional
+ * clock, and frequency of that clock, as configured by BOARD_BootClockRUN()
+ */
+#define UART_CLOCK_SOURCE_FIRC_ASYNC        3
+#define UART_FIRC_ASYNC_CLOCK_FREQ_IN_HZ    UINT32_C(48000000)
+
+/**
+ * Number of idle characters after which the receiver asserts RDRF, if the
+ * Rx FIFO holds bytes below the Rx watermark, encoded as in the RXIDEN
+ * field of the FIFO register (1 means 1 idle character)
+ */
+#define UART_RX_IDLE_CHARACTERS_ENCODED     1
+
+/**
+ * LPUART status flags that are cleared by writing 1 to them
+ */
+#define UART_STAT_W1C_FLAGS_MASK \
+        (LPUART_STAT_LBKDIF_MASK | LPUART_STAT_RXEDGIF_MASK |               \
+         LPUART_STAT_IDLE_MASK | LPUART_STAT_OR_MASK | LPUART_STAT_NF_MASK | \
+         LPUART_STAT_FE_MASK | LPUART_STAT_PF_MASK | LPUART_STAT_MA1F_MASK | \
+         LPUART_STAT_MA2F_MASK)
+
+/**
+ * LPUART receive error flags
+ */
+#define UART_STAT_ERROR_FLAGS_MASK \
+        (LPUART_STAT_OR_MASK | LPUART_STAT_NF_MASK | LPUART_STAT_FE_MASK |  \
+         LPUART_STAT_PF_MASK)
+
+#ifdef UART_TX_USE_DMA
+/**
+ * DMAMUX request source for the LPUART0 transmitter (see KL28Z reference
+ * manual, DMA request sources table)
+ */
+#define LPUART0_TX_DMA_REQUEST_SOURCE       16
+#endif
+
+/**
+ * Ring type of the transmit queue
+ */
+DECLARE_RING_TYPE(uart_transmit_ring, uint8_t,
+                  UART_TRANSMIT_QUEUE_SIZE_IN_BYTES);
+
+/**
+ * Non-const fields of a UART device (to be placed in SRAM)
+ */
+struct uart_device_var {
+    bool urt_initialized;
+    uint32_t urt_received_bytes_dropped;
+    uint32_t urt_errors;
+    struct byte_ring_buffer urt_receive_queue;
+    uint8_t urt_receive_queue_data[UART_RECEIVE_QUEUE_SIZE_IN_BYTES];
+
+    /**
+     * Transmit queue filled by uart_putchar_with_interrupts() and drained
+     * into the Tx FIFO by the LPUART interrupt handler or the Tx DMA channel
+     */
+    struct uart_transmit_ring urt_transmit_queue;
+
+    /**
+     * Flag set by a writer waiting for room in the transmit queue
+     */
+    volatile bool urt_transmit_queue_writer_waiting;
+
+    /**
+     * Semaphore signaled when room becomes available in the transmit queue
+     * for a waiting writer
+     */
+    struct rtos_semaphore urt_transmit_queue_semaphore;
+
+#ifdef UART_TX_USE_DMA
+    /**
+     * Number of bytes at the head of the transmit queue being moved to the
+     * Tx FIFO by the current DMA transfer, or 0 if no DMA transfer is in
+     * progress
+     */
+    uint16_t urt_tx_dma_transfer_length;
+#endif
+
+    uint8_t urt_tx_fifo_size;
+    uint8_t urt_rx_fifo_size;
+};
+
+
+/**
+ * Global array of non-const structures for UART devices
+ * (allocated in SRAM space)
+ */
+static struct uart_device_var g_uart_devices_var[] =
+{
+    [0] = {
+        .urt_initialized = false,
+        .urt_received_bytes_dropped = 0,
+        .urt_errors = 0,
+    },
+};
+
+/**
+ * Global array of const structures for UART devices
+ * (allocated in flash space)
+ */
+const struct uart_device g_uart_devices[] =
+{
+    [0] = {
+        .urt_signature = UART_DEVICE_SIGNATURE,
+        .urt_var_p = &g_uart_devices_var[0],
+        .urt_mmio_uart_p = LPUART0,
+        .urt_mmio_tx_port_pcr_p = &PORTB->PCR[17],
+        .urt_mmio_rx_port_pcr_p = &PORTB->PCR[16],
+        .urt_mmio_pin_mux_selector_mask = PORT_PCR_MUX(3),
+        .urt_mmio_clock_gate_reg_p = &PCC_LPUART0,
+        .urt_mmio_clock_gate_mask = PCC_CLKCFG_CGC_MASK,
+        .urt_clock_source_selector = UART_CLOCK_SOURCE_FIRC_ASYNC,
+        .urt_source_clock_freq_in_hz = UART_FIRC_ASYNC_CLOCK_FREQ_IN_HZ,
+        .urt_irq_num = LPUART0_IRQn,
+#ifdef UART_TX_USE_DMA
+        .urt_tx_dma_channel = 0,
+        .urt_tx_dma_request_source = LPUART0_TX_DMA_REQUEST_SOURCE,
+        .urt_tx_dma_irq_num = DMA0_04_IRQn,
+#endif
+    },
+};
+
+C_ASSERT(
+    ARRAY_SIZE(g_uart_devices) >= ARRAY_SIZE(g_uart_devices_var));
+
+
+/**
+ * Returns the size of a FIFO of an LPUART, from the value of the
+ * TXFIFOSIZE or RXFIFOSIZE field of the FIFO register
+ */
+static uint8_t uart_decode_fifo_size(uint32_t fifo_size_field)
+{
+    if (fifo_size_field == 0x0) {
+        return 1;
+    } else {
+        return 1 << (fifo_size_field + 1);
+    }
+}
+
+
+static void uart_set_baud_rate(
+    const struct uart_device *uart_device_p,
+    uint32_t baud_rate)
+{
+    uint32_t reg_value;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+
+    /*
+     * baud rate = LPUART clock / (oversampling ratio * SBR), rounding SBR
+     * to the nearest integer:
+     */
+    uint32_t divisor = UART_OVERSAMPLING_RATIO * baud_rate;
+    uint32_t sbr_val = (uart_device_p->urt_source_clock_freq_in_hz +
+                        divisor / 2) / divisor;
+
+    D_ASSERT(sbr_val >= 1 &&
+             sbr_val <= (LPUART_BAUD_SBR_MASK >> LPUART_BAUD_SBR_SHIFT));
+
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->BAUD);
+    SET_BIT_FIELD(reg_value, LPUART_BAUD_OSR_MASK, LPUART_BAUD_OSR_SHIFT,
+                  UART_OVERSAMPLING_RATIO - 1);
+    SET_BIT_FIELD(reg_value, LPUART_BAUD_SBR_MASK, LPUART_BAUD_SBR_SHIFT,
+                  sbr_val);
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->BAUD, reg_value);
+}
+
+
+/**
+ * Configures the Tx and Rx FIFOs of an LPUART:
+ * - Tx watermark = 1/4 of the Tx FIFO: a Tx interrupt (or DMA request) is
+ *   generated when the Tx FIFO has at most that many bytes left, so each
+ *   interrupt refills most of the FIFO, while still leaving time to do it
+ *   before the transmitter runs dry.
+ * - Rx watermark = 1/2 of the Rx FIFO: an Rx interrupt is generated when
+ *   the Rx FIFO has more bytes than that, leaving room for the bytes still
+ *   arriving while the interrupt is serviced.
+ * - Rx idle detection, so that bytes left below the Rx watermark at the end
+ *   of a burst are not stuck in the Rx FIFO.
+ */
+static void uart_configure_fifos(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->FIFO);
+    uart_var_p->urt_tx_fifo_size =
+        uart_decode_fifo_size(GET_BIT_FIELD(reg_value,
+                                            LPUART_FIFO_TXFIFOSIZE_MASK,
+                                            LPUART_FIFO_TXFIFOSIZE_SHIFT));
+    uart_var_p->urt_rx_fifo_size =
+        uart_decode_fifo_size(GET_BIT_FIELD(reg_value,
+                                            LPUART_FIFO_RXFIFOSIZE_MASK,
+                                            LPUART_FIFO_RXFIFOSIZE_SHIFT));
+
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->WATER,
+                        LPUART_WATER_TXWATER(uart_var_p->urt_tx_fifo_size / 4) |
+                        LPUART_WATER_RXWATER(uart_var_p->urt_rx_fifo_size / 2));
+
+    reg_value |= LPUART_FIFO_TXFE_MASK | LPUART_FIFO_RXFE_MASK;
+    SET_BIT_FIELD(reg_value, LPUART_FIFO_RXIDEN_MASK, LPUART_FIFO_RXIDEN_SHIFT,
+                  UART_RX_IDLE_CHARACTERS_ENCODED);
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->FIFO, reg_value);
+
+    /*
+     * Flush Tx and Rx FIFOs:
+     */
+    reg_value |= LPUART_FIFO_TXFLUSH_MASK | LPUART_FIFO_RXFLUSH_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->FIFO, reg_value);
+}
+
+
+#ifdef UART_TX_USE_DMA
+/**
+ * Configures the Tx DMA channel of a UART to copy one byte from memory to
+ * the LPUART's data register per DMA request, and to generate an interrupt
+ * at the end of each transfer. The source address and length of each
+ * transfer are set by uart_tx_dma_start_transfer().
+ */
+static void uart_tx_dma_init(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+    uint8_t dma_channel = uart_device_p->urt_tx_dma_channel;
+
+    uart_device_p->urt_var_p->urt_tx_dma_transfer_length = 0;
+
+    /*
+     * Enable clocks for the DMA engine and the DMA request multiplexer:
+     */
+    reg_value = READ_MMIO_REGISTER(&PCC_DMAMUX0);
+    D_ASSERT(reg_value & PCC_CLKCFG_PR_MASK);
+    WRITE_MMIO_REGISTER(&PCC_DMAMUX0, reg_value | PCC_CLKCFG_CGC_MASK);
+    reg_value = READ_MMIO_REGISTER(&PCC_DMA0);
+    D_ASSERT(reg_value & PCC_CLKCFG_PR_MASK);
+    WRITE_MMIO_REGISTER(&PCC_DMA0, reg_value | PCC_CLKCFG_CGC_MASK);
+
+    WRITE_MMIO_REGISTER(&DMAMUX0->CHCFG[dma_channel], 0);
+    WRITE_MMIO_REGISTER(&DMA0->CERQ, dma_channel);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SOFF, 1);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].ATTR,
+                        DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].NBYTES_MLNO, 1);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SLAST, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DADDR,
+                        (uint32_t)&uart_mmio_registers_p->DATA);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DOFF, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DLAST_SGA, 0);
+
+    /*
+     * Clear the channel's request enable at the end of each transfer, so
+     * that the LPUART's DMA requests are ignored while the transmit queue
+     * is empty:
+     */
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CSR,
+                        DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK);
+    WRITE_MMIO_REGISTER(&DMAMUX0->CHCFG[dma_channel],
+                        DMAMUX_CHCFG_ENBL_MASK |
+                        DMAMUX_CHCFG_SOURCE(uart_device_p->urt_tx_dma_request_source));
+
+    NVIC_SetPriority(uart_device_p->urt_tx_dma_irq_num, UART_INTERRUPT_PRIORITY);
+    NVIC_ClearPendingIRQ(uart_device_p->urt_tx_dma_irq_num);
+    NVIC_EnableIRQ(uart_device_p->urt_tx_dma_irq_num);
+
+    /*
+     * Route "transmit data register empty" to DMA requests:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->BAUD);
+    reg_value |= LPUART_BAUD_TDMAE_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->BAUD, reg_value);
+}
+
+
+/**
+ * Starts a DMA transfer of the longest contiguous span of bytes at the head
+ * of the transmit queue. It must be called with interrupts disabled, with
+ * the transmit queue not empty and no DMA transfer in progress.
+ */
+static void uart_tx_dma_start_transfer(const struct uart_device *uart_device_p)
+{
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    struct uart_transmit_ring *ring_p = &uart_var_p->urt_transmit_queue;
+    uint8_t dma_channel = uart_device_p->urt_tx_dma_channel;
+    uint_fast16_t length = uart_transmit_ring_length(ring_p);
+    uint_fast16_t offset = ring_p->read_count &
+                           (UART_TRANSMIT_QUEUE_SIZE_IN_BYTES - 1);
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+    D_ASSERT(uart_var_p->urt_tx_dma_transfer_length == 0);
+    D_ASSERT(length != 0);
+
+    if (offset + length > UART_TRANSMIT_QUEUE_SIZE_IN_BYTES) {
+        length = UART_TRANSMIT_QUEUE_SIZE_IN_BYTES - offset;
+    }
+
+    uart_var_p->urt_tx_dma_transfer_length = length;
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SADDR,
+                        (uint32_t)&ring_p->entries[offset]);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CITER_ELINKNO,
+                        DMA_CITER_ELINKNO_CITER(length));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].BITER_ELINKNO,
+                        DMA_BITER_ELINKNO_BITER(length));
+    WRITE_MMIO_REGISTER(&DMA0->SERQ, dma_channel);
+}
+#endif /* UART_TX_USE_DMA */
+
+
+void uart_init(
+    const struct uart_device *uart_device_p,
+    uint32_t baud_rate,
+    uint8_t mode)
+{
+    uint32_t reg_value;
+
+    D_ASSERT(
+        uart_device_p->urt_signature == UART_DEVICE_SIGNATURE);
+
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+
+    D_ASSERT(uart_var_p != NULL);
+    D_ASSERT(!uart_var_p->urt_initialized);
+
+    /*
+     * Only the default transmission mode is supported for now
+     * (8-bit mode, no parity, 1 stop bit), which is the reset state of
+     * the LPUART's CTRL register
+     */
+    D_ASSERT(mode == UART_DEFAULT_MODE);
+
+    bool old_writable = set_writable_background_region(true);
+
+    /*
+     * Select the UART's functional clock and enable clock for the UART
+     * (the clock source can only be changed while the clock is gated):
+     */
+    reg_value = READ_MMIO_REGISTER(uart_device_p->urt_mmio_clock_gate_reg_p);
+    D_ASSERT(reg_value & PCC_CLKCFG_PR_MASK);
+    reg_value &= ~uart_device_p->urt_mmio_clock_gate_mask;
+    WRITE_MMIO_REGISTER(uart_device_p->urt_mmio_clock_gate_reg_p, reg_value);
+    SET_BIT_FIELD(reg_value, PCC_CLKCFG_PCS_MASK, PCC_CLKCFG_PCS_SHIFT,
+                  uart_device_p->urt_clock_source_selector);
+    reg_value |= uart_device_p->urt_mmio_clock_gate_mask;
+    WRITE_MMIO_REGISTER(uart_device_p->urt_mmio_clock_gate_reg_p, reg_value);
+
+    /*
+     * Reset all the UART's registers, which also disables the UART's
+     * transmitter and receiver, while the UART is being configured:
+     */
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->GLOBAL, LPUART_GLOBAL_RST_MASK);
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->GLOBAL, 0);
+
+    /*
+     * Configure Tx and Rx pins:
+     */
+    reg_value = READ_MMIO_REGISTER(uart_device_p->urt_mmio_tx_port_pcr_p);
+    reg_value &= ~PORT_PCR_MUX_MASK;
+    reg_value |= uart_device_p->urt_mmio_pin_mux_selector_mask;
+    WRITE_MMIO_REGISTER(uart_device_p->urt_mmio_tx_port_pcr_p, reg_value);
+
+    reg_value = READ_MMIO_REGISTER(uart_device_p->urt_mmio_rx_port_pcr_p);
+    reg_value &= ~PORT_PCR_MUX_MASK;
+    reg_value |= uart_device_p->urt_mmio_pin_mux_selector_mask;
+    WRITE_MMIO_REGISTER(uart_device_p->urt_mmio_rx_port_pcr_p, reg_value);
+
+    uart_set_baud_rate(uart_device_p, baud_rate);
+    uart_configure_fifos(uart_device_p);
+
+    /*
+     * Initialize receive queue:
+     */
+    byte_ring_buffer_init(&uart_var_p->urt_receive_queue,
+                          uart_var_p->urt_receive_queue_data,
+                          sizeof uart_var_p->urt_receive_queue_data);
+
+    /*
+     * Initialize transmit queue:
+     */
+    uart_transmit_ring_init(&uart_var_p->urt_transmit_queue);
+    uart_var_p->urt_transmit_queue_writer_waiting = false;
+    rtos_semaphore_init(&uart_var_p->urt_transmit_queue_semaphore,
+                        "UART transmit queue semaphore", 0);
+
+#ifdef UART_TX_USE_DMA
+    uart_tx_dma_init(uart_device_p);
+#endif
+
+    /*
+     * Enable generation of Rx and error interrupts. Tx interrupts are
+     * enabled only while the transmit queue is not empty:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->CTRL);
+    reg_value |= LPUART_CTRL_RIE_MASK | LPUART_CTRL_ORIE_MASK |
+                 LPUART_CTRL_NEIE_MASK | LPUART_CTRL_FEIE_MASK;
+    reg_value &= ~LPUART_CTRL_TIE_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->CTRL, reg_value);
+
+    /*
+     * Enable interrupt in the interrupt controller (NVIC):
+     */
+    NVIC_SetPriority(uart_device_p->urt_irq_num, UART_INTERRUPT_PRIORITY);
+    NVIC_ClearPendingIRQ(uart_device_p->urt_irq_num);
+    NVIC_EnableIRQ(uart_device_p->urt_irq_num);
+
+    /*
+     * Enable UART's transmitter and receiver:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->CTRL);
+    reg_value |= LPUART_CTRL_TE_MASK | LPUART_CTRL_RE_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->CTRL, reg_value);
+
+    uart_var_p->urt_initialized = true;
+    (void)set_writable_background_region(old_writable);
+}
+
+
+void uart_stop(
+    const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+
+    D_ASSERT(uart_var_p != NULL);
+    D_ASSERT(uart_var_p->urt_initialized);
+
+    bool old_writable = set_writable_background_region(true);
+
+    /*
+     * Disable UART's transmitter and receiver, and its interrupts:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->CTRL);
+    reg_value &= ~(LPUART_CTRL_TE_MASK | LPUART_CTRL_RE_MASK |
+                   LPUART_CTRL_TIE_MASK | LPUART_CTRL_RIE_MASK);
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->CTRL, reg_value);
+    NVIC_DisableIRQ(uart_device_p->urt_irq_num);
+
+#ifdef UART_TX_USE_DMA
+    WRITE_MMIO_REGISTER(&DMA0->CERQ, uart_device_p->urt_tx_dma_channel);
+    NVIC_DisableIRQ(uart_device_p->urt_tx_dma_irq_num);
+#endif
+
+    /*
+     * Disable clock for the UART:
+     */
+    reg_value = READ_MMIO_REGISTER(uart_device_p->urt_mmio_clock_gate_reg_p);
+    reg_value &= ~uart_device_p->urt_mmio_clock_gate_mask;
+    WRITE_MMIO_REGISTER(uart_device_p->urt_mmio_clock_gate_reg_p, reg_value);
+
+    uart_var_p->urt_initialized = false;
+    (void)set_writable_background_region(old_writable);
+}
+
+
+/**
+ * Moves bytes from the transmit queue to the Tx FIFO, until the FIFO is full
+ * or the queue is empty. Once the queue is empty, it disables the Tx
+ * interrupt. It is invoked from the LPUART interrupt handler.
+ */
+static void uart_fill_tx_fifo(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+    bool room_made = false;
+
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->WATER);
+    uint_fast8_t tx_fifo_length = GET_BIT_FIELD(reg_value,
+                                                LPUART_WATER_TXCOUNT_MASK,
+                                                LPUART_WATER_TXCOUNT_SHIFT);
+
+    D_ASSERT(tx_fifo_length <= uart_var_p->urt_tx_fifo_size);
+    while (tx_fifo_length < uart_var_p->urt_tx_fifo_size) {
+        uint8_t byte;
+
+        if (!uart_transmit_ring_get(&uart_var_p->urt_transmit_queue, &byte)) {
+            break;
+        }
+
+        WRITE_MMIO_REGISTER(&uart_mmio_registers_p->DATA, byte);
+        tx_fifo_length ++;
+        room_made = true;
+    }
+
+    if (uart_transmit_ring_is_empty(&uart_var_p->urt_transmit_queue)) {
+        reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->CTRL);
+        reg_value &= ~LPUART_CTRL_TIE_MASK;
+        WRITE_MMIO_REGISTER(&uart_mmio_registers_p->CTRL, reg_value);
+    }
+
+    if (room_made && uart_var_p->urt_transmit_queue_writer_waiting) {
+        uart_var_p->urt_transmit_queue_writer_waiting = false;
+        rtos_semaphore_signal(&uart_var_p->urt_transmit_queue_semaphore);
+    }
+}
+
+
+/**
+ * Moves all the bytes in the Rx FIFO to the receive queue. It is invoked
+ * from the LPUART interrupt handler.
+ */
+static void uart_drain_rx_fifo(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+
+    for ( ; ; ) {
+        reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->WATER);
+        uint_fast8_t rx_fifo_length = GET_BIT_FIELD(reg_value,
+                                                    LPUART_WATER_RXCOUNT_MASK,
+                                                    LPUART_WATER_RXCOUNT_SHIFT);
+        if (rx_fifo_length == 0) {
+            break;
+        }
+
+        D_ASSERT(rx_fifo_length <= uart_var_p->urt_rx_fifo_size);
+        do {
+            uint8_t byte = (uint8_t)READ_MMIO_REGISTER(&uart_mmio_registers_p->DATA);
+
+            if (!byte_ring_buffer_write_non_blocking(&uart_var_p->urt_receive_queue,
+                                                     byte)) {
+                uart_var_p->urt_received_bytes_dropped ++;
+            }
+
+            rx_fifo_length --;
+        } while (rx_fifo_length != 0);
+    }
+}
+
+
+static void uart_irq_handler(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+
+    D_ASSERT(uart_var_p != NULL);
+    D_ASSERT(uart_var_p->urt_initialized);
+
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->STAT);
+
+    /*
+     * Clear receive error flags, if any. The receiver stops storing bytes
+     * in the Rx FIFO while the overrun flag is set:
+     */
+    uint32_t error_flags = reg_value & UART_STAT_ERROR_FLAGS_MASK;
+
+    if (error_flags != 0) {
+        uart_var_p->urt_errors ++;
+        WRITE_MMIO_REGISTER(&uart_mmio_registers_p->STAT,
+                            (reg_value & ~UART_STAT_W1C_FLAGS_MASK) | error_flags);
+    }
+
+    /*
+     * Check if this interrupt was triggered by "Receive data register full",
+     * which is asserted when the Rx FIFO goes above the Rx watermark, or when
+     * the Rx line goes idle with bytes still in the Rx FIFO:
+     */
+    if ((reg_value & LPUART_STAT_RDRF_MASK) != 0) {
+        uart_drain_rx_fifo(uart_device_p);
+    }
+
+    /*
+     * Check if this interrupt was triggered by "Transmit data register
+     * empty", which is asserted when the Tx FIFO goes at or below the Tx
+     * watermark, while the Tx interrupt is enabled:
+     */
+    if ((reg_value & LPUART_STAT_TDRE_MASK) != 0 &&
+        (READ_MMIO_REGISTER(&uart_mmio_registers_p->CTRL) & LPUART_CTRL_TIE_MASK) != 0) {
+        uart_fill_tx_fifo(uart_device_p);
+    }
+}
+
+
+/**
+ * ISR for the LPUART0 interrupt
+ */
+void lpuart0_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    bool old_writable = set_writable_background_region(true);
+    uart_irq_handler(&g_uart_devices[0]);
+    (void)set_writable_background_region(old_writable);
+    rtos_exit_isr();
+}
+
+
+#ifdef UART_TX_USE_DMA
+/**
+ * Handles the end of a DMA transfer from the transmit queue of a UART,
+ * by removing the bytes transferred from the queue and starting the next
+ * transfer, if the queue is not empty yet.
+ */
+static void uart_tx_dma_irq_handler(const struct uart_device *uart_device_p)
+{
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    struct uart_transmit_ring *ring_p = &uart_var_p->urt_transmit_queue;
+
+    WRITE_MMIO_REGISTER(&DMA0->CINT, uart_device_p->urt_tx_dma_channel);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    D_ASSERT(uart_var_p->urt_tx_dma_transfer_length != 0);
+    D_ASSERT(uart_var_p->urt_tx_dma_transfer_length <=
+             uart_transmit_ring_length(ring_p));
+    ring_p->read_count += uart_var_p->urt_tx_dma_transfer_length;
+    uart_var_p->urt_tx_dma_transfer_length = 0;
+    if (!uart_transmit_ring_is_empty(ring_p)) {
+        uart_tx_dma_start_transfer(uart_device_p);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    if (uart_var_p->urt_transmit_queue_writer_waiting) {
+        uart_var_p->urt_transmit_queue_writer_waiting = false;
+        rtos_semaphore_signal(&uart_var_p->urt_transmit_queue_semaphore);
+    }
+}
+
+
+/**
+ * ISR for the LPUART0's Tx DMA channel interrupt
+ */
+void lpuart0_tx_dma_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    bool old_writable = set_writable_background_region(true);
+    uart_tx_dma_irq_handler(&g_uart_devices[0]);
+    (void)set_writable_background_region(old_writable);
+    rtos_exit_isr();
+}
+#endif /* UART_TX_USE_DMA */
+
+
+/**
+ * Send a character over a UART serial port, doing polling until the
+ * character gets transmitted.
+ */
+void uart_putchar(const struct uart_device *uart_device_p, uint8_t c)
+{
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+    struct mpu_region_descriptor old_region;
+    uint32_t reg_value;
+
+    if (!uart_var_p->urt_initialized) {
+        return;
+    }
+
+    set_private_data_region(uart_mmio_registers_p,
+                            sizeof(*uart_mmio_registers_p),
+                            READ_WRITE, &old_region);
+
+    /*
+     * Do polling until there is room in the UART's Tx FIFO:
+     */
+    for ( ; ; ) {
+        reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->STAT);
+        if ((reg_value & LPUART_STAT_TDRE_MASK) != 0) {
+            break;
+        }
+    }
+
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->DATA, c);
+    restore_private_data_region(&old_region);
+}
+
+
+/**
+ * Send a character over a UART serial port, through the UART's transmit
+ * queue, which is drained into the UART's Tx FIFO by the LPUART interrupt
+ * handler or by the Tx DMA channel. If the transmit queue is full, the
+ * caller blocks until room is made in it, so the CPU is not held polling.
+ *
+ * NOTE: Calls to this function for a given UART must be serialized (for
+ * the console, only the console output task calls it).
+ */
+void uart_putchar_with_interrupts(const struct uart_device *uart_device_p,
+                                  uint8_t c)
+{
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    struct mpu_region_descriptor old_region;
+    uint32_t int_mask;
+
+    D_ASSERT(uart_var_p->urt_initialized);
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+    bool old_writable = set_writable_background_region(true);
+
+    for ( ; ; ) {
+        int_mask = disable_cpu_interrupts();
+        if (uart_transmit_ring_put(&uart_var_p->urt_transmit_queue, c)) {
+            break;
+        }
+
+        /*
+         * Transmit queue full: wait for room to be made in it:
+         */
+        uart_var_p->urt_transmit_queue_writer_waiting = true;
+        restore_cpu_interrupts(int_mask);
+        rtos_semaphore_wait(&uart_var_p->urt_transmit_queue_semaphore);
+    }
+
+#ifdef UART_TX_USE_DMA
+    /*
+     * Start a DMA transfer, unless one is already in progress, in which
+     * case the DMA interrupt handler starts the next one:
+     */
+    if (uart_var_p->urt_tx_dma_transfer_length == 0) {
+        set_private_data_region(DMA0, sizeof(*DMA0), READ_WRITE, &old_region);
+        uart_tx_dma_start_transfer(uart_device_p);
+        restore_private_data_region(&old_region);
+    }
+#else
+    /*
+     * Enable generation of Tx interrupts, so that the interrupt handler
+     * drains the transmit queue:
+     */
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+    uint32_t reg_value;
+
+    set_private_data_region(uart_mmio_registers_p,
+                            sizeof(*uart_mmio_registers_p),
+                            READ_WRITE, &old_region);
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->CTRL);
+    reg_value |= LPUART_CTRL_TIE_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->CTRL, reg_value);
+    restore_private_data_region(&old_region);
+#endif
+
+    restore_cpu_interrupts(int_mask);
+    (void)set_writable_background_region(old_writable);
+}
+
+
+/**
+ * Receive a character from a UART serial port, blocking the caller
+ * if there are no characters to read
+ */
+uint8_t uart_getchar(const struct uart_device *uart_device_p)
+{
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    uint8_t c;
+
+    D_ASSERT(uart_var_p->urt_initialized);
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+    c = byte_ring_buffer_read(&uart_var_p->urt_receive_queue);
+    return c;
+}
+
+
+/**
+ * Reads the next character received from a UART serial port, doing polling
+ * until the character is received.
+ *
+ * NOTE: This function is to be used only when interrupts are disabled.
+ */
+uint8_t uart_getchar_with_polling(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+    struct mpu_region_descriptor old_region;
+
+    D_ASSERT(uart_var_p->urt_initialized);
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+
+    set_private_data_region(uart_mmio_registers_p,
+                            sizeof(*uart_mmio_registers_p),
+                            READ_WRITE, &old_region);
+
+    /*
+     * Do polling until the UART's Rx FIFO is not empty:
+     */
+    for ( ; ; ) {
+        reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->WATER);
+        if ((reg_value & LPUART_WATER_RXCOUNT_MASK) != 0) {
+            break;
+        }
+    }
+
+    uint8_t byte_received = (uint8_t)READ_MMIO_REGISTER(&uart_mmio_registers_p->DATA);
+
+    restore_private_data_region(&old_region);
+    return byte_received;
+}
+
+
+/**
+ * Reads the next character received on a UART, if any.
+ *
+ * If no character has been received, it returns right away with -1.
+ *
+ * NOTE: This function is to be used only if interrupts are disabled.
+ *
+ * @return: ASCII code of the character received, on success
+ * @return: -1, if no character was available to read from the UART.
+ */
+int uart_getchar_non_blocking(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    LPUART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_uart_p;
+    struct mpu_region_descriptor old_region;
+    int c;
+
+    D_ASSERT(uart_var_p->urt_initialized);
+
+    set_private_data_region(uart_mmio_registers_p,
+                            sizeof(*uart_mmio_registers_p),
+                            READ_ONLY, &old_region);
+
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->WATER);
+    if ((reg_value & LPUART_WATER_RXCOUNT_MASK) != 0) {
+        /*
+         * Read next byte received:
+         */
+        c = (uint8_t)READ_MMIO_REGISTER(&uart_mmio_registers_p->DATA);
+    } else {
+        c = -1;
+    }
+
+    restore_private_data_region(&old_region);
+    return c;
+}
@@ -28,9 +28,20 @@ struct uart_device {
     volatile uint32_t *urt_mmio_tx_port_pcr_p;
     volatile uint32_t *urt_mmio_rx_port_pcr_p;
     uint32_t urt_mmio_pin_mux_selector_mask;
+    volatile uint32_t *urt_mmio_clock_gate_reg_p;
     uint32_t urt_mmio_clock_gate_mask;
+
+    /**
+     * Value of the PCC PCS field that selects the LPUART's functional clock
+     */
+    uint32_t urt_clock_source_selector;
     uint32_t urt_source_clock_freq_in_hz;
 	IRQn_Type urt_irq_num;
+#ifdef UART_TX_USE_DMA
+    uint8_t urt_tx_dma_channel;
+    uint8_t urt_tx_dma_request_source;
+    IRQn_Type urt_tx_dma_irq_num;
+#endif
 };
 
 
@@ -45,8 +56,13 @@ void uart_putchar(
     const struct uart_device *uart_device_p,
     uint8_t c);
 
+void uart_putchar_with_interrupts(const struct uart_device *uart_device_p,
+                                  uint8_t c);
+
 uint8_t uart_getchar(const struct uart_device *uart_device_p);
 
+uint8_t uart_getchar_with_polling(const struct uart_device *uart_device_p);
+
 int uart_getchar_non_blocking(const struct uart_device *uart_device_p);
 
 extern const struct uart_device g_uart_devices[];
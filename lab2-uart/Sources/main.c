@@ -5,23 +5,117 @@
 #include <fsl_device_registers.h>
 #include <board.h>
 #include <fsl_debug_console.h>
+#include <stdlib.h>
+#include <string.h>
 #include "embedded_debug.h"
+#include "uart_bench.h"
+
+/**
+ * Maximum length of a command line
+ */
+#define COMMAND_LINE_MAX_LENGTH     32
+
+/**
+ * Reads a command line from the debug UART, echoing it back
+ */
+static void read_command_line(char *buffer, size_t buffer_size)
+{
+    size_t length = 0;
+
+    for ( ; ; ) {
+        int c = GETCHAR();
+
+        if (c == '\r' || c == '\n') {
+            if (length != 0) {
+                break;
+            }
+
+            continue;
+        }
+
+        if (length < buffer_size - 1) {
+            buffer[length] = (char)c;
+            length ++;
+            PUTCHAR(c);
+        }
+    }
+
+    buffer[length] = '\0';
+    PRINTF("\r\n");
+}
+
+
+/**
+ * Runs a 'bench <irq|dma> <baud rate>' command. Once the board replies
+ * READY, the sender switches to the given baud rate, and every byte it
+ * sends is echoed back, until the line is idle for
+ * UART_BENCH_IDLE_TIMEOUT_MS. The board then switches back to the console
+ * baud rate and prints the counters of the run.
+ */
+static void run_bench_command(char *args)
+{
+    enum uart_bench_modes mode;
+    struct uart_bench_stats stats;
+    char *mode_s = strtok(args, " ");
+    char *baud_rate_s = strtok(NULL, " ");
+    uint32_t baud_rate;
+
+    if (mode_s == NULL || baud_rate_s == NULL) {
+        PRINTF("ERROR: usage: bench <irq|dma> <baud rate>\r\n");
+        return;
+    }
+
+    if (strcmp(mode_s, "irq") == 0) {
+        mode = UART_BENCH_MODE_INTERRUPT;
+    } else if (strcmp(mode_s, "dma") == 0) {
+        mode = UART_BENCH_MODE_DMA;
+    } else {
+        PRINTF("ERROR: invalid mode: %s\r\n", mode_s);
+        return;
+    }
+
+    baud_rate = strtoul(baud_rate_s, NULL, 10);
+    if (baud_rate == 0) {
+        PRINTF("ERROR: invalid baud rate: %s\r\n", baud_rate_s);
+        return;
+    }
+
+    PRINTF("READY %s %u\r\n", mode_s, baud_rate);
+    if (!uart_bench_run(mode, baud_rate, &stats)) {
+        PRINTF("ERROR: unsupported baud rate: %u\r\n", baud_rate);
+        return;
+    }
+
+    PRINTF("RESULT mode=%s baud=%u rx=%u tx=%u overrun=%u framing=%u "
+           "noise=%u parity=%u ring_overflow=%u dma_error=%u ms=%u\r\n",
+           mode_s, baud_rate, stats.rx_bytes, stats.tx_bytes,
+           stats.overrun_errors, stats.framing_errors, stats.noise_errors,
+           stats.parity_errors, stats.ring_overflows, stats.dma_errors,
+           stats.elapsed_ms);
+}
+
 
 int main(void)
 {
+    char command_line[COMMAND_LINE_MAX_LENGTH];
+
     hardware_init();
     dbg_uart_init();
+    uart_bench_init();
 
-    PRINTF("lab2 - UART: hello world\n");
+    PRINTF("lab2 - UART: hello world\r\n");
 
     /*  Never leave main */
     for ( ; ; ) {
-        /*
-         * TODO: Read characters from the UART and echo them back
-         */
+        PRINTF("> ");
+        read_command_line(command_line, sizeof command_line);
+        if (strncmp(command_line, "bench ", 6) == 0) {
+            run_bench_command(command_line + 6);
+        } else {
+            PRINTF("ERROR: unknown command: %s\r\n", command_line);
+        }
     }
 
     ASSERT(false);
     return 0;
 }
-
@@ -0,0 +1,440 @@
+/*
+ * uart_bench.c - UART echo throughput benchmark
+ *
+ * @author: German Rivera
+ */
+#include "uart_bench.h"
+#include "embedded_debug.h"
+#include <fsl_device_registers.h>
+#include <fsl_clock_manager.h>
+#include <board.h>
+
+/**
+ * Size of the ring buffer of received bytes used in interrupt mode
+ * (must be a power of 2)
+ */
+#define UART_BENCH_RX_RING_SIZE         256
+
+/**
+ * DMA channel used in DMA mode, and DMAMUX request source for it (see
+ * KL25Z reference manual, table 3-20)
+ */
+#define UART_BENCH_DMA_CHANNEL          0
+#define DMA_REQUEST_SOURCE_UART0_RX     2
+
+/**
+ * Largest byte count of a DMA transfer (BCR is a 20-bit field)
+ */
+#define UART_BENCH_DMA_MAX_BYTE_COUNT   UINT32_C(0xfffff)
+
+/**
+ * Range of oversampling ratios supported by UART0
+ */
+#define UART0_MIN_OVERSAMPLING_RATIO    4
+#define UART0_MAX_OVERSAMPLING_RATIO    32
+
+/**
+ * Largest acceptable baud rate error (in percent)
+ */
+#define UART_BENCH_MAX_BAUD_RATE_ERROR_PERCENT  3
+
+#define UART0_S1_ERROR_FLAGS_MASK \
+        (UART0_S1_OR_MASK | UART0_S1_NF_MASK | UART0_S1_FE_MASK | \
+         UART0_S1_PF_MASK)
+
+/**
+ * State variables of the UART benchmark
+ */
+struct uart_bench {
+    enum uart_bench_modes mode;
+    uint8_t rx_ring[UART_BENCH_RX_RING_SIZE];
+
+    /**
+     * Free-running ring cursors. rx_ring_head is only written by the
+     * receive side of the ISR, and rx_ring_tail by the transmit side.
+     */
+    volatile uint32_t rx_ring_head;
+    volatile uint32_t rx_ring_tail;
+
+    /**
+     * Bytes moved by DMA transfers already completed and reloaded
+     */
+    volatile uint32_t dma_completed_bytes;
+
+    volatile uint32_t first_rx_ms;
+    volatile uint32_t last_rx_ms;
+    volatile struct uart_bench_stats stats;
+};
+
+static struct uart_bench g_uart_bench;
+
+/**
+ * Milliseconds since uart_bench_init() was called
+ */
+static volatile uint32_t g_ms_ticks;
+
+
+void SysTick_Handler(void)
+{
+    g_ms_ticks ++;
+}
+
+
+/**
+ * Initializes the UART benchmark
+ */
+void uart_bench_init(void)
+{
+    (void)SysTick_Config(CLOCK_SYS_GetCoreClockFreq() / 1000);
+
+    /*
+     * Enable clocks for the DMA engine and the DMA request multiplexer:
+     */
+    SIM->SCGC6 |= SIM_SCGC6_DMAMUX_MASK;
+    SIM->SCGC7 |= SIM_SCGC7_DMA_MASK;
+
+    NVIC_EnableIRQ(UART0_IRQn);
+    NVIC_EnableIRQ(DMA0_IRQn);
+}
+
+
+/**
+ * Programs the baud rate of UART0, choosing the oversampling ratio that
+ * gives the smallest baud rate error
+ *
+ * @param baud_rate     baud rate to set
+ *
+ * @return true, if the baud rate can be set with an acceptable error
+ * @return false, otherwise
+ */
+static bool uart0_set_baud_rate(uint32_t baud_rate)
+{
+    uint32_t uart_clock_freq = CLOCK_SYS_GetLpsciFreq(BOARD_DEBUG_UART_INSTANCE);
+    uint32_t best_osr = 0;
+    uint32_t best_sbr = 0;
+    uint32_t best_error = UINT32_MAX;
+
+    for (uint32_t osr = UART0_MIN_OVERSAMPLING_RATIO;
+         osr <= UART0_MAX_OVERSAMPLING_RATIO; osr ++) {
+        uint32_t sbr = (uart_clock_freq + (osr * baud_rate) / 2) /
+                       (osr * baud_rate);
+
+        if (sbr == 0 || sbr > (UART0_BDH_SBR_MASK << 8 | UART0_BDL_SBR_MASK)) {
+            continue;
+        }
+
+        uint32_t actual_baud_rate = uart_clock_freq / (osr * sbr);
+        uint32_t error = (actual_baud_rate > baud_rate) ?
+                         actual_baud_rate - baud_rate :
+                         baud_rate - actual_baud_rate;
+
+        if (error < best_error) {
+            best_error = error;
+            best_osr = osr;
+            best_sbr = sbr;
+        }
+    }
+
+    if (best_error > (baud_rate / 100) * UART_BENCH_MAX_BAUD_RATE_ERROR_PERCENT) {
+        return false;
+    }
+
+    /*
+     * Sampling on both edges is required for oversampling ratios below 8:
+     */
+    if (best_osr < 8) {
+        UART0->C5 |= UART0_C5_BOTHEDGE_MASK;
+    } else {
+        UART0->C5 &= ~UART0_C5_BOTHEDGE_MASK;
+    }
+
+    UART0->C4 = (UART0->C4 & ~UART0_C4_OSR_MASK) | UART0_C4_OSR(best_osr - 1);
+    UART0->BDH = (UART0->BDH & ~UART0_BDH_SBR_MASK) | UART0_BDH_SBR(best_sbr >> 8);
+    UART0->BDL = UART0_BDL_SBR(best_sbr);
+    return true;
+}
+
+
+/**
+ * Counts the receive errors flagged in a value of UART0's S1 register
+ */
+static void uart_bench_count_rx_errors(uint8_t status)
+{
+    volatile struct uart_bench_stats *stats_p = &g_uart_bench.stats;
+
+    if (status & UART0_S1_OR_MASK) {
+        stats_p->overrun_errors ++;
+    }
+
+    if (status & UART0_S1_NF_MASK) {
+        stats_p->noise_errors ++;
+    }
+
+    if (status & UART0_S1_FE_MASK) {
+        stats_p->framing_errors ++;
+    }
+
+    if (status & UART0_S1_PF_MASK) {
+        stats_p->parity_errors ++;
+    }
+}
+
+
+/**
+ * UART0 ISR, for interrupt mode
+ */
+void UART0_IRQHandler(void)
+{
+    uint8_t status = UART0->S1;
+
+    if (status & UART0_S1_ERROR_FLAGS_MASK) {
+        uart_bench_count_rx_errors(status);
+        UART0->S1 = status & UART0_S1_ERROR_FLAGS_MASK; /* write 1 to clear */
+    }
+
+    if (status & UART0_S1_RDRF_MASK) {
+        uint8_t byte = UART0->D;
+        uint32_t head = g_uart_bench.rx_ring_head;
+
+        if (g_uart_bench.stats.rx_bytes == 0) {
+            g_uart_bench.first_rx_ms = g_ms_ticks;
+        }
+
+        g_uart_bench.stats.rx_bytes ++;
+        g_uart_bench.last_rx_ms = g_ms_ticks;
+        if (head - g_uart_bench.rx_ring_tail == UART_BENCH_RX_RING_SIZE) {
+            g_uart_bench.stats.ring_overflows ++;
+        } else {
+            g_uart_bench.rx_ring[head % UART_BENCH_RX_RING_SIZE] = byte;
+            g_uart_bench.rx_ring_head = head + 1;
+            UART0->C2 |= UART0_C2_TIE_MASK;
+            status = UART0->S1;
+        }
+    }
+
+    if ((UART0->C2 & UART0_C2_TIE_MASK) && (status & UART0_S1_TDRE_MASK)) {
+        uint32_t tail = g_uart_bench.rx_ring_tail;
+
+        if (tail != g_uart_bench.rx_ring_head) {
+            UART0->D = g_uart_bench.rx_ring[tail % UART_BENCH_RX_RING_SIZE];
+            g_uart_bench.rx_ring_tail = tail + 1;
+            g_uart_bench.stats.tx_bytes ++;
+        } else {
+            UART0->C2 &= ~UART0_C2_TIE_MASK;
+        }
+    }
+}
+
+
+/**
+ * DMA channel ISR, for DMA mode. It restarts the channel's transfer when
+ * its byte count has run out.
+ */
+void DMA0_IRQHandler(void)
+{
+    uint32_t status = DMA0->DMA[UART_BENCH_DMA_CHANNEL].DSR_BCR;
+
+    if (status & (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_BES_MASK |
+                  DMA_DSR_BCR_BED_MASK)) {
+        g_uart_bench.stats.dma_errors ++;
+    }
+
+    DMA0->DMA[UART_BENCH_DMA_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+    g_uart_bench.dma_completed_bytes += UART_BENCH_DMA_MAX_BYTE_COUNT -
+        (status & DMA_DSR_BCR_BCR_MASK);
+    DMA0->DMA[UART_BENCH_DMA_CHANNEL].DSR_BCR =
+        DMA_DSR_BCR_BCR(UART_BENCH_DMA_MAX_BYTE_COUNT);
+}
+
+
+/**
+ * Returns the number of bytes echoed so far by the DMA channel
+ */
+static uint32_t uart_bench_get_dma_bytes(void)
+{
+    uint32_t completed_bytes;
+    uint32_t byte_count;
+
+    /*
+     * Retry if a transfer was reloaded while reading:
+     */
+    do {
+        completed_bytes = g_uart_bench.dma_completed_bytes;
+        byte_count = DMA0->DMA[UART_BENCH_DMA_CHANNEL].DSR_BCR &
+                     DMA_DSR_BCR_BCR_MASK;
+    } while (completed_bytes != g_uart_bench.dma_completed_bytes);
+
+    return completed_bytes + (UART_BENCH_DMA_MAX_BYTE_COUNT - byte_count);
+}
+
+
+static void uart_bench_start_dma(void)
+{
+    uint8_t dma_channel = UART_BENCH_DMA_CHANNEL;
+
+    DMAMUX0->CHCFG[dma_channel] = 0;
+    DMA0->DMA[dma_channel].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+    DMA0->DMA[dma_channel].SAR = (uint32_t)&UART0->D;
+    DMA0->DMA[dma_channel].DAR = (uint32_t)&UART0->D;
+    DMA0->DMA[dma_channel].DSR_BCR =
+        DMA_DSR_BCR_BCR(UART_BENCH_DMA_MAX_BYTE_COUNT);
+
+    /*
+     * One byte per request (cycle steal), from the receive data register
+     * to the transmit data register (SSIZE/DSIZE of 1 means 8-bit):
+     */
+    DMA0->DMA[dma_channel].DCR = DMA_DCR_EINT_MASK | DMA_DCR_ERQ_MASK |
+                                 DMA_DCR_CS_MASK | DMA_DCR_SSIZE(1) |
+                                 DMA_DCR_DSIZE(1);
+    DMAMUX0->CHCFG[dma_channel] = DMAMUX_CHCFG_ENBL_MASK |
+                                  DMAMUX_CHCFG_SOURCE(DMA_REQUEST_SOURCE_UART0_RX);
+    UART0->C5 |= UART0_C5_RDMAE_MASK;
+}
+
+
+static void uart_bench_stop_dma(void)
+{
+    uint8_t dma_channel = UART_BENCH_DMA_CHANNEL;
+
+    UART0->C5 &= ~UART0_C5_RDMAE_MASK;
+    DMA0->DMA[dma_channel].DCR = 0;
+    DMAMUX0->CHCFG[dma_channel] = 0;
+    DMA0->DMA[dma_channel].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+}
+
+
+/**
+ * Waits for the end of a benchmark run, that is, until no byte has been
+ * received for UART_BENCH_IDLE_TIMEOUT_MS
+ *
+ * @return true, if any byte was received
+ * @return false, if no byte was received in UART_BENCH_START_TIMEOUT_MS
+ */
+static bool uart_bench_wait_run_end(void)
+{
+    uint32_t start_ms = g_ms_ticks;
+    uint32_t last_dma_bytes = 0;
+
+    for ( ; ; ) {
+        if (g_uart_bench.mode == UART_BENCH_MODE_DMA) {
+            /*
+             * Nobody else looks at the receive error flags in DMA mode, and
+             * an overrun stops the receiver until its flag is cleared:
+             */
+            uint8_t status = UART0->S1;
+
+            if (status & UART0_S1_ERROR_FLAGS_MASK) {
+                uart_bench_count_rx_errors(status);
+                UART0->S1 = status & UART0_S1_ERROR_FLAGS_MASK;
+            }
+
+            uint32_t dma_bytes = uart_bench_get_dma_bytes();
+
+            if (dma_bytes != last_dma_bytes) {
+                if (last_dma_bytes == 0) {
+                    g_uart_bench.first_rx_ms = g_ms_ticks;
+                }
+
+                g_uart_bench.last_rx_ms = g_ms_ticks;
+                last_dma_bytes = dma_bytes;
+            }
+
+            g_uart_bench.stats.rx_bytes = dma_bytes;
+            g_uart_bench.stats.tx_bytes = dma_bytes;
+        }
+
+        uint32_t now_ms = g_ms_ticks;
+
+        if (g_uart_bench.stats.rx_bytes == 0) {
+            if (now_ms - start_ms >= UART_BENCH_START_TIMEOUT_MS) {
+                return false;
+            }
+        } else if (now_ms - g_uart_bench.last_rx_ms >= UART_BENCH_IDLE_TIMEOUT_MS) {
+            return true;
+        }
+    }
+}
+
+
+/**
+ * Runs the UART echo benchmark on UART0 at a given baud rate. UART0 is set
+ * back to its current baud rate at the end of the run.
+ *
+ * @param mode          how to echo received bytes
+ * @param baud_rate     baud rate of the run
+ * @param stats_p       area where the counters of the run are returned
+ *
+ * @return true, if the run took place
+ * @return false, if the baud rate is not supported
+ */
+bool uart_bench_run(enum uart_bench_modes mode, uint32_t baud_rate,
+                    struct uart_bench_stats *stats_p)
+{
+    uint8_t saved_bdh = UART0->BDH;
+    uint8_t saved_bdl = UART0->BDL;
+    uint8_t saved_c4 = UART0->C4;
+    uint8_t saved_c5 = UART0->C5;
+    uint8_t saved_c2 = UART0->C2;
+    bool baud_rate_ok;
+
+    ASSERT(mode == UART_BENCH_MODE_INTERRUPT || mode == UART_BENCH_MODE_DMA);
+
+    /*
+     * Let the last message at the current baud rate go out, and reprogram
+     * the baud rate with the transmitter and receiver disabled:
+     */
+    while (!(UART0->S1 & UART0_S1_TC_MASK)) {
+        ;
+    }
+
+    UART0->C2 = 0;
+    baud_rate_ok = uart0_set_baud_rate(baud_rate);
+    if (!baud_rate_ok) {
+        goto exit;
+    }
+
+    g_uart_bench.mode = mode;
+    g_uart_bench.rx_ring_head = 0;
+    g_uart_bench.rx_ring_tail = 0;
+    g_uart_bench.dma_completed_bytes = 0;
+    g_uart_bench.first_rx_ms = 0;
+    g_uart_bench.last_rx_ms = 0;
+    g_uart_bench.stats = (struct uart_bench_stats){ 0 };
+
+    UART0->S1 = UART0_S1_ERROR_FLAGS_MASK;
+    if (mode == UART_BENCH_MODE_DMA) {
+        uart_bench_start_dma();
+        UART0->C2 = UART0_C2_TE_MASK | UART0_C2_RE_MASK;
+    } else {
+        UART0->C2 = UART0_C2_TE_MASK | UART0_C2_RE_MASK | UART0_C2_RIE_MASK;
+    }
+
+    if (uart_bench_wait_run_end() && mode == UART_BENCH_MODE_INTERRUPT) {
+        /*
+         * Let the ISR send the rest of the ring:
+         */
+        while (g_uart_bench.rx_ring_tail != g_uart_bench.rx_ring_head) {
+            ;
+        }
+    }
+
+    while (!(UART0->S1 & UART0_S1_TC_MASK)) {
+        ;
+    }
+
+    UART0->C2 = 0;
+    if (mode == UART_BENCH_MODE_DMA) {
+        uart_bench_stop_dma();
+    }
+
+    *stats_p = g_uart_bench.stats;
+    stats_p->elapsed_ms = g_uart_bench.last_rx_ms - g_uart_bench.first_rx_ms;
+
+exit:
+    UART0->BDH = saved_bdh;
+    UART0->BDL = saved_bdl;
+    UART0->C4 = saved_c4;
+    UART0->C5 = saved_c5;
+    UART0->C2 = saved_c2;
+    return baud_rate_ok;
+}
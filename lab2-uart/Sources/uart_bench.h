@@ -0,0 +1,74 @@
+/*
+ * uart_bench.h - UART echo throughput benchmark
+ *
+ * The benchmark echoes back every byte received on the debug UART (UART0)
+ * at a given baud rate, until the line has been idle for
+ * UART_BENCH_IDLE_TIMEOUT_MS. The host side is scripts/uart_bench.pl.
+ *
+ * @author: German Rivera
+ */
+#ifndef SOURCES_UART_BENCH_H_
+#define SOURCES_UART_BENCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Time without received bytes that ends a benchmark run (in ms)
+ */
+#define UART_BENCH_IDLE_TIMEOUT_MS      1000
+
+/**
+ * Time to wait for the first byte of a benchmark run (in ms)
+ */
+#define UART_BENCH_START_TIMEOUT_MS     10000
+
+/**
+ * Ways to echo received bytes:
+ * - UART_BENCH_MODE_INTERRUPT: the UART0 ISR queues received bytes in a
+ *   ring buffer and transmits them from there, when the transmit data
+ *   register is empty.
+ * - UART_BENCH_MODE_DMA: a DMA channel, triggered by the "receive data
+ *   register full" request of UART0, moves each received byte straight to
+ *   the transmit data register, without CPU intervention. The transmitter
+ *   is always free by then, as it drains bytes at the same rate as the
+ *   receiver fills them.
+ */
+enum uart_bench_modes {
+    UART_BENCH_MODE_INTERRUPT = 0,
+    UART_BENCH_MODE_DMA,
+};
+
+/**
+ * Counters of a benchmark run
+ */
+struct uart_bench_stats {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t overrun_errors;
+    uint32_t framing_errors;
+    uint32_t noise_errors;
+    uint32_t parity_errors;
+
+    /**
+     * Bytes dropped because the ring buffer was full (interrupt mode only)
+     */
+    uint32_t ring_overflows;
+
+    /**
+     * DMA configuration or bus errors (DMA mode only)
+     */
+    uint32_t dma_errors;
+
+    /**
+     * Time from the first to the last byte received (in ms)
+     */
+    uint32_t elapsed_ms;
+};
+
+void uart_bench_init(void);
+
+bool uart_bench_run(enum uart_bench_modes mode, uint32_t baud_rate,
+                    struct uart_bench_stats *stats_p);
+
+#endif /* SOURCES_UART_BENCH_H_ */
@@ -9,6 +9,7 @@
 #include "cortex_m_startup.h"
 #include "arm_cmsis.h"
 #include "runtime_checks.h"
+#include "rtos_wrapper.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -103,6 +104,11 @@ void SVC_Handler(void)
  */
 void DebugMonitor_Handler(void)
 {
+    /*
+     * It does not return, if the running task overflowed its stack:
+     */
+    rtos_task_stack_guard_check();
+
     D_ASSERT(false);
 
     /*
@@ -166,10 +172,10 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     /*
      * Interrupts external to the Cortex-M core
      */
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA0_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA1_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA2_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA3_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA0_IRQn)] = uart0_rx_dma_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA1_IRQn)] = uart4_rx_dma_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA2_IRQn)] = crc_32_dma_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA3_IRQn)] = dma_memcpy_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA4_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA5_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA6_IRQn)] = unexpected_irq_handler,
@@ -184,7 +190,7 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA15_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(DMA_Error_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(MCM_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(FTFE_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(FTFE_IRQn)] = nor_flash_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(Read_Collision_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LVD_LVW_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(LLWU_IRQn)] = unexpected_irq_handler,
@@ -214,8 +220,8 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     [IRQ_NUMBER_TO_VECTOR_NUMBER(CMT_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(RTC_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(RTC_Seconds_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(PIT0_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(PIT1_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(PIT0_IRQn)] = pit0_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(PIT1_IRQn)] = pit1_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(PIT2_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(PIT3_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(PDB0_IRQn)] = unexpected_irq_handler,
@@ -248,7 +254,7 @@ isr_function_t *const g_interrupt_vector_table[] __attribute__ ((section(".isr_v
     [IRQ_NUMBER_TO_VECTOR_NUMBER(CAN0_Rx_Warning_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(CAN0_Wake_Up_IRQn)] = unexpected_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(SDHC_IRQn)] = unexpected_irq_handler,
-    [IRQ_NUMBER_TO_VECTOR_NUMBER(ENET_1588_Timer_IRQn)] = unexpected_irq_handler,
+    [IRQ_NUMBER_TO_VECTOR_NUMBER(ENET_1588_Timer_IRQn)] = ethernet_mac0_ieee_1588_timer_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(ENET_Transmit_IRQn)] = ethernet_mac0_tx_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(ENET_Receive_IRQn)] = ethernet_mac0_rx_irq_handler,
     [IRQ_NUMBER_TO_VECTOR_NUMBER(ENET_Error_IRQn)] = ethernet_mac0_error_irq_handler,
@@ -13,6 +13,9 @@
 #elif defined(K64F_MCU)
 #include <MK64F12.h>
 #include <core_cm4.h>
+#elif defined(STM32F479_MCU)
+#include <stm32f479xx.h>
+#include <core_cm4.h>
 #else
 #error "No Microcontroller defined"
 #endif
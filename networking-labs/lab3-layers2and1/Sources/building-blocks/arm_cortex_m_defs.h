@@ -34,6 +34,12 @@
 #define CPU_EXC_RETURN_TO_THREAD_MODE_USING_PSP       UINT32_C(0xFFFFFFFD)
 #define CPU_EXC_RETURN_TO_THREAD_MODE_USING_PSP_FPU   UINT32_C(0xFFFFFFED)
 
+/**
+ * Bit of an exception return value that indicates that the interrupted code
+ * was using the PSP stack pointer (its exception frame is in that stack)
+ */
+#define CPU_EXC_RETURN_USING_PSP_MASK                 UINT32_C(0x4)
+
 /**
  * Tell if a return address is one of the exception return special values
  */
@@ -266,6 +272,39 @@
  */
 #define CPU_SCB_ICSR_PENDSVSET_MASK  (0x1 << 28)
 
+/*
+ * Bit-band regions of the ARMv7-M memory map. Each bit of the first 1MB of
+ * the SRAM and peripheral regions is aliased to a word in the corresponding
+ * alias region. A word write to the alias sets or clears just that bit, as
+ * a single bus operation that cannot be interrupted. Cortex-M0+ does not
+ * implement bit-banding.
+ */
+#define BIT_BAND_SRAM_REGION_BASE_ADDR          UINT32_C(0x20000000)
+#define BIT_BAND_SRAM_ALIAS_BASE_ADDR           UINT32_C(0x22000000)
+#define BIT_BAND_PERIPHERAL_REGION_BASE_ADDR    UINT32_C(0x40000000)
+#define BIT_BAND_PERIPHERAL_ALIAS_BASE_ADDR     UINT32_C(0x42000000)
+#define BIT_BAND_REGION_SIZE                    UINT32_C(0x100000)
+
+/**
+ * Tell if an address is in one of the bit-band regions
+ */
+#define IS_BIT_BAND_ADDRESS(_addr) \
+        ((uintptr_t)(_addr) - BIT_BAND_SRAM_REGION_BASE_ADDR <            \
+            BIT_BAND_REGION_SIZE ||                                       \
+         (uintptr_t)(_addr) - BIT_BAND_PERIPHERAL_REGION_BASE_ADDR <      \
+            BIT_BAND_REGION_SIZE)
+
+/**
+ * Calculate the bit-band alias word address of a bit of the (little-endian)
+ * value stored at a given address of a bit-band region. The bit index can
+ * be larger than 7, to address bits of halfwords and words.
+ */
+#define BIT_BAND_ALIAS_ADDRESS(_addr, _bit_index)                         \
+        ((volatile uint32_t *)(((uintptr_t)(_addr) & UINT32_C(0xF0000000)) + \
+                               UINT32_C(0x02000000) +                     \
+                               (((uintptr_t)(_addr) & (BIT_BAND_REGION_SIZE - 1)) << 5) + \
+                               ((uint32_t)(_bit_index) << 2)))
+
 /**
  * ARM thumb instruction
  */
@@ -9,6 +9,8 @@
 #include "microcontroller.h"
 #include "time_utils.h"
 #include "runtime_checks.h"
+#include "io_utils.h"
+#include <stddef.h>
 
 /**
  * Interrupts disabled stats variables
@@ -28,6 +30,23 @@ struct interrupts_disabled_stats {
      * Address in function that has disabled interrupts for the longest time
      */
     uintptr_t longest_interrupts_disabled_code_addr;
+
+    /**
+     * Distribution of the durations of interrupts-disabled spans
+     */
+    struct cycles_histogram histogram;
+
+    /**
+     * Call sites that have disabled interrupts for the longest times (in
+     * no particular order). Empty entries have code_addr 0.
+     */
+    struct interrupts_disabled_call_site top_call_sites[INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES];
+
+    /**
+     * Smallest max_cycles in top_call_sites[], or 0 if there are empty
+     * entries
+     */
+    uint32_t top_call_sites_min_cycles;
 };
 
 static struct interrupts_disabled_stats g_interrupts_disabled_stats = {
@@ -55,6 +74,63 @@ disable_cpu_interrupts(void)
 }
 
 
+/**
+ * Records an interrupts-disabled span in the top call sites table. Spans
+ * that are not longer than the shortest one in the table, once the table is
+ * full, are discarded without searching the table.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void record_interrupts_disabled_call_site(uintptr_t code_addr,
+                                                 uint32_t delta_cycles)
+{
+    struct interrupts_disabled_stats *const stats_p = &g_interrupts_disabled_stats;
+    struct interrupts_disabled_call_site *min_call_site_p = NULL;
+    uint_fast8_t i;
+
+    if (delta_cycles <= stats_p->top_call_sites_min_cycles) {
+        return;
+    }
+
+    for (i = 0; i < INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES; i ++) {
+        struct interrupts_disabled_call_site *call_site_p = &stats_p->top_call_sites[i];
+
+        if (call_site_p->code_addr == code_addr) {
+            if (delta_cycles > call_site_p->max_cycles) {
+                call_site_p->max_cycles = delta_cycles;
+            }
+
+            min_call_site_p = NULL;
+            break;
+        }
+
+        if (min_call_site_p == NULL ||
+            call_site_p->max_cycles < min_call_site_p->max_cycles) {
+            min_call_site_p = call_site_p;
+        }
+    }
+
+    if (min_call_site_p != NULL) {
+        /*
+         * New call site: replace the call site with the shortest span
+         * (or an empty entry):
+         */
+        min_call_site_p->code_addr = code_addr;
+        min_call_site_p->max_cycles = delta_cycles;
+    }
+
+    uint32_t min_cycles = UINT32_MAX;
+
+    for (i = 0; i < INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES; i ++) {
+        if (stats_p->top_call_sites[i].max_cycles < min_cycles) {
+            min_cycles = stats_p->top_call_sites[i].max_cycles;
+        }
+    }
+
+    stats_p->top_call_sites_min_cycles = min_cycles;
+}
+
+
 /**
  * Function that restores (and possibly enables) interrupts
  *
@@ -78,6 +154,10 @@ restore_cpu_interrupts(uint32_t old_primask)
         	g_interrupts_disabled_stats.longest_interrupts_disabled_code_addr = GET_CALL_ADDRESS(return_address);
         }
 
+        cycles_histogram_record(&g_interrupts_disabled_stats.histogram, delta_cycles);
+        record_interrupts_disabled_call_site(GET_CALL_ADDRESS(return_address),
+                                             delta_cycles);
+
         __ISB();
         __enable_irq();
     }
@@ -94,6 +174,66 @@ restore_cpu_interrupts(uint32_t old_primask)
  }
 
 
+/**
+ * Takes a snapshot of the distribution of interrupts-disabled spans and of
+ * the call sites that have disabled interrupts for the longest times
+ *
+ * @param histogram_p       Area where the histogram is to be returned
+ * @param top_call_sites    Area where the top call sites are to be returned,
+ *                          sorted from longest to shortest span. Unused
+ *                          entries have code_addr 0.
+ */
+void get_interrupts_disabled_histogram(
+        struct cycles_histogram *histogram_p,
+        struct interrupts_disabled_call_site top_call_sites[INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES])
+{
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    *histogram_p = g_interrupts_disabled_stats.histogram;
+    for (uint_fast8_t i = 0; i < INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES; i ++) {
+        top_call_sites[i] = g_interrupts_disabled_stats.top_call_sites[i];
+    }
+
+    restore_cpu_interrupts(old_primask);
+
+    /*
+     * Insertion sort by descending max_cycles:
+     */
+    for (uint_fast8_t i = 1; i < INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES; i ++) {
+        struct interrupts_disabled_call_site call_site = top_call_sites[i];
+        uint_fast8_t j = i;
+
+        for ( ; j > 0 && top_call_sites[j - 1].max_cycles < call_site.max_cycles; j --) {
+            top_call_sites[j] = top_call_sites[j - 1];
+        }
+
+        top_call_sites[j] = call_site;
+    }
+}
+
+
+/**
+ * Clears the distribution of interrupts-disabled spans and the top call
+ * sites table. The maximum interrupts disabled time to date is kept.
+ */
+void reset_interrupts_disabled_histogram(void)
+{
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    for (uint_fast8_t i = 0; i < CYCLES_HISTOGRAM_NUM_BUCKETS; i ++) {
+        g_interrupts_disabled_stats.histogram.buckets[i] = 0;
+    }
+
+    for (uint_fast8_t i = 0; i < INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES; i ++) {
+        g_interrupts_disabled_stats.top_call_sites[i].code_addr = 0;
+        g_interrupts_disabled_stats.top_call_sites[i].max_cycles = 0;
+    }
+
+    g_interrupts_disabled_stats.top_call_sites_min_cycles = 0;
+    restore_cpu_interrupts(old_primask);
+}
+
+
 /**
  * Increments atomically the 32-bit value stored in *counter_p, and returns the
  * original value.
@@ -160,6 +300,156 @@ atomic_fetch_sub_uint32(volatile uint32_t *counter_p, uint32_t value)
 }
 
 
+/**
+ * Atomically "and" the 32-bit value stored in *counter_p with 'value',
+ * and returns the original value.
+ *
+ * @param   counter_p: Pointer to the value to be updated.
+ *
+ * @param   value: Mask to "and" with.
+ *
+ * @return  value of *counter_p prior to the update.
+ */
+uint32_t
+atomic_fetch_and_uint32(volatile uint32_t *counter_p, uint32_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    uint32_t old_value;
+
+    do {
+    old_value = __LDREXW(counter_p);
+    } while (__STREXW(old_value & value, counter_p) != 0);
+
+    return old_value;
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_value = *counter_p;
+
+    *counter_p &= value;
+
+    restore_cpu_interrupts(old_primask);
+    return old_value;
+#endif
+}
+
+
+/**
+ * Atomically "or" the 32-bit value stored in *counter_p with 'value',
+ * and returns the original value.
+ *
+ * @param   counter_p: Pointer to the value to be updated.
+ *
+ * @param   value: Mask to "or" with.
+ *
+ * @return  value of *counter_p prior to the update.
+ */
+uint32_t
+atomic_fetch_or_uint32(volatile uint32_t *counter_p, uint32_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    uint32_t old_value;
+
+    do {
+    old_value = __LDREXW(counter_p);
+    } while (__STREXW(old_value | value, counter_p) != 0);
+
+    return old_value;
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t old_value = *counter_p;
+
+    *counter_p |= value;
+
+    restore_cpu_interrupts(old_primask);
+    return old_value;
+#endif
+}
+
+
+/**
+ * Atomically replaces the 32-bit value stored in *value_p with 'new_value',
+ * if it is equal to 'old_value'.
+ *
+ * @param   value_p: Pointer to the value to be updated.
+ *
+ * @param   old_value: Expected current value.
+ *
+ * @param   new_value: Value to be stored.
+ *
+ * @return  true, if the value was replaced
+ * @return  false, if the current value was not 'old_value'
+ */
+bool
+atomic_compare_and_swap_uint32(volatile uint32_t *value_p,
+                               uint32_t old_value,
+                               uint32_t new_value)
+{
+#if (__CORTEX_M >= 0x03)
+    do {
+        if (__LDREXW(value_p) != old_value) {
+            __CLREX();
+            return false;
+        }
+    } while (__STREXW(new_value, value_p) != 0);
+
+    return true;
+#else
+    bool swapped = false;
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    if (*value_p == old_value) {
+        *value_p = new_value;
+        swapped = true;
+    }
+
+    restore_cpu_interrupts(old_primask);
+    return swapped;
+#endif
+}
+
+
+/**
+ * Atomically sets a bit in a 32-bit bit vector
+ *
+ * @param   bit_vector_p: Pointer to the bit vector.
+ *
+ * @param   bit_index: Index of the bit to set.
+ *
+ * @return  true, if the bit was clear before
+ * @return  false, if the bit was already set
+ */
+bool
+atomic_test_and_set_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index)
+{
+    D_ASSERT(bit_index < 32);
+
+    uint32_t old_value = atomic_fetch_or_uint32(bit_vector_p, BIT(bit_index));
+
+    return (old_value & BIT(bit_index)) == 0;
+}
+
+
+/**
+ * Atomically clears a bit in a 32-bit bit vector
+ *
+ * @param   bit_vector_p: Pointer to the bit vector.
+ *
+ * @param   bit_index: Index of the bit to clear.
+ *
+ * @return  true, if the bit was set before
+ * @return  false, if the bit was already clear
+ */
+bool
+atomic_test_and_clear_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index)
+{
+    D_ASSERT(bit_index < 32);
+
+    uint32_t old_value = atomic_fetch_and_uint32(bit_vector_p, ~BIT(bit_index));
+
+    return (old_value & BIT(bit_index)) != 0;
+}
+
+
 /**
  * Increments atomically the 16-bit value stored in *counter_p, and returns the
  * original value.
@@ -226,6 +516,72 @@ atomic_fetch_sub_uint16(volatile uint16_t *counter_p, uint16_t value)
 }
 
 
+/**
+ * Atomically "or" the 16-bit value stored in *counter_p with 'value',
+ * and returns the original value.
+ *
+ * @param   counter_p: Pointer to the value to be updated.
+ *
+ * @param   value: Mask to "or" with.
+ *
+ * @return  value of *counter_p prior to the update.
+ */
+uint16_t
+atomic_fetch_or_uint16(volatile uint16_t *counter_p, uint16_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    uint16_t old_value;
+
+    do {
+    old_value = __LDREXH(counter_p);
+    } while (__STREXH(old_value | value, counter_p) != 0);
+
+    return old_value;
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint16_t old_value = *counter_p;
+
+    *counter_p |= value;
+
+    restore_cpu_interrupts(old_primask);
+    return old_value;
+#endif
+}
+
+
+/**
+ * Atomically "and" the 16-bit value stored in *counter_p with 'value',
+ * and returns the original value.
+ *
+ * @param   counter_p: Pointer to the value to be updated.
+ *
+ * @param   value: Mask to "and" with.
+ *
+ * @return  value of *counter_p prior to the update.
+ */
+uint16_t
+atomic_fetch_and_uint16(volatile uint16_t *counter_p, uint16_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    uint16_t old_value;
+
+    do {
+    old_value = __LDREXH(counter_p);
+    } while (__STREXH(old_value & value, counter_p) != 0);
+
+    return old_value;
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint16_t old_value = *counter_p;
+
+    *counter_p &= value;
+
+    restore_cpu_interrupts(old_primask);
+    return old_value;
+#endif
+}
+
+
 /**
  * Increments atomically the 8-bit value stored in *counter_p, and returns the
  * original value.
@@ -290,3 +646,244 @@ atomic_fetch_sub_uint8(volatile uint8_t *counter_p, uint8_t value)
     return old_value;
 #endif
 }
+
+
+/**
+ * Returns a pointer to the link field of a node of an atomic stack
+ */
+static inline void *volatile *atomic_stack_node_link(const struct atomic_stack *stack_p,
+                                                     void *node_p)
+{
+    return (void *volatile *)((uintptr_t)node_p + stack_p->link_offset);
+}
+
+
+/**
+ * Initializes an atomic stack as empty
+ *
+ * @param   stack_p: Pointer to the stack.
+ *
+ * @param   link_offset: Offset of the link field (a pointer) in the nodes
+ *          (as given by offsetof()).
+ */
+void
+atomic_stack_init(struct atomic_stack *stack_p, size_t link_offset)
+{
+    D_ASSERT(link_offset <= UINT16_MAX &&
+             link_offset % sizeof(void *) == 0);
+
+    stack_p->top_p = NULL;
+    stack_p->link_offset = link_offset;
+}
+
+
+/**
+ * Pushes a node on an atomic stack. It can be called from ISRs.
+ *
+ * @param   stack_p: Pointer to the stack.
+ *
+ * @param   node_p: Pointer to the node.
+ */
+void
+atomic_stack_push(struct atomic_stack *stack_p, void *node_p)
+{
+    void *volatile *link_p = atomic_stack_node_link(stack_p, node_p);
+
+#if (__CORTEX_M >= 0x03)
+    void *top_p;
+
+    do {
+        top_p = (void *)__LDREXW((volatile uint32_t *)&stack_p->top_p);
+        *link_p = top_p;
+    } while (__STREXW((uint32_t)node_p,
+                      (volatile uint32_t *)&stack_p->top_p) != 0);
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    *link_p = stack_p->top_p;
+    stack_p->top_p = node_p;
+
+    restore_cpu_interrupts(old_primask);
+#endif
+}
+
+
+/**
+ * Pops the node at the top of an atomic stack. It can be called from ISRs.
+ *
+ * @param   stack_p: Pointer to the stack.
+ *
+ * @return  pointer to the node popped (with its link field set to NULL),
+ *          or NULL if the stack was empty.
+ */
+void *
+atomic_stack_pop(struct atomic_stack *stack_p)
+{
+    void *top_p;
+
+#if (__CORTEX_M >= 0x03)
+    void *next_p;
+
+    do {
+        top_p = (void *)__LDREXW((volatile uint32_t *)&stack_p->top_p);
+        if (top_p == NULL) {
+            __CLREX();
+            return NULL;
+        }
+
+        next_p = *atomic_stack_node_link(stack_p, top_p);
+    } while (__STREXW((uint32_t)next_p,
+                      (volatile uint32_t *)&stack_p->top_p) != 0);
+#else
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    top_p = stack_p->top_p;
+    if (top_p != NULL) {
+        stack_p->top_p = *atomic_stack_node_link(stack_p, top_p);
+    }
+
+    restore_cpu_interrupts(old_primask);
+    if (top_p == NULL) {
+        return NULL;
+    }
+#endif
+
+    *atomic_stack_node_link(stack_p, top_p) = NULL;
+    return top_p;
+}
+
+
+/**
+ * Initializes an atomic MPMC queue as empty
+ *
+ * @param   queue_p: Pointer to the queue.
+ *
+ * @param   entries_p: Array of entries for the queue.
+ *
+ * @param   num_entries: Number of entries in entries_p (must be a power
+ *          of 2).
+ */
+void
+atomic_mpmc_queue_init(struct atomic_mpmc_queue *queue_p,
+                       struct atomic_mpmc_queue_entry *entries_p,
+                       uint32_t num_entries)
+{
+    D_ASSERT(num_entries >= 2 && (num_entries & (num_entries - 1)) == 0);
+
+    for (uint32_t i = 0; i < num_entries; i ++) {
+        entries_p[i].sequence = i;
+        entries_p[i].data_p = NULL;
+    }
+
+    queue_p->signature = ATOMIC_MPMC_QUEUE_SIGNATURE;
+    queue_p->entries_p = entries_p;
+    queue_p->index_mask = num_entries - 1;
+    queue_p->enqueue_pos = 0;
+    queue_p->dequeue_pos = 0;
+}
+
+
+/**
+ * Adds a pointer at the end of an atomic MPMC queue, if the queue is not
+ * full. It can be called from ISRs.
+ *
+ * @param   queue_p: Pointer to the queue.
+ *
+ * @param   data_p: Pointer to be added.
+ *
+ * @return  true, if the pointer was added
+ * @return  false, if the queue was full
+ */
+bool
+atomic_mpmc_queue_enqueue(struct atomic_mpmc_queue *queue_p, void *data_p)
+{
+    struct atomic_mpmc_queue_entry *entry_p;
+    uint32_t pos;
+
+    D_ASSERT(queue_p->signature == ATOMIC_MPMC_QUEUE_SIGNATURE);
+    for ( ; ; ) {
+        pos = queue_p->enqueue_pos;
+        entry_p = &queue_p->entries_p[pos & queue_p->index_mask];
+
+        int32_t diff = (int32_t)(entry_p->sequence - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_and_swap_uint32(&queue_p->enqueue_pos,
+                                               pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /*
+             * The entry has not been read yet since the last time around:
+             */
+            return false;
+        }
+
+        /*
+         * Another producer got ahead of us, so try again with the new
+         * enqueue position.
+         */
+    }
+
+    entry_p->data_p = data_p;
+
+    /*
+     * Make the pointer visible before publishing the entry to consumers:
+     */
+    __DMB();
+    entry_p->sequence = pos + 1;
+    return true;
+}
+
+
+/**
+ * Removes the pointer at the head of an atomic MPMC queue, if the queue is
+ * not empty. It can be called from ISRs.
+ *
+ * @param   queue_p: Pointer to the queue.
+ *
+ * @param   data_p: Area where the pointer removed is to be returned.
+ *
+ * @return  true, if a pointer was removed
+ * @return  false, if the queue was empty
+ */
+bool
+atomic_mpmc_queue_dequeue(struct atomic_mpmc_queue *queue_p, void **data_p)
+{
+    struct atomic_mpmc_queue_entry *entry_p;
+    uint32_t pos;
+
+    D_ASSERT(queue_p->signature == ATOMIC_MPMC_QUEUE_SIGNATURE);
+    for ( ; ; ) {
+        pos = queue_p->dequeue_pos;
+        entry_p = &queue_p->entries_p[pos & queue_p->index_mask];
+
+        int32_t diff = (int32_t)(entry_p->sequence - (pos + 1));
+
+        if (diff == 0) {
+            if (atomic_compare_and_swap_uint32(&queue_p->dequeue_pos,
+                                               pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /*
+             * The entry has not been written yet:
+             */
+            return false;
+        }
+
+        /*
+         * Another consumer got ahead of us, so try again with the new
+         * dequeue position.
+         */
+    }
+
+    *data_p = entry_p->data_p;
+
+    /*
+     * Finish reading the entry before releasing it to producers:
+     */
+    __DMB();
+    entry_p->sequence = pos + queue_p->index_mask + 1;
+    return true;
+}
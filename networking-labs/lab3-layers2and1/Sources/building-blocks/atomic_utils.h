@@ -9,7 +9,33 @@
 #define SOURCES_BUILDING_BLOCKS_ATOMIC_UTILS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "compile_time_checks.h"
+#include "microcontroller.h"
+#include "time_utils.h"
+
+/**
+ * Number of code locations that have disabled interrupts for the longest
+ * times that are tracked
+ */
+#define INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES  8
+
+/**
+ * Code location that disabled interrupts
+ */
+struct interrupts_disabled_call_site {
+    /**
+     * Address in the function that restored interrupts
+     */
+    uintptr_t code_addr;
+
+    /**
+     * Maximum number of CPU cycles that interrupts have been disabled by
+     * this call site
+     */
+    uint32_t max_cycles;
+};
 
 #define ATOMIC_POST_INCREMENT_UINT32(_counter_p) \
         atomic_fetch_add_uint32(_counter_p, 1)
@@ -33,24 +59,208 @@
         ((void *)atomic_fetch_add_uint32(                               \
                     (uint32_t *)&(_pointer_p), sizeof(*(_pointer_p))))
 
+#define ATOMIC_COMPARE_AND_SWAP_POINTER(_pointer_p, _old_value, _new_value)  \
+        atomic_compare_and_swap_uint32((volatile uint32_t *)(_pointer_p),     \
+                                       (uint32_t)(_old_value),                \
+                                       (uint32_t)(_new_value))
+
 C_ASSERT(sizeof(void *) == sizeof(uint32_t));
 
+/**
+ * Lock-free LIFO list (Treiber stack) of caller-defined nodes. Nodes are
+ * linked through a pointer field embedded in them, at offset 'link_offset'.
+ * Nodes are never copied and the stack never allocates memory.
+ *
+ * On Cortex-M3/M4, push and pop are LDREX/STREX loops on the top pointer.
+ * Pop reads the next pointer of the top node between the LDREX and the
+ * STREX. This is ABA-safe, as any other push or pop in between can only
+ * happen from an exception handler or another thread, and the local
+ * exclusive monitor is cleared on every exception entry and return, so the
+ * STREX fails and the loop retries. On Cortex-M0+, which lacks LDREX/STREX,
+ * interrupts are disabled around the update instead.
+ */
+struct atomic_stack {
+    /**
+     * Node at the top of the stack or NULL if the stack is empty
+     */
+    void *volatile top_p;
+
+    /**
+     * Offset of the link field (a void pointer) in the nodes
+     */
+    uint16_t link_offset;
+};
+
+/**
+ * Entry of a lock-free bounded MPMC queue
+ */
+struct atomic_mpmc_queue_entry {
+    /**
+     * Sequence number that tells if the entry is ready to be written (it
+     * equals the enqueue position) or to be read (it equals the enqueue
+     * position plus 1)
+     */
+    volatile uint32_t sequence;
+
+    void *volatile data_p;
+};
+
+/**
+ * Lock-free bounded multi-producer/multi-consumer FIFO queue of pointers.
+ *
+ * Producers claim an entry by advancing 'enqueue_pos' with compare-and-swap,
+ * and publish it by updating the entry's sequence number after storing the
+ * pointer. Consumers do the same with 'dequeue_pos'. A producer or consumer
+ * preempted between claiming and publishing an entry does not block others:
+ * they see the queue as full or empty (for that entry) and return, so the
+ * queue can be used from ISRs and threads alike. Entries are caller-allocated
+ * and their number must be a power of 2.
+ */
+struct atomic_mpmc_queue {
+#   define ATOMIC_MPMC_QUEUE_SIGNATURE  GEN_SIGNATURE('A', 'M', 'Q', 'U')
+    uint32_t signature;
+
+    struct atomic_mpmc_queue_entry *entries_p;
+
+    /**
+     * Number of entries minus 1
+     */
+    uint32_t index_mask;
+
+    /**
+     * Free-running position of the next entry to be written
+     */
+    volatile uint32_t enqueue_pos;
+
+    /**
+     * Free-running position of the next entry to be read
+     */
+    volatile uint32_t dequeue_pos;
+};
+
 uint32_t disable_cpu_interrupts(void);
 
 void restore_cpu_interrupts(uint32_t old_primask);
 
  void get_max_interrupts_disabled_stats_us(uint32_t *max_time_us, uintptr_t *code_addr);
 
+void get_interrupts_disabled_histogram(
+        struct cycles_histogram *histogram_p,
+        struct interrupts_disabled_call_site top_call_sites[INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES]);
+
+void reset_interrupts_disabled_histogram(void);
+
 uint32_t atomic_fetch_add_uint32(volatile uint32_t *counter_p, uint32_t value);
 
 uint32_t atomic_fetch_sub_uint32(volatile uint32_t *counter_p, uint32_t value);
 
+uint32_t atomic_fetch_and_uint32(volatile uint32_t *counter_p, uint32_t value);
+
+uint32_t atomic_fetch_or_uint32(volatile uint32_t *counter_p, uint32_t value);
+
+bool atomic_compare_and_swap_uint32(volatile uint32_t *value_p,
+                                    uint32_t old_value,
+                                    uint32_t new_value);
+
+bool atomic_test_and_set_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index);
+
+bool atomic_test_and_clear_bit(volatile uint32_t *bit_vector_p, uint8_t bit_index);
+
 uint16_t atomic_fetch_add_uint16(volatile uint16_t *counter_p, uint16_t value);
 
 uint16_t atomic_fetch_sub_uint16(volatile uint16_t *counter_p, uint16_t value);
 
+uint16_t atomic_fetch_or_uint16(volatile uint16_t *counter_p, uint16_t value);
+
+uint16_t atomic_fetch_and_uint16(volatile uint16_t *counter_p, uint16_t value);
+
 uint8_t atomic_fetch_add_uint8(volatile uint8_t *counter_p, uint8_t value);
 
 uint8_t atomic_fetch_sub_uint8(volatile uint8_t *counter_p, uint8_t value);
 
+void atomic_stack_init(struct atomic_stack *stack_p, size_t link_offset);
+
+void atomic_stack_push(struct atomic_stack *stack_p, void *node_p);
+
+void *atomic_stack_pop(struct atomic_stack *stack_p);
+
+void atomic_mpmc_queue_init(struct atomic_mpmc_queue *queue_p,
+                            struct atomic_mpmc_queue_entry *entries_p,
+                            uint32_t num_entries);
+
+bool atomic_mpmc_queue_enqueue(struct atomic_mpmc_queue *queue_p, void *data_p);
+
+bool atomic_mpmc_queue_dequeue(struct atomic_mpmc_queue *queue_p, void **data_p);
+
+#if (__CORTEX_M >= 0x03)
+/**
+ * Sets a bit of a word in a bit-band region (typically a peripheral
+ * register), with a single store to the bit's bit-band alias. Unlike a
+ * read-modify-write of the word, it needs no lock and cannot race with
+ * updates of other bits of the word from ISRs.
+ *
+ * @param word_p    Pointer to the word (must be in a bit-band region)
+ * @param bit_index Index of the bit in the word
+ */
+static inline void bit_band_set_bit(volatile uint32_t *word_p, uint8_t bit_index)
+{
+    *BIT_BAND_ALIAS_ADDRESS(word_p, bit_index) = 1;
+}
+
+
+/**
+ * Clears a bit of a word in a bit-band region (typically a peripheral
+ * register), with a single store to the bit's bit-band alias.
+ *
+ * @param word_p    Pointer to the word (must be in a bit-band region)
+ * @param bit_index Index of the bit in the word
+ */
+static inline void bit_band_clear_bit(volatile uint32_t *word_p, uint8_t bit_index)
+{
+    *BIT_BAND_ALIAS_ADDRESS(word_p, bit_index) = 0;
+}
+#endif
+
+
+/**
+ * Atomically sets a flag bit of a halfword. If the halfword is in a bit-band
+ * region, this is a single store to the bit's bit-band alias. Otherwise, it
+ * falls back to atomic_fetch_or_uint16().
+ *
+ * @param flags_p   Pointer to the halfword
+ * @param flag_mask Mask of the flag (it must have a single bit set)
+ */
+static inline void atomic_set_flag_uint16(volatile uint16_t *flags_p, uint16_t flag_mask)
+{
+#if (__CORTEX_M >= 0x03)
+    if (IS_BIT_BAND_ADDRESS(flags_p)) {
+        *BIT_BAND_ALIAS_ADDRESS(flags_p, __builtin_ctz(flag_mask)) = 1;
+        return;
+    }
+#endif
+
+    (void)atomic_fetch_or_uint16(flags_p, flag_mask);
+}
+
+
+/**
+ * Atomically clears a flag bit of a halfword. If the halfword is in a
+ * bit-band region, this is a single store to the bit's bit-band alias.
+ * Otherwise, it falls back to atomic_fetch_and_uint16().
+ *
+ * @param flags_p   Pointer to the halfword
+ * @param flag_mask Mask of the flag (it must have a single bit set)
+ */
+static inline void atomic_clear_flag_uint16(volatile uint16_t *flags_p, uint16_t flag_mask)
+{
+#if (__CORTEX_M >= 0x03)
+    if (IS_BIT_BAND_ADDRESS(flags_p)) {
+        *BIT_BAND_ALIAS_ADDRESS(flags_p, __builtin_ctz(flag_mask)) = 0;
+        return;
+    }
+#endif
+
+    (void)atomic_fetch_and_uint16(flags_p, ~flag_mask);
+}
+
 #endif /* SOURCES_BUILDING_BLOCKS_ATOMIC_UTILS_H_ */
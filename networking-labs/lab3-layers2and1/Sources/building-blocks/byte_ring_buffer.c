@@ -9,98 +9,367 @@
 #include "runtime_checks.h"
 #include "rtos_wrapper.h"
 #include "atomic_utils.h"
+#include "mem_utils.h"
+#include <string.h>
 
 /**
  * Initialize a byte ring buffer
  *
  * @param ring_buffer_p pointer to the ring buffer
+ * @param data_area_p   pointer to the data area of the ring buffer
+ * @param num_entries   size of the data area (must be a power of 2, so that
+ *                      indices wrap around with a mask)
  */
 void byte_ring_buffer_init(struct byte_ring_buffer *ring_buffer_p,
                            uint8_t *data_area_p,
                            uint16_t num_entries)
 {
     D_ASSERT(data_area_p != NULL);
-    D_ASSERT(num_entries != 0);
+    D_ASSERT(IS_POWER_OF_2(num_entries));
 
     ring_buffer_p->signature = BYTE_RING_BUFF_SIGNATURE;
     ring_buffer_p->data_area_p = data_area_p;
-    ring_buffer_p->data_area_end_p = data_area_p + num_entries;
-    ring_buffer_p->write_cursor_p = data_area_p;
-    ring_buffer_p->read_cursor_p = data_area_p;
+    ring_buffer_p->write_index = 0;
+    ring_buffer_p->read_index = 0;
     ring_buffer_p->num_entries = num_entries;
     ring_buffer_p->num_entries_filled = 0;
+    ring_buffer_p->num_producers_waiting = 0;
+    ring_buffer_p->num_consumers_waiting = 0;
     rtos_semaphore_init(&ring_buffer_p->producer_semaphore, "ring buffer producer semaphore",
-                        num_entries);
+                        0);
     rtos_semaphore_init(&ring_buffer_p->consumer_semaphore, "ring buffer consumer semaphore",
                         0);
 }
 
 
 /**
- * Write to next available entry in the given byte ring buffer.
- * If it is full, the caller will block until an entry becomes available.
+ * Wakes up the tasks waiting on one side of a byte ring buffer, so that they
+ * re-check the state of the ring buffer. It must be called with interrupts
+ * enabled, after the caller took the count of waiters with interrupts
+ * disabled.
+ */
+static void wake_up_waiters(struct rtos_semaphore *semaphore_p,
+                            uint_fast8_t num_waiters)
+{
+    for ( ; num_waiters != 0; num_waiters --) {
+        rtos_semaphore_signal(semaphore_p);
+    }
+}
+
+
+/**
+ * Copies bytes to the free entries of a byte ring buffer, doing at most two
+ * memcpy's (one before and one after the wrap-around point). It must be
+ * called with interrupts disabled.
+ *
+ * @return number of bytes copied
+ */
+static size_t copy_to_ring_buffer(struct byte_ring_buffer *ring_buffer_p,
+                                  const uint8_t *data_p,
+                                  size_t num_bytes)
+{
+    size_t num_free = ring_buffer_p->num_entries - ring_buffer_p->num_entries_filled;
+
+    if (num_bytes > num_free) {
+        num_bytes = num_free;
+    }
+
+    size_t write_index = ring_buffer_p->write_index;
+    size_t first_span = ring_buffer_p->num_entries - write_index;
+
+    if (first_span > num_bytes) {
+        first_span = num_bytes;
+    }
+
+    memcpy(&ring_buffer_p->data_area_p[write_index], data_p, first_span);
+    if (num_bytes > first_span) {
+        memcpy(ring_buffer_p->data_area_p, data_p + first_span,
+               num_bytes - first_span);
+    }
+
+    ring_buffer_p->write_index = (write_index + num_bytes) &
+                                 (ring_buffer_p->num_entries - 1);
+    ring_buffer_p->num_entries_filled += num_bytes;
+    return num_bytes;
+}
+
+
+/**
+ * Copies bytes from the filled entries of a byte ring buffer, doing at most
+ * two memcpy's (one before and one after the wrap-around point). It must be
+ * called with interrupts disabled.
+ *
+ * @return number of bytes copied
+ */
+static size_t copy_from_ring_buffer(struct byte_ring_buffer *ring_buffer_p,
+                                    uint8_t *buffer_p,
+                                    size_t buffer_size)
+{
+    size_t num_bytes = ring_buffer_p->num_entries_filled;
+
+    if (num_bytes > buffer_size) {
+        num_bytes = buffer_size;
+    }
+
+    size_t read_index = ring_buffer_p->read_index;
+    size_t first_span = ring_buffer_p->num_entries - read_index;
+
+    if (first_span > num_bytes) {
+        first_span = num_bytes;
+    }
+
+    memcpy(buffer_p, &ring_buffer_p->data_area_p[read_index], first_span);
+    if (num_bytes > first_span) {
+        memcpy(buffer_p + first_span, ring_buffer_p->data_area_p,
+               num_bytes - first_span);
+    }
+
+    ring_buffer_p->read_index = (read_index + num_bytes) &
+                                (ring_buffer_p->num_entries - 1);
+    ring_buffer_p->num_entries_filled -= num_bytes;
+    return num_bytes;
+}
+
+
+/**
+ * Writes a sequence of bytes to the given byte ring buffer. If there is not
+ * enough room in the buffer, the caller blocks until all the bytes have
+ * been written.
  *
  * @param ring_buffer_p pointer to the byte ring buffer
- * @param byte value to write to the ring buffer
+ * @param data_p        pointer to the bytes to write
+ * @param num_bytes     number of bytes to write
  */
-void byte_ring_buffer_write(struct byte_ring_buffer *ring_buffer_p, uint8_t byte)
+void byte_ring_buffer_write_bulk(struct byte_ring_buffer *ring_buffer_p,
+                                 const uint8_t *data_p, size_t num_bytes)
 {
     D_ASSERT(ring_buffer_p->signature == BYTE_RING_BUFF_SIGNATURE);
     D_ASSERT(ring_buffer_p->num_entries_filled <= ring_buffer_p->num_entries);
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
 
-    rtos_semaphore_wait(&ring_buffer_p->producer_semaphore);
-    D_ASSERT(ring_buffer_p->num_entries_filled < ring_buffer_p->num_entries);
+    while (num_bytes != 0) {
+        uint32_t old_primask = disable_cpu_interrupts();
+        size_t num_copied = copy_to_ring_buffer(ring_buffer_p, data_p, num_bytes);
 
-    uint32_t old_primask = disable_cpu_interrupts();
+        if (num_copied == 0) {
+            /*
+             * Buffer full: wait for a consumer to make room in it:
+             */
+            ring_buffer_p->num_producers_waiting ++;
+            restore_cpu_interrupts(old_primask);
+            rtos_semaphore_wait(&ring_buffer_p->producer_semaphore);
+            continue;
+        }
 
-    *ring_buffer_p->write_cursor_p++ = byte;
-    if (ring_buffer_p->write_cursor_p == ring_buffer_p->data_area_end_p) {
-        ring_buffer_p->write_cursor_p = ring_buffer_p->data_area_p;
+        uint_fast8_t num_consumers_waiting = ring_buffer_p->num_consumers_waiting;
+
+        ring_buffer_p->num_consumers_waiting = 0;
+        restore_cpu_interrupts(old_primask);
+        wake_up_waiters(&ring_buffer_p->consumer_semaphore, num_consumers_waiting);
+        data_p += num_copied;
+        num_bytes -= num_copied;
     }
+}
 
-    ring_buffer_p->num_entries_filled ++;
+
+/**
+ * Writes as many bytes as fit in the given byte ring buffer, without
+ * blocking. It can be called from an ISR.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param data_p        pointer to the bytes to write
+ * @param num_bytes     number of bytes to write
+ *
+ * @return number of bytes written
+ */
+size_t byte_ring_buffer_write_bulk_non_blocking(struct byte_ring_buffer *ring_buffer_p,
+                                                const uint8_t *data_p,
+                                                size_t num_bytes)
+{
+    D_ASSERT(ring_buffer_p->signature == BYTE_RING_BUFF_SIGNATURE);
+    D_ASSERT(ring_buffer_p->num_entries_filled <= ring_buffer_p->num_entries);
+
+    uint32_t old_primask = disable_cpu_interrupts();
+    size_t num_copied = copy_to_ring_buffer(ring_buffer_p, data_p, num_bytes);
+    uint_fast8_t num_consumers_waiting = 0;
+
+    if (num_copied != 0) {
+        num_consumers_waiting = ring_buffer_p->num_consumers_waiting;
+        ring_buffer_p->num_consumers_waiting = 0;
+    }
 
     restore_cpu_interrupts(old_primask);
-    rtos_semaphore_signal(&ring_buffer_p->consumer_semaphore);
+    wake_up_waiters(&ring_buffer_p->consumer_semaphore, num_consumers_waiting);
+    return num_copied;
 }
 
 
 /**
- * Write to next available entry in the given byte ring buffer, if
- * there is room in the buffer.
+ * Writes a sequence of bytes to the given byte ring buffer, only if all of
+ * them fit in it, without blocking. It can be called from an ISR.
  *
  * @param ring_buffer_p pointer to the byte ring buffer
- * @param byte value to write to the ring buffer
+ * @param data_p        pointer to the bytes to write
+ * @param num_bytes     number of bytes to write
  *
- * @return true, if success
- * @return false, if buffer full
+ * @return true, if all the bytes were written
+ * @return false, if nothing was written, because there was not enough room
  */
-bool byte_ring_buffer_write_non_blocking(struct byte_ring_buffer *ring_buffer_p,
-                                         uint8_t byte)
+bool byte_ring_buffer_write_bulk_if_room(struct byte_ring_buffer *ring_buffer_p,
+                                         const uint8_t *data_p,
+                                         size_t num_bytes)
 {
     D_ASSERT(ring_buffer_p->signature == BYTE_RING_BUFF_SIGNATURE);
     D_ASSERT(ring_buffer_p->num_entries_filled <= ring_buffer_p->num_entries);
 
+    uint_fast8_t num_consumers_waiting = 0;
     uint32_t old_primask = disable_cpu_interrupts();
 
-    if (ring_buffer_p->num_entries_filled == ring_buffer_p->num_entries) {
+    if (num_bytes > (size_t)(ring_buffer_p->num_entries - ring_buffer_p->num_entries_filled)) {
         restore_cpu_interrupts(old_primask);
         return false;
     }
 
-    *ring_buffer_p->write_cursor_p++ = byte;
-    if (ring_buffer_p->write_cursor_p == ring_buffer_p->data_area_end_p) {
-        ring_buffer_p->write_cursor_p = ring_buffer_p->data_area_p;
+    (void)copy_to_ring_buffer(ring_buffer_p, data_p, num_bytes);
+    if (num_bytes != 0) {
+        num_consumers_waiting = ring_buffer_p->num_consumers_waiting;
+        ring_buffer_p->num_consumers_waiting = 0;
     }
 
-    ring_buffer_p->num_entries_filled ++;
-
     restore_cpu_interrupts(old_primask);
-    rtos_semaphore_signal(&ring_buffer_p->consumer_semaphore);
+    wake_up_waiters(&ring_buffer_p->consumer_semaphore, num_consumers_waiting);
     return true;
 }
 
 
+/**
+ * Writes a sequence of bytes to the given byte ring buffer without
+ * blocking, discarding the oldest bytes in the buffer to make room for
+ * them, if necessary. If more bytes than the capacity of the buffer are
+ * given, only the last ones are kept. It can be called from an ISR.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param data_p        pointer to the bytes to write
+ * @param num_bytes     number of bytes to write
+ *
+ * @return number of bytes discarded (old or new)
+ */
+size_t byte_ring_buffer_write_bulk_overwrite(struct byte_ring_buffer *ring_buffer_p,
+                                             const uint8_t *data_p,
+                                             size_t num_bytes)
+{
+    D_ASSERT(ring_buffer_p->signature == BYTE_RING_BUFF_SIGNATURE);
+    D_ASSERT(ring_buffer_p->num_entries_filled <= ring_buffer_p->num_entries);
+
+    size_t num_discarded = 0;
+    uint_fast8_t num_consumers_waiting = 0;
+
+    if (num_bytes > ring_buffer_p->num_entries) {
+        num_discarded = num_bytes - ring_buffer_p->num_entries;
+        data_p += num_discarded;
+        num_bytes = ring_buffer_p->num_entries;
+    }
+
+    uint32_t old_primask = disable_cpu_interrupts();
+    size_t num_free = ring_buffer_p->num_entries - ring_buffer_p->num_entries_filled;
+
+    if (num_bytes > num_free) {
+        /*
+         * Discard the oldest bytes, by advancing the read index:
+         */
+        size_t num_to_discard = num_bytes - num_free;
+
+        ring_buffer_p->read_index = (ring_buffer_p->read_index + num_to_discard) &
+                                    (ring_buffer_p->num_entries - 1);
+        ring_buffer_p->num_entries_filled -= num_to_discard;
+        num_discarded += num_to_discard;
+    }
+
+    (void)copy_to_ring_buffer(ring_buffer_p, data_p, num_bytes);
+    if (num_bytes != 0) {
+        num_consumers_waiting = ring_buffer_p->num_consumers_waiting;
+        ring_buffer_p->num_consumers_waiting = 0;
+    }
+
+    restore_cpu_interrupts(old_primask);
+    wake_up_waiters(&ring_buffer_p->consumer_semaphore, num_consumers_waiting);
+    return num_discarded;
+}
+
+
+/**
+ * Reads the bytes currently available in the given byte ring buffer, up to
+ * a maximum. If the ring buffer is empty, it blocks the caller until the
+ * ring buffer becomes not empty.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param buffer_p      area where the bytes read are to be returned
+ * @param buffer_size   maximum number of bytes to read
+ *
+ * @return number of bytes read (at least 1)
+ */
+size_t byte_ring_buffer_read_bulk(struct byte_ring_buffer *ring_buffer_p,
+                                  uint8_t *buffer_p, size_t buffer_size)
+{
+    D_ASSERT(ring_buffer_p->signature == BYTE_RING_BUFF_SIGNATURE);
+    D_ASSERT(ring_buffer_p->num_entries_filled <= ring_buffer_p->num_entries);
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+    D_ASSERT(buffer_size != 0);
+
+    for ( ; ; ) {
+        uint32_t old_primask = disable_cpu_interrupts();
+        size_t num_copied = copy_from_ring_buffer(ring_buffer_p, buffer_p, buffer_size);
+
+        if (num_copied == 0) {
+            /*
+             * Buffer empty: wait for a producer to fill it:
+             */
+            ring_buffer_p->num_consumers_waiting ++;
+            restore_cpu_interrupts(old_primask);
+            rtos_semaphore_wait(&ring_buffer_p->consumer_semaphore);
+            continue;
+        }
+
+        uint_fast8_t num_producers_waiting = ring_buffer_p->num_producers_waiting;
+
+        ring_buffer_p->num_producers_waiting = 0;
+        restore_cpu_interrupts(old_primask);
+        wake_up_waiters(&ring_buffer_p->producer_semaphore, num_producers_waiting);
+        return num_copied;
+    }
+}
+
+
+/**
+ * Write to next available entry in the given byte ring buffer.
+ * If it is full, the caller will block until an entry becomes available.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param byte value to write to the ring buffer
+ */
+void byte_ring_buffer_write(struct byte_ring_buffer *ring_buffer_p, uint8_t byte)
+{
+    byte_ring_buffer_write_bulk(ring_buffer_p, &byte, 1);
+}
+
+
+/**
+ * Write to next available entry in the given byte ring buffer, if
+ * there is room in the buffer.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param byte value to write to the ring buffer
+ *
+ * @return true, if success
+ * @return false, if buffer full
+ */
+bool byte_ring_buffer_write_non_blocking(struct byte_ring_buffer *ring_buffer_p,
+                                         uint8_t byte)
+{
+    return byte_ring_buffer_write_bulk_non_blocking(ring_buffer_p, &byte, 1) == 1;
+}
+
+
 /**
  * Read to next filled entry in the given byte ring buffer, if the ring buffer
  * is not empty. Otherwise, it blocks the caller until the ring buffer becomes
@@ -113,22 +382,178 @@ bool byte_ring_buffer_write_non_blocking(struct byte_ring_buffer *ring_buffer_p,
  */
 uint8_t byte_ring_buffer_read(struct byte_ring_buffer *ring_buffer_p)
 {
-    D_ASSERT(ring_buffer_p->signature == BYTE_RING_BUFF_SIGNATURE);
-    D_ASSERT(ring_buffer_p->num_entries_filled <= ring_buffer_p->num_entries);
+    uint8_t byte;
 
-    rtos_semaphore_wait(&ring_buffer_p->consumer_semaphore);
-    D_ASSERT(ring_buffer_p->num_entries_filled != 0);
+    (void)byte_ring_buffer_read_bulk(ring_buffer_p, &byte, 1);
+    return byte;
+}
 
-    uint32_t old_primask = disable_cpu_interrupts();
 
-    uint8_t byte = *ring_buffer_p->read_cursor_p++;
-    if (ring_buffer_p->read_cursor_p == ring_buffer_p->data_area_end_p) {
-        ring_buffer_p->read_cursor_p = ring_buffer_p->data_area_p;
+/**
+ * Initialize a single-producer/single-consumer byte ring buffer
+ *
+ * @param ring_buffer_p pointer to the ring buffer
+ * @param data_area_p   pointer to the data area of the ring buffer
+ * @param num_entries   size of the data area (must be a power of 2)
+ */
+void spsc_byte_ring_buffer_init(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                uint8_t *data_area_p,
+                                uint32_t num_entries)
+{
+    D_ASSERT(data_area_p != NULL);
+    D_ASSERT(IS_POWER_OF_2(num_entries));
+
+    ring_buffer_p->signature = SPSC_BYTE_RING_BUFF_SIGNATURE;
+    ring_buffer_p->data_area_p = data_area_p;
+    ring_buffer_p->index_mask = num_entries - 1;
+    ring_buffer_p->write_index = 0;
+    ring_buffer_p->read_index = 0;
+    ring_buffer_p->consumer_waiting = false;
+    ring_buffer_p->producer_waiting = false;
+    rtos_signal_init(&ring_buffer_p->producer_signal, NULL);
+    rtos_signal_init(&ring_buffer_p->consumer_signal, NULL);
+}
+
+
+/**
+ * Write a byte to a single-producer/single-consumer byte ring buffer, if
+ * there is room in the buffer. It can be called from an ISR.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param byte value to write to the ring buffer
+ *
+ * @return true, if success
+ * @return false, if buffer full
+ */
+bool spsc_byte_ring_buffer_write_non_blocking(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                              uint8_t byte)
+{
+    D_ASSERT(ring_buffer_p->signature == SPSC_BYTE_RING_BUFF_SIGNATURE);
+
+    uint32_t write_index = ring_buffer_p->write_index;
+
+    if (write_index - ring_buffer_p->read_index > ring_buffer_p->index_mask) {
+        return false;
     }
 
-    ring_buffer_p->num_entries_filled --;
+    ring_buffer_p->data_area_p[write_index & ring_buffer_p->index_mask] = byte;
+
+    /*
+     * Make the byte visible before publishing the new write index, and
+     * publish the new write index before checking if the consumer is
+     * waiting (the consumer does the mirror sequence):
+     */
+    __DMB();
+    ring_buffer_p->write_index = write_index + 1;
+    __DMB();
+    if (ring_buffer_p->consumer_waiting) {
+        ring_buffer_p->consumer_waiting = false;
+        rtos_signal_signal(&ring_buffer_p->consumer_signal);
+    }
+
+    return true;
+}
+
+
+/**
+ * Write a byte to a single-producer/single-consumer byte ring buffer.
+ * If it is full, the caller blocks until an entry becomes available.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param byte value to write to the ring buffer
+ */
+void spsc_byte_ring_buffer_write(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                 uint8_t byte)
+{
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+    while (!spsc_byte_ring_buffer_write_non_blocking(ring_buffer_p, byte)) {
+        ring_buffer_p->producer_waiting = true;
+        __DMB();
+
+        /*
+         * Re-check after announcing that we are waiting, in case the
+         * consumer made room before seeing our flag:
+         */
+        if (ring_buffer_p->write_index - ring_buffer_p->read_index <=
+            ring_buffer_p->index_mask) {
+            ring_buffer_p->producer_waiting = false;
+            continue;
+        }
+
+        rtos_signal_wait(&ring_buffer_p->producer_signal);
+    }
+}
+
+
+/**
+ * Read a byte from a single-producer/single-consumer byte ring buffer, if
+ * the ring buffer is not empty. It can be called from an ISR.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ * @param byte_p        area where the byte read is to be returned
+ *
+ * @return true, if success
+ * @return false, if buffer empty
+ */
+bool spsc_byte_ring_buffer_read_non_blocking(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                             uint8_t *byte_p)
+{
+    D_ASSERT(ring_buffer_p->signature == SPSC_BYTE_RING_BUFF_SIGNATURE);
+
+    uint32_t read_index = ring_buffer_p->read_index;
+
+    if (read_index == ring_buffer_p->write_index) {
+        return false;
+    }
+
+    /*
+     * Do not read the byte before seeing the producer's write index, and
+     * finish reading the byte before giving its entry back to the producer:
+     */
+    __DMB();
+    *byte_p = ring_buffer_p->data_area_p[read_index & ring_buffer_p->index_mask];
+    __DMB();
+    ring_buffer_p->read_index = read_index + 1;
+    __DMB();
+    if (ring_buffer_p->producer_waiting) {
+        ring_buffer_p->producer_waiting = false;
+        rtos_signal_signal(&ring_buffer_p->producer_signal);
+    }
+
+    return true;
+}
+
+
+/**
+ * Read a byte from a single-producer/single-consumer byte ring buffer. If
+ * the ring buffer is empty, the caller blocks until a byte is written.
+ *
+ * @param ring_buffer_p pointer to the byte ring buffer
+ *
+ * @return byte value read from the ring buffer
+ */
+uint8_t spsc_byte_ring_buffer_read(struct spsc_byte_ring_buffer *ring_buffer_p)
+{
+    uint8_t byte;
+
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+    while (!spsc_byte_ring_buffer_read_non_blocking(ring_buffer_p, &byte)) {
+        ring_buffer_p->consumer_waiting = true;
+        __DMB();
+
+        /*
+         * Re-check after announcing that we are waiting, in case the
+         * producer wrote a byte before seeing our flag:
+         */
+        if (ring_buffer_p->read_index != ring_buffer_p->write_index) {
+            ring_buffer_p->consumer_waiting = false;
+            continue;
+        }
+
+        rtos_signal_wait(&ring_buffer_p->consumer_signal);
+    }
 
-    restore_cpu_interrupts(old_primask);
-    rtos_semaphore_signal(&ring_buffer_p->producer_semaphore);
     return byte;
 }
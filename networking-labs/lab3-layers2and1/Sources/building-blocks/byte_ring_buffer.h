@@ -9,6 +9,7 @@
 #define SOURCES_BYTE_RING_BUFFER_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include "rtos_wrapper.h"
 
 /**
@@ -21,28 +22,22 @@ struct byte_ring_buffer
 
     /**
      * Pointer to data area of the ring buffer. The size of this area
-     * must be 'num'_entries' bytes.
+     * must be 'num_entries' bytes.
      */
     uint8_t *data_area_p;
 
     /**
-      * Pointer to one byte after the last byte of the data area of the ring
-      * buffer.
-      */
-     uint8_t *data_area_end_p;
-
-    /**
-     * Pointer to the next entry to fill in the ring buffer
+     * Index of the next entry to fill in the ring buffer
      */
-    uint8_t *write_cursor_p;
+    uint16_t write_index;
 
     /**
-     * Pointer to the next entry to read from the ring buffer
+     * Index of the next entry to read from the ring buffer
      */
-    uint8_t *read_cursor_p;
+    uint16_t read_index;
 
     /**
-     * Total number of entries in the ring buffer
+     * Total number of entries in the ring buffer (a power of 2)
      */
     uint16_t num_entries;
 
@@ -52,16 +47,77 @@ struct byte_ring_buffer
     uint16_t num_entries_filled;
 
     /**
-     * Producer-side semaphore
+     * Number of producers waiting for room in the ring buffer
+     */
+    uint8_t num_producers_waiting;
+
+    /**
+     * Number of consumers waiting for the ring buffer to become non-empty
+     */
+    uint8_t num_consumers_waiting;
+
+    /**
+     * Producer-side semaphore. It is signaled only when there are producers
+     * waiting, once for each waiting producer.
      */
     struct rtos_semaphore producer_semaphore;
 
     /**
-     * Consumer-side semaphore
+     * Consumer-side semaphore. It is signaled only when there are consumers
+     * waiting, once for each waiting consumer.
      */
     struct rtos_semaphore consumer_semaphore;
 };
 
+/**
+ * Single-producer/single-consumer ring buffer of bytes. Producer and
+ * consumer each own one index, so no interrupt masking is needed, as long
+ * as there is only one producer (task or ISR) and one consumer (task or
+ * ISR). A blocked consumer (producer) is woken up only when the buffer
+ * goes from empty to non-empty (from full to non-full).
+ */
+struct spsc_byte_ring_buffer
+{
+#   define      SPSC_BYTE_RING_BUFF_SIGNATURE  GEN_SIGNATURE('S', 'P', 'S', 'C')
+    uint32_t    signature;
+
+    /**
+     * Pointer to data area of the ring buffer. The size of this area must
+     * be a power of 2.
+     */
+    uint8_t *data_area_p;
+
+    /**
+     * Size of the data area minus 1
+     */
+    uint32_t index_mask;
+
+    /**
+     * Free-running count of bytes written (only updated by the producer)
+     */
+    volatile uint32_t write_index;
+
+    /**
+     * Free-running count of bytes read (only updated by the consumer)
+     */
+    volatile uint32_t read_index;
+
+    /**
+     * Flags set by a consumer (producer) about to block, because the ring
+     * buffer is empty (full)
+     */
+    volatile bool consumer_waiting;
+    volatile bool producer_waiting;
+
+    /**
+     * Signals to wake up the blocked producer and consumer. There is at
+     * most one task on each side, so single-waiter signals are used instead
+     * of semaphores.
+     */
+    struct rtos_signal producer_signal;
+    struct rtos_signal consumer_signal;
+};
+
 void byte_ring_buffer_init(struct byte_ring_buffer *ring_buffer_p,
                            uint8_t *data_area_p,
                            uint16_t num_entries);
@@ -73,4 +129,37 @@ bool byte_ring_buffer_write_non_blocking(struct byte_ring_buffer *ring_buffer_p,
 
 uint8_t byte_ring_buffer_read(struct byte_ring_buffer *ring_buffer_p);
 
+void byte_ring_buffer_write_bulk(struct byte_ring_buffer *ring_buffer_p,
+                                 const uint8_t *data_p, size_t num_bytes);
+
+size_t byte_ring_buffer_write_bulk_non_blocking(struct byte_ring_buffer *ring_buffer_p,
+                                                const uint8_t *data_p,
+                                                size_t num_bytes);
+
+bool byte_ring_buffer_write_bulk_if_room(struct byte_ring_buffer *ring_buffer_p,
+                                         const uint8_t *data_p,
+                                         size_t num_bytes);
+
+size_t byte_ring_buffer_write_bulk_overwrite(struct byte_ring_buffer *ring_buffer_p,
+                                             const uint8_t *data_p,
+                                             size_t num_bytes);
+
+size_t byte_ring_buffer_read_bulk(struct byte_ring_buffer *ring_buffer_p,
+                                  uint8_t *buffer_p, size_t buffer_size);
+
+void spsc_byte_ring_buffer_init(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                uint8_t *data_area_p,
+                                uint32_t num_entries);
+
+bool spsc_byte_ring_buffer_write_non_blocking(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                              uint8_t byte);
+
+void spsc_byte_ring_buffer_write(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                 uint8_t byte);
+
+bool spsc_byte_ring_buffer_read_non_blocking(struct spsc_byte_ring_buffer *ring_buffer_p,
+                                             uint8_t *byte_p);
+
+uint8_t spsc_byte_ring_buffer_read(struct spsc_byte_ring_buffer *ring_buffer_p);
+
 #endif /* SOURCES_BYTE_RING_BUFFER_H_ */
@@ -9,6 +9,36 @@
 #include "runtime_checks.h"
 #include "runtime_log.h"
 #include "gpio_driver.h"
+#include "mem_utils.h"
+#include "atomic_utils.h"
+#include "io_utils.h"
+#include "microcontroller.h"
+#include <string.h>
+
+/**
+ * FTM0 paces blink patterns. It counts the bus clock divided by 128, and
+ * wraps around every COLOR_LED_BLINK_TICK_MS milliseconds.
+ */
+#define BLINK_FTM_PRESCALER_SELECTOR    7
+#define BLINK_FTM_COUNTER_FREQ_IN_HZ    (MCU_BUS_CLOCK_FREQ_IN_HZ / 128)
+#define BLINK_FTM_MODULO \
+        ((BLINK_FTM_COUNTER_FREQ_IN_HZ / 1000) * COLOR_LED_BLINK_TICK_MS - 1)
+
+C_ASSERT(BLINK_FTM_MODULO <= UINT16_MAX);
+
+/**
+ * eDMA channels that write blink patterns to the LED ports (channels 0 to 3
+ * are used by the UARTs' Rx DMA mode, the CRC accelerator and dma_memcpy)
+ */
+#define BLINK_PORT_B_DMA_CHANNEL        4
+#define BLINK_PORT_E_DMA_CHANNEL        5
+
+/**
+ * DMAMUX request sources of FTM0 channels 0 and 1 (see K64F reference
+ * manual, table 3-24)
+ */
+#define DMA_REQUEST_SOURCE_FTM0_CH0     20
+#define DMA_REQUEST_SOURCE_FTM0_CH1     21
 
 enum rgb_led_pins {
     RED_LED_PIN = 0,
@@ -37,12 +67,58 @@ static const struct gpio_pin g_rgb_led_pins[] = {
                                           false),
 };
 
+/**
+ * LED pins of each pin port used by the RGB LED. Each LED color is a bit
+ * mask of the pins to activate, so the pins of a port are updated with a
+ * single register write.
+ *
+ * The RGB LED pins have no FTM channel function, so blinking is done by an
+ * eDMA channel per port, that on every compare event of an FTM0 channel
+ * writes the next word of a pattern table to the port's toggle register
+ * (PTOR). Once started, a blink pattern runs without any CPU intervention.
+ */
+static const struct rgb_led_port {
+    pin_port_t pin_port;
+    uint32_t pins_mask;
+    GPIO_Type *gpio_regs_p;
+    uint8_t blink_ftm_channel;
+    uint8_t blink_dma_channel;
+    uint8_t blink_dma_request_source;
+} g_rgb_led_ports[] = {
+    {
+        .pin_port = PIN_PORT_B,
+        .pins_mask = RGB_LED_RED_PIN_MASK | RGB_LED_BLUE_PIN_MASK,
+        .gpio_regs_p = PTB,
+        .blink_ftm_channel = 0,
+        .blink_dma_channel = BLINK_PORT_B_DMA_CHANNEL,
+        .blink_dma_request_source = DMA_REQUEST_SOURCE_FTM0_CH0,
+    },
+
+    {
+        .pin_port = PIN_PORT_E,
+        .pins_mask = RGB_LED_GREEN_PIN_MASK,
+        .gpio_regs_p = PTE,
+        .blink_ftm_channel = 1,
+        .blink_dma_channel = BLINK_PORT_E_DMA_CHANNEL,
+        .blink_dma_request_source = DMA_REQUEST_SOURCE_FTM0_CH1,
+    },
+};
+
+#define NUM_RGB_LED_PORTS   ARRAY_SIZE(g_rgb_led_ports)
+
 /**
  * State variables of a multi-color LED
  */
 struct color_led {
     bool initialized;
+    bool blinking;
     led_color_t current_color;
+
+    /**
+     * Blink pattern table of each LED port: word i is the mask of the port's
+     * pins to toggle at tick i of the pattern. It is read by the DMA engine.
+     */
+    uint32_t blink_patterns[NUM_RGB_LED_PORTS][COLOR_LED_BLINK_MAX_TICKS];
 };
 
 static struct color_led g_color_led = {
@@ -61,15 +137,102 @@ void color_led_init(void)
     D_ASSERT(!g_color_led.initialized);
 
     for (int i = 0; i < NUM_RGB_LED_PINS; i++) {
+        /*
+         * color_led_set() relies on all LED pins being active low:
+         */
+        D_ASSERT(!g_rgb_led_pins[i].pin_is_active_high);
         gpio_configure_pin(&g_rgb_led_pins[i], 0, true);
         gpio_deactivate_output_pin(&g_rgb_led_pins[i]);
     }
 
+    /*
+     * Enable clocks for FTM0, the DMA engine and the DMA request multiplexer:
+     */
+    uint32_t reg_value = READ_MMIO_REGISTER(&SIM_SCGC6);
+
+    reg_value |= SIM_SCGC6_FTM0_MASK | SIM_SCGC6_DMAMUX_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC6, reg_value);
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC7);
+    reg_value |= SIM_SCGC7_DMA_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC7, reg_value);
+
+    /*
+     * FTM0 is left stopped until a blink pattern is started. Each channel
+     * used is in software compare mode (no pin output), matching when the
+     * counter wraps around, and generating a DMA request instead of an
+     * interrupt:
+     */
+    WRITE_MMIO_REGISTER(&FTM0->SC, 0);
+    WRITE_MMIO_REGISTER(&FTM0->CNTIN, 0);
+    WRITE_MMIO_REGISTER(&FTM0->MOD, BLINK_FTM_MODULO);
+    for (unsigned int i = 0; i < NUM_RGB_LED_PORTS; i++) {
+        const struct rgb_led_port *port_p = &g_rgb_led_ports[i];
+        uint8_t dma_channel = port_p->blink_dma_channel;
+
+        WRITE_MMIO_REGISTER(&FTM0->CONTROLS[port_p->blink_ftm_channel].CnV, 0);
+        WRITE_MMIO_REGISTER(&FTM0->CONTROLS[port_p->blink_ftm_channel].CnSC,
+                            FTM_CnSC_MSA_MASK | FTM_CnSC_CHIE_MASK |
+                            FTM_CnSC_DMA_MASK);
+
+        /*
+         * The pattern table is walked in a circle: at the end of the major
+         * loop the source address goes back to the beginning of the table,
+         * and the request is left enabled (no DREQ):
+         */
+        WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel], 0);
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SOFF, sizeof(uint32_t));
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].ATTR,
+                            DMA_ATTR_SSIZE(2) | DMA_ATTR_DSIZE(2));
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].NBYTES_MLNO,
+                            sizeof(uint32_t));
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DADDR,
+                            (uint32_t)&port_p->gpio_regs_p->PTOR);
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DOFF, 0);
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DLAST_SGA, 0);
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CSR, 0);
+        WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel],
+                            DMAMUX_CHCFG_ENBL_MASK |
+                            DMAMUX_CHCFG_SOURCE(port_p->blink_dma_request_source));
+    }
+
     g_color_led.current_color = LED_COLOR_BLACK;
+    g_color_led.blinking = false;
     g_color_led.initialized = true;
 }
 
 
+/**
+ * Stops the blink pattern in progress, if any, leaving the LED pins in
+ * whatever state they were left by the last toggle
+ */
+static void color_led_blink_stop(void)
+{
+    if (!g_color_led.blinking) {
+        return;
+    }
+
+    WRITE_MMIO_REGISTER(&FTM0->SC, 0);
+    for (unsigned int i = 0; i < NUM_RGB_LED_PORTS; i++) {
+        const struct rgb_led_port *port_p = &g_rgb_led_ports[i];
+
+        WRITE_MMIO_REGISTER(&DMA0->CERQ, port_p->blink_dma_channel);
+
+        /*
+         * Clear a compare event that may be pending, so that it does not
+         * trigger a DMA request when the next pattern is started:
+         */
+        uint32_t reg_value =
+            READ_MMIO_REGISTER(&FTM0->CONTROLS[port_p->blink_ftm_channel].CnSC);
+
+        reg_value &= ~FTM_CnSC_CHF_MASK;
+        WRITE_MMIO_REGISTER(&FTM0->CONTROLS[port_p->blink_ftm_channel].CnSC,
+                            reg_value);
+    }
+
+    g_color_led.blinking = false;
+}
+
+
 /**
  * Set the current color of the multi-color LED
  *
@@ -86,13 +249,18 @@ led_color_t color_led_set(led_color_t new_color)
         return old_color;
     }
 
-    for (int i = 0; i < NUM_RGB_LED_PINS; i++) {
-        if (g_rgb_led_pins[i].pin_bit_mask & new_color_mask) {
-            gpio_activate_output_pin(&g_rgb_led_pins[i]);
-        } else {
-            gpio_deactivate_output_pin(&g_rgb_led_pins[i]);
-        }
+    color_led_blink_stop();
+
+    /*
+     * LED pins are active low, so the pins of the new color are set low and
+     * all others high:
+     */
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_rgb_led_ports); i++) {
+        gpio_write_port_pins(g_rgb_led_ports[i].pin_port,
+                             g_rgb_led_ports[i].pins_mask,
+                             ~new_color_mask);
     }
+
     g_color_led.current_color = new_color;
     return old_color;
 }
@@ -103,12 +271,96 @@ void color_led_toggle(led_color_t color)
 	uint32_t color_mask = color;
 
     D_ASSERT(g_color_led.initialized);
+    D_ASSERT(!g_color_led.blinking);
 
-    for (int i = 0; i < NUM_RGB_LED_PINS; i++) {
-        if (g_rgb_led_pins[i].pin_bit_mask & color_mask) {
-            gpio_toggle_output_pin(&g_rgb_led_pins[i]);
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_rgb_led_ports); i++) {
+        uint32_t pins_mask = g_rgb_led_ports[i].pins_mask & color_mask;
+
+        if (pins_mask != 0) {
+            gpio_toggle_port_pins(g_rgb_led_ports[i].pin_port, pins_mask);
         }
     }
 
     g_color_led.current_color ^= color;
 }
+
+
+/**
+ * Starts blinking the multi-color LED with a given pattern, replacing the
+ * current color or blink pattern. The pattern is repeated until the LED is
+ * set to a steady color with color_led_set() or another pattern is started.
+ *
+ * @param color             color to blink
+ * @param phases_ms         durations of the phases of the pattern (in ms).
+ *                          Phases alternate between 'color' and black,
+ *                          starting with 'color'. Each duration is rounded
+ *                          down to a multiple of COLOR_LED_BLINK_TICK_MS,
+ *                          and it must be at least one tick.
+ * @param num_phases        number of phases (an even number, so that the
+ *                          LED is black again at the end of the pattern)
+ */
+void color_led_blink(led_color_t color, const uint16_t phases_ms[],
+                     uint_fast8_t num_phases)
+{
+    uint32_t color_mask = color;
+    uint_fast16_t num_ticks = 0;
+
+    D_ASSERT(g_color_led.initialized);
+    D_ASSERT(num_phases != 0 && num_phases % 2 == 0);
+
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    color_led_blink_stop();
+    (void)color_led_set(LED_COLOR_BLACK);
+    if (color == LED_COLOR_BLACK) {
+        goto exit;
+    }
+
+    memset(g_color_led.blink_patterns, 0, sizeof g_color_led.blink_patterns);
+    for (uint_fast8_t phase = 0; phase < num_phases; phase++) {
+        uint_fast16_t phase_ticks = phases_ms[phase] / COLOR_LED_BLINK_TICK_MS;
+
+        D_ASSERT(phase_ticks != 0);
+        D_ASSERT(num_ticks + phase_ticks <= COLOR_LED_BLINK_MAX_TICKS);
+        for (unsigned int i = 0; i < NUM_RGB_LED_PORTS; i++) {
+            g_color_led.blink_patterns[i][num_ticks] =
+                g_rgb_led_ports[i].pins_mask & color_mask;
+        }
+
+        num_ticks += phase_ticks;
+    }
+
+    for (unsigned int i = 0; i < NUM_RGB_LED_PORTS; i++) {
+        uint8_t dma_channel = g_rgb_led_ports[i].blink_dma_channel;
+
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SADDR,
+                            (uint32_t)g_color_led.blink_patterns[i]);
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SLAST,
+                            -(int32_t)(num_ticks * sizeof(uint32_t)));
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CITER_ELINKNO,
+                            DMA_CITER_ELINKNO_CITER(num_ticks));
+        WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].BITER_ELINKNO,
+                            DMA_BITER_ELINKNO_BITER(num_ticks));
+    }
+
+    /*
+     * Make sure that the pattern tables have reached memory before the DMA
+     * engine reads them:
+     */
+    __DSB();
+    for (unsigned int i = 0; i < NUM_RGB_LED_PORTS; i++) {
+        WRITE_MMIO_REGISTER(&DMA0->SERQ, g_rgb_led_ports[i].blink_dma_channel);
+    }
+
+    /*
+     * Restart the counter from CNTIN and start it on the bus clock:
+     */
+    WRITE_MMIO_REGISTER(&FTM0->CNT, 0);
+    WRITE_MMIO_REGISTER(&FTM0->SC,
+                        FTM_SC_CLKS(1) | FTM_SC_PS(BLINK_FTM_PRESCALER_SELECTOR));
+    g_color_led.current_color = color;
+    g_color_led.blinking = true;
+
+exit:
+    restore_cpu_interrupts(old_primask);
+}
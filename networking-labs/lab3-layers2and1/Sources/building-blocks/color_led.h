@@ -9,6 +9,7 @@
 #define SOURCES_COLOR_LED_H_
 
 #include "io_utils.h"
+#include <stdint.h>
 
 #define RGB_LED_RED_PIN_BIT_INDEX      22	/* in port B */
 #define RGB_LED_GREEN_PIN_BIT_INDEX    26	/* in port E */
@@ -31,10 +32,23 @@ enum led_colors {
 
 typedef enum led_colors led_color_t;
 
+/**
+ * Resolution of blink pattern phases (in ms)
+ */
+#define COLOR_LED_BLINK_TICK_MS     50
+
+/**
+ * Maximum length of a blink pattern (in ticks)
+ */
+#define COLOR_LED_BLINK_MAX_TICKS   64
+
 void color_led_init(void);
 
 led_color_t color_led_set(led_color_t new_color);
 
 void color_led_toggle(led_color_t color);
 
+void color_led_blink(led_color_t color, const uint16_t phases_ms[],
+                     uint_fast8_t num_phases);
+
 #endif /* SOURCES_COLOR_LED_H_ */
@@ -8,7 +8,9 @@
 #include "command_line.h"
 #include "serial_console.h"
 #include "runtime_checks.h"
+#include "crc_32.h"
 #include <ctype.h>
+#include <string.h>
 
 /**
  * Max command line size including null terminator
@@ -20,6 +22,13 @@
  */
 #define COMMAND_LINE_MAX_ARGV 8
 
+/**
+ * Max size of a command frame, not including COMMAND_FRAME_START
+ */
+#define COMMAND_FRAME_MAX_SIZE \
+        (COMMAND_FRAME_HEADER_SIZE + COMMAND_FRAME_MAX_PAYLOAD_SIZE + \
+         COMMAND_FRAME_CRC_SIZE)
+
 /**
  * Command line state variables
  */
@@ -28,8 +37,30 @@ struct command_line {
     char *buffer_cursor;
     const char *prompt;
     command_parser_t *command_parser;
-    int argc;
-    const char *argv[COMMAND_LINE_MAX_ARGV];
+
+    /**
+     * Handler of binary command frames (NULL if command frames are not
+     * accepted)
+     */
+    command_frame_handler_t *frame_handler;
+
+    /**
+     * Flag indicating that a command frame is being received
+     */
+    bool receiving_frame;
+
+    /**
+     * Number of bytes of the command frame received so far, not including
+     * COMMAND_FRAME_START
+     */
+    uint_fast16_t frame_length;
+
+    uint8_t frame_buffer[COMMAND_FRAME_MAX_SIZE];
+
+    /**
+     * Number of command frames dropped because of an invalid length or CRC
+     */
+    uint32_t frames_dropped;
 };
 
 static struct command_line g_command_line;
@@ -51,15 +82,44 @@ void command_line_init(const char *prompt, command_parser_t *command_parser)
 }
 
 
-static void command_line_build_argv(struct command_line *command_line_p)
+/**
+ * Sets the handler for binary command frames received on the command line
+ * UART
+ *
+ * @param frame_handler     callback function to process command frames
+ */
+void command_line_set_frame_handler(command_frame_handler_t *frame_handler)
+{
+    g_command_line.frame_handler = frame_handler;
+}
+
+
+/**
+ * Returns the number of command frames dropped because of an invalid
+ * length or CRC
+ */
+uint32_t command_line_get_frames_dropped(void)
+{
+    return g_command_line.frames_dropped;
+}
+
+
+/**
+ * Splits a command line in place into its arguments. Arguments beyond
+ * COMMAND_LINE_MAX_ARGV are ignored.
+ *
+ * @return number of arguments
+ */
+static int command_line_build_argv(char *line_p,
+                                   const char *argv[COMMAND_LINE_MAX_ARGV])
 {
     int argc = 0;
-    char *next_arg_p = command_line_p->buffer;
+    char *next_arg_p = line_p;
 
-    for (char *s = next_arg_p; *s != '\0'; s ++) {
+    for (char *s = next_arg_p; *s != '\0' && argc < COMMAND_LINE_MAX_ARGV; s ++) {
         if (*s == ' ' || *s == '\t') {
             *s = '\0';
-            command_line_p->argv[argc] = next_arg_p;
+            argv[argc] = next_arg_p;
             argc ++;
             for (s ++; *s == ' ' || *s == '\t'; s ++) {
                 ;
@@ -69,12 +129,118 @@ static void command_line_build_argv(struct command_line *command_line_p)
         }
     }
 
-    if (*next_arg_p != '\0') {
-        command_line_p->argv[argc] = next_arg_p;
+    if (*next_arg_p != '\0' && argc < COMMAND_LINE_MAX_ARGV) {
+        argv[argc] = next_arg_p;
         argc ++;
     }
 
-    command_line_p->argc = argc;
+    return argc;
+}
+
+
+/**
+ * Runs a command line with the given parser. It is used for the lines typed
+ * on the serial console, and for command lines received from other sources
+ * (for example, from the network), in which case the calling task redirects
+ * the console output (see console_redirect_output()).
+ *
+ * @param line_p            null-terminated command line. It is modified,
+ *                          as it is split in place into arguments.
+ * @param command_parser    callback function to parse the command
+ */
+void command_line_execute(char *line_p, command_parser_t *command_parser)
+{
+    const char *argv[COMMAND_LINE_MAX_ARGV];
+    int argc = command_line_build_argv(line_p, argv);
+
+    command_parser(argc, argv);
+}
+
+
+static void store_uint32_little_endian(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+
+/**
+ * Invokes the command frame handler for a received command frame, and
+ * sends the response frame
+ */
+static void command_line_dispatch_frame(struct command_line *command_line_p)
+{
+    uint8_t response[1 + COMMAND_FRAME_HEADER_SIZE + COMMAND_FRAME_MAX_PAYLOAD_SIZE +
+                     COMMAND_FRAME_CRC_SIZE];
+    uint8_t *const request_p = command_line_p->frame_buffer;
+    size_t payload_length = request_p[0];
+    size_t response_data_size = COMMAND_FRAME_MAX_PAYLOAD_SIZE - 1;
+
+    response[4] = command_line_p->frame_handler(request_p[1],
+                                                &request_p[COMMAND_FRAME_HEADER_SIZE],
+                                                payload_length,
+                                                &response[5],
+                                                &response_data_size);
+
+    D_ASSERT(response_data_size <= COMMAND_FRAME_MAX_PAYLOAD_SIZE - 1);
+    size_t response_payload_length = 1 + response_data_size;
+
+    response[0] = COMMAND_FRAME_START;
+    response[1] = response_payload_length;
+    response[2] = request_p[1] | COMMAND_FRAME_RESPONSE_FLAG;
+    response[3] = request_p[2];
+    store_uint32_little_endian(
+        &response[1 + COMMAND_FRAME_HEADER_SIZE + response_payload_length],
+        crc_32_accelerator_run(&response[1],
+                               COMMAND_FRAME_HEADER_SIZE + response_payload_length));
+
+    console_write_binary(response,
+                         1 + COMMAND_FRAME_HEADER_SIZE + response_payload_length +
+                         COMMAND_FRAME_CRC_SIZE);
+}
+
+
+/**
+ * Processes a byte of a command frame being received
+ */
+static void command_line_process_frame_byte(struct command_line *command_line_p,
+                                            uint8_t byte)
+{
+    uint8_t *const frame_p = command_line_p->frame_buffer;
+
+    D_ASSERT(command_line_p->frame_length < COMMAND_FRAME_MAX_SIZE);
+    frame_p[command_line_p->frame_length] = byte;
+    command_line_p->frame_length ++;
+
+    size_t payload_length = frame_p[0];
+
+    if (payload_length > COMMAND_FRAME_MAX_PAYLOAD_SIZE) {
+        command_line_p->frames_dropped ++;
+        command_line_p->receiving_frame = false;
+        return;
+    }
+
+    size_t crc_offset = COMMAND_FRAME_HEADER_SIZE + payload_length;
+
+    if (command_line_p->frame_length < crc_offset + COMMAND_FRAME_CRC_SIZE) {
+        return;
+    }
+
+    command_line_p->receiving_frame = false;
+
+    uint32_t received_crc = (uint32_t)frame_p[crc_offset] |
+                            ((uint32_t)frame_p[crc_offset + 1] << 8) |
+                            ((uint32_t)frame_p[crc_offset + 2] << 16) |
+                            ((uint32_t)frame_p[crc_offset + 3] << 24);
+
+    if (crc_32_accelerator_run(frame_p, crc_offset) != received_crc) {
+        command_line_p->frames_dropped ++;
+        return;
+    }
+
+    command_line_dispatch_frame(command_line_p);
 }
 
 
@@ -84,14 +250,22 @@ static void command_line_process_char(int c)
              g_command_line.buffer_cursor <
                  g_command_line.buffer + COMMAND_LINE_BUFFER_SIZE);
 
-    if (c == '\r') {
+    if (g_command_line.receiving_frame) {
+        command_line_process_frame_byte(&g_command_line, c);
+    } else if (c == COMMAND_FRAME_START && g_command_line.frame_handler != NULL) {
+        /*
+         * Start of a binary command frame. A partially typed command line
+         * is kept, as command frames are not echoed:
+         */
+        g_command_line.receiving_frame = true;
+        g_command_line.frame_length = 0;
+    } else if (c == '\r') {
         /*
          * Process completed command-line:
          */
         console_puts("\n");
         *g_command_line.buffer_cursor = '\0';
-        command_line_build_argv(&g_command_line);
-        g_command_line.command_parser(g_command_line.argc, g_command_line.argv);
+        command_line_execute(g_command_line.buffer, g_command_line.command_parser);
         g_command_line.buffer_cursor = g_command_line.buffer;
         console_printf("%s ", g_command_line.prompt);
     } else if (c == '\b') {
@@ -127,3 +301,108 @@ void command_line_process_input(bool wait)
 }
 
 
+/**
+ * FNV-1a hash of a command name
+ */
+static uint32_t command_table_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (const char *s = name; *s != '\0'; s ++) {
+        hash ^= (uint8_t)*s;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+/**
+ * Initializes a command table, by hashing the names of its entries
+ *
+ * @param table_p       pointer to the command table
+ * @param entries_p     array of entries (it must not be modified afterwards)
+ * @param num_entries   number of entries. There must not be duplicated
+ *                      names.
+ */
+void command_table_init(struct command_table *table_p,
+                        const struct command_table_entry *entries_p,
+                        size_t num_entries)
+{
+    D_ASSERT(num_entries <= COMMAND_TABLE_MAX_ENTRIES);
+    table_p->entries_p = entries_p;
+    table_p->num_entries = num_entries;
+    memset(table_p->slots, 0, sizeof table_p->slots);
+
+    for (uint_fast8_t i = 0; i < num_entries; i ++) {
+        uint32_t slot = command_table_hash(entries_p[i].name) &
+                        (COMMAND_TABLE_NUM_SLOTS - 1);
+
+        D_ASSERT(command_table_lookup(table_p, entries_p[i].name) == NULL);
+        while (table_p->slots[slot] != 0) {
+            slot = (slot + 1) & (COMMAND_TABLE_NUM_SLOTS - 1);
+        }
+
+        table_p->slots[slot] = i + 1;
+    }
+}
+
+
+/**
+ * Looks up a command by name in a command table
+ *
+ * @param table_p       pointer to the command table
+ * @param name          command name
+ *
+ * @return pointer to the entry found, or NULL if none
+ */
+const struct command_table_entry *command_table_lookup(
+    const struct command_table *table_p, const char *name)
+{
+    uint32_t slot = command_table_hash(name) & (COMMAND_TABLE_NUM_SLOTS - 1);
+
+    /*
+     * The table is at most half full, so an empty slot is always found:
+     */
+    while (table_p->slots[slot] != 0) {
+        const struct command_table_entry *entry_p =
+            &table_p->entries_p[table_p->slots[slot] - 1];
+
+        if (strcmp(entry_p->name, name) == 0) {
+            return entry_p;
+        }
+
+        slot = (slot + 1) & (COMMAND_TABLE_NUM_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Invokes the handler of the command named by argv[0], passing it the
+ * remaining arguments
+ *
+ * @param table_p       pointer to the command table
+ * @param argc          number of arguments, including the command name
+ * @param argv          arguments, including the command name
+ *
+ * @return true, if the command was found
+ * @return false, otherwise
+ */
+bool command_table_dispatch(const struct command_table *table_p,
+                            int argc, const char *argv[])
+{
+    D_ASSERT(argc >= 1);
+
+    const struct command_table_entry *entry_p =
+        command_table_lookup(table_p, argv[0]);
+
+    if (entry_p == NULL) {
+        return false;
+    }
+
+    D_ASSERT(entry_p->handler != NULL);
+    entry_p->handler(argc - 1, argv + 1);
+    return true;
+}
@@ -9,11 +9,135 @@
 #define SOURCES_COMMAND_LINE_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "compile_time_checks.h"
+
+/*
+ * Binary command frames
+ *
+ * Besides text command lines, the command line processor accepts binary
+ * command frames on the same UART, meant for host tools. A command frame
+ * has the following layout:
+ *
+ *   byte 0:            COMMAND_FRAME_START
+ *   byte 1:            payload length (N)
+ *   byte 2:            command ID
+ *   byte 3:            sequence number (echoed in the response)
+ *   bytes 4..N+3:      payload
+ *   bytes N+4..N+7:    CRC-32 of bytes 1..N+3 (little endian)
+ *
+ * The CRC-32 is the one calculated by crc_32_accelerator_run(): polynomial
+ * 0x04C11DB7, reflected, seed 0xffffffff and no final XOR (that is, the
+ * bitwise complement of the zlib/Ethernet CRC-32).
+ *
+ * The response frame has the same layout, with COMMAND_FRAME_RESPONSE_FLAG
+ * set in the command ID. The first byte of its payload is the status
+ * returned by the command frame handler, followed by the response data.
+ * Host tools must skip any bytes received before COMMAND_FRAME_START, as
+ * responses share the UART with the console text output. Frames with an
+ * invalid length or CRC are dropped without a response.
+ */
+#define COMMAND_FRAME_START                 0x02
+#define COMMAND_FRAME_RESPONSE_FLAG         0x80
+#define COMMAND_FRAME_HEADER_SIZE           3
+#define COMMAND_FRAME_CRC_SIZE              4
+#define COMMAND_FRAME_MAX_PAYLOAD_SIZE      128
+
+/*
+ * Status values for response frames
+ */
+#define COMMAND_FRAME_STATUS_OK                 0
+#define COMMAND_FRAME_STATUS_UNKNOWN_COMMAND    1
+#define COMMAND_FRAME_STATUS_INVALID_PAYLOAD    2
 
 typedef void command_parser_t(int argc, const char *argv[]);
 
+/**
+ * Max number of entries in a command table
+ */
+#define COMMAND_TABLE_MAX_ENTRIES   32
+
+/**
+ * Number of hash slots of a command table (must be a power of 2). Keeping
+ * the table at most half full keeps probe sequences short.
+ */
+#define COMMAND_TABLE_NUM_SLOTS     (2 * COMMAND_TABLE_MAX_ENTRIES)
+
+C_ASSERT((COMMAND_TABLE_NUM_SLOTS & (COMMAND_TABLE_NUM_SLOTS - 1)) == 0);
+
+/**
+ * Command handler
+ *
+ * @param argc  number of arguments after the command name
+ * @param argv  arguments after the command name
+ */
+typedef void command_handler_t(int argc, const char *argv[]);
+
+/**
+ * Entry of a command table
+ */
+struct command_table_entry {
+    const char *name;
+
+    /**
+     * Handler of the command (NULL for tables only used for lookups)
+     */
+    command_handler_t *handler;
+};
+
+/**
+ * Command table: maps command names to command table entries with a hash
+ * table, so that a command is found with one string comparison, in the
+ * common case, instead of one per command.
+ */
+struct command_table {
+    const struct command_table_entry *entries_p;
+    uint8_t num_entries;
+
+    /**
+     * Hash slots: each slot has the index + 1 of the entry whose name
+     * hashes to it (or to a preceding slot, on collisions), or 0 if empty
+     */
+    uint8_t slots[COMMAND_TABLE_NUM_SLOTS];
+};
+
+/**
+ * Command frame handler
+ *
+ * @param command_id            command ID from the command frame
+ * @param payload_p             payload of the command frame
+ * @param payload_length        length of the payload in bytes
+ * @param response_data_p       area where the response data is to be returned
+ * @param response_data_size_p  on entry, size of the response data area; on
+ *                              exit, length of the response data returned
+ *
+ * @return COMMAND_FRAME_STATUS_ value for the response frame
+ */
+typedef uint8_t command_frame_handler_t(uint8_t command_id,
+                                        const uint8_t *payload_p,
+                                        size_t payload_length,
+                                        uint8_t *response_data_p,
+                                        size_t *response_data_size_p);
+
 void command_line_init(const char *prompt, command_parser_t *command_parser);
 
+void command_line_set_frame_handler(command_frame_handler_t *frame_handler);
+
+uint32_t command_line_get_frames_dropped(void);
+
 void command_line_process_input(bool wait);
 
+void command_line_execute(char *line_p, command_parser_t *command_parser);
+
+void command_table_init(struct command_table *table_p,
+                        const struct command_table_entry *entries_p,
+                        size_t num_entries);
+
+const struct command_table_entry *command_table_lookup(
+    const struct command_table *table_p, const char *name);
+
+bool command_table_dispatch(const struct command_table *table_p,
+                            int argc, const char *argv[]);
+
 #endif /* SOURCES_COMMAND_LINE_H_ */
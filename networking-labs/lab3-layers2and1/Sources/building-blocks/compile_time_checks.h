@@ -8,6 +8,8 @@
 #ifndef SOURCES_BUILDING_BLOCKS_COMPILE_TIME_CHECKS_H_
 #define SOURCES_BUILDING_BLOCKS_COMPILE_TIME_CHECKS_H_
 
+#include <stdint.h>
+
 #if __STDC_VERSION__ == 201112L
 /**
  * Macro to check compile-time assertions
@@ -21,4 +23,43 @@
 
 #endif /* __STDC_VERSION__ == 201112L */
 
+/**
+ * Inverts the byte order of a 16-bit value, as an integer constant
+ * expression, if _x is one. So, it can be used in static initializers,
+ * case labels and C_ASSERT()
+ */
+#define BYTE_SWAP16_CONST(_x) \
+        ((uint16_t)((((uint16_t)(_x) & 0x00ffu) << 8) | \
+                    (((uint16_t)(_x) & 0xff00u) >> 8)))
+
+/**
+ * Inverts the byte order of a 32-bit value, as an integer constant
+ * expression, if _x is one
+ */
+#define BYTE_SWAP32_CONST(_x) \
+        ((uint32_t)((((uint32_t)(_x) & 0x000000ffu) << 24) | \
+                    (((uint32_t)(_x) & 0x0000ff00u) << 8) |  \
+                    (((uint32_t)(_x) & 0x00ff0000u) >> 8) |  \
+                    (((uint32_t)(_x) & 0xff000000u) >> 24)))
+
+/**
+ * Macro to tell the compiler to place a function in SRAM instead of flash.
+ *
+ * The '.ram_functions' input section is placed by the linker script in the
+ * initialized data output section, in SRAM_L (which the Cortex-M4 fetches
+ * from on the code bus, with no wait states), so it is copied from flash at
+ * reset, along with the initialized C global variables, by
+ * init_c_global_and_static_variables(). Calls from SRAM_L to flash and back
+ * are out of range of a BL instruction, but the linker inserts a long branch
+ * veneer for them.
+ *
+ * It is meant for the few functions run often enough for flash wait states
+ * and flash cache misses to show up in the profile, such as ISRs of fast
+ * devices. SRAM_L is only 64KB and is shared with the initialized data.
+ */
+#define RAM_FUNC __attribute__ ((section (".ram_functions")))
+
+C_ASSERT(BYTE_SWAP16_CONST(0x1234) == 0x3412);
+C_ASSERT(BYTE_SWAP32_CONST(0x12345678) == 0x78563412);
+
 #endif /* SOURCES_BUILDING_BLOCKS_COMPILE_TIME_CHECKS_H_ */
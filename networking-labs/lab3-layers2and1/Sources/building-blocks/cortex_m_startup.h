@@ -9,6 +9,12 @@
 #define SOURCES_BUILDING_BLOCKS_CORTEX_M_STARTUP_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Maximum number of boot phases recorded by boot_phase_end()
+ */
+#define MAX_BOOT_PHASES 12
 
 /*
  * Variable representing the bottom of the stack used by the reset exception
@@ -27,6 +33,11 @@ extern uint32_t __StackLimit[];
 
 uint32_t get_starup_time_us(void);
 
+void boot_phase_end(const char *name_p, uint32_t begin_cycles);
+
+bool get_boot_phase_time_us(uint_fast8_t index, const char **name_pp,
+                            uint32_t *duration_us_p);
+
 uint32_t get_flash_used(void);
 
 uint32_t get_sram_used(void);
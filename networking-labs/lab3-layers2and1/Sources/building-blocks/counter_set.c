@@ -0,0 +1,59 @@
+/**
+ * @file counter_set.c
+ *
+ * Sharded statistics counters implementation
+ *
+ * @author German Rivera
+ */
+#include "counter_set.h"
+#include "runtime_checks.h"
+
+/**
+ * Reads a counter of a counter set, by adding up its shards. Each shard is
+ * read atomically, but the sum is not a snapshot of all the shards at the
+ * same instant, which is fine for statistics.
+ *
+ * @param shards_p      pointer to the first shard of the counter set
+ * @param num_counters  number of counters of the counter set
+ * @param counter       index of the counter
+ *
+ * @return value of the counter
+ */
+uint32_t counter_set_read(const volatile uint32_t *shards_p,
+                          uint_fast8_t num_counters,
+                          uint_fast8_t counter)
+{
+    uint32_t sum = 0;
+
+    D_ASSERT(counter < num_counters);
+    for (uint_fast8_t i = 0; i < COUNTER_SET_NUM_SHARDS; i ++) {
+        sum += shards_p[i * num_counters + counter];
+    }
+
+    return sum;
+}
+
+
+/**
+ * Reads all the counters of a counter set, in one pass over its shards
+ *
+ * @param shards_p      pointer to the first shard of the counter set
+ * @param num_counters  number of counters of the counter set
+ * @param counts_p      array of num_counters entries where the values of
+ *                      the counters are returned
+ */
+void counter_set_read_all(const volatile uint32_t *shards_p,
+                          uint_fast8_t num_counters,
+                          uint32_t *counts_p)
+{
+    for (uint_fast8_t j = 0; j < num_counters; j ++) {
+        counts_p[j] = 0;
+    }
+
+    for (uint_fast8_t i = 0; i < COUNTER_SET_NUM_SHARDS; i ++) {
+        for (uint_fast8_t j = 0; j < num_counters; j ++) {
+            counts_p[j] += *shards_p;
+            shards_p ++;
+        }
+    }
+}
@@ -0,0 +1,154 @@
+/**
+ * @file counter_set.h
+ *
+ * Sharded statistics counters interface
+ *
+ * A counter set keeps one copy (shard) of its counters for each execution
+ * context that can increment them: one shard per task and one shard per
+ * interrupt priority level. A context can only be preempted by a context
+ * that uses another shard, so counters are incremented with a plain
+ * read-modify-write of the caller's shard, instead of an atomic operation
+ * on a counter shared by all contexts. Readers pay instead, by adding up
+ * the shards of a counter.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_COUNTER_SET_H_
+#define SOURCES_BUILDING_BLOCKS_COUNTER_SET_H_
+
+#include <stdint.h>
+#include "compile_time_checks.h"
+#include "mem_utils.h"
+#include "atomic_utils.h"
+#include "microcontroller.h"
+#include "rtos_wrapper.h"
+
+/**
+ * Shards of a counter set: one per task created with rtos_task_create(),
+ * one per interrupt priority level, and one shared shard, incremented
+ * atomically, for any other context (system exception handlers, RTOS
+ * internal tasks and code that runs before the RTOS is started)
+ */
+#define COUNTER_SET_NUM_TASK_SHARDS     RTOS_MAX_NUM_TASKS
+#define COUNTER_SET_NUM_ISR_SHARDS      MCU_NUM_INTERRUPT_PRIORITIES
+#define COUNTER_SET_SHARED_SHARD \
+        (COUNTER_SET_NUM_TASK_SHARDS + COUNTER_SET_NUM_ISR_SHARDS)
+#define COUNTER_SET_NUM_SHARDS          (COUNTER_SET_SHARED_SHARD + 1)
+
+/**
+ * First exception number of external interrupts
+ */
+#define COUNTER_SET_FIRST_IRQ_EXCEPTION_NUMBER  16
+
+/**
+ * Mask of the exception number field of IPSR (9 bits on Cortex-M4)
+ */
+#define COUNTER_SET_IPSR_EXCEPTION_NUMBER_MASK  UINT32_C(0x1ff)
+
+/**
+ * Declares a counter set type, 'struct _name', of _num_counters counters.
+ * Counters are identified by their index (0 .. _num_counters - 1).
+ * A counter set variable with static storage starts with all its counters
+ * set to 0.
+ */
+#define DECLARE_COUNTER_SET(_name, _num_counters) \
+    struct _name {                                                          \
+        volatile uint32_t shards[COUNTER_SET_NUM_SHARDS][_num_counters];    \
+    }
+
+/**
+ * Adds a value to a counter of a counter set
+ */
+#define COUNTER_SET_ADD(_counter_set, _counter, _value) \
+        counter_set_add(&(_counter_set).shards[0][0],                       \
+                        ARRAY_SIZE((_counter_set).shards[0]),               \
+                        _counter, _value)
+
+#define COUNTER_SET_INCREMENT(_counter_set, _counter) \
+        COUNTER_SET_ADD(_counter_set, _counter, 1)
+
+/**
+ * Reads a counter of a counter set
+ */
+#define COUNTER_SET_READ(_counter_set, _counter) \
+        counter_set_read(&(_counter_set).shards[0][0],                      \
+                         ARRAY_SIZE((_counter_set).shards[0]), _counter)
+
+/**
+ * Reads all the counters of a counter set into an array of
+ * ARRAY_SIZE((_counter_set).shards[0]) entries
+ */
+#define COUNTER_SET_READ_ALL(_counter_set, _counts) \
+        counter_set_read_all(&(_counter_set).shards[0][0],                  \
+                             ARRAY_SIZE((_counter_set).shards[0]), _counts)
+
+/**
+ * Returns the shard of the calling context
+ *
+ * @return shard index (0 .. COUNTER_SET_NUM_SHARDS - 1)
+ */
+static inline uint_fast8_t counter_set_get_shard(void)
+{
+    uint32_t exception_number = __get_IPSR() & COUNTER_SET_IPSR_EXCEPTION_NUMBER_MASK;
+
+    if (exception_number == 0) {
+        /*
+         * Tasks not created with rtos_task_create() get
+         * COUNTER_SET_SHARED_SHARD:
+         */
+        uint_fast8_t task_index = rtos_task_get_running_index();
+
+        return (task_index < COUNTER_SET_NUM_TASK_SHARDS) ?
+               task_index : COUNTER_SET_SHARED_SHARD;
+    }
+
+    if (exception_number < COUNTER_SET_FIRST_IRQ_EXCEPTION_NUMBER) {
+        return COUNTER_SET_SHARED_SHARD;
+    }
+
+    /*
+     * Interrupts of the same priority never preempt each other:
+     */
+    uint32_t priority = NVIC_GetPriority(
+        (IRQn_Type)(exception_number - COUNTER_SET_FIRST_IRQ_EXCEPTION_NUMBER));
+
+    D_ASSERT(priority < COUNTER_SET_NUM_ISR_SHARDS);
+    return COUNTER_SET_NUM_TASK_SHARDS + priority;
+}
+
+
+/**
+ * Adds a value to a counter of a counter set. It can be called from any
+ * context.
+ *
+ * @param shards_p      pointer to the first shard of the counter set
+ * @param num_counters  number of counters of the counter set
+ * @param counter       index of the counter
+ * @param value         value to add
+ */
+static inline void counter_set_add(volatile uint32_t *shards_p,
+                                   uint_fast8_t num_counters,
+                                   uint_fast8_t counter,
+                                   uint32_t value)
+{
+    D_ASSERT(counter < num_counters);
+
+    uint_fast8_t shard = counter_set_get_shard();
+    volatile uint32_t *counter_p = &shards_p[shard * num_counters + counter];
+
+    if (shard == COUNTER_SET_SHARED_SHARD) {
+        (void)atomic_fetch_add_uint32(counter_p, value);
+    } else {
+        *counter_p += value;
+    }
+}
+
+uint32_t counter_set_read(const volatile uint32_t *shards_p,
+                          uint_fast8_t num_counters,
+                          uint_fast8_t counter);
+
+void counter_set_read_all(const volatile uint32_t *shards_p,
+                          uint_fast8_t num_counters,
+                          uint32_t *counts_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_COUNTER_SET_H_ */
@@ -0,0 +1,336 @@
+/**
+ * @file crash_dump.c
+ *
+ * Crash dump implementation
+ *
+ * @author German Rivera
+ */
+#include "crash_dump.h"
+#include "cpu_reset_counter.h"
+#include "stack_trace.h"
+#include "runtime_log.h"
+#include "rtos_wrapper.h"
+#include "serial_console.h"
+#include "nor_flash_driver.h"
+#include "mem_utils.h"
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Compile-time configuration options:
+ */
+#define CRASH_DUMP_FLASH_RING
+
+/**
+ * Maximum number of bytes of error log text saved in a crash dump in flash
+ */
+#define CRASH_DUMP_MAX_LOG_TEXT_SIZE    1024
+
+/**
+ * Crash record of the last crash
+ *
+ * NOTE: This is not a regular C global variable, as it is not
+ * in the '.data' section nor in  the '.bss' section. It is kept
+ * with the runtime logs in the '.runtime_logs' section (see linker script).
+ */
+static struct crash_record
+    __attribute__ ((section(".runtime_logs"))) g_crash_record;
+
+
+static uint32_t crash_record_checksum(const struct crash_record *crash_record_p)
+{
+    return mem_checksum(&crash_record_p->cpu_reset_count,
+                        sizeof(*crash_record_p) -
+                        offsetof(struct crash_record, cpu_reset_count));
+}
+
+
+static bool crash_record_is_valid(const struct crash_record *crash_record_p)
+{
+    return crash_record_p->signature == CRASH_RECORD_SIGNATURE &&
+           crash_record_p->num_stack_trace_entries <=
+                CRASH_RECORD_MAX_STACK_TRACE_ENTRIES &&
+           crash_record_p->checksum == crash_record_checksum(crash_record_p);
+}
+
+
+static void crash_record_print(const struct crash_record *crash_record_p)
+{
+    static const char *const cause_names[] = {
+        [CRASH_CAUSE_ASSERTION_FAILURE] = "assertion failure",
+        [CRASH_CAUSE_FATAL_ERROR] = "fatal error",
+    };
+
+    const char *cause_name_p = "unknown";
+
+    if (crash_record_p->cause < ARRAY_SIZE(cause_names) &&
+        cause_names[crash_record_p->cause] != NULL) {
+        cause_name_p = cause_names[crash_record_p->cause];
+    }
+
+    console_printf("Cause: %s (%#x), task: %#x, CPU reset count: %u, ticks: %u\n"
+                   "Stack trace:\n",
+                   cause_name_p, crash_record_p->arg, crash_record_p->task_addr,
+                   crash_record_p->cpu_reset_count, crash_record_p->ticks);
+
+    for (uint_fast8_t i = 0; i < crash_record_p->num_stack_trace_entries; i ++) {
+        console_printf("\t%#x\n", crash_record_p->stack_trace[i]);
+    }
+}
+
+#ifdef CRASH_DUMP_FLASH_RING
+
+/**
+ * Header of a crash dump in the NOR flash crash dump ring. It is followed
+ * by the text of the last entries of the error log. Each crash dump takes
+ * one sector of the ring.
+ */
+struct crash_dump_header {
+#   define CRASH_DUMP_SIGNATURE  GEN_SIGNATURE('C', 'D', 'M', 'P')
+    uint32_t signature;
+
+    /**
+     * mem_checksum() of the rest of the header and of the log text
+     */
+    uint32_t checksum;
+
+    /**
+     * Sequence number of the crash dump
+     */
+    uint32_t sequence_num;
+
+    /**
+     * Size in bytes of the log text
+     */
+    uint32_t log_text_size;
+
+    struct crash_record crash_record;
+};
+
+/**
+ * RAM staging buffer for a crash dump to be written to flash
+ */
+static union {
+    struct crash_dump_header header;
+    uint32_t words[ROUND_UP(sizeof(struct crash_dump_header) +
+                            CRASH_DUMP_MAX_LOG_TEXT_SIZE,
+                            NOR_FLASH_PROGRAM_UNIT_SIZE) / sizeof(uint32_t)];
+} g_crash_dump_buffer;
+
+C_ASSERT(sizeof(g_crash_dump_buffer) <= NOR_FLASH_SECTOR_SIZE);
+
+
+static const struct crash_dump_header *crash_dump_get_sector_header(
+    uint_fast8_t sector)
+{
+    return (const struct crash_dump_header *)(NOR_FLASH_CRASH_DUMP_AREA_ADDR +
+                                              sector * NOR_FLASH_SECTOR_SIZE);
+}
+
+
+static uint32_t crash_dump_checksum(const struct crash_dump_header *header_p)
+{
+    return mem_checksum(&header_p->sequence_num,
+                        sizeof(*header_p) -
+                        offsetof(struct crash_dump_header, sequence_num) +
+                        header_p->log_text_size);
+}
+
+
+static bool crash_dump_is_valid(const struct crash_dump_header *header_p)
+{
+    return header_p->signature == CRASH_DUMP_SIGNATURE &&
+           header_p->log_text_size <= CRASH_DUMP_MAX_LOG_TEXT_SIZE &&
+           header_p->checksum == crash_dump_checksum(header_p);
+}
+
+
+/**
+ * Finds the sector of the crash dump ring that has the newest crash dump
+ *
+ * @return sector index, or -1 if the ring has no crash dumps
+ */
+static int_fast8_t crash_dump_find_newest(void)
+{
+    int_fast8_t newest_sector = -1;
+    uint32_t newest_sequence_num = 0;
+
+    for (uint_fast8_t i = 0; i < NOR_FLASH_CRASH_DUMP_NUM_SECTORS; i ++) {
+        const struct crash_dump_header *header_p = crash_dump_get_sector_header(i);
+
+        if (!crash_dump_is_valid(header_p)) {
+            continue;
+        }
+
+        if (newest_sector < 0 ||
+            (int32_t)(header_p->sequence_num - newest_sequence_num) > 0) {
+            newest_sector = i;
+            newest_sequence_num = header_p->sequence_num;
+        }
+    }
+
+    return newest_sector;
+}
+
+
+/**
+ * Writes a crash dump, with the given crash record and the last entries of
+ * the error log, to the sector of the crash dump ring that follows the
+ * newest crash dump (that is, over the oldest one). It is called with
+ * interrupts disabled.
+ */
+static void crash_dump_flush_to_flash(const struct crash_record *crash_record_p)
+{
+    struct crash_dump_header *const header_p = &g_crash_dump_buffer.header;
+    int_fast8_t newest_sector = crash_dump_find_newest();
+    uint_fast8_t sector = 0;
+    uint32_t sequence_num = 0;
+
+    if (newest_sector >= 0) {
+        sector = (newest_sector + 1) % NOR_FLASH_CRASH_DUMP_NUM_SECTORS;
+        sequence_num = crash_dump_get_sector_header(newest_sector)->sequence_num + 1;
+    }
+
+    header_p->sequence_num = sequence_num;
+    header_p->crash_record = *crash_record_p;
+    header_p->log_text_size = runtime_log_snapshot(RUNTIME_ERROR_LOG,
+                                                   (char *)(header_p + 1),
+                                                   CRASH_DUMP_MAX_LOG_TEXT_SIZE);
+
+    size_t dump_size = sizeof(*header_p) + header_p->log_text_size;
+    size_t padded_dump_size = ROUND_UP(dump_size, NOR_FLASH_PROGRAM_UNIT_SIZE);
+
+    memset((uint8_t *)header_p + dump_size, 0xff, padded_dump_size - dump_size);
+    header_p->checksum = crash_dump_checksum(header_p);
+    header_p->signature = CRASH_DUMP_SIGNATURE;
+
+    (void)nor_flash_panic_write(NOR_FLASH_CRASH_DUMP_AREA_ADDR +
+                                    sector * NOR_FLASH_SECTOR_SIZE,
+                                header_p, padded_dump_size);
+}
+
+
+/**
+ * Prints the crash dumps of the crash dump ring, oldest first
+ */
+static void crash_dump_print_flash_ring(void)
+{
+    int_fast8_t newest_sector = crash_dump_find_newest();
+
+    if (newest_sector < 0) {
+        console_printf("No crash dumps in flash\n");
+        return;
+    }
+
+    for (uint_fast8_t i = 1; i <= NOR_FLASH_CRASH_DUMP_NUM_SECTORS; i ++) {
+        uint_fast8_t sector = (newest_sector + i) % NOR_FLASH_CRASH_DUMP_NUM_SECTORS;
+        const struct crash_dump_header *header_p = crash_dump_get_sector_header(sector);
+
+        if (!crash_dump_is_valid(header_p)) {
+            continue;
+        }
+
+        console_printf("\nCrash dump %u in flash:\n", header_p->sequence_num);
+        crash_record_print(&header_p->crash_record);
+        console_printf("Error log:\n");
+
+        const char *log_text_p = (const char *)(header_p + 1);
+
+        for (uint32_t j = 0; j < header_p->log_text_size; j ++) {
+            if (log_text_p[j] != RUNTIME_LOG_ENTRY_START) {
+                console_putchar(log_text_p[j]);
+            }
+        }
+    }
+}
+
+#endif /* CRASH_DUMP_FLASH_RING */
+
+
+/**
+ * Checks if there is a crash record from the previous run, in which case it
+ * is logged to the error log. It must be called from the reset handler,
+ * after init_runtime_logs().
+ */
+void crash_dump_init(void)
+{
+    struct crash_record *const crash_record_p = &g_crash_record;
+    uint32_t cpu_reset_count = read_cpu_reset_counter();
+
+    D_ASSERT(CALLER_IS_RESET_HANDLER());
+
+    /*
+     * SRAM contains garbage after power-cycling the microcontroller:
+     */
+    if (cpu_reset_count == 0 || !crash_record_is_valid(crash_record_p)) {
+        crash_record_p->signature = 0;
+        return;
+    }
+
+    if (crash_record_p->cpu_reset_count + 1 != cpu_reset_count) {
+        return;
+    }
+
+    uintptr_t trace[4] = { 0 };
+
+    for (uint_fast8_t i = 0;
+         i < ARRAY_SIZE(trace) && i < crash_record_p->num_stack_trace_entries;
+         i ++) {
+        trace[i] = crash_record_p->stack_trace[i];
+    }
+
+    ERROR_PRINTF("Crashed before last reset (cause %u, %#x, task %#x, "
+                 "ticks %u), stack trace: %#x %#x %#x %#x\n",
+                 crash_record_p->cause, crash_record_p->arg,
+                 crash_record_p->task_addr, crash_record_p->ticks,
+                 trace[0], trace[1], trace[2], trace[3]);
+}
+
+
+/**
+ * Saves a crash record for a fatal failure, and optionally flushes it to
+ * flash along with the error log. It must be called with interrupts
+ * disabled, from the handler of the failure, right before stopping.
+ *
+ * @param cause crash cause
+ * @param arg   error code or code address associated with the crash
+ */
+void crash_dump_capture(enum crash_causes cause, uintptr_t arg)
+{
+    struct crash_record *const crash_record_p = &g_crash_record;
+    uint_fast8_t num_stack_trace_entries = CRASH_RECORD_MAX_STACK_TRACE_ENTRIES;
+
+    crash_record_p->cpu_reset_count = read_cpu_reset_counter();
+    crash_record_p->ticks = rtos_get_ticks_since_boot();
+    crash_record_p->cause = cause;
+    crash_record_p->arg = arg;
+    crash_record_p->task_addr = (uintptr_t)rtos_task_self();
+    stack_trace_capture(1, crash_record_p->stack_trace, &num_stack_trace_entries);
+    crash_record_p->num_stack_trace_entries = num_stack_trace_entries;
+    crash_record_p->checksum = crash_record_checksum(crash_record_p);
+    crash_record_p->signature = CRASH_RECORD_SIGNATURE;
+
+#   ifdef CRASH_DUMP_FLASH_RING
+    crash_dump_flush_to_flash(crash_record_p);
+#   endif
+}
+
+
+/**
+ * Prints the crash record of the last crash and, if enabled, the crash
+ * dumps saved in flash
+ */
+void crash_dump_print(void)
+{
+    if (crash_record_is_valid(&g_crash_record)) {
+        console_printf("Last crash:\n");
+        crash_record_print(&g_crash_record);
+    } else {
+        console_printf("No crash record in RAM\n");
+    }
+
+#   ifdef CRASH_DUMP_FLASH_RING
+    crash_dump_print_flash_ring();
+#   endif
+}
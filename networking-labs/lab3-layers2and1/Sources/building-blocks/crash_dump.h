@@ -0,0 +1,92 @@
+/**
+ * @file crash_dump.h
+ *
+ * Crash dump interface
+ *
+ * When a fatal error or a failed assertion stops the firmware, a crash
+ * record with the cause and the stack trace of the failure is saved in SRAM
+ * that is not initialized at reset, next to the runtime logs. So, after the
+ * subsequent warm reset (e.g., by the watchdog), both the runtime logs and
+ * the crash record of the previous run are still there, and the crash record
+ * is copied to the error log. Optionally, the crash record and the error log
+ * are also flushed, right at the time of the failure, to a ring of NOR flash
+ * sectors (NOR_FLASH_CRASH_DUMP_AREA_ADDR), so that they survive a power
+ * cycle too.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_CRASH_DUMP_H_
+#define SOURCES_BUILDING_BLOCKS_CRASH_DUMP_H_
+
+#include <stdint.h>
+#include "runtime_checks.h"
+
+/**
+ * Maximum number of stack trace entries of a crash record
+ */
+#define CRASH_RECORD_MAX_STACK_TRACE_ENTRIES    12
+
+/**
+ * Causes of a crash
+ */
+enum crash_causes {
+    CRASH_CAUSE_ASSERTION_FAILURE = 1,
+    CRASH_CAUSE_FATAL_ERROR,
+};
+
+/**
+ * Crash record
+ */
+struct crash_record {
+#   define CRASH_RECORD_SIGNATURE  GEN_SIGNATURE('C', 'R', 'S', 'H')
+    uint32_t signature;
+
+    /**
+     * mem_checksum() of the rest of the record
+     */
+    uint32_t checksum;
+
+    /**
+     * Value of the CPU reset counter when the crash happened
+     */
+    uint32_t cpu_reset_count;
+
+    /**
+     * RTOS ticks since boot when the crash happened
+     */
+    uint32_t ticks;
+
+    /**
+     * Crash cause (enum crash_causes)
+     */
+    uint8_t cause;
+
+    /**
+     * Number of entries of stack_trace[] filled
+     */
+    uint8_t num_stack_trace_entries;
+
+    /**
+     * Error code for CRASH_CAUSE_FATAL_ERROR, or code address of the failed
+     * assertion for CRASH_CAUSE_ASSERTION_FAILURE
+     */
+    uintptr_t arg;
+
+    /**
+     * Task that was running
+     */
+    uintptr_t task_addr;
+
+    /**
+     * Return addresses of the call chain that led to the crash
+     */
+    uintptr_t stack_trace[CRASH_RECORD_MAX_STACK_TRACE_ENTRIES];
+};
+
+void crash_dump_init(void);
+
+void crash_dump_capture(enum crash_causes cause, uintptr_t arg);
+
+void crash_dump_print(void);
+
+#endif /* SOURCES_BUILDING_BLOCKS_CRASH_DUMP_H_ */
@@ -8,6 +8,37 @@
 #include "crc_32.h"
 #include "runtime_checks.h"
 #include "io_utils.h"
+#include "mem_utils.h"
+#include "rtos_wrapper.h"
+#include "interrupt_vector_table.h"
+
+#define CRC_32_POLYNOMIAL UINT32_C(0x04C11DB7)
+
+/**
+ * eDMA channel used to feed the CRC DATA register (channels 0 and 1 are used
+ * by the UARTs' Rx DMA mode)
+ */
+#define CRC_32_DMA_CHANNEL              2
+
+/**
+ * DMAMUX request source for the CRC DMA channel: one of the "always enabled"
+ * slots (see K64F reference manual, table 3-24), so that the channel keeps
+ * requesting service until its major loop completes.
+ */
+#define CRC_32_DMA_REQUEST_SOURCE       63
+
+/**
+ * Maximum number of 32-bit words moved by one DMA major loop (CITER is a
+ * 15-bit field)
+ */
+#define CRC_32_DMA_MAX_WORDS_PER_TRANSFER   UINT32_C(0x7fff)
+
+/**
+ * Shortest data block for which crc_32_accelerator_update_dma() uses DMA.
+ * For shorter blocks, setting up the DMA channel and taking its interrupt
+ * costs more than feeding the data register with the CPU.
+ */
+#define CRC_32_DMA_MIN_SIZE             UINT32_C(64)
 
 /**
  * Const fields of the CRC device (to be placed in flash)
@@ -17,6 +48,9 @@ struct crc_device {
     uint32_t signature;
     CRC_Type *mmio_regs_p;
     struct crc_device_var *var_p;
+    uint8_t dma_channel;
+    uint8_t dma_request_source;
+    IRQn_Type dma_irq_num;
 };
 
 /**
@@ -24,6 +58,24 @@ struct crc_device {
  */
 struct crc_device_var {
     bool initialized;
+
+    /**
+     * Mutex held from crc_32_accelerator_begin() to crc_32_accelerator_final(),
+     * as the CRC module holds the state of one computation at a time.
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Semaphore signaled by the DMA channel's interrupt handler when a
+     * transfer to the DATA register completes
+     */
+    struct rtos_semaphore dma_semaphore;
+
+    /**
+     * Number of bytes fed to the CRC module by DMA and by the CPU
+     */
+    uint32_t dma_bytes;
+    uint32_t cpu_bytes;
 };
 
 static struct crc_device_var g_crc_var = {
@@ -34,71 +86,101 @@ static const struct crc_device g_crc = {
     .signature = CRC_DEVICE_SIGNATURE,
     .mmio_regs_p = (CRC_Type *)CRC_BASE,
     .var_p = &g_crc_var,
+    .dma_channel = CRC_32_DMA_CHANNEL,
+    .dma_request_source = CRC_32_DMA_REQUEST_SOURCE,
+    .dma_irq_num = DMA2_IRQn,
 };
 
 
 /**
- * Initializes CRC hardware module
+ * Configures the DMA channel that moves data to the CRC DATA register
  */
-void crc_32_accelerator_init(void)
+static void crc_32_dma_init(void)
 {
     uint32_t reg_value;
+    uint8_t dma_channel = g_crc.dma_channel;
 
-    D_ASSERT(g_crc.signature == CRC_DEVICE_SIGNATURE);
-    struct crc_device_var *const crc_var_p = g_crc.var_p;
-
-    D_ASSERT(!crc_var_p->initialized);
-
-    CRC_Type *const crc_regs_p = g_crc.mmio_regs_p;
+    rtos_semaphore_init(&g_crc.var_p->dma_semaphore, "CRC DMA semaphore", 0);
 
     /*
-     * Enable the Clock to the CRC Module
+     * Enable clocks for the DMA engine and the DMA request multiplexer:
      */
     reg_value = READ_MMIO_REGISTER(&SIM_SCGC6);
-    reg_value |= SIM_SCGC6_CRC_MASK;
+    reg_value |= SIM_SCGC6_DMAMUX_MASK;
     WRITE_MMIO_REGISTER(&SIM_SCGC6, reg_value);
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC7);
+    reg_value |= SIM_SCGC7_DMA_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC7, reg_value);
 
-    WRITE_MMIO_REGISTER(&crc_regs_p->CTRL, 0);
-    crc_var_p->initialized = true;
+    /*
+     * Use round-robin channel arbitration, so that the CRC channel, which
+     * requests service continuously during a transfer, does not hold off
+     * the lower-numbered UART Rx DMA channels for more than one minor loop:
+     */
+    reg_value = READ_MMIO_REGISTER(&DMA0->CR);
+    reg_value |= DMA_CR_ERCA_MASK;
+    WRITE_MMIO_REGISTER(&DMA0->CR, reg_value);
+
+    /*
+     * Configure the parts of the channel's TCD that are the same for all
+     * transfers: one 32-bit word per minor loop, to the DATA register.
+     * The channel's request is disabled by hardware (DREQ) when the major
+     * loop completes:
+     */
+    WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel], 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SOFF, sizeof(uint32_t));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].ATTR,
+                        DMA_ATTR_SSIZE(2) | DMA_ATTR_DSIZE(2));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].NBYTES_MLNO, sizeof(uint32_t));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SLAST, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DADDR,
+                        (uint32_t)&g_crc.mmio_regs_p->DATA);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DOFF, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DLAST_SGA, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CSR,
+                        DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK);
+    WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel],
+                        DMAMUX_CHCFG_ENBL_MASK |
+                        DMAMUX_CHCFG_SOURCE(g_crc.dma_request_source));
+
+    nvic_setup_irq(g_crc.dma_irq_num, CRC_32_DMA_INTERRUPT_PRIORITY);
 }
 
 
 /**
- * Calculate CRC-32 using the CRC hardware module
- *
- * @param data_buf_p	Pointer to data buffer for which
- *                      CRC is to be computed
- * @param num_bytes		Size of the data buffer
- *
- * @return Computed CRC-32
+ * Initializes CRC hardware module
  */
-uint32_t crc_32_accelerator_run(const void *data_buf_p, size_t num_bytes)
+void crc_32_accelerator_init(void)
 {
-#   define CRC_32_POLYNOMIAL UINT32_C(0x04C11DB7)
-
     uint32_t reg_value;
-    struct crc_device_var *const crc_var_p = g_crc.var_p;
 
-#   ifdef USE_MPU
-    bool privileged_caller = rtos_enter_privileged_mode();
-#   endif
+    D_ASSERT(g_crc.signature == CRC_DEVICE_SIGNATURE);
+    struct crc_device_var *const crc_var_p = g_crc.var_p;
 
-    D_ASSERT(crc_var_p->initialized);
+    D_ASSERT(!crc_var_p->initialized);
 
     CRC_Type *const crc_regs_p = g_crc.mmio_regs_p;
 
     /*
-     * Configure CRC functionality:
+     * Enable the Clock to the CRC Module
+     */
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC6);
+    reg_value |= SIM_SCGC6_CRC_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC6, reg_value);
+
+    /*
+     * Configure CRC functionality, once for all computations, as nothing
+     * else uses the CRC module:
      * - Select 32-bit CRC
      * - Don't do 1's complement of input data
-     * - Bits in bytes are transposed but bytes are not transposed, when writing
-     *   to DATA register.
+     * - Both bits in bytes and bytes are transposed when writing the DATA
+     *   register, so 32-bit words can be written as loaded from memory
+     *   (little endian) and bytes can be written to its lowest byte.
      * - Both bits in bytes and bytes are transposed when reading DATA register
      */
-    reg_value = READ_MMIO_REGISTER(&crc_regs_p->CTRL);
+    reg_value = 0;
     reg_value |= CRC_CTRL_TCRC_MASK;
-    reg_value &= ~CRC_CTRL_FXOR_MASK;
-    SET_BIT_FIELD(reg_value, CRC_CTRL_TOT_MASK, CRC_CTRL_TOT_SHIFT, 0x1);
+    SET_BIT_FIELD(reg_value, CRC_CTRL_TOT_MASK, CRC_CTRL_TOT_SHIFT, 0x2);
     SET_BIT_FIELD(reg_value, CRC_CTRL_TOTR_MASK, CRC_CTRL_TOTR_SHIFT, 0x2);
     WRITE_MMIO_REGISTER(&crc_regs_p->CTRL, reg_value);
 
@@ -107,6 +189,87 @@ uint32_t crc_32_accelerator_run(const void *data_buf_p, size_t num_bytes)
      */
     write_32bit_mmio_register(&crc_regs_p->GPOLY, CRC_32_POLYNOMIAL);
 
+    rtos_mutex_init(&crc_var_p->mutex, "CRC mutex");
+    crc_var_p->dma_bytes = 0;
+    crc_var_p->cpu_bytes = 0;
+    crc_32_dma_init();
+    crc_var_p->initialized = true;
+}
+
+
+/**
+ * Writes bytes, one at a time, to the CRC DATA register
+ */
+static void crc_32_write_bytes(CRC_Type *crc_regs_p, const uint8_t *p,
+                               size_t num_bytes)
+{
+    for (const uint8_t *end_p = p + num_bytes; p != end_p; p ++) {
+        WRITE_MMIO_REGISTER(&crc_regs_p->ACCESS8BIT.DATALL, *p);
+    }
+}
+
+
+/**
+ * Writes 32-bit words to the CRC DATA register
+ */
+static void crc_32_write_words(CRC_Type *crc_regs_p, const uint32_t *p,
+                               size_t num_words)
+{
+    for (const uint32_t *end_p = p + num_words; p != end_p; p ++) {
+        WRITE_MMIO_REGISTER(&crc_regs_p->DATA, *p);
+    }
+}
+
+
+/**
+ * Moves 32-bit words to the CRC DATA register with the DMA channel, and
+ * waits for the transfer to complete
+ */
+static void crc_32_dma_transfer(const uint32_t *p, size_t num_words)
+{
+    uint8_t dma_channel = g_crc.dma_channel;
+
+    D_ASSERT(num_words != 0 && num_words <= CRC_32_DMA_MAX_WORDS_PER_TRANSFER);
+
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SADDR, (uint32_t)p);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CITER_ELINKNO,
+                        DMA_CITER_ELINKNO_CITER(num_words));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].BITER_ELINKNO,
+                        DMA_BITER_ELINKNO_BITER(num_words));
+    WRITE_MMIO_REGISTER(&DMA0->SERQ, dma_channel);
+
+    rtos_semaphore_wait(&g_crc.var_p->dma_semaphore);
+
+    if (READ_MMIO_REGISTER(&DMA0->ERR) & BIT(dma_channel)) {
+        error_t error = CAPTURE_ERROR("CRC DMA transfer failed", p,
+                                      READ_MMIO_REGISTER(&DMA0->ES));
+
+        fatal_error_handler(error);
+        /*UNREACHABLE*/
+    }
+}
+
+
+/**
+ * Starts an incremental CRC-32 computation with the CRC hardware module.
+ * Data is then fed with crc_32_accelerator_update() or
+ * crc_32_accelerator_update_dma(), and the CRC is obtained with
+ * crc_32_accelerator_final(). The CRC module is reserved for the calling
+ * task until then.
+ */
+void crc_32_accelerator_begin(void)
+{
+    uint32_t reg_value;
+    struct crc_device_var *const crc_var_p = g_crc.var_p;
+    CRC_Type *const crc_regs_p = g_crc.mmio_regs_p;
+
+    D_ASSERT(crc_var_p->initialized);
+    rtos_mutex_lock(&crc_var_p->mutex);
+
+#   ifdef USE_MPU
+    bool privileged_caller = rtos_enter_privileged_mode();
+#   endif
+
     /*
      * Program seed
      */
@@ -117,37 +280,131 @@ uint32_t crc_32_accelerator_run(const void *data_buf_p, size_t num_bytes)
     reg_value &= ~CRC_CTRL_WAS_MASK;
     WRITE_MMIO_REGISTER(&crc_regs_p->CTRL, reg_value);
 
-    /*
-     * Write data values (most significant byte first - Big endian):
-     */
-    size_t num_words = num_bytes / 4;
-    size_t remaining_bytes = num_bytes % 4;
+#   ifdef USE_MPU
+    if (!privileged_caller) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Feeds a block of data to the incremental CRC-32 computation started by
+ * the calling task, using the CPU to write the CRC DATA register
+ *
+ * @param data_buf_p	Pointer to data buffer
+ * @param num_bytes		Size of the data buffer
+ */
+void crc_32_accelerator_update(const void *data_buf_p, size_t num_bytes)
+{
+    struct crc_device_var *const crc_var_p = g_crc.var_p;
+    CRC_Type *const crc_regs_p = g_crc.mmio_regs_p;
     const uint8_t *p = data_buf_p;
-    const uint8_t *end_p = p + num_words * 4;
-
-    for ( ; p != end_p; p += 4) {
-        reg_value = (((uint32_t)p[0] << 24) |
-                     ((uint32_t)p[1] << 16) |
-                     ((uint32_t)p[2] << 8) |
-                     (uint32_t)p[3]);
-        WRITE_MMIO_REGISTER(&crc_regs_p->DATA, reg_value);
+    size_t head_size = (-(uintptr_t)p) % sizeof(uint32_t);
+
+    D_ASSERT(rtos_mutex_is_mine(&crc_var_p->mutex));
+
+#   ifdef USE_MPU
+    bool privileged_caller = rtos_enter_privileged_mode();
+#   endif
+
+    if (head_size > num_bytes) {
+        head_size = num_bytes;
+    }
+
+    crc_32_write_bytes(crc_regs_p, p, head_size);
+    p += head_size;
+    num_bytes -= head_size;
+    crc_32_write_words(crc_regs_p, (const uint32_t *)p,
+                       num_bytes / sizeof(uint32_t));
+    p += ROUND_DOWN(num_bytes, sizeof(uint32_t));
+    crc_32_write_bytes(crc_regs_p, p, num_bytes % sizeof(uint32_t));
+    crc_var_p->cpu_bytes += head_size + num_bytes;
+
+#   ifdef USE_MPU
+    if (!privileged_caller) {
+        rtos_exit_privileged_mode();
     }
+#   endif
+}
+
+
+/**
+ * Feeds a block of data to the incremental CRC-32 computation started by
+ * the calling task, using DMA to write the CRC DATA register. The calling
+ * task blocks until the transfer completes, leaving the CPU to other tasks.
+ * Blocks shorter than CRC_32_DMA_MIN_SIZE and the unaligned head and tail
+ * bytes of a block are fed by the CPU.
+ *
+ * @param data_buf_p	Pointer to data buffer
+ * @param num_bytes		Size of the data buffer
+ */
+void crc_32_accelerator_update_dma(const void *data_buf_p, size_t num_bytes)
+{
+    struct crc_device_var *const crc_var_p = g_crc.var_p;
+    CRC_Type *const crc_regs_p = g_crc.mmio_regs_p;
+    const uint8_t *p = data_buf_p;
+    size_t head_size = (-(uintptr_t)p) % sizeof(uint32_t);
 
-    switch (remaining_bytes) {
-    case 3:
-        WRITE_MMIO_REGISTER(&crc_regs_p->ACCESS8BIT.DATAHU, p[0]);
-        WRITE_MMIO_REGISTER(&crc_regs_p->ACCESS8BIT.DATAHL, p[1]);
-        WRITE_MMIO_REGISTER(&crc_regs_p->ACCESS8BIT.DATALU, p[2]);
-        break;
-    case 2:
-        WRITE_MMIO_REGISTER(&crc_regs_p->ACCESS8BIT.DATAHU, p[0]);
-        WRITE_MMIO_REGISTER(&crc_regs_p->ACCESS8BIT.DATAHL, p[1]);
-        break;
-    case 1:
-        WRITE_MMIO_REGISTER(&crc_regs_p->ACCESS8BIT.DATAHU, p[0]);
-        break;
+    D_ASSERT(rtos_mutex_is_mine(&crc_var_p->mutex));
+
+    if (num_bytes < CRC_32_DMA_MIN_SIZE) {
+        crc_32_accelerator_update(data_buf_p, num_bytes);
+        return;
     }
 
+#   ifdef USE_MPU
+    bool privileged_caller = rtos_enter_privileged_mode();
+#   endif
+
+    crc_32_write_bytes(crc_regs_p, p, head_size);
+    p += head_size;
+    num_bytes -= head_size;
+    crc_var_p->cpu_bytes += head_size + num_bytes % sizeof(uint32_t);
+
+    size_t num_words = num_bytes / sizeof(uint32_t);
+
+    crc_var_p->dma_bytes += num_words * sizeof(uint32_t);
+    while (num_words != 0) {
+        size_t chunk_words = num_words;
+
+        if (chunk_words > CRC_32_DMA_MAX_WORDS_PER_TRANSFER) {
+            chunk_words = CRC_32_DMA_MAX_WORDS_PER_TRANSFER;
+        }
+
+        crc_32_dma_transfer((const uint32_t *)p, chunk_words);
+        p += chunk_words * sizeof(uint32_t);
+        num_words -= chunk_words;
+    }
+
+    crc_32_write_bytes(crc_regs_p, p, num_bytes % sizeof(uint32_t));
+
+#   ifdef USE_MPU
+    if (!privileged_caller) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Ends the incremental CRC-32 computation started by the calling task,
+ * releasing the CRC module
+ *
+ * @return Computed CRC-32
+ */
+uint32_t crc_32_accelerator_final(void)
+{
+    uint32_t reg_value;
+    struct crc_device_var *const crc_var_p = g_crc.var_p;
+    CRC_Type *const crc_regs_p = g_crc.mmio_regs_p;
+
+    D_ASSERT(rtos_mutex_is_mine(&crc_var_p->mutex));
+
+#   ifdef USE_MPU
+    bool privileged_caller = rtos_enter_privileged_mode();
+#   endif
+
     /*
      * Retrieve calculated CRC:
      */
@@ -159,6 +416,48 @@ uint32_t crc_32_accelerator_run(const void *data_buf_p, size_t num_bytes)
     }
 #   endif
 
+    rtos_mutex_unlock(&crc_var_p->mutex);
     return reg_value;
 }
 
+
+/**
+ * Calculate CRC-32 using the CRC hardware module
+ *
+ * @param data_buf_p	Pointer to data buffer for which
+ *                      CRC is to be computed
+ * @param num_bytes		Size of the data buffer
+ *
+ * @return Computed CRC-32
+ */
+uint32_t crc_32_accelerator_run(const void *data_buf_p, size_t num_bytes)
+{
+    crc_32_accelerator_begin();
+    crc_32_accelerator_update(data_buf_p, num_bytes);
+    return crc_32_accelerator_final();
+}
+
+
+/**
+ * Returns the number of bytes fed to the CRC module by the CPU and by DMA
+ * since boot
+ */
+void crc_32_accelerator_get_stats(uint32_t *cpu_bytes_p, uint32_t *dma_bytes_p)
+{
+    *cpu_bytes_p = g_crc.var_p->cpu_bytes;
+    *dma_bytes_p = g_crc.var_p->dma_bytes;
+}
+
+
+/**
+ * ISR for the CRC DMA channel interrupt
+ */
+void crc_32_dma_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    WRITE_MMIO_REGISTER(&DMA0->CINT, g_crc.dma_channel);
+    rtos_semaphore_signal(&g_crc.var_p->dma_semaphore);
+    rtos_exit_isr();
+}
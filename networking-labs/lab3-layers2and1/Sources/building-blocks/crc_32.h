@@ -15,4 +15,14 @@ void crc_32_accelerator_init(void);
 
 uint32_t crc_32_accelerator_run(const void *data_buf_p, size_t num_bytes);
 
+void crc_32_accelerator_begin(void);
+
+void crc_32_accelerator_update(const void *data_buf_p, size_t num_bytes);
+
+void crc_32_accelerator_update_dma(const void *data_buf_p, size_t num_bytes);
+
+uint32_t crc_32_accelerator_final(void);
+
+void crc_32_accelerator_get_stats(uint32_t *cpu_bytes_p, uint32_t *dma_bytes_p);
+
 #endif /* SOURCES_BUILDING_BLOCKS_CRC_32_H_ */
@@ -0,0 +1,389 @@
+/**
+ * @file dma_memcpy.c
+ *
+ * DMA-engine memory copy service implementation
+ *
+ * @author German Rivera
+ */
+#include "dma_memcpy.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+#include "io_utils.h"
+#include "mem_utils.h"
+#include "rtos_wrapper.h"
+#include "interrupt_vector_table.h"
+
+/**
+ * eDMA channel used for memory copies (channels 0 and 1 are used by the
+ * UARTs' Rx DMA mode and channel 2 by the CRC accelerator)
+ */
+#define DMA_MEMCPY_CHANNEL              3
+
+/**
+ * DMAMUX request source for the copy channel: one of the "always enabled"
+ * slots (see K64F reference manual, table 3-24), so that the channel keeps
+ * requesting service until its major loop completes.
+ */
+#define DMA_MEMCPY_REQUEST_SOURCE       62
+
+/**
+ * Bytes moved per minor loop. The channel gives up the DMA engine to other
+ * channels between minor loops (round-robin arbitration).
+ */
+#define DMA_MEMCPY_MINOR_LOOP_SIZE      UINT32_C(32)
+
+/**
+ * Maximum number of minor loops in one major loop (CITER is a 15-bit field)
+ */
+#define DMA_MEMCPY_MAX_MINOR_LOOPS      UINT32_C(0x7fff)
+
+/**
+ * State of the memory copy service
+ */
+struct dma_memcpy_service {
+    bool initialized;
+
+    /**
+     * FIFO queue of requests. The head request is the one in progress on the
+     * DMA channel. It is protected by disabling interrupts, as it is updated
+     * from the DMA channel's ISR.
+     */
+    struct dma_memcpy_request *head_p;
+    struct dma_memcpy_request *tail_p;
+
+    /**
+     * Request and semaphore used by dma_memcpy(), serialized by
+     * sync_mutex
+     */
+    struct rtos_mutex sync_mutex;
+    struct dma_memcpy_request sync_request;
+    struct rtos_semaphore sync_semaphore;
+
+    uint32_t num_queued;
+    uint32_t max_queued;
+    uint32_t dma_copies;
+    uint32_t cpu_copies;
+};
+
+static struct dma_memcpy_service g_dma_memcpy = {
+    .initialized = false,
+};
+
+
+/**
+ * Initializes the memory copy service
+ */
+void dma_memcpy_init(void)
+{
+    uint32_t reg_value;
+    uint8_t dma_channel = DMA_MEMCPY_CHANNEL;
+
+    D_ASSERT(!g_dma_memcpy.initialized);
+
+    g_dma_memcpy.head_p = NULL;
+    g_dma_memcpy.tail_p = NULL;
+    g_dma_memcpy.num_queued = 0;
+    g_dma_memcpy.max_queued = 0;
+    g_dma_memcpy.dma_copies = 0;
+    g_dma_memcpy.cpu_copies = 0;
+    rtos_mutex_init(&g_dma_memcpy.sync_mutex, "DMA memcpy mutex");
+    rtos_semaphore_init(&g_dma_memcpy.sync_semaphore, "DMA memcpy semaphore",
+                        0);
+    dma_memcpy_request_init(&g_dma_memcpy.sync_request);
+
+    /*
+     * Enable clocks for the DMA engine and the DMA request multiplexer:
+     */
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC6);
+    reg_value |= SIM_SCGC6_DMAMUX_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC6, reg_value);
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC7);
+    reg_value |= SIM_SCGC7_DMA_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC7, reg_value);
+
+    /*
+     * Use round-robin channel arbitration, so that long copies do not hold
+     * off the other DMA channels for more than one minor loop:
+     */
+    reg_value = READ_MMIO_REGISTER(&DMA0->CR);
+    reg_value |= DMA_CR_ERCA_MASK;
+    WRITE_MMIO_REGISTER(&DMA0->CR, reg_value);
+
+    /*
+     * The channel's request is disabled by hardware (DREQ) when the major
+     * loop completes:
+     */
+    WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel], 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].NBYTES_MLNO,
+                        DMA_MEMCPY_MINOR_LOOP_SIZE);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SLAST, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DLAST_SGA, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CSR,
+                        DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK);
+    WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel],
+                        DMAMUX_CHCFG_ENBL_MASK |
+                        DMAMUX_CHCFG_SOURCE(DMA_MEMCPY_REQUEST_SOURCE));
+
+    nvic_setup_irq(DMA3_IRQn, DMA_MEMCPY_INTERRUPT_PRIORITY);
+    g_dma_memcpy.initialized = true;
+}
+
+
+/**
+ * Initializes a memory copy request
+ *
+ * @param request_p     Pointer to the request
+ */
+void dma_memcpy_request_init(struct dma_memcpy_request *request_p)
+{
+    request_p->signature = DMA_MEMCPY_REQUEST_SIGNATURE;
+    request_p->done = true;
+    request_p->callback_p = NULL;
+    request_p->callback_arg = NULL;
+    request_p->next_p = NULL;
+}
+
+
+/**
+ * Programs the DMA channel for the next chunk of a request, and starts it
+ *
+ * @pre Called with interrupts disabled
+ */
+static void dma_memcpy_start_chunk(struct dma_memcpy_request *request_p)
+{
+    static const uint8_t attr_sizes[] = {
+        [1] = 0, [2] = 1, [4] = 2, [16] = 4,
+    };
+
+    uint8_t dma_channel = DMA_MEMCPY_CHANNEL;
+    uint32_t num_minor_loops =
+        request_p->dma_remaining_size / DMA_MEMCPY_MINOR_LOOP_SIZE;
+    uint32_t attr_size = attr_sizes[request_p->dma_transfer_size];
+
+    if (num_minor_loops > DMA_MEMCPY_MAX_MINOR_LOOPS) {
+        num_minor_loops = DMA_MEMCPY_MAX_MINOR_LOOPS;
+    }
+
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SADDR,
+                        (uint32_t)request_p->src_cursor_p);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SOFF,
+                        request_p->dma_transfer_size);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].ATTR,
+                        DMA_ATTR_SSIZE(attr_size) | DMA_ATTR_DSIZE(attr_size));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DADDR,
+                        (uint32_t)request_p->dst_cursor_p);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DOFF,
+                        request_p->dma_transfer_size);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CITER_ELINKNO,
+                        DMA_CITER_ELINKNO_CITER(num_minor_loops));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].BITER_ELINKNO,
+                        DMA_BITER_ELINKNO_BITER(num_minor_loops));
+
+    request_p->src_cursor_p += num_minor_loops * DMA_MEMCPY_MINOR_LOOP_SIZE;
+    request_p->dst_cursor_p += num_minor_loops * DMA_MEMCPY_MINOR_LOOP_SIZE;
+    request_p->dma_remaining_size -=
+        num_minor_loops * DMA_MEMCPY_MINOR_LOOP_SIZE;
+
+    /*
+     * Make sure that the CPU's writes to the source have reached memory
+     * before the DMA engine reads it:
+     */
+    __DSB();
+    WRITE_MMIO_REGISTER(&DMA0->SERQ, dma_channel);
+}
+
+
+/**
+ * Marks a request as complete, and invokes its callback
+ */
+static void dma_memcpy_complete(struct dma_memcpy_request *request_p)
+{
+    request_p->done = true;
+    if (request_p->callback_p != NULL) {
+        request_p->callback_p(request_p, request_p->callback_arg);
+    }
+}
+
+
+/**
+ * Starts an asynchronous memory copy. The request is queued for the DMA
+ * channel, unless the copy is shorter than DMA_MEMCPY_MIN_SIZE, in which
+ * case it is done by the CPU before returning. It can be called from ISRs.
+ *
+ * @param request_p     Pointer to a request that is not in progress
+ * @param dst_p         Destination
+ * @param src_p         Source
+ * @param size          Number of bytes to copy
+ * @param callback_p    Function to invoke when the copy is complete, or NULL
+ * @param callback_arg  Argument for callback_p
+ */
+void dma_memcpy_start(struct dma_memcpy_request *request_p,
+                      void *dst_p, const void *src_p, size_t size,
+                      dma_memcpy_callback_t *callback_p, void *callback_arg)
+{
+    uint8_t *dst_cursor_p = dst_p;
+    const uint8_t *src_cursor_p = src_p;
+
+    D_ASSERT(g_dma_memcpy.initialized);
+    D_ASSERT(request_p->signature == DMA_MEMCPY_REQUEST_SIGNATURE);
+    D_ASSERT(request_p->done);
+
+    request_p->done = false;
+    request_p->callback_p = callback_p;
+    request_p->callback_arg = callback_arg;
+    if (size < DMA_MEMCPY_MIN_SIZE) {
+        mem_copy(dst_p, src_p, size);
+        ATOMIC_POST_INCREMENT_UINT32(&g_dma_memcpy.cpu_copies);
+        dma_memcpy_complete(request_p);
+        return;
+    }
+
+    /*
+     * Pick the widest DMA transfer size allowed by the relative alignment
+     * of source and destination, and copy with the CPU the bytes before
+     * the first aligned address and after the last whole minor loop:
+     */
+    uintptr_t misalignment = (uintptr_t)dst_cursor_p ^ (uintptr_t)src_cursor_p;
+    uint8_t transfer_size;
+
+    if (misalignment % sizeof(uint32_t) == 0) {
+        transfer_size = sizeof(uint32_t);
+    } else if (misalignment % sizeof(uint16_t) == 0) {
+        transfer_size = sizeof(uint16_t);
+    } else {
+        transfer_size = 1;
+    }
+
+    size_t head_size = (-(uintptr_t)dst_cursor_p) % transfer_size;
+
+    mem_copy(dst_cursor_p, src_cursor_p, head_size);
+    dst_cursor_p += head_size;
+    src_cursor_p += head_size;
+    size -= head_size;
+    if (transfer_size == sizeof(uint32_t) &&
+        ((uintptr_t)dst_cursor_p | (uintptr_t)src_cursor_p) % 16 == 0) {
+        transfer_size = 16;
+    }
+
+    size_t dma_size = ROUND_DOWN(size, DMA_MEMCPY_MINOR_LOOP_SIZE);
+
+    mem_copy(dst_cursor_p + dma_size, src_cursor_p + dma_size,
+             size - dma_size);
+
+    request_p->dst_cursor_p = dst_cursor_p;
+    request_p->src_cursor_p = src_cursor_p;
+    request_p->dma_remaining_size = dma_size;
+    request_p->dma_transfer_size = transfer_size;
+    request_p->next_p = NULL;
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (g_dma_memcpy.tail_p == NULL) {
+        g_dma_memcpy.head_p = request_p;
+        g_dma_memcpy.tail_p = request_p;
+        dma_memcpy_start_chunk(request_p);
+    } else {
+        g_dma_memcpy.tail_p->next_p = request_p;
+        g_dma_memcpy.tail_p = request_p;
+    }
+
+    g_dma_memcpy.num_queued ++;
+    if (g_dma_memcpy.num_queued > g_dma_memcpy.max_queued) {
+        g_dma_memcpy.max_queued = g_dma_memcpy.num_queued;
+    }
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+static void dma_memcpy_sync_callback(struct dma_memcpy_request *request_p,
+                                     void *arg)
+{
+    rtos_semaphore_signal(&g_dma_memcpy.sync_semaphore);
+}
+
+
+/**
+ * Copies a block of memory with the DMA engine, blocking the calling task
+ * (not the CPU) until the copy is complete. Short copies are done by the
+ * CPU. It must be called from a task.
+ *
+ * @param dst_p         Destination
+ * @param src_p         Source
+ * @param size          Number of bytes to copy
+ */
+void dma_memcpy(void *dst_p, const void *src_p, size_t size)
+{
+    if (size < DMA_MEMCPY_MIN_SIZE) {
+        mem_copy(dst_p, src_p, size);
+        ATOMIC_POST_INCREMENT_UINT32(&g_dma_memcpy.cpu_copies);
+        return;
+    }
+
+    rtos_mutex_lock(&g_dma_memcpy.sync_mutex);
+    dma_memcpy_start(&g_dma_memcpy.sync_request, dst_p, src_p, size,
+                     dma_memcpy_sync_callback, NULL);
+    rtos_semaphore_wait(&g_dma_memcpy.sync_semaphore);
+    rtos_mutex_unlock(&g_dma_memcpy.sync_mutex);
+}
+
+
+/**
+ * Returns the number of copies done by DMA, the number of copies done by
+ * the CPU and the maximum number of requests ever queued
+ */
+void dma_memcpy_get_stats(uint32_t *dma_copies_p, uint32_t *cpu_copies_p,
+                          uint32_t *max_queued_p)
+{
+    *dma_copies_p = g_dma_memcpy.dma_copies;
+    *cpu_copies_p = g_dma_memcpy.cpu_copies;
+    *max_queued_p = g_dma_memcpy.max_queued;
+}
+
+
+/**
+ * ISR for the memory copy DMA channel interrupt
+ */
+void dma_memcpy_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    WRITE_MMIO_REGISTER(&DMA0->CINT, DMA_MEMCPY_CHANNEL);
+
+    if (READ_MMIO_REGISTER(&DMA0->ERR) & BIT(DMA_MEMCPY_CHANNEL)) {
+        error_t error = CAPTURE_ERROR("DMA memcpy transfer failed",
+                                      g_dma_memcpy.head_p,
+                                      READ_MMIO_REGISTER(&DMA0->ES));
+
+        fatal_error_handler(error);
+        /*UNREACHABLE*/
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+    struct dma_memcpy_request *request_p = g_dma_memcpy.head_p;
+
+    D_ASSERT(request_p != NULL);
+    D_ASSERT(request_p->signature == DMA_MEMCPY_REQUEST_SIGNATURE);
+    if (request_p->dma_remaining_size != 0) {
+        dma_memcpy_start_chunk(request_p);
+        request_p = NULL;
+    } else {
+        g_dma_memcpy.head_p = request_p->next_p;
+        if (g_dma_memcpy.head_p == NULL) {
+            g_dma_memcpy.tail_p = NULL;
+        } else {
+            dma_memcpy_start_chunk(g_dma_memcpy.head_p);
+        }
+
+        g_dma_memcpy.num_queued --;
+        g_dma_memcpy.dma_copies ++;
+    }
+
+    restore_cpu_interrupts(int_mask);
+    if (request_p != NULL) {
+        dma_memcpy_complete(request_p);
+    }
+
+    rtos_exit_isr();
+}
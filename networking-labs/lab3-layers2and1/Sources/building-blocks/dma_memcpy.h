@@ -0,0 +1,95 @@
+/**
+ * @file dma_memcpy.h
+ *
+ * DMA-engine memory copy service interface
+ *
+ * Copies are done by an eDMA channel, one request at a time in FIFO order,
+ * while the CPU does other work. Copies shorter than DMA_MEMCPY_MIN_SIZE
+ * are done by the CPU right away, as setting up the DMA channel and taking
+ * its completion interrupt would cost more than the copy itself.
+ *
+ * NOTE: The source and destination of a request must not overlap and must
+ * not be touched by the CPU until the request is complete.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_DMA_MEMCPY_H_
+#define SOURCES_BUILDING_BLOCKS_DMA_MEMCPY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Shortest copy done by DMA
+ */
+#define DMA_MEMCPY_MIN_SIZE     UINT32_C(256)
+
+struct dma_memcpy_request;
+
+/**
+ * Signature of a copy completion callback. It is invoked from the DMA
+ * channel's ISR, or from dma_memcpy_start() for copies done by the CPU.
+ */
+typedef void dma_memcpy_callback_t(struct dma_memcpy_request *request_p,
+                                   void *arg);
+
+/**
+ * Memory copy request
+ */
+struct dma_memcpy_request {
+#   define DMA_MEMCPY_REQUEST_SIGNATURE  GEN_SIGNATURE('D', 'M', 'A', 'R')
+    uint32_t signature;
+
+    /**
+     * Flag set when the copy is complete
+     */
+    volatile bool done;
+
+    /**
+     * Remaining part of the copy to be done by DMA
+     */
+    uint8_t *dst_cursor_p;
+    const uint8_t *src_cursor_p;
+    size_t dma_remaining_size;
+
+    /**
+     * Number of bytes read and written by each DMA read/write (1, 2, 4 or
+     * 16), as allowed by the relative alignment of source and destination
+     */
+    uint8_t dma_transfer_size;
+
+    /**
+     * Completion callback (optional)
+     */
+    dma_memcpy_callback_t *callback_p;
+    void *callback_arg;
+
+    /**
+     * Next request in the DMA channel's queue
+     */
+    struct dma_memcpy_request *next_p;
+};
+
+void dma_memcpy_init(void);
+
+void dma_memcpy_request_init(struct dma_memcpy_request *request_p);
+
+void dma_memcpy_start(struct dma_memcpy_request *request_p,
+                      void *dst_p, const void *src_p, size_t size,
+                      dma_memcpy_callback_t *callback_p, void *callback_arg);
+
+/**
+ * Tells if a copy started with dma_memcpy_start() is complete
+ */
+static inline bool dma_memcpy_is_done(const struct dma_memcpy_request *request_p)
+{
+    return request_p->done;
+}
+
+void dma_memcpy(void *dst_p, const void *src_p, size_t size);
+
+void dma_memcpy_get_stats(uint32_t *dma_copies_p, uint32_t *cpu_copies_p,
+                          uint32_t *max_queued_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_DMA_MEMCPY_H_ */
@@ -0,0 +1,986 @@
+/**
+ * @file dns_resolver.c
+ *
+ * DNS resolver implementation
+ *
+ * @author German Rivera
+ */
+#include "dns_resolver.h"
+#include "networking_layer4.h"
+#include "networking_layer2.h"
+#include "rtos_wrapper.h"
+#include "time_utils.h"
+#include "arm_cortex_m_defs.h"
+#include "mem_utils.h"
+#include "net_config.h"
+#include <string.h>
+
+/**
+ * Number of entries of the DNS resolver cache
+ */
+#define DNS_RESOLVER_CACHE_NUM_ENTRIES          NET_CONFIG_DNS_CACHE_NUM_ENTRIES
+
+/**
+ * Time in milliseconds to wait for the reply to a query, before sending it
+ * again
+ */
+#define DNS_RESOLVER_RETRANSMIT_TIMEOUT_MS      1000
+
+/**
+ * Maximum number of times a query is sent, before giving up
+ */
+#define DNS_RESOLVER_MAX_TRANSMISSIONS          3
+
+/**
+ * Bounds of the time in seconds a resolved name is kept in the cache. The
+ * TTL of an A record is clamped to them, so that a name with a TTL of 0 is
+ * not resolved again on every lookup, and a name with a very long TTL does
+ * not become stale forever.
+ */
+#define DNS_RESOLVER_MIN_TTL_SECONDS            5
+#define DNS_RESOLVER_MAX_TTL_SECONDS            3600
+
+/**
+ * Time in seconds a name that does not exist, or that has no IPv4 address,
+ * is kept in the cache
+ */
+#define DNS_RESOLVER_NEGATIVE_TTL_SECONDS       30
+
+/**
+ * Time in seconds a name that could not be resolved, because the server did
+ * not reply or reported an error, is kept in the cache
+ */
+#define DNS_RESOLVER_FAILURE_TTL_SECONDS        5
+
+/**
+ * Maximum number of compression pointers followed when decoding a name in a
+ * DNS message, to not loop forever on malformed messages
+ */
+#define DNS_MAX_COMPRESSION_POINTERS            8
+
+/**
+ * DNS resource record types and classes used
+ */
+#define DNS_TYPE_A                              1
+#define DNS_CLASS_IN                            1
+
+/**
+ * Size in bytes of the fixed part of a DNS question (type and class),
+ * and of a DNS resource record (type, class, TTL and data length)
+ */
+#define DNS_QUESTION_FIXED_SIZE                 4
+#define DNS_RESOURCE_RECORD_FIXED_SIZE          10
+
+/**
+ * States of a DNS resolver cache entry
+ */
+enum dns_cache_entry_states {
+    DNS_CACHE_ENTRY_FREE = 0,
+    DNS_CACHE_ENTRY_PENDING,
+    DNS_CACHE_ENTRY_RESOLVED,
+    DNS_CACHE_ENTRY_NEGATIVE,
+};
+
+/**
+ * DNS resolver cache entry
+ */
+struct dns_cache_entry {
+    enum dns_cache_entry_states state;
+
+    /**
+     * Host name (null-terminated and in lower case)
+     */
+    char name[DNS_RESOLVER_MAX_NAME_LENGTH + 1];
+
+    /**
+     * Address the name resolved to. Only meaningful in the
+     * DNS_CACHE_ENTRY_RESOLVED state.
+     */
+    struct ipv4_address ip_addr;
+
+    /**
+     * RTOS ticks at which the entry expires. Only meaningful in the
+     * DNS_CACHE_ENTRY_RESOLVED and DNS_CACHE_ENTRY_NEGATIVE states.
+     */
+    uint32_t expire_ticks;
+
+    /**
+     * RTOS ticks at which the entry was last looked up, to pick the least
+     * recently used entry to evict
+     */
+    uint32_t last_use_ticks;
+
+    /**
+     * ID of the query in progress. Only meaningful in the
+     * DNS_CACHE_ENTRY_PENDING state.
+     */
+    uint16_t query_id;
+
+    /**
+     * Number of times the query in progress has been sent
+     */
+    uint8_t num_transmissions;
+
+    /**
+     * RTOS ticks at which the query in progress was last sent
+     */
+    uint32_t last_tx_ticks;
+};
+
+/**
+ * DNS resolver state
+ */
+struct dns_resolver {
+    bool initialized;
+
+    /**
+     * Address of the DNS server
+     */
+    struct ipv4_address server_ip_addr;
+
+    /**
+     * Name cache
+     */
+    struct dns_cache_entry cache[DNS_RESOLVER_CACHE_NUM_ENTRIES];
+
+    /**
+     * Number of cache entries in the DNS_CACHE_ENTRY_PENDING state
+     */
+    uint8_t num_pending_entries;
+
+    /**
+     * Counter used to generate query IDs
+     */
+    uint16_t next_query_id;
+
+    struct dns_resolver_stats stats;
+
+    /**
+     * Semaphore signaled when a resolution is started, to wake up the
+     * resolver task
+     */
+    struct rtos_semaphore work_semaphore;
+
+    /**
+     * Semaphore broadcast when resolutions complete, to wake up the tasks
+     * waiting in dns_resolver_resolve()
+     */
+    struct rtos_semaphore done_semaphore;
+
+    /**
+     * Mutex to serialize access to this structure
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Local UDP end point
+     */
+    struct net_layer4_end_point end_point;
+
+    /**
+     * Resolver task
+     */
+    struct rtos_task task;
+};
+
+static struct dns_resolver g_dns_resolver = {
+    .initialized = false,
+};
+
+
+/**
+ * Returns the lower-case version of an ASCII character
+ */
+static inline char dns_to_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+
+/**
+ * Reads a 16-bit big endian field of a DNS message, that may not be
+ * aligned
+ */
+static inline uint16_t dns_read_16(const uint8_t *field_p)
+{
+    return ((uint16_t)field_p[0] << 8) | field_p[1];
+}
+
+
+/**
+ * Reads a 32-bit big endian field of a DNS message, that may not be
+ * aligned
+ */
+static inline uint32_t dns_read_32(const uint8_t *field_p)
+{
+    return ((uint32_t)dns_read_16(field_p) << 16) | dns_read_16(field_p + 2);
+}
+
+
+/**
+ * Copies a host name into a cache entry name, in lower case
+ *
+ * @return true, if the name is a valid host name
+ * @return false, otherwise
+ */
+static bool dns_copy_name(char name[DNS_RESOLVER_MAX_NAME_LENGTH + 1],
+                          const char *name_p)
+{
+    size_t label_length = 0;
+    size_t i;
+
+    for (i = 0; name_p[i] != '\0'; i ++) {
+        if (i == DNS_RESOLVER_MAX_NAME_LENGTH) {
+            return false;
+        }
+
+        if (name_p[i] == '.') {
+            if (label_length == 0) {
+                return false;
+            }
+
+            label_length = 0;
+        } else {
+            label_length ++;
+        }
+
+        name[i] = dns_to_lower(name_p[i]);
+    }
+
+    name[i] = '\0';
+    return i != 0 && label_length != 0;
+}
+
+
+/**
+ * Decodes a name of a DNS message, following compression pointers
+ *
+ * @param msg_p         Pointer to the start of the DNS message
+ * @param msg_length    Length of the DNS message in bytes
+ * @param offset        Offset of the name in the message
+ * @param name          Area where the name is returned (null-terminated and
+ *                      in lower case)
+ * @param end_offset_p  Area where the offset of the first byte after the
+ *                      name (where it is in the message, not where it was
+ *                      pointed to) is returned
+ *
+ * @return true, if the name was decoded
+ * @return false, if the name is malformed or is too long
+ */
+static bool dns_decode_name(const uint8_t *msg_p, size_t msg_length,
+                            size_t offset,
+                            char name[DNS_RESOLVER_MAX_NAME_LENGTH + 1],
+                            size_t *end_offset_p)
+{
+    size_t name_length = 0;
+    uint_fast8_t num_pointers = 0;
+
+    *end_offset_p = 0;
+    for ( ; ; ) {
+        if (offset >= msg_length) {
+            return false;
+        }
+
+        uint_fast8_t label_length = msg_p[offset];
+
+        if ((label_length & 0xc0) == 0xc0) {
+            if (offset + 1 >= msg_length ||
+                num_pointers == DNS_MAX_COMPRESSION_POINTERS) {
+                return false;
+            }
+
+            if (num_pointers == 0) {
+                *end_offset_p = offset + 2;
+            }
+
+            num_pointers ++;
+            offset = dns_read_16(&msg_p[offset]) & 0x3fff;
+            continue;
+        }
+
+        if (label_length > 63) {
+            return false;
+        }
+
+        if (label_length == 0) {
+            if (num_pointers == 0) {
+                *end_offset_p = offset + 1;
+            }
+
+            name[name_length] = '\0';
+            return true;
+        }
+
+        if (offset + 1 + label_length > msg_length ||
+            name_length + (name_length != 0) + label_length >
+                DNS_RESOLVER_MAX_NAME_LENGTH) {
+            return false;
+        }
+
+        if (name_length != 0) {
+            name[name_length] = '.';
+            name_length ++;
+        }
+
+        for (uint_fast8_t i = 0; i < label_length; i ++) {
+            name[name_length] = dns_to_lower(msg_p[offset + 1 + i]);
+            name_length ++;
+        }
+
+        offset += 1 + label_length;
+    }
+}
+
+
+/**
+ * Skips a name of a DNS message
+ *
+ * @return offset of the first byte after the name, or 0 if the name is
+ *         malformed
+ */
+static size_t dns_skip_name(const uint8_t *msg_p, size_t msg_length,
+                            size_t offset)
+{
+    while (offset < msg_length) {
+        uint_fast8_t label_length = msg_p[offset];
+
+        if ((label_length & 0xc0) == 0xc0) {
+            return (offset + 2 <= msg_length) ? offset + 2 : 0;
+        }
+
+        if (label_length > 63) {
+            return 0;
+        }
+
+        offset += 1 + label_length;
+        if (label_length == 0) {
+            return offset;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Looks up a name in the cache. Must be called with the resolver's mutex
+ * held.
+ *
+ * @return pointer to the name's cache entry, or NULL if not found
+ */
+static struct dns_cache_entry *dns_cache_find(struct dns_resolver *resolver_p,
+                                              const char *name_p)
+{
+    for (uint_fast8_t i = 0; i < DNS_RESOLVER_CACHE_NUM_ENTRIES; i ++) {
+        struct dns_cache_entry *entry_p = &resolver_p->cache[i];
+
+        if (entry_p->state != DNS_CACHE_ENTRY_FREE &&
+            strcmp(entry_p->name, name_p) == 0) {
+            return entry_p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Tells if a resolved or negative cache entry has expired
+ */
+static bool dns_cache_entry_expired(const struct dns_cache_entry *entry_p,
+                                    uint32_t now_ticks)
+{
+    return (int32_t)(now_ticks - entry_p->expire_ticks) >= 0;
+}
+
+
+/**
+ * Picks a cache entry for a new name: a free entry, an expired entry, or
+ * else the least recently used entry that is not pending. Must be called
+ * with the resolver's mutex held.
+ *
+ * @return pointer to cache entry, or NULL if all entries are pending
+ */
+static struct dns_cache_entry *dns_cache_allocate(struct dns_resolver *resolver_p,
+                                                  uint32_t now_ticks)
+{
+    struct dns_cache_entry *lru_entry_p = NULL;
+
+    for (uint_fast8_t i = 0; i < DNS_RESOLVER_CACHE_NUM_ENTRIES; i ++) {
+        struct dns_cache_entry *entry_p = &resolver_p->cache[i];
+
+        if (entry_p->state == DNS_CACHE_ENTRY_FREE) {
+            return entry_p;
+        }
+
+        if (entry_p->state == DNS_CACHE_ENTRY_PENDING) {
+            continue;
+        }
+
+        if (dns_cache_entry_expired(entry_p, now_ticks)) {
+            return entry_p;
+        }
+
+        if (lru_entry_p == NULL ||
+            RTOS_TICKS_DELTA(entry_p->last_use_ticks, now_ticks) >
+            RTOS_TICKS_DELTA(lru_entry_p->last_use_ticks, now_ticks)) {
+            lru_entry_p = entry_p;
+        }
+    }
+
+    if (lru_entry_p != NULL) {
+        resolver_p->stats.cache_evictions ++;
+    }
+
+    return lru_entry_p;
+}
+
+
+/**
+ * Completes the resolution of a pending cache entry. Must be called with
+ * the resolver's mutex held.
+ *
+ * @param entry_p       Pointer to pending cache entry
+ * @param state         New state of the entry
+ * @param ttl_seconds   Time the entry is to be kept in the cache
+ */
+static void dns_cache_entry_complete(struct dns_resolver *resolver_p,
+                                     struct dns_cache_entry *entry_p,
+                                     enum dns_cache_entry_states state,
+                                     uint32_t ttl_seconds)
+{
+    D_ASSERT(entry_p->state == DNS_CACHE_ENTRY_PENDING);
+    D_ASSERT(resolver_p->num_pending_entries != 0);
+
+    entry_p->state = state;
+    entry_p->expire_ticks = rtos_get_ticks_since_boot() +
+                            ttl_seconds * RTOS_TICK_RATE_HZ;
+    resolver_p->num_pending_entries --;
+    rtos_semaphore_broadcast(&resolver_p->done_semaphore);
+}
+
+
+/**
+ * Sends the query of a pending cache entry to the DNS server. Must be
+ * called with the resolver's mutex held.
+ */
+static void dns_resolver_send_query(struct dns_resolver *resolver_p,
+                                    struct dns_cache_entry *entry_p)
+{
+    error_t error;
+    size_t name_length = strlen(entry_p->name);
+    size_t query_length = sizeof(struct dns_header) + name_length + 2 +
+                          DNS_QUESTION_FIXED_SIZE;
+
+    C_ASSERT(sizeof(struct dns_header) + DNS_RESOLVER_MAX_NAME_LENGTH + 2 +
+             DNS_QUESTION_FIXED_SIZE <= NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE);
+
+    entry_p->num_transmissions ++;
+    entry_p->last_tx_ticks = rtos_get_ticks_since_boot();
+
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(NET_PACKET_SMALL_DATA_BUFFER_SIZE, true);
+
+    if (tx_packet_p == NULL) {
+        resolver_p->stats.send_failures ++;
+        return;
+    }
+
+    struct dns_header *header_p = get_ipv4_udp_data_payload_area(tx_packet_p);
+    uint8_t *question_p = (uint8_t *)(header_p + 1);
+
+    header_p->id = hton16(entry_p->query_id);
+    header_p->flags = hton16(DNS_FLAG_RD);
+    header_p->question_count = hton16(1);
+    header_p->answer_count = 0;
+    header_p->authority_count = 0;
+    header_p->additional_count = 0;
+
+    /*
+     * Encode the name as a sequence of length-prefixed labels, replacing
+     * each '.' by the length of the label that follows it:
+     */
+    size_t label_length_offset = 0;
+
+    for (size_t i = 0; i <= name_length; i ++) {
+        if (i == name_length || entry_p->name[i] == '.') {
+            question_p[label_length_offset] = i - label_length_offset;
+            label_length_offset = i + 1;
+        } else {
+            question_p[i + 1] = entry_p->name[i];
+        }
+    }
+
+    question_p[name_length + 1] = 0;
+    question_p[name_length + 2] = 0;
+    question_p[name_length + 3] = DNS_TYPE_A;
+    question_p[name_length + 4] = 0;
+    question_p[name_length + 5] = DNS_CLASS_IN;
+
+    error = net_layer4_send_udp_datagram_over_ipv4(&resolver_p->end_point,
+                                                   &resolver_p->server_ip_addr,
+                                                   hton16(DNS_SERVER_PORT),
+                                                   tx_packet_p,
+                                                   query_length);
+    if (error != 0) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+        resolver_p->stats.send_failures ++;
+        return;
+    }
+
+    resolver_p->stats.queries_sent ++;
+}
+
+
+/**
+ * Processes a datagram received from the DNS server. Must be called with
+ * the resolver's mutex held.
+ *
+ * @return true, if the datagram was a valid reply to a pending query
+ * @return false, otherwise
+ */
+static bool dns_resolver_process_reply(struct dns_resolver *resolver_p,
+                                       const struct net_udp_rx_datagram *datagram_p)
+{
+    const uint8_t *msg_p = datagram_p->payload_p;
+    size_t msg_length = datagram_p->payload_length;
+    struct dns_cache_entry *entry_p = NULL;
+    char name[DNS_RESOLVER_MAX_NAME_LENGTH + 1];
+    size_t offset;
+
+    if (datagram_p->ip_version != 4 ||
+        datagram_p->source_ip_addr.ipv4.value != resolver_p->server_ip_addr.value ||
+        datagram_p->source_port != hton16(DNS_SERVER_PORT) ||
+        msg_length < sizeof(struct dns_header)) {
+        return false;
+    }
+
+    uint16_t query_id = dns_read_16(&msg_p[0]);
+    uint16_t flags = dns_read_16(&msg_p[2]);
+    uint16_t question_count = dns_read_16(&msg_p[4]);
+    uint16_t answer_count = dns_read_16(&msg_p[6]);
+
+    if (!(flags & DNS_FLAG_QR) || (flags & DNS_FLAG_OPCODE_MASK) != 0 ||
+        question_count != 1) {
+        return false;
+    }
+
+    /*
+     * The question must be the one of a pending query with the reply's ID,
+     * so that stray or forged replies are not accepted:
+     */
+    if (!dns_decode_name(msg_p, msg_length, sizeof(struct dns_header), name,
+                         &offset) ||
+        offset + DNS_QUESTION_FIXED_SIZE > msg_length ||
+        dns_read_16(&msg_p[offset]) != DNS_TYPE_A ||
+        dns_read_16(&msg_p[offset + 2]) != DNS_CLASS_IN) {
+        return false;
+    }
+
+    offset += DNS_QUESTION_FIXED_SIZE;
+    for (uint_fast8_t i = 0; i < DNS_RESOLVER_CACHE_NUM_ENTRIES; i ++) {
+        if (resolver_p->cache[i].state == DNS_CACHE_ENTRY_PENDING &&
+            resolver_p->cache[i].query_id == query_id &&
+            strcmp(resolver_p->cache[i].name, name) == 0) {
+            entry_p = &resolver_p->cache[i];
+            break;
+        }
+    }
+
+    if (entry_p == NULL) {
+        return false;
+    }
+
+    uint_fast8_t rcode = flags & DNS_FLAG_RCODE_MASK;
+
+    if (rcode == DNS_RCODE_NAME_ERROR) {
+        dns_cache_entry_complete(resolver_p, entry_p, DNS_CACHE_ENTRY_NEGATIVE,
+                                 DNS_RESOLVER_NEGATIVE_TTL_SECONDS);
+        resolver_p->stats.names_not_found ++;
+        return true;
+    }
+
+    if (rcode != DNS_RCODE_NO_ERROR || (flags & DNS_FLAG_TC)) {
+        dns_cache_entry_complete(resolver_p, entry_p, DNS_CACHE_ENTRY_NEGATIVE,
+                                 DNS_RESOLVER_FAILURE_TTL_SECONDS);
+        resolver_p->stats.resolution_failures ++;
+        return true;
+    }
+
+    /*
+     * Take the first A record of the answer section. Any CNAME records
+     * that precede it are skipped, as the server has already followed them:
+     */
+    for (uint_fast16_t i = 0; i < answer_count; i ++) {
+        offset = dns_skip_name(msg_p, msg_length, offset);
+        if (offset == 0 || offset + DNS_RESOURCE_RECORD_FIXED_SIZE > msg_length) {
+            break;
+        }
+
+        uint16_t type = dns_read_16(&msg_p[offset]);
+        uint16_t class = dns_read_16(&msg_p[offset + 2]);
+        uint32_t ttl_seconds = dns_read_32(&msg_p[offset + 4]);
+        uint16_t data_length = dns_read_16(&msg_p[offset + 8]);
+
+        offset += DNS_RESOURCE_RECORD_FIXED_SIZE;
+        if (offset + data_length > msg_length) {
+            break;
+        }
+
+        if (type == DNS_TYPE_A && class == DNS_CLASS_IN &&
+            data_length == sizeof(struct ipv4_address)) {
+            if (ttl_seconds < DNS_RESOLVER_MIN_TTL_SECONDS) {
+                ttl_seconds = DNS_RESOLVER_MIN_TTL_SECONDS;
+            } else if (ttl_seconds > DNS_RESOLVER_MAX_TTL_SECONDS) {
+                ttl_seconds = DNS_RESOLVER_MAX_TTL_SECONDS;
+            }
+
+            memcpy(entry_p->ip_addr.bytes, &msg_p[offset],
+                   sizeof entry_p->ip_addr.bytes);
+            dns_cache_entry_complete(resolver_p, entry_p,
+                                     DNS_CACHE_ENTRY_RESOLVED, ttl_seconds);
+            resolver_p->stats.names_resolved ++;
+            return true;
+        }
+
+        offset += data_length;
+    }
+
+    /*
+     * The name exists, but it has no IPv4 address:
+     */
+    dns_cache_entry_complete(resolver_p, entry_p, DNS_CACHE_ENTRY_NEGATIVE,
+                             DNS_RESOLVER_NEGATIVE_TTL_SECONDS);
+    resolver_p->stats.names_not_found ++;
+    return true;
+}
+
+
+/**
+ * Sends the queries of the pending cache entries that have not been sent
+ * yet or whose last transmission has timed out, and gives up on the ones
+ * that have been sent too many times. Must be called with the resolver's
+ * mutex held.
+ */
+static void dns_resolver_send_due_queries(struct dns_resolver *resolver_p)
+{
+    uint32_t now_ticks = rtos_get_ticks_since_boot();
+
+    for (uint_fast8_t i = 0; i < DNS_RESOLVER_CACHE_NUM_ENTRIES; i ++) {
+        struct dns_cache_entry *entry_p = &resolver_p->cache[i];
+
+        if (entry_p->state != DNS_CACHE_ENTRY_PENDING ||
+            (entry_p->num_transmissions != 0 &&
+             RTOS_TICKS_TO_MILLISECONDS(
+                RTOS_TICKS_DELTA(entry_p->last_tx_ticks, now_ticks)) <
+             DNS_RESOLVER_RETRANSMIT_TIMEOUT_MS)) {
+            continue;
+        }
+
+        if (entry_p->num_transmissions == DNS_RESOLVER_MAX_TRANSMISSIONS) {
+            dns_cache_entry_complete(resolver_p, entry_p,
+                                     DNS_CACHE_ENTRY_NEGATIVE,
+                                     DNS_RESOLVER_FAILURE_TTL_SECONDS);
+            resolver_p->stats.resolution_failures ++;
+            continue;
+        }
+
+        dns_resolver_send_query(resolver_p, entry_p);
+    }
+}
+
+
+/**
+ * DNS resolver task. It sleeps while there are no resolutions in progress.
+ */
+static void dns_resolver_task_func(void *arg)
+{
+    error_t error;
+    struct dns_resolver *resolver_p = arg;
+    struct net_udp_rx_datagram datagram;
+
+    D_ASSERT(resolver_p == &g_dns_resolver);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    /*
+     * This task accesses the resolver state all the time, so its MPU
+     * region is never restored:
+     */
+    rtos_thread_set_comp_region(resolver_p,
+                                sizeof *resolver_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    for ( ; ; ) {
+        rtos_mutex_lock(&resolver_p->mutex);
+        dns_resolver_send_due_queries(resolver_p);
+        bool idle = (resolver_p->num_pending_entries == 0);
+
+        rtos_mutex_unlock(&resolver_p->mutex);
+
+        if (idle) {
+            rtos_semaphore_wait(&resolver_p->work_semaphore);
+            continue;
+        }
+
+        error = net_layer4_udp_receive_zero_copy(&resolver_p->end_point,
+                                                 DNS_RESOLVER_RETRANSMIT_TIMEOUT_MS / 4,
+                                                 &datagram);
+        if (error != 0) {
+            continue;
+        }
+
+        rtos_mutex_lock(&resolver_p->mutex);
+        if (!dns_resolver_process_reply(resolver_p, &datagram)) {
+            resolver_p->stats.invalid_replies ++;
+        }
+
+        rtos_mutex_unlock(&resolver_p->mutex);
+        net_layer4_udp_release_rx_datagram(&resolver_p->end_point, &datagram);
+    }
+}
+
+
+/**
+ * Starts the DNS resolver task, to resolve names with a given DNS server.
+ * If the resolver is already running, it just switches to the new server,
+ * and flushes the cache.
+ *
+ * @param server_ip_addr_p  IPv4 address of the DNS server
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t dns_resolver_start(const struct ipv4_address *server_ip_addr_p)
+{
+    struct dns_resolver *const resolver_p = &g_dns_resolver;
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(resolver_p,
+                                sizeof *resolver_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    if (!resolver_p->initialized) {
+        rtos_mutex_init(&resolver_p->mutex, "DNS resolver mutex");
+        rtos_semaphore_init(&resolver_p->work_semaphore,
+                            "DNS resolver work semaphore", 0);
+        rtos_semaphore_init(&resolver_p->done_semaphore,
+                            "DNS resolver done semaphore", 0);
+        resolver_p->next_query_id = get_dwt_cycles();
+        net_layer4_udp_end_point_init(&resolver_p->end_point);
+
+        /*
+         * An ephemeral local port makes forged replies harder to inject:
+         */
+        error = net_layer4_udp_end_point_bind(&resolver_p->end_point, 0);
+        if (error != 0) {
+            goto common_exit;
+        }
+
+        resolver_p->server_ip_addr = *server_ip_addr_p;
+        resolver_p->initialized = true;
+        rtos_task_create(&resolver_p->task,
+                         "DNS resolver task",
+                         dns_resolver_task_func,
+                         resolver_p,
+                         RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
+    } else {
+        rtos_mutex_lock(&resolver_p->mutex);
+        resolver_p->server_ip_addr = *server_ip_addr_p;
+        for (uint_fast8_t i = 0; i < DNS_RESOLVER_CACHE_NUM_ENTRIES; i ++) {
+            struct dns_cache_entry *entry_p = &resolver_p->cache[i];
+
+            /*
+             * Queries in progress are sent again to the new server:
+             */
+            if (entry_p->state == DNS_CACHE_ENTRY_PENDING) {
+                entry_p->num_transmissions = 0;
+            } else {
+                entry_p->state = DNS_CACHE_ENTRY_FREE;
+            }
+        }
+
+        rtos_mutex_unlock(&resolver_p->mutex);
+        rtos_semaphore_signal(&resolver_p->work_semaphore);
+    }
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Looks up the IPv4 address of a host name, without blocking. If the name
+ * is not in the cache, or its entry has expired, the resolver task is asked
+ * to resolve it.
+ *
+ * @param name_p        Host name
+ * @param ip_addr_p     Area where the address is returned, if the name is
+ *                      resolved
+ *
+ * @return outcome of the lookup
+ */
+enum dns_lookup_status dns_resolver_lookup(const char *name_p,
+                                           struct ipv4_address *ip_addr_p)
+{
+    struct dns_resolver *const resolver_p = &g_dns_resolver;
+    char name[DNS_RESOLVER_MAX_NAME_LENGTH + 1];
+    enum dns_lookup_status status;
+    bool resolution_started = false;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    if (!resolver_p->initialized || !dns_copy_name(name, name_p)) {
+        return DNS_LOOKUP_FAILED;
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(resolver_p,
+                                sizeof *resolver_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&resolver_p->mutex);
+
+    uint32_t now_ticks = rtos_get_ticks_since_boot();
+    struct dns_cache_entry *entry_p = dns_cache_find(resolver_p, name);
+
+    resolver_p->stats.lookups ++;
+    if (entry_p != NULL && entry_p->state != DNS_CACHE_ENTRY_PENDING &&
+        dns_cache_entry_expired(entry_p, now_ticks)) {
+        entry_p->state = DNS_CACHE_ENTRY_FREE;
+        entry_p = NULL;
+    }
+
+    if (entry_p == NULL) {
+        entry_p = dns_cache_allocate(resolver_p, now_ticks);
+        if (entry_p == NULL) {
+            status = DNS_LOOKUP_FAILED;
+            goto common_exit;
+        }
+
+        memcpy(entry_p->name, name, sizeof name);
+        entry_p->state = DNS_CACHE_ENTRY_PENDING;
+        entry_p->query_id = resolver_p->next_query_id;
+        entry_p->num_transmissions = 0;
+        resolver_p->next_query_id += (uint16_t)get_dwt_cycles() | 1;
+        resolver_p->num_pending_entries ++;
+        resolution_started = true;
+    }
+
+    entry_p->last_use_ticks = now_ticks;
+    switch (entry_p->state) {
+    case DNS_CACHE_ENTRY_RESOLVED:
+        *ip_addr_p = entry_p->ip_addr;
+        resolver_p->stats.cache_hits ++;
+        status = DNS_LOOKUP_RESOLVED;
+        break;
+
+    case DNS_CACHE_ENTRY_NEGATIVE:
+        resolver_p->stats.negative_cache_hits ++;
+        status = DNS_LOOKUP_FAILED;
+        break;
+
+    default:
+        D_ASSERT(entry_p->state == DNS_CACHE_ENTRY_PENDING);
+        status = DNS_LOOKUP_IN_PROGRESS;
+    }
+
+common_exit:
+    rtos_mutex_unlock(&resolver_p->mutex);
+    if (resolution_started) {
+        rtos_semaphore_signal(&resolver_p->work_semaphore);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return status;
+}
+
+
+/**
+ * Resolves a host name or an IPv4 address literal into an IPv4 address,
+ * waiting for the resolution to complete if the name is not in the cache
+ *
+ * @param name_p        Host name or IPv4 address literal
+ * @param timeout_ms    Maximum time to wait for the resolution
+ * @param ip_addr_p     Area where the address is returned
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t dns_resolver_resolve(const char *name_p,
+                             uint32_t timeout_ms,
+                             struct ipv4_address *ip_addr_p)
+{
+    struct dns_resolver *const resolver_p = &g_dns_resolver;
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+
+    if (net_layer3_parse_ipv4_addr(name_p, ip_addr_p, NULL)) {
+        return 0;
+    }
+
+    for ( ; ; ) {
+        enum dns_lookup_status status = dns_resolver_lookup(name_p, ip_addr_p);
+
+        if (status == DNS_LOOKUP_RESOLVED) {
+            return 0;
+        }
+
+        if (status == DNS_LOOKUP_FAILED) {
+            return CAPTURE_ERROR("Host name could not be resolved", name_p, 0);
+        }
+
+        uint32_t elapsed_ms = RTOS_TICKS_TO_MILLISECONDS(
+                                RTOS_TICKS_DELTA(start_ticks,
+                                                 rtos_get_ticks_since_boot()));
+
+        if (elapsed_ms + MS_PER_TIMER_TICK > timeout_ms) {
+            return CAPTURE_ERROR("Host name resolution timed out", name_p,
+                                 timeout_ms);
+        }
+
+        (void)rtos_semaphore_wait_timeout(&resolver_p->done_semaphore,
+                                          timeout_ms - elapsed_ms);
+    }
+}
+
+
+/**
+ * Takes a snapshot of the DNS resolver statistics
+ *
+ * @param stats_p   Area where the snapshot is to be returned
+ */
+void dns_resolver_get_stats(struct dns_resolver_stats *stats_p)
+{
+    struct dns_resolver *const resolver_p = &g_dns_resolver;
+
+    if (!resolver_p->initialized) {
+        memset(stats_p, 0, sizeof *stats_p);
+        return;
+    }
+
+    rtos_mutex_lock(&resolver_p->mutex);
+    *stats_p = resolver_p->stats;
+    rtos_mutex_unlock(&resolver_p->mutex);
+}
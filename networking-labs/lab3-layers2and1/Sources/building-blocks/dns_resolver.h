@@ -0,0 +1,154 @@
+/**
+ * @file dns_resolver.h
+ *
+ * DNS resolver interface
+ *
+ * The DNS resolver translates host names into IPv4 addresses, by sending
+ * DNS queries for A records to a DNS server, from a background task. Names
+ * resolved are kept in a small cache for as long as the TTL of their A
+ * record says, and names that do not exist (or that could not be resolved)
+ * are also cached for a while, so that repeated lookups of the same name do
+ * not cause any network traffic. dns_resolver_lookup() never blocks: if the
+ * name is not in the cache, it starts resolving it and returns
+ * DNS_LOOKUP_IN_PROGRESS, so it can be called from latency-sensitive code.
+ * dns_resolver_resolve() waits for the resolution to complete.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_DNS_RESOLVER_H_
+#define SOURCES_BUILDING_BLOCKS_DNS_RESOLVER_H_
+
+#include <stdint.h>
+#include "networking_layer3.h"
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+
+/**
+ * UDP port of DNS servers
+ */
+#define DNS_SERVER_PORT     53
+
+/**
+ * Maximum length of a host name that can be resolved (without the
+ * terminating null character)
+ */
+#define DNS_RESOLVER_MAX_NAME_LENGTH    63
+
+/**
+ * DNS message header. All fields are big endian.
+ */
+struct dns_header {
+    uint16_t id;
+
+    uint16_t flags;
+#   define DNS_FLAG_QR              BIT(15)
+#   define DNS_FLAG_OPCODE_MASK     (UINT16_C(0xf) << 11)
+#   define DNS_FLAG_TC              BIT(9)
+#   define DNS_FLAG_RD              BIT(8)
+#   define DNS_FLAG_RCODE_MASK      UINT16_C(0xf)
+#   define DNS_RCODE_NO_ERROR       0
+#   define DNS_RCODE_NAME_ERROR     3
+
+    /**
+     * Number of entries of the question, answer, authority and additional
+     * sections
+     */
+    uint16_t question_count;
+    uint16_t answer_count;
+    uint16_t authority_count;
+    uint16_t additional_count;
+};
+
+C_ASSERT(sizeof(struct dns_header) == 12);
+
+/**
+ * Outcome of a non-blocking name lookup
+ */
+enum dns_lookup_status {
+    /*
+     * The name was found in the cache, and its address was returned
+     */
+    DNS_LOOKUP_RESOLVED = 0,
+
+    /*
+     * The name is being resolved; it should be looked up again later
+     */
+    DNS_LOOKUP_IN_PROGRESS,
+
+    /*
+     * The name does not exist, could not be resolved recently, or is not a
+     * valid host name
+     */
+    DNS_LOOKUP_FAILED,
+};
+
+/**
+ * DNS resolver statistics
+ */
+struct dns_resolver_stats {
+    /**
+     * Number of lookups
+     */
+    uint32_t lookups;
+
+    /**
+     * Number of lookups answered from the cache with an address
+     */
+    uint32_t cache_hits;
+
+    /**
+     * Number of lookups answered from the cache with a failure
+     */
+    uint32_t negative_cache_hits;
+
+    /**
+     * Number of cache entries reused for another name, before they had
+     * expired
+     */
+    uint32_t cache_evictions;
+
+    /**
+     * Number of queries sent, including retransmissions
+     */
+    uint32_t queries_sent;
+
+    /**
+     * Number of queries that could not be sent
+     */
+    uint32_t send_failures;
+
+    /**
+     * Number of datagrams received that were not a valid reply to a
+     * query in progress
+     */
+    uint32_t invalid_replies;
+
+    /**
+     * Number of names resolved to an address
+     */
+    uint32_t names_resolved;
+
+    /**
+     * Number of names that do not exist or have no IPv4 address
+     */
+    uint32_t names_not_found;
+
+    /**
+     * Number of resolutions abandoned because the server did not reply or
+     * reported an error
+     */
+    uint32_t resolution_failures;
+};
+
+error_t dns_resolver_start(const struct ipv4_address *server_ip_addr_p);
+
+enum dns_lookup_status dns_resolver_lookup(const char *name_p,
+                                           struct ipv4_address *ip_addr_p);
+
+error_t dns_resolver_resolve(const char *name_p,
+                             uint32_t timeout_ms,
+                             struct ipv4_address *ip_addr_p);
+
+void dns_resolver_get_stats(struct dns_resolver_stats *stats_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_DNS_RESOLVER_H_ */
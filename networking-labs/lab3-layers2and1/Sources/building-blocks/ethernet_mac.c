@@ -5,6 +5,7 @@
  *
  * @author German Rivera
  */
+#include <string.h>
 #include "ethernet_mac.h"
 #include "ethernet_phy.h"
 #include "crc_32.h"
@@ -15,6 +16,11 @@
 #include "io_utils.h"
 #include "interrupt_vector_table.h"
 #include "memory_protection_unit.h"
+#include "perf_probes.h"
+#include "power_utils.h"
+#include "net_config.h"
+
+#if defined(K64F_MCU)
 
 /*
  * Compile-time configuration options:
@@ -22,15 +28,141 @@
 #define ENET_DATA_PAYLOAD_32_BIT_ALIGNED
 #define    ENET_CHECKSUM_OFFLOAD
 
+/**
+ * Frequency of the clock of the Ethernet MAC's IEEE 1588 timer. The timer
+ * is clocked from OSCERCLK, which is driven by the 50MHz external oscillator,
+ * that also provides the RMII reference clock.
+ */
+#define ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ  UINT32_C(50000000)
+
+/**
+ * Increment of the IEEE 1588 timer value for every timer clock tick
+ */
+#define ETHERNET_MAC_IEEE_1588_TIMER_INCREMENT_NS \
+        (UINT32_C(1000000000) / ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ)
+
+C_ASSERT(UINT32_C(1000000000) % ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ == 0);
+
+extern const uint32_t g_ethernet_crc32_table[256];
+
+/**
+ * Number of CPU cycles to wait for a capture of the IEEE 1588 timer value
+ * to complete
+ */
+#define ETHERNET_MAC_IEEE_1588_CAPTURE_DELAY_COUNT  38
+
+/**
+ * IEEE 1588 timer channel whose output compare releases launch-time Tx
+ * frames into the Tx ring. The channel is used in "software only" output
+ * compare mode, so its pin is not driven.
+ */
+#define ETHERNET_MAC_TX_LAUNCH_TIMER_CHANNEL    0
+
+/**
+ * Value of the TMODE field of TCSR for "output compare, software only" mode
+ */
+#define ETHERNET_MAC_TCSR_TMODE_OUTPUT_COMPARE_SW_ONLY  0x4
+
+/**
+ * How long before its launch time a launch-time Tx frame is queued in the
+ * Tx ring, in nanoseconds, to make up for the latency of the IEEE 1588
+ * timer interrupt and for the time that the MAC takes to fetch the frame.
+ * Frames whose launch time is closer than this are queued right away.
+ */
+#define ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS   UINT32_C(2000)
+
+C_ASSERT(ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS < ETHERNET_MAC_TX_LAUNCH_MAX_LEAD_NS);
+
 C_ASSERT(NET_PACKET_DATA_BUFFER_SIZE >= 256 &&
      (NET_PACKET_DATA_BUFFER_SIZE & ~ENET_MRBR_R_BUF_SIZE_MASK) == 0);
 
+/**
+ * Number of entries of the Tx buffer descriptor ring of MAC0
+ */
+#define ETHERNET_MAC0_TX_RING_NUM_ENTRIES   NET_CONFIG_MAC_TX_RING_NUM_ENTRIES
+
+/**
+ * Number of entries of the Rx buffer descriptor ring of MAC0
+ */
+#define ETHERNET_MAC0_RX_RING_NUM_ENTRIES   NET_CONFIG_MAC_RX_RING_NUM_ENTRIES
+
+/**
+ * Rx FIFO section empty threshold (RSEM), in 64-bit words. When the Rx FIFO
+ * fills up to this level, because the MAC's DMA has no posted Rx buffer to
+ * drain it into, the MAC sends a PAUSE frame if flow control is on. It is
+ * low enough to leave room in the Rx FIFO for the frames that the link
+ * partner sends before it reacts to the PAUSE frame.
+ */
+#define ETHERNET_MAC_RX_FIFO_XOFF_THRESHOLD     48
+
+/**
+ * Rx FIFO almost empty (RAEM) and almost full (RAFL) thresholds, in 64-bit
+ * words (reset defaults)
+ */
+#define ETHERNET_MAC_RX_FIFO_ALMOST_EMPTY       4
+#define ETHERNET_MAC_RX_FIFO_ALMOST_FULL        4
+
+/**
+ * Number of posted Rx ring entries below which the Rx ring is considered
+ * about to be starved, because the receiver tasks are falling behind. The
+ * MAC then sends a PAUSE frame right away, before the Rx FIFO fills up.
+ */
+#define ETHERNET_MAC_RX_RING_XOFF_THRESHOLD     4
+
+C_ASSERT(ETHERNET_MAC_RX_RING_XOFF_THRESHOLD < ETHERNET_MAC0_RX_RING_NUM_ENTRIES);
+
+/**
+ * Duration of the PAUSE frames sent by the MAC (OPD PAUSE_DUR), in pause
+ * quanta of 512 bit times (0x400 quanta is about 5 ms at 100 Mb/s)
+ */
+#define ETHERNET_MAC_PAUSE_DURATION             0x400
+
+/**
+ * Maximum length in bytes (including CRC) of frames accepted by the Ethernet
+ * MAC's receiver (RCR MAX_FL). It can be raised on networks that use jumbo
+ * frames. Frames that do not fit in one Rx data buffer are received in
+ * several Rx buffer descriptors and returned as a chain of Rx packets
+ * (see next_fragment_p in struct network_packet).
+ */
+#define ETHERNET_MAC_MAX_RX_FRAME_SIZE     ETHERNET_MAX_VLAN_FRAME_SIZE
+
+/**
+ * Received frames longer than this are truncated by the Ethernet MAC
+ * (FTRL TRUNC_FL)
+ */
+#define ETHERNET_MAC_RX_TRUNCATE_FRAME_SIZE \
+        (ETHERNET_MAC_MAX_RX_FRAME_SIZE > 2047 ? ETHERNET_MAC_MAX_RX_FRAME_SIZE : 2047)
+
+/**
+ * Maximum number of Rx buffer descriptors used by one received frame
+ * (the first Rx data buffer starts with the 2-byte alignment padding)
+ */
+#define ETHERNET_MAC_MAX_RX_FRAME_BUFFER_DESCRIPTORS \
+        HOW_MANY(ETHERNET_MAC_MAX_RX_FRAME_SIZE + sizeof(uint16_t),          \
+                 NET_PACKET_DATA_BUFFER_SIZE)
+
+C_ASSERT(ETHERNET_MAC_MAX_RX_FRAME_SIZE <=
+         (ENET_RCR_MAX_FL_MASK >> ENET_RCR_MAX_FL_SHIFT));
+C_ASSERT(ETHERNET_MAC_RX_TRUNCATE_FRAME_SIZE <= ENET_FTRL_TRUNC_FL_MASK);
+
+C_ASSERT(ETHERNET_MAC0_TX_RING_NUM_ENTRIES <= ETHERNET_MAC_MAX_TX_RING_ENTRIES);
+C_ASSERT(ETHERNET_MAC0_RX_RING_NUM_ENTRIES <= ETHERNET_MAC_MAX_RX_RING_ENTRIES);
+C_ASSERT(ETHERNET_MAC0_RX_RING_NUM_ENTRIES <= NET_MAX_RX_PACKETS);
+C_ASSERT(ETHERNET_MAC0_RX_RING_NUM_ENTRIES >=
+         2 * ETHERNET_MAC_MAX_RX_FRAME_BUFFER_DESCRIPTORS);
+
 /**
  * Maximum number of iterations for a polling loop
  * waiting for reset completion of the Ethernet MAC
  */
 #define ETHERNET_MAC_RESET_MAX_POLLING_COUNT   UINT16_MAX
 
+/**
+ * Maximum number of iterations for a polling loop
+ * waiting for a graceful stop of the Ethernet MAC's transmitter
+ */
+#define ETHERNET_MAC_TX_STOP_MAX_POLLING_COUNT UINT16_MAX
+
 /**
  * Ethernet frame buffer descriptor alignment in bytes
  */
@@ -195,6 +327,50 @@ struct ethernet_tx_buffer_descriptor {
 C_ASSERT(sizeof(struct ethernet_tx_buffer_descriptor) %
          ETHERNET_FRAME_BUFFER_DESCRIPTOR_ALIGNMENT == 0);
 
+/**
+ * Hardware MIB counter that is accumulated into a field of
+ * struct ethernet_mac_stats
+ */
+struct ethernet_mac_mib_counter {
+    /**
+     * Offset of the MIB counter register in ENET_Type
+     */
+    uint16_t reg_offset;
+
+    /**
+     * Offset of the corresponding uint32_t field in struct ethernet_mac_stats
+     */
+    uint16_t stats_offset;
+
+    /**
+     * Mask for the valid bits of the MIB counter register, as some
+     * MIB counters are only 16-bit wide
+     */
+    uint32_t width_mask;
+};
+
+#define ETHERNET_MAC_MIB_COUNTER(_reg, _stats_field, _width_mask) \
+        { .reg_offset = offsetof(ENET_Type, _reg),                    \
+          .stats_offset = offsetof(struct ethernet_mac_stats, _stats_field), \
+          .width_mask = (_width_mask) }
+
+static const struct ethernet_mac_mib_counter g_ethernet_mac_mib_counters[] = {
+    ETHERNET_MAC_MIB_COUNTER(IEEE_T_OCTETS_OK, tx_octets, UINT32_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_T_FRAME_OK, tx_frames, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(RMON_T_COL, tx_collisions, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_T_LCOL, tx_collision_errors, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_T_EXCOL, tx_collision_errors, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_T_MACERR, tx_underruns, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_R_OCTETS_OK, rx_octets, UINT32_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_R_FRAME_OK, rx_frames, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_R_CRC, rx_crc_errors, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_R_ALIGN, rx_crc_errors, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_R_MACERR, rx_overruns, UINT16_MAX),
+    ETHERNET_MAC_MIB_COUNTER(IEEE_R_DROP, rx_drops, UINT16_MAX),
+};
+
+#define ETHERNET_MAC_NUM_MIB_COUNTERS   ARRAY_SIZE(g_ethernet_mac_mib_counters)
+
 /**
  * Non-const fields of an Ethernet MAC device (to be placed in SRAM)
  */
@@ -220,11 +396,35 @@ struct ethernet_mac_device_var {
      */
     struct net_layer2_end_point *layer2_end_point_p;
 
+    /**
+     * Rx completion handling mode
+     */
+    enum ethernet_mac_rx_modes rx_mode;
+
+    /**
+     * Tx completion handling mode
+     */
+    enum ethernet_mac_tx_modes tx_mode;
+
+    /**
+     * Number of frames queued in the Tx ring since the last one that
+     * was marked to generate a Tx interrupt (only used in
+     * ETHERNET_MAC_TX_LAZY_RECLAIM_MODE)
+     */
+    uint8_t tx_frames_since_last_interrupt;
+
     /**
      * Number of Tx buffer descriptors currently filled in ths MAC's Tx ring
      */
     uint16_t tx_ring_entries_filled;
 
+    /**
+     * Number of frames currently queued in this MAC's Tx ring. It is smaller
+     * than tx_ring_entries_filled when frames with payload fragments are
+     * queued, as those frames take more than one Tx buffer descriptor.
+     */
+    uint16_t tx_ring_frames_filled;
+
     /**
      * Number of Rx buffer descriptors currently filled in this MAC's Rx ring
      */
@@ -254,57 +454,213 @@ struct ethernet_mac_device_var {
      */
     volatile struct ethernet_rx_buffer_descriptor *rx_ring_read_cursor;
 
+    /**
+     * Largest value that tx_ring_entries_filled has ever had
+     */
+    uint16_t tx_ring_entries_filled_high_water_mark;
+
+    /**
+     * Largest number of received frames found in the Rx ring in one call to
+     * ethernet_mac_drain_rx_ring()
+     */
+    uint16_t rx_ring_entries_received_high_water_mark;
+
+    /**
+     * Number of times that the Rx ring was left without any posted entry
+     */
+    uint32_t rx_ring_starved_count;
+
+    /**
+     * Flag indicating that PAUSE frames can be sent and are honored on the
+     * current link (full-duplex link, with flow control negotiated)
+     */
+    bool flow_control_on;
+
+    /**
+     * Flag indicating that a PAUSE frame was sent since the number of
+     * posted Rx ring entries dropped below ETHERNET_MAC_RX_RING_XOFF_THRESHOLD
+     */
+    bool rx_ring_xoff_sent;
+
+    /**
+     * Number of PAUSE frames sent because the Rx ring was about to be starved
+     */
+    uint32_t rx_ring_xoff_count;
+
+    /**
+     * Number of entries in tx_launch_queue[]
+     */
+    uint8_t tx_launch_queue_length;
+
+    /**
+     * Number of launch-time Tx frames queued in the Tx ring
+     */
+    uint32_t tx_launched_count;
+
+    /**
+     * Number of launch-time Tx frames whose launch time had already passed
+     * when they were queued in the Tx ring
+     */
+    uint32_t tx_launch_late_count;
+
+    /**
+     * Launch-time Tx packets (see ethernet_mac_start_xmit_at()) waiting to
+     * be queued in the Tx ring, sorted by launch time: entry 0 is the next
+     * one due. Every Tx packet is either here or in the Tx ring, or in
+     * neither, so this queue can never overflow.
+     */
+    struct network_packet *tx_launch_queue[NET_MAX_TX_PACKETS];
+
     /**
      * Array of counters for the multicast hash table buckets. Each entry
      * corresponds to the number of multicast addresses added to the
      * corresponding bucket (bit in the GAUR/GALR bit hash table)
      */
-#   define ETHERNET_MAC_MULTICAST_HASH_TABLE_NUM_BUCKETS    64
-    uint8_t multicast_hash_table_counts[ETHERNET_MAC_MULTICAST_HASH_TABLE_NUM_BUCKETS];
+#   define ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS    64
+    uint8_t multicast_hash_table_counts[ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS];
+
+    /**
+     * Array of counters for the unicast hash table buckets. Each entry
+     * corresponds to the number of additional unicast addresses added to the
+     * corresponding bucket (bit in the IAUR/IALR bit hash table)
+     */
+    uint8_t unicast_hash_table_counts[ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS];
+
+    /**
+     * Statistics accumulated from the hardware MIB counters
+     */
+    struct ethernet_mac_stats stats;
+
+    /**
+     * Values that the hardware MIB counters had the last time that they
+     * were accumulated into stats, indexed as g_ethernet_mac_mib_counters[]
+     */
+    uint32_t mib_counters_last_values[ETHERNET_MAC_NUM_MIB_COUNTERS];
+
+    /**
+     * Tx packets currently queued in this MAC's Tx ring, indexed by the
+     * position in the ring of the last Tx buffer descriptor of the
+     * corresponding frame. Entries for any other Tx buffer descriptors are
+     * NULL.
+     */
+    struct network_packet *tx_ring_packets[ETHERNET_MAC_MAX_TX_RING_ENTRIES];
+
+    /**
+     * Rx packets currently posted to this MAC's Rx ring, indexed by the
+     * position in the ring of the Rx buffer descriptor they are posted to.
+     * (Rx packet data buffers are not embedded in the network packet
+     * objects, so the packet cannot be derived from the data buffer pointer
+     * in the Rx buffer descriptor.)
+     */
+    struct network_packet *rx_ring_packets[ETHERNET_MAC_MAX_RX_RING_ENTRIES];
 
     /**
      * This MAC's Tx buffer descriptor ring
      */
-    volatile struct ethernet_tx_buffer_descriptor tx_buffer_descriptors[NET_MAX_TX_PACKETS];
+    volatile struct ethernet_tx_buffer_descriptor tx_buffer_descriptors[ETHERNET_MAC_MAX_TX_RING_ENTRIES];
 
     /**
      * This MAC's Rx buffer descriptor ring
      */
-    volatile struct ethernet_rx_buffer_descriptor rx_buffer_descriptors[NET_MAX_RX_PACKETS];
+    volatile struct ethernet_rx_buffer_descriptor rx_buffer_descriptors[ETHERNET_MAC_MAX_RX_RING_ENTRIES];
 };
 
 /**
- * Global non-const structure for Ethernet MAC device
+ * Global non-const structures for Ethernet MAC devices
  * (allocated in SRAM space)
+ *
+ * NOTE: These are deliberately not statically initialized, so that they
+ * go in the '.bss' section, in SRAM_U, instead of in '.data', in SRAM_L.
+ * This way, the ENET DMA engine accessing the buffer descriptor rings
+ * (over the system bus) does not contend with the CPU fetching the
+ * RAM_FUNC ISRs (over the code bus). Also, their initializers do not take
+ * flash space nor take time to copy at reset.
  */
-static struct ethernet_mac_device_var g_ethernet_mac0_var = {
-    .initialized = false,
-};
+static struct ethernet_mac_device_var g_ethernet_macs_var[NUM_ETHERNET_MACS];
 
 /**
- * Global const structure for the Ethernet MAC device
+ * Global const structures for the Ethernet MAC devices
  * (allocated in flash space)
+ *
+ * NOTE: Each MAC instance has its own buffer descriptor rings (in its
+ * ethernet_mac_device_var) and its own set of interrupt handlers
+ * (ethernet_mac<n>_*_irq_handler()), so that adding an entry here for each
+ * additional ENET module of a given SoC is all that is needed at this layer.
  */
-const struct ethernet_mac_device g_ethernet_mac0 = {
-    .signature = ETHERNET_MAC_DEVICE_SIGNATURE,
-    .name_p = "enet0",
-    .var_p = &g_ethernet_mac0_var,
-    .mmio_registers_p = (ENET_Type *)ENET_BASE,
-    .ethernet_phy_p = &g_ethernet_phy0,
-    .ieee_1588_timer_pins = {
-        [0] = PIN_INITIALIZER(PIN_PORT_C, 16, PIN_FUNCTION_ALT4),
-        [1] = PIN_INITIALIZER(PIN_PORT_C, 17, PIN_FUNCTION_ALT4),
-        [2] = PIN_INITIALIZER(PIN_PORT_C, 18, PIN_FUNCTION_ALT4),
-        [3] = PIN_INITIALIZER(PIN_PORT_C, 19, PIN_FUNCTION_ALT4),
+const struct ethernet_mac_device g_ethernet_macs[NUM_ETHERNET_MACS] = {
+    [0] = {
+        .signature = ETHERNET_MAC_DEVICE_SIGNATURE,
+        .name_p = "enet0",
+        .var_p = &g_ethernet_macs_var[0],
+        .mmio_registers_p = (ENET_Type *)ENET_BASE,
+        .ethernet_phy_p = &g_ethernet_phys[0],
+        .ieee_1588_timer_pins = {
+            [0] = PIN_INITIALIZER(PIN_PORT_C, 16, PIN_FUNCTION_ALT4),
+            [1] = PIN_INITIALIZER(PIN_PORT_C, 17, PIN_FUNCTION_ALT4),
+            [2] = PIN_INITIALIZER(PIN_PORT_C, 18, PIN_FUNCTION_ALT4),
+            [3] = PIN_INITIALIZER(PIN_PORT_C, 19, PIN_FUNCTION_ALT4),
+        },
+
+        .tx_irq_num = ENET_Transmit_IRQn,
+        .rx_irq_num = ENET_Receive_IRQn,
+        .error_irq_num = ENET_Error_IRQn,
+        .ieee_1588_timer_irq_num = ENET_1588_Timer_IRQn,
+        .clock_gate_mask = SIM_SCGC2_ENET_MASK,
+        .tx_ring_num_entries = ETHERNET_MAC0_TX_RING_NUM_ENTRIES,
+        .rx_ring_num_entries = ETHERNET_MAC0_RX_RING_NUM_ENTRIES,
     },
-
-    .tx_irq_num = ENET_Transmit_IRQn,
-    .rx_irq_num = ENET_Receive_IRQn,
-    .error_irq_num = ENET_Error_IRQn,
-    .clock_gate_mask = SIM_SCGC2_ENET_MASK,
 };
 
 
+/**
+ * Initializes and starts the IEEE 1588 timer of the given Ethernet MAC,
+ * which provides the hardware timestamps stored in the enhanced
+ * Tx/Rx buffer descriptors.
+ */
+static void
+ethernet_mac_ieee_1588_timer_init(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    uint32_t reg_value;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    /*
+     * Select OSCERCLK as the clock source for the IEEE 1588 timer:
+     */
+    reg_value = READ_MMIO_REGISTER(&SIM_SOPT2);
+    SET_BIT_FIELD(reg_value, SIM_SOPT2_TIMESRC_MASK, SIM_SOPT2_TIMESRC_SHIFT,
+                  0x2);
+    WRITE_MMIO_REGISTER(&SIM_SOPT2, reg_value);
+
+    /*
+     * - Set timer increment per timer clock tick (no correction)
+     * - Set the timer to wrap around every second
+     * - Reset the timer to 0 and start it
+     */
+    reg_value = 0;
+    SET_BIT_FIELD(reg_value, ENET_ATINC_INC_MASK, ENET_ATINC_INC_SHIFT,
+                  ETHERNET_MAC_IEEE_1588_TIMER_INCREMENT_NS);
+    WRITE_MMIO_REGISTER(&mac_regs_p->ATINC, reg_value);
+    WRITE_MMIO_REGISTER(&mac_regs_p->ATCOR, 0);
+    WRITE_MMIO_REGISTER(&mac_regs_p->ATPER, ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS);
+    WRITE_MMIO_REGISTER(&mac_regs_p->ATCR,
+                        ENET_ATCR_RESTART_MASK | ENET_ATCR_PEREN_MASK);
+    WRITE_MMIO_REGISTER(&mac_regs_p->ATCR,
+                        ENET_ATCR_EN_MASK | ENET_ATCR_PEREN_MASK);
+
+    /*
+     * Keep the Tx launch channel disabled until a launch-time Tx frame is
+     * queued, and enable its interrupt in the interrupt controller (NVIC):
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->CHANNEL[ETHERNET_MAC_TX_LAUNCH_TIMER_CHANNEL].TCSR,
+                        ENET_TCSR_TF_MASK);
+    ethernet_mac_p->var_p->tx_launch_queue_length = 0;
+    ethernet_mac_p->var_p->tx_launched_count = 0;
+    ethernet_mac_p->var_p->tx_launch_late_count = 0;
+    nvic_setup_irq(ethernet_mac_p->ieee_1588_timer_irq_num,
+                   ETHERNET_MAC_TX_LAUNCH_INTERRUPT_PRIORITY);
+}
+
+
 static void
 ethernet_mac_tx_buffer_descriptor_ring_init(
     const struct ethernet_mac_device *ethernet_mac_p)
@@ -319,31 +675,34 @@ ethernet_mac_tx_buffer_descriptor_ring_init(
      */
     D_ASSERT(((uintptr_t)mac_var_p->tx_buffer_descriptors &
               ~ENET_TDSR_X_DES_START_MASK) == 0);
+    D_ASSERT((uintptr_t)mac_var_p->tx_buffer_descriptors >= MCU_SRAM_U_BASE_ADDR);
 
     WRITE_MMIO_REGISTER(&mac_regs_p->TDSR,
                         (uintptr_t)mac_var_p->tx_buffer_descriptors);
 
-    for (unsigned int i = 0; i < NET_MAX_TX_PACKETS; i ++) {
+    for (unsigned int i = 0; i < ethernet_mac_p->tx_ring_num_entries; i ++) {
         volatile struct ethernet_tx_buffer_descriptor *buffer_desc_p =
             &mac_var_p->tx_buffer_descriptors[i];
 
         buffer_desc_p->data_buffer = NULL;
         buffer_desc_p->data_length = 0;
+        mac_var_p->tx_ring_packets[i] = NULL;
 
         /*
-         * Our Tx buffers are large enough to always hold entire frames, so a
-         * frame is never fragmented into multiple buffers.
+         * NOTE: The "last in frame" and "CRC" flags are set by
+         * ethernet_mac_start_xmit_gather() only on the last Tx buffer
+         * descriptor of each frame, as a frame with payload fragments spans
+         * multiple Tx buffer descriptors.
          * Frames smaller than 60 bytes are automatically padded.
          * The minimum Ethernet frame length transmitted on the wire
          * is 64 bytes, including the CRC.
          */
-        buffer_desc_p->control = ENET_TX_BD_LAST_IN_FRAME_MASK |
-                                 ENET_TX_BD_CRC_MASK;
+        buffer_desc_p->control = 0;
 
         /*
          * Set the wrap flag for the last buffer of the ring:
          */
-        if (i == NET_MAX_TX_PACKETS - 1) {
+        if (i == ethernet_mac_p->tx_ring_num_entries - 1) {
             buffer_desc_p->control |= ENET_TX_BD_WRAP_MASK;
         }
     }
@@ -352,6 +711,8 @@ ethernet_mac_tx_buffer_descriptor_ring_init(
      * The Tx descriptor ring is empty:
      */
     mac_var_p->tx_ring_entries_filled = 0;
+    mac_var_p->tx_ring_frames_filled = 0;
+    mac_var_p->tx_ring_entries_filled_high_water_mark = 0;
     mac_var_p->tx_ring_write_cursor = &mac_var_p->tx_buffer_descriptors[0];
     mac_var_p->tx_ring_read_cursor = &mac_var_p->tx_buffer_descriptors[0];
 }
@@ -375,31 +736,37 @@ ethernet_mac_rx_buffer_descriptor_ring_init(
      */
     D_ASSERT(((uintptr_t)mac_var_p->rx_buffer_descriptors &
               ~ENET_RDSR_R_DES_START_MASK) == 0);
+    D_ASSERT((uintptr_t)mac_var_p->rx_buffer_descriptors >= MCU_SRAM_U_BASE_ADDR);
 
     WRITE_MMIO_REGISTER(&mac_regs_p->RDSR,
                         (uintptr_t)mac_var_p->rx_buffer_descriptors);
     WRITE_MMIO_REGISTER(&mac_regs_p->MRBR, NET_PACKET_DATA_BUFFER_SIZE);
 
-    for (unsigned int i = 0; i < NET_MAX_RX_PACKETS; i ++) {
+    for (unsigned int i = 0; i < ethernet_mac_p->rx_ring_num_entries; i ++) {
         volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p =
             &mac_var_p->rx_buffer_descriptors[i];
 
-        struct network_packet *rx_packet_p = &layer2_end_point_p->rx_packets[i];
+        uint32_t int_mask = disable_cpu_interrupts();
+        struct network_packet *rx_packet_p = net_layer2_take_rx_packet(layer2_end_point_p);
 
-        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        restore_cpu_interrupts(int_mask);
+        D_ASSERT(rx_packet_p != NULL);
         rx_packet_p->state_flags = NET_PACKET_IN_RX_TRANSIT;
+        D_ASSERT(rx_packet_p->data_buffer_size == NET_PACKET_DATA_BUFFER_SIZE);
         rx_packet_p->rx_buf_desc_p = buffer_desc_p;
         buffer_desc_p->data_buffer = rx_packet_p->data_buffer;
+        mac_var_p->rx_ring_packets[i] = rx_packet_p;
 
         D_ASSERT((uintptr_t)buffer_desc_p->data_buffer %
                  NET_PACKET_DATA_BUFFER_ALIGNMENT == 0);
+        D_ASSERT((uintptr_t)buffer_desc_p->data_buffer >= MCU_SRAM_U_BASE_ADDR);
 
         buffer_desc_p->data_length = NET_PACKET_DATA_BUFFER_SIZE;
 
         /*
          * Set the wrap flag for the last buffer of the ring:
          */
-        if (i != NET_MAX_RX_PACKETS - 1) {
+        if (i != ethernet_mac_p->rx_ring_num_entries - 1) {
             buffer_desc_p->control = 0;
         } else {
             buffer_desc_p->control = ENET_RX_BD_WRAP_MASK;
@@ -419,7 +786,11 @@ ethernet_mac_rx_buffer_descriptor_ring_init(
     /*
      * The Rx descriptor ring is full:
      */
-    mac_var_p->rx_ring_entries_filled = NET_MAX_RX_PACKETS;
+    mac_var_p->rx_ring_entries_filled = ethernet_mac_p->rx_ring_num_entries;
+    mac_var_p->rx_ring_entries_received_high_water_mark = 0;
+    mac_var_p->rx_ring_starved_count = 0;
+    mac_var_p->rx_ring_xoff_sent = false;
+    mac_var_p->rx_ring_xoff_count = 0;
     mac_var_p->rx_ring_write_cursor = &mac_var_p->rx_buffer_descriptors[0];
     mac_var_p->rx_ring_read_cursor = &mac_var_p->rx_buffer_descriptors[0];
 }
@@ -491,7 +862,8 @@ static void ethernet_mac_tx_init(const struct ethernet_mac_device *ethernet_mac_
      * - Automatically write the source MAC address (SA) to Ethernet frame
      *   header in the Tx buffer, using the address programmed in the PALR/PAUR
      *   registers
-     * - Enable full duplex mode
+     * - Enable full duplex mode (until the link comes up and
+     *   ethernet_mac_set_link_mode() is called for the negotiated link mode)
      */
     reg_value = READ_MMIO_REGISTER(&mac_regs_p->TCR);
     reg_value |= ENET_TCR_ADDINS_MASK | ENET_TCR_FDEN_MASK;
@@ -505,11 +877,12 @@ static void ethernet_mac_tx_init(const struct ethernet_mac_device *ethernet_mac_
     WRITE_MMIO_REGISTER(&mac_regs_p->TIPG, reg_value);
 
     /*
-     * Set pause duration to 0:
+     * Set the duration of the PAUSE frames sent by the MAC, either when the
+     * Rx FIFO reaches RSEM or when ethernet_mac_refill_rx_ring() requests it:
      */
     reg_value = READ_MMIO_REGISTER(&mac_regs_p->OPD);
     SET_BIT_FIELD(reg_value, ENET_OPD_PAUSE_DUR_MASK, ENET_OPD_PAUSE_DUR_SHIFT,
-                  0);
+                  ETHERNET_MAC_PAUSE_DURATION);
     WRITE_MMIO_REGISTER(&mac_regs_p->OPD, reg_value);
 
     /*
@@ -567,7 +940,8 @@ static void ethernet_mac_rx_init(const struct ethernet_mac_device *ethernet_mac_
      * - ???Enable frame padding remove for incoming frames
      * - Enable flow control
      * - Configure RMII interface to the Ethernet PHY
-     * - Enable 100Mbps operation
+     * - Enable 100Mbps operation (until the link comes up and
+     *   ethernet_mac_set_link_mode() is called for the negotiated link mode)
      * - Disable internal loopback
      * - Set max incoming frame length (including CRC)
      */
@@ -577,34 +951,37 @@ static void ethernet_mac_rx_init(const struct ethernet_mac_device *ethernet_mac_
     reg_value |= ENET_RCR_FCE_MASK;
     reg_value |= ENET_RCR_MII_MODE_MASK | ENET_RCR_RMII_MODE_MASK;
 
-#if 0  /* Promiscuous mode is useful for debugging */
-    reg_value |= ENET_RCR_PROM_MASK;
-#endif
+    /*
+     * Only receive frames that pass the destination address filters
+     * (promiscuous mode can be turned on for debugging by calling
+     * ethernet_mac_set_promiscuous_mode()):
+     */
+    reg_value &= ~ENET_RCR_PROM_MASK;
 
     reg_value &= ~ENET_RCR_RMII_10T_MASK;
     reg_value &= ~ENET_RCR_LOOP_MASK;
     SET_BIT_FIELD(reg_value, ENET_RCR_MAX_FL_MASK, ENET_RCR_MAX_FL_SHIFT,
-                  ETHERNET_MAX_FRAME_SIZE);
+                  ETHERNET_MAC_MAX_RX_FRAME_SIZE);
     WRITE_MMIO_REGISTER(&mac_regs_p->RCR, reg_value);
 
     /*
-     * Set receive frame truncate length (use reset value 0x7ff):
-     *
-     * GERMAN: Should this be changed to ENET_MAX_FRAME_SIZE?
+     * Set receive frame truncate length (reset value 0x7ff, unless jumbo
+     * frames are accepted):
      */
     reg_value = read_32bit_mmio_register(&mac_regs_p->FTRL);
     SET_BIT_FIELD(reg_value, ENET_FTRL_TRUNC_FL_MASK, ENET_FTRL_TRUNC_FL_SHIFT,
-                  2047);
+                  ETHERNET_MAC_RX_TRUNCATE_FRAME_SIZE);
     WRITE_MMIO_REGISTER(&mac_regs_p->FTRL, reg_value);
 
     /*
      * Set Rx accelerators:
      * - Enable padding removal for short IP frames
      * - Enable discard of frames with MAC layer errors
-     * - Enable IP header checksum offload
-     *   (automatically discard frames with wrong IP header checksum)
-     * - Enable layer-4 checksum offload for TCP, UDP, ICMP
-     *   (automatically discard frames with wrong layer-4 checksum)
+     * - Do not discard frames with wrong IP header checksum or wrong
+     *   layer-4 checksum (TCP, UDP, ICMP). The checksums are still validated
+     *   by the MAC and the result is carried in the Rx buffer descriptor
+     *   to the corresponding Rx packet, so that upper layers can drop
+     *   and count those frames.
      * - Enable Rx FIFO shift 16, so that the data payload of
      *   an incoming Ethernet frame can be 32-bit aligned in memory.
      *   (Like if 2 dummy bytes were added at the beginning of the
@@ -614,10 +991,6 @@ static void ethernet_mac_rx_init(const struct ethernet_mac_device *ethernet_mac_
 
     reg_value = ENET_RACC_PADREM_MASK | ENET_RACC_LINEDIS_MASK;
 
-#   ifdef ENET_CHECKSUM_OFFLOAD
-    reg_value |= ENET_RACC_IPDIS_MASK | ENET_RACC_PRODIS_MASK;
-#   endif
-
 #   ifdef ENET_DATA_PAYLOAD_32_BIT_ALIGNED
     reg_value |= ENET_RACC_SHIFT16_MASK;
 #   endif
@@ -626,15 +999,17 @@ static void ethernet_mac_rx_init(const struct ethernet_mac_device *ethernet_mac_
 
     /*
      * Configure Rx FIFO:
-     * - Set Rx FIFO section full threshold to 0 (reset default)
-     * - Set Rx FIFO section empty threshold to 0 (reset default)
-     * - Set Rx FIFO almost empty threshold to 4 (reset default)
-     * - Set Rx FIFO almost full threshold to 4 (reset default)
+     * - Set Rx FIFO section full threshold to 0 (store and forward, which
+     *   the discard of frames with errors set in RACC depends on)
+     * - Set Rx FIFO section empty threshold to the level at which a PAUSE
+     *   frame is sent (0 would disable FIFO-triggered PAUSE frames)
+     * - Set Rx FIFO almost empty and almost full thresholds
      */
     WRITE_MMIO_REGISTER(&mac_regs_p->RSFL, 0);
-    WRITE_MMIO_REGISTER(&mac_regs_p->RSEM, 0);
-    WRITE_MMIO_REGISTER(&mac_regs_p->RAEM, 4);
-    WRITE_MMIO_REGISTER(&mac_regs_p->RAFL, 4);
+    WRITE_MMIO_REGISTER(&mac_regs_p->RSEM, ETHERNET_MAC_RX_FIFO_XOFF_THRESHOLD);
+    WRITE_MMIO_REGISTER(&mac_regs_p->RAEM, ETHERNET_MAC_RX_FIFO_ALMOST_EMPTY);
+    WRITE_MMIO_REGISTER(&mac_regs_p->RAFL, ETHERNET_MAC_RX_FIFO_ALMOST_FULL);
+    ethernet_mac_p->var_p->flow_control_on = true;
 
     /*
      * Enable Rx interrupts in the interrupt controller (NVIC):
@@ -649,9 +1024,12 @@ static void ethernet_mac_rx_init(const struct ethernet_mac_device *ethernet_mac_
  * @param ethernet_mac_p        Pointer to the Ethernet MAC device
  * @param layer2_end_point_p     Pointer to the local layer-2 end point
  *                                 to be associated with this MAC
+ * @param rx_mode               Rx completion handling mode
  */
 void ethernet_mac_init(const struct ethernet_mac_device *ethernet_mac_p,
-                       struct net_layer2_end_point *layer2_end_point_p)
+                       struct net_layer2_end_point *layer2_end_point_p,
+                       enum ethernet_mac_rx_modes rx_mode,
+                       enum ethernet_mac_tx_modes tx_mode)
 {
     uint32_t reg_value;
     ENET_Type *mac_regs_p = ethernet_mac_p->mmio_registers_p;
@@ -660,8 +1038,25 @@ void ethernet_mac_init(const struct ethernet_mac_device *ethernet_mac_p,
     D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
     D_ASSERT(!mac_var_p->initialized);
     D_ASSERT(mac_var_p->layer2_end_point_p == NULL);
+    D_ASSERT(ethernet_mac_p->tx_ring_num_entries != 0 &&
+             ethernet_mac_p->tx_ring_num_entries <=
+                ETHERNET_MAC_MAX_TX_RING_ENTRIES);
+    D_ASSERT(ethernet_mac_p->rx_ring_num_entries != 0 &&
+             ethernet_mac_p->rx_ring_num_entries <=
+                 ETHERNET_MAC_MAX_RX_RING_ENTRIES &&
+             ethernet_mac_p->rx_ring_num_entries <= NET_MAX_RX_PACKETS);
+
+    /*
+     * The Tx ring must be able to hold all Tx packets at once, with one Tx
+     * buffer descriptor for each (Tx packets with payload fragments take
+     * additional Tx buffer descriptors only while there is room for them):
+     */
+    D_ASSERT(ethernet_mac_p->tx_ring_num_entries >= NET_MAX_TX_PACKETS);
 
     mac_var_p->layer2_end_point_p = layer2_end_point_p;
+    mac_var_p->rx_mode = rx_mode;
+    mac_var_p->tx_mode = tx_mode;
+    mac_var_p->tx_frames_since_last_interrupt = 0;
 
     /*
      * Enable the Clock to the ENET Module
@@ -714,13 +1109,18 @@ void ethernet_mac_init(const struct ethernet_mac_device *ethernet_mac_p,
 
     ethernet_mac_tx_init(ethernet_mac_p);
     ethernet_mac_rx_init(ethernet_mac_p);
+    ethernet_mac_ieee_1588_timer_init(ethernet_mac_p);
 
     /*
-     * Disable MIB counters:
+     * Clear MIB counters (they must be disabled to be cleared) and then
+     * enable them:
      */
     WRITE_MMIO_REGISTER(&mac_regs_p->MIBC,
                         ENET_MIBC_MIB_DIS_MASK | ENET_MIBC_MIB_CLEAR_MASK);
     WRITE_MMIO_REGISTER(&mac_regs_p->MIBC, 0x0);
+    memset(&mac_var_p->stats, 0, sizeof mac_var_p->stats);
+    memset(mac_var_p->mib_counters_last_values, 0,
+           sizeof mac_var_p->mib_counters_last_values);
 
     /*
      * Enable error interrupts in the interrupt controller (NVIC):
@@ -732,8 +1132,9 @@ void ethernet_mac_init(const struct ethernet_mac_device *ethernet_mac_p,
     crc_32_accelerator_init();
 
     mac_var_p->initialized = true;
-    DEBUG_PRINTF("Ethernet MAC: Initialized MAC %s\n",
-                 ethernet_mac_p->name_p);
+    DEBUG_PRINTF("Ethernet MAC: Initialized MAC %s (%s Rx mode)\n",
+                 ethernet_mac_p->name_p,
+                 rx_mode == ETHERNET_MAC_RX_POLLED_MODE ? "polled" : "interrupt");
 }
 
 
@@ -790,8 +1191,11 @@ void ethernet_mac_start(const struct ethernet_mac_device *ethernet_mac_p)
      *   last and only Tx buffer descriptor of the frame has been updated)
      * - Generate Rx interrupt when a frame has been received (the
      *   (last and only Rx buffer descriptor of the frame has been updated)
+     * - Keep the MII interrupt, if the PHY driver enabled it
      */
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIMR);
     WRITE_MMIO_REGISTER(&mac_regs_p->EIMR,
+                        (reg_value & ENET_EIMR_MII_MASK) |
                         ENET_EIMR_TXF_MASK |
                         ENET_EIMR_RXF_MASK |
                         ENET_EIMR_BABR_MASK |
@@ -807,6 +1211,12 @@ void ethernet_mac_start(const struct ethernet_mac_device *ethernet_mac_p)
     reg_value |= ENET_ECR_ETHEREN_MASK;
     WRITE_MMIO_REGISTER(&mac_regs_p->ECR, reg_value);
 
+    /*
+     * The ENET module is clocked from the system clock, which is gated in
+     * Stop mode, so frames would be missed:
+     */
+    cpu_idle_deep_sleep_veto_acquire();
+
     /*
      * Activate Rx buffer descriptor ring:
      * (the Rx descriptor ring must have at least one descriptor with the "empty"
@@ -832,10 +1242,43 @@ void ethernet_mac_start(const struct ethernet_mac_device *ethernet_mac_p)
 
 
 /**
- * Add a multicast MAC address to the given Ethernet device
+ * Computes the bucket of the Ethernet MAC's hash tables that a MAC address
+ * falls in: the top 6 bits of the CRC-32 of the address, as computed by the
+ * MAC for the destination address of received frames. The CRC is computed
+ * with a table generated at build time (see ethernet_crc32_table.c), rather
+ * than with the CRC module, that would have to be shared with other users.
+ *
+ * @param mac_addr_p    Pointer to the MAC address
+ *
+ * @return hash bucket index
  */
-void ethernet_mac_add_multicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
-                                     struct ethernet_mac_address *mac_addr_p)
+static uint32_t ethernet_mac_hash_index(const struct ethernet_mac_address *mac_addr_p)
+{
+    uint32_t crc = UINT32_MAX;
+
+    for (size_t i = 0; i < sizeof mac_addr_p->bytes; i ++) {
+        crc = (crc >> 8) ^ g_ethernet_crc32_table[(crc ^ mac_addr_p->bytes[i]) & 0xff];
+    }
+
+    return crc >> 26; /* top 6 bits */
+}
+
+
+/**
+ * Adds a MAC address to one of the hash tables of the given Ethernet MAC
+ * (GAUR/GALR for multicast addresses or IAUR/IALR for unicast addresses)
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param mac_addr_p        Pointer to the MAC address
+ * @param hash_table_counts Array of counters for the hash table buckets
+ * @param upper_reg_p       Pointer to the upper 32-bit hash table register
+ * @param lower_reg_p       Pointer to the lower 32-bit hash table register
+ */
+static void ethernet_mac_hash_table_add(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct ethernet_mac_address *mac_addr_p,
+                                        uint8_t hash_table_counts[],
+                                        volatile uint32_t *upper_reg_p,
+                                        volatile uint32_t *lower_reg_p)
 {
     uint32_t reg_value;
     uint32_t hash_bit_index;
@@ -844,47 +1287,42 @@ void ethernet_mac_add_multicast_addr(const struct ethernet_mac_device *ethernet_
 #   ifdef USE_MPU
     struct mpu_region_range old_comp_region;
 
-    rtos_thread_set_comp_region(enet_var_p,
-                                sizeof *enet_var_p,
+    rtos_thread_set_comp_region(ethernet_mac_p->var_p,
+                                sizeof *ethernet_mac_p->var_p,
                                 0,
                                 &old_comp_region);
 #    endif
 
     D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
-    D_ASSERT(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK);
-
-    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
-    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
-
-    D_ASSERT(mac_var_p->initialized);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
 
 #   ifdef USE_MPU
     bool caller_was_privileged = rtos_enter_privileged_mode();
 #   endif
 
-    uint32_t crc = crc_32_accelerator_run(mac_addr_p, sizeof *mac_addr_p);
-    uint32_t hash_value = crc >> 26; /* top 6 bits */
+    uint32_t hash_value = ethernet_mac_hash_index(mac_addr_p);
 
-    D_ASSERT(hash_value < ETHERNET_MAC_MULTICAST_HASH_TABLE_NUM_BUCKETS);
-    mac_var_p->multicast_hash_table_counts[hash_value] ++;
+    D_ASSERT(hash_value < ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS);
+    hash_table_counts[hash_value] ++;
 
-    D_ASSERT(mac_var_p->multicast_hash_table_counts[hash_value] != 0);
+    D_ASSERT(hash_table_counts[hash_value] != 0);
 
     /*
-     * Select either GAUR or GARL from the top bit of the hash value:
+     * Select either the upper or the lower hash table register from the
+     * top bit of the hash value:
      */
     if (hash_value & BIT(5)) {
-        reg_p = &mac_regs_p->GAUR;
+        reg_p = upper_reg_p;
         hash_bit_index = hash_value & ~BIT(5);
     } else {
-        reg_p = &mac_regs_p->GALR;
+        reg_p = lower_reg_p;
         hash_bit_index = hash_value;
     }
 
     D_ASSERT(hash_bit_index < 32);
 
     /*
-     * Set hash bit in GAUR or GALR, if not set already:
+     * Set hash bit in the hash table register, if not set already:
      */
     reg_value = READ_MMIO_REGISTER(reg_p);
     if ((reg_value & BIT(hash_bit_index)) == 0) {
@@ -903,10 +1341,20 @@ void ethernet_mac_add_multicast_addr(const struct ethernet_mac_device *ethernet_
 
 
 /**
- * Remove a multicast MAC address from the given Ethernet device
+ * Removes a MAC address from one of the hash tables of the given Ethernet
+ * MAC (GAUR/GALR for multicast addresses or IAUR/IALR for unicast addresses)
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param mac_addr_p        Pointer to the MAC address
+ * @param hash_table_counts Array of counters for the hash table buckets
+ * @param upper_reg_p       Pointer to the upper 32-bit hash table register
+ * @param lower_reg_p       Pointer to the lower 32-bit hash table register
  */
-void ethernet_mac_remove_multicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
-                                        struct ethernet_mac_address *mac_addr_p)
+static void ethernet_mac_hash_table_remove(const struct ethernet_mac_device *ethernet_mac_p,
+                                           struct ethernet_mac_address *mac_addr_p,
+                                           uint8_t hash_table_counts[],
+                                           volatile uint32_t *upper_reg_p,
+                                           volatile uint32_t *lower_reg_p)
 {
     uint32_t reg_value;
     volatile uint32_t *reg_p;
@@ -915,122 +1363,337 @@ void ethernet_mac_remove_multicast_addr(const struct ethernet_mac_device *ethern
 #   ifdef USE_MPU
     struct mpu_region_range old_comp_region;
 
-    rtos_thread_set_comp_region(enet_var_p,
-                                sizeof *enet_var_p,
+    rtos_thread_set_comp_region(ethernet_mac_p->var_p,
+                                sizeof *ethernet_mac_p->var_p,
                                 0,
                                 &old_comp_region);
 #   endif
 
     D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
 
-    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
-    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
-
-    D_ASSERT(mac_var_p->initialized);
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#   endif
 
-    uint32_t crc = crc_32_accelerator_run(mac_addr_p, sizeof *mac_addr_p);
-    uint32_t hash_value = crc >> 26; /* top 6 bits */
+    uint32_t hash_value = ethernet_mac_hash_index(mac_addr_p);
 
-    D_ASSERT(hash_value < ETHERNET_MAC_MULTICAST_HASH_TABLE_NUM_BUCKETS);
-    D_ASSERT(mac_var_p->multicast_hash_table_counts[hash_value] != 0);
+    D_ASSERT(hash_value < ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS);
+    D_ASSERT(hash_table_counts[hash_value] != 0);
 
-    mac_var_p->multicast_hash_table_counts[hash_value] --;
+    hash_table_counts[hash_value] --;
 
     /*
-     * Select either GAUR or GARL from the top bit of the hash value:
+     * Select either the upper or the lower hash table register from the
+     * top bit of the hash value:
      */
     if (hash_value & BIT(5)) {
-        reg_p = &mac_regs_p->GAUR;
+        reg_p = upper_reg_p;
         hash_bit_index = hash_value & ~BIT(5);
     } else {
-        reg_p = &mac_regs_p->GALR;
+        reg_p = lower_reg_p;
         hash_bit_index = hash_value;
     }
 
     D_ASSERT(hash_bit_index < 32);
 
     /*
-     * Clear hash bit in GAUR or GALR, if hash bucket became empty:
+     * Clear hash bit in the hash table register, if hash bucket became empty:
      */
     reg_value = READ_MMIO_REGISTER(reg_p);
-    if (mac_var_p->multicast_hash_table_counts[hash_value] == 0) {
+    if (hash_table_counts[hash_value] == 0) {
         reg_value &= ~BIT(hash_bit_index);
         WRITE_MMIO_REGISTER(reg_p, reg_value);
     }
 
 #   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+
     rtos_thread_restore_comp_region(&old_comp_region);
 #   endif
 }
 
 
 /**
- * Remove Tx buffer descriptors from the Tx ring, for those network packets
- * that have already been transmitted, and return those packets to the pool
- * of free Tx packets.
+ * Add a multicast MAC address to the given Ethernet device
  */
-static void ethernet_mac_drain_tx_ring(struct ethernet_mac_device_var *mac_var_p)
+void ethernet_mac_add_multicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                     struct ethernet_mac_address *mac_addr_p)
 {
-    volatile struct ethernet_tx_buffer_descriptor *buffer_desc_p =
-        mac_var_p->tx_ring_read_cursor;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
 
-    do {
-        D_ASSERT(buffer_desc_p >= &mac_var_p->tx_buffer_descriptors[0] &&
-                 buffer_desc_p <=
-                   &mac_var_p->tx_buffer_descriptors[NET_MAX_TX_PACKETS - 1]);
+    D_ASSERT(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK);
+    ethernet_mac_hash_table_add(ethernet_mac_p, mac_addr_p,
+                                ethernet_mac_p->var_p->multicast_hash_table_counts,
+                                &mac_regs_p->GAUR, &mac_regs_p->GALR);
+}
 
-        D_ASSERT(buffer_desc_p != mac_var_p->tx_ring_write_cursor ||
-                 mac_var_p->tx_ring_entries_filled == NET_MAX_TX_PACKETS);
 
-        D_ASSERT((buffer_desc_p->control &
-                  (ENET_TX_BD_LAST_IN_FRAME_MASK | ENET_TX_BD_CRC_MASK)) ==
-                 (ENET_TX_BD_LAST_IN_FRAME_MASK | ENET_TX_BD_CRC_MASK));
+/**
+ * Remove a multicast MAC address from the given Ethernet device
+ */
+void ethernet_mac_remove_multicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct ethernet_mac_address *mac_addr_p)
+{
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
 
-        if (buffer_desc_p->control & ENET_TX_BD_READY_MASK) {
-            break;
-        }
+    D_ASSERT(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK);
+    ethernet_mac_hash_table_remove(ethernet_mac_p, mac_addr_p,
+                                   ethernet_mac_p->var_p->multicast_hash_table_counts,
+                                   &mac_regs_p->GAUR, &mac_regs_p->GALR);
+}
 
-        struct network_packet *tx_packet_p =
-            BUFFER_TO_NETWORK_PACKET(buffer_desc_p->data_buffer);
 
-        D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
-        D_ASSERT(tx_packet_p->tx_buf_desc_p == buffer_desc_p);
-        D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT);
-        D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_USE_BY_APP);
+/**
+ * Add an additional unicast MAC address to be accepted by the given
+ * Ethernet device, besides its own MAC address
+ */
+void ethernet_mac_add_unicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct ethernet_mac_address *mac_addr_p)
+{
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
 
-#       if 0
-        DEBUG_PRINTF("Ethernet MAC: Transmitted packet %#x\n", tx_packet_p);
-#       endif
+    D_ASSERT(!(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK));
+    ethernet_mac_hash_table_add(ethernet_mac_p, mac_addr_p,
+                                ethernet_mac_p->var_p->unicast_hash_table_counts,
+                                &mac_regs_p->IAUR, &mac_regs_p->IALR);
+}
 
-        tx_packet_p->state_flags &= ~NET_PACKET_IN_TX_TRANSIT;
-        tx_packet_p->tx_buf_desc_p = NULL;
-        buffer_desc_p->data_buffer = NULL;
-        buffer_desc_p->control_extend1 &= ~ENET_TX_BD_INTERRUPT_MASK;
-        if (buffer_desc_p->control_extend0 &
-            (ENET_TX_BD_ERROR_MASK |
-             ENET_TX_BD_FIFO_OVERFLOW_ERROR_MASK |
-             ENET_TX_BD_TMESTAMP_ERROR_MASK |
-             ENET_TX_BD_FRAME_ERROR_MASK)) {
-             ERROR_PRINTF("Ethernet transmission failed (Tx packet dropped): "
-                          "control_extended: %#x, buffer_desc: %#x\n",
-                          buffer_desc_p->control_extend0, buffer_desc_p);
-        }
 
-        if (tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE) {
-            /*
-             * Free transmitted packet:
-             */
-            tx_packet_p->state_flags &= ~NET_PACKET_FREE_AFTER_TX_COMPLETE;
-            net_layer2_free_tx_packet(tx_packet_p);
-        }
+/**
+ * Remove an additional unicast MAC address from the given Ethernet device
+ */
+void ethernet_mac_remove_unicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                      struct ethernet_mac_address *mac_addr_p)
+{
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
 
-        if (buffer_desc_p->control & ENET_TX_BD_WRAP_MASK) {
-            buffer_desc_p = &mac_var_p->tx_buffer_descriptors[0];
-        } else {
-            buffer_desc_p ++;
-        }
+    D_ASSERT(!(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK));
+    ethernet_mac_hash_table_remove(ethernet_mac_p, mac_addr_p,
+                                   ethernet_mac_p->var_p->unicast_hash_table_counts,
+                                   &mac_regs_p->IAUR, &mac_regs_p->IALR);
+}
 
-        mac_var_p->tx_ring_entries_filled --;
+
+/**
+ * Configures the given Ethernet device for the link mode resolved by
+ * auto-negotiation. The transmitter is gracefully stopped while the duplex
+ * mode is changed, so that no frame is truncated.
+ *
+ * @param ethernet_mac_p    Pointer to Ethernet MAC
+ * @param link_mode_p       Link mode (speed, duplex and flow control)
+ */
+void ethernet_mac_set_link_mode(const struct ethernet_mac_device *ethernet_mac_p,
+                                const struct ethernet_phy_link_mode *link_mode_p)
+{
+    uint32_t reg_value;
+    uint_fast16_t polling_count;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#   endif
+
+    /*
+     * Stop the transmitter after the frame in progress, if any:
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_GRA_MASK);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->TCR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->TCR, reg_value | ENET_TCR_GTS_MASK);
+    restore_cpu_interrupts(int_mask);
+
+    polling_count = ETHERNET_MAC_TX_STOP_MAX_POLLING_COUNT;
+    while ((READ_MMIO_REGISTER(&mac_regs_p->EIR) & ENET_EIR_GRA_MASK) == 0 &&
+           polling_count != 0) {
+        polling_count --;
+    }
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_GRA_MASK);
+
+    /*
+     * - Full duplex: enable full-duplex transmit and, if negotiated,
+     *   send and honor PAUSE frames
+     * - Half duplex: disable receive on transmit, so that the MAC does not
+     *   receive its own frames
+     * - Select 10 or 100 Mb/s operation of the RMII interface
+     * - Restart the transmitter
+     */
+    int_mask = disable_cpu_interrupts();
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->TCR);
+    if (link_mode_p->full_duplex) {
+        reg_value |= ENET_TCR_FDEN_MASK;
+    } else {
+        reg_value &= ~ENET_TCR_FDEN_MASK;
+    }
+
+    uint32_t rcr_value = READ_MMIO_REGISTER(&mac_regs_p->RCR);
+
+    if (link_mode_p->full_duplex) {
+        rcr_value &= ~ENET_RCR_DRT_MASK;
+    } else {
+        rcr_value |= ENET_RCR_DRT_MASK;
+    }
+
+    if (link_mode_p->pause) {
+        rcr_value |= ENET_RCR_FCE_MASK;
+    } else {
+        rcr_value &= ~ENET_RCR_FCE_MASK;
+    }
+
+    if (link_mode_p->speed_100_mbps) {
+        rcr_value &= ~ENET_RCR_RMII_10T_MASK;
+    } else {
+        rcr_value |= ENET_RCR_RMII_10T_MASK;
+    }
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->RCR, rcr_value);
+    WRITE_MMIO_REGISTER(&mac_regs_p->TCR, reg_value & ~ENET_TCR_GTS_MASK);
+    ethernet_mac_p->var_p->flow_control_on = link_mode_p->pause;
+    restore_cpu_interrupts(int_mask);
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Turns promiscuous mode on/off for the given Ethernet device. In promiscuous
+ * mode, all frames seen on the link are received, regardless of their
+ * destination MAC address. Otherwise, only frames whose destination address
+ * is the device's own MAC address, the broadcast address or an address that
+ * hits the unicast or multicast hash tables are received.
+ */
+void ethernet_mac_set_promiscuous_mode(const struct ethernet_mac_device *ethernet_mac_p,
+                                       bool on)
+{
+    uint32_t reg_value;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#   endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->RCR);
+    if (on) {
+        reg_value |= ENET_RCR_PROM_MASK;
+    } else {
+        reg_value &= ~ENET_RCR_PROM_MASK;
+    }
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->RCR, reg_value);
+
+    restore_cpu_interrupts(int_mask);
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Remove Tx buffer descriptors from the Tx ring, for those network packets
+ * that have already been transmitted, and return those packets to the pool
+ * of free Tx packets.
+ *
+ * NOTE: A Tx packet is considered transmitted only when the last Tx buffer
+ * descriptor of its frame has been released by the MAC, as the payload
+ * fragments chained to it may still being read by the MAC's DMA engine.
+ */
+RAM_FUNC static void ethernet_mac_drain_tx_ring(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    volatile struct ethernet_tx_buffer_descriptor *buffer_desc_p =
+        mac_var_p->tx_ring_read_cursor;
+
+    do {
+        D_ASSERT(buffer_desc_p >= &mac_var_p->tx_buffer_descriptors[0] &&
+                 buffer_desc_p <=
+                   &mac_var_p->tx_buffer_descriptors[ethernet_mac_p->tx_ring_num_entries - 1]);
+
+        D_ASSERT(buffer_desc_p != mac_var_p->tx_ring_write_cursor ||
+                 mac_var_p->tx_ring_entries_filled == ethernet_mac_p->tx_ring_num_entries);
+
+        if (buffer_desc_p->control & ENET_TX_BD_READY_MASK) {
+            break;
+        }
+
+        unsigned int buffer_desc_index =
+            buffer_desc_p - &mac_var_p->tx_buffer_descriptors[0];
+        struct network_packet *tx_packet_p =
+            mac_var_p->tx_ring_packets[buffer_desc_index];
+
+        buffer_desc_p->data_buffer = NULL;
+        if (tx_packet_p != NULL) {
+            /*
+             * Last Tx buffer descriptor of a frame:
+             */
+            D_ASSERT((buffer_desc_p->control &
+                      (ENET_TX_BD_LAST_IN_FRAME_MASK | ENET_TX_BD_CRC_MASK)) ==
+                     (ENET_TX_BD_LAST_IN_FRAME_MASK | ENET_TX_BD_CRC_MASK));
+            D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+            D_ASSERT(tx_packet_p->tx_buf_desc_p != NULL);
+            D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT);
+            D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_USE_BY_APP);
+
+#           if 0
+            DEBUG_PRINTF("Ethernet MAC: Transmitted packet %#x\n", tx_packet_p);
+#           endif
+
+            if (tx_packet_p->timestamp_flags & NET_PACKET_TX_TIMESTAMP_REQUESTED) {
+                tx_packet_p->timestamp = buffer_desc_p->timestamp;
+                tx_packet_p->timestamp_flags = NET_PACKET_TIMESTAMP_VALID;
+            }
+
+            mac_var_p->tx_ring_packets[buffer_desc_index] = NULL;
+            NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+            tx_packet_p->tx_buf_desc_p = NULL;
+            buffer_desc_p->control_extend1 &= ~ENET_TX_BD_INTERRUPT_MASK;
+            if (buffer_desc_p->control_extend0 &
+                (ENET_TX_BD_ERROR_MASK |
+                 ENET_TX_BD_FIFO_OVERFLOW_ERROR_MASK |
+                 ENET_TX_BD_TMESTAMP_ERROR_MASK |
+                 ENET_TX_BD_FRAME_ERROR_MASK)) {
+                net_layer2_count_drop(NET_LAYER2_DROP_TX_FAILED);
+            }
+
+            D_ASSERT(mac_var_p->tx_ring_frames_filled != 0);
+            mac_var_p->tx_ring_frames_filled --;
+            if (tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE) {
+                /*
+                 * Free transmitted packet:
+                 */
+                NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+                net_layer2_free_tx_packet(tx_packet_p);
+            }
+        } else {
+            D_ASSERT((buffer_desc_p->control & ENET_TX_BD_LAST_IN_FRAME_MASK) == 0);
+        }
+
+        if (buffer_desc_p->control & ENET_TX_BD_WRAP_MASK) {
+            buffer_desc_p = &mac_var_p->tx_buffer_descriptors[0];
+        } else {
+            buffer_desc_p ++;
+        }
+
+        mac_var_p->tx_ring_entries_filled --;
     } while (mac_var_p->tx_ring_entries_filled != 0);
 
     mac_var_p->tx_ring_read_cursor = buffer_desc_p;
@@ -1038,237 +1701,1486 @@ static void ethernet_mac_drain_tx_ring(struct ethernet_mac_device_var *mac_var_p
 
 
 /**
- * Transmit completion interrupt handler
+ * Transmit completion interrupt handler
+ */
+RAM_FUNC static void ethernet_mac_tx_irq_handler(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    for ( ; ; ) {
+        uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIR);
+
+        if ((reg_value & ENET_EIR_TXF_MASK) == 0) {
+            break;
+        }
+
+        /*
+         * Clear interrupt source (w1c):
+         */
+        WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_TXF_MASK);
+
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        D_ASSERT(mac_var_p->tx_ring_entries_filled <=
+                 ethernet_mac_p->tx_ring_num_entries);
+        D_ASSERT(mac_var_p->tx_ring_read_cursor != NULL);
+
+        if (mac_var_p->tx_ring_entries_filled == 0) {
+            restore_cpu_interrupts(int_mask);
+            break;
+        }
+
+        ethernet_mac_drain_tx_ring(ethernet_mac_p);
+        restore_cpu_interrupts(int_mask);
+    }
+
+    /*
+     * Hand to the MAC the frames that were waiting for room in the Tx ring:
+     */
+    net_layer2_tx_complete(mac_var_p->layer2_end_point_p);
+}
+
+
+/**
+ * ISR for the Ethernet MAC0's Tx interrupt
+ */
+RAM_FUNC void ethernet_mac0_tx_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    ethernet_mac_tx_irq_handler(&g_ethernet_macs[0]);
+    rtos_exit_isr();
+}
+
+
+/**
+ * Carries the checksum validation results and the header fields parsed by
+ * the MAC from an Rx buffer descriptor to its Rx packet, so that upper
+ * layers can classify the packet without reading its data buffer
+ */
+static inline void
+ethernet_mac_get_rx_checksum_status(
+    volatile const struct ethernet_rx_buffer_descriptor *buffer_desc_p,
+    struct network_packet *rx_packet_p)
+{
+    uint16_t control_extend0 = buffer_desc_p->control_extend0;
+    uint8_t checksum_flags = 0;
+
+#   ifdef ENET_CHECKSUM_OFFLOAD
+    /*
+     * The MAC parsed the IP headers of the frame, only if it is an IP frame:
+     */
+    if (buffer_desc_p->header_length != 0) {
+        checksum_flags |= NET_PACKET_RX_CHECKSUMS_VALIDATED;
+        if (!(control_extend0 & ENET_RX_BD_IP_HEADER_CHECKSUM_ERROR_MASK)) {
+            checksum_flags |= NET_PACKET_RX_IP_HEADER_CHECKSUM_OK;
+        }
+
+        if (!(control_extend0 & ENET_RX_BD_PROTOCOL_CHECKSUM_ERROR_MASK)) {
+            checksum_flags |= NET_PACKET_RX_PROTOCOL_CHECKSUM_OK;
+        }
+    }
+#   endif
+
+    if (control_extend0 & ENET_RX_BD_IPv6_FRAME_MASK) {
+        checksum_flags |= NET_PACKET_RX_IPv6_FRAME;
+    }
+
+    if (control_extend0 & ENET_RX_BD_IPv4_FRAGMENT_MASK) {
+        checksum_flags |= NET_PACKET_RX_IPv4_FRAGMENT;
+    }
+
+    if (control_extend0 & ENET_RX_BD_VLAN_FRAME_MASK) {
+        checksum_flags |= NET_PACKET_RX_VLAN_FRAME;
+    }
+
+    /*
+     * The header length is 0 if the frame is not an IP frame, or if the MAC
+     * found an error in its IP header:
+     */
+    uint8_t header_length = buffer_desc_p->header_length;
+
+    if (header_length != 0) {
+        checksum_flags |= NET_PACKET_RX_HEADERS_PARSED;
+    }
+
+    rx_packet_p->rx_checksum_flags = checksum_flags;
+    rx_packet_p->rx_protocol_type = buffer_desc_p->protocol_type;
+    rx_packet_p->rx_header_length = header_length;
+}
+
+
+/**
+ * Returns the Rx buffer descriptor that follows a given one in the Rx ring
+ */
+static inline volatile struct ethernet_rx_buffer_descriptor *
+ethernet_mac_next_rx_buffer_descriptor(
+    struct ethernet_mac_device_var *mac_var_p,
+    volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p)
+{
+    if (buffer_desc_p->control & ENET_RX_BD_WRAP_MASK) {
+        return &mac_var_p->rx_buffer_descriptors[0];
+    } else {
+        return buffer_desc_p + 1;
+    }
+}
+
+
+/**
+ * Unlinks the Rx packet of the Rx buffer descriptor at the Rx ring read
+ * cursor and advances the read cursor
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return Pointer to the Rx packet that was in the Rx buffer descriptor
+ */
+static struct network_packet *
+ethernet_mac_unlink_rx_buffer_descriptor(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p =
+        mac_var_p->rx_ring_read_cursor;
+
+    D_ASSERT(mac_var_p->rx_ring_entries_filled != 0);
+    D_ASSERT(!(buffer_desc_p->control & ENET_RX_BD_EMPTY_MASK));
+
+    uint_fast16_t buffer_desc_index =
+        buffer_desc_p - &mac_var_p->rx_buffer_descriptors[0];
+    struct network_packet *rx_packet_p =
+        mac_var_p->rx_ring_packets[buffer_desc_index];
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_TRANSIT);
+    D_ASSERT(!(rx_packet_p->state_flags & NET_PACKET_IN_RX_USE_BY_APP));
+    D_ASSERT(rx_packet_p->data_buffer == buffer_desc_p->data_buffer);
+
+    NET_PACKET_CLEAR_STATE_FLAG(rx_packet_p, NET_PACKET_IN_RX_TRANSIT);
+    rx_packet_p->rx_buf_desc_p = NULL;
+    rx_packet_p->next_fragment_p = NULL;
+    buffer_desc_p->data_buffer = NULL;
+    mac_var_p->rx_ring_packets[buffer_desc_index] = NULL;
+    buffer_desc_p->control_extend1 &= ~ENET_RX_BD_GENERATE_INTERRUPT_MASK;
+
+    mac_var_p->rx_ring_entries_filled --;
+    mac_var_p->rx_ring_read_cursor =
+        ethernet_mac_next_rx_buffer_descriptor(mac_var_p, buffer_desc_p);
+    return rx_packet_p;
+}
+
+
+/**
+ * Removes the Rx buffer descriptors of the next received frame from the Rx
+ * ring, if the Ethernet MAC has already received the whole frame. A frame that
+ * does not fit in one Rx data buffer spans several Rx buffer descriptors and
+ * is returned as a chain of Rx packets linked by next_fragment_p.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return Pointer to the (first) Rx packet of the received frame, or NULL if
+ *         the Rx ring has no completely received frames
+ */
+static struct network_packet *
+ethernet_mac_remove_rx_packet(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p =
+        mac_var_p->rx_ring_read_cursor;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+
+    if (mac_var_p->rx_ring_entries_filled == 0) {
+        return NULL;
+    }
+
+    D_ASSERT(buffer_desc_p >= &mac_var_p->rx_buffer_descriptors[0] &&
+             buffer_desc_p <=
+               &mac_var_p->rx_buffer_descriptors[ethernet_mac_p->rx_ring_num_entries - 1]);
+
+    D_ASSERT(buffer_desc_p != mac_var_p->rx_ring_write_cursor ||
+             mac_var_p->rx_ring_entries_filled == ethernet_mac_p->rx_ring_num_entries);
+
+    if (buffer_desc_p->control & ENET_RX_BD_EMPTY_MASK) {
+        return NULL;
+    }
+
+    /*
+     * Find the last Rx buffer descriptor of the frame. If the Ethernet MAC
+     * is still receiving the frame, leave it in the Rx ring for now:
+     */
+    volatile struct ethernet_rx_buffer_descriptor *last_buffer_desc_p =
+        buffer_desc_p;
+    uint_fast16_t num_frame_buffer_descs = 1;
+
+    while (!(last_buffer_desc_p->control & ENET_RX_BD_LAST_IN_FRAME_MASK)) {
+        if (num_frame_buffer_descs == mac_var_p->rx_ring_entries_filled) {
+            return NULL;
+        }
+
+        last_buffer_desc_p =
+            ethernet_mac_next_rx_buffer_descriptor(mac_var_p, last_buffer_desc_p);
+        if (last_buffer_desc_p->control & ENET_RX_BD_EMPTY_MASK) {
+            return NULL;
+        }
+
+        num_frame_buffer_descs ++;
+    }
+
+    D_ASSERT(num_frame_buffer_descs <= ETHERNET_MAC_MAX_RX_FRAME_BUFFER_DESCRIPTORS);
+
+    /*
+     * NOTE: The frame status, length, checksum status and timestamp are
+     * only meaningful in the frame's last Rx buffer descriptor
+     */
+    bool frame_failed = (last_buffer_desc_p->control &
+                         (ENET_RX_BD_LENGTH_VIOLATION_MASK |
+                          ENET_RX_BD_NON_OCTET_ALIGNED_FRAME_MASK |
+                          ENET_RX_BD_CRC_ERROR_MASK |
+                          ENET_RX_BD_FIFO_OVERRRUN_MASK |
+                          ENET_RX_BD_FRAME_TRUNCATED_MASK)) != 0;
+
+    if (frame_failed) {
+        net_layer2_count_drop(NET_LAYER2_DROP_RX_BAD_FRAME);
+    } else {
+        D_ASSERT(last_buffer_desc_p->data_length <= ETHERNET_MAC_MAX_RX_FRAME_SIZE);
+    }
+
+    struct network_packet *rx_packet_p = NULL;
+    struct network_packet *last_fragment_p = NULL;
+
+    for (uint_fast16_t i = 0; i < num_frame_buffer_descs; i ++) {
+        struct network_packet *fragment_p =
+            ethernet_mac_unlink_rx_buffer_descriptor(ethernet_mac_p);
+
+        if (frame_failed) {
+            fragment_p->state_flags = NET_PACKET_RX_FAILED;
+        }
+
+        if (rx_packet_p == NULL) {
+            rx_packet_p = fragment_p;
+        } else {
+            last_fragment_p->next_fragment_p = fragment_p;
+            if (!frame_failed) {
+                fragment_p->total_length = NET_PACKET_DATA_BUFFER_SIZE;
+            }
+        }
+
+        last_fragment_p = fragment_p;
+    }
+
+    if (!frame_failed) {
+        rx_packet_p->total_length = last_buffer_desc_p->data_length;
+        if (last_fragment_p != rx_packet_p) {
+            uint_fast16_t bytes_before_last_fragment =
+                (num_frame_buffer_descs - 1) * NET_PACKET_DATA_BUFFER_SIZE;
+
+            D_ASSERT(last_buffer_desc_p->data_length > bytes_before_last_fragment);
+            last_fragment_p->total_length =
+                last_buffer_desc_p->data_length - bytes_before_last_fragment;
+        }
+
+        ethernet_mac_get_rx_checksum_status(last_buffer_desc_p, rx_packet_p);
+        rx_packet_p->timestamp = last_buffer_desc_p->timestamp;
+        rx_packet_p->timestamp_flags = NET_PACKET_TIMESTAMP_VALID;
+        NET_RX_PACKET_LATENCY_BEGIN(rx_packet_p);
+    }
+
+#   if 0
+    DEBUG_PRINTF("Ethernet MAC: Received packet %#x (type %#x, state_flags %#x)\n",
+                 rx_packet_p, last_buffer_desc_p->protocol_type, rx_packet_p->state_flags);
+#   endif
+
+    return rx_packet_p;
+}
+
+
+/**
+ * Updates the high-water mark of received frames found in the Rx ring
+ * in one pass
+ */
+static inline void
+ethernet_mac_update_rx_received_high_water_mark(
+    struct ethernet_mac_device_var *mac_var_p,
+    uint16_t entries_received)
+{
+    if (entries_received > mac_var_p->rx_ring_entries_received_high_water_mark) {
+        mac_var_p->rx_ring_entries_received_high_water_mark = entries_received;
+    }
+}
+
+
+/**
+ * Remove Rx buffer descriptors from the Rx ring, for those network packets
+ * that have already been received, and enqueue those packets at the corresponding
+ * layer2 end point's Rx packet queue, as a single chain.
+ */
+RAM_FUNC static void ethernet_mac_drain_rx_ring(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    struct network_packet *head_packet_p = NULL;
+    struct network_packet *tail_packet_p = NULL;
+    uint16_t entries_received = 0;
+    PERF_PROBE_BEGIN(PERF_PROBE_ENET_RX_RING_DRAIN);
+
+    for ( ; ; ) {
+        struct network_packet *rx_packet_p =
+            ethernet_mac_remove_rx_packet(ethernet_mac_p);
+
+        if (rx_packet_p == NULL) {
+            break;
+        }
+
+        D_ASSERT(NET_PACKET_NOT_IN_QUEUE(rx_packet_p));
+        if (tail_packet_p == NULL) {
+            head_packet_p = rx_packet_p;
+        } else {
+            tail_packet_p->next_p = rx_packet_p;
+        }
+
+        tail_packet_p = rx_packet_p;
+        entries_received ++;
+    }
+
+    if (entries_received != 0) {
+        /*
+         * Enqueue received packets at the corresponding layer-2 end point:
+         */
+        net_layer2_enqueue_rx_packet_chain(mac_var_p->layer2_end_point_p,
+                                           head_packet_p, tail_packet_p,
+                                           entries_received);
+    }
+
+    ethernet_mac_update_rx_received_high_water_mark(mac_var_p, entries_received);
+    PERF_PROBE_END(PERF_PROBE_ENET_RX_RING_DRAIN);
+}
+
+
+/**
+ * Assigns an Rx packet to the next available Rx descriptor in the Rx ring and
+ * marks that descriptor as "empty". The caller is responsible for
+ * re-activating the Rx descriptor ring.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_post_rx_packet(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct network_packet *rx_packet_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+    D_ASSERT(mac_var_p->rx_ring_entries_filled < ethernet_mac_p->rx_ring_num_entries);
+
+    volatile struct ethernet_rx_buffer_descriptor *rx_buf_desc_p =
+        mac_var_p->rx_ring_write_cursor;
+
+    D_ASSERT((rx_buf_desc_p->control & ENET_RX_BD_EMPTY_MASK) == 0);
+    D_ASSERT(rx_buf_desc_p->data_buffer == NULL);
+    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+    D_ASSERT(rx_packet_p->data_buffer_size == NET_PACKET_DATA_BUFFER_SIZE);
+    rx_buf_desc_p->data_buffer = rx_packet_p->data_buffer;
+    rx_packet_p->rx_buf_desc_p = rx_buf_desc_p;
+    mac_var_p->rx_ring_packets[rx_buf_desc_p -
+                               &mac_var_p->rx_buffer_descriptors[0]] = rx_packet_p;
+    rx_buf_desc_p->control_extend1 |= ENET_RX_BD_GENERATE_INTERRUPT_MASK;
+
+    D_ASSERT(!(rx_packet_p->state_flags & NET_PACKET_IN_RX_TRANSIT));
+
+    rx_packet_p->state_flags = NET_PACKET_IN_RX_TRANSIT;
+
+    /*
+     * Mark buffer descriptor as "ready for reception":
+     */
+    rx_buf_desc_p->control |= ENET_RX_BD_EMPTY_MASK;
+
+    /*
+     * Advance Rx ring write cursor:
+     */
+    if (rx_buf_desc_p->control & ENET_RX_BD_WRAP_MASK) {
+        mac_var_p->rx_ring_write_cursor = mac_var_p->rx_buffer_descriptors;
+    } else {
+        mac_var_p->rx_ring_write_cursor ++;
+    }
+
+    mac_var_p->rx_ring_entries_filled ++;
+}
+
+
+/**
+ * Refills the Rx ring with Rx packets from the shared Rx packet pool, so that
+ * the Ethernet MAC does not run out of empty Rx buffers while the received
+ * frames are being processed by upper layers.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return true, if at least one Rx descriptor was posted
+ * @return false, otherwise
+ */
+RAM_FUNC static bool ethernet_mac_refill_rx_ring(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    bool refilled = false;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+
+    while (mac_var_p->rx_ring_entries_filled < ethernet_mac_p->rx_ring_num_entries) {
+        struct network_packet *rx_packet_p =
+            net_layer2_take_rx_packet(mac_var_p->layer2_end_point_p);
+
+        if (rx_packet_p == NULL) {
+            break;
+        }
+
+        rx_packet_p->state_flags = 0;
+        ethernet_mac_post_rx_packet(ethernet_mac_p, rx_packet_p);
+        refilled = true;
+    }
+
+    if (mac_var_p->rx_ring_entries_filled == 0) {
+        mac_var_p->rx_ring_starved_count ++;
+    }
+
+    /*
+     * If the receiver tasks are falling behind, have the link partner back
+     * off, instead of letting the MAC drop frames for lack of Rx buffers.
+     * One PAUSE frame is sent each time the Rx ring drops below the
+     * threshold; the link partner resumes when its duration expires:
+     */
+    if (mac_var_p->rx_ring_entries_filled < ETHERNET_MAC_RX_RING_XOFF_THRESHOLD) {
+        if (mac_var_p->flow_control_on && !mac_var_p->rx_ring_xoff_sent) {
+            ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+            uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->TCR);
+
+            WRITE_MMIO_REGISTER(&mac_regs_p->TCR, reg_value | ENET_TCR_TFC_PAUSE_MASK);
+            mac_var_p->rx_ring_xoff_sent = true;
+            mac_var_p->rx_ring_xoff_count ++;
+        }
+    } else {
+        mac_var_p->rx_ring_xoff_sent = false;
+    }
+
+    return refilled;
+}
+
+
+/**
+ * Receive completion interrupt handler
+ */
+RAM_FUNC static void ethernet_mac_rx_irq_handler(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    for ( ; ; ) {
+        uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIR);
+
+        if ((reg_value & ENET_EIR_RXF_MASK) == 0) {
+            break;
+        }
+
+        /*
+         * Clear interrupt source (w1c):
+         */
+        WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_RXF_MASK);
+
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        if (mac_var_p->rx_mode == ETHERNET_MAC_RX_POLLED_MODE) {
+            /*
+             * Mask the Rx interrupt and let the layer-2 packet receiver
+             * task drain the Rx ring. The Rx interrupt is unmasked again
+             * by ethernet_mac_poll_rx(), once the Rx ring is empty:
+             */
+            reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIMR);
+            reg_value &= ~ENET_EIMR_RXF_MASK;
+            WRITE_MMIO_REGISTER(&mac_regs_p->EIMR, reg_value);
+            restore_cpu_interrupts(int_mask);
+
+            net_layer2_rx_poll_wakeup(mac_var_p->layer2_end_point_p);
+            break;
+        }
+
+        D_ASSERT(mac_var_p->rx_ring_entries_filled <=
+                 ethernet_mac_p->rx_ring_num_entries);
+        D_ASSERT(mac_var_p->rx_ring_read_cursor != NULL);
+        if (mac_var_p->rx_ring_entries_filled == 0) {
+            restore_cpu_interrupts(int_mask);
+            break;
+        }
+
+        ethernet_mac_drain_rx_ring(ethernet_mac_p);
+        bool refilled = ethernet_mac_refill_rx_ring(ethernet_mac_p);
+        restore_cpu_interrupts(int_mask);
+
+        if (refilled) {
+            /*
+             * Re-activate Rx buffer descriptor ring:
+             */
+            __DSB();
+            WRITE_MMIO_REGISTER(&mac_regs_p->RDAR, ENET_RDAR_RDAR_MASK);
+        }
+    }
+}
+
+
+/**
+ * ISR for the Ethernet MAC0's Rx interrupt
+ */
+RAM_FUNC void ethernet_mac0_rx_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    ethernet_mac_rx_irq_handler(&g_ethernet_macs[0]);
+    rtos_exit_isr();
+}
+
+
+/**
+ * Error and MII (MDIO transfer completion) interrupt handler
+ */
+static void ethernet_mac_error_irq_handler(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIR);
+
+    if ((reg_value & ENET_EIR_MII_MASK) != 0 &&
+        (READ_MMIO_REGISTER(&mac_regs_p->EIMR) & ENET_EIMR_MII_MASK) != 0) {
+        /*
+         * An MDIO transfer to the PHY has completed. Clear interrupt source
+         * (w1c):
+         */
+        WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_MII_MASK);
+        ethernet_phy_mdio_irq_handler(ethernet_mac_p->ethernet_phy_p);
+    }
+
+    uint32_t error_interrupt_mask = (reg_value &
+                                     (ENET_EIMR_BABR_MASK |
+                                      ENET_EIMR_BABT_MASK |
+                                      ENET_EIMR_EBERR_MASK |
+                                      ENET_EIMR_UN_MASK |
+                                      ENET_EIMR_PLR_MASK));
+
+    if (error_interrupt_mask != 0) {
+        net_layer2_count_drop(NET_LAYER2_DROP_MAC_ERROR_INTERRUPT);
+
+        /*
+         * Clear interrupt source (w1c):
+         */
+        WRITE_MMIO_REGISTER(&mac_regs_p->EIR, error_interrupt_mask);
+        mac_var_p->tx_rx_error_count ++;
+    }
+}
+
+
+/**
+ * ISR for the Ethernet MAC0's error interrupt
+ */
+void ethernet_mac0_error_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    ethernet_mac_error_irq_handler(&g_ethernet_macs[0]);
+    rtos_exit_isr();
+}
+
+
+/**
+ * In ETHERNET_MAC_TX_LAZY_RECLAIM_MODE, reclaims the Tx buffer descriptors of
+ * frames already transmitted, as most frames do not generate a Tx interrupt
+ * in that mode.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_lazy_reclaim_tx_ring(
+    const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    if (mac_var_p->tx_mode == ETHERNET_MAC_TX_LAZY_RECLAIM_MODE &&
+        mac_var_p->tx_ring_entries_filled != 0) {
+        ethernet_mac_drain_tx_ring(ethernet_mac_p);
+    }
+}
+
+
+/**
+ * Tells if a frame that takes a given number of Tx buffer descriptors can be
+ * queued in the Tx ring. Enough free Tx buffer descriptors are always kept to
+ * queue every Tx packet not yet queued in the ring, using one Tx buffer
+ * descriptor for each, so that ethernet_mac_start_xmit() never finds the Tx
+ * ring full.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static bool ethernet_mac_tx_ring_has_room(
+    const struct ethernet_mac_device *ethernet_mac_p,
+    uint_fast8_t num_buffer_descs)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    uint_fast16_t free_entries = ethernet_mac_p->tx_ring_num_entries -
+                                 mac_var_p->tx_ring_entries_filled;
+    uint_fast16_t reserved_entries = NET_MAX_TX_PACKETS -
+                                     (mac_var_p->tx_ring_frames_filled + 1);
+
+    D_ASSERT(mac_var_p->tx_ring_frames_filled < NET_MAX_TX_PACKETS);
+    return free_entries >= num_buffer_descs + reserved_entries;
+}
+
+
+/**
+ * Fills the Tx buffer descriptor at the Tx ring write cursor and advances
+ * the cursor.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return pointer to the Tx buffer descriptor filled
+ */
+static volatile struct ethernet_tx_buffer_descriptor *
+ethernet_mac_fill_tx_buffer_descriptor(
+    const struct ethernet_mac_device *ethernet_mac_p,
+    const void *data_p,
+    uint16_t data_length,
+    bool last_in_frame)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(mac_var_p->tx_ring_entries_filled < ethernet_mac_p->tx_ring_num_entries);
+    D_ASSERT(mac_var_p->tx_ring_write_cursor != mac_var_p->tx_ring_read_cursor ||
+             mac_var_p->tx_ring_entries_filled == 0);
+    D_ASSERT(data_length != 0);
+
+    volatile struct ethernet_tx_buffer_descriptor *tx_buf_desc_p =
+        mac_var_p->tx_ring_write_cursor;
+
+    D_ASSERT((tx_buf_desc_p->control & ENET_TX_BD_READY_MASK) == 0);
+    D_ASSERT(tx_buf_desc_p->data_buffer == NULL);
+
+    /*
+     * NOTE: The MAC's DMA engine only reads from the data buffer
+     */
+    tx_buf_desc_p->data_buffer = (void *)data_p;
+    tx_buf_desc_p->data_length = data_length;
+    tx_buf_desc_p->control_extend1 &= ~(ENET_TX_BD_INTERRUPT_MASK |
+                                        ENET_TX_BD_TIMESTAMP_MASK);
+    if (last_in_frame) {
+        tx_buf_desc_p->control |= (ENET_TX_BD_LAST_IN_FRAME_MASK |
+                                   ENET_TX_BD_CRC_MASK);
+    } else {
+        tx_buf_desc_p->control &= ~(ENET_TX_BD_LAST_IN_FRAME_MASK |
+                                    ENET_TX_BD_CRC_MASK);
+    }
+
+    /*
+     * Advance Tx ring write cursor:
+     */
+    if (tx_buf_desc_p->control & ENET_TX_BD_WRAP_MASK) {
+        mac_var_p->tx_ring_write_cursor = mac_var_p->tx_buffer_descriptors;
+    } else {
+        mac_var_p->tx_ring_write_cursor ++;
+    }
+
+    mac_var_p->tx_ring_entries_filled ++;
+    return tx_buf_desc_p;
+}
+
+
+/**
+ * Queues a Tx packet, followed by the given payload fragments, in the
+ * Tx ring, marking its Tx descriptors as "ready".
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_queue_tx_frame(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct network_packet *tx_packet_p,
+                                        const struct ethernet_tx_fragment fragments[],
+                                        uint_fast8_t num_fragments)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    volatile struct ethernet_tx_buffer_descriptor *last_tx_buf_desc_p;
+
+    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
+    D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_USE_BY_APP);
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
+    D_ASSERT(tx_packet_p->total_length <= tx_packet_p->data_buffer_size);
+
+    volatile struct ethernet_tx_buffer_descriptor *first_tx_buf_desc_p =
+        ethernet_mac_fill_tx_buffer_descriptor(ethernet_mac_p,
+                                               tx_packet_p->data_buffer,
+                                               tx_packet_p->total_length,
+                                               num_fragments == 0);
+
+    last_tx_buf_desc_p = first_tx_buf_desc_p;
+    for (uint_fast8_t i = 0; i < num_fragments; i ++) {
+        last_tx_buf_desc_p =
+            ethernet_mac_fill_tx_buffer_descriptor(ethernet_mac_p,
+                                                   fragments[i].data_p,
+                                                   fragments[i].length,
+                                                   i == num_fragments - 1);
+
+        /*
+         * Mark buffer descriptor as "ready for transmission".
+         * The MAC does not start transmitting the frame until its first
+         * buffer descriptor is marked "ready" as well.
+         */
+        last_tx_buf_desc_p->control |= ENET_TX_BD_READY_MASK;
+    }
+
+    /*
+     * Decide if the MAC is to generate a Tx interrupt when this frame
+     * has been transmitted:
+     */
+    if (mac_var_p->tx_mode == ETHERNET_MAC_TX_LAZY_RECLAIM_MODE) {
+        mac_var_p->tx_frames_since_last_interrupt ++;
+        if (mac_var_p->tx_frames_since_last_interrupt ==
+                ETHERNET_MAC_TX_LAZY_RECLAIM_INTERRUPT_INTERVAL ||
+            (tx_packet_p->state_flags & NET_PACKET_TX_INTERRUPT_REQUESTED)) {
+            last_tx_buf_desc_p->control_extend1 |= ENET_TX_BD_INTERRUPT_MASK;
+            mac_var_p->tx_frames_since_last_interrupt = 0;
+        }
+    } else {
+        last_tx_buf_desc_p->control_extend1 |= ENET_TX_BD_INTERRUPT_MASK;
+    }
+
+    if (tx_packet_p->state_flags & NET_PACKET_TX_INTERRUPT_REQUESTED) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_TX_INTERRUPT_REQUESTED);
+    }
+
+    if (tx_packet_p->timestamp_flags & NET_PACKET_TX_TIMESTAMP_REQUESTED) {
+        last_tx_buf_desc_p->control_extend1 |= ENET_TX_BD_TIMESTAMP_MASK;
+    }
+
+    tx_packet_p->tx_buf_desc_p = first_tx_buf_desc_p;
+    NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+    mac_var_p->tx_ring_packets[last_tx_buf_desc_p -
+                               &mac_var_p->tx_buffer_descriptors[0]] = tx_packet_p;
+
+    mac_var_p->tx_ring_frames_filled ++;
+    if (mac_var_p->tx_ring_entries_filled >
+        mac_var_p->tx_ring_entries_filled_high_water_mark) {
+        mac_var_p->tx_ring_entries_filled_high_water_mark =
+            mac_var_p->tx_ring_entries_filled;
+    }
+
+    /*
+     * Mark the first buffer descriptor of the frame as "ready for
+     * transmission", after all the other ones:
+     */
+    __DMB();
+    first_tx_buf_desc_p->control |= ENET_TX_BD_READY_MASK;
+}
+
+
+/**
+ * Initiates the transmission of a Tx packet, by assigning it to the next
+ * available Tx descriptor in the Tx descriptor ring, marking that descriptor
+ * as "ready" and re-activating the Tx descriptor ring.
+ */
+void ethernet_mac_start_xmit(const struct ethernet_mac_device *ethernet_mac_p,
+                             struct network_packet *tx_packet_p)
+{
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->total_length != 0);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#    endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    D_ASSERT(ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1));
+    ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p, NULL, 0);
+
+    restore_cpu_interrupts(int_mask);
+
+    /*
+     * Re-activate Tx buffer descriptor ring, to start transmitting the frame:
+     * (the Tx descriptor ring has at least one descriptor with the "ready"
+     *  bit set in its control field)
+     */
+    __DSB();
+    WRITE_MMIO_REGISTER(&mac_regs_p->TDAR, ENET_TDAR_TDAR_MASK);
+
+#   if 0
+    if (!ethernet_phy_link_is_up(ethernet_mac_p->ethernet_phy_p)) {
+        DEBUG_PRINTF("Ethernet MAC: link down for MAC %s\n", ethernet_mac_p->name_p);
+    }
+#   endif
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Initiates the transmission of a batch of Tx packets, by assigning each of
+ * them to the next available Tx descriptor in the Tx descriptor ring, within
+ * a single critical section, and then re-activating the Tx descriptor ring
+ * only once for the whole batch.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ * @param tx_packets: array of Tx packets to transmit, in order
+ * @param num_packets: number of entries in tx_packets[]
+ */
+void ethernet_mac_start_xmit_batch(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *tx_packets[],
+                                   uint_fast8_t num_packets)
+{
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(num_packets != 0 && num_packets <= NET_MAX_TX_PACKETS);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#    endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    for (uint_fast8_t i = 0; i < num_packets; i ++) {
+        struct network_packet *tx_packet_p = tx_packets[i];
+
+        D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+        D_ASSERT(tx_packet_p->total_length != 0);
+        D_ASSERT(ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1));
+        ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p, NULL, 0);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    /*
+     * Re-activate Tx buffer descriptor ring, to start transmitting the
+     * frames:
+     */
+    __DSB();
+    WRITE_MMIO_REGISTER(&mac_regs_p->TDAR, ENET_TDAR_TDAR_MASK);
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Initiates the transmission of a frame made of the data in a Tx packet's
+ * data buffer (Ethernet header and any other protocol headers), followed
+ * by one or more payload fragments that are not copied to the Tx packet.
+ * Each payload fragment takes its own Tx buffer descriptor in the Tx ring.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ * @param tx_packet_p: Tx packet. Its total_length field contains only the
+ *                     length of the data in its data buffer.
+ * @param fragments: payload fragments to be transmitted after the data in
+ *                   the Tx packet's data buffer. This array can be reused
+ *                   as soon as this function returns, but the fragments'
+ *                   data buffers must not be modified until the Tx packet
+ *                   has been transmitted.
+ * @param num_fragments: number of entries in fragments[]
+ *
+ * @return 0, on success
+ * @return error code, if there are not enough free entries in the Tx ring
+ *         at this time
+ */
+error_t ethernet_mac_start_xmit_gather(const struct ethernet_mac_device *ethernet_mac_p,
+                                       struct network_packet *tx_packet_p,
+                                       const struct ethernet_tx_fragment fragments[],
+                                       uint_fast8_t num_fragments)
+{
+    error_t error = 0;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->total_length != 0);
+    D_ASSERT(num_fragments <= ETHERNET_MAC_MAX_TX_FRAGMENTS);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#    endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    if (ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1 + num_fragments)) {
+        ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p,
+                                    fragments, num_fragments);
+    } else {
+        error = CAPTURE_ERROR("Ethernet MAC Tx ring full", ethernet_mac_p,
+                              num_fragments);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    if (error == 0) {
+        /*
+         * Re-activate Tx buffer descriptor ring, to start transmitting the
+         * frame:
+         */
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->TDAR, ENET_TDAR_TDAR_MASK);
+    }
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Reclaims the Tx buffer descriptors of all the frames that have already
+ * been transmitted, returning to the Tx packet pool those Tx packets that
+ * were to be freed after transmission. This is only needed in
+ * ETHERNET_MAC_TX_LAZY_RECLAIM_MODE.
+ */
+void ethernet_mac_reclaim_tx_packets(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#    endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (mac_var_p->tx_ring_entries_filled != 0) {
+        ethernet_mac_drain_tx_ring(ethernet_mac_p);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Returns the number of frames queued in the Ethernet MAC's Tx ring that
+ * have not been reclaimed yet. In ETHERNET_MAC_TX_LAZY_RECLAIM_MODE, the Tx
+ * buffer descriptors of frames already transmitted are reclaimed first.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ *
+ * @return number of frames in the Tx ring
+ */
+uint_fast16_t ethernet_mac_get_tx_ring_frames(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    uint_fast16_t num_frames;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    num_frames = mac_var_p->tx_ring_frames_filled;
+    restore_cpu_interrupts(int_mask);
+    return num_frames;
+}
+
+
+/**
+ * Re-post the given Rx packet to the Ethernet MAC's Rx ring, by assigning it to
+ * the next available Rx descriptor in the Rx descriptor ring, marking that
+ * descriptor as "empty" and re-activating the Rx descriptor ring. If the Rx
+ * ring is already fully posted, the Rx packet is given back to the shared Rx
+ * packet pool instead.
+ */
+void ethernet_mac_repost_rx_packet(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *rx_packet_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP ||
+             rx_packet_p->state_flags == NET_PACKET_RX_FAILED);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#   endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (mac_var_p->rx_ring_entries_filled == ethernet_mac_p->rx_ring_num_entries) {
+        D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+        net_layer2_give_rx_packet(rx_packet_p);
+        restore_cpu_interrupts(int_mask);
+    } else {
+        ethernet_mac_post_rx_packet(ethernet_mac_p, rx_packet_p);
+        restore_cpu_interrupts(int_mask);
+
+        /*
+         * Re-activate Rx buffer descriptor ring:
+         * (the Rx descriptor ring has at least one descriptor with the "empty"
+         *  bit set in its control field)
+         */
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->RDAR, ENET_RDAR_RDAR_MASK);
+    }
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+}
+
+
+/**
+ * Removes up to 'budget' received frames from the Rx ring of an Ethernet MAC
+ * operating in polled Rx mode. If the Rx ring is found empty before the
+ * budget is exhausted, the Rx interrupt is unmasked, so that the next
+ * received frame wakes up the caller again.
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param rx_packets        Array where the received Rx packets are returned
+ * @param budget            Maximum number of Rx packets to return (size of
+ *                          the 'rx_packets' array)
+ *
+ * @return number of Rx packets returned in 'rx_packets'. If this number is
+ *         less than 'budget', the Rx ring has been drained and the Rx
+ *         interrupt has been re-enabled.
+ */
+uint_fast16_t ethernet_mac_poll_rx(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *rx_packets[],
+                                   uint_fast16_t budget)
+{
+    uint32_t reg_value;
+    uint_fast16_t num_received = 0;
+    bool refilled = false;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(budget != 0);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(mac_var_p->rx_mode == ETHERNET_MAC_RX_POLLED_MODE);
+
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#   endif
+
+    /*
+     * Clear any stale Rx interrupt source (w1c), so that only frames received
+     * after this point can trigger a new Rx interrupt once it is unmasked:
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_RXF_MASK);
+
+    while (num_received < budget) {
+        /*
+         * Interrupts are disabled for one frame at a time only, to keep
+         * interrupt latency low while the Rx ring is being drained:
+         */
+        uint32_t int_mask = disable_cpu_interrupts();
+        struct network_packet *rx_packet_p =
+            ethernet_mac_remove_rx_packet(ethernet_mac_p);
+
+        if (rx_packet_p != NULL) {
+            refilled |= ethernet_mac_refill_rx_ring(ethernet_mac_p);
+        }
+
+        restore_cpu_interrupts(int_mask);
+        if (rx_packet_p == NULL) {
+            break;
+        }
+
+        rx_packets[num_received] = rx_packet_p;
+        num_received ++;
+    }
+
+    if (refilled) {
+        /*
+         * Re-activate Rx buffer descriptor ring:
+         */
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->RDAR, ENET_RDAR_RDAR_MASK);
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_update_rx_received_high_water_mark(mac_var_p, num_received);
+    if (num_received < budget) {
+        /*
+         * The Rx ring is empty. Unmask the Rx interrupt. If a frame was
+         * received after the last check, the RXF bit is already set in EIR,
+         * so the Rx interrupt will fire right away:
+         */
+        reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIMR);
+        reg_value |= ENET_EIMR_RXF_MASK;
+        WRITE_MMIO_REGISTER(&mac_regs_p->EIMR, reg_value);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+
+    return num_received;
+}
+
+
+/**
+ * Obtains a snapshot of the occupancy statistics of the Tx/Rx rings
+ * of the given Ethernet MAC
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param ring_stats_p      Area where the ring statistics are to be returned
+ */
+void ethernet_mac_get_ring_stats(const struct ethernet_mac_device *ethernet_mac_p,
+                                 struct ethernet_mac_ring_stats *ring_stats_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(mac_var_p->initialized);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ring_stats_p->tx_ring_num_entries = ethernet_mac_p->tx_ring_num_entries;
+    ring_stats_p->tx_ring_entries_filled = mac_var_p->tx_ring_entries_filled;
+    ring_stats_p->tx_ring_entries_filled_high_water_mark =
+        mac_var_p->tx_ring_entries_filled_high_water_mark;
+    ring_stats_p->rx_ring_num_entries = ethernet_mac_p->rx_ring_num_entries;
+    ring_stats_p->rx_ring_entries_filled = mac_var_p->rx_ring_entries_filled;
+    ring_stats_p->rx_ring_entries_received_high_water_mark =
+        mac_var_p->rx_ring_entries_received_high_water_mark;
+    ring_stats_p->rx_ring_starved_count = mac_var_p->rx_ring_starved_count;
+    ring_stats_p->rx_ring_xoff_count = mac_var_p->rx_ring_xoff_count;
+    ring_stats_p->tx_launch_queue_length = mac_var_p->tx_launch_queue_length;
+    ring_stats_p->tx_launched_count = mac_var_p->tx_launched_count;
+    ring_stats_p->tx_launch_late_count = mac_var_p->tx_launch_late_count;
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Latches the current value of the IEEE 1588 timer into ATVR and reads it.
+ *
+ * NOTE: This function must be called with interrupts disabled.
  */
-static void ethernet_mac_tx_irq_handler(const struct ethernet_mac_device *ethernet_mac_p)
+static uint32_t ethernet_mac_capture_ieee_1588_time(ENET_Type *mac_regs_p)
 {
-    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->ATCR);
 
-    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
-    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    WRITE_MMIO_REGISTER(&mac_regs_p->ATCR, reg_value | ENET_ATCR_CAPTURE_MASK);
 
-    for ( ; ; ) {
-        uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIR);
+    /*
+     * The capture takes a few cycles of the timer clock to complete:
+     */
+    for (unsigned int i = 0; i < ETHERNET_MAC_IEEE_1588_CAPTURE_DELAY_COUNT; i ++) {
+        __NOP();
+    }
 
-        if ((reg_value & ENET_EIR_TXF_MASK) == 0) {
-            break;
-        }
+    return READ_MMIO_REGISTER(&mac_regs_p->ATVR);
+}
 
-        /*
-         * Clear interrupt source (w1c):
-         */
-        WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_TXF_MASK);
 
-        uint32_t int_mask = disable_cpu_interrupts();
+/**
+ * Arms the output compare of the Tx launch channel of the IEEE 1588 timer
+ * to match at a given timer value, or disables it. Either way, the
+ * channel's pending compare flag is cleared.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_arm_tx_launch_timer(ENET_Type *mac_regs_p,
+                                             bool enable,
+                                             uint32_t compare_time_ns)
+{
+    uint32_t reg_value;
+    volatile uint32_t *const tcsr_p =
+        &mac_regs_p->CHANNEL[ETHERNET_MAC_TX_LAUNCH_TIMER_CHANNEL].TCSR;
 
-        D_ASSERT(mac_var_p->tx_ring_entries_filled <= NET_MAX_TX_PACKETS);
-        D_ASSERT(mac_var_p->tx_ring_read_cursor != NULL);
+    /*
+     * The compare value can only be changed while the channel is disabled.
+     * Disabling the channel also clears its compare flag (w1c):
+     */
+    WRITE_MMIO_REGISTER(tcsr_p, ENET_TCSR_TF_MASK);
+    if (!enable) {
+        return;
+    }
 
-        if (mac_var_p->tx_ring_entries_filled == 0) {
-            restore_cpu_interrupts(int_mask);
-            break;
-        }
+    WRITE_MMIO_REGISTER(
+        &mac_regs_p->CHANNEL[ETHERNET_MAC_TX_LAUNCH_TIMER_CHANNEL].TCCR,
+        compare_time_ns);
 
-        ethernet_mac_drain_tx_ring(mac_var_p);
-        restore_cpu_interrupts(int_mask);
-    }
+    reg_value = ENET_TCSR_TIE_MASK;
+    SET_BIT_FIELD(reg_value, ENET_TCSR_TMODE_MASK, ENET_TCSR_TMODE_SHIFT,
+                  ETHERNET_MAC_TCSR_TMODE_OUTPUT_COMPARE_SW_ONLY);
+    WRITE_MMIO_REGISTER(tcsr_p, reg_value);
 }
 
 
 /**
- * ISR for the Ethernet MAC0's Tx interrupt
+ * Calculates how far ahead in the future a launch time is, in nanoseconds.
+ * Launch times that have already passed are reported as 0.
  */
-void ethernet_mac0_tx_irq_handler(void)
+static uint32_t ethernet_mac_get_tx_launch_lead_ns(uint32_t now_ns,
+                                                   uint32_t launch_time_ns)
 {
-    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+    uint32_t lead_ns = ETHERNET_MAC_IEEE_1588_TIME_DELTA_NS(now_ns, launch_time_ns);
 
-    rtos_enter_isr();
-    ethernet_mac_tx_irq_handler(&g_ethernet_mac0);
-    rtos_exit_isr();
+    return lead_ns <= ETHERNET_MAC_TX_LAUNCH_MAX_LEAD_NS ? lead_ns : 0;
 }
 
 
 /**
- * Remove Rx buffer descriptors from the Rx ring, for those network packets
- * that have already been received, and enqueue those packets at the corresponding
- * layer2 end point's Rx packet queue.
+ * Queues in the Tx ring the launch-time Tx frames whose launch time is less
+ * than ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS ahead, and arms the Tx launch
+ * channel of the IEEE 1588 timer for the next frame due, if any.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return true, if any frame was queued in the Tx ring
  */
-static void ethernet_mac_drain_rx_ring(struct ethernet_mac_device_var *mac_var_p)
+static bool ethernet_mac_release_tx_launch_frames(
+    const struct ethernet_mac_device *ethernet_mac_p)
 {
-    volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p =
-        mac_var_p->rx_ring_read_cursor;
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    bool frames_released = false;
 
-    do {
-        D_ASSERT(buffer_desc_p >= &mac_var_p->rx_buffer_descriptors[0] &&
-                 buffer_desc_p <=
-                   &mac_var_p->rx_buffer_descriptors[NET_MAX_RX_PACKETS - 1]);
+    for ( ; ; ) {
+        uint_fast8_t num_due = 0;
+        uint32_t now_ns = ethernet_mac_capture_ieee_1588_time(mac_regs_p);
+
+        while (num_due < mac_var_p->tx_launch_queue_length) {
+            struct network_packet *tx_packet_p =
+                mac_var_p->tx_launch_queue[num_due];
+            uint32_t lead_ns =
+                ethernet_mac_get_tx_launch_lead_ns(now_ns,
+                                                   tx_packet_p->tx_launch_time);
+
+            if (lead_ns > ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS) {
+                break;
+            }
+
+            if (!frames_released) {
+                ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+                frames_released = true;
+            }
+
+            if (lead_ns == 0) {
+                mac_var_p->tx_launch_late_count ++;
+            }
+
+            NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+            D_ASSERT(ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1));
+            ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p, NULL, 0);
+            mac_var_p->tx_launched_count ++;
+            num_due ++;
+        }
 
-        D_ASSERT(buffer_desc_p != mac_var_p->rx_ring_write_cursor ||
-                 mac_var_p->rx_ring_entries_filled == NET_MAX_RX_PACKETS);
+        if (num_due != 0) {
+            mac_var_p->tx_launch_queue_length -= num_due;
+            memmove(&mac_var_p->tx_launch_queue[0],
+                    &mac_var_p->tx_launch_queue[num_due],
+                    mac_var_p->tx_launch_queue_length *
+                        sizeof mac_var_p->tx_launch_queue[0]);
+        }
 
-        if (buffer_desc_p->control & ENET_RX_BD_EMPTY_MASK) {
+        if (mac_var_p->tx_launch_queue_length == 0) {
+            ethernet_mac_arm_tx_launch_timer(mac_regs_p, false, 0);
             break;
         }
 
-        D_ASSERT(buffer_desc_p->control & ENET_RX_BD_LAST_IN_FRAME_MASK);
-
-        struct network_packet *rx_packet_p =
-            BUFFER_TO_NETWORK_PACKET(buffer_desc_p->data_buffer);
-
-        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
-        D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_TRANSIT);
-        D_ASSERT(!(rx_packet_p->state_flags & NET_PACKET_IN_RX_USE_BY_APP));
+        uint32_t next_launch_time_ns = mac_var_p->tx_launch_queue[0]->tx_launch_time;
+        uint32_t compare_time_ns =
+            next_launch_time_ns >= ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS ?
+                next_launch_time_ns - ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS :
+                next_launch_time_ns + ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS -
+                    ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS;
 
-        rx_packet_p->state_flags &= ~NET_PACKET_IN_RX_TRANSIT;
-        rx_packet_p->rx_buf_desc_p = NULL;
-        buffer_desc_p->data_buffer = NULL;
-        buffer_desc_p->control_extend1 &= ~ENET_RX_BD_GENERATE_INTERRUPT_MASK;
-        if (buffer_desc_p->control &
-            (ENET_RX_BD_LENGTH_VIOLATION_MASK |
-             ENET_RX_BD_NON_OCTET_ALIGNED_FRAME_MASK |
-             ENET_RX_BD_CRC_ERROR_MASK |
-             ENET_RX_BD_FIFO_OVERRRUN_MASK |
-             ENET_RX_BD_FRAME_TRUNCATED_MASK)) {
-            ERROR_PRINTF("Received bad frame (Rx packet dropped): "
-                          "control: %#x, buffer_desc: %#x\n",
-                          buffer_desc_p->control, buffer_desc_p);
-
-            rx_packet_p->state_flags = NET_PACKET_RX_FAILED;
-        } else {
-            D_ASSERT(buffer_desc_p->data_length <= ETHERNET_MAX_FRAME_DATA_SIZE);
-            rx_packet_p->total_length = buffer_desc_p->data_length;
-        }
-
-#       if 0
-        DEBUG_PRINTF("Ethernet MAC: Received packet %#x (type %#x, state_flags %#x)\n",
-                     rx_packet_p, buffer_desc_p->protocol_type, rx_packet_p->state_flags);
-#       endif
+        ethernet_mac_arm_tx_launch_timer(mac_regs_p, true, compare_time_ns);
 
         /*
-         * Enqueue received packet at the corresponding layer-2 end point:
+         * If the compare time passed while the channel was being armed, the
+         * compare would not match until the timer wraps around, so check
+         * for due frames again:
          */
-        net_layer2_enqueue_rx_packet(mac_var_p->layer2_end_point_p, rx_packet_p);
-
-        if (buffer_desc_p->control & ENET_RX_BD_WRAP_MASK) {
-            buffer_desc_p = &mac_var_p->rx_buffer_descriptors[0];
-        } else {
-            buffer_desc_p ++;
+        now_ns = ethernet_mac_capture_ieee_1588_time(mac_regs_p);
+        if (ethernet_mac_get_tx_launch_lead_ns(now_ns, next_launch_time_ns) >
+            ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS) {
+            break;
         }
+    }
 
-        mac_var_p->rx_ring_entries_filled --;
-    } while (mac_var_p->rx_ring_entries_filled != 0);
-
-    mac_var_p->rx_ring_read_cursor = buffer_desc_p;
+    return frames_released;
 }
 
 
 /**
- * Receive completion interrupt handler
+ * Initiates the transmission of a Tx packet at a given time. The packet is
+ * kept in the MAC's Tx launch queue and it is only queued in the Tx ring
+ * ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS before its launch time, by the
+ * interrupt handler of the IEEE 1588 timer's output compare. As frames are
+ * released by an ISR, rather than gated by the MAC itself, they leave with
+ * the jitter of the interrupt latency (a few microseconds) and they can be
+ * delayed by frames already in the Tx ring.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ * @param tx_packet_p: Tx packet to transmit
+ * @param launch_time_ns: value of the MAC's IEEE 1588 timer at which the
+ *                        frame is to be transmitted. It must be at most
+ *                        ETHERNET_MAC_TX_LAUNCH_MAX_LEAD_NS ahead;
+ *                        otherwise, it is taken as a launch time that has
+ *                        already passed, and the frame is transmitted
+ *                        right away.
  */
-static void ethernet_mac_rx_irq_handler(const struct ethernet_mac_device *ethernet_mac_p)
+void ethernet_mac_start_xmit_at(const struct ethernet_mac_device *ethernet_mac_p,
+                                struct network_packet *tx_packet_p,
+                                uint32_t launch_time_ns)
 {
-    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
-
     struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
     ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    uint_fast8_t i;
 
-    for ( ; ; ) {
-        uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIR);
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->total_length != 0);
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
+    D_ASSERT(launch_time_ns < ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS);
 
-        if ((reg_value & ENET_EIR_RXF_MASK) == 0) {
-            break;
-        }
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#    endif
 
-        /*
-         * Clear interrupt source (w1c):
-         */
-        WRITE_MMIO_REGISTER(&mac_regs_p->EIR, ENET_EIR_RXF_MASK);
+    uint32_t int_mask = disable_cpu_interrupts();
 
-        uint32_t int_mask = disable_cpu_interrupts();
+    D_ASSERT(mac_var_p->tx_launch_queue_length <
+             ARRAY_SIZE(mac_var_p->tx_launch_queue));
 
-        D_ASSERT(mac_var_p->rx_ring_entries_filled <= NET_MAX_RX_PACKETS);
-        D_ASSERT(mac_var_p->rx_ring_read_cursor != NULL);
-        if (mac_var_p->rx_ring_entries_filled == 0) {
-            restore_cpu_interrupts(int_mask);
+    /*
+     * Insert the packet in the Tx launch queue, after the packets whose
+     * launch time is not later than its own:
+     */
+    uint32_t now_ns = ethernet_mac_capture_ieee_1588_time(mac_regs_p);
+    uint32_t lead_ns = ethernet_mac_get_tx_launch_lead_ns(now_ns, launch_time_ns);
+
+    for (i = mac_var_p->tx_launch_queue_length; i != 0; i --) {
+        struct network_packet *queued_packet_p = mac_var_p->tx_launch_queue[i - 1];
+
+        if (ethernet_mac_get_tx_launch_lead_ns(now_ns,
+                                               queued_packet_p->tx_launch_time) <=
+            lead_ns) {
             break;
         }
 
-        ethernet_mac_drain_rx_ring(mac_var_p);
-        restore_cpu_interrupts(int_mask);
+        mac_var_p->tx_launch_queue[i] = queued_packet_p;
     }
-}
 
+    tx_packet_p->tx_launch_time = launch_time_ns;
+    NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+    mac_var_p->tx_launch_queue[i] = tx_packet_p;
+    mac_var_p->tx_launch_queue_length ++;
 
-/**
- * ISR for the Ethernet MAC0's Rx interrupt
- */
-void ethernet_mac0_rx_irq_handler(void)
-{
-    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+    bool frames_released = ethernet_mac_release_tx_launch_frames(ethernet_mac_p);
 
-    rtos_enter_isr();
-    ethernet_mac_rx_irq_handler(&g_ethernet_mac0);
-    rtos_exit_isr();
+    restore_cpu_interrupts(int_mask);
+
+    if (frames_released) {
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->TDAR, ENET_TDAR_TDAR_MASK);
+    }
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
 }
 
 
 /**
- * Transmission error interrupt handler
+ * IEEE 1588 timer interrupt handler. The only timer event that generates
+ * interrupts is the output compare of the Tx launch channel.
  */
-static void ethernet_mac_error_irq_handler(const struct ethernet_mac_device *ethernet_mac_p)
+RAM_FUNC static void ethernet_mac_ieee_1588_timer_irq_handler(
+    const struct ethernet_mac_device *ethernet_mac_p)
 {
     D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
 
-    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
     ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
-    uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->EIR);
+    uint32_t int_mask = disable_cpu_interrupts();
 
-    uint32_t error_interrupt_mask = (reg_value &
-                                     (ENET_EIMR_BABR_MASK |
-                                      ENET_EIMR_BABT_MASK |
-                                      ENET_EIMR_EBERR_MASK |
-                                      ENET_EIMR_UN_MASK |
-                                      ENET_EIMR_PLR_MASK));
+    /*
+     * Re-arming the Tx launch channel clears the interrupt source:
+     */
+    bool frames_released = ethernet_mac_release_tx_launch_frames(ethernet_mac_p);
 
-    if (error_interrupt_mask != 0) {
-        ERROR_PRINTF("Ethernet MAC %s error (error interrupt mask: %#x)\n",
-                     ethernet_mac_p->name_p, error_interrupt_mask);
+    restore_cpu_interrupts(int_mask);
 
-        /*
-         * Clear interrupt source (w1c):
-         */
-        WRITE_MMIO_REGISTER(&mac_regs_p->EIR, error_interrupt_mask);
-        mac_var_p->tx_rx_error_count ++;
+    if (frames_released) {
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->TDAR, ENET_TDAR_TDAR_MASK);
     }
 }
 
 
 /**
- * ISR for the Ethernet MAC0's error interrupt
+ * ISR for the Ethernet MAC0's IEEE 1588 timer interrupt
  */
-void ethernet_mac0_error_irq_handler(void)
+RAM_FUNC void ethernet_mac0_ieee_1588_timer_irq_handler(void)
 {
     D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
 
     rtos_enter_isr();
-    ethernet_mac_error_irq_handler(&g_ethernet_mac0);
+    ethernet_mac_ieee_1588_timer_irq_handler(&g_ethernet_macs[0]);
     rtos_exit_isr();
 }
 
 
 /**
- * Initiates the transmission of a Tx packet, by assigning it to the next
- * available Tx descriptor in the Tx descriptor ring, marking that descriptor
- * as "ready" and re-activating the Tx descriptor ring.
+ * Reads the current value of the IEEE 1588 timer of the given Ethernet MAC
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ *
+ * @return current timer value in nanoseconds, in the same time base as the
+ *         hardware timestamps of Rx/Tx packets
  */
-void ethernet_mac_start_xmit(const struct ethernet_mac_device *ethernet_mac_p,
-                             struct network_packet *tx_packet_p)
+uint32_t ethernet_mac_get_ieee_1588_time(const struct ethernet_mac_device *ethernet_mac_p)
 {
-    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    uint32_t reg_value;
     ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
 
     D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
-    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
 
 #   ifdef USE_MPU
     bool caller_was_privileged = rtos_enter_privileged_mode();
@@ -1276,60 +3188,71 @@ void ethernet_mac_start_xmit(const struct ethernet_mac_device *ethernet_mac_p,
 
     uint32_t int_mask = disable_cpu_interrupts();
 
-    D_ASSERT(mac_var_p->tx_ring_entries_filled < NET_MAX_TX_PACKETS);
-    D_ASSERT(mac_var_p->tx_ring_write_cursor != mac_var_p->tx_ring_read_cursor ||
-             mac_var_p->tx_ring_entries_filled == 0);
+    reg_value = ethernet_mac_capture_ieee_1588_time(mac_regs_p);
 
-    volatile struct ethernet_tx_buffer_descriptor *tx_buf_desc_p =
-        mac_var_p->tx_ring_write_cursor;
+    restore_cpu_interrupts(int_mask);
 
-    D_ASSERT((tx_buf_desc_p->control & ENET_TX_BD_READY_MASK) == 0);
-    D_ASSERT(tx_buf_desc_p->data_buffer == NULL);
-    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
 
-    tx_buf_desc_p->data_buffer = tx_packet_p->data_buffer;
-    tx_packet_p->tx_buf_desc_p = tx_buf_desc_p;
+    return reg_value;
+}
 
-    D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_USE_BY_APP);
-    D_ASSERT(tx_packet_p->total_length != 0);
 
-    tx_buf_desc_p->data_length = tx_packet_p->total_length;
-    tx_buf_desc_p->control_extend1 |= ENET_TX_BD_INTERRUPT_MASK;
+/**
+ * Adjusts the IEEE 1588 timer of the given Ethernet MAC by a given offset,
+ * for example to synchronize it with the clock of another board.
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param offset_ns         Offset to add to the timer, in nanoseconds
+ *                          (it must be less than one timer period)
+ */
+void ethernet_mac_adjust_ieee_1588_time(const struct ethernet_mac_device *ethernet_mac_p,
+                                        int32_t offset_ns)
+{
+    uint32_t reg_value;
+    ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
 
-    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(offset_ns > -(int32_t)ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS &&
+             offset_ns < (int32_t)ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS);
 
-    tx_packet_p->state_flags |= NET_PACKET_IN_TX_TRANSIT;
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#    endif
 
-    /*
-     * Mark buffer descriptor as "ready for transmission":
-     */
-    tx_buf_desc_p->control |= ENET_TX_BD_READY_MASK;
+    uint32_t int_mask = disable_cpu_interrupts();
 
-    /*
-     * Advance Tx ring write cursor:
-     */
-    if (tx_buf_desc_p->control & ENET_TX_BD_WRAP_MASK) {
-        mac_var_p->tx_ring_write_cursor = mac_var_p->tx_buffer_descriptors;
-    } else {
-        mac_var_p->tx_ring_write_cursor ++;
+    int32_t new_time_ns =
+        (int32_t)ethernet_mac_capture_ieee_1588_time(mac_regs_p) + offset_ns;
+
+    if (new_time_ns < 0) {
+        new_time_ns += ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS;
+    } else if (new_time_ns >= (int32_t)ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS) {
+        new_time_ns -= ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS;
     }
 
-    mac_var_p->tx_ring_entries_filled ++;
-    restore_cpu_interrupts(int_mask);
+    WRITE_MMIO_REGISTER(&mac_regs_p->ATVR, (uint32_t)new_time_ns);
 
     /*
-     * Re-activate Tx buffer descriptor ring, to start transmitting the frame:
-     * (the Tx descriptor ring has at least one descriptor with the "ready"
-     *  bit set in its control field)
+     * The output compare of the Tx launch channel may have been skipped
+     * over, so re-arm it:
      */
-    __DSB();
-    WRITE_MMIO_REGISTER(&mac_regs_p->TDAR, ENET_TDAR_TDAR_MASK);
+    bool frames_released = false;
 
-#   if 0
-    if (!ethernet_phy_link_is_up(ethernet_mac_p->ethernet_phy_p)) {
-        DEBUG_PRINTF("Ethernet MAC: link down for MAC %s\n", ethernet_mac_p->name_p);
+    if (ethernet_mac_p->var_p->tx_launch_queue_length != 0) {
+        frames_released = ethernet_mac_release_tx_launch_frames(ethernet_mac_p);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    if (frames_released) {
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->TDAR, ENET_TDAR_TDAR_MASK);
     }
-#   endif
 
 #   ifdef USE_MPU
     if (!caller_was_privileged) {
@@ -1340,69 +3263,51 @@ void ethernet_mac_start_xmit(const struct ethernet_mac_device *ethernet_mac_p,
 
 
 /**
- * Re-post the given Rx packet to the Ethernet MAC's Rx ring, by assigning it to
- * the next available Rx descriptor in the Rx descriptor ring, marking that
- * descriptor as "empty" and re-activating the Rx descriptor ring.
+ * Obtains a snapshot of the traffic and error statistics of the given
+ * Ethernet MAC, accumulating into them the increments of the hardware MIB
+ * counters since the last call.
+ *
+ * NOTE: Some MIB counters are only 16-bit wide, so this function needs to
+ * be called often enough, so that those counters do not wrap around more
+ * than once between calls (at 100Mbps, a 16-bit frame counter wraps
+ * around after ~440ms of minimum-size frames).
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param stats_p           Area where the statistics are to be returned
  */
-void ethernet_mac_repost_rx_packet(const struct ethernet_mac_device *ethernet_mac_p,
-                                   struct network_packet *rx_packet_p)
+void ethernet_mac_get_stats(const struct ethernet_mac_device *ethernet_mac_p,
+                            struct ethernet_mac_stats *stats_p)
 {
     D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
 
     struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
     ENET_Type *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
 
-    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
-    D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP ||
-             rx_packet_p->state_flags == NET_PACKET_RX_FAILED);
+    D_ASSERT(mac_var_p->initialized);
 
 #   ifdef USE_MPU
     bool caller_was_privileged = rtos_enter_privileged_mode();
-#   endif
+#    endif
 
     uint32_t int_mask = disable_cpu_interrupts();
 
-    D_ASSERT(mac_var_p->rx_ring_entries_filled < NET_MAX_RX_PACKETS);
-
-    volatile struct ethernet_rx_buffer_descriptor *rx_buf_desc_p =
-        mac_var_p->rx_ring_write_cursor;
-
-    D_ASSERT((rx_buf_desc_p->control & ENET_RX_BD_EMPTY_MASK) == 0);
-    D_ASSERT(rx_buf_desc_p->data_buffer == NULL);
-    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
-
-    rx_buf_desc_p->data_buffer = rx_packet_p->data_buffer;
-    rx_packet_p->rx_buf_desc_p = rx_buf_desc_p;
-    rx_buf_desc_p->control_extend1 |= ENET_RX_BD_GENERATE_INTERRUPT_MASK;
-
-    D_ASSERT(!(rx_packet_p->state_flags & NET_PACKET_IN_RX_TRANSIT));
-
-    rx_packet_p->state_flags = NET_PACKET_IN_RX_TRANSIT;
-
-    /*
-     * Mark buffer descriptor as "ready for reception":
-     */
-    rx_buf_desc_p->control |= ENET_RX_BD_EMPTY_MASK;
-
-    /*
-     * Advance Rx ring write cursor:
-     */
-    if (rx_buf_desc_p->control & ENET_RX_BD_WRAP_MASK) {
-        mac_var_p->rx_ring_write_cursor = mac_var_p->rx_buffer_descriptors;
-    } else {
-        mac_var_p->rx_ring_write_cursor ++;
+    for (unsigned int i = 0; i < ETHERNET_MAC_NUM_MIB_COUNTERS; i ++) {
+        const struct ethernet_mac_mib_counter *counter_p =
+            &g_ethernet_mac_mib_counters[i];
+        uint32_t value = READ_MMIO_REGISTER(
+            (volatile uint32_t *)((uintptr_t)mac_regs_p + counter_p->reg_offset));
+        uint32_t *stats_field_p =
+            (uint32_t *)((uintptr_t)&mac_var_p->stats + counter_p->stats_offset);
+
+        value &= counter_p->width_mask;
+        *stats_field_p += (value - mac_var_p->mib_counters_last_values[i]) &
+                          counter_p->width_mask;
+        mac_var_p->mib_counters_last_values[i] = value;
     }
 
-    mac_var_p->rx_ring_entries_filled ++;
-    restore_cpu_interrupts(int_mask);
+    *stats_p = mac_var_p->stats;
 
-    /*
-     * Re-activate Rx buffer descriptor ring:
-     * (the Rx descriptor ring has at least one descriptor with the "empty"
-     *  bit set in its control field)
-     */
-    __DSB();
-    WRITE_MMIO_REGISTER(&mac_regs_p->RDAR, ENET_RDAR_RDAR_MASK);
+    restore_cpu_interrupts(int_mask);
 
 #   ifdef USE_MPU
     if (!caller_was_privileged) {
@@ -1411,3 +3316,30 @@ void ethernet_mac_repost_rx_packet(const struct ethernet_mac_device *ethernet_ma
 #   endif
 }
 
+
+/**
+ * Calculates the difference between two snapshots of the statistics of an
+ * Ethernet MAC
+ *
+ * @param old_stats_p       Pointer to the older snapshot
+ * @param new_stats_p       Pointer to the newer snapshot
+ * @param delta_stats_p     Area where the difference is to be returned
+ */
+void ethernet_mac_stats_delta(const struct ethernet_mac_stats *old_stats_p,
+                              const struct ethernet_mac_stats *new_stats_p,
+                              struct ethernet_mac_stats *delta_stats_p)
+{
+    const uint32_t *old_p = (const uint32_t *)old_stats_p;
+    const uint32_t *new_p = (const uint32_t *)new_stats_p;
+    uint32_t *delta_p = (uint32_t *)delta_stats_p;
+
+    C_ASSERT(sizeof(struct ethernet_mac_stats) % sizeof(uint32_t) == 0);
+
+    for (unsigned int i = 0;
+         i < sizeof(struct ethernet_mac_stats) / sizeof(uint32_t);
+         i ++) {
+        delta_p[i] = new_p[i] - old_p[i];
+    }
+}
+
+#endif /* K64F_MCU */
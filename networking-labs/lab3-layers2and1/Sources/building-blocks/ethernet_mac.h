@@ -3,20 +3,181 @@
  *
  * Ethernet MAC driver interface
  *
+ * The networking stack, the PHY driver and the application only reach the
+ * Ethernet hardware through the functions declared here. A simulated MAC
+ * (for example, an in-memory loopback) needs to implement all of them,
+ * with the same packet ownership rules, to run the protocol code without
+ * the ENET hardware:
+ * - Bring-up: ethernet_mac_init(), ethernet_mac_start() and
+ *   ethernet_mac_set_link_mode(), called on PHY link changes
+ * - Tx: ethernet_mac_start_xmit(), ethernet_mac_start_xmit_batch(),
+ *   ethernet_mac_start_xmit_gather(), ethernet_mac_start_xmit_at(),
+ *   ethernet_mac_reclaim_tx_packets() and ethernet_mac_get_tx_ring_frames()
+ * - Rx: ethernet_mac_poll_rx() and ethernet_mac_repost_rx_packet()
+ * - Address filtering: ethernet_mac_set_promiscuous_mode(),
+ *   ethernet_mac_add_multicast_addr(), ethernet_mac_remove_multicast_addr(),
+ *   ethernet_mac_add_unicast_addr() and ethernet_mac_remove_unicast_addr()
+ * - Stats and time: ethernet_mac_get_stats(), ethernet_mac_stats_delta(),
+ *   ethernet_mac_get_ring_stats(), ethernet_mac_get_ieee_1588_time() and
+ *   ethernet_mac_adjust_ieee_1588_time()
+ *
+ * The K64F ENET driver is in ethernet_mac.c and the STM32F4 ETH driver is in
+ * ethernet_mac_stm32f4.c. Only the one for the selected microcontroller is
+ * compiled in.
+ *
  * @author German Rivera
  */
 #ifndef SOURCES_BUILDING_BLOCKS_ETHERNET_MAC_H_
 #define SOURCES_BUILDING_BLOCKS_ETHERNET_MAC_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "runtime_checks.h"
 #include "microcontroller.h"
+#if defined(K64F_MCU)
 #include "pin_config.h"
+#endif
 
 struct ethernet_mac_address;
+struct ethernet_phy_link_mode;
 struct net_layer2_end_point;
 struct network_packet;
 
+/**
+ * Number of Ethernet MAC instances (the K64F has only one ENET module and
+ * the STM32F4 has only one ETH module)
+ */
+#define NUM_ETHERNET_MACS   1
+
+/**
+ * Maximum number of entries of an Ethernet MAC's Tx buffer descriptor ring
+ */
+#define ETHERNET_MAC_MAX_TX_RING_ENTRIES    32
+
+/**
+ * Maximum number of entries of an Ethernet MAC's Rx buffer descriptor ring
+ */
+#define ETHERNET_MAC_MAX_RX_RING_ENTRIES    32
+
+/**
+ * Maximum number of payload fragments that can be chained to a Tx packet,
+ * in a call to ethernet_mac_start_xmit_gather()
+ */
+#define ETHERNET_MAC_MAX_TX_FRAGMENTS       3
+
+/**
+ * Tx payload fragment: a data buffer outside of a Tx packet, which is
+ * transmitted, without being copied, in its own Tx buffer descriptor,
+ * right after the data held in the Tx packet's data buffer.
+ */
+struct ethernet_tx_fragment {
+    /**
+     * Pointer to the fragment's data (it can be in flash or in SRAM).
+     * The data must not be modified until the Tx packet to which this
+     * fragment was chained has been transmitted.
+     */
+    const void *data_p;
+
+    /**
+     * Length of the fragment's data in bytes
+     */
+    uint16_t length;
+};
+
+/**
+ * Rx completion handling modes of an Ethernet MAC
+ */
+enum ethernet_mac_rx_modes {
+    /**
+     * Received frames are removed from the Rx ring by the Rx interrupt
+     * handler, one interrupt per frame.
+     */
+    ETHERNET_MAC_RX_INTERRUPT_MODE = 0,
+
+    /**
+     * The first received frame masks the Rx interrupt and wakes up the
+     * layer-2 packet receiver task, which then removes frames from the Rx
+     * ring by calling ethernet_mac_poll_rx(). The Rx interrupt is unmasked
+     * again only when the Rx ring has been drained.
+     */
+    ETHERNET_MAC_RX_POLLED_MODE,
+};
+
+/**
+ * Tx completion handling modes of an Ethernet MAC
+ */
+enum ethernet_mac_tx_modes {
+    /**
+     * One Tx interrupt is generated for each transmitted frame, to
+     * reclaim its Tx buffer descriptors.
+     */
+    ETHERNET_MAC_TX_INTERRUPT_MODE = 0,
+
+    /**
+     * A Tx interrupt is generated only every
+     * ETHERNET_MAC_TX_LAZY_RECLAIM_INTERRUPT_INTERVAL frames. Tx buffer
+     * descriptors of frames already transmitted are also reclaimed when a
+     * new frame is queued for transmission and, by calling
+     * ethernet_mac_reclaim_tx_packets(), when the pool of free Tx packets
+     * runs out.
+     */
+    ETHERNET_MAC_TX_LAZY_RECLAIM_MODE,
+};
+
+/**
+ * Number of frames queued for transmission between Tx interrupts,
+ * in ETHERNET_MAC_TX_LAZY_RECLAIM_MODE
+ */
+#define ETHERNET_MAC_TX_LAZY_RECLAIM_INTERRUPT_INTERVAL    4
+
+/**
+ * Period of the IEEE 1588 timer of an Ethernet MAC, in nanoseconds. The
+ * timer wraps around to 0 every second.
+ */
+#define ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS  UINT32_C(1000000000)
+
+/**
+ * Calculate the difference in nanoseconds between two values of the
+ * IEEE 1588 timer of an Ethernet MAC (for example, hardware timestamps of
+ * two packets). The two values must be less than one timer period apart.
+ */
+#define ETHERNET_MAC_IEEE_1588_TIME_DELTA_NS(_begin_ns, _end_ns) \
+        ((uint32_t)(_end_ns) >= (uint32_t)(_begin_ns) ?            \
+            (uint32_t)(_end_ns) - (uint32_t)(_begin_ns) :           \
+            ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS -                \
+                ((uint32_t)(_begin_ns) - (uint32_t)(_end_ns)))
+
+/**
+ * Maximum time in advance, in nanoseconds, that the launch time of a frame
+ * sent with ethernet_mac_start_xmit_at() can be. Launch times farther
+ * ahead than this are taken as launch times that have already passed.
+ */
+#define ETHERNET_MAC_TX_LAUNCH_MAX_LEAD_NS  (ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS / 2)
+
+#if defined(STM32F479_MCU)
+/**
+ * Number of pins of the RMII and RMII management interfaces of an STM32
+ * Ethernet MAC
+ */
+#define ETHERNET_MAC_NUM_RMII_PINS  9
+
+/**
+ * GPIO pin used by an STM32 Ethernet MAC. All the Ethernet pin functions
+ * are alternate function 11 (AF11).
+ */
+struct ethernet_mac_gpio_pin {
+    /**
+     * Pointer to MMIO registers of the GPIO port of the pin
+     */
+    GPIO_TypeDef *gpio_regs_p;
+
+    /**
+     * Pin index within its GPIO port (0 .. 15)
+     */
+    uint8_t pin_index;
+};
+#endif
+
 /**
  * Const fields of an Ethernet MAC device (to be placed in flash)
  */
@@ -40,7 +201,11 @@ struct ethernet_mac_device {
     /**
      * Pointer to MMIO registers for this MAC device
      */
+#if defined(K64F_MCU)
     ENET_Type *mmio_registers_p;
+#elif defined(STM32F479_MCU)
+    ETH_TypeDef *mmio_registers_p;
+#endif
 
     /**
      * Pointer to Ethernet PHY device physically connected
@@ -48,6 +213,7 @@ struct ethernet_mac_device {
      */
     const struct ethernet_phy_device *ethernet_phy_p;
 
+#if defined(K64F_MCU)
     /**
      * IEEE 1588 timestamp timer pins
      */
@@ -68,15 +234,179 @@ struct ethernet_mac_device {
      */
     IRQn_Type error_irq_num;
 
+    /**
+     * IEEE 1588 timer IRQ number
+     */
+    IRQn_Type ieee_1588_timer_irq_num;
+
     /**
      * Clock gate mask to enable the clock for this MAC
      */
     uint32_t clock_gate_mask;
+
+#elif defined(STM32F479_MCU)
+    /**
+     * Pins of the RMII interface and of the RMII management interface
+     * (MDIO bus) connecting this MAC to its Ethernet PHY
+     */
+    struct ethernet_mac_gpio_pin rmii_pins[ETHERNET_MAC_NUM_RMII_PINS];
+
+    /**
+     * IRQ number of the one interrupt of this MAC (Tx/Rx completion, errors
+     * and IEEE 1588 timer events)
+     */
+    IRQn_Type irq_num;
+
+    /**
+     * Clock gate mask to enable the clocks for this MAC (in RCC_AHB1ENR)
+     */
+    uint32_t clock_gate_mask;
+#endif
+
+    /**
+     * Number of entries of this MAC's Tx buffer descriptor ring
+     * (must be <= ETHERNET_MAC_MAX_TX_RING_ENTRIES)
+     */
+    uint16_t tx_ring_num_entries;
+
+    /**
+     * Number of entries of this MAC's Rx buffer descriptor ring
+     * (must be <= ETHERNET_MAC_MAX_RX_RING_ENTRIES). Rx packets of the
+     * associated layer-2 end point beyond this number are kept in a spare
+     * pool, used to refill the Rx ring as soon as received frames are
+     * removed from it.
+     */
+    uint16_t rx_ring_num_entries;
+};
+
+/**
+ * Snapshot of the occupancy statistics of an Ethernet MAC's Tx/Rx rings
+ */
+struct ethernet_mac_ring_stats {
+    /**
+     * Number of entries of the Tx ring
+     */
+    uint16_t tx_ring_num_entries;
+
+    /**
+     * Number of Tx ring entries currently filled
+     */
+    uint16_t tx_ring_entries_filled;
+
+    /**
+     * Largest number of Tx ring entries ever filled at the same time
+     */
+    uint16_t tx_ring_entries_filled_high_water_mark;
+
+    /**
+     * Number of entries of the Rx ring
+     */
+    uint16_t rx_ring_num_entries;
+
+    /**
+     * Number of Rx ring entries currently posted (available for reception)
+     */
+    uint16_t rx_ring_entries_filled;
+
+    /**
+     * Largest number of received frames ever found in the Rx ring in
+     * one pass of the Rx interrupt handler
+     */
+    uint16_t rx_ring_entries_received_high_water_mark;
+
+    /**
+     * Number of times that the Rx ring was left without any posted entry
+     * (the MAC drops incoming frames in that case)
+     */
+    uint32_t rx_ring_starved_count;
+
+    /**
+     * Number of PAUSE frames sent because too few Rx ring entries were
+     * left posted
+     */
+    uint32_t rx_ring_xoff_count;
+
+    /**
+     * Number of launch-time Tx frames currently waiting for their launch
+     * time to be queued in the Tx ring
+     */
+    uint16_t tx_launch_queue_length;
+
+    /**
+     * Number of launch-time Tx frames queued in the Tx ring
+     */
+    uint32_t tx_launched_count;
+
+    /**
+     * Number of launch-time Tx frames whose launch time had already passed
+     * when they were queued in the Tx ring
+     */
+    uint32_t tx_launch_late_count;
+};
+
+/**
+ * Traffic and error statistics of an Ethernet MAC, accumulated from
+ * the MAC's hardware MIB counters since the MAC was initialized. All
+ * fields are free-running counters that wrap around at 2^32.
+ */
+struct ethernet_mac_stats {
+    /**
+     * Number of octets in frames transmitted successfully
+     */
+    uint32_t tx_octets;
+
+    /**
+     * Number of frames transmitted successfully
+     */
+    uint32_t tx_frames;
+
+    /**
+     * Number of frames transmitted with collisions
+     */
+    uint32_t tx_collisions;
+
+    /**
+     * Number of frames not transmitted due to late or excessive collisions
+     */
+    uint32_t tx_collision_errors;
+
+    /**
+     * Number of frames not transmitted due to Tx FIFO underruns
+     */
+    uint32_t tx_underruns;
+
+    /**
+     * Number of octets in frames received successfully
+     */
+    uint32_t rx_octets;
+
+    /**
+     * Number of frames received successfully
+     */
+    uint32_t rx_frames;
+
+    /**
+     * Number of frames received with CRC or alignment errors
+     */
+    uint32_t rx_crc_errors;
+
+    /**
+     * Number of frames dropped due to Rx FIFO overruns
+     */
+    uint32_t rx_overruns;
+
+    /**
+     * Number of frames dropped by the MAC for other reasons (for example,
+     * no free Rx buffer descriptor)
+     */
+    uint32_t rx_drops;
 };
 
 
 void ethernet_mac_init(const struct ethernet_mac_device *ethernet_mac_p,
-                       struct net_layer2_end_point *layer2_end_point_p);
+                       struct net_layer2_end_point *layer2_end_point_p,
+                       enum ethernet_mac_rx_modes rx_mode,
+                       enum ethernet_mac_tx_modes tx_mode);
 
 void ethernet_mac_start(const struct ethernet_mac_device *ethernet_mac_p);
 
@@ -86,12 +416,60 @@ void ethernet_mac_add_multicast_addr(const struct ethernet_mac_device *ethernet_
 void ethernet_mac_remove_multicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
                                         struct ethernet_mac_address *mac_addr_p);
 
+void ethernet_mac_add_unicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct ethernet_mac_address *mac_addr_p);
+
+void ethernet_mac_remove_unicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                      struct ethernet_mac_address *mac_addr_p);
+
+void ethernet_mac_set_link_mode(const struct ethernet_mac_device *ethernet_mac_p,
+                                const struct ethernet_phy_link_mode *link_mode_p);
+
+void ethernet_mac_set_promiscuous_mode(const struct ethernet_mac_device *ethernet_mac_p,
+                                       bool on);
+
 void ethernet_mac_start_xmit(const struct ethernet_mac_device *ethernet_mac_p,
                              struct network_packet *tx_packet_p);
 
+void ethernet_mac_start_xmit_batch(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *tx_packets[],
+                                   uint_fast8_t num_packets);
+
+error_t ethernet_mac_start_xmit_gather(const struct ethernet_mac_device *ethernet_mac_p,
+                                       struct network_packet *tx_packet_p,
+                                       const struct ethernet_tx_fragment fragments[],
+                                       uint_fast8_t num_fragments);
+
+void ethernet_mac_start_xmit_at(const struct ethernet_mac_device *ethernet_mac_p,
+                                struct network_packet *tx_packet_p,
+                                uint32_t launch_time_ns);
+
+void ethernet_mac_reclaim_tx_packets(const struct ethernet_mac_device *ethernet_mac_p);
+
+uint_fast16_t ethernet_mac_get_tx_ring_frames(const struct ethernet_mac_device *ethernet_mac_p);
+
 void ethernet_mac_repost_rx_packet(const struct ethernet_mac_device *ethernet_mac_p,
                                    struct network_packet *rx_packet_p);
 
-extern const struct ethernet_mac_device g_ethernet_mac0;
+uint_fast16_t ethernet_mac_poll_rx(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *rx_packets[],
+                                   uint_fast16_t budget);
+
+void ethernet_mac_get_ring_stats(const struct ethernet_mac_device *ethernet_mac_p,
+                                 struct ethernet_mac_ring_stats *ring_stats_p);
+
+uint32_t ethernet_mac_get_ieee_1588_time(const struct ethernet_mac_device *ethernet_mac_p);
+
+void ethernet_mac_adjust_ieee_1588_time(const struct ethernet_mac_device *ethernet_mac_p,
+                                        int32_t offset_ns);
+
+void ethernet_mac_get_stats(const struct ethernet_mac_device *ethernet_mac_p,
+                            struct ethernet_mac_stats *stats_p);
+
+void ethernet_mac_stats_delta(const struct ethernet_mac_stats *old_stats_p,
+                              const struct ethernet_mac_stats *new_stats_p,
+                              struct ethernet_mac_stats *delta_stats_p);
+
+extern const struct ethernet_mac_device g_ethernet_macs[NUM_ETHERNET_MACS];
 
 #endif /* SOURCES_BUILDING_BLOCKS_ETHERNET_MAC_H_ */
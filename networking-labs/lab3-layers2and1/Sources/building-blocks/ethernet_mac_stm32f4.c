@@ -0,0 +1,3101 @@
+/**
+ * @file ethernet_mac_stm32f4.c
+ *
+ * STM32F4 Ethernet MAC driver
+ *
+ * This is the STM32F4 counterpart of the K64F ENET driver (ethernet_mac.c),
+ * behind the same interface (ethernet_mac.h), so that the networking stack
+ * runs unchanged on either microcontroller. It uses the enhanced DMA
+ * descriptors of the STM32 ETH module, in ring mode, with one Rx data
+ * buffer per received frame. The same packet ownership rules, Rx spare
+ * pool, Tx ring reservation and Tx launch queue as in the K64F driver are
+ * kept.
+ *
+ * @author German Rivera
+ */
+#include <string.h>
+#include "ethernet_mac.h"
+#include "ethernet_phy.h"
+#include "networking_layer2.h"
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+#include "runtime_log.h"
+#include "io_utils.h"
+#include "interrupt_vector_table.h"
+#include "perf_probes.h"
+#include "power_utils.h"
+#include "net_config.h"
+
+#if defined(STM32F479_MCU)
+
+/*
+ * Compile-time configuration options:
+ */
+#define    ETH_CHECKSUM_OFFLOAD
+
+/**
+ * Frequency in Hz of the clock of the Ethernet MAC's IEEE 1588 timer. The
+ * timer is clocked from HCLK and its value is advanced by the fine
+ * correction method, as if it was clocked from a 50MHz clock (the same
+ * timer resolution as on the K64F).
+ */
+#define ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ  UINT32_C(50000000)
+
+/**
+ * Increment of the IEEE 1588 timer value for every timer clock tick
+ */
+#define ETHERNET_MAC_IEEE_1588_TIMER_INCREMENT_NS \
+        (UINT32_C(1000000000) / ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ)
+
+/**
+ * Value of the PTPTSAR register for the fine correction method: the
+ * accumulator overflows, and the timer is advanced, at
+ * ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ
+ */
+#define ETHERNET_MAC_IEEE_1588_TIMER_ADDEND \
+        ((uint32_t)((UINT64_C(1) << 32) *                                 \
+                    ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ /           \
+                    (MCU_CPU_CLOCK_FREQ_IN_MHZ * UINT64_C(1000000))))
+
+C_ASSERT(UINT32_C(1000000000) % ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ == 0);
+C_ASSERT(MCU_CPU_CLOCK_FREQ_IN_MHZ * UINT32_C(1000000) >
+         ETHERNET_MAC_IEEE_1588_TIMER_CLOCK_FREQ_HZ);
+
+extern const uint32_t g_ethernet_crc32_table[256];
+
+/**
+ * How long before its launch time a launch-time Tx frame is queued in the
+ * Tx ring, in nanoseconds, to make up for the latency of the IEEE 1588
+ * target time interrupt and for the time that the MAC takes to fetch the
+ * frame. Frames whose launch time is closer than this are queued right away.
+ */
+#define ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS   UINT32_C(2000)
+
+C_ASSERT(ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS < ETHERNET_MAC_TX_LAUNCH_MAX_LEAD_NS);
+
+/**
+ * Number of entries of the Tx buffer descriptor ring of MAC0
+ */
+#define ETHERNET_MAC0_TX_RING_NUM_ENTRIES   NET_CONFIG_MAC_TX_RING_NUM_ENTRIES
+
+/**
+ * Number of entries of the Rx buffer descriptor ring of MAC0
+ */
+#define ETHERNET_MAC0_RX_RING_NUM_ENTRIES   NET_CONFIG_MAC_RX_RING_NUM_ENTRIES
+
+/**
+ * Number of posted Rx ring entries below which the Rx ring is considered
+ * about to be starved, because the receiver tasks are falling behind. The
+ * MAC then sends a PAUSE frame right away.
+ */
+#define ETHERNET_MAC_RX_RING_XOFF_THRESHOLD     4
+
+C_ASSERT(ETHERNET_MAC_RX_RING_XOFF_THRESHOLD < ETHERNET_MAC0_RX_RING_NUM_ENTRIES);
+
+/**
+ * Duration of the PAUSE frames sent by the MAC (MACFCR PT), in pause
+ * quanta of 512 bit times (0x400 quanta is about 5 ms at 100 Mb/s)
+ */
+#define ETHERNET_MAC_PAUSE_DURATION             0x400
+
+/**
+ * Maximum length in bytes (including CRC) of received frames
+ */
+#define ETHERNET_MAC_MAX_RX_FRAME_SIZE     ETHERNET_MAX_VLAN_FRAME_SIZE
+
+/**
+ * Length in bytes of the CRC at the end of an Ethernet frame
+ */
+#define ETHERNET_MAC_CRC_SIZE               sizeof(uint32_t)
+
+/**
+ * Size in bytes of the Rx data buffers given to the MAC's DMA engine (RDES1
+ * RBS1). Rx data buffers are posted starting at the 2-byte alignment
+ * padding (see ethernet_mac_post_rx_packet()), and RBS1 must be a multiple
+ * of 4.
+ */
+#define ETHERNET_MAC_RX_DMA_BUFFER_SIZE    (NET_PACKET_DATA_BUFFER_SIZE - 4)
+
+/*
+ * The STM32 MAC does not have a "frame truncate length", so every frame
+ * the MAC accepts must fit in one Rx data buffer. Longer frames span
+ * several Rx buffer descriptors and are dropped.
+ */
+C_ASSERT(ETHERNET_MAC_MAX_RX_FRAME_SIZE + sizeof(uint16_t) <=
+         ETHERNET_MAC_RX_DMA_BUFFER_SIZE);
+C_ASSERT(ETHERNET_MAC_RX_DMA_BUFFER_SIZE % 4 == 0);
+
+C_ASSERT(ETHERNET_MAC0_TX_RING_NUM_ENTRIES <= ETHERNET_MAC_MAX_TX_RING_ENTRIES);
+C_ASSERT(ETHERNET_MAC0_RX_RING_NUM_ENTRIES <= ETHERNET_MAC_MAX_RX_RING_ENTRIES);
+C_ASSERT(ETHERNET_MAC0_RX_RING_NUM_ENTRIES <= NET_MAX_RX_PACKETS);
+
+/**
+ * Maximum number of iterations for a polling loop
+ * waiting for reset completion of the Ethernet MAC
+ */
+#define ETHERNET_MAC_RESET_MAX_POLLING_COUNT   UINT16_MAX
+
+/**
+ * Maximum number of iterations for a polling loop
+ * waiting for the Ethernet MAC's Tx DMA to stop
+ */
+#define ETHERNET_MAC_TX_STOP_MAX_POLLING_COUNT UINT16_MAX
+
+/**
+ * Maximum number of iterations for a polling loop waiting for an update of
+ * the IEEE 1588 timer to complete
+ */
+#define ETHERNET_MAC_IEEE_1588_UPDATE_MAX_POLLING_COUNT UINT16_MAX
+
+/**
+ * Ethernet frame buffer descriptor alignment in bytes
+ */
+#define ETHERNET_FRAME_BUFFER_DESCRIPTOR_ALIGNMENT UINT32_C(32)
+
+/*
+ * Bit masks of the ETH registers used by this driver. The names have a
+ * _MASK/_SHIFT suffix, so they do not collide with the ones in the CMSIS
+ * device header.
+ */
+#define ETH_MACCR_RE_MASK           BIT(2)
+#define ETH_MACCR_TE_MASK           BIT(3)
+#define ETH_MACCR_IPCO_MASK         BIT(10)
+#define ETH_MACCR_DM_MASK           BIT(11)
+#define ETH_MACCR_ROD_MASK          BIT(13)
+#define ETH_MACCR_FES_MASK          BIT(14)
+
+#define ETH_MACFFR_PM_MASK          BIT(0)
+#define ETH_MACFFR_HU_MASK          BIT(1)
+#define ETH_MACFFR_HM_MASK          BIT(2)
+#define ETH_MACFFR_HPF_MASK         BIT(10)
+
+#define ETH_MACFCR_FCB_MASK         BIT(0)
+#define ETH_MACFCR_TFCE_MASK        BIT(1)
+#define ETH_MACFCR_RFCE_MASK        BIT(2)
+#define ETH_MACFCR_PT_MASK          MULTI_BIT_MASK(31, 16)
+#define ETH_MACFCR_PT_SHIFT         16
+
+#define ETH_MACSR_TSTS_MASK         BIT(9)
+
+#define ETH_MACIMR_PMTIM_MASK       BIT(3)
+#define ETH_MACIMR_TSTIM_MASK       BIT(9)
+
+#define ETH_MMCCR_CR_MASK           BIT(0)
+#define ETH_MMCCR_ROR_MASK          BIT(2)
+
+#define ETH_MMCRIMR_RFCEM_MASK      BIT(5)
+#define ETH_MMCRIMR_RFAEM_MASK      BIT(6)
+#define ETH_MMCRIMR_RGUFM_MASK      BIT(17)
+
+#define ETH_MMCTIMR_TGFSCM_MASK     BIT(14)
+#define ETH_MMCTIMR_TGFMSCM_MASK    BIT(15)
+#define ETH_MMCTIMR_TGFM_MASK       BIT(21)
+
+#define ETH_PTPTSCR_TSE_MASK        BIT(0)
+#define ETH_PTPTSCR_TSFCU_MASK      BIT(1)
+#define ETH_PTPTSCR_TSSTI_MASK      BIT(2)
+#define ETH_PTPTSCR_TSSTU_MASK      BIT(3)
+#define ETH_PTPTSCR_TSITE_MASK      BIT(4)
+#define ETH_PTPTSCR_TSARU_MASK      BIT(5)
+#define ETH_PTPTSCR_TSSARFE_MASK    BIT(8)
+#define ETH_PTPTSCR_TSSSR_MASK      BIT(9)
+
+#define ETH_PTPTSLR_STSS_MASK       MULTI_BIT_MASK(30, 0)
+#define ETH_PTPTSLUR_TSUPNS_MASK    MULTI_BIT_MASK(30, 0)
+#define ETH_PTPTSLUR_TSUPNS_SUBTRACT_MASK BIT(31)
+
+#define ETH_DMABMR_SR_MASK          BIT(0)
+#define ETH_DMABMR_EDFE_MASK        BIT(7)
+#define ETH_DMABMR_PBL_MASK         MULTI_BIT_MASK(13, 8)
+#define ETH_DMABMR_PBL_SHIFT        8
+#define ETH_DMABMR_FB_MASK          BIT(16)
+#define ETH_DMABMR_AAB_MASK         BIT(25)
+
+#define ETH_DMASR_TS_MASK           BIT(0)
+#define ETH_DMASR_TBUS_MASK         BIT(2)
+#define ETH_DMASR_ROS_MASK          BIT(4)
+#define ETH_DMASR_TUS_MASK          BIT(5)
+#define ETH_DMASR_RS_MASK           BIT(6)
+#define ETH_DMASR_RBUS_MASK         BIT(7)
+#define ETH_DMASR_FBES_MASK         BIT(13)
+#define ETH_DMASR_AIS_MASK          BIT(15)
+#define ETH_DMASR_NIS_MASK          BIT(16)
+#define ETH_DMASR_TPS_MASK          MULTI_BIT_MASK(22, 20)
+
+#define ETH_DMAOMR_SR_MASK          BIT(1)
+#define ETH_DMAOMR_OSF_MASK         BIT(2)
+#define ETH_DMAOMR_ST_MASK          BIT(13)
+#define ETH_DMAOMR_TSF_MASK         BIT(21)
+#define ETH_DMAOMR_RSF_MASK         BIT(25)
+#define ETH_DMAOMR_DTCEFD_MASK      BIT(26)
+
+/*
+ * The bits of DMAIER are in the same positions as the corresponding
+ * status bits of DMASR
+ */
+#define ETH_DMAIER_TIE_MASK         ETH_DMASR_TS_MASK
+#define ETH_DMAIER_ROIE_MASK        ETH_DMASR_ROS_MASK
+#define ETH_DMAIER_TUIE_MASK        ETH_DMASR_TUS_MASK
+#define ETH_DMAIER_RIE_MASK         ETH_DMASR_RS_MASK
+#define ETH_DMAIER_FBEIE_MASK       ETH_DMASR_FBES_MASK
+#define ETH_DMAIER_AISE_MASK        ETH_DMASR_AIS_MASK
+#define ETH_DMAIER_NISE_MASK        ETH_DMASR_NIS_MASK
+
+#define ETH_DMAMFBOCR_MFC_MASK      MULTI_BIT_MASK(15, 0)
+#define ETH_DMAMFBOCR_MFC_SHIFT     0
+#define ETH_DMAMFBOCR_MFA_MASK      MULTI_BIT_MASK(27, 17)
+#define ETH_DMAMFBOCR_MFA_SHIFT     17
+
+/*
+ * RCC and SYSCFG bits for the Ethernet MAC
+ */
+#define RCC_AHB1ENR_ETHMAC_CLOCKS_MASK  MULTI_BIT_MASK(28, 25)
+#define RCC_AHB1RSTR_ETHMACRST_MASK     BIT(25)
+#define RCC_APB2ENR_SYSCFGEN_MASK       BIT(14)
+#define SYSCFG_PMC_MII_RMII_SEL_MASK    BIT(23)
+
+/**
+ * Alternate function of the GPIO pins of the Ethernet MAC
+ */
+#define ETHERNET_MAC_GPIO_ALT_FUNCTION  11
+
+/**
+ * Rx buffer descriptor (type of entries of the Ethernet MAC Rx ring).
+ * It is an enhanced Rx DMA descriptor (DMABMR EDFE set) in ring mode.
+ */
+struct ethernet_rx_buffer_descriptor {
+    /**
+     * Rx buffer descriptor status flags (RDES0)
+     */
+    uint32_t status;
+#   define  ETH_RX_BD_OWN_MASK                      BIT(31)
+#   define  ETH_RX_BD_FRAME_LENGTH_MASK             MULTI_BIT_MASK(29, 16)
+#   define  ETH_RX_BD_FRAME_LENGTH_SHIFT            16
+#   define  ETH_RX_BD_ERROR_SUMMARY_MASK            BIT(15)
+#   define  ETH_RX_BD_DESCRIPTOR_ERROR_MASK         BIT(14)
+#   define  ETH_RX_BD_LENGTH_ERROR_MASK             BIT(12)
+#   define  ETH_RX_BD_OVERFLOW_ERROR_MASK           BIT(11)
+#   define  ETH_RX_BD_VLAN_FRAME_MASK               BIT(10)
+#   define  ETH_RX_BD_FIRST_DESCRIPTOR_MASK         BIT(9)
+#   define  ETH_RX_BD_LAST_DESCRIPTOR_MASK          BIT(8)
+#   define  ETH_RX_BD_TIMESTAMP_VALID_MASK          BIT(7)
+#   define  ETH_RX_BD_LATE_COLLISION_MASK           BIT(6)
+#   define  ETH_RX_BD_WATCHDOG_TIMEOUT_MASK         BIT(4)
+#   define  ETH_RX_BD_RECEIVE_ERROR_MASK            BIT(3)
+#   define  ETH_RX_BD_CRC_ERROR_MASK                BIT(1)
+#   define  ETH_RX_BD_EXTENDED_STATUS_MASK          BIT(0)
+
+    /**
+     * Rx buffer descriptor control flags and buffer size (RDES1)
+     */
+    uint32_t control;
+#   define  ETH_RX_BD_DISABLE_INTERRUPT_MASK        BIT(31)
+#   define  ETH_RX_BD_END_OF_RING_MASK              BIT(15)
+#   define  ETH_RX_BD_BUFFER_SIZE_MASK              MULTI_BIT_MASK(12, 0)
+#   define  ETH_RX_BD_BUFFER_SIZE_SHIFT             0
+
+    /**
+     * Pointer to the Rx buffer descriptor's data buffer (RDES2)
+     */
+    void *data_buffer;
+
+    /**
+     * Second buffer pointer (RDES3), unused in ring mode
+     */
+    uint32_t reserved0;
+
+    /**
+     * Rx buffer descriptor extended status flags (RDES4), only meaningful
+     * if ETH_RX_BD_EXTENDED_STATUS is set in 'status'
+     */
+    uint32_t extended_status;
+#   define  ETH_RX_BD_IPv6_FRAME_MASK               BIT(7)
+#   define  ETH_RX_BD_IPv4_FRAME_MASK               BIT(6)
+#   define  ETH_RX_BD_CHECKSUM_BYPASSED_MASK        BIT(5)
+#   define  ETH_RX_BD_PAYLOAD_CHECKSUM_ERROR_MASK   BIT(4)
+#   define  ETH_RX_BD_IP_HEADER_CHECKSUM_ERROR_MASK BIT(3)
+#   define  ETH_RX_BD_PAYLOAD_TYPE_MASK             MULTI_BIT_MASK(2, 0)
+#   define  ETH_RX_BD_PAYLOAD_TYPE_SHIFT            0
+
+    uint32_t reserved1;
+
+    /**
+     * Rx buffer descriptor timestamp, nanoseconds part (RDES6)
+     */
+    uint32_t timestamp;
+
+    /**
+     * Rx buffer descriptor timestamp, seconds part (RDES7)
+     */
+    uint32_t timestamp_seconds;
+} __attribute__ ((aligned(ETHERNET_FRAME_BUFFER_DESCRIPTOR_ALIGNMENT)));
+
+/*
+ * With DMABMR DSL set to 0, the MAC's DMA engine expects enhanced
+ * descriptors to be contiguous in memory:
+ */
+C_ASSERT(sizeof(struct ethernet_rx_buffer_descriptor) ==
+         ETHERNET_FRAME_BUFFER_DESCRIPTOR_ALIGNMENT);
+
+/**
+ * Tx buffer descriptor (type of entries of the Ethernet MAC Tx ring).
+ * It is an enhanced Tx DMA descriptor (DMABMR EDFE set) in ring mode.
+ */
+struct ethernet_tx_buffer_descriptor {
+    /**
+     * Tx buffer descriptor control and status flags (TDES0)
+     */
+    uint32_t control;
+#   define  ETH_TX_BD_OWN_MASK                      BIT(31)
+#   define  ETH_TX_BD_INTERRUPT_MASK                BIT(30)
+#   define  ETH_TX_BD_LAST_SEGMENT_MASK             BIT(29)
+#   define  ETH_TX_BD_FIRST_SEGMENT_MASK            BIT(28)
+#   define  ETH_TX_BD_TIMESTAMP_MASK                BIT(25)
+#   define  ETH_TX_BD_CHECKSUM_INSERTION_MASK       MULTI_BIT_MASK(23, 22)
+#   define  ETH_TX_BD_CHECKSUM_INSERTION_SHIFT      22
+#   define  ETH_TX_BD_END_OF_RING_MASK              BIT(21)
+#   define  ETH_TX_BD_TIMESTAMP_STATUS_MASK         BIT(17)
+#   define  ETH_TX_BD_ERROR_SUMMARY_MASK            BIT(15)
+#   define  ETH_TX_BD_LATE_COLLISION_MASK           BIT(9)
+#   define  ETH_TX_BD_EXCESSIVE_COLLISION_MASK      BIT(8)
+#   define  ETH_TX_BD_UNDERFLOW_ERROR_MASK          BIT(1)
+
+    /**
+     * Length of the data in the Tx buffer descriptor's data buffer (TDES1)
+     */
+    uint32_t data_length;
+
+    /**
+     * Pointer to the Tx buffer descriptor's data buffer (TDES2)
+     */
+    void *data_buffer;
+
+    /**
+     * Second buffer pointer (TDES3), unused in ring mode
+     */
+    uint32_t reserved0;
+
+    uint32_t reserved1;
+    uint32_t reserved2;
+
+    /**
+     * Tx buffer descriptor timestamp, nanoseconds part (TDES6)
+     */
+    uint32_t timestamp;
+
+    /**
+     * Tx buffer descriptor timestamp, seconds part (TDES7)
+     */
+    uint32_t timestamp_seconds;
+} __attribute__ ((aligned(ETHERNET_FRAME_BUFFER_DESCRIPTOR_ALIGNMENT)));
+
+C_ASSERT(sizeof(struct ethernet_tx_buffer_descriptor) ==
+         ETHERNET_FRAME_BUFFER_DESCRIPTOR_ALIGNMENT);
+
+/**
+ * Value of the CIC field of TDES0 to insert the IP header checksum and the
+ * TCP/UDP/ICMP checksum, including the pseudo-header
+ */
+#define ETH_TX_BD_CHECKSUM_INSERTION_FULL       0x3
+
+/**
+ * Hardware MMC counter that is accumulated into a field of
+ * struct ethernet_mac_stats. MMC counters are reset on read (MMCCR ROR),
+ * so every read returns the increment since the previous one.
+ */
+struct ethernet_mac_mmc_counter {
+    /**
+     * Offset of the MMC counter register in ETH_TypeDef
+     */
+    uint16_t reg_offset;
+
+    /**
+     * Offset of the corresponding uint32_t field in struct ethernet_mac_stats
+     */
+    uint16_t stats_offset;
+};
+
+#define ETHERNET_MAC_MMC_COUNTER(_reg, _stats_field) \
+        { .reg_offset = offsetof(ETH_TypeDef, _reg),                  \
+          .stats_offset = offsetof(struct ethernet_mac_stats, _stats_field) }
+
+/*
+ * The MMC has no octet counters nor Tx error counters, so those fields of
+ * struct ethernet_mac_stats are counted in software, from the descriptors
+ */
+static const struct ethernet_mac_mmc_counter g_ethernet_mac_mmc_counters[] = {
+    ETHERNET_MAC_MMC_COUNTER(MMCTGFCR, tx_frames),
+    ETHERNET_MAC_MMC_COUNTER(MMCTGFSCCR, tx_collisions),
+    ETHERNET_MAC_MMC_COUNTER(MMCTGFMSCCR, tx_collisions),
+    ETHERNET_MAC_MMC_COUNTER(MMCRFCECR, rx_crc_errors),
+    ETHERNET_MAC_MMC_COUNTER(MMCRFAECR, rx_crc_errors),
+};
+
+#define ETHERNET_MAC_NUM_MMC_COUNTERS   ARRAY_SIZE(g_ethernet_mac_mmc_counters)
+
+/**
+ * Non-const fields of an Ethernet MAC device (to be placed in SRAM)
+ */
+struct ethernet_mac_device_var {
+    /**
+     * Flag indicating that ethernet_mac_init() has been called
+     * for this MAC
+     */
+    bool initialized;
+
+    /**
+     * Ethernet MAC address for this layer-2 end point (Ethernet port)
+     */
+    struct ethernet_mac_address mac_address;
+
+    /**
+     * Total number of Tx/Rx errors
+     */
+    uint32_t tx_rx_error_count;
+
+    /**
+     * Pointer to the local layer-2 end point associated with this MAC
+     */
+    struct net_layer2_end_point *layer2_end_point_p;
+
+    /**
+     * Rx completion handling mode
+     */
+    enum ethernet_mac_rx_modes rx_mode;
+
+    /**
+     * Tx completion handling mode
+     */
+    enum ethernet_mac_tx_modes tx_mode;
+
+    /**
+     * Number of frames queued in the Tx ring since the last one that
+     * was marked to generate a Tx interrupt (only used in
+     * ETHERNET_MAC_TX_LAZY_RECLAIM_MODE)
+     */
+    uint8_t tx_frames_since_last_interrupt;
+
+    /**
+     * Number of Tx buffer descriptors currently filled in ths MAC's Tx ring
+     */
+    uint16_t tx_ring_entries_filled;
+
+    /**
+     * Number of frames currently queued in this MAC's Tx ring. It is smaller
+     * than tx_ring_entries_filled when frames with payload fragments are
+     * queued, as those frames take more than one Tx buffer descriptor.
+     */
+    uint16_t tx_ring_frames_filled;
+
+    /**
+     * Number of bytes of the frame being reclaimed from the Tx ring, in
+     * the Tx buffer descriptors already reclaimed
+     */
+    uint16_t tx_frame_octets;
+
+    /**
+     * Number of Rx buffer descriptors currently filled in this MAC's Rx ring
+     */
+    uint16_t rx_ring_entries_filled;
+
+    /**
+     * This MAC's Tx ring write cursor (pointer to next Tx buffer descriptor
+     * that can be filled by ethernet_mac_start_xmit())
+     */
+    volatile struct ethernet_tx_buffer_descriptor *tx_ring_write_cursor;
+
+    /**
+     * This MAC's Tx ring read cursor (pointer to the first Tx buffer
+     * descriptor that can be read by ethernet_mac_drain_tx_ring())
+     */
+    volatile struct ethernet_tx_buffer_descriptor *tx_ring_read_cursor;
+
+    /**
+     * This MAC's Rx ring write cursor (pointer to next Rx buffer descriptor
+     * that can be filled by ethernet_mac_repost_rx_packet())
+     */
+    volatile struct ethernet_rx_buffer_descriptor *rx_ring_write_cursor;
+
+    /**
+     * This MAC's Rx ring read cursor (pointer to the first Rx buffer
+     * descriptor that can be read by ethernet_mac_remove_rx_packet())
+     */
+    volatile struct ethernet_rx_buffer_descriptor *rx_ring_read_cursor;
+
+    /**
+     * Largest value that tx_ring_entries_filled has ever had
+     */
+    uint16_t tx_ring_entries_filled_high_water_mark;
+
+    /**
+     * Largest number of received frames found in the Rx ring in one call to
+     * ethernet_mac_drain_rx_ring()
+     */
+    uint16_t rx_ring_entries_received_high_water_mark;
+
+    /**
+     * Number of times that the Rx ring was left without any posted entry
+     */
+    uint32_t rx_ring_starved_count;
+
+    /**
+     * Flag indicating that PAUSE frames can be sent and are honored on the
+     * current link (full-duplex link, with flow control negotiated)
+     */
+    bool flow_control_on;
+
+    /**
+     * Flag indicating that a PAUSE frame was sent since the number of
+     * posted Rx ring entries dropped below ETHERNET_MAC_RX_RING_XOFF_THRESHOLD
+     */
+    bool rx_ring_xoff_sent;
+
+    /**
+     * Number of PAUSE frames sent because the Rx ring was about to be starved
+     */
+    uint32_t rx_ring_xoff_count;
+
+    /**
+     * Number of entries in tx_launch_queue[]
+     */
+    uint8_t tx_launch_queue_length;
+
+    /**
+     * Number of launch-time Tx frames queued in the Tx ring
+     */
+    uint32_t tx_launched_count;
+
+    /**
+     * Number of launch-time Tx frames whose launch time had already passed
+     * when they were queued in the Tx ring
+     */
+    uint32_t tx_launch_late_count;
+
+    /**
+     * Launch-time Tx packets (see ethernet_mac_start_xmit_at()) waiting to
+     * be queued in the Tx ring, sorted by launch time: entry 0 is the next
+     * one due. Every Tx packet is either here or in the Tx ring, or in
+     * neither, so this queue can never overflow.
+     */
+    struct network_packet *tx_launch_queue[NET_MAX_TX_PACKETS];
+
+    /**
+     * Array of counters for the hash table buckets. Each entry corresponds
+     * to the number of multicast addresses and additional unicast addresses
+     * added to the corresponding bucket (bit in the MACHTHR/MACHTLR bit hash
+     * table). Unlike the K64F ENET, the STM32 MAC has only one hash table,
+     * for both kinds of destination addresses.
+     */
+#   define ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS    64
+    uint8_t hash_table_counts[ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS];
+
+    /**
+     * Statistics accumulated from the hardware MMC counters and from the
+     * status of the Tx/Rx buffer descriptors
+     */
+    struct ethernet_mac_stats stats;
+
+    /**
+     * Tx packets currently queued in this MAC's Tx ring, indexed by the
+     * position in the ring of the last Tx buffer descriptor of the
+     * corresponding frame. Entries for any other Tx buffer descriptors are
+     * NULL.
+     */
+    struct network_packet *tx_ring_packets[ETHERNET_MAC_MAX_TX_RING_ENTRIES];
+
+    /**
+     * Rx packets currently posted to this MAC's Rx ring, indexed by the
+     * position in the ring of the Rx buffer descriptor they are posted to.
+     */
+    struct network_packet *rx_ring_packets[ETHERNET_MAC_MAX_RX_RING_ENTRIES];
+
+    /**
+     * This MAC's Tx buffer descriptor ring
+     */
+    volatile struct ethernet_tx_buffer_descriptor tx_buffer_descriptors[ETHERNET_MAC_MAX_TX_RING_ENTRIES];
+
+    /**
+     * This MAC's Rx buffer descriptor ring
+     */
+    volatile struct ethernet_rx_buffer_descriptor rx_buffer_descriptors[ETHERNET_MAC_MAX_RX_RING_ENTRIES];
+};
+
+/**
+ * Global non-const structures for Ethernet MAC devices
+ * (allocated in SRAM space)
+ *
+ * NOTE: These are deliberately not statically initialized, so that they
+ * go in the '.bss' section and their initializers do not take flash space
+ * nor take time to copy at reset.
+ */
+static struct ethernet_mac_device_var g_ethernet_macs_var[NUM_ETHERNET_MACS];
+
+/**
+ * Global const structures for the Ethernet MAC devices
+ * (allocated in flash space)
+ *
+ * NOTE: The RMII pins are the ones routed to the on-board PHY on the
+ * STM32F4 boards that have one.
+ */
+const struct ethernet_mac_device g_ethernet_macs[NUM_ETHERNET_MACS] = {
+    [0] = {
+        .signature = ETHERNET_MAC_DEVICE_SIGNATURE,
+        .name_p = "eth0",
+        .var_p = &g_ethernet_macs_var[0],
+        .mmio_registers_p = ETH,
+        .ethernet_phy_p = &g_ethernet_phys[0],
+        .rmii_pins = {
+            [0] = { .gpio_regs_p = GPIOA, .pin_index = 1 },  /* REF_CLK */
+            [1] = { .gpio_regs_p = GPIOA, .pin_index = 2 },  /* MDIO */
+            [2] = { .gpio_regs_p = GPIOA, .pin_index = 7 },  /* CRS_DV */
+            [3] = { .gpio_regs_p = GPIOC, .pin_index = 1 },  /* MDC */
+            [4] = { .gpio_regs_p = GPIOC, .pin_index = 4 },  /* RXD0 */
+            [5] = { .gpio_regs_p = GPIOC, .pin_index = 5 },  /* RXD1 */
+            [6] = { .gpio_regs_p = GPIOG, .pin_index = 11 }, /* TX_EN */
+            [7] = { .gpio_regs_p = GPIOG, .pin_index = 13 }, /* TXD0 */
+            [8] = { .gpio_regs_p = GPIOB, .pin_index = 13 }, /* TXD1 */
+        },
+
+        .irq_num = ETH_IRQn,
+        .clock_gate_mask = RCC_AHB1ENR_ETHMAC_CLOCKS_MASK,
+        .tx_ring_num_entries = ETHERNET_MAC0_TX_RING_NUM_ENTRIES,
+        .rx_ring_num_entries = ETHERNET_MAC0_RX_RING_NUM_ENTRIES,
+    },
+};
+
+
+/**
+ * Waits for the hardware to clear a self-clearing bit of the PTPTSCR
+ * register, after an update of the IEEE 1588 timer was requested
+ */
+static void ethernet_mac_wait_ieee_1588_update(ETH_TypeDef *mac_regs_p,
+                                               uint32_t update_mask)
+{
+    uint32_t reg_value;
+    uint_fast16_t polling_count;
+
+    polling_count = ETHERNET_MAC_IEEE_1588_UPDATE_MAX_POLLING_COUNT;
+    do {
+        reg_value = READ_MMIO_REGISTER(&mac_regs_p->PTPTSCR);
+        polling_count --;
+    } while ((reg_value & update_mask) != 0 && polling_count != 0);
+
+    if (reg_value & update_mask) {
+        error_t error = CAPTURE_ERROR("IEEE 1588 timer update failed",
+                                      mac_regs_p, reg_value);
+
+        fatal_error_handler(error);
+        /*UNREACHABLE*/
+    }
+}
+
+
+/**
+ * Initializes and starts the IEEE 1588 timer of the given Ethernet MAC,
+ * which provides the hardware timestamps stored in the enhanced
+ * Tx/Rx buffer descriptors.
+ */
+static void
+ethernet_mac_ieee_1588_timer_init(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    /*
+     * Mask the timestamp trigger interrupt, until ethernet_mac_start():
+     */
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->MACIMR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACIMR,
+                        reg_value | ETH_MACIMR_TSTIM_MASK | ETH_MACIMR_PMTIM_MASK);
+
+    /*
+     * Enable timestamping:
+     * - Digital rollover, so that the nanoseconds part of the timer wraps
+     *   around to 0 every second, like the K64F's timer
+     * - Take a timestamp of every received frame
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSCR,
+                        ETH_PTPTSCR_TSE_MASK |
+                        ETH_PTPTSCR_TSSSR_MASK |
+                        ETH_PTPTSCR_TSSARFE_MASK);
+
+    /*
+     * Set the timer increment and the addend of the fine correction method:
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPSSIR,
+                        ETHERNET_MAC_IEEE_1588_TIMER_INCREMENT_NS);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSAR,
+                        ETHERNET_MAC_IEEE_1588_TIMER_ADDEND);
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->PTPTSCR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSCR, reg_value | ETH_PTPTSCR_TSARU_MASK);
+    ethernet_mac_wait_ieee_1588_update(mac_regs_p, ETH_PTPTSCR_TSARU_MASK);
+
+    /*
+     * Start the timer from 0:
+     */
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->PTPTSCR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSCR, reg_value | ETH_PTPTSCR_TSFCU_MASK);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSHUR, 0);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSLUR, 0);
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->PTPTSCR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSCR, reg_value | ETH_PTPTSCR_TSSTI_MASK);
+    ethernet_mac_wait_ieee_1588_update(mac_regs_p, ETH_PTPTSCR_TSSTI_MASK);
+}
+
+
+static void
+ethernet_mac_tx_buffer_descriptor_ring_init(
+    const struct ethernet_mac_device *ethernet_mac_p)
+{
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    /*
+     * Configure Tx buffer descriptor ring:
+     * - Set Tx descriptor ring start address
+     * - Initialize Tx buffer descriptors
+     */
+    D_ASSERT((uintptr_t)mac_var_p->tx_buffer_descriptors % sizeof(uint32_t) == 0);
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMATDLAR,
+                        (uintptr_t)mac_var_p->tx_buffer_descriptors);
+
+    for (unsigned int i = 0; i < ethernet_mac_p->tx_ring_num_entries; i ++) {
+        volatile struct ethernet_tx_buffer_descriptor *buffer_desc_p =
+            &mac_var_p->tx_buffer_descriptors[i];
+
+        buffer_desc_p->data_buffer = NULL;
+        buffer_desc_p->data_length = 0;
+        mac_var_p->tx_ring_packets[i] = NULL;
+
+        /*
+         * NOTE: The "first segment" and "last segment" flags are set by
+         * ethernet_mac_fill_tx_buffer_descriptor() for each frame, as a
+         * frame with payload fragments spans multiple Tx buffer descriptors.
+         * Frames smaller than 60 bytes are automatically padded, and the CRC
+         * is always appended.
+         */
+        buffer_desc_p->control = 0;
+
+        /*
+         * Set the end-of-ring flag for the last buffer of the ring:
+         */
+        if (i == ethernet_mac_p->tx_ring_num_entries - 1) {
+            buffer_desc_p->control |= ETH_TX_BD_END_OF_RING_MASK;
+        }
+    }
+
+    /*
+     * The Tx descriptor ring is empty:
+     */
+    mac_var_p->tx_ring_entries_filled = 0;
+    mac_var_p->tx_ring_frames_filled = 0;
+    mac_var_p->tx_frame_octets = 0;
+    mac_var_p->tx_ring_entries_filled_high_water_mark = 0;
+    mac_var_p->tx_ring_write_cursor = &mac_var_p->tx_buffer_descriptors[0];
+    mac_var_p->tx_ring_read_cursor = &mac_var_p->tx_buffer_descriptors[0];
+}
+
+
+static void
+ethernet_mac_rx_buffer_descriptor_ring_init(
+    const struct ethernet_mac_device *ethernet_mac_p)
+{
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    struct net_layer2_end_point *const layer2_end_point_p = mac_var_p->layer2_end_point_p;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    /*
+     * Configure Rx buffer descriptor ring:
+     * - Set Rx descriptor ring start address
+     * - Initialize Rx buffer descriptors
+     */
+    D_ASSERT((uintptr_t)mac_var_p->rx_buffer_descriptors % sizeof(uint32_t) == 0);
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMARDLAR,
+                        (uintptr_t)mac_var_p->rx_buffer_descriptors);
+
+    for (unsigned int i = 0; i < ethernet_mac_p->rx_ring_num_entries; i ++) {
+        volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p =
+            &mac_var_p->rx_buffer_descriptors[i];
+
+        uint32_t int_mask = disable_cpu_interrupts();
+        struct network_packet *rx_packet_p = net_layer2_take_rx_packet(layer2_end_point_p);
+
+        restore_cpu_interrupts(int_mask);
+        D_ASSERT(rx_packet_p != NULL);
+        D_ASSERT(rx_packet_p->data_buffer_size == NET_PACKET_DATA_BUFFER_SIZE);
+        D_ASSERT((uintptr_t)rx_packet_p->data_buffer %
+                 NET_PACKET_DATA_BUFFER_ALIGNMENT == 0);
+
+        rx_packet_p->state_flags = NET_PACKET_IN_RX_TRANSIT;
+        rx_packet_p->rx_buf_desc_p = buffer_desc_p;
+        mac_var_p->rx_ring_packets[i] = rx_packet_p;
+
+        /*
+         * The MAC's DMA engine writes the frame right after the 2-byte
+         * alignment padding at the beginning of the data buffer, so that
+         * the data payload of the frame is 32-bit aligned in memory (what
+         * the SHIFT16 option does on the K64F):
+         */
+        buffer_desc_p->data_buffer =
+            (uint8_t *)rx_packet_p->data_buffer + sizeof(uint16_t);
+
+        /*
+         * Set the end-of-ring flag for the last buffer of the ring:
+         */
+        if (i != ethernet_mac_p->rx_ring_num_entries - 1) {
+            buffer_desc_p->control = 0;
+        } else {
+            buffer_desc_p->control = ETH_RX_BD_END_OF_RING_MASK;
+        }
+
+        SET_BIT_FIELD(buffer_desc_p->control, ETH_RX_BD_BUFFER_SIZE_MASK,
+                      ETH_RX_BD_BUFFER_SIZE_SHIFT,
+                      ETHERNET_MAC_RX_DMA_BUFFER_SIZE);
+
+        /*
+         * Give the buffer descriptor to the MAC ("available for reception"):
+         */
+        buffer_desc_p->status = ETH_RX_BD_OWN_MASK;
+    }
+
+    /*
+     * The Rx descriptor ring is full:
+     */
+    mac_var_p->rx_ring_entries_filled = ethernet_mac_p->rx_ring_num_entries;
+    mac_var_p->rx_ring_entries_received_high_water_mark = 0;
+    mac_var_p->rx_ring_starved_count = 0;
+    mac_var_p->rx_ring_xoff_sent = false;
+    mac_var_p->rx_ring_xoff_count = 0;
+    mac_var_p->rx_ring_write_cursor = &mac_var_p->rx_buffer_descriptors[0];
+    mac_var_p->rx_ring_read_cursor = &mac_var_p->rx_buffer_descriptors[0];
+}
+
+
+static void ethernet_mac_reset(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    uint32_t reg_value;
+    uint_fast16_t polling_count;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    /*
+     * Reset Ethernet MAC module, through the RCC first and then through its
+     * DMA engine's software reset, which resets all the MAC's registers:
+     */
+    reg_value = READ_MMIO_REGISTER(&RCC->AHB1RSTR);
+    WRITE_MMIO_REGISTER(&RCC->AHB1RSTR, reg_value | RCC_AHB1RSTR_ETHMACRST_MASK);
+    WRITE_MMIO_REGISTER(&RCC->AHB1RSTR, reg_value & ~RCC_AHB1RSTR_ETHMACRST_MASK);
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMABMR, ETH_DMABMR_SR_MASK);
+
+    /*
+     * Wait for reset to complete (it only completes if the PHY is
+     * providing the RMII reference clock):
+     */
+    polling_count = ETHERNET_MAC_RESET_MAX_POLLING_COUNT;
+    do {
+        reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMABMR);
+        polling_count --;
+    } while ((reg_value & ETH_DMABMR_SR_MASK) != 0 && polling_count != 0);
+
+    if (reg_value & ETH_DMABMR_SR_MASK) {
+        error_t error = CAPTURE_ERROR("Eth reset failed", ethernet_mac_p,
+                                       reg_value);
+
+        fatal_error_handler(error);
+        /*UNREACHABLE*/
+    }
+
+    D_ASSERT((READ_MMIO_REGISTER(&mac_regs_p->MACCR) &
+              (ETH_MACCR_RE_MASK | ETH_MACCR_TE_MASK)) == 0);
+}
+
+
+static void set_mac_address(const struct ethernet_mac_device *ethernet_mac_p,
+                            const struct ethernet_mac_address *mac_address_p)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    mac_var_p->mac_address = *mac_address_p;
+
+    /*
+     * Program the MAC address (MACA0HR must be written first, as the
+     * address is latched by the write to MACA0LR):
+     */
+    reg_value = mac_var_p->mac_address.bytes[5] << 8 |
+                mac_var_p->mac_address.bytes[4];
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACA0HR, reg_value);
+
+    reg_value = mac_var_p->mac_address.bytes[3] << 24 |
+                mac_var_p->mac_address.bytes[2] << 16 |
+                mac_var_p->mac_address.bytes[1] << 8 |
+                mac_var_p->mac_address.bytes[0];
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACA0LR, reg_value);
+}
+
+
+/**
+ * Configures the GPIO pins of the RMII interface and of the RMII management
+ * interface of the given Ethernet MAC
+ */
+static void ethernet_mac_pins_init(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    uint32_t reg_value;
+
+    for (uint_fast8_t i = 0; i < ARRAY_SIZE(ethernet_mac_p->rmii_pins); ++ i) {
+        const struct ethernet_mac_gpio_pin *pin_p = &ethernet_mac_p->rmii_pins[i];
+        GPIO_TypeDef *const gpio_regs_p = pin_p->gpio_regs_p;
+        uint32_t pin_index = pin_p->pin_index;
+        uint32_t port_index =
+            ((uintptr_t)gpio_regs_p - GPIOA_BASE) / (GPIOB_BASE - GPIOA_BASE);
+
+        D_ASSERT(pin_index < 16);
+
+        /*
+         * Enable the clock of the GPIO port:
+         */
+        reg_value = READ_MMIO_REGISTER(&RCC->AHB1ENR);
+        WRITE_MMIO_REGISTER(&RCC->AHB1ENR, reg_value | BIT(port_index));
+
+        /*
+         * Select the Ethernet alternate function, push-pull output at the
+         * highest slew rate, without pull-up/pull-down:
+         */
+        reg_value = READ_MMIO_REGISTER(&gpio_regs_p->AFR[pin_index / 8]);
+        SET_BIT_FIELD(reg_value, MULTI_BIT_MASK(3, 0) << ((pin_index % 8) * 4),
+                      (pin_index % 8) * 4, ETHERNET_MAC_GPIO_ALT_FUNCTION);
+        WRITE_MMIO_REGISTER(&gpio_regs_p->AFR[pin_index / 8], reg_value);
+
+        reg_value = READ_MMIO_REGISTER(&gpio_regs_p->OSPEEDR);
+        SET_BIT_FIELD(reg_value, MULTI_BIT_MASK(1, 0) << (pin_index * 2),
+                      pin_index * 2, 0x3);
+        WRITE_MMIO_REGISTER(&gpio_regs_p->OSPEEDR, reg_value);
+
+        reg_value = READ_MMIO_REGISTER(&gpio_regs_p->OTYPER);
+        WRITE_MMIO_REGISTER(&gpio_regs_p->OTYPER, reg_value & ~BIT(pin_index));
+
+        reg_value = READ_MMIO_REGISTER(&gpio_regs_p->PUPDR);
+        reg_value &= ~(MULTI_BIT_MASK(1, 0) << (pin_index * 2));
+        WRITE_MMIO_REGISTER(&gpio_regs_p->PUPDR, reg_value);
+
+        reg_value = READ_MMIO_REGISTER(&gpio_regs_p->MODER);
+        SET_BIT_FIELD(reg_value, MULTI_BIT_MASK(1, 0) << (pin_index * 2),
+                      pin_index * 2, 0x2);
+        WRITE_MMIO_REGISTER(&gpio_regs_p->MODER, reg_value);
+    }
+}
+
+
+static void ethernet_mac_tx_init(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    /*
+     * Set the duration of the PAUSE frames sent by the MAC, when
+     * ethernet_mac_refill_rx_ring() requests it. Sending and honoring PAUSE
+     * frames is enabled by ethernet_mac_set_link_mode(), if negotiated.
+     */
+    reg_value = 0;
+    SET_BIT_FIELD(reg_value, ETH_MACFCR_PT_MASK, ETH_MACFCR_PT_SHIFT,
+                  ETHERNET_MAC_PAUSE_DURATION);
+    reg_value |= ETH_MACFCR_TFCE_MASK | ETH_MACFCR_RFCE_MASK;
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACFCR, reg_value);
+
+    /*
+     * Configure Tx DMA:
+     * - Set store and forward mode, which checksum insertion depends on
+     * - Let the DMA fetch the next frame while the previous one is still
+     *   being transmitted
+     */
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAOMR);
+    reg_value |= ETH_DMAOMR_TSF_MASK | ETH_DMAOMR_OSF_MASK;
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMAOMR, reg_value);
+}
+
+
+static void ethernet_mac_rx_init(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    /*
+     * Configure the MAC:
+     * - Enable Rx checksum offload: the IP header checksum and the layer-4
+     *   checksum (TCP, UDP, ICMP) are validated by the MAC, and the result
+     *   is carried in the Rx buffer descriptor to the corresponding Rx
+     *   packet, so that upper layers can drop and count bad frames.
+     * - Do not strip the CRC, so that the frame length reported in the Rx
+     *   buffer descriptor always includes it.
+     * - Enable full duplex and 100Mbps operation (until the link comes up
+     *   and ethernet_mac_set_link_mode() is called for the negotiated
+     *   link mode)
+     */
+    reg_value = ETH_MACCR_DM_MASK | ETH_MACCR_FES_MASK;
+
+#   ifdef ETH_CHECKSUM_OFFLOAD
+    reg_value |= ETH_MACCR_IPCO_MASK;
+#   endif
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACCR, reg_value);
+
+    /*
+     * Only receive frames that pass the destination address filters:
+     * own MAC address (perfect filter), broadcast address, or addresses that
+     * hit the hash table (promiscuous mode can be turned on for debugging by
+     * calling ethernet_mac_set_promiscuous_mode()):
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACFFR,
+                        ETH_MACFFR_HPF_MASK |
+                        ETH_MACFFR_HM_MASK |
+                        ETH_MACFFR_HU_MASK);
+
+    /*
+     * Configure Rx DMA:
+     * - Set store and forward mode, so that frames with MAC layer errors
+     *   are discarded
+     * - Do not discard frames with wrong IP header checksum or wrong
+     *   layer-4 checksum (they are counted by upper layers)
+     */
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAOMR);
+    reg_value |= ETH_DMAOMR_RSF_MASK | ETH_DMAOMR_DTCEFD_MASK;
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMAOMR, reg_value);
+    ethernet_mac_p->var_p->flow_control_on = true;
+}
+
+
+/**
+ * Initializes an Ethernet MAC module
+ *
+ * @param ethernet_mac_p        Pointer to the Ethernet MAC device
+ * @param layer2_end_point_p     Pointer to the local layer-2 end point
+ *                                 to be associated with this MAC
+ * @param rx_mode               Rx completion handling mode
+ */
+void ethernet_mac_init(const struct ethernet_mac_device *ethernet_mac_p,
+                       struct net_layer2_end_point *layer2_end_point_p,
+                       enum ethernet_mac_rx_modes rx_mode,
+                       enum ethernet_mac_tx_modes tx_mode)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(!mac_var_p->initialized);
+    D_ASSERT(mac_var_p->layer2_end_point_p == NULL);
+    D_ASSERT(ethernet_mac_p->tx_ring_num_entries != 0 &&
+             ethernet_mac_p->tx_ring_num_entries <=
+                ETHERNET_MAC_MAX_TX_RING_ENTRIES);
+    D_ASSERT(ethernet_mac_p->rx_ring_num_entries != 0 &&
+             ethernet_mac_p->rx_ring_num_entries <=
+                 ETHERNET_MAC_MAX_RX_RING_ENTRIES &&
+             ethernet_mac_p->rx_ring_num_entries <= NET_MAX_RX_PACKETS);
+
+    /*
+     * The Tx ring must be able to hold all Tx packets at once, with one Tx
+     * buffer descriptor for each (Tx packets with payload fragments take
+     * additional Tx buffer descriptors only while there is room for them):
+     */
+    D_ASSERT(ethernet_mac_p->tx_ring_num_entries >= NET_MAX_TX_PACKETS);
+
+    mac_var_p->layer2_end_point_p = layer2_end_point_p;
+    mac_var_p->rx_mode = rx_mode;
+    mac_var_p->tx_mode = tx_mode;
+    mac_var_p->tx_frames_since_last_interrupt = 0;
+
+    ethernet_mac_pins_init(ethernet_mac_p);
+
+    /*
+     * Select the RMII interface to the Ethernet PHY. This must be done
+     * before the clocks of the ETH module are enabled:
+     */
+    reg_value = READ_MMIO_REGISTER(&RCC->APB2ENR);
+    WRITE_MMIO_REGISTER(&RCC->APB2ENR, reg_value | RCC_APB2ENR_SYSCFGEN_MASK);
+    reg_value = READ_MMIO_REGISTER(&SYSCFG->PMC);
+    WRITE_MMIO_REGISTER(&SYSCFG->PMC, reg_value | SYSCFG_PMC_MII_RMII_SEL_MASK);
+
+    /*
+     * Enable the clocks of the ETH module (MAC, Tx, Rx and PTP)
+     */
+    reg_value = READ_MMIO_REGISTER(&RCC->AHB1ENR);
+    reg_value |= ethernet_mac_p->clock_gate_mask;
+    WRITE_MMIO_REGISTER(&RCC->AHB1ENR, reg_value);
+
+    ethernet_mac_reset(ethernet_mac_p);
+
+    /*
+     * Configure the DMA engine:
+     * - Use enhanced descriptors (needed for hardware timestamps), stored
+     *   contiguously in memory
+     * - Use fixed, address-aligned bursts of up to 32 beats
+     */
+    reg_value = ETH_DMABMR_EDFE_MASK | ETH_DMABMR_FB_MASK | ETH_DMABMR_AAB_MASK;
+    SET_BIT_FIELD(reg_value, ETH_DMABMR_PBL_MASK, ETH_DMABMR_PBL_SHIFT, 32);
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMABMR, reg_value);
+
+    /*
+     * Disable generation of interrupts:
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMAIER, 0x0);
+
+    /*
+     * Clear pending interrupts:
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMASR, MULTI_BIT_MASK(16, 0));
+
+    /*
+     * Clear hash table registers
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACHTHR, 0x0);
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACHTLR, 0x0);
+
+    set_mac_address(ethernet_mac_p, &layer2_end_point_p->mac_address);
+
+    ethernet_mac_tx_init(ethernet_mac_p);
+    ethernet_mac_rx_init(ethernet_mac_p);
+    ethernet_mac_ieee_1588_timer_init(ethernet_mac_p);
+
+    /*
+     * Reset MMC counters and make them reset on read, and mask the MMC
+     * interrupts of the counters that are read:
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->MMCRIMR,
+                        ETH_MMCRIMR_RFCEM_MASK |
+                        ETH_MMCRIMR_RFAEM_MASK |
+                        ETH_MMCRIMR_RGUFM_MASK);
+    WRITE_MMIO_REGISTER(&mac_regs_p->MMCTIMR,
+                        ETH_MMCTIMR_TGFSCM_MASK |
+                        ETH_MMCTIMR_TGFMSCM_MASK |
+                        ETH_MMCTIMR_TGFM_MASK);
+    WRITE_MMIO_REGISTER(&mac_regs_p->MMCCR,
+                        ETH_MMCCR_ROR_MASK | ETH_MMCCR_CR_MASK);
+    (void)READ_MMIO_REGISTER(&mac_regs_p->DMAMFBOCR);
+    memset(&mac_var_p->stats, 0, sizeof mac_var_p->stats);
+
+    /*
+     * Enable the interrupt in the interrupt controller (NVIC). The MAC has
+     * only one interrupt, for Tx/Rx completion, errors and IEEE 1588 timer
+     * events:
+     */
+    nvic_setup_irq(ethernet_mac_p->irq_num, ETHERNET_MAC_INTERRUPT_PRIORITY);
+
+    ethernet_phy_init(ethernet_mac_p->ethernet_phy_p);
+
+    mac_var_p->initialized = true;
+    DEBUG_PRINTF("Ethernet MAC: Initialized MAC %s (%s Rx mode)\n",
+                 ethernet_mac_p->name_p,
+                 rx_mode == ETHERNET_MAC_RX_POLLED_MODE ? "polled" : "interrupt");
+}
+
+
+/**
+ * Activates an Ethernet MAC module
+ *
+ * @param ethernet_mac_p        Pointer to the Ethernet MAC device
+ */
+void ethernet_mac_start(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(mac_var_p->initialized);
+    D_ASSERT(mac_var_p->layer2_end_point_p != NULL);
+
+    /*
+     * Initialize Tx buffer descriptor ring:
+     */
+    ethernet_mac_tx_buffer_descriptor_ring_init(ethernet_mac_p);
+
+    /*
+     * Initialize Rx buffer descriptor ring:
+     */
+    ethernet_mac_rx_buffer_descriptor_ring_init(ethernet_mac_p);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    /*
+     * Enable generation of Tx/Rx interrupts:
+     * - Generate Tx interrupt when a frame has been transmitted (the
+     *   last Tx buffer descriptor of the frame has the "interrupt on
+     *   completion" flag set)
+     * - Generate Rx interrupt when a frame has been received
+     * - Generate error interrupts for Rx overflow, Tx underflow and bus
+     *   errors
+     * - Unmask the IEEE 1588 target time interrupt, which is only enabled
+     *   while the Tx launch queue is not empty
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMAIER,
+                        ETH_DMAIER_NISE_MASK |
+                        ETH_DMAIER_AISE_MASK |
+                        ETH_DMAIER_TIE_MASK |
+                        ETH_DMAIER_RIE_MASK |
+                        ETH_DMAIER_ROIE_MASK |
+                        ETH_DMAIER_TUIE_MASK |
+                        ETH_DMAIER_FBEIE_MASK);
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->MACIMR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACIMR, reg_value & ~ETH_MACIMR_TSTIM_MASK);
+
+    /*
+     * Enable the MAC's transmitter and receiver, and then the DMA engine's
+     * Tx and Rx processes:
+     */
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->MACCR);
+    reg_value |= ETH_MACCR_TE_MASK | ETH_MACCR_RE_MASK;
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACCR, reg_value);
+
+    /*
+     * The ETH module is clocked from HCLK, which is gated in Stop mode,
+     * so frames would be missed:
+     */
+    cpu_idle_deep_sleep_veto_acquire();
+
+    /*
+     * Activate Tx and Rx buffer descriptor rings:
+     * (the Rx descriptor ring has all its descriptors owned by the MAC)
+     */
+    __DSB();
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAOMR);
+    reg_value |= ETH_DMAOMR_ST_MASK | ETH_DMAOMR_SR_MASK;
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMAOMR, reg_value);
+
+    restore_cpu_interrupts(int_mask);
+
+    DEBUG_PRINTF("Ethernet MAC: Started MAC %s\n", ethernet_mac_p->name_p);
+}
+
+
+/**
+ * Computes the bucket of the Ethernet MAC's hash table that a MAC address
+ * falls in: the top 6 bits of the bit-reversed complement of the CRC-32 of
+ * the address, as computed by the MAC for the destination address of
+ * received frames. The CRC is computed with a table generated at build time
+ * (see ethernet_crc32_table.c).
+ *
+ * @param mac_addr_p    Pointer to the MAC address
+ *
+ * @return hash bucket index
+ */
+static uint32_t ethernet_mac_hash_index(const struct ethernet_mac_address *mac_addr_p)
+{
+    uint32_t crc = UINT32_MAX;
+
+    for (size_t i = 0; i < sizeof mac_addr_p->bytes; i ++) {
+        crc = (crc >> 8) ^ g_ethernet_crc32_table[(crc ^ mac_addr_p->bytes[i]) & 0xff];
+    }
+
+    return __RBIT(~crc) >> 26; /* top 6 bits */
+}
+
+
+/**
+ * Adds a MAC address to the hash table of the given Ethernet MAC
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param mac_addr_p        Pointer to the MAC address
+ */
+static void ethernet_mac_hash_table_add(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct ethernet_mac_address *mac_addr_p)
+{
+    uint32_t reg_value;
+    uint32_t hash_bit_index;
+    volatile uint32_t *reg_p;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    uint8_t *const hash_table_counts = ethernet_mac_p->var_p->hash_table_counts;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
+
+    uint32_t hash_value = ethernet_mac_hash_index(mac_addr_p);
+
+    D_ASSERT(hash_value < ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS);
+    hash_table_counts[hash_value] ++;
+
+    D_ASSERT(hash_table_counts[hash_value] != 0);
+
+    /*
+     * Select either the upper or the lower hash table register from the
+     * top bit of the hash value:
+     */
+    if (hash_value & BIT(5)) {
+        reg_p = &mac_regs_p->MACHTHR;
+        hash_bit_index = hash_value & ~BIT(5);
+    } else {
+        reg_p = &mac_regs_p->MACHTLR;
+        hash_bit_index = hash_value;
+    }
+
+    D_ASSERT(hash_bit_index < 32);
+
+    /*
+     * Set hash bit in the hash table register, if not set already:
+     */
+    reg_value = READ_MMIO_REGISTER(reg_p);
+    if ((reg_value & BIT(hash_bit_index)) == 0) {
+        reg_value |= BIT(hash_bit_index);
+        WRITE_MMIO_REGISTER(reg_p, reg_value);
+    }
+}
+
+
+/**
+ * Removes a MAC address from the hash table of the given Ethernet MAC
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param mac_addr_p        Pointer to the MAC address
+ */
+static void ethernet_mac_hash_table_remove(const struct ethernet_mac_device *ethernet_mac_p,
+                                           struct ethernet_mac_address *mac_addr_p)
+{
+    uint32_t reg_value;
+    volatile uint32_t *reg_p;
+    uint32_t hash_bit_index;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    uint8_t *const hash_table_counts = ethernet_mac_p->var_p->hash_table_counts;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
+
+    uint32_t hash_value = ethernet_mac_hash_index(mac_addr_p);
+
+    D_ASSERT(hash_value < ETHERNET_MAC_HASH_TABLE_NUM_BUCKETS);
+    D_ASSERT(hash_table_counts[hash_value] != 0);
+
+    hash_table_counts[hash_value] --;
+
+    /*
+     * Select either the upper or the lower hash table register from the
+     * top bit of the hash value:
+     */
+    if (hash_value & BIT(5)) {
+        reg_p = &mac_regs_p->MACHTHR;
+        hash_bit_index = hash_value & ~BIT(5);
+    } else {
+        reg_p = &mac_regs_p->MACHTLR;
+        hash_bit_index = hash_value;
+    }
+
+    D_ASSERT(hash_bit_index < 32);
+
+    /*
+     * Clear hash bit in the hash table register, if hash bucket became empty:
+     */
+    reg_value = READ_MMIO_REGISTER(reg_p);
+    if (hash_table_counts[hash_value] == 0) {
+        reg_value &= ~BIT(hash_bit_index);
+        WRITE_MMIO_REGISTER(reg_p, reg_value);
+    }
+}
+
+
+/**
+ * Add a multicast MAC address to the given Ethernet device
+ */
+void ethernet_mac_add_multicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                     struct ethernet_mac_address *mac_addr_p)
+{
+    D_ASSERT(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK);
+    ethernet_mac_hash_table_add(ethernet_mac_p, mac_addr_p);
+}
+
+
+/**
+ * Remove a multicast MAC address from the given Ethernet device
+ */
+void ethernet_mac_remove_multicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct ethernet_mac_address *mac_addr_p)
+{
+    D_ASSERT(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK);
+    ethernet_mac_hash_table_remove(ethernet_mac_p, mac_addr_p);
+}
+
+
+/**
+ * Add an additional unicast MAC address to be accepted by the given
+ * Ethernet device, besides its own MAC address
+ *
+ * NOTE: As the hash table is shared with multicast addresses, unicast frames
+ * whose destination address falls in the bucket of a multicast address are
+ * also accepted. Upper layers drop them.
+ */
+void ethernet_mac_add_unicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct ethernet_mac_address *mac_addr_p)
+{
+    D_ASSERT(!(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK));
+    ethernet_mac_hash_table_add(ethernet_mac_p, mac_addr_p);
+}
+
+
+/**
+ * Remove an additional unicast MAC address from the given Ethernet device
+ */
+void ethernet_mac_remove_unicast_addr(const struct ethernet_mac_device *ethernet_mac_p,
+                                      struct ethernet_mac_address *mac_addr_p)
+{
+    D_ASSERT(!(mac_addr_p->bytes[0] & MAC_MULTICAST_ADDRESS_MASK));
+    ethernet_mac_hash_table_remove(ethernet_mac_p, mac_addr_p);
+}
+
+
+/**
+ * Configures the given Ethernet device for the link mode resolved by
+ * auto-negotiation. The Tx DMA is stopped, after the frame in progress,
+ * while the duplex mode is changed, so that no frame is truncated.
+ *
+ * @param ethernet_mac_p    Pointer to Ethernet MAC
+ * @param link_mode_p       Link mode (speed, duplex and flow control)
+ */
+void ethernet_mac_set_link_mode(const struct ethernet_mac_device *ethernet_mac_p,
+                                const struct ethernet_phy_link_mode *link_mode_p)
+{
+    uint32_t reg_value;
+    uint_fast16_t polling_count;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
+
+    /*
+     * Stop the Tx DMA after the frame in progress, if any:
+     */
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAOMR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMAOMR, reg_value & ~ETH_DMAOMR_ST_MASK);
+    restore_cpu_interrupts(int_mask);
+
+    polling_count = ETHERNET_MAC_TX_STOP_MAX_POLLING_COUNT;
+    while ((READ_MMIO_REGISTER(&mac_regs_p->DMASR) & ETH_DMASR_TPS_MASK) != 0 &&
+           polling_count != 0) {
+        polling_count --;
+    }
+
+    /*
+     * - Full duplex: enable full-duplex operation and, if negotiated,
+     *   send and honor PAUSE frames
+     * - Half duplex: disable receive own, so that the MAC does not
+     *   receive its own frames
+     * - Select 10 or 100 Mb/s operation of the RMII interface
+     * - Restart the Tx DMA
+     */
+    int_mask = disable_cpu_interrupts();
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->MACCR);
+    if (link_mode_p->full_duplex) {
+        reg_value |= ETH_MACCR_DM_MASK;
+        reg_value &= ~ETH_MACCR_ROD_MASK;
+    } else {
+        reg_value &= ~ETH_MACCR_DM_MASK;
+        reg_value |= ETH_MACCR_ROD_MASK;
+    }
+
+    if (link_mode_p->speed_100_mbps) {
+        reg_value |= ETH_MACCR_FES_MASK;
+    } else {
+        reg_value &= ~ETH_MACCR_FES_MASK;
+    }
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACCR, reg_value);
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->MACFCR);
+    if (link_mode_p->pause) {
+        reg_value |= ETH_MACFCR_TFCE_MASK | ETH_MACFCR_RFCE_MASK;
+    } else {
+        reg_value &= ~(ETH_MACFCR_TFCE_MASK | ETH_MACFCR_RFCE_MASK);
+    }
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACFCR, reg_value);
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAOMR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMAOMR, reg_value | ETH_DMAOMR_ST_MASK);
+    ethernet_mac_p->var_p->flow_control_on = link_mode_p->pause;
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Turns promiscuous mode on/off for the given Ethernet device. In promiscuous
+ * mode, all frames seen on the link are received, regardless of their
+ * destination MAC address. Otherwise, only frames whose destination address
+ * is the device's own MAC address, the broadcast address or an address that
+ * hits the hash table are received.
+ */
+void ethernet_mac_set_promiscuous_mode(const struct ethernet_mac_device *ethernet_mac_p,
+                                       bool on)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(ethernet_mac_p->var_p->initialized);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->MACFFR);
+    if (on) {
+        reg_value |= ETH_MACFFR_PM_MASK;
+    } else {
+        reg_value &= ~ETH_MACFFR_PM_MASK;
+    }
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->MACFFR, reg_value);
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Remove Tx buffer descriptors from the Tx ring, for those network packets
+ * that have already been transmitted, and return those packets to the pool
+ * of free Tx packets.
+ *
+ * NOTE: A Tx packet is considered transmitted only when the last Tx buffer
+ * descriptor of its frame has been released by the MAC, as the payload
+ * fragments chained to it may still being read by the MAC's DMA engine.
+ */
+RAM_FUNC static void ethernet_mac_drain_tx_ring(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    volatile struct ethernet_tx_buffer_descriptor *buffer_desc_p =
+        mac_var_p->tx_ring_read_cursor;
+
+    do {
+        D_ASSERT(buffer_desc_p >= &mac_var_p->tx_buffer_descriptors[0] &&
+                 buffer_desc_p <=
+                   &mac_var_p->tx_buffer_descriptors[ethernet_mac_p->tx_ring_num_entries - 1]);
+
+        D_ASSERT(buffer_desc_p != mac_var_p->tx_ring_write_cursor ||
+                 mac_var_p->tx_ring_entries_filled == ethernet_mac_p->tx_ring_num_entries);
+
+        uint32_t control = buffer_desc_p->control;
+
+        if (control & ETH_TX_BD_OWN_MASK) {
+            break;
+        }
+
+        unsigned int buffer_desc_index =
+            buffer_desc_p - &mac_var_p->tx_buffer_descriptors[0];
+        struct network_packet *tx_packet_p =
+            mac_var_p->tx_ring_packets[buffer_desc_index];
+
+        buffer_desc_p->data_buffer = NULL;
+        mac_var_p->tx_frame_octets += buffer_desc_p->data_length;
+        if (tx_packet_p != NULL) {
+            /*
+             * Last Tx buffer descriptor of a frame:
+             */
+            D_ASSERT(control & ETH_TX_BD_LAST_SEGMENT_MASK);
+            D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+            D_ASSERT(tx_packet_p->tx_buf_desc_p != NULL);
+            D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT);
+            D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_USE_BY_APP);
+
+            if (tx_packet_p->timestamp_flags & NET_PACKET_TX_TIMESTAMP_REQUESTED) {
+                if (control & ETH_TX_BD_TIMESTAMP_STATUS_MASK) {
+                    tx_packet_p->timestamp = buffer_desc_p->timestamp;
+                    tx_packet_p->timestamp_flags = NET_PACKET_TIMESTAMP_VALID;
+                } else {
+                    tx_packet_p->timestamp_flags = 0;
+                }
+            }
+
+            mac_var_p->tx_ring_packets[buffer_desc_index] = NULL;
+            NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+            tx_packet_p->tx_buf_desc_p = NULL;
+
+            /*
+             * The MAC has no Tx octet counter nor Tx error counters, so
+             * those are counted here:
+             */
+            if (control & ETH_TX_BD_ERROR_SUMMARY_MASK) {
+                net_layer2_count_drop(NET_LAYER2_DROP_TX_FAILED);
+                if (control & (ETH_TX_BD_LATE_COLLISION_MASK |
+                               ETH_TX_BD_EXCESSIVE_COLLISION_MASK)) {
+                    mac_var_p->stats.tx_collision_errors ++;
+                }
+
+                if (control & ETH_TX_BD_UNDERFLOW_ERROR_MASK) {
+                    mac_var_p->stats.tx_underruns ++;
+                }
+            } else {
+                mac_var_p->stats.tx_octets +=
+                    mac_var_p->tx_frame_octets + ETHERNET_MAC_CRC_SIZE;
+            }
+
+            mac_var_p->tx_frame_octets = 0;
+
+            D_ASSERT(mac_var_p->tx_ring_frames_filled != 0);
+            mac_var_p->tx_ring_frames_filled --;
+            if (tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE) {
+                /*
+                 * Free transmitted packet:
+                 */
+                NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+                net_layer2_free_tx_packet(tx_packet_p);
+            }
+        } else {
+            D_ASSERT((control & ETH_TX_BD_LAST_SEGMENT_MASK) == 0);
+        }
+
+        if (control & ETH_TX_BD_END_OF_RING_MASK) {
+            buffer_desc_p = &mac_var_p->tx_buffer_descriptors[0];
+        } else {
+            buffer_desc_p ++;
+        }
+
+        mac_var_p->tx_ring_entries_filled --;
+    } while (mac_var_p->tx_ring_entries_filled != 0);
+
+    mac_var_p->tx_ring_read_cursor = buffer_desc_p;
+}
+
+
+/**
+ * Carries the checksum validation results of the MAC from an Rx buffer
+ * descriptor to its Rx packet. Unlike the K64F ENET, the STM32 MAC does not
+ * report the length of the IP headers, so upper layers always parse them
+ * from the packet's data buffer (NET_PACKET_RX_HEADERS_PARSED is never set).
+ */
+static inline void
+ethernet_mac_get_rx_checksum_status(
+    volatile const struct ethernet_rx_buffer_descriptor *buffer_desc_p,
+    struct network_packet *rx_packet_p)
+{
+    uint32_t status = buffer_desc_p->status;
+    uint8_t checksum_flags = 0;
+
+    if (status & ETH_RX_BD_EXTENDED_STATUS_MASK) {
+        uint32_t extended_status = buffer_desc_p->extended_status;
+
+        if (extended_status & ETH_RX_BD_IPv6_FRAME_MASK) {
+            checksum_flags |= NET_PACKET_RX_IPv6_FRAME;
+        }
+
+#       ifdef ETH_CHECKSUM_OFFLOAD
+        /*
+         * The MAC validated the checksums of the frame, only if it is an
+         * IP frame that carries a TCP, UDP or ICMP payload (the payload
+         * type is 0 otherwise, for example for IPv4 fragments):
+         */
+        if ((extended_status &
+             (ETH_RX_BD_IPv4_FRAME_MASK | ETH_RX_BD_IPv6_FRAME_MASK)) != 0 &&
+            !(extended_status & ETH_RX_BD_CHECKSUM_BYPASSED_MASK) &&
+            GET_BIT_FIELD(extended_status, ETH_RX_BD_PAYLOAD_TYPE_MASK,
+                          ETH_RX_BD_PAYLOAD_TYPE_SHIFT) != 0) {
+            checksum_flags |= NET_PACKET_RX_CHECKSUMS_VALIDATED;
+            if (!(extended_status & ETH_RX_BD_IP_HEADER_CHECKSUM_ERROR_MASK)) {
+                checksum_flags |= NET_PACKET_RX_IP_HEADER_CHECKSUM_OK;
+            }
+
+            if (!(extended_status & ETH_RX_BD_PAYLOAD_CHECKSUM_ERROR_MASK)) {
+                checksum_flags |= NET_PACKET_RX_PROTOCOL_CHECKSUM_OK;
+            }
+        }
+#       endif
+    }
+
+    if (status & ETH_RX_BD_VLAN_FRAME_MASK) {
+        checksum_flags |= NET_PACKET_RX_VLAN_FRAME;
+    }
+
+    rx_packet_p->rx_checksum_flags = checksum_flags;
+    rx_packet_p->rx_protocol_type = 0;
+    rx_packet_p->rx_header_length = 0;
+}
+
+
+/**
+ * Returns the Rx buffer descriptor that follows a given one in the Rx ring
+ */
+static inline volatile struct ethernet_rx_buffer_descriptor *
+ethernet_mac_next_rx_buffer_descriptor(
+    struct ethernet_mac_device_var *mac_var_p,
+    volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p)
+{
+    if (buffer_desc_p->control & ETH_RX_BD_END_OF_RING_MASK) {
+        return &mac_var_p->rx_buffer_descriptors[0];
+    } else {
+        return buffer_desc_p + 1;
+    }
+}
+
+
+/**
+ * Removes the Rx buffer descriptor of the next received frame from the Rx
+ * ring, if the Ethernet MAC has already received the whole frame. Frames
+ * that do not fit in one Rx data buffer span several Rx buffer descriptors,
+ * and each of these is returned as a failed Rx packet.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return Pointer to the Rx packet of the received frame, or NULL if
+ *         the Rx ring has no completely received frames
+ */
+static struct network_packet *
+ethernet_mac_remove_rx_packet(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    volatile struct ethernet_rx_buffer_descriptor *buffer_desc_p =
+        mac_var_p->rx_ring_read_cursor;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+
+    if (mac_var_p->rx_ring_entries_filled == 0) {
+        return NULL;
+    }
+
+    D_ASSERT(buffer_desc_p >= &mac_var_p->rx_buffer_descriptors[0] &&
+             buffer_desc_p <=
+               &mac_var_p->rx_buffer_descriptors[ethernet_mac_p->rx_ring_num_entries - 1]);
+
+    D_ASSERT(buffer_desc_p != mac_var_p->rx_ring_write_cursor ||
+             mac_var_p->rx_ring_entries_filled == ethernet_mac_p->rx_ring_num_entries);
+
+    uint32_t status = buffer_desc_p->status;
+
+    if (status & ETH_RX_BD_OWN_MASK) {
+        return NULL;
+    }
+
+    /*
+     * Frames with checksum errors are not failed frames, as those are
+     * counted by upper layers (see ethernet_mac_get_rx_checksum_status()):
+     */
+    bool frame_failed =
+        (status & (ETH_RX_BD_FIRST_DESCRIPTOR_MASK |
+                   ETH_RX_BD_LAST_DESCRIPTOR_MASK)) !=
+            (ETH_RX_BD_FIRST_DESCRIPTOR_MASK | ETH_RX_BD_LAST_DESCRIPTOR_MASK) ||
+        (status & (ETH_RX_BD_DESCRIPTOR_ERROR_MASK |
+                   ETH_RX_BD_LENGTH_ERROR_MASK |
+                   ETH_RX_BD_OVERFLOW_ERROR_MASK |
+                   ETH_RX_BD_LATE_COLLISION_MASK |
+                   ETH_RX_BD_WATCHDOG_TIMEOUT_MASK |
+                   ETH_RX_BD_RECEIVE_ERROR_MASK |
+                   ETH_RX_BD_CRC_ERROR_MASK)) != 0;
+
+    uint_fast16_t frame_length = GET_BIT_FIELD(status,
+                                               ETH_RX_BD_FRAME_LENGTH_MASK,
+                                               ETH_RX_BD_FRAME_LENGTH_SHIFT);
+
+    if (!frame_failed && frame_length <= ETHERNET_MAC_CRC_SIZE) {
+        frame_failed = true;
+    }
+
+    /*
+     * Unlink the Rx packet from the Rx buffer descriptor and advance the
+     * Rx ring read cursor:
+     */
+    uint_fast16_t buffer_desc_index =
+        buffer_desc_p - &mac_var_p->rx_buffer_descriptors[0];
+    struct network_packet *rx_packet_p =
+        mac_var_p->rx_ring_packets[buffer_desc_index];
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_TRANSIT);
+    D_ASSERT(!(rx_packet_p->state_flags & NET_PACKET_IN_RX_USE_BY_APP));
+    D_ASSERT((uint8_t *)rx_packet_p->data_buffer + sizeof(uint16_t) ==
+             buffer_desc_p->data_buffer);
+
+    NET_PACKET_CLEAR_STATE_FLAG(rx_packet_p, NET_PACKET_IN_RX_TRANSIT);
+    rx_packet_p->rx_buf_desc_p = NULL;
+    rx_packet_p->next_fragment_p = NULL;
+    buffer_desc_p->data_buffer = NULL;
+    mac_var_p->rx_ring_packets[buffer_desc_index] = NULL;
+
+    mac_var_p->rx_ring_entries_filled --;
+    mac_var_p->rx_ring_read_cursor =
+        ethernet_mac_next_rx_buffer_descriptor(mac_var_p, buffer_desc_p);
+
+    if (frame_failed) {
+        net_layer2_count_drop(NET_LAYER2_DROP_RX_BAD_FRAME);
+        rx_packet_p->state_flags = NET_PACKET_RX_FAILED;
+        return rx_packet_p;
+    }
+
+    D_ASSERT(frame_length <= ETHERNET_MAC_MAX_RX_FRAME_SIZE);
+
+    /*
+     * The frame length reported by the MAC includes the CRC, which is not
+     * stripped, and the packet's total length includes the 2-byte alignment
+     * padding (as with the K64F ENET's SHIFT16 option):
+     */
+    rx_packet_p->total_length =
+        frame_length - ETHERNET_MAC_CRC_SIZE + sizeof(uint16_t);
+
+    mac_var_p->stats.rx_frames ++;
+    mac_var_p->stats.rx_octets += frame_length;
+
+    ethernet_mac_get_rx_checksum_status(buffer_desc_p, rx_packet_p);
+    if (status & ETH_RX_BD_TIMESTAMP_VALID_MASK) {
+        rx_packet_p->timestamp = buffer_desc_p->timestamp;
+        rx_packet_p->timestamp_flags = NET_PACKET_TIMESTAMP_VALID;
+    } else {
+        rx_packet_p->timestamp_flags = 0;
+    }
+
+    NET_RX_PACKET_LATENCY_BEGIN(rx_packet_p);
+    return rx_packet_p;
+}
+
+
+/**
+ * Updates the high-water mark of received frames found in the Rx ring
+ * in one pass
+ */
+static inline void
+ethernet_mac_update_rx_received_high_water_mark(
+    struct ethernet_mac_device_var *mac_var_p,
+    uint16_t entries_received)
+{
+    if (entries_received > mac_var_p->rx_ring_entries_received_high_water_mark) {
+        mac_var_p->rx_ring_entries_received_high_water_mark = entries_received;
+    }
+}
+
+
+/**
+ * Remove Rx buffer descriptors from the Rx ring, for those network packets
+ * that have already been received, and enqueue those packets at the corresponding
+ * layer2 end point's Rx packet queue, as a single chain.
+ */
+RAM_FUNC static void ethernet_mac_drain_rx_ring(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    struct network_packet *head_packet_p = NULL;
+    struct network_packet *tail_packet_p = NULL;
+    uint16_t entries_received = 0;
+    PERF_PROBE_BEGIN(PERF_PROBE_ENET_RX_RING_DRAIN);
+
+    for ( ; ; ) {
+        struct network_packet *rx_packet_p =
+            ethernet_mac_remove_rx_packet(ethernet_mac_p);
+
+        if (rx_packet_p == NULL) {
+            break;
+        }
+
+        D_ASSERT(NET_PACKET_NOT_IN_QUEUE(rx_packet_p));
+        if (tail_packet_p == NULL) {
+            head_packet_p = rx_packet_p;
+        } else {
+            tail_packet_p->next_p = rx_packet_p;
+        }
+
+        tail_packet_p = rx_packet_p;
+        entries_received ++;
+    }
+
+    if (entries_received != 0) {
+        /*
+         * Enqueue received packets at the corresponding layer-2 end point:
+         */
+        net_layer2_enqueue_rx_packet_chain(mac_var_p->layer2_end_point_p,
+                                           head_packet_p, tail_packet_p,
+                                           entries_received);
+    }
+
+    ethernet_mac_update_rx_received_high_water_mark(mac_var_p, entries_received);
+    PERF_PROBE_END(PERF_PROBE_ENET_RX_RING_DRAIN);
+}
+
+
+/**
+ * Assigns an Rx packet to the next available Rx descriptor in the Rx ring and
+ * gives that descriptor to the MAC. The caller is responsible for
+ * resuming the Rx DMA.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_post_rx_packet(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct network_packet *rx_packet_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+    D_ASSERT(mac_var_p->rx_ring_entries_filled < ethernet_mac_p->rx_ring_num_entries);
+
+    volatile struct ethernet_rx_buffer_descriptor *rx_buf_desc_p =
+        mac_var_p->rx_ring_write_cursor;
+
+    D_ASSERT((rx_buf_desc_p->status & ETH_RX_BD_OWN_MASK) == 0);
+    D_ASSERT(rx_buf_desc_p->data_buffer == NULL);
+    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+    D_ASSERT(rx_packet_p->data_buffer_size == NET_PACKET_DATA_BUFFER_SIZE);
+    rx_buf_desc_p->data_buffer =
+        (uint8_t *)rx_packet_p->data_buffer + sizeof(uint16_t);
+    rx_packet_p->rx_buf_desc_p = rx_buf_desc_p;
+    mac_var_p->rx_ring_packets[rx_buf_desc_p -
+                               &mac_var_p->rx_buffer_descriptors[0]] = rx_packet_p;
+
+    D_ASSERT(!(rx_packet_p->state_flags & NET_PACKET_IN_RX_TRANSIT));
+
+    rx_packet_p->state_flags = NET_PACKET_IN_RX_TRANSIT;
+
+    /*
+     * Give buffer descriptor to the MAC ("available for reception"), after
+     * the data buffer pointer has been written:
+     */
+    __DMB();
+    rx_buf_desc_p->status = ETH_RX_BD_OWN_MASK;
+
+    /*
+     * Advance Rx ring write cursor:
+     */
+    if (rx_buf_desc_p->control & ETH_RX_BD_END_OF_RING_MASK) {
+        mac_var_p->rx_ring_write_cursor = mac_var_p->rx_buffer_descriptors;
+    } else {
+        mac_var_p->rx_ring_write_cursor ++;
+    }
+
+    mac_var_p->rx_ring_entries_filled ++;
+}
+
+
+/**
+ * Refills the Rx ring with Rx packets from the shared Rx packet pool, so that
+ * the Ethernet MAC does not run out of empty Rx buffers while the received
+ * frames are being processed by upper layers.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return true, if at least one Rx descriptor was posted
+ * @return false, otherwise
+ */
+RAM_FUNC static bool ethernet_mac_refill_rx_ring(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    bool refilled = false;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+
+    while (mac_var_p->rx_ring_entries_filled < ethernet_mac_p->rx_ring_num_entries) {
+        struct network_packet *rx_packet_p =
+            net_layer2_take_rx_packet(mac_var_p->layer2_end_point_p);
+
+        if (rx_packet_p == NULL) {
+            break;
+        }
+
+        rx_packet_p->state_flags = 0;
+        ethernet_mac_post_rx_packet(ethernet_mac_p, rx_packet_p);
+        refilled = true;
+    }
+
+    if (mac_var_p->rx_ring_entries_filled == 0) {
+        mac_var_p->rx_ring_starved_count ++;
+    }
+
+    /*
+     * If the receiver tasks are falling behind, have the link partner back
+     * off, instead of letting the MAC drop frames for lack of Rx buffers.
+     * One PAUSE frame is sent each time the Rx ring drops below the
+     * threshold; the link partner resumes when its duration expires:
+     */
+    if (mac_var_p->rx_ring_entries_filled < ETHERNET_MAC_RX_RING_XOFF_THRESHOLD) {
+        if (mac_var_p->flow_control_on && !mac_var_p->rx_ring_xoff_sent) {
+            ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+            uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->MACFCR);
+
+            /*
+             * FCB reads as 1 while a PAUSE frame is being sent:
+             */
+            if ((reg_value & ETH_MACFCR_FCB_MASK) == 0) {
+                WRITE_MMIO_REGISTER(&mac_regs_p->MACFCR,
+                                    reg_value | ETH_MACFCR_FCB_MASK);
+                mac_var_p->rx_ring_xoff_sent = true;
+                mac_var_p->rx_ring_xoff_count ++;
+            }
+        }
+    } else {
+        mac_var_p->rx_ring_xoff_sent = false;
+    }
+
+    return refilled;
+}
+
+
+/**
+ * In ETHERNET_MAC_TX_LAZY_RECLAIM_MODE, reclaims the Tx buffer descriptors of
+ * frames already transmitted, as most frames do not generate a Tx interrupt
+ * in that mode.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_lazy_reclaim_tx_ring(
+    const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    if (mac_var_p->tx_mode == ETHERNET_MAC_TX_LAZY_RECLAIM_MODE &&
+        mac_var_p->tx_ring_entries_filled != 0) {
+        ethernet_mac_drain_tx_ring(ethernet_mac_p);
+    }
+}
+
+
+/**
+ * Tells if a frame that takes a given number of Tx buffer descriptors can be
+ * queued in the Tx ring. Enough free Tx buffer descriptors are always kept to
+ * queue every Tx packet not yet queued in the ring, using one Tx buffer
+ * descriptor for each, so that ethernet_mac_start_xmit() never finds the Tx
+ * ring full.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static bool ethernet_mac_tx_ring_has_room(
+    const struct ethernet_mac_device *ethernet_mac_p,
+    uint_fast8_t num_buffer_descs)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    uint_fast16_t free_entries = ethernet_mac_p->tx_ring_num_entries -
+                                 mac_var_p->tx_ring_entries_filled;
+    uint_fast16_t reserved_entries = NET_MAX_TX_PACKETS -
+                                     (mac_var_p->tx_ring_frames_filled + 1);
+
+    D_ASSERT(mac_var_p->tx_ring_frames_filled < NET_MAX_TX_PACKETS);
+    return free_entries >= num_buffer_descs + reserved_entries;
+}
+
+
+/**
+ * Fills the Tx buffer descriptor at the Tx ring write cursor and advances
+ * the cursor. The descriptor is not given to the MAC yet.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return pointer to the Tx buffer descriptor filled
+ */
+static volatile struct ethernet_tx_buffer_descriptor *
+ethernet_mac_fill_tx_buffer_descriptor(
+    const struct ethernet_mac_device *ethernet_mac_p,
+    const void *data_p,
+    uint16_t data_length,
+    bool first_in_frame,
+    bool last_in_frame)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(mac_var_p->tx_ring_entries_filled < ethernet_mac_p->tx_ring_num_entries);
+    D_ASSERT(mac_var_p->tx_ring_write_cursor != mac_var_p->tx_ring_read_cursor ||
+             mac_var_p->tx_ring_entries_filled == 0);
+    D_ASSERT(data_length != 0);
+
+    volatile struct ethernet_tx_buffer_descriptor *tx_buf_desc_p =
+        mac_var_p->tx_ring_write_cursor;
+    uint32_t control = tx_buf_desc_p->control & ETH_TX_BD_END_OF_RING_MASK;
+
+    D_ASSERT((tx_buf_desc_p->control & ETH_TX_BD_OWN_MASK) == 0);
+    D_ASSERT(tx_buf_desc_p->data_buffer == NULL);
+
+    /*
+     * NOTE: The MAC's DMA engine only reads from the data buffer
+     */
+    tx_buf_desc_p->data_buffer = (void *)data_p;
+    tx_buf_desc_p->data_length = data_length;
+
+    if (first_in_frame) {
+        control |= ETH_TX_BD_FIRST_SEGMENT_MASK;
+
+#       ifdef ETH_CHECKSUM_OFFLOAD
+        /*
+         * Automatically insert the IP header checksum and the layer-4
+         * checksum (for TCP, UDP, ICMP):
+         */
+        SET_BIT_FIELD(control, ETH_TX_BD_CHECKSUM_INSERTION_MASK,
+                      ETH_TX_BD_CHECKSUM_INSERTION_SHIFT,
+                      ETH_TX_BD_CHECKSUM_INSERTION_FULL);
+#       endif
+    }
+
+    if (last_in_frame) {
+        control |= ETH_TX_BD_LAST_SEGMENT_MASK;
+    }
+
+    tx_buf_desc_p->control = control;
+
+    /*
+     * Advance Tx ring write cursor:
+     */
+    if (control & ETH_TX_BD_END_OF_RING_MASK) {
+        mac_var_p->tx_ring_write_cursor = mac_var_p->tx_buffer_descriptors;
+    } else {
+        mac_var_p->tx_ring_write_cursor ++;
+    }
+
+    mac_var_p->tx_ring_entries_filled ++;
+    return tx_buf_desc_p;
+}
+
+
+/**
+ * Queues a Tx packet, followed by the given payload fragments, in the
+ * Tx ring, giving its Tx descriptors to the MAC.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_queue_tx_frame(const struct ethernet_mac_device *ethernet_mac_p,
+                                        struct network_packet *tx_packet_p,
+                                        const struct ethernet_tx_fragment fragments[],
+                                        uint_fast8_t num_fragments)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    volatile struct ethernet_tx_buffer_descriptor *last_tx_buf_desc_p;
+
+    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
+    D_ASSERT(tx_packet_p->state_flags & NET_PACKET_IN_TX_USE_BY_APP);
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
+    D_ASSERT(tx_packet_p->total_length <= tx_packet_p->data_buffer_size);
+    D_ASSERT(tx_packet_p->total_length > sizeof(uint16_t));
+
+    /*
+     * The 2-byte alignment padding at the beginning of the data buffer is
+     * not transmitted (what the SHIFT16 option does on the K64F):
+     */
+    volatile struct ethernet_tx_buffer_descriptor *first_tx_buf_desc_p =
+        ethernet_mac_fill_tx_buffer_descriptor(
+            ethernet_mac_p,
+            (uint8_t *)tx_packet_p->data_buffer + sizeof(uint16_t),
+            tx_packet_p->total_length - sizeof(uint16_t),
+            true,
+            num_fragments == 0);
+
+    last_tx_buf_desc_p = first_tx_buf_desc_p;
+    for (uint_fast8_t i = 0; i < num_fragments; i ++) {
+        last_tx_buf_desc_p =
+            ethernet_mac_fill_tx_buffer_descriptor(ethernet_mac_p,
+                                                   fragments[i].data_p,
+                                                   fragments[i].length,
+                                                   false,
+                                                   i == num_fragments - 1);
+    }
+
+    /*
+     * Decide if the MAC is to generate a Tx interrupt when this frame
+     * has been transmitted:
+     */
+    if (mac_var_p->tx_mode == ETHERNET_MAC_TX_LAZY_RECLAIM_MODE) {
+        mac_var_p->tx_frames_since_last_interrupt ++;
+        if (mac_var_p->tx_frames_since_last_interrupt ==
+                ETHERNET_MAC_TX_LAZY_RECLAIM_INTERRUPT_INTERVAL ||
+            (tx_packet_p->state_flags & NET_PACKET_TX_INTERRUPT_REQUESTED)) {
+            last_tx_buf_desc_p->control |= ETH_TX_BD_INTERRUPT_MASK;
+            mac_var_p->tx_frames_since_last_interrupt = 0;
+        }
+    } else {
+        last_tx_buf_desc_p->control |= ETH_TX_BD_INTERRUPT_MASK;
+    }
+
+    if (tx_packet_p->state_flags & NET_PACKET_TX_INTERRUPT_REQUESTED) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_TX_INTERRUPT_REQUESTED);
+    }
+
+    /*
+     * The timestamp is requested in the first Tx buffer descriptor of the
+     * frame, but the MAC stores it in the last one:
+     */
+    if (tx_packet_p->timestamp_flags & NET_PACKET_TX_TIMESTAMP_REQUESTED) {
+        first_tx_buf_desc_p->control |= ETH_TX_BD_TIMESTAMP_MASK;
+    }
+
+    tx_packet_p->tx_buf_desc_p = first_tx_buf_desc_p;
+    NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+    mac_var_p->tx_ring_packets[last_tx_buf_desc_p -
+                               &mac_var_p->tx_buffer_descriptors[0]] = tx_packet_p;
+
+    mac_var_p->tx_ring_frames_filled ++;
+    if (mac_var_p->tx_ring_entries_filled >
+        mac_var_p->tx_ring_entries_filled_high_water_mark) {
+        mac_var_p->tx_ring_entries_filled_high_water_mark =
+            mac_var_p->tx_ring_entries_filled;
+    }
+
+    /*
+     * Give the Tx buffer descriptors of the frame to the MAC, the first one
+     * after all the other ones, so that the MAC does not start
+     * transmitting the frame before all of them are ready:
+     */
+    volatile struct ethernet_tx_buffer_descriptor *tx_buf_desc_p =
+        last_tx_buf_desc_p;
+
+    __DMB();
+    while (tx_buf_desc_p != first_tx_buf_desc_p) {
+        tx_buf_desc_p->control |= ETH_TX_BD_OWN_MASK;
+        if (tx_buf_desc_p == &mac_var_p->tx_buffer_descriptors[0]) {
+            tx_buf_desc_p =
+                &mac_var_p->tx_buffer_descriptors[ethernet_mac_p->tx_ring_num_entries - 1];
+        } else {
+            tx_buf_desc_p --;
+        }
+    }
+
+    __DMB();
+    first_tx_buf_desc_p->control |= ETH_TX_BD_OWN_MASK;
+}
+
+
+/**
+ * Initiates the transmission of a Tx packet, by assigning it to the next
+ * available Tx descriptor in the Tx descriptor ring, giving that descriptor
+ * to the MAC and resuming the Tx DMA.
+ */
+void ethernet_mac_start_xmit(const struct ethernet_mac_device *ethernet_mac_p,
+                             struct network_packet *tx_packet_p)
+{
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->total_length != 0);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    D_ASSERT(ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1));
+    ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p, NULL, 0);
+
+    restore_cpu_interrupts(int_mask);
+
+    /*
+     * Resume the Tx DMA, to start transmitting the frame:
+     * (the Tx descriptor ring has at least one descriptor owned by the MAC)
+     */
+    __DSB();
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMATPDR, 0);
+}
+
+
+/**
+ * Initiates the transmission of a batch of Tx packets, by assigning each of
+ * them to the next available Tx descriptor in the Tx descriptor ring, within
+ * a single critical section, and then resuming the Tx DMA only once for the
+ * whole batch.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ * @param tx_packets: array of Tx packets to transmit, in order
+ * @param num_packets: number of entries in tx_packets[]
+ */
+void ethernet_mac_start_xmit_batch(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *tx_packets[],
+                                   uint_fast8_t num_packets)
+{
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(num_packets != 0 && num_packets <= NET_MAX_TX_PACKETS);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    for (uint_fast8_t i = 0; i < num_packets; i ++) {
+        struct network_packet *tx_packet_p = tx_packets[i];
+
+        D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+        D_ASSERT(tx_packet_p->total_length != 0);
+        D_ASSERT(ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1));
+        ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p, NULL, 0);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    /*
+     * Resume the Tx DMA, to start transmitting the frames:
+     */
+    __DSB();
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMATPDR, 0);
+}
+
+
+/**
+ * Initiates the transmission of a frame made of the data in a Tx packet's
+ * data buffer (Ethernet header and any other protocol headers), followed
+ * by one or more payload fragments that are not copied to the Tx packet.
+ * Each payload fragment takes its own Tx buffer descriptor in the Tx ring.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ * @param tx_packet_p: Tx packet. Its total_length field contains only the
+ *                     length of the data in its data buffer.
+ * @param fragments: payload fragments to be transmitted after the data in
+ *                   the Tx packet's data buffer. This array can be reused
+ *                   as soon as this function returns, but the fragments'
+ *                   data buffers must not be modified until the Tx packet
+ *                   has been transmitted.
+ * @param num_fragments: number of entries in fragments[]
+ *
+ * @return 0, on success
+ * @return error code, if there are not enough free entries in the Tx ring
+ *         at this time
+ */
+error_t ethernet_mac_start_xmit_gather(const struct ethernet_mac_device *ethernet_mac_p,
+                                       struct network_packet *tx_packet_p,
+                                       const struct ethernet_tx_fragment fragments[],
+                                       uint_fast8_t num_fragments)
+{
+    error_t error = 0;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->total_length != 0);
+    D_ASSERT(num_fragments <= ETHERNET_MAC_MAX_TX_FRAGMENTS);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    if (ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1 + num_fragments)) {
+        ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p,
+                                    fragments, num_fragments);
+    } else {
+        error = CAPTURE_ERROR("Ethernet MAC Tx ring full", ethernet_mac_p,
+                              num_fragments);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    if (error == 0) {
+        /*
+         * Resume the Tx DMA, to start transmitting the frame:
+         */
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->DMATPDR, 0);
+    }
+
+    return error;
+}
+
+
+/**
+ * Reclaims the Tx buffer descriptors of all the frames that have already
+ * been transmitted, returning to the Tx packet pool those Tx packets that
+ * were to be freed after transmission. This is only needed in
+ * ETHERNET_MAC_TX_LAZY_RECLAIM_MODE.
+ */
+void ethernet_mac_reclaim_tx_packets(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (mac_var_p->tx_ring_entries_filled != 0) {
+        ethernet_mac_drain_tx_ring(ethernet_mac_p);
+    }
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Returns the number of frames queued in the Ethernet MAC's Tx ring that
+ * have not been reclaimed yet. In ETHERNET_MAC_TX_LAZY_RECLAIM_MODE, the Tx
+ * buffer descriptors of frames already transmitted are reclaimed first.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ *
+ * @return number of frames in the Tx ring
+ */
+uint_fast16_t ethernet_mac_get_tx_ring_frames(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    uint_fast16_t num_frames;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+    num_frames = mac_var_p->tx_ring_frames_filled;
+    restore_cpu_interrupts(int_mask);
+    return num_frames;
+}
+
+
+/**
+ * Re-post the given Rx packet to the Ethernet MAC's Rx ring, by assigning it to
+ * the next available Rx descriptor in the Rx descriptor ring, giving that
+ * descriptor to the MAC and resuming the Rx DMA. If the Rx ring is already
+ * fully posted, the Rx packet is given back to the shared Rx packet pool
+ * instead.
+ */
+void ethernet_mac_repost_rx_packet(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *rx_packet_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP ||
+             rx_packet_p->state_flags == NET_PACKET_RX_FAILED);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (mac_var_p->rx_ring_entries_filled == ethernet_mac_p->rx_ring_num_entries) {
+        D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+        net_layer2_give_rx_packet(rx_packet_p);
+        restore_cpu_interrupts(int_mask);
+    } else {
+        ethernet_mac_post_rx_packet(ethernet_mac_p, rx_packet_p);
+        restore_cpu_interrupts(int_mask);
+
+        /*
+         * Resume the Rx DMA, in case it was suspended for lack of Rx buffers:
+         */
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->DMARPDR, 0);
+    }
+}
+
+
+/**
+ * Removes up to 'budget' received frames from the Rx ring of an Ethernet MAC
+ * operating in polled Rx mode. If the Rx ring is found empty before the
+ * budget is exhausted, the Rx interrupt is unmasked, so that the next
+ * received frame wakes up the caller again.
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param rx_packets        Array where the received Rx packets are returned
+ * @param budget            Maximum number of Rx packets to return (size of
+ *                          the 'rx_packets' array)
+ *
+ * @return number of Rx packets returned in 'rx_packets'. If this number is
+ *         less than 'budget', the Rx ring has been drained and the Rx
+ *         interrupt has been re-enabled.
+ */
+uint_fast16_t ethernet_mac_poll_rx(const struct ethernet_mac_device *ethernet_mac_p,
+                                   struct network_packet *rx_packets[],
+                                   uint_fast16_t budget)
+{
+    uint32_t reg_value;
+    uint_fast16_t num_received = 0;
+    bool refilled = false;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(budget != 0);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(mac_var_p->rx_mode == ETHERNET_MAC_RX_POLLED_MODE);
+
+    /*
+     * Clear any stale Rx interrupt source (w1c), so that only frames received
+     * after this point can trigger a new Rx interrupt once it is unmasked:
+     */
+    WRITE_MMIO_REGISTER(&mac_regs_p->DMASR, ETH_DMASR_RS_MASK);
+
+    while (num_received < budget) {
+        /*
+         * Interrupts are disabled for one frame at a time only, to keep
+         * interrupt latency low while the Rx ring is being drained:
+         */
+        uint32_t int_mask = disable_cpu_interrupts();
+        struct network_packet *rx_packet_p =
+            ethernet_mac_remove_rx_packet(ethernet_mac_p);
+
+        if (rx_packet_p != NULL) {
+            refilled |= ethernet_mac_refill_rx_ring(ethernet_mac_p);
+        }
+
+        restore_cpu_interrupts(int_mask);
+        if (rx_packet_p == NULL) {
+            break;
+        }
+
+        rx_packets[num_received] = rx_packet_p;
+        num_received ++;
+    }
+
+    if (refilled) {
+        /*
+         * Resume the Rx DMA, in case it was suspended for lack of Rx buffers:
+         */
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->DMARPDR, 0);
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ethernet_mac_update_rx_received_high_water_mark(mac_var_p, num_received);
+    if (num_received < budget) {
+        /*
+         * The Rx ring is empty. Unmask the Rx interrupt. If a frame was
+         * received after the last check, the RS bit is already set in DMASR,
+         * so the Rx interrupt will fire right away:
+         */
+        reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAIER);
+        reg_value |= ETH_DMAIER_RIE_MASK;
+        WRITE_MMIO_REGISTER(&mac_regs_p->DMAIER, reg_value);
+    }
+
+    restore_cpu_interrupts(int_mask);
+    return num_received;
+}
+
+
+/**
+ * Obtains a snapshot of the occupancy statistics of the Tx/Rx rings
+ * of the given Ethernet MAC
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param ring_stats_p      Area where the ring statistics are to be returned
+ */
+void ethernet_mac_get_ring_stats(const struct ethernet_mac_device *ethernet_mac_p,
+                                 struct ethernet_mac_ring_stats *ring_stats_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+
+    D_ASSERT(mac_var_p->initialized);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    ring_stats_p->tx_ring_num_entries = ethernet_mac_p->tx_ring_num_entries;
+    ring_stats_p->tx_ring_entries_filled = mac_var_p->tx_ring_entries_filled;
+    ring_stats_p->tx_ring_entries_filled_high_water_mark =
+        mac_var_p->tx_ring_entries_filled_high_water_mark;
+    ring_stats_p->rx_ring_num_entries = ethernet_mac_p->rx_ring_num_entries;
+    ring_stats_p->rx_ring_entries_filled = mac_var_p->rx_ring_entries_filled;
+    ring_stats_p->rx_ring_entries_received_high_water_mark =
+        mac_var_p->rx_ring_entries_received_high_water_mark;
+    ring_stats_p->rx_ring_starved_count = mac_var_p->rx_ring_starved_count;
+    ring_stats_p->rx_ring_xoff_count = mac_var_p->rx_ring_xoff_count;
+    ring_stats_p->tx_launch_queue_length = mac_var_p->tx_launch_queue_length;
+    ring_stats_p->tx_launched_count = mac_var_p->tx_launched_count;
+    ring_stats_p->tx_launch_late_count = mac_var_p->tx_launch_late_count;
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Reads the nanoseconds part (subseconds register) of the IEEE 1588 timer.
+ * With digital rollover enabled, it counts from 0 to 999,999,999, like the
+ * K64F ENET's timer.
+ */
+static uint32_t ethernet_mac_capture_ieee_1588_time(ETH_TypeDef *mac_regs_p)
+{
+    return READ_MMIO_REGISTER(&mac_regs_p->PTPTSLR) & ETH_PTPTSLR_STSS_MASK;
+}
+
+
+/**
+ * Arms the target time trigger of the IEEE 1588 timer to fire at a given
+ * nanoseconds value, or disables it. Either way, any pending trigger
+ * status is cleared.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void ethernet_mac_arm_tx_launch_timer(ETH_TypeDef *mac_regs_p,
+                                             bool enable,
+                                             uint32_t compare_time_ns)
+{
+    uint32_t reg_value;
+    uint32_t seconds;
+    uint32_t now_ns;
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->PTPTSCR);
+    reg_value &= ~ETH_PTPTSCR_TSITE_MASK;
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSCR, reg_value);
+
+    /*
+     * Reading PTPTSSR clears the trigger status (and MACSR's TSTS):
+     */
+    (void)READ_MMIO_REGISTER(&mac_regs_p->PTPTSSR);
+    if (!enable) {
+        return;
+    }
+
+    /*
+     * The target time is compared against the whole timer (seconds and
+     * nanoseconds), so a compare time that has already passed in the
+     * current second is taken as a compare time in the next second:
+     */
+    do {
+        seconds = READ_MMIO_REGISTER(&mac_regs_p->PTPTSHR);
+        now_ns = READ_MMIO_REGISTER(&mac_regs_p->PTPTSLR) & ETH_PTPTSLR_STSS_MASK;
+    } while (seconds != READ_MMIO_REGISTER(&mac_regs_p->PTPTSHR));
+
+    if (compare_time_ns <= now_ns) {
+        seconds ++;
+    }
+
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTTHR, seconds);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTTLR, compare_time_ns);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSCR, reg_value | ETH_PTPTSCR_TSITE_MASK);
+}
+
+
+/**
+ * Calculates how far ahead in the future a launch time is, in nanoseconds.
+ * Launch times that have already passed are reported as 0.
+ */
+static uint32_t ethernet_mac_get_tx_launch_lead_ns(uint32_t now_ns,
+                                                   uint32_t launch_time_ns)
+{
+    uint32_t lead_ns = ETHERNET_MAC_IEEE_1588_TIME_DELTA_NS(now_ns, launch_time_ns);
+
+    return lead_ns <= ETHERNET_MAC_TX_LAUNCH_MAX_LEAD_NS ? lead_ns : 0;
+}
+
+
+/**
+ * Queues in the Tx ring the launch-time Tx frames whose launch time is less
+ * than ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS ahead, and arms the target time
+ * trigger of the IEEE 1588 timer for the next frame due, if any.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @return true, if any frame was queued in the Tx ring
+ */
+static bool ethernet_mac_release_tx_launch_frames(
+    const struct ethernet_mac_device *ethernet_mac_p)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    bool frames_released = false;
+
+    for ( ; ; ) {
+        uint_fast8_t num_due = 0;
+        uint32_t now_ns = ethernet_mac_capture_ieee_1588_time(mac_regs_p);
+
+        while (num_due < mac_var_p->tx_launch_queue_length) {
+            struct network_packet *tx_packet_p =
+                mac_var_p->tx_launch_queue[num_due];
+            uint32_t lead_ns =
+                ethernet_mac_get_tx_launch_lead_ns(now_ns,
+                                                   tx_packet_p->tx_launch_time);
+
+            if (lead_ns > ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS) {
+                break;
+            }
+
+            if (!frames_released) {
+                ethernet_mac_lazy_reclaim_tx_ring(ethernet_mac_p);
+                frames_released = true;
+            }
+
+            if (lead_ns == 0) {
+                mac_var_p->tx_launch_late_count ++;
+            }
+
+            NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+            D_ASSERT(ethernet_mac_tx_ring_has_room(ethernet_mac_p, 1));
+            ethernet_mac_queue_tx_frame(ethernet_mac_p, tx_packet_p, NULL, 0);
+            mac_var_p->tx_launched_count ++;
+            num_due ++;
+        }
+
+        if (num_due != 0) {
+            mac_var_p->tx_launch_queue_length -= num_due;
+            memmove(&mac_var_p->tx_launch_queue[0],
+                    &mac_var_p->tx_launch_queue[num_due],
+                    mac_var_p->tx_launch_queue_length *
+                        sizeof mac_var_p->tx_launch_queue[0]);
+        }
+
+        if (mac_var_p->tx_launch_queue_length == 0) {
+            ethernet_mac_arm_tx_launch_timer(mac_regs_p, false, 0);
+            break;
+        }
+
+        uint32_t next_launch_time_ns = mac_var_p->tx_launch_queue[0]->tx_launch_time;
+        uint32_t compare_time_ns =
+            next_launch_time_ns >= ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS ?
+                next_launch_time_ns - ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS :
+                next_launch_time_ns + ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS -
+                    ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS;
+
+        ethernet_mac_arm_tx_launch_timer(mac_regs_p, true, compare_time_ns);
+
+        /*
+         * If the compare time passed while the trigger was being armed, it
+         * would not fire until the next second, so check for due frames
+         * again:
+         */
+        now_ns = ethernet_mac_capture_ieee_1588_time(mac_regs_p);
+        if (ethernet_mac_get_tx_launch_lead_ns(now_ns, next_launch_time_ns) >
+            ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS) {
+            break;
+        }
+    }
+
+    return frames_released;
+}
+
+
+/**
+ * Initiates the transmission of a Tx packet at a given time. The packet is
+ * kept in the MAC's Tx launch queue and it is only queued in the Tx ring
+ * ETHERNET_MAC_TX_LAUNCH_ADVANCE_NS before its launch time, by the
+ * interrupt handler of the IEEE 1588 timer's target time trigger. As frames
+ * are released by an ISR, rather than gated by the MAC itself, they leave
+ * with the jitter of the interrupt latency (a few microseconds) and they
+ * can be delayed by frames already in the Tx ring.
+ *
+ * @param ethernet_mac_p: Pointer to Ethernet MAC device
+ * @param tx_packet_p: Tx packet to transmit
+ * @param launch_time_ns: value of the MAC's IEEE 1588 timer at which the
+ *                        frame is to be transmitted. It must be at most
+ *                        ETHERNET_MAC_TX_LAUNCH_MAX_LEAD_NS ahead;
+ *                        otherwise, it is taken as a launch time that has
+ *                        already passed, and the frame is transmitted
+ *                        right away.
+ */
+void ethernet_mac_start_xmit_at(const struct ethernet_mac_device *ethernet_mac_p,
+                                struct network_packet *tx_packet_p,
+                                uint32_t launch_time_ns)
+{
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    uint_fast8_t i;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->total_length != 0);
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
+    D_ASSERT(launch_time_ns < ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    D_ASSERT(mac_var_p->tx_launch_queue_length <
+             ARRAY_SIZE(mac_var_p->tx_launch_queue));
+
+    /*
+     * Insert the packet in the Tx launch queue, after the packets whose
+     * launch time is not later than its own:
+     */
+    uint32_t now_ns = ethernet_mac_capture_ieee_1588_time(mac_regs_p);
+    uint32_t lead_ns = ethernet_mac_get_tx_launch_lead_ns(now_ns, launch_time_ns);
+
+    for (i = mac_var_p->tx_launch_queue_length; i != 0; i --) {
+        struct network_packet *queued_packet_p = mac_var_p->tx_launch_queue[i - 1];
+
+        if (ethernet_mac_get_tx_launch_lead_ns(now_ns,
+                                               queued_packet_p->tx_launch_time) <=
+            lead_ns) {
+            break;
+        }
+
+        mac_var_p->tx_launch_queue[i] = queued_packet_p;
+    }
+
+    tx_packet_p->tx_launch_time = launch_time_ns;
+    NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+    mac_var_p->tx_launch_queue[i] = tx_packet_p;
+    mac_var_p->tx_launch_queue_length ++;
+
+    bool frames_released = ethernet_mac_release_tx_launch_frames(ethernet_mac_p);
+
+    restore_cpu_interrupts(int_mask);
+
+    if (frames_released) {
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->DMATPDR, 0);
+    }
+}
+
+
+/**
+ * Ethernet MAC interrupt handler. Unlike the K64F ENET, the STM32 MAC has a
+ * single interrupt for all its DMA events (Rx/Tx completions and errors) and
+ * for the target time trigger of its IEEE 1588 timer.
+ */
+RAM_FUNC static void ethernet_mac_irq_handler(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+    bool tx_completed = false;
+
+    for ( ; ; ) {
+        uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMASR);
+        uint32_t events = reg_value & READ_MMIO_REGISTER(&mac_regs_p->DMAIER) &
+                          (ETH_DMASR_RS_MASK |
+                           ETH_DMASR_TS_MASK |
+                           ETH_DMASR_ROS_MASK |
+                           ETH_DMASR_TUS_MASK |
+                           ETH_DMASR_FBES_MASK);
+
+        if (events == 0) {
+            break;
+        }
+
+        /*
+         * Clear interrupt sources and their summary bits (w1c). Buffer
+         * unavailable events do not generate interrupts, as the rings are
+         * refilled after draining them anyway:
+         */
+        WRITE_MMIO_REGISTER(&mac_regs_p->DMASR,
+                            events |
+                            ETH_DMASR_NIS_MASK | ETH_DMASR_AIS_MASK |
+                            ETH_DMASR_TBUS_MASK | ETH_DMASR_RBUS_MASK);
+
+        if (events & ETH_DMASR_RS_MASK) {
+            uint32_t int_mask = disable_cpu_interrupts();
+
+            if (mac_var_p->rx_mode == ETHERNET_MAC_RX_POLLED_MODE) {
+                /*
+                 * Mask the Rx interrupt and let the layer-2 packet receiver
+                 * task drain the Rx ring. The Rx interrupt is unmasked again
+                 * by ethernet_mac_poll_rx(), once the Rx ring is empty:
+                 */
+                reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAIER);
+                reg_value &= ~ETH_DMAIER_RIE_MASK;
+                WRITE_MMIO_REGISTER(&mac_regs_p->DMAIER, reg_value);
+                restore_cpu_interrupts(int_mask);
+
+                net_layer2_rx_poll_wakeup(mac_var_p->layer2_end_point_p);
+            } else {
+                bool refilled = false;
+
+                D_ASSERT(mac_var_p->rx_ring_entries_filled <=
+                         ethernet_mac_p->rx_ring_num_entries);
+                D_ASSERT(mac_var_p->rx_ring_read_cursor != NULL);
+                if (mac_var_p->rx_ring_entries_filled != 0) {
+                    ethernet_mac_drain_rx_ring(ethernet_mac_p);
+                    refilled = ethernet_mac_refill_rx_ring(ethernet_mac_p);
+                }
+
+                restore_cpu_interrupts(int_mask);
+                if (refilled) {
+                    /*
+                     * Resume the Rx DMA, in case it was suspended for lack
+                     * of Rx buffers:
+                     */
+                    __DSB();
+                    WRITE_MMIO_REGISTER(&mac_regs_p->DMARPDR, 0);
+                }
+            }
+        }
+
+        if (events & ETH_DMASR_TS_MASK) {
+            uint32_t int_mask = disable_cpu_interrupts();
+
+            D_ASSERT(mac_var_p->tx_ring_entries_filled <=
+                     ethernet_mac_p->tx_ring_num_entries);
+            D_ASSERT(mac_var_p->tx_ring_read_cursor != NULL);
+            if (mac_var_p->tx_ring_entries_filled != 0) {
+                ethernet_mac_drain_tx_ring(ethernet_mac_p);
+            }
+
+            restore_cpu_interrupts(int_mask);
+            tx_completed = true;
+        }
+
+        if (events & (ETH_DMASR_ROS_MASK | ETH_DMASR_TUS_MASK | ETH_DMASR_FBES_MASK)) {
+            net_layer2_count_drop(NET_LAYER2_DROP_MAC_ERROR_INTERRUPT);
+            mac_var_p->tx_rx_error_count ++;
+            if (events & ETH_DMASR_TUS_MASK) {
+                /*
+                 * The Tx DMA is suspended after a Tx underflow, so resume it:
+                 */
+                WRITE_MMIO_REGISTER(&mac_regs_p->DMATPDR, 0);
+            }
+        }
+    }
+
+    if (tx_completed) {
+        /*
+         * Hand to the MAC the frames that were waiting for room in the
+         * Tx ring:
+         */
+        net_layer2_tx_complete(mac_var_p->layer2_end_point_p);
+    }
+
+    if (READ_MMIO_REGISTER(&mac_regs_p->MACSR) & ETH_MACSR_TSTS_MASK) {
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        /*
+         * Re-arming the target time trigger clears the interrupt source:
+         */
+        bool frames_released = ethernet_mac_release_tx_launch_frames(ethernet_mac_p);
+
+        restore_cpu_interrupts(int_mask);
+
+        if (frames_released) {
+            __DSB();
+            WRITE_MMIO_REGISTER(&mac_regs_p->DMATPDR, 0);
+        }
+    }
+}
+
+
+/**
+ * ISR for the Ethernet MAC0's interrupt
+ */
+RAM_FUNC void ethernet_mac0_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    ethernet_mac_irq_handler(&g_ethernet_macs[0]);
+    rtos_exit_isr();
+}
+
+
+/**
+ * Reads the current value of the IEEE 1588 timer of the given Ethernet MAC
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ *
+ * @return current timer value in nanoseconds, in the same time base as the
+ *         hardware timestamps of Rx/Tx packets
+ */
+uint32_t ethernet_mac_get_ieee_1588_time(const struct ethernet_mac_device *ethernet_mac_p)
+{
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    return ethernet_mac_capture_ieee_1588_time(mac_regs_p);
+}
+
+
+/**
+ * Adjusts the IEEE 1588 timer of the given Ethernet MAC by a given offset,
+ * for example to synchronize it with the clock of another board.
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param offset_ns         Offset to add to the timer, in nanoseconds
+ *                          (it must be less than one timer period)
+ */
+void ethernet_mac_adjust_ieee_1588_time(const struct ethernet_mac_device *ethernet_mac_p,
+                                        int32_t offset_ns)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(offset_ns > -(int32_t)ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS &&
+             offset_ns < (int32_t)ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    /*
+     * The MAC adds or subtracts the offset to the running timer itself,
+     * borrowing from or carrying into the seconds register as needed:
+     */
+    ethernet_mac_wait_ieee_1588_update(mac_regs_p, ETH_PTPTSCR_TSSTU_MASK);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSHUR, 0);
+    if (offset_ns < 0) {
+        WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSLUR,
+                            ETH_PTPTSLUR_TSUPNS_SUBTRACT_MASK |
+                            ((uint32_t)-offset_ns & ETH_PTPTSLUR_TSUPNS_MASK));
+    } else {
+        WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSLUR,
+                            (uint32_t)offset_ns & ETH_PTPTSLUR_TSUPNS_MASK);
+    }
+
+    reg_value = READ_MMIO_REGISTER(&mac_regs_p->PTPTSCR);
+    WRITE_MMIO_REGISTER(&mac_regs_p->PTPTSCR, reg_value | ETH_PTPTSCR_TSSTU_MASK);
+    ethernet_mac_wait_ieee_1588_update(mac_regs_p, ETH_PTPTSCR_TSSTU_MASK);
+
+    /*
+     * The target time trigger may have been skipped over, so re-arm it:
+     */
+    bool frames_released = false;
+
+    if (ethernet_mac_p->var_p->tx_launch_queue_length != 0) {
+        frames_released = ethernet_mac_release_tx_launch_frames(ethernet_mac_p);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    if (frames_released) {
+        __DSB();
+        WRITE_MMIO_REGISTER(&mac_regs_p->DMATPDR, 0);
+    }
+}
+
+
+/**
+ * Obtains a snapshot of the traffic and error statistics of the given
+ * Ethernet MAC, accumulating into them the hardware MMC counters, which are
+ * reset on read, and the missed frame counters of the DMA engine, which
+ * are also reset on read.
+ *
+ * NOTE: The MMC counters are 32-bit wide, but the DMA's missed frame
+ * counters are only 16-bit and 11-bit wide, so this function needs to be
+ * called often enough, so that those counters do not saturate between calls.
+ *
+ * @param ethernet_mac_p    Pointer to the Ethernet MAC device
+ * @param stats_p           Area where the statistics are to be returned
+ */
+void ethernet_mac_get_stats(const struct ethernet_mac_device *ethernet_mac_p,
+                            struct ethernet_mac_stats *stats_p)
+{
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    struct ethernet_mac_device_var *const mac_var_p = ethernet_mac_p->var_p;
+    ETH_TypeDef *const mac_regs_p = ethernet_mac_p->mmio_registers_p;
+
+    D_ASSERT(mac_var_p->initialized);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    for (unsigned int i = 0; i < ETHERNET_MAC_NUM_MMC_COUNTERS; i ++) {
+        const struct ethernet_mac_mmc_counter *counter_p =
+            &g_ethernet_mac_mmc_counters[i];
+        uint32_t value = READ_MMIO_REGISTER(
+            (volatile uint32_t *)((uintptr_t)mac_regs_p + counter_p->reg_offset));
+        uint32_t *stats_field_p =
+            (uint32_t *)((uintptr_t)&mac_var_p->stats + counter_p->stats_offset);
+
+        *stats_field_p += value;
+    }
+
+    uint32_t reg_value = READ_MMIO_REGISTER(&mac_regs_p->DMAMFBOCR);
+
+    mac_var_p->stats.rx_drops += GET_BIT_FIELD(reg_value,
+                                               ETH_DMAMFBOCR_MFC_MASK,
+                                               ETH_DMAMFBOCR_MFC_SHIFT);
+    mac_var_p->stats.rx_overruns += GET_BIT_FIELD(reg_value,
+                                                  ETH_DMAMFBOCR_MFA_MASK,
+                                                  ETH_DMAMFBOCR_MFA_SHIFT);
+
+    *stats_p = mac_var_p->stats;
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Calculates the difference between two snapshots of the statistics of an
+ * Ethernet MAC
+ *
+ * @param old_stats_p       Pointer to the older snapshot
+ * @param new_stats_p       Pointer to the newer snapshot
+ * @param delta_stats_p     Area where the difference is to be returned
+ */
+void ethernet_mac_stats_delta(const struct ethernet_mac_stats *old_stats_p,
+                              const struct ethernet_mac_stats *new_stats_p,
+                              struct ethernet_mac_stats *delta_stats_p)
+{
+    const uint32_t *old_p = (const uint32_t *)old_stats_p;
+    const uint32_t *new_p = (const uint32_t *)new_stats_p;
+    uint32_t *delta_p = (uint32_t *)delta_stats_p;
+
+    C_ASSERT(sizeof(struct ethernet_mac_stats) % sizeof(uint32_t) == 0);
+
+    for (unsigned int i = 0;
+         i < sizeof(struct ethernet_mac_stats) / sizeof(uint32_t);
+         i ++) {
+        delta_p[i] = new_p[i] - old_p[i];
+    }
+}
+
+#endif /* STM32F479_MCU */
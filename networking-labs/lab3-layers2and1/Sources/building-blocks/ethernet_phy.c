@@ -3,6 +3,11 @@
  *
  * Micrel KSZ8081RNA Ethernet PHY driver
  *
+ * On the STM32F4, the RMII pins are configured by the Ethernet MAC driver
+ * (ethernet_mac_stm32f4.c), as they are all muxed the same way, and MDIO
+ * transfers are always polled, as the STM32 Ethernet MAC has no interrupt
+ * for their completion.
+ *
  * @author German Rivera
  */
 #include "ethernet_phy.h"
@@ -11,6 +16,8 @@
 #include "microcontroller.h"
 #include "runtime_checks.h"
 #include "io_utils.h"
+#include "atomic_utils.h"
+#include "hr_timer.h"
 
 /**
  * ETHERNET PHY Registers
@@ -20,11 +27,13 @@ enum ethernet_phy_registers {
     ETHERNET_PHY_STATUS_REG =               0x1, /* basic status register */
     ETHERNET_PHY_ID1_REG =                  0x2, /* identification register 1 */
     ETHERNET_PHY_ID2_REG =                  0x3, /* identification register 2 */
+    ETHERNET_PHY_AUTO_NEG_ADVERTISEMENT_REG = 0x4, /* auto-negotiation advertisement register */
     ETHERNET_PHY_INTR_CONTROL_STATUS_REG =  0x1b, /* interrupt control/status register */
     ETHERNET_PHY_CONTROL1_REG =             0x1e, /* control register 1 */
     ETHERNET_PHY_CONTROL2_REG =             0x1f, /* control register 2*/
 };
 
+#if defined(K64F_MCU)
 /**
  * Values for the operation code field of the Ethernet MAC's MMFR register.
  * This register is used to send read/write commands to the Ethernet PHY
@@ -37,6 +46,33 @@ enum enet_mmfr_op_values {
     ENET_MMFR_OP_READ_NON_MII_COMPLIANT_FRAME =      0x3,
 };
 
+#elif defined(STM32F479_MCU)
+/*
+ * Fields of the Ethernet MAC's MII address register (ETH_MACMIIAR). This
+ * register is used to send read/write commands to the Ethernet PHY through
+ * the RMII management interface, over the MDIO bus. The data of the command
+ * goes through the MII data register (ETH_MACMIIDR).
+ */
+#define ETH_MACMIIAR_PA_MASK        MULTI_BIT_MASK(15, 11)
+#define ETH_MACMIIAR_PA_SHIFT       11
+#define ETH_MACMIIAR_MR_MASK        MULTI_BIT_MASK(10, 6)
+#define ETH_MACMIIAR_MR_SHIFT       6
+#define ETH_MACMIIAR_CR_MASK        MULTI_BIT_MASK(4, 2)
+#define ETH_MACMIIAR_CR_SHIFT       2
+#define ETH_MACMIIAR_MW_MASK        BIT(1)
+#define ETH_MACMIIAR_MB_MASK        BIT(0)
+
+/**
+ * Value of the CR field of ETH_MACMIIAR for an HCLK of 150-180MHz
+ * (MDC clock = HCLK / 102)
+ */
+#define ETH_MACMIIAR_CR_HCLK_DIV_102    0x4
+
+C_ASSERT(MCU_CPU_CLOCK_FREQ_IN_MHZ >= 150 && MCU_CPU_CLOCK_FREQ_IN_MHZ <= 180);
+#else
+#error "No Microcontroller defined"
+#endif
+
 /*
  * Bit masks for ETHERNET_PHY_CONTROL_REG register flags
  */
@@ -57,6 +93,11 @@ enum enet_mmfr_op_values {
 #define ETHERNET_PHY_AUTO_NEG_CAPABLE_MASK    BIT(3)
 #define ETHERNET_PHY_LINK_UP_MASK             BIT(2)
 
+/*
+ * Bit masks for ETHERNET_PHY_AUTO_NEG_ADVERTISEMENT_REG register flags
+ */
+#define ETHERNET_PHY_ADVERTISE_PAUSE_MASK     BIT(10)
+
 /*
  * Bit masks for ETHERNET_PHY_INTR_CONTROL_STATUS_REG register flags
  */
@@ -67,6 +108,25 @@ enum enet_mmfr_op_values {
 #define ETHERNET_PHY_LINK_DOWN_INTR_MASK            BIT(2)
 #define ETHERNET_PHY_LINK_UP_INTR_MASK              BIT(0)
 
+/*
+ * Bit masks for ETHERNET_PHY_CONTROL1_REG register flags
+ */
+#define ETHERNET_PHY_PAUSE_ENABLED_MASK       BIT(9)  /* flow control negotiated */
+#define ETHERNET_PHY_OPERATION_MODE_MASK      MULTI_BIT_MASK(2, 0)
+#define ETHERNET_PHY_OPERATION_MODE_SHIFT     0
+
+/**
+ * Values of the operation mode field of the ETHERNET_PHY_CONTROL1_REG
+ * register (result of auto-negotiation)
+ */
+enum ethernet_phy_operation_modes {
+    ETHERNET_PHY_OPERATION_MODE_AUTO_NEG_IN_PROGRESS = 0x0,
+    ETHERNET_PHY_OPERATION_MODE_10_BASE_T_HALF_DUPLEX = 0x1,
+    ETHERNET_PHY_OPERATION_MODE_100_BASE_TX_HALF_DUPLEX = 0x2,
+    ETHERNET_PHY_OPERATION_MODE_10_BASE_T_FULL_DUPLEX = 0x5,
+    ETHERNET_PHY_OPERATION_MODE_100_BASE_TX_FULL_DUPLEX = 0x6,
+};
+
 /*
  * Bit masks for ETHERNET_PHY_CONTROL2_REG register flags
  */
@@ -80,6 +140,19 @@ enum enet_mmfr_op_values {
  */
 #define ETHERNET_PHY_MAX_POLLING_COUNT   UINT16_MAX
 
+/**
+ * Timeout in milliseconds for an MDIO transfer, when waiting for the MII
+ * interrupt. A transfer takes about 26 us at the 2.4 MHz MDC clock.
+ */
+#define ETHERNET_PHY_MDIO_TIMEOUT_MS        10
+
+/**
+ * Interval in microseconds at which the PHY's control register is polled
+ * while waiting for a reset to complete, and maximum number of polls
+ */
+#define ETHERNET_PHY_RESET_POLL_INTERVAL_US 100
+#define ETHERNET_PHY_RESET_MAX_POLLS        5000
+
 /**
  * Non-const fields of an Ethernet PHY device (to be placed in SRAM)
  */
@@ -94,38 +167,142 @@ struct ethernet_phy_device_var {
      * Mutex to serialize access to the Ethernet PHY
      */
     struct rtos_mutex mutex;
+
+    /**
+     * Flag indicating that completion of MDIO transfers is signaled by the
+     * Ethernet MAC's MII interrupt, instead of being polled. It is set by
+     * ethernet_phy_init(), if it is called from a task.
+     */
+    bool mdio_interrupt_mode;
+
+    /**
+     * Semaphore signaled by ethernet_phy_mdio_irq_handler() when an MDIO
+     * transfer completes, in MDIO interrupt mode
+     */
+    struct rtos_semaphore mdio_done_semaphore;
 };
 
 /**
- * Global non-const structure for Ethernet PHY device
+ * Global non-const structures for Ethernet PHY devices
  * (allocated in SRAM space)
  */
-static struct ethernet_phy_device_var g_ethernet_phy0_var = {
-    .initialized = false,
+static struct ethernet_phy_device_var g_ethernet_phys_var[NUM_ETHERNET_MACS] = {
+    [0] = {
+        .initialized = false,
+    },
 };
 
 /**
- * Global const structure for the Ethernet PHY device
+ * Global const structures for the Ethernet PHY devices, one per Ethernet MAC
  * (allocated in flash space)
  */
-const struct ethernet_phy_device g_ethernet_phy0 = {
-    .signature = ETHERNET_PHY_DEVICE_SIGNATURE,
-    .var_p = &g_ethernet_phy0_var,
-    .ethernet_mac_p = &g_ethernet_mac0,
-    .mdio_address = 0x0,
-    .rmii_rxer_pin = PIN_INITIALIZER(PIN_PORT_A, 5, PIN_FUNCTION_ALT4),
-    .rmii_rxd1_pin = PIN_INITIALIZER(PIN_PORT_A, 12, PIN_FUNCTION_ALT4),
-    .rmii_rxd0_pin = PIN_INITIALIZER(PIN_PORT_A, 13, PIN_FUNCTION_ALT4),
-    .rmii_crs_dv_pin = PIN_INITIALIZER(PIN_PORT_A, 14, PIN_FUNCTION_ALT4),
-    .rmii_txen_pin = PIN_INITIALIZER(PIN_PORT_A, 15, PIN_FUNCTION_ALT4),
-    .rmii_txd0_pin = PIN_INITIALIZER(PIN_PORT_A, 16, PIN_FUNCTION_ALT4),
-    .rmii_txd1_pin = PIN_INITIALIZER(PIN_PORT_A, 17, PIN_FUNCTION_ALT4),
-    .mii_txer_pin = PIN_INITIALIZER(PIN_PORT_A, 28, PIN_FUNCTION_ALT4),
-    .rmii_mdio_pin = PIN_INITIALIZER(PIN_PORT_B, 0, PIN_FUNCTION_ALT4),
-    .rmii_mdc_pin = PIN_INITIALIZER(PIN_PORT_B, 1, PIN_FUNCTION_ALT4),
+const struct ethernet_phy_device g_ethernet_phys[NUM_ETHERNET_MACS] = {
+    [0] = {
+        .signature = ETHERNET_PHY_DEVICE_SIGNATURE,
+        .var_p = &g_ethernet_phys_var[0],
+        .ethernet_mac_p = &g_ethernet_macs[0],
+        .mdio_address = 0x0,
+#if defined(K64F_MCU)
+        .rmii_rxer_pin = PIN_INITIALIZER(PIN_PORT_A, 5, PIN_FUNCTION_ALT4),
+        .rmii_rxd1_pin = PIN_INITIALIZER(PIN_PORT_A, 12, PIN_FUNCTION_ALT4),
+        .rmii_rxd0_pin = PIN_INITIALIZER(PIN_PORT_A, 13, PIN_FUNCTION_ALT4),
+        .rmii_crs_dv_pin = PIN_INITIALIZER(PIN_PORT_A, 14, PIN_FUNCTION_ALT4),
+        .rmii_txen_pin = PIN_INITIALIZER(PIN_PORT_A, 15, PIN_FUNCTION_ALT4),
+        .rmii_txd0_pin = PIN_INITIALIZER(PIN_PORT_A, 16, PIN_FUNCTION_ALT4),
+        .rmii_txd1_pin = PIN_INITIALIZER(PIN_PORT_A, 17, PIN_FUNCTION_ALT4),
+        .mii_txer_pin = PIN_INITIALIZER(PIN_PORT_A, 28, PIN_FUNCTION_ALT4),
+        .rmii_mdio_pin = PIN_INITIALIZER(PIN_PORT_B, 0, PIN_FUNCTION_ALT4),
+        .rmii_mdc_pin = PIN_INITIALIZER(PIN_PORT_B, 1, PIN_FUNCTION_ALT4),
+#endif
+    },
 };
 
 
+#if defined(K64F_MCU)
+/**
+ * Waits for the MDIO transfer in progress to complete. In MDIO interrupt
+ * mode, the caller blocks until the MII interrupt is received. Otherwise,
+ * the MII event bit is polled in the EIR register.
+ *
+ * @return true, if the transfer completed, false if it timed out
+ */
+static bool ethernet_phy_mdio_wait_transfer(const struct ethernet_phy_device *ethernet_phy_p)
+{
+    struct ethernet_phy_device_var *const phy_var_p = ethernet_phy_p->var_p;
+    ENET_Type *const enet_regs_p = ethernet_phy_p->ethernet_mac_p->mmio_registers_p;
+    uint32_t reg_value;
+    uint_fast16_t polling_count;
+
+    if (phy_var_p->mdio_interrupt_mode) {
+        return rtos_semaphore_wait_timeout(&phy_var_p->mdio_done_semaphore,
+                                           ETHERNET_PHY_MDIO_TIMEOUT_MS);
+    }
+
+    /*
+     * Wait for the SMI transfer to complete
+     * (the MMI interrupt event bit is set in the EIR, when
+     *  an SMI data transfer is completed)
+     */
+    polling_count = ETHERNET_PHY_MAX_POLLING_COUNT;
+    do {
+        reg_value = READ_MMIO_REGISTER(&enet_regs_p->EIR);
+        polling_count --;
+    } while ((reg_value & ENET_EIR_MII_MASK) == 0 && polling_count != 0);
+
+    if ((reg_value & ENET_EIR_MII_MASK) == 0) {
+        return false;
+    }
+
+    /*
+     * Clear the MII interrupt event in the EIR register
+     * (EIR is a w1c register)
+     */
+    WRITE_MMIO_REGISTER(&enet_regs_p->EIR, ENET_EIR_MII_MASK);
+    return true;
+}
+
+#elif defined(STM32F479_MCU)
+/**
+ * Waits for the MDIO transfer in progress to complete, by polling the busy
+ * bit in the ETH_MACMIIAR register (the STM32 Ethernet MAC does not generate
+ * an interrupt when an MDIO transfer completes).
+ *
+ * @return true, if the transfer completed, false if it timed out
+ */
+static bool ethernet_phy_mdio_wait_transfer(const struct ethernet_phy_device *ethernet_phy_p)
+{
+    ETH_TypeDef *const eth_regs_p = ethernet_phy_p->ethernet_mac_p->mmio_registers_p;
+    uint32_t reg_value;
+    uint_fast16_t polling_count;
+
+    D_ASSERT(!ethernet_phy_p->var_p->mdio_interrupt_mode);
+
+    polling_count = ETHERNET_PHY_MAX_POLLING_COUNT;
+    do {
+        reg_value = READ_MMIO_REGISTER(&eth_regs_p->MACMIIAR);
+        polling_count --;
+    } while ((reg_value & ETH_MACMIIAR_MB_MASK) != 0 && polling_count != 0);
+
+    return (reg_value & ETH_MACMIIAR_MB_MASK) == 0;
+}
+#endif
+
+
+/**
+ * Handles the MII interrupt of the Ethernet MAC connected to a given PHY,
+ * which signals the completion of an MDIO transfer. It is called from the
+ * Ethernet MAC's error interrupt handler, after clearing the interrupt.
+ */
+void ethernet_phy_mdio_irq_handler(const struct ethernet_phy_device *ethernet_phy_p)
+{
+    struct ethernet_phy_device_var *const phy_var_p = ethernet_phy_p->var_p;
+
+    D_ASSERT(phy_var_p->mdio_interrupt_mode);
+    rtos_semaphore_signal(&phy_var_p->mdio_done_semaphore);
+}
+
+
+#if defined(K64F_MCU)
 static void
 ethernet_phy_mdio_write_nolock(const struct ethernet_phy_device *ethernet_phy_p,
                                uint32_t phy_reg,
@@ -135,13 +312,13 @@ ethernet_phy_mdio_write_nolock(const struct ethernet_phy_device *ethernet_phy_p,
         ethernet_phy_p->ethernet_mac_p;
     ENET_Type *const enet_regs_p = ethernet_mac_p->mmio_registers_p;
     uint32_t reg_value;
-    uint_fast16_t polling_count;
 
     reg_value = READ_MMIO_REGISTER(&enet_regs_p->MSCR);
     D_ASSERT((reg_value & ENET_MSCR_MII_SPEED_MASK) != 0);
 
     reg_value = READ_MMIO_REGISTER(&enet_regs_p->EIR);
     D_ASSERT((reg_value & ENET_EIR_MII_MASK) == 0);
+    D_ASSERT(!ethernet_phy_p->var_p->mdio_interrupt_mode || CALLER_IS_THREAD());
 
     /*
      * Set write command
@@ -161,31 +338,49 @@ ethernet_phy_mdio_write_nolock(const struct ethernet_phy_device *ethernet_phy_p,
                   data);
     write_32bit_mmio_register(&enet_regs_p->MMFR, reg_value);
 
-    /*
-     * Wait for SMI write to complete
-     * (the MMI interrupt event bit is set in the EIR, when
-     *  an SMI data transfer is completed)
-     */
-    polling_count = ETHERNET_PHY_MAX_POLLING_COUNT;
-    do {
-        reg_value = READ_MMIO_REGISTER(&enet_regs_p->EIR);
-        polling_count --;
-    } while ((reg_value & ENET_EIR_MII_MASK) == 0 && polling_count != 0);
-
-    if ((reg_value & ENET_EIR_MII_MASK) == 0) {
+    if (!ethernet_phy_mdio_wait_transfer(ethernet_phy_p)) {
         error_t error = CAPTURE_ERROR("SMI write failed", ethernet_phy_p,
-                                      reg_value);
+                                      READ_MMIO_REGISTER(&enet_regs_p->EIR));
 
         fatal_error_handler(error);
         /*UNREACHABLE*/
     }
+}
+
+#elif defined(STM32F479_MCU)
+static void
+ethernet_phy_mdio_write_nolock(const struct ethernet_phy_device *ethernet_phy_p,
+                               uint32_t phy_reg,
+                               uint32_t data)
+{
+    ETH_TypeDef *const eth_regs_p = ethernet_phy_p->ethernet_mac_p->mmio_registers_p;
+    uint32_t reg_value;
+
+    reg_value = READ_MMIO_REGISTER(&eth_regs_p->MACMIIAR);
+    D_ASSERT((reg_value & ETH_MACMIIAR_MB_MASK) == 0);
 
     /*
-     * Clear the MII interrupt event in the EIR register
-     * (EIR is a w1c register)
+     * Set write command (keeping the MDC clock range set by
+     * ether_phy_mdio_init()):
      */
-    WRITE_MMIO_REGISTER(&enet_regs_p->EIR, ENET_EIR_MII_MASK);
+    WRITE_MMIO_REGISTER(&eth_regs_p->MACMIIDR, data);
+    reg_value &= ETH_MACMIIAR_CR_MASK;
+    SET_BIT_FIELD(reg_value, ETH_MACMIIAR_PA_MASK, ETH_MACMIIAR_PA_SHIFT,
+                  ethernet_phy_p->mdio_address);
+    SET_BIT_FIELD(reg_value, ETH_MACMIIAR_MR_MASK, ETH_MACMIIAR_MR_SHIFT,
+                  phy_reg);
+    reg_value |= ETH_MACMIIAR_MW_MASK | ETH_MACMIIAR_MB_MASK;
+    WRITE_MMIO_REGISTER(&eth_regs_p->MACMIIAR, reg_value);
+
+    if (!ethernet_phy_mdio_wait_transfer(ethernet_phy_p)) {
+        error_t error = CAPTURE_ERROR("SMI write failed", ethernet_phy_p,
+                                      READ_MMIO_REGISTER(&eth_regs_p->MACMIIAR));
+
+        fatal_error_handler(error);
+        /*UNREACHABLE*/
+    }
 }
+#endif
 
 
 /**
@@ -213,6 +408,7 @@ static void ethernet_phy_mdio_write(const struct ethernet_phy_device *ethernet_p
 }
 
 
+#if defined(K64F_MCU)
 static uint32_t
 ethernet_phy_mdio_read_nolock(const struct ethernet_phy_device *ethernet_phy_p,
                               uint32_t phy_reg)
@@ -221,13 +417,13 @@ ethernet_phy_mdio_read_nolock(const struct ethernet_phy_device *ethernet_phy_p,
         ethernet_phy_p->ethernet_mac_p;
     ENET_Type *const enet_regs_p = ethernet_mac_p->mmio_registers_p;
     uint32_t reg_value;
-    uint16_t polling_count = ETHERNET_PHY_MAX_POLLING_COUNT;
 
     reg_value = READ_MMIO_REGISTER(&enet_regs_p->MSCR);
     D_ASSERT((reg_value & ENET_MSCR_MII_SPEED_MASK) != 0);
 
     reg_value = READ_MMIO_REGISTER(&enet_regs_p->EIR);
     D_ASSERT((reg_value & ENET_EIR_MII_MASK) == 0);
+    D_ASSERT(!ethernet_phy_p->var_p->mdio_interrupt_mode || CALLER_IS_THREAD());
 
     /*
      * Set read command
@@ -245,34 +441,52 @@ ethernet_phy_mdio_read_nolock(const struct ethernet_phy_device *ethernet_phy_p,
                   0x2);
     WRITE_MMIO_REGISTER(&enet_regs_p->MMFR, reg_value);
 
-    /*
-     * Wait for SMI read to complete
-     * (the MMI interrupt event bit is set in the EIR, when
-     *  an SMI data transfer is completed)
-     */
-    do {
-        reg_value = READ_MMIO_REGISTER(&enet_regs_p->EIR);
-        polling_count --;
-    } while ((reg_value & ENET_EIR_MII_MASK) == 0 && polling_count != 0);
-
-    if ((reg_value & ENET_EIR_MII_MASK) == 0) {
+    if (!ethernet_phy_mdio_wait_transfer(ethernet_phy_p)) {
         error_t error = CAPTURE_ERROR("SMI read failed", ethernet_phy_p,
-                                      reg_value);
+                                      READ_MMIO_REGISTER(&enet_regs_p->EIR));
 
         fatal_error_handler(error);
         /*UNREACHABLE*/
     }
 
     reg_value = READ_MMIO_REGISTER(&enet_regs_p->MMFR);
+    return GET_BIT_FIELD(reg_value, ENET_MMFR_DATA_MASK, ENET_MMFR_DATA_SHIFT);
+}
+
+#elif defined(STM32F479_MCU)
+static uint32_t
+ethernet_phy_mdio_read_nolock(const struct ethernet_phy_device *ethernet_phy_p,
+                              uint32_t phy_reg)
+{
+    ETH_TypeDef *const eth_regs_p = ethernet_phy_p->ethernet_mac_p->mmio_registers_p;
+    uint32_t reg_value;
+
+    reg_value = READ_MMIO_REGISTER(&eth_regs_p->MACMIIAR);
+    D_ASSERT((reg_value & ETH_MACMIIAR_MB_MASK) == 0);
 
     /*
-     * Clear the MII interrupt event in the EIR register
-     * (EIR is a w1c register)
+     * Set read command (keeping the MDC clock range set by
+     * ether_phy_mdio_init()):
      */
-    WRITE_MMIO_REGISTER(&enet_regs_p->EIR, ENET_EIR_MII_MASK);
+    reg_value &= ETH_MACMIIAR_CR_MASK;
+    SET_BIT_FIELD(reg_value, ETH_MACMIIAR_PA_MASK, ETH_MACMIIAR_PA_SHIFT,
+                  ethernet_phy_p->mdio_address);
+    SET_BIT_FIELD(reg_value, ETH_MACMIIAR_MR_MASK, ETH_MACMIIAR_MR_SHIFT,
+                  phy_reg);
+    reg_value |= ETH_MACMIIAR_MB_MASK;
+    WRITE_MMIO_REGISTER(&eth_regs_p->MACMIIAR, reg_value);
 
-    return GET_BIT_FIELD(reg_value, ENET_MMFR_DATA_MASK, ENET_MMFR_DATA_SHIFT);
+    if (!ethernet_phy_mdio_wait_transfer(ethernet_phy_p)) {
+        error_t error = CAPTURE_ERROR("SMI read failed", ethernet_phy_p,
+                                      READ_MMIO_REGISTER(&eth_regs_p->MACMIIAR));
+
+        fatal_error_handler(error);
+        /*UNREACHABLE*/
+    }
+
+    return READ_MMIO_REGISTER(&eth_regs_p->MACMIIDR) & UINT16_MAX;
 }
+#endif
 
 
 /**
@@ -303,6 +517,7 @@ static uint32_t ethernet_phy_mdio_read(
 }
 
 
+#if defined(K64F_MCU)
 static void
 ether_phy_mdio_init(const struct ethernet_phy_device *ethernet_phy_p)
 {
@@ -348,6 +563,25 @@ ether_phy_mdio_init(const struct ethernet_phy_device *ethernet_phy_p)
                      PORT_PCR_PS_MASK);
 }
 
+#elif defined(STM32F479_MCU)
+static void
+ether_phy_mdio_init(const struct ethernet_phy_device *ethernet_phy_p)
+{
+    uint32_t reg_value;
+    ETH_TypeDef *const eth_regs_p = ethernet_phy_p->ethernet_mac_p->mmio_registers_p;
+
+    /*
+     * Set the MDC clock frequency, which must not exceed 2.5MHz. The MDC and
+     * MDIO pins are configured by ethernet_mac_init(), together with the
+     * RMII pins, as they all use the same alternate function.
+     */
+    reg_value = 0;
+    SET_BIT_FIELD(reg_value, ETH_MACMIIAR_CR_MASK, ETH_MACMIIAR_CR_SHIFT,
+                  ETH_MACMIIAR_CR_HCLK_DIV_102);
+    WRITE_MMIO_REGISTER(&eth_regs_p->MACMIIAR, reg_value);
+}
+#endif
+
 
 /**
  * Initializes an Ethernet PHY chip (Micrel KSZ8081RNA)
@@ -369,6 +603,29 @@ void ethernet_phy_init(const struct ethernet_phy_device *ethernet_phy_p)
 
     ether_phy_mdio_init(ethernet_phy_p);
 
+#if defined(K64F_MCU)
+    /*
+     * If we can block, have the completion of MDIO transfers signaled by the
+     * MII interrupt, instead of spinning on the EIR register. The Ethernet
+     * MAC's error interrupt, which the MII interrupt is routed to, has
+     * already been enabled in the NVIC by ethernet_mac_init().
+     */
+    if (CALLER_IS_THREAD()) {
+        ENET_Type *const enet_regs_p =
+            ethernet_phy_p->ethernet_mac_p->mmio_registers_p;
+
+        rtos_semaphore_init(&phy_var_p->mdio_done_semaphore,
+                            "Ethernet PHY MDIO semaphore", 0);
+        phy_var_p->mdio_interrupt_mode = true;
+
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        reg_value = READ_MMIO_REGISTER(&enet_regs_p->EIMR);
+        reg_value |= ENET_EIMR_MII_MASK;
+        WRITE_MMIO_REGISTER(&enet_regs_p->EIMR, reg_value);
+        restore_cpu_interrupts(int_mask);
+    }
+
     /*
      * Set GPIO pins for Ethernet PHY RMII functions:
      */
@@ -380,6 +637,7 @@ void ethernet_phy_init(const struct ethernet_phy_device *ethernet_phy_p)
     set_pin_function(&ethernet_phy_p->rmii_txd1_pin, 0);
     set_pin_function(&ethernet_phy_p->rmii_txen_pin, 0);
     set_pin_function(&ethernet_phy_p->mii_txer_pin, 0);
+#endif
 
     /*
      * Reset Phy
@@ -391,12 +649,17 @@ void ethernet_phy_init(const struct ethernet_phy_device *ethernet_phy_p)
     /*
      * Wait for reset to complete:
      */
-    polling_count = ETHERNET_PHY_MAX_POLLING_COUNT;
-    do {
+    polling_count = ETHERNET_PHY_RESET_MAX_POLLS;
+    for ( ; ; ) {
         reg_value = ethernet_phy_mdio_read_nolock(ethernet_phy_p,
                                                   ETHERNET_PHY_CONTROL_REG);
         polling_count --;
-    } while ((reg_value & ETHERNET_PHY_RESET_MASK) != 0 && polling_count != 0);
+        if ((reg_value & ETHERNET_PHY_RESET_MASK) == 0 || polling_count == 0) {
+            break;
+        }
+
+        hr_timer_delay_us(ETHERNET_PHY_RESET_POLL_INTERVAL_US);
+    }
 
     if ((reg_value & ETHERNET_PHY_RESET_MASK) != 0) {
         error = CAPTURE_ERROR("Ethernet PHY reset failed", ethernet_phy_p,
@@ -407,37 +670,45 @@ void ethernet_phy_init(const struct ethernet_phy_device *ethernet_phy_p)
 
     reg_value = ethernet_phy_mdio_read_nolock(ethernet_phy_p,
                                               ETHERNET_PHY_STATUS_REG);
-    if ((reg_value & ETHERNET_PHY_AUTO_NEG_CAPABLE_MASK) != 0 &&
-        (reg_value & ETHERNET_PHY_AUTO_NEG_COMPLETE_MASK) == 0) {
+    if ((reg_value & ETHERNET_PHY_AUTO_NEG_CAPABLE_MASK) != 0) {
         /*
-         * Set auto-negotiation:
+         * Advertise symmetric pause (flow control), which is not advertised
+         * by default, and restart auto-negotiation, so that the link partner
+         * sees it:
+         *
+         * NOTE: We do not wait for auto-negotiation to complete, as it can
+         * take seconds (or never complete if the cable is unplugged). The
+         * link coming up is detected later by ethernet_phy_get_link_change(),
+         * and the negotiated link mode is then obtained with
+         * ethernet_phy_get_link_mode(), to configure the MAC to match it.
          */
+        reg_value = ethernet_phy_mdio_read_nolock(ethernet_phy_p,
+                                                  ETHERNET_PHY_AUTO_NEG_ADVERTISEMENT_REG);
+        reg_value |= ETHERNET_PHY_ADVERTISE_PAUSE_MASK;
+        ethernet_phy_mdio_write_nolock(ethernet_phy_p,
+                                       ETHERNET_PHY_AUTO_NEG_ADVERTISEMENT_REG,
+                                       reg_value);
+
         reg_value = ethernet_phy_mdio_read_nolock(ethernet_phy_p,
                                                   ETHERNET_PHY_CONTROL_REG);
-        reg_value |= ETHERNET_PHY_AUTO_NEGOTIATION_MASK;
+        reg_value |= ETHERNET_PHY_AUTO_NEGOTIATION_MASK |
+                     ETHERNET_PHY_RESTART_AUTO_NEG_MASK;
         ethernet_phy_mdio_write_nolock(ethernet_phy_p, ETHERNET_PHY_CONTROL_REG,
                                        reg_value);
-
-        /*
-         * Wait for auto-negotiation completion:
-         */
-        polling_count = ETHERNET_PHY_MAX_POLLING_COUNT;
-        do {
-            reg_value = ethernet_phy_mdio_read_nolock(ethernet_phy_p,
-                                                      ETHERNET_PHY_STATUS_REG);
-            polling_count --;
-        } while ((reg_value & ETHERNET_PHY_AUTO_NEG_COMPLETE_MASK) == 0 &&
-                 polling_count != 0);
-
-        if ((reg_value & ETHERNET_PHY_RESET_MASK) != 0) {
-            error = CAPTURE_ERROR("Ethernet PHY auto-negotiation failed",
-                                  ethernet_phy_p, reg_value);
-
-            fatal_error_handler(error);
-            /*UNREACHABLE*/
-        }
     }
 
+    /*
+     * Have the PHY latch link up and link down events in its interrupt
+     * status register, for ethernet_phy_get_link_change(), and discard any
+     * event latched so far:
+     */
+    ethernet_phy_mdio_write_nolock(ethernet_phy_p,
+                                   ETHERNET_PHY_INTR_CONTROL_STATUS_REG,
+                                   ETHERNET_PHY_LINK_DOWN_INTR_ENABLE_MASK |
+                                   ETHERNET_PHY_LINK_UP_INTR_ENABLE_MASK);
+    (void)ethernet_phy_mdio_read_nolock(ethernet_phy_p,
+                                        ETHERNET_PHY_INTR_CONTROL_STATUS_REG);
+
     phy_var_p->initialized = true;
 }
 
@@ -463,6 +734,110 @@ bool ethernet_phy_link_is_up(const struct ethernet_phy_device *ethernet_phy_p)
 }
 
 
+/**
+ * Tells if the Ethernet link of a given Ethernet PHY has gone up or down
+ * since the last call. The link events latched by the PHY are cleared.
+ *
+ * @param ethernet_phy_p Pointer to Ethernet PHY
+ * @param link_up_p      Area where the current link state is returned, if
+ *                       there were link events (true, link is up)
+ *
+ * @return true, if the link has gone up or down at least once
+ * @return false, otherwise
+ */
+bool ethernet_phy_get_link_change(const struct ethernet_phy_device *ethernet_phy_p,
+                                  bool *link_up_p)
+{
+    D_ASSERT(ethernet_phy_p->signature == ETHERNET_PHY_DEVICE_SIGNATURE);
+    struct ethernet_phy_device_var *const phy_var_p = ethernet_phy_p->var_p;
+
+    D_ASSERT(phy_var_p->initialized);
+    rtos_mutex_lock(&phy_var_p->mutex);
+
+    /*
+     * NOTE: The event bits of the interrupt status register are cleared
+     * by reading it:
+     */
+    uint32_t reg_value =
+        ethernet_phy_mdio_read_nolock(ethernet_phy_p,
+                                      ETHERNET_PHY_INTR_CONTROL_STATUS_REG);
+    bool link_changed = (reg_value & (ETHERNET_PHY_LINK_DOWN_INTR_MASK |
+                                      ETHERNET_PHY_LINK_UP_INTR_MASK)) != 0;
+
+    if (link_changed) {
+        /*
+         * The link status bit latches link failures until read, so it is
+         * read twice to get the current link state:
+         */
+        (void)ethernet_phy_mdio_read_nolock(ethernet_phy_p,
+                                            ETHERNET_PHY_STATUS_REG);
+        reg_value = ethernet_phy_mdio_read_nolock(ethernet_phy_p,
+                                                  ETHERNET_PHY_STATUS_REG);
+        *link_up_p = (reg_value & ETHERNET_PHY_LINK_UP_MASK) != 0;
+    }
+
+    rtos_mutex_unlock(&phy_var_p->mutex);
+    return link_changed;
+}
+
+
+/**
+ * Gets the link mode (speed, duplex and flow control) resolved by
+ * auto-negotiation for a given Ethernet PHY
+ *
+ * @param ethernet_phy_p Pointer to Ethernet PHY
+ * @param link_mode_p    Area where the link mode is returned
+ *
+ * @return true, if auto-negotiation has completed
+ * @return false, otherwise (*link_mode_p is not modified)
+ */
+bool ethernet_phy_get_link_mode(const struct ethernet_phy_device *ethernet_phy_p,
+                                struct ethernet_phy_link_mode *link_mode_p)
+{
+    D_ASSERT(ethernet_phy_p->signature == ETHERNET_PHY_DEVICE_SIGNATURE);
+    struct ethernet_phy_device_var *const phy_var_p = ethernet_phy_p->var_p;
+
+    D_ASSERT(phy_var_p->initialized);
+    uint32_t reg_value = ethernet_phy_mdio_read(ethernet_phy_p,
+                                                ETHERNET_PHY_CONTROL1_REG);
+    uint32_t operation_mode = GET_BIT_FIELD(reg_value,
+                                            ETHERNET_PHY_OPERATION_MODE_MASK,
+                                            ETHERNET_PHY_OPERATION_MODE_SHIFT);
+
+    switch (operation_mode) {
+    case ETHERNET_PHY_OPERATION_MODE_10_BASE_T_HALF_DUPLEX:
+        link_mode_p->speed_100_mbps = false;
+        link_mode_p->full_duplex = false;
+        break;
+
+    case ETHERNET_PHY_OPERATION_MODE_100_BASE_TX_HALF_DUPLEX:
+        link_mode_p->speed_100_mbps = true;
+        link_mode_p->full_duplex = false;
+        break;
+
+    case ETHERNET_PHY_OPERATION_MODE_10_BASE_T_FULL_DUPLEX:
+        link_mode_p->speed_100_mbps = false;
+        link_mode_p->full_duplex = true;
+        break;
+
+    case ETHERNET_PHY_OPERATION_MODE_100_BASE_TX_FULL_DUPLEX:
+        link_mode_p->speed_100_mbps = true;
+        link_mode_p->full_duplex = true;
+        break;
+
+    default:
+        return false;
+    }
+
+    /*
+     * Pause frames are only used on full-duplex links:
+     */
+    link_mode_p->pause = link_mode_p->full_duplex &&
+                         (reg_value & ETHERNET_PHY_PAUSE_ENABLED_MASK) != 0;
+    return true;
+}
+
+
 /**
  * Turns on/off loopback mode for the Ethernet PHY
  *
@@ -11,7 +11,9 @@
 #include <stdint.h>
 #include "runtime_checks.h"
 #include "microcontroller.h"
+#if defined(K64F_MCU)
 #include "pin_config.h"
+#endif
 
 /**
  * Const fields of an Ethernet PHY device (to be placed in flash)
@@ -39,6 +41,7 @@ struct ethernet_phy_device {
      */
     uint32_t mdio_address;
 
+#if defined(K64F_MCU)
     /*
      * RMII interface pins used to connect the MCU's Ethernet MAC to this PHY chip
      */
@@ -58,16 +61,41 @@ struct ethernet_phy_device {
      */
     struct pin_info rmii_mdio_pin;
     struct pin_info rmii_mdc_pin;
+#endif
 };
 
+/**
+ * Ethernet link mode resolved by auto-negotiation
+ */
+struct ethernet_phy_link_mode {
+    /**
+     * true for 100 Mb/s, false for 10 Mb/s
+     */
+    bool speed_100_mbps;
+
+    bool full_duplex;
+
+    /**
+     * true if both link partners can send and honor pause frames
+     */
+    bool pause;
+};
 
 void ethernet_phy_init(const struct ethernet_phy_device *ethernet_phy_p);
 
+void ethernet_phy_mdio_irq_handler(const struct ethernet_phy_device *ethernet_phy_p);
+
 bool ethernet_phy_link_is_up(const struct ethernet_phy_device *ethernet_phy_p);
 
+bool ethernet_phy_get_link_change(const struct ethernet_phy_device *ethernet_phy_p,
+                                  bool *link_up_p);
+
+bool ethernet_phy_get_link_mode(const struct ethernet_phy_device *ethernet_phy_p,
+                                struct ethernet_phy_link_mode *link_mode_p);
+
 void ethernet_phy_set_loopback(const struct ethernet_phy_device *ethernet_phy_p,
 		                       bool on);
 
-extern const struct ethernet_phy_device g_ethernet_phy0;
+extern const struct ethernet_phy_device g_ethernet_phys[];
 
 #endif /* SOURCES_BUILDING_BLOCKS_ETHERNET_PHY_H_ */
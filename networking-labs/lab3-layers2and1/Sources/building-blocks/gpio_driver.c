@@ -29,26 +29,27 @@ static GPIO_Type *const g_pin_gpio_regs[NUM_PIN_PORTS] = {
 void gpio_configure_pin(const struct gpio_pin *gpio_pin_p, uint32_t pin_flags,
 		   	   	        bool is_output)
 {
-    uint32_t reg_value;
-
     uint32_t old_primask = disable_cpu_interrupts();
 
     set_pin_function(&gpio_pin_p->pin_info, pin_flags);
 
+    restore_cpu_interrupts(old_primask);
+
     volatile GPIO_Type *gpio_regs_p =
         g_pin_gpio_regs[gpio_pin_p->pin_info.pin_port];
 
-   if (is_output) {
-        reg_value = READ_MMIO_REGISTER(&gpio_regs_p->PDDR);
-        reg_value |= gpio_pin_p->pin_bit_mask;
-        WRITE_MMIO_REGISTER(&gpio_regs_p->PDDR, reg_value);
+    D_ASSERT(gpio_pin_p->pin_bit_mask == BIT(gpio_pin_p->pin_info.pin_index));
+
+    /*
+     * The GPIO registers are in the peripheral bit-band region, so the pin's
+     * PDDR bit is updated with one store, without a read-modify-write of the
+     * register shared by all pins of the port:
+     */
+    if (is_output) {
+        bit_band_set_bit(&gpio_regs_p->PDDR, gpio_pin_p->pin_info.pin_index);
     } else {
-        reg_value = READ_MMIO_REGISTER(&gpio_regs_p->PDDR);
-        reg_value &= ~gpio_pin_p->pin_bit_mask;
-        WRITE_MMIO_REGISTER(&gpio_regs_p->PDDR, reg_value);
+        bit_band_clear_bit(&gpio_regs_p->PDDR, gpio_pin_p->pin_info.pin_index);
     }
-
-    restore_cpu_interrupts(old_primask);
 }
 
 
@@ -128,6 +129,78 @@ bool gpio_read_input_pin(const struct gpio_pin *gpio_pin_p)
 }
 
 
+/**
+ * Sets high several output pins of the same port, with one register write
+ *
+ * @param pin_port  pin port
+ * @param pins_mask bit mask of the pins to set high
+ */
+void gpio_set_port_pins(pin_port_t pin_port, uint32_t pins_mask)
+{
+    volatile GPIO_Type *gpio_regs_p = g_pin_gpio_regs[pin_port];
+
+    D_ASSERT((READ_MMIO_REGISTER(&gpio_regs_p->PDDR) & pins_mask) == pins_mask);
+    WRITE_MMIO_REGISTER(&gpio_regs_p->PSOR, pins_mask);
+}
+
+
+/**
+ * Sets low several output pins of the same port, with one register write
+ *
+ * @param pin_port  pin port
+ * @param pins_mask bit mask of the pins to set low
+ */
+void gpio_clear_port_pins(pin_port_t pin_port, uint32_t pins_mask)
+{
+    volatile GPIO_Type *gpio_regs_p = g_pin_gpio_regs[pin_port];
+
+    D_ASSERT((READ_MMIO_REGISTER(&gpio_regs_p->PDDR) & pins_mask) == pins_mask);
+    WRITE_MMIO_REGISTER(&gpio_regs_p->PCOR, pins_mask);
+}
+
+
+/**
+ * Toggles several output pins of the same port, with one register write
+ *
+ * @param pin_port  pin port
+ * @param pins_mask bit mask of the pins to toggle
+ */
+void gpio_toggle_port_pins(pin_port_t pin_port, uint32_t pins_mask)
+{
+    volatile GPIO_Type *gpio_regs_p = g_pin_gpio_regs[pin_port];
+
+    D_ASSERT((READ_MMIO_REGISTER(&gpio_regs_p->PDDR) & pins_mask) == pins_mask);
+    WRITE_MMIO_REGISTER(&gpio_regs_p->PTOR, pins_mask);
+}
+
+
+/**
+ * Sets several output pins of the same port to the given levels. All the
+ * pins change at once, as PDOR is written only once. The read-modify-write
+ * of PDOR is done with interrupts disabled, so that it does not undo
+ * changes to other pins of the port made from ISRs.
+ *
+ * @param pin_port      pin port
+ * @param pins_mask     bit mask of the pins to change
+ * @param pins_value    new levels of the pins (bits outside pins_mask are
+ *                      ignored)
+ */
+void gpio_write_port_pins(pin_port_t pin_port, uint32_t pins_mask,
+                          uint32_t pins_value)
+{
+    volatile GPIO_Type *gpio_regs_p = g_pin_gpio_regs[pin_port];
+
+    D_ASSERT((READ_MMIO_REGISTER(&gpio_regs_p->PDDR) & pins_mask) == pins_mask);
+
+    uint32_t old_primask = disable_cpu_interrupts();
+    uint32_t reg_value = READ_MMIO_REGISTER(&gpio_regs_p->PDOR);
+
+    reg_value = (reg_value & ~pins_mask) | (pins_value & pins_mask);
+    WRITE_MMIO_REGISTER(&gpio_regs_p->PDOR, reg_value);
+    restore_cpu_interrupts(old_primask);
+}
+
+
 void gpio_enable_pin_irq(const struct gpio_pin *gpio_pin_p, enum gpio_pin_irq_type irq_type)
 {
 	uint32_t reg_value;
@@ -51,6 +51,15 @@ void gpio_toggle_output_pin(const struct gpio_pin *gpio_pin_p);
 
 bool gpio_read_input_pin(const struct gpio_pin *gpio_pin_p);
 
+void gpio_set_port_pins(pin_port_t pin_port, uint32_t pins_mask);
+
+void gpio_clear_port_pins(pin_port_t pin_port, uint32_t pins_mask);
+
+void gpio_toggle_port_pins(pin_port_t pin_port, uint32_t pins_mask);
+
+void gpio_write_port_pins(pin_port_t pin_port, uint32_t pins_mask,
+                          uint32_t pins_value);
+
 void gpio_enable_pin_irq(const struct gpio_pin *gpio_pin_p, enum gpio_pin_irq_type irq_type);
 
 void gpio_disable_pin_irq(const struct gpio_pin *gpio_pin_p);
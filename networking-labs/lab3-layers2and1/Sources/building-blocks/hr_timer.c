@@ -0,0 +1,401 @@
+/**
+ * @file hr_timer.c
+ *
+ * High-resolution timer service implementation
+ *
+ * @author German Rivera
+ */
+#include "hr_timer.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+#include "io_utils.h"
+#include "time_utils.h"
+#include "rtos_wrapper.h"
+#include "interrupt_vector_table.h"
+#include "microcontroller.h"
+#include <stddef.h>
+
+/**
+ * Number of CPU cycles per cycle of the bus clock, which clocks the PIT
+ */
+#define HR_TIMER_CPU_CYCLES_PER_BUS_CYCLE \
+        (MCU_CPU_CLOCK_FREQ_IN_HZ / MCU_BUS_CLOCK_FREQ_IN_HZ)
+
+/**
+ * Minimum countdown programmed in the PIT, in bus clock cycles (1 us), so
+ * that a deadline that is already due or imminent does not make the PIT
+ * fire before the interrupt handler has returned
+ */
+#define HR_TIMER_MIN_COUNTDOWN_BUS_CYCLES \
+        (MCU_BUS_CLOCK_FREQ_IN_HZ / UINT32_C(1000000))
+
+/**
+ * State of the high-resolution timer service
+ */
+struct hr_timer_service {
+    /**
+     * Flag indicating if hr_timer_service_init() has been called
+     */
+    bool initialized;
+
+    /**
+     * List of armed timers, sorted by expiration. The PIT is always
+     * programmed to fire at the expiration of the first one.
+     */
+    struct hr_timer *armed_timers_p;
+
+    struct hr_timer_stats stats;
+};
+
+static struct hr_timer_service g_hr_timer_service;
+
+
+/**
+ * Programs the PIT to fire at the expiration of the first armed timer, or
+ * stops it if there are no armed timers. Must be called with interrupts
+ * disabled.
+ */
+static void hr_timer_reprogram(struct hr_timer_service *service_p)
+{
+    struct hr_timer *first_timer_p = service_p->armed_timers_p;
+
+    WRITE_MMIO_REGISTER(&PIT_TCTRL1, 0);
+    if (first_timer_p == NULL) {
+        return;
+    }
+
+    uint64_t now_cycles = get_monotonic_cycles();
+    uint32_t countdown = HR_TIMER_MIN_COUNTDOWN_BUS_CYCLES;
+
+    if (first_timer_p->expiration_cycles > now_cycles) {
+        uint64_t delta_cycles = first_timer_p->expiration_cycles - now_cycles;
+
+        if (delta_cycles > UINT32_MAX) {
+            delta_cycles = UINT32_MAX;
+        }
+
+        countdown = (uint32_t)delta_cycles / HR_TIMER_CPU_CYCLES_PER_BUS_CYCLE;
+        if (countdown < HR_TIMER_MIN_COUNTDOWN_BUS_CYCLES) {
+            countdown = HR_TIMER_MIN_COUNTDOWN_BUS_CYCLES;
+        }
+    }
+
+    /*
+     * Disabling and re-enabling the PIT channel makes it start counting down
+     * from the new load value right away:
+     */
+    WRITE_MMIO_REGISTER(&PIT_TFLG1, PIT_TFLG_TIF_MASK);
+    WRITE_MMIO_REGISTER(&PIT_LDVAL1, countdown - 1);
+    WRITE_MMIO_REGISTER(&PIT_TCTRL1, PIT_TCTRL_TIE_MASK | PIT_TCTRL_TEN_MASK);
+}
+
+
+/**
+ * Inserts a timer in the list of armed timers, after any other timers with
+ * the same expiration. Must be called with interrupts disabled.
+ */
+static void hr_timer_insert(struct hr_timer_service *service_p,
+                            struct hr_timer *timer_p)
+{
+    struct hr_timer **link_p = &service_p->armed_timers_p;
+
+    while (*link_p != NULL &&
+           (*link_p)->expiration_cycles <= timer_p->expiration_cycles) {
+        link_p = &(*link_p)->next_p;
+    }
+
+    timer_p->next_p = *link_p;
+    *link_p = timer_p;
+    timer_p->armed = true;
+}
+
+
+/**
+ * Removes an armed timer from the list of armed timers. Must be called with
+ * interrupts disabled.
+ */
+static void hr_timer_remove(struct hr_timer_service *service_p,
+                            struct hr_timer *timer_p)
+{
+    struct hr_timer **link_p = &service_p->armed_timers_p;
+
+    D_ASSERT(timer_p->armed);
+    while (*link_p != timer_p) {
+        D_ASSERT(*link_p != NULL);
+        link_p = &(*link_p)->next_p;
+    }
+
+    *link_p = timer_p->next_p;
+    timer_p->next_p = NULL;
+    timer_p->armed = false;
+}
+
+
+/**
+ * Initializes the high-resolution timer service
+ */
+void hr_timer_service_init(void)
+{
+    struct hr_timer_service *const service_p = &g_hr_timer_service;
+    uint32_t reg_value;
+
+    D_ASSERT(!service_p->initialized);
+
+    /*
+     * Enable clock for the PIT peripheral:
+     */
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC6);
+    reg_value |= SIM_SCGC6_PIT_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC6, reg_value);
+
+    /*
+     * Enable the PIT module, and stop its timers while the CPU is halted
+     * in the debugger (the PIT module is shared with the sampling profiler,
+     * which configures it the same way):
+     */
+    WRITE_MMIO_REGISTER(&PIT_MCR, PIT_MCR_FRZ_MASK);
+    WRITE_MMIO_REGISTER(&PIT_TCTRL1, 0);
+    WRITE_MMIO_REGISTER(&PIT_TFLG1, PIT_TFLG_TIF_MASK);
+
+    nvic_setup_irq(PIT1_IRQn, HR_TIMER_INTERRUPT_PRIORITY);
+    service_p->initialized = true;
+}
+
+
+/**
+ * Initializes a high-resolution timer
+ *
+ * @param timer_p       Pointer to the timer
+ * @param callback_p    Function to call, from the PIT1 interrupt handler,
+ *                      when the timer expires
+ * @param callback_arg  Argument for callback_p
+ */
+void hr_timer_init(struct hr_timer *timer_p,
+                   hr_timer_callback_t *callback_p,
+                   void *callback_arg)
+{
+    D_ASSERT(callback_p != NULL);
+
+    timer_p->signature = HR_TIMER_SIGNATURE;
+    timer_p->armed = false;
+    timer_p->expiration_cycles = 0;
+    timer_p->period_cycles = 0;
+    timer_p->callback_p = callback_p;
+    timer_p->callback_arg = callback_arg;
+    timer_p->next_p = NULL;
+}
+
+
+/**
+ * Arms a high-resolution timer. If the timer is already armed, it is
+ * re-armed with the new timeout. It can be called from tasks, ISRs and
+ * timer callbacks.
+ *
+ * @param timer_p       Pointer to the timer
+ * @param timeout_us    Time from now until the first expiration in
+ *                      microseconds. It is truncated to
+ *                      HR_TIMER_MAX_TIMEOUT_US.
+ * @param period_us     Time between expirations in microseconds, for a
+ *                      periodic timer, or 0 for a one-shot timer. It is
+ *                      truncated to HR_TIMER_MAX_TIMEOUT_US.
+ */
+void hr_timer_start(struct hr_timer *timer_p,
+                    uint32_t timeout_us,
+                    uint32_t period_us)
+{
+    struct hr_timer_service *const service_p = &g_hr_timer_service;
+
+    D_ASSERT(service_p->initialized);
+    D_ASSERT(timer_p->signature == HR_TIMER_SIGNATURE);
+
+    if (timeout_us > HR_TIMER_MAX_TIMEOUT_US) {
+        timeout_us = HR_TIMER_MAX_TIMEOUT_US;
+    }
+
+    if (period_us > HR_TIMER_MAX_TIMEOUT_US) {
+        period_us = HR_TIMER_MAX_TIMEOUT_US;
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (timer_p->armed) {
+        hr_timer_remove(service_p, timer_p);
+    } else {
+        service_p->stats.num_armed_timers ++;
+    }
+
+    timer_p->period_cycles = MICROSECONDS_TO_CPU_CLOCK_CYCLES(period_us);
+    timer_p->expiration_cycles = get_monotonic_cycles() +
+                                 MICROSECONDS_TO_CPU_CLOCK_CYCLES(timeout_us);
+    hr_timer_insert(service_p, timer_p);
+    if (service_p->armed_timers_p == timer_p) {
+        hr_timer_reprogram(service_p);
+    }
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Disarms a high-resolution timer, if it is armed. It can be called from
+ * tasks, ISRs and timer callbacks.
+ *
+ * NOTE: If called from a task, the timer's callback may be running in the
+ * interrupted context of another task, when this function returns.
+ *
+ * @param timer_p       Pointer to the timer
+ */
+void hr_timer_stop(struct hr_timer *timer_p)
+{
+    struct hr_timer_service *const service_p = &g_hr_timer_service;
+
+    D_ASSERT(service_p->initialized);
+    D_ASSERT(timer_p->signature == HR_TIMER_SIGNATURE);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (timer_p->armed) {
+        bool was_first = (service_p->armed_timers_p == timer_p);
+
+        hr_timer_remove(service_p, timer_p);
+        service_p->stats.num_armed_timers --;
+        if (was_first) {
+            hr_timer_reprogram(service_p);
+        }
+    }
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Returns the statistics of the high-resolution timer service
+ */
+void hr_timer_get_stats(struct hr_timer_stats *stats_p)
+{
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    *stats_p = g_hr_timer_service.stats;
+    restore_cpu_interrupts(int_mask);
+}
+
+
+static void hr_timer_wake_up_task_callback(struct hr_timer *timer_p, void *arg)
+{
+    rtos_task_wake_up(arg);
+}
+
+
+/**
+ * Delays the caller a given number of microseconds. If the delay is at least
+ * HR_TIMER_DELAY_SPIN_THRESHOLD_US and the caller is an RTOS task with
+ * interrupts enabled, the caller is blocked until a high-resolution timer
+ * wakes it up, so that other tasks can use the CPU meanwhile. Otherwise
+ * (short delays, ISRs, interrupts disabled, before the high-resolution timer
+ * service is initialized), it busy-waits on the CPU cycle counter.
+ *
+ * @param us    Number of microseconds to delay (at most
+ *              HR_TIMER_MAX_TIMEOUT_US)
+ */
+void hr_timer_delay_us(uint32_t us)
+{
+    struct hr_timer_service *const service_p = &g_hr_timer_service;
+    struct rtos_task *task_p = NULL;
+
+    D_ASSERT(us <= HR_TIMER_MAX_TIMEOUT_US);
+
+    if (us >= HR_TIMER_DELAY_SPIN_THRESHOLD_US && service_p->initialized &&
+        CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED()) {
+        task_p = rtos_task_self();
+    }
+
+    if (task_p != NULL) {
+        struct hr_timer timer;
+
+        hr_timer_init(&timer, hr_timer_wake_up_task_callback, task_p);
+        hr_timer_start(&timer, us, 0);
+        rtos_task_sleep();
+        D_ASSERT(!timer.armed);
+        ATOMIC_POST_INCREMENT_UINT32(&service_p->stats.blocking_delays_count);
+    } else {
+        uint64_t end_cycles = get_monotonic_cycles() +
+                              MICROSECONDS_TO_CPU_CLOCK_CYCLES(us);
+
+        while (get_monotonic_cycles() < end_cycles) {
+            ;
+        }
+
+        ATOMIC_POST_INCREMENT_UINT32(&service_p->stats.spinning_delays_count);
+    }
+}
+
+
+/**
+ * ISR for the PIT channel 1 interrupt. It invokes the callbacks of all the
+ * timers that have expired, re-arming the periodic ones, and then programs
+ * the PIT for the next deadline.
+ */
+void pit1_irq_handler(void)
+{
+    struct hr_timer_service *const service_p = &g_hr_timer_service;
+    uint32_t int_mask;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    WRITE_MMIO_REGISTER(&PIT_TFLG1, PIT_TFLG_TIF_MASK);
+    service_p->stats.interrupts_count ++;
+
+    for ( ; ; ) {
+        int_mask = disable_cpu_interrupts();
+
+        struct hr_timer *timer_p = service_p->armed_timers_p;
+        uint64_t now_cycles = get_monotonic_cycles();
+
+        if (timer_p == NULL || timer_p->expiration_cycles > now_cycles) {
+            break;
+        }
+
+        uint64_t late_cycles = now_cycles - timer_p->expiration_cycles;
+
+        if (late_cycles > service_p->stats.max_late_cycles) {
+            service_p->stats.max_late_cycles =
+                late_cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)late_cycles;
+        }
+
+        hr_timer_remove(service_p, timer_p);
+        if (timer_p->period_cycles != 0) {
+            /*
+             * Keep periodic timers in phase with their first expiration,
+             * skipping any periods that have already gone by:
+             */
+            timer_p->expiration_cycles += timer_p->period_cycles;
+            if (timer_p->expiration_cycles <= now_cycles) {
+                uint32_t skipped_periods =
+                    (now_cycles - timer_p->expiration_cycles) /
+                    timer_p->period_cycles + 1;
+
+                timer_p->expiration_cycles +=
+                    (uint64_t)skipped_periods * timer_p->period_cycles;
+                service_p->stats.overruns_count += skipped_periods;
+            }
+
+            hr_timer_insert(service_p, timer_p);
+        } else {
+            service_p->stats.num_armed_timers --;
+        }
+
+        service_p->stats.expirations_count ++;
+        restore_cpu_interrupts(int_mask);
+
+        /*
+         * The callback is invoked with interrupts enabled, and it can
+         * re-arm or stop any timer, including its own:
+         */
+        timer_p->callback_p(timer_p, timer_p->callback_arg);
+    }
+
+    hr_timer_reprogram(service_p);
+    restore_cpu_interrupts(int_mask);
+    rtos_exit_isr();
+}
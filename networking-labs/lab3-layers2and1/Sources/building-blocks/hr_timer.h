@@ -0,0 +1,147 @@
+/**
+ * @file hr_timer.h
+ *
+ * High-resolution timer service interface
+ *
+ * The high-resolution timer service multiplexes any number of one-shot and
+ * periodic software timers onto a single hardware countdown timer (PIT
+ * channel 1), which is always re-armed to fire at the earliest deadline
+ * of the armed timers. Deadlines are kept as 64-bit counts of CPU cycles,
+ * as returned by get_monotonic_cycles(), so timeouts have microsecond
+ * resolution and do not depend on the RTOS tick.
+ *
+ * Timer callbacks are invoked from the PIT1 interrupt handler, so they must
+ * be short and can only call RTOS services that can be called from ISRs
+ * (e.g., rtos_semaphore_signal()). For longer timeouts, where millisecond
+ * resolution is enough, use a timer wheel (timer_wheel.h) instead.
+ *
+ * hr_timer_delay_us() is a drop-in replacement for delay_us() that blocks
+ * the calling task on a high-resolution timer instead of spinning, when the
+ * delay is long enough and the caller is allowed to block.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_HR_TIMER_H_
+#define SOURCES_BUILDING_BLOCKS_HR_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "runtime_checks.h"
+#include "microcontroller.h"
+
+/**
+ * Maximum timeout or period of a high-resolution timer in microseconds
+ * (the number of CPU cycles in it must fit in 32 bits)
+ */
+#define HR_TIMER_MAX_TIMEOUT_US \
+        (UINT32_MAX / MCU_CPU_CLOCK_FREQ_IN_MHZ)
+
+/**
+ * Delays shorter than this number of microseconds are busy-waited by
+ * hr_timer_delay_us(), as they would not be long enough to pay for the two
+ * context switches of blocking the calling task
+ */
+#define HR_TIMER_DELAY_SPIN_THRESHOLD_US    20
+
+struct hr_timer;
+
+/**
+ * Signature of a high-resolution timer callback function
+ */
+typedef void hr_timer_callback_t(struct hr_timer *timer_p, void *arg);
+
+/**
+ * High-resolution timer
+ */
+struct hr_timer {
+#   define HR_TIMER_SIGNATURE  GEN_SIGNATURE('H', 'R', 'T', 'M')
+    uint32_t signature;
+
+    /**
+     * Flag indicating if the timer is currently armed (in the list of
+     * armed timers)
+     */
+    bool armed;
+
+    /**
+     * Value of get_monotonic_cycles() at which the timer expires
+     */
+    uint64_t expiration_cycles;
+
+    /**
+     * Period in CPU cycles, for periodic timers, or 0 for one-shot timers
+     */
+    uint32_t period_cycles;
+
+    /**
+     * Function to call when the timer expires
+     */
+    hr_timer_callback_t *callback_p;
+
+    /**
+     * Argument for callback_p
+     */
+    void *callback_arg;
+
+    /**
+     * Next timer in the list of armed timers, sorted by expiration
+     */
+    struct hr_timer *next_p;
+};
+
+/**
+ * High-resolution timer service statistics
+ */
+struct hr_timer_stats {
+    /**
+     * Number of timers currently armed
+     */
+    uint32_t num_armed_timers;
+
+    /**
+     * Number of timer expirations (callbacks invoked)
+     */
+    uint32_t expirations_count;
+
+    /**
+     * Number of hardware timer interrupts
+     */
+    uint32_t interrupts_count;
+
+    /**
+     * Number of periods skipped by periodic timers, because their callbacks
+     * were invoked too late
+     */
+    uint32_t overruns_count;
+
+    /**
+     * Largest delay between a timer's deadline and the invocation of its
+     * callback, in CPU cycles
+     */
+    uint32_t max_late_cycles;
+
+    /**
+     * Number of hr_timer_delay_us() calls that blocked the calling task, and
+     * that busy-waited
+     */
+    uint32_t blocking_delays_count;
+    uint32_t spinning_delays_count;
+};
+
+void hr_timer_service_init(void);
+
+void hr_timer_init(struct hr_timer *timer_p,
+                   hr_timer_callback_t *callback_p,
+                   void *callback_arg);
+
+void hr_timer_start(struct hr_timer *timer_p,
+                    uint32_t timeout_us,
+                    uint32_t period_us);
+
+void hr_timer_stop(struct hr_timer *timer_p);
+
+void hr_timer_get_stats(struct hr_timer_stats *stats_p);
+
+void hr_timer_delay_us(uint32_t us);
+
+#endif /* SOURCES_BUILDING_BLOCKS_HR_TIMER_H_ */
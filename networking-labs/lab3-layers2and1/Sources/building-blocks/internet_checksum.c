@@ -0,0 +1,174 @@
+/**
+ * @file internet_checksum.c
+ *
+ * Internet checksum (RFC 1071) implementation
+ *
+ * The sum is accumulated a 32-bit word at a time into a 64-bit accumulator,
+ * which the compiler implements with an ADDS/ADC pair per word, and the
+ * carries are folded back in only once, at the end.
+ *
+ * @author German Rivera
+ */
+#include "internet_checksum.h"
+#include "runtime_checks.h"
+
+/**
+ * Folds a one's complement sum to 16 bits
+ */
+static inline uint32_t internet_checksum_fold(uint64_t sum)
+{
+    sum = (sum & UINT32_MAX) + (sum >> 32);
+    sum = (sum & UINT32_MAX) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint32_t)sum;
+}
+
+
+/**
+ * Adds a block of data to a partial one's complement sum. A message can be
+ * summed in several blocks, as long as all of them, except the last one,
+ * have an even length.
+ *
+ * @param sum       Partial sum of the preceding blocks (0 for the first one)
+ * @param data_p    Pointer to the block (any alignment)
+ * @param length    Length of the block in bytes
+ *
+ * @return new partial sum, to be passed to internet_checksum_finish() or to
+ *         the next call of this function
+ */
+uint32_t internet_checksum_add(uint32_t sum, const void *data_p, size_t length)
+{
+    const uint8_t *byte_p = data_p;
+    uint64_t sum64 = 0;
+    uint32_t first_byte = 0;
+    bool odd_start = false;
+
+    /*
+     * If the block starts at an odd address, sum from the next byte (which
+     * pairs bytes the other way around) and swap the bytes of the result
+     * (RFC 1071, section 2.B):
+     */
+    if (length != 0 && ((uintptr_t)byte_p & 0x1) != 0) {
+        first_byte = *byte_p;
+        byte_p ++;
+        length --;
+        odd_start = true;
+    }
+
+    if (length >= sizeof(uint16_t) && ((uintptr_t)byte_p & 0x2) != 0) {
+        sum64 += *(const uint16_t *)byte_p;
+        byte_p += sizeof(uint16_t);
+        length -= sizeof(uint16_t);
+    }
+
+    const uint32_t *word_p = (const uint32_t *)byte_p;
+
+    for ( ; length >= 4 * sizeof(uint32_t); length -= 4 * sizeof(uint32_t)) {
+        sum64 += word_p[0];
+        sum64 += word_p[1];
+        sum64 += word_p[2];
+        sum64 += word_p[3];
+        word_p += 4;
+    }
+
+    for ( ; length >= sizeof(uint32_t); length -= sizeof(uint32_t)) {
+        sum64 += *word_p++;
+    }
+
+    byte_p = (const uint8_t *)word_p;
+    if (length >= sizeof(uint16_t)) {
+        sum64 += *(const uint16_t *)byte_p;
+        byte_p += sizeof(uint16_t);
+        length -= sizeof(uint16_t);
+    }
+
+    /*
+     * A trailing odd byte is summed as if followed by a zero byte. On the
+     * little-endian Cortex-M, the first byte of a 16-bit word in memory is
+     * its least significant one:
+     */
+    if (length != 0) {
+        sum64 += *byte_p;
+    }
+
+    uint32_t block_sum = internet_checksum_fold(sum64);
+
+    if (odd_start) {
+        block_sum = ((block_sum & 0xff) << 8) | (block_sum >> 8);
+        block_sum += first_byte;
+    }
+
+    return internet_checksum_fold((uint64_t)sum + block_sum);
+}
+
+
+/**
+ * Computes the Internet checksum from a partial one's complement sum
+ *
+ * @param sum   Partial sum returned by internet_checksum_add()
+ *
+ * @return checksum in network byte order
+ */
+uint16_t internet_checksum_finish(uint32_t sum)
+{
+    return (uint16_t)~internet_checksum_fold(sum);
+}
+
+
+/**
+ * Computes the Internet checksum (one's complement of the one's complement
+ * sum of all 16-bit words) of a message
+ *
+ * @param data_p    Pointer to the message (any alignment)
+ * @param length    Message length in bytes
+ *
+ * @return checksum in network byte order
+ */
+uint16_t internet_checksum(const void *data_p, size_t length)
+{
+    return internet_checksum_finish(internet_checksum_add(0, data_p, length));
+}
+
+
+/**
+ * Updates a checksum for a change of a 16-bit field of the checksummed
+ * data, without summing the data again (RFC 1624, equation 3:
+ * HC' = ~(~HC + ~m + m'))
+ *
+ * @param checksum  Current checksum
+ * @param old_value Old value of the field
+ * @param new_value New value of the field
+ *
+ * @return new checksum
+ */
+uint16_t internet_checksum_update16(uint16_t checksum, uint16_t old_value,
+                                    uint16_t new_value)
+{
+    uint32_t sum = (uint16_t)~checksum;
+
+    sum += (uint16_t)~old_value;
+    sum += new_value;
+    return internet_checksum_finish(sum);
+}
+
+
+/**
+ * Updates a checksum for a change of a 32-bit field (such as an IPv4
+ * address) of the checksummed data (RFC 1624)
+ *
+ * @param checksum  Current checksum
+ * @param old_value Old value of the field
+ * @param new_value New value of the field
+ *
+ * @return new checksum
+ */
+uint16_t internet_checksum_update32(uint16_t checksum, uint32_t old_value,
+                                    uint32_t new_value)
+{
+    uint32_t sum = (uint16_t)~checksum;
+
+    sum = internet_checksum_add32(sum, ~old_value);
+    sum = internet_checksum_add32(sum, new_value);
+    return internet_checksum_finish(sum);
+}
@@ -0,0 +1,48 @@
+/**
+ * @file internet_checksum.h
+ *
+ * Internet checksum (RFC 1071) interface, for the paths not covered by the
+ * Ethernet MAC's checksum offload
+ *
+ * All 16-bit values passed to or returned by these functions are in network
+ * byte order, as they are in packet headers. The one's complement sum does
+ * not depend on byte order, so no byte swapping is ever needed.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_INTERNET_CHECKSUM_H_
+#define SOURCES_BUILDING_BLOCKS_INTERNET_CHECKSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint32_t internet_checksum_add(uint32_t sum, const void *data_p, size_t length);
+
+uint16_t internet_checksum_finish(uint32_t sum);
+
+uint16_t internet_checksum(const void *data_p, size_t length);
+
+uint16_t internet_checksum_update16(uint16_t checksum, uint16_t old_value,
+                                    uint16_t new_value);
+
+uint16_t internet_checksum_update32(uint16_t checksum, uint32_t old_value,
+                                    uint32_t new_value);
+
+/**
+ * Adds a 16-bit value to a partial sum
+ */
+static inline uint32_t internet_checksum_add16(uint32_t sum, uint16_t value)
+{
+    return sum + value;
+}
+
+
+/**
+ * Adds a 32-bit value (two 16-bit words) to a partial sum
+ */
+static inline uint32_t internet_checksum_add32(uint32_t sum, uint32_t value)
+{
+    return sum + (value & 0xffff) + (value >> 16);
+}
+
+#endif /* SOURCES_BUILDING_BLOCKS_INTERNET_CHECKSUM_H_ */
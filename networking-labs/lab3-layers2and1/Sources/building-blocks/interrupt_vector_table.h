@@ -11,11 +11,18 @@
 #include "microcontroller.h"
 
 #define HW_TIMER_INTERRUPT_PRIORITY             (MCU_HIGHEST_INTERRUPT_PRIORITY + 1)
+#define SAMPLING_PROFILER_INTERRUPT_PRIORITY    MCU_HIGHEST_INTERRUPT_PRIORITY
+#define HR_TIMER_INTERRUPT_PRIORITY             (MCU_HIGHEST_INTERRUPT_PRIORITY + 2)
 
 #define ETHERNET_MAC_RX_INTERRUPT_PRIORITY      (MCU_LOWEST_INTERRUPT_PRIORITY - 2)
 #define ETHERNET_MAC_TX_INTERRUPT_PRIORITY      (MCU_LOWEST_INTERRUPT_PRIORITY - 1)
 #define ETHERNET_MAC_ERROR_INTERRUPT_PRIORITY   (MCU_LOWEST_INTERRUPT_PRIORITY - 3)
+#define ETHERNET_MAC_TX_LAUNCH_INTERRUPT_PRIORITY (MCU_HIGHEST_INTERRUPT_PRIORITY + 3)
+#define ETHERNET_MAC_INTERRUPT_PRIORITY         (MCU_LOWEST_INTERRUPT_PRIORITY - 3)
 #define UART_INTERRUPT_PRIORITY                 (MCU_LOWEST_INTERRUPT_PRIORITY)
+#define CRC_32_DMA_INTERRUPT_PRIORITY           (MCU_LOWEST_INTERRUPT_PRIORITY - 1)
+#define DMA_MEMCPY_INTERRUPT_PRIORITY           (MCU_LOWEST_INTERRUPT_PRIORITY - 1)
+#define NOR_FLASH_INTERRUPT_PRIORITY            (MCU_LOWEST_INTERRUPT_PRIORITY - 1)
 
 /**
  * Base interrupt vector number for external IRQs
@@ -76,6 +83,10 @@ void SysTick_Handler(void);
 
 void lptmr0_irq_handler(void);
 
+void pit0_irq_handler(void);
+
+void pit1_irq_handler(void);
+
 void uart0_rx_tx_irq_handler(void);
 
 void uart0_error_irq_handler(void);
@@ -84,12 +95,26 @@ void uart4_rx_tx_irq_handler(void);
 
 void uart4_error_irq_handler(void);
 
+void uart0_rx_dma_irq_handler(void);
+
+void uart4_rx_dma_irq_handler(void);
+
+void crc_32_dma_irq_handler(void);
+
+void dma_memcpy_irq_handler(void);
+
+void nor_flash_irq_handler(void);
+
 void ethernet_mac0_tx_irq_handler(void);
 
 void ethernet_mac0_rx_irq_handler(void);
 
 void ethernet_mac0_error_irq_handler(void);
 
+void ethernet_mac0_ieee_1588_timer_irq_handler(void);
+
+void ethernet_mac0_irq_handler(void);
+
 extern isr_function_t *const g_interrupt_vector_table[];
 
 #endif /* SOURCES_BUILDING_BLOCKS_INTERRUPT_VECTOR_TABLE_H_ */
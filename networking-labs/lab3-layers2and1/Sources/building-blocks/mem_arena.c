@@ -0,0 +1,107 @@
+/**
+ * @file mem_arena.c
+ *
+ * Memory arena (bump-pointer allocator) implementation
+ *
+ * @author German Rivera
+ */
+#include "mem_arena.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+
+/**
+ * List of all memory arenas, for stats reporting
+ */
+static struct mem_arena *g_mem_arenas_list_head_p = NULL;
+
+
+/**
+ * Initializes a memory arena, with all its storage free
+ *
+ * @param arena_p       Pointer to the arena
+ * @param name_p        Name of the arena
+ * @param storage_p     Storage area for the arena (typically defined with
+ *                      MEM_ARENA_STORAGE())
+ * @param storage_size  Size in bytes of the storage area
+ */
+void mem_arena_init(struct mem_arena *arena_p,
+                    const char *name_p,
+                    void *storage_p,
+                    size_t storage_size)
+{
+    D_ASSERT(storage_p != NULL);
+    D_ASSERT(storage_size != 0);
+
+    arena_p->signature = MEM_ARENA_SIGNATURE;
+    arena_p->name_p = name_p;
+    arena_p->storage_p = storage_p;
+    arena_p->size = storage_size;
+    arena_p->cursor = 0;
+    arena_p->high_water_mark = 0;
+    arena_p->alloc_failures_count = 0;
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    arena_p->next_p = g_mem_arenas_list_head_p;
+    g_mem_arenas_list_head_p = arena_p;
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Allocates a chunk of memory from a memory arena. The chunk stays allocated
+ * until the arena is reset to a mark taken before this call.
+ *
+ * @param arena_p   Pointer to the arena
+ * @param size      Size in bytes of the chunk
+ * @param alignment Alignment in bytes of the chunk (power of 2), or 0 for
+ *                  MEM_ARENA_DEFAULT_ALIGNMENT
+ *
+ * @return pointer to the chunk, or NULL if the arena does not have enough
+ *         free space left
+ */
+void *mem_arena_alloc(struct mem_arena *arena_p,
+                      size_t size,
+                      size_t alignment)
+{
+    D_ASSERT(arena_p->signature == MEM_ARENA_SIGNATURE);
+    if (alignment == 0) {
+        alignment = MEM_ARENA_DEFAULT_ALIGNMENT;
+    }
+
+    D_ASSERT(IS_POWER_OF_2(alignment));
+
+    uintptr_t base_addr = (uintptr_t)arena_p->storage_p;
+    size_t offset = ROUND_UP(base_addr + arena_p->cursor, alignment) - base_addr;
+
+    if (offset > arena_p->size || size > arena_p->size - offset) {
+        arena_p->alloc_failures_count ++;
+        return NULL;
+    }
+
+    arena_p->cursor = offset + size;
+    if (arena_p->cursor > arena_p->high_water_mark) {
+        arena_p->high_water_mark = arena_p->cursor;
+    }
+
+    return arena_p->storage_p + offset;
+}
+
+
+/**
+ * Iterates over the list of all memory arenas
+ *
+ * @param arena_p   NULL to get the first arena, or pointer to the arena
+ *                  returned by the previous call
+ *
+ * @return pointer to the next arena, or NULL if there are no more arenas
+ */
+const struct mem_arena *mem_arena_get_next(const struct mem_arena *arena_p)
+{
+    if (arena_p == NULL) {
+        return g_mem_arenas_list_head_p;
+    }
+
+    D_ASSERT(arena_p->signature == MEM_ARENA_SIGNATURE);
+    return arena_p->next_p;
+}
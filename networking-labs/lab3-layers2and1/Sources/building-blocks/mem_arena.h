@@ -0,0 +1,134 @@
+/**
+ * @file mem_arena.h
+ *
+ * Memory arena (bump-pointer allocator) interface
+ *
+ * A memory arena hands out variable-size chunks of memory, carved out of a
+ * caller-provided storage area, by just advancing a cursor. Chunks are not
+ * freed individually. Instead, the caller saves a mark (the current cursor)
+ * before allocating temporary chunks, and resets the arena back to that mark
+ * when it is done with them, which releases all the chunks allocated after
+ * the mark at once.
+ *
+ * An arena is not thread-safe: it is meant to be used by only one task. In
+ * particular, each task can have its own scratch arena (see
+ * rtos_task_set_scratch_arena()), for temporary buffers that would
+ * otherwise be allocated on the task's stack.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_MEM_ARENA_H_
+#define SOURCES_BUILDING_BLOCKS_MEM_ARENA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mem_utils.h"
+#include "runtime_checks.h"
+#include "microcontroller.h"
+
+/**
+ * Default alignment in bytes of the chunks allocated from a memory arena
+ */
+#define MEM_ARENA_DEFAULT_ALIGNMENT UINT32_C(8)
+
+/**
+ * Defines a storage area for a memory arena, aligned and padded for the
+ * alignment required by MPU regions
+ */
+#define MEM_ARENA_STORAGE(_name, _size) \
+        uint8_t _name[ROUND_UP(_size, MPU_REGION_ALIGNMENT)] \
+            __attribute__ ((aligned(MPU_REGION_ALIGNMENT)))
+
+/**
+ * Memory arena
+ */
+struct mem_arena {
+#   define MEM_ARENA_SIGNATURE  GEN_SIGNATURE('M', 'A', 'R', 'N')
+    uint32_t signature;
+
+    /**
+     * Arena name (null-terminated string)
+     */
+    const char *name_p;
+
+    /**
+     * Storage area of the arena
+     */
+    uint8_t *storage_p;
+
+    /**
+     * Size in bytes of the storage area
+     */
+    size_t size;
+
+    /**
+     * Offset of the first free byte in the storage area
+     */
+    size_t cursor;
+
+    /**
+     * Highest value that cursor ever reached
+     */
+    size_t high_water_mark;
+
+    /**
+     * Number of allocations that failed because the arena was full
+     */
+    uint32_t alloc_failures_count;
+
+    /**
+     * Next arena in the list of all memory arenas
+     */
+    struct mem_arena *next_p;
+};
+
+/**
+ * Saved position of a memory arena's cursor (see mem_arena_get_mark())
+ */
+typedef size_t mem_arena_mark_t;
+
+void mem_arena_init(struct mem_arena *arena_p,
+                    const char *name_p,
+                    void *storage_p,
+                    size_t storage_size);
+
+void *mem_arena_alloc(struct mem_arena *arena_p,
+                      size_t size,
+                      size_t alignment);
+
+const struct mem_arena *mem_arena_get_next(const struct mem_arena *arena_p);
+
+
+/**
+ * Returns the current position of a memory arena's cursor, to later release
+ * all the chunks allocated after this point, with mem_arena_reset_to_mark()
+ */
+static inline mem_arena_mark_t mem_arena_get_mark(const struct mem_arena *arena_p)
+{
+    D_ASSERT(arena_p->signature == MEM_ARENA_SIGNATURE);
+    return arena_p->cursor;
+}
+
+
+/**
+ * Releases all the chunks allocated from a memory arena after the given mark
+ * was taken
+ */
+static inline void mem_arena_reset_to_mark(struct mem_arena *arena_p,
+                                           mem_arena_mark_t mark)
+{
+    D_ASSERT(arena_p->signature == MEM_ARENA_SIGNATURE);
+    D_ASSERT(mark <= arena_p->cursor);
+    arena_p->cursor = mark;
+}
+
+
+/**
+ * Releases all the chunks allocated from a memory arena
+ */
+static inline void mem_arena_reset(struct mem_arena *arena_p)
+{
+    mem_arena_reset_to_mark(arena_p, 0);
+}
+
+#endif /* SOURCES_BUILDING_BLOCKS_MEM_ARENA_H_ */
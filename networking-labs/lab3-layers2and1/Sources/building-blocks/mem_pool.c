@@ -0,0 +1,194 @@
+/**
+ * @file mem_pool.c
+ *
+ * Fixed-block memory pool implementation
+ *
+ * @author German Rivera
+ */
+#include "mem_pool.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+
+/**
+ * List of all memory pools, for stats reporting
+ */
+static struct mem_pool *g_mem_pools_list_head_p = NULL;
+
+
+/**
+ * Initializes a memory pool, with all its blocks free
+ *
+ * @param pool_p        Pointer to the pool
+ * @param name_p        Name of the pool
+ * @param storage_p     Storage area for the pool's blocks (typically defined
+ *                      with MEM_POOL_STORAGE()). It must be aligned to
+ *                      MEM_POOL_BLOCK_ALIGNMENT.
+ * @param storage_size  Size in bytes of the storage area
+ * @param block_size    Size in bytes of each block
+ * @param lock_free     Flag indicating if the pool's free list is to be
+ *                      updated lock-free. If false, it is updated with
+ *                      interrupts disabled.
+ */
+void mem_pool_init(struct mem_pool *pool_p,
+                   const char *name_p,
+                   void *storage_p,
+                   size_t storage_size,
+                   size_t block_size,
+                   bool lock_free)
+{
+    size_t actual_block_size = MEM_POOL_BLOCK_SIZE(block_size);
+    size_t num_blocks = storage_size / actual_block_size;
+
+    D_ASSERT(((uintptr_t)storage_p & (MEM_POOL_BLOCK_ALIGNMENT - 1)) == 0);
+    D_ASSERT(actual_block_size <= UINT16_MAX);
+    D_ASSERT(num_blocks != 0 && num_blocks <= UINT16_MAX);
+
+    pool_p->signature = MEM_POOL_SIGNATURE;
+    pool_p->name_p = name_p;
+    pool_p->blocks_p = storage_p;
+    pool_p->block_size = actual_block_size;
+    pool_p->num_blocks = num_blocks;
+    pool_p->lock_free = lock_free;
+    pool_p->alloc_count = 0;
+    pool_p->alloc_failures_count = 0;
+    atomic_stack_init(&pool_p->free_list, 0);
+
+    /*
+     * Push blocks in reverse order, so that they are allocated in address
+     * order at first:
+     */
+    for (size_t i = num_blocks; i != 0; i --) {
+        atomic_stack_push(&pool_p->free_list,
+                          pool_p->blocks_p + (i - 1) * actual_block_size);
+    }
+
+    pool_p->num_free_blocks = num_blocks;
+    pool_p->min_free_blocks = num_blocks;
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    pool_p->next_p = g_mem_pools_list_head_p;
+    g_mem_pools_list_head_p = pool_p;
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Allocates a block from a memory pool. It can be called from ISRs.
+ *
+ * @param pool_p    Pointer to the pool
+ *
+ * @return pointer to the block, or NULL if the pool is empty
+ */
+void *mem_pool_alloc(struct mem_pool *pool_p)
+{
+    void *block_p;
+    uint16_t num_free_blocks;
+    uint32_t int_mask;
+
+    D_ASSERT(pool_p->signature == MEM_POOL_SIGNATURE);
+    if (pool_p->lock_free) {
+        block_p = atomic_stack_pop(&pool_p->free_list);
+        if (block_p == NULL) {
+            ATOMIC_POST_INCREMENT_UINT32(&pool_p->alloc_failures_count);
+            return NULL;
+        }
+
+        num_free_blocks = ATOMIC_POST_DECREMENT_UINT16(&pool_p->num_free_blocks) - 1;
+        ATOMIC_POST_INCREMENT_UINT32(&pool_p->alloc_count);
+    } else {
+        int_mask = disable_cpu_interrupts();
+        block_p = atomic_stack_pop(&pool_p->free_list);
+        if (block_p == NULL) {
+            pool_p->alloc_failures_count ++;
+            restore_cpu_interrupts(int_mask);
+            return NULL;
+        }
+
+        pool_p->num_free_blocks --;
+        num_free_blocks = pool_p->num_free_blocks;
+        pool_p->alloc_count ++;
+    }
+
+    /*
+     * NOTE: For lock-free pools, a concurrent allocation may overwrite the
+     * low-water mark with a slightly higher value. This is acceptable, as it
+     * is only used for stats.
+     */
+    if (num_free_blocks < pool_p->min_free_blocks) {
+        pool_p->min_free_blocks = num_free_blocks;
+    }
+
+    if (!pool_p->lock_free) {
+        restore_cpu_interrupts(int_mask);
+    }
+
+    return block_p;
+}
+
+
+/**
+ * Frees a block back to its memory pool. It can be called from ISRs.
+ *
+ * @param pool_p    Pointer to the pool
+ * @param block_p   Pointer to the block (as returned by mem_pool_alloc())
+ */
+void mem_pool_free(struct mem_pool *pool_p, void *block_p)
+{
+    D_ASSERT(pool_p->signature == MEM_POOL_SIGNATURE);
+    D_ASSERT((uint8_t *)block_p >= pool_p->blocks_p &&
+             (uint8_t *)block_p < pool_p->blocks_p +
+                                  (size_t)pool_p->num_blocks * pool_p->block_size);
+    D_ASSERT(((uint8_t *)block_p - pool_p->blocks_p) % pool_p->block_size == 0);
+    D_ASSERT(pool_p->num_free_blocks < pool_p->num_blocks);
+
+    if (pool_p->lock_free) {
+        atomic_stack_push(&pool_p->free_list, block_p);
+        ATOMIC_POST_INCREMENT_UINT16(&pool_p->num_free_blocks);
+    } else {
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        atomic_stack_push(&pool_p->free_list, block_p);
+        pool_p->num_free_blocks ++;
+        restore_cpu_interrupts(int_mask);
+    }
+}
+
+
+/**
+ * Takes a snapshot of the stats of a memory pool
+ *
+ * @param pool_p    Pointer to the pool
+ * @param stats_p   Area where the stats are to be returned
+ */
+void mem_pool_get_stats(const struct mem_pool *pool_p,
+                        struct mem_pool_stats *stats_p)
+{
+    D_ASSERT(pool_p->signature == MEM_POOL_SIGNATURE);
+
+    stats_p->block_size = pool_p->block_size;
+    stats_p->num_blocks = pool_p->num_blocks;
+    stats_p->num_free_blocks = pool_p->num_free_blocks;
+    stats_p->min_free_blocks = pool_p->min_free_blocks;
+    stats_p->alloc_count = pool_p->alloc_count;
+    stats_p->alloc_failures_count = pool_p->alloc_failures_count;
+}
+
+
+/**
+ * Iterates over the list of all memory pools
+ *
+ * @param pool_p    NULL to get the first pool, or pointer to the pool
+ *                  returned by the previous call
+ *
+ * @return pointer to the next pool, or NULL if there are no more pools
+ */
+const struct mem_pool *mem_pool_get_next(const struct mem_pool *pool_p)
+{
+    if (pool_p == NULL) {
+        return g_mem_pools_list_head_p;
+    }
+
+    D_ASSERT(pool_p->signature == MEM_POOL_SIGNATURE);
+    return pool_p->next_p;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file mem_pool.h
+ *
+ * Fixed-block memory pool interface
+ *
+ * A memory pool hands out blocks of a fixed size, carved out of a
+ * caller-provided storage area. Allocating and freeing a block are O(1): free
+ * blocks are kept in a LIFO free list, linked through their first word. The
+ * free list is either an atomic (lock-free) stack, or a stack updated with
+ * interrupts disabled, which also keeps the pool stats exact. Either way,
+ * blocks can be allocated and freed from ISRs.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_MEM_POOL_H_
+#define SOURCES_BUILDING_BLOCKS_MEM_POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "mem_utils.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+#include "microcontroller.h"
+
+/**
+ * Minimum alignment in bytes of the blocks of a memory pool
+ */
+#define MEM_POOL_BLOCK_ALIGNMENT    UINT32_C(8)
+
+/**
+ * Size in bytes that a block of a memory pool actually takes, for a given
+ * requested block size
+ */
+#define MEM_POOL_BLOCK_SIZE(_block_size) \
+        ROUND_UP((_block_size) < sizeof(void *) ? sizeof(void *) : (_block_size), \
+                 MEM_POOL_BLOCK_ALIGNMENT)
+
+/**
+ * Defines a storage area for a memory pool, aligned and padded for the
+ * alignment required by MPU regions. So, the whole pool can be covered by an
+ * MPU region (e.g., with rtos_thread_set_comp_region()) without exposing
+ * neighboring data.
+ */
+#define MEM_POOL_STORAGE(_name, _block_size, _num_blocks) \
+        uint8_t _name[ROUND_UP(MEM_POOL_BLOCK_SIZE(_block_size) * (_num_blocks), \
+                               MPU_REGION_ALIGNMENT)]                          \
+            __attribute__ ((aligned(MPU_REGION_ALIGNMENT)))
+
+/**
+ * Fixed-block memory pool
+ */
+struct mem_pool {
+#   define MEM_POOL_SIGNATURE  GEN_SIGNATURE('M', 'P', 'O', 'L')
+    uint32_t signature;
+
+    /**
+     * Pool name (null-terminated string)
+     */
+    const char *name_p;
+
+    /**
+     * Storage area of the pool's blocks
+     */
+    uint8_t *blocks_p;
+
+    /**
+     * Size in bytes of each block (see MEM_POOL_BLOCK_SIZE())
+     */
+    uint16_t block_size;
+
+    /**
+     * Total number of blocks in the pool
+     */
+    uint16_t num_blocks;
+
+    /**
+     * Flag indicating if the free list is updated lock-free (true), or with
+     * interrupts disabled (false)
+     */
+    bool lock_free;
+
+    /**
+     * Number of blocks currently free
+     */
+    volatile uint16_t num_free_blocks;
+
+    /**
+     * Lowest value that num_free_blocks ever reached
+     */
+    volatile uint16_t min_free_blocks;
+
+    /**
+     * Number of successful allocations
+     */
+    volatile uint32_t alloc_count;
+
+    /**
+     * Number of allocations that failed because the pool was empty
+     */
+    volatile uint32_t alloc_failures_count;
+
+    /**
+     * Stack of free blocks
+     */
+    struct atomic_stack free_list;
+
+    /**
+     * Next pool in the list of all memory pools
+     */
+    struct mem_pool *next_p;
+};
+
+/**
+ * Snapshot of the stats of a memory pool
+ */
+struct mem_pool_stats {
+    uint16_t block_size;
+    uint16_t num_blocks;
+    uint16_t num_free_blocks;
+    uint16_t min_free_blocks;
+    uint32_t alloc_count;
+    uint32_t alloc_failures_count;
+};
+
+void mem_pool_init(struct mem_pool *pool_p,
+                   const char *name_p,
+                   void *storage_p,
+                   size_t storage_size,
+                   size_t block_size,
+                   bool lock_free);
+
+void *mem_pool_alloc(struct mem_pool *pool_p);
+
+void mem_pool_free(struct mem_pool *pool_p, void *block_p);
+
+void mem_pool_get_stats(const struct mem_pool *pool_p,
+                        struct mem_pool_stats *stats_p);
+
+const struct mem_pool *mem_pool_get_next(const struct mem_pool *pool_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_MEM_POOL_H_ */
@@ -12,15 +12,23 @@
 
 #define CRC_32_POLYNOMIAL UINT32_C(0x04c11db7)
 
+#if MEM_CHECKSUM_CRC_ALGORITHM == MEM_CHECKSUM_CRC_NIBBLE_TABLE
+extern const uint32_t g_crc32_nibble_table[16];
+#elif MEM_CHECKSUM_CRC_ALGORITHM != MEM_CHECKSUM_CRC_BITWISE
+extern const uint32_t g_crc32_tables[MEM_CHECKSUM_CRC_NUM_TABLES][256];
+#endif
+
 /**
- * Computes the CRC-32 checksum for a given block of memory
+ * Computes the CRC-32 checksum for a given block of memory, one bit at a
+ * time. It is the reference for the table-driven implementations in
+ * mem_checksum(), which must give identical results.
  *
  * @param start_addr: start address of the memory block
  * @param size: size in bytes
  *
  * @return calculated CRC value
  */
-uint32_t mem_checksum(const void *start_addr, uint32_t size)
+uint32_t mem_checksum_bitwise(const void *start_addr, uint32_t size)
 {
     uint32_t crc = UINT32_C(0xffffffff);
     const uint8_t *end_p = (uint8_t *)start_addr + size;
@@ -44,6 +52,101 @@ uint32_t mem_checksum(const void *start_addr, uint32_t size)
 }
 
 
+#if MEM_CHECKSUM_CRC_ALGORITHM >= MEM_CHECKSUM_CRC_BYTE_TABLE
+/**
+ * Updates a CRC-32 with a block of bytes, one byte per table lookup
+ */
+static inline uint32_t crc32_update_bytes(uint32_t crc, const uint8_t *byte_p,
+                                          const uint8_t *end_p)
+{
+    for ( ; byte_p < end_p; byte_p ++) {
+        crc = (crc >> 8) ^ g_crc32_tables[0][(crc ^ *byte_p) & 0xff];
+    }
+
+    return crc;
+}
+#endif
+
+
+/**
+ * Computes the CRC-32 checksum for a given block of memory, using the
+ * implementation selected by MEM_CHECKSUM_CRC_ALGORITHM
+ *
+ * @param start_addr: start address of the memory block
+ * @param size: size in bytes
+ *
+ * @return calculated CRC value
+ */
+uint32_t mem_checksum(const void *start_addr, uint32_t size)
+{
+#if MEM_CHECKSUM_CRC_ALGORITHM == MEM_CHECKSUM_CRC_BITWISE
+    return mem_checksum_bitwise(start_addr, size);
+
+#elif MEM_CHECKSUM_CRC_ALGORITHM == MEM_CHECKSUM_CRC_NIBBLE_TABLE
+    uint32_t crc = UINT32_C(0xffffffff);
+    const uint8_t *end_p = (uint8_t *)start_addr + size;
+
+    for (const uint8_t *byte_p = start_addr; byte_p < end_p; byte_p ++) {
+        crc = (crc >> 4) ^ g_crc32_nibble_table[(crc ^ *byte_p) & 0xf];
+        crc = (crc >> 4) ^ g_crc32_nibble_table[(crc ^ (*byte_p >> 4)) & 0xf];
+    }
+
+    return crc;
+
+#elif MEM_CHECKSUM_CRC_ALGORITHM == MEM_CHECKSUM_CRC_BYTE_TABLE
+    return crc32_update_bytes(UINT32_C(0xffffffff), start_addr,
+                              (uint8_t *)start_addr + size);
+
+#else
+    /*
+     * Slice-by-4/8: process the unaligned head one byte at a time, then
+     * whole 32-bit words (little-endian, as on all Cortex-M parts used
+     * here), then the tail one byte at a time:
+     */
+    const uint8_t *byte_p = start_addr;
+    const uint8_t *end_p = byte_p + size;
+    uint32_t crc = UINT32_C(0xffffffff);
+    size_t head_size = (-(uintptr_t)byte_p) % sizeof(uint32_t);
+
+    if (head_size > size) {
+        head_size = size;
+    }
+
+    crc = crc32_update_bytes(crc, byte_p, byte_p + head_size);
+    byte_p += head_size;
+
+    const uint32_t *word_p = (const uint32_t *)byte_p;
+    const uint32_t *words_end_p =
+        word_p + ROUND_DOWN((size_t)(end_p - byte_p) / sizeof(uint32_t),
+                            MEM_CHECKSUM_CRC_NUM_TABLES / 4);
+
+    while (word_p < words_end_p) {
+        uint32_t word1 = *word_p++ ^ crc;
+
+#   if MEM_CHECKSUM_CRC_NUM_TABLES == 8
+        uint32_t word2 = *word_p++;
+
+        crc = g_crc32_tables[7][word1 & 0xff] ^
+              g_crc32_tables[6][(word1 >> 8) & 0xff] ^
+              g_crc32_tables[5][(word1 >> 16) & 0xff] ^
+              g_crc32_tables[4][word1 >> 24] ^
+              g_crc32_tables[3][word2 & 0xff] ^
+              g_crc32_tables[2][(word2 >> 8) & 0xff] ^
+              g_crc32_tables[1][(word2 >> 16) & 0xff] ^
+              g_crc32_tables[0][word2 >> 24];
+#   else
+        crc = g_crc32_tables[3][word1 & 0xff] ^
+              g_crc32_tables[2][(word1 >> 8) & 0xff] ^
+              g_crc32_tables[1][(word1 >> 16) & 0xff] ^
+              g_crc32_tables[0][word1 >> 24];
+#   endif
+    }
+
+    return crc32_update_bytes(crc, (const uint8_t *)word_p, end_p);
+#endif
+}
+
+
 /**
  * Copies a 32-bit aligned block of memory from one location to another
  *
@@ -147,3 +250,229 @@ void memset32(uint32_t *dst, uint_fast8_t byte_value, uint32_t size)
 	}
 }
 
+
+/*
+ * Number of 32-bit words moved by each LDM/STM burst in mem_copy() and
+ * mem_fill(), and the registers used for the burst. Cortex-M0+ can only use
+ * low registers in LDM/STM, and the compiler needs some of them for the
+ * pointers, so it does 4-word bursts. r7 is never used, as it is the frame
+ * pointer.
+ */
+#if __CORTEX_M >= 0x03
+#define MEM_BURST_NUM_WORDS     8
+#define MEM_BURST_REGS          "{r3-r6, r8-r10, r12}"
+#define MEM_BURST_PTR_REG       "+r"
+#else
+#define MEM_BURST_NUM_WORDS     4
+#define MEM_BURST_REGS          "{r3-r6}"
+#define MEM_BURST_PTR_REG       "+l"
+#endif
+
+/*
+ * Blocks shorter than this are copied or filled one byte at a time, as
+ * aligning them would cost more than it saves
+ */
+#define MEM_COPY_MIN_WORD_SIZE  16
+
+#if __CORTEX_M >= 0x03
+/**
+ * 32-bit word at a possibly unaligned address. Cortex-M3/M4 do unaligned
+ * LDR/STR in hardware, so accesses through it compile to a single LDR/STR.
+ */
+struct unaligned_uint32 {
+    uint32_t value;
+} __attribute__ ((packed));
+#endif
+
+
+/**
+ * Copies 32-bit words between two 4-byte aligned locations, using LDM/STM
+ * bursts for most of them
+ *
+ * @param dst_p: destination
+ * @param src_p: source
+ * @param num_words: number of words to copy
+ */
+static inline void mem_copy_aligned_words(uint32_t *dst_p,
+                                          const uint32_t *src_p,
+                                          size_t num_words)
+{
+    uint32_t *const bursts_end_p =
+        dst_p + ROUND_DOWN(num_words, MEM_BURST_NUM_WORDS);
+    uint32_t *const words_end_p = dst_p + num_words;
+
+    while (dst_p != bursts_end_p) {
+        asm volatile (
+            "ldmia %[src]!, " MEM_BURST_REGS "\n\t"
+            "stmia %[dst]!, " MEM_BURST_REGS
+            : [dst] MEM_BURST_PTR_REG (dst_p),
+              [src] MEM_BURST_PTR_REG (src_p)
+            :
+            : "r3", "r4", "r5", "r6",
+#           if MEM_BURST_NUM_WORDS == 8
+              "r8", "r9", "r10", "r12",
+#           endif
+              "memory");
+    }
+
+    while (dst_p != words_end_p) {
+        *dst_p++ = *src_p++;
+    }
+}
+
+
+/**
+ * Copies 32-bit words from a location that is not 4-byte aligned to one
+ * that is
+ *
+ * @param dst_p: destination (4-byte aligned)
+ * @param src_p: source (not 4-byte aligned)
+ * @param num_words: number of words to copy
+ */
+static inline void mem_copy_unaligned_words(uint32_t *dst_p,
+                                            const uint8_t *src_p,
+                                            size_t num_words)
+{
+    uint32_t *const words_end_p = dst_p + num_words;
+
+#if __CORTEX_M >= 0x03
+    const struct unaligned_uint32 *src_word_p =
+        (const struct unaligned_uint32 *)src_p;
+
+    while (dst_p != words_end_p) {
+        *dst_p++ = (src_word_p++)->value;
+    }
+#else
+    /*
+     * Cortex-M0+ faults on unaligned word accesses, so read aligned words
+     * and merge each pair of consecutive words with shifts (little endian).
+     * The last word read is the one holding the last source byte, so no
+     * memory beyond the source's last aligned word is touched.
+     */
+    uint32_t src_offset = (uintptr_t)src_p % sizeof(uint32_t);
+    uint32_t right_shift = src_offset * 8;
+    uint32_t left_shift = 32 - right_shift;
+    const uint32_t *src_word_p = (const uint32_t *)(src_p - src_offset);
+    uint32_t word = *src_word_p++;
+
+    while (dst_p != words_end_p) {
+        uint32_t next_word = *src_word_p++;
+
+        *dst_p++ = (word >> right_shift) | (next_word << left_shift);
+        word = next_word;
+    }
+#endif
+}
+
+
+/**
+ * Copies a block of memory of any alignment and size to a location that
+ * does not overlap with it. The destination is aligned first, and then the
+ * bulk of the block is copied a word at a time, in LDM/STM bursts when the
+ * source is also aligned.
+ *
+ * @param dst: pointer to destination location
+ * @param src: pointer to source location
+ * @param size: size in bytes
+ */
+void mem_copy(void *dst, const void *src, size_t size)
+{
+    uint8_t *dst_p = dst;
+    const uint8_t *src_p = src;
+
+    D_ASSERT(dst_p + size <= src_p || src_p + size <= dst_p);
+
+    if (size >= MEM_COPY_MIN_WORD_SIZE) {
+        size_t head_size = (-(uintptr_t)dst_p) % sizeof(uint32_t);
+
+        size -= head_size;
+        while (head_size-- != 0) {
+            *dst_p++ = *src_p++;
+        }
+
+        size_t num_words = size / sizeof(uint32_t);
+
+        if ((uintptr_t)src_p % sizeof(uint32_t) == 0) {
+            mem_copy_aligned_words((uint32_t *)dst_p, (const uint32_t *)src_p,
+                                   num_words);
+        } else {
+            mem_copy_unaligned_words((uint32_t *)dst_p, src_p, num_words);
+        }
+
+        dst_p += num_words * sizeof(uint32_t);
+        src_p += num_words * sizeof(uint32_t);
+        size %= sizeof(uint32_t);
+    }
+
+    while (size-- != 0) {
+        *dst_p++ = *src_p++;
+    }
+}
+
+
+/**
+ * Fills a block of memory of any alignment and size with a given byte
+ * value. The bulk of the block is filled in STM bursts.
+ *
+ * @param dst: pointer to destination location
+ * @param byte_value: value to write to every byte
+ * @param size: size in bytes
+ */
+void mem_fill(void *dst, uint8_t byte_value, size_t size)
+{
+    uint8_t *dst_p = dst;
+
+    if (size >= MEM_COPY_MIN_WORD_SIZE) {
+        size_t head_size = (-(uintptr_t)dst_p) % sizeof(uint32_t);
+
+        size -= head_size;
+        while (head_size-- != 0) {
+            *dst_p++ = byte_value;
+        }
+
+        uint32_t *dst_word_p = (uint32_t *)dst_p;
+        size_t num_words = size / sizeof(uint32_t);
+        uint32_t *const bursts_end_p =
+            dst_word_p + ROUND_DOWN(num_words, MEM_BURST_NUM_WORDS);
+        uint32_t *const words_end_p = dst_word_p + num_words;
+        uint32_t word_value = byte_value * UINT32_C(0x01010101);
+
+        /*
+         * Registers stored by each STM burst:
+         */
+        register uint32_t burst_reg0 asm("r3") = word_value;
+        register uint32_t burst_reg1 asm("r4") = word_value;
+        register uint32_t burst_reg2 asm("r5") = word_value;
+        register uint32_t burst_reg3 asm("r6") = word_value;
+#       if MEM_BURST_NUM_WORDS == 8
+        register uint32_t burst_reg4 asm("r8") = word_value;
+        register uint32_t burst_reg5 asm("r9") = word_value;
+        register uint32_t burst_reg6 asm("r10") = word_value;
+        register uint32_t burst_reg7 asm("r12") = word_value;
+#       endif
+
+        while (dst_word_p != bursts_end_p) {
+            asm volatile (
+                "stmia %[dst]!, " MEM_BURST_REGS
+                : [dst] MEM_BURST_PTR_REG (dst_word_p)
+                : "r" (burst_reg0), "r" (burst_reg1),
+                  "r" (burst_reg2), "r" (burst_reg3)
+#               if MEM_BURST_NUM_WORDS == 8
+                  , "r" (burst_reg4), "r" (burst_reg5),
+                  "r" (burst_reg6), "r" (burst_reg7)
+#               endif
+                : "memory");
+        }
+
+        while (dst_word_p != words_end_p) {
+            *dst_word_p++ = word_value;
+        }
+
+        dst_p = (uint8_t *)dst_word_p;
+        size %= sizeof(uint32_t);
+    }
+
+    while (size-- != 0) {
+        *dst_p++ = byte_value;
+    }
+}
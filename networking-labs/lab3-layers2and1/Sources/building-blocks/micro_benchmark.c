@@ -0,0 +1,315 @@
+/**
+ * @file micro_benchmark.c
+ *
+ * Micro-benchmarks implementation
+ *
+ * @author German Rivera
+ */
+#include "micro_benchmark.h"
+#include "mem_utils.h"
+#include "compile_time_checks.h"
+#include "crc_32.h"
+#include "byte_ring_buffer.h"
+#include "network_packet.h"
+#include "atomic_utils.h"
+#include "rtos_wrapper.h"
+#include "serial_console.h"
+#include "time_utils.h"
+#include "runtime_checks.h"
+
+/**
+ * Number of entries of the data area of the benchmarked byte ring buffer
+ */
+#define MICRO_BENCHMARK_RING_BUFFER_SIZE    16
+
+C_ASSERT(IS_POWER_OF_2(MICRO_BENCHMARK_RING_BUFFER_SIZE));
+
+/**
+ * Signature of a micro-benchmark function. It calls the benchmarked
+ * primitive the given number of times.
+ */
+typedef void micro_benchmark_func_t(uint32_t iterations);
+
+/**
+ * Micro-benchmark case
+ */
+struct micro_benchmark_case {
+    const char *name_p;
+    micro_benchmark_func_t *func_p;
+};
+
+/**
+ * State of the micro-benchmarks
+ */
+struct micro_benchmark {
+    bool initialized;
+
+    /**
+     * Receives the results of the benchmarked primitives, so that the
+     * compiler cannot optimize the calls away
+     */
+    volatile uint32_t sink;
+
+    volatile uint32_t atomic_counter;
+
+    uint32_t src_buffer[MICRO_BENCHMARK_BUFFER_SIZE / sizeof(uint32_t)];
+
+    uint32_t dst_buffer[MICRO_BENCHMARK_BUFFER_SIZE / sizeof(uint32_t)];
+
+    uint8_t ring_buffer_data[MICRO_BENCHMARK_RING_BUFFER_SIZE];
+
+    struct byte_ring_buffer ring_buffer;
+
+    struct net_packet_queue packet_queue;
+
+    /**
+     * Packet added to and removed from packet_queue. Only the fields
+     * checked by the packet queue functions are initialized.
+     */
+    struct network_packet packet;
+
+    struct rtos_semaphore semaphore;
+
+    struct rtos_mutex mutex;
+};
+
+static struct micro_benchmark g_micro_benchmark;
+
+
+static void micro_benchmark_init(struct micro_benchmark *benchmark_p)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(benchmark_p->src_buffer); i ++) {
+        benchmark_p->src_buffer[i] = i * 0x9e3779b9;
+    }
+
+    byte_ring_buffer_init(&benchmark_p->ring_buffer,
+                          benchmark_p->ring_buffer_data,
+                          MICRO_BENCHMARK_RING_BUFFER_SIZE);
+    net_packet_queue_init("micro benchmark packet queue", false,
+                          &benchmark_p->packet_queue);
+    benchmark_p->packet.signature = NET_TX_PACKET_SIGNATURE;
+    benchmark_p->packet.queue_p = NULL;
+    benchmark_p->packet.next_p = NULL;
+    rtos_semaphore_init(&benchmark_p->semaphore, "micro benchmark semaphore", 0);
+    rtos_mutex_init(&benchmark_p->mutex, "micro benchmark mutex");
+    benchmark_p->initialized = true;
+}
+
+
+/**
+ * Measurement loop with no primitive, to measure the overhead of the loop
+ */
+static void micro_benchmark_empty(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        g_micro_benchmark.sink = i;
+    }
+}
+
+
+static void micro_benchmark_memcpy32(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        memcpy32(g_micro_benchmark.dst_buffer, g_micro_benchmark.src_buffer,
+                 MICRO_BENCHMARK_BUFFER_SIZE);
+        g_micro_benchmark.sink = i;
+    }
+}
+
+
+static void micro_benchmark_memset32(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        memset32(g_micro_benchmark.dst_buffer, 0xa5, MICRO_BENCHMARK_BUFFER_SIZE);
+        g_micro_benchmark.sink = i;
+    }
+}
+
+
+static void micro_benchmark_mem_checksum(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        g_micro_benchmark.sink = mem_checksum(g_micro_benchmark.src_buffer,
+                                              MICRO_BENCHMARK_BUFFER_SIZE);
+    }
+}
+
+
+static void micro_benchmark_crc_32_accelerator(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        g_micro_benchmark.sink =
+            crc_32_accelerator_run(g_micro_benchmark.src_buffer,
+                                   MICRO_BENCHMARK_BUFFER_SIZE);
+    }
+}
+
+
+static void micro_benchmark_byte_ring_buffer(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        byte_ring_buffer_write(&g_micro_benchmark.ring_buffer, (uint8_t)i);
+        g_micro_benchmark.sink =
+            byte_ring_buffer_read(&g_micro_benchmark.ring_buffer);
+    }
+}
+
+
+static void micro_benchmark_net_packet_queue(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        net_packet_queue_add(&g_micro_benchmark.packet_queue,
+                             &g_micro_benchmark.packet);
+        g_micro_benchmark.sink =
+            (uintptr_t)net_packet_queue_remove(&g_micro_benchmark.packet_queue, 0);
+    }
+}
+
+
+static void micro_benchmark_semaphore(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        rtos_semaphore_signal(&g_micro_benchmark.semaphore);
+        rtos_semaphore_wait(&g_micro_benchmark.semaphore);
+        g_micro_benchmark.sink = i;
+    }
+}
+
+
+static void micro_benchmark_mutex(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        rtos_mutex_lock(&g_micro_benchmark.mutex);
+        rtos_mutex_unlock(&g_micro_benchmark.mutex);
+        g_micro_benchmark.sink = i;
+    }
+}
+
+
+static void micro_benchmark_atomic_fetch_add(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i ++) {
+        g_micro_benchmark.sink =
+            atomic_fetch_add_uint32(&g_micro_benchmark.atomic_counter, 1);
+    }
+}
+
+
+/**
+ * Measures a micro-benchmark function
+ *
+ * @param func_p            micro-benchmark function
+ * @param min_cycles_p      area where the cycles of the fastest measured
+ *                          batch of calls is returned
+ * @param total_cycles_p    area where the cycles of all measured batches of
+ *                          calls is returned
+ * @param max_cycles_p      area where the cycles of the slowest measured
+ *                          batch of calls is returned
+ */
+static void micro_benchmark_measure(micro_benchmark_func_t *func_p,
+                                    uint32_t *min_cycles_p,
+                                    uint32_t *total_cycles_p,
+                                    uint32_t *max_cycles_p)
+{
+    uint32_t min_cycles = UINT32_MAX;
+    uint32_t total_cycles = 0;
+    uint32_t max_cycles = 0;
+
+    func_p(MICRO_BENCHMARK_WARMUP_ITERATIONS);
+    for (uint32_t i = 0; i < MICRO_BENCHMARK_REPETITIONS; i ++) {
+        uint32_t start_cycles = get_dwt_cycles();
+
+        func_p(MICRO_BENCHMARK_ITERATIONS);
+
+        uint32_t cycles = get_dwt_cycles() - start_cycles;
+
+        if (cycles < min_cycles) {
+            min_cycles = cycles;
+        }
+
+        if (cycles > max_cycles) {
+            max_cycles = cycles;
+        }
+
+        total_cycles += cycles;
+    }
+
+    *min_cycles_p = min_cycles;
+    *total_cycles_p = total_cycles;
+    *max_cycles_p = max_cycles;
+}
+
+
+/**
+ * Runs all the micro-benchmarks and prints a table with the minimum,
+ * average and maximum CPU cycles per call of each benchmarked primitive
+ */
+void micro_benchmark_run_all(void)
+{
+    static const struct micro_benchmark_case cases[] = {
+        { "memcpy32", micro_benchmark_memcpy32 },
+        { "memset32", micro_benchmark_memset32 },
+        { "mem_checksum", micro_benchmark_mem_checksum },
+        { "crc_32_accelerator_run", micro_benchmark_crc_32_accelerator },
+        { "byte_ring_buffer_write+read", micro_benchmark_byte_ring_buffer },
+        { "net_packet_queue_add+remove", micro_benchmark_net_packet_queue },
+        { "rtos_semaphore_signal+wait", micro_benchmark_semaphore },
+        { "rtos_mutex_lock+unlock", micro_benchmark_mutex },
+        { "atomic_fetch_add_uint32", micro_benchmark_atomic_fetch_add },
+    };
+
+    struct micro_benchmark *const benchmark_p = &g_micro_benchmark;
+    uint32_t overhead_cycles;
+    uint32_t total_cycles;
+    uint32_t max_cycles;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(benchmark_p,
+                                sizeof *benchmark_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    if (!benchmark_p->initialized) {
+        micro_benchmark_init(benchmark_p);
+    }
+
+    /*
+     * The fastest batch of the empty loop is the measurement overhead
+     * subtracted from every batch:
+     */
+    micro_benchmark_measure(micro_benchmark_empty, &overhead_cycles,
+                            &total_cycles, &max_cycles);
+
+    console_printf("CPU cycles per call (%u-byte blocks, %u x %u calls):\n",
+                   MICRO_BENCHMARK_BUFFER_SIZE, MICRO_BENCHMARK_REPETITIONS,
+                   MICRO_BENCHMARK_ITERATIONS);
+    console_printf("%-28s %8s %8s %8s\n", "primitive", "min", "avg", "max");
+    for (uint32_t i = 0; i < ARRAY_SIZE(cases); i ++) {
+        uint32_t min_cycles;
+
+        micro_benchmark_measure(cases[i].func_p, &min_cycles, &total_cycles,
+                                &max_cycles);
+
+        min_cycles = (min_cycles > overhead_cycles) ?
+                        min_cycles - overhead_cycles : 0;
+        max_cycles = (max_cycles > overhead_cycles) ?
+                        max_cycles - overhead_cycles : 0;
+        total_cycles = (total_cycles > overhead_cycles * MICRO_BENCHMARK_REPETITIONS) ?
+                        total_cycles - overhead_cycles * MICRO_BENCHMARK_REPETITIONS : 0;
+
+        console_printf("%-28s %8u %8u %8u\n", cases[i].name_p,
+                       min_cycles / MICRO_BENCHMARK_ITERATIONS,
+                       total_cycles / (MICRO_BENCHMARK_REPETITIONS *
+                                       MICRO_BENCHMARK_ITERATIONS),
+                       max_cycles / MICRO_BENCHMARK_ITERATIONS);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
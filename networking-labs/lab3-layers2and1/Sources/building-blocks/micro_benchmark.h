@@ -0,0 +1,45 @@
+/**
+ * @file micro_benchmark.h
+ *
+ * Micro-benchmarks interface
+ *
+ * The micro-benchmarks measure the CPU cycles (DWT cycle counter) taken by
+ * each call of building-block primitives, such as memcpy32(),
+ * net_packet_queue_add() or rtos_mutex_lock(). Each primitive is called
+ * MICRO_BENCHMARK_WARMUP_ITERATIONS times first, to warm up caches and
+ * branch predictors, and then measured in MICRO_BENCHMARK_REPETITIONS
+ * batches of MICRO_BENCHMARK_ITERATIONS calls. The overhead of the
+ * measurement loop is measured the same way and subtracted.
+ *
+ * Interrupts are not disabled while measuring, so the minimum per-call
+ * cycles is the cost of the primitive itself, while the average and the
+ * maximum include any interrupts that hit the measurement.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_MICRO_BENCHMARK_H_
+#define SOURCES_BUILDING_BLOCKS_MICRO_BENCHMARK_H_
+
+/**
+ * Number of unmeasured calls to a primitive before measuring it
+ */
+#define MICRO_BENCHMARK_WARMUP_ITERATIONS   8
+
+/**
+ * Number of calls to a primitive in each measured batch
+ */
+#define MICRO_BENCHMARK_ITERATIONS          32
+
+/**
+ * Number of measured batches of calls to each primitive
+ */
+#define MICRO_BENCHMARK_REPETITIONS         16
+
+/**
+ * Size in bytes of the memory blocks processed by the memory primitives
+ */
+#define MICRO_BENCHMARK_BUFFER_SIZE         256
+
+void micro_benchmark_run_all(void);
+
+#endif /* SOURCES_BUILDING_BLOCKS_MICRO_BENCHMARK_H_ */
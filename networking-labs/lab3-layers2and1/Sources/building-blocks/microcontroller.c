@@ -7,6 +7,7 @@
  */
 #include "microcontroller.h"
 #include "io_utils.h"
+#include "runtime_checks.h"
 
 /**
  * Trigger software reset  for the microcontroller
@@ -49,3 +50,147 @@ enum cpu_reset_causes find_cpu_reset_cause(void)
     return reset_cause;
 }
 
+
+#if defined(K64F_MCU)
+/**
+ * Enables the flash memory controller's cache, prefetch and speculation
+ * buffers, for instructions and data, on both program flash banks. It is
+ * called from the reset handler, before any other code that matters for
+ * performance runs.
+ *
+ * NOTE: On the K64F, flash read wait states are inserted by hardware
+ * (the flash clock must be kept at or below 25MHz, by SIM_CLKDIV1[OUTDIV4]).
+ * So, only the cache and prefetch settings need to be programmed here.
+ */
+void flash_cache_init(void)
+{
+    uint32_t reg_value;
+
+    flash_cache_invalidate();
+
+    reg_value = READ_MMIO_REGISTER(&FMC->PFB0CR);
+    reg_value &= ~FMC_PFB0CR_CRC_MASK; /* LRU, all ways for instructions or data */
+    reg_value |= FMC_PFB0CR_B0SEBE_MASK | FMC_PFB0CR_B0IPE_MASK |
+                 FMC_PFB0CR_B0DPE_MASK | FMC_PFB0CR_B0ICE_MASK |
+                 FMC_PFB0CR_B0DCE_MASK;
+    WRITE_MMIO_REGISTER(&FMC->PFB0CR, reg_value);
+
+    reg_value = READ_MMIO_REGISTER(&FMC->PFB1CR);
+    reg_value |= FMC_PFB1CR_B1SEBE_MASK | FMC_PFB1CR_B1IPE_MASK |
+                 FMC_PFB1CR_B1DPE_MASK | FMC_PFB1CR_B1ICE_MASK |
+                 FMC_PFB1CR_B1DCE_MASK;
+    WRITE_MMIO_REGISTER(&FMC->PFB1CR, reg_value);
+}
+
+
+/**
+ * Invalidates the flash memory controller's cache and speculation buffer.
+ * It must be called after each flash erase or program operation, so that
+ * stale flash contents are not read from the cache.
+ */
+void flash_cache_invalidate(void)
+{
+    uint32_t reg_value = READ_MMIO_REGISTER(&FMC->PFB0CR);
+
+    reg_value |= FMC_PFB0CR_CINV_WAY_MASK | FMC_PFB0CR_S_B_INV_MASK;
+    WRITE_MMIO_REGISTER(&FMC->PFB0CR, reg_value);
+    __DSB();
+}
+
+
+/**
+ * Crossbar switch (AXBS) master ports
+ */
+#define AXBS_MASTER_CORE_CODE_BUS   0
+#define AXBS_MASTER_CORE_SYSTEM_BUS 1
+#define AXBS_MASTER_DMA             2
+#define AXBS_MASTER_ENET            3
+#define AXBS_MASTER_USB             4
+#define AXBS_MASTER_SDHC            5
+
+/**
+ * Crossbar switch (AXBS) slave port of the SRAM backdoor
+ */
+#define AXBS_SLAVE_SRAM_BACKDOOR    1
+
+/**
+ * Configures the arbitration among bus masters for the SRAM, so that the
+ * ENET DMA engine fetches buffer descriptors and moves frame data to and
+ * from SRAM with as little latency as possible under load, to avoid Rx FIFO
+ * overruns. It is called from the reset handler.
+ *
+ * - On the crossbar switch's SRAM backdoor port, which the CPU does not use,
+ *   the ENET master gets the highest fixed priority, followed by the DMA
+ *   controller, and the port parks on the ENET master while idle, so that
+ *   ENET accesses do not pay for an arbitration cycle.
+ * - The SRAM_U controller arbitrates between the CPU's system bus and the
+ *   backdoor with "special round robin", which favors the backdoor, so that
+ *   a CPU loop over SRAM_U data does not starve the ENET DMA engine. SRAM_L,
+ *   where the CPU fetches RAM_FUNC code from, keeps plain round robin.
+ *
+ * NOTE: The Ethernet MAC's buffer descriptor rings and the network packets'
+ * data buffers are in '.bss', which the linker script places in SRAM_U
+ * (checked when the rings are initialized), so that ENET DMA accesses only
+ * contend with CPU data accesses, not with code fetches from SRAM_L.
+ */
+void bus_masters_init(void)
+{
+    uint32_t reg_value;
+
+    /*
+     * NOTE: Each master must have a different priority on a given slave
+     * port (0 is the highest):
+     */
+    reg_value = AXBS_PRS_M3(0) |
+                AXBS_PRS_M2(1) |
+                AXBS_PRS_M1(2) |
+                AXBS_PRS_M0(3) |
+                AXBS_PRS_M4(4) |
+                AXBS_PRS_M5(5);
+    WRITE_MMIO_REGISTER(&AXBS->SLAVE[AXBS_SLAVE_SRAM_BACKDOOR].PRS, reg_value);
+
+    reg_value = AXBS_CRS_PARK(AXBS_MASTER_ENET) |
+                AXBS_CRS_PCTL(0) |  /* park on the PARK master */
+                AXBS_CRS_ARB(0);    /* fixed priority */
+    WRITE_MMIO_REGISTER(&AXBS->SLAVE[AXBS_SLAVE_SRAM_BACKDOOR].CRS, reg_value);
+
+    reg_value = READ_MMIO_REGISTER(&MCM->CR);
+    reg_value &= ~MCM_CR_SRAMUAP_MASK;
+    reg_value |= MCM_CR_SRAMUAP(1); /* special round robin */
+    WRITE_MMIO_REGISTER(&MCM->CR, reg_value);
+}
+
+
+/**
+ * Gets the cache and prefetch configuration of a program flash bank
+ *
+ * @param bank      Flash bank: 0 or 1
+ * @param config_p  Area where the configuration is to be returned
+ */
+void flash_cache_get_config(uint_fast8_t bank,
+                            struct flash_bank_cache_config *config_p)
+{
+    D_ASSERT(bank <= 1);
+    if (bank == 0) {
+        uint32_t reg_value = READ_MMIO_REGISTER(&FMC->PFB0CR);
+
+        config_p->read_wait_states =
+            GET_BIT_FIELD(reg_value, FMC_PFB0CR_B0RWSC_MASK, FMC_PFB0CR_B0RWSC_SHIFT);
+        config_p->single_entry_buffer_enabled = (reg_value & FMC_PFB0CR_B0SEBE_MASK) != 0;
+        config_p->instruction_prefetch_enabled = (reg_value & FMC_PFB0CR_B0IPE_MASK) != 0;
+        config_p->data_prefetch_enabled = (reg_value & FMC_PFB0CR_B0DPE_MASK) != 0;
+        config_p->instruction_cache_enabled = (reg_value & FMC_PFB0CR_B0ICE_MASK) != 0;
+        config_p->data_cache_enabled = (reg_value & FMC_PFB0CR_B0DCE_MASK) != 0;
+    } else {
+        uint32_t reg_value = READ_MMIO_REGISTER(&FMC->PFB1CR);
+
+        config_p->read_wait_states =
+            GET_BIT_FIELD(reg_value, FMC_PFB1CR_B1RWSC_MASK, FMC_PFB1CR_B1RWSC_SHIFT);
+        config_p->single_entry_buffer_enabled = (reg_value & FMC_PFB1CR_B1SEBE_MASK) != 0;
+        config_p->instruction_prefetch_enabled = (reg_value & FMC_PFB1CR_B1IPE_MASK) != 0;
+        config_p->data_prefetch_enabled = (reg_value & FMC_PFB1CR_B1DPE_MASK) != 0;
+        config_p->instruction_cache_enabled = (reg_value & FMC_PFB1CR_B1ICE_MASK) != 0;
+        config_p->data_cache_enabled = (reg_value & FMC_PFB1CR_B1DCE_MASK) != 0;
+    }
+}
+#endif
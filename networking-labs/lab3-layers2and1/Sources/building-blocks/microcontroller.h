@@ -9,14 +9,21 @@
 #define MICROCONTROLLER_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#if !defined(STM32F479_MCU)
 #define K64F_MCU
+#endif
 #include "arm_cmsis.h"
 #include "arm_cortex_m_defs.h"
 
 /**
  * NOR Flash base address
  */
+#if defined(STM32F479_MCU)
+#define MCU_FLASH_BASE_ADDR    UINT32_C(0x08000000)
+#else
 #define MCU_FLASH_BASE_ADDR    UINT32_C(0x0)
+#endif
 
 #if defined(KL25Z_MCU)
 /**
@@ -61,6 +68,14 @@
  */
 #define MCU_SRAM_SIZE    (UINT32_C(256) * 1024)
 
+/**
+ * Base address of SRAM_U, the upper half of the SRAM. The lower half,
+ * SRAM_L, is accessed by the CPU over the code bus, and SRAM_U over the
+ * system bus. Other bus masters, such as the ENET DMA engine, access both
+ * through the crossbar switch's SRAM backdoor port.
+ */
+#define MCU_SRAM_U_BASE_ADDR    UINT32_C(0x20000000)
+
 /**
  * Number of interrupt priorities
  */
@@ -71,6 +86,33 @@
  */
 #define MCU_CPU_CLOCK_FREQ_IN_MHZ  UINT32_C(120)
 
+#elif defined(STM32F479_MCU)
+
+/**
+ * NOR Flash size in bytes
+ */
+#define MCU_FLASH_SIZE    (UINT32_C(2048) * 1024)
+
+/**
+ * SRAM base address
+ */
+#define MCU_SRAM_BASE_ADDR    UINT32_C(0x20000000)
+
+/**
+ * SRAM size in bytes
+ */
+#define MCU_SRAM_SIZE    (UINT32_C(384) * 1024)
+
+/**
+ * Number of interrupt priorities
+ */
+#define MCU_NUM_INTERRUPT_PRIORITIES 16
+
+/**
+ * CPU clock frequency in MHz
+ */
+#define MCU_CPU_CLOCK_FREQ_IN_MHZ  UINT32_C(180)
+
 #else
 #error "No Microcontroller defined"
 #endif
@@ -130,4 +172,43 @@ void reset_cpu(void);
 
 enum cpu_reset_causes find_cpu_reset_cause(void);
 
+#if defined(K64F_MCU)
+/**
+ * Flash memory controller (FMC) cache and prefetch configuration of a
+ * flash bank
+ */
+struct flash_bank_cache_config {
+    /**
+     * Number of wait states for flash reads (set by hardware)
+     */
+    uint8_t read_wait_states;
+
+    /**
+     * Flag indicating if the single-entry (speculation) buffer is enabled
+     */
+    bool single_entry_buffer_enabled;
+
+    /**
+     * Flags indicating if instruction and data prefetch are enabled
+     */
+    bool instruction_prefetch_enabled;
+    bool data_prefetch_enabled;
+
+    /**
+     * Flags indicating if the cache is enabled for instructions and data
+     */
+    bool instruction_cache_enabled;
+    bool data_cache_enabled;
+};
+
+void flash_cache_init(void);
+
+void flash_cache_invalidate(void);
+
+void bus_masters_init(void);
+
+void flash_cache_get_config(uint_fast8_t bank,
+                            struct flash_bank_cache_config *config_p);
+#endif
+
 #endif /* MICROCONTROLLER_H_ */
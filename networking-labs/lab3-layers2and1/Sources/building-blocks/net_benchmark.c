@@ -0,0 +1,1262 @@
+/**
+ * @file net_benchmark.c
+ *
+ * Networking benchmarks implementation
+ *
+ * @author German Rivera
+ */
+#include "net_benchmark.h"
+#include "networking_layer4.h"
+#include "networking_layer2.h"
+#include "rtos_wrapper.h"
+#include "time_utils.h"
+#include "internet_checksum.h"
+#include "perf_probes.h"
+#include <string.h>
+
+/**
+ * Maximum time in milliseconds that a UDP Rx benchmark waits for the first
+ * datagram, and for every subsequent datagram
+ */
+#define NET_BENCHMARK_RX_START_TIMEOUT_MS   10000
+#define NET_BENCHMARK_RX_IDLE_TIMEOUT_MS    1000
+
+/**
+ * Maximum time in milliseconds that an RTT benchmark waits for each echo
+ * reply
+ */
+#define NET_BENCHMARK_RTT_TIMEOUT_MS        1000
+
+/**
+ * Maximum size in bytes of a frame injected by an Rx injection benchmark,
+ * including the alignment padding of the Ethernet header
+ */
+#define NET_BENCHMARK_INJECT_MAX_FRAME_SIZE 128
+
+/**
+ * EtherType of the junk frames injected by an Rx injection benchmark
+ * (IEEE 802 local experimental EtherType, not handled by layer 2)
+ */
+#define NET_BENCHMARK_INJECT_JUNK_FRAME_TYPE    0x88b5
+
+/**
+ * Payload size in bytes of the junk frames injected by an Rx injection
+ * benchmark (minimum Ethernet payload)
+ */
+#define NET_BENCHMARK_INJECT_JUNK_PAYLOAD_SIZE  46
+
+/**
+ * Cycle budget of the Rx callback of the benchmark end point during an Rx
+ * injection benchmark
+ */
+#define NET_BENCHMARK_INJECT_RX_CALLBACK_CYCLE_BUDGET   2000
+
+C_ASSERT(sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+         sizeof(struct udp_header) + NET_BENCHMARK_INJECT_UDP_PAYLOAD_SIZE <=
+         NET_BENCHMARK_INJECT_MAX_FRAME_SIZE);
+C_ASSERT(sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+         sizeof(struct icmpv4_echo_message) + NET_BENCHMARK_INJECT_ICMP_DATA_SIZE <=
+         NET_BENCHMARK_INJECT_MAX_FRAME_SIZE);
+C_ASSERT(NET_BENCHMARK_INJECT_MAX_FRAME_SIZE <= NET_PACKET_DATA_BUFFER_SIZE);
+
+/**
+ * Ping request of a ping flood, waiting for its reply
+ */
+struct net_benchmark_ping {
+    /**
+     * Flag indicating if this entry is in use
+     */
+    bool outstanding;
+
+    /**
+     * Sequence number of the request
+     */
+    uint16_t seq_num;
+
+    /**
+     * Time when the request was sent
+     */
+    uint64_t sent_ns;
+};
+
+/**
+ * State of the networking benchmarks
+ */
+struct net_benchmark {
+    /**
+     * Flag indicating if end_point has been initialized
+     */
+    bool end_point_initialized;
+
+    /**
+     * Identifier of the last benchmark run
+     */
+    uint16_t last_run_id;
+
+    /**
+     * UDP end point used by the benchmarks. It is only bound to
+     * NET_BENCHMARK_PORT while a benchmark is running.
+     */
+    struct net_layer4_end_point end_point;
+
+    /**
+     * Round-trip times in nanoseconds of an RTT benchmark
+     */
+    uint32_t rtt_samples[NET_BENCHMARK_MAX_RTT_SAMPLES];
+
+    /**
+     * Outstanding requests of a ping flood
+     */
+    struct net_benchmark_ping pings[NET_BENCHMARK_PING_MAX_OUTSTANDING];
+
+    /**
+     * Frames injected by an Rx injection benchmark, built when the benchmark
+     * starts, one for each type (enum net_benchmark_inject_frame_types)
+     */
+    uint8_t inject_frames[NET_BENCHMARK_NUM_INJECT_FRAME_TYPES]
+                         [NET_BENCHMARK_INJECT_MAX_FRAME_SIZE]
+        __attribute__ ((aligned(sizeof(uint32_t))));
+
+    /**
+     * Length in bytes of each entry of inject_frames[]
+     */
+    uint16_t inject_frame_lengths[NET_BENCHMARK_NUM_INJECT_FRAME_TYPES];
+};
+
+/**
+ * Rx counters of layers 2 to 4, sampled before and after an Rx injection
+ * benchmark
+ */
+struct net_benchmark_rx_counters {
+    uint32_t layer2_dropped;
+    uint32_t ipv4_accepted;
+    uint32_t ipv4_dropped;
+    uint32_t udp_accepted;
+    uint32_t udp_dropped;
+};
+
+static struct net_benchmark g_net_benchmark;
+
+/**
+ * Source MAC address of the frames injected by an Rx injection benchmark
+ * (locally administered unicast address)
+ */
+static const struct ethernet_mac_address g_net_benchmark_inject_source_mac_addr = {
+    .bytes = { 0x02, 0x00, 0x00, 0x00, 0xbe, 0x01 }
+};
+
+
+/**
+ * Releases all the datagrams queued for the benchmark end point, so that
+ * datagrams of a previous run are not counted in the next one
+ */
+static void net_benchmark_drain(struct net_benchmark *benchmark_p)
+{
+    struct net_udp_rx_datagram datagram;
+
+    while (net_layer4_udp_receive_zero_copy(&benchmark_p->end_point, 1,
+                                            &datagram) == 0) {
+        net_layer4_udp_release_rx_datagram(&benchmark_p->end_point, &datagram);
+    }
+}
+
+
+/**
+ * Prepares for a benchmark run: validates the datagram size, binds the
+ * benchmark end point and starts measuring time and CPU usage
+ */
+static error_t net_benchmark_begin(struct net_benchmark *benchmark_p,
+                                   size_t datagram_size,
+                                   struct net_benchmark_result *result_p)
+{
+    error_t error;
+
+    if (datagram_size < sizeof(struct net_benchmark_header) ||
+        datagram_size > NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE) {
+        return CAPTURE_ERROR("Invalid benchmark datagram size",
+                             datagram_size, NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE);
+    }
+
+    if (!benchmark_p->end_point_initialized) {
+        net_layer4_udp_end_point_init(&benchmark_p->end_point);
+        benchmark_p->end_point_initialized = true;
+    }
+
+    error = net_layer4_udp_end_point_bind(&benchmark_p->end_point,
+                                          hton16(NET_BENCHMARK_PORT));
+    if (error != 0) {
+        return error;
+    }
+
+    net_benchmark_drain(benchmark_p);
+    memset(result_p, 0, sizeof *result_p);
+    benchmark_p->last_run_id ++;
+    return 0;
+}
+
+
+/**
+ * Cleans up after a benchmark run
+ */
+static void net_benchmark_end(struct net_benchmark *benchmark_p)
+{
+    net_benchmark_drain(benchmark_p);
+    net_layer4_udp_end_point_unbind(&benchmark_p->end_point);
+}
+
+
+/**
+ * Measurement of the elapsed time and of the CPU cycles not spent in the
+ * RTOS idle task
+ */
+struct net_benchmark_clock {
+    uint64_t start_cycles;
+    uint64_t start_idle_cycles;
+};
+
+
+static void net_benchmark_clock_start(struct net_benchmark_clock *clock_p)
+{
+    clock_p->start_idle_cycles = rtos_get_idle_task_cpu_cycles();
+    clock_p->start_cycles = get_monotonic_cycles();
+}
+
+
+static void net_benchmark_clock_stop(const struct net_benchmark_clock *clock_p,
+                                     struct net_benchmark_result *result_p)
+{
+    uint64_t elapsed_cycles = get_monotonic_cycles() - clock_p->start_cycles;
+    uint64_t idle_cycles = rtos_get_idle_task_cpu_cycles() -
+                           clock_p->start_idle_cycles;
+
+    result_p->elapsed_ns = CPU_CLOCK_CYCLES_TO_NANOSECONDS(elapsed_cycles);
+    result_p->busy_cycles = (idle_cycles < elapsed_cycles) ?
+                                elapsed_cycles - idle_cycles : 0;
+}
+
+
+/**
+ * Sends a benchmark message, padded to the given datagram size. It waits
+ * for a Tx packet to become available, so that the sender is paced by the
+ * Ethernet MAC.
+ */
+static error_t net_benchmark_send(struct net_benchmark *benchmark_p,
+                                  const struct ipv4_address *peer_ip_addr_p,
+                                  enum net_benchmark_message_types type,
+                                  uint32_t seq_num,
+                                  size_t datagram_size)
+{
+    error_t error;
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                          sizeof(struct ipv4_header) +
+                                          sizeof(struct udp_header) +
+                                          datagram_size,
+                                      true);
+    struct net_benchmark_header *header_p =
+        get_ipv4_udp_data_payload_area(tx_packet_p);
+
+    header_p->magic = hton32(NET_BENCHMARK_MAGIC);
+    header_p->type = type;
+    header_p->reserved = 0;
+    header_p->run_id = hton16(benchmark_p->last_run_id);
+    header_p->seq_num = hton32(seq_num);
+    header_p->timestamp_us = hton32((uint32_t)(get_monotonic_ns() / 1000));
+    memset(header_p + 1, 0, datagram_size - sizeof(*header_p));
+
+    error = net_layer4_send_udp_datagram_over_ipv4(&benchmark_p->end_point,
+                                                   peer_ip_addr_p,
+                                                   hton16(NET_BENCHMARK_PORT),
+                                                   tx_packet_p,
+                                                   datagram_size);
+    if (error != 0) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+    }
+
+    return error;
+}
+
+
+/**
+ * Tells if a received datagram is a benchmark message of the given type
+ * from the peer
+ */
+static bool net_benchmark_is_message(const struct net_udp_rx_datagram *datagram_p,
+                                     const struct ipv4_address *peer_ip_addr_p,
+                                     enum net_benchmark_message_types type)
+{
+    const struct net_benchmark_header *header_p = datagram_p->payload_p;
+
+    return datagram_p->ip_version == 4 &&
+           datagram_p->source_ip_addr.ipv4.value == peer_ip_addr_p->value &&
+           datagram_p->payload_length >= sizeof(*header_p) &&
+           ntoh32(header_p->magic) == NET_BENCHMARK_MAGIC &&
+           header_p->type == type;
+}
+
+
+/**
+ * Runs a UDP Tx benchmark, sending datagrams to the peer as fast as
+ * possible
+ *
+ * @param peer_ip_addr_p    IPv4 address of the peer
+ * @param datagram_size     UDP payload size of each datagram in bytes
+ * @param count             Number of datagrams to send
+ * @param result_p          Area where the benchmark results are returned
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t net_benchmark_udp_tx(const struct ipv4_address *peer_ip_addr_p,
+                             size_t datagram_size,
+                             uint32_t count,
+                             struct net_benchmark_result *result_p)
+{
+    struct net_benchmark *const benchmark_p = &g_net_benchmark;
+    struct net_benchmark_clock clock;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(benchmark_p,
+                                sizeof *benchmark_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    error = net_benchmark_begin(benchmark_p, datagram_size, result_p);
+    if (error != 0) {
+        goto common_exit;
+    }
+
+    net_benchmark_clock_start(&clock);
+    for (uint32_t i = 0; i < count; i ++) {
+        error = net_benchmark_send(benchmark_p, peer_ip_addr_p,
+                                   NET_BENCHMARK_MSG_DATA, i, datagram_size);
+        if (error != 0) {
+            break;
+        }
+
+        result_p->packets ++;
+        result_p->bytes += datagram_size;
+    }
+
+    net_benchmark_clock_stop(&clock, result_p);
+    net_benchmark_end(benchmark_p);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Runs a UDP Rx benchmark, receiving the datagrams sent by the peer. The
+ * measurement starts when the first datagram is received, and ends when
+ * the given number of datagrams has been received, or when no datagram
+ * has been received for NET_BENCHMARK_RX_IDLE_TIMEOUT_MS.
+ *
+ * @param peer_ip_addr_p    IPv4 address of the peer
+ * @param datagram_size     UDP payload size of each datagram in bytes.
+ *                          Datagrams of other sizes are not counted.
+ * @param count             Number of datagrams that the peer sends
+ * @param result_p          Area where the benchmark results are returned
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t net_benchmark_udp_rx(const struct ipv4_address *peer_ip_addr_p,
+                             size_t datagram_size,
+                             uint32_t count,
+                             struct net_benchmark_result *result_p)
+{
+    struct net_benchmark *const benchmark_p = &g_net_benchmark;
+    struct net_benchmark_clock clock;
+    struct net_udp_rx_datagram datagram;
+    uint32_t timeout_ms = NET_BENCHMARK_RX_START_TIMEOUT_MS;
+    uint16_t run_id = 0;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(benchmark_p,
+                                sizeof *benchmark_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    error = net_benchmark_begin(benchmark_p, datagram_size, result_p);
+    if (error != 0) {
+        goto common_exit;
+    }
+
+    while (result_p->packets < count) {
+        if (net_layer4_udp_receive_zero_copy(&benchmark_p->end_point,
+                                             timeout_ms, &datagram) != 0) {
+            break;
+        }
+
+        if (net_benchmark_is_message(&datagram, peer_ip_addr_p,
+                                     NET_BENCHMARK_MSG_DATA) &&
+            datagram.payload_length == datagram_size) {
+            const struct net_benchmark_header *header_p = datagram.payload_p;
+
+            /*
+             * The first datagram received determines the run to count:
+             */
+            if (result_p->packets == 0) {
+                run_id = ntoh16(header_p->run_id);
+                net_benchmark_clock_start(&clock);
+                timeout_ms = NET_BENCHMARK_RX_IDLE_TIMEOUT_MS;
+            }
+
+            if (ntoh16(header_p->run_id) == run_id) {
+                result_p->packets ++;
+                result_p->bytes += datagram_size;
+            }
+        }
+
+        net_layer4_udp_release_rx_datagram(&benchmark_p->end_point, &datagram);
+    }
+
+    if (result_p->packets != 0) {
+        net_benchmark_clock_stop(&clock, result_p);
+    }
+
+    result_p->lost_packets = count - result_p->packets;
+    net_benchmark_end(benchmark_p);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Sorts an array of round-trip times in ascending order (insertion sort,
+ * as the array is small)
+ */
+static void net_benchmark_sort_samples(uint32_t samples[], uint32_t num_samples)
+{
+    for (uint32_t i = 1; i < num_samples; i ++) {
+        uint32_t sample = samples[i];
+        uint32_t j = i;
+
+        while (j != 0 && samples[j - 1] > sample) {
+            samples[j] = samples[j - 1];
+            j --;
+        }
+
+        samples[j] = sample;
+    }
+}
+
+
+/**
+ * Calculates the round-trip time average and percentiles of a benchmark
+ * from its round-trip time samples. The samples are left sorted.
+ */
+static void net_benchmark_calc_rtt_stats(uint32_t samples[],
+                                         uint32_t num_samples,
+                                         struct net_benchmark_result *result_p)
+{
+    uint64_t sum_ns = 0;
+
+    if (num_samples == 0) {
+        return;
+    }
+
+    net_benchmark_sort_samples(samples, num_samples);
+    for (uint32_t i = 0; i < num_samples; i ++) {
+        sum_ns += samples[i];
+    }
+
+    result_p->rtt_min_ns = samples[0];
+    result_p->rtt_avg_ns = (uint32_t)(sum_ns / num_samples);
+    result_p->rtt_p50_ns = samples[(num_samples - 1) * 50 / 100];
+    result_p->rtt_p90_ns = samples[(num_samples - 1) * 90 / 100];
+    result_p->rtt_p99_ns = samples[(num_samples - 1) * 99 / 100];
+    result_p->rtt_max_ns = samples[num_samples - 1];
+}
+
+
+/**
+ * Waits for the echo reply to a given echo request
+ *
+ * @return true, if the reply was received, false if it timed out
+ */
+static bool net_benchmark_wait_echo_reply(struct net_benchmark *benchmark_p,
+                                          const struct ipv4_address *peer_ip_addr_p,
+                                          uint32_t seq_num,
+                                          uint64_t start_ns)
+{
+    struct net_udp_rx_datagram datagram;
+
+    for ( ; ; ) {
+        uint32_t elapsed_ms = (uint32_t)((get_monotonic_ns() - start_ns) / 1000000);
+
+        if (elapsed_ms >= NET_BENCHMARK_RTT_TIMEOUT_MS) {
+            return false;
+        }
+
+        if (net_layer4_udp_receive_zero_copy(&benchmark_p->end_point,
+                                             NET_BENCHMARK_RTT_TIMEOUT_MS - elapsed_ms,
+                                             &datagram) != 0) {
+            return false;
+        }
+
+        const struct net_benchmark_header *header_p = datagram.payload_p;
+
+        /*
+         * Late replies to previous requests are discarded:
+         */
+        bool matched =
+            net_benchmark_is_message(&datagram, peer_ip_addr_p,
+                                     NET_BENCHMARK_MSG_ECHO_REPLY) &&
+            ntoh16(header_p->run_id) == benchmark_p->last_run_id &&
+            ntoh32(header_p->seq_num) == seq_num;
+
+        net_layer4_udp_release_rx_datagram(&benchmark_p->end_point, &datagram);
+        if (matched) {
+            return true;
+        }
+    }
+}
+
+
+/**
+ * Runs a UDP round-trip time benchmark, sending echo requests to the peer,
+ * one at a time
+ *
+ * @param peer_ip_addr_p    IPv4 address of the peer
+ * @param datagram_size     UDP payload size of each echo request in bytes
+ * @param count             Number of echo requests to send
+ * @param result_p          Area where the benchmark results are returned
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t net_benchmark_udp_rtt(const struct ipv4_address *peer_ip_addr_p,
+                              size_t datagram_size,
+                              uint32_t count,
+                              struct net_benchmark_result *result_p)
+{
+    struct net_benchmark *const benchmark_p = &g_net_benchmark;
+    struct net_benchmark_clock clock;
+    uint32_t num_samples = 0;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(benchmark_p,
+                                sizeof *benchmark_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    error = net_benchmark_begin(benchmark_p, datagram_size, result_p);
+    if (error != 0) {
+        goto common_exit;
+    }
+
+    net_benchmark_clock_start(&clock);
+    for (uint32_t i = 0; i < count; i ++) {
+        uint64_t start_ns = get_monotonic_ns();
+
+        error = net_benchmark_send(benchmark_p, peer_ip_addr_p,
+                                   NET_BENCHMARK_MSG_ECHO_REQUEST, i,
+                                   datagram_size);
+        if (error != 0) {
+            break;
+        }
+
+        if (!net_benchmark_wait_echo_reply(benchmark_p, peer_ip_addr_p, i,
+                                           start_ns)) {
+            result_p->lost_packets ++;
+            continue;
+        }
+
+        /*
+         * The round trip is bounded by NET_BENCHMARK_RTT_TIMEOUT_MS, so it
+         * fits in 32 bits:
+         */
+        if (num_samples < NET_BENCHMARK_MAX_RTT_SAMPLES) {
+            benchmark_p->rtt_samples[num_samples] =
+                (uint32_t)(get_monotonic_ns() - start_ns);
+            num_samples ++;
+        }
+
+        result_p->packets ++;
+        result_p->bytes += datagram_size;
+    }
+
+    net_benchmark_clock_stop(&clock, result_p);
+    net_benchmark_end(benchmark_p);
+    net_benchmark_calc_rtt_stats(benchmark_p->rtt_samples, num_samples,
+                                 result_p);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Counts as lost the ping flood requests that have not been replied within
+ * NET_BENCHMARK_RTT_TIMEOUT_MS
+ *
+ * @return time in nanoseconds until the next outstanding request times out,
+ *         or UINT64_MAX if there are no outstanding requests
+ */
+static uint64_t net_benchmark_expire_pings(struct net_benchmark *benchmark_p,
+                                           uint64_t now_ns,
+                                           uint32_t *num_outstanding_p,
+                                           struct net_benchmark_result *result_p)
+{
+    const uint64_t timeout_ns = (uint64_t)NET_BENCHMARK_RTT_TIMEOUT_MS * 1000000;
+    uint64_t min_remaining_ns = UINT64_MAX;
+
+    for (uint32_t i = 0; i < NET_BENCHMARK_PING_MAX_OUTSTANDING; i ++) {
+        struct net_benchmark_ping *ping_p = &benchmark_p->pings[i];
+
+        if (!ping_p->outstanding) {
+            continue;
+        }
+
+        uint64_t elapsed_ns = now_ns - ping_p->sent_ns;
+
+        if (elapsed_ns >= timeout_ns) {
+            ping_p->outstanding = false;
+            (*num_outstanding_p) --;
+            result_p->lost_packets ++;
+        } else if (timeout_ns - elapsed_ns < min_remaining_ns) {
+            min_remaining_ns = timeout_ns - elapsed_ns;
+        }
+    }
+
+    return min_remaining_ns;
+}
+
+
+/**
+ * Returns the outstanding ping flood request with the given sequence
+ * number, or NULL if there is none (the reply is late or duplicated)
+ */
+static struct net_benchmark_ping *net_benchmark_find_ping(
+    struct net_benchmark *benchmark_p,
+    uint16_t seq_num)
+{
+    for (uint32_t i = 0; i < NET_BENCHMARK_PING_MAX_OUTSTANDING; i ++) {
+        struct net_benchmark_ping *ping_p = &benchmark_p->pings[i];
+
+        if (ping_p->outstanding && ping_p->seq_num == seq_num) {
+            return ping_p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Runs a ping flood benchmark, sending ICMPv4 echo requests to the peer,
+ * with up to max_outstanding of them waiting for their replies. A request
+ * is sent every interval_ms, or as soon as a reply frees room for it if
+ * interval_ms is 0. Requests not replied within NET_BENCHMARK_RTT_TIMEOUT_MS
+ * are counted as lost. The peer does not need to run any benchmark script.
+ *
+ * @param peer_ip_addr_p    IPv4 address of the peer
+ * @param count             Number of echo requests to send
+ * @param interval_ms       Minimum time in milliseconds between requests
+ * @param max_outstanding   Maximum number of requests waiting for their
+ *                          replies (1 .. NET_BENCHMARK_PING_MAX_OUTSTANDING)
+ * @param result_p          Area where the benchmark results are returned
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t net_benchmark_ping_flood(const struct ipv4_address *peer_ip_addr_p,
+                                 uint32_t count,
+                                 uint32_t interval_ms,
+                                 uint32_t max_outstanding,
+                                 struct net_benchmark_result *result_p)
+{
+    struct net_benchmark *const benchmark_p = &g_net_benchmark;
+    struct net_benchmark_clock clock;
+    const uint64_t interval_ns = (uint64_t)interval_ms * 1000000;
+    uint64_t next_send_ns = 0;
+    uint32_t num_sent = 0;
+    uint32_t num_outstanding = 0;
+    uint32_t num_samples = 0;
+    uint16_t identifier;
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    if (max_outstanding == 0 ||
+        max_outstanding > NET_BENCHMARK_PING_MAX_OUTSTANDING) {
+        return CAPTURE_ERROR("Invalid number of outstanding pings",
+                             max_outstanding, NET_BENCHMARK_PING_MAX_OUTSTANDING);
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(benchmark_p,
+                                sizeof *benchmark_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    memset(result_p, 0, sizeof *result_p);
+    memset(benchmark_p->pings, 0, sizeof benchmark_p->pings);
+    benchmark_p->last_run_id ++;
+    identifier = benchmark_p->last_run_id;
+
+    net_layer3_start_ipv4_ping_flood();
+    net_benchmark_clock_start(&clock);
+    while (num_sent < count || num_outstanding != 0) {
+        uint64_t now_ns = get_monotonic_ns();
+        uint64_t wait_ns = net_benchmark_expire_pings(benchmark_p, now_ns,
+                                                      &num_outstanding,
+                                                      result_p);
+        bool can_send = (num_sent < count && num_outstanding < max_outstanding);
+
+        if (can_send && now_ns >= next_send_ns) {
+            struct net_benchmark_ping *ping_p = benchmark_p->pings;
+
+            while (ping_p->outstanding) {
+                ping_p ++;
+            }
+
+            ping_p->seq_num = (uint16_t)num_sent;
+            ping_p->sent_ns = get_monotonic_ns();
+            error = net_layer3_send_ipv4_ping_flood_request(peer_ip_addr_p,
+                                                            hton16(identifier),
+                                                            hton16(ping_p->seq_num));
+            if (error != 0) {
+                break;
+            }
+
+            ping_p->outstanding = true;
+            num_outstanding ++;
+            num_sent ++;
+            next_send_ns = ping_p->sent_ns + interval_ns;
+            continue;
+        }
+
+        if (can_send && next_send_ns - now_ns < wait_ns) {
+            wait_ns = next_send_ns - now_ns;
+        }
+
+        /*
+         * Waits are in whole milliseconds, and a 0 ms wait means waiting
+         * forever:
+         */
+        uint32_t wait_ms = (uint32_t)(wait_ns / 1000000);
+
+        if (wait_ms == 0) {
+            wait_ms = 1;
+        }
+
+        if (num_outstanding == 0) {
+            rtos_task_delay(wait_ms);
+            continue;
+        }
+
+        struct ipv4_address remote_ip_addr;
+        uint16_t reply_identifier;
+        uint16_t reply_seq_num;
+
+        if (!net_layer3_receive_ipv4_ping_flood_reply(wait_ms,
+                                                      &remote_ip_addr,
+                                                      &reply_identifier,
+                                                      &reply_seq_num)) {
+            continue;
+        }
+
+        if (remote_ip_addr.value != peer_ip_addr_p->value ||
+            ntoh16(reply_identifier) != identifier) {
+            continue;
+        }
+
+        struct net_benchmark_ping *ping_p =
+            net_benchmark_find_ping(benchmark_p, ntoh16(reply_seq_num));
+
+        if (ping_p == NULL) {
+            continue;
+        }
+
+        /*
+         * The round trip is bounded by NET_BENCHMARK_RTT_TIMEOUT_MS, so it
+         * fits in 32 bits:
+         */
+        if (num_samples < NET_BENCHMARK_MAX_RTT_SAMPLES) {
+            benchmark_p->rtt_samples[num_samples] =
+                (uint32_t)(get_monotonic_ns() - ping_p->sent_ns);
+            num_samples ++;
+        }
+
+        ping_p->outstanding = false;
+        num_outstanding --;
+        result_p->packets ++;
+        result_p->bytes += sizeof(struct icmpv4_echo_message);
+    }
+
+    net_benchmark_clock_stop(&clock, result_p);
+    net_layer3_stop_ipv4_ping_flood();
+    net_benchmark_calc_rtt_stats(benchmark_p->rtt_samples, num_samples,
+                                 result_p);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Fills in the Ethernet header of a frame to inject
+ */
+static void net_benchmark_build_ethernet_header(
+    struct ethernet_header *ethernet_header_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    uint16_t frame_type)
+{
+    ethernet_header_p->alignment_padding = 0;
+    ethernet_header_p->dest_mac_addr = *dest_mac_addr_p;
+    ethernet_header_p->source_mac_addr = g_net_benchmark_inject_source_mac_addr;
+    ethernet_header_p->frame_type = hton16(frame_type);
+}
+
+
+/**
+ * Fills in the IPv4 header of a frame to inject, including its checksum
+ */
+static void net_benchmark_build_ipv4_header(struct ipv4_header *ipv4_header_p,
+                                            const struct ipv4_address *source_ip_addr_p,
+                                            const struct ipv4_address *dest_ip_addr_p,
+                                            uint8_t ip_packet_type,
+                                            size_t data_payload_length)
+{
+    ipv4_header_p->version_and_header_length = 0;
+    SET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                  IP_VERSION_MASK, IP_VERSION_SHIFT, 4);
+    SET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                  IP_HEADER_LENGTH_MASK, IP_HEADER_LENGTH_SHIFT, 5);
+    ipv4_header_p->type_of_service = 0;
+    ipv4_header_p->total_length =
+        hton16(sizeof(struct ipv4_header) + data_payload_length);
+    ipv4_header_p->identification = 0;
+    ipv4_header_p->flags_and_fragment_offset = hton16(IP_FLAG_DONT_FRAGMENT_MASK);
+    ipv4_header_p->time_to_live = 64;
+    ipv4_header_p->protocol_type = ip_packet_type;
+    ipv4_header_p->source_ip_addr.value = source_ip_addr_p->value;
+    ipv4_header_p->dest_ip_addr.value = dest_ip_addr_p->value;
+    ipv4_header_p->header_checksum = 0;
+    ipv4_header_p->header_checksum = internet_checksum(ipv4_header_p,
+                                                       sizeof *ipv4_header_p);
+}
+
+
+/**
+ * Builds the frames to inject in an Rx injection benchmark, addressed to
+ * the local MAC and IPv4 addresses. They come from a made-up host, which
+ * takes the last host address of the local subnet.
+ */
+static error_t net_benchmark_build_inject_frames(struct net_benchmark *benchmark_p)
+{
+    struct ethernet_mac_address local_mac_addr;
+    struct ipv4_address local_ip_addr;
+    struct ipv4_address subnet_mask;
+    struct ipv4_address source_ip_addr;
+    struct ethernet_frame *frame_p;
+    size_t payload_length;
+
+    net_layer2_get_mac_addr(&g_net_layer2.local_layer2_end_points[0],
+                            &local_mac_addr);
+    net_layer3_get_local_ipv4_address(&local_ip_addr, &subnet_mask);
+    if (local_ip_addr.value == 0) {
+        return CAPTURE_ERROR("No local IPv4 address to inject frames to", 0, 0);
+    }
+
+    uint32_t last_host_addr = ntoh32(local_ip_addr.value | ~subnet_mask.value) - 1;
+
+    if (hton32(last_host_addr) == local_ip_addr.value) {
+        last_host_addr --;
+    }
+
+    source_ip_addr.value = hton32(last_host_addr);
+    memset(benchmark_p->inject_frames, 0, sizeof benchmark_p->inject_frames);
+
+    /*
+     * ARP request:
+     */
+    frame_p = (struct ethernet_frame *)benchmark_p->inject_frames[NET_BENCHMARK_INJECT_ARP];
+    net_benchmark_build_ethernet_header(&frame_p->ethernet_header,
+                                        &g_ethernet_broadcast_mac_addr,
+                                        FRAME_TYPE_ARP_PACKET);
+    frame_p->arp_packet.link_addr_type = hton16(0x1);
+    frame_p->arp_packet.network_addr_type = hton16(FRAME_TYPE_IPv4_PACKET);
+    frame_p->arp_packet.link_addr_size = sizeof(struct ethernet_mac_address);
+    frame_p->arp_packet.network_addr_size = sizeof(struct ipv4_address);
+    frame_p->arp_packet.operation = hton16(ARP_REQUEST);
+    frame_p->arp_packet.source_mac_addr = g_net_benchmark_inject_source_mac_addr;
+    frame_p->arp_packet.source_ip_addr.value = source_ip_addr.value;
+    frame_p->arp_packet.dest_ip_addr.value = local_ip_addr.value;
+    benchmark_p->inject_frame_lengths[NET_BENCHMARK_INJECT_ARP] =
+        sizeof(struct ethernet_header) + sizeof(struct arp_packet);
+
+    /*
+     * ICMPv4 echo request:
+     */
+    struct icmpv4_echo_message *echo_msg_p;
+
+    frame_p = (struct ethernet_frame *)benchmark_p->inject_frames[NET_BENCHMARK_INJECT_ICMP];
+    payload_length = sizeof(struct icmpv4_echo_message) +
+                     NET_BENCHMARK_INJECT_ICMP_DATA_SIZE;
+    net_benchmark_build_ethernet_header(&frame_p->ethernet_header,
+                                        &local_mac_addr,
+                                        FRAME_TYPE_IPv4_PACKET);
+    net_benchmark_build_ipv4_header(&frame_p->ipv4_header, &source_ip_addr,
+                                    &local_ip_addr, IP_PACKET_TYPE_ICMP,
+                                    payload_length);
+    echo_msg_p = (struct icmpv4_echo_message *)(&frame_p->ipv4_header + 1);
+    echo_msg_p->header.msg_type = ICMP_TYPE_PING_REQUEST;
+    echo_msg_p->header.msg_code = ICMP_CODE_PING_REQUEST;
+    echo_msg_p->identifier = hton16(benchmark_p->last_run_id);
+    echo_msg_p->seq_num = 0;
+    echo_msg_p->header.msg_checksum = internet_checksum(echo_msg_p,
+                                                        payload_length);
+    benchmark_p->inject_frame_lengths[NET_BENCHMARK_INJECT_ICMP] =
+        sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+        payload_length;
+
+    /*
+     * UDP datagram, without checksum:
+     */
+    struct udp_header *udp_header_p;
+    struct net_benchmark_header *header_p;
+
+    frame_p = (struct ethernet_frame *)benchmark_p->inject_frames[NET_BENCHMARK_INJECT_UDP];
+    payload_length = sizeof(struct udp_header) + NET_BENCHMARK_INJECT_UDP_PAYLOAD_SIZE;
+    net_benchmark_build_ethernet_header(&frame_p->ethernet_header,
+                                        &local_mac_addr,
+                                        FRAME_TYPE_IPv4_PACKET);
+    net_benchmark_build_ipv4_header(&frame_p->ipv4_header, &source_ip_addr,
+                                    &local_ip_addr, IP_PACKET_TYPE_UDP,
+                                    payload_length);
+    udp_header_p = (struct udp_header *)(&frame_p->ipv4_header + 1);
+    udp_header_p->source_port = hton16(NET_BENCHMARK_PORT);
+    udp_header_p->dest_port = hton16(NET_BENCHMARK_PORT);
+    udp_header_p->datagram_length = hton16(payload_length);
+    udp_header_p->datagram_checksum = 0;
+    header_p = (struct net_benchmark_header *)(udp_header_p + 1);
+    header_p->magic = hton32(NET_BENCHMARK_MAGIC);
+    header_p->type = NET_BENCHMARK_MSG_DATA;
+    header_p->run_id = hton16(benchmark_p->last_run_id);
+    benchmark_p->inject_frame_lengths[NET_BENCHMARK_INJECT_UDP] =
+        sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+        payload_length;
+
+    /*
+     * Junk frame:
+     */
+    frame_p = (struct ethernet_frame *)benchmark_p->inject_frames[NET_BENCHMARK_INJECT_JUNK];
+    net_benchmark_build_ethernet_header(&frame_p->ethernet_header,
+                                        &local_mac_addr,
+                                        NET_BENCHMARK_INJECT_JUNK_FRAME_TYPE);
+    benchmark_p->inject_frame_lengths[NET_BENCHMARK_INJECT_JUNK] =
+        sizeof(struct ethernet_header) + NET_BENCHMARK_INJECT_JUNK_PAYLOAD_SIZE;
+    return 0;
+}
+
+
+/**
+ * Rx callback of the benchmark end point during an Rx injection benchmark.
+ * Injected datagrams are counted by layer 4, so they are just released.
+ */
+static bool net_benchmark_inject_rx_callback(struct net_layer4_end_point *layer4_end_point_p,
+                                             struct net_udp_rx_datagram *rx_datagram_p,
+                                             void *arg)
+{
+    return false;
+}
+
+
+/**
+ * Samples the Rx counters of layers 2 to 4
+ */
+static void net_benchmark_read_rx_counters(struct net_benchmark_rx_counters *counters_p)
+{
+    counters_p->layer2_dropped =
+        g_net_layer2.drop_counts[NET_LAYER2_DROP_RX_BAD_FRAME] +
+        g_net_layer2.drop_counts[NET_LAYER2_DROP_RX_UNKNOWN_FRAME_TYPE] +
+        g_net_layer2.drop_counts[NET_LAYER2_DROP_RX_WRONG_VLAN] +
+        g_net_layer2.drop_counts[NET_LAYER2_DROP_RX_DISPATCH_QUEUE_FULL] +
+        g_net_layer2.drop_counts[NET_LAYER2_DROP_RX_OVERLOAD];
+    counters_p->ipv4_accepted = COUNTER_SET_READ(g_net_layer3.ipv4.packet_counters,
+                                                 NET_PACKET_COUNTER_RX_ACCEPTED);
+    counters_p->ipv4_dropped = COUNTER_SET_READ(g_net_layer3.ipv4.packet_counters,
+                                                NET_PACKET_COUNTER_RX_DROPPED);
+    counters_p->udp_accepted = COUNTER_SET_READ(g_net_layer4.udp.counters,
+                                                NET_UDP_COUNTER_RX_ACCEPTED);
+    counters_p->udp_dropped = COUNTER_SET_READ(g_net_layer4.udp.counters,
+                                               NET_UDP_COUNTER_RX_DROPPED);
+}
+
+
+/**
+ * Injects a copy of a frame into a layer-2 end point, as if the end point's
+ * Ethernet MAC had received it. The frame is processed by layer 2 in the
+ * calling task (see net_layer2_inject_rx_packet()).
+ *
+ * @return true, on success
+ * @return false, if no free Rx packet could be taken from the shared Rx
+ *         packet pool
+ */
+static bool net_benchmark_inject_frame(struct net_layer2_end_point *layer2_end_point_p,
+                                       const uint8_t *frame_p,
+                                       uint16_t frame_length)
+{
+#   ifdef USE_MPU
+    bool caller_was_privileged = rtos_enter_privileged_mode();
+#   endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+    struct network_packet *rx_packet_p = net_layer2_take_rx_packet(layer2_end_point_p);
+
+    restore_cpu_interrupts(int_mask);
+    if (rx_packet_p != NULL) {
+        memcpy(rx_packet_p->data_buffer, frame_p, frame_length);
+        rx_packet_p->state_flags = 0;
+        rx_packet_p->total_length = frame_length;
+        rx_packet_p->next_fragment_p = NULL;
+
+        /*
+         * The injected frames have valid checksums, so they are marked as
+         * validated, in the same way as looped-back IPv4 packets:
+         */
+        rx_packet_p->rx_checksum_flags = NET_PACKET_RX_CHECKSUMS_VALIDATED |
+                                         NET_PACKET_RX_IP_HEADER_CHECKSUM_OK |
+                                         NET_PACKET_RX_PROTOCOL_CHECKSUM_OK;
+        rx_packet_p->vlan_pcp = 0;
+        rx_packet_p->timestamp_flags = 0;
+        NET_RX_PACKET_LATENCY_BEGIN(rx_packet_p);
+        net_layer2_inject_rx_packet(layer2_end_point_p, rx_packet_p);
+    }
+
+#   ifdef USE_MPU
+    if (!caller_was_privileged) {
+        rtos_exit_privileged_mode();
+    }
+#   endif
+
+    return rx_packet_p != NULL;
+}
+
+
+/**
+ * Waits for the layer-2 end point to get back all the Rx packets taken from
+ * the shared Rx packet pool for injected frames, as they are recycled at
+ * the end of their processing. It gives up if none is recycled for
+ * NET_BENCHMARK_RX_IDLE_TIMEOUT_MS.
+ *
+ * @return number of Rx packets not recycled
+ */
+static uint32_t net_benchmark_wait_injected_frames(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    uint16_t start_held_count)
+{
+    uint16_t last_held_count = UINT16_MAX;
+    uint32_t idle_ms = 0;
+
+    for ( ; ; ) {
+        uint16_t held_count = layer2_end_point_p->rx_packets_held_count;
+
+        if (held_count <= start_held_count) {
+            return 0;
+        }
+
+        if (held_count < last_held_count) {
+            last_held_count = held_count;
+            idle_ms = 0;
+        } else if (idle_ms >= NET_BENCHMARK_RX_IDLE_TIMEOUT_MS) {
+            return held_count - start_held_count;
+        }
+
+        rtos_task_delay(1);
+        idle_ms ++;
+    }
+}
+
+
+/**
+ * Runs an Rx injection benchmark: frames of the given types are built once,
+ * and copies of them are injected, in turns, into the first layer-2 end
+ * point, so that they go up the stack as if they had been received from the
+ * network. Replies to them (ARP and ICMPv4 echo replies)
+ * are sent to the made-up host that the frames come from.
+ *
+ * Frames are injected at the given rate, or as fast as free Rx packets are
+ * available if the rate is 0. The probes of the networking stack are reset
+ * at the beginning, so that the per-layer durations reported by
+ * perf_probes_dump() afterwards are those of the injected frames.
+ *
+ * @param frame_types_mask  Mask of the types of frames to inject: bit i set
+ *                          means to inject frames of type i (enum
+ *                          net_benchmark_inject_frame_types)
+ * @param count             Number of frames to inject
+ * @param rate_pps          Frames to inject per second, or 0 for no limit
+ * @param result_p          Area where the benchmark results are returned
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t net_benchmark_rx_inject(uint32_t frame_types_mask,
+                                uint32_t count,
+                                uint32_t rate_pps,
+                                struct net_benchmark_inject_result *result_p)
+{
+    struct net_benchmark *const benchmark_p = &g_net_benchmark;
+    struct net_layer2_end_point *const layer2_end_point_p =
+        &g_net_layer2.local_layer2_end_points[0];
+    struct net_benchmark_rx_counters start_counters;
+    struct net_benchmark_rx_counters end_counters;
+    struct net_benchmark_result clock_result;
+    struct net_benchmark_clock clock;
+    uint_fast8_t frame_type = 0;
+    uint32_t idle_ms = 0;
+    uint64_t start_ns;
+    uint16_t start_held_count;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    frame_types_mask &= NET_BENCHMARK_INJECT_ALL_FRAME_TYPES;
+    if (frame_types_mask == 0) {
+        return CAPTURE_ERROR("No frame types to inject", frame_types_mask, 0);
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(benchmark_p,
+                                sizeof *benchmark_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    error = net_benchmark_begin(benchmark_p,
+                                NET_BENCHMARK_INJECT_UDP_PAYLOAD_SIZE,
+                                &clock_result);
+    if (error != 0) {
+        goto common_exit;
+    }
+
+    error = net_benchmark_build_inject_frames(benchmark_p);
+    if (error != 0) {
+        net_benchmark_end(benchmark_p);
+        goto common_exit;
+    }
+
+    memset(result_p, 0, sizeof *result_p);
+    net_layer4_udp_end_point_set_rx_callback(&benchmark_p->end_point,
+                                             net_benchmark_inject_rx_callback,
+                                             NULL,
+                                             NET_BENCHMARK_INJECT_RX_CALLBACK_CYCLE_BUDGET);
+    perf_probes_reset();
+    net_benchmark_read_rx_counters(&start_counters);
+    start_held_count = layer2_end_point_p->rx_packets_held_count;
+    start_ns = get_monotonic_ns();
+    net_benchmark_clock_start(&clock);
+    for (uint32_t i = 0; i < count; ) {
+        if (rate_pps != 0) {
+            uint64_t next_inject_ns = start_ns + (uint64_t)i * 1000000000 / rate_pps;
+            uint64_t now_ns = get_monotonic_ns();
+
+            /*
+             * Frames due less than a millisecond from now are injected
+             * right away, as waits are in whole milliseconds:
+             */
+            if (next_inject_ns >= now_ns + 1000000) {
+                rtos_task_delay((uint32_t)((next_inject_ns - now_ns) / 1000000));
+                continue;
+            }
+        }
+
+        while (!(frame_types_mask & BIT(frame_type))) {
+            frame_type = (frame_type + 1) % NET_BENCHMARK_NUM_INJECT_FRAME_TYPES;
+        }
+
+        if (!net_benchmark_inject_frame(layer2_end_point_p,
+                                        benchmark_p->inject_frames[frame_type],
+                                        benchmark_p->inject_frame_lengths[frame_type])) {
+            /*
+             * Wait for the stack to recycle Rx packets of previously
+             * injected frames:
+             */
+            if (idle_ms >= NET_BENCHMARK_RX_IDLE_TIMEOUT_MS) {
+                break;
+            }
+
+            result_p->rx_packet_waits ++;
+            rtos_task_delay(1);
+            idle_ms ++;
+            continue;
+        }
+
+        idle_ms = 0;
+        result_p->injected[frame_type] ++;
+        frame_type = (frame_type + 1) % NET_BENCHMARK_NUM_INJECT_FRAME_TYPES;
+        i ++;
+    }
+
+    result_p->unfinished = net_benchmark_wait_injected_frames(layer2_end_point_p,
+                                                              start_held_count);
+    net_benchmark_clock_stop(&clock, &clock_result);
+    net_benchmark_read_rx_counters(&end_counters);
+
+    result_p->elapsed_ns = clock_result.elapsed_ns;
+    result_p->busy_cycles = clock_result.busy_cycles;
+    result_p->layer2_dropped = end_counters.layer2_dropped -
+                               start_counters.layer2_dropped;
+    result_p->ipv4_accepted = end_counters.ipv4_accepted -
+                              start_counters.ipv4_accepted;
+    result_p->ipv4_dropped = end_counters.ipv4_dropped -
+                             start_counters.ipv4_dropped;
+    result_p->udp_accepted = end_counters.udp_accepted -
+                             start_counters.udp_accepted;
+    result_p->udp_dropped = end_counters.udp_dropped -
+                            start_counters.udp_dropped;
+
+    net_layer4_udp_end_point_set_rx_callback(&benchmark_p->end_point, NULL, NULL, 0);
+    net_benchmark_end(benchmark_p);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
@@ -0,0 +1,284 @@
+/**
+ * @file net_benchmark.h
+ *
+ * Networking benchmarks interface
+ *
+ * The networking benchmarks measure the UDP throughput and latency of the
+ * networking stack against a peer running scripts/udp_bench.pl:
+ *
+ * - UDP Tx: the board sends datagrams to the peer as fast as Tx packets
+ *   become available, and the peer counts them ('udp_bench.pl sink').
+ * - UDP Rx: the peer sends datagrams to the board ('udp_bench.pl blast'),
+ *   and the board counts them. Datagrams not received by the time the peer
+ *   goes idle are counted as lost.
+ * - UDP RTT: the board sends echo requests to the peer, one at a time, and
+ *   the peer sends them back ('udp_bench.pl echo'). Round-trip time
+ *   percentiles are calculated over all the replies received.
+ * - Ping flood: the board sends ICMPv4 echo requests to any peer, with up to
+ *   a given number of them outstanding, and at a given interval. Requests
+ *   not replied within a timeout are counted as lost.
+ * - Rx injection: the board feeds synthetic frames (ARP requests, ICMPv4
+ *   echo requests, UDP datagrams to NET_BENCHMARK_PORT and frames of an
+ *   unknown EtherType) straight into layer 2, at a given rate, as if the
+ *   Ethernet MAC had received them. It needs no peer or network,
+ *   so that changes to layers 2 to 4 can be benchmarked deterministically on
+ *   a bare board. The performance probes are reset when it starts, so that
+ *   afterwards they only hold the durations measured for the injected frames.
+ *
+ * Besides throughput, each benchmark reports the CPU cycles the whole system
+ * spent per datagram, calculated from the DWT cycles not spent in the RTOS
+ * idle task while the benchmark was running.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_NET_BENCHMARK_H_
+#define SOURCES_BUILDING_BLOCKS_NET_BENCHMARK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "networking_layer3.h"
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+
+/**
+ * UDP port used by the benchmarks, on both the board and the peer
+ */
+#define NET_BENCHMARK_PORT                  5001
+
+/**
+ * Maximum number of round-trip time samples of an RTT benchmark. If the
+ * benchmark sends more echo requests, only the round-trip times of the
+ * first ones are used to calculate percentiles.
+ */
+#define NET_BENCHMARK_MAX_RTT_SAMPLES       512
+
+/**
+ * Maximum number of ping requests that a ping flood can have outstanding
+ */
+#define NET_BENCHMARK_PING_MAX_OUTSTANDING  16
+
+/**
+ * UDP payload size in bytes of the datagrams injected by an Rx injection
+ * benchmark
+ */
+#define NET_BENCHMARK_INJECT_UDP_PAYLOAD_SIZE   64
+
+/**
+ * Data size in bytes of the ICMPv4 echo requests injected by an Rx
+ * injection benchmark (same as the default of ping(8))
+ */
+#define NET_BENCHMARK_INJECT_ICMP_DATA_SIZE     56
+
+/**
+ * Types of frames injected by an Rx injection benchmark
+ */
+enum net_benchmark_inject_frame_types {
+    /*
+     * ARP request for the local IPv4 address
+     */
+    NET_BENCHMARK_INJECT_ARP = 0,
+
+    /*
+     * ICMPv4 echo request to the local IPv4 address
+     */
+    NET_BENCHMARK_INJECT_ICMP,
+
+    /*
+     * UDP datagram to NET_BENCHMARK_PORT, which is bound while the benchmark
+     * runs
+     */
+    NET_BENCHMARK_INJECT_UDP,
+
+    /*
+     * Frame of an EtherType that layer 2 does not handle
+     */
+    NET_BENCHMARK_INJECT_JUNK,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NET_BENCHMARK_NUM_INJECT_FRAME_TYPES
+};
+
+/**
+ * Mask of all the frame types of an Rx injection benchmark
+ */
+#define NET_BENCHMARK_INJECT_ALL_FRAME_TYPES \
+        MULTI_BIT_MASK(NET_BENCHMARK_NUM_INJECT_FRAME_TYPES - 1, 0)
+
+/**
+ * Types of benchmark messages
+ */
+enum net_benchmark_message_types {
+    /*
+     * Datagram of a throughput benchmark (board -> peer or peer -> board)
+     */
+    NET_BENCHMARK_MSG_DATA = 1,
+
+    /*
+     * Board -> peer: echo request. The peer sends it back unchanged, except
+     * for the message type.
+     */
+    NET_BENCHMARK_MSG_ECHO_REQUEST,
+
+    /*
+     * Peer -> board: echo reply
+     */
+    NET_BENCHMARK_MSG_ECHO_REPLY,
+};
+
+/**
+ * Header of a benchmark message. It is followed by padding up to the
+ * datagram size of the benchmark. All fields are big endian.
+ */
+struct net_benchmark_header {
+#   define NET_BENCHMARK_MAGIC  GEN_SIGNATURE('B', 'N', 'C', 'H')
+    uint32_t magic;
+
+    /**
+     * Message type (enum net_benchmark_message_types)
+     */
+    uint8_t type;
+
+    uint8_t reserved;
+
+    /**
+     * Identifier of the benchmark run, chosen by the sender
+     */
+    uint16_t run_id;
+
+    /**
+     * Sequence number of the message in the run, starting at 0
+     */
+    uint32_t seq_num;
+
+    /**
+     * Sender's timestamp in microseconds (echoed back in echo replies)
+     */
+    uint32_t timestamp_us;
+};
+
+C_ASSERT(sizeof(struct net_benchmark_header) == 16);
+
+/**
+ * Benchmark results
+ */
+struct net_benchmark_result {
+    /**
+     * Number of datagrams sent, or received for UDP Rx benchmarks, or
+     * echo replies received for RTT benchmarks
+     */
+    uint32_t packets;
+
+    /**
+     * Number of datagrams lost (UDP Rx and RTT benchmarks only)
+     */
+    uint32_t lost_packets;
+
+    /**
+     * Number of UDP payload bytes sent or received
+     */
+    uint64_t bytes;
+
+    /**
+     * Duration of the benchmark in nanoseconds
+     */
+    uint64_t elapsed_ns;
+
+    /**
+     * DWT cycles spent outside of the RTOS idle task during the benchmark
+     */
+    uint64_t busy_cycles;
+
+    /**
+     * Round-trip time average and percentiles in nanoseconds (RTT and
+     * ping flood benchmarks only)
+     */
+    uint32_t rtt_min_ns;
+    uint32_t rtt_avg_ns;
+    uint32_t rtt_p50_ns;
+    uint32_t rtt_p90_ns;
+    uint32_t rtt_p99_ns;
+    uint32_t rtt_max_ns;
+};
+
+/**
+ * Results of an Rx injection benchmark. Counts of accepted and dropped
+ * packets are the changes of the corresponding counters of each layer while
+ * the benchmark ran.
+ */
+struct net_benchmark_inject_result {
+    /**
+     * Number of frames injected of each type (enum
+     * net_benchmark_inject_frame_types)
+     */
+    uint32_t injected[NET_BENCHMARK_NUM_INJECT_FRAME_TYPES];
+
+    /**
+     * Number of times that injection had to wait for a free Rx packet
+     */
+    uint32_t rx_packet_waits;
+
+    /**
+     * Number of injected frames still being processed when the benchmark
+     * stopped waiting for them
+     */
+    uint32_t unfinished;
+
+    /**
+     * Duration of the benchmark in nanoseconds, from the first injection
+     * until all the injected frames had been processed
+     */
+    uint64_t elapsed_ns;
+
+    /**
+     * DWT cycles spent outside of the RTOS idle task during the benchmark,
+     * including the cycles spent building the injected frames
+     */
+    uint64_t busy_cycles;
+
+    /**
+     * Received frames dropped by layer 2
+     */
+    uint32_t layer2_dropped;
+
+    /**
+     * Received IPv4 packets accepted and dropped by layer 3
+     */
+    uint32_t ipv4_accepted;
+    uint32_t ipv4_dropped;
+
+    /**
+     * Received UDP datagrams accepted and dropped by layer 4
+     */
+    uint32_t udp_accepted;
+    uint32_t udp_dropped;
+};
+
+error_t net_benchmark_udp_tx(const struct ipv4_address *peer_ip_addr_p,
+                             size_t datagram_size,
+                             uint32_t count,
+                             struct net_benchmark_result *result_p);
+
+error_t net_benchmark_udp_rx(const struct ipv4_address *peer_ip_addr_p,
+                             size_t datagram_size,
+                             uint32_t count,
+                             struct net_benchmark_result *result_p);
+
+error_t net_benchmark_udp_rtt(const struct ipv4_address *peer_ip_addr_p,
+                              size_t datagram_size,
+                              uint32_t count,
+                              struct net_benchmark_result *result_p);
+
+error_t net_benchmark_ping_flood(const struct ipv4_address *peer_ip_addr_p,
+                                 uint32_t count,
+                                 uint32_t interval_ms,
+                                 uint32_t max_outstanding,
+                                 struct net_benchmark_result *result_p);
+
+error_t net_benchmark_rx_inject(uint32_t frame_types_mask,
+                                uint32_t count,
+                                uint32_t rate_pps,
+                                struct net_benchmark_inject_result *result_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_NET_BENCHMARK_H_ */
@@ -0,0 +1,108 @@
+/**
+ * @file net_config.h
+ *
+ * Networking stack tuning profiles
+ *
+ * All the sizes of packet pools, rings and caches of the networking stack
+ * are derived from the profile selected by NET_CONFIG_PROFILE, so that the
+ * stack is retuned for a workload in one place. The SRAM taken by the
+ * networking stack with the selected profile is checked at compile time
+ * against the SRAM of the target MCU (see networking.c).
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_NET_CONFIG_H_
+#define SOURCES_BUILDING_BLOCKS_NET_CONFIG_H_
+
+#include "compile_time_checks.h"
+#include "mem_utils.h"
+#include "microcontroller.h"
+
+/**
+ * Networking stack tuning profiles:
+ * - LOW_MEM: fewest packets and smallest caches that keep the stack
+ *   working, for applications that need the SRAM for other things.
+ * - DEFAULT: balanced sizes for the lab applications.
+ * - THROUGHPUT: deeper Rx/Tx pools and Ethernet MAC rings, to sustain
+ *   line rate with bursty traffic and slow consumers.
+ */
+#define NET_CONFIG_PROFILE_LOW_MEM      1
+#define NET_CONFIG_PROFILE_DEFAULT      2
+#define NET_CONFIG_PROFILE_THROUGHPUT   3
+
+#ifndef NET_CONFIG_PROFILE
+#define NET_CONFIG_PROFILE  NET_CONFIG_PROFILE_DEFAULT
+#endif
+
+#if NET_CONFIG_PROFILE == NET_CONFIG_PROFILE_LOW_MEM
+
+#define NET_CONFIG_MAX_LARGE_TX_PACKETS         4
+#define NET_CONFIG_MAX_SMALL_TX_PACKETS         4
+#define NET_CONFIG_MAX_RX_PACKETS               16
+#define NET_CONFIG_RX_PACKET_POOL_SIZE          16
+#define NET_CONFIG_MAX_RX_COPYBREAK_PACKETS     8
+#define NET_CONFIG_MAX_RX_PACKET_CLONES         4
+#define NET_CONFIG_PACKET_SPSC_QUEUE_NUM_ENTRIES 16
+#define NET_CONFIG_MAC_TX_RING_NUM_ENTRIES      8
+#define NET_CONFIG_MAC_RX_RING_NUM_ENTRIES      8
+#define NET_CONFIG_ARP_CACHE_NUM_BUCKETS        4
+#define NET_CONFIG_NEIGHBOR_CACHE_NUM_BUCKETS   4
+#define NET_CONFIG_DNS_CACHE_NUM_ENTRIES        4
+
+#elif NET_CONFIG_PROFILE == NET_CONFIG_PROFILE_DEFAULT
+
+#define NET_CONFIG_MAX_LARGE_TX_PACKETS         4
+#define NET_CONFIG_MAX_SMALL_TX_PACKETS         8
+#define NET_CONFIG_MAX_RX_PACKETS               24
+#define NET_CONFIG_RX_PACKET_POOL_SIZE          24
+#define NET_CONFIG_MAX_RX_COPYBREAK_PACKETS     16
+#define NET_CONFIG_MAX_RX_PACKET_CLONES         8
+#define NET_CONFIG_PACKET_SPSC_QUEUE_NUM_ENTRIES 32
+#define NET_CONFIG_MAC_TX_RING_NUM_ENTRIES      16
+#define NET_CONFIG_MAC_RX_RING_NUM_ENTRIES      16
+#define NET_CONFIG_ARP_CACHE_NUM_BUCKETS        8
+#define NET_CONFIG_NEIGHBOR_CACHE_NUM_BUCKETS   8
+#define NET_CONFIG_DNS_CACHE_NUM_ENTRIES        8
+
+#elif NET_CONFIG_PROFILE == NET_CONFIG_PROFILE_THROUGHPUT
+
+#define NET_CONFIG_MAX_LARGE_TX_PACKETS         8
+#define NET_CONFIG_MAX_SMALL_TX_PACKETS         16
+#define NET_CONFIG_MAX_RX_PACKETS               40
+#define NET_CONFIG_RX_PACKET_POOL_SIZE          40
+#define NET_CONFIG_MAX_RX_COPYBREAK_PACKETS     32
+#define NET_CONFIG_MAX_RX_PACKET_CLONES         8
+#define NET_CONFIG_PACKET_SPSC_QUEUE_NUM_ENTRIES 64
+#define NET_CONFIG_MAC_TX_RING_NUM_ENTRIES      32
+#define NET_CONFIG_MAC_RX_RING_NUM_ENTRIES      32
+#define NET_CONFIG_ARP_CACHE_NUM_BUCKETS        16
+#define NET_CONFIG_NEIGHBOR_CACHE_NUM_BUCKETS   16
+#define NET_CONFIG_DNS_CACHE_NUM_ENTRIES        16
+
+#else
+#error "Unknown networking stack tuning profile"
+#endif
+
+/**
+ * Percentage of the MCU's SRAM that the networking stack's state variables
+ * and packet data buffers may take. The rest is left for the RTOS, the
+ * console, the application and the main stack.
+ */
+#ifndef NET_CONFIG_SRAM_BUDGET_PERCENT
+#define NET_CONFIG_SRAM_BUDGET_PERCENT  60
+#endif
+
+/**
+ * Maximum number of bytes of SRAM that the networking stack may take
+ */
+#define NET_CONFIG_SRAM_BUDGET \
+        ((MCU_SRAM_SIZE / 100) * NET_CONFIG_SRAM_BUDGET_PERCENT)
+
+C_ASSERT(NET_CONFIG_SRAM_BUDGET_PERCENT > 0 &&
+         NET_CONFIG_SRAM_BUDGET_PERCENT < 100);
+
+C_ASSERT(IS_POWER_OF_2(NET_CONFIG_PACKET_SPSC_QUEUE_NUM_ENTRIES));
+C_ASSERT(IS_POWER_OF_2(NET_CONFIG_ARP_CACHE_NUM_BUCKETS));
+C_ASSERT(IS_POWER_OF_2(NET_CONFIG_NEIGHBOR_CACHE_NUM_BUCKETS));
+
+#endif /* SOURCES_BUILDING_BLOCKS_NET_CONFIG_H_ */
@@ -11,6 +11,55 @@
 #include <stdint.h>
 #include "network_packet.h"
 
+/**
+ * Maximum number of IPv4 multicast groups that a layer-4 end point can join
+ */
+#define NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS  2
+
+/**
+ * Default maximum number of received packets that a layer-4 end point can
+ * hold at any given time: packets waiting in its Rx queue plus packets lent
+ * to the application by the zero-copy receive API. Further packets received
+ * for the end point are dropped, so that one slow reader cannot drain the Rx
+ * packet pool. It can be changed per end point with
+ * net_layer4_end_point_set_max_held_rx_packets().
+ */
+#define NET_LAYER4_END_POINT_DEFAULT_MAX_HELD_RX_PACKETS   8
+
+/**
+ * Upper bound for the maximum number of received packets that a layer-4 end
+ * point can hold (half of the Rx packet pool)
+ */
+#define NET_LAYER4_END_POINT_MAX_HELD_RX_PACKETS_LIMIT     (NET_MAX_RX_PACKETS / 2)
+
+C_ASSERT(NET_LAYER4_END_POINT_DEFAULT_MAX_HELD_RX_PACKETS <=
+         NET_LAYER4_END_POINT_MAX_HELD_RX_PACKETS_LIMIT);
+
+/**
+ * Maximum number of layer-4 end points in a poll group
+ */
+#define NET_LAYER4_POLL_GROUP_MAX_END_POINTS    8
+
+struct net_ipv4_flow;
+struct net_layer4_poll_group;
+struct net_layer4_end_point;
+struct net_udp_rx_datagram;
+
+/**
+ * Signature of the callback that a UDP end point can register to have its
+ * received datagrams delivered directly from the networking Rx path, instead
+ * of being queued for a task to receive them (see
+ * net_layer4_udp_end_point_set_rx_callback()). The datagram is lent to the
+ * callback as by net_layer4_udp_receive_zero_copy().
+ *
+ * @return true, if the callback keeps the datagram, to be returned later with
+ *         net_layer4_udp_release_rx_datagram()
+ * @return false, if the datagram is to be released right away
+ */
+typedef bool net_udp_rx_callback_t(struct net_layer4_end_point *layer4_end_point_p,
+                                   struct net_udp_rx_datagram *rx_datagram_p,
+                                   void *arg);
+
 /**
  * Layer-4 protocol types
  */
@@ -44,6 +93,105 @@ struct net_layer4_end_point {
      */
     struct net_packet_queue rx_packet_queue;
 
+    /**
+     * Number of received packets currently lent to the application by the
+     * zero-copy receive API, and not yet released
+     */
+    volatile uint32_t num_lent_rx_packets;
+
+    /**
+     * Maximum number of received packets that this end point can hold (queued
+     * in rx_packet_queue plus lent)
+     */
+    uint16_t max_held_rx_packets;
+
+    /**
+     * Number of received packets queued for this end point
+     */
+    volatile uint32_t rx_packets_accepted_count;
+
+    /**
+     * Number of received packets dropped because this end point already held
+     * max_held_rx_packets packets
+     */
+    volatile uint32_t rx_packets_dropped_count;
+
+    /**
+     * IPv4 multicast groups joined by this layer-4 end point, as IPv4 address
+     * values in network byte order (0 for free entries). Datagrams sent to a
+     * multicast group are only delivered to end points that joined it.
+     */
+    uint32_t ipv4_multicast_groups[NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS];
+
+    /**
+     * IPv4 flow to the peer of a connected end point, or NULL if the end
+     * point is not connected
+     */
+    struct net_ipv4_flow *connected_flow_p;
+
+    /**
+     * IPv4 address value (network byte order) of the peer of a connected
+     * end point
+     */
+    uint32_t connected_peer_ipv4_addr;
+
+    /**
+     * Port number (network byte order) of the peer of a connected end point,
+     * or 0 if the end point is not connected. It is read without holding any
+     * lock on the Rx path, so it is written last on connect and first on
+     * disconnect.
+     */
+    volatile uint16_t connected_peer_port;
+
+    /**
+     * Poll group to be signaled when a packet is added to rx_packet_queue,
+     * or NULL if the end point is not in a poll group
+     */
+    struct net_layer4_poll_group *volatile poll_group_p;
+
+    /**
+     * Callback to which received datagrams are delivered directly from the
+     * Rx path, or NULL if they are queued in rx_packet_queue. It is read
+     * without holding any lock on the Rx path, so it is written after
+     * rx_callback_arg and rx_callback_cycle_budget.
+     */
+    net_udp_rx_callback_t *volatile rx_callback_p;
+
+    /**
+     * Argument passed to rx_callback_p
+     */
+    void *rx_callback_arg;
+
+    /**
+     * Maximum number of CPU cycles that one invocation of rx_callback_p can
+     * take. The first invocation that takes longer unregisters the callback,
+     * so that further datagrams are queued in rx_packet_queue instead.
+     */
+    uint32_t rx_callback_cycle_budget;
+
+    /**
+     * Flag indicating if other end points can be bound to the same port as
+     * this end point (they must set this flag too). Multicast and broadcast
+     * datagrams received for the port are delivered to every end point bound
+     * to it that is to receive them, sharing the same Rx packet.
+     */
+    bool shared_port;
+
+    /**
+     * How unicast datagrams received for a shared port are distributed
+     * among the end points bound to it. The policy of the end point bound
+     * last to the port is the one used.
+     */
+    uint8_t load_balancing;
+#   define NET_LAYER4_BALANCE_BY_SOURCE_HASH    UINT8_C(0)
+#   define NET_LAYER4_BALANCE_ROUND_ROBIN       UINT8_C(1)
+
+    /**
+     * Number of unicast datagrams distributed round-robin, with this end
+     * point's policy, among the end points bound to its shared port
+     */
+    volatile uint32_t round_robin_count;
+
     /**
      * Pointer to list of layer-4 end points that contains
      * this layer-4 end point.
@@ -55,6 +203,61 @@ struct net_layer4_end_point {
      * Layer-4 end points for the same layer-4 protocol.
      */
     struct net_layer4_end_point *next_p;
+
+    /**
+     * Pointer to next layer-4 end point in the same bucket of the port hash
+     * table of its layer-4 protocol. It is read without holding any lock on
+     * the Rx path, so it is only changed inside a bucket update.
+     */
+    struct net_layer4_end_point *volatile hash_chain_next_p;
+};
+
+/**
+ * Rx statistics of a layer-4 end point
+ */
+struct net_layer4_end_point_stats {
+    uint32_t rx_packets_accepted_count;
+    uint32_t rx_packets_dropped_count;
+    uint16_t rx_queue_length;
+    uint16_t rx_queue_length_high_water_mark;
+    uint16_t num_lent_rx_packets;
+    uint16_t max_held_rx_packets;
+};
+
+/**
+ * Group of layer-4 end points that can be waited on together, so that a
+ * single task can service several end points. Each packet queued for a
+ * member end point signals the group's semaphore.
+ */
+struct net_layer4_poll_group {
+#   define NET_LAYER4_POLL_GROUP_SIGNATURE  GEN_SIGNATURE('L', '4', 'P', 'G')
+    uint32_t signature;
+
+    /**
+     * Number of entries used in end_points[]
+     */
+    uint8_t num_end_points;
+
+    /**
+     * Index in end_points[] where the next readiness scan starts, so that a
+     * busy end point does not starve the others
+     */
+    uint8_t next_scan_index;
+
+    /**
+     * Member end points
+     */
+    struct net_layer4_end_point *end_points[NET_LAYER4_POLL_GROUP_MAX_END_POINTS];
+
+    /**
+     * Counting semaphore signaled when a packet is queued for a member
+     */
+    struct rtos_semaphore semaphore;
+
+    /**
+     * Mutex to serialize changes to the group membership
+     */
+    struct rtos_mutex mutex;
 };
 
 /**
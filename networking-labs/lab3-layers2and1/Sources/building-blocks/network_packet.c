@@ -5,10 +5,13 @@
  *
  * @author German Rivera
  */
+#include <string.h>
 #include "network_packet.h"
 #include "atomic_utils.h"
+#include "compile_time_checks.h"
+#include "trace_recorder.h"
 
-static void check_net_packet_queue_invariants(struct net_packet_queue *queue_p)
+RAM_FUNC static void check_net_packet_queue_invariants(struct net_packet_queue *queue_p)
 {
     if (_INFREQUENTLY_TRUE_(queue_p->head_p == NULL)) {
         D_ASSERT(queue_p->tail_p == NULL);
@@ -63,7 +66,7 @@ void net_packet_queue_init(const char *name_p,
  * @param queue_p    Pointer to the queue
  * @param packet_p    Pointer to the packet to be added
  */
-void net_packet_queue_add(struct net_packet_queue *queue_p,
+RAM_FUNC void net_packet_queue_add(struct net_packet_queue *queue_p,
                           struct network_packet *packet_p)
 {
     bool use_mutex = queue_p->use_mutex;
@@ -96,6 +99,8 @@ void net_packet_queue_add(struct net_packet_queue *queue_p,
     	queue_p->length_high_water_mark = queue_p->length;
     }
 
+    TRACE_RECORD(TRACE_EVENT_PACKET_QUEUE_ADD, queue_p, queue_p->length);
+
     if (use_mutex) {
         rtos_mutex_unlock(&queue_p->mutex);
     } else {
@@ -106,6 +111,33 @@ void net_packet_queue_add(struct net_packet_queue *queue_p,
 }
 
 
+/**
+ * Unlinks the packet at the head of a non-empty network packet queue.
+ * It must be called with the queue's lock held.
+ */
+RAM_FUNC static void unlink_net_packet_queue_head(struct net_packet_queue *queue_p)
+{
+    struct network_packet *head_packet_p = queue_p->head_p;
+
+    D_ASSERT(head_packet_p != NULL);
+    D_ASSERT(head_packet_p->queue_p == queue_p);
+    D_ASSERT(head_packet_p->signature == NET_RX_PACKET_SIGNATURE ||
+             head_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+
+    queue_p->head_p = head_packet_p->next_p;
+    head_packet_p->next_p = NULL;
+    head_packet_p->queue_p = NULL;
+
+    if (_INFREQUENTLY_TRUE_(queue_p->head_p == NULL)) {
+        D_ASSERT(queue_p->tail_p == head_packet_p);
+        queue_p->tail_p = NULL;
+    }
+
+    queue_p->length --;
+    TRACE_RECORD(TRACE_EVENT_PACKET_QUEUE_REMOVE, queue_p, queue_p->length);
+}
+
+
 /**
  * Removes the packet from the head of a network packet queue, if the queue
  * is not empty. Otherwise, it waits until the queue becomes non-empty.
@@ -118,7 +150,7 @@ void net_packet_queue_add(struct net_packet_queue *queue_p,
  *
  * @return pointer to packet removed from the queue, or NULL if timeout
  */
-struct network_packet *net_packet_queue_remove(struct net_packet_queue *queue_p,
+RAM_FUNC struct network_packet *net_packet_queue_remove(struct net_packet_queue *queue_p,
                                                uint32_t timeout_ms)
 {
     uint32_t int_mask;
@@ -160,27 +192,685 @@ struct network_packet *net_packet_queue_remove(struct net_packet_queue *queue_p,
         }
     }
 
-    D_ASSERT(head_packet_p != NULL);
-    D_ASSERT(head_packet_p->queue_p == queue_p);
-    D_ASSERT(head_packet_p->signature == NET_RX_PACKET_SIGNATURE ||
-             head_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    unlink_net_packet_queue_head(queue_p);
+    if (use_mutex) {
+        rtos_mutex_unlock(&queue_p->mutex);
+    } else {
+        restore_cpu_interrupts(int_mask);
+    }
 
-    queue_p->head_p = head_packet_p->next_p;
-    head_packet_p->next_p = NULL;
-    head_packet_p->queue_p = NULL;
+    D_ASSERT(NET_PACKET_NOT_IN_QUEUE(head_packet_p));
+    return head_packet_p;
+}
 
-    if (_INFREQUENTLY_TRUE_(queue_p->head_p == NULL)) {
-        D_ASSERT(queue_p->tail_p == head_packet_p);
-        queue_p->tail_p = NULL;
+
+/**
+ * Removes the packet from the head of a network packet queue, if the queue
+ * is not empty, without waiting.
+ *
+ * @param queue_p        Pointer to the queue
+ *
+ * @return pointer to packet removed from the queue, or NULL if the queue
+ *         was empty
+ */
+RAM_FUNC struct network_packet *net_packet_queue_try_remove(struct net_packet_queue *queue_p)
+{
+    uint32_t int_mask;
+    struct network_packet *head_packet_p;
+    bool use_mutex = queue_p->use_mutex;
+
+    D_ASSERT(queue_p->signature == NET_PACKET_QUEUE_SIGNATURE);
+    if (!rtos_semaphore_try_wait(&queue_p->semaphore)) {
+        return NULL;
+    }
+
+    if (use_mutex) {
+        rtos_mutex_lock(&queue_p->mutex);
+    } else {
+        int_mask = disable_cpu_interrupts();
+    }
+
+    check_net_packet_queue_invariants(queue_p);
+    head_packet_p = queue_p->head_p;
+    if (_INFREQUENTLY_FALSE_(head_packet_p != NULL)) {
+        unlink_net_packet_queue_head(queue_p);
     }
 
-    queue_p->length --;
     if (use_mutex) {
         rtos_mutex_unlock(&queue_p->mutex);
     } else {
         restore_cpu_interrupts(int_mask);
     }
 
-    D_ASSERT(NET_PACKET_NOT_IN_QUEUE(head_packet_p));
+    D_ASSERT(head_packet_p == NULL || NET_PACKET_NOT_IN_QUEUE(head_packet_p));
+    return head_packet_p;
+}
+
+
+/**
+ * Adds a chain of packets at the end of a network packet queue, signaling
+ * the queue's semaphore only once for the whole chain.
+ *
+ * NOTE: A queue fed with this function is meant to be drained with
+ * net_packet_queue_remove_all(), as its semaphore count does not track the
+ * number of packets in the queue.
+ *
+ * @param queue_p        Pointer to the queue
+ * @param head_packet_p  Pointer to the first packet of the chain
+ * @param tail_packet_p  Pointer to the last packet of the chain
+ * @param num_packets    Number of packets in the chain (linked through
+ *                       their 'next_p' fields)
+ */
+RAM_FUNC void net_packet_queue_add_chain(struct net_packet_queue *queue_p,
+                                struct network_packet *head_packet_p,
+                                struct network_packet *tail_packet_p,
+                                uint16_t num_packets)
+{
+    bool use_mutex = queue_p->use_mutex;
+    uint32_t int_mask;
+
+    D_ASSERT(queue_p->signature == NET_PACKET_QUEUE_SIGNATURE);
+    D_ASSERT(num_packets != 0);
+    D_ASSERT(tail_packet_p->next_p == NULL);
+
+    /*
+     * The chain is not visible to other threads yet, so tag its packets
+     * before acquiring the queue's lock:
+     */
+    uint_fast16_t chain_length = 0;
+    for (struct network_packet *packet_p = head_packet_p;
+         packet_p != NULL;
+         packet_p = packet_p->next_p) {
+        D_ASSERT(packet_p->signature == head_packet_p->signature);
+        D_ASSERT(packet_p->queue_p == NULL);
+        packet_p->queue_p = queue_p;
+        chain_length ++;
+    }
+
+    D_ASSERT(chain_length == num_packets);
+
+    if (use_mutex) {
+        rtos_mutex_lock(&queue_p->mutex);
+    } else {
+        int_mask = disable_cpu_interrupts();
+    }
+
+    check_net_packet_queue_invariants(queue_p);
+
+    struct network_packet *old_tail_packet_p = queue_p->tail_p;
+
+    queue_p->tail_p = tail_packet_p;
+    if (_INFREQUENTLY_TRUE_(old_tail_packet_p == NULL)) {
+        queue_p->head_p = head_packet_p;
+    } else {
+        old_tail_packet_p->next_p = head_packet_p;
+    }
+
+    queue_p->length += num_packets;
+    if (queue_p->length > queue_p->length_high_water_mark) {
+        queue_p->length_high_water_mark = queue_p->length;
+    }
+
+    TRACE_RECORD(TRACE_EVENT_PACKET_QUEUE_ADD, queue_p, queue_p->length);
+
+    if (use_mutex) {
+        rtos_mutex_unlock(&queue_p->mutex);
+    } else {
+        restore_cpu_interrupts(int_mask);
+    }
+
+    rtos_semaphore_signal(&queue_p->semaphore);
+}
+
+
+/**
+ * Removes all the packets from a network packet queue, if the queue
+ * is not empty. Otherwise, it waits until the queue becomes non-empty.
+ * If timeout_ms is not 0, The wait will timeout at the specified
+ * milliseconds value.
+ *
+ * @param queue_p        Pointer to the queue
+ * @param timeout_ms     0, or timeout (in milliseconds) for waiting for the
+ *                       queue to become non-empty
+ * @param num_packets_p  Area where the number of packets removed is to be
+ *                       returned
+ *
+ * @return pointer to the first packet of the chain of packets removed from
+ *         the queue (linked through their 'next_p' fields), or NULL if timeout
+ */
+struct network_packet *net_packet_queue_remove_all(struct net_packet_queue *queue_p,
+                                                   uint32_t timeout_ms,
+                                                   uint16_t *num_packets_p)
+{
+    uint32_t int_mask;
+    struct network_packet *head_packet_p = NULL;
+    bool use_mutex = queue_p->use_mutex;
+
+    for ( ; ; ) {
+        D_ASSERT(queue_p->signature == NET_PACKET_QUEUE_SIGNATURE);
+        if (timeout_ms != 0) {
+            bool sem_signaled = rtos_semaphore_wait_timeout(&queue_p->semaphore,
+                                                            timeout_ms);
+            if (!sem_signaled) {
+                *num_packets_p = 0;
+                return NULL;
+            }
+        } else {
+            rtos_semaphore_wait(&queue_p->semaphore);
+        }
+
+        if (use_mutex) {
+            rtos_mutex_lock(&queue_p->mutex);
+        } else {
+            int_mask = disable_cpu_interrupts();
+        }
+
+        check_net_packet_queue_invariants(queue_p);
+        head_packet_p = queue_p->head_p;
+        if (_INFREQUENTLY_FALSE_(head_packet_p != NULL)) {
+            break;
+        }
+
+        /*
+         * The packets for this semaphore signal were already removed by an
+         * earlier call, so try again.
+         */
+        if (use_mutex) {
+            rtos_mutex_unlock(&queue_p->mutex);
+        } else {
+            restore_cpu_interrupts(int_mask);
+        }
+    }
+
+    D_ASSERT(head_packet_p->queue_p == queue_p);
+
+    *num_packets_p = queue_p->length;
+    queue_p->head_p = NULL;
+    queue_p->tail_p = NULL;
+    queue_p->length = 0;
+    TRACE_RECORD(TRACE_EVENT_PACKET_QUEUE_REMOVE, queue_p, 0);
+    if (use_mutex) {
+        rtos_mutex_unlock(&queue_p->mutex);
+    } else {
+        restore_cpu_interrupts(int_mask);
+    }
+
+    /*
+     * The chain is no longer visible to other threads, so untag its packets
+     * after releasing the queue's lock:
+     */
+    for (struct network_packet *packet_p = head_packet_p;
+         packet_p != NULL;
+         packet_p = packet_p->next_p) {
+        D_ASSERT(packet_p->signature == NET_RX_PACKET_SIGNATURE ||
+                 packet_p->signature == NET_TX_PACKET_SIGNATURE);
+        D_ASSERT(packet_p->queue_p == queue_p);
+        packet_p->queue_p = NULL;
+    }
+
+    return head_packet_p;
+}
+
+
+/**
+ * Initializes a network packet free list as empty
+ *
+ * @param name_p        Name for the free list
+ * @param free_list_p   Pointer to the free list to be initialized
+ */
+void net_packet_free_list_init(const char *name_p,
+                               struct net_packet_free_list *free_list_p)
+{
+    free_list_p->signature = NET_PACKET_FREE_LIST_SIGNATURE;
+    free_list_p->name_p = name_p;
+    free_list_p->length = 0;
+    atomic_stack_init(&free_list_p->stack, offsetof(struct network_packet, next_p));
+    rtos_semaphore_init(&free_list_p->semaphore, name_p, 0);
+}
+
+
+/**
+ * Adds a packet to a network packet free list. It can be called from ISRs.
+ *
+ * @param free_list_p   Pointer to the free list
+ * @param packet_p      Pointer to the packet to be added
+ */
+void net_packet_free_list_add(struct net_packet_free_list *free_list_p,
+                              struct network_packet *packet_p)
+{
+    D_ASSERT(free_list_p->signature == NET_PACKET_FREE_LIST_SIGNATURE);
+    D_ASSERT(packet_p->signature == NET_RX_PACKET_SIGNATURE ||
+             packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(NET_PACKET_NOT_IN_QUEUE(packet_p));
+
+    atomic_stack_push(&free_list_p->stack, packet_p);
+    ATOMIC_POST_INCREMENT_UINT16(&free_list_p->length);
+    TRACE_RECORD(TRACE_EVENT_PACKET_QUEUE_ADD, free_list_p, free_list_p->length);
+    rtos_semaphore_signal(&free_list_p->semaphore);
+}
+
+
+/**
+ * Pops a packet from a network packet free list, after a unit of its
+ * semaphore has been acquired. The semaphore is signaled only after a packet
+ * is pushed, so there is always a packet for every unit acquired.
+ */
+static struct network_packet *net_packet_free_list_pop(struct net_packet_free_list *free_list_p)
+{
+    struct network_packet *packet_p = atomic_stack_pop(&free_list_p->stack);
+
+    D_ASSERT(packet_p != NULL);
+    D_ASSERT(packet_p->signature == NET_RX_PACKET_SIGNATURE ||
+             packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(NET_PACKET_NOT_IN_QUEUE(packet_p));
+
+    ATOMIC_POST_DECREMENT_UINT16(&free_list_p->length);
+    TRACE_RECORD(TRACE_EVENT_PACKET_QUEUE_REMOVE, free_list_p, free_list_p->length);
+    return packet_p;
+}
+
+
+/**
+ * Removes a packet from a network packet free list, if the free list is not
+ * empty. Otherwise, it waits until a packet is added to the free list.
+ * If timeout_ms is not 0, The wait will timeout at the specified
+ * milliseconds value.
+ *
+ * @param free_list_p   Pointer to the free list
+ * @param timeout_ms    0, or timeout (in milliseconds) for waiting for the
+ *                      free list to become non-empty
+ *
+ * @return pointer to packet removed from the free list, or NULL if timeout
+ */
+struct network_packet *net_packet_free_list_remove(struct net_packet_free_list *free_list_p,
+                                                   uint32_t timeout_ms)
+{
+    D_ASSERT(free_list_p->signature == NET_PACKET_FREE_LIST_SIGNATURE);
+    if (timeout_ms != 0) {
+        if (!rtos_semaphore_wait_timeout(&free_list_p->semaphore, timeout_ms)) {
+            return NULL;
+        }
+    } else {
+        rtos_semaphore_wait(&free_list_p->semaphore);
+    }
+
+    return net_packet_free_list_pop(free_list_p);
+}
+
+
+/**
+ * Removes a packet from a network packet free list, if the free list is not
+ * empty, without waiting.
+ *
+ * @param free_list_p   Pointer to the free list
+ *
+ * @return pointer to packet removed from the free list, or NULL if the free
+ *         list was empty
+ */
+struct network_packet *net_packet_free_list_try_remove(struct net_packet_free_list *free_list_p)
+{
+    D_ASSERT(free_list_p->signature == NET_PACKET_FREE_LIST_SIGNATURE);
+    if (!rtos_semaphore_try_wait(&free_list_p->semaphore)) {
+        return NULL;
+    }
+
+    return net_packet_free_list_pop(free_list_p);
+}
+
+
+/**
+ * Records the calling task as the current owner of a packet, and the time at
+ * which it took ownership. Called when a packet is handed to the application,
+ * and each time a packet is passed on to another task, for leak diagnostics.
+ *
+ * @param packet_p      Pointer to Rx or Tx packet
+ */
+void net_packet_set_owner(struct network_packet *packet_p)
+{
+    D_ASSERT(packet_p->signature == NET_TX_PACKET_SIGNATURE ||
+             packet_p->signature == NET_RX_PACKET_SIGNATURE);
+
+    packet_p->owner_task_p = rtos_task_self();
+    packet_p->owner_acquire_ticks = rtos_get_ticks_since_boot();
+}
+
+
+/**
+ * Tells for how long a packet has been held by its current owner
+ *
+ * @param packet_p      Pointer to Rx or Tx packet
+ *
+ * @return time in milliseconds since net_packet_set_owner() was last called
+ *         for the packet
+ */
+uint32_t net_packet_get_hold_time_ms(const struct network_packet *packet_p)
+{
+    D_ASSERT(packet_p->signature == NET_TX_PACKET_SIGNATURE ||
+             packet_p->signature == NET_RX_PACKET_SIGNATURE);
+
+    return RTOS_TICKS_TO_MILLISECONDS(
+                RTOS_TICKS_DELTA(packet_p->owner_acquire_ticks,
+                                 rtos_get_ticks_since_boot()));
+}
+
+
+/**
+ * Requests the Ethernet MAC to take a hardware timestamp when the given Tx
+ * packet is transmitted. The timestamp can be obtained by calling
+ * net_packet_get_timestamp(), after the packet has been transmitted (that is,
+ * once NET_PACKET_IN_TX_TRANSIT is cleared). So, this is only useful for Tx
+ * packets that are not freed after transmission.
+ *
+ * @param tx_packet_p   Pointer to Tx packet
+ */
+void net_packet_request_tx_timestamp(struct network_packet *tx_packet_p)
+{
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
+
+    tx_packet_p->timestamp_flags = NET_PACKET_TX_TIMESTAMP_REQUESTED;
+}
+
+
+/**
+ * Obtains the IEEE 1588 hardware timestamp taken by the Ethernet MAC when
+ * the given packet was received or transmitted.
+ *
+ * @param packet_p      Pointer to Rx or Tx packet
+ * @param timestamp_p   Area where the timestamp (in nanoseconds) is to be
+ *                      returned
+ *
+ * @return true, if the packet has a valid timestamp
+ * @return false, otherwise
+ */
+bool net_packet_get_timestamp(const struct network_packet *packet_p,
+                              uint32_t *timestamp_p)
+{
+    D_ASSERT(packet_p->signature == NET_TX_PACKET_SIGNATURE ||
+             packet_p->signature == NET_RX_PACKET_SIGNATURE);
+
+    if (!(packet_p->timestamp_flags & NET_PACKET_TIMESTAMP_VALID)) {
+        return false;
+    }
+
+    *timestamp_p = packet_p->timestamp;
+    return true;
+}
+
+
+/**
+ * Copies data out of a received frame, which may span several Rx packets
+ * (see next_fragment_p)
+ *
+ * @param rx_packet_p   Pointer to first Rx packet of the frame
+ * @param offset        Offset in bytes from the beginning of the frame
+ *                      (beginning of the first packet's data buffer)
+ * @param dest_p        Area where the data is to be copied
+ * @param length        Number of bytes to copy
+ *
+ * @return number of bytes copied (less than 'length' if the frame ends
+ *         before)
+ */
+size_t net_packet_copy_rx_frame_data(const struct network_packet *rx_packet_p,
+                                     size_t offset,
+                                     void *dest_p,
+                                     size_t length)
+{
+    uint8_t *dest_cursor_p = dest_p;
+    size_t bytes_copied = 0;
+    const struct network_packet *fragment_p = rx_packet_p;
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+
+    while (fragment_p != NULL && bytes_copied < length) {
+        size_t fragment_length;
+
+        if (fragment_p == rx_packet_p) {
+            fragment_length = (rx_packet_p->next_fragment_p == NULL) ?
+                rx_packet_p->total_length : rx_packet_p->data_buffer_size;
+        } else {
+            fragment_length = fragment_p->total_length;
+        }
+
+        if (offset >= fragment_length) {
+            offset -= fragment_length;
+        } else {
+            size_t chunk_length = fragment_length - offset;
+
+            if (chunk_length > length - bytes_copied) {
+                chunk_length = length - bytes_copied;
+            }
+
+            memcpy(dest_cursor_p, fragment_p->data_buffer + offset, chunk_length);
+            dest_cursor_p += chunk_length;
+            bytes_copied += chunk_length;
+            offset = 0;
+        }
+
+        fragment_p = fragment_p->next_fragment_p;
+    }
+
+    return bytes_copied;
+}
+
+
+/**
+ * Initializes a single-producer/single-consumer network packet queue
+ *
+ * @param name_p     Name for the queue
+ * @param queue_p    Pointer to the queue to be initialized
+ */
+void net_packet_spsc_queue_init(const char *name_p,
+                                struct net_packet_spsc_queue *queue_p)
+{
+    queue_p->signature = NET_PACKET_SPSC_QUEUE_SIGNATURE;
+    queue_p->name_p = name_p;
+    queue_p->write_index = 0;
+    queue_p->read_index = 0;
+    queue_p->length_high_water_mark = 0;
+    for (unsigned int i = 0; i < ARRAY_SIZE(queue_p->entries); i ++) {
+        queue_p->entries[i] = NULL;
+    }
+
+    rtos_signal_init(&queue_p->signal, NULL);
+}
+
+
+/**
+ * Adds a chain of packets at the end of a single-producer/single-consumer
+ * network packet queue, signaling the queue's consumer only once for the
+ * whole chain. It must only be called by the queue's producer.
+ *
+ * NOTE: The queue must have room for the whole chain. The caller guarantees
+ * this by bounding the number of packets that can be in the queue.
+ *
+ * @param queue_p        Pointer to the queue
+ * @param head_packet_p  Pointer to the first packet of the chain
+ * @param num_packets    Number of packets in the chain (linked through
+ *                       their 'next_p' fields)
+ */
+void net_packet_spsc_queue_add_chain(struct net_packet_spsc_queue *queue_p,
+                                     struct network_packet *head_packet_p,
+                                     uint16_t num_packets)
+{
+    D_ASSERT(queue_p->signature == NET_PACKET_SPSC_QUEUE_SIGNATURE);
+    D_ASSERT(num_packets != 0);
+
+    uint16_t write_index = queue_p->write_index;
+    uint16_t length = (uint16_t)(write_index - queue_p->read_index);
+
+    D_ASSERT(length + num_packets <= NET_PACKET_SPSC_QUEUE_NUM_ENTRIES);
+
+    struct network_packet *packet_p = head_packet_p;
+    for (uint_fast16_t i = 0; i < num_packets; i ++) {
+        D_ASSERT(packet_p != NULL);
+        D_ASSERT(packet_p->signature == NET_RX_PACKET_SIGNATURE ||
+                 packet_p->signature == NET_TX_PACKET_SIGNATURE);
+        D_ASSERT(packet_p->queue_p == NULL);
+
+        struct network_packet *next_packet_p = packet_p->next_p;
+
+        packet_p->next_p = NULL;
+        queue_p->entries[write_index % NET_PACKET_SPSC_QUEUE_NUM_ENTRIES] =
+            packet_p;
+        write_index ++;
+        packet_p = next_packet_p;
+    }
+
+    D_ASSERT(packet_p == NULL);
+
+    /*
+     * Make the ring entries visible before publishing the new write index:
+     */
+    __DMB();
+    queue_p->write_index = write_index;
+
+    length += num_packets;
+    if (length > queue_p->length_high_water_mark) {
+        queue_p->length_high_water_mark = length;
+    }
+
+    rtos_signal_signal(&queue_p->signal);
+}
+
+
+/**
+ * Waits until a single-producer/single-consumer network packet queue becomes
+ * non-empty. It must only be called by the queue's consumer.
+ *
+ * @param queue_p       Pointer to the queue
+ * @param timeout_ms    0, or timeout (in milliseconds) for waiting for the
+ *                      queue to become non-empty
+ *
+ * @return number of packets in the queue, or 0 if timeout
+ */
+static uint16_t net_packet_spsc_queue_wait(struct net_packet_spsc_queue *queue_p,
+                                           uint32_t timeout_ms)
+{
+    uint16_t length;
+
+    D_ASSERT(queue_p->signature == NET_PACKET_SPSC_QUEUE_SIGNATURE);
+    for ( ; ; ) {
+        length = (uint16_t)(queue_p->write_index - queue_p->read_index);
+        if (length != 0) {
+            break;
+        }
+
+        /*
+         * The signal may have been sent for packets that were already
+         * removed by an earlier call, so the ring indices are checked again
+         * after waking up:
+         */
+        if (timeout_ms != 0) {
+            bool signaled = rtos_signal_wait_timeout(&queue_p->signal,
+                                                     timeout_ms);
+            if (!signaled) {
+                return 0;
+            }
+        } else {
+            rtos_signal_wait(&queue_p->signal);
+        }
+    }
+
+    D_ASSERT(length <= NET_PACKET_SPSC_QUEUE_NUM_ENTRIES);
+
+    /*
+     * Do not read ring entries before reading the write index:
+     */
+    __DMB();
+    return length;
+}
+
+
+/**
+ * Removes the packet from the head of a single-producer/single-consumer
+ * network packet queue, if the queue is not empty. Otherwise, it waits until
+ * the queue becomes non-empty. If timeout_ms is not 0, The wait will timeout at
+ * the specified milliseconds value. It must only be called by the queue's
+ * consumer.
+ *
+ * @param queue_p       Pointer to the queue
+ * @param timeout_ms    0, or timeout (in milliseconds) for waiting for the
+ *                      queue to become non-empty
+ *
+ * @return pointer to packet removed from the queue, or NULL if timeout
+ */
+struct network_packet *net_packet_spsc_queue_remove(struct net_packet_spsc_queue *queue_p,
+                                                    uint32_t timeout_ms)
+{
+    uint16_t length = net_packet_spsc_queue_wait(queue_p, timeout_ms);
+
+    if (length == 0) {
+        return NULL;
+    }
+
+    uint16_t read_index = queue_p->read_index;
+    struct network_packet *packet_p =
+        queue_p->entries[read_index % NET_PACKET_SPSC_QUEUE_NUM_ENTRIES];
+
+    D_ASSERT(packet_p->signature == NET_RX_PACKET_SIGNATURE ||
+             packet_p->signature == NET_TX_PACKET_SIGNATURE);
+
+    /*
+     * Finish reading the ring entry before releasing it to the producer:
+     */
+    __DMB();
+    queue_p->read_index = read_index + 1;
+
+    D_ASSERT(NET_PACKET_NOT_IN_QUEUE(packet_p));
+    return packet_p;
+}
+
+
+/**
+ * Removes all the packets from a single-producer/single-consumer network
+ * packet queue, if the queue is not empty. Otherwise, it waits until the queue
+ * becomes non-empty. If timeout_ms is not 0, The wait will timeout at the
+ * specified milliseconds value. It must only be called by the queue's
+ * consumer.
+ *
+ * @param queue_p        Pointer to the queue
+ * @param timeout_ms     0, or timeout (in milliseconds) for waiting for the
+ *                       queue to become non-empty
+ * @param num_packets_p  Area where the number of packets removed is to be
+ *                       returned
+ *
+ * @return pointer to the first packet of the chain of packets removed from
+ *         the queue (linked through their 'next_p' fields), or NULL if timeout
+ */
+struct network_packet *net_packet_spsc_queue_remove_all(struct net_packet_spsc_queue *queue_p,
+                                                        uint32_t timeout_ms,
+                                                        uint16_t *num_packets_p)
+{
+    uint16_t length = net_packet_spsc_queue_wait(queue_p, timeout_ms);
+
+    *num_packets_p = length;
+    if (length == 0) {
+        return NULL;
+    }
+
+    uint16_t read_index = queue_p->read_index;
+    struct network_packet *head_packet_p =
+        queue_p->entries[read_index % NET_PACKET_SPSC_QUEUE_NUM_ENTRIES];
+    struct network_packet *tail_packet_p = head_packet_p;
+
+    read_index ++;
+    for (uint_fast16_t i = 1; i < length; i ++) {
+        struct network_packet *packet_p =
+            queue_p->entries[read_index % NET_PACKET_SPSC_QUEUE_NUM_ENTRIES];
+
+        D_ASSERT(packet_p->signature == head_packet_p->signature);
+        tail_packet_p->next_p = packet_p;
+        tail_packet_p = packet_p;
+        read_index ++;
+    }
+
+    D_ASSERT(tail_packet_p->next_p == NULL);
+
+    /*
+     * Finish reading the ring entries before releasing them to the producer:
+     */
+    __DMB();
+    queue_p->read_index = read_index;
     return head_packet_p;
 }
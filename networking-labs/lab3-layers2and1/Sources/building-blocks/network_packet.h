@@ -15,6 +15,10 @@
 #include "runtime_checks.h"
 #include "rtos_wrapper.h"
 #include "io_utils.h"
+#include "atomic_utils.h"
+#include "perf_probes.h"
+#include "net_config.h"
+#include "counter_set.h"
 
 /**
  * Maximum transfer unit for Ethernet (frame size without CRC)
@@ -27,6 +31,16 @@
  */
 #define ETHERNET_MAX_FRAME_SIZE        (ETHERNET_MAX_FRAME_DATA_SIZE + 18)
 
+/**
+ * Size in bytes of an IEEE 802.1Q VLAN tag
+ */
+#define ETHERNET_VLAN_TAG_SIZE          4
+
+/**
+ * Maximum Ethernet frame size (in bytes) including CRC and a VLAN tag
+ */
+#define ETHERNET_MAX_VLAN_FRAME_SIZE   (ETHERNET_MAX_FRAME_SIZE + ETHERNET_VLAN_TAG_SIZE)
+
 /**
  * Network packet data buffer alignment in bytes
  * (minimum 16-byte alignment required by the ENET device)
@@ -34,44 +48,131 @@
 #define NET_PACKET_DATA_BUFFER_ALIGNMENT    UINT32_C(16)
 
 /**
- * Network packet data buffer size rounded-up to the required alignment
+ * Network packet data buffer size rounded-up to the required alignment. It
+ * must fit a VLAN-tagged frame, plus the alignment padding that precedes the
+ * Ethernet header (see struct ethernet_header)
  */
 #define NET_PACKET_DATA_BUFFER_SIZE \
-    ROUND_UP(ETHERNET_MAX_FRAME_SIZE, NET_PACKET_DATA_BUFFER_ALIGNMENT)
+    ROUND_UP(ETHERNET_MAX_VLAN_FRAME_SIZE + sizeof(uint16_t),              \
+             NET_PACKET_DATA_BUFFER_ALIGNMENT)
+
+/**
+ * Size of the data buffer of small Tx packets. Small Tx packets are used for
+ * short frames, such as ARP and ICMP echo messages, so that full-size data
+ * buffers are only spent in frames that need them.
+ */
+#define NET_PACKET_SMALL_DATA_BUFFER_SIZE   UINT32_C(128)
+
+C_ASSERT(NET_PACKET_SMALL_DATA_BUFFER_SIZE % NET_PACKET_DATA_BUFFER_ALIGNMENT == 0);
+
+/**
+ * Headroom reserved at the beginning of the data buffer of Tx packets, so
+ * that a VLAN tag can be inserted in an outgoing frame without moving its
+ * payload. It is a multiple of 4 bytes, so that the IP header stays 32-bit
+ * aligned.
+ */
+#define NET_PACKET_TX_HEADROOM  ETHERNET_VLAN_TAG_SIZE
+
+C_ASSERT(NET_PACKET_TX_HEADROOM % sizeof(uint32_t) == 0);
+
+/**
+ * Maximum number of Tx packets with a full-size data buffer
+ */
+#define NET_MAX_LARGE_TX_PACKETS    NET_CONFIG_MAX_LARGE_TX_PACKETS
+
+/**
+ * Maximum number of Tx packets with a small data buffer
+ */
+#define NET_MAX_SMALL_TX_PACKETS    NET_CONFIG_MAX_SMALL_TX_PACKETS
 
 /**
  * Maximum number of Tx packet buffers
  */
-#define NET_MAX_TX_PACKETS   8
+#define NET_MAX_TX_PACKETS   (NET_MAX_LARGE_TX_PACKETS + NET_MAX_SMALL_TX_PACKETS)
 
 /**
- * Maximum number of Rx packet buffers per layer-2 end point
+ * Maximum number of Rx packet buffers that a layer-2 end point can hold at
+ * the same time (Rx packets posted to the Ethernet MAC's Rx ring, queued or
+ * handed to the application). They are taken from the Rx packet pool shared
+ * by all layer-2 end points.
  */
-#define NET_MAX_RX_PACKETS   8
+#define NET_MAX_RX_PACKETS   NET_CONFIG_MAX_RX_PACKETS
+
+/**
+ * Number of Rx packet buffers in the Rx packet pool shared by all layer-2
+ * end points
+ */
+#define NET_RX_PACKET_POOL_SIZE     NET_CONFIG_RX_PACKET_POOL_SIZE
+
+C_ASSERT(NET_MAX_RX_PACKETS <= NET_RX_PACKET_POOL_SIZE);
+
+/**
+ * Maximum number of Rx copybreak packets per layer-2 end point. Small
+ * received frames are copied to a copybreak packet, so that their full-size
+ * Rx buffer can be reposted to the Ethernet MAC right away (see
+ * NET_LAYER2_RX_COPYBREAK_THRESHOLD).
+ */
+#define NET_MAX_RX_COPYBREAK_PACKETS    NET_CONFIG_MAX_RX_COPYBREAK_PACKETS
+
+/**
+ * Maximum number of Rx packet clones per layer-2 end point. A clone is a
+ * network packet object without a data buffer of its own, that shares the
+ * data buffer of an Rx packet (see net_layer2_clone_rx_packet()).
+ */
+#define NET_MAX_RX_PACKET_CLONES    NET_CONFIG_MAX_RX_PACKET_CLONES
+
+/**
+ * Packet counters of a networking layer, kept in a counter set, so that
+ * the Rx/Tx fast paths increment them without atomic operations
+ */
+enum net_packet_counters {
+    NET_PACKET_COUNTER_RX_ACCEPTED = 0,
+    NET_PACKET_COUNTER_RX_DROPPED,
+    NET_PACKET_COUNTER_SENT,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_NET_PACKET_COUNTERS
+};
+
+DECLARE_COUNTER_SET(net_packet_counter_set, NUM_NET_PACKET_COUNTERS);
 
 /**
  * Convert a 16-bit value from host byte order to network byte order
  * (Do byte swap since Cortex-M is little endian)
+ *
+ * NOTE: For a constant argument, the byte swap is done at compile time, as
+ * byte_swap16() is inline assembly, which the compiler cannot fold.
  */
-#define hton16(_x)  byte_swap16(_x)
+#define hton16(_x) \
+        (__builtin_constant_p(_x) ? BYTE_SWAP16_CONST(_x) : byte_swap16(_x))
 
 /**
  * Convert a 16-bit value from network byte order to host byte order
  * (Do byte swap since Cortex-M is little endian)
  */
-#define ntoh16(_x)  byte_swap16(_x)
+#define ntoh16(_x)  hton16(_x)
 
 /**
  * Convert a 32-bit value from host byte order to network byte order
  * (Do byte swap since Cortex-M is little endian)
  */
-#define hton32(_x)  byte_swap32(_x)
+#define hton32(_x) \
+        (__builtin_constant_p(_x) ? BYTE_SWAP32_CONST(_x) : byte_swap32(_x))
 
 /**
  * Convert a 32-bit value from network byte order to host byte order
  * (Do byte swap since Cortex-M is little endian)
  */
-#define ntoh32(_x)  byte_swap32(_x)
+#define ntoh32(_x)  hton32(_x)
+
+/**
+ * Versions of hton16()/hton32() for contexts that require an integer
+ * constant expression, such as static initializers and case labels
+ */
+#define HTON16_CONST(_x)    BYTE_SWAP16_CONST(_x)
+#define HTON32_CONST(_x)    BYTE_SWAP32_CONST(_x)
 
 /**
  * Copies a MAC address. The source and destination must be at least
@@ -99,7 +200,27 @@
 		((_net_packet_p)->queue_p == NULL && (_net_packet_p)->next_p == NULL)
 
 /**
- * Network packet object
+ * Atomically set a state flag of a network packet. It is a single store to
+ * the flag's bit-band alias, if the packet is in the bit-band SRAM region,
+ * so that hot state transitions need neither a lock nor an LDREX/STREX loop.
+ */
+#define NET_PACKET_SET_STATE_FLAG(_net_packet_p, _flag) \
+        atomic_set_flag_uint16(&(_net_packet_p)->state_flags, _flag)
+
+/**
+ * Atomically clear a state flag of a network packet
+ */
+#define NET_PACKET_CLEAR_STATE_FLAG(_net_packet_p, _flag) \
+        atomic_clear_flag_uint16(&(_net_packet_p)->state_flags, _flag)
+
+/**
+ * Network packet object (packet metadata).
+ *
+ * The fields touched on every queue operation and state transition come
+ * first, so that they share the first 16 bytes of the object. Packet data
+ * buffers are not part of this object. They are kept in separate arrays,
+ * which are the only memory accessed by the Ethernet MAC's DMA engine, so
+ * that arrays of network packet objects stay compact.
  */
 struct network_packet {
 	/*
@@ -109,20 +230,6 @@ struct network_packet {
 #   define NET_RX_PACKET_SIGNATURE  GEN_SIGNATURE('R', 'X', 'B', 'U')
     uint32_t signature;
 
-    /**
-     * Ethernet MAC buffer descriptor associated with the packet
-     */
-    union {
-        volatile struct ethernet_tx_buffer_descriptor *tx_buf_desc_p;
-        volatile struct ethernet_rx_buffer_descriptor *rx_buf_desc_p;
-    };
-
-    /**
-     * Pointer to the local layer-2 end point that owns this network packet
-     * object. Only meaningful for Rx packets.
-     */
-    struct net_layer2_end_point *layer2_end_point_p;
-
     uint16_t state_flags;
 #   define NET_PACKET_IN_TX_TRANSIT             BIT(0)
 #   define NET_PACKET_IN_RX_TRANSIT             BIT(1)
@@ -134,6 +241,9 @@ struct network_packet {
 #   define NET_PACKET_IN_TX_POOL                BIT(7)
 #   define NET_PACKET_IN_ICMP_QUEUE             BIT(8)
 #   define NET_PACKET_IN_ICMPV6_QUEUE           BIT(9)
+#   define NET_PACKET_IN_RX_SPARE_POOL          BIT(10)
+#   define NET_PACKET_IN_NDP_QUEUE              BIT(11)
+#   define NET_PACKET_TX_INTERRUPT_REQUESTED    BIT(12)
 
     /**
      * Total packet length, including L2 L3 and L4 headers
@@ -154,23 +264,350 @@ struct network_packet {
     struct network_packet *next_p;
 
     /*
-     * Packet payload data buffer
+     * Pointer to the start of the frame in the packet payload data buffer.
+     * The data buffer itself starts headroom bytes before it and it is
+     * aligned to NET_PACKET_DATA_BUFFER_ALIGNMENT. Data buffers live in
+     * separate arrays owned by the packet pools, so that packets of different
+     * buffer sizes share the same network packet object layout.
+     */
+    uint8_t *data_buffer;
+
+    /**
+     * Size in bytes of the whole data buffer, including the headroom
+     * (NET_PACKET_DATA_BUFFER_SIZE or NET_PACKET_SMALL_DATA_BUFFER_SIZE)
+     */
+    uint16_t data_buffer_size;
+
+    /**
+     * Number of free bytes of the data buffer in front of the frame, where
+     * headers can be prepended with net_packet_push_header() without moving
+     * the frame. It is reset to 0 when the packet returns to its pool.
+     */
+    uint8_t headroom;
+
+    /**
+     * Rx checksum status flags, carried from the Ethernet MAC's Rx buffer
+     * descriptor. Only meaningful for Rx packets.
+     */
+    uint8_t rx_checksum_flags;
+#   define NET_PACKET_RX_CHECKSUMS_VALIDATED        BIT(0)
+#   define NET_PACKET_RX_IP_HEADER_CHECKSUM_OK      BIT(1)
+#   define NET_PACKET_RX_PROTOCOL_CHECKSUM_OK       BIT(2)
+#   define NET_PACKET_RX_IPv6_FRAME                 BIT(3)
+#   define NET_PACKET_RX_IPv4_FRAGMENT              BIT(4)
+#   define NET_PACKET_RX_VLAN_FRAME                 BIT(5)
+#   define NET_PACKET_RX_HEADERS_PARSED             BIT(6)
+
+    /**
+     * IP protocol type of the received frame, as parsed by the Ethernet
+     * MAC. Only meaningful for Rx packets, if NET_PACKET_RX_HEADERS_PARSED
+     * is set in rx_checksum_flags.
+     */
+    uint8_t rx_protocol_type;
+
+    /**
+     * Length in 32-bit words of the IP header plus the header of the
+     * protocol that follows it, if the MAC knows that protocol, as parsed
+     * by the Ethernet MAC. Only meaningful for Rx packets, if
+     * NET_PACKET_RX_HEADERS_PARSED is set in rx_checksum_flags.
+     */
+    uint8_t rx_header_length;
+
+    /**
+     * IEEE 802.1Q priority code point (PCP) of the packet:
+     * - For Rx packets, PCP of the VLAN tag of the received frame (the tag is
+     *   stripped by layer 2), or 0 if the frame was not tagged.
+     * - For Tx packets, PCP to use in the VLAN tag of the outgoing frame, if
+     *   the layer-2 end point is in a VLAN. If NET_PACKET_VLAN_PCP_DEFAULT,
+     *   the end point's default Tx PCP is used.
+     */
+    uint8_t vlan_pcp;
+#   define NET_PACKET_VLAN_PCP_DEFAULT  UINT8_C(0xff)
+
+    /**
+     * Ethernet MAC buffer descriptor associated with the packet
+     */
+    union {
+        volatile struct ethernet_tx_buffer_descriptor *tx_buf_desc_p;
+        volatile struct ethernet_rx_buffer_descriptor *rx_buf_desc_p;
+    };
+
+    /**
+     * Pointer to the local layer-2 end point that owns this network packet
+     * object. Only meaningful for Rx packets.
+     */
+    struct net_layer2_end_point *layer2_end_point_p;
+
+    /**
+     * Next fragment of a received frame that did not fit in one Rx data
+     * buffer (NULL if none). Only meaningful for Rx packets. The first
+     * fragment's total_length is the length of the whole frame, and its
+     * data buffer is full. For the other fragments, total_length is the
+     * number of bytes of the frame held in that fragment's data buffer.
+     * Fragments are recycled together with the first fragment.
+     */
+    struct network_packet *next_fragment_p;
+
+    /**
+     * IPv4 reassembly buffer lent to this packet, or NULL if none. Only
+     * meaningful for Rx packets. If not NULL, data_buffer points to the
+     * reassembly buffer's data instead of to the packet's own data buffer,
+     * until the packet is recycled.
      */
-    uint8_t data_buffer[NET_PACKET_DATA_BUFFER_SIZE]
-        __attribute__ ((aligned(NET_PACKET_DATA_BUFFER_ALIGNMENT)));
-}  __attribute__ ((aligned(MPU_REGION_ALIGNMENT)));
+    struct net_ipv4_reassembly_buffer *ipv4_reassembly_buffer_p;
 
-C_ASSERT(sizeof(struct network_packet) % MPU_REGION_ALIGNMENT == 0);
+    /**
+     * Number of references to the packet's data buffer: one for the packet
+     * itself plus one for each of its outstanding clones. Only meaningful
+     * for Rx packets. The packet is only recycled when its last reference
+     * is dropped.
+     */
+    volatile uint8_t ref_count;
+
+    /**
+     * Rx packet whose data buffer this packet shares, if this packet is a
+     * clone, or NULL otherwise
+     */
+    struct network_packet *clone_of_p;
+
+    /**
+     * IEEE 1588 timestamp status flags
+     */
+    uint8_t timestamp_flags;
+#   define NET_PACKET_TIMESTAMP_VALID               BIT(0)
+#   define NET_PACKET_TX_TIMESTAMP_REQUESTED        BIT(1)
+#   define NET_PACKET_RX_LATENCY_TRACKED            BIT(2)
+
+    /**
+     * IEEE 1588 hardware timestamp (in nanoseconds, as a value of the
+     * Ethernet MAC's IEEE 1588 timer) taken by the Ethernet MAC when the
+     * frame was received or transmitted. Only meaningful if
+     * NET_PACKET_TIMESTAMP_VALID is set in timestamp_flags.
+     */
+    uint32_t timestamp;
+
+    /**
+     * Value of the Ethernet MAC's IEEE 1588 timer at which the frame is to
+     * be transmitted. Only meaningful for Tx packets sent with
+     * ethernet_mac_start_xmit_at(), while they wait in the MAC's Tx launch
+     * queue.
+     */
+    uint32_t tx_launch_time;
+
+    /**
+     * DWT cycle count when the frame was removed from the Ethernet MAC's
+     * Rx ring. Only meaningful for Rx packets, if
+     * NET_PACKET_RX_LATENCY_TRACKED is set in timestamp_flags.
+     */
+    uint32_t rx_latency_begin_cycles;
+
+    /**
+     * DWT cycle count when the packet entered its current Rx latency stage
+     * (see NET_RX_PACKET_LATENCY_STAGE())
+     */
+    uint32_t rx_latency_stage_cycles;
+
+    /**
+     * Task that took ownership of the packet last, when the packet was
+     * handed to the application (NET_PACKET_IN_TX_USE_BY_APP or
+     * NET_PACKET_IN_RX_USE_BY_APP set), or NULL if it was taken from an ISR.
+     * Used for leak diagnostics only.
+     */
+    struct rtos_task *owner_task_p;
+
+    /**
+     * Value of rtos_get_ticks_since_boot() when owner_task_p was set
+     */
+    uint32_t owner_acquire_ticks;
+
+    /**
+     * Tx packet reservation to which this packet belongs, or NULL if it
+     * belongs to the shared part of the Tx packet pool. Only meaningful for
+     * Tx packets.
+     */
+    struct net_tx_packet_reservation *tx_reservation_p;
+};
+
+C_ASSERT(offsetof(struct network_packet, next_p) < 16);
 C_ASSERT(sizeof(bool) == sizeof(uint8_t));
-C_ASSERT(offsetof(struct network_packet, data_buffer) %
-		 NET_PACKET_DATA_BUFFER_ALIGNMENT == 0);
 
 /**
- * Get the network packet for a given data buffer
+ * Tells if the Ethernet MAC parsed the IP headers of a received packet, so
+ * that rx_protocol_type and rx_header_length can be used instead of reading
+ * the headers from the packet's data buffer
+ */
+#define NET_RX_PACKET_HEADERS_PARSED(_rx_packet_p) \
+        (((_rx_packet_p)->rx_checksum_flags & NET_PACKET_RX_HEADERS_PARSED) != 0)
+
+/**
+ * Tells if the Ethernet MAC parsed a received packet as an IPv4 packet
  */
-#define BUFFER_TO_NETWORK_PACKET(_data_buf) \
-    ((struct network_packet *) \
-     ((uintptr_t)(_data_buf) - offsetof(struct network_packet, data_buffer)))
+#define NET_RX_PACKET_PARSED_AS_IPv4(_rx_packet_p) \
+        (((_rx_packet_p)->rx_checksum_flags &                 \
+          (NET_PACKET_RX_HEADERS_PARSED | NET_PACKET_RX_IPv6_FRAME)) == \
+         NET_PACKET_RX_HEADERS_PARSED)
+
+/**
+ * Tells if the Ethernet MAC found a wrong IP header checksum in a
+ * received packet
+ */
+#define NET_RX_PACKET_IP_HEADER_CHECKSUM_BAD(_rx_packet_p) \
+        (((_rx_packet_p)->rx_checksum_flags &                 \
+          (NET_PACKET_RX_CHECKSUMS_VALIDATED |                  \
+           NET_PACKET_RX_IP_HEADER_CHECKSUM_OK)) ==             \
+         NET_PACKET_RX_CHECKSUMS_VALIDATED)
+
+/**
+ * Tells if the Ethernet MAC found a wrong layer-4 (or ICMP) checksum in a
+ * received packet. The MAC does not validate the protocol checksum of IPv4
+ * fragments.
+ */
+#define NET_RX_PACKET_PROTOCOL_CHECKSUM_BAD(_rx_packet_p) \
+        (((_rx_packet_p)->rx_checksum_flags &                 \
+          (NET_PACKET_RX_CHECKSUMS_VALIDATED |                  \
+           NET_PACKET_RX_PROTOCOL_CHECKSUM_OK |                 \
+           NET_PACKET_RX_IPv4_FRAGMENT)) ==                     \
+         NET_PACKET_RX_CHECKSUMS_VALIDATED)
+
+#if PERF_PROBES_ON
+
+/**
+ * Starts tracking the latency of a received packet through the networking
+ * stack. It must be invoked when the frame is removed from the Ethernet
+ * MAC's Rx ring.
+ */
+#define NET_RX_PACKET_LATENCY_BEGIN(_rx_packet_p) \
+        net_rx_packet_latency_begin(_rx_packet_p)
+
+/**
+ * Records the time a received packet spent in the Rx latency stage that is
+ * ending, in the given performance probe, and starts the next stage. It does
+ * nothing for packets whose latency is not tracked, such as Tx packets
+ * looped back to the receive path.
+ */
+#define NET_RX_PACKET_LATENCY_STAGE(_rx_packet_p, _probe) \
+        net_rx_packet_latency_stage(_rx_packet_p, _probe)
+
+/**
+ * Records the last Rx latency stage of a packet and its end-to-end latency,
+ * when the packet is handed to the application, and stops tracking it.
+ */
+#define NET_RX_PACKET_LATENCY_END(_rx_packet_p) \
+        net_rx_packet_latency_end(_rx_packet_p)
+
+static inline void net_rx_packet_latency_begin(struct network_packet *rx_packet_p)
+{
+    uint32_t cycles = perf_probe_get_cycles();
+
+    rx_packet_p->rx_latency_begin_cycles = cycles;
+    rx_packet_p->rx_latency_stage_cycles = cycles;
+    rx_packet_p->timestamp_flags |= NET_PACKET_RX_LATENCY_TRACKED;
+}
+
+
+static inline void net_rx_packet_latency_stage(struct network_packet *rx_packet_p,
+                                               enum perf_probes probe)
+{
+    if (rx_packet_p->timestamp_flags & NET_PACKET_RX_LATENCY_TRACKED) {
+        uint32_t cycles = perf_probe_get_cycles();
+
+        perf_probe_record_cycles(probe, cycles - rx_packet_p->rx_latency_stage_cycles);
+        rx_packet_p->rx_latency_stage_cycles = cycles;
+    }
+}
+
+
+static inline void net_rx_packet_latency_end(struct network_packet *rx_packet_p)
+{
+    if (rx_packet_p->timestamp_flags & NET_PACKET_RX_LATENCY_TRACKED) {
+        uint32_t cycles = perf_probe_get_cycles();
+
+        perf_probe_record_cycles(PERF_PROBE_RX_LATENCY_UDP_QUEUE_TO_APP,
+                                 cycles - rx_packet_p->rx_latency_stage_cycles);
+        perf_probe_record_cycles(PERF_PROBE_RX_LATENCY_MAC_TO_APP,
+                                 cycles - rx_packet_p->rx_latency_begin_cycles);
+        rx_packet_p->timestamp_flags &= ~NET_PACKET_RX_LATENCY_TRACKED;
+    }
+}
+
+#else
+
+#define NET_RX_PACKET_LATENCY_BEGIN(_rx_packet_p)           do { } while (0)
+
+#define NET_RX_PACKET_LATENCY_STAGE(_rx_packet_p, _probe)   do { } while (0)
+
+#define NET_RX_PACKET_LATENCY_END(_rx_packet_p)             do { } while (0)
+
+#endif /* PERF_PROBES_ON */
+
+/**
+ * Reserves headroom at the beginning of the data buffer of an empty packet,
+ * so that the frame is built after it
+ */
+static inline void net_packet_reserve_headroom(struct network_packet *packet_p,
+                                               uint8_t length)
+{
+    D_ASSERT(packet_p->headroom + length <= packet_p->data_buffer_size);
+    packet_p->data_buffer += length;
+    packet_p->headroom += length;
+}
+
+
+/**
+ * Returns the number of free bytes of the data buffer after the frame
+ */
+static inline size_t net_packet_get_tailroom(const struct network_packet *packet_p)
+{
+    D_ASSERT(packet_p->headroom + packet_p->total_length <=
+             packet_p->data_buffer_size);
+    return packet_p->data_buffer_size - packet_p->headroom -
+           packet_p->total_length;
+}
+
+
+/**
+ * Grows the frame of a packet at its start, taking the room from the
+ * packet's headroom
+ *
+ * @return pointer to the new start of the frame
+ */
+static inline uint8_t *net_packet_push_header(struct network_packet *packet_p,
+                                              uint8_t length)
+{
+    D_ASSERT(packet_p->headroom >= length);
+    packet_p->data_buffer -= length;
+    packet_p->headroom -= length;
+    packet_p->total_length += length;
+    return packet_p->data_buffer;
+}
+
+
+/**
+ * Shrinks the frame of a packet at its start, returning the room to the
+ * packet's headroom
+ *
+ * @return pointer to the new start of the frame
+ */
+static inline uint8_t *net_packet_pull_header(struct network_packet *packet_p,
+                                              uint8_t length)
+{
+    D_ASSERT(packet_p->total_length >= length);
+    packet_p->data_buffer += length;
+    packet_p->headroom += length;
+    packet_p->total_length -= length;
+    return packet_p->data_buffer;
+}
+
+
+/**
+ * Makes data_buffer point to the start of the data buffer again, before the
+ * packet's data buffer is given back to its pool or to the Ethernet MAC
+ */
+static inline void net_packet_reset_headroom(struct network_packet *packet_p)
+{
+    packet_p->data_buffer -= packet_p->headroom;
+    packet_p->headroom = 0;
+}
 
 /**
  * Network packet queue
@@ -217,7 +654,104 @@ struct net_packet_queue {
     struct rtos_mutex mutex;
 
     /**
-     * Counting semaphore to be signaled when a packet is added to the queue.
+     * Counting semaphore to be signaled when a packet, or a chain of packets,
+     * is added to the queue.
+     */
+    struct rtos_semaphore semaphore;
+};
+
+/**
+ * Number of entries of a single-producer/single-consumer network packet queue
+ * (must be a power of 2)
+ */
+#define NET_PACKET_SPSC_QUEUE_NUM_ENTRIES   NET_CONFIG_PACKET_SPSC_QUEUE_NUM_ENTRIES
+
+C_ASSERT(IS_POWER_OF_2(NET_PACKET_SPSC_QUEUE_NUM_ENTRIES));
+
+/**
+ * Lock-free single-producer/single-consumer network packet queue.
+ *
+ * The queue is a ring of packet pointers. Only the producer writes
+ * 'write_index' and only the consumer writes 'read_index', so neither side
+ * needs to disable interrupts or take a mutex. The producer can be an ISR
+ * and the consumer a thread, or vice versa, but there must never be more
+ * than one of each.
+ */
+struct net_packet_spsc_queue {
+#   define NET_PACKET_SPSC_QUEUE_SIGNATURE  GEN_SIGNATURE('N', 'P', 'S', 'Q')
+    uint32_t signature;
+
+    /**
+     * Queue name (null-terminated string)
+     */
+    const char *name_p;
+
+    /**
+     * Free-running count of packets added to the queue. Only written by the
+     * producer.
+     */
+    volatile uint16_t write_index;
+
+    /**
+     * Free-running count of packets removed from the queue. Only written by
+     * the consumer.
+     */
+    volatile uint16_t read_index;
+
+    /**
+     * largest length that the queue has ever had
+     */
+    uint16_t length_high_water_mark;
+
+    /**
+     * Ring of packet pointers
+     */
+    struct network_packet *entries[NET_PACKET_SPSC_QUEUE_NUM_ENTRIES];
+
+    /**
+     * Signal sent by the producer to wake up the consumer, when a packet,
+     * or a chain of packets, is added to the queue. Its count is only a
+     * hint, as the consumer always checks the ring indices. As there is only
+     * one consumer task, a single-waiter signal is used instead of a
+     * semaphore.
+     */
+    struct rtos_signal signal;
+};
+
+/**
+ * Lock-free free list of network packets.
+ *
+ * Free packets are kept in an atomic stack, linked through their 'next_p'
+ * fields, so adding and removing packets does not disable interrupts or take
+ * a mutex. Packets in a free list are not in a packet queue ('queue_p' stays
+ * NULL). The order in which free packets are handed out does not matter, so
+ * LIFO order is used, which also tends to reuse the packets most recently
+ * touched.
+ */
+struct net_packet_free_list {
+#   define NET_PACKET_FREE_LIST_SIGNATURE  GEN_SIGNATURE('N', 'P', 'F', 'L')
+    uint32_t signature;
+
+    /**
+     * Free list name (null-terminated string)
+     */
+    const char *name_p;
+
+    /**
+     * Number of packets in the free list. It may lag behind the contents
+     * of 'stack' for an instant, so it is only meant for heuristics and
+     * stats.
+     */
+    volatile uint16_t length;
+
+    /**
+     * Stack of free packets
+     */
+    struct atomic_stack stack;
+
+    /**
+     * Counting semaphore signaled once for every packet added to the free
+     * list, so that callers can wait for a free packet
      */
     struct rtos_semaphore semaphore;
 };
@@ -267,4 +801,54 @@ void net_packet_queue_add(struct net_packet_queue *queue_p,
 struct network_packet *net_packet_queue_remove(struct net_packet_queue *queue_p,
                                                uint32_t timeout_ms);
 
+struct network_packet *net_packet_queue_try_remove(struct net_packet_queue *queue_p);
+
+void net_packet_queue_add_chain(struct net_packet_queue *queue_p,
+                                struct network_packet *head_packet_p,
+                                struct network_packet *tail_packet_p,
+                                uint16_t num_packets);
+
+struct network_packet *net_packet_queue_remove_all(struct net_packet_queue *queue_p,
+                                                   uint32_t timeout_ms,
+                                                   uint16_t *num_packets_p);
+
+void net_packet_spsc_queue_init(const char *name_p,
+                                struct net_packet_spsc_queue *queue_p);
+
+void net_packet_spsc_queue_add_chain(struct net_packet_spsc_queue *queue_p,
+                                     struct network_packet *head_packet_p,
+                                     uint16_t num_packets);
+
+struct network_packet *net_packet_spsc_queue_remove(struct net_packet_spsc_queue *queue_p,
+                                                    uint32_t timeout_ms);
+
+struct network_packet *net_packet_spsc_queue_remove_all(struct net_packet_spsc_queue *queue_p,
+                                                        uint32_t timeout_ms,
+                                                        uint16_t *num_packets_p);
+
+void net_packet_free_list_init(const char *name_p,
+                               struct net_packet_free_list *free_list_p);
+
+void net_packet_free_list_add(struct net_packet_free_list *free_list_p,
+                              struct network_packet *packet_p);
+
+struct network_packet *net_packet_free_list_remove(struct net_packet_free_list *free_list_p,
+                                                   uint32_t timeout_ms);
+
+struct network_packet *net_packet_free_list_try_remove(struct net_packet_free_list *free_list_p);
+
+void net_packet_set_owner(struct network_packet *packet_p);
+
+uint32_t net_packet_get_hold_time_ms(const struct network_packet *packet_p);
+
+void net_packet_request_tx_timestamp(struct network_packet *tx_packet_p);
+
+bool net_packet_get_timestamp(const struct network_packet *packet_p,
+                              uint32_t *timestamp_p);
+
+size_t net_packet_copy_rx_frame_data(const struct network_packet *rx_packet_p,
+                                     size_t offset,
+                                     void *dest_p,
+                                     size_t length);
+
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORK_PACKET_H_ */
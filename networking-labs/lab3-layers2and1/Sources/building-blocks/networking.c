@@ -9,15 +9,84 @@
 #include "networking_layer2.h"
 #include "networking_layer3.h"
 #include "networking_layer4.h"
+#include "atomic_utils.h"
+#include "time_utils.h"
+#include "net_config.h"
+
+/*
+ * SRAM budget of the networking stack for the selected tuning profile. The
+ * layers' state variables include the stacks of the networking tasks, and
+ * the packet data buffers are the Rx/Tx pools sized by the profile.
+ */
+C_ASSERT(sizeof(struct net_layer2) + sizeof(struct net_packet_data_buffers) +
+         sizeof(struct net_layer3) + sizeof(struct net_layer4) +
+         sizeof(struct timer_wheel) <= NET_CONFIG_SRAM_BUDGET);
+
+/**
+ * Timer wheel shared by the timers of all networking layers
+ */
+struct timer_wheel g_net_timer_wheel;
 
 /**
  * Global initialization of the networking stack
  */
 void networking_init(void)
 {
+    timer_wheel_init(&g_net_timer_wheel, "Network timer wheel",
+                     NET_TIMER_WHEEL_TICK_MS);
+    timer_wheel_start(&g_net_timer_wheel,
+                      RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 2));
     net_layer2_init();
     net_layer3_init();
     net_layer4_init();
     net_layer2_start();
     net_layer3_start_tasks();
 }
+
+
+/**
+ * Copies the packet counters of a networking layer from its counter set
+ */
+static void copy_packet_counts(const struct net_packet_counter_set *counter_set_p,
+                               struct net_layer_packet_counts *counts_p)
+{
+    uint32_t counts[NUM_NET_PACKET_COUNTERS];
+
+    COUNTER_SET_READ_ALL(*counter_set_p, counts);
+    counts_p->rx_packets_accepted_count = counts[NET_PACKET_COUNTER_RX_ACCEPTED];
+    counts_p->rx_packets_dropped_count = counts[NET_PACKET_COUNTER_RX_DROPPED];
+    counts_p->sent_packets_count = counts[NET_PACKET_COUNTER_SENT];
+}
+
+
+/**
+ * Takes a snapshot of the statistics of all networking layers. The packet
+ * counters are copied with interrupts disabled, so that one snapshot never
+ * mixes counts from before and after a packet went through the stack.
+ * Adding up the shards of the counter sets takes a few hundred cycles,
+ * which is paid only here, rather than in the Rx/Tx fast paths. Link state
+ * and local address are read afterwards, as they change rarely and are
+ * protected by their own locks.
+ *
+ * @param snapshot_p    area where the snapshot is returned
+ */
+void networking_get_stats_snapshot(struct net_stats_snapshot *snapshot_p)
+{
+    uint32_t udp_counts[NUM_NET_UDP_COUNTERS];
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    snapshot_p->timestamp_cycles = get_monotonic_cycles();
+    copy_packet_counts(&g_net_layer2.packet_counters, &snapshot_p->layer2);
+    copy_packet_counts(&g_net_layer3.ipv4.packet_counters, &snapshot_p->ipv4);
+    COUNTER_SET_READ_ALL(g_net_layer4.udp.counters, udp_counts);
+    restore_cpu_interrupts(old_primask);
+
+    snapshot_p->udp.rx_packets_accepted_count = udp_counts[NET_UDP_COUNTER_RX_ACCEPTED];
+    snapshot_p->udp.rx_packets_dropped_count = udp_counts[NET_UDP_COUNTER_RX_DROPPED];
+    snapshot_p->udp.sent_packets_count = udp_counts[NET_UDP_COUNTER_SENT_OVER_IPV4];
+
+    snapshot_p->link_is_up =
+        net_layer2_end_point_link_is_up(&g_net_layer2.local_layer2_end_points[0]);
+    net_layer3_get_local_ipv4_address(&snapshot_p->local_ipv4_addr,
+                                      &snapshot_p->subnet_mask);
+}
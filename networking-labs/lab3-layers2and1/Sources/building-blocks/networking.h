@@ -8,6 +8,51 @@
 #ifndef SOURCES_BUILDING_BLOCKS_NETWORKING_H_
 #define SOURCES_BUILDING_BLOCKS_NETWORKING_H_
 
+#include "timer_wheel.h"
+#include "networking_layer3.h"
+
+/**
+ * Resolution in milliseconds of the network timer wheel
+ */
+#define NET_TIMER_WHEEL_TICK_MS     10
+
+/**
+ * Packet counters of a networking layer
+ */
+struct net_layer_packet_counts {
+    uint32_t rx_packets_accepted_count;
+    uint32_t rx_packets_dropped_count;
+    uint32_t sent_packets_count;
+};
+
+/**
+ * Snapshot of the networking stack statistics, taken by
+ * networking_get_stats_snapshot(). The packet counters of all layers are
+ * read at the same point in time, so they are consistent with each other.
+ */
+struct net_stats_snapshot {
+    /**
+     * get_monotonic_cycles() value when the packet counters were read
+     */
+    uint64_t timestamp_cycles;
+
+    struct net_layer_packet_counts layer2;
+    struct net_layer_packet_counts ipv4;
+
+    /**
+     * UDP counters (sent_packets_count is the UDP-over-IPv4 count)
+     */
+    struct net_layer_packet_counts udp;
+
+    bool link_is_up;
+    struct ipv4_address local_ipv4_addr;
+    struct ipv4_address subnet_mask;
+};
+
 void networking_init(void);
 
+void networking_get_stats_snapshot(struct net_stats_snapshot *snapshot_p);
+
+extern struct timer_wheel g_net_timer_wheel;
+
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_H_ */
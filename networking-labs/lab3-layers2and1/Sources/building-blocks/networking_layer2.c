@@ -5,6 +5,7 @@
  *
  * @author German Rivera
  */
+#include <string.h>
 #include "networking_layer2.h"
 #include "microcontroller.h"
 #include "io_utils.h"
@@ -12,44 +13,222 @@
 #include "ethernet_mac.h"
 #include "ethernet_phy.h"
 #include "networking_layer3.h"
+#include "networking_layer4_udp.h"
+#include "networking.h"
 #include "runtime_log.h"
+#include "atomic_utils.h"
+#include "perf_probes.h"
+#include "packet_capture.h"
+#include "watchdog.h"
 
 const struct ethernet_mac_address g_ethernet_broadcast_mac_addr = {
     .bytes = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }
 };
 
+/**
+ * Configuration of a layer-2 Rx dispatch queue
+ */
+struct net_layer2_rx_dispatch_queue_config {
+    /**
+     * Name of the queue's handler task
+     */
+    const char *task_name_p;
+
+    /**
+     * Priority of the queue's handler task
+     */
+    rtos_task_priority_t task_priority;
+
+    /**
+     * Maximum number of packets that can be waiting in the queue. Received
+     * frames for a full queue are dropped, so that a flood of one traffic
+     * class cannot take all the Rx packets of a layer-2 end point.
+     */
+    uint16_t max_length;
+};
+
+/**
+ * Configuration of the layer-2 Rx dispatch queues
+ */
+static const struct net_layer2_rx_dispatch_queue_config
+g_net_layer2_rx_dispatch_queue_configs[NUM_NET_LAYER2_RX_DISPATCH_QUEUES] = {
+    [NET_LAYER2_RX_HIGH_PRIORITY_QUEUE] = {
+        .task_name_p = "Networking layer-2 high priority Rx task",
+        .task_priority = RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 1),
+        .max_length = NET_MAX_RX_PACKETS / 2,
+    },
+
+    [NET_LAYER2_RX_BULK_QUEUE] = {
+        .task_name_p = "Networking layer-2 bulk Rx task",
+        .task_priority = RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 4),
+        .max_length = NET_MAX_RX_PACKETS / 4,
+    },
+};
+
+/**
+ * Layer-2 Rx dispatch rules. The first rule that matches a received frame
+ * determines the dispatch queue for the frame.
+ */
+static const struct net_layer2_rx_dispatch_rule g_net_layer2_rx_dispatch_rules[] = {
+    {
+        .frame_type = FRAME_TYPE_ARP_PACKET,
+        .ip_protocol = NET_LAYER2_RX_DISPATCH_ANY_IP_PROTOCOL,
+        .dispatch_queue = NET_LAYER2_RX_HIGH_PRIORITY_QUEUE,
+    },
+
+    {
+        .frame_type = FRAME_TYPE_IPv4_PACKET,
+        .ip_protocol = IP_PACKET_TYPE_UDP,
+        .dispatch_queue = NET_LAYER2_RX_HIGH_PRIORITY_QUEUE,
+    },
+
+    {
+        .frame_type = FRAME_TYPE_IPv6_PACKET,
+        .ip_protocol = NET_LAYER2_RX_DISPATCH_ANY_IP_PROTOCOL,
+        .dispatch_queue = NET_LAYER2_RX_BULK_QUEUE,
+    },
+};
+
+/**
+ * Value of g_net_layer2_vlan_pcp_to_rx_dispatch_queue[] entries for VLAN
+ * priorities whose frames are dispatched according to
+ * g_net_layer2_rx_dispatch_rules[], as untagged frames
+ */
+#define NET_LAYER2_RX_DISPATCH_BY_RULES    UINT8_C(0xff)
+
+/**
+ * Rx dispatch queue for received VLAN-tagged frames, indexed by priority code
+ * point. Frames marked as time-sensitive by the sender (PCP 4 to 7) go to the
+ * high priority queue and background frames (PCP 1 and 2) go to the bulk
+ * queue.
+ */
+static const uint8_t
+g_net_layer2_vlan_pcp_to_rx_dispatch_queue[ETHERNET_NUM_VLAN_PCPS] = {
+    [0] = NET_LAYER2_RX_DISPATCH_BY_RULES,
+    [1] = NET_LAYER2_RX_BULK_QUEUE,
+    [2] = NET_LAYER2_RX_BULK_QUEUE,
+    [3] = NET_LAYER2_RX_DISPATCH_BY_RULES,
+    [4] = NET_LAYER2_RX_HIGH_PRIORITY_QUEUE,
+    [5] = NET_LAYER2_RX_HIGH_PRIORITY_QUEUE,
+    [6] = NET_LAYER2_RX_HIGH_PRIORITY_QUEUE,
+    [7] = NET_LAYER2_RX_HIGH_PRIORITY_QUEUE,
+};
+
+/**
+ * Value of g_net_layer2_vlan_pcp_to_tx_class[] entries for VLAN priorities
+ * whose frames are classified by the priority of the sending task
+ */
+#define NET_LAYER2_TX_CLASS_BY_TASK_PRIORITY    UINT8_C(0xff)
+
+/**
+ * Tx class for outgoing frames, indexed by the priority code point of their
+ * Tx packet, mirroring g_net_layer2_vlan_pcp_to_rx_dispatch_queue[]
+ */
+static const uint8_t
+g_net_layer2_vlan_pcp_to_tx_class[ETHERNET_NUM_VLAN_PCPS] = {
+    [0] = NET_LAYER2_TX_CLASS_BY_TASK_PRIORITY,
+    [1] = NET_LAYER2_TX_CLASS_BULK,
+    [2] = NET_LAYER2_TX_CLASS_BULK,
+    [3] = NET_LAYER2_TX_CLASS_BY_TASK_PRIORITY,
+    [4] = NET_LAYER2_TX_CLASS_HIGH_PRIORITY,
+    [5] = NET_LAYER2_TX_CLASS_HIGH_PRIORITY,
+    [6] = NET_LAYER2_TX_CLASS_HIGH_PRIORITY,
+    [7] = NET_LAYER2_TX_CLASS_HIGH_PRIORITY,
+};
+
+/**
+ * Weighted round-robin weights of the Tx classes (frames per round). The
+ * high priority class is served by strict priority, so it has no weight.
+ */
+static const uint8_t g_net_layer2_tx_class_weights[NUM_NET_LAYER2_TX_CLASSES] = {
+    [NET_LAYER2_TX_CLASS_HIGH_PRIORITY] = 0,
+    [NET_LAYER2_TX_CLASS_NORMAL] = 3,
+    [NET_LAYER2_TX_CLASS_BULK] = 1,
+};
+
+/**
+ * Descriptions of the layer-2 drop reasons, for the drop summary reports
+ */
+static const char *const g_net_layer2_drop_reason_names[] = {
+    [NET_LAYER2_DROP_RX_BAD_FRAME] = "bad Rx frame",
+    [NET_LAYER2_DROP_RX_UNKNOWN_FRAME_TYPE] = "unknown Rx frame type",
+    [NET_LAYER2_DROP_RX_WRONG_VLAN] = "Rx frame for other VLAN",
+    [NET_LAYER2_DROP_RX_DISPATCH_QUEUE_FULL] = "Rx dispatch queue full",
+    [NET_LAYER2_DROP_TX_FAILED] = "Tx frame failed",
+    [NET_LAYER2_DROP_MAC_ERROR_INTERRUPT] = "Ethernet MAC error interrupt",
+    [NET_LAYER2_DROP_RX_OVERLOAD] = "Rx frame shed under overload",
+    [NET_LAYER2_DROP_TX_LINK_DOWN] = "Tx frame discarded while link down",
+};
+
+C_ASSERT(ARRAY_SIZE(g_net_layer2_drop_reason_names) == NUM_NET_LAYER2_DROP_REASONS);
+
+/**
+ * Rx backlog (received frames waiting to be processed) at which frames of
+ * each load-shedding class start being shed
+ */
+static const uint16_t g_net_layer2_rx_shed_watermarks[NUM_NET_LAYER2_RX_SHED_CLASSES] = {
+    [NET_LAYER2_RX_SHED_CLASS_CRITICAL] = UINT16_MAX,
+    [NET_LAYER2_RX_SHED_CLASS_UDP] = NET_LAYER2_RX_SHED_UDP_WATERMARK,
+    [NET_LAYER2_RX_SHED_CLASS_OTHER] = NET_LAYER2_RX_SHED_OTHER_WATERMARK,
+};
+
+C_ASSERT(NET_LAYER2_RX_SHED_OTHER_WATERMARK <= NET_LAYER2_RX_SHED_UDP_WATERMARK);
+
+/**
+ * Data buffers of all the network packets of networking layer 2
+ */
+static struct net_packet_data_buffers g_net_packet_data_buffers;
+
 const struct ethernet_mac_address g_ethernet_null_mac_addr = {
     .bytes = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }
 };
 
+/**
+ * Initializer for the layer-2 end point bound to Ethernet MAC _index. Each end
+ * point has its own Ethernet MAC, Rx/Tx rings, Rx packets and packet receiver
+ * task.
+ */
+#define NET_LAYER2_END_POINT_INITIALIZER(_index) \
+        {                                                                     \
+            .signature = NET_LAYER2_END_POINT_SIGNATURE,                      \
+            .type = NET_LAYER2_ETHERNET,                                      \
+            .initialized = false,                                             \
+            .layer3_end_point_p = &g_net_layer3.local_layer3_end_points[_index], \
+            .ethernet_mac_p = &g_ethernet_macs[_index],                       \
+            .ethernet_mac_rx_mode = ETHERNET_MAC_RX_POLLED_MODE,              \
+            .ethernet_mac_tx_mode = ETHERNET_MAC_TX_LAZY_RECLAIM_MODE,        \
+            .vlan_id = NET_LAYER2_NO_VLAN,                                    \
+            .vlan_default_tx_pcp = 0,                                         \
+        }
+
 /**
  * Networking layer-2 global state variables
  */
 struct net_layer2 g_net_layer2 = {
     .initialized = false,
     .tracing_on = false,
-    .rx_packets_accepted_count = 0,
-	.rx_packets_dropped_count = 0,
-	.sent_packets_count = 0,
     .local_layer2_end_points = {
-        [0] = {
-            .signature = NET_LAYER2_END_POINT_SIGNATURE,
-            .type = NET_LAYER2_ETHERNET,
-            .initialized = false,
-            .layer3_end_point_p = &g_net_layer3.local_layer3_end_points[0],
-            .ethernet_mac_p = &g_ethernet_mac0,
-        },
+        [0] = NET_LAYER2_END_POINT_INITIALIZER(0),
     },
 };
 
+/*
+ * An initializer entry must be added above for each additional end point:
+ */
+C_ASSERT(NUM_NET_LAYER2_END_POINTS == 1);
+
 /**
  * Builds an Ethernet MAC address from the Micrcontroller's unique
  * hardware identifier
  *
+ * @param end_point_index Index of the layer-2 end point, added to the last
+ *                        byte of the address, so that each end point gets a
+ *                        different MAC address
  * @param mac_addr_p Pointer to are where the built MAC address is to be
  *                   stored
  */
-static void build_local_mac_address(struct ethernet_mac_address *mac_addr_p)
+static void build_local_mac_address(unsigned int end_point_index,
+                                    struct ethernet_mac_address *mac_addr_p)
 {
     uint32_t reg_value;
 
@@ -63,7 +242,7 @@ static void build_local_mac_address(struct ethernet_mac_address *mac_addr_p)
     mac_addr_p->bytes[2] = (uint8_t)(reg_value >> 24);
     mac_addr_p->bytes[3] = (uint8_t)(reg_value >> 16);
     mac_addr_p->bytes[4] = (uint8_t)((uint16_t)reg_value >> 8);
-    mac_addr_p->bytes[5] = (uint8_t)reg_value;
+    mac_addr_p->bytes[5] = (uint8_t)(reg_value + end_point_index);
 
     /*
      * Ensure special bits of first byte of the MAC address are properly
@@ -75,570 +254,764 @@ static void build_local_mac_address(struct ethernet_mac_address *mac_addr_p)
 
 
 /**
- * Packet receive processing thread for a given Layer-2 end point
+ * Hands a received packet (and its fragments, if any) to the application,
+ * recording the calling task as its owner and updating the Rx packet usage
+ * counters of the layer-2 end point
  */
-static void net_layer2_packet_receiver_task(void *arg)
+static void net_layer2_hand_rx_packet_to_app(
+    struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *rx_packet_p)
 {
-    struct net_layer2_end_point *const layer2_end_point_p =
-        (struct net_layer2_end_point *)arg;
+    uint16_t in_use_count = 0;
+
+    for (struct network_packet *fragment_p = rx_packet_p;
+         fragment_p != NULL;
+         fragment_p = fragment_p->next_fragment_p) {
+        NET_PACKET_SET_STATE_FLAG(fragment_p, NET_PACKET_IN_RX_USE_BY_APP);
+        net_packet_set_owner(fragment_p);
+        in_use_count =
+            ATOMIC_POST_INCREMENT_UINT16(&layer2_end_point_p->rx_packets_in_use_count) + 1;
+    }
 
-#   ifdef USE_MPU
-    rtos_thread_set_comp_region(layer2_end_point_p,
-                                sizeof *layer2_end_point_p,
-                                0,
-                                NULL);
-#   endif
+    if (in_use_count > layer2_end_point_p->rx_packets_in_use_high_water_mark) {
+        layer2_end_point_p->rx_packets_in_use_high_water_mark = in_use_count;
+    }
+}
 
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
 
-    for ( ; ; ) {
-        struct network_packet *rx_packet_p = NULL;
-        bool frame_dropped = false;
+/**
+ * Delivers a received Ethernet frame to the corresponding upper layer, based
+ * on its frame type
+ */
+static void net_layer2_deliver_rx_packet(struct network_packet *rx_packet_p)
+{
+    bool frame_dropped = false;
+    struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
 
-        net_layer2_dequeue_rx_packet(layer2_end_point_p, &rx_packet_p);
+    /*
+     * Compare against the frame types in network byte order, so that no
+     * byte swap is done at run time:
+     */
+    switch (rx_frame_p->ethernet_header.frame_type) {
+    case HTON16_CONST(FRAME_TYPE_ARP_PACKET):
+        net_layer3_receive_arp_packet(rx_packet_p);
+        break;
+    case HTON16_CONST(FRAME_TYPE_IPv4_PACKET):
+        net_layer3_receive_ipv4_packet(rx_packet_p);
+        break;
+    case HTON16_CONST(FRAME_TYPE_IPv6_PACKET):
+        net_layer3_receive_ipv6_packet(rx_packet_p);
+        break;
+    default:
+        net_layer2_count_drop(NET_LAYER2_DROP_RX_UNKNOWN_FRAME_TYPE);
+        net_recycle_rx_packet(rx_packet_p);
+        frame_dropped = true;
+    }
 
-        D_ASSERT(rx_packet_p != NULL);
-        D_ASSERT(rx_packet_p->layer2_end_point_p == layer2_end_point_p);
+    if (frame_dropped) {
+        COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_RX_DROPPED);
+    } else {
+        COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_RX_ACCEPTED);
+    }
+}
 
-        if (rx_packet_p->state_flags == NET_PACKET_RX_FAILED) {
-            net_recycle_rx_packet(rx_packet_p);
-            continue;
-        }
 
-        struct ethernet_frame *rx_frame_p =
-            (struct ethernet_frame *)rx_packet_p->data_buffer;
-
-        if (g_net_layer2.tracing_on) {
-            DEBUG_PRINTF("Net layer2: Ethernet frame received:\n"
-                         "\tsource MAC address %02x:%02x:%02x:%02x:%02x:%02x\n"
-                         "\tdestination MAC address %02x:%02x:%02x:%02x:%02x:%02x\n"
-                         "\tFrame type %#x, Total length: %u\n",
-                         rx_frame_p->ethernet_header.source_mac_addr.bytes[0],
-                         rx_frame_p->ethernet_header.source_mac_addr.bytes[1],
-                         rx_frame_p->ethernet_header.source_mac_addr.bytes[2],
-                         rx_frame_p->ethernet_header.source_mac_addr.bytes[3],
-                         rx_frame_p->ethernet_header.source_mac_addr.bytes[4],
-                         rx_frame_p->ethernet_header.source_mac_addr.bytes[5],
-                         rx_frame_p->ethernet_header.dest_mac_addr.bytes[0],
-                         rx_frame_p->ethernet_header.dest_mac_addr.bytes[1],
-                         rx_frame_p->ethernet_header.dest_mac_addr.bytes[2],
-                         rx_frame_p->ethernet_header.dest_mac_addr.bytes[3],
-                         rx_frame_p->ethernet_header.dest_mac_addr.bytes[4],
-                         rx_frame_p->ethernet_header.dest_mac_addr.bytes[5],
-                         rx_frame_p->ethernet_header.frame_type,
-                         rx_packet_p->total_length);
-        }
-
-        switch (ntoh16(rx_frame_p->ethernet_header.frame_type)) {
-        case FRAME_TYPE_ARP_PACKET:
-            net_layer3_receive_arp_packet(rx_packet_p);
-            break;
-        case FRAME_TYPE_IPv4_PACKET:
-            net_layer3_receive_ipv4_packet(rx_packet_p);
-            break;
-        case FRAME_TYPE_IPv6_PACKET:
-            net_layer3_receive_ipv6_packet(rx_packet_p);
-            break;
-        default:
-            ERROR_PRINTF("Received frame of unknown type: %#x\n",
-                          ntoh16(rx_frame_p->ethernet_header.frame_type));
+/**
+ * Finds the Rx dispatch queue for a received Ethernet frame
+ *
+ * @return dispatch queue (enum net_layer2_rx_dispatch_queues), or
+ *         NET_LAYER2_RX_DISPATCH_INLINE if the frame is to be processed inline
+ */
+static uint_fast8_t net_layer2_classify_rx_packet(const struct network_packet *rx_packet_p)
+{
+    const struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
+    uint16_t frame_type = ntoh16(rx_frame_p->ethernet_header.frame_type);
+    uint8_t ip_protocol = NET_LAYER2_RX_DISPATCH_ANY_IP_PROTOCOL;
+
+    if (rx_packet_p->vlan_pcp != 0) {
+        D_ASSERT(rx_packet_p->vlan_pcp < ETHERNET_NUM_VLAN_PCPS);
+        uint8_t dispatch_queue =
+            g_net_layer2_vlan_pcp_to_rx_dispatch_queue[rx_packet_p->vlan_pcp];
+
+        if (dispatch_queue != NET_LAYER2_RX_DISPATCH_BY_RULES) {
+            return dispatch_queue;
+        }
+    }
 
-            net_recycle_rx_packet(rx_packet_p);
-            frame_dropped = true;
+    if (frame_type == FRAME_TYPE_IPv4_PACKET) {
+        if (NET_RX_PACKET_PARSED_AS_IPv4(rx_packet_p)) {
+            ip_protocol = rx_packet_p->rx_protocol_type;
+        } else if (rx_packet_p->total_length >= sizeof(struct ethernet_header) +
+                                                sizeof(struct ipv4_header)) {
+            ip_protocol = GET_IPV4_HEADER(rx_packet_p)->protocol_type;
         }
+    }
 
-        if (frame_dropped) {
-			ATOMIC_POST_INCREMENT_UINT32(&g_net_layer2.rx_packets_dropped_count);
-        } else {
-			ATOMIC_POST_INCREMENT_UINT32(&g_net_layer2.rx_packets_accepted_count);
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_net_layer2_rx_dispatch_rules); i ++) {
+        const struct net_layer2_rx_dispatch_rule *rule_p =
+            &g_net_layer2_rx_dispatch_rules[i];
+
+        if (rule_p->frame_type == frame_type &&
+            (rule_p->ip_protocol == NET_LAYER2_RX_DISPATCH_ANY_IP_PROTOCOL ||
+             rule_p->ip_protocol == ip_protocol)) {
+            D_ASSERT(rule_p->dispatch_queue < NUM_NET_LAYER2_RX_DISPATCH_QUEUES);
+            return rule_p->dispatch_queue;
         }
     }
 
-    ERROR_PRINTF("task %s should not have terminated\n",
-                 rtos_task_self()->tsk_name_p);
+    return NET_LAYER2_RX_DISPATCH_INLINE;
 }
 
 
 /**
- * Initialize a given layer-2 end point
+ * Strips the IEEE 802.1Q VLAN tag from a received VLAN-tagged frame. The
+ * frame's Ethernet header is moved over the tag and the tag is pulled from
+ * the frame, so that upper layers find their headers right after the
+ * Ethernet header, as in untagged frames, without moving the payload.
  *
- * @param layer2_end_point_p    Pointer to layer-2 end point
+ * @return true, if the frame is to be accepted
+ * @return false, if the frame is to be dropped (runt frame, or frame for
+ *         a VLAN other than the end point's VLAN)
  */
-static void net_layer2_end_point_init(struct net_layer2_end_point *layer2_end_point_p)
+static bool net_layer2_strip_vlan_tag(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *rx_packet_p)
 {
-    D_ASSERT(CALLER_IS_THREAD());
-
-#   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
-
-    rtos_thread_set_comp_region(layer2_end_point_p,
-                                sizeof *layer2_end_point_p,
-                                0,
-                                &old_comp_region);
-#   endif
-
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(!layer2_end_point_p->initialized);
-
-    build_local_mac_address(&layer2_end_point_p->mac_address);
+    struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
+    struct ethernet_vlan_tag *vlan_tag_p =
+        (struct ethernet_vlan_tag *)(rx_packet_p->data_buffer +
+                                     sizeof(struct ethernet_header));
+
+    if (rx_packet_p->total_length <
+        sizeof(struct ethernet_header) + sizeof(struct ethernet_vlan_tag)) {
+        return false;
+    }
 
-    INFO_PRINTF("Net layer2: Generated MAC address %02x:%02x:%02x:%02x:%02x:%02x for MAC %s\n",
-                layer2_end_point_p->mac_address.bytes[0],
-                layer2_end_point_p->mac_address.bytes[1],
-                layer2_end_point_p->mac_address.bytes[2],
-                layer2_end_point_p->mac_address.bytes[3],
-                layer2_end_point_p->mac_address.bytes[4],
-                layer2_end_point_p->mac_address.bytes[5],
-                layer2_end_point_p->ethernet_mac_p->name_p);
+    /*
+     * The start of the frame moves within the data buffer, so VLAN-tagged
+     * frames that span several Rx packets are not supported:
+     */
+    if (rx_packet_p->next_fragment_p != NULL) {
+        return false;
+    }
 
-    net_packet_queue_init("Layer-2 Rx network packet queue", false,
-                          &layer2_end_point_p->rx_packet_queue);
+    uint16_t tag_control = ntoh16(vlan_tag_p->tag_control);
+    uint16_t vlan_id = GET_BIT_FIELD(tag_control, ETHERNET_VLAN_ID_MASK,
+                                     ETHERNET_VLAN_ID_SHIFT);
 
     /*
-     * Initialize Rx packets:
+     * VLAN ID 0 indicates a priority-tagged frame that is not in any VLAN:
      */
-    for (unsigned int i = 0;
-         i < ARRAY_SIZE(layer2_end_point_p->rx_packets);
-         i ++) {
-        struct network_packet *rx_packet_p = &layer2_end_point_p->rx_packets[i];
-
-        rx_packet_p->signature = NET_RX_PACKET_SIGNATURE;
-        rx_packet_p->state_flags = 0;
-        rx_packet_p->rx_buf_desc_p = NULL;
-        rx_packet_p->layer2_end_point_p = layer2_end_point_p;
-        rx_packet_p->queue_p = NULL;
-        rx_packet_p->next_p = NULL;
+    if (vlan_id != 0 && vlan_id != layer2_end_point_p->vlan_id) {
+        return false;
     }
 
-    ethernet_mac_init(layer2_end_point_p->ethernet_mac_p,
-                      layer2_end_point_p);
+    rx_packet_p->vlan_pcp = GET_BIT_FIELD(tag_control, ETHERNET_VLAN_PCP_MASK,
+                                          ETHERNET_VLAN_PCP_SHIFT);
+    rx_frame_p->ethernet_header.frame_type = vlan_tag_p->frame_type;
+    memmove(rx_packet_p->data_buffer + sizeof(struct ethernet_vlan_tag),
+            rx_packet_p->data_buffer, sizeof(struct ethernet_header));
+    (void)net_packet_pull_header(rx_packet_p, sizeof(struct ethernet_vlan_tag));
+    return true;
+}
 
-    layer2_end_point_p->initialized = true;
 
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+/**
+ * Tells if a UDP destination port is one of the ports registered with
+ * net_layer2_add_rx_critical_udp_port()
+ */
+static bool net_layer2_is_rx_critical_udp_port(uint16_t port /* big endian */)
+{
+    uint_fast8_t num_ports = g_net_layer2.num_rx_critical_udp_ports;
+
+    for (uint_fast8_t i = 0; i < num_ports; i ++) {
+        if (g_net_layer2.rx_critical_udp_ports[i] == port) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 
 /**
- * Start packet reception for a given layer-2 end point
+ * Finds the load-shedding class of a received Ethernet frame (after its
+ * VLAN tag, if any, has been stripped). If the Ethernet MAC parsed the IP
+ * headers of the frame, the fields it parsed are used, so that only the
+ * UDP destination port is read from the frame, and only for UDP datagrams.
  *
- * @param layer2_end_point_p    Pointer to layer-2 end point
+ * @return load-shedding class (enum net_layer2_rx_shed_classes)
  */
-static void net_layer2_end_point_start(struct net_layer2_end_point *layer2_end_point_p)
+static uint_fast8_t net_layer2_get_rx_shed_class(const struct network_packet *rx_packet_p)
 {
-    D_ASSERT(CALLER_IS_THREAD());
+    const struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
+    const struct udp_header *udp_header_p;
+    uint_fast16_t headers_length;
+
+    switch (rx_frame_p->ethernet_header.frame_type) {
+    case HTON16_CONST(FRAME_TYPE_ARP_PACKET):
+        return NET_LAYER2_RX_SHED_CLASS_CRITICAL;
+
+    case HTON16_CONST(FRAME_TYPE_IPv4_PACKET): {
+        const struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+
+        if (NET_RX_PACKET_PARSED_AS_IPv4(rx_packet_p) &&
+            !(rx_packet_p->rx_checksum_flags & NET_PACKET_RX_IPv4_FRAGMENT)) {
+            uint8_t protocol_type = rx_packet_p->rx_protocol_type;
+
+            if (protocol_type == IP_PACKET_TYPE_ICMP ||
+                protocol_type == IP_PACKET_TYPE_IGMP) {
+                return NET_LAYER2_RX_SHED_CLASS_CRITICAL;
+            }
+
+            if (protocol_type != IP_PACKET_TYPE_UDP) {
+                return NET_LAYER2_RX_SHED_CLASS_OTHER;
+            }
+
+            /*
+             * The header length parsed by the MAC includes the UDP header:
+             */
+            headers_length = sizeof(struct ethernet_header) +
+                             rx_packet_p->rx_header_length * sizeof(uint32_t) -
+                             sizeof(struct udp_header);
+            break;
+        }
 
-#   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
+        if (rx_packet_p->total_length <
+            sizeof(struct ethernet_header) + sizeof(struct ipv4_header)) {
+            return NET_LAYER2_RX_SHED_CLASS_OTHER;
+        }
 
-    rtos_thread_set_comp_region(layer2_end_point_p,
-                                sizeof *layer2_end_point_p,
-                                0,
-                                &old_comp_region);
-#   endif
+        if (ipv4_header_p->protocol_type == IP_PACKET_TYPE_ICMP ||
+            ipv4_header_p->protocol_type == IP_PACKET_TYPE_IGMP) {
+            return NET_LAYER2_RX_SHED_CLASS_CRITICAL;
+        }
 
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(layer2_end_point_p->initialized);
+        /*
+         * Only the first fragment of a fragmented datagram has the UDP
+         * header:
+         */
+        if (ipv4_header_p->protocol_type != IP_PACKET_TYPE_UDP ||
+            (ipv4_header_p->flags_and_fragment_offset &
+             HTON16_CONST(IP_FRAGMENT_OFFSET_MASK)) != 0) {
+            return NET_LAYER2_RX_SHED_CLASS_OTHER;
+        }
 
-    /*
-     * Start packet reception at the Ethernet MAC:
-     *
-     * NOTE: Packets can start arriving right after this call. If so,
-     * they will sit in the layer-2 end point's incoming queue.
-     */
-    ethernet_mac_start(layer2_end_point_p->ethernet_mac_p);
+        headers_length = sizeof(struct ethernet_header) +
+                         GET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                                       IP_HEADER_LENGTH_MASK,
+                                       IP_HEADER_LENGTH_SHIFT) * sizeof(uint32_t);
+        break;
+    }
 
-    /*
-     * Create layer-2 packet receiver task:
-     */
-    rtos_task_create(&layer2_end_point_p->packet_receiver_task,
-                     "Networking layer-2 packet receiver task",
-                     net_layer2_packet_receiver_task,
-                     layer2_end_point_p,
-                     HIGHEST_APP_TASK_PRIORITY + 2);
+    case HTON16_CONST(FRAME_TYPE_IPv6_PACKET): {
+        const struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
 
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+        if (rx_packet_p->total_length <
+            sizeof(struct ethernet_header) + sizeof(struct ipv6_header)) {
+            return NET_LAYER2_RX_SHED_CLASS_OTHER;
+        }
+
+        if (ipv6_header_p->next_header == IP_PACKET_TYPE_ICMPV6) {
+            return NET_LAYER2_RX_SHED_CLASS_CRITICAL;
+        }
+
+        if (ipv6_header_p->next_header != IP_PACKET_TYPE_UDP) {
+            return NET_LAYER2_RX_SHED_CLASS_OTHER;
+        }
+
+        headers_length = sizeof(struct ethernet_header) + sizeof(struct ipv6_header);
+        break;
+    }
+
+    default:
+        return NET_LAYER2_RX_SHED_CLASS_OTHER;
+    }
+
+    if (rx_packet_p->total_length < headers_length + sizeof(struct udp_header)) {
+        return NET_LAYER2_RX_SHED_CLASS_OTHER;
+    }
+
+    udp_header_p = (struct udp_header *)(rx_packet_p->data_buffer + headers_length);
+    if (net_layer2_is_rx_critical_udp_port(udp_header_p->dest_port)) {
+        return NET_LAYER2_RX_SHED_CLASS_CRITICAL;
+    }
+
+    return NET_LAYER2_RX_SHED_CLASS_UDP;
 }
 
 
 /**
- * Tell if the Ethernet link is up for a given Ethernet port
+ * Copies a small received frame to an Rx copybreak packet, and recycles its
+ * full-size Rx packet, so that its Rx buffer is reposted to the Ethernet MAC
+ * right away. Frames longer than NET_LAYER2_RX_COPYBREAK_THRESHOLD, or
+ * received when no Rx copybreak packet is free, are not copied.
  *
- * @param layer2_end_point_p	Pointer to layer-2 end point
+ * @param layer2_end_point_p    Pointer to the layer-2 end point
+ * @param rx_packet_p           Pointer to the received packet
  *
- * @return true, link is up
- * @return false, link is down
+ * @return Pointer to the packet that holds the frame now
  */
-bool net_layer2_end_point_link_is_up(
-            const struct net_layer2_end_point *layer2_end_point_p)
+static struct network_packet *net_layer2_rx_copybreak(
+    struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *rx_packet_p)
 {
-    D_ASSERT(CALLER_IS_THREAD());
-
-#   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
+    if (rx_packet_p->total_length > NET_LAYER2_RX_COPYBREAK_THRESHOLD) {
+        return rx_packet_p;
+    }
 
-    rtos_thread_set_comp_region(layer2_end_point_p,
-                                sizeof *layer2_end_point_p,
-                                0,
-                                &old_comp_region);
-#   endif
+    D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP);
+    D_ASSERT(rx_packet_p->next_fragment_p == NULL);
+    D_ASSERT(rx_packet_p->ref_count == 1);
 
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(layer2_end_point_p->initialized);
+    struct network_packet *copy_packet_p =
+        net_packet_free_list_try_remove(&layer2_end_point_p->rx_copybreak_free_list);
 
-    const struct ethernet_mac_device *ethernet_mac_p =
-        layer2_end_point_p->ethernet_mac_p;
+    if (copy_packet_p == NULL) {
+        layer2_end_point_p->rx_copybreak_misses_count ++;
+        return rx_packet_p;
+    }
 
-    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+    D_ASSERT(copy_packet_p->state_flags == NET_PACKET_IN_RX_SPARE_POOL);
+    D_ASSERT(copy_packet_p->layer2_end_point_p == layer2_end_point_p);
 
-    bool link_up = ethernet_phy_link_is_up(ethernet_mac_p->ethernet_phy_p);
+    uint16_t in_use_count = NET_MAX_RX_COPYBREAK_PACKETS -
+                            layer2_end_point_p->rx_copybreak_free_list.length;
 
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+    if (in_use_count > layer2_end_point_p->rx_copybreak_in_use_high_water_mark) {
+        layer2_end_point_p->rx_copybreak_in_use_high_water_mark = in_use_count;
+    }
 
-    return link_up;
+    memcpy(copy_packet_p->data_buffer, rx_packet_p->data_buffer,
+           rx_packet_p->total_length);
+    copy_packet_p->total_length = rx_packet_p->total_length;
+    copy_packet_p->rx_checksum_flags = rx_packet_p->rx_checksum_flags;
+    copy_packet_p->rx_protocol_type = rx_packet_p->rx_protocol_type;
+    copy_packet_p->rx_header_length = rx_packet_p->rx_header_length;
+    copy_packet_p->timestamp_flags = rx_packet_p->timestamp_flags;
+    copy_packet_p->timestamp = rx_packet_p->timestamp;
+    copy_packet_p->rx_latency_begin_cycles = rx_packet_p->rx_latency_begin_cycles;
+    copy_packet_p->rx_latency_stage_cycles = rx_packet_p->rx_latency_stage_cycles;
+    copy_packet_p->state_flags = NET_PACKET_IN_RX_USE_BY_APP;
+    net_packet_set_owner(copy_packet_p);
+
+    net_recycle_rx_packet(rx_packet_p);
+    layer2_end_point_p->rx_copybreak_count ++;
+    return copy_packet_p;
 }
 
 
 /**
- * Set loopback mode on/off for a given given Ethernet port
+ * Processes a received Ethernet frame: it is either delivered inline to the
+ * corresponding upper layer, or handed to the Rx dispatch queue that
+ * corresponds to its traffic class. Under overload, it may be shed instead
+ * (see enum net_layer2_rx_shed_classes).
  *
- * @param layer2_end_point_p	Pointer to layer-2 end point
- * @param on					boolean flag: true (on), false (off)
+ * @param layer2_end_point_p    Pointer to the layer-2 end point
+ * @param rx_packet_p           Pointer to the received packet
+ * @param rx_backlog            Number of received frames waiting to be
+ *                              processed, including this one
  */
-void net_layer2_end_point_set_loopback(
-	const struct net_layer2_end_point *layer2_end_point_p,
-	bool on)
+static void net_layer2_process_rx_packet(
+    struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *rx_packet_p,
+    uint_fast16_t rx_backlog)
 {
-    D_ASSERT(CALLER_IS_THREAD());
-
-#   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
+    D_ASSERT(rx_packet_p != NULL);
+    D_ASSERT(rx_packet_p->layer2_end_point_p == layer2_end_point_p);
 
-    rtos_thread_set_comp_region(layer2_end_point_p,
-                                sizeof *layer2_end_point_p,
-                                0,
-                                &old_comp_region);
-#   endif
+    if (rx_packet_p->state_flags == NET_PACKET_RX_FAILED) {
+        net_recycle_rx_packet(rx_packet_p);
+        return;
+    }
 
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(layer2_end_point_p->initialized);
+    rx_packet_p = net_layer2_rx_copybreak(layer2_end_point_p, rx_packet_p);
+    NET_RX_PACKET_LATENCY_STAGE(rx_packet_p, PERF_PROBE_RX_LATENCY_MAC_TO_LAYER2);
+    PACKET_CAPTURE(false, rx_packet_p, rx_packet_p->total_length);
 
-    const struct ethernet_mac_device *ethernet_mac_p =
-        layer2_end_point_p->ethernet_mac_p;
+    struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
 
-    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
-
-    ethernet_phy_set_loopback(ethernet_mac_p->ethernet_phy_p, on);
-
-    INFO_PRINTF("Layer2: Set loopback mode %s for MAC %s\n",
-    		    on ? "on" : "off",
-    		    ethernet_mac_p->name_p);
-
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
-}
+    if (NET_LAYER2_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer2: Ethernet frame received:\n"
+                     "\tsource MAC address %02x:%02x:%02x:%02x:%02x:%02x\n"
+                     "\tdestination MAC address %02x:%02x:%02x:%02x:%02x:%02x\n"
+                     "\tFrame type %#x, Total length: %u\n",
+                     rx_frame_p->ethernet_header.source_mac_addr.bytes[0],
+                     rx_frame_p->ethernet_header.source_mac_addr.bytes[1],
+                     rx_frame_p->ethernet_header.source_mac_addr.bytes[2],
+                     rx_frame_p->ethernet_header.source_mac_addr.bytes[3],
+                     rx_frame_p->ethernet_header.source_mac_addr.bytes[4],
+                     rx_frame_p->ethernet_header.source_mac_addr.bytes[5],
+                     rx_frame_p->ethernet_header.dest_mac_addr.bytes[0],
+                     rx_frame_p->ethernet_header.dest_mac_addr.bytes[1],
+                     rx_frame_p->ethernet_header.dest_mac_addr.bytes[2],
+                     rx_frame_p->ethernet_header.dest_mac_addr.bytes[3],
+                     rx_frame_p->ethernet_header.dest_mac_addr.bytes[4],
+                     rx_frame_p->ethernet_header.dest_mac_addr.bytes[5],
+                     rx_frame_p->ethernet_header.frame_type,
+                     rx_packet_p->total_length);
+    }
 
+    rx_packet_p->vlan_pcp = 0;
+    if (rx_frame_p->ethernet_header.frame_type ==
+        HTON16_CONST(FRAME_TYPE_VLAN_TAGGED_FRAME)) {
+        if (!net_layer2_strip_vlan_tag(layer2_end_point_p, rx_packet_p)) {
+            net_layer2_count_drop(NET_LAYER2_DROP_RX_WRONG_VLAN);
+            COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_RX_DROPPED);
+            net_recycle_rx_packet(rx_packet_p);
+            return;
+        }
+    }
 
-/**
- * Obtain the MAC address associated with a layer-2 end point
- *
- * @param layer2_end_point_p    Pointer to Layer-2 end point
- * @param mac_addr_p            Area where MAC address is to be returned
- */
-void net_layer2_get_mac_addr(const struct net_layer2_end_point *layer2_end_point_p,
-                             struct ethernet_mac_address *mac_addr_p)
-{
-    D_ASSERT(CALLER_IS_THREAD());
+    if (rx_backlog >= NET_LAYER2_RX_SHED_OTHER_WATERMARK) {
+        uint_fast8_t shed_class = net_layer2_get_rx_shed_class(rx_packet_p);
 
-#   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
+        if (rx_backlog >= g_net_layer2_rx_shed_watermarks[shed_class]) {
+            ATOMIC_POST_INCREMENT_UINT32(&g_net_layer2.rx_shed_counts[shed_class]);
+            net_layer2_count_drop(NET_LAYER2_DROP_RX_OVERLOAD);
+            COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_RX_DROPPED);
+            net_recycle_rx_packet(rx_packet_p);
+            return;
+        }
+    }
 
-    rtos_thread_set_comp_region(layer2_end_point_p,
-                                sizeof *layer2_end_point_p,
-                                0,
-                                &old_comp_region);
+    uint_fast8_t dispatch_queue = net_layer2_classify_rx_packet(rx_packet_p);
 
-    rtos_thread_set_tmp_region(mac_addr_p, sizeof *mac_addr_p, 0);
-#   endif
+    if (dispatch_queue == NET_LAYER2_RX_DISPATCH_INLINE) {
+        net_layer2_deliver_rx_packet(rx_packet_p);
+        return;
+    }
 
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(layer2_end_point_p->initialized);
+    struct net_layer2_rx_dispatch_queue *rx_dispatch_queue_p =
+        &layer2_end_point_p->rx_dispatch_queues[dispatch_queue];
 
-    COPY_MAC_ADDRESS(mac_addr_p, &layer2_end_point_p->mac_address);
+    if (rx_dispatch_queue_p->rx_packet_queue.length >=
+        g_net_layer2_rx_dispatch_queue_configs[dispatch_queue].max_length) {
+        rx_dispatch_queue_p->rx_packets_dropped_count ++;
+        net_layer2_count_drop(NET_LAYER2_DROP_RX_DISPATCH_QUEUE_FULL);
+        COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_RX_DROPPED);
+        net_recycle_rx_packet(rx_packet_p);
+        return;
+    }
 
-#   ifdef USE_MPU
-    rtos_thread_unset_tmp_region();
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+    net_packet_queue_add(&rx_dispatch_queue_p->rx_packet_queue, rx_packet_p);
 }
 
 
 /**
- * Initializes global pool of free Tx packets
+ * Handler task for a layer-2 Rx dispatch queue. It delivers the packets
+ * in the queue to the corresponding upper layer, at the queue's priority.
  */
-static void net_layer2_init_tx_packet_pool(struct net_tx_packet_pool *tx_packet_pool_p)
+static void net_layer2_rx_dispatch_task(void *arg)
 {
-    net_packet_queue_init("Tx packet pool",
-                          false,
-                          &tx_packet_pool_p->free_list);
+    struct net_layer2_rx_dispatch_queue *const rx_dispatch_queue_p =
+        (struct net_layer2_rx_dispatch_queue *)arg;
 
-    for (unsigned int i = 0;
-         i < ARRAY_SIZE(tx_packet_pool_p->tx_packets);
-         i ++) {
-        struct network_packet *const tx_packet_p =
-            &tx_packet_pool_p->tx_packets[i];
+    for ( ; ; ) {
+        struct network_packet *rx_packet_p =
+            net_packet_queue_remove(&rx_dispatch_queue_p->rx_packet_queue, 0);
 
-        tx_packet_p->signature = NET_TX_PACKET_SIGNATURE;
-        tx_packet_p->state_flags = NET_PACKET_IN_TX_POOL;
-        tx_packet_p->tx_buf_desc_p = NULL;
-        tx_packet_p->layer2_end_point_p = NULL;
-        tx_packet_p->queue_p = NULL;
-        tx_packet_p->next_p = NULL;
+        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_USE_BY_APP);
+
+        net_packet_set_owner(rx_packet_p);
 
-        net_packet_queue_add(&tx_packet_pool_p->free_list, tx_packet_p);
+        PERF_PROBE_BEGIN(PERF_PROBE_LAYER2_RX_DISPATCH);
+        net_layer2_deliver_rx_packet(rx_packet_p);
+        PERF_PROBE_END(PERF_PROBE_LAYER2_RX_DISPATCH);
     }
+
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
 }
 
 
 /**
- * Global initialization of networking layer 2
+ * Packet receive processing thread for a given Layer-2 end point
  */
-void net_layer2_init(void)
+static void net_layer2_packet_receiver_task(void *arg)
 {
-    D_ASSERT(CALLER_IS_THREAD());
+    struct net_layer2_end_point *const layer2_end_point_p =
+        (struct net_layer2_end_point *)arg;
 
 #   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
-
     rtos_thread_set_comp_region(&g_net_layer2,
                                 sizeof g_net_layer2,
                                 0,
-                                &old_comp_region);
+                                NULL);
 #   endif
 
-    D_ASSERT(!g_net_layer2.initialized);
-    net_layer2_init_tx_packet_pool(&g_net_layer2.free_tx_packet_pool);
-
-#   ifdef USE_MPU
-    /*
-     * Enable access to Rx/Tx buffers memory for the ENET DMA engine:
-     */
-    ethernet_mac_register_dma_region(&g_net_layer2, sizeof g_net_layer2);
-#   endif
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
 
-    for (unsigned int i = 0;
-         i < ARRAY_SIZE(g_net_layer2.local_layer2_end_points);
-         i ++) {
-        net_layer2_end_point_init(&g_net_layer2.local_layer2_end_points[i]);
+    for ( ; ; ) {
+        uint16_t num_packets;
+        struct network_packet *rx_packet_p =
+            net_layer2_dequeue_rx_packet_chain(layer2_end_point_p, &num_packets);
+
+        D_ASSERT(num_packets != 0);
+        while (rx_packet_p != NULL) {
+            struct network_packet *next_rx_packet_p = rx_packet_p->next_p;
+            struct net_packet_spsc_queue *const rx_packet_queue_p =
+                &layer2_end_point_p->rx_packet_queue;
+
+            /*
+             * The Rx backlog is the rest of the dequeued chain plus the
+             * frames received since the chain was dequeued:
+             */
+            uint_fast16_t rx_backlog =
+                num_packets +
+                (uint16_t)(rx_packet_queue_p->write_index - rx_packet_queue_p->read_index);
+
+            rx_packet_p->next_p = NULL;
+            net_layer2_process_rx_packet(layer2_end_point_p, rx_packet_p, rx_backlog);
+            rx_packet_p = next_rx_packet_p;
+            num_packets --;
+        }
     }
 
-    g_net_layer2.initialized = true;
-
-    DEBUG_PRINTF("Networking layer 2 initialized\n");
-
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
 }
 
 
-
 /**
- * Start packet reception for networking layer 2
+ * Packet receive processing thread for a given Layer-2 end point, whose
+ * Ethernet MAC operates in polled Rx mode. The task sleeps until the MAC's
+ * Rx interrupt wakes it up, and then drains the MAC's Rx ring in batches
+ * of up to NET_LAYER2_RX_POLL_BUDGET packets, until the Rx ring is empty.
+ *
+ * The task signals its watchdog heartbeat after every polling pass. It waits
+ * for the Rx interrupt with a timeout, so that it keeps signaling it when no
+ * packets arrive, and so a starved receiver task is caught by the watchdog.
  */
-void net_layer2_start(void)
+static void net_layer2_packet_poller_task(void *arg)
 {
-    D_ASSERT(CALLER_IS_THREAD());
+    struct net_layer2_end_point *const layer2_end_point_p =
+        (struct net_layer2_end_point *)arg;
+    struct network_packet *rx_packets[NET_LAYER2_RX_POLL_BUDGET];
+    uint_fast16_t num_received;
+    uint_fast8_t heartbeat_index =
+        watchdog_heartbeat_register(rtos_task_self()->tsk_name_p,
+                                    NET_LAYER2_RX_HEARTBEAT_DEADLINE_MS);
 
 #   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
-
     rtos_thread_set_comp_region(&g_net_layer2,
                                 sizeof g_net_layer2,
                                 0,
-                                &old_comp_region);
+                                NULL);
 #   endif
 
-    D_ASSERT(g_net_layer2.initialized);
-
-    for (unsigned int i = 0;
-         i < ARRAY_SIZE(g_net_layer2.local_layer2_end_points);
-         i ++) {
-        net_layer2_end_point_start(&g_net_layer2.local_layer2_end_points[i]);
-    }
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
 
-    g_net_layer2.initialized = true;
+    for ( ; ; ) {
+        watchdog_heartbeat_signal(heartbeat_index);
+        if (!rtos_semaphore_wait_timeout(&layer2_end_point_p->rx_poll_semaphore,
+                                         NET_LAYER2_RX_HEARTBEAT_PERIOD_MS)) {
+            continue;
+        }
 
-    DEBUG_PRINTF("Networking layer 2 started\n");
+        do {
+            num_received = ethernet_mac_poll_rx(layer2_end_point_p->ethernet_mac_p,
+                                                rx_packets,
+                                                ARRAY_SIZE(rx_packets));
+
+            for (uint_fast16_t i = 0; i < num_received; i ++) {
+                struct network_packet *rx_packet_p = rx_packets[i];
+
+                D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+                D_ASSERT(rx_packet_p->state_flags == 0 ||
+                         rx_packet_p->state_flags == NET_PACKET_RX_FAILED);
+
+                if (rx_packet_p->state_flags == 0) {
+                    net_layer2_hand_rx_packet_to_app(layer2_end_point_p,
+                                                     rx_packet_p);
+                }
+
+                /*
+                 * In polled Rx mode, received frames wait in the MAC's Rx
+                 * ring, not in the Rx packet queue, and the polling budget
+                 * already bounds the work done per pass, so frames are not
+                 * shed:
+                 */
+                net_layer2_process_rx_packet(layer2_end_point_p, rx_packet_p, 0);
+            }
+        } while (num_received == ARRAY_SIZE(rx_packets));
+    }
 
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
 }
 
 
 /**
- * Allocates a Tx packet from layer-2's global Tx packet pool.
- * If there are no free Tx packets, it waits until one becomes available
+ * Returns the Tx scheduler of a layer-2 end point. The send functions only
+ * get a const pointer to the end point, but the scheduler state they update
+ * lives in the end point itself.
  */
-struct network_packet *net_layer2_allocate_tx_packet(bool free_after_tx_complete)
+static struct net_layer2_tx_scheduler *net_layer2_get_tx_scheduler(
+    const struct net_layer2_end_point *layer2_end_point_p)
 {
-    struct network_packet *tx_packet_p = NULL;
-    struct net_tx_packet_pool *const free_tx_packet_pool_p =
-         &g_net_layer2.free_tx_packet_pool;
-
-    D_ASSERT(CALLER_IS_THREAD());
-
-#    ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
-
-    rtos_thread_set_comp_region(&g_net_layer2,
-                                sizeof g_net_layer2,
-                                0,
-                                &old_comp_region);
-#    endif
+    unsigned int end_point_index =
+        layer2_end_point_p - &g_net_layer2.local_layer2_end_points[0];
 
-    D_ASSERT(g_net_layer2.initialized);
+    D_ASSERT(end_point_index < NUM_NET_LAYER2_END_POINTS);
+    return &g_net_layer2.local_layer2_end_points[end_point_index].tx_scheduler;
+}
 
-    tx_packet_p = net_packet_queue_remove(&free_tx_packet_pool_p->free_list, 0);
 
-    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
-    D_ASSERT(tx_packet_p->state_flags == NET_PACKET_IN_TX_POOL);
-    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
+/**
+ * Discards an outgoing frame while Tx is paused, as if it had been
+ * transmitted.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void net_layer2_tx_scheduler_discard(struct network_packet *tx_packet_p)
+{
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
 
-    tx_packet_p->state_flags = NET_PACKET_IN_TX_USE_BY_APP;
-    if (free_after_tx_complete) {
-        tx_packet_p->state_flags |= NET_PACKET_FREE_AFTER_TX_COMPLETE;
+    net_layer2_count_drop(NET_LAYER2_DROP_TX_LINK_DOWN);
+    if (tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
     }
-
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
-    return tx_packet_p;
 }
 
 
 /**
- * Frees a Tx packet back to the global Tx packet pool
+ * Pauses or resumes Tx for a layer-2 end point. When Tx is paused, the
+ * frames waiting in the Tx class queues are discarded.
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
+ * @param link_down             true, if the Ethernet link went down
  */
-void net_layer2_free_tx_packet(struct network_packet *tx_packet_p)
+static void net_layer2_tx_scheduler_set_link_down(
+    struct net_layer2_end_point *layer2_end_point_p,
+    bool link_down)
 {
-    struct net_tx_packet_pool *const free_tx_packet_pool_p =
-         &g_net_layer2.free_tx_packet_pool;
-
-#    ifdef USE_MPU
-    bool comp_region_changed = false;
-    struct mpu_region_range old_comp_region;
+    struct net_layer2_tx_scheduler *const tx_scheduler_p =
+        &layer2_end_point_p->tx_scheduler;
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    tx_scheduler_p->link_down = link_down;
+    if (link_down && !tx_scheduler_p->loopback_on) {
+        for (unsigned int i = 0; i < ARRAY_SIZE(tx_scheduler_p->class_queues); i ++) {
+            struct net_layer2_tx_class_queue *class_queue_p =
+                &tx_scheduler_p->class_queues[i];
+
+            struct network_packet *tx_packet_p;
+
+            while (net_layer2_tx_packet_ring_get(&class_queue_p->tx_packet_ring,
+                                                 &tx_packet_p)) {
+                NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+                net_layer2_tx_scheduler_discard(tx_packet_p);
+            }
+        }
 
-    if (CALLER_IS_THREAD()) {
-        rtos_thread_set_comp_region(free_tx_packet_pool_p,
-                                    sizeof *free_tx_packet_pool_p,
-                                    0,
-                                    &old_comp_region);
-        comp_region_changed = true;
+        tx_scheduler_p->backlog = 0;
     }
-#    endif
-
-    D_ASSERT(g_net_layer2.initialized);
-    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
-    D_ASSERT(tx_packet_p->state_flags == NET_PACKET_IN_TX_USE_BY_APP);
-    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
-
-    tx_packet_p->state_flags = NET_PACKET_IN_TX_POOL;
-    net_packet_queue_add(&free_tx_packet_pool_p->free_list, tx_packet_p);
 
-#    ifdef USE_MPU
-    if (comp_region_changed) {
-        rtos_thread_restore_comp_region(&old_comp_region);
-    }
-#    endif
+    restore_cpu_interrupts(int_mask);
 }
 
 
 /**
- * Dequeues a Rx packet from a given layer-2 end point's Rx packet queue
+ * Configures the Ethernet MAC of a layer-2 end point for the link mode
+ * negotiated by its PHY. A duplex mismatch with the link partner does not
+ * prevent the link from coming up, but causes late collisions and CRC
+ * errors that collapse throughput.
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
  */
-void net_layer2_dequeue_rx_packet(
-        struct net_layer2_end_point *layer2_end_point_p,
-        struct network_packet **rx_packet_pp)
+static void net_layer2_apply_link_mode(struct net_layer2_end_point *layer2_end_point_p)
 {
-    struct network_packet *rx_packet_p = NULL;
-
-    D_ASSERT(CALLER_IS_THREAD());
-
-#   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
+    const struct ethernet_mac_device *const ethernet_mac_p =
+        layer2_end_point_p->ethernet_mac_p;
+    struct ethernet_phy_link_mode link_mode;
 
-    rtos_thread_set_comp_region(layer2_end_point_p,
-                                sizeof *layer2_end_point_p,
-                                0,
-                                &old_comp_region);
-#   endif
+    if (!ethernet_phy_get_link_mode(ethernet_mac_p->ethernet_phy_p, &link_mode)) {
+        return;
+    }
 
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    ethernet_mac_set_link_mode(ethernet_mac_p, &link_mode);
+    INFO_PRINTF("Net layer2: Link mode %s Mb/s %s duplex%s for MAC %s\n",
+                link_mode.speed_100_mbps ? "100" : "10",
+                link_mode.full_duplex ? "full" : "half",
+                link_mode.pause ? ", flow control" : "",
+                ethernet_mac_p->name_p);
+}
 
-    rx_packet_p = net_packet_queue_remove(&layer2_end_point_p->rx_packet_queue, 0);
 
-    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
-    D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_QUEUE);
-    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+/**
+ * Updates the cached link state of a layer-2 end point. When the link goes
+ * down, Tx is paused and the ARP cache is flushed, as the neighbors may be
+ * different when the link comes back up (for example, if the cable was
+ * moved to another switch). When the link comes up, the MAC is configured
+ * for the newly negotiated link mode before Tx is resumed.
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
+ * @param link_up               New link state
+ */
+static void net_layer2_link_state_changed(struct net_layer2_end_point *layer2_end_point_p,
+                                          bool link_up)
+{
+    if (link_up) {
+        net_layer2_apply_link_mode(layer2_end_point_p);
+    }
 
-    rx_packet_p->state_flags &= ~NET_PACKET_IN_RX_QUEUE;
-    rx_packet_p->state_flags |= NET_PACKET_IN_RX_USE_BY_APP;
-    *rx_packet_pp = rx_packet_p;
+    layer2_end_point_p->link_is_up = link_up;
+    ATOMIC_POST_INCREMENT_UINT32(&layer2_end_point_p->link_change_count);
+    net_layer2_tx_scheduler_set_link_down(layer2_end_point_p, !link_up);
+    if (!link_up) {
+        net_layer3_flush_arp_cache(layer2_end_point_p->layer3_end_point_p);
+    }
 
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+    INFO_PRINTF("Net layer2: Link %s for MAC %s\n",
+                link_up ? "up" : "down",
+                layer2_end_point_p->ethernet_mac_p->name_p);
 }
 
 
 /**
- * Enqueue a Rx packet to a given layer-2 end point's Rx packet queue
+ * Callback of the link monitor timer of a layer-2 end point. It runs in the
+ * network timer wheel's task. A link event seen while the link was up is
+ * handled as the link going down, even if the link is already back up, as
+ * the link may have flapped between two checks.
  */
-void net_layer2_enqueue_rx_packet(
-        struct net_layer2_end_point *layer2_end_point_p,
-        struct network_packet *rx_packet_p)
+static void net_layer2_link_monitor_timer_callback(struct timer_wheel_timer *timer_p,
+                                                   void *arg)
 {
-#   ifdef USE_MPU
-    bool comp_region_changed = false;
-    struct mpu_region_range old_comp_region;
-
-    if (CALLER_IS_THREAD()) {
-        rtos_thread_set_comp_region(layer2_end_point_p,
-                                    sizeof *layer2_end_point_p,
-                                    0,
-                                    &old_comp_region);
-        comp_region_changed = true;
-    }
-#   endif
+    struct net_layer2_end_point *const layer2_end_point_p =
+        (struct net_layer2_end_point *)arg;
+    bool link_up;
 
     D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
-    D_ASSERT(rx_packet_p->state_flags == 0);
-    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+    if (ethernet_phy_get_link_change(layer2_end_point_p->ethernet_mac_p->ethernet_phy_p,
+                                     &link_up)) {
+        if (layer2_end_point_p->link_is_up) {
+            net_layer2_link_state_changed(layer2_end_point_p, false);
+        }
 
-    rx_packet_p->state_flags |= NET_PACKET_IN_RX_QUEUE;
-    net_packet_queue_add(&layer2_end_point_p->rx_packet_queue, rx_packet_p);
+        if (link_up) {
+            net_layer2_link_state_changed(layer2_end_point_p, true);
+        }
+    }
 
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+    timer_wheel_timer_arm(&g_net_timer_wheel, timer_p,
+                          NET_LAYER2_LINK_MONITOR_PERIOD_MS);
 }
 
 
 /**
- * Recycle a Rx packet for receiving another packet from the
- * corresponding layer-2 end point
+ * Initialize a given layer-2 end point
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
  */
-void net_recycle_rx_packet(struct network_packet *rx_packet_p)
+static void net_layer2_end_point_init(struct net_layer2_end_point *layer2_end_point_p)
 {
     D_ASSERT(CALLER_IS_THREAD());
 
@@ -651,30 +1024,1979 @@ void net_recycle_rx_packet(struct network_packet *rx_packet_p)
                                 &old_comp_region);
 #   endif
 
-    struct net_layer2_end_point *layer2_end_point_p = rx_packet_p->layer2_end_point_p;
-
     D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
-    D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP);
+    D_ASSERT(!layer2_end_point_p->initialized);
+
+    unsigned int end_point_index =
+        layer2_end_point_p - &g_net_layer2.local_layer2_end_points[0];
+
+    D_ASSERT(end_point_index < NUM_NET_LAYER2_END_POINTS);
+
+    build_local_mac_address(end_point_index, &layer2_end_point_p->mac_address);
+
+    INFO_PRINTF("Net layer2: Generated MAC address %02x:%02x:%02x:%02x:%02x:%02x for MAC %s\n",
+                layer2_end_point_p->mac_address.bytes[0],
+                layer2_end_point_p->mac_address.bytes[1],
+                layer2_end_point_p->mac_address.bytes[2],
+                layer2_end_point_p->mac_address.bytes[3],
+                layer2_end_point_p->mac_address.bytes[4],
+                layer2_end_point_p->mac_address.bytes[5],
+                layer2_end_point_p->ethernet_mac_p->name_p);
+
+    net_packet_spsc_queue_init("Layer-2 Rx network packet queue",
+                               &layer2_end_point_p->rx_packet_queue);
+
+    rtos_semaphore_init(&layer2_end_point_p->rx_poll_semaphore,
+                        "Layer-2 Rx poll semaphore", 0);
+
+    layer2_end_point_p->rx_packets_in_use_count = 0;
+    layer2_end_point_p->rx_packets_in_use_high_water_mark = 0;
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(layer2_end_point_p->rx_dispatch_queues);
+         i ++) {
+        struct net_layer2_rx_dispatch_queue *rx_dispatch_queue_p =
+            &layer2_end_point_p->rx_dispatch_queues[i];
+
+        net_packet_queue_init(g_net_layer2_rx_dispatch_queue_configs[i].task_name_p,
+                              false,
+                              &rx_dispatch_queue_p->rx_packet_queue);
+        rx_dispatch_queue_p->rx_packets_dropped_count = 0;
+    }
+
+    struct net_layer2_tx_scheduler *const tx_scheduler_p =
+        &layer2_end_point_p->tx_scheduler;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(tx_scheduler_p->class_queues); i ++) {
+        struct net_layer2_tx_class_queue *class_queue_p =
+            &tx_scheduler_p->class_queues[i];
+
+        net_layer2_tx_packet_ring_init(&class_queue_p->tx_packet_ring);
+        class_queue_p->length_high_water_mark = 0;
+        class_queue_p->credits = g_net_layer2_tx_class_weights[i];
+        class_queue_p->sent_count = 0;
+        class_queue_p->deferred_count = 0;
+    }
+
+    tx_scheduler_p->backlog = 0;
+    tx_scheduler_p->current_wrr_class = NET_LAYER2_TX_CLASS_NORMAL;
+    tx_scheduler_p->link_down = false;
+    tx_scheduler_p->loopback_on = false;
+    layer2_end_point_p->link_is_up = false;
+    layer2_end_point_p->link_change_count = 0;
+
+    /*
+     * Rx packets are taken from the shared Rx packet pool. By default, enough
+     * of them are reserved for this end point to fill its Ethernet MAC's Rx
+     * ring:
+     */
+    layer2_end_point_p->rx_packets_held_count = 0;
+    layer2_end_point_p->rx_packets_reserved_count =
+        layer2_end_point_p->ethernet_mac_p->rx_ring_num_entries;
+
+    /*
+     * Initialize Rx copybreak packets:
+     */
+    net_packet_free_list_init("Rx copybreak packet pool",
+                              &layer2_end_point_p->rx_copybreak_free_list);
+    layer2_end_point_p->rx_copybreak_count = 0;
+    layer2_end_point_p->rx_copybreak_misses_count = 0;
+    layer2_end_point_p->rx_copybreak_in_use_high_water_mark = 0;
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(layer2_end_point_p->rx_copybreak_packets);
+         i ++) {
+        struct network_packet *rx_packet_p =
+            &layer2_end_point_p->rx_copybreak_packets[i];
+
+        rx_packet_p->signature = NET_RX_PACKET_SIGNATURE;
+        rx_packet_p->data_buffer =
+            g_net_packet_data_buffers.rx_copybreak_data_buffers[end_point_index][i];
+        rx_packet_p->data_buffer_size = NET_PACKET_SMALL_DATA_BUFFER_SIZE;
+        rx_packet_p->state_flags = NET_PACKET_IN_RX_SPARE_POOL;
+        rx_packet_p->rx_buf_desc_p = NULL;
+        rx_packet_p->rx_checksum_flags = 0;
+        rx_packet_p->rx_header_length = 0;
+        rx_packet_p->timestamp_flags = 0;
+        rx_packet_p->owner_task_p = NULL;
+        rx_packet_p->layer2_end_point_p = layer2_end_point_p;
+        rx_packet_p->next_fragment_p = NULL;
+        rx_packet_p->ipv4_reassembly_buffer_p = NULL;
+        rx_packet_p->headroom = 0;
+        rx_packet_p->ref_count = 1;
+        rx_packet_p->clone_of_p = NULL;
+        rx_packet_p->queue_p = NULL;
+        rx_packet_p->next_p = NULL;
+        net_packet_free_list_add(&layer2_end_point_p->rx_copybreak_free_list,
+                                 rx_packet_p);
+    }
+
+    /*
+     * Initialize Rx packet clones:
+     */
+    net_packet_free_list_init("Rx packet clone pool",
+                              &layer2_end_point_p->rx_clone_free_list);
+    layer2_end_point_p->rx_clone_misses_count = 0;
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(layer2_end_point_p->rx_packet_clones);
+         i ++) {
+        struct network_packet *clone_p = &layer2_end_point_p->rx_packet_clones[i];
+
+        clone_p->signature = NET_RX_PACKET_SIGNATURE;
+        clone_p->data_buffer = NULL;
+        clone_p->data_buffer_size = 0;
+        clone_p->headroom = 0;
+        clone_p->state_flags = NET_PACKET_IN_RX_SPARE_POOL;
+        clone_p->rx_buf_desc_p = NULL;
+        clone_p->owner_task_p = NULL;
+        clone_p->layer2_end_point_p = layer2_end_point_p;
+        clone_p->next_fragment_p = NULL;
+        clone_p->ipv4_reassembly_buffer_p = NULL;
+        clone_p->ref_count = 1;
+        clone_p->clone_of_p = NULL;
+        clone_p->queue_p = NULL;
+        clone_p->next_p = NULL;
+        net_packet_free_list_add(&layer2_end_point_p->rx_clone_free_list, clone_p);
+    }
+
+    ethernet_mac_init(layer2_end_point_p->ethernet_mac_p,
+                      layer2_end_point_p,
+                      layer2_end_point_p->ethernet_mac_rx_mode,
+                      layer2_end_point_p->ethernet_mac_tx_mode);
+
+    layer2_end_point_p->initialized = true;
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Start packet reception for a given layer-2 end point
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
+ */
+static void net_layer2_end_point_start(struct net_layer2_end_point *layer2_end_point_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(layer2_end_point_p,
+                                sizeof *layer2_end_point_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer2_end_point_p->initialized);
+
+    /*
+     * Start packet reception at the Ethernet MAC:
+     *
+     * NOTE: Packets can start arriving right after this call. If so,
+     * they will sit in the layer-2 end point's incoming queue.
+     */
+    ethernet_mac_start(layer2_end_point_p->ethernet_mac_p);
+
+    /*
+     * Create layer-2 packet receiver task:
+     */
+    rtos_task_create(&layer2_end_point_p->packet_receiver_task,
+                     "Networking layer-2 packet receiver task",
+                     layer2_end_point_p->ethernet_mac_rx_mode ==
+                        ETHERNET_MAC_RX_POLLED_MODE ?
+                            net_layer2_packet_poller_task :
+                            net_layer2_packet_receiver_task,
+                     layer2_end_point_p,
+                     RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 2));
+
+    /*
+     * Create layer-2 Rx dispatch tasks:
+     */
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(layer2_end_point_p->rx_dispatch_queues);
+         i ++) {
+        const struct net_layer2_rx_dispatch_queue_config *config_p =
+            &g_net_layer2_rx_dispatch_queue_configs[i];
+
+        rtos_task_create(&layer2_end_point_p->rx_dispatch_queues[i].handler_task,
+                         config_p->task_name_p,
+                         net_layer2_rx_dispatch_task,
+                         &layer2_end_point_p->rx_dispatch_queues[i],
+                         config_p->task_priority);
+    }
+
+    /*
+     * Start the link monitor, from the current link state:
+     */
+    bool link_up = ethernet_phy_link_is_up(layer2_end_point_p->ethernet_mac_p->ethernet_phy_p);
+
+    if (link_up) {
+        net_layer2_apply_link_mode(layer2_end_point_p);
+    }
+
+    layer2_end_point_p->link_is_up = link_up;
+    layer2_end_point_p->tx_scheduler.link_down = !link_up;
+    timer_wheel_timer_init(&layer2_end_point_p->link_monitor_timer,
+                           net_layer2_link_monitor_timer_callback,
+                           layer2_end_point_p);
+    timer_wheel_timer_arm(&g_net_timer_wheel,
+                          &layer2_end_point_p->link_monitor_timer,
+                          NET_LAYER2_LINK_MONITOR_PERIOD_MS);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Tell if the Ethernet link is up for a given Ethernet port
+ *
+ * @param layer2_end_point_p	Pointer to layer-2 end point
+ *
+ * @return true, link is up
+ * @return false, link is down
+ */
+bool net_layer2_end_point_link_is_up(
+            const struct net_layer2_end_point *layer2_end_point_p)
+{
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer2_end_point_p->initialized);
+
+    /*
+     * NOTE: The link state is cached by the link monitor, so that callers
+     * do not need to do an MDIO transfer:
+     */
+    return layer2_end_point_p->link_is_up;
+}
+
+
+/**
+ * Set loopback mode on/off for a given given Ethernet port
+ *
+ * @param layer2_end_point_p	Pointer to layer-2 end point
+ * @param on					boolean flag: true (on), false (off)
+ */
+void net_layer2_end_point_set_loopback(
+	const struct net_layer2_end_point *layer2_end_point_p,
+	bool on)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(layer2_end_point_p,
+                                sizeof *layer2_end_point_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer2_end_point_p->initialized);
+
+    const struct ethernet_mac_device *ethernet_mac_p =
+        layer2_end_point_p->ethernet_mac_p;
+
+    D_ASSERT(ethernet_mac_p->signature == ETHERNET_MAC_DEVICE_SIGNATURE);
+
+    ethernet_phy_set_loopback(ethernet_mac_p->ethernet_phy_p, on);
+    net_layer2_get_tx_scheduler(layer2_end_point_p)->loopback_on = on;
+
+    INFO_PRINTF("Layer2: Set loopback mode %s for MAC %s\n",
+    		    on ? "on" : "off",
+    		    ethernet_mac_p->name_p);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Sets the IEEE 802.1Q VLAN of a given Ethernet port. Outgoing frames are
+ * tagged with the VLAN ID and received frames tagged for other VLANs are
+ * dropped.
+ *
+ * @param layer2_end_point_p	Pointer to layer-2 end point
+ * @param vlan_id				VLAN ID (1 .. ETHERNET_MAX_VLAN_ID), or
+ *                              NET_LAYER2_NO_VLAN to send untagged frames
+ * @param default_tx_pcp		Priority code point for outgoing frames whose
+ *                              Tx packet does not specify one
+ */
+void net_layer2_end_point_set_vlan(
+	struct net_layer2_end_point *layer2_end_point_p,
+	uint16_t vlan_id,
+	uint8_t default_tx_pcp)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(vlan_id <= ETHERNET_MAX_VLAN_ID);
+    D_ASSERT(default_tx_pcp < ETHERNET_NUM_VLAN_PCPS);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(layer2_end_point_p,
+                                sizeof *layer2_end_point_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    layer2_end_point_p->vlan_default_tx_pcp = default_tx_pcp;
+    layer2_end_point_p->vlan_id = vlan_id;
+
+    INFO_PRINTF("Layer2: Set VLAN ID %u (default Tx priority %u) for MAC %s\n",
+    		    vlan_id, default_tx_pcp,
+    		    layer2_end_point_p->ethernet_mac_p->name_p);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Set promiscuous mode on/off for a given given Ethernet port. When off,
+ * the Ethernet MAC hardware only receives frames addressed to this port.
+ *
+ * @param layer2_end_point_p	Pointer to layer-2 end point
+ * @param on					boolean flag: true (on), false (off)
+ */
+void net_layer2_end_point_set_promiscuous(
+	const struct net_layer2_end_point *layer2_end_point_p,
+	bool on)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(layer2_end_point_p,
+                                sizeof *layer2_end_point_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer2_end_point_p->initialized);
+
+    const struct ethernet_mac_device *ethernet_mac_p =
+        layer2_end_point_p->ethernet_mac_p;
+
+    ethernet_mac_set_promiscuous_mode(ethernet_mac_p, on);
+
+    INFO_PRINTF("Layer2: Set promiscuous mode %s for MAC %s\n",
+    		    on ? "on" : "off",
+    		    ethernet_mac_p->name_p);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Obtain the MAC address associated with a layer-2 end point
+ *
+ * @param layer2_end_point_p    Pointer to Layer-2 end point
+ * @param mac_addr_p            Area where MAC address is to be returned
+ */
+void net_layer2_get_mac_addr(const struct net_layer2_end_point *layer2_end_point_p,
+                             struct ethernet_mac_address *mac_addr_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(layer2_end_point_p,
+                                sizeof *layer2_end_point_p,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(mac_addr_p, sizeof *mac_addr_p, 0);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer2_end_point_p->initialized);
+
+    COPY_MAC_ADDRESS(mac_addr_p, &layer2_end_point_p->mac_address);
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Initializes global pool of free Tx packets
+ */
+static void net_layer2_init_tx_packet_pool(struct net_tx_packet_pool *tx_packet_pool_p,
+                                           struct net_packet_data_buffers *data_buffers_p)
+{
+    net_packet_free_list_init("Large Tx packet pool",
+                              &tx_packet_pool_p->large_free_list);
+
+    net_packet_free_list_init("Small Tx packet pool",
+                              &tx_packet_pool_p->small_free_list);
+
+    tx_packet_pool_p->allocated_high_water_mark = 0;
+    for (unsigned int i = 0; i < ARRAY_SIZE(tx_packet_pool_p->reservations); i ++) {
+        struct net_tx_packet_reservation *reservation_p =
+            &tx_packet_pool_p->reservations[i];
+
+        reservation_p->task_p = NULL;
+        reservation_p->num_packets = 0;
+        net_packet_free_list_init("Reserved Tx packet pool",
+                                  &reservation_p->free_list);
+    }
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(tx_packet_pool_p->tx_packets);
+         i ++) {
+        struct network_packet *const tx_packet_p =
+            &tx_packet_pool_p->tx_packets[i];
+
+        tx_packet_p->signature = NET_TX_PACKET_SIGNATURE;
+        tx_packet_p->state_flags = NET_PACKET_IN_TX_POOL;
+        tx_packet_p->tx_buf_desc_p = NULL;
+        tx_packet_p->layer2_end_point_p = NULL;
+        tx_packet_p->owner_task_p = NULL;
+        tx_packet_p->tx_reservation_p = NULL;
+        tx_packet_p->queue_p = NULL;
+        tx_packet_p->next_p = NULL;
+        tx_packet_p->headroom = 0;
+
+        if (i < NET_MAX_LARGE_TX_PACKETS) {
+            tx_packet_p->data_buffer = data_buffers_p->large_tx_data_buffers[i];
+            tx_packet_p->data_buffer_size = NET_PACKET_DATA_BUFFER_SIZE;
+            net_packet_free_list_add(&tx_packet_pool_p->large_free_list, tx_packet_p);
+        } else {
+            tx_packet_p->data_buffer =
+                data_buffers_p->small_tx_data_buffers[i - NET_MAX_LARGE_TX_PACKETS];
+            tx_packet_p->data_buffer_size = NET_PACKET_SMALL_DATA_BUFFER_SIZE;
+            net_packet_free_list_add(&tx_packet_pool_p->small_free_list, tx_packet_p);
+        }
+    }
+}
+
+
+/**
+ * Initializes the pool of Rx packets shared by all layer-2 end points
+ */
+static void net_layer2_init_rx_packet_pool(struct net_rx_packet_pool *rx_packet_pool_p,
+                                           struct net_packet_data_buffers *data_buffers_p)
+{
+    rx_packet_pool_p->free_count = 0;
+    rx_packet_pool_p->take_denied_count = 0;
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(rx_packet_pool_p->rx_packets);
+         i ++) {
+        struct network_packet *rx_packet_p = &rx_packet_pool_p->rx_packets[i];
+
+        rx_packet_p->signature = NET_RX_PACKET_SIGNATURE;
+        rx_packet_p->data_buffer = data_buffers_p->rx_data_buffers[i];
+        rx_packet_p->data_buffer_size = NET_PACKET_DATA_BUFFER_SIZE;
+        rx_packet_p->state_flags = NET_PACKET_IN_RX_SPARE_POOL;
+        rx_packet_p->rx_buf_desc_p = NULL;
+        rx_packet_p->rx_checksum_flags = 0;
+        rx_packet_p->rx_header_length = 0;
+        rx_packet_p->timestamp_flags = 0;
+        rx_packet_p->owner_task_p = NULL;
+        rx_packet_p->layer2_end_point_p = NULL;
+        rx_packet_p->next_fragment_p = NULL;
+        rx_packet_p->ipv4_reassembly_buffer_p = NULL;
+        rx_packet_p->headroom = 0;
+        rx_packet_p->ref_count = 1;
+        rx_packet_p->clone_of_p = NULL;
+        rx_packet_p->queue_p = NULL;
+        rx_packet_p->next_p = NULL;
+
+        rx_packet_pool_p->free_packets[rx_packet_pool_p->free_count] = rx_packet_p;
+        rx_packet_pool_p->free_count ++;
+    }
+
+    rx_packet_pool_p->free_low_water_mark = rx_packet_pool_p->free_count;
+}
+
+
+/**
+ * Counts the free Rx packets of the shared Rx packet pool that are needed to
+ * honor the Rx packet reservations of the layer-2 end points other than a
+ * given one
+ */
+static uint_fast16_t net_layer2_count_rx_packets_reserved_for_others(
+    const struct net_layer2_end_point *layer2_end_point_p)
+{
+    uint_fast16_t count = 0;
+
+    for (unsigned int i = 0; i < NUM_NET_LAYER2_END_POINTS; i ++) {
+        const struct net_layer2_end_point *other_end_point_p =
+            &g_net_layer2.local_layer2_end_points[i];
+
+        if (other_end_point_p != layer2_end_point_p &&
+            other_end_point_p->rx_packets_held_count <
+                other_end_point_p->rx_packets_reserved_count) {
+            count += other_end_point_p->rx_packets_reserved_count -
+                     other_end_point_p->rx_packets_held_count;
+        }
+    }
+
+    return count;
+}
+
+
+/**
+ * Takes a free Rx packet from the shared Rx packet pool, for a given layer-2
+ * end point to post it to its Ethernet MAC's Rx ring. An end point always
+ * gets a free Rx packet while it holds fewer than its reserved number of Rx
+ * packets. Beyond that, it only gets free Rx packets not needed to honor the
+ * reservations of the other end points, up to NET_MAX_RX_PACKETS.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @param layer2_end_point_p    Pointer to the layer-2 end point
+ *
+ * @return Pointer to the Rx packet taken, with NET_PACKET_IN_RX_SPARE_POOL
+ *         still set, on success
+ * @return NULL, if no free Rx packet can be taken by the end point
+ */
+RAM_FUNC struct network_packet *net_layer2_take_rx_packet(
+    struct net_layer2_end_point *layer2_end_point_p)
+{
+    struct net_rx_packet_pool *const rx_packet_pool_p = &g_net_layer2.rx_packet_pool;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    if (rx_packet_pool_p->free_count == 0) {
+        return NULL;
+    }
+
+    if (layer2_end_point_p->rx_packets_held_count >= NET_MAX_RX_PACKETS ||
+        (layer2_end_point_p->rx_packets_held_count >=
+            layer2_end_point_p->rx_packets_reserved_count &&
+         rx_packet_pool_p->free_count <=
+            net_layer2_count_rx_packets_reserved_for_others(layer2_end_point_p))) {
+        rx_packet_pool_p->take_denied_count ++;
+        return NULL;
+    }
+
+    rx_packet_pool_p->free_count --;
+
+    struct network_packet *rx_packet_p =
+        rx_packet_pool_p->free_packets[rx_packet_pool_p->free_count];
+
+    rx_packet_pool_p->free_packets[rx_packet_pool_p->free_count] = NULL;
+    if (rx_packet_pool_p->free_count < rx_packet_pool_p->free_low_water_mark) {
+        rx_packet_pool_p->free_low_water_mark = rx_packet_pool_p->free_count;
+    }
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_SPARE_POOL);
+    D_ASSERT(rx_packet_p->layer2_end_point_p == NULL);
+
+    rx_packet_p->layer2_end_point_p = layer2_end_point_p;
+    layer2_end_point_p->rx_packets_held_count ++;
+    return rx_packet_p;
+}
+
+
+/**
+ * Gives back an Rx packet to the shared Rx packet pool, so that any layer-2
+ * end point can take it
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ *
+ * @param rx_packet_p   Pointer to the Rx packet, not posted to any Ethernet
+ *                      MAC's Rx ring
+ */
+RAM_FUNC void net_layer2_give_rx_packet(struct network_packet *rx_packet_p)
+{
+    struct net_rx_packet_pool *const rx_packet_pool_p = &g_net_layer2.rx_packet_pool;
+    struct net_layer2_end_point *const layer2_end_point_p =
+        rx_packet_p->layer2_end_point_p;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->data_buffer_size == NET_PACKET_DATA_BUFFER_SIZE);
+    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer2_end_point_p->rx_packets_held_count != 0);
+    D_ASSERT(rx_packet_pool_p->free_count < NET_RX_PACKET_POOL_SIZE);
+
+    layer2_end_point_p->rx_packets_held_count --;
+    rx_packet_p->layer2_end_point_p = NULL;
+    rx_packet_p->state_flags = NET_PACKET_IN_RX_SPARE_POOL;
+    rx_packet_pool_p->free_packets[rx_packet_pool_p->free_count] = rx_packet_p;
+    rx_packet_pool_p->free_count ++;
+}
+
+
+/**
+ * Sets the number of Rx packets of the shared Rx packet pool reserved for a
+ * given layer-2 end point. Reserving fewer Rx packets than the size of the
+ * end point's Ethernet MAC's Rx ring lets other end points starve its Rx
+ * ring under load.
+ *
+ * @param layer2_end_point_p    Pointer to the layer-2 end point
+ * @param num_packets           Number of Rx packets to reserve (at most
+ *                              NET_MAX_RX_PACKETS)
+ *
+ * @return 0, on success
+ * @return error code, on failure. In particular, if the reservations of all
+ *         end points would add up to more than NET_RX_PACKET_POOL_SIZE.
+ */
+error_t net_layer2_end_point_reserve_rx_packets(
+    struct net_layer2_end_point *layer2_end_point_p,
+    uint16_t num_packets)
+{
+    uint_fast16_t total_reserved = num_packets;
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    if (num_packets > NET_MAX_RX_PACKETS) {
+        return CAPTURE_ERROR("Too many Rx packets to reserve",
+                             layer2_end_point_p, num_packets);
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    for (unsigned int i = 0; i < NUM_NET_LAYER2_END_POINTS; i ++) {
+        const struct net_layer2_end_point *other_end_point_p =
+            &g_net_layer2.local_layer2_end_points[i];
+
+        if (other_end_point_p != layer2_end_point_p) {
+            total_reserved += other_end_point_p->rx_packets_reserved_count;
+        }
+    }
+
+    if (total_reserved > NET_RX_PACKET_POOL_SIZE) {
+        restore_cpu_interrupts(int_mask);
+        error = CAPTURE_ERROR("Rx packet reservations exceed the Rx packet pool",
+                              layer2_end_point_p, total_reserved);
+        goto common_exit;
+    }
+
+    layer2_end_point_p->rx_packets_reserved_count = num_packets;
+    restore_cpu_interrupts(int_mask);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Counts the free Tx packets of a Tx packet pool, including the free
+ * reserved ones
+ */
+static uint_fast16_t net_layer2_count_free_tx_packets(
+    const struct net_tx_packet_pool *tx_packet_pool_p)
+{
+    uint_fast16_t count = tx_packet_pool_p->large_free_list.length +
+                          tx_packet_pool_p->small_free_list.length;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(tx_packet_pool_p->reservations); i ++) {
+        count += tx_packet_pool_p->reservations[i].free_list.length;
+    }
+
+    return count;
+}
+
+
+/**
+ * Reclaims Tx packets already transmitted by Ethernet MACs that do not
+ * generate a Tx interrupt for every frame (ETHERNET_MAC_TX_LAZY_RECLAIM_MODE).
+ * Callers that keep a Tx packet after sending it, and need to know if the
+ * transmission has completed (NET_PACKET_IN_TX_TRANSIT cleared), call it
+ * first, as otherwise the packet may stay in the Tx ring until more frames
+ * are sent.
+ */
+void net_layer2_reclaim_lazy_tx_packets(void)
+{
+    for (unsigned int i = 0; i < NUM_NET_LAYER2_END_POINTS; i ++) {
+        struct net_layer2_end_point *layer2_end_point_p =
+            &g_net_layer2.local_layer2_end_points[i];
+
+        if (layer2_end_point_p->ethernet_mac_tx_mode ==
+            ETHERNET_MAC_TX_LAZY_RECLAIM_MODE) {
+            ethernet_mac_reclaim_tx_packets(layer2_end_point_p->ethernet_mac_p);
+        }
+    }
+}
+
+
+/**
+ * Global initialization of networking layer 2
+ */
+void net_layer2_init(void)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(!g_net_layer2.initialized);
+    net_layer2_init_tx_packet_pool(&g_net_layer2.free_tx_packet_pool,
+                                   &g_net_packet_data_buffers);
+    net_layer2_init_rx_packet_pool(&g_net_layer2.rx_packet_pool,
+                                   &g_net_packet_data_buffers);
+
+#   ifdef USE_MPU
+    /*
+     * Enable access to Rx/Tx buffers memory for the ENET DMA engine:
+     */
+    ethernet_mac_register_dma_region(&g_net_packet_data_buffers,
+                                     sizeof g_net_packet_data_buffers);
+#   endif
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer2.local_layer2_end_points);
+         i ++) {
+        net_layer2_end_point_init(&g_net_layer2.local_layer2_end_points[i]);
+    }
+
+    g_net_layer2.initialized = true;
+
+    DEBUG_PRINTF("Networking layer 2 initialized\n");
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+
+/**
+ * Logs a summary line for each drop reason whose count has changed since it
+ * was last reported, as long as there are tokens left in the drop log token
+ * bucket. Reasons that cannot be reported for lack of tokens are reported
+ * in a later period, with their accumulated count.
+ */
+static void net_layer2_drop_report_timer_callback(struct rtos_timer *timer_p,
+                                                  void *arg)
+{
+    D_ASSERT(timer_p->tmr_signature == TIMER_SIGNATURE);
+
+    uint32_t now_ticks = rtos_get_ticks_since_boot();
+
+    g_net_layer2.drop_log_tokens += NET_LAYER2_DROP_LOG_TOKENS_PER_PERIOD;
+    if (g_net_layer2.drop_log_tokens > NET_LAYER2_DROP_LOG_MAX_TOKENS) {
+        g_net_layer2.drop_log_tokens = NET_LAYER2_DROP_LOG_MAX_TOKENS;
+    }
+
+    for (unsigned int i = 0; i < NUM_NET_LAYER2_DROP_REASONS; i ++) {
+        if (g_net_layer2.drop_log_tokens == 0) {
+            break;
+        }
+
+        uint32_t count = g_net_layer2.drop_counts[i];
+        uint32_t delta = count - g_net_layer2.drop_counts_reported[i];
+
+        if (delta == 0) {
+            g_net_layer2.drop_reported_ticks[i] = now_ticks;
+            continue;
+        }
+
+        ERROR_PRINTF("Net layer2: %u dropped for reason '%s' in the last %u ms\n",
+                     delta, g_net_layer2_drop_reason_names[i],
+                     RTOS_TICKS_TO_MILLISECONDS(
+                        RTOS_TICKS_DELTA(g_net_layer2.drop_reported_ticks[i],
+                                         now_ticks)));
+
+        g_net_layer2.drop_counts_reported[i] = count;
+        g_net_layer2.drop_reported_ticks[i] = now_ticks;
+        g_net_layer2.drop_log_tokens --;
+    }
+}
+
+
+/**
+ * Counts a drop for the given reason. Since this is called from the Rx/Tx
+ * fast path, including interrupt handlers, nothing is logged here. Drops are
+ * summarized in the error log, once per NET_LAYER2_DROP_REPORT_PERIOD_MS at
+ * most, by net_layer2_drop_report_timer_callback().
+ *
+ * @param reason    Drop reason
+ */
+void net_layer2_count_drop(enum net_layer2_drop_reasons reason)
+{
+    D_ASSERT(reason < NUM_NET_LAYER2_DROP_REASONS);
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer2.drop_counts[reason]);
+}
+
+
+/**
+ * Registers a UDP port whose datagrams are never shed under Rx overload
+ * (see enum net_layer2_rx_shed_classes), such as the port of a control or
+ * management protocol that must stay reachable during a flood
+ *
+ * @param port  UDP destination port (big endian)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer2_add_rx_critical_udp_port(uint16_t port)
+{
+    error_t error;
+    uint32_t int_mask;
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    int_mask = disable_cpu_interrupts();
+    uint_fast8_t num_ports = g_net_layer2.num_rx_critical_udp_ports;
+
+    if (net_layer2_is_rx_critical_udp_port(port)) {
+        error = 0;
+    } else if (num_ports == NET_LAYER2_MAX_RX_CRITICAL_UDP_PORTS) {
+        error = CAPTURE_ERROR("Too many critical UDP ports", port, num_ports);
+    } else {
+        g_net_layer2.rx_critical_udp_ports[num_ports] = port;
+        __DMB();
+        g_net_layer2.num_rx_critical_udp_ports = num_ports + 1;
+        error = 0;
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Returns the number of received frames shed under overload so far, for
+ * each load-shedding class
+ *
+ * @param shed_counts   area where the counts are to be returned, indexed by
+ *                      enum net_layer2_rx_shed_classes
+ */
+void net_layer2_get_rx_shed_counts(uint32_t shed_counts[NUM_NET_LAYER2_RX_SHED_CLASSES])
+{
+    for (uint_fast8_t i = 0; i < NUM_NET_LAYER2_RX_SHED_CLASSES; i ++) {
+        shed_counts[i] = g_net_layer2.rx_shed_counts[i];
+    }
+}
+
+
+/**
+ * Start packet reception for networking layer 2
+ */
+void net_layer2_start(void)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(g_net_layer2.initialized);
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer2.local_layer2_end_points);
+         i ++) {
+        net_layer2_end_point_start(&g_net_layer2.local_layer2_end_points[i]);
+    }
+
+    g_net_layer2.drop_log_tokens = NET_LAYER2_DROP_LOG_MAX_TOKENS;
+    rtos_timer_init(&g_net_layer2.drop_report_timer,
+                    "Networking layer-2 drop report timer",
+                    NET_LAYER2_DROP_REPORT_PERIOD_MS,
+                    true, net_layer2_drop_report_timer_callback, NULL);
+
+    rtos_timer_start(&g_net_layer2.drop_report_timer);
+
+    g_net_layer2.initialized = true;
+
+    DEBUG_PRINTF("Networking layer 2 started\n");
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Finds the Tx packet reservation of the calling task
+ *
+ * @return pointer to the reservation, or NULL if the calling task has no
+ *         Tx packet reservation
+ */
+static struct net_tx_packet_reservation *net_layer2_find_tx_packet_reservation(
+    struct net_tx_packet_pool *tx_packet_pool_p)
+{
+    struct rtos_task *const task_p = rtos_task_self();
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(tx_packet_pool_p->reservations); i ++) {
+        struct net_tx_packet_reservation *reservation_p =
+            &tx_packet_pool_p->reservations[i];
+
+        if (reservation_p->task_p == task_p) {
+            return reservation_p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Common logic for allocating a Tx packet from layer-2's global Tx packet
+ * pool.
+ *
+ * If the calling task has a Tx packet reservation, the packet is taken from
+ * it first. Otherwise, or if all the reserved packets are in use, the packet
+ * is taken from the shared free lists: a Tx packet with a small data buffer
+ * is used if frame_length fits in it and there is one free. Otherwise, a Tx
+ * packet with a full-size data buffer is used.
+ *
+ * @param frame_length: maximum length in bytes of the Ethernet frame to be
+ *                      built in the Tx packet, including the Ethernet header
+ * @param free_after_tx_complete: true if the Tx packet is to be returned to
+ *                                the pool once it has been transmitted
+ * @param timeout_ms: 0, or timeout (in milliseconds) for waiting for a
+ *                    Tx packet to become available
+ * @param no_wait: true if the caller does not want to wait at all, if there
+ *                 are no free Tx packets of a suitable size
+ *
+ * @return pointer to the allocated Tx packet, or NULL if none was available
+ *         within the given timeout
+ */
+static struct network_packet *net_layer2_allocate_tx_packet_internal(
+    size_t frame_length,
+    bool free_after_tx_complete,
+    uint32_t timeout_ms,
+    bool no_wait)
+{
+    struct network_packet *tx_packet_p = NULL;
+    struct net_tx_packet_pool *const free_tx_packet_pool_p =
+         &g_net_layer2.free_tx_packet_pool;
+    struct net_packet_free_list *free_list_p;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#    ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#    endif
+
+    D_ASSERT(g_net_layer2.initialized);
+    D_ASSERT(frame_length <= NET_PACKET_DATA_BUFFER_SIZE);
+
+    struct net_tx_packet_reservation *reservation_p =
+        net_layer2_find_tx_packet_reservation(free_tx_packet_pool_p);
+
+    if (reservation_p != NULL) {
+        if (reservation_p->free_list.length == 0) {
+            net_layer2_reclaim_lazy_tx_packets();
+        }
+
+        tx_packet_p = net_packet_free_list_try_remove(&reservation_p->free_list);
+        if (tx_packet_p != NULL) {
+            goto got_packet;
+        }
+    }
+
+    /*
+     * Leave room for the Tx headroom, where a VLAN tag is inserted in case
+     * the frame is sent from a layer-2 end point that is in a VLAN:
+     */
+    if (frame_length + NET_PACKET_TX_HEADROOM <= NET_PACKET_SMALL_DATA_BUFFER_SIZE) {
+        if (free_tx_packet_pool_p->small_free_list.length == 0 &&
+            free_tx_packet_pool_p->large_free_list.length == 0) {
+            net_layer2_reclaim_lazy_tx_packets();
+        }
+
+        /*
+         * Fall back to a large Tx packet only if there is no small one
+         * available:
+         */
+        if (free_tx_packet_pool_p->small_free_list.length == 0 &&
+            free_tx_packet_pool_p->large_free_list.length != 0) {
+            free_list_p = &free_tx_packet_pool_p->large_free_list;
+        } else {
+            free_list_p = &free_tx_packet_pool_p->small_free_list;
+        }
+    } else {
+        if (free_tx_packet_pool_p->large_free_list.length == 0) {
+            net_layer2_reclaim_lazy_tx_packets();
+        }
+
+        free_list_p = &free_tx_packet_pool_p->large_free_list;
+    }
+
+    if (no_wait) {
+        tx_packet_p = net_packet_free_list_try_remove(free_list_p);
+    } else {
+        uint32_t start_ticks = rtos_get_ticks_since_boot();
+
+        /*
+         * Wait in bounded slices, reclaiming lazily reclaimed Tx packets
+         * on every pass, as the MAC may not raise another Tx interrupt
+         * for the frames that are still in its Tx ring:
+         */
+        for ( ; ; ) {
+            uint32_t wait_ms = NET_LAYER2_TX_PACKET_WAIT_RECLAIM_PERIOD_MS;
+
+            if (timeout_ms != 0) {
+                uint32_t elapsed_ms = RTOS_TICKS_TO_MILLISECONDS(
+                    RTOS_TICKS_DELTA(start_ticks, rtos_get_ticks_since_boot()));
+
+                if (elapsed_ms >= timeout_ms) {
+                    break;
+                }
+
+                if (timeout_ms - elapsed_ms < wait_ms) {
+                    wait_ms = timeout_ms - elapsed_ms;
+                }
+            }
+
+            tx_packet_p = net_packet_free_list_remove(free_list_p, wait_ms);
+            if (tx_packet_p != NULL) {
+                break;
+            }
+
+            net_layer2_reclaim_lazy_tx_packets();
+        }
+    }
+
+    if (tx_packet_p == NULL) {
+        goto exit;
+    }
+
+got_packet:
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->state_flags == NET_PACKET_IN_TX_POOL);
+    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
+    D_ASSERT(tx_packet_p->data_buffer_size >= frame_length + NET_PACKET_TX_HEADROOM);
+    D_ASSERT(tx_packet_p->headroom == 0);
+
+    net_packet_reserve_headroom(tx_packet_p, NET_PACKET_TX_HEADROOM);
+    tx_packet_p->state_flags = NET_PACKET_IN_TX_USE_BY_APP;
+    tx_packet_p->timestamp_flags = 0;
+    tx_packet_p->vlan_pcp = NET_PACKET_VLAN_PCP_DEFAULT;
+    if (free_after_tx_complete) {
+        NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+    }
+
+    net_packet_set_owner(tx_packet_p);
+
+    uint16_t allocated_count = NET_MAX_TX_PACKETS -
+                               net_layer2_count_free_tx_packets(free_tx_packet_pool_p);
+
+    if (allocated_count > free_tx_packet_pool_p->allocated_high_water_mark) {
+        free_tx_packet_pool_p->allocated_high_water_mark = allocated_count;
+    }
+
+exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+    return tx_packet_p;
+}
+
+
+/**
+ * Allocates a Tx packet from layer-2's global Tx packet pool.
+ * If there are no free Tx packets of a suitable size, it waits until one
+ * becomes available.
+ *
+ * @param frame_length: maximum length in bytes of the Ethernet frame to be
+ *                      built in the Tx packet, including the Ethernet header
+ * @param free_after_tx_complete: true if the Tx packet is to be returned to
+ *                                the pool once it has been transmitted
+ *
+ * @return pointer to the allocated Tx packet
+ */
+struct network_packet *net_layer2_allocate_tx_packet(size_t frame_length,
+                                                     bool free_after_tx_complete)
+{
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet_internal(frame_length,
+                                               free_after_tx_complete,
+                                               0, false);
+
+    D_ASSERT(tx_packet_p != NULL);
+    return tx_packet_p;
+}
+
+
+/**
+ * Allocates a Tx packet from layer-2's global Tx packet pool, waiting at most
+ * the given time for one of a suitable size to become available.
+ *
+ * @param frame_length: maximum length in bytes of the Ethernet frame to be
+ *                      built in the Tx packet, including the Ethernet header
+ * @param free_after_tx_complete: true if the Tx packet is to be returned to
+ *                                the pool once it has been transmitted
+ * @param timeout_ms: timeout in milliseconds (must not be 0)
+ *
+ * @return pointer to the allocated Tx packet, or NULL if timeout
+ */
+struct network_packet *net_layer2_allocate_tx_packet_timeout(size_t frame_length,
+                                                             bool free_after_tx_complete,
+                                                             uint32_t timeout_ms)
+{
+    D_ASSERT(timeout_ms != 0);
+    return net_layer2_allocate_tx_packet_internal(frame_length,
+                                                  free_after_tx_complete,
+                                                  timeout_ms, false);
+}
+
+
+/**
+ * Allocates a Tx packet from layer-2's global Tx packet pool, without
+ * waiting.
+ *
+ * @param frame_length: maximum length in bytes of the Ethernet frame to be
+ *                      built in the Tx packet, including the Ethernet header
+ * @param free_after_tx_complete: true if the Tx packet is to be returned to
+ *                                the pool once it has been transmitted
+ *
+ * @return pointer to the allocated Tx packet, or NULL if there are no free
+ *         Tx packets of a suitable size
+ */
+struct network_packet *net_layer2_try_allocate_tx_packet(size_t frame_length,
+                                                         bool free_after_tx_complete)
+{
+    return net_layer2_allocate_tx_packet_internal(frame_length,
+                                                  free_after_tx_complete,
+                                                  0, true);
+}
+
+
+/**
+ * Reserves Tx packets with full-size data buffers for the exclusive use of
+ * the calling task. Tx packets allocated by the task come from its
+ * reservation first, so that critical traffic always has Tx packets
+ * available, while other senders compete for the rest of the pool.
+ *
+ * @param num_packets: number of Tx packets to reserve. At least one Tx packet
+ *                     with a full-size data buffer must remain unreserved.
+ *
+ * @return 0 on success, or error code
+ */
+error_t net_layer2_reserve_tx_packets(uint16_t num_packets)
+{
+    error_t error;
+    struct net_tx_packet_pool *const free_tx_packet_pool_p =
+         &g_net_layer2.free_tx_packet_pool;
+    struct net_tx_packet_reservation *reservation_p;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(num_packets != 0);
+
+#    ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#    endif
+
+    D_ASSERT(g_net_layer2.initialized);
+
+    if (net_layer2_find_tx_packet_reservation(free_tx_packet_pool_p) != NULL) {
+        error = CAPTURE_ERROR("Task already has a Tx packet reservation",
+                              rtos_task_self(), num_packets);
+        goto exit;
+    }
+
+    reservation_p = NULL;
+    for (unsigned int i = 0; i < ARRAY_SIZE(free_tx_packet_pool_p->reservations); i ++) {
+        if (free_tx_packet_pool_p->reservations[i].task_p == NULL) {
+            reservation_p = &free_tx_packet_pool_p->reservations[i];
+            break;
+        }
+    }
+
+    if (reservation_p == NULL) {
+        error = CAPTURE_ERROR("No Tx packet reservations left", num_packets, 0);
+        goto exit;
+    }
+
+    if (num_packets >= free_tx_packet_pool_p->large_free_list.length) {
+        error = CAPTURE_ERROR("Not enough free Tx packets to reserve",
+                              num_packets,
+                              free_tx_packet_pool_p->large_free_list.length);
+        goto exit;
+    }
+
+    for (uint_fast16_t i = 0; i < num_packets; i ++) {
+        struct network_packet *tx_packet_p =
+            net_packet_free_list_try_remove(&free_tx_packet_pool_p->large_free_list);
+
+        D_ASSERT(tx_packet_p != NULL);
+        D_ASSERT(tx_packet_p->state_flags == NET_PACKET_IN_TX_POOL);
+        tx_packet_p->tx_reservation_p = reservation_p;
+        net_packet_free_list_add(&reservation_p->free_list, tx_packet_p);
+    }
+
+    reservation_p->num_packets = num_packets;
+    reservation_p->task_p = rtos_task_self();
+    error = 0;
+
+exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+    return error;
+}
+
+
+/**
+ * Frees a Tx packet back to the global Tx packet pool
+ */
+void net_layer2_free_tx_packet(struct network_packet *tx_packet_p)
+{
+    struct net_tx_packet_pool *const free_tx_packet_pool_p =
+         &g_net_layer2.free_tx_packet_pool;
+
+#    ifdef USE_MPU
+    bool comp_region_changed = false;
+    struct mpu_region_range old_comp_region;
+
+    if (CALLER_IS_THREAD()) {
+        rtos_thread_set_comp_region(free_tx_packet_pool_p,
+                                    sizeof *free_tx_packet_pool_p,
+                                    0,
+                                    &old_comp_region);
+        comp_region_changed = true;
+    }
+#    endif
+
+    D_ASSERT(g_net_layer2.initialized);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(tx_packet_p->state_flags == NET_PACKET_IN_TX_USE_BY_APP);
+    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
+
+    net_packet_reset_headroom(tx_packet_p);
+    tx_packet_p->state_flags = NET_PACKET_IN_TX_POOL;
+    tx_packet_p->owner_task_p = NULL;
+    if (tx_packet_p->tx_reservation_p != NULL) {
+        net_packet_free_list_add(&tx_packet_p->tx_reservation_p->free_list, tx_packet_p);
+    } else if (tx_packet_p->data_buffer_size == NET_PACKET_DATA_BUFFER_SIZE) {
+        net_packet_free_list_add(&free_tx_packet_pool_p->large_free_list, tx_packet_p);
+    } else {
+        D_ASSERT(tx_packet_p->data_buffer_size == NET_PACKET_SMALL_DATA_BUFFER_SIZE);
+        net_packet_free_list_add(&free_tx_packet_pool_p->small_free_list, tx_packet_p);
+    }
+
+#    ifdef USE_MPU
+    if (comp_region_changed) {
+        rtos_thread_restore_comp_region(&old_comp_region);
+    }
+#    endif
+}
+
+
+/**
+ * Takes a snapshot of the usage of layer-2's global Tx packet pool
+ *
+ * @param stats_p: Area where the snapshot is to be returned
+ */
+void net_layer2_get_tx_packet_pool_stats(struct net_packet_pool_stats *stats_p)
+{
+    const struct net_tx_packet_pool *const tx_packet_pool_p =
+         &g_net_layer2.free_tx_packet_pool;
+
+    D_ASSERT(g_net_layer2.initialized);
+
+    stats_p->total_packets = ARRAY_SIZE(tx_packet_pool_p->tx_packets);
+    stats_p->free_packets = 0;
+    stats_p->in_transit_packets = 0;
+    stats_p->queued_packets = 0;
+    stats_p->held_by_app_packets = 0;
+    stats_p->in_use_high_water_mark = tx_packet_pool_p->allocated_high_water_mark;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(tx_packet_pool_p->tx_packets); i ++) {
+        uint16_t state_flags = tx_packet_pool_p->tx_packets[i].state_flags;
+
+        if (state_flags & NET_PACKET_IN_TX_POOL) {
+            stats_p->free_packets ++;
+        } else if (state_flags & NET_PACKET_IN_TX_TRANSIT) {
+            stats_p->in_transit_packets ++;
+        } else if (state_flags &
+                   (NET_PACKET_IN_TX_USE_BY_APP | NET_PACKET_IN_RX_USE_BY_APP)) {
+            /*
+             * NOTE: NET_PACKET_IN_RX_USE_BY_APP is set for Tx packets looped
+             * back by layer 3
+             */
+            stats_p->held_by_app_packets ++;
+        }
+    }
+}
+
+
+/**
+ * Takes a snapshot of the usage of the Rx packets of a given layer-2 end
+ * point. The total and free packet counts are those of the shared Rx packet
+ * pool, and the other counts are those of the Rx packets held by the end
+ * point.
+ *
+ * @param layer2_end_point_p: Pointer to the layer-2 end point
+ * @param stats_p: Area where the snapshot is to be returned
+ */
+void net_layer2_end_point_get_rx_packet_pool_stats(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_packet_pool_stats *stats_p)
+{
+    const struct net_rx_packet_pool *const rx_packet_pool_p =
+        &g_net_layer2.rx_packet_pool;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    stats_p->total_packets = ARRAY_SIZE(rx_packet_pool_p->rx_packets);
+    stats_p->free_packets = rx_packet_pool_p->free_count;
+    stats_p->in_transit_packets = 0;
+    stats_p->queued_packets = 0;
+    stats_p->held_by_app_packets = 0;
+    stats_p->in_use_high_water_mark =
+        layer2_end_point_p->rx_packets_in_use_high_water_mark;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(rx_packet_pool_p->rx_packets); i ++) {
+        const struct network_packet *rx_packet_p = &rx_packet_pool_p->rx_packets[i];
+        uint16_t state_flags = rx_packet_p->state_flags;
+
+        if (rx_packet_p->layer2_end_point_p != layer2_end_point_p) {
+            continue;
+        }
+
+        if (state_flags & NET_PACKET_IN_RX_TRANSIT) {
+            stats_p->in_transit_packets ++;
+        } else if (state_flags & NET_PACKET_IN_RX_QUEUE) {
+            stats_p->queued_packets ++;
+        } else if (state_flags & NET_PACKET_IN_RX_USE_BY_APP) {
+            stats_p->held_by_app_packets ++;
+        }
+    }
+}
+
+
+/**
+ * Takes a snapshot of the Rx copybreak stats of a given layer-2 end point
+ *
+ * @param layer2_end_point_p: Pointer to the layer-2 end point
+ * @param stats_p: Area where the snapshot is to be returned
+ */
+void net_layer2_end_point_get_rx_copybreak_stats(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_layer2_rx_copybreak_stats *stats_p)
+{
+    struct net_packet_pool_stats *const pool_stats_p = &stats_p->pool_stats;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    stats_p->copied_count = layer2_end_point_p->rx_copybreak_count;
+    stats_p->misses_count = layer2_end_point_p->rx_copybreak_misses_count;
+    pool_stats_p->total_packets = ARRAY_SIZE(layer2_end_point_p->rx_copybreak_packets);
+    pool_stats_p->free_packets = 0;
+    pool_stats_p->in_transit_packets = 0;
+    pool_stats_p->queued_packets = 0;
+    pool_stats_p->held_by_app_packets = 0;
+    pool_stats_p->in_use_high_water_mark =
+        layer2_end_point_p->rx_copybreak_in_use_high_water_mark;
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(layer2_end_point_p->rx_copybreak_packets);
+         i ++) {
+        uint16_t state_flags = layer2_end_point_p->rx_copybreak_packets[i].state_flags;
+
+        if (state_flags & NET_PACKET_IN_RX_SPARE_POOL) {
+            pool_stats_p->free_packets ++;
+        } else if (state_flags & NET_PACKET_IN_RX_USE_BY_APP) {
+            pool_stats_p->held_by_app_packets ++;
+        }
+    }
+}
+
+
+/**
+ * Looks for packets of an array of Rx packets that have been held by the
+ * application for longer than a given time
+ *
+ * @return number of packets found
+ */
+static uint_fast16_t net_layer2_find_rx_packets_held_too_long(
+    const struct network_packet rx_packets[],
+    unsigned int num_packets,
+    uint32_t max_hold_time_ms,
+    net_layer2_held_packet_callback_t *callback_p,
+    void *arg)
+{
+    uint_fast16_t num_found = 0;
+
+    for (unsigned int i = 0; i < num_packets; i ++) {
+        const struct network_packet *rx_packet_p = &rx_packets[i];
+
+        if (!(rx_packet_p->state_flags & NET_PACKET_IN_RX_USE_BY_APP)) {
+            continue;
+        }
+
+        uint32_t hold_time_ms = net_packet_get_hold_time_ms(rx_packet_p);
+
+        if (hold_time_ms > max_hold_time_ms) {
+            callback_p(rx_packet_p, hold_time_ms, arg);
+            num_found ++;
+        }
+    }
+
+    return num_found;
+}
+
+
+/**
+ * Looks for Tx and Rx packets that have been held by the application for
+ * longer than a given time. Tx packets queued for transmission are not
+ * considered held by the application.
+ *
+ * @param max_hold_time_ms: Maximum hold time in milliseconds
+ * @param callback_p: Function to be called for each packet found
+ * @param arg: Argument to be passed to the callback function
+ *
+ * @return number of packets found
+ */
+uint_fast16_t net_layer2_find_packets_held_too_long(
+    uint32_t max_hold_time_ms,
+    net_layer2_held_packet_callback_t *callback_p,
+    void *arg)
+{
+    uint_fast16_t num_found = 0;
+    struct net_tx_packet_pool *const tx_packet_pool_p =
+         &g_net_layer2.free_tx_packet_pool;
+
+    D_ASSERT(g_net_layer2.initialized);
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(tx_packet_pool_p->tx_packets); i ++) {
+        const struct network_packet *tx_packet_p = &tx_packet_pool_p->tx_packets[i];
+
+        if ((tx_packet_p->state_flags &
+             (NET_PACKET_IN_TX_USE_BY_APP | NET_PACKET_IN_TX_TRANSIT)) !=
+            NET_PACKET_IN_TX_USE_BY_APP) {
+            continue;
+        }
+
+        uint32_t hold_time_ms = net_packet_get_hold_time_ms(tx_packet_p);
+
+        if (hold_time_ms > max_hold_time_ms) {
+            callback_p(tx_packet_p, hold_time_ms, arg);
+            num_found ++;
+        }
+    }
+
+    num_found += net_layer2_find_rx_packets_held_too_long(
+                    g_net_layer2.rx_packet_pool.rx_packets,
+                    ARRAY_SIZE(g_net_layer2.rx_packet_pool.rx_packets),
+                    max_hold_time_ms, callback_p, arg);
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer2.local_layer2_end_points);
+         i ++) {
+        const struct net_layer2_end_point *layer2_end_point_p =
+            &g_net_layer2.local_layer2_end_points[i];
+
+        num_found += net_layer2_find_rx_packets_held_too_long(
+                        layer2_end_point_p->rx_copybreak_packets,
+                        ARRAY_SIZE(layer2_end_point_p->rx_copybreak_packets),
+                        max_hold_time_ms, callback_p, arg);
+        num_found += net_layer2_find_rx_packets_held_too_long(
+                        layer2_end_point_p->rx_packet_clones,
+                        ARRAY_SIZE(layer2_end_point_p->rx_packet_clones),
+                        max_hold_time_ms, callback_p, arg);
+    }
+
+    return num_found;
+}
+
+
+/**
+ * Dequeues a Rx packet from a given layer-2 end point's Rx packet queue
+ */
+void net_layer2_dequeue_rx_packet(
+        struct net_layer2_end_point *layer2_end_point_p,
+        struct network_packet **rx_packet_pp)
+{
+    struct network_packet *rx_packet_p = NULL;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    rx_packet_p = net_packet_spsc_queue_remove(&layer2_end_point_p->rx_packet_queue, 0);
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_QUEUE);
+    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+    NET_PACKET_CLEAR_STATE_FLAG(rx_packet_p, NET_PACKET_IN_RX_QUEUE);
+    net_layer2_hand_rx_packet_to_app(layer2_end_point_p, rx_packet_p);
+    *rx_packet_pp = rx_packet_p;
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Enqueue a Rx packet to a given layer-2 end point's Rx packet queue
+ */
+void net_layer2_enqueue_rx_packet(
+        struct net_layer2_end_point *layer2_end_point_p,
+        struct network_packet *rx_packet_p)
+{
+#   ifdef USE_MPU
+    bool comp_region_changed = false;
+    struct mpu_region_range old_comp_region;
+
+    if (CALLER_IS_THREAD()) {
+        rtos_thread_set_comp_region(&g_net_layer2,
+                                    sizeof g_net_layer2,
+                                    0,
+                                    &old_comp_region);
+        comp_region_changed = true;
+    }
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags == 0);
+    D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+    NET_PACKET_SET_STATE_FLAG(rx_packet_p, NET_PACKET_IN_RX_QUEUE);
+    net_packet_spsc_queue_add_chain(&layer2_end_point_p->rx_packet_queue,
+                                    rx_packet_p, 1);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Dequeues all the Rx packets from a given layer-2 end point's Rx packet
+ * queue, waiting until the queue becomes non-empty, if necessary
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
+ * @param num_packets_p         Area where the number of Rx packets dequeued
+ *                              is to be returned
+ *
+ * @return Pointer to the first Rx packet of the chain of dequeued packets
+ *         (linked through their 'next_p' fields)
+ */
+struct network_packet *net_layer2_dequeue_rx_packet_chain(
+        struct net_layer2_end_point *layer2_end_point_p,
+        uint16_t *num_packets_p)
+{
+    struct network_packet *head_packet_p;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    head_packet_p = net_packet_spsc_queue_remove_all(&layer2_end_point_p->rx_packet_queue,
+                                                     0, num_packets_p);
+
+    for (struct network_packet *rx_packet_p = head_packet_p;
+         rx_packet_p != NULL;
+         rx_packet_p = rx_packet_p->next_p) {
+        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_QUEUE);
+        D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+        NET_PACKET_CLEAR_STATE_FLAG(rx_packet_p, NET_PACKET_IN_RX_QUEUE);
+        net_layer2_hand_rx_packet_to_app(layer2_end_point_p, rx_packet_p);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return head_packet_p;
+}
+
+
+/**
+ * Enqueue a chain of Rx packets to a given layer-2 end point's Rx packet
+ * queue, waking up the layer-2 packet receiver task only once for the whole
+ * chain
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
+ * @param head_packet_p         Pointer to the first Rx packet of the chain
+ * @param tail_packet_p         Pointer to the last Rx packet of the chain
+ * @param num_packets           Number of Rx packets in the chain (linked
+ *                              through their 'next_p' fields)
+ */
+void net_layer2_enqueue_rx_packet_chain(
+        struct net_layer2_end_point *layer2_end_point_p,
+        struct network_packet *head_packet_p,
+        struct network_packet *tail_packet_p,
+        uint16_t num_packets)
+{
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    for (struct network_packet *rx_packet_p = head_packet_p;
+         rx_packet_p != NULL;
+         rx_packet_p = rx_packet_p->next_p) {
+        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        D_ASSERT(rx_packet_p->state_flags == 0 ||
+                 rx_packet_p->state_flags == NET_PACKET_RX_FAILED);
+        D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+
+        NET_PACKET_SET_STATE_FLAG(rx_packet_p, NET_PACKET_IN_RX_QUEUE);
+    }
+
+    D_ASSERT(tail_packet_p->next_p == NULL);
+    net_packet_spsc_queue_add_chain(&layer2_end_point_p->rx_packet_queue,
+                                    head_packet_p, num_packets);
+}
+
+
+/**
+ * Processes, in the calling task, a received frame that did not come from
+ * the end point's Ethernet MAC (such as a frame injected by a benchmark), in
+ * the same way as the layer-2 packet poller task processes the frames it
+ * polls from the MAC's Rx ring. The end point's Rx packet queue is not used,
+ * so that the Rx ISR remains its only producer, and the frame is processed
+ * regardless of the end point's Rx mode.
+ *
+ * @param layer2_end_point_p    Pointer to layer-2 end point
+ * @param rx_packet_p           Rx packet taken for the end point with
+ *                              net_layer2_take_rx_packet(), with its
+ *                              state flags cleared
+ */
+void net_layer2_inject_rx_packet(
+        struct net_layer2_end_point *layer2_end_point_p,
+        struct network_packet *rx_packet_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags == 0);
     D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
 
-    ethernet_mac_repost_rx_packet(layer2_end_point_p->ethernet_mac_p, rx_packet_p);
+    net_layer2_hand_rx_packet_to_app(layer2_end_point_p, rx_packet_p);
+    net_layer2_process_rx_packet(layer2_end_point_p, rx_packet_p, 0);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Recycle a Rx packet (and its fragments, if any) for receiving another
+ * packet from the corresponding layer-2 end point
+ */
+void net_recycle_rx_packet(struct network_packet *rx_packet_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    struct net_layer2_end_point *layer2_end_point_p = rx_packet_p->layer2_end_point_p;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    if (rx_packet_p->signature == NET_RX_PACKET_SIGNATURE &&
+        rx_packet_p->clone_of_p != NULL) {
+        /*
+         * Clone: return it to its free list and drop its reference to the
+         * Rx packet it shares the data buffer with
+         */
+        struct network_packet *clone_p = rx_packet_p;
+
+        D_ASSERT(clone_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP);
+        rx_packet_p = clone_p->clone_of_p;
+        clone_p->clone_of_p = NULL;
+        clone_p->data_buffer = NULL;
+        clone_p->owner_task_p = NULL;
+        clone_p->state_flags = NET_PACKET_IN_RX_SPARE_POOL;
+        net_packet_free_list_add(&layer2_end_point_p->rx_clone_free_list, clone_p);
+    }
+
+    if (rx_packet_p->signature == NET_RX_PACKET_SIGNATURE) {
+        uint8_t old_ref_count = ATOMIC_POST_DECREMENT_UINT8(&rx_packet_p->ref_count);
+
+        D_ASSERT(old_ref_count != 0);
+        if (old_ref_count != 1) {
+            /*
+             * The data buffer is still shared by clones of the packet
+             */
+            goto exit;
+        }
+
+        rx_packet_p->ref_count = 1;
+    }
+
+    if (rx_packet_p->signature == NET_TX_PACKET_SIGNATURE) {
+        /*
+         * Tx packet looped back by layer 3: return it to the Tx packet pool
+         */
+        D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP);
+        D_ASSERT(rx_packet_p->next_fragment_p == NULL);
+        if (rx_packet_p->ipv4_reassembly_buffer_p != NULL) {
+            net_layer3_ipv4_release_reassembly_buffer(rx_packet_p);
+        }
+
+        rx_packet_p->state_flags = NET_PACKET_IN_TX_USE_BY_APP;
+        rx_packet_p->layer2_end_point_p = NULL;
+        net_layer2_free_tx_packet(rx_packet_p);
+        goto exit;
+    }
+
+    /*
+     * Recycle the packet and its fragments, if any:
+     */
+    while (rx_packet_p != NULL) {
+        struct network_packet *next_fragment_p = rx_packet_p->next_fragment_p;
+
+        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        D_ASSERT(rx_packet_p->state_flags == NET_PACKET_IN_RX_USE_BY_APP);
+        D_ASSERT(rx_packet_p->rx_buf_desc_p == NULL);
+        D_ASSERT(rx_packet_p->layer2_end_point_p == layer2_end_point_p);
+
+        if (rx_packet_p->ipv4_reassembly_buffer_p != NULL) {
+            net_layer3_ipv4_release_reassembly_buffer(rx_packet_p);
+        }
+
+        net_packet_reset_headroom(rx_packet_p);
+        rx_packet_p->owner_task_p = NULL;
+        rx_packet_p->next_fragment_p = NULL;
+        if (rx_packet_p->data_buffer_size != NET_PACKET_DATA_BUFFER_SIZE) {
+            /*
+             * Rx copybreak packet: return it to its free list
+             */
+            D_ASSERT(rx_packet_p->data_buffer_size == NET_PACKET_SMALL_DATA_BUFFER_SIZE);
+            rx_packet_p->state_flags = NET_PACKET_IN_RX_SPARE_POOL;
+            net_packet_free_list_add(&layer2_end_point_p->rx_copybreak_free_list,
+                                     rx_packet_p);
+            break;
+        }
+
+        D_ASSERT(layer2_end_point_p->rx_packets_in_use_count != 0);
+        ATOMIC_POST_DECREMENT_UINT16(&layer2_end_point_p->rx_packets_in_use_count);
+        ethernet_mac_repost_rx_packet(layer2_end_point_p->ethernet_mac_p, rx_packet_p);
+        rx_packet_p = next_fragment_p;
+    }
+
+exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Creates a clone of a received packet: a network packet object that shares
+ * the packet's data buffer, so that the same received frame can be handed to
+ * several consumers without copying it. Each of them recycles its own packet
+ * object with net_recycle_rx_packet(), and the data buffer is only recycled
+ * after the last of them does it. Consumers must not modify the shared
+ * frame.
+ *
+ * @param rx_packet_p   Pointer to the received packet (or to a clone of it)
+ *
+ * @return Pointer to the clone, on success
+ * @return NULL, if no clone is free, or if the frame cannot be shared (it
+ *         is a Tx packet looped back by layer 3, or it spans several Rx
+ *         buffers)
+ */
+struct network_packet *net_layer2_clone_rx_packet(struct network_packet *rx_packet_p)
+{
+    struct network_packet *clone_p = NULL;
+    struct net_layer2_end_point *const layer2_end_point_p =
+        rx_packet_p->layer2_end_point_p;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(rx_packet_p->state_flags & NET_PACKET_IN_RX_USE_BY_APP);
+
+    if (rx_packet_p->signature != NET_RX_PACKET_SIGNATURE ||
+        rx_packet_p->next_fragment_p != NULL) {
+        return NULL;
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer2,
+                                sizeof g_net_layer2,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    struct network_packet *const shared_packet_p =
+        (rx_packet_p->clone_of_p != NULL) ? rx_packet_p->clone_of_p : rx_packet_p;
+
+    clone_p = net_packet_free_list_try_remove(&layer2_end_point_p->rx_clone_free_list);
+    if (clone_p == NULL) {
+        ATOMIC_POST_INCREMENT_UINT32(&layer2_end_point_p->rx_clone_misses_count);
+        goto exit;
+    }
 
+    D_ASSERT(clone_p->state_flags == NET_PACKET_IN_RX_SPARE_POOL);
+    D_ASSERT(shared_packet_p->ref_count <= NET_MAX_RX_PACKET_CLONES);
+    (void)ATOMIC_POST_INCREMENT_UINT8(&shared_packet_p->ref_count);
+
+    clone_p->data_buffer = rx_packet_p->data_buffer;
+    clone_p->data_buffer_size = rx_packet_p->data_buffer_size;
+    clone_p->total_length = rx_packet_p->total_length;
+    clone_p->rx_checksum_flags = rx_packet_p->rx_checksum_flags;
+    clone_p->rx_protocol_type = rx_packet_p->rx_protocol_type;
+    clone_p->rx_header_length = rx_packet_p->rx_header_length;
+    clone_p->vlan_pcp = rx_packet_p->vlan_pcp;
+    clone_p->timestamp_flags = rx_packet_p->timestamp_flags;
+    clone_p->timestamp = rx_packet_p->timestamp;
+    clone_p->rx_latency_begin_cycles = rx_packet_p->rx_latency_begin_cycles;
+    clone_p->rx_latency_stage_cycles = rx_packet_p->rx_latency_stage_cycles;
+    clone_p->clone_of_p = shared_packet_p;
+    clone_p->state_flags = NET_PACKET_IN_RX_USE_BY_APP;
+    net_packet_set_owner(clone_p);
+
+exit:
 #   ifdef USE_MPU
     rtos_thread_restore_comp_region(&old_comp_region);
 #   endif
+
+    return clone_p;
 }
 
 
-error_t net_layer2_send_ethernet_frame(
+/**
+ * Wakes up the packet receiver task of a given layer-2 end point, whose
+ * Ethernet MAC operates in polled Rx mode. Called from the Ethernet MAC's
+ * Rx interrupt handler.
+ */
+void net_layer2_rx_poll_wakeup(struct net_layer2_end_point *layer2_end_point_p)
+{
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer2_end_point_p->ethernet_mac_rx_mode ==
+             ETHERNET_MAC_RX_POLLED_MODE);
+
+    rtos_semaphore_signal(&layer2_end_point_p->rx_poll_semaphore);
+}
+
+
+/**
+ * Populates the Ethernet header of an outgoing frame. If the layer-2 end
+ * point is in a VLAN, a VLAN tag is inserted after the Ethernet header. The
+ * Ethernet header is moved back into the Tx packet's headroom to make room
+ * for the tag, so the frame's payload is only moved forward if the packet
+ * has no headroom left.
+ *
+ * @param layer2_end_point_p: Pointer to the local layer-2 end point
+ * @param dest_mac_addr_p: Pointer to the destination MAC address
+ * @param tx_packet_p: Pointer to the Tx packet
+ * @param frame_type: Ethernet frame type
+ * @param data_payload_length: length of the frame's payload held in the
+ *                             Tx packet's data buffer
+ * @param total_frame_length: total frame length (for tracing only)
+ */
+static void net_layer2_populate_ethernet_header(
     const struct net_layer2_end_point *layer2_end_point_p,
     const struct ethernet_mac_address *dest_mac_addr_p,
     struct network_packet *tx_packet_p,
     uint16_t frame_type,
-    size_t data_payload_length)
+    size_t data_payload_length,
+    size_t total_frame_length)
 {
-    struct ethernet_frame *tx_frame_p =
-       (struct ethernet_frame *)tx_packet_p->data_buffer;
+    struct ethernet_frame *tx_frame_p;
+
+    if (layer2_end_point_p->vlan_id != NET_LAYER2_NO_VLAN &&
+        tx_packet_p->headroom >= sizeof(struct ethernet_vlan_tag)) {
+        (void)net_packet_push_header(tx_packet_p, sizeof(struct ethernet_vlan_tag));
+    } else if (layer2_end_point_p->vlan_id != NET_LAYER2_NO_VLAN) {
+        memmove(tx_packet_p->data_buffer + sizeof(struct ethernet_header) +
+                    sizeof(struct ethernet_vlan_tag),
+                tx_packet_p->data_buffer + sizeof(struct ethernet_header),
+                data_payload_length);
+    }
+
+    tx_frame_p = (struct ethernet_frame *)tx_packet_p->data_buffer;
 
     /*
      * Populate Ethernet header:
@@ -690,12 +3012,40 @@ error_t net_layer2_send_ethernet_frame(
 #endif
 
     COPY_MAC_ADDRESS(&tx_frame_p->ethernet_header.dest_mac_addr, dest_mac_addr_p);
-    tx_frame_p->ethernet_header.frame_type = hton16(frame_type);
+
+    if (layer2_end_point_p->vlan_id != NET_LAYER2_NO_VLAN) {
+        struct ethernet_vlan_tag *vlan_tag_p =
+            (struct ethernet_vlan_tag *)(tx_packet_p->data_buffer +
+                                         sizeof(struct ethernet_header));
+        uint16_t tag_control = 0;
+        uint8_t pcp = tx_packet_p->vlan_pcp;
+
+        if (pcp == NET_PACKET_VLAN_PCP_DEFAULT) {
+            pcp = layer2_end_point_p->vlan_default_tx_pcp;
+        }
+
+        D_ASSERT(pcp < ETHERNET_NUM_VLAN_PCPS);
+        D_ASSERT(tx_packet_p->headroom + sizeof(struct ethernet_header) +
+                 sizeof(struct ethernet_vlan_tag) + data_payload_length <=
+                 tx_packet_p->data_buffer_size);
+
+        SET_BIT_FIELD(tag_control, ETHERNET_VLAN_PCP_MASK, ETHERNET_VLAN_PCP_SHIFT,
+                      pcp);
+        SET_BIT_FIELD(tag_control, ETHERNET_VLAN_ID_MASK, ETHERNET_VLAN_ID_SHIFT,
+                      layer2_end_point_p->vlan_id);
+        vlan_tag_p->tag_control = hton16(tag_control);
+        vlan_tag_p->frame_type = hton16(frame_type);
+        tx_frame_p->ethernet_header.frame_type = hton16(FRAME_TYPE_VLAN_TAGGED_FRAME);
+        data_payload_length += sizeof(struct ethernet_vlan_tag);
+        total_frame_length += sizeof(struct ethernet_vlan_tag);
+    } else {
+        tx_frame_p->ethernet_header.frame_type = hton16(frame_type);
+    }
 
     tx_packet_p->total_length = sizeof(struct ethernet_header) +
                                 data_payload_length;
 
-    if (g_net_layer2.tracing_on) {
+    if (NET_LAYER2_TRACING_ON()) {
         DEBUG_PRINTF("Net layer2: Ethernet frame sent:\n"
                      "\tsource MAC address %02x:%02x:%02x:%02x:%02x:%02x\n"
                      "\tdestination MAC address %02x:%02x:%02x:%02x:%02x:%02x\n"
@@ -713,14 +3063,559 @@ error_t net_layer2_send_ethernet_frame(
                      tx_frame_p->ethernet_header.dest_mac_addr.bytes[4],
                      tx_frame_p->ethernet_header.dest_mac_addr.bytes[5],
                      ntoh16(tx_frame_p->ethernet_header.frame_type),
-                     tx_packet_p->total_length);
+                     total_frame_length);
+    }
+}
+
+
+/**
+ * Finds the Tx class of an outgoing frame, from its VLAN priority or, if
+ * that does not determine it, from the priority of the sending task
+ *
+ * @return Tx class (enum net_layer2_tx_classes)
+ */
+static uint_fast8_t net_layer2_get_tx_class(const struct network_packet *tx_packet_p)
+{
+    uint8_t pcp = tx_packet_p->vlan_pcp;
+
+    if (pcp != NET_PACKET_VLAN_PCP_DEFAULT) {
+        D_ASSERT(pcp < ETHERNET_NUM_VLAN_PCPS);
+        uint_fast8_t tx_class = g_net_layer2_vlan_pcp_to_tx_class[pcp];
+
+        if (tx_class != NET_LAYER2_TX_CLASS_BY_TASK_PRIORITY) {
+            return tx_class;
+        }
+    }
+
+    if (!CALLER_IS_THREAD()) {
+        return NET_LAYER2_TX_CLASS_HIGH_PRIORITY;
+    }
+
+    rtos_task_priority_t task_priority = rtos_task_get_current_priority();
+
+    if (RTOS_TASK_PRIORITY_IS_AT_LEAST(task_priority,
+                                       NET_LAYER2_TX_HIGH_PRIORITY_TASK_PRIORITY)) {
+        return NET_LAYER2_TX_CLASS_HIGH_PRIORITY;
+    }
+
+    if (RTOS_TASK_PRIORITY_IS_AT_MOST(task_priority,
+                                      NET_LAYER2_TX_BULK_TASK_PRIORITY)) {
+        return NET_LAYER2_TX_CLASS_BULK;
+    }
+
+    return NET_LAYER2_TX_CLASS_NORMAL;
+}
+
+
+/**
+ * Hands a Tx packet to the Ethernet MAC. If the frame fills the Tx ring up
+ * to NET_LAYER2_TX_MAX_RING_FRAMES, a Tx interrupt is requested for it, so
+ * that the frames that arrive while the ring is full are handed to the MAC
+ * from the Tx interrupt handler, even in ETHERNET_MAC_TX_LAZY_RECLAIM_MODE.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void net_layer2_tx_scheduler_xmit(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_layer2_tx_scheduler *tx_scheduler_p,
+    uint_fast8_t tx_class,
+    struct network_packet *tx_packet_p,
+    uint_fast16_t ring_frames)
+{
+    if (ring_frames + 1 == NET_LAYER2_TX_MAX_RING_FRAMES) {
+        NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_TX_INTERRUPT_REQUESTED);
+    }
+
+    ethernet_mac_start_xmit(layer2_end_point_p->ethernet_mac_p, tx_packet_p);
+    tx_scheduler_p->class_queues[tx_class].sent_count ++;
+}
+
+
+/**
+ * Adds a Tx packet at the tail of its Tx class queue. The Tx packet is
+ * marked as in transit, as it is no longer the application's to reuse.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void net_layer2_tx_scheduler_enqueue(
+    struct net_layer2_tx_scheduler *tx_scheduler_p,
+    uint_fast8_t tx_class,
+    struct network_packet *tx_packet_p)
+{
+    struct net_layer2_tx_class_queue *class_queue_p =
+        &tx_scheduler_p->class_queues[tx_class];
+
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT));
+
+    NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+    if (!net_layer2_tx_packet_ring_put(&class_queue_p->tx_packet_ring,
+                                       tx_packet_p)) {
+        D_ASSERT(false);
+    }
+
+    uint_fast16_t length =
+        net_layer2_tx_packet_ring_length(&class_queue_p->tx_packet_ring);
+
+    if (length > class_queue_p->length_high_water_mark) {
+        class_queue_p->length_high_water_mark = length;
+    }
+
+    class_queue_p->deferred_count ++;
+    tx_scheduler_p->backlog ++;
+}
+
+
+/**
+ * Picks the Tx class whose oldest frame is to be handed to the Ethernet MAC
+ * next: the high priority class if it has frames waiting, or else the
+ * weighted round-robin class being served, moving on to the next one when
+ * it runs out of frames or of credits for the current round.
+ *
+ * NOTE: This function must be called with interrupts disabled and with
+ * frames waiting in the Tx class queues.
+ *
+ * @return Tx class (enum net_layer2_tx_classes)
+ */
+static uint_fast8_t net_layer2_tx_scheduler_pick_class(
+    struct net_layer2_tx_scheduler *tx_scheduler_p)
+{
+    struct net_layer2_tx_class_queue *class_queue_p;
+    uint_fast8_t tx_class;
+
+    D_ASSERT(tx_scheduler_p->backlog != 0);
+    if (!net_layer2_tx_packet_ring_is_empty(
+            &tx_scheduler_p->class_queues[NET_LAYER2_TX_CLASS_HIGH_PRIORITY].tx_packet_ring)) {
+        return NET_LAYER2_TX_CLASS_HIGH_PRIORITY;
+    }
+
+    tx_class = tx_scheduler_p->current_wrr_class;
+    for ( ; ; ) {
+        class_queue_p = &tx_scheduler_p->class_queues[tx_class];
+        if (!net_layer2_tx_packet_ring_is_empty(&class_queue_p->tx_packet_ring) &&
+            class_queue_p->credits != 0) {
+            break;
+        }
+
+        /*
+         * The class's turn is over. Its credits are replenished for its next
+         * turn, but unused credits are not carried over:
+         */
+        class_queue_p->credits = g_net_layer2_tx_class_weights[tx_class];
+        tx_class ++;
+        if (tx_class == NUM_NET_LAYER2_TX_CLASSES) {
+            tx_class = NET_LAYER2_TX_CLASS_HIGH_PRIORITY + 1;
+        }
+    }
+
+    class_queue_p->credits --;
+    tx_scheduler_p->current_wrr_class = tx_class;
+    return tx_class;
+}
+
+
+/**
+ * Hands to the Ethernet MAC the frames waiting in the Tx class queues of a
+ * layer-2 end point, while the MAC's Tx ring has fewer than
+ * NET_LAYER2_TX_MAX_RING_FRAMES frames.
+ *
+ * NOTE: This function must be called with interrupts disabled.
+ */
+static void net_layer2_tx_scheduler_run(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_layer2_tx_scheduler *tx_scheduler_p)
+{
+    while (tx_scheduler_p->backlog != 0) {
+        uint_fast16_t ring_frames =
+            ethernet_mac_get_tx_ring_frames(layer2_end_point_p->ethernet_mac_p);
+
+        if (ring_frames >= NET_LAYER2_TX_MAX_RING_FRAMES) {
+            break;
+        }
+
+        uint_fast8_t tx_class = net_layer2_tx_scheduler_pick_class(tx_scheduler_p);
+        struct net_layer2_tx_class_queue *class_queue_p =
+            &tx_scheduler_p->class_queues[tx_class];
+        struct network_packet *tx_packet_p;
+
+        if (!net_layer2_tx_packet_ring_get(&class_queue_p->tx_packet_ring,
+                                           &tx_packet_p)) {
+            D_ASSERT(false);
+        }
+
+        tx_scheduler_p->backlog --;
+
+        D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_IN_TX_TRANSIT);
+        net_layer2_tx_scheduler_xmit(layer2_end_point_p, tx_scheduler_p,
+                                     tx_class, tx_packet_p, ring_frames);
+    }
+}
+
+
+/**
+ * Hands an outgoing frame to the Ethernet MAC, if the MAC's Tx ring is
+ * shallow enough and no other frames are waiting for room in it, or else
+ * queues it in its Tx class queue.
+ *
+ * @param layer2_end_point_p: Pointer to the local layer-2 end point
+ * @param tx_packet_p: Pointer to the Tx packet, with the frame populated
+ */
+static void net_layer2_tx_schedule_frame(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *tx_packet_p)
+{
+    struct net_layer2_tx_scheduler *const tx_scheduler_p =
+        net_layer2_get_tx_scheduler(layer2_end_point_p);
+    uint_fast8_t tx_class = net_layer2_get_tx_class(tx_packet_p);
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (tx_scheduler_p->link_down && !tx_scheduler_p->loopback_on) {
+        net_layer2_tx_scheduler_discard(tx_packet_p);
+        restore_cpu_interrupts(int_mask);
+        return;
+    }
+
+    if (tx_scheduler_p->backlog == 0) {
+        uint_fast16_t ring_frames =
+            ethernet_mac_get_tx_ring_frames(layer2_end_point_p->ethernet_mac_p);
+
+        if (ring_frames < NET_LAYER2_TX_MAX_RING_FRAMES) {
+            net_layer2_tx_scheduler_xmit(layer2_end_point_p, tx_scheduler_p,
+                                         tx_class, tx_packet_p, ring_frames);
+            restore_cpu_interrupts(int_mask);
+            return;
+        }
+    }
+
+    net_layer2_tx_scheduler_enqueue(tx_scheduler_p, tx_class, tx_packet_p);
+    net_layer2_tx_scheduler_run(layer2_end_point_p, tx_scheduler_p);
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Hands to the Ethernet MAC the frames waiting in the Tx class queues of a
+ * given layer-2 end point, once earlier frames have left the MAC's Tx ring.
+ * Called from the Ethernet MAC's Tx interrupt handler.
+ */
+void net_layer2_tx_complete(struct net_layer2_end_point *layer2_end_point_p)
+{
+    struct net_layer2_tx_scheduler *const tx_scheduler_p =
+        &layer2_end_point_p->tx_scheduler;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    net_layer2_tx_scheduler_run(layer2_end_point_p, tx_scheduler_p);
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Returns the statistics of each Tx class of a layer-2 end point
+ *
+ * @param layer2_end_point_p: Pointer to the local layer-2 end point
+ * @param stats: area where the statistics are to be returned, indexed by
+ *               enum net_layer2_tx_classes
+ */
+void net_layer2_end_point_get_tx_class_stats(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_layer2_tx_class_stats stats[NUM_NET_LAYER2_TX_CLASSES])
+{
+    const struct net_layer2_tx_scheduler *const tx_scheduler_p =
+        &layer2_end_point_p->tx_scheduler;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    for (uint_fast8_t i = 0; i < NUM_NET_LAYER2_TX_CLASSES; i ++) {
+        const struct net_layer2_tx_class_queue *class_queue_p =
+            &tx_scheduler_p->class_queues[i];
+
+        stats[i].sent_count = class_queue_p->sent_count;
+        stats[i].deferred_count = class_queue_p->deferred_count;
+        stats[i].queued_count =
+            net_layer2_tx_packet_ring_length(&class_queue_p->tx_packet_ring);
+        stats[i].queued_high_water_mark = class_queue_p->length_high_water_mark;
     }
 
+    restore_cpu_interrupts(int_mask);
+}
+
+
+error_t net_layer2_send_ethernet_frame(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    struct network_packet *tx_packet_p,
+    uint16_t frame_type,
+    size_t data_payload_length)
+{
+    net_layer2_populate_ethernet_header(layer2_end_point_p, dest_mac_addr_p,
+                                        tx_packet_p, frame_type,
+                                        data_payload_length,
+                                        sizeof(struct ethernet_header) +
+                                            data_payload_length);
+
+    PACKET_CAPTURE(true, tx_packet_p, tx_packet_p->total_length);
+
     /*
      * Transmit packet:
      */
-    ethernet_mac_start_xmit(layer2_end_point_p->ethernet_mac_p, tx_packet_p);
-    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer2.sent_packets_count);
+    net_layer2_tx_schedule_frame(layer2_end_point_p, tx_packet_p);
+    COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_SENT);
+    return 0;
+}
+
+
+/**
+ * Sends an Ethernet frame whose Ethernet header has already been populated by
+ * the caller (for example, from a header template). The layer-2 end point
+ * must not be in a VLAN.
+ *
+ * @param layer2_end_point_p: Pointer to the local layer-2 end point
+ * @param tx_packet_p: Pointer to the Tx packet
+ * @param total_frame_length: length of the frame, including the Ethernet
+ *                            header
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer2_send_prebuilt_ethernet_frame(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *tx_packet_p,
+    size_t total_frame_length)
+{
+    D_ASSERT(layer2_end_point_p->vlan_id == NET_LAYER2_NO_VLAN);
+    D_ASSERT(total_frame_length <= tx_packet_p->data_buffer_size);
+
+    tx_packet_p->total_length = total_frame_length;
+    PACKET_CAPTURE(true, tx_packet_p, total_frame_length);
+    net_layer2_tx_schedule_frame(layer2_end_point_p, tx_packet_p);
+    COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_SENT);
+    return 0;
+}
+
+
+/**
+ * Sends an Ethernet frame at a given time, for cyclic traffic that needs
+ * deterministic departure times. These frames bypass the Tx class queues,
+ * so that their launch time is not pushed back by frames waiting for room
+ * in the Tx ring.
+ *
+ * @param layer2_end_point_p: Pointer to the local layer-2 end point
+ * @param dest_mac_addr_p: Pointer to the destination MAC address
+ * @param tx_packet_p: Pointer to the Tx packet
+ * @param frame_type: Ethernet frame type
+ * @param data_payload_length: frame payload length
+ * @param launch_time_ns: value of the Ethernet MAC's IEEE 1588 timer at
+ *                        which the frame is to be transmitted (see
+ *                        ethernet_mac_start_xmit_at())
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer2_send_ethernet_frame_at(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    struct network_packet *tx_packet_p,
+    uint16_t frame_type,
+    size_t data_payload_length,
+    uint32_t launch_time_ns)
+{
+    if (launch_time_ns >= ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS) {
+        return CAPTURE_ERROR("Invalid Tx launch time", tx_packet_p,
+                             launch_time_ns);
+    }
+
+    net_layer2_populate_ethernet_header(layer2_end_point_p, dest_mac_addr_p,
+                                        tx_packet_p, frame_type,
+                                        data_payload_length,
+                                        sizeof(struct ethernet_header) +
+                                            data_payload_length);
+
+    PACKET_CAPTURE(true, tx_packet_p, tx_packet_p->total_length);
+
+    /*
+     * Transmit packet:
+     */
+    ethernet_mac_start_xmit_at(layer2_end_point_p->ethernet_mac_p,
+                               tx_packet_p, launch_time_ns);
+    COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_SENT);
+    return 0;
+}
+
+
+/**
+ * Sends a burst of Ethernet frames to the same destination, handing them all
+ * to the Ethernet MAC at once, so that the MAC's Tx ring is re-activated
+ * only once for the whole burst. If the burst does not fit in the Tx ring
+ * (see NET_LAYER2_TX_MAX_RING_FRAMES), its frames go through the Tx class
+ * queues instead.
+ *
+ * @param layer2_end_point_p: Pointer to the local layer-2 end point
+ * @param dest_mac_addr_p: Pointer to the destination MAC address
+ * @param tx_packets: array of Tx packets to send, in order
+ * @param frame_type: Ethernet frame type
+ * @param data_payload_lengths: array of frame payload lengths, one for each
+ *                              entry of tx_packets[]
+ * @param num_packets: number of entries in tx_packets[]
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer2_send_ethernet_frames(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    struct network_packet *tx_packets[],
+    uint16_t frame_type,
+    const size_t data_payload_lengths[],
+    uint_fast8_t num_packets)
+{
+    struct net_layer2_tx_scheduler *const tx_scheduler_p =
+        net_layer2_get_tx_scheduler(layer2_end_point_p);
+    uint_fast16_t ring_frames = NET_LAYER2_TX_MAX_RING_FRAMES;
+
+    D_ASSERT(num_packets != 0 && num_packets <= NET_MAX_TX_PACKETS);
+
+    for (uint_fast8_t i = 0; i < num_packets; i ++) {
+        net_layer2_populate_ethernet_header(layer2_end_point_p,
+                                            dest_mac_addr_p,
+                                            tx_packets[i],
+                                            frame_type,
+                                            data_payload_lengths[i],
+                                            sizeof(struct ethernet_header) +
+                                                data_payload_lengths[i]);
+        PACKET_CAPTURE(true, tx_packets[i], tx_packets[i]->total_length);
+    }
+
+    /*
+     * Transmit packets, as one batch if they all fit in the Tx ring and no
+     * other frames are waiting for room in it:
+     */
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (tx_scheduler_p->link_down && !tx_scheduler_p->loopback_on) {
+        for (uint_fast8_t i = 0; i < num_packets; i ++) {
+            net_layer2_tx_scheduler_discard(tx_packets[i]);
+        }
+
+        restore_cpu_interrupts(int_mask);
+        return 0;
+    }
+
+    if (tx_scheduler_p->backlog == 0) {
+        ring_frames =
+            ethernet_mac_get_tx_ring_frames(layer2_end_point_p->ethernet_mac_p);
+    }
+
+    if (ring_frames + num_packets <= NET_LAYER2_TX_MAX_RING_FRAMES) {
+        if (ring_frames + num_packets == NET_LAYER2_TX_MAX_RING_FRAMES) {
+            NET_PACKET_SET_STATE_FLAG(tx_packets[num_packets - 1],
+                                      NET_PACKET_TX_INTERRUPT_REQUESTED);
+        }
+
+        ethernet_mac_start_xmit_batch(layer2_end_point_p->ethernet_mac_p,
+                                      tx_packets, num_packets);
+        for (uint_fast8_t i = 0; i < num_packets; i ++) {
+            uint_fast8_t tx_class = net_layer2_get_tx_class(tx_packets[i]);
+
+            tx_scheduler_p->class_queues[tx_class].sent_count ++;
+        }
+    } else {
+        for (uint_fast8_t i = 0; i < num_packets; i ++) {
+            net_layer2_tx_scheduler_enqueue(tx_scheduler_p,
+                                            net_layer2_get_tx_class(tx_packets[i]),
+                                            tx_packets[i]);
+        }
+
+        net_layer2_tx_scheduler_run(layer2_end_point_p, tx_scheduler_p);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    for (uint_fast8_t i = 0; i < num_packets; i ++) {
+        COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_SENT);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Sends an Ethernet frame whose payload is made of the data that follows
+ * the Ethernet header in the Tx packet's data buffer (typically, upper-layer
+ * protocol headers), followed by the given payload fragments. The payload
+ * fragments are transmitted without being copied into the Tx packet.
+ * These frames bypass the Tx class queues, as the caller gets an error if
+ * the Tx ring has no room for all the fragments.
+ *
+ * @param layer2_end_point_p: Pointer to the local layer-2 end point
+ * @param dest_mac_addr_p: Pointer to the destination MAC address
+ * @param tx_packet_p: Pointer to the Tx packet
+ * @param frame_type: Ethernet frame type
+ * @param data_payload_length: length of the frame's payload held in the
+ *                             Tx packet's data buffer (it can be 0)
+ * @param fragments: payload fragments. Their data must not be modified
+ *                   until the Tx packet has been transmitted.
+ * @param num_fragments: number of entries in fragments[]
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer2_send_ethernet_frame_gather(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    struct network_packet *tx_packet_p,
+    uint16_t frame_type,
+    size_t data_payload_length,
+    const struct ethernet_tx_fragment fragments[],
+    uint_fast8_t num_fragments)
+{
+    error_t error;
+    size_t total_frame_length = sizeof(struct ethernet_header) +
+                                data_payload_length;
+
+    D_ASSERT(num_fragments != 0 &&
+             num_fragments <= ETHERNET_MAC_MAX_TX_FRAGMENTS);
+
+    for (uint_fast8_t i = 0; i < num_fragments; i ++) {
+        D_ASSERT(fragments[i].data_p != NULL && fragments[i].length != 0);
+        total_frame_length += fragments[i].length;
+    }
+
+    if (total_frame_length >
+        sizeof(struct ethernet_header) + ETHERNET_MAX_FRAME_DATA_SIZE) {
+        return CAPTURE_ERROR("Ethernet frame too long", tx_packet_p,
+                             total_frame_length);
+    }
+
+    net_layer2_populate_ethernet_header(layer2_end_point_p, dest_mac_addr_p,
+                                        tx_packet_p, frame_type,
+                                        data_payload_length,
+                                        total_frame_length);
+
+    /*
+     * Only the headers in the Tx packet's data buffer are captured, but the
+     * captured frame length includes the payload fragments:
+     */
+    PACKET_CAPTURE(true, tx_packet_p,
+                   tx_packet_p->total_length + total_frame_length -
+                       sizeof(struct ethernet_header) - data_payload_length);
+
+    /*
+     * Transmit packet:
+     */
+    error = ethernet_mac_start_xmit_gather(layer2_end_point_p->ethernet_mac_p,
+                                           tx_packet_p,
+                                           fragments,
+                                           num_fragments);
+    if (error != 0) {
+        return error;
+    }
+
+    COUNTER_SET_INCREMENT(g_net_layer2.packet_counters, NET_PACKET_COUNTER_SENT);
     return 0;
 }
 
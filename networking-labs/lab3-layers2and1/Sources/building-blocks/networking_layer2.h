@@ -13,16 +13,303 @@
 #include <stdbool.h>
 #include "compile_time_checks.h"
 #include "runtime_checks.h"
+#include "runtime_log.h"
 #include "network_packet.h"
 #include "microcontroller.h"
 #include "networking_layer2_ethernet.h"
+#include "ethernet_mac.h"
+#include "timer_wheel.h"
+#include "ring_template.h"
 
 struct ethernet_phy_device;
 
 /**
- * Number of layer-2 end points (NICs)
+ * Number of layer-2 end points (NICs): one per Ethernet MAC instance
  */
-#define NUM_NET_LAYER2_END_POINTS 1
+#define NUM_NET_LAYER2_END_POINTS NUM_ETHERNET_MACS
+
+/**
+ * Maximum number of Rx packets that the layer-2 packet receiver task removes
+ * from the Ethernet MAC's Rx ring in one polling pass, when the MAC operates
+ * in polled Rx mode
+ */
+#define NET_LAYER2_RX_POLL_BUDGET   8
+
+/**
+ * Maximum length in bytes of a received frame to be copied to an Rx
+ * copybreak packet. A frame that is copied does not hold its full-size Rx
+ * buffer while upper layers or the application process it, so slow
+ * consumers of small datagrams cannot starve the Ethernet MAC's Rx ring.
+ * 0 disables copybreak.
+ */
+#define NET_LAYER2_RX_COPYBREAK_THRESHOLD   NET_PACKET_SMALL_DATA_BUFFER_SIZE
+
+C_ASSERT(NET_LAYER2_RX_COPYBREAK_THRESHOLD <= NET_PACKET_SMALL_DATA_BUFFER_SIZE);
+
+/**
+ * Watchdog heartbeat deadline of the layer-2 packet receiver task, in
+ * milliseconds, and period at which the task wakes up to signal it, when no
+ * packets arrive
+ */
+#define NET_LAYER2_RX_HEARTBEAT_DEADLINE_MS     1000
+#define NET_LAYER2_RX_HEARTBEAT_PERIOD_MS       250
+
+/**
+ * Period in milliseconds at which the link monitor of a layer-2 end point
+ * checks the link events latched by the Ethernet PHY
+ */
+#define NET_LAYER2_LINK_MONITOR_PERIOD_MS       100
+
+/**
+ * Layer-2 Rx dispatch queues. Received frames are handed to a dispatch queue
+ * according to the Rx dispatch rules table (g_net_layer2_rx_dispatch_rules[])
+ * and are processed by the queue's handler task, at the queue's own priority.
+ * Frames that do not match any rule are processed inline by the layer-2
+ * packet receiver task.
+ */
+enum net_layer2_rx_dispatch_queues {
+    NET_LAYER2_RX_HIGH_PRIORITY_QUEUE = 0,
+    NET_LAYER2_RX_BULK_QUEUE,
+
+    /*
+     * Must be last:
+     */
+    NUM_NET_LAYER2_RX_DISPATCH_QUEUES,
+
+    /*
+     * Pseudo queue for frames processed inline by the packet receiver task:
+     */
+    NET_LAYER2_RX_DISPATCH_INLINE = NUM_NET_LAYER2_RX_DISPATCH_QUEUES
+};
+
+/**
+ * Load-shedding classes of received frames. When the layer-2 packet receiver
+ * task falls behind, received frames pile up in the end point's Rx packet
+ * queue. Once the number of frames waiting to be processed reaches the
+ * watermark of a frame's class, the frame is dropped before being processed,
+ * so that the Rx buffers are recycled to the Ethernet MAC quickly and the
+ * frames of the classes that matter most keep getting through.
+ */
+enum net_layer2_rx_shed_classes {
+    /*
+     * ARP, ICMP, ICMPv6 and IGMP, and UDP datagrams to the ports registered
+     * with net_layer2_add_rx_critical_udp_port(). Never shed.
+     */
+    NET_LAYER2_RX_SHED_CLASS_CRITICAL = 0,
+
+    /*
+     * Other UDP datagrams
+     */
+    NET_LAYER2_RX_SHED_CLASS_UDP,
+
+    /*
+     * Everything else (TCP, IPv4 fragments after the first one, unknown
+     * EtherTypes, ...). Shed first.
+     */
+    NET_LAYER2_RX_SHED_CLASS_OTHER,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_NET_LAYER2_RX_SHED_CLASSES
+};
+
+/**
+ * Number of received frames waiting to be processed at which frames of the
+ * NET_LAYER2_RX_SHED_CLASS_UDP and NET_LAYER2_RX_SHED_CLASS_OTHER classes
+ * start being shed
+ */
+#define NET_LAYER2_RX_SHED_UDP_WATERMARK        ((NET_MAX_RX_PACKETS * 3) / 4)
+#define NET_LAYER2_RX_SHED_OTHER_WATERMARK      (NET_MAX_RX_PACKETS / 2)
+
+/**
+ * Maximum number of UDP ports registered with
+ * net_layer2_add_rx_critical_udp_port()
+ */
+#define NET_LAYER2_MAX_RX_CRITICAL_UDP_PORTS    4
+
+/**
+ * Layer-2 Tx classes. Outgoing frames are handed to the Ethernet MAC right
+ * away only while its Tx ring holds fewer than
+ * NET_LAYER2_TX_MAX_RING_FRAMES frames. Otherwise, they wait in the Tx class
+ * queue of their end point and are handed to the MAC as earlier frames
+ * complete: frames of the high priority class first (strict priority), and
+ * frames of the other classes by weighted round robin. Keeping the Tx ring
+ * shallow bounds the time that a latency-critical frame waits behind frames
+ * of a bulk sender.
+ */
+enum net_layer2_tx_classes {
+    /*
+     * Frames with VLAN priority 4 to 7, frames sent from ISRs, and frames
+     * sent by tasks of priority NET_LAYER2_TX_HIGH_PRIORITY_TASK_PRIORITY or
+     * higher
+     */
+    NET_LAYER2_TX_CLASS_HIGH_PRIORITY = 0,
+
+    /*
+     * Frames sent by other tasks
+     */
+    NET_LAYER2_TX_CLASS_NORMAL,
+
+    /*
+     * Frames with VLAN priority 1 or 2, and frames sent by tasks of priority
+     * NET_LAYER2_TX_BULK_TASK_PRIORITY or lower
+     */
+    NET_LAYER2_TX_CLASS_BULK,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_NET_LAYER2_TX_CLASSES
+};
+
+/**
+ * Maximum number of frames that the Tx scheduler of a layer-2 end point
+ * keeps in the Ethernet MAC's Tx ring
+ */
+#define NET_LAYER2_TX_MAX_RING_FRAMES   4
+
+C_ASSERT(NET_LAYER2_TX_MAX_RING_FRAMES <= NET_MAX_TX_PACKETS);
+
+/**
+ * Maximum time in milliseconds that a task waiting for a free Tx packet
+ * sleeps before reclaiming again the Tx packets already transmitted by
+ * Ethernet MACs in ETHERNET_MAC_TX_LAZY_RECLAIM_MODE. Frames queued after
+ * the last frame that raised a Tx interrupt are only reclaimed by polling,
+ * so an unbounded wait could wait for packets that nobody reclaims.
+ */
+#define NET_LAYER2_TX_PACKET_WAIT_RECLAIM_PERIOD_MS  10
+
+/**
+ * Task priority thresholds for the Tx classes of frames not carrying a VLAN
+ * priority that maps to a Tx class
+ */
+#define NET_LAYER2_TX_HIGH_PRIORITY_TASK_PRIORITY \
+        RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 2)
+#define NET_LAYER2_TX_BULK_TASK_PRIORITY \
+        RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 4)
+
+/**
+ * Ring of Tx packets of a Tx class queue
+ */
+DECLARE_RING_TYPE(net_layer2_tx_packet_ring, struct network_packet *,
+                  RING_NUM_ENTRIES(NET_MAX_TX_PACKETS));
+
+/**
+ * Tx class queue of a layer-2 end point
+ */
+struct net_layer2_tx_class_queue {
+    /**
+     * Tx packets waiting to be handed to the Ethernet MAC. A Tx packet can
+     * only be in one queue at a time, so the ring never overflows.
+     */
+    struct net_layer2_tx_packet_ring tx_packet_ring;
+
+    /**
+     * Largest number of Tx packets that tx_packet_ring has ever had
+     */
+    uint8_t length_high_water_mark;
+
+    /**
+     * Frames that the class can still send in the current weighted
+     * round-robin round
+     */
+    uint8_t credits;
+
+    /**
+     * Number of frames of this class handed to the Ethernet MAC
+     */
+    volatile uint32_t sent_count;
+
+    /**
+     * Number of frames of this class that had to wait in the queue
+     */
+    volatile uint32_t deferred_count;
+};
+
+/**
+ * Tx scheduler of a layer-2 end point. It is accessed with interrupts
+ * disabled, as it is also run from the Ethernet MAC's Tx interrupt handler.
+ */
+struct net_layer2_tx_scheduler {
+    struct net_layer2_tx_class_queue class_queues[NUM_NET_LAYER2_TX_CLASSES];
+
+    /**
+     * Total number of Tx packets waiting in class_queues[]
+     */
+    uint8_t backlog;
+
+    /**
+     * Weighted round-robin class currently being served
+     */
+    uint8_t current_wrr_class;
+
+    /**
+     * Flags indicating that the Ethernet link is down and that the PHY is
+     * in loopback mode. While the link is down, and the PHY is not in
+     * loopback mode, Tx is paused: outgoing frames are discarded, instead
+     * of piling up in the Tx ring.
+     */
+    bool link_down;
+    bool loopback_on;
+};
+
+/**
+ * Statistics of a Tx class of a layer-2 end point
+ */
+struct net_layer2_tx_class_stats {
+    uint32_t sent_count;
+    uint32_t deferred_count;
+    uint16_t queued_count;
+    uint16_t queued_high_water_mark;
+};
+
+/**
+ * Value of the ip_protocol field of an Rx dispatch rule that matches any IP
+ * protocol (or frames that are not IP packets)
+ */
+#define NET_LAYER2_RX_DISPATCH_ANY_IP_PROTOCOL  UINT8_C(0xff)
+
+/**
+ * Rx dispatch rule: maps an EtherType, and optionally an IPv4 protocol, to
+ * an Rx dispatch queue
+ */
+struct net_layer2_rx_dispatch_rule {
+    /**
+     * Ethernet frame type (in host byte order)
+     */
+    uint16_t frame_type;
+
+    /**
+     * IPv4 protocol type or NET_LAYER2_RX_DISPATCH_ANY_IP_PROTOCOL
+     */
+    uint8_t ip_protocol;
+
+    /**
+     * Dispatch queue (enum net_layer2_rx_dispatch_queues)
+     */
+    uint8_t dispatch_queue;
+};
+
+/**
+ * Layer-2 Rx dispatch queue of a layer-2 end point
+ */
+struct net_layer2_rx_dispatch_queue {
+    /**
+     * Queue of received packets waiting to be processed by the handler task
+     */
+    struct net_packet_queue rx_packet_queue;
+
+    /**
+     * Number of received packets dropped because the queue was full
+     */
+    volatile uint32_t rx_packets_dropped_count;
+
+    /**
+     * Handler task for this queue
+     */
+    struct rtos_task handler_task;
+};
 
 /**
  * Types of layer-2 end points
@@ -62,48 +349,337 @@ struct net_layer2_end_point {
      */
     const struct ethernet_mac_device *const ethernet_mac_p;
 
+    /**
+     * Rx completion handling mode for the Ethernet MAC
+     */
+    const enum ethernet_mac_rx_modes ethernet_mac_rx_mode;
+
+    /**
+     * Tx completion handling mode for the Ethernet MAC
+     */
+    const enum ethernet_mac_tx_modes ethernet_mac_tx_mode;
+
     /**
      * Ethernet MAC address of this layer-2 end-point.
      */
     struct ethernet_mac_address mac_address;
 
     /**
-     * Queue of received Rx packets (non-empty Rx buffers)
+     * IEEE 802.1Q VLAN ID of this end point, or NET_LAYER2_NO_VLAN. If set,
+     * outgoing frames are tagged with this VLAN ID, and tagged frames
+     * received for other VLANs are dropped.
      */
-    struct net_packet_queue rx_packet_queue;
+    uint16_t vlan_id;
+#   define NET_LAYER2_NO_VLAN   UINT16_C(0)
+
+    /**
+     * Priority code point for outgoing VLAN-tagged frames whose Tx packet's
+     * vlan_pcp is NET_PACKET_VLAN_PCP_DEFAULT
+     */
+    uint8_t vlan_default_tx_pcp;
 
     /**
-     * Rx packet buffers
+     * Queue of received Rx packets (non-empty Rx buffers). Its only producer
+     * is the Ethernet MAC's Rx interrupt handler and its only consumer is the
+     * layer-2 packet receiver task, so it does not need to disable interrupts.
      */
-    struct network_packet rx_packets[NET_MAX_RX_PACKETS];
+    struct net_packet_spsc_queue rx_packet_queue;
+
+    /**
+     * Number of Rx packets currently handed to the application
+     * (NET_PACKET_IN_RX_USE_BY_APP set)
+     */
+    volatile uint16_t rx_packets_in_use_count;
+
+    /**
+     * Largest value that rx_packets_in_use_count has ever had
+     */
+    uint16_t rx_packets_in_use_high_water_mark;
+
+    /**
+     * Semaphore signaled from the Ethernet MAC's Rx interrupt handler, to
+     * wake up the packet receiver task when the MAC operates in polled
+     * Rx mode
+     */
+    struct rtos_semaphore rx_poll_semaphore;
+
+    /**
+     * Number of Rx packets of the shared Rx packet pool currently held by
+     * this end point (posted to its Ethernet MAC's Rx ring, queued or handed
+     * to the application). It is only changed with interrupts disabled.
+     */
+    uint16_t rx_packets_held_count;
+
+    /**
+     * Minimum number of Rx packets of the shared Rx packet pool reserved for
+     * this end point: other end points cannot take free Rx packets from the
+     * pool that this end point needs to reach this number
+     */
+    uint16_t rx_packets_reserved_count;
+
+    /**
+     * Free list of Rx copybreak packets
+     */
+    struct net_packet_free_list rx_copybreak_free_list;
+
+    /**
+     * Rx copybreak packets. They have small data buffers and are never
+     * posted to the Ethernet MAC's Rx ring.
+     */
+    struct network_packet rx_copybreak_packets[NET_MAX_RX_COPYBREAK_PACKETS];
+
+    /**
+     * Number of received frames copied to Rx copybreak packets
+     */
+    volatile uint32_t rx_copybreak_count;
+
+    /**
+     * Number of received frames not copied because no Rx copybreak packet
+     * was free
+     */
+    volatile uint32_t rx_copybreak_misses_count;
+
+    /**
+     * Largest number of Rx copybreak packets ever held by the application at
+     * the same time
+     */
+    uint16_t rx_copybreak_in_use_high_water_mark;
+
+    /**
+     * Free list of Rx packet clones
+     */
+    struct net_packet_free_list rx_clone_free_list;
+
+    /**
+     * Rx packet clones. They have no data buffer of their own.
+     */
+    struct network_packet rx_packet_clones[NET_MAX_RX_PACKET_CLONES];
+
+    /**
+     * Number of Rx packets not cloned because no clone was free
+     */
+    volatile uint32_t rx_clone_misses_count;
 
     /**
      * Layer-2 packet receiving task
      */
     struct rtos_task packet_receiver_task;
 
+    /**
+     * Rx dispatch queues, with their handler tasks
+     */
+    struct net_layer2_rx_dispatch_queue rx_dispatch_queues[NUM_NET_LAYER2_RX_DISPATCH_QUEUES];
+
+    /**
+     * Tx scheduler
+     */
+    struct net_layer2_tx_scheduler tx_scheduler;
+
+    /**
+     * Cached Ethernet link state, updated by the link monitor when the
+     * Ethernet PHY reports a link change
+     */
+    volatile bool link_is_up;
+
+    /**
+     * Number of link state changes seen by the link monitor
+     */
+    volatile uint32_t link_change_count;
+
+    /**
+     * Link monitor timer, on the network timer wheel
+     */
+    struct timer_wheel_timer link_monitor_timer;
+
 }  __attribute__ ((aligned(MPU_REGION_ALIGNMENT)));
 
 C_ASSERT(sizeof(struct net_layer2_end_point) % MPU_REGION_ALIGNMENT == 0);
+C_ASSERT(NET_PACKET_SPSC_QUEUE_NUM_ENTRIES >= NET_MAX_RX_PACKETS);
+
+/*
+ * The default Rx packet reservation of each layer-2 end point is the size
+ * of its Ethernet MAC's Rx ring:
+ */
+C_ASSERT(NET_CONFIG_MAC_RX_RING_NUM_ENTRIES * NUM_NET_LAYER2_END_POINTS <=
+         NET_RX_PACKET_POOL_SIZE);
 
 /**
- * Pool of Tx packets
+ * Pool of Rx packets shared by all layer-2 end points. Each end point takes
+ * free Rx packets from it to refill its Ethernet MAC's Rx ring, and gives
+ * them back when they are recycled while its Rx ring is fully posted, so
+ * that Rx packets follow the traffic among end points. It is used from the
+ * Ethernet MACs' interrupt handlers, so it is only accessed with interrupts
+ * disabled.
+ */
+struct net_rx_packet_pool {
+    /**
+     * Number of entries in free_packets[]
+     */
+    uint16_t free_count;
+
+    /**
+     * Smallest value that free_count has ever had
+     */
+    uint16_t free_low_water_mark;
+
+    /**
+     * Number of times that a layer-2 end point could not take a free Rx
+     * packet, because it already held NET_MAX_RX_PACKETS Rx packets, or
+     * because the free Rx packets left were reserved for other end points
+     */
+    uint32_t take_denied_count;
+
+    /**
+     * Stack of free Rx packets
+     */
+    struct network_packet *free_packets[NET_RX_PACKET_POOL_SIZE];
+
+    /**
+     * Rx packets
+     */
+    struct network_packet rx_packets[NET_RX_PACKET_POOL_SIZE];
+};
+
+/**
+ * Maximum number of tasks that can have Tx packets reserved
+ */
+#define NET_MAX_TX_PACKET_RESERVATIONS  2
+
+/**
+ * Set of Tx packets reserved for the exclusive use of one task
+ */
+struct net_tx_packet_reservation {
+    /**
+     * Task that owns the reservation, or NULL if this reservation entry is
+     * not in use
+     */
+    struct rtos_task *task_p;
+
+    /**
+     * Free list of the reserved Tx packets
+     */
+    struct net_packet_free_list free_list;
+
+    /**
+     * Number of Tx packets reserved
+     */
+    uint16_t num_packets;
+};
+
+/**
+ * Pool of Tx packets, split in two size classes: Tx packets with a full-size
+ * data buffer and Tx packets with a small data buffer
  */
 struct net_tx_packet_pool {
     /**
-     * Free list
+     * Free list of Tx packets with a full-size data buffer
+     */
+    struct net_packet_free_list large_free_list;
+
+    /**
+     * Free list of Tx packets with a small data buffer
+     */
+    struct net_packet_free_list small_free_list;
+
+    /**
+     * Largest number of Tx packets that have ever been allocated at the
+     * same time
      */
-    struct net_packet_queue free_list;
+    uint16_t allocated_high_water_mark;
 
     /**
-     * Tx packet buffers
+     * Per-task Tx packet reservations. Reserved Tx packets are taken from
+     * large_free_list.
+     */
+    struct net_tx_packet_reservation reservations[NET_MAX_TX_PACKET_RESERVATIONS];
+
+    /**
+     * Tx packets. The first NET_MAX_LARGE_TX_PACKETS entries have full-size
+     * data buffers and the last NET_MAX_SMALL_TX_PACKETS entries have small
+     * data buffers.
      */
     struct network_packet tx_packets[NET_MAX_TX_PACKETS];
 };
 
+/**
+ * Data buffers of all the network packets of networking layer 2. They are
+ * kept apart from the network packet objects, as they are the only memory
+ * accessed by the Ethernet MACs' DMA engines.
+ */
+struct net_packet_data_buffers {
+    /**
+     * Data buffers of the Rx packets of the shared Rx packet pool (always
+     * full size, as the size of incoming frames is not known in advance)
+     */
+    uint8_t rx_data_buffers[NET_RX_PACKET_POOL_SIZE][NET_PACKET_DATA_BUFFER_SIZE]
+        __attribute__ ((aligned(NET_PACKET_DATA_BUFFER_ALIGNMENT)));
+
+    /**
+     * Data buffers of the Rx copybreak packets of each layer-2 end point.
+     * They are not accessed by DMA, but they are kept with the other data
+     * buffers, so that upper layers access all packet data the same way.
+     */
+    uint8_t rx_copybreak_data_buffers[NUM_NET_LAYER2_END_POINTS]
+                                     [NET_MAX_RX_COPYBREAK_PACKETS]
+                                     [NET_PACKET_SMALL_DATA_BUFFER_SIZE]
+        __attribute__ ((aligned(NET_PACKET_DATA_BUFFER_ALIGNMENT)));
+
+    /**
+     * Data buffers of the Tx packets with full-size data buffers
+     */
+    uint8_t large_tx_data_buffers[NET_MAX_LARGE_TX_PACKETS][NET_PACKET_DATA_BUFFER_SIZE]
+        __attribute__ ((aligned(NET_PACKET_DATA_BUFFER_ALIGNMENT)));
+
+    /**
+     * Data buffers of the Tx packets with small data buffers
+     */
+    uint8_t small_tx_data_buffers[NET_MAX_SMALL_TX_PACKETS][NET_PACKET_SMALL_DATA_BUFFER_SIZE]
+        __attribute__ ((aligned(NET_PACKET_DATA_BUFFER_ALIGNMENT)));
+}  __attribute__ ((aligned(MPU_REGION_ALIGNMENT)));
+
+C_ASSERT(sizeof(struct net_packet_data_buffers) % MPU_REGION_ALIGNMENT == 0);
+
 /**
  * Networking layer-2 global state variables
  */
+/**
+ * Reasons for which frames (or events) are dropped in the Rx/Tx fast path.
+ * They are only counted there. The counts are summarized in the error log
+ * periodically, at a limited rate (see net_layer2_count_drop()).
+ */
+enum net_layer2_drop_reasons {
+    NET_LAYER2_DROP_RX_BAD_FRAME = 0,
+    NET_LAYER2_DROP_RX_UNKNOWN_FRAME_TYPE,
+    NET_LAYER2_DROP_RX_WRONG_VLAN,
+    NET_LAYER2_DROP_RX_DISPATCH_QUEUE_FULL,
+    NET_LAYER2_DROP_TX_FAILED,
+    NET_LAYER2_DROP_MAC_ERROR_INTERRUPT,
+    NET_LAYER2_DROP_RX_OVERLOAD,
+    NET_LAYER2_DROP_TX_LINK_DOWN,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_NET_LAYER2_DROP_REASONS
+};
+
+/**
+ * Period in milliseconds of the layer-2 drop summary reports
+ */
+#define NET_LAYER2_DROP_REPORT_PERIOD_MS    UINT32_C(1000)
+
+/**
+ * Maximum number of drop summary messages that can be logged in one
+ * report period (tokens added to the drop log token bucket per period)
+ */
+#define NET_LAYER2_DROP_LOG_TOKENS_PER_PERIOD   2
+
+/**
+ * Capacity of the drop log token bucket (maximum burst of drop summary
+ * messages)
+ */
+#define NET_LAYER2_DROP_LOG_MAX_TOKENS          4
+
 struct net_layer2 {
     /**
      * Flag indicating if this layer has been initialized
@@ -116,25 +692,63 @@ struct net_layer2 {
     bool tracing_on;
 
     /**
-     * Total number of received Ethernet frames accepted
+     * Total numbers of received Ethernet frames accepted and dropped, and of
+     * Ethernet frames sent (placed for transmission)
      */
-    volatile uint32_t rx_packets_accepted_count;
+    struct net_packet_counter_set packet_counters;
 
     /**
-     * Total number of received Ethernet frames dropped
+     * Number of drops for each reason (enum net_layer2_drop_reasons)
      */
-    volatile uint32_t rx_packets_dropped_count;
+    volatile uint32_t drop_counts[NUM_NET_LAYER2_DROP_REASONS];
+
+    /**
+     * Values that drop_counts[] had when they were last reported
+     */
+    uint32_t drop_counts_reported[NUM_NET_LAYER2_DROP_REASONS];
+
+    /**
+     * RTOS tick count when each entry of drop_counts[] was last reported
+     */
+    uint32_t drop_reported_ticks[NUM_NET_LAYER2_DROP_REASONS];
+
+    /**
+     * Token bucket that limits the rate of drop summary messages
+     */
+    uint8_t drop_log_tokens;
+
+    /**
+     * Number of entries of rx_critical_udp_ports[] in use
+     */
+    volatile uint8_t num_rx_critical_udp_ports;
 
     /**
-     * Total number of Ethernet frames sent (placed for transmission)
+     * Destination UDP ports (big endian) of the datagrams in the
+     * NET_LAYER2_RX_SHED_CLASS_CRITICAL load-shedding class
      */
-    volatile uint32_t sent_packets_count;
+    uint16_t rx_critical_udp_ports[NET_LAYER2_MAX_RX_CRITICAL_UDP_PORTS];
+
+    /**
+     * Number of received frames shed under overload, for each load-shedding
+     * class (enum net_layer2_rx_shed_classes)
+     */
+    volatile uint32_t rx_shed_counts[NUM_NET_LAYER2_RX_SHED_CLASSES];
+
+    /**
+     * Periodic timer that triggers the drop summary reports
+     */
+    struct rtos_timer drop_report_timer;
 
     /**
      * Global pool of free Tx packets shared among all layer-2 end points
      */
     struct net_tx_packet_pool free_tx_packet_pool;
 
+    /**
+     * Pool of Rx packets shared among all layer-2 end points
+     */
+    struct net_rx_packet_pool rx_packet_pool;
+
     /**
      * Local layer-2 end points (network interfaces)
      */
@@ -143,6 +757,79 @@ struct net_layer2 {
 
 C_ASSERT(sizeof(struct net_layer2) % MPU_REGION_ALIGNMENT == 0);
 
+/**
+ * Time in milliseconds after which a packet held by the application is
+ * reported as a potential leak
+ */
+#define NET_LAYER2_PACKET_HELD_TOO_LONG_MS  UINT32_C(2000)
+
+/**
+ * Snapshot of the usage of a pool of network packets
+ */
+struct net_packet_pool_stats {
+    /**
+     * Total number of packets in the pool
+     */
+    uint16_t total_packets;
+
+    /**
+     * Number of free packets (in the Tx free lists, or in the shared Rx
+     * packet pool)
+     */
+    uint16_t free_packets;
+
+    /**
+     * Number of packets owned by the Ethernet MAC (queued for transmission,
+     * or posted to the Rx ring)
+     */
+    uint16_t in_transit_packets;
+
+    /**
+     * Number of received packets waiting in the layer-2 Rx packet queue
+     */
+    uint16_t queued_packets;
+
+    /**
+     * Number of packets held by the application
+     */
+    uint16_t held_by_app_packets;
+
+    /**
+     * Largest number of packets ever taken out of the pool at the same time
+     * (allocated Tx packets, or Rx packets handed to the application)
+     */
+    uint16_t in_use_high_water_mark;
+};
+
+/**
+ * Snapshot of the Rx copybreak stats of a layer-2 end point
+ */
+struct net_layer2_rx_copybreak_stats {
+    /**
+     * Number of received frames copied to Rx copybreak packets
+     */
+    uint32_t copied_count;
+
+    /**
+     * Number of received frames not copied because no Rx copybreak packet
+     * was free
+     */
+    uint32_t misses_count;
+
+    /**
+     * Usage of the Rx copybreak packets
+     */
+    struct net_packet_pool_stats pool_stats;
+};
+
+/**
+ * Signature of the callback invoked by net_layer2_find_packets_held_too_long()
+ * for each packet found
+ */
+typedef void net_layer2_held_packet_callback_t(const struct network_packet *packet_p,
+                                               uint32_t hold_time_ms,
+                                               void *arg);
+
 
 void net_layer2_init(void);
 
@@ -153,13 +840,58 @@ bool net_layer2_end_point_link_is_up(const struct net_layer2_end_point *layer2_e
 void net_layer2_end_point_set_loopback(const struct net_layer2_end_point *layer2_end_point_p,
 	                                   bool on);
 
+void net_layer2_end_point_set_promiscuous(const struct net_layer2_end_point *layer2_end_point_p,
+                                          bool on);
+
+void net_layer2_end_point_set_vlan(struct net_layer2_end_point *layer2_end_point_p,
+                                   uint16_t vlan_id,
+                                   uint8_t default_tx_pcp);
+
 void net_layer2_get_mac_addr(const struct net_layer2_end_point *layer2_end_point_p,
                              struct ethernet_mac_address *mac_addr_p);
 
-struct network_packet *net_layer2_allocate_tx_packet(bool free_after_tx_complete);
+struct network_packet *net_layer2_allocate_tx_packet(size_t frame_length,
+                                                     bool free_after_tx_complete);
+
+struct network_packet *net_layer2_allocate_tx_packet_timeout(size_t frame_length,
+                                                             bool free_after_tx_complete,
+                                                             uint32_t timeout_ms);
+
+struct network_packet *net_layer2_try_allocate_tx_packet(size_t frame_length,
+                                                         bool free_after_tx_complete);
+
+error_t net_layer2_reserve_tx_packets(uint16_t num_packets);
 
 void net_layer2_free_tx_packet(struct network_packet *tx_packet_p);
 
+void net_layer2_reclaim_lazy_tx_packets(void);
+
+void net_layer2_get_tx_packet_pool_stats(struct net_packet_pool_stats *stats_p);
+
+void net_layer2_end_point_get_rx_packet_pool_stats(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_packet_pool_stats *stats_p);
+
+error_t net_layer2_end_point_reserve_rx_packets(
+    struct net_layer2_end_point *layer2_end_point_p,
+    uint16_t num_packets);
+
+struct network_packet *net_layer2_take_rx_packet(
+    struct net_layer2_end_point *layer2_end_point_p);
+
+void net_layer2_give_rx_packet(struct network_packet *rx_packet_p);
+
+struct network_packet *net_layer2_clone_rx_packet(struct network_packet *rx_packet_p);
+
+void net_layer2_end_point_get_rx_copybreak_stats(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_layer2_rx_copybreak_stats *stats_p);
+
+uint_fast16_t net_layer2_find_packets_held_too_long(
+    uint32_t max_hold_time_ms,
+    net_layer2_held_packet_callback_t *callback_p,
+    void *arg);
+
 void net_layer2_dequeue_rx_packet(
         struct net_layer2_end_point *layer2_end_point_p,
         struct network_packet **rx_packet_pp);
@@ -168,8 +900,36 @@ void net_layer2_enqueue_rx_packet(
         struct net_layer2_end_point *layer2_end_point_p,
         struct network_packet *rx_packet_p);
 
+struct network_packet *net_layer2_dequeue_rx_packet_chain(
+        struct net_layer2_end_point *layer2_end_point_p,
+        uint16_t *num_packets_p);
+
+void net_layer2_enqueue_rx_packet_chain(
+        struct net_layer2_end_point *layer2_end_point_p,
+        struct network_packet *head_packet_p,
+        struct network_packet *tail_packet_p,
+        uint16_t num_packets);
+
+void net_layer2_inject_rx_packet(
+        struct net_layer2_end_point *layer2_end_point_p,
+        struct network_packet *rx_packet_p);
+
 void net_recycle_rx_packet(struct network_packet *rx_packet_p);
 
+void net_layer2_count_drop(enum net_layer2_drop_reasons reason);
+
+error_t net_layer2_add_rx_critical_udp_port(uint16_t port /* big endian */);
+
+void net_layer2_get_rx_shed_counts(uint32_t shed_counts[NUM_NET_LAYER2_RX_SHED_CLASSES]);
+
+void net_layer2_rx_poll_wakeup(struct net_layer2_end_point *layer2_end_point_p);
+
+void net_layer2_tx_complete(struct net_layer2_end_point *layer2_end_point_p);
+
+void net_layer2_end_point_get_tx_class_stats(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct net_layer2_tx_class_stats stats[NUM_NET_LAYER2_TX_CLASSES]);
+
 error_t net_layer2_send_ethernet_frame(
     const struct net_layer2_end_point *layer2_end_point_p,
     const struct ethernet_mac_address *dest_mac_addr_p,
@@ -177,10 +937,48 @@ error_t net_layer2_send_ethernet_frame(
     uint16_t frame_type,
     size_t data_payload_length);
 
+error_t net_layer2_send_prebuilt_ethernet_frame(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *tx_packet_p,
+    size_t total_frame_length);
+
+error_t net_layer2_send_ethernet_frames(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    struct network_packet *tx_packets[],
+    uint16_t frame_type,
+    const size_t data_payload_lengths[],
+    uint_fast8_t num_packets);
+
+error_t net_layer2_send_ethernet_frame_at(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    struct network_packet *tx_packet_p,
+    uint16_t frame_type,
+    size_t data_payload_length,
+    uint32_t launch_time_ns);
+
+error_t net_layer2_send_ethernet_frame_gather(
+    const struct net_layer2_end_point *layer2_end_point_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    struct network_packet *tx_packet_p,
+    uint16_t frame_type,
+    size_t data_payload_length,
+    const struct ethernet_tx_fragment fragments[],
+    uint_fast8_t num_fragments);
+
 void net_layer2_start_tracing(void);
 
 void net_layer2_stop_tracing(void);
 
 extern struct net_layer2 g_net_layer2;
 
+/**
+ * Tells if networking layer 2 tracing is on (always false if it is compiled
+ * out, see RUNTIME_LOG_MODULES_MASK)
+ */
+#define NET_LAYER2_TRACING_ON() \
+        RUNTIME_LOG_TRACING_ON(RUNTIME_LOG_MODULE_NET_LAYER2, \
+                               g_net_layer2.tracing_on)
+
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER2_H_ */
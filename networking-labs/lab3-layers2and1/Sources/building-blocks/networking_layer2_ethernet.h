@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "compile_time_checks.h"
+#include "io_utils.h"
 
 /*
  * Bit masks for first byte of a MAC address
@@ -90,6 +91,44 @@ C_ASSERT(offsetof(struct ethernet_header, dest_mac_addr) == 2);
 C_ASSERT(offsetof(struct ethernet_header, source_mac_addr) == 8);
 C_ASSERT(offsetof(struct ethernet_header, frame_type) == 14);
 
+/**
+ * IEEE 802.1Q VLAN tag in network byte order. In a VLAN-tagged frame, the
+ * frame_type field of the Ethernet header is FRAME_TYPE_VLAN_TAGGED_FRAME
+ * and the VLAN tag immediately follows the Ethernet header.
+ */
+struct ethernet_vlan_tag {
+    /**
+     * Tag control information (TCI)
+     * (hton16() must be invoked before writing this field.
+     *  ntoh16() must be invoked after reading this field.)
+     */
+    uint16_t tag_control;
+#   define ETHERNET_VLAN_PCP_MASK       MULTI_BIT_MASK(15, 13)
+#   define ETHERNET_VLAN_PCP_SHIFT      13
+#   define ETHERNET_VLAN_DEI_MASK       BIT(12)
+#   define ETHERNET_VLAN_ID_MASK        MULTI_BIT_MASK(11, 0)
+#   define ETHERNET_VLAN_ID_SHIFT       0
+
+    /**
+     * Frame type of the encapsulated payload
+     * (hton16() must be invoked before writing this field.
+     *  ntoh16() must be invoked after reading this field.)
+     */
+    uint16_t frame_type;
+};
+
+C_ASSERT(sizeof(struct ethernet_vlan_tag) == 4);
+
+/**
+ * Number of distinct VLAN priority code points
+ */
+#define ETHERNET_NUM_VLAN_PCPS  8
+
+/**
+ * Highest valid VLAN ID (VLAN ID 0 means "priority tag only")
+ */
+#define ETHERNET_MAX_VLAN_ID    4094
+
 extern const struct ethernet_mac_address g_ethernet_broadcast_mac_addr;
 extern const struct ethernet_mac_address g_ethernet_null_mac_addr;
 
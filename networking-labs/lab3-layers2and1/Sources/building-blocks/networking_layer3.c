@@ -9,6 +9,25 @@
 #include "mem_utils.h"
 #include "runtime_log.h"
 
+/**
+ * Initializer for the layer-3 end point bound to layer-2 end point _index
+ */
+#define NET_LAYER3_END_POINT_INITIALIZER(_index) \
+        {                                                                     \
+            .signature = NET_LAYER3_END_POINT_SIGNATURE,                      \
+            .initialized = false,                                             \
+            .layer2_end_point_p = &g_net_layer2.local_layer2_end_points[_index], \
+            .ipv4 = {                                                         \
+                .local_ip_addr.value = IPV4_NULL_ADDR,                        \
+                .subnet_mask = 0x0,                                           \
+                .default_gateway_ip_addr.value = IPV4_NULL_ADDR,              \
+                .next_tx_ip_packet_seq_num = 0,                               \
+            },                                                                \
+            .ipv6 = {                                                         \
+                .flags = 0,                                                   \
+            }                                                                 \
+        }
+
 /**
  * Networking layer-3 - global state variables
  */
@@ -17,28 +36,17 @@ struct net_layer3 g_net_layer3 = {
     .tracing_on = false,
     .ipv4 = {
         .expecting_ping_reply = false,
-        .rx_packets_accepted_count = 0,
-        .rx_packets_dropped_count = 0,
-        .sent_packets_count = 0,
     },
     .local_layer3_end_points = {
-        [0] = {
-            .signature = NET_LAYER3_END_POINT_SIGNATURE,
-            .initialized = false,
-            .layer2_end_point_p = &g_net_layer2.local_layer2_end_points[0],
-            .ipv4 = {
-                .local_ip_addr.value = IPV4_NULL_ADDR,
-                .subnet_mask = 0x0,
-                .default_gateway_ip_addr.value = IPV4_NULL_ADDR,
-                .next_tx_ip_packet_seq_num = 0,
-            },
-            .ipv6 = {
-                .flags = 0,
-            }
-        },
+        [0] = NET_LAYER3_END_POINT_INITIALIZER(0),
     },
 };
 
+/*
+ * An initializer entry must be added above for each additional end point:
+ */
+C_ASSERT(ARRAY_SIZE(g_net_layer3.local_layer3_end_points) == 1);
+
 
 /**
  * Initializes a layer-3 end point
@@ -12,34 +12,11 @@
 #include <stdbool.h>
 #include "compile_time_checks.h"
 #include "runtime_checks.h"
+#include "runtime_log.h"
 #include "networking_layer2.h"
 #include "networking_layer3_ipv4.h"
 #include "networking_layer3_ipv6.h"
 
-/**
- * Convert a 16-bit value from host byte order to network byte order
- * (Do byte swap since Cortex-M is little endian)
- */
-#define hton16(_x)  byte_swap16(_x)
-
-/**
- * Convert a 16-bit value from network byte order to host byte order
- * (Do byte swap since Cortex-M is little endian)
- */
-#define ntoh16(_x)  byte_swap16(_x)
-
-/**
- * Convert a 32-bit value from host byte order to network byte order
- * (Do byte swap since Cortex-M is little endian)
- */
-#define hton32(_x)  byte_swap32(_x)
-
-/**
- * Convert a 32-bit value from network byte order to host byte order
- * (Do byte swap since Cortex-M is little endian)
- */
-#define ntoh32(_x)  byte_swap32(_x)
-
 /**
  * Networking layer-3 (network layer) local end point
  */
@@ -160,4 +137,12 @@ void net_layer3_stop_tracing(void);
 
 extern struct net_layer3 g_net_layer3;
 
+/**
+ * Tells if networking layer 3 tracing is on (always false if it is compiled
+ * out, see RUNTIME_LOG_MODULES_MASK)
+ */
+#define NET_LAYER3_TRACING_ON() \
+        RUNTIME_LOG_TRACING_ON(RUNTIME_LOG_MODULE_NET_LAYER3, \
+                               g_net_layer3.tracing_on)
+
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER3_H_ */
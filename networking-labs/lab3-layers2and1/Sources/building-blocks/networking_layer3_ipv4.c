@@ -9,6 +9,11 @@
 #include "ethernet_mac.h"
 #include "networking_layer4.h"
 #include "runtime_log.h"
+#include "nor_flash_kv_store.h"
+#include "mem_utils.h"
+#include "dma_memcpy.h"
+#include "internet_checksum.h"
+#include "perf_probes.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -22,6 +27,114 @@
  */
 #define DHCP_UDP_SERVER_PORT    67
 
+/**
+ * DHCP magic cookie
+ */
+#define DHCP_MAGIC_COOKIE       UINT32_C(0x63825363)
+
+/**
+ * DHCP options used by the DHCP client
+ */
+#define DHCP_OPTION_PAD                 0
+#define DHCP_OPTION_SUBNET_MASK         1
+#define DHCP_OPTION_ROUTER              3
+#define DHCP_OPTION_REQUESTED_IP_ADDR   50
+#define DHCP_OPTION_LEASE_TIME          51
+#define DHCP_OPTION_MESSAGE_TYPE        53
+#define DHCP_OPTION_SERVER_ID           54
+#define DHCP_OPTION_PARAMETER_LIST      55
+#define DHCP_OPTION_END                 255
+
+/**
+ * DHCP message types
+ */
+#define DHCP_DISCOVER   1
+#define DHCP_OFFER      2
+#define DHCP_REQUEST    3
+#define DHCP_ACK        5
+#define DHCP_NAK        6
+
+/**
+ * Time to wait for a reply from a DHCP server, before retransmitting a
+ * DHCPDISCOVER, or a DHCPREQUEST in the INIT-REBOOT state
+ */
+#define DHCP_REPLY_TIMEOUT_IN_MS    2000
+
+/**
+ * Number of DHCPREQUEST messages sent for the cached lease (INIT-REBOOT),
+ * before falling back to a DHCPDISCOVER
+ */
+#define DHCP_INIT_REBOOT_MAX_TRIES  2
+
+/**
+ * Minimum interval in seconds between DHCPREQUEST retransmissions, in the
+ * RENEWING and REBINDING states
+ */
+#define DHCP_MIN_RETRANSMIT_INTERVAL_IN_SECS    60
+
+/**
+ * Maximum lease time in seconds used to compute the DHCP renewal and
+ * rebinding times. Longer leases, including infinite ones, are renewed
+ * earlier than required, which DHCP allows.
+ */
+#define DHCP_MAX_LEASE_TIME_IN_SECS (7u * 24 * 60 * 60)
+
+/**
+ * Maximum time to wait for DHCP messages at once, in the BOUND, RENEWING and
+ * REBINDING states
+ */
+#define DHCP_MAX_WAIT_IN_MS         (60u * 60 * 1000)
+
+/**
+ * Maximum number of retries of a lock-free IPv4 route lookup, before taking
+ * the routes mutex
+ */
+#define IPV4_ROUTE_LOCK_FREE_LOOKUP_MAX_RETRIES 4
+
+/**
+ * Length of an Ethernet frame carrying an ARP packet
+ */
+#define ARP_FRAME_LENGTH \
+        (sizeof(struct ethernet_header) + sizeof(struct arp_packet))
+
+/**
+ * Length of an Ethernet frame carrying an ICMPv4 echo message
+ */
+#define ICMPV4_ECHO_FRAME_LENGTH \
+        (sizeof(struct ethernet_header) + sizeof(struct ipv4_header) + \
+         sizeof(struct icmpv4_echo_message))
+
+/**
+ * Length of an Ethernet frame carrying an IGMP message of a given length
+ */
+#define IGMP_FRAME_LENGTH(_igmp_msg_length) \
+        (sizeof(struct ethernet_header) + sizeof(struct ipv4_header) + \
+         (_igmp_msg_length))
+
+/**
+ * IPv4 all-systems multicast group (224.0.0.1), to which general IGMP
+ * membership queries are sent
+ */
+static const struct ipv4_address g_ipv4_all_systems_multicast_addr = {
+    .bytes = { 224, 0, 0, 1 }
+};
+
+/**
+ * IPv4 all-routers multicast group (224.0.0.2), to which IGMPv2 leave
+ * messages are sent
+ */
+static const struct ipv4_address g_ipv4_all_routers_multicast_addr = {
+    .bytes = { 224, 0, 0, 2 }
+};
+
+/**
+ * IGMPv3 routers multicast group (224.0.0.22), to which IGMPv3 membership
+ * reports are sent
+ */
+static const struct ipv4_address g_igmpv3_routers_multicast_addr = {
+    .bytes = { 224, 0, 0, 22 }
+};
+
 /**
  * Initializes Networking layer-3 for IPv4
  *
@@ -40,71 +153,328 @@ void net_layer3_ipv4_init(struct net_layer3_ipv4 *layer3_ipv4_p)
     rtos_semaphore_init(&layer3_ipv4_p->ping_reply_received_semaphore,
                         "ping_reply_received semaphore",
                         0);
+
+    rtos_mutex_init(&layer3_ipv4_p->reassembly_mutex,
+                    "IPv4 reassembly mutex");
+
+    rtos_mutex_init(&layer3_ipv4_p->routes_mutex, "IPv4 routes mutex");
+    layer3_ipv4_p->num_routes = 0;
+    layer3_ipv4_p->routes_sequence_count = 0;
+
+    for (unsigned int i = 0; i < NET_IPV4_NUM_REASSEMBLY_BUFFERS; i++) {
+        layer3_ipv4_p->reassembly_buffers[i].state =
+            NET_IPV4_REASSEMBLY_BUFFER_FREE;
+    }
+}
+
+
+/**
+ * Returns the mask for a given IPv4 prefix length, in network byte order
+ */
+static inline uint32_t ipv4_prefix_mask(uint8_t prefix_length)
+{
+    D_ASSERT(prefix_length <= 32);
+    return (prefix_length == 0) ? 0 : hton32(UINT32_MAX << (32 - prefix_length));
 }
 
 
 /**
- * Chooses the local network end-point to be used for sending a packet,
- * based on the destination IPv4 address
+ * Returns the local layer-3 end point whose subnet contains a given IPv4
+ * address, or NULL if there is none
  */
 static struct net_layer3_end_point *
-choose_ipv4_local_layer3_end_point(const struct ipv4_address *dest_ip_addr_p)
+find_ipv4_connected_layer3_end_point(const struct ipv4_address *ip_addr_p)
 {
-    /*
-     * There is only one local layer-3 end-point
-     */
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer3.local_layer3_end_points); i ++) {
+        struct net_layer3_end_point *layer3_end_point_p =
+            &g_net_layer3.local_layer3_end_points[i];
+
+        if (layer3_end_point_p->ipv4.local_ip_addr.value != IPV4_NULL_ADDR &&
+            SAME_IPv4_SUBNET(&layer3_end_point_p->ipv4.local_ip_addr,
+                             ip_addr_p,
+                             layer3_end_point_p->ipv4.subnet_mask)) {
+            return layer3_end_point_p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Resolves the egress local layer-3 end point of a static IPv4 route
+ *
+ * @return pointer to the layer-3 end point, or NULL if the route is not
+ *         usable now (its next-hop router is not in any local subnet)
+ */
+static struct net_layer3_end_point *
+resolve_ipv4_route_layer3_end_point(const struct ipv4_route *route_p)
+{
+    if (route_p->layer2_end_point_p == NULL) {
+        return find_ipv4_connected_layer3_end_point(&route_p->next_hop_ip_addr);
+    }
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer3.local_layer3_end_points); i ++) {
+        struct net_layer3_end_point *layer3_end_point_p =
+            &g_net_layer3.local_layer3_end_points[i];
+
+        if (layer3_end_point_p->layer2_end_point_p == route_p->layer2_end_point_p) {
+            return layer3_end_point_p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Finds the longest prefix match for a destination among the static IPv4
+ * routes whose prefix is longer than a given length. Since routes[] is sorted
+ * by decreasing prefix length, the first usable match is the longest one.
+ *
+ * @return number of bits of the matched prefix, or -1 if there is no match
+ */
+static int match_ipv4_static_route(const struct ipv4_address *dest_ip_addr_p,
+                                   int min_prefix_length,
+                                   struct net_layer3_end_point **layer3_end_point_pp,
+                                   struct ipv4_address *next_hop_ip_addr_p)
+{
+    struct net_layer3_ipv4 *const layer3_ipv4_p = &g_net_layer3.ipv4;
+
+    for (unsigned int i = 0; i < layer3_ipv4_p->num_routes; i ++) {
+        const struct ipv4_route *route_p = &layer3_ipv4_p->routes[i];
+
+        if ((int)route_p->prefix_length <= min_prefix_length) {
+            break;
+        }
+
+        if ((dest_ip_addr_p->value & route_p->prefix_mask) !=
+            route_p->dest_prefix.value) {
+            continue;
+        }
+
+        struct net_layer3_end_point *layer3_end_point_p =
+            resolve_ipv4_route_layer3_end_point(route_p);
+
+        if (layer3_end_point_p == NULL) {
+            continue;
+        }
+
+        *layer3_end_point_pp = layer3_end_point_p;
+        if (route_p->next_hop_ip_addr.value == IPV4_NULL_ADDR) {
+            *next_hop_ip_addr_p = *dest_ip_addr_p;
+        } else {
+            *next_hop_ip_addr_p = route_p->next_hop_ip_addr;
+        }
+
+        return route_p->prefix_length;
+    }
+
+    return -1;
+}
+
+
+/**
+ * Chooses the local network end point and the next-hop IPv4 address to be
+ * used for sending a packet to a given destination, by longest prefix match
+ * among:
+ * - the subnets of the local end points (on-link destinations),
+ * - the static routes,
+ * - the default gateways of the local end points (0.0.0.0/0).
+ * On ties, a local subnet wins over a static route.
+ *
+ * @param dest_ip_addr_p        Destination IPv4 address
+ * @param next_hop_ip_addr_p    Area where the next-hop IPv4 address is
+ *                              returned. It is 0.0.0.0 if there is no route
+ *                              to the destination.
+ *
+ * @return pointer to the egress local layer-3 end point. If there is no route,
+ *         the first end point is returned.
+ */
+static struct net_layer3_end_point *
+ipv4_route_lookup(const struct ipv4_address *dest_ip_addr_p,
+                  struct ipv4_address *next_hop_ip_addr_p)
+{
+    struct net_layer3_ipv4 *const layer3_ipv4_p = &g_net_layer3.ipv4;
+    struct net_layer3_end_point *best_end_point_p = NULL;
+    struct net_layer3_end_point *gateway_end_point_p = NULL;
+    int best_prefix_length = -1;
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer3.local_layer3_end_points); i ++) {
+        struct net_layer3_end_point *layer3_end_point_p =
+            &g_net_layer3.local_layer3_end_points[i];
+        uint32_t subnet_mask = layer3_end_point_p->ipv4.subnet_mask;
+
+        if (layer3_end_point_p->ipv4.local_ip_addr.value == IPV4_NULL_ADDR) {
+            continue;
+        }
+
+        if (SAME_IPv4_SUBNET(&layer3_end_point_p->ipv4.local_ip_addr,
+                             dest_ip_addr_p,
+                             subnet_mask) &&
+            __builtin_popcount(subnet_mask) > best_prefix_length) {
+            best_prefix_length = __builtin_popcount(subnet_mask);
+            best_end_point_p = layer3_end_point_p;
+        }
+
+        if (gateway_end_point_p == NULL &&
+            layer3_end_point_p->ipv4.default_gateway_ip_addr.value != IPV4_NULL_ADDR) {
+            gateway_end_point_p = layer3_end_point_p;
+        }
+    }
+
+    if (best_end_point_p != NULL) {
+        *next_hop_ip_addr_p = *dest_ip_addr_p;
+    }
+
+    if (layer3_ipv4_p->num_routes != 0) {
+        struct net_layer3_end_point *route_end_point_p = NULL;
+        struct ipv4_address route_next_hop_ip_addr;
+        int route_prefix_length = -1;
+        bool lookup_done = false;
+
+        for (unsigned int retries = 0;
+             retries < IPV4_ROUTE_LOCK_FREE_LOOKUP_MAX_RETRIES;
+             retries ++) {
+            uint32_t sequence_count = layer3_ipv4_p->routes_sequence_count;
+
+            if (sequence_count % 2 != 0) {
+                continue;
+            }
+
+            __DMB();
+            route_prefix_length = match_ipv4_static_route(dest_ip_addr_p,
+                                                          best_prefix_length,
+                                                          &route_end_point_p,
+                                                          &route_next_hop_ip_addr);
+            __DMB();
+            if (layer3_ipv4_p->routes_sequence_count == sequence_count) {
+                lookup_done = true;
+                break;
+            }
+        }
+
+        if (!lookup_done) {
+            rtos_mutex_lock(&layer3_ipv4_p->routes_mutex);
+            route_prefix_length = match_ipv4_static_route(dest_ip_addr_p,
+                                                          best_prefix_length,
+                                                          &route_end_point_p,
+                                                          &route_next_hop_ip_addr);
+            rtos_mutex_unlock(&layer3_ipv4_p->routes_mutex);
+        }
+
+        if (route_prefix_length > best_prefix_length) {
+            best_end_point_p = route_end_point_p;
+            *next_hop_ip_addr_p = route_next_hop_ip_addr;
+        }
+    }
+
+    if (best_end_point_p != NULL) {
+        return best_end_point_p;
+    }
+
+    if (gateway_end_point_p != NULL) {
+        *next_hop_ip_addr_p = gateway_end_point_p->ipv4.default_gateway_ip_addr;
+        return gateway_end_point_p;
+    }
+
+    next_hop_ip_addr_p->value = IPV4_NULL_ADDR;
     return &g_net_layer3.local_layer3_end_points[0];
 }
 
 
+/**
+ * Fills in the fixed part of a DHCP message sent by the DHCP client
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param dhcp_msg_p            Pointer to the DHCP message to fill in
+ * @param transaction_id        DHCP transaction ID
+ * @param client_ip_addr_p      Client IPv4 address ('ciaddr' field)
+ */
+static void net_init_ipv4_dhcp_client_message(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct dhcp_message *dhcp_msg_p,
+    uint32_t transaction_id,
+    const struct ipv4_address *client_ip_addr_p)
+{
+    struct ethernet_mac_address local_mac_address;
+
+    net_layer2_get_mac_addr(layer3_end_point_p->layer2_end_point_p, &local_mac_address);
+
+    dhcp_msg_p->op = 0x1;
+    dhcp_msg_p->hardware_type = 0x1; /* Ethernet */
+    dhcp_msg_p->hw_addr_len = 0x6;
+    dhcp_msg_p->hops = 0x0;
+    dhcp_msg_p->transaction_id = transaction_id;
+    dhcp_msg_p->seconds = 0x0;
+    dhcp_msg_p->flags = 0x0;
+    dhcp_msg_p->client_ip_addr.value = client_ip_addr_p->value;
+    dhcp_msg_p->your_ip_addr.value = IPV4_NULL_ADDR;
+    dhcp_msg_p->next_server_ip_addr.value = IPV4_NULL_ADDR;
+    dhcp_msg_p->relay_agent_ip_addr.value = IPV4_NULL_ADDR;
+    COPY_MAC_ADDRESS(&dhcp_msg_p->client_mac_addr,
+             &local_mac_address);
+
+    bzero(dhcp_msg_p->zero_filled,
+      sizeof dhcp_msg_p->zero_filled);
+
+    dhcp_msg_p->magic_cookie = hton32(DHCP_MAGIC_COOKIE);
+}
+
+
+/**
+ * Appends the DHCP parameter request list option to the options of a DHCP
+ * message
+ *
+ * @return index in options[] just after the option
+ */
+static unsigned int dhcp_add_parameter_request_list_option(uint8_t *options,
+                                                           unsigned int i)
+{
+    options[i + 0] = DHCP_OPTION_PARAMETER_LIST;
+    options[i + 1] = 11; /* option length */
+    options[i + 2] = 0x01; /* option value[0]: subnet mask */
+    options[i + 3] = 0x1c; /* option value[1]: broadcast address */
+    options[i + 4] = 0x02; /* option value[2]: time offset */
+    options[i + 5] = 0x03; /* option value[3]: router */
+    options[i + 6] = 0x0f; /* option value[4]: domain name */
+    options[i + 7] = 0x06; /* option value[5]: domain name server */
+    options[i + 8] = 0x77; /* option value[6]: domain search */
+    options[i + 9] = 0x0c; /* option value[7]: host name */
+    options[i + 10] = 0x1a; /* option value[8]: interface MTU */
+    options[i + 11] = 0x79; /* option value[9]: classless static route */
+    options[i + 12] = 0x2a; /* option value[10]: network time protocol servers */
+    return i + 13;
+}
+
+
 static void net_send_ipv4_dhcp_discovery(
     struct net_layer3_end_point *layer3_end_point_p,
-    struct net_layer4_end_point *client_end_point_p)
+    struct net_layer4_end_point *client_end_point_p,
+    uint32_t transaction_id)
 {
-    struct network_packet *tx_packet_p = net_layer2_allocate_tx_packet(true);
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(NET_PACKET_DATA_BUFFER_SIZE, true);
 
     struct dhcp_message *dhcp_discovery_msg_p =
         get_ipv4_udp_data_payload_area(tx_packet_p);
 
-    struct ethernet_mac_address local_mac_address;
+    struct ipv4_address client_ip_addr = { .value = IPV4_NULL_ADDR };
 
-    net_layer2_get_mac_addr(layer3_end_point_p->layer2_end_point_p, &local_mac_address);
+    net_init_ipv4_dhcp_client_message(layer3_end_point_p, dhcp_discovery_msg_p,
+                                      transaction_id, &client_ip_addr);
 
-    dhcp_discovery_msg_p->op = 0x1;
-    dhcp_discovery_msg_p->hardware_type = 0x1; /* Ethernet */
-    dhcp_discovery_msg_p->hw_addr_len = 0x6;
-    dhcp_discovery_msg_p->hops = 0x0;
-    dhcp_discovery_msg_p->transaction_id = rtos_get_ticks_since_boot();
-    dhcp_discovery_msg_p->seconds = 0x0;
-    dhcp_discovery_msg_p->flags = 0x0;
-    dhcp_discovery_msg_p->client_ip_addr.value = IPV4_NULL_ADDR;
-    dhcp_discovery_msg_p->your_ip_addr.value = IPV4_NULL_ADDR;
-    dhcp_discovery_msg_p->next_server_ip_addr.value = IPV4_NULL_ADDR;
-    dhcp_discovery_msg_p->relay_agent_ip_addr.value = IPV4_NULL_ADDR;
-    COPY_MAC_ADDRESS(&dhcp_discovery_msg_p->client_mac_addr,
-             &local_mac_address);
+    dhcp_discovery_msg_p->options[0] = DHCP_OPTION_MESSAGE_TYPE;
+    dhcp_discovery_msg_p->options[1] = 1; /* option length */
+    dhcp_discovery_msg_p->options[2] = DHCP_DISCOVER;
 
-    bzero(dhcp_discovery_msg_p->zero_filled,
-      sizeof dhcp_discovery_msg_p->zero_filled);
+    unsigned int i = dhcp_add_parameter_request_list_option(
+                        dhcp_discovery_msg_p->options, 3);
 
-    dhcp_discovery_msg_p->magic_cookie = 0x63825363; /* DHCP */
-    dhcp_discovery_msg_p->options[0] = 53; /* option 1 type: DHCP message type */
-    dhcp_discovery_msg_p->options[1] = 1; /* option length */
-    dhcp_discovery_msg_p->options[2] = 0x01; /* option value: DHCPDISCOVER */
-
-    dhcp_discovery_msg_p->options[3] = 55; /* option 2 type: parameter request list */
-    dhcp_discovery_msg_p->options[4] = 11; /* option length */
-    dhcp_discovery_msg_p->options[5] = 0x01; /* option value[0]: subnet mask */
-    dhcp_discovery_msg_p->options[6] = 0x1c; /* option value[1]: broadcast address */
-    dhcp_discovery_msg_p->options[7] = 0x02; /* option value[2]: time offset */
-    dhcp_discovery_msg_p->options[8] = 0x03; /* option value[3]: router */
-    dhcp_discovery_msg_p->options[9] = 0x0f; /* option value[4]: domain name */
-    dhcp_discovery_msg_p->options[10] = 0x06; /* option value[5]: domain name server */
-    dhcp_discovery_msg_p->options[11] = 0x77; /* option value[6]: domain search */
-    dhcp_discovery_msg_p->options[12] = 0x0c; /* option value[7]: host name */
-    dhcp_discovery_msg_p->options[13] = 0x1a; /* option value[8]: interface MTU */
-    dhcp_discovery_msg_p->options[14] = 0x79; /* option value[9]: classless static route */
-    dhcp_discovery_msg_p->options[15] = 0x2a; /* option value[10]: network time protocol servers */
+    dhcp_discovery_msg_p->options[i++] = DHCP_OPTION_END;
 
     struct ipv4_address dest_ip_addr = { .value = IPV4_BROADCAST_ADDR };
 
@@ -112,96 +482,139 @@ static void net_send_ipv4_dhcp_discovery(
                                            &dest_ip_addr,
                                            hton16(DHCP_UDP_SERVER_PORT),
                                            tx_packet_p,
-                                           sizeof(struct dhcp_message) + 16);
+                                           sizeof(struct dhcp_message) + i);
 
-    if (g_net_layer3.tracing_on) {
+    if (NET_LAYER3_TRACING_ON()) {
         DEBUG_PRINTF("Net layer3: DHCP client sent discovery message\n");
     }
 }
 
 
 /**
- * Maps multicast IPv4 address to multicast Ethernet MAC address
+ * Sends a DHCPREQUEST message for a lease that the DHCP client already has,
+ * that is, in the INIT-REBOOT, RENEWING or REBINDING states
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param client_end_point_p    Pointer to the DHCP client UDP end point
+ * @param transaction_id        DHCP transaction ID
+ * @param client_ip_addr_p      IPv4 address being renewed or rebound, or
+ *                              0.0.0.0 in the INIT-REBOOT state
+ * @param requested_ip_addr_p   IPv4 address requested in the INIT-REBOOT
+ *                              state, or NULL in the other states
+ * @param dest_ip_addr_p        DHCP server address in the RENEWING state,
+ *                              or broadcast address in the other states
  */
-static inline void map_ipv4_multicast_addr_to_ethernet_multicast_addr(
-    const struct ipv4_address *ipv4_multicast_addr_p,
-    struct ethernet_mac_address *ethernet_multicast_addr_p)
+static void net_send_ipv4_dhcp_lease_request(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct net_layer4_end_point *client_end_point_p,
+    uint32_t transaction_id,
+    const struct ipv4_address *client_ip_addr_p,
+    const struct ipv4_address *requested_ip_addr_p,
+    const struct ipv4_address *dest_ip_addr_p)
 {
-    D_ASSERT(IPV4_ADDR_IS_MULTICAST(ipv4_multicast_addr_p));
-
-    ethernet_multicast_addr_p->bytes[0] = 0x01;
-    ethernet_multicast_addr_p->bytes[1] = 0x00;
-    ethernet_multicast_addr_p->bytes[2] = 0x5e;
-    ethernet_multicast_addr_p->bytes[3] = (ipv4_multicast_addr_p->bytes[1] & 0x7f);
-    ethernet_multicast_addr_p->hwords[2] = ipv4_multicast_addr_p->hwords[1];
-}
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(NET_PACKET_DATA_BUFFER_SIZE, true);
 
+    struct dhcp_message *dhcp_request_msg_p =
+        get_ipv4_udp_data_payload_area(tx_packet_p);
 
-static void
-join_ipv4_multicast_group(struct net_layer3_end_point *layer3_end_point_p,
-                          const struct ipv4_address *multicast_addr_p)
-{
-    struct ethernet_mac_address enet_multicast_addr;
-    struct net_layer2_end_point *layer2_end_point_p =
-        layer3_end_point_p->layer2_end_point_p;
+    net_init_ipv4_dhcp_client_message(layer3_end_point_p, dhcp_request_msg_p,
+                                      transaction_id, client_ip_addr_p);
 
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    dhcp_request_msg_p->options[0] = DHCP_OPTION_MESSAGE_TYPE;
+    dhcp_request_msg_p->options[1] = 1; /* option length */
+    dhcp_request_msg_p->options[2] = DHCP_REQUEST;
+
+    unsigned int i = 3;
+
+    if (requested_ip_addr_p != NULL) {
+        dhcp_request_msg_p->options[i + 0] = DHCP_OPTION_REQUESTED_IP_ADDR;
+        dhcp_request_msg_p->options[i + 1] = 4; /* option length */
+        dhcp_request_msg_p->options[i + 2] = requested_ip_addr_p->bytes[0];
+        dhcp_request_msg_p->options[i + 3] = requested_ip_addr_p->bytes[1];
+        dhcp_request_msg_p->options[i + 4] = requested_ip_addr_p->bytes[2];
+        dhcp_request_msg_p->options[i + 5] = requested_ip_addr_p->bytes[3];
+        i += 6;
+    }
 
-    map_ipv4_multicast_addr_to_ethernet_multicast_addr(multicast_addr_p,
-                                                       &enet_multicast_addr);
+    i = dhcp_add_parameter_request_list_option(dhcp_request_msg_p->options, i);
+    dhcp_request_msg_p->options[i++] = DHCP_OPTION_END;
 
-    ethernet_mac_add_multicast_addr(layer2_end_point_p->ethernet_mac_p,
-                                    &enet_multicast_addr);
+    net_layer4_send_udp_datagram_over_ipv4(client_end_point_p,
+                                           dest_ip_addr_p,
+                                           hton16(DHCP_UDP_SERVER_PORT),
+                                           tx_packet_p,
+                                           sizeof(struct dhcp_message) + i);
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: DHCP client sent request message for "
+                     "%u.%u.%u.%u\n",
+                     requested_ip_addr_p != NULL ?
+                        requested_ip_addr_p->bytes[0] : client_ip_addr_p->bytes[0],
+                     requested_ip_addr_p != NULL ?
+                        requested_ip_addr_p->bytes[1] : client_ip_addr_p->bytes[1],
+                     requested_ip_addr_p != NULL ?
+                        requested_ip_addr_p->bytes[2] : client_ip_addr_p->bytes[2],
+                     requested_ip_addr_p != NULL ?
+                        requested_ip_addr_p->bytes[3] : client_ip_addr_p->bytes[3]);
+    }
 }
 
 
-void net_layer3_join_ipv4_multicast_group(const struct ipv4_address *multicast_addr_p)
+/**
+ * Maps multicast IPv4 address to multicast Ethernet MAC address
+ */
+static inline void map_ipv4_multicast_addr_to_ethernet_multicast_addr(
+    const struct ipv4_address *ipv4_multicast_addr_p,
+    struct ethernet_mac_address *ethernet_multicast_addr_p)
 {
-    D_ASSERT(CALLER_IS_THREAD());
-
-#   ifdef USE_MPU
-    struct mpu_region_range old_comp_region;
-
-    rtos_thread_set_comp_region(&g_net_layer3,
-                                sizeof g_net_layer3,
-                                0,
-                                &old_comp_region);
-#   endif
-
-    join_ipv4_multicast_group(&g_net_layer3.local_layer3_end_points[0],
-                              multicast_addr_p);
+    D_ASSERT(IPV4_ADDR_IS_MULTICAST(ipv4_multicast_addr_p));
 
-#   ifdef USE_MPU
-    rtos_thread_restore_comp_region(&old_comp_region);
-#   endif
+    /*
+     * 01:00:5e, followed by the low 23 bits of the IPv4 address. The
+     * constant halfwords are in network byte order, so that the whole
+     * address is written with three halfword stores:
+     */
+    ethernet_multicast_addr_p->hwords[0] = HTON16_CONST(0x0100);
+    ethernet_multicast_addr_p->hwords[1] =
+        HTON16_CONST(0x5e00) | ((uint16_t)(ipv4_multicast_addr_p->bytes[1] & 0x7f) << 8);
+    ethernet_multicast_addr_p->hwords[2] = ipv4_multicast_addr_p->hwords[1];
 }
 
 
 static void arp_cache_init(struct arp_cache *arp_cache_p)
 {
-    rtos_mutex_init(&arp_cache_p->mutex, "ARP cache mutex");
-
-    rtos_semaphore_init(&arp_cache_p->cache_updated_semaphore,
-                        "ARP cache updated semaphore",
-                        0);
-
-    for (unsigned int i = 0; i < ARP_CACHE_NUM_ENTRIES; i++) {
-        struct arp_cache_entry *entry_p = &arp_cache_p->entries[i];
-
-        entry_p->state = ARP_ENTRY_INVALID;
+    for (unsigned int i = 0; i < ARP_CACHE_NUM_BUCKETS; i++) {
+        struct arp_cache_bucket *bucket_p = &arp_cache_p->buckets[i];
+
+        rtos_mutex_init(&bucket_p->mutex, "ARP cache bucket mutex");
+        bucket_p->sequence_count = 0;
+        for (unsigned int j = 0; j < ARP_CACHE_BUCKET_NUM_ENTRIES; j++) {
+            bucket_p->entries[j].state = ARP_ENTRY_INVALID;
+            bucket_p->entries[j].num_pending_tx_packets = 0;
+        }
     }
 }
 
 
 /**
  * Send an ARP request message
+ *
+ * @param layer2_end_point_p    Pointer to the local layer-2 end point
+ * @param source_ip_addr_p      Local IPv4 address
+ * @param dest_ip_addr_p        IPv4 address to resolve
+ * @param dest_mac_addr_p       MAC address to send the ARP request to (for
+ *                              refreshing a known mapping), or NULL to
+ *                              broadcast it
  */
 static void
 net_send_arp_request(const struct net_layer2_end_point *layer2_end_point_p,
                      const struct ipv4_address *source_ip_addr_p,
-                     const struct ipv4_address *dest_ip_addr_p)
+                     const struct ipv4_address *dest_ip_addr_p,
+                     const struct ethernet_mac_address *dest_mac_addr_p)
 {
-    struct network_packet *tx_packet_p = net_layer2_allocate_tx_packet(true);
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(ARP_FRAME_LENGTH, true);
 
     D_ASSERT(tx_packet_p != NULL);
 
@@ -224,7 +637,7 @@ net_send_arp_request(const struct net_layer2_end_point *layer2_end_point_p,
     COPY_MAC_ADDRESS(&arp_packet_p->dest_mac_addr, &g_ethernet_null_mac_addr);
     COPY_UNALIGNED_IPv4_ADDRESS(&arp_packet_p->dest_ip_addr, dest_ip_addr_p);
 
-    if (g_net_layer3.tracing_on) {
+    if (NET_LAYER3_TRACING_ON()) {
     	bool gratuitous_arp_req = (dest_ip_addr_p->value == source_ip_addr_p->value);
 
         DEBUG_PRINTF("Net layer3: %s request sent:\n"
@@ -236,8 +649,12 @@ net_send_arp_request(const struct net_layer2_end_point *layer2_end_point_p,
                      arp_packet_p->dest_ip_addr.bytes[3]);
     }
 
+    if (dest_mac_addr_p == NULL) {
+        dest_mac_addr_p = &g_ethernet_broadcast_mac_addr;
+    }
+
     (void)net_layer2_send_ethernet_frame(layer2_end_point_p,
-                                         &g_ethernet_broadcast_mac_addr,
+                                         dest_mac_addr_p,
                                          tx_packet_p,
                                          FRAME_TYPE_ARP_PACKET,
                                          sizeof(struct arp_packet));
@@ -253,7 +670,8 @@ static void net_send_arp_reply(
     const struct ethernet_mac_address *dest_mac_addr_p,
     const struct ipv4_address *dest_ip_addr_p)
 {
-    struct network_packet *tx_packet_p = net_layer2_allocate_tx_packet(true);
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(ARP_FRAME_LENGTH, true);
 
     D_ASSERT(tx_packet_p != NULL);
 
@@ -285,7 +703,7 @@ static void net_send_arp_reply(
     COPY_MAC_ADDRESS(&arp_packet_p->dest_mac_addr, dest_mac_addr_p);
     COPY_UNALIGNED_IPv4_ADDRESS(&arp_packet_p->dest_ip_addr, dest_ip_addr_p);
 
-    if (g_net_layer3.tracing_on) {
+    if (NET_LAYER3_TRACING_ON()) {
         DEBUG_PRINTF("Net layer3: ARP reply sent:\n"
                      "\tsource IPv4 address %u.%u.%u.%u\n"
                      "\tdestination IPv4 address %u.%u.%u.%u\n",
@@ -307,43 +725,202 @@ static void net_send_arp_reply(
 }
 
 
-static struct arp_cache_entry *
-arp_cache_lookup_or_allocate(struct arp_cache *arp_cache_p,
-                             const struct ipv4_address *dest_ip_addr_p,
-                             struct arp_cache_entry **free_entry_pp)
+/**
+ * Returns the ARP cache hash bucket for a given IPv4 address
+ */
+static inline struct arp_cache_bucket *
+arp_cache_get_bucket(struct arp_cache *arp_cache_p,
+                     const struct ipv4_address *ip_addr_p)
 {
-    struct arp_cache_entry *first_free_entry_p = NULL;
-    struct arp_cache_entry *least_recently_used_entry_p = NULL;
-    uint32_t least_recently_used_ticks_delta = 0;
-    struct arp_cache_entry *matching_entry_p = NULL;
+    uint32_t hash = ip_addr_p->value;
 
-    *free_entry_pp = NULL;
-    for (unsigned int i = 0; i < ARP_CACHE_NUM_ENTRIES; i++) {
-        struct arp_cache_entry *entry_p = &arp_cache_p->entries[i];
-        uint32_t current_ticks = rtos_get_ticks_since_boot();
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+    return &arp_cache_p->buckets[hash & (ARP_CACHE_NUM_BUCKETS - 1)];
+}
 
-        if (entry_p->state == ARP_ENTRY_INVALID) {
-            if (first_free_entry_p == NULL) {
-                first_free_entry_p = entry_p;
-            }
-        } else {
-            D_ASSERT(entry_p->state == ARP_ENTRY_FILLED ||
-                     entry_p->state == ARP_ENTRY_HALF_FILLED);
 
-            if (entry_p->dest_ip_addr.value == dest_ip_addr_p->value) {
-                matching_entry_p = entry_p;
-                break;
-            }
+/**
+ * Marks the beginning of an update of an ARP cache bucket, for lock-free
+ * readers. Must be called with the bucket's mutex held.
+ */
+static inline void arp_cache_bucket_update_begin(struct arp_cache_bucket *bucket_p)
+{
+    D_ASSERT(bucket_p->sequence_count % 2 == 0);
+    bucket_p->sequence_count ++;
+    __DMB();
+}
 
-            if (least_recently_used_entry_p == NULL ||
-                RTOS_TICKS_DELTA(entry_p->last_lookup_time_stamp,
-                                 current_ticks) >
-                   least_recently_used_ticks_delta) {
-                least_recently_used_entry_p = entry_p;
-                least_recently_used_ticks_delta =
-                RTOS_TICKS_DELTA(entry_p->last_lookup_time_stamp,
-                                 current_ticks);
-            }
+
+/**
+ * Marks the end of an update of an ARP cache bucket, for lock-free readers.
+ * Must be called with the bucket's mutex held.
+ */
+static inline void arp_cache_bucket_update_end(struct arp_cache_bucket *bucket_p)
+{
+    __DMB();
+    D_ASSERT(bucket_p->sequence_count % 2 != 0);
+    bucket_p->sequence_count ++;
+}
+
+
+/**
+ * Tells if a filled ARP cache entry is close to expiring and a refresh ARP
+ * request needs to be sent for it
+ */
+static inline bool arp_cache_entry_needs_refresh(
+    const struct arp_cache_entry *entry_p,
+    uint32_t current_ticks)
+{
+    return RTOS_TICKS_DELTA(entry_p->entry_filled_time_stamp, current_ticks) >=
+               ARP_CACHE_ENTRY_REFRESH_AGE_IN_TICKS &&
+           RTOS_TICKS_DELTA(entry_p->arp_request_time_stamp, current_ticks) >=
+               MILLISECONDS_TO_TICKS(ARP_REQUEST_RESEND_INTERVAL_IN_MS);
+}
+
+
+/**
+ * Looks up a non-expired ARP cache entry for a given IPv4 address, without
+ * taking the bucket's mutex
+ *
+ * @param arp_cache_p       Pointer to ARP cache
+ * @param dest_ip_addr_p    IPv4 address to look up
+ * @param dest_mac_addr_p   Area where the MAC address is to be returned
+ *
+ * @return true, on ARP cache hit
+ * @return false, on ARP cache miss, if the entry needs to be refreshed, or
+ *         if the bucket kept being updated while it was being read (the
+ *         caller must then retry with the bucket's mutex held)
+ */
+static bool arp_cache_lock_free_lookup(struct arp_cache *arp_cache_p,
+                                       const struct ipv4_address *dest_ip_addr_p,
+                                       struct ethernet_mac_address *dest_mac_addr_p)
+{
+    struct arp_cache_bucket *bucket_p = arp_cache_get_bucket(arp_cache_p,
+                                                             dest_ip_addr_p);
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
+
+    for (unsigned int retries = 0;
+         retries < ARP_CACHE_LOCK_FREE_LOOKUP_MAX_RETRIES;
+         retries ++) {
+        uint32_t sequence_count = bucket_p->sequence_count;
+        struct arp_cache_entry *hit_entry_p = NULL;
+        struct ethernet_mac_address mac_addr;
+        bool needs_refresh = false;
+
+        if (sequence_count % 2 != 0) {
+            continue;
+        }
+
+        __DMB();
+        for (unsigned int i = 0; i < ARP_CACHE_BUCKET_NUM_ENTRIES; i++) {
+            struct arp_cache_entry *entry_p = &bucket_p->entries[i];
+
+            if (entry_p->state == ARP_ENTRY_FILLED &&
+                entry_p->dest_ip_addr.value == dest_ip_addr_p->value &&
+                RTOS_TICKS_DELTA(entry_p->entry_filled_time_stamp,
+                                 current_ticks) <
+                    ARP_CACHE_ENTRY_LIFETIME_IN_TICKS) {
+                mac_addr = entry_p->dest_mac_addr;
+                needs_refresh = arp_cache_entry_needs_refresh(entry_p,
+                                                              current_ticks);
+                hit_entry_p = entry_p;
+                break;
+            }
+        }
+
+        __DMB();
+        if (bucket_p->sequence_count != sequence_count) {
+            continue;
+        }
+
+        if (hit_entry_p == NULL || needs_refresh) {
+            return false;
+        }
+
+        /*
+         * NOTE: This store races with updaters, but it is a single word
+         * only used as a hint for LRU replacement
+         */
+        hit_entry_p->last_lookup_time_stamp = current_ticks;
+        *dest_mac_addr_p = mac_addr;
+        return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * Drops the Tx packets queued in an ARP cache entry, waiting for the entry
+ * to be resolved. Must be called with the entry's bucket mutex held.
+ */
+static void arp_cache_entry_drop_pending_tx_packets(
+    struct arp_cache_entry *entry_p)
+{
+    for (unsigned int i = 0; i < entry_p->num_pending_tx_packets; i++) {
+        struct network_packet *tx_packet_p =
+            entry_p->pending_tx_packets[i].tx_packet_p;
+
+        D_ASSERT(tx_packet_p->state_flags ==
+                 (NET_PACKET_IN_TX_USE_BY_APP | NET_PACKET_FREE_AFTER_TX_COMPLETE));
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv4.arp_pending_tx_packets_dropped_count);
+    }
+
+    entry_p->num_pending_tx_packets = 0;
+}
+
+
+/**
+ * Looks up the ARP cache entry for a given IPv4 address, in its hash bucket.
+ * If there is none, it chooses an entry of the bucket for the IPv4 address:
+ * a free one, or else the least recently used one, which is invalidated.
+ * Must be called with the bucket's mutex held.
+ */
+static struct arp_cache_entry *
+arp_cache_lookup_or_allocate(struct arp_cache *arp_cache_p,
+                             const struct ipv4_address *dest_ip_addr_p,
+                             struct arp_cache_entry **free_entry_pp)
+{
+    struct arp_cache_bucket *bucket_p = arp_cache_get_bucket(arp_cache_p,
+                                                             dest_ip_addr_p);
+    struct arp_cache_entry *first_free_entry_p = NULL;
+    struct arp_cache_entry *least_recently_used_entry_p = NULL;
+    uint32_t least_recently_used_ticks_delta = 0;
+    struct arp_cache_entry *matching_entry_p = NULL;
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
+
+    D_ASSERT(rtos_mutex_is_mine(&bucket_p->mutex));
+
+    *free_entry_pp = NULL;
+    for (unsigned int i = 0; i < ARP_CACHE_BUCKET_NUM_ENTRIES; i++) {
+        struct arp_cache_entry *entry_p = &bucket_p->entries[i];
+
+        if (entry_p->state == ARP_ENTRY_INVALID) {
+            if (first_free_entry_p == NULL) {
+                first_free_entry_p = entry_p;
+            }
+        } else {
+            D_ASSERT(entry_p->state == ARP_ENTRY_FILLED ||
+                     entry_p->state == ARP_ENTRY_HALF_FILLED);
+
+            if (entry_p->dest_ip_addr.value == dest_ip_addr_p->value) {
+                matching_entry_p = entry_p;
+                break;
+            }
+
+            if (least_recently_used_entry_p == NULL ||
+                RTOS_TICKS_DELTA(entry_p->last_lookup_time_stamp,
+                                 current_ticks) >
+                   least_recently_used_ticks_delta) {
+                least_recently_used_entry_p = entry_p;
+                least_recently_used_ticks_delta =
+                RTOS_TICKS_DELTA(entry_p->last_lookup_time_stamp,
+                                 current_ticks);
+            }
         }
     }
 
@@ -355,7 +932,10 @@ arp_cache_lookup_or_allocate(struct arp_cache *arp_cache_p,
              * Overwrite the least recently used entry:
              */
             D_ASSERT(least_recently_used_entry_p != NULL);
+            arp_cache_entry_drop_pending_tx_packets(least_recently_used_entry_p);
+            arp_cache_bucket_update_begin(bucket_p);
             least_recently_used_entry_p->state = ARP_ENTRY_INVALID;
+            arp_cache_bucket_update_end(bucket_p);
             *free_entry_pp = least_recently_used_entry_p;
         }
     }
@@ -364,75 +944,189 @@ arp_cache_lookup_or_allocate(struct arp_cache *arp_cache_p,
 }
 
 
+/**
+ * Queues a Tx packet in an ARP cache entry that is waiting to be resolved.
+ * If the Tx packet is owned by the caller (it does not have
+ * NET_PACKET_FREE_AFTER_TX_COMPLETE set), a copy of it is queued instead.
+ * If the queue is full, the oldest queued packet is dropped.
+ * Must be called with the entry's bucket mutex held.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t arp_cache_entry_enqueue_pending_tx_packet(
+    struct arp_cache_entry *entry_p,
+    struct network_packet *tx_packet_p,
+    size_t ipv4_packet_length)
+{
+    struct arp_pending_tx_packet *pending_tx_packet_p;
+    size_t frame_length = sizeof(struct ethernet_header) + ipv4_packet_length;
+
+    D_ASSERT(entry_p->state == ARP_ENTRY_HALF_FILLED);
+    if (!(tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE)) {
+        struct network_packet *tx_packet_copy_p =
+            net_layer2_try_allocate_tx_packet(frame_length, true);
+
+        if (tx_packet_copy_p == NULL) {
+            ATOMIC_POST_INCREMENT_UINT32(
+                &g_net_layer3.ipv4.arp_pending_tx_packets_dropped_count);
+            return CAPTURE_ERROR("No Tx packet available to wait for ARP reply",
+                                 tx_packet_p, frame_length);
+        }
+
+        memcpy(tx_packet_copy_p->data_buffer, tx_packet_p->data_buffer,
+               frame_length);
+        tx_packet_copy_p->vlan_pcp = tx_packet_p->vlan_pcp;
+        tx_packet_copy_p->timestamp_flags = tx_packet_p->timestamp_flags;
+        tx_packet_p = tx_packet_copy_p;
+    }
+
+    if (entry_p->num_pending_tx_packets == ARP_PENDING_TX_QUEUE_MAX_PACKETS) {
+        struct network_packet *oldest_tx_packet_p =
+            entry_p->pending_tx_packets[0].tx_packet_p;
+
+        NET_PACKET_CLEAR_STATE_FLAG(oldest_tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(oldest_tx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv4.arp_pending_tx_packets_dropped_count);
+
+        memmove(&entry_p->pending_tx_packets[0],
+                &entry_p->pending_tx_packets[1],
+                (ARP_PENDING_TX_QUEUE_MAX_PACKETS - 1) *
+                    sizeof entry_p->pending_tx_packets[0]);
+        entry_p->num_pending_tx_packets --;
+    }
+
+    pending_tx_packet_p =
+        &entry_p->pending_tx_packets[entry_p->num_pending_tx_packets];
+    pending_tx_packet_p->tx_packet_p = tx_packet_p;
+    pending_tx_packet_p->ipv4_packet_length = ipv4_packet_length;
+    entry_p->num_pending_tx_packets ++;
+    return 0;
+}
+
+
+/**
+ * Resolves the MAC address of the next hop of an outgoing IPv4 packet. If the
+ * MAC address is not in the ARP cache, an ARP request is sent (unless one was
+ * sent recently) and the Tx packet is queued in the ARP cache entry, to be
+ * transmitted once the ARP reply is received. The caller is never blocked
+ * waiting for the ARP reply.
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param dest_ip_addr_p        IPv4 address of the next hop
+ * @param tx_packet_p           Tx packet to send, or NULL if the packet
+ *                              cannot be queued in the ARP cache entry. In
+ *                              that case, an error is returned if the MAC
+ *                              address is not resolved yet (the ARP request
+ *                              is still sent).
+ * @param ipv4_packet_length    Length of the IPv4 packet
+ * @param dest_mac_addr_p       Area where the MAC address of the next hop is
+ *                              to be returned, if it was resolved
+ * @param tx_packet_queued_p    Area where it is returned whether the Tx
+ *                              packet was queued waiting for the ARP reply
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
 static error_t resolve_dest_ipv4_addr(
     struct net_layer3_end_point *layer3_end_point_p,
     const struct ipv4_address *dest_ip_addr_p,
-    struct ethernet_mac_address *dest_mac_addr_p)
+    struct network_packet *tx_packet_p,
+    size_t ipv4_packet_length,
+    struct ethernet_mac_address *dest_mac_addr_p,
+    bool *tx_packet_queued_p)
 {
-    unsigned int arp_request_retries = 0;
     struct arp_cache_entry *matching_entry_p = NULL;
     struct arp_cache_entry *free_entry_p = NULL;
     struct arp_cache *arp_cache_p = &layer3_end_point_p->ipv4.arp_cache;
+    struct arp_cache_bucket *bucket_p = arp_cache_get_bucket(arp_cache_p,
+                                                             dest_ip_addr_p);
+    bool send_arp_request = false;
+    bool send_refresh_arp_request = false;
+    uint32_t current_ticks;
     error_t error;
 
-    rtos_mutex_lock(&arp_cache_p->mutex);
-    for ( ; ; ) {
-        bool send_arp_request = false;
-        matching_entry_p = arp_cache_lookup_or_allocate(arp_cache_p,
-                                                        dest_ip_addr_p,
-                                                        &free_entry_p);
-        uint32_t current_ticks = rtos_get_ticks_since_boot();
+    *tx_packet_queued_p = false;
+    PERF_PROBE_BEGIN(PERF_PROBE_ARP_LOOKUP);
 
-        if (matching_entry_p == NULL) {
-            send_arp_request = true;
-        } else if (matching_entry_p->state == ARP_ENTRY_FILLED) {
-            if (RTOS_TICKS_DELTA(matching_entry_p->entry_filled_time_stamp,
-                                 current_ticks) <
-                    ARP_CACHE_ENTRY_LIFETIME_IN_TICKS) {
-                /*
-                 * ARP cache hit
-                 */
-                *dest_mac_addr_p = matching_entry_p->dest_mac_addr;
-                break;
-            } else {
+    /*
+     * Fast path: ARP cache hit, without taking the bucket's mutex:
+     */
+    if (arp_cache_lock_free_lookup(arp_cache_p, dest_ip_addr_p,
+                                   dest_mac_addr_p)) {
+        PERF_PROBE_END(PERF_PROBE_ARP_LOOKUP);
+        return 0;
+    }
+
+    rtos_mutex_lock(&bucket_p->mutex);
+    matching_entry_p = arp_cache_lookup_or_allocate(arp_cache_p,
+                                                    dest_ip_addr_p,
+                                                    &free_entry_p);
+    PERF_PROBE_END(PERF_PROBE_ARP_LOOKUP);
+    current_ticks = rtos_get_ticks_since_boot();
+    if (matching_entry_p != NULL &&
+        matching_entry_p->state == ARP_ENTRY_FILLED) {
+        if (RTOS_TICKS_DELTA(matching_entry_p->entry_filled_time_stamp,
+                             current_ticks) <
+                ARP_CACHE_ENTRY_LIFETIME_IN_TICKS) {
+            /*
+             * ARP cache hit
+             */
+            *dest_mac_addr_p = matching_entry_p->dest_mac_addr;
+            matching_entry_p->last_lookup_time_stamp = current_ticks;
+            if (arp_cache_entry_needs_refresh(matching_entry_p, current_ticks)) {
                 /*
-                 * ARP entry expired, send a new ARP request:
+                 * Entry close to expiring: keep using it, but send a unicast
+                 * ARP request to refresh it before it expires:
                  */
-                if (g_net_layer3.tracing_on) {
-                    DEBUG_PRINTF("Net layer3: Expired ARP cache entry for IP address %u.%u.%u.%u\n",
-                                 dest_ip_addr_p->bytes[0],
-                                 dest_ip_addr_p->bytes[1],
-                                 dest_ip_addr_p->bytes[2],
-                                 dest_ip_addr_p->bytes[3]);
-                }
-
-                matching_entry_p->state = ARP_ENTRY_INVALID;
-                send_arp_request = true;
+                arp_cache_bucket_update_begin(bucket_p);
+                matching_entry_p->arp_request_time_stamp = current_ticks;
+                arp_cache_bucket_update_end(bucket_p);
+                send_refresh_arp_request = true;
             }
-        } else {
-            D_ASSERT(matching_entry_p->state == ARP_ENTRY_HALF_FILLED);
 
-            if (RTOS_TICKS_DELTA(matching_entry_p->arp_request_time_stamp, current_ticks) >=
-                MILLISECONDS_TO_TICKS(ARP_REPLY_WAIT_TIMEOUT_IN_MS)) {
-                /*
-                 * Re-send ARP request:
-                 */
-                ERROR_PRINTF(
-                    "Outstanding ARP request re-sent for IP address: %u.%u.%u.%u\n",
-                    dest_ip_addr_p->bytes[0],
-                    dest_ip_addr_p->bytes[1],
-                    dest_ip_addr_p->bytes[2],
-                    dest_ip_addr_p->bytes[3]);
+            error = 0;
+            goto common_exit;
+        }
 
-                send_arp_request = true;
-            }
+        /*
+         * ARP entry expired, send a new ARP request:
+         */
+        if (NET_LAYER3_TRACING_ON()) {
+            DEBUG_PRINTF("Net layer3: Expired ARP cache entry for IP address %u.%u.%u.%u\n",
+                         dest_ip_addr_p->bytes[0],
+                         dest_ip_addr_p->bytes[1],
+                         dest_ip_addr_p->bytes[2],
+                         dest_ip_addr_p->bytes[3]);
         }
 
+        free_entry_p = matching_entry_p;
+        matching_entry_p = NULL;
+    }
+
+    if (matching_entry_p == NULL) {
         /*
-         * Send ARP request if necessary:
+         * Start a new resolution:
          */
-        if (send_arp_request) {
-            if (arp_request_retries == ARP_REQUEST_MAX_RETRIES) {
+        D_ASSERT(free_entry_p != NULL);
+        arp_cache_bucket_update_begin(bucket_p);
+        free_entry_p->dest_ip_addr.value = dest_ip_addr_p->value;
+        free_entry_p->arp_request_time_stamp = current_ticks;
+        free_entry_p->last_lookup_time_stamp = current_ticks;
+        free_entry_p->arp_request_count = 1;
+        free_entry_p->num_pending_tx_packets = 0;
+        free_entry_p->state = ARP_ENTRY_HALF_FILLED;
+        arp_cache_bucket_update_end(bucket_p);
+        matching_entry_p = free_entry_p;
+        send_arp_request = true;
+    } else {
+        D_ASSERT(matching_entry_p->state == ARP_ENTRY_HALF_FILLED);
+
+        matching_entry_p->last_lookup_time_stamp = current_ticks;
+        if (RTOS_TICKS_DELTA(matching_entry_p->arp_request_time_stamp, current_ticks) >=
+            MILLISECONDS_TO_TICKS(ARP_REQUEST_RESEND_INTERVAL_IN_MS)) {
+            if (matching_entry_p->arp_request_count == ARP_REQUEST_MAX_RETRIES) {
                 error = CAPTURE_ERROR("Unreachable IP address",
                                       dest_ip_addr_p->value, 0);
 
@@ -442,94 +1136,199 @@ static error_t resolve_dest_ipv4_addr(
                              dest_ip_addr_p->bytes[2],
                              dest_ip_addr_p->bytes[3]);
 
+                arp_cache_entry_drop_pending_tx_packets(matching_entry_p);
+                arp_cache_bucket_update_begin(bucket_p);
+                matching_entry_p->state = ARP_ENTRY_INVALID;
+                arp_cache_bucket_update_end(bucket_p);
                 goto common_exit;
             }
 
-            arp_request_retries ++;
-            if (matching_entry_p != NULL) {
-                matching_entry_p->arp_request_time_stamp = rtos_get_ticks_since_boot();
-                matching_entry_p->state = ARP_ENTRY_HALF_FILLED;
-            } else {
-                D_ASSERT(free_entry_p != NULL);
-                free_entry_p->dest_ip_addr.value = dest_ip_addr_p->value;
-                free_entry_p->arp_request_time_stamp = rtos_get_ticks_since_boot();
-                free_entry_p->state = ARP_ENTRY_HALF_FILLED;
+            /*
+             * Re-send ARP request:
+             */
+            if (NET_LAYER3_TRACING_ON()) {
+                DEBUG_PRINTF("Net layer3: Outstanding ARP request re-sent for IP address %u.%u.%u.%u\n",
+                             dest_ip_addr_p->bytes[0],
+                             dest_ip_addr_p->bytes[1],
+                             dest_ip_addr_p->bytes[2],
+                             dest_ip_addr_p->bytes[3]);
             }
 
-            net_send_arp_request(layer3_end_point_p->layer2_end_point_p,
-                                 &layer3_end_point_p->ipv4.local_ip_addr,
-                                 dest_ip_addr_p);
+            matching_entry_p->arp_request_time_stamp = current_ticks;
+            matching_entry_p->arp_request_count ++;
+            send_arp_request = true;
+        }
+    }
+
+    if (tx_packet_p != NULL) {
+        error = arp_cache_entry_enqueue_pending_tx_packet(matching_entry_p,
+                                                          tx_packet_p,
+                                                          ipv4_packet_length);
+        if (error == 0) {
+            *tx_packet_queued_p = true;
         }
+    } else {
+        error = CAPTURE_ERROR("ARP resolution in progress",
+                              dest_ip_addr_p->value, 0);
+    }
 
-        /*
-         * Wait for ARP cache update:
-         */
-        rtos_mutex_unlock(&arp_cache_p->mutex);
-        rtos_semaphore_wait_timeout(&arp_cache_p->cache_updated_semaphore,
-                                    ARP_REPLY_WAIT_TIMEOUT_IN_MS);
-        rtos_mutex_lock(&arp_cache_p->mutex);
+common_exit:
+    rtos_mutex_unlock(&bucket_p->mutex);
+
+    /*
+     * ARP requests are sent without the bucket's mutex held, so that the
+     * ARP reply, or other resolutions in the same bucket, do not have to
+     * wait for the transmission:
+     */
+    if (send_arp_request) {
+        net_send_arp_request(layer3_end_point_p->layer2_end_point_p,
+                             &layer3_end_point_p->ipv4.local_ip_addr,
+                             dest_ip_addr_p,
+                             NULL);
     }
 
-    error = 0;
+    if (send_refresh_arp_request) {
+        net_send_arp_request(layer3_end_point_p->layer2_end_point_p,
+                             &layer3_end_point_p->ipv4.local_ip_addr,
+                             dest_ip_addr_p,
+                             dest_mac_addr_p);
+    }
 
-common_exit:
-    rtos_mutex_unlock(&arp_cache_p->mutex);
     return error;
 }
 
 
-static void arp_cache_update(struct arp_cache *arp_cache_p,
+/**
+ * Updates the ARP cache entry for a given IPv4 address, and transmits the Tx
+ * packets that were queued waiting for the entry to be resolved.
+ */
+static void arp_cache_update(struct net_layer3_end_point *layer3_end_point_p,
                              const struct ipv4_address *dest_ip_addr_p,
                              struct ethernet_mac_address *dest_mac_addr_p)
 {
+    struct arp_cache *arp_cache_p = &layer3_end_point_p->ipv4.arp_cache;
     struct arp_cache_entry *chosen_entry_p = NULL;
     struct arp_cache_entry *free_entry_p = NULL;
+    struct arp_cache_bucket *bucket_p = arp_cache_get_bucket(arp_cache_p,
+                                                             dest_ip_addr_p);
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
+    struct arp_pending_tx_packet pending_tx_packets[ARP_PENDING_TX_QUEUE_MAX_PACKETS];
+    unsigned int num_pending_tx_packets = 0;
 
-    rtos_mutex_lock(&arp_cache_p->mutex);
+    rtos_mutex_lock(&bucket_p->mutex);
     chosen_entry_p = arp_cache_lookup_or_allocate(arp_cache_p, dest_ip_addr_p,
                                                   &free_entry_p);
 
+    if (chosen_entry_p != NULL &&
+        chosen_entry_p->state == ARP_ENTRY_HALF_FILLED) {
+        num_pending_tx_packets = chosen_entry_p->num_pending_tx_packets;
+        memcpy(pending_tx_packets, chosen_entry_p->pending_tx_packets,
+               num_pending_tx_packets * sizeof pending_tx_packets[0]);
+        chosen_entry_p->num_pending_tx_packets = 0;
+    }
+
+    arp_cache_bucket_update_begin(bucket_p);
     if (chosen_entry_p == NULL) {
         D_ASSERT(free_entry_p != NULL);
         chosen_entry_p = free_entry_p;
         chosen_entry_p->dest_ip_addr.value = dest_ip_addr_p->value;
+        chosen_entry_p->last_lookup_time_stamp = current_ticks;
+        chosen_entry_p->arp_request_time_stamp = current_ticks;
+        chosen_entry_p->num_pending_tx_packets = 0;
     }
 
     COPY_MAC_ADDRESS(&chosen_entry_p->dest_mac_addr, dest_mac_addr_p);
     chosen_entry_p->state = ARP_ENTRY_FILLED;
-    chosen_entry_p->entry_filled_time_stamp = rtos_get_ticks_since_boot();
-    rtos_mutex_unlock(&arp_cache_p->mutex);
-    rtos_semaphore_signal(&arp_cache_p->cache_updated_semaphore);
+    chosen_entry_p->entry_filled_time_stamp = current_ticks;
+    arp_cache_bucket_update_end(bucket_p);
+    rtos_mutex_unlock(&bucket_p->mutex);
+
+    /*
+     * Transmit the packets that were waiting for the ARP reply:
+     */
+    for (unsigned int i = 0; i < num_pending_tx_packets; i++) {
+        (void)net_layer2_send_ethernet_frame(layer3_end_point_p->layer2_end_point_p,
+                                             dest_mac_addr_p,
+                                             pending_tx_packets[i].tx_packet_p,
+                                             FRAME_TYPE_IPv4_PACKET,
+                                             pending_tx_packets[i].ipv4_packet_length);
+    }
 }
 
 
 /**
- * Sends an IPv4 packet over Ethernet
+ * Loops back an outgoing IPv4 packet, handing it to the local IPv4 receive
+ * path as an Rx packet, without going through the Ethernet MAC. The Tx packet
+ * itself becomes the Rx packet, so that the data is not copied, unless the
+ * Tx packet is owned by the caller (NET_PACKET_FREE_AFTER_TX_COMPLETE not
+ * set). In that case, a copy of it is looped back instead. The Tx packet is
+ * returned to the Tx packet pool when the Rx packet is recycled.
+ *
+ * @param layer2_end_point_p    Pointer to the local layer-2 end point
+ * @param tx_packet_p           Tx packet containing the IPv4 packet
+ * @param ipv4_packet_length    Length of the IPv4 packet
+ *
+ * @return 0, on success
+ * @return error code, on failure
  */
-error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
-                                    struct network_packet *tx_packet_p,
-                                    size_t data_payload_length,
-                                    uint_fast8_t ip_packet_type)
+static error_t net_layer3_loopback_ipv4_packet(
+    struct net_layer2_end_point *layer2_end_point_p,
+    struct network_packet *tx_packet_p,
+    size_t ipv4_packet_length)
 {
-    struct ethernet_mac_address dest_mac_addr;
-    error_t error;
+    size_t frame_length = sizeof(struct ethernet_header) + ipv4_packet_length;
 
-    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
-    D_ASSERT(data_payload_length <= NET_MAX_IPV4_PACKET_PAYLOAD_SIZE);
+    if (!(tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE)) {
+        struct network_packet *tx_packet_copy_p =
+            net_layer2_try_allocate_tx_packet(frame_length, true);
 
-    struct ethernet_frame *tx_frame_p =
-       (struct ethernet_frame *)tx_packet_p->data_buffer;
-    struct ipv4_header *const ipv4_header_p = &tx_frame_p->ipv4_header;
+        if (tx_packet_copy_p == NULL) {
+            return CAPTURE_ERROR("No Tx packet available for IPv4 loopback",
+                                 tx_packet_p, frame_length);
+        }
 
-    struct net_layer3_end_point *layer3_end_point_p =
-        choose_ipv4_local_layer3_end_point(dest_ip_addr_p);
+        dma_memcpy(tx_packet_copy_p->data_buffer, tx_packet_p->data_buffer,
+                   frame_length);
+        tx_packet_p = tx_packet_copy_p;
+    }
 
-    struct net_layer2_end_point *layer2_end_point_p =
-        layer3_end_point_p->layer2_end_point_p;
+    D_ASSERT(tx_packet_p->state_flags ==
+             (NET_PACKET_IN_TX_USE_BY_APP | NET_PACKET_FREE_AFTER_TX_COMPLETE));
+    D_ASSERT(tx_packet_p->tx_buf_desc_p == NULL);
 
     /*
-     * Populate IP header
+     * Hand off ownership of the packet from the Tx side to the Rx side. The
+     * packet keeps its Tx signature, so that net_recycle_rx_packet() returns
+     * it to the Tx packet pool:
      */
+    tx_packet_p->state_flags = NET_PACKET_IN_RX_USE_BY_APP;
+    tx_packet_p->total_length = frame_length;
+    tx_packet_p->layer2_end_point_p = layer2_end_point_p;
+    tx_packet_p->next_fragment_p = NULL;
+    tx_packet_p->ipv4_reassembly_buffer_p = NULL;
+    tx_packet_p->rx_checksum_flags = NET_PACKET_RX_CHECKSUMS_VALIDATED |
+                                     NET_PACKET_RX_IP_HEADER_CHECKSUM_OK |
+                                     NET_PACKET_RX_PROTOCOL_CHECKSUM_OK;
+    tx_packet_p->vlan_pcp = 0;
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.looped_back_packets_count);
+    net_layer3_receive_ipv4_packet(tx_packet_p);
+    return 0;
+}
+
+
+/**
+ * Populates the IPv4 header of an outgoing IPv4 packet
+ */
+static void net_layer3_populate_ipv4_header(
+    struct ipv4_header *ipv4_header_p,
+    const struct ipv4_address *source_ip_addr_p,
+    const struct ipv4_address *dest_ip_addr_p,
+    size_t data_payload_length,
+    uint_fast8_t ip_packet_type,
+    uint16_t identification,
+    uint16_t flags_and_fragment_offset)
+{
     ipv4_header_p->version_and_header_length = 0;
     SET_BIT_FIELD(ipv4_header_p->version_and_header_length,
           IP_VERSION_MASK, IP_VERSION_SHIFT, 4);
@@ -540,22 +1339,18 @@ error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
     ipv4_header_p->total_length =
         hton16(sizeof(struct ipv4_header) + data_payload_length);
 
-    ipv4_header_p->identification =
-        hton16(ATOMIC_POST_INCREMENT_UINT16(
-                    &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num));
+    ipv4_header_p->identification = identification;
+    ipv4_header_p->flags_and_fragment_offset =
+        hton16(flags_and_fragment_offset);
 
     /*
-     * No IP packet fragmentation is supported:
+     * IGMP messages must not be forwarded beyond the local network
      */
-    ipv4_header_p->flags_and_fragment_offset =
-        hton16(IP_FLAG_DONT_FRAGMENT_MASK);
-
-    ipv4_header_p->time_to_live = 64; /* max routing hops */
+    ipv4_header_p->time_to_live =
+        (ip_packet_type == IP_PACKET_TYPE_IGMP) ? 1 : 64; /* max routing hops */
     ipv4_header_p->protocol_type = ip_packet_type;
 
-    ipv4_header_p->source_ip_addr.value =
-        layer3_end_point_p->ipv4.local_ip_addr.value;
-
+    ipv4_header_p->source_ip_addr.value = source_ip_addr_p->value;
     ipv4_header_p->dest_ip_addr.value = dest_ip_addr_p->value;
 
     /*
@@ -563,8 +1358,61 @@ error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
      * We just need to initialize the checksum field to 0
      */
     ipv4_header_p->header_checksum = 0;
+}
+
+
+/**
+ * Sends an IPv4 packet, or an IPv4 fragment, over Ethernet
+ *
+ * @param layer3_end_point_p        Pointer to the local layer-3 end point
+ * @param dest_ip_addr_p            Destination IPv4 address
+ * @param next_hop_ip_addr_p        Next-hop IPv4 address for unicast
+ *                                  destinations, as returned by
+ *                                  ipv4_route_lookup()
+ * @param tx_packet_p               Tx packet, with the IPv4 payload already
+ *                                  filled in
+ * @param data_payload_length       Length of the IPv4 payload
+ * @param ip_packet_type            IPv4 protocol type
+ * @param identification            IPv4 identification (big endian)
+ * @param flags_and_fragment_offset IPv4 flags and fragment offset (host
+ *                                  byte order)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t net_layer3_send_ipv4_packet_internal(
+    struct net_layer3_end_point *layer3_end_point_p,
+    const struct ipv4_address *dest_ip_addr_p,
+    const struct ipv4_address *next_hop_ip_addr_p,
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length,
+    uint_fast8_t ip_packet_type,
+    uint16_t identification,
+    uint16_t flags_and_fragment_offset)
+{
+    struct ethernet_mac_address dest_mac_addr;
+    bool tx_packet_queued = false;
+    error_t error;
+
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(data_payload_length <= NET_MAX_IPV4_PACKET_PAYLOAD_SIZE);
+
+    struct ethernet_frame *tx_frame_p =
+       (struct ethernet_frame *)tx_packet_p->data_buffer;
+    struct ipv4_header *const ipv4_header_p = &tx_frame_p->ipv4_header;
+
+    struct net_layer2_end_point *layer2_end_point_p =
+        layer3_end_point_p->layer2_end_point_p;
 
-    if (g_net_layer3.tracing_on) {
+    net_layer3_populate_ipv4_header(ipv4_header_p,
+                                    &layer3_end_point_p->ipv4.local_ip_addr,
+                                    dest_ip_addr_p,
+                                    data_payload_length,
+                                    ip_packet_type,
+                                    identification,
+                                    flags_and_fragment_offset);
+
+    if (NET_LAYER3_TRACING_ON()) {
         DEBUG_PRINTF("Net layer3: IPv4 packet sent:\n"
                      "\tsource IPv4 address %u.%u.%u.%u\n"
                      "\tdestination IPv4 address %u.%u.%u.%u\n"
@@ -581,38 +1429,50 @@ error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
                      ntoh16(ipv4_header_p->total_length));
     }
 
-    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.sent_packets_count);
+    COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_SENT);
+
+    if (layer3_end_point_p->ipv4.local_ip_addr.value == dest_ip_addr_p->value ||
+        IPV4_ADDR_IS_LOOPBACK(dest_ip_addr_p)) {
+        return net_layer3_loopback_ipv4_packet(layer2_end_point_p,
+                                               tx_packet_p,
+                                               sizeof(struct ipv4_header) +
+                                                   data_payload_length);
+    }
 
     /*
      * Get destination MAC address:
      */
-    if (layer3_end_point_p->ipv4.local_ip_addr.value == dest_ip_addr_p->value) {
-        error = CAPTURE_ERROR("IPv4 Loopback not supported", 0, 0);
-    } else if (dest_ip_addr_p->value == IPV4_BROADCAST_ADDR) {
+    if (dest_ip_addr_p->value == IPV4_BROADCAST_ADDR) {
         dest_mac_addr = g_ethernet_broadcast_mac_addr;
         error = 0;
     } else if (IPV4_ADDR_IS_MULTICAST(dest_ip_addr_p)) {
         map_ipv4_multicast_addr_to_ethernet_multicast_addr(dest_ip_addr_p,
                                                            &dest_mac_addr);
         error = 0;
-    } else if (SAME_IPv4_SUBNET(&layer3_end_point_p->ipv4.local_ip_addr,
-                                dest_ip_addr_p,
-                                layer3_end_point_p->ipv4.subnet_mask)) {
-        error = resolve_dest_ipv4_addr(layer3_end_point_p,
-                                       dest_ip_addr_p,
-                                       &dest_mac_addr);
-    } else if (layer3_end_point_p->ipv4.default_gateway_ip_addr.value == IPV4_NULL_ADDR) {
-        error = CAPTURE_ERROR("No default IPv4 gateway defined", 0, 0);
+    } else if (next_hop_ip_addr_p->value == IPV4_NULL_ADDR) {
+        error = CAPTURE_ERROR("No IPv4 route to destination",
+                              dest_ip_addr_p->value, 0);
     } else {
         error = resolve_dest_ipv4_addr(layer3_end_point_p,
-                                       &layer3_end_point_p->ipv4.default_gateway_ip_addr,
-                                       &dest_mac_addr);
+                                       next_hop_ip_addr_p,
+                                       tx_packet_p,
+                                       sizeof(struct ipv4_header) +
+                                           data_payload_length,
+                                       &dest_mac_addr,
+                                       &tx_packet_queued);
     }
 
     if (error != 0) {
         return error;
     }
 
+    if (tx_packet_queued) {
+        /*
+         * The packet will be sent when the ARP reply is received:
+         */
+        return 0;
+    }
+
    return net_layer2_send_ethernet_frame(layer2_end_point_p,
                                          &dest_mac_addr,
                                          tx_packet_p,
@@ -621,27 +1481,449 @@ error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
 }
 
 
+/**
+ * Sends an IPv4 packet over Ethernet. The IPv4 payload must fit in the Tx
+ * packet, so the packet is not fragmented.
+ */
+error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
+                                    struct network_packet *tx_packet_p,
+                                    size_t data_payload_length,
+                                    uint_fast8_t ip_packet_type)
+{
+    struct ipv4_address next_hop_ip_addr;
+    struct net_layer3_end_point *layer3_end_point_p =
+        ipv4_route_lookup(dest_ip_addr_p, &next_hop_ip_addr);
+
+    return net_layer3_send_ipv4_packet_internal(
+                layer3_end_point_p,
+                dest_ip_addr_p,
+                &next_hop_ip_addr,
+                tx_packet_p,
+                data_payload_length,
+                ip_packet_type,
+                hton16(ATOMIC_POST_INCREMENT_UINT16(
+                            &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num)),
+                IP_FLAG_DONT_FRAGMENT_MASK);
+}
+
 
 /**
- * Send an ICMPv4 message
+ * Sends a batch of IPv4 packets to the same destination over Ethernet. The
+ * route and the destination MAC address are looked up only once for the
+ * whole batch, and the packets are handed to the Ethernet MAC at once, so
+ * that its Tx ring is re-activated only once. The IPv4 payload of each
+ * packet must fit in its Tx packet.
  *
- * @param dest_ip_addr_p
- * @param tx_packet_p
- * @param msg_type
- * @param msg_code
- * @param data_payload_length
+ * @param dest_ip_addr_p        Destination IPv4 address
+ * @param tx_packets            Tx packets to send, in order, with their IPv4
+ *                              payloads already filled in
+ * @param data_payload_lengths  IPv4 payload length of each entry of
+ *                              tx_packets[]
+ * @param num_packets           Number of entries in tx_packets[] (at most
+ *                              NET_IPV4_MAX_TX_BATCH_PACKETS)
+ * @param ip_packet_type        IPv4 protocol type
  *
  * @return 0, on success
  * @return error code, on failure
- *
  */
-error_t net_layer3_send_ipv4_icmp_message(const struct ipv4_address *dest_ip_addr_p,
-                                          struct network_packet *tx_packet_p,
-                                          uint8_t msg_type,
-                                          uint8_t msg_code,
-                                          size_t data_payload_length)
+error_t net_layer3_send_ipv4_packets(const struct ipv4_address *dest_ip_addr_p,
+                                     struct network_packet *tx_packets[],
+                                     const size_t data_payload_lengths[],
+                                     uint_fast8_t num_packets,
+                                     uint_fast8_t ip_packet_type)
 {
-    /*
+    struct ipv4_address next_hop_ip_addr;
+    struct ethernet_mac_address dest_mac_addr;
+    size_t ip_packet_lengths[NET_IPV4_MAX_TX_BATCH_PACKETS];
+    bool tx_packet_queued = false;
+    error_t error;
+
+    D_ASSERT(num_packets != 0 && num_packets <= NET_IPV4_MAX_TX_BATCH_PACKETS);
+
+    struct net_layer3_end_point *layer3_end_point_p =
+        ipv4_route_lookup(dest_ip_addr_p, &next_hop_ip_addr);
+
+    if (layer3_end_point_p->ipv4.local_ip_addr.value == dest_ip_addr_p->value ||
+        IPV4_ADDR_IS_LOOPBACK(dest_ip_addr_p) ||
+        (next_hop_ip_addr.value == IPV4_NULL_ADDR &&
+         dest_ip_addr_p->value != IPV4_BROADCAST_ADDR &&
+         !IPV4_ADDR_IS_MULTICAST(dest_ip_addr_p))) {
+        /*
+         * Uncommon cases (loopback or no route): send packets one by one.
+         */
+        for (uint_fast8_t i = 0; i < num_packets; i ++) {
+            error = net_layer3_send_ipv4_packet_internal(
+                        layer3_end_point_p,
+                        dest_ip_addr_p,
+                        &next_hop_ip_addr,
+                        tx_packets[i],
+                        data_payload_lengths[i],
+                        ip_packet_type,
+                        hton16(ATOMIC_POST_INCREMENT_UINT16(
+                                &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num)),
+                        IP_FLAG_DONT_FRAGMENT_MASK);
+            if (error != 0) {
+                return error;
+            }
+        }
+
+        return 0;
+    }
+
+    for (uint_fast8_t i = 0; i < num_packets; i ++) {
+        D_ASSERT(tx_packets[i]->signature == NET_TX_PACKET_SIGNATURE);
+        D_ASSERT(data_payload_lengths[i] <= NET_MAX_IPV4_PACKET_PAYLOAD_SIZE);
+
+        net_layer3_populate_ipv4_header(
+            GET_IPV4_HEADER(tx_packets[i]),
+            &layer3_end_point_p->ipv4.local_ip_addr,
+            dest_ip_addr_p,
+            data_payload_lengths[i],
+            ip_packet_type,
+            hton16(ATOMIC_POST_INCREMENT_UINT16(
+                    &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num)),
+            IP_FLAG_DONT_FRAGMENT_MASK);
+
+        ip_packet_lengths[i] = sizeof(struct ipv4_header) + data_payload_lengths[i];
+        COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_SENT);
+    }
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: Batch of %u IPv4 packets sent to %u.%u.%u.%u\n",
+                     num_packets,
+                     dest_ip_addr_p->bytes[0],
+                     dest_ip_addr_p->bytes[1],
+                     dest_ip_addr_p->bytes[2],
+                     dest_ip_addr_p->bytes[3]);
+    }
+
+    /*
+     * Get destination MAC address, once for the whole batch:
+     */
+    if (dest_ip_addr_p->value == IPV4_BROADCAST_ADDR) {
+        dest_mac_addr = g_ethernet_broadcast_mac_addr;
+    } else if (IPV4_ADDR_IS_MULTICAST(dest_ip_addr_p)) {
+        map_ipv4_multicast_addr_to_ethernet_multicast_addr(dest_ip_addr_p,
+                                                           &dest_mac_addr);
+    } else {
+        error = resolve_dest_ipv4_addr(layer3_end_point_p,
+                                       &next_hop_ip_addr,
+                                       tx_packets[0],
+                                       ip_packet_lengths[0],
+                                       &dest_mac_addr,
+                                       &tx_packet_queued);
+        if (error != 0) {
+            return error;
+        }
+
+        if (tx_packet_queued) {
+            /*
+             * ARP resolution in progress: queue the rest of the batch in the
+             * ARP cache entry too, to be sent when the ARP reply is received:
+             */
+            for (uint_fast8_t i = 1; i < num_packets; i ++) {
+                error = resolve_dest_ipv4_addr(layer3_end_point_p,
+                                               &next_hop_ip_addr,
+                                               tx_packets[i],
+                                               ip_packet_lengths[i],
+                                               &dest_mac_addr,
+                                               &tx_packet_queued);
+                if (error != 0) {
+                    return error;
+                }
+
+                if (!tx_packet_queued) {
+                    /*
+                     * The ARP reply arrived in the meantime:
+                     */
+                    error = net_layer2_send_ethernet_frame(
+                                layer3_end_point_p->layer2_end_point_p,
+                                &dest_mac_addr,
+                                tx_packets[i],
+                                FRAME_TYPE_IPv4_PACKET,
+                                ip_packet_lengths[i]);
+                    if (error != 0) {
+                        return error;
+                    }
+                }
+            }
+
+            return 0;
+        }
+    }
+
+    return net_layer2_send_ethernet_frames(layer3_end_point_p->layer2_end_point_p,
+                                           &dest_mac_addr,
+                                           tx_packets,
+                                           FRAME_TYPE_IPv4_PACKET,
+                                           ip_packet_lengths,
+                                           num_packets);
+}
+
+
+/**
+ * Sends an IPv4 packet over Ethernet, whose payload is made of the data that
+ * follows the IPv4 header in the Tx packet's data buffer (typically, an
+ * upper-layer protocol header), followed by payload fragments that are
+ * transmitted without being copied (for example, from memory-mapped flash).
+ *
+ * Unlike net_layer3_send_ipv4_packet(), the packet cannot be queued waiting
+ * for an ARP reply, as the fragments are not part of the Tx packet. If the
+ * MAC address of the next hop is not known, an ARP request is sent and an
+ * error is returned, so that the caller can retry later. The destination
+ * must be a unicast remote address.
+ *
+ * @param dest_ip_addr_p        Destination IPv4 address
+ * @param tx_packet_p           Tx packet with the upper-layer header
+ * @param header_length         Length of the upper-layer header in the Tx
+ *                              packet's data buffer
+ * @param fragments             Payload fragments. Their data must not be
+ *                              modified until the Tx packet has been
+ *                              transmitted.
+ * @param num_fragments         Number of entries in fragments[] (at most
+ *                              ETHERNET_MAC_MAX_TX_FRAGMENTS)
+ * @param ip_packet_type        IPv4 protocol type
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer3_send_ipv4_packet_gather(const struct ipv4_address *dest_ip_addr_p,
+                                           struct network_packet *tx_packet_p,
+                                           size_t header_length,
+                                           const struct ethernet_tx_fragment fragments[],
+                                           uint_fast8_t num_fragments,
+                                           uint_fast8_t ip_packet_type)
+{
+    struct ipv4_address next_hop_ip_addr;
+    struct ethernet_mac_address dest_mac_addr;
+    bool tx_packet_queued;
+    size_t data_payload_length = header_length;
+    error_t error;
+
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(num_fragments != 0 && num_fragments <= ETHERNET_MAC_MAX_TX_FRAGMENTS);
+
+    for (uint_fast8_t i = 0; i < num_fragments; i ++) {
+        data_payload_length += fragments[i].length;
+    }
+
+    if (data_payload_length > NET_MAX_IPV4_PACKET_PAYLOAD_SIZE) {
+        return CAPTURE_ERROR("IPv4 packet payload too long", tx_packet_p,
+                             data_payload_length);
+    }
+
+    struct net_layer3_end_point *layer3_end_point_p =
+        ipv4_route_lookup(dest_ip_addr_p, &next_hop_ip_addr);
+
+    if (layer3_end_point_p->ipv4.local_ip_addr.value == dest_ip_addr_p->value ||
+        IPV4_ADDR_IS_LOOPBACK(dest_ip_addr_p) ||
+        IPV4_ADDR_IS_MULTICAST(dest_ip_addr_p) ||
+        dest_ip_addr_p->value == IPV4_BROADCAST_ADDR) {
+        return CAPTURE_ERROR("Invalid destination for gather IPv4 send",
+                             dest_ip_addr_p->value, 0);
+    }
+
+    if (next_hop_ip_addr.value == IPV4_NULL_ADDR) {
+        return CAPTURE_ERROR("No IPv4 route to destination",
+                             dest_ip_addr_p->value, 0);
+    }
+
+    error = resolve_dest_ipv4_addr(layer3_end_point_p,
+                                   &next_hop_ip_addr,
+                                   NULL,
+                                   0,
+                                   &dest_mac_addr,
+                                   &tx_packet_queued);
+    if (error != 0) {
+        return error;
+    }
+
+    D_ASSERT(!tx_packet_queued);
+
+    net_layer3_populate_ipv4_header(GET_IPV4_HEADER(tx_packet_p),
+                                    &layer3_end_point_p->ipv4.local_ip_addr,
+                                    dest_ip_addr_p,
+                                    data_payload_length,
+                                    ip_packet_type,
+                                    hton16(ATOMIC_POST_INCREMENT_UINT16(
+                                            &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num)),
+                                    IP_FLAG_DONT_FRAGMENT_MASK);
+
+    COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_SENT);
+    return net_layer2_send_ethernet_frame_gather(layer3_end_point_p->layer2_end_point_p,
+                                                 &dest_mac_addr,
+                                                 tx_packet_p,
+                                                 FRAME_TYPE_IPv4_PACKET,
+                                                 sizeof(struct ipv4_header) +
+                                                    header_length,
+                                                 fragments,
+                                                 num_fragments);
+}
+
+
+/**
+ * Copies a range of bytes of the concatenation of two buffers
+ */
+static void copy_from_two_buffers(uint8_t *dest_p,
+                                  const uint8_t *buffer1_p, size_t buffer1_length,
+                                  const uint8_t *buffer2_p,
+                                  size_t offset, size_t length)
+{
+    if (offset < buffer1_length) {
+        size_t chunk_length = buffer1_length - offset;
+
+        if (chunk_length > length) {
+            chunk_length = length;
+        }
+
+        memcpy(dest_p, buffer1_p + offset, chunk_length);
+        dest_p += chunk_length;
+        offset += chunk_length;
+        length -= chunk_length;
+    }
+
+    if (length != 0) {
+        memcpy(dest_p, buffer2_p + (offset - buffer1_length), length);
+    }
+}
+
+
+/**
+ * Sends an IPv4 packet over Ethernet, whose payload is copied from caller
+ * buffers, and which does not need to fit in one Ethernet frame. If it does
+ * not fit, it is sent as multiple IPv4 fragments, each one in a Tx packet
+ * allocated from the global Tx packet pool.
+ *
+ * @param dest_ip_addr_p    Destination IPv4 address
+ * @param ip_packet_type    IPv4 protocol type
+ * @param header_p          Upper-layer protocol header to prepend to the data
+ *                          (it can be NULL if header_length is 0)
+ * @param header_length     Length of the upper-layer protocol header
+ * @param data_p            Payload data
+ * @param data_length       Length of the payload data
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer3_send_large_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
+                                          uint_fast8_t ip_packet_type,
+                                          const void *header_p,
+                                          size_t header_length,
+                                          const void *data_p,
+                                          size_t data_length)
+{
+    size_t payload_length = header_length + data_length;
+    size_t fragment_length;
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    if (payload_length == 0 ||
+        payload_length > NET_IPV4_MAX_PACKET_SIZE - sizeof(struct ipv4_header)) {
+        return CAPTURE_ERROR("Invalid IPv4 packet length", payload_length, 0);
+    }
+
+    struct ipv4_address next_hop_ip_addr;
+    struct net_layer3_end_point *layer3_end_point_p =
+        ipv4_route_lookup(dest_ip_addr_p, &next_hop_ip_addr);
+
+    uint16_t identification =
+        hton16(ATOMIC_POST_INCREMENT_UINT16(
+                    &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num));
+
+    if (payload_length > NET_IPV4_FRAGMENT_MAX_PAYLOAD_SIZE) {
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv4.sent_fragmented_packets_count);
+    }
+
+    for (size_t offset = 0; offset < payload_length; offset += fragment_length) {
+        uint16_t flags_and_fragment_offset;
+
+        fragment_length = payload_length - offset;
+        if (fragment_length > NET_IPV4_FRAGMENT_MAX_PAYLOAD_SIZE) {
+            fragment_length = NET_IPV4_FRAGMENT_MAX_PAYLOAD_SIZE;
+            flags_and_fragment_offset = IP_FLAG_MORE_FRAGMENTS_MASK;
+        } else if (offset == 0) {
+            flags_and_fragment_offset = IP_FLAG_DONT_FRAGMENT_MASK;
+        } else {
+            flags_and_fragment_offset = 0;
+        }
+
+        D_ASSERT(offset % 8 == 0);
+        SET_BIT_FIELD(flags_and_fragment_offset,
+                      IP_FRAGMENT_OFFSET_MASK, IP_FRAGMENT_OFFSET_SHIFT,
+                      offset / 8);
+
+        struct network_packet *tx_packet_p =
+            net_layer2_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                              sizeof(struct ipv4_header) +
+                                              fragment_length,
+                                          true);
+
+        D_ASSERT(tx_packet_p != NULL);
+        copy_from_two_buffers(GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p),
+                              header_p, header_length,
+                              data_p, offset, fragment_length);
+
+        error = net_layer3_send_ipv4_packet_internal(layer3_end_point_p,
+                                                     dest_ip_addr_p,
+                                                     &next_hop_ip_addr,
+                                                     tx_packet_p,
+                                                     fragment_length,
+                                                     ip_packet_type,
+                                                     identification,
+                                                     flags_and_fragment_offset);
+        if (error != 0) {
+            NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+            net_layer2_free_tx_packet(tx_packet_p);
+            break;
+        }
+    }
+
+    return error;
+}
+
+
+
+/**
+ * Returns the source IPv4 address of the packets sent to a given
+ * destination (the local address of the egress layer-3 end point). It is
+ * needed by upper layers that compute checksums over a pseudo-header.
+ *
+ * @param dest_ip_addr_p    Destination IPv4 address
+ * @param source_ip_addr_p  Area where the source IPv4 address is returned
+ */
+void net_layer3_get_ipv4_source_address(const struct ipv4_address *dest_ip_addr_p,
+                                        struct ipv4_address *source_ip_addr_p)
+{
+    struct ipv4_address next_hop_ip_addr;
+    struct net_layer3_end_point *layer3_end_point_p =
+        ipv4_route_lookup(dest_ip_addr_p, &next_hop_ip_addr);
+
+    source_ip_addr_p->value = layer3_end_point_p->ipv4.local_ip_addr.value;
+}
+
+
+/**
+ * Send an ICMPv4 message
+ *
+ * @param dest_ip_addr_p
+ * @param tx_packet_p
+ * @param msg_type
+ * @param msg_code
+ * @param data_payload_length
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ *
+ */
+error_t net_layer3_send_ipv4_icmp_message(const struct ipv4_address *dest_ip_addr_p,
+                                          struct network_packet *tx_packet_p,
+                                          uint8_t msg_type,
+                                          uint8_t msg_code,
+                                          size_t data_payload_length)
+{
+    /*
      * Populate ICMP header:
      */
     struct icmpv4_header *icmp_header_p =
@@ -666,594 +1948,2337 @@ error_t net_layer3_send_ipv4_icmp_message(const struct ipv4_address *dest_ip_add
 }
 
 
-static void net_trace_received_arp_packet(struct network_packet *packet_p)
+/**
+ * Sends a membership report for a given multicast group, or a leave message,
+ * in the format of the IGMP version of the last membership query received
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param group_addr_p          Multicast group address
+ * @param igmpv3_record_type    IGMPv3 group record type. For IGMPv2,
+ *                              IGMPV3_CHANGE_TO_INCLUDE_MODE means that a
+ *                              leave message is sent and any other value
+ *                              that a membership report is sent.
+ */
+static void net_send_igmp_report(struct net_layer3_end_point *layer3_end_point_p,
+                                 const struct ipv4_address *group_addr_p,
+                                 uint8_t igmpv3_record_type)
 {
-    struct ethernet_frame *frame_p =
-        (struct ethernet_frame *)packet_p->data_buffer;
+    struct network_packet *tx_packet_p;
+    const struct ipv4_address *dest_ip_addr_p;
+    size_t igmp_msg_length;
+    uint16_t *msg_checksum_p;
 
-    uint16_t arp_operation = ntoh16(frame_p->arp_packet.operation);
+    if (layer3_end_point_p->ipv4.igmp_version == 2) {
+        igmp_msg_length = sizeof(struct igmp_message);
+        tx_packet_p = net_layer2_allocate_tx_packet(
+                        IGMP_FRAME_LENGTH(igmp_msg_length), true);
 
-    DEBUG_PRINTF(
-        "Net layer3: Received ARP packet:\n"
-        "\toperation: %s (%#x)\n"
-        "\tsource mac addr: %x:%x:%x:%x:%x:%x\n"
-        "\tsource IP address: %u.%u.%u.%u\n"
-        "\tdest mac addr: %x:%x:%x:%x:%x:%x\n"
-        "\tdest IP address: %u.%u.%u.%u\n",
-        arp_operation == ARP_REQUEST ? "ARP request" : "ARP reply",
-        arp_operation,
-        frame_p->arp_packet.source_mac_addr.bytes[0],
-        frame_p->arp_packet.source_mac_addr.bytes[1],
-        frame_p->arp_packet.source_mac_addr.bytes[2],
-        frame_p->arp_packet.source_mac_addr.bytes[3],
-        frame_p->arp_packet.source_mac_addr.bytes[4],
-        frame_p->arp_packet.source_mac_addr.bytes[5],
-        frame_p->arp_packet.source_ip_addr.bytes[0],
-        frame_p->arp_packet.source_ip_addr.bytes[1],
-        frame_p->arp_packet.source_ip_addr.bytes[2],
-        frame_p->arp_packet.source_ip_addr.bytes[3],
-        frame_p->arp_packet.dest_mac_addr.bytes[0],
-        frame_p->arp_packet.dest_mac_addr.bytes[1],
-        frame_p->arp_packet.dest_mac_addr.bytes[2],
-        frame_p->arp_packet.dest_mac_addr.bytes[3],
-        frame_p->arp_packet.dest_mac_addr.bytes[4],
-        frame_p->arp_packet.dest_mac_addr.bytes[5],
-        frame_p->arp_packet.dest_ip_addr.bytes[0],
-        frame_p->arp_packet.dest_ip_addr.bytes[1],
-        frame_p->arp_packet.dest_ip_addr.bytes[2],
-        frame_p->arp_packet.dest_ip_addr.bytes[3]);
+        struct igmp_message *igmp_msg_p = GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+
+        if (igmpv3_record_type == IGMPV3_CHANGE_TO_INCLUDE_MODE) {
+            igmp_msg_p->msg_type = IGMP_TYPE_V2_LEAVE_GROUP;
+            dest_ip_addr_p = &g_ipv4_all_routers_multicast_addr;
+        } else {
+            igmp_msg_p->msg_type = IGMP_TYPE_V2_MEMBERSHIP_REPORT;
+            dest_ip_addr_p = group_addr_p;
+        }
+
+        igmp_msg_p->max_resp_code = 0;
+        igmp_msg_p->group_addr.value = group_addr_p->value;
+        msg_checksum_p = &igmp_msg_p->msg_checksum;
+    } else {
+        igmp_msg_length = sizeof(struct igmpv3_membership_report) +
+                          sizeof(struct igmpv3_group_record);
+        tx_packet_p = net_layer2_allocate_tx_packet(
+                        IGMP_FRAME_LENGTH(igmp_msg_length), true);
+
+        struct igmpv3_membership_report *report_p =
+            GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+
+        report_p->msg_type = IGMP_TYPE_V3_MEMBERSHIP_REPORT;
+        report_p->reserved1 = 0;
+        report_p->reserved2 = 0;
+        report_p->num_group_records = hton16(1);
+        report_p->group_records[0].record_type = igmpv3_record_type;
+        report_p->group_records[0].aux_data_length = 0;
+        report_p->group_records[0].num_sources = 0;
+        report_p->group_records[0].group_addr.value = group_addr_p->value;
+        dest_ip_addr_p = &g_igmpv3_routers_multicast_addr;
+        msg_checksum_p = &report_p->msg_checksum;
+    }
+
+    /*
+     * NOTE: The Ethernet MAC does not compute IGMP checksums
+     */
+    *msg_checksum_p = 0;
+    *msg_checksum_p = internet_checksum(GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p),
+                                        igmp_msg_length);
+
+    (void)net_layer3_send_ipv4_packet_internal(
+                layer3_end_point_p,
+                dest_ip_addr_p,
+                dest_ip_addr_p,
+                tx_packet_p,
+                igmp_msg_length,
+                IP_PACKET_TYPE_IGMP,
+                hton16(ATOMIC_POST_INCREMENT_UINT16(
+                            &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num)),
+                IP_FLAG_DONT_FRAGMENT_MASK);
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.sent_igmp_messages_count);
 }
 
 
-void net_layer3_receive_arp_packet(struct network_packet *rx_packet_p)
+/**
+ * Joins an IPv4 multicast group on a given local layer-3 end point. On the
+ * first join of the group, the corresponding Ethernet multicast address is
+ * added to the MAC's hash filter and an unsolicited membership report is sent.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t
+join_ipv4_multicast_group(struct net_layer3_end_point *layer3_end_point_p,
+                          const struct ipv4_address *multicast_addr_p)
 {
-    D_ASSERT(rx_packet_p->total_length >=
-             sizeof(struct ethernet_header) + sizeof(struct arp_packet));
+    struct ethernet_mac_address enet_multicast_addr;
+    struct ipv4_multicast_group *group_p = NULL;
+    struct ipv4_multicast_group *free_group_p = NULL;
+    struct ipv4_end_point *ipv4_end_point_p = &layer3_end_point_p->ipv4;
+    struct net_layer2_end_point *layer2_end_point_p =
+        layer3_end_point_p->layer2_end_point_p;
+    bool first_join = false;
+    error_t error = 0;
 
-    if (g_net_layer3.tracing_on) {
-        net_trace_received_arp_packet(rx_packet_p);
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+
+    rtos_mutex_lock(&ipv4_end_point_p->multicast_groups_mutex);
+
+    for (unsigned int i = 0; i < NET_IPV4_MAX_MULTICAST_GROUPS; i ++) {
+        struct ipv4_multicast_group *entry_p = &ipv4_end_point_p->multicast_groups[i];
+
+        if (entry_p->group_addr.value == multicast_addr_p->value) {
+            group_p = entry_p;
+            break;
+        }
+
+        if (entry_p->group_addr.value == IPV4_NULL_ADDR && free_group_p == NULL) {
+            free_group_p = entry_p;
+        }
     }
 
-    struct net_layer2_end_point *const layer2_end_point_p =
-        rx_packet_p->layer2_end_point_p;
-    struct net_layer3_end_point *const layer3_end_point_p =
-        layer2_end_point_p->layer3_end_point_p;
-    struct ethernet_frame *const rx_frame_p =
-        (struct ethernet_frame *)rx_packet_p->data_buffer;
+    if (group_p == NULL) {
+        if (free_group_p == NULL) {
+            error = CAPTURE_ERROR("Too many IPv4 multicast groups joined",
+                                  multicast_addr_p->value, layer3_end_point_p);
+            goto common_exit;
+        }
 
-    uint16_t arp_operation = ntoh16(rx_frame_p->arp_packet.operation);
-    struct ipv4_address source_ip_addr;
-    struct ipv4_address dest_ip_addr;
-    bool duplicate_ip_addr_detected = false;
+        if (ipv4_end_point_p->num_multicast_groups == 0) {
+            /*
+             * General membership queries are sent to the all-systems group:
+             */
+            map_ipv4_multicast_addr_to_ethernet_multicast_addr(
+                &g_ipv4_all_systems_multicast_addr, &enet_multicast_addr);
+            ethernet_mac_add_multicast_addr(layer2_end_point_p->ethernet_mac_p,
+                                            &enet_multicast_addr);
+        }
+
+        map_ipv4_multicast_addr_to_ethernet_multicast_addr(multicast_addr_p,
+                                                           &enet_multicast_addr);
+        ethernet_mac_add_multicast_addr(layer2_end_point_p->ethernet_mac_p,
+                                        &enet_multicast_addr);
+
+        group_p = free_group_p;
+        group_p->group_addr.value = multicast_addr_p->value;
+        group_p->join_count = 0;
+        ipv4_end_point_p->num_multicast_groups ++;
+        first_join = true;
+    }
+
+    group_p->join_count ++;
+
+common_exit:
+    rtos_mutex_unlock(&ipv4_end_point_p->multicast_groups_mutex);
+
+    if (first_join) {
+        net_send_igmp_report(layer3_end_point_p, multicast_addr_p,
+                             IGMPV3_CHANGE_TO_EXCLUDE_MODE);
+    }
+
+    return error;
+}
+
+
+/**
+ * Leaves an IPv4 multicast group on a given local layer-3 end point. On the
+ * last leave of the group, the corresponding Ethernet multicast address is
+ * removed from the MAC's hash filter and a leave message is sent.
+ */
+static void
+leave_ipv4_multicast_group(struct net_layer3_end_point *layer3_end_point_p,
+                           const struct ipv4_address *multicast_addr_p)
+{
+    struct ethernet_mac_address enet_multicast_addr;
+    struct ipv4_multicast_group *group_p = NULL;
+    struct ipv4_end_point *ipv4_end_point_p = &layer3_end_point_p->ipv4;
+    struct net_layer2_end_point *layer2_end_point_p =
+        layer3_end_point_p->layer2_end_point_p;
+    bool last_leave = false;
 
     D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
-    D_ASSERT(layer3_end_point_p->layer2_end_point_p == layer2_end_point_p);
 
-    if (arp_operation == ARP_REQUEST || arp_operation == ARP_REPLY) {
-        D_ASSERT(rx_frame_p->arp_packet.link_addr_type == hton16(0x1));
-        D_ASSERT(rx_frame_p->arp_packet.network_addr_type ==
-                 hton16(FRAME_TYPE_IPv4_PACKET));
-        D_ASSERT(rx_frame_p->arp_packet.link_addr_size ==
-                 sizeof(struct ethernet_mac_address));
-        D_ASSERT(rx_frame_p->arp_packet.network_addr_size ==
-                 sizeof(struct ipv4_address));
+    rtos_mutex_lock(&ipv4_end_point_p->multicast_groups_mutex);
+
+    for (unsigned int i = 0; i < NET_IPV4_MAX_MULTICAST_GROUPS; i ++) {
+        if (ipv4_end_point_p->multicast_groups[i].group_addr.value ==
+                multicast_addr_p->value) {
+            group_p = &ipv4_end_point_p->multicast_groups[i];
+            break;
+        }
     }
 
-    COPY_UNALIGNED_IPv4_ADDRESS(&source_ip_addr,
-                                &rx_frame_p->arp_packet.source_ip_addr);
+    D_ASSERT(group_p != NULL);
+    D_ASSERT(group_p->join_count != 0);
+
+    group_p->join_count --;
+    if (group_p->join_count == 0) {
+        group_p->group_addr.value = IPV4_NULL_ADDR;
+        map_ipv4_multicast_addr_to_ethernet_multicast_addr(multicast_addr_p,
+                                                           &enet_multicast_addr);
+        ethernet_mac_remove_multicast_addr(layer2_end_point_p->ethernet_mac_p,
+                                           &enet_multicast_addr);
+
+        D_ASSERT(ipv4_end_point_p->num_multicast_groups != 0);
+        ipv4_end_point_p->num_multicast_groups --;
+        if (ipv4_end_point_p->num_multicast_groups == 0) {
+            map_ipv4_multicast_addr_to_ethernet_multicast_addr(
+                &g_ipv4_all_systems_multicast_addr, &enet_multicast_addr);
+            ethernet_mac_remove_multicast_addr(layer2_end_point_p->ethernet_mac_p,
+                                               &enet_multicast_addr);
+        }
+
+        last_leave = true;
+    }
+
+    rtos_mutex_unlock(&ipv4_end_point_p->multicast_groups_mutex);
+
+    if (last_leave) {
+        net_send_igmp_report(layer3_end_point_p, multicast_addr_p,
+                             IGMPV3_CHANGE_TO_INCLUDE_MODE);
+    }
+}
+
+
+/**
+ * Joins an IPv4 multicast group on all local layer-3 end points. Joins are
+ * reference counted, so each successful call must be matched by a call to
+ * net_layer3_leave_ipv4_multicast_group().
+ *
+ * @param multicast_addr_p  Multicast group address (other than 224.0.0.1)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer3_join_ipv4_multicast_group(const struct ipv4_address *multicast_addr_p)
+{
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    if (!IPV4_ADDR_IS_MULTICAST(multicast_addr_p) ||
+        multicast_addr_p->value == g_ipv4_all_systems_multicast_addr.value) {
+        error = CAPTURE_ERROR("Invalid IPv4 multicast group address",
+                              multicast_addr_p->value, 0);
+        goto common_exit;
+    }
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer3.local_layer3_end_points); i ++) {
+        error = join_ipv4_multicast_group(&g_net_layer3.local_layer3_end_points[i],
+                                          multicast_addr_p);
+        if (error != 0) {
+            /*
+             * Undo the joins done on the previous end points:
+             */
+            while (i -- != 0) {
+                leave_ipv4_multicast_group(&g_net_layer3.local_layer3_end_points[i],
+                                           multicast_addr_p);
+            }
+
+            break;
+        }
+    }
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Leaves an IPv4 multicast group on all local layer-3 end points
+ *
+ * @param multicast_addr_p  Multicast group address previously joined with
+ *                          net_layer3_join_ipv4_multicast_group()
+ */
+void net_layer3_leave_ipv4_multicast_group(const struct ipv4_address *multicast_addr_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer3.local_layer3_end_points); i ++) {
+        leave_ipv4_multicast_group(&g_net_layer3.local_layer3_end_points[i],
+                                   multicast_addr_p);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Processes an incoming IGMP message. Membership queries are answered right
+ * away with a membership report for each group joined that the query asks
+ * about, instead of after a random delay bounded by the query's maximum
+ * response time. Membership reports from other hosts are ignored.
+ */
+static void net_process_incoming_igmp_message(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct network_packet *rx_packet_p)
+{
+    struct ipv4_end_point *ipv4_end_point_p = &layer3_end_point_p->ipv4;
+    struct ipv4_address reported_groups[NET_IPV4_MAX_MULTICAST_GROUPS];
+    unsigned int num_reported_groups = 0;
+    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    size_t ipv4_header_length =
+        GET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                      IP_HEADER_LENGTH_MASK, IP_HEADER_LENGTH_SHIFT) *
+        sizeof(uint32_t);
+    size_t ipv4_packet_length = ntoh16(ipv4_header_p->total_length);
+
+    /*
+     * NOTE: IGMP messages usually carry the IPv4 router alert option, so
+     * the IGMP message is located using the actual IPv4 header length.
+     */
+    if (ipv4_header_length < sizeof(struct ipv4_header) ||
+        ipv4_packet_length < ipv4_header_length + sizeof(struct igmp_message) ||
+        sizeof(struct ethernet_header) + ipv4_packet_length > rx_packet_p->total_length ||
+        (ipv4_packet_length - ipv4_header_length) % sizeof(uint16_t) != 0) {
+        ERROR_PRINTF("Received malformed IGMP message\n");
+        COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_RX_DROPPED);
+        goto exit;
+    }
+
+    size_t igmp_msg_length = ipv4_packet_length - ipv4_header_length;
+    struct igmp_message *igmp_msg_p =
+        (struct igmp_message *)((uint8_t *)ipv4_header_p + ipv4_header_length);
+
+    if (internet_checksum(igmp_msg_p, igmp_msg_length) != 0) {
+        ERROR_PRINTF("Received IGMP message with wrong checksum\n");
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv4.rx_packets_dropped_bad_checksum_count);
+        COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_RX_DROPPED);
+        goto exit;
+    }
+
+    if (igmp_msg_p->msg_type != IGMP_TYPE_MEMBERSHIP_QUERY) {
+        goto exit;
+    }
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.rx_igmp_queries_count);
+
+    rtos_mutex_lock(&ipv4_end_point_p->multicast_groups_mutex);
+
+    ipv4_end_point_p->igmp_version =
+        (igmp_msg_length >= IGMPV3_MEMBERSHIP_QUERY_MIN_LENGTH) ? 3 : 2;
+
+    for (unsigned int i = 0; i < NET_IPV4_MAX_MULTICAST_GROUPS; i ++) {
+        uint32_t group_addr_value =
+            ipv4_end_point_p->multicast_groups[i].group_addr.value;
+
+        if (group_addr_value != IPV4_NULL_ADDR &&
+            (igmp_msg_p->group_addr.value == IPV4_NULL_ADDR ||
+             igmp_msg_p->group_addr.value == group_addr_value)) {
+            reported_groups[num_reported_groups].value = group_addr_value;
+            num_reported_groups ++;
+        }
+    }
+
+    rtos_mutex_unlock(&ipv4_end_point_p->multicast_groups_mutex);
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: IGMPv%u membership query received for "
+                     "%u.%u.%u.%u (%u groups to report)\n",
+                     ipv4_end_point_p->igmp_version,
+                     igmp_msg_p->group_addr.bytes[0],
+                     igmp_msg_p->group_addr.bytes[1],
+                     igmp_msg_p->group_addr.bytes[2],
+                     igmp_msg_p->group_addr.bytes[3],
+                     num_reported_groups);
+    }
+
+exit:
+    net_recycle_rx_packet(rx_packet_p);
+
+    for (unsigned int i = 0; i < num_reported_groups; i ++) {
+        net_send_igmp_report(layer3_end_point_p, &reported_groups[i],
+                             IGMPV3_MODE_IS_EXCLUDE);
+    }
+}
+
+
+static void net_trace_received_arp_packet(struct network_packet *packet_p)
+{
+    struct ethernet_frame *frame_p =
+        (struct ethernet_frame *)packet_p->data_buffer;
+
+    uint16_t arp_operation = ntoh16(frame_p->arp_packet.operation);
+
+    DEBUG_PRINTF(
+        "Net layer3: Received ARP packet:\n"
+        "\toperation: %s (%#x)\n"
+        "\tsource mac addr: %x:%x:%x:%x:%x:%x\n"
+        "\tsource IP address: %u.%u.%u.%u\n"
+        "\tdest mac addr: %x:%x:%x:%x:%x:%x\n"
+        "\tdest IP address: %u.%u.%u.%u\n",
+        arp_operation == ARP_REQUEST ? "ARP request" : "ARP reply",
+        arp_operation,
+        frame_p->arp_packet.source_mac_addr.bytes[0],
+        frame_p->arp_packet.source_mac_addr.bytes[1],
+        frame_p->arp_packet.source_mac_addr.bytes[2],
+        frame_p->arp_packet.source_mac_addr.bytes[3],
+        frame_p->arp_packet.source_mac_addr.bytes[4],
+        frame_p->arp_packet.source_mac_addr.bytes[5],
+        frame_p->arp_packet.source_ip_addr.bytes[0],
+        frame_p->arp_packet.source_ip_addr.bytes[1],
+        frame_p->arp_packet.source_ip_addr.bytes[2],
+        frame_p->arp_packet.source_ip_addr.bytes[3],
+        frame_p->arp_packet.dest_mac_addr.bytes[0],
+        frame_p->arp_packet.dest_mac_addr.bytes[1],
+        frame_p->arp_packet.dest_mac_addr.bytes[2],
+        frame_p->arp_packet.dest_mac_addr.bytes[3],
+        frame_p->arp_packet.dest_mac_addr.bytes[4],
+        frame_p->arp_packet.dest_mac_addr.bytes[5],
+        frame_p->arp_packet.dest_ip_addr.bytes[0],
+        frame_p->arp_packet.dest_ip_addr.bytes[1],
+        frame_p->arp_packet.dest_ip_addr.bytes[2],
+        frame_p->arp_packet.dest_ip_addr.bytes[3]);
+}
+
+
+/**
+ * Invalidates all the entries of the ARP cache of a layer-3 end point. The
+ * Tx packets waiting for pending ARP resolutions are dropped.
+ *
+ * @param layer3_end_point_p    Pointer to layer-3 end point
+ */
+void net_layer3_flush_arp_cache(struct net_layer3_end_point *layer3_end_point_p)
+{
+    struct arp_cache *arp_cache_p = &layer3_end_point_p->ipv4.arp_cache;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(arp_cache_p->buckets); i++) {
+        struct arp_cache_bucket *bucket_p = &arp_cache_p->buckets[i];
+
+        rtos_mutex_lock(&bucket_p->mutex);
+        for (unsigned int j = 0; j < ARRAY_SIZE(bucket_p->entries); j++) {
+            struct arp_cache_entry *entry_p = &bucket_p->entries[j];
+
+            if (entry_p->state == ARP_ENTRY_HALF_FILLED) {
+                arp_cache_entry_drop_pending_tx_packets(entry_p);
+            }
+        }
+
+        arp_cache_bucket_update_begin(bucket_p);
+        for (unsigned int j = 0; j < ARRAY_SIZE(bucket_p->entries); j++) {
+            bucket_p->entries[j].state = ARP_ENTRY_INVALID;
+        }
+
+        arp_cache_bucket_update_end(bucket_p);
+        rtos_mutex_unlock(&bucket_p->mutex);
+    }
+}
+
+
+void net_layer3_receive_arp_packet(struct network_packet *rx_packet_p)
+{
+    D_ASSERT(rx_packet_p->total_length >=
+             sizeof(struct ethernet_header) + sizeof(struct arp_packet));
+
+    if (NET_LAYER3_TRACING_ON()) {
+        net_trace_received_arp_packet(rx_packet_p);
+    }
+
+    struct net_layer2_end_point *const layer2_end_point_p =
+        rx_packet_p->layer2_end_point_p;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        layer2_end_point_p->layer3_end_point_p;
+    struct ethernet_frame *const rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
+
+    uint16_t arp_operation = ntoh16(rx_frame_p->arp_packet.operation);
+    struct ipv4_address source_ip_addr;
+    struct ipv4_address dest_ip_addr;
+    bool duplicate_ip_addr_detected = false;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+    D_ASSERT(layer3_end_point_p->layer2_end_point_p == layer2_end_point_p);
+
+    if (arp_operation == ARP_REQUEST || arp_operation == ARP_REPLY) {
+        D_ASSERT(rx_frame_p->arp_packet.link_addr_type == hton16(0x1));
+        D_ASSERT(rx_frame_p->arp_packet.network_addr_type ==
+                 hton16(FRAME_TYPE_IPv4_PACKET));
+        D_ASSERT(rx_frame_p->arp_packet.link_addr_size ==
+                 sizeof(struct ethernet_mac_address));
+        D_ASSERT(rx_frame_p->arp_packet.network_addr_size ==
+                 sizeof(struct ipv4_address));
+    }
+
+    COPY_UNALIGNED_IPv4_ADDRESS(&source_ip_addr,
+                                &rx_frame_p->arp_packet.source_ip_addr);
+
+    COPY_UNALIGNED_IPv4_ADDRESS(&dest_ip_addr,
+                                &rx_frame_p->arp_packet.dest_ip_addr);
+
+    switch(arp_operation) {
+    case ARP_REQUEST:
+        if (dest_ip_addr.value == layer3_end_point_p->ipv4.local_ip_addr.value) {
+            if (source_ip_addr.value == dest_ip_addr.value) {
+                /*
+                 * Duplicate IPv4 address detected:
+                 * Received gratuitous ARP request from  a remote layer-3
+                 * end-point that wants to have the same IP address as us.
+                 */
+                duplicate_ip_addr_detected = true;
+                ERROR_PRINTF(
+                    "Duplicated IP address %u.%u.%u.%u detected. "
+                    "Remote node with MAC address %x:%x:%x:%x:%x:%x wants to have the same IP address.\n",
+                    source_ip_addr.bytes[0],
+                    source_ip_addr.bytes[1],
+                    source_ip_addr.bytes[2],
+                    source_ip_addr.bytes[3],
+                    rx_frame_p->arp_packet.source_mac_addr.bytes[0],
+                    rx_frame_p->arp_packet.source_mac_addr.bytes[1],
+                    rx_frame_p->arp_packet.source_mac_addr.bytes[2],
+                    rx_frame_p->arp_packet.source_mac_addr.bytes[3],
+                    rx_frame_p->arp_packet.source_mac_addr.bytes[4],
+                    rx_frame_p->arp_packet.source_mac_addr.bytes[5]);
+            }
+
+            /*
+             * Send ARP reply
+             */
+            net_send_arp_reply(layer2_end_point_p,
+                               &layer3_end_point_p->ipv4.local_ip_addr,
+                               &rx_frame_p->arp_packet.source_mac_addr,
+                               &source_ip_addr);
+        }
+
+        if (source_ip_addr.value != IPV4_NULL_ADDR &&
+            !duplicate_ip_addr_detected) {
+            /*
+             * Update ARP cache with (source IP addr, source MAC addr)
+             */
+            arp_cache_update(layer3_end_point_p,
+                             &source_ip_addr,
+                             &rx_frame_p->arp_packet.source_mac_addr);
+        }
+
+        break;
+
+    case ARP_REPLY:
+        D_ASSERT(
+            UNALIGNED_IPv4_ADDRESSES_EQUAL(&rx_frame_p->arp_packet.dest_ip_addr,
+                                           &layer3_end_point_p->ipv4.local_ip_addr));
+
+        struct ethernet_mac_address local_mac_address;
+
+        net_layer2_get_mac_addr(layer2_end_point_p, &local_mac_address);
+
+        D_ASSERT(MAC_ADDRESSES_EQUAL(&rx_frame_p->arp_packet.dest_mac_addr,
+                                     &local_mac_address));
+
+        if (source_ip_addr.value == layer3_end_point_p->ipv4.local_ip_addr.value) {
+            /*
+             * Duplicate IPv4 address detected:
+             * Received ARP reply from a remote layer-3
+             * end-point that already has the same IP address as us.
+             */
+            ERROR_PRINTF(
+                "Duplicated IP address %u.%u.%u.%u detected. "
+                "Remote node with MAC address %x:%x:%x:%x:%x:%x already has the same IP address.\n",
+                source_ip_addr.bytes[0],
+                source_ip_addr.bytes[1],
+                source_ip_addr.bytes[2],
+                source_ip_addr.bytes[3],
+                rx_frame_p->arp_packet.source_mac_addr.bytes[0],
+                rx_frame_p->arp_packet.source_mac_addr.bytes[1],
+                rx_frame_p->arp_packet.source_mac_addr.bytes[2],
+                rx_frame_p->arp_packet.source_mac_addr.bytes[3],
+                rx_frame_p->arp_packet.source_mac_addr.bytes[4],
+                rx_frame_p->arp_packet.source_mac_addr.bytes[5]);
+        } else {
+            /*
+             * Update ARP cache with (source IP addr, source MAC addr)
+             */
+            arp_cache_update(layer3_end_point_p,
+                             &source_ip_addr,
+                             &rx_frame_p->arp_packet.source_mac_addr);
+        }
+
+        break;
+
+    default:
+        ERROR_PRINTF("Received ARP packet with unsupported operation (%#x)\n",
+                     arp_operation);
+    }
+
+    net_recycle_rx_packet(rx_packet_p);
+}
+
+
+/**
+ * Sends an ICMPv4 echo reply for a received echo request, echoing the
+ * request's whole data payload. The Tx packet is allocated without waiting,
+ * so that echo requests cannot block the ICMPv4 packet receiver task when the
+ * Tx packet pool is exhausted. Whenever possible, the data buffer of the echo
+ * request is swapped with the data buffer of the Tx packet, so the reply is
+ * built in place, without copying the request.
+ *
+ * @param rx_packet_p   Rx packet containing the echo request. The caller
+ *                      still owns it when this function returns, but its data
+ *                      buffer contents may have been replaced.
+ */
+static void net_send_ipv4_ping_reply(struct network_packet *rx_packet_p)
+{
+    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    size_t ipv4_packet_length = ntoh16(ipv4_header_p->total_length);
+    struct ipv4_address dest_ip_addr;
+
+    dest_ip_addr.value = ipv4_header_p->source_ip_addr.value;
+
+    if (GET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                      IP_HEADER_LENGTH_MASK, IP_HEADER_LENGTH_SHIFT) != 5 ||
+        ipv4_packet_length < sizeof(struct ipv4_header) +
+                             sizeof(struct icmpv4_echo_message) ||
+        ipv4_packet_length > sizeof(struct ipv4_header) +
+                             NET_MAX_IPV4_PACKET_PAYLOAD_SIZE ||
+        sizeof(struct ethernet_header) + ipv4_packet_length >
+            rx_packet_p->total_length) {
+        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.echo_requests_not_replied_count);
+        return;
+    }
+
+    size_t icmp_msg_length = ipv4_packet_length - sizeof(struct ipv4_header);
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                              ipv4_packet_length,
+                                          true);
+
+    if (tx_packet_p == NULL) {
+        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.echo_requests_not_replied_count);
+        return;
+    }
+
+    if (rx_packet_p->signature == NET_RX_PACKET_SIGNATURE &&
+        rx_packet_p->ipv4_reassembly_buffer_p == NULL &&
+        rx_packet_p->next_fragment_p == NULL &&
+        rx_packet_p->clone_of_p == NULL &&
+        rx_packet_p->ref_count == 1 &&
+        tx_packet_p->data_buffer_size == rx_packet_p->data_buffer_size) {
+        /*
+         * Swap data buffers, so that the echo request becomes the
+         * payload of the Tx packet. The Rx packet will be reposted to the
+         * Ethernet MAC with the Tx packet's data buffer instead.
+         */
+        uint8_t *const data_buffer = tx_packet_p->data_buffer;
+        uint8_t headroom = tx_packet_p->headroom;
+
+        tx_packet_p->data_buffer = rx_packet_p->data_buffer;
+        tx_packet_p->headroom = rx_packet_p->headroom;
+        rx_packet_p->data_buffer = data_buffer;
+        rx_packet_p->headroom = headroom;
+        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.sent_in_place_echo_replies_count);
+    } else {
+        memcpy(GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p),
+               GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p),
+               icmp_msg_length);
+    }
+
+    /*
+     * The identifier, sequence number and data of the echo request are
+     * echoed back unchanged. Only the ICMP header and the IPv4 header (with
+     * source and destination addresses swapped) are rewritten:
+     */
+    (void)net_layer3_send_ipv4_icmp_message(&dest_ip_addr,
+                                            tx_packet_p,
+                                            ICMP_TYPE_PING_REPLY,
+                                            ICMP_CODE_PING_REPLY,
+                                            icmp_msg_length -
+                                                sizeof(struct icmpv4_header));
+}
+
+
+static void net_process_incoming_icmpv4_message(struct network_packet *rx_packet_p)
+{
+    bool signal_ping_reply_received = false;
+
+    D_ASSERT(rx_packet_p->total_length >=
+             sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+             sizeof(struct icmpv4_header));
+
+    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    struct icmpv4_header *icmpv4_header_p = GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+
+    switch (icmpv4_header_p->msg_type) {
+    case ICMP_TYPE_PING_REPLY:
+        D_ASSERT(icmpv4_header_p->msg_code == ICMP_CODE_PING_REPLY);
+
+        rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+        if (g_net_layer3.ipv4.expecting_ping_reply) {
+            net_packet_queue_add(&g_net_layer3.ipv4.rx_ipv4_ping_reply_packet_queue,
+                                 rx_packet_p);
+
+            g_net_layer3.ipv4.expecting_ping_reply = false;
+            signal_ping_reply_received = true;
+        } else if (g_net_layer3.ipv4.ping_flood_on) {
+            /*
+             * The ping flood matches replies to its requests:
+             */
+            net_packet_queue_add(&g_net_layer3.ipv4.rx_ipv4_ping_reply_packet_queue,
+                                 rx_packet_p);
+        } else {
+            /*
+             * Drop unmatched ping reply
+             */
+            net_recycle_rx_packet(rx_packet_p);
+        }
+
+        rtos_mutex_unlock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+        if (signal_ping_reply_received) {
+            rtos_semaphore_signal(&g_net_layer3.ipv4.ping_reply_received_semaphore);
+        }
+
+        break;
+
+    case ICMP_TYPE_PING_REQUEST:
+        D_ASSERT(icmpv4_header_p->msg_code == ICMP_CODE_PING_REQUEST);
+
+        net_send_ipv4_ping_reply(rx_packet_p);
+        net_recycle_rx_packet(rx_packet_p);
+        break;
+
+    default:
+        ERROR_PRINTF("Received ICMP message with unsupported type: %#x\n",
+                     icmpv4_header_p->msg_type);
+
+        net_recycle_rx_packet(rx_packet_p);
+    }
+}
+
+
+/**
+ * Finds a given option in a received DHCP message
+ *
+ * @param dhcp_msg_p        Pointer to the DHCP message
+ * @param dhcp_msg_size     Size of the DHCP message in bytes
+ * @param option_type       DHCP option to find
+ * @param option_length     Expected length of the option value
+ *
+ * @return Pointer to the option value, if found with the expected length
+ * @return NULL, otherwise
+ */
+static const uint8_t *dhcp_find_option(const struct dhcp_message *dhcp_msg_p,
+                                       size_t dhcp_msg_size,
+                                       uint8_t option_type,
+                                       uint8_t option_length)
+{
+    const uint8_t *options = dhcp_msg_p->options;
+    size_t options_len = dhcp_msg_size - sizeof(struct dhcp_message);
+
+    for (size_t i = 0; i < options_len; ) {
+        if (options[i] == DHCP_OPTION_END) {
+            break;
+        }
+
+        if (options[i] == DHCP_OPTION_PAD) {
+            i ++;
+            continue;
+        }
+
+        if (i + 2 > options_len || i + 2 + options[i + 1] > options_len) {
+            /*
+             * Truncated option
+             */
+            break;
+        }
+
+        if (options[i] == option_type) {
+            return (options[i + 1] == option_length) ? &options[i + 2] : NULL;
+        }
+
+        /*
+         * Skip to next option:
+         */
+        i += 2 + options[i + 1];
+    }
+
+    return NULL;
+}
+
+
+/**
+ * ICMPv4 packet receiver task for a given IPv4 end point
+ */
+static void icmpv4_packet_receiver_task(void *arg)
+{
+    struct ipv4_end_point *const ipv4_end_point_p =
+        (struct ipv4_end_point *)arg;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        ENCLOSING_STRUCT(ipv4_end_point_p, struct net_layer3_end_point, ipv4);
+
+#   ifdef USE_MPU
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                NULL);
+#   endif
+
+    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+
+    for ( ; ; ) {
+        struct network_packet *rx_packet_p = NULL;
+
+        rx_packet_p =
+            net_packet_queue_remove(&ipv4_end_point_p->rx_icmpv4_packet_queue, 0);
+
+        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        NET_PACKET_CLEAR_STATE_FLAG(rx_packet_p, NET_PACKET_IN_ICMP_QUEUE);
+        if (GET_IPV4_HEADER(rx_packet_p)->protocol_type == IP_PACKET_TYPE_IGMP) {
+            net_process_incoming_igmp_message(layer3_end_point_p, rx_packet_p);
+        } else {
+            net_process_incoming_icmpv4_message(rx_packet_p);
+        }
+    }
+
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
+}
+
+
+static void net_send_ipv4_dhcp_request(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct net_layer4_end_point *client_end_point_p,
+    const struct dhcp_message *dhcp_offer_msg_p,
+    size_t dhcp_offer_msg_size)
+{
+    struct ipv4_address server_ip_addr = dhcp_offer_msg_p->next_server_ip_addr;
+    const uint8_t *server_id_p =
+        dhcp_find_option(dhcp_offer_msg_p, dhcp_offer_msg_size,
+                         DHCP_OPTION_SERVER_ID, 4);
+
+    if (server_id_p != NULL) {
+        memcpy(&server_ip_addr, server_id_p, sizeof server_ip_addr);
+    }
+
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(NET_PACKET_DATA_BUFFER_SIZE, true);
+
+    struct dhcp_message *dhcp_request_msg_p =
+        get_ipv4_udp_data_payload_area(tx_packet_p);
+
+    *dhcp_request_msg_p = *dhcp_offer_msg_p;
+    dhcp_request_msg_p->op = 0x1;
+    dhcp_request_msg_p->your_ip_addr.value = IPV4_NULL_ADDR;
+    dhcp_request_msg_p->next_server_ip_addr.value = IPV4_NULL_ADDR;
+    dhcp_request_msg_p->options[0] = 53; /* option 1 type: DHCP message type */
+    dhcp_request_msg_p->options[1] = 1; /* option length */
+    dhcp_request_msg_p->options[2] = 0x03; /* option value: DHCPREQUEST */
+
+    dhcp_request_msg_p->options[3] = 54; /* option 2 type: DHCP server identifier */
+    dhcp_request_msg_p->options[4] = 4; /* option length */
+    dhcp_request_msg_p->options[5] = server_ip_addr.bytes[0]; /* option value[0] */
+    dhcp_request_msg_p->options[6] = server_ip_addr.bytes[1]; /* option value[1] */
+    dhcp_request_msg_p->options[7] = server_ip_addr.bytes[2]; /* option value[2] */
+    dhcp_request_msg_p->options[8] = server_ip_addr.bytes[3]; /* option value[3] */
+
+    dhcp_request_msg_p->options[9] = 50; /* option 3 type: Requested IP address */
+    dhcp_request_msg_p->options[10] = 4; /* option length */
+    dhcp_request_msg_p->options[11] = dhcp_offer_msg_p->your_ip_addr.bytes[0]; /* option value[0] */
+    dhcp_request_msg_p->options[12] = dhcp_offer_msg_p->your_ip_addr.bytes[1]; /* option value[1] */
+    dhcp_request_msg_p->options[13] = dhcp_offer_msg_p->your_ip_addr.bytes[2]; /* option value[2] */
+    dhcp_request_msg_p->options[14] = dhcp_offer_msg_p->your_ip_addr.bytes[3]; /* option value[3] */
+
+    dhcp_request_msg_p->options[15] = 55; /* option 2 type: parameter request list */
+    dhcp_request_msg_p->options[16] = 11; /* option length */
+    dhcp_request_msg_p->options[17] = 0x01; /* option value[0]: subnet mask */
+    dhcp_request_msg_p->options[18] = 0x1c; /* option value[1]: broadcast address */
+    dhcp_request_msg_p->options[19] = 0x02; /* option value[2]: time offset */
+    dhcp_request_msg_p->options[20] = 0x03; /* option value[3]: router */
+    dhcp_request_msg_p->options[21] = 0x0f; /* option value[4]: domain name */
+    dhcp_request_msg_p->options[22] = 0x06; /* option value[5]: domain name server */
+    dhcp_request_msg_p->options[23] = 0x77; /* option value[6]: domain search */
+    dhcp_request_msg_p->options[24] = 0x0c; /* option value[7]: host name */
+    dhcp_request_msg_p->options[25] = 0x1a; /* option value[8]: interface MTU */
+    dhcp_request_msg_p->options[26] = 0x79; /* option value[9]: classless static route */
+    dhcp_request_msg_p->options[27] = 0x2a; /* option value[10]: network time protocol servers */
+    dhcp_request_msg_p->options[28] = DHCP_OPTION_END;
+
+    struct ipv4_address dest_ip_addr = { .value = IPV4_BROADCAST_ADDR };
+
+    net_layer4_send_udp_datagram_over_ipv4(client_end_point_p, &dest_ip_addr,
+                                           hton16(DHCP_UDP_SERVER_PORT),
+                                           tx_packet_p,
+                                           sizeof(struct dhcp_message) + 29);
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: DHCP client sent request message\n");
+    }
+}
+
+
+/**
+ * Returns the type of a received DHCP message, or 0 if the message is not a
+ * valid reply to the DHCP client's current transaction
+ */
+static uint8_t dhcp_get_reply_type(const struct dhcp_message *dhcp_msg_p,
+                                   size_t dhcp_msg_size,
+                                   uint32_t transaction_id)
+{
+    if (dhcp_msg_size < sizeof(struct dhcp_message) ||
+        dhcp_msg_p->op != 0x2 ||
+        dhcp_msg_p->transaction_id != transaction_id ||
+        dhcp_msg_p->magic_cookie != hton32(DHCP_MAGIC_COOKIE)) {
+        return 0;
+    }
+
+    const uint8_t *msg_type_p = dhcp_find_option(dhcp_msg_p, dhcp_msg_size,
+                                                 DHCP_OPTION_MESSAGE_TYPE, 1);
+
+    return (msg_type_p != NULL) ? *msg_type_p : 0;
+}
+
+
+/**
+ * Reads the cached DHCP lease of a local IPv4 end point from the NOR flash
+ * key/value store
+ *
+ * @return true, if a valid cached lease was found
+ * @return false, otherwise
+ */
+static bool dhcp_read_cached_lease(struct net_layer3_end_point *layer3_end_point_p,
+                                   struct dhcp_cached_lease *cached_lease_p)
+{
+    unsigned int index = layer3_end_point_p - &g_net_layer3.local_layer3_end_points[0];
+    size_t lease_size;
+
+    lease_size = nor_flash_kv_store_get(&g_nor_flash_kv_store,
+                                        NOR_FLASH_KV_KEY_DHCP_LEASE + index,
+                                        cached_lease_p, sizeof *cached_lease_p);
+
+    return lease_size == sizeof *cached_lease_p &&
+           cached_lease_p->signature == DHCP_CACHED_LEASE_SIGNATURE &&
+           cached_lease_p->local_ip_addr.value != IPV4_NULL_ADDR;
+}
+
+
+/**
+ * Saves the current DHCP lease of a local IPv4 end point in the NOR flash
+ * key/value store. The store only appends a new record if the lease differs
+ * from the cached lease, which is not the case for plain lease renewals.
+ */
+static void dhcp_save_cached_lease(struct net_layer3_end_point *layer3_end_point_p)
+{
+    struct dhcp_cached_lease cached_lease;
+    unsigned int index = layer3_end_point_p - &g_net_layer3.local_layer3_end_points[0];
+    struct ipv4_end_point *ipv4_end_point_p = &layer3_end_point_p->ipv4;
+    error_t error;
+
+    C_ASSERT(sizeof cached_lease <= NOR_FLASH_KV_MAX_VALUE_SIZE);
+
+    cached_lease.signature = DHCP_CACHED_LEASE_SIGNATURE;
+    cached_lease.local_ip_addr = ipv4_end_point_p->local_ip_addr;
+    cached_lease.subnet_mask = ipv4_end_point_p->subnet_mask;
+    cached_lease.default_gateway_ip_addr = ipv4_end_point_p->default_gateway_ip_addr;
+    cached_lease.server_ip_addr = ipv4_end_point_p->dhcp_server_ip_addr;
+    cached_lease.lease_time = ipv4_end_point_p->dhcp_lease_time;
+
+    /*
+     * NOTE: The key/value store sectors are in the last NOR flash block,
+     * so code can keep running from the other block while they are written.
+     */
+    error = nor_flash_kv_store_put(&g_nor_flash_kv_store,
+                                   NOR_FLASH_KV_KEY_DHCP_LEASE + index,
+                                   &cached_lease, sizeof cached_lease);
+    if (error != 0) {
+        ERROR_PRINTF("Could not save DHCP lease in NOR flash\n");
+    }
+}
+
+
+/**
+ * Sets the local IPv4 address and the lease parameters of a local IPv4 end
+ * point from a received DHCPACK message
+ *
+ * @return true, on success
+ * @return false, if the DHCPACK message lacks any required option
+ */
+static bool net_set_local_ipv4_addr_from_dhcp(
+    struct net_layer3_end_point *layer3_end_point_p,
+    const struct dhcp_message *dhcp_ack_msg_p,
+    size_t dhcp_ack_msg_size,
+    const struct ipv4_address *source_ip_addr_p)
+{
+    struct ipv4_address router_ip_addr;
+    struct ipv4_address server_ip_addr;
+    uint32_t subnet_mask;
+    uint32_t lease_time;
+    const struct ipv4_address *local_ip_addr_p = &dhcp_ack_msg_p->your_ip_addr;
+
+    D_ASSERT(g_net_layer3.initialized);
+
+    /*
+     * Extract DHCP options:
+     */
+    const uint8_t *subnet_mask_p =
+        dhcp_find_option(dhcp_ack_msg_p, dhcp_ack_msg_size,
+                         DHCP_OPTION_SUBNET_MASK, 4);
+    const uint8_t *router_p =
+        dhcp_find_option(dhcp_ack_msg_p, dhcp_ack_msg_size,
+                         DHCP_OPTION_ROUTER, 4);
+    const uint8_t *lease_time_p =
+        dhcp_find_option(dhcp_ack_msg_p, dhcp_ack_msg_size,
+                         DHCP_OPTION_LEASE_TIME, 4);
+    const uint8_t *server_id_p =
+        dhcp_find_option(dhcp_ack_msg_p, dhcp_ack_msg_size,
+                         DHCP_OPTION_SERVER_ID, 4);
+
+    if (local_ip_addr_p->value == IPV4_NULL_ADDR ||
+        subnet_mask_p == NULL || router_p == NULL || lease_time_p == NULL) {
+        ERROR_PRINTF("Received DHCP acknowledge message without required options\n");
+        return false;
+    }
+
+    memcpy(&subnet_mask, subnet_mask_p, sizeof subnet_mask);
+    memcpy(&router_ip_addr, router_p, sizeof router_ip_addr);
+    memcpy(&lease_time, lease_time_p, sizeof lease_time);
+    lease_time = ntoh32(lease_time);
+    if (server_id_p != NULL) {
+        memcpy(&server_ip_addr, server_id_p, sizeof server_ip_addr);
+    } else {
+        server_ip_addr = *source_ip_addr_p;
+    }
+
+    bool local_ip_addr_changed =
+        (layer3_end_point_p->ipv4.local_ip_addr.value != local_ip_addr_p->value);
+
+    layer3_end_point_p->ipv4.local_ip_addr = *local_ip_addr_p;
+    layer3_end_point_p->ipv4.subnet_mask = subnet_mask;
+    layer3_end_point_p->ipv4.default_gateway_ip_addr = router_ip_addr;
+    layer3_end_point_p->ipv4.dhcp_lease_time = lease_time;
+    layer3_end_point_p->ipv4.dhcp_lease_start_time = rtos_get_time_since_boot();
+    layer3_end_point_p->ipv4.dhcp_server_ip_addr = server_ip_addr;
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: Set local IP address from DHCP: %u.%u.%u.%u "
+                     "(lease time %u seconds)\n",
+                     local_ip_addr_p->bytes[0],
+                     local_ip_addr_p->bytes[1],
+                     local_ip_addr_p->bytes[2],
+                     local_ip_addr_p->bytes[3],
+                     lease_time);
+    }
+
+    if (local_ip_addr_changed) {
+        /*
+         * Send gratuitous ARP request (to catch if someone else is using the
+         * same IP address):
+         */
+        net_send_arp_request(layer3_end_point_p->layer2_end_point_p,
+                             &layer3_end_point_p->ipv4.local_ip_addr,
+                             &layer3_end_point_p->ipv4.local_ip_addr,
+                             NULL);
+    }
+
+    return true;
+}
+
+
+/**
+ * Computes the time in seconds since boot when the DHCP client must
+ * (re)transmit a DHCPREQUEST for a lease that it has, in the RENEWING and
+ * REBINDING states, as prescribed by RFC 2131: half of the remaining time
+ * until the given deadline (T2 or lease expiration), but no less than 60
+ * seconds, and never past the deadline.
+ */
+static uint32_t dhcp_next_retransmit_time(uint32_t now, uint32_t deadline)
+{
+    uint32_t interval = (deadline - now) / 2;
+
+    if (interval < DHCP_MIN_RETRANSMIT_INTERVAL_IN_SECS) {
+        interval = DHCP_MIN_RETRANSMIT_INTERVAL_IN_SECS;
+    }
+
+    if (interval > deadline - now) {
+        interval = deadline - now;
+    }
+
+    return now + interval;
+}
+
+
+/**
+ * DHCPv4 client task
+ *
+ * On boot, if a lease is cached in NOR flash, the task first requests the
+ * cached IPv4 address (INIT-REBOOT), and falls back to a DHCPDISCOVER if the
+ * server refuses it or does not reply. Once a lease is granted, the lease is
+ * renewed with the server that granted it at T1 (half of the lease time), or
+ * with any server at T2 (7/8 of the lease time), using the Rx timeout as
+ * renewal timer.
+ */
+static void dhcpv4_client_task(void *arg)
+{
+    enum dhcp_client_states {
+        DHCP_SELECTING,         /* DHCPOFFER expected */
+        DHCP_REQUESTING,        /* DHCPACK expected for the offered address */
+        DHCP_INIT_REBOOT,       /* DHCPACK expected for the cached address */
+        DHCP_BOUND,
+        DHCP_RENEWING,          /* DHCPACK expected from the lease's server */
+        DHCP_REBINDING,         /* DHCPACK expected from any server */
+    } state;
+
+    error_t error;
+    struct network_packet *rx_packet_p = NULL;
+    struct ipv4_address server_ip_addr;
+    uint16_t server_port;
+    struct dhcp_message *dhcp_msg_p;
+    size_t dhcp_msg_size;
+    uint32_t timeout_ms;
+    uint32_t transaction_id;
+    struct dhcp_cached_lease cached_lease;
+    unsigned int init_reboot_tries = 0;
+    uint32_t t1_time = 0;           /* in seconds since boot */
+    uint32_t t2_time = 0;           /* in seconds since boot */
+    uint32_t lease_expiration_time = 0; /* in seconds since boot */
+    uint32_t timer_expiration_time = 0; /* in seconds since boot */
+    struct ipv4_address null_ip_addr = { .value = IPV4_NULL_ADDR };
+    struct ipv4_address broadcast_ip_addr = { .value = IPV4_BROADCAST_ADDR };
+    struct ipv4_end_point *const ipv4_end_point_p =
+        (struct ipv4_end_point *)arg;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        ENCLOSING_STRUCT(ipv4_end_point_p, struct net_layer3_end_point, ipv4);
+
+#   ifdef USE_MPU
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                NULL);
+#   endif
+
+    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+
+    struct net_layer4_end_point *dhcp_client_end_point_p =
+            &ipv4_end_point_p->dhcpv4_client_end_point;
+
+    net_layer4_udp_end_point_init(dhcp_client_end_point_p);
+
+    error = net_layer4_udp_end_point_bind(dhcp_client_end_point_p,
+                                          DHCP_UDP_CLIENT_PORT);
+    if (error != 0) {
+        goto exit;
+    }
+
+    transaction_id = rtos_get_ticks_since_boot();
+    if (dhcp_read_cached_lease(layer3_end_point_p, &cached_lease)) {
+        net_send_ipv4_dhcp_lease_request(layer3_end_point_p,
+                                         dhcp_client_end_point_p,
+                                         transaction_id,
+                                         &null_ip_addr,
+                                         &cached_lease.local_ip_addr,
+                                         &broadcast_ip_addr);
+        init_reboot_tries = 1;
+        state = DHCP_INIT_REBOOT;
+    } else {
+        net_send_ipv4_dhcp_discovery(layer3_end_point_p, dhcp_client_end_point_p,
+                                     transaction_id);
+        state = DHCP_SELECTING;
+    }
+
+    for ( ; ; ) {
+        if (state == DHCP_BOUND || state == DHCP_RENEWING ||
+            state == DHCP_REBINDING) {
+            uint32_t now = rtos_get_time_since_boot();
+
+            if ((int32_t)(timer_expiration_time - now) <= 0) {
+                /*
+                 * Renewal timer expired:
+                 */
+                if ((int32_t)(lease_expiration_time - now) <= 0) {
+                    ERROR_PRINTF("DHCP lease expired\n");
+                    layer3_end_point_p->ipv4.local_ip_addr.value = IPV4_NULL_ADDR;
+                    transaction_id = rtos_get_ticks_since_boot();
+                    net_send_ipv4_dhcp_discovery(layer3_end_point_p,
+                                                 dhcp_client_end_point_p,
+                                                 transaction_id);
+                    state = DHCP_SELECTING;
+                } else if ((int32_t)(t2_time - now) <= 0) {
+                    if (state != DHCP_REBINDING) {
+                        transaction_id = rtos_get_ticks_since_boot();
+                        state = DHCP_REBINDING;
+                    }
+
+                    net_send_ipv4_dhcp_lease_request(layer3_end_point_p,
+                                                     dhcp_client_end_point_p,
+                                                     transaction_id,
+                                                     &ipv4_end_point_p->local_ip_addr,
+                                                     NULL,
+                                                     &broadcast_ip_addr);
+                    timer_expiration_time =
+                        dhcp_next_retransmit_time(now, lease_expiration_time);
+                } else {
+                    if (state != DHCP_RENEWING) {
+                        transaction_id = rtos_get_ticks_since_boot();
+                        state = DHCP_RENEWING;
+                    }
+
+                    net_send_ipv4_dhcp_lease_request(layer3_end_point_p,
+                                                     dhcp_client_end_point_p,
+                                                     transaction_id,
+                                                     &ipv4_end_point_p->local_ip_addr,
+                                                     NULL,
+                                                     &ipv4_end_point_p->dhcp_server_ip_addr);
+                    timer_expiration_time = dhcp_next_retransmit_time(now, t2_time);
+                }
+
+                continue;
+            }
+
+            timeout_ms = (timer_expiration_time - now) * 1000;
+            if ((timer_expiration_time - now) > DHCP_MAX_WAIT_IN_MS / 1000) {
+                timeout_ms = DHCP_MAX_WAIT_IN_MS;
+            }
+        } else {
+            timeout_ms = DHCP_REPLY_TIMEOUT_IN_MS;
+        }
+
+        /*
+         * Receive DHCP message:
+         */
+        error = net_layer4_receive_udp_datagram_over_ipv4(dhcp_client_end_point_p,
+                                                          timeout_ms,
+                                                          &server_ip_addr,
+                                                          &server_port,
+                                                          &rx_packet_p);
+        if (error != 0) {
+            /*
+             * Timeout:
+             */
+            D_ASSERT(rx_packet_p == NULL);
+            if (state == DHCP_INIT_REBOOT &&
+                init_reboot_tries < DHCP_INIT_REBOOT_MAX_TRIES) {
+                net_send_ipv4_dhcp_lease_request(layer3_end_point_p,
+                                                 dhcp_client_end_point_p,
+                                                 transaction_id,
+                                                 &null_ip_addr,
+                                                 &cached_lease.local_ip_addr,
+                                                 &broadcast_ip_addr);
+                init_reboot_tries ++;
+            } else if (state == DHCP_INIT_REBOOT || state == DHCP_SELECTING ||
+                       state == DHCP_REQUESTING) {
+                transaction_id = rtos_get_ticks_since_boot();
+                net_send_ipv4_dhcp_discovery(layer3_end_point_p,
+                                             dhcp_client_end_point_p,
+                                             transaction_id);
+                state = DHCP_SELECTING;
+            }
+
+            continue;
+        }
+
+        D_ASSERT(rx_packet_p != NULL);
+        dhcp_msg_p = get_ipv4_udp_data_payload_area(rx_packet_p);
+        dhcp_msg_size = get_ipv4_udp_data_payload_length(rx_packet_p);
+
+        uint8_t msg_type = dhcp_get_reply_type(dhcp_msg_p, dhcp_msg_size,
+                                               transaction_id);
+
+        if (NET_LAYER3_TRACING_ON()) {
+            DEBUG_PRINTF("Net layer3: DHCP client received message %#x from %u.%u.%u.%u\n",
+                         msg_type,
+                         server_ip_addr.bytes[0],
+                         server_ip_addr.bytes[1],
+                         server_ip_addr.bytes[2],
+                         server_ip_addr.bytes[3]);
+        }
+
+        switch (state) {
+        case DHCP_SELECTING:
+            if (msg_type == DHCP_OFFER) {
+                net_send_ipv4_dhcp_request(layer3_end_point_p,
+                                           dhcp_client_end_point_p,
+                                           dhcp_msg_p,
+                                           dhcp_msg_size);
+                state = DHCP_REQUESTING;
+            }
+
+            break;
+
+        case DHCP_REQUESTING:
+        case DHCP_INIT_REBOOT:
+        case DHCP_RENEWING:
+        case DHCP_REBINDING:
+            if (msg_type == DHCP_ACK &&
+                net_set_local_ipv4_addr_from_dhcp(layer3_end_point_p,
+                                                  dhcp_msg_p,
+                                                  dhcp_msg_size,
+                                                  &server_ip_addr)) {
+                uint32_t lease_time = ipv4_end_point_p->dhcp_lease_time;
+
+                if (lease_time > DHCP_MAX_LEASE_TIME_IN_SECS) {
+                    lease_time = DHCP_MAX_LEASE_TIME_IN_SECS;
+                }
+
+                t1_time = ipv4_end_point_p->dhcp_lease_start_time + lease_time / 2;
+                t2_time = ipv4_end_point_p->dhcp_lease_start_time +
+                          (uint32_t)(((uint64_t)lease_time * 7) / 8);
+                lease_expiration_time =
+                    ipv4_end_point_p->dhcp_lease_start_time + lease_time;
+                timer_expiration_time = t1_time;
+                dhcp_save_cached_lease(layer3_end_point_p);
+                state = DHCP_BOUND;
+            } else if (msg_type == DHCP_NAK) {
+                if (NET_LAYER3_TRACING_ON()) {
+                    DEBUG_PRINTF("Net layer3: DHCP request refused by server\n");
+                }
+
+                layer3_end_point_p->ipv4.local_ip_addr.value = IPV4_NULL_ADDR;
+                transaction_id = rtos_get_ticks_since_boot();
+                net_send_ipv4_dhcp_discovery(layer3_end_point_p,
+                                             dhcp_client_end_point_p,
+                                             transaction_id);
+                state = DHCP_SELECTING;
+            }
+
+            break;
+
+        default:
+            /* Drop packet */
+            if (NET_LAYER3_TRACING_ON()) {
+                DEBUG_PRINTF("Net layer3: Dropped DHCP message (DHCP client state: %d)\n",
+                             state);
+            }
+        }
+
+        net_recycle_rx_packet(rx_packet_p);
+    }
+
+exit:
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
+}
+
+
+/**
+ * IPv4-specific initialization of a layer-3 end point
+ *
+ * @param ipv4_end_point_p Pointer to IPv4 layer-3 end point
+ *
+ * NOTE: This function is to be invoked from net_layer3_end_point_init()
+ */
+void net_layer3_ipv4_end_point_init(struct ipv4_end_point *ipv4_end_point_p)
+{
+    net_packet_queue_init("ICMPv4 incoming packet queue",
+                          true,
+                          &ipv4_end_point_p->rx_icmpv4_packet_queue);
+
+    /*
+     * Initialize IPv4 ARP cache for the layer-3 end point
+     */
+    arp_cache_init(&ipv4_end_point_p->arp_cache);
+
+    rtos_mutex_init(&ipv4_end_point_p->multicast_groups_mutex,
+                    "IPv4 multicast groups mutex");
+    for (unsigned int i = 0; i < NET_IPV4_MAX_MULTICAST_GROUPS; i ++) {
+        ipv4_end_point_p->multicast_groups[i].group_addr.value = IPV4_NULL_ADDR;
+        ipv4_end_point_p->multicast_groups[i].join_count = 0;
+    }
+
+    ipv4_end_point_p->num_multicast_groups = 0;
+
+    /*
+     * Send IGMPv3 reports until an IGMPv2 querier is heard from
+     */
+    ipv4_end_point_p->igmp_version = 3;
+
+    rtos_mutex_init(&ipv4_end_point_p->icmpv4_rate_limiter_mutex,
+                    "ICMPv4 rate limiter mutex");
+    for (unsigned int i = 0; i < ICMPV4_RATE_LIMITER_NUM_SOURCES; i ++) {
+        struct icmpv4_rate_limiter_bucket *bucket_p =
+            &ipv4_end_point_p->icmpv4_rate_limiter_buckets[i];
+
+        bucket_p->source_ip_addr.value = IPV4_NULL_ADDR;
+        bucket_p->tokens = 0;
+        bucket_p->refill_time_stamp = 0;
+    }
+}
+
+
+/**
+ * Start RTOS tasks for an IPv4 layer-3 end point
+ *
+ * @param ipv4_end_point_p    Pointer to IPv4 end point
+ *
+ * NOTE: This function is to be invoked from net_layer3_end_point_start_tasks()
+ */
+void net_layer3_ipv4_end_point_start_tasks(struct ipv4_end_point *ipv4_end_point_p)
+{
+    /*
+     * Create ICMPv4 packet receiver task:
+     */
+    rtos_task_create(&ipv4_end_point_p->icmpv4_packet_receiver_task,
+                     "ICMPv4 packet receiver task",
+                     icmpv4_packet_receiver_task,
+                     ipv4_end_point_p,
+                     RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 2));
+
+    /*
+     * Create DHCPv4 client task:
+     */
+    rtos_task_create(&ipv4_end_point_p->dhcpv4_client_task,
+                     "DHCPv4 client task",
+                     dhcpv4_client_task,
+                     ipv4_end_point_p,
+                     RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 2));
+}
+
 
-    COPY_UNALIGNED_IPv4_ADDRESS(&dest_ip_addr,
-                                &rx_frame_p->arp_packet.dest_ip_addr);
+/**
+ * Initializes a "connected" IPv4 flow to a given destination
+ *
+ * @param flow_p            Pointer to the flow object
+ * @param dest_ip_addr_p    Destination IPv4 address
+ * @param ip_packet_type    IPv4 protocol type of the packets of the flow
+ */
+void net_layer3_ipv4_flow_init(struct net_ipv4_flow *flow_p,
+                               const struct ipv4_address *dest_ip_addr_p,
+                               uint_fast8_t ip_packet_type)
+{
+    flow_p->signature = NET_IPV4_FLOW_SIGNATURE;
+    flow_p->dest_ip_addr.value = dest_ip_addr_p->value;
+    flow_p->ip_packet_type = ip_packet_type;
+    flow_p->template_valid = false;
+    flow_p->layer3_end_point_p = NULL;
+    flow_p->arp_cache_bucket_p = NULL;
+}
 
-    switch(arp_operation) {
-    case ARP_REQUEST:
-        if (dest_ip_addr.value == layer3_end_point_p->ipv4.local_ip_addr.value) {
-            if (source_ip_addr.value == dest_ip_addr.value) {
-                /*
-                 * Duplicate IPv4 address detected:
-                 * Received gratuitous ARP request from  a remote layer-3
-                 * end-point that wants to have the same IP address as us.
-                 */
-                duplicate_ip_addr_detected = true;
-                ERROR_PRINTF(
-                    "Duplicated IP address %u.%u.%u.%u detected. "
-                    "Remote node with MAC address %x:%x:%x:%x:%x:%x wants to have the same IP address.\n",
-                    source_ip_addr.bytes[0],
-                    source_ip_addr.bytes[1],
-                    source_ip_addr.bytes[2],
-                    source_ip_addr.bytes[3],
-                    rx_frame_p->arp_packet.source_mac_addr.bytes[0],
-                    rx_frame_p->arp_packet.source_mac_addr.bytes[1],
-                    rx_frame_p->arp_packet.source_mac_addr.bytes[2],
-                    rx_frame_p->arp_packet.source_mac_addr.bytes[3],
-                    rx_frame_p->arp_packet.source_mac_addr.bytes[4],
-                    rx_frame_p->arp_packet.source_mac_addr.bytes[5]);
-            }
 
-            /*
-             * Send ARP reply
-             */
-            net_send_arp_reply(layer2_end_point_p,
-                               &layer3_end_point_p->ipv4.local_ip_addr,
-                               &rx_frame_p->arp_packet.source_mac_addr,
-                               &source_ip_addr);
+/**
+ * Builds the header template of an IPv4 flow, if the next-hop MAC address
+ * is known. A template is not built for loopback destinations or for
+ * layer-2 end points in a VLAN, whose packets always take the regular send
+ * path.
+ *
+ * @return true, if the template was built
+ * @return false, otherwise
+ */
+static bool net_layer3_ipv4_flow_build_template(struct net_ipv4_flow *flow_p,
+                                                uint32_t current_ticks)
+{
+    struct ethernet_mac_address dest_mac_addr;
+    struct arp_cache_bucket *bucket_p = NULL;
+    uint32_t sequence_count = 0;
+    struct ipv4_address next_hop_ip_addr;
+    const struct ipv4_address *next_hop_ip_addr_p = &next_hop_ip_addr;
+    struct net_layer3_end_point *layer3_end_point_p =
+        ipv4_route_lookup(&flow_p->dest_ip_addr, &next_hop_ip_addr);
+    struct ipv4_end_point *ipv4_end_point_p = &layer3_end_point_p->ipv4;
+
+    flow_p->template_valid = false;
+    if (layer3_end_point_p->layer2_end_point_p->vlan_id != NET_LAYER2_NO_VLAN ||
+        ipv4_end_point_p->local_ip_addr.value == flow_p->dest_ip_addr.value ||
+        IPV4_ADDR_IS_LOOPBACK(&flow_p->dest_ip_addr)) {
+        return false;
+    }
+
+    if (flow_p->dest_ip_addr.value == IPV4_BROADCAST_ADDR) {
+        dest_mac_addr = g_ethernet_broadcast_mac_addr;
+    } else if (IPV4_ADDR_IS_MULTICAST(&flow_p->dest_ip_addr)) {
+        map_ipv4_multicast_addr_to_ethernet_multicast_addr(&flow_p->dest_ip_addr,
+                                                           &dest_mac_addr);
+    } else {
+        if (next_hop_ip_addr.value == IPV4_NULL_ADDR) {
+            return false;
         }
 
-        if (source_ip_addr.value != IPV4_NULL_ADDR &&
-            !duplicate_ip_addr_detected) {
-            /*
-             * Update ARP cache with (source IP addr, source MAC addr)
-             */
-            arp_cache_update(&layer3_end_point_p->ipv4.arp_cache,
-                             &source_ip_addr,
-                             &rx_frame_p->arp_packet.source_mac_addr);
+        /*
+         * Snapshot the bucket's sequence count before the lookup, so that any
+         * later update of the bucket invalidates the template:
+         */
+        bucket_p = arp_cache_get_bucket(&ipv4_end_point_p->arp_cache,
+                                        next_hop_ip_addr_p);
+        sequence_count = bucket_p->sequence_count;
+        if (sequence_count % 2 != 0) {
+            return false;
         }
 
-        break;
+        __DMB();
+        if (!arp_cache_lock_free_lookup(&ipv4_end_point_p->arp_cache,
+                                        next_hop_ip_addr_p, &dest_mac_addr)) {
+            return false;
+        }
+    }
 
-    case ARP_REPLY:
-        D_ASSERT(
-            UNALIGNED_IPv4_ADDRESSES_EQUAL(&rx_frame_p->arp_packet.dest_ip_addr,
-                                           &layer3_end_point_p->ipv4.local_ip_addr));
+    struct ethernet_frame *template_frame_p =
+        (struct ethernet_frame *)flow_p->header_template;
 
-        struct ethernet_mac_address local_mac_address;
+    template_frame_p->ethernet_header.alignment_padding = 0;
+    COPY_MAC_ADDRESS(&template_frame_p->ethernet_header.dest_mac_addr,
+                     &dest_mac_addr);
 
-        net_layer2_get_mac_addr(layer2_end_point_p, &local_mac_address);
+    /*
+     * NOTE: The Ethernet MAC hardware populates the source MAC address
+     * automatically in an outgoing frame
+     */
+    bzero(&template_frame_p->ethernet_header.source_mac_addr,
+          sizeof template_frame_p->ethernet_header.source_mac_addr);
+    template_frame_p->ethernet_header.frame_type = hton16(FRAME_TYPE_IPv4_PACKET);
+
+    net_layer3_populate_ipv4_header(&template_frame_p->ipv4_header,
+                                    &ipv4_end_point_p->local_ip_addr,
+                                    &flow_p->dest_ip_addr,
+                                    0,
+                                    flow_p->ip_packet_type,
+                                    0,
+                                    IP_FLAG_DONT_FRAGMENT_MASK);
+
+    flow_p->layer3_end_point_p = layer3_end_point_p;
+    flow_p->arp_cache_bucket_p = bucket_p;
+    flow_p->arp_cache_bucket_sequence_count = sequence_count;
+    flow_p->template_time_stamp = current_ticks;
+    flow_p->template_valid = true;
+    return true;
+}
 
-        D_ASSERT(MAC_ADDRESSES_EQUAL(&rx_frame_p->arp_packet.dest_mac_addr,
-                                     &local_mac_address));
 
-        if (source_ip_addr.value == layer3_end_point_p->ipv4.local_ip_addr.value) {
-            /*
-             * Duplicate IPv4 address detected:
-             * Received ARP reply from a remote layer-3
-             * end-point that already has the same IP address as us.
-             */
-            ERROR_PRINTF(
-                "Duplicated IP address %u.%u.%u.%u detected. "
-                "Remote node with MAC address %x:%x:%x:%x:%x:%x already has the same IP address.\n",
-                source_ip_addr.bytes[0],
-                source_ip_addr.bytes[1],
-                source_ip_addr.bytes[2],
-                source_ip_addr.bytes[3],
-                rx_frame_p->arp_packet.source_mac_addr.bytes[0],
-                rx_frame_p->arp_packet.source_mac_addr.bytes[1],
-                rx_frame_p->arp_packet.source_mac_addr.bytes[2],
-                rx_frame_p->arp_packet.source_mac_addr.bytes[3],
-                rx_frame_p->arp_packet.source_mac_addr.bytes[4],
-                rx_frame_p->arp_packet.source_mac_addr.bytes[5]);
-        } else {
-            /*
-             * Update ARP cache with (source IP addr, source MAC addr)
-             */
-            arp_cache_update(&layer3_end_point_p->ipv4.arp_cache,
-                             &source_ip_addr,
-                             &rx_frame_p->arp_packet.source_mac_addr);
-        }
+/**
+ * Sends an IPv4 packet of a "connected" IPv4 flow. If the flow's header
+ * template is valid, the Ethernet and IPv4 headers are copied from the
+ * template and only the IPv4 total length and identification are filled in.
+ * Otherwise, the packet is sent through the regular send path.
+ *
+ * @param flow_p                Pointer to the flow object
+ * @param tx_packet_p           Tx packet, with the IPv4 payload already
+ *                              filled in
+ * @param data_payload_length   Length of the IPv4 payload
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer3_send_ipv4_flow_packet(struct net_ipv4_flow *flow_p,
+                                         struct network_packet *tx_packet_p,
+                                         size_t data_payload_length)
+{
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
 
-        break;
+    D_ASSERT(flow_p->signature == NET_IPV4_FLOW_SIGNATURE);
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(data_payload_length <= NET_MAX_IPV4_PACKET_PAYLOAD_SIZE);
 
-    default:
-        ERROR_PRINTF("Received ARP packet with unsupported operation (%#x)\n",
-                     arp_operation);
+    struct ethernet_frame *const template_frame_p =
+        (struct ethernet_frame *)flow_p->header_template;
+
+    if (!flow_p->template_valid ||
+        (flow_p->arp_cache_bucket_p != NULL &&
+         flow_p->arp_cache_bucket_p->sequence_count !=
+            flow_p->arp_cache_bucket_sequence_count) ||
+        template_frame_p->ipv4_header.source_ip_addr.value !=
+            flow_p->layer3_end_point_p->ipv4.local_ip_addr.value ||
+        RTOS_TICKS_DELTA(flow_p->template_time_stamp, current_ticks) >=
+            MILLISECONDS_TO_TICKS(NET_IPV4_FLOW_TEMPLATE_LIFETIME_IN_MS)) {
+        if (!net_layer3_ipv4_flow_build_template(flow_p, current_ticks)) {
+            return net_layer3_send_ipv4_packet(&flow_p->dest_ip_addr,
+                                               tx_packet_p,
+                                               data_payload_length,
+                                               flow_p->ip_packet_type);
+        }
     }
 
-    net_recycle_rx_packet(rx_packet_p);
-}
+    struct net_layer3_end_point *const layer3_end_point_p =
+        flow_p->layer3_end_point_p;
+    struct ethernet_frame *const tx_frame_p =
+        (struct ethernet_frame *)tx_packet_p->data_buffer;
 
+    memcpy32((uint32_t *)tx_frame_p, flow_p->header_template,
+             sizeof flow_p->header_template);
 
-static void net_send_ipv4_ping_reply(
-    const struct ipv4_address *dest_ip_addr_p,
-    const struct icmpv4_echo_message *ping_request_msg_p)
-{
-    struct network_packet *tx_packet_p = net_layer2_allocate_tx_packet(true);
-    struct icmpv4_echo_message *echo_msg_p =
-    (struct icmpv4_echo_message *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+    tx_frame_p->ipv4_header.total_length =
+        hton16(sizeof(struct ipv4_header) + data_payload_length);
+    tx_frame_p->ipv4_header.identification =
+        hton16(ATOMIC_POST_INCREMENT_UINT16(
+                    &layer3_end_point_p->ipv4.next_tx_ip_packet_seq_num));
 
-    echo_msg_p->identifier = ping_request_msg_p->identifier;
-    echo_msg_p->seq_num = ping_request_msg_p->seq_num;
-    net_layer3_send_ipv4_icmp_message(dest_ip_addr_p,
-                                      tx_packet_p,
-                                      ICMP_TYPE_PING_REPLY,
-                                      ICMP_CODE_PING_REPLY,
-                                      sizeof(struct icmpv4_echo_message) -
-                                         sizeof(struct icmpv4_header));
+    COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_SENT);
+    return net_layer2_send_prebuilt_ethernet_frame(
+                layer3_end_point_p->layer2_end_point_p,
+                tx_packet_p,
+                sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+                    data_payload_length);
 }
 
 
-static void net_process_incoming_icmpv4_message(struct network_packet *rx_packet_p)
+/**
+ * Adds a received IPv4 fragment to the reassembly buffer of its packet. The
+ * fragment's data is copied to the reassembly buffer and its Rx packet is
+ * recycled, except when the fragment completes the packet. In that case, the
+ * reassembly buffer is lent to the fragment's Rx packet, which is returned
+ * holding the reassembled packet.
+ *
+ * @param rx_packet_p   Rx packet containing an IPv4 fragment
+ *
+ * @return pointer to the Rx packet holding the reassembled IPv4 packet, or
+ *         NULL if the packet is not complete yet or the fragment was dropped
+ */
+static struct network_packet *
+net_layer3_reassemble_ipv4_packet(struct network_packet *rx_packet_p)
 {
-    bool signal_ping_reply_received = false;
-
-    D_ASSERT(rx_packet_p->total_length >=
-             sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
-             sizeof(struct icmpv4_header));
+    struct ipv4_header *const ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    struct net_layer3_ipv4 *const layer3_ipv4_p = &g_net_layer3.ipv4;
+    struct net_ipv4_reassembly_buffer *reassembly_buffer_p = NULL;
+    struct net_ipv4_reassembly_buffer *free_reassembly_buffer_p = NULL;
+    uint16_t flags_and_fragment_offset =
+        ntoh16(ipv4_header_p->flags_and_fragment_offset);
+    size_t header_length =
+        GET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                      IP_HEADER_LENGTH_MASK, IP_HEADER_LENGTH_SHIFT) * 4;
+    size_t total_length = ntoh16(ipv4_header_p->total_length);
+    size_t fragment_offset =
+        GET_BIT_FIELD(flags_and_fragment_offset,
+                      IP_FRAGMENT_OFFSET_MASK, IP_FRAGMENT_OFFSET_SHIFT) * 8;
+    bool more_fragments =
+        (flags_and_fragment_offset & IP_FLAG_MORE_FRAGMENTS_MASK) != 0;
+    size_t fragment_length;
+    uint32_t current_ticks;
+
+    ATOMIC_POST_INCREMENT_UINT32(&layer3_ipv4_p->rx_fragments_count);
+
+    if (header_length < sizeof(struct ipv4_header) ||
+        total_length <= header_length ||
+        rx_packet_p->total_length < sizeof(struct ethernet_header) + total_length ||
+        rx_packet_p->next_fragment_p != NULL) {
+        goto drop_fragment;
+    }
 
-    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
-    struct icmpv4_header *icmpv4_header_p = GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+    fragment_length = total_length - header_length;
+    if ((more_fragments && fragment_length % 8 != 0) ||
+        fragment_offset + fragment_length > NET_IPV4_REASSEMBLY_MAX_PAYLOAD_SIZE) {
+        goto drop_fragment;
+    }
 
-    switch (icmpv4_header_p->msg_type) {
-    case ICMP_TYPE_PING_REPLY:
-        D_ASSERT(icmpv4_header_p->msg_code == ICMP_CODE_PING_REPLY);
+    rtos_mutex_lock(&layer3_ipv4_p->reassembly_mutex);
 
-        rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
-        if (g_net_layer3.ipv4.expecting_ping_reply) {
-            net_packet_queue_add(&g_net_layer3.ipv4.rx_ipv4_ping_reply_packet_queue,
-                                 rx_packet_p);
+    /*
+     * Find the reassembly buffer of the fragment's packet, abandoning
+     * reassemblies that timed out:
+     */
+    current_ticks = rtos_get_ticks_since_boot();
+    for (unsigned int i = 0; i < NET_IPV4_NUM_REASSEMBLY_BUFFERS; i++) {
+        struct net_ipv4_reassembly_buffer *buffer_p =
+            &layer3_ipv4_p->reassembly_buffers[i];
+
+        if (buffer_p->state == NET_IPV4_REASSEMBLY_BUFFER_REASSEMBLING &&
+            RTOS_TICKS_DELTA(buffer_p->start_time_stamp, current_ticks) >=
+                MILLISECONDS_TO_TICKS(NET_IPV4_REASSEMBLY_TIMEOUT_IN_MS)) {
+            buffer_p->state = NET_IPV4_REASSEMBLY_BUFFER_FREE;
+            ATOMIC_POST_INCREMENT_UINT32(&layer3_ipv4_p->rx_fragments_dropped_count);
+        }
 
-            g_net_layer3.ipv4.expecting_ping_reply = false;
-            signal_ping_reply_received = true;
-        } else {
-            /*
-             * Drop unmatched ping reply
-             */
-            net_recycle_rx_packet(rx_packet_p);
+        if (buffer_p->state == NET_IPV4_REASSEMBLY_BUFFER_FREE) {
+            if (free_reassembly_buffer_p == NULL) {
+                free_reassembly_buffer_p = buffer_p;
+            }
+        } else if (buffer_p->state == NET_IPV4_REASSEMBLY_BUFFER_REASSEMBLING &&
+                   buffer_p->identification == ipv4_header_p->identification &&
+                   buffer_p->source_ip_addr.value ==
+                        ipv4_header_p->source_ip_addr.value &&
+                   buffer_p->dest_ip_addr.value ==
+                        ipv4_header_p->dest_ip_addr.value &&
+                   buffer_p->protocol_type == ipv4_header_p->protocol_type) {
+            reassembly_buffer_p = buffer_p;
         }
+    }
 
-        rtos_mutex_unlock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
-        if (signal_ping_reply_received) {
-            rtos_semaphore_signal(&g_net_layer3.ipv4.ping_reply_received_semaphore);
+    if (reassembly_buffer_p == NULL) {
+        if (free_reassembly_buffer_p == NULL) {
+            rtos_mutex_unlock(&layer3_ipv4_p->reassembly_mutex);
+            goto drop_fragment;
         }
 
-        break;
+        reassembly_buffer_p = free_reassembly_buffer_p;
+        reassembly_buffer_p->state = NET_IPV4_REASSEMBLY_BUFFER_REASSEMBLING;
+        reassembly_buffer_p->identification = ipv4_header_p->identification;
+        reassembly_buffer_p->source_ip_addr.value =
+            ipv4_header_p->source_ip_addr.value;
+        reassembly_buffer_p->dest_ip_addr.value =
+            ipv4_header_p->dest_ip_addr.value;
+        reassembly_buffer_p->protocol_type = ipv4_header_p->protocol_type;
+        reassembly_buffer_p->payload_length = 0;
+        reassembly_buffer_p->received_blocks_count = 0;
+        reassembly_buffer_p->start_time_stamp = current_ticks;
+        bzero(reassembly_buffer_p->received_blocks_bitmap,
+              sizeof reassembly_buffer_p->received_blocks_bitmap);
+    }
 
-    case ICMP_TYPE_PING_REQUEST:
-        D_ASSERT(icmpv4_header_p->msg_code == ICMP_CODE_PING_REQUEST);
+    if (!more_fragments) {
+        if (reassembly_buffer_p->payload_length != 0 &&
+            reassembly_buffer_p->payload_length != fragment_offset + fragment_length) {
+            /*
+             * Inconsistent last fragments: abandon the reassembly
+             */
+            reassembly_buffer_p->state = NET_IPV4_REASSEMBLY_BUFFER_FREE;
+            rtos_mutex_unlock(&layer3_ipv4_p->reassembly_mutex);
+            goto drop_fragment;
+        }
 
-        struct ipv4_address dest_ip_addr;
+        reassembly_buffer_p->payload_length = fragment_offset + fragment_length;
+    }
 
-        dest_ip_addr.value = ipv4_header_p->source_ip_addr.value;
+    /*
+     * Copy the fragment's data to the reassembly buffer. The first fragment
+     * also provides the Ethernet header and the IPv4 header (without
+     * options):
+     */
+    if (fragment_offset == 0) {
+        memcpy(reassembly_buffer_p->data_buffer, rx_packet_p->data_buffer,
+               sizeof(struct ethernet_header) + sizeof(struct ipv4_header));
+    }
 
-        net_send_ipv4_ping_reply(
-            &dest_ip_addr,
-            (struct icmpv4_echo_message *)icmpv4_header_p);
+    dma_memcpy(reassembly_buffer_p->data_buffer +
+                   sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+                   fragment_offset,
+               (uint8_t *)ipv4_header_p + header_length,
+               fragment_length);
 
-        net_recycle_rx_packet(rx_packet_p);
-        break;
+    for (size_t block = fragment_offset / 8;
+         block < HOW_MANY(fragment_offset + fragment_length, 8);
+         block ++) {
+        uint32_t block_mask = BIT(block % 32);
 
-    default:
-        ERROR_PRINTF("Received ICMP message with unsupported type: %#x\n",
-                     icmpv4_header_p->msg_type);
+        if ((reassembly_buffer_p->received_blocks_bitmap[block / 32] & block_mask) == 0) {
+            reassembly_buffer_p->received_blocks_bitmap[block / 32] |= block_mask;
+            reassembly_buffer_p->received_blocks_count ++;
+        }
+    }
 
+    if (reassembly_buffer_p->payload_length == 0 ||
+        reassembly_buffer_p->received_blocks_count !=
+            HOW_MANY(reassembly_buffer_p->payload_length, 8)) {
+        /*
+         * Packet not complete yet:
+         */
+        rtos_mutex_unlock(&layer3_ipv4_p->reassembly_mutex);
         net_recycle_rx_packet(rx_packet_p);
+        return NULL;
     }
+
+    /*
+     * Packet complete: fix up its IPv4 header and lend the reassembly buffer
+     * to the Rx packet of the last fragment received:
+     */
+    struct ipv4_header *const reassembled_ipv4_header_p =
+        (struct ipv4_header *)(reassembly_buffer_p->data_buffer +
+                               sizeof(struct ethernet_header));
+
+    SET_BIT_FIELD(reassembled_ipv4_header_p->version_and_header_length,
+                  IP_HEADER_LENGTH_MASK, IP_HEADER_LENGTH_SHIFT,
+                  sizeof(struct ipv4_header) / 4);
+    reassembled_ipv4_header_p->total_length =
+        hton16(sizeof(struct ipv4_header) + reassembly_buffer_p->payload_length);
+    reassembled_ipv4_header_p->flags_and_fragment_offset = 0;
+
+    reassembly_buffer_p->state = NET_IPV4_REASSEMBLY_BUFFER_LENT_TO_RX_PACKET;
+    reassembly_buffer_p->rx_packet_p = rx_packet_p;
+    reassembly_buffer_p->rx_packet_data_buffer = rx_packet_p->data_buffer;
+    reassembly_buffer_p->rx_packet_data_buffer_size = rx_packet_p->data_buffer_size;
+    reassembly_buffer_p->rx_packet_headroom = rx_packet_p->headroom;
+    rtos_mutex_unlock(&layer3_ipv4_p->reassembly_mutex);
+
+    D_ASSERT(rx_packet_p->ipv4_reassembly_buffer_p == NULL);
+    rx_packet_p->ipv4_reassembly_buffer_p = reassembly_buffer_p;
+    rx_packet_p->data_buffer = reassembly_buffer_p->data_buffer;
+    rx_packet_p->data_buffer_size = sizeof reassembly_buffer_p->data_buffer;
+    rx_packet_p->headroom = 0;
+    rx_packet_p->total_length = sizeof(struct ethernet_header) +
+                                sizeof(struct ipv4_header) +
+                                reassembly_buffer_p->payload_length;
+
+    ATOMIC_POST_INCREMENT_UINT32(&layer3_ipv4_p->rx_reassembled_packets_count);
+    return rx_packet_p;
+
+drop_fragment:
+    ATOMIC_POST_INCREMENT_UINT32(&layer3_ipv4_p->rx_fragments_dropped_count);
+    net_recycle_rx_packet(rx_packet_p);
+    return NULL;
 }
 
 
 /**
- * ICMPv4 packet receiver task for a given IPv4 end point
+ * Releases the IPv4 reassembly buffer lent to an Rx packet, restoring the
+ * packet's own data buffer. Called when the Rx packet is recycled.
+ *
+ * @param rx_packet_p   Rx packet holding a reassembled IPv4 packet
  */
-static void icmpv4_packet_receiver_task(void *arg)
+void net_layer3_ipv4_release_reassembly_buffer(struct network_packet *rx_packet_p)
 {
-    struct ipv4_end_point *const ipv4_end_point_p =
-        (struct ipv4_end_point *)arg;
-    struct net_layer3_end_point *const layer3_end_point_p =
-        ENCLOSING_STRUCT(ipv4_end_point_p, struct net_layer3_end_point, ipv4);
-
-#   ifdef USE_MPU
-    rtos_thread_set_comp_region(&g_net_layer3,
-                                sizeof g_net_layer3,
-                                0,
-                                NULL);
-#   endif
-
-    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
-
-    for ( ; ; ) {
-        struct network_packet *rx_packet_p = NULL;
-
-        rx_packet_p =
-            net_packet_queue_remove(&ipv4_end_point_p->rx_icmpv4_packet_queue, 0);
-
-        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
-        rx_packet_p->state_flags &= ~NET_PACKET_IN_ICMP_QUEUE;
-        net_process_incoming_icmpv4_message(rx_packet_p);
-    }
-
-    ERROR_PRINTF("task %s should not have terminated\n",
-                 rtos_task_self()->tsk_name_p);
+    struct net_ipv4_reassembly_buffer *const reassembly_buffer_p =
+        rx_packet_p->ipv4_reassembly_buffer_p;
+
+    D_ASSERT(reassembly_buffer_p->state ==
+             NET_IPV4_REASSEMBLY_BUFFER_LENT_TO_RX_PACKET);
+    D_ASSERT(reassembly_buffer_p->rx_packet_p == rx_packet_p);
+
+    rx_packet_p->data_buffer = reassembly_buffer_p->rx_packet_data_buffer;
+    rx_packet_p->data_buffer_size = reassembly_buffer_p->rx_packet_data_buffer_size;
+    rx_packet_p->headroom = reassembly_buffer_p->rx_packet_headroom;
+    rx_packet_p->ipv4_reassembly_buffer_p = NULL;
+
+    rtos_mutex_lock(&g_net_layer3.ipv4.reassembly_mutex);
+    reassembly_buffer_p->rx_packet_p = NULL;
+    reassembly_buffer_p->state = NET_IPV4_REASSEMBLY_BUFFER_FREE;
+    rtos_mutex_unlock(&g_net_layer3.ipv4.reassembly_mutex);
 }
 
 
-static void net_send_ipv4_dhcp_request(
-    struct net_layer3_end_point *layer3_end_point_p,
-    struct net_layer4_end_point *client_end_point_p,
-    struct dhcp_message *dhcp_offer_msg_p)
+/**
+ * Takes a token from the ICMPv4 rate limiter bucket of the source address of
+ * a received ICMPv4 message. A token is added to a bucket every
+ * ICMPV4_RATE_LIMITER_TOKEN_INTERVAL_IN_MS, up to
+ * ICMPV4_RATE_LIMITER_BUCKET_SIZE tokens. If the source address has no bucket,
+ * the bucket refilled least recently is reassigned to it.
+ *
+ * @param ipv4_end_point_p  Pointer to the local IPv4 end point
+ * @param source_ip_addr_p  Source IPv4 address of the ICMPv4 message
+ *
+ * @return true, if the ICMPv4 message can be accepted
+ * @return false, if the ICMPv4 message must be dropped
+ */
+static bool icmpv4_rate_limiter_take_token(struct ipv4_end_point *ipv4_end_point_p,
+                                           const struct ipv4_address *source_ip_addr_p)
 {
-    struct network_packet *tx_packet_p = net_layer2_allocate_tx_packet(true);
-
-    struct dhcp_message *dhcp_request_msg_p =
-        get_ipv4_udp_data_payload_area(tx_packet_p);
-
-    *dhcp_request_msg_p = *dhcp_offer_msg_p;
-    dhcp_request_msg_p->op = 0x1;
-    dhcp_request_msg_p->options[0] = 53; /* option 1 type: DHCP message type */
-    dhcp_request_msg_p->options[1] = 1; /* option length */
-    dhcp_request_msg_p->options[2] = 0x03; /* option value: DHCPREQUEST */
-
-    dhcp_request_msg_p->options[3] = 54; /* option 2 type: DHCP server identifier */
-    dhcp_request_msg_p->options[4] = 4; /* option length */
-    dhcp_request_msg_p->options[5] = dhcp_offer_msg_p->next_server_ip_addr.bytes[0]; /* option value[0] */
-    dhcp_request_msg_p->options[6] = dhcp_offer_msg_p->next_server_ip_addr.bytes[1]; /* option value[1] */
-    dhcp_request_msg_p->options[7] = dhcp_offer_msg_p->next_server_ip_addr.bytes[2]; /* option value[2] */
-    dhcp_request_msg_p->options[8] = dhcp_offer_msg_p->next_server_ip_addr.bytes[3]; /* option value[3] */
+    const uint32_t token_interval_ticks =
+        MILLISECONDS_TO_TICKS(ICMPV4_RATE_LIMITER_TOKEN_INTERVAL_IN_MS);
+    struct icmpv4_rate_limiter_bucket *bucket_p = NULL;
+    struct icmpv4_rate_limiter_bucket *oldest_bucket_p =
+        &ipv4_end_point_p->icmpv4_rate_limiter_buckets[0];
+    bool token_taken;
 
-    dhcp_request_msg_p->options[9] = 50; /* option 3 type: Requested IP address */
-    dhcp_request_msg_p->options[10] = 4; /* option length */
-    dhcp_request_msg_p->options[11] = dhcp_offer_msg_p->your_ip_addr.bytes[0]; /* option value[0] */
-    dhcp_request_msg_p->options[12] = dhcp_offer_msg_p->your_ip_addr.bytes[1]; /* option value[1] */
-    dhcp_request_msg_p->options[13] = dhcp_offer_msg_p->your_ip_addr.bytes[2]; /* option value[2] */
-    dhcp_request_msg_p->options[14] = dhcp_offer_msg_p->your_ip_addr.bytes[3]; /* option value[3] */
+    rtos_mutex_lock(&ipv4_end_point_p->icmpv4_rate_limiter_mutex);
 
-    dhcp_request_msg_p->options[15] = 55; /* option 2 type: parameter request list */
-    dhcp_request_msg_p->options[16] = 11; /* option length */
-    dhcp_request_msg_p->options[17] = 0x01; /* option value[0]: subnet mask */
-    dhcp_request_msg_p->options[18] = 0x1c; /* option value[1]: broadcast address */
-    dhcp_request_msg_p->options[19] = 0x02; /* option value[2]: time offset */
-    dhcp_request_msg_p->options[20] = 0x03; /* option value[3]: router */
-    dhcp_request_msg_p->options[21] = 0x0f; /* option value[4]: domain name */
-    dhcp_request_msg_p->options[22] = 0x06; /* option value[5]: domain name server */
-    dhcp_request_msg_p->options[23] = 0x77; /* option value[6]: domain search */
-    dhcp_request_msg_p->options[24] = 0x0c; /* option value[7]: host name */
-    dhcp_request_msg_p->options[25] = 0x1a; /* option value[8]: interface MTU */
-    dhcp_request_msg_p->options[26] = 0x79; /* option value[9]: classless static route */
-    dhcp_request_msg_p->options[27] = 0x2a; /* option value[10]: network time protocol servers */
+    uint32_t now = rtos_get_ticks_since_boot();
 
-    struct ipv4_address dest_ip_addr = { .value = IPV4_BROADCAST_ADDR };
+    for (unsigned int i = 0; i < ICMPV4_RATE_LIMITER_NUM_SOURCES; i ++) {
+        struct icmpv4_rate_limiter_bucket *entry_p =
+            &ipv4_end_point_p->icmpv4_rate_limiter_buckets[i];
 
-    net_layer4_send_udp_datagram_over_ipv4(client_end_point_p, &dest_ip_addr,
-                                           hton16(DHCP_UDP_SERVER_PORT),
-                                           tx_packet_p,
-                                           sizeof(struct dhcp_message) + 28);
+        if (entry_p->source_ip_addr.value == source_ip_addr_p->value) {
+            bucket_p = entry_p;
+            break;
+        }
 
-    if (g_net_layer3.tracing_on) {
-        DEBUG_PRINTF("Net layer3: DHCP client sent request message\n");
+        if (RTOS_TICKS_DELTA(entry_p->refill_time_stamp, now) >
+            RTOS_TICKS_DELTA(oldest_bucket_p->refill_time_stamp, now)) {
+            oldest_bucket_p = entry_p;
+        }
+    }
+
+    if (bucket_p == NULL) {
+        bucket_p = oldest_bucket_p;
+        bucket_p->source_ip_addr.value = source_ip_addr_p->value;
+        bucket_p->tokens = ICMPV4_RATE_LIMITER_BUCKET_SIZE;
+        bucket_p->refill_time_stamp = now;
+    } else {
+        uint32_t new_tokens =
+            RTOS_TICKS_DELTA(bucket_p->refill_time_stamp, now) / token_interval_ticks;
+
+        if (bucket_p->tokens + new_tokens >= ICMPV4_RATE_LIMITER_BUCKET_SIZE) {
+            bucket_p->tokens = ICMPV4_RATE_LIMITER_BUCKET_SIZE;
+            bucket_p->refill_time_stamp = now;
+        } else {
+            bucket_p->tokens += new_tokens;
+            bucket_p->refill_time_stamp += new_tokens * token_interval_ticks;
+        }
+    }
+
+    token_taken = (bucket_p->tokens != 0);
+    if (token_taken) {
+        bucket_p->tokens --;
     }
+
+    rtos_mutex_unlock(&ipv4_end_point_p->icmpv4_rate_limiter_mutex);
+    return token_taken;
 }
 
 
-static void net_set_local_ipv4_addr_from_dhcp(
+/**
+ * Fills or refreshes the ARP cache entry of the sender of a received IPv4
+ * packet addressed to us, from the packet's source MAC and IPv4 addresses,
+ * if the sender is on our subnet. So, replying to a peer that just sent us
+ * a packet does not have to wait for an ARP request round trip. If the
+ * sender's entry is already filled with the same MAC address, and it does
+ * not need to be refreshed yet, the bucket's mutex is not taken.
+ */
+static void arp_cache_learn_from_rx_packet(
     struct net_layer3_end_point *layer3_end_point_p,
-    struct dhcp_message *dhcp_ack_msg_p,
-    size_t dhcp_ack_msg_size)
+    const struct network_packet *rx_packet_p)
 {
-    uint32_t subnet_mask = 0;
-    uint32_t lease_time = 0;
-    struct ipv4_address router_ip_addr = { .value = IPV4_NULL_ADDR };
-    struct ipv4_address *local_ip_addr_p = &dhcp_ack_msg_p->your_ip_addr;
-    size_t options_len = dhcp_ack_msg_size - sizeof(struct dhcp_message);
-    unsigned int expected_options_found = 0;
-
-    D_ASSERT(g_net_layer3.initialized);
-    D_ASSERT(local_ip_addr_p->value != IPV4_NULL_ADDR);
+    const struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
+    const struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    const struct ipv4_end_point *ipv4_end_point_p = &layer3_end_point_p->ipv4;
+    struct ipv4_address source_ip_addr;
+    struct ethernet_mac_address cached_mac_addr;
 
     /*
-     * Extract DHCP options:
+     * Packets looped back by layer 3 have no source MAC address:
      */
-    for (unsigned int i = 0; i < options_len; ) {
-        if (dhcp_ack_msg_p->options[i] == 1) {          /* subnet mask option */
-            D_ASSERT(dhcp_ack_msg_p->options[i + 1] == 4);
+    if (rx_packet_p->signature != NET_RX_PACKET_SIGNATURE) {
+        return;
+    }
+
+    source_ip_addr.value = ipv4_header_p->source_ip_addr.value;
+    if (ipv4_header_p->dest_ip_addr.value != ipv4_end_point_p->local_ip_addr.value ||
+        source_ip_addr.value == IPV4_NULL_ADDR ||
+        source_ip_addr.value == ipv4_end_point_p->local_ip_addr.value ||
+        IPV4_ADDR_IS_MULTICAST(&source_ip_addr) ||
+        !SAME_IPv4_SUBNET(&ipv4_end_point_p->local_ip_addr, &source_ip_addr,
+                          ipv4_end_point_p->subnet_mask) ||
+        (source_ip_addr.value | ipv4_end_point_p->subnet_mask) == IPV4_BROADCAST_ADDR ||
+        (rx_frame_p->ethernet_header.source_mac_addr.bytes[0] &
+         MAC_MULTICAST_ADDRESS_MASK) != 0) {
+        return;
+    }
 
-            uint8_t *subnet_mask_bytes_p = (uint8_t *)&subnet_mask;
+    if (arp_cache_lock_free_lookup(&layer3_end_point_p->ipv4.arp_cache,
+                                   &source_ip_addr, &cached_mac_addr) &&
+        MAC_ADDRESSES_EQUAL(&cached_mac_addr,
+                            &rx_frame_p->ethernet_header.source_mac_addr)) {
+        return;
+    }
 
-            subnet_mask_bytes_p[0] = dhcp_ack_msg_p->options[i + 2];
-            subnet_mask_bytes_p[1] = dhcp_ack_msg_p->options[i + 3];
-            subnet_mask_bytes_p[2] = dhcp_ack_msg_p->options[i + 4];
-            subnet_mask_bytes_p[3] = dhcp_ack_msg_p->options[i + 5];
+    struct ethernet_mac_address source_mac_addr;
 
-            expected_options_found ++;
-        } else if (dhcp_ack_msg_p->options[i] == 3) {   /* router option */
-            D_ASSERT(dhcp_ack_msg_p->options[i + 1] == 4);
+    COPY_MAC_ADDRESS(&source_mac_addr, &rx_frame_p->ethernet_header.source_mac_addr);
+    arp_cache_update(layer3_end_point_p, &source_ip_addr, &source_mac_addr);
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.arp_cache_learned_count);
+}
 
-            router_ip_addr.bytes[0] = dhcp_ack_msg_p->options[i + 2];
-            router_ip_addr.bytes[1] = dhcp_ack_msg_p->options[i + 3];
-            router_ip_addr.bytes[2] = dhcp_ack_msg_p->options[i + 4];
-            router_ip_addr.bytes[3] = dhcp_ack_msg_p->options[i + 5];
 
-            expected_options_found ++;
-        } else if (dhcp_ack_msg_p->options[i] == 51) {  /* lease time option */
-            D_ASSERT(dhcp_ack_msg_p->options[i + 1] == 4);
+/**
+ * Checks that the IPv4 header of a received packet is well formed: version 4,
+ * no IP options (the rest of the stack assumes a fixed-size header) and a
+ * total length that fits in the received frame.
+ *
+ * @param rx_packet_p   Pointer to the received packet
+ *
+ * @return true, if the header is well formed
+ * @return false, otherwise
+ */
+static bool net_layer3_ipv4_header_is_valid(const struct network_packet *rx_packet_p)
+{
+    const struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    size_t ip_packet_length = ntoh16(ipv4_header_p->total_length);
+
+    if (GET_IP_VERSION(ipv4_header_p) != 4 ||
+        GET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                      IP_HEADER_LENGTH_MASK, IP_HEADER_LENGTH_SHIFT) !=
+            sizeof(struct ipv4_header) / sizeof(uint32_t)) {
+        return false;
+    }
 
-            uint8_t *lease_time_bytes_p = (uint8_t *)&lease_time;
+    /*
+     * NOTE: The frame may be longer than the IPv4 packet, because of the
+     * Ethernet minimum frame length padding.
+     */
+    return ip_packet_length >= sizeof(struct ipv4_header) &&
+           ip_packet_length <= rx_packet_p->total_length - sizeof(struct ethernet_header);
+}
 
-            lease_time_bytes_p[0] = dhcp_ack_msg_p->options[i + 2];
-            lease_time_bytes_p[1] = dhcp_ack_msg_p->options[i + 3];
-            lease_time_bytes_p[2] = dhcp_ack_msg_p->options[i + 4];
-            lease_time_bytes_p[3] = dhcp_ack_msg_p->options[i + 5];
 
-            lease_time = ntoh32(lease_time);
-            expected_options_found ++;
-        }
+/**
+ * Tells if the destination address of a received IPv4 packet is one of ours:
+ * the local IPv4 address, a loopback address, the limited broadcast address,
+ * the directed broadcast address of our subnet, the all-systems multicast
+ * group or a multicast group joined on the receiving end point. The Ethernet
+ * MAC is in promiscuous mode, so this is the first place where traffic for
+ * other hosts can be told apart.
+ *
+ * While the local IPv4 address is not configured, any destination is
+ * accepted, as the DHCP server may unicast its replies to the address being
+ * offered.
+ *
+ * NOTE: The multicast groups table is looked up without taking its mutex.
+ * Entries are single 32-bit words, so a concurrent join or leave can only
+ * make us accept or drop the first packets sent to that group.
+ *
+ * @param ipv4_end_point_p  Pointer to the receiving IPv4 end point
+ * @param dest_ip_addr_p    Destination address of the received IPv4 packet
+ *
+ * @return true, if the packet is for us
+ * @return false, otherwise
+ */
+static bool net_layer3_ipv4_dest_addr_is_local(const struct ipv4_end_point *ipv4_end_point_p,
+                                               const struct ipv4_address *dest_ip_addr_p)
+{
+    uint32_t local_ip_addr = ipv4_end_point_p->local_ip_addr.value;
 
-        /*
-         * Skip to next option:
-         */
-        i += dhcp_ack_msg_p->options[i + 1];
+    if (local_ip_addr == IPV4_NULL_ADDR ||
+        dest_ip_addr_p->value == local_ip_addr ||
+        dest_ip_addr_p->value == IPV4_BROADCAST_ADDR ||
+        IPV4_ADDR_IS_LOOPBACK(dest_ip_addr_p)) {
+        return true;
     }
 
-    D_ASSERT(expected_options_found == 3);
+    if (IPV4_ADDR_IS_MULTICAST(dest_ip_addr_p)) {
+        if (dest_ip_addr_p->value == g_ipv4_all_systems_multicast_addr.value) {
+            return true;
+        }
 
-    layer3_end_point_p->ipv4.local_ip_addr = *local_ip_addr_p;
-    layer3_end_point_p->ipv4.subnet_mask = subnet_mask;
-    layer3_end_point_p->ipv4.default_gateway_ip_addr = router_ip_addr;
-    layer3_end_point_p->ipv4.dhcp_lease_time = lease_time;
+        if (ipv4_end_point_p->num_multicast_groups == 0) {
+            return false;
+        }
 
-    if (g_net_layer3.tracing_on) {
-        DEBUG_PRINTF("Net layer3: Set local IP address from DHCP: %u.%u.%u.%u\n",
-                     local_ip_addr_p->bytes[0],
-                     local_ip_addr_p->bytes[1],
-                     local_ip_addr_p->bytes[2],
-                     local_ip_addr_p->bytes[3]);
+        for (unsigned int i = 0; i < NET_IPV4_MAX_MULTICAST_GROUPS; i ++) {
+            if (ipv4_end_point_p->multicast_groups[i].group_addr.value ==
+                    dest_ip_addr_p->value) {
+                return true;
+            }
+        }
+
+        return false;
     }
 
-    /*
-     * Send gratuitous ARP request (to catch if someone else is using the same
-     * IP address):
-     */
-    net_send_arp_request(layer3_end_point_p->layer2_end_point_p,
-                         &layer3_end_point_p->ipv4.local_ip_addr,
-                         &layer3_end_point_p->ipv4.local_ip_addr);
+    return dest_ip_addr_p->value == (local_ip_addr | ~ipv4_end_point_p->subnet_mask);
 }
 
 
-/**
- * DHCPv4 client task
- */
-static void dhcpv4_client_task(void *arg)
+void net_layer3_receive_ipv4_packet(struct network_packet *rx_packet_p)
 {
-    enum dhcp_client_states {
-        DHCP_OFFER_EXPECTED,
-        DHCP_ACKNOWLEDGE_EXPECTED,
-        DHCP_LEASE_GRANTED,
-    } state;
-
-    error_t error;
-    struct network_packet *rx_packet_p = NULL;
-    struct ipv4_address server_ip_addr;
-    uint16_t server_port;
-    struct dhcp_message *dhcp_msg_p;
-    size_t dhcp_msg_size;
-    uint32_t timeout_ms = 0;
-    struct ipv4_end_point *const ipv4_end_point_p =
-        (struct ipv4_end_point *)arg;
-    struct net_layer3_end_point *const layer3_end_point_p =
-        ENCLOSING_STRUCT(ipv4_end_point_p, struct net_layer3_end_point, ipv4);
+    D_ASSERT(CALLER_IS_THREAD());
 
 #   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
     rtos_thread_set_comp_region(&g_net_layer3,
                                 sizeof g_net_layer3,
                                 0,
-                                NULL);
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(rx_packet_p, sizeof *rx_packet_p, 0);
 #   endif
 
+    NET_RX_PACKET_LATENCY_STAGE(rx_packet_p, PERF_PROBE_RX_LATENCY_LAYER2_TO_LAYER3);
+    D_ASSERT(rx_packet_p->total_length >=
+             sizeof(struct ethernet_header) + sizeof(struct ipv4_header));
+
+    struct net_layer2_end_point *const layer2_end_point_p =
+        rx_packet_p->layer2_end_point_p;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        layer2_end_point_p->layer3_end_point_p;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
     D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+    D_ASSERT(layer3_end_point_p->layer2_end_point_p == layer2_end_point_p);
 
-    struct net_layer4_end_point *dhcp_client_end_point_p =
-            &ipv4_end_point_p->dhcpv4_client_end_point;
+    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
 
-    net_layer4_udp_end_point_init(dhcp_client_end_point_p);
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: IPv4 packet received:\n"
+                     "\tsource IPv4 address %u.%u.%u.%u\n"
+                     "\tdestination IPv4 address %u.%u.%u.%u\n"
+                     "\tPacket type %#x, Total length: %u\n",
+                     ipv4_header_p->source_ip_addr.bytes[0],
+                     ipv4_header_p->source_ip_addr.bytes[1],
+                     ipv4_header_p->source_ip_addr.bytes[2],
+                     ipv4_header_p->source_ip_addr.bytes[3],
+                     ipv4_header_p->dest_ip_addr.bytes[0],
+                     ipv4_header_p->dest_ip_addr.bytes[1],
+                     ipv4_header_p->dest_ip_addr.bytes[2],
+                     ipv4_header_p->dest_ip_addr.bytes[3],
+                     ipv4_header_p->protocol_type,
+                     ntoh16(ipv4_header_p->total_length));
+    }
 
-    error = net_layer4_udp_end_point_bind(dhcp_client_end_point_p,
-                                          DHCP_UDP_CLIENT_PORT);
-    if (error != 0) {
+    bool packet_dropped = false;
+
+    if (!net_layer3_ipv4_header_is_valid(rx_packet_p)) {
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv4.rx_packets_dropped_bad_header_count);
+        net_recycle_rx_packet(rx_packet_p);
+        packet_dropped = true;
         goto exit;
     }
 
-    net_send_ipv4_dhcp_discovery(layer3_end_point_p, dhcp_client_end_point_p);
-    state = DHCP_OFFER_EXPECTED;
-    for ( ; ; ) {
+    if (!net_layer3_ipv4_dest_addr_is_local(&layer3_end_point_p->ipv4,
+                                            &ipv4_header_p->dest_ip_addr)) {
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv4.rx_packets_dropped_not_for_us_count);
+        net_recycle_rx_packet(rx_packet_p);
+        packet_dropped = true;
+        goto exit;
+    }
+
+    /*
+     * NOTE: Checksums are validated by the Ethernet MAC hardware. We just
+     * need to check the result.
+     */
+    if (NET_RX_PACKET_IP_HEADER_CHECKSUM_BAD(rx_packet_p)) {
+        ERROR_PRINTF("Received IPv4 packet with wrong header checksum\n");
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv4.rx_packets_dropped_bad_checksum_count);
+        net_recycle_rx_packet(rx_packet_p);
+        packet_dropped = true;
+        goto exit;
+    }
+
+    arp_cache_learn_from_rx_packet(layer3_end_point_p, rx_packet_p);
+
+    if (ntoh16(ipv4_header_p->flags_and_fragment_offset) &
+        (IP_FLAG_MORE_FRAGMENTS_MASK | IP_FRAGMENT_OFFSET_MASK)) {
         /*
-         * Receive DHCP message:
+         * IPv4 fragment:
          */
-        net_layer4_receive_udp_datagram_over_ipv4(dhcp_client_end_point_p,
-                                                  timeout_ms,
-                                                  &server_ip_addr,
-                                                  &server_port,
-                                                  &rx_packet_p);
-
-        D_ASSERT(rx_packet_p != NULL);
-        D_ASSERT(server_port == DHCP_UDP_SERVER_PORT);
-        if (g_net_layer3.tracing_on) {
-            DEBUG_PRINTF("Net layer3: DHCP client received message %#x from %u.%u.%u.%u\n",
-                         dhcp_msg_p->options[2],
-                         server_ip_addr.bytes[0],
-                         server_ip_addr.bytes[1],
-                         server_ip_addr.bytes[2],
-                         server_ip_addr.bytes[3]);
+        rx_packet_p = net_layer3_reassemble_ipv4_packet(rx_packet_p);
+        if (rx_packet_p == NULL) {
+            goto exit;
         }
 
-        dhcp_msg_size = get_ipv4_udp_data_payload_length(rx_packet_p);
-        D_ASSERT(dhcp_msg_size >= sizeof(struct dhcp_message));
-        switch (state) {
-        case DHCP_OFFER_EXPECTED:
-            dhcp_msg_p = get_ipv4_udp_data_payload_area(rx_packet_p);
-            D_ASSERT(dhcp_msg_p->op == 0x2);
-            D_ASSERT(dhcp_msg_p->options[2] == 0x2);
-            net_send_ipv4_dhcp_request(layer3_end_point_p,
-                                       dhcp_client_end_point_p,
-                                       dhcp_msg_p);
-            state = DHCP_ACKNOWLEDGE_EXPECTED;
+        ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    }
+
+    switch (ipv4_header_p->protocol_type) {
+    case IP_PACKET_TYPE_ICMP:
+        if (NET_RX_PACKET_PROTOCOL_CHECKSUM_BAD(rx_packet_p)) {
+            ERROR_PRINTF("Received ICMPv4 message with wrong checksum\n");
+            ATOMIC_POST_INCREMENT_UINT32(
+                &g_net_layer3.ipv4.rx_packets_dropped_bad_checksum_count);
+            net_recycle_rx_packet(rx_packet_p);
+            packet_dropped = true;
             break;
+        }
 
-        case DHCP_ACKNOWLEDGE_EXPECTED:
-            dhcp_msg_p = get_ipv4_udp_data_payload_area(rx_packet_p);
-            D_ASSERT(dhcp_msg_p->op == 0x2);
-            D_ASSERT(dhcp_msg_p->options[2] == 0x5);
-            net_set_local_ipv4_addr_from_dhcp(layer3_end_point_p, dhcp_msg_p,
-                                              dhcp_msg_size);
-            state = DHCP_LEASE_GRANTED;
+        if (layer3_end_point_p->ipv4.rx_icmpv4_packet_queue.length >=
+                ICMPV4_RX_PACKET_QUEUE_MAX_LENGTH ||
+            !icmpv4_rate_limiter_take_token(&layer3_end_point_p->ipv4,
+                                            &ipv4_header_p->source_ip_addr)) {
+            ATOMIC_POST_INCREMENT_UINT32(
+                &g_net_layer3.ipv4.rx_icmpv4_packets_rate_limited_count);
+            net_recycle_rx_packet(rx_packet_p);
+            packet_dropped = true;
             break;
+        }
 
-        default:
-            /* Drop packet */
-            if (g_net_layer3.tracing_on) {
-                DEBUG_PRINTF("Net layer3: Dropped DHCP message (DHCP client state: %d)\n",
-                             state);
-            }
+        NET_PACKET_SET_STATE_FLAG(rx_packet_p, NET_PACKET_IN_ICMP_QUEUE);
+        net_packet_queue_add(&layer3_end_point_p->ipv4.rx_icmpv4_packet_queue,
+                             rx_packet_p);
+        break;
+
+    case IP_PACKET_TYPE_IGMP:
+        /*
+         * NOTE: The Ethernet MAC does not validate IGMP checksums. The IGMP
+         * message is validated when it is processed by the ICMPv4 packet
+         * receiver task.
+         */
+        if (layer3_end_point_p->ipv4.rx_icmpv4_packet_queue.length >=
+                ICMPV4_RX_PACKET_QUEUE_MAX_LENGTH) {
+            ATOMIC_POST_INCREMENT_UINT32(
+                &g_net_layer3.ipv4.rx_icmpv4_packets_rate_limited_count);
+            net_recycle_rx_packet(rx_packet_p);
+            packet_dropped = true;
+            break;
         }
 
+        NET_PACKET_SET_STATE_FLAG(rx_packet_p, NET_PACKET_IN_ICMP_QUEUE);
+        net_packet_queue_add(&layer3_end_point_p->ipv4.rx_icmpv4_packet_queue,
+                             rx_packet_p);
+        break;
+
+    case IP_PACKET_TYPE_UDP:
+        net_layer4_process_incoming_udp_datagram(rx_packet_p);
+        break;
+
+    case IP_PACKET_TYPE_TCP:
+        net_layer4_process_incoming_tcp_segment(rx_packet_p);
+        break;
+
+    default:
+        ERROR_PRINTF("Received IPv4 packet with unsupported protocol type: %#x\n",
+                     ipv4_header_p->protocol_type);
+
         net_recycle_rx_packet(rx_packet_p);
+        packet_dropped = true;
     }
 
 exit:
-    ERROR_PRINTF("task %s should not have terminated\n",
-                 rtos_task_self()->tsk_name_p);
+    if (packet_dropped) {
+        COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_RX_DROPPED);
+    } else {
+		COUNTER_SET_INCREMENT(g_net_layer3.ipv4.packet_counters, NET_PACKET_COUNTER_RX_ACCEPTED);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
 }
 
 
 /**
- * IPv4-specific initialization of a layer-3 end point
+ * Adds a static IPv4 route. If a route for the same prefix already exists,
+ * it is replaced.
  *
- * @param ipv4_end_point_p Pointer to IPv4 layer-3 end point
+ * @param dest_prefix_p         Destination prefix
+ * @param prefix_length         Number of bits of the destination prefix
+ *                              (0 for a default route)
+ * @param next_hop_ip_addr_p    Next-hop router, or NULL if the destination
+ *                              prefix is directly reachable through
+ *                              layer2_end_point_p
+ * @param layer2_end_point_p    Egress layer-2 end point, or NULL to use the
+ *                              local end point whose subnet contains the
+ *                              next-hop router
  *
- * NOTE: This function is to be invoked from net_layer3_end_point_init()
+ * @return 0, on success
+ * @return error code, on failure
  */
-void net_layer3_ipv4_end_point_init(struct ipv4_end_point *ipv4_end_point_p)
+error_t net_layer3_add_ipv4_route(const struct ipv4_address *dest_prefix_p,
+                                  uint8_t prefix_length,
+                                  const struct ipv4_address *next_hop_ip_addr_p,
+                                  struct net_layer2_end_point *layer2_end_point_p)
 {
-    net_packet_queue_init("ICMPv4 incoming packet queue",
-                          true,
-                          &ipv4_end_point_p->rx_icmpv4_packet_queue);
+    struct ipv4_route new_route;
+    struct net_layer3_ipv4 *const layer3_ipv4_p = &g_net_layer3.ipv4;
+    error_t error = 0;
+    unsigned int i;
 
-    /*
-     * Initialize IPv4 ARP cache for the layer-3 end point
-     */
-    arp_cache_init(&ipv4_end_point_p->arp_cache);
-}
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(g_net_layer3.initialized);
 
+    if (prefix_length > 32) {
+        return CAPTURE_ERROR("Invalid IPv4 route prefix length", prefix_length, 0);
+    }
+
+    if (next_hop_ip_addr_p == NULL && layer2_end_point_p == NULL) {
+        return CAPTURE_ERROR("IPv4 route without next hop nor egress end point",
+                             dest_prefix_p->value, prefix_length);
+    }
+
+    new_route.prefix_mask = ipv4_prefix_mask(prefix_length);
+    new_route.dest_prefix.value = dest_prefix_p->value & new_route.prefix_mask;
+    new_route.prefix_length = prefix_length;
+    new_route.next_hop_ip_addr.value =
+        (next_hop_ip_addr_p != NULL) ? next_hop_ip_addr_p->value : IPV4_NULL_ADDR;
+    new_route.layer2_end_point_p = layer2_end_point_p;
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&layer3_ipv4_p->routes_mutex);
+    layer3_ipv4_p->routes_sequence_count ++;
+    __DMB();
+
+    for (i = 0; i < layer3_ipv4_p->num_routes; i ++) {
+        struct ipv4_route *route_p = &layer3_ipv4_p->routes[i];
+
+        if (route_p->prefix_length == prefix_length &&
+            route_p->dest_prefix.value == new_route.dest_prefix.value) {
+            *route_p = new_route;
+            goto unlock;
+        }
+
+        if (route_p->prefix_length < prefix_length) {
+            break;
+        }
+    }
+
+    if (layer3_ipv4_p->num_routes == NET_IPV4_MAX_ROUTES) {
+        error = CAPTURE_ERROR("IPv4 route table full", dest_prefix_p->value,
+                              prefix_length);
+        goto unlock;
+    }
 
-/**
- * Start RTOS tasks for an IPv4 layer-3 end point
- *
- * @param ipv4_end_point_p    Pointer to IPv4 end point
- *
- * NOTE: This function is to be invoked from net_layer3_end_point_start_tasks()
- */
-void net_layer3_ipv4_end_point_start_tasks(struct ipv4_end_point *ipv4_end_point_p)
-{
     /*
-     * Create ICMPv4 packet receiver task:
+     * Insert the new route at position i, to keep routes[] sorted by
+     * decreasing prefix length:
      */
-    rtos_task_create(&ipv4_end_point_p->icmpv4_packet_receiver_task,
-                     "ICMPv4 packet receiver task",
-                     icmpv4_packet_receiver_task,
-                     ipv4_end_point_p,
-                     HIGHEST_APP_TASK_PRIORITY + 2);
+    memmove(&layer3_ipv4_p->routes[i + 1], &layer3_ipv4_p->routes[i],
+            (layer3_ipv4_p->num_routes - i) * sizeof(struct ipv4_route));
+    layer3_ipv4_p->routes[i] = new_route;
+    layer3_ipv4_p->num_routes ++;
+
+unlock:
+    __DMB();
+    layer3_ipv4_p->routes_sequence_count ++;
+    rtos_mutex_unlock(&layer3_ipv4_p->routes_mutex);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
 
-    /*
-     * Create DHCPv4 client task:
-     */
-    rtos_task_create(&ipv4_end_point_p->dhcpv4_client_task,
-                     "DHCPv4 client task",
-                     dhcpv4_client_task,
-                     ipv4_end_point_p,
-                     HIGHEST_APP_TASK_PRIORITY + 2);
+    return error;
 }
 
 
-void net_layer3_receive_ipv4_packet(struct network_packet *rx_packet_p)
+/**
+ * Removes a static IPv4 route
+ *
+ * @param dest_prefix_p         Destination prefix
+ * @param prefix_length         Number of bits of the destination prefix
+ *
+ * @return 0, on success
+ * @return error code, if the route does not exist
+ */
+error_t net_layer3_remove_ipv4_route(const struct ipv4_address *dest_prefix_p,
+                                     uint8_t prefix_length)
 {
+    struct net_layer3_ipv4 *const layer3_ipv4_p = &g_net_layer3.ipv4;
+    bool route_found = false;
+
     D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(g_net_layer3.initialized);
+
+    if (prefix_length > 32) {
+        return CAPTURE_ERROR("Invalid IPv4 route prefix length", prefix_length, 0);
+    }
+
+    uint32_t dest_prefix = dest_prefix_p->value & ipv4_prefix_mask(prefix_length);
 
 #   ifdef USE_MPU
     struct mpu_region_range old_comp_region;
@@ -1262,78 +4287,39 @@ void net_layer3_receive_ipv4_packet(struct network_packet *rx_packet_p)
                                 sizeof g_net_layer3,
                                 0,
                                 &old_comp_region);
-
-    rtos_thread_set_tmp_region(rx_packet_p, sizeof *rx_packet_p, 0);
 #   endif
 
-    D_ASSERT(rx_packet_p->total_length >=
-             sizeof(struct ethernet_header) + sizeof(struct ipv4_header));
-
-    struct net_layer2_end_point *const layer2_end_point_p =
-        rx_packet_p->layer2_end_point_p;
-    struct net_layer3_end_point *const layer3_end_point_p =
-        layer2_end_point_p->layer3_end_point_p;
-
-    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
-    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
-    D_ASSERT(layer3_end_point_p->layer2_end_point_p == layer2_end_point_p);
-
-    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
-
-    if (g_net_layer3.tracing_on) {
-        DEBUG_PRINTF("Net layer3: IPv4 packet received:\n"
-                     "\tsource IPv4 address %u.%u.%u.%u\n"
-                     "\tdestination IPv4 address %u.%u.%u.%u\n"
-                     "\tPacket type %#x, Total length: %u\n",
-                     ipv4_header_p->source_ip_addr.bytes[0],
-                     ipv4_header_p->source_ip_addr.bytes[1],
-                     ipv4_header_p->source_ip_addr.bytes[2],
-                     ipv4_header_p->source_ip_addr.bytes[3],
-                     ipv4_header_p->dest_ip_addr.bytes[0],
-                     ipv4_header_p->dest_ip_addr.bytes[1],
-                     ipv4_header_p->dest_ip_addr.bytes[2],
-                     ipv4_header_p->dest_ip_addr.bytes[3],
-                     ipv4_header_p->protocol_type,
-                     ntoh16(ipv4_header_p->total_length));
-    }
-
-    bool packet_dropped = false;
-
-    switch (ipv4_header_p->protocol_type) {
-    case IP_PACKET_TYPE_ICMP:
-        rx_packet_p->state_flags |= NET_PACKET_IN_ICMP_QUEUE;
-        net_packet_queue_add(&layer3_end_point_p->ipv4.rx_icmpv4_packet_queue,
-                             rx_packet_p);
-        break;
-
-    case IP_PACKET_TYPE_UDP:
-        net_layer4_process_incoming_udp_datagram(rx_packet_p);
-        break;
-
-#if 0
-    case IP_PACKET_TYPE_TCP:
-        net_layer4_process_incoming_tcp_segment(rx_packet_p);
-        break;
-#endif
+    rtos_mutex_lock(&layer3_ipv4_p->routes_mutex);
+    layer3_ipv4_p->routes_sequence_count ++;
+    __DMB();
 
-    default:
-        ERROR_PRINTF("Received IPv4 packet with unsupported protocol type: %#x\n",
-                     ipv4_header_p->protocol_type);
+    for (unsigned int i = 0; i < layer3_ipv4_p->num_routes; i ++) {
+        struct ipv4_route *route_p = &layer3_ipv4_p->routes[i];
 
-        net_recycle_rx_packet(rx_packet_p);
-        packet_dropped = true;
+        if (route_p->prefix_length == prefix_length &&
+            route_p->dest_prefix.value == dest_prefix) {
+            layer3_ipv4_p->num_routes --;
+            memmove(route_p, route_p + 1,
+                    (layer3_ipv4_p->num_routes - i) * sizeof(struct ipv4_route));
+            route_found = true;
+            break;
+        }
     }
 
-    if (packet_dropped) {
-        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.rx_packets_dropped_count);
-    } else {
-		ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv4.rx_packets_accepted_count);
-    }
+    __DMB();
+    layer3_ipv4_p->routes_sequence_count ++;
+    rtos_mutex_unlock(&layer3_ipv4_p->routes_mutex);
 
 #   ifdef USE_MPU
-    rtos_thread_unset_tmp_region();
     rtos_thread_restore_comp_region(&old_comp_region);
 #   endif
+
+    if (!route_found) {
+        return CAPTURE_ERROR("IPv4 route not found", dest_prefix_p->value,
+                             prefix_length);
+    }
+
+    return 0;
 }
 
 
@@ -1396,7 +4382,8 @@ void net_layer3_set_local_ipv4_address(const struct ipv4_address *ip_addr_p,
      */
     net_send_arp_request(layer2_end_point_p,
                          &layer3_end_point_p->ipv4.local_ip_addr,
-                         &layer3_end_point_p->ipv4.local_ip_addr);
+                         &layer3_end_point_p->ipv4.local_ip_addr,
+                         NULL);
 
 #   ifdef USE_MPU
     rtos_thread_unset_tmp_region();
@@ -1496,6 +4483,31 @@ bool net_layer3_parse_ipv4_addr(const char *ipv4_addr_string,
 }
 
 
+/**
+ * Builds and sends an ICMPv4 echo request
+ */
+static error_t net_send_ipv4_echo_request(const struct ipv4_address *dest_ip_addr_p,
+                                          uint16_t identifier,
+                                          uint16_t seq_num)
+{
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(ICMPV4_ECHO_FRAME_LENGTH, true);
+
+    D_ASSERT(tx_packet_p != NULL);
+    struct icmpv4_echo_message *echo_msg_p =
+        (struct icmpv4_echo_message *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+
+    echo_msg_p->identifier = identifier;
+    echo_msg_p->seq_num = seq_num;
+    return net_layer3_send_ipv4_icmp_message(dest_ip_addr_p,
+                                             tx_packet_p,
+                                             ICMP_TYPE_PING_REQUEST,
+                                             ICMP_CODE_PING_REQUEST,
+                                             sizeof(struct icmpv4_echo_message) -
+                                                 sizeof(struct icmpv4_header));
+}
+
+
 error_t net_layer3_send_ipv4_ping_request(
     const struct ipv4_address *dest_ip_addr_p,
     uint16_t identifier,
@@ -1515,7 +4527,8 @@ error_t net_layer3_send_ipv4_ping_request(
 #   endif
 
     rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
-    while (g_net_layer3.ipv4.expecting_ping_reply) {
+    while (g_net_layer3.ipv4.expecting_ping_reply ||
+           g_net_layer3.ipv4.ping_flood_on) {
         rtos_mutex_unlock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
         rtos_semaphore_wait(&g_net_layer3.ipv4.ping_reply_received_semaphore);
         rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
@@ -1524,20 +4537,7 @@ error_t net_layer3_send_ipv4_ping_request(
     g_net_layer3.ipv4.expecting_ping_reply = true;
     rtos_mutex_unlock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
 
-    struct network_packet *tx_packet_p = net_layer2_allocate_tx_packet(true);
-
-    D_ASSERT(tx_packet_p != NULL);
-    struct icmpv4_echo_message *echo_msg_p =
-        (struct icmpv4_echo_message *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
-
-    echo_msg_p->identifier = identifier;
-    echo_msg_p->seq_num = seq_num;
-    error = net_layer3_send_ipv4_icmp_message(dest_ip_addr_p,
-                                              tx_packet_p,
-                                              ICMP_TYPE_PING_REQUEST,
-                                              ICMP_CODE_PING_REQUEST,
-                                              sizeof(struct icmpv4_echo_message) -
-                                                  sizeof(struct icmpv4_header));
+    error = net_send_ipv4_echo_request(dest_ip_addr_p, identifier, seq_num);
     if (error != 0) {
         rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
         g_net_layer3.ipv4.expecting_ping_reply = false;
@@ -1553,13 +4553,46 @@ error_t net_layer3_send_ipv4_ping_request(
 }
 
 
+/**
+ * Dequeues a received IPv4 ping reply
+ *
+ * @return true, if a reply was received before the timeout expired
+ * @return false, otherwise
+ */
+static bool net_dequeue_ipv4_ping_reply(uint32_t timeout_ms,
+                                        struct ipv4_address *remote_ip_addr_p,
+                                        uint16_t *identifier_p,
+                                        uint16_t *seq_num_p)
+{
+    struct network_packet *rx_packet_p = net_packet_queue_remove(
+        &g_net_layer3.ipv4.rx_ipv4_ping_reply_packet_queue, timeout_ms);
+
+    if (rx_packet_p == NULL) {
+        return false;
+    }
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+
+    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    struct icmpv4_header *icmpv4_header_p = GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+    struct icmpv4_echo_message *echo_msg_p =
+        (struct icmpv4_echo_message *)(icmpv4_header_p);
+
+    remote_ip_addr_p->value = ipv4_header_p->source_ip_addr.value;
+    *identifier_p = echo_msg_p->identifier;
+    *seq_num_p = echo_msg_p->seq_num;
+    net_recycle_rx_packet(rx_packet_p);
+    return true;
+}
+
+
 error_t net_layer3_receive_ipv4_ping_reply(
     uint32_t timeout_ms,
     struct ipv4_address *remote_ip_addr_p,
     uint16_t *identifier_p,
     uint16_t *seq_num_p)
 {
-    error_t error;
+    error_t error = 0;
 
 #   ifdef USE_MPU
     struct mpu_region_range old_comp_region;
@@ -1570,29 +4603,168 @@ error_t net_layer3_receive_ipv4_ping_reply(
                                 &old_comp_region);
 #   endif
 
-    struct network_packet *rx_packet_p = net_packet_queue_remove(
-        &g_net_layer3.ipv4.rx_ipv4_ping_reply_packet_queue, timeout_ms);
-
-    if (rx_packet_p == NULL) {
+    if (!net_dequeue_ipv4_ping_reply(timeout_ms, remote_ip_addr_p,
+                                     identifier_p, seq_num_p)) {
         error = CAPTURE_ERROR("No Rx packet available", timeout_ms, 0);
-        goto exit;
     }
 
-    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
 
-    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
-    struct icmpv4_header *icmpv4_header_p = GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
-    struct icmpv4_echo_message *echo_msg_p =
-        (struct icmpv4_echo_message *)(icmpv4_header_p);
+    return error;
+}
 
-    remote_ip_addr_p->value = ipv4_header_p->source_ip_addr.value;
-    *identifier_p = echo_msg_p->identifier;
-    *seq_num_p = echo_msg_p->seq_num;
-    net_recycle_rx_packet(rx_packet_p);
-    error = 0;
 
-exit:
+/**
+ * Starts a ping flood, in which the caller can have multiple IPv4 ping
+ * requests outstanding. It waits for any outstanding single ping (and any
+ * other ping flood) to complete first. While the ping flood is on, every
+ * ping reply received is returned by
+ * net_layer3_receive_ipv4_ping_flood_reply(), and the caller is responsible
+ * for matching replies to requests.
+ */
+void net_layer3_start_ipv4_ping_flood(void)
+{
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+    while (g_net_layer3.ipv4.expecting_ping_reply ||
+           g_net_layer3.ipv4.ping_flood_on) {
+        rtos_mutex_unlock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+        rtos_semaphore_wait(&g_net_layer3.ipv4.ping_reply_received_semaphore);
+        rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+    }
+
+    g_net_layer3.ipv4.ping_flood_on = true;
+    rtos_mutex_unlock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Ends a ping flood. Replies that were not received by the caller are
+ * discarded.
+ */
+void net_layer3_stop_ipv4_ping_flood(void)
+{
+    struct network_packet *rx_packet_p;
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+    D_ASSERT(g_net_layer3.ipv4.ping_flood_on);
+    g_net_layer3.ipv4.ping_flood_on = false;
+    rtos_mutex_unlock(&g_net_layer3.ipv4.expecting_ping_reply_mutex);
+
+    while ((rx_packet_p = net_packet_queue_remove(
+                &g_net_layer3.ipv4.rx_ipv4_ping_reply_packet_queue, 1)) != NULL) {
+        net_recycle_rx_packet(rx_packet_p);
+    }
+
+    /*
+     * Wake up a single ping that may be waiting for the ping flood to end:
+     */
+    rtos_semaphore_signal(&g_net_layer3.ipv4.ping_reply_received_semaphore);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Receives an IPv4 ping reply during a ping flood. Unlike
+ * net_layer3_receive_ipv4_ping_reply(), a timeout is not treated as an
+ * error, as the caller typically waits for replies only until it is time to
+ * send its next request.
+ *
+ * @param timeout_ms    timeout in milliseconds (must not be 0)
+ *
+ * @return true, if a reply was received before the timeout expired
+ * @return false, otherwise
+ *
+ * @pre net_layer3_start_ipv4_ping_flood() has been called
+ */
+bool net_layer3_receive_ipv4_ping_flood_reply(
+    uint32_t timeout_ms,
+    struct ipv4_address *remote_ip_addr_p,
+    uint16_t *identifier_p,
+    uint16_t *seq_num_p)
+{
+    bool received;
+
+    D_ASSERT(g_net_layer3.ipv4.ping_flood_on);
+    D_ASSERT(timeout_ms != 0);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    received = net_dequeue_ipv4_ping_reply(timeout_ms, remote_ip_addr_p,
+                                           identifier_p, seq_num_p);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return received;
+}
+
+
+/**
+ * Sends an IPv4 ping request of a ping flood. Unlike
+ * net_layer3_send_ipv4_ping_request(), it does not wait for the reply to
+ * the previous request.
+ *
+ * @pre net_layer3_start_ipv4_ping_flood() has been called
+ */
+error_t net_layer3_send_ipv4_ping_flood_request(
+    const struct ipv4_address *dest_ip_addr_p,
+    uint16_t identifier,
+    uint16_t seq_num)
+{
+    error_t error;
+
+    D_ASSERT(g_net_layer3.ipv4.ping_flood_on);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(dest_ip_addr_p, sizeof *dest_ip_addr_p, 0);
+#   endif
+
+    error = net_send_ipv4_echo_request(dest_ip_addr_p, identifier, seq_num);
+
 #   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
     rtos_thread_restore_comp_region(&old_comp_region);
 #   endif
 
@@ -15,6 +15,7 @@
 #include "io_utils.h"
 #include "compile_time_checks.h"
 #include "network_packet.h"
+#include "net_config.h"
 #include "net_layer4_end_point.h"
 
 /**
@@ -28,15 +29,67 @@
 #define IPV4_BROADCAST_ADDR UINT32_C(0xffffffff)
 
 /*
- * Mask for first octet of an IPv4 multicast address
+ * Mask and value of the first octet of an IPv4 multicast address
  * (224.0.0.0 to 239.255.255.255)
  */
-#define IPV4_MULTICAST_ADDRESS_MASK UINT8_C(0xe0)
+#define IPV4_MULTICAST_ADDRESS_MASK   UINT8_C(0xf0)
+#define IPV4_MULTICAST_ADDRESS_PREFIX UINT8_C(0xe0)
+
+/**
+ * Number of source IPv4 addresses tracked by the ICMPv4 rate limiter of a
+ * local IPv4 end point
+ */
+#define ICMPV4_RATE_LIMITER_NUM_SOURCES     4
+
+/**
+ * Maximum number of tokens of an ICMPv4 rate limiter bucket (maximum burst
+ * of ICMPv4 messages accepted from the same source address)
+ */
+#define ICMPV4_RATE_LIMITER_BUCKET_SIZE     8
+
+/**
+ * Interval in milliseconds at which a token is added to an ICMPv4 rate
+ * limiter bucket (sustained rate of 10 ICMPv4 messages per second per
+ * source address)
+ */
+#define ICMPV4_RATE_LIMITER_TOKEN_INTERVAL_IN_MS    100
+
+/**
+ * Maximum number of received ICMPv4 and IGMP packets waiting to be processed
+ * by the ICMPv4 packet receiver task of a local IPv4 end point. It bounds the
+ * number of Rx packets held by ICMPv4, regardless of the number of sources.
+ */
+#define ICMPV4_RX_PACKET_QUEUE_MAX_LENGTH   4
+
+/**
+ * Maximum number of IPv4 multicast groups that a local IPv4 end point can
+ * join (not counting the all-systems group 224.0.0.1)
+ */
+#define NET_IPV4_MAX_MULTICAST_GROUPS   8
+
+/**
+ * Number of hash buckets of the IPv4 ARP cache table (must be a power of 2)
+ */
+#define ARP_CACHE_NUM_BUCKETS    NET_CONFIG_ARP_CACHE_NUM_BUCKETS
+
+C_ASSERT(IS_POWER_OF_2(ARP_CACHE_NUM_BUCKETS));
+
+/**
+ * Number of entries per hash bucket of the IPv4 ARP cache table
+ */
+#define ARP_CACHE_BUCKET_NUM_ENTRIES    2
 
 /**
  * Number of entries for the IPv4 ARP cache table
  */
-#define ARP_CACHE_NUM_ENTRIES    16
+#define ARP_CACHE_NUM_ENTRIES    (ARP_CACHE_NUM_BUCKETS * ARP_CACHE_BUCKET_NUM_ENTRIES)
+
+/**
+ * Maximum number of times that a lock-free ARP cache lookup is retried,
+ * because the bucket was concurrently updated, before falling back to
+ * a lookup with the bucket's mutex held
+ */
+#define ARP_CACHE_LOCK_FREE_LOOKUP_MAX_RETRIES  4
 
 /**
  * ARP cache entry lifetime in ticks (20 minutes)
@@ -45,10 +98,19 @@
     MILLISECONDS_TO_TICKS(20u * 60 * 1000)
 
 /**
- * Timeout in milliseconds to wait for an ARP reply after sending a
- * non-gratuitous ARP request (3 minutes)
+ * Age in ticks after which an ARP cache entry that is being used is refreshed
+ * with a unicast ARP request, while its current mapping is still used (the
+ * last minute of its lifetime)
+ */
+#define ARP_CACHE_ENTRY_REFRESH_AGE_IN_TICKS \
+    (ARP_CACHE_ENTRY_LIFETIME_IN_TICKS - MILLISECONDS_TO_TICKS(60u * 1000))
+
+/**
+ * Minimum time in milliseconds to wait for an ARP reply after sending a
+ * non-gratuitous ARP request, before sending another ARP request for the
+ * same destination IP address
  */
-#define ARP_REPLY_WAIT_TIMEOUT_IN_MS    (3u * 60 * 1000)
+#define ARP_REQUEST_RESEND_INTERVAL_IN_MS    1000
 
 /**
  * Maximum number of ARP requests to be sent for a given destination
@@ -56,6 +118,13 @@
  */
 #define ARP_REQUEST_MAX_RETRIES    64
 
+/**
+ * Maximum number of Tx packets that can be queued in an ARP cache entry,
+ * waiting for the entry to be resolved. When the queue is full, the oldest
+ * packet is dropped.
+ */
+#define ARP_PENDING_TX_QUEUE_MAX_PACKETS    4
+
 /**
  * Maximum data payload size of an IPv4 packet
  */
@@ -63,6 +132,75 @@
         (NET_PACKET_DATA_BUFFER_SIZE - \
          (sizeof(struct ethernet_header) + sizeof(struct ipv4_header)))
 
+/**
+ * Maximum number of IPv4 packets that can be sent in one call to
+ * net_layer3_send_ipv4_packets()
+ */
+#define NET_IPV4_MAX_TX_BATCH_PACKETS   8
+
+C_ASSERT(NET_IPV4_MAX_TX_BATCH_PACKETS <= NET_MAX_TX_PACKETS);
+
+/**
+ * Maximum data payload size of an IPv4 fragment sent over Ethernet
+ * (fragment offsets are in units of 8 bytes)
+ */
+#define NET_IPV4_FRAGMENT_MAX_PAYLOAD_SIZE \
+        ((ETHERNET_MAX_FRAME_DATA_SIZE - sizeof(struct ipv4_header)) & ~UINT32_C(0x7))
+
+/**
+ * Maximum IPv4 packet size (IPv4 header + IPv4 payload)
+ */
+#define NET_IPV4_MAX_PACKET_SIZE    UINT16_MAX
+
+/**
+ * Maximum size of an IPv4 packet (IPv4 header + IPv4 payload) that can be
+ * reassembled from received fragments. Together with
+ * NET_IPV4_NUM_REASSEMBLY_BUFFERS, it determines the memory budget for
+ * IPv4 reassembly.
+ */
+#ifndef NET_IPV4_REASSEMBLY_MAX_PACKET_SIZE
+#define NET_IPV4_REASSEMBLY_MAX_PACKET_SIZE     4096
+#endif
+
+C_ASSERT(NET_IPV4_REASSEMBLY_MAX_PACKET_SIZE >
+            ETHERNET_MAX_FRAME_DATA_SIZE &&
+         NET_IPV4_REASSEMBLY_MAX_PACKET_SIZE <= NET_IPV4_MAX_PACKET_SIZE);
+
+/**
+ * Number of IPv4 packets that can be reassembled at the same time
+ */
+#ifndef NET_IPV4_NUM_REASSEMBLY_BUFFERS
+#define NET_IPV4_NUM_REASSEMBLY_BUFFERS         2
+#endif
+
+/**
+ * Maximum payload size of a reassembled IPv4 packet
+ */
+#define NET_IPV4_REASSEMBLY_MAX_PAYLOAD_SIZE \
+        (NET_IPV4_REASSEMBLY_MAX_PACKET_SIZE - sizeof(struct ipv4_header))
+
+/**
+ * Size of the data buffer of an IPv4 reassembly buffer
+ */
+#define NET_IPV4_REASSEMBLY_DATA_BUFFER_SIZE \
+        ROUND_UP(sizeof(struct ethernet_header) +                       \
+                 NET_IPV4_REASSEMBLY_MAX_PACKET_SIZE,                   \
+                 NET_PACKET_DATA_BUFFER_ALIGNMENT)
+
+C_ASSERT(NET_IPV4_REASSEMBLY_DATA_BUFFER_SIZE <= UINT16_MAX);
+
+/**
+ * Number of 8-byte blocks of the payload of a reassembled IPv4 packet
+ */
+#define NET_IPV4_REASSEMBLY_MAX_PAYLOAD_BLOCKS \
+        HOW_MANY(NET_IPV4_REASSEMBLY_MAX_PAYLOAD_SIZE, 8)
+
+/**
+ * Time in milliseconds after which an incomplete IPv4 packet reassembly is
+ * abandoned, and its reassembly buffer is reused
+ */
+#define NET_IPV4_REASSEMBLY_TIMEOUT_IN_MS   (5u * 1000)
+
 /**
  * Copies an IPv4 address, where the source or destination are not 4-byte
  * aligned, but they must be at least 2-byte aligned.
@@ -132,7 +270,18 @@
  */
 #define IPV4_ADDR_IS_MULTICAST(_ipv4_addr_p) \
         (((_ipv4_addr_p)->bytes[0] & IPV4_MULTICAST_ADDRESS_MASK) == \
-         IPV4_MULTICAST_ADDRESS_MASK)
+         IPV4_MULTICAST_ADDRESS_PREFIX)
+
+/**
+ * First octet of IPv4 loopback addresses (127.0.0.0/8)
+ */
+#define IPV4_LOOPBACK_ADDRESS_FIRST_BYTE UINT8_C(127)
+
+/**
+ * Tell if a given IPv4 address is a loopback address
+ */
+#define IPV4_ADDR_IS_LOOPBACK(_ipv4_addr_p) \
+        ((_ipv4_addr_p)->bytes[0] == IPV4_LOOPBACK_ADDRESS_FIRST_BYTE)
 
 /**
  * IPv4 address in network byte order
@@ -219,6 +368,7 @@ struct ipv4_header {
      */
     uint8_t protocol_type;
 #	define IP_PACKET_TYPE_ICMP       UINT8_C(0x1)
+#	define IP_PACKET_TYPE_IGMP       UINT8_C(0x2)
 #	define IP_PACKET_TYPE_TCP        UINT8_C(0x6)
 #	define IP_PACKET_TYPE_UDP        UINT8_C(0x11)
 #	define IP_PACKET_TYPE_ICMPV6     UINT8_C(0x3a)
@@ -343,6 +493,77 @@ struct icmpv4_echo_message {
 C_ASSERT(offsetof(struct icmpv4_echo_message, identifier) ==
          sizeof(struct icmpv4_header));
 
+/**
+ * IGMP message layout: IGMPv1/v2 messages and fixed part of IGMPv3
+ * membership queries
+ * (An IGMP message is encapsulated in an IPv4 packet)
+ */
+struct igmp_message {
+    /**
+     * Message type
+     */
+    uint8_t msg_type;
+#   define IGMP_TYPE_MEMBERSHIP_QUERY       0x11
+#   define IGMP_TYPE_V1_MEMBERSHIP_REPORT   0x12
+#   define IGMP_TYPE_V2_MEMBERSHIP_REPORT   0x16
+#   define IGMP_TYPE_V2_LEAVE_GROUP         0x17
+#   define IGMP_TYPE_V3_MEMBERSHIP_REPORT   0x22
+
+    /**
+     * Maximum response time in tenths of a second (membership queries only)
+     */
+    uint8_t max_resp_code;
+
+    /**
+     * Message checksum (computed by software, as the Ethernet MAC only
+     * handles TCP, UDP and ICMP checksums)
+     */
+    uint16_t msg_checksum;
+
+    /**
+     * Multicast group address (0.0.0.0 for general membership queries)
+     */
+    struct ipv4_address group_addr;
+};
+
+C_ASSERT(sizeof(struct igmp_message) == 8);
+
+/**
+ * Minimum length of an IGMPv3 membership query. Shorter membership queries
+ * come from IGMPv1/v2 queriers.
+ */
+#define IGMPV3_MEMBERSHIP_QUERY_MIN_LENGTH  12
+
+/**
+ * Group record of an IGMPv3 membership report (with no source addresses)
+ */
+struct igmpv3_group_record {
+    uint8_t record_type;
+#   define IGMPV3_MODE_IS_EXCLUDE           2
+#   define IGMPV3_CHANGE_TO_INCLUDE_MODE    3
+#   define IGMPV3_CHANGE_TO_EXCLUDE_MODE    4
+
+    uint8_t aux_data_length;
+    uint16_t num_sources;
+    struct ipv4_address group_addr;
+};
+
+C_ASSERT(sizeof(struct igmpv3_group_record) == 8);
+
+/**
+ * IGMPv3 membership report layout
+ */
+struct igmpv3_membership_report {
+    uint8_t msg_type;
+    uint8_t reserved1;
+    uint16_t msg_checksum;
+    uint16_t reserved2;
+    uint16_t num_group_records;
+    struct igmpv3_group_record group_records[];
+};
+
+C_ASSERT(sizeof(struct igmpv3_membership_report) == 8);
+
 /**
  * IPv4 DHCP message layout
  */
@@ -364,6 +585,63 @@ struct dhcp_message {
     uint8_t options[];
 };
 
+/**
+ * Maximum number of static IPv4 routes
+ */
+#define NET_IPV4_MAX_ROUTES    8
+
+/**
+ * Static IPv4 route
+ */
+struct ipv4_route {
+    /**
+     * Destination prefix (host bits are 0)
+     */
+    struct ipv4_address dest_prefix;
+
+    /**
+     * Mask for the prefix length in network byte order
+     */
+    uint32_t prefix_mask;
+
+    /**
+     * Number of bits of the destination prefix
+     */
+    uint8_t prefix_length;
+
+    /**
+     * Next-hop router, or 0.0.0.0 if the destination prefix is directly
+     * reachable through layer2_end_point_p
+     */
+    struct ipv4_address next_hop_ip_addr;
+
+    /**
+     * Egress layer-2 end point, or NULL for the local end point whose subnet
+     * contains the next-hop router
+     */
+    struct net_layer2_end_point *layer2_end_point_p;
+};
+
+/**
+ * DHCP lease of a local IPv4 end point, cached in NOR flash so that after a
+ * reset the DHCP client can request the same IPv4 address again
+ * (INIT-REBOOT), instead of starting over with a DHCPDISCOVER
+ */
+struct dhcp_cached_lease {
+#   define DHCP_CACHED_LEASE_SIGNATURE  GEN_SIGNATURE('D', 'H', 'C', 'P')
+    uint32_t signature;
+
+    struct ipv4_address local_ip_addr;
+    uint32_t subnet_mask;
+    struct ipv4_address default_gateway_ip_addr;
+    struct ipv4_address server_ip_addr;
+
+    /**
+     * Lease time in seconds
+     */
+    uint32_t lease_time;
+};
+
 /**
  * States of an ARP cache entry
  */
@@ -373,6 +651,22 @@ enum arp_cache_entry_states {
     ARP_ENTRY_FILLED,
 };
 
+/**
+ * IPv4 packet waiting for the resolution of its next-hop MAC address
+ */
+struct arp_pending_tx_packet {
+    /**
+     * Tx packet, owned by the networking stack (it has
+     * NET_PACKET_FREE_AFTER_TX_COMPLETE set)
+     */
+    struct network_packet *tx_packet_p;
+
+    /**
+     * Length of the IPv4 packet (IPv4 header + IPv4 payload)
+     */
+    uint16_t ipv4_packet_length;
+};
+
 /**
  * IPv4 ARP cache entry
  */
@@ -384,7 +678,8 @@ struct arp_cache_entry {
     /**
      * Timestamp in ticks when the last ARP request for this entry was sent.
      * It is used to determine if we have waited too long for the ARP reply,
-     * and need to send another ARP request.
+     * and need to send another ARP request. For a filled entry, it is used
+     * to rate-limit refresh ARP requests.
      */
     uint32_t arp_request_time_stamp;
 
@@ -401,26 +696,231 @@ struct arp_cache_entry {
      * replacement.
      */
     uint32_t last_lookup_time_stamp;
+
+    /**
+     * Number of ARP requests sent for the current resolution of this entry
+     */
+    uint8_t arp_request_count;
+
+    /**
+     * Number of entries used in pending_tx_packets[]. Only meaningful in
+     * state ARP_ENTRY_HALF_FILLED.
+     */
+    uint8_t num_pending_tx_packets;
+
+    /**
+     * Tx packets waiting for this entry to be resolved, in FIFO order. They
+     * are transmitted when the ARP reply is received.
+     */
+    struct arp_pending_tx_packet pending_tx_packets[ARP_PENDING_TX_QUEUE_MAX_PACKETS];
 };
 
+C_ASSERT(ARP_PENDING_TX_QUEUE_MAX_PACKETS <= UINT8_MAX);
+C_ASSERT(ARP_REQUEST_MAX_RETRIES <= UINT8_MAX);
+
 /**
- * IPv4 ARP cache
+ * IPv4 ARP cache hash bucket
  */
-struct arp_cache {
+struct arp_cache_bucket {
     /**
-     * Mutex to serialize access to the ARP cache
+     * Mutex to serialize updates to the bucket's entries, including their
+     * pending Tx packet queues. Each bucket has its own mutex, so that
+     * resolutions and ARP replies for IPv4 addresses that hash to
+     * different buckets neither serialize nor wait for each other.
      */
     struct rtos_mutex mutex;
 
     /**
-     * Semaphore signaled when the ARP cache is updated
+     * Sequence count for lock-free readers (seqlock). It is odd while an
+     * updater (holding the bucket's mutex) is modifying the bucket's
+     * entries. A reader retries if the count was odd, or changed, while it
+     * read the entries.
+     */
+    volatile uint32_t sequence_count;
+
+    /**
+     * Entries of the bucket
      */
-    struct rtos_semaphore cache_updated_semaphore;
+    struct arp_cache_entry entries[ARP_CACHE_BUCKET_NUM_ENTRIES];
+};
 
+/**
+ * IPv4 ARP cache, as a hash table keyed by IPv4 address. ARP cache hits are
+ * served without taking any mutex.
+ */
+struct arp_cache {
     /**
-     * Array of cache entries
+     * Hash buckets
      */
-    struct arp_cache_entry entries[ARP_CACHE_NUM_ENTRIES];
+    struct arp_cache_bucket buckets[ARP_CACHE_NUM_BUCKETS];
+};
+
+/**
+ * States of an IPv4 reassembly buffer
+ */
+enum net_ipv4_reassembly_buffer_states {
+    NET_IPV4_REASSEMBLY_BUFFER_FREE = 0,
+    NET_IPV4_REASSEMBLY_BUFFER_REASSEMBLING,
+    NET_IPV4_REASSEMBLY_BUFFER_LENT_TO_RX_PACKET,
+};
+
+/**
+ * Buffer where an IPv4 packet is reassembled from received fragments.
+ * Once complete, the reassembled packet is delivered in the Rx packet of its
+ * last received fragment, by lending the buffer to that packet until it is
+ * recycled.
+ */
+struct net_ipv4_reassembly_buffer {
+    enum net_ipv4_reassembly_buffer_states state;
+
+    /**
+     * Fields that identify the fragments of the packet being reassembled
+     * (identification is in network byte order)
+     */
+    struct ipv4_address source_ip_addr;
+    struct ipv4_address dest_ip_addr;
+    uint16_t identification;
+    uint8_t protocol_type;
+
+    /**
+     * Payload length of the reassembled packet, known once the last
+     * fragment has been received (0 before)
+     */
+    uint16_t payload_length;
+
+    /**
+     * Number of distinct 8-byte payload blocks received so far
+     */
+    uint16_t received_blocks_count;
+
+    /**
+     * Timestamp in ticks when the first fragment was received
+     */
+    uint32_t start_time_stamp;
+
+    /**
+     * Rx packet to which this buffer is lent, and that packet's own data buffer
+     * to be restored when the packet is recycled. Only meaningful in state
+     * NET_IPV4_REASSEMBLY_BUFFER_LENT_TO_RX_PACKET.
+     */
+    struct network_packet *rx_packet_p;
+    uint8_t *rx_packet_data_buffer;
+    uint16_t rx_packet_data_buffer_size;
+    uint8_t rx_packet_headroom;
+
+    /**
+     * Bitmap of the 8-byte payload blocks received so far
+     */
+    uint32_t received_blocks_bitmap[HOW_MANY(NET_IPV4_REASSEMBLY_MAX_PAYLOAD_BLOCKS, 32)];
+
+    /**
+     * Reassembled Ethernet frame, laid out as a received frame (Ethernet
+     * header of the first fragment, followed by the IPv4 packet)
+     */
+    uint8_t data_buffer[NET_IPV4_REASSEMBLY_DATA_BUFFER_SIZE]
+        __attribute__ ((aligned(NET_PACKET_DATA_BUFFER_ALIGNMENT)));
+};
+
+/**
+ * Size in bytes of the header template of an IPv4 flow
+ */
+#define NET_IPV4_FLOW_HEADER_TEMPLATE_SIZE \
+        (sizeof(struct ethernet_header) + sizeof(struct ipv4_header))
+
+C_ASSERT(NET_IPV4_FLOW_HEADER_TEMPLATE_SIZE % sizeof(uint32_t) == 0);
+
+/**
+ * Maximum time in milliseconds that the header template of an IPv4 flow is
+ * used before being rebuilt. This bounds how long the flow takes to notice
+ * that the ARP cache entry of its next hop needs to be refreshed.
+ */
+#define NET_IPV4_FLOW_TEMPLATE_LIFETIME_IN_MS   1000
+
+/**
+ * "Connected" IPv4 flow to a fixed destination. It caches a prebuilt
+ * Ethernet + IPv4 header template, including the resolved next-hop MAC
+ * address, so that each send only needs to copy the template and patch the
+ * IPv4 total length and identification. The template is rebuilt when the
+ * ARP cache bucket of the next hop is updated, when the local IPv4 address
+ * changes, or when the template has been used for
+ * NET_IPV4_FLOW_TEMPLATE_LIFETIME_IN_MS.
+ */
+struct net_ipv4_flow {
+#   define NET_IPV4_FLOW_SIGNATURE  GEN_SIGNATURE('I', 'P', 'F', 'L')
+    uint32_t signature;
+
+    /**
+     * Destination IPv4 address
+     */
+    struct ipv4_address dest_ip_addr;
+
+    /**
+     * IPv4 protocol type
+     */
+    uint8_t ip_packet_type;
+
+    /**
+     * Flag indicating if header_template[] is valid
+     */
+    bool template_valid;
+
+    /**
+     * Local layer-3 end point used to send packets, when the template was
+     * built
+     */
+    struct net_layer3_end_point *layer3_end_point_p;
+
+    /**
+     * ARP cache bucket of the next hop, and its sequence count when the
+     * template was built. NULL for broadcast and multicast destinations.
+     */
+    struct arp_cache_bucket *arp_cache_bucket_p;
+    uint32_t arp_cache_bucket_sequence_count;
+
+    /**
+     * Timestamp in ticks when the template was built
+     */
+    uint32_t template_time_stamp;
+
+    /**
+     * Ethernet header + IPv4 header template
+     */
+    uint32_t header_template[NET_IPV4_FLOW_HEADER_TEMPLATE_SIZE / sizeof(uint32_t)];
+};
+
+/**
+ * Token bucket of the ICMPv4 rate limiter, for a given source IPv4 address
+ */
+struct icmpv4_rate_limiter_bucket {
+    /**
+     * Source IPv4 address
+     */
+    struct ipv4_address source_ip_addr;
+
+    /**
+     * Number of tokens available (ICMPv4 messages that can be accepted now)
+     */
+    uint16_t tokens;
+
+    /**
+     * Timestamp in ticks when tokens were last added to the bucket
+     */
+    uint32_t refill_time_stamp;
+};
+
+/**
+ * IPv4 multicast group joined by a local IPv4 end point
+ */
+struct ipv4_multicast_group {
+    /**
+     * Multicast group address (IPV4_NULL_ADDR if this entry is free)
+     */
+    struct ipv4_address group_addr;
+
+    /**
+     * Number of joins of the group not matched by a leave yet
+     */
+    uint16_t join_count;
 };
 
 /**
@@ -447,6 +947,16 @@ struct ipv4_end_point {
      */
     uint32_t dhcp_lease_time;
 
+    /**
+     * Time in seconds since boot when the current DHCP lease was granted
+     */
+    uint32_t dhcp_lease_start_time;
+
+    /**
+     * Address of the DHCP server that granted the current DHCP lease
+     */
+    struct ipv4_address dhcp_server_ip_addr;
+
     /**
      * Sequence number to use as the 'identification' field of the next
      * IP packet transmitted out of this network end-point
@@ -454,7 +964,7 @@ struct ipv4_end_point {
     uint16_t next_tx_ip_packet_seq_num;
 
     /**
-     * Queue of received ICMPv4 packets
+     * Queue of received ICMPv4 and IGMP packets
      */
     struct net_packet_queue rx_icmpv4_packet_queue;
 
@@ -477,6 +987,37 @@ struct ipv4_end_point {
      * DHCPv4 client task
      */
     struct rtos_task dhcpv4_client_task;
+
+    /**
+     * Multicast groups joined and reported with IGMP
+     */
+    struct ipv4_multicast_group multicast_groups[NET_IPV4_MAX_MULTICAST_GROUPS];
+
+    /**
+     * Number of entries in use in multicast_groups[]
+     */
+    uint8_t num_multicast_groups;
+
+    /**
+     * IGMP version (2 or 3) of the last membership query received. It selects
+     * the format of the membership reports sent.
+     */
+    uint8_t igmp_version;
+
+    /**
+     * Mutex to serialize access to the multicast group fields
+     */
+    struct rtos_mutex multicast_groups_mutex;
+
+    /**
+     * ICMPv4 rate limiter buckets, one per recent source IPv4 address
+     */
+    struct icmpv4_rate_limiter_bucket icmpv4_rate_limiter_buckets[ICMPV4_RATE_LIMITER_NUM_SOURCES];
+
+    /**
+     * Mutex to serialize access to icmpv4_rate_limiter_buckets[]
+     */
+    struct rtos_mutex icmpv4_rate_limiter_mutex;
 };
 
 
@@ -491,19 +1032,139 @@ struct net_layer3_ipv4 {
     volatile bool expecting_ping_reply;
 
     /**
-     * Number of received IPv4 packets accepted
+     * Flag indicating if a ping flood is running. While it is, all received
+     * IPv4 ping replies are queued, as multiple requests are outstanding,
+     * and single pings wait for it to end.
+     */
+    volatile bool ping_flood_on;
+
+    /**
+     * Numbers of received IPv4 packets accepted and dropped, and of IPv4
+     * packets sent
+     */
+    struct net_packet_counter_set packet_counters;
+
+    /**
+     * Number of received IPv4 packets dropped because the Ethernet MAC
+     * found a wrong IP header checksum or a wrong ICMP checksum
+     * (included in NET_PACKET_COUNTER_RX_DROPPED)
+     */
+    volatile uint32_t rx_packets_dropped_bad_checksum_count;
+
+    /**
+     * Number of received IPv4 packets dropped because their header was
+     * malformed (wrong version, IP options or inconsistent total length)
+     * (included in NET_PACKET_COUNTER_RX_DROPPED)
+     */
+    volatile uint32_t rx_packets_dropped_bad_header_count;
+
+    /**
+     * Number of received IPv4 packets dropped because their destination
+     * address was not one of ours. The Ethernet MAC runs in promiscuous
+     * mode, so these are mostly unicast packets for other hosts
+     * (included in NET_PACKET_COUNTER_RX_DROPPED)
+     */
+    volatile uint32_t rx_packets_dropped_not_for_us_count;
+
+    /**
+     * Number of IPv4 packets dropped while waiting for the resolution of their
+     * next-hop MAC address (pending queue overflow, ARP cache entry evicted or
+     * destination unreachable)
+     */
+    volatile uint32_t arp_pending_tx_packets_dropped_count;
+
+    /**
+     * Number of times the ARP cache was filled or refreshed from the source
+     * addresses of a received IPv4 packet, instead of from an ARP packet
+     */
+    volatile uint32_t arp_cache_learned_count;
+
+    /**
+     * Number of IPv4 fragments received
+     */
+    volatile uint32_t rx_fragments_count;
+
+    /**
+     * Number of IPv4 packets successfully reassembled from fragments
+     */
+    volatile uint32_t rx_reassembled_packets_count;
+
+    /**
+     * Number of received IPv4 fragments dropped, or discarded when their
+     * reassembly timed out
+     */
+    volatile uint32_t rx_fragments_dropped_count;
+
+    /**
+     * Number of IPv4 packets looped back to the local IPv4 receive path
+     */
+    volatile uint32_t looped_back_packets_count;
+
+    /**
+     * Number of IPv4 packets sent fragmented
+     */
+    volatile uint32_t sent_fragmented_packets_count;
+
+    /**
+     * Number of received ICMPv4 and IGMP packets dropped by the ICMPv4 rate
+     * limiter, or because too many were waiting to be processed
+     * (included in rx_packets_dropped_count)
+     */
+    volatile uint32_t rx_icmpv4_packets_rate_limited_count;
+
+    /**
+     * Number of ICMPv4 echo replies sent by reusing the data buffer of the
+     * echo request
+     */
+    volatile uint32_t sent_in_place_echo_replies_count;
+
+    /**
+     * Number of ICMPv4 echo requests not replied, because no Tx packet was
+     * available or the request was malformed
+     */
+    volatile uint32_t echo_requests_not_replied_count;
+
+    /**
+     * Number of IGMP membership queries received
+     */
+    volatile uint32_t rx_igmp_queries_count;
+
+    /**
+     * Number of IGMP membership reports and leave messages sent
+     */
+    volatile uint32_t sent_igmp_messages_count;
+
+    /**
+     * Mutex to serialize access to reassembly_buffers[]
+     */
+    struct rtos_mutex reassembly_mutex;
+
+    /**
+     * Static IPv4 routes, sorted by decreasing prefix length, so that the
+     * first matching entry is the longest prefix match
+     */
+    struct ipv4_route routes[NET_IPV4_MAX_ROUTES];
+
+    /**
+     * Number of entries in use in routes[]
+     */
+    uint8_t num_routes;
+
+    /**
+     * Sequence count for lock-free lookups of routes[]. It is odd while
+     * routes[] is being updated.
      */
-    volatile uint32_t rx_packets_accepted_count;
+    volatile uint32_t routes_sequence_count;
 
     /**
-     * Number of received IPv4 packets dropped
+     * Mutex to serialize updates of routes[]
      */
-    volatile uint32_t rx_packets_dropped_count;
+    struct rtos_mutex routes_mutex;
 
     /**
-     * Number of IPv4 packets sent
+     * IPv4 reassembly buffers
      */
-    volatile uint32_t sent_packets_count;
+    struct net_ipv4_reassembly_buffer reassembly_buffers[NET_IPV4_NUM_REASSEMBLY_BUFFERS];
 
     /**
      * Queue of received IPPv4 ping replies
@@ -511,7 +1172,7 @@ struct net_layer3_ipv4 {
     struct net_packet_queue rx_ipv4_ping_reply_packet_queue;
 
     /**
-     * Mutex to serialize access to expecting_ping_reply
+     * Mutex to serialize access to expecting_ping_reply and ping_flood_on
      */
     struct rtos_mutex expecting_ping_reply_mutex;
 
@@ -531,6 +1192,8 @@ void net_layer3_ipv4_end_point_start_tasks(struct ipv4_end_point *ipv4_end_point
 
 void net_layer3_receive_arp_packet(struct network_packet *rx_packet_p);
 
+void net_layer3_flush_arp_cache(struct net_layer3_end_point *layer3_end_point_p);
+
 void net_layer3_receive_ipv4_packet(struct network_packet *rx_packet_p);
 
 error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
@@ -538,13 +1201,56 @@ error_t net_layer3_send_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
                                     size_t data_payload_length,
                                     uint_fast8_t ip_packet_type);
 
+error_t net_layer3_send_ipv4_packets(const struct ipv4_address *dest_ip_addr_p,
+                                     struct network_packet *tx_packets[],
+                                     const size_t data_payload_lengths[],
+                                     uint_fast8_t num_packets,
+                                     uint_fast8_t ip_packet_type);
+
+error_t net_layer3_send_ipv4_packet_gather(const struct ipv4_address *dest_ip_addr_p,
+                                           struct network_packet *tx_packet_p,
+                                           size_t header_length,
+                                           const struct ethernet_tx_fragment fragments[],
+                                           uint_fast8_t num_fragments,
+                                           uint_fast8_t ip_packet_type);
+
+error_t net_layer3_send_large_ipv4_packet(const struct ipv4_address *dest_ip_addr_p,
+                                          uint_fast8_t ip_packet_type,
+                                          const void *header_p,
+                                          size_t header_length,
+                                          const void *data_p,
+                                          size_t data_length);
+
+void net_layer3_get_ipv4_source_address(const struct ipv4_address *dest_ip_addr_p,
+                                        struct ipv4_address *source_ip_addr_p);
+
+void net_layer3_ipv4_release_reassembly_buffer(struct network_packet *rx_packet_p);
+
+void net_layer3_ipv4_flow_init(struct net_ipv4_flow *flow_p,
+                               const struct ipv4_address *dest_ip_addr_p,
+                               uint_fast8_t ip_packet_type);
+
+error_t net_layer3_send_ipv4_flow_packet(struct net_ipv4_flow *flow_p,
+                                         struct network_packet *tx_packet_p,
+                                         size_t data_payload_length);
+
 error_t net_layer3_send_ipv4_icmp_message(const struct ipv4_address *dest_ip_addr_p,
                                           struct network_packet *tx_packet_p,
                                           uint8_t msg_type,
                                           uint8_t msg_code,
                                           size_t data_payload_length);
 
-void net_layer3_join_ipv4_multicast_group(const struct ipv4_address *multicast_addr_p);
+error_t net_layer3_join_ipv4_multicast_group(const struct ipv4_address *multicast_addr_p);
+
+void net_layer3_leave_ipv4_multicast_group(const struct ipv4_address *multicast_addr_p);
+
+error_t net_layer3_add_ipv4_route(const struct ipv4_address *dest_prefix_p,
+                                  uint8_t prefix_length,
+                                  const struct ipv4_address *next_hop_ip_addr_p,
+                                  struct net_layer2_end_point *layer2_end_point_p);
+
+error_t net_layer3_remove_ipv4_route(const struct ipv4_address *dest_prefix_p,
+                                     uint8_t prefix_length);
 
 void net_layer3_set_local_ipv4_address(const struct ipv4_address *ip_addr_p,
 			                           uint8_t subnet_prefix);
@@ -568,4 +1274,19 @@ error_t net_layer3_receive_ipv4_ping_reply(
     uint16_t *identifier_p,
     uint16_t *seq_num_p);
 
+void net_layer3_start_ipv4_ping_flood(void);
+
+void net_layer3_stop_ipv4_ping_flood(void);
+
+error_t net_layer3_send_ipv4_ping_flood_request(
+    const struct ipv4_address *dest_ip_addr_p,
+    uint16_t identifier,
+    uint16_t seq_num);
+
+bool net_layer3_receive_ipv4_ping_flood_reply(
+    uint32_t timeout_ms,
+    struct ipv4_address *remote_ip_addr_p,
+    uint16_t *identifier_p,
+    uint16_t *seq_num_p);
+
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER3_IPV4_H_ */
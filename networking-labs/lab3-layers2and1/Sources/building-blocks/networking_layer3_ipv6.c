@@ -0,0 +1,1883 @@
+/**
+ * @file networking_layer3_ipv6.c
+ *
+ * Networking layer 3 implementation: IPv6
+ *
+ * @author German Rivera
+ */
+#include "networking_layer3.h"
+#include "ethernet_mac.h"
+#include "networking_layer4.h"
+#include "runtime_log.h"
+#include "mem_utils.h"
+#include <string.h>
+
+/**
+ * Length of an Ethernet frame carrying an ICMPv6 neighbor solicitation or
+ * advertisement, with a link-layer address option
+ */
+#define ICMPV6_NDP_FRAME_LENGTH \
+        (sizeof(struct ethernet_header) + sizeof(struct ipv6_header) + \
+         sizeof(struct icmpv6_neighbor_solicitation) +                 \
+         sizeof(struct icmpv6_link_layer_addr_option))
+
+C_ASSERT(sizeof(struct icmpv6_neighbor_solicitation) ==
+         sizeof(struct icmpv6_neighbor_advertisement));
+
+/**
+ * Length of an Ethernet frame carrying an ICMPv6 echo message
+ */
+#define ICMPV6_ECHO_FRAME_LENGTH \
+        (sizeof(struct ethernet_header) + sizeof(struct ipv6_header) + \
+         sizeof(struct icmpv6_echo_message))
+
+/**
+ * Link-local all-nodes multicast address (ff02::1)
+ */
+static const struct ipv6_address g_ipv6_all_nodes_multicast_addr = {
+    .bytes = { 0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01 }
+};
+
+/**
+ * Unspecified IPv6 address (::)
+ */
+static const struct ipv6_address g_ipv6_unspecified_addr = {
+    .words = { 0, 0, 0, 0 }
+};
+
+
+/**
+ * Initializes the global IPv6 state of networking layer 3
+ *
+ * @param layer3_ipv6_p Pointer to IPv6 global state
+ */
+void net_layer3_ipv6_init(struct net_layer3_ipv6 *layer3_ipv6_p)
+{
+    layer3_ipv6_p->expecting_ping_ipv6_reply = false;
+    layer3_ipv6_p->received_ipv6_packets_count = 0;
+    layer3_ipv6_p->rx_packets_dropped_count = 0;
+    layer3_ipv6_p->sent_packets_count = 0;
+    layer3_ipv6_p->neighbor_pending_tx_packets_dropped_count = 0;
+
+    net_packet_queue_init("Incoming IPv6 ping reply packet queue",
+                          true,
+                          &layer3_ipv6_p->rx_ipv6_ping_reply_packet_queue);
+
+    rtos_mutex_init(&layer3_ipv6_p->expecting_ping_ipv6_reply_mutex,
+                    "expecting_ping_ipv6_reply mutex");
+
+    rtos_semaphore_init(&layer3_ipv6_p->ping_ipv6_reply_received_semaphore,
+                        "ping_ipv6_reply_received semaphore",
+                        0);
+}
+
+
+/**
+ * Maps multicast IPv6 address to multicast Ethernet MAC address
+ * (33:33 followed by the last 32 bits of the IPv6 address)
+ */
+static inline void map_ipv6_multicast_addr_to_ethernet_multicast_addr(
+    const struct ipv6_address *ipv6_multicast_addr_p,
+    struct ethernet_mac_address *ethernet_multicast_addr_p)
+{
+    D_ASSERT(IPV6_ADDR_IS_MULTICAST(ipv6_multicast_addr_p));
+
+    ethernet_multicast_addr_p->bytes[0] = 0x33;
+    ethernet_multicast_addr_p->bytes[1] = 0x33;
+    ethernet_multicast_addr_p->hwords[1] = ipv6_multicast_addr_p->hwords[6];
+    ethernet_multicast_addr_p->hwords[2] = ipv6_multicast_addr_p->hwords[7];
+}
+
+
+/**
+ * Builds the solicited-node multicast address (ff02::1:ffxx:xxxx) of an IPv6
+ * unicast address
+ */
+static inline void build_ipv6_solicited_node_multicast_addr(
+    const struct ipv6_address *unicast_addr_p,
+    struct ipv6_address *multicast_addr_p)
+{
+    multicast_addr_p->words[0] = hton32(UINT32_C(0xff020000));
+    multicast_addr_p->words[1] = 0;
+    multicast_addr_p->words[2] = hton32(UINT32_C(0x1));
+    multicast_addr_p->words[3] = unicast_addr_p->words[3];
+    multicast_addr_p->bytes[12] = 0xff;
+}
+
+
+static void neighbor_cache_init(struct neighbor_cache *neighbor_cache_p)
+{
+    rtos_mutex_init(&neighbor_cache_p->mutex, "Neighbor cache mutex");
+
+    for (unsigned int i = 0; i < NEIGHBOR_CACHE_NUM_BUCKETS; i++) {
+        struct neighbor_cache_bucket *bucket_p = &neighbor_cache_p->buckets[i];
+
+        bucket_p->sequence_count = 0;
+        for (unsigned int j = 0; j < NEIGHBOR_CACHE_BUCKET_NUM_ENTRIES; j++) {
+            bucket_p->entries[j].state = NEIGHBOR_ENTRY_INVALID;
+            bucket_p->entries[j].num_pending_tx_packets = 0;
+        }
+    }
+}
+
+
+/**
+ * Populates the IPv6 header of an outgoing IPv6 packet
+ */
+static void net_layer3_populate_ipv6_header(struct ipv6_header *ipv6_header_p,
+                                            const struct ipv6_address *source_ip_addr_p,
+                                            const struct ipv6_address *dest_ip_addr_p,
+                                            size_t data_payload_length,
+                                            uint_fast8_t next_header,
+                                            uint_fast8_t hop_limit)
+{
+    /*
+     * Version 6, traffic class 0 and flow label 0:
+     */
+    ipv6_header_p->first_word.value = 0;
+    SET_BIT_FIELD(ipv6_header_p->first_word.bytes[0],
+                  IPv6_VERSION_MASK, IPv6_VERSION_SHIFT, 6);
+
+    ipv6_header_p->payload_length = hton16(data_payload_length);
+    ipv6_header_p->next_header = next_header;
+    ipv6_header_p->hop_limit = hop_limit;
+    ipv6_address_copy(&ipv6_header_p->source_ipv6_addr, source_ip_addr_p);
+    ipv6_address_copy(&ipv6_header_p->dest_ipv6_addr, dest_ip_addr_p);
+}
+
+
+/**
+ * Populates the ICMPv6 header of an outgoing ICMPv6 message
+ */
+static void net_layer3_populate_icmpv6_header(struct icmpv6_header *icmpv6_header_p,
+                                              uint8_t msg_type,
+                                              uint8_t msg_code)
+{
+    icmpv6_header_p->msg_type = msg_type;
+    icmpv6_header_p->msg_code = msg_code;
+
+    /*
+     * NOTE: icmpv6_header_p->msg_checksum is computed by hardware.
+     * We just need to initialize the checksum field to 0
+     */
+    icmpv6_header_p->msg_checksum = 0;
+}
+
+
+/**
+ * Sends an ICMPv6 neighbor solicitation message
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param source_ip_addr_p      Source IPv6 address: the local address, or
+ *                              the unspecified address for duplicate address
+ *                              detection
+ * @param target_ip_addr_p      IPv6 address to resolve
+ * @param dest_mac_addr_p       MAC address to send the solicitation to (for
+ *                              refreshing a known mapping), or NULL to send it
+ *                              to the target's solicited-node multicast
+ *                              address
+ */
+static void net_send_ipv6_neighbor_solicitation(
+    struct net_layer3_end_point *layer3_end_point_p,
+    const struct ipv6_address *source_ip_addr_p,
+    const struct ipv6_address *target_ip_addr_p,
+    const struct ethernet_mac_address *dest_mac_addr_p)
+{
+    struct ethernet_mac_address local_mac_address;
+    struct ethernet_mac_address dest_mac_addr;
+    struct ipv6_address dest_ip_addr;
+    size_t icmpv6_msg_length = sizeof(struct icmpv6_neighbor_solicitation);
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(ICMPV6_NDP_FRAME_LENGTH, true);
+
+    D_ASSERT(tx_packet_p != NULL);
+
+    struct icmpv6_neighbor_solicitation *ns_msg_p =
+        GET_IPV6_DATA_PAYLOAD_AREA(tx_packet_p);
+
+    net_layer2_get_mac_addr(layer3_end_point_p->layer2_end_point_p,
+                            &local_mac_address);
+
+    net_layer3_populate_icmpv6_header(&ns_msg_p->header,
+                                      ICMPV6_TYPE_NEIGHBOR_SOLICITATION, 0);
+    ns_msg_p->reserved = 0;
+    ipv6_address_copy(&ns_msg_p->target_ip_addr, target_ip_addr_p);
+
+    /*
+     * The source link-layer address option must not be included if the
+     * source address is unspecified (RFC 4861):
+     */
+    if (!IPV6_ADDR_IS_UNSPECIFIED(source_ip_addr_p)) {
+        struct icmpv6_link_layer_addr_option *option_p =
+            (struct icmpv6_link_layer_addr_option *)ns_msg_p->options;
+
+        option_p->type = ICMPV6_OPTION_SOURCE_LINK_LAYER_ADDR;
+        option_p->length = 1;
+        COPY_MAC_ADDRESS(&option_p->mac_addr, &local_mac_address);
+        icmpv6_msg_length += sizeof(struct icmpv6_link_layer_addr_option);
+    }
+
+    if (dest_mac_addr_p == NULL) {
+        build_ipv6_solicited_node_multicast_addr(target_ip_addr_p, &dest_ip_addr);
+        map_ipv6_multicast_addr_to_ethernet_multicast_addr(&dest_ip_addr,
+                                                           &dest_mac_addr);
+    } else {
+        ipv6_address_copy(&dest_ip_addr, target_ip_addr_p);
+        dest_mac_addr = *dest_mac_addr_p;
+    }
+
+    net_layer3_populate_ipv6_header(GET_IPV6_HEADER(tx_packet_p),
+                                    source_ip_addr_p,
+                                    &dest_ip_addr,
+                                    icmpv6_msg_length,
+                                    IPV6_NEXT_HEADER_ICMPV6,
+                                    IPV6_NDP_HOP_LIMIT);
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: IPv6 neighbor solicitation sent for "
+                     "%x:%x:%x:%x:%x:%x:%x:%x\n",
+                     ntoh16(target_ip_addr_p->hwords[0]),
+                     ntoh16(target_ip_addr_p->hwords[1]),
+                     ntoh16(target_ip_addr_p->hwords[2]),
+                     ntoh16(target_ip_addr_p->hwords[3]),
+                     ntoh16(target_ip_addr_p->hwords[4]),
+                     ntoh16(target_ip_addr_p->hwords[5]),
+                     ntoh16(target_ip_addr_p->hwords[6]),
+                     ntoh16(target_ip_addr_p->hwords[7]));
+    }
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv6.sent_packets_count);
+    (void)net_layer2_send_ethernet_frame(layer3_end_point_p->layer2_end_point_p,
+                                         &dest_mac_addr,
+                                         tx_packet_p,
+                                         FRAME_TYPE_IPv6_PACKET,
+                                         sizeof(struct ipv6_header) +
+                                             icmpv6_msg_length);
+}
+
+
+/**
+ * Sends an ICMPv6 neighbor advertisement message for the local link-local
+ * address
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param dest_ip_addr_p        Destination IPv6 address: the source of the
+ *                              neighbor solicitation, or the all-nodes
+ *                              multicast address if the solicitation came
+ *                              from the unspecified address
+ * @param dest_mac_addr_p       Destination MAC address
+ * @param solicited             Flag indicating if the advertisement is sent
+ *                              in response to a neighbor solicitation
+ */
+static void net_send_ipv6_neighbor_advertisement(
+    struct net_layer3_end_point *layer3_end_point_p,
+    const struct ipv6_address *dest_ip_addr_p,
+    const struct ethernet_mac_address *dest_mac_addr_p,
+    bool solicited)
+{
+    struct ethernet_mac_address local_mac_address;
+    struct ipv6_end_point *ipv6_end_point_p = &layer3_end_point_p->ipv6;
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(ICMPV6_NDP_FRAME_LENGTH, true);
+
+    D_ASSERT(tx_packet_p != NULL);
+
+    struct icmpv6_neighbor_advertisement *na_msg_p =
+        GET_IPV6_DATA_PAYLOAD_AREA(tx_packet_p);
+    struct icmpv6_link_layer_addr_option *option_p =
+        (struct icmpv6_link_layer_addr_option *)na_msg_p->options;
+
+    net_layer2_get_mac_addr(layer3_end_point_p->layer2_end_point_p,
+                            &local_mac_address);
+
+    net_layer3_populate_icmpv6_header(&na_msg_p->header,
+                                      ICMPV6_TYPE_NEIGHBOR_ADVERTISEMENT, 0);
+    na_msg_p->reserved_and_flags = 0;
+
+    /*
+     * NOTE: The flags are the most significant bits of the first byte after
+     * the ICMPv6 header: R (0x80), S (0x40) and O (0x20).
+     */
+    na_msg_p->reserved[0] = solicited ? 0x60 : 0x20;
+    ipv6_address_copy(&na_msg_p->target_ip_addr,
+                      &ipv6_end_point_p->link_local_ip_addr);
+
+    option_p->type = ICMPV6_OPTION_TARGET_LINK_LAYER_ADDR;
+    option_p->length = 1;
+    COPY_MAC_ADDRESS(&option_p->mac_addr, &local_mac_address);
+
+    net_layer3_populate_ipv6_header(GET_IPV6_HEADER(tx_packet_p),
+                                    &ipv6_end_point_p->link_local_ip_addr,
+                                    dest_ip_addr_p,
+                                    sizeof(struct icmpv6_neighbor_advertisement) +
+                                        sizeof(struct icmpv6_link_layer_addr_option),
+                                    IPV6_NEXT_HEADER_ICMPV6,
+                                    IPV6_NDP_HOP_LIMIT);
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv6.sent_packets_count);
+    (void)net_layer2_send_ethernet_frame(layer3_end_point_p->layer2_end_point_p,
+                                         dest_mac_addr_p,
+                                         tx_packet_p,
+                                         FRAME_TYPE_IPv6_PACKET,
+                                         sizeof(struct ipv6_header) +
+                                             sizeof(struct icmpv6_neighbor_advertisement) +
+                                             sizeof(struct icmpv6_link_layer_addr_option));
+}
+
+
+/**
+ * Returns the neighbor cache hash bucket for a given IPv6 address
+ */
+static inline struct neighbor_cache_bucket *
+neighbor_cache_get_bucket(struct neighbor_cache *neighbor_cache_p,
+                          const struct ipv6_address *ip_addr_p)
+{
+    return &neighbor_cache_p->buckets[ipv6_address_hash(ip_addr_p,
+                                                        NEIGHBOR_CACHE_NUM_BUCKETS)];
+}
+
+
+/**
+ * Marks the beginning of an update of a neighbor cache bucket, for lock-free
+ * readers. Must be called with the neighbor cache mutex held.
+ */
+static inline void neighbor_cache_bucket_update_begin(struct neighbor_cache_bucket *bucket_p)
+{
+    D_ASSERT(bucket_p->sequence_count % 2 == 0);
+    bucket_p->sequence_count ++;
+    __DMB();
+}
+
+
+/**
+ * Marks the end of an update of a neighbor cache bucket, for lock-free
+ * readers. Must be called with the neighbor cache mutex held.
+ */
+static inline void neighbor_cache_bucket_update_end(struct neighbor_cache_bucket *bucket_p)
+{
+    __DMB();
+    D_ASSERT(bucket_p->sequence_count % 2 != 0);
+    bucket_p->sequence_count ++;
+}
+
+
+/**
+ * Tells if a reachable neighbor cache entry is close to expiring and a
+ * refresh neighbor solicitation needs to be sent for it
+ */
+static inline bool neighbor_cache_entry_needs_refresh(
+    const struct neighbor_cache_entry *entry_p,
+    uint32_t current_ticks)
+{
+    return RTOS_TICKS_DELTA(entry_p->entry_filled_time_stamp, current_ticks) >=
+               NEIGHBOR_CACHE_ENTRY_REFRESH_AGE_IN_TICKS &&
+           RTOS_TICKS_DELTA(entry_p->neighbor_solicitation_time_stamp, current_ticks) >=
+               MILLISECONDS_TO_TICKS(NEIGHBOR_SOLICITATION_RESEND_INTERVAL_IN_MS);
+}
+
+
+/**
+ * Looks up a non-expired neighbor cache entry for a given IPv6 address,
+ * without taking the neighbor cache mutex
+ *
+ * @param neighbor_cache_p  Pointer to neighbor cache
+ * @param dest_ip_addr_p    IPv6 address to look up
+ * @param dest_mac_addr_p   Area where the MAC address is to be returned
+ *
+ * @return true, on neighbor cache hit
+ * @return false, on neighbor cache miss, if the entry needs to be refreshed,
+ *         or if the bucket kept being updated while it was being read (the
+ *         caller must then retry with the neighbor cache mutex held)
+ */
+static bool neighbor_cache_lock_free_lookup(struct neighbor_cache *neighbor_cache_p,
+                                            const struct ipv6_address *dest_ip_addr_p,
+                                            struct ethernet_mac_address *dest_mac_addr_p)
+{
+    struct neighbor_cache_bucket *bucket_p =
+        neighbor_cache_get_bucket(neighbor_cache_p, dest_ip_addr_p);
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
+
+    for (unsigned int retries = 0;
+         retries < NEIGHBOR_CACHE_LOCK_FREE_LOOKUP_MAX_RETRIES;
+         retries ++) {
+        uint32_t sequence_count = bucket_p->sequence_count;
+        struct neighbor_cache_entry *hit_entry_p = NULL;
+        struct ethernet_mac_address mac_addr;
+        bool needs_refresh = false;
+
+        if (sequence_count % 2 != 0) {
+            continue;
+        }
+
+        __DMB();
+        for (unsigned int i = 0; i < NEIGHBOR_CACHE_BUCKET_NUM_ENTRIES; i++) {
+            struct neighbor_cache_entry *entry_p = &bucket_p->entries[i];
+
+            if (entry_p->state == NEIGHBOR_ENTRY_REACHABLE &&
+                IPV6_ADDRESSES_EQUAL(&entry_p->dest_ipv6_addr, dest_ip_addr_p) &&
+                RTOS_TICKS_DELTA(entry_p->entry_filled_time_stamp,
+                                 current_ticks) <
+                    NEIGHBOR_CACHE_ENTRY_LIFETIME_IN_TICKS) {
+                mac_addr = entry_p->dest_mac_addr;
+                needs_refresh = neighbor_cache_entry_needs_refresh(entry_p,
+                                                                   current_ticks);
+                hit_entry_p = entry_p;
+                break;
+            }
+        }
+
+        __DMB();
+        if (bucket_p->sequence_count != sequence_count) {
+            continue;
+        }
+
+        if (hit_entry_p == NULL || needs_refresh) {
+            return false;
+        }
+
+        /*
+         * NOTE: This store races with updaters, but it is a single word
+         * only used as a hint for LRU replacement
+         */
+        hit_entry_p->last_lookup_time_stamp = current_ticks;
+        *dest_mac_addr_p = mac_addr;
+        return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * Drops the Tx packets queued in a neighbor cache entry, waiting for the
+ * entry to be resolved. Must be called with the neighbor cache mutex held.
+ */
+static void neighbor_cache_entry_drop_pending_tx_packets(
+    struct neighbor_cache_entry *entry_p)
+{
+    for (unsigned int i = 0; i < entry_p->num_pending_tx_packets; i++) {
+        struct network_packet *tx_packet_p =
+            entry_p->pending_tx_packets[i].tx_packet_p;
+
+        D_ASSERT(tx_packet_p->state_flags ==
+                 (NET_PACKET_IN_TX_USE_BY_APP | NET_PACKET_FREE_AFTER_TX_COMPLETE));
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv6.neighbor_pending_tx_packets_dropped_count);
+    }
+
+    entry_p->num_pending_tx_packets = 0;
+}
+
+
+/**
+ * Looks up the neighbor cache entry for a given IPv6 address, in its hash
+ * bucket. If there is none, it chooses an entry of the bucket for the IPv6
+ * address: a free one, or else the least recently used one, which is
+ * invalidated. Must be called with the neighbor cache mutex held.
+ */
+static struct neighbor_cache_entry *
+neighbor_cache_lookup_or_allocate(struct neighbor_cache *neighbor_cache_p,
+                                  const struct ipv6_address *dest_ip_addr_p,
+                                  struct neighbor_cache_entry **free_entry_pp)
+{
+    struct neighbor_cache_bucket *bucket_p =
+        neighbor_cache_get_bucket(neighbor_cache_p, dest_ip_addr_p);
+    struct neighbor_cache_entry *first_free_entry_p = NULL;
+    struct neighbor_cache_entry *least_recently_used_entry_p = NULL;
+    uint32_t least_recently_used_ticks_delta = 0;
+    struct neighbor_cache_entry *matching_entry_p = NULL;
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
+
+    D_ASSERT(rtos_mutex_is_mine(&neighbor_cache_p->mutex));
+
+    *free_entry_pp = NULL;
+    for (unsigned int i = 0; i < NEIGHBOR_CACHE_BUCKET_NUM_ENTRIES; i++) {
+        struct neighbor_cache_entry *entry_p = &bucket_p->entries[i];
+
+        if (entry_p->state == NEIGHBOR_ENTRY_INVALID) {
+            if (first_free_entry_p == NULL) {
+                first_free_entry_p = entry_p;
+            }
+        } else {
+            D_ASSERT(entry_p->state == NEIGHBOR_ENTRY_REACHABLE ||
+                     entry_p->state == NEIGHBOR_ENTRY_INCOMPLETE);
+
+            if (IPV6_ADDRESSES_EQUAL(&entry_p->dest_ipv6_addr, dest_ip_addr_p)) {
+                matching_entry_p = entry_p;
+                break;
+            }
+
+            if (least_recently_used_entry_p == NULL ||
+                RTOS_TICKS_DELTA(entry_p->last_lookup_time_stamp,
+                                 current_ticks) >
+                   least_recently_used_ticks_delta) {
+                least_recently_used_entry_p = entry_p;
+                least_recently_used_ticks_delta =
+                RTOS_TICKS_DELTA(entry_p->last_lookup_time_stamp,
+                                 current_ticks);
+            }
+        }
+    }
+
+    if (matching_entry_p == NULL) {
+        if (first_free_entry_p != NULL) {
+            *free_entry_pp = first_free_entry_p;
+        } else {
+            /*
+             * Overwrite the least recently used entry:
+             */
+            D_ASSERT(least_recently_used_entry_p != NULL);
+            neighbor_cache_entry_drop_pending_tx_packets(least_recently_used_entry_p);
+            neighbor_cache_bucket_update_begin(bucket_p);
+            least_recently_used_entry_p->state = NEIGHBOR_ENTRY_INVALID;
+            neighbor_cache_bucket_update_end(bucket_p);
+            *free_entry_pp = least_recently_used_entry_p;
+        }
+    }
+
+    return matching_entry_p;
+}
+
+
+/**
+ * Queues a Tx packet in a neighbor cache entry that is waiting to be
+ * resolved. If the Tx packet is owned by the caller (it does not have
+ * NET_PACKET_FREE_AFTER_TX_COMPLETE set), a copy of it is queued instead.
+ * If the queue is full, the oldest queued packet is dropped.
+ * Must be called with the neighbor cache mutex held.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t neighbor_cache_entry_enqueue_pending_tx_packet(
+    struct neighbor_cache_entry *entry_p,
+    struct network_packet *tx_packet_p,
+    size_t ipv6_packet_length)
+{
+    struct neighbor_pending_tx_packet *pending_tx_packet_p;
+    size_t frame_length = sizeof(struct ethernet_header) + ipv6_packet_length;
+
+    D_ASSERT(entry_p->state == NEIGHBOR_ENTRY_INCOMPLETE);
+    if (!(tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE)) {
+        struct network_packet *tx_packet_copy_p =
+            net_layer2_try_allocate_tx_packet(frame_length, true);
+
+        if (tx_packet_copy_p == NULL) {
+            ATOMIC_POST_INCREMENT_UINT32(
+                &g_net_layer3.ipv6.neighbor_pending_tx_packets_dropped_count);
+            return CAPTURE_ERROR("No Tx packet available to wait for neighbor advertisement",
+                                 tx_packet_p, frame_length);
+        }
+
+        memcpy(tx_packet_copy_p->data_buffer, tx_packet_p->data_buffer,
+               frame_length);
+        tx_packet_copy_p->vlan_pcp = tx_packet_p->vlan_pcp;
+        tx_packet_copy_p->timestamp_flags = tx_packet_p->timestamp_flags;
+        tx_packet_p = tx_packet_copy_p;
+    }
+
+    if (entry_p->num_pending_tx_packets == NEIGHBOR_PENDING_TX_QUEUE_MAX_PACKETS) {
+        struct network_packet *oldest_tx_packet_p =
+            entry_p->pending_tx_packets[0].tx_packet_p;
+
+        NET_PACKET_CLEAR_STATE_FLAG(oldest_tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(oldest_tx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer3.ipv6.neighbor_pending_tx_packets_dropped_count);
+
+        memmove(&entry_p->pending_tx_packets[0],
+                &entry_p->pending_tx_packets[1],
+                (NEIGHBOR_PENDING_TX_QUEUE_MAX_PACKETS - 1) *
+                    sizeof entry_p->pending_tx_packets[0]);
+        entry_p->num_pending_tx_packets --;
+    }
+
+    pending_tx_packet_p =
+        &entry_p->pending_tx_packets[entry_p->num_pending_tx_packets];
+    pending_tx_packet_p->tx_packet_p = tx_packet_p;
+    pending_tx_packet_p->ipv6_packet_length = ipv6_packet_length;
+    entry_p->num_pending_tx_packets ++;
+    return 0;
+}
+
+
+/**
+ * Resolves the MAC address of an on-link IPv6 destination. If the MAC
+ * address is not in the neighbor cache, a neighbor solicitation is sent
+ * (unless one was sent recently) and the Tx packet is queued in the neighbor
+ * cache entry, to be transmitted once the neighbor advertisement is received.
+ * The caller is never blocked waiting for the neighbor advertisement.
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param dest_ip_addr_p        IPv6 address of the destination
+ * @param tx_packet_p           Tx packet to send
+ * @param ipv6_packet_length    Length of the IPv6 packet
+ * @param dest_mac_addr_p       Area where the MAC address of the destination
+ *                              is to be returned, if it was resolved
+ * @param tx_packet_queued_p    Area where it is returned whether the Tx
+ *                              packet was queued waiting for the neighbor
+ *                              advertisement
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t resolve_dest_ipv6_addr(
+    struct net_layer3_end_point *layer3_end_point_p,
+    const struct ipv6_address *dest_ip_addr_p,
+    struct network_packet *tx_packet_p,
+    size_t ipv6_packet_length,
+    struct ethernet_mac_address *dest_mac_addr_p,
+    bool *tx_packet_queued_p)
+{
+    struct neighbor_cache_entry *matching_entry_p = NULL;
+    struct neighbor_cache_entry *free_entry_p = NULL;
+    struct neighbor_cache *neighbor_cache_p = &layer3_end_point_p->ipv6.neighbor_cache;
+    struct neighbor_cache_bucket *bucket_p =
+        neighbor_cache_get_bucket(neighbor_cache_p, dest_ip_addr_p);
+    bool send_solicitation = false;
+    bool send_refresh_solicitation = false;
+    uint32_t current_ticks;
+    error_t error;
+
+    *tx_packet_queued_p = false;
+
+    /*
+     * Fast path: neighbor cache hit, without taking the neighbor cache mutex:
+     */
+    if (neighbor_cache_lock_free_lookup(neighbor_cache_p, dest_ip_addr_p,
+                                        dest_mac_addr_p)) {
+        return 0;
+    }
+
+    rtos_mutex_lock(&neighbor_cache_p->mutex);
+    matching_entry_p = neighbor_cache_lookup_or_allocate(neighbor_cache_p,
+                                                         dest_ip_addr_p,
+                                                         &free_entry_p);
+    current_ticks = rtos_get_ticks_since_boot();
+    if (matching_entry_p != NULL &&
+        matching_entry_p->state == NEIGHBOR_ENTRY_REACHABLE) {
+        if (RTOS_TICKS_DELTA(matching_entry_p->entry_filled_time_stamp,
+                             current_ticks) <
+                NEIGHBOR_CACHE_ENTRY_LIFETIME_IN_TICKS) {
+            /*
+             * Neighbor cache hit
+             */
+            *dest_mac_addr_p = matching_entry_p->dest_mac_addr;
+            matching_entry_p->last_lookup_time_stamp = current_ticks;
+            if (neighbor_cache_entry_needs_refresh(matching_entry_p, current_ticks)) {
+                /*
+                 * Entry close to expiring: keep using it, but send a unicast
+                 * neighbor solicitation to refresh it before it expires:
+                 */
+                neighbor_cache_bucket_update_begin(bucket_p);
+                matching_entry_p->neighbor_solicitation_time_stamp = current_ticks;
+                neighbor_cache_bucket_update_end(bucket_p);
+                send_refresh_solicitation = true;
+            }
+
+            error = 0;
+            goto common_exit;
+        }
+
+        /*
+         * Neighbor entry expired, send a new neighbor solicitation:
+         */
+        free_entry_p = matching_entry_p;
+        matching_entry_p = NULL;
+    }
+
+    if (matching_entry_p == NULL) {
+        /*
+         * Start a new resolution:
+         */
+        D_ASSERT(free_entry_p != NULL);
+        neighbor_cache_bucket_update_begin(bucket_p);
+        ipv6_address_copy(&free_entry_p->dest_ipv6_addr, dest_ip_addr_p);
+        free_entry_p->neighbor_solicitation_time_stamp = current_ticks;
+        free_entry_p->last_lookup_time_stamp = current_ticks;
+        free_entry_p->neighbor_solicitation_count = 1;
+        free_entry_p->num_pending_tx_packets = 0;
+        free_entry_p->state = NEIGHBOR_ENTRY_INCOMPLETE;
+        neighbor_cache_bucket_update_end(bucket_p);
+        matching_entry_p = free_entry_p;
+        send_solicitation = true;
+    } else {
+        D_ASSERT(matching_entry_p->state == NEIGHBOR_ENTRY_INCOMPLETE);
+
+        matching_entry_p->last_lookup_time_stamp = current_ticks;
+        if (RTOS_TICKS_DELTA(matching_entry_p->neighbor_solicitation_time_stamp,
+                             current_ticks) >=
+            MILLISECONDS_TO_TICKS(NEIGHBOR_SOLICITATION_RESEND_INTERVAL_IN_MS)) {
+            if (matching_entry_p->neighbor_solicitation_count ==
+                    NEIGHBOR_SOLICITATION_MAX_RETRIES) {
+                error = CAPTURE_ERROR("Unreachable IPv6 address",
+                                      dest_ip_addr_p->words[3], 0);
+
+                neighbor_cache_entry_drop_pending_tx_packets(matching_entry_p);
+                neighbor_cache_bucket_update_begin(bucket_p);
+                matching_entry_p->state = NEIGHBOR_ENTRY_INVALID;
+                neighbor_cache_bucket_update_end(bucket_p);
+                goto common_exit;
+            }
+
+            /*
+             * Re-send neighbor solicitation:
+             */
+            matching_entry_p->neighbor_solicitation_time_stamp = current_ticks;
+            matching_entry_p->neighbor_solicitation_count ++;
+            send_solicitation = true;
+        }
+    }
+
+    error = neighbor_cache_entry_enqueue_pending_tx_packet(matching_entry_p,
+                                                           tx_packet_p,
+                                                           ipv6_packet_length);
+    if (error == 0) {
+        *tx_packet_queued_p = true;
+    }
+
+common_exit:
+    rtos_mutex_unlock(&neighbor_cache_p->mutex);
+
+    /*
+     * NOTE: Neighbor solicitations are sent after releasing the neighbor
+     * cache mutex, as allocating their Tx packets may block.
+     */
+    if (send_solicitation) {
+        net_send_ipv6_neighbor_solicitation(layer3_end_point_p,
+                                            &layer3_end_point_p->ipv6.link_local_ip_addr,
+                                            dest_ip_addr_p,
+                                            NULL);
+    } else if (send_refresh_solicitation) {
+        net_send_ipv6_neighbor_solicitation(layer3_end_point_p,
+                                            &layer3_end_point_p->ipv6.link_local_ip_addr,
+                                            dest_ip_addr_p,
+                                            dest_mac_addr_p);
+    }
+
+    return error;
+}
+
+
+/**
+ * Updates the neighbor cache entry for a given IPv6 address, and transmits
+ * the Tx packets that were queued waiting for the entry to be resolved.
+ *
+ * @param layer3_end_point_p    Pointer to the local layer-3 end point
+ * @param dest_ip_addr_p        IPv6 address of the neighbor
+ * @param dest_mac_addr_p       MAC address of the neighbor
+ * @param create_entry          Flag indicating if an entry is to be created
+ *                              if there is none for the neighbor. Otherwise,
+ *                              only an existing entry is updated.
+ */
+static void neighbor_cache_update(struct net_layer3_end_point *layer3_end_point_p,
+                                  const struct ipv6_address *dest_ip_addr_p,
+                                  const struct ethernet_mac_address *dest_mac_addr_p,
+                                  bool create_entry)
+{
+    struct neighbor_cache *neighbor_cache_p = &layer3_end_point_p->ipv6.neighbor_cache;
+    struct neighbor_cache_entry *chosen_entry_p = NULL;
+    struct neighbor_cache_entry *free_entry_p = NULL;
+    struct neighbor_cache_bucket *bucket_p =
+        neighbor_cache_get_bucket(neighbor_cache_p, dest_ip_addr_p);
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
+    struct neighbor_pending_tx_packet pending_tx_packets[NEIGHBOR_PENDING_TX_QUEUE_MAX_PACKETS];
+    unsigned int num_pending_tx_packets = 0;
+
+    rtos_mutex_lock(&neighbor_cache_p->mutex);
+    chosen_entry_p = neighbor_cache_lookup_or_allocate(neighbor_cache_p,
+                                                       dest_ip_addr_p,
+                                                       &free_entry_p);
+
+    if (chosen_entry_p == NULL && !create_entry) {
+        rtos_mutex_unlock(&neighbor_cache_p->mutex);
+        return;
+    }
+
+    if (chosen_entry_p != NULL &&
+        chosen_entry_p->state == NEIGHBOR_ENTRY_INCOMPLETE) {
+        num_pending_tx_packets = chosen_entry_p->num_pending_tx_packets;
+        memcpy(pending_tx_packets, chosen_entry_p->pending_tx_packets,
+               num_pending_tx_packets * sizeof pending_tx_packets[0]);
+        chosen_entry_p->num_pending_tx_packets = 0;
+    }
+
+    neighbor_cache_bucket_update_begin(bucket_p);
+    if (chosen_entry_p == NULL) {
+        D_ASSERT(free_entry_p != NULL);
+        chosen_entry_p = free_entry_p;
+        ipv6_address_copy(&chosen_entry_p->dest_ipv6_addr, dest_ip_addr_p);
+        chosen_entry_p->last_lookup_time_stamp = current_ticks;
+        chosen_entry_p->neighbor_solicitation_time_stamp = current_ticks;
+        chosen_entry_p->num_pending_tx_packets = 0;
+    }
+
+    COPY_MAC_ADDRESS(&chosen_entry_p->dest_mac_addr, dest_mac_addr_p);
+    chosen_entry_p->state = NEIGHBOR_ENTRY_REACHABLE;
+    chosen_entry_p->entry_filled_time_stamp = current_ticks;
+    neighbor_cache_bucket_update_end(bucket_p);
+    rtos_mutex_unlock(&neighbor_cache_p->mutex);
+
+    /*
+     * Transmit the packets that were waiting for the neighbor advertisement:
+     */
+    for (unsigned int i = 0; i < num_pending_tx_packets; i++) {
+        (void)net_layer2_send_ethernet_frame(layer3_end_point_p->layer2_end_point_p,
+                                             dest_mac_addr_p,
+                                             pending_tx_packets[i].tx_packet_p,
+                                             FRAME_TYPE_IPv6_PACKET,
+                                             pending_tx_packets[i].ipv6_packet_length);
+    }
+}
+
+
+/**
+ * Chooses the local layer-3 end point to be used for sending an IPv6 packet.
+ * Only link-local addresses are configured, so the first end point whose
+ * link-local address is ready is chosen.
+ */
+static struct net_layer3_end_point *choose_ipv6_local_layer3_end_point(void)
+{
+    for (unsigned int i = 0;
+         i < ARRAY_SIZE(g_net_layer3.local_layer3_end_points); i ++) {
+        struct net_layer3_end_point *layer3_end_point_p =
+            &g_net_layer3.local_layer3_end_points[i];
+
+        if (layer3_end_point_p->ipv6.flags & IPV6_LINK_LOCAL_ADDR_READY) {
+            return layer3_end_point_p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Sends an IPv6 packet over Ethernet. The IPv6 payload must fit in the Tx
+ * packet, as IPv6 packets are not fragmented. All unicast destinations are
+ * considered on-link.
+ *
+ * @param dest_ip_addr_p        Destination IPv6 address
+ * @param tx_packet_p           Tx packet, with the IPv6 payload already
+ *                              filled in
+ * @param data_payload_length   Length of the IPv6 payload
+ * @param next_header           IPv6 next header (upper-layer protocol)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer3_send_ipv6_packet(const struct ipv6_address *dest_ip_addr_p,
+                                    struct network_packet *tx_packet_p,
+                                    size_t data_payload_length,
+                                    uint_fast8_t next_header)
+{
+    struct ethernet_mac_address dest_mac_addr;
+    bool tx_packet_queued = false;
+    error_t error;
+
+    D_ASSERT(tx_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    D_ASSERT(data_payload_length <= NET_MAX_IPV6_PACKET_PAYLOAD_SIZE);
+
+    struct net_layer3_end_point *layer3_end_point_p =
+        choose_ipv6_local_layer3_end_point();
+
+    if (layer3_end_point_p == NULL) {
+        return CAPTURE_ERROR("No local IPv6 address ready", 0, 0);
+    }
+
+    struct ipv6_header *const ipv6_header_p = GET_IPV6_HEADER(tx_packet_p);
+
+    net_layer3_populate_ipv6_header(ipv6_header_p,
+                                    &layer3_end_point_p->ipv6.link_local_ip_addr,
+                                    dest_ip_addr_p,
+                                    data_payload_length,
+                                    next_header,
+                                    IPV6_DEFAULT_HOP_LIMIT);
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: IPv6 packet sent:\n"
+                     "\tdestination IPv6 address %x:%x:%x:%x:%x:%x:%x:%x\n"
+                     "\tNext header %#x, Payload length: %u\n",
+                     ntoh16(dest_ip_addr_p->hwords[0]),
+                     ntoh16(dest_ip_addr_p->hwords[1]),
+                     ntoh16(dest_ip_addr_p->hwords[2]),
+                     ntoh16(dest_ip_addr_p->hwords[3]),
+                     ntoh16(dest_ip_addr_p->hwords[4]),
+                     ntoh16(dest_ip_addr_p->hwords[5]),
+                     ntoh16(dest_ip_addr_p->hwords[6]),
+                     ntoh16(dest_ip_addr_p->hwords[7]),
+                     next_header,
+                     data_payload_length);
+    }
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv6.sent_packets_count);
+
+    /*
+     * Get destination MAC address:
+     */
+    if (IPV6_ADDR_IS_MULTICAST(dest_ip_addr_p)) {
+        map_ipv6_multicast_addr_to_ethernet_multicast_addr(dest_ip_addr_p,
+                                                           &dest_mac_addr);
+        error = 0;
+    } else {
+        error = resolve_dest_ipv6_addr(layer3_end_point_p,
+                                       dest_ip_addr_p,
+                                       tx_packet_p,
+                                       sizeof(struct ipv6_header) +
+                                           data_payload_length,
+                                       &dest_mac_addr,
+                                       &tx_packet_queued);
+    }
+
+    if (error != 0) {
+        return error;
+    }
+
+    if (tx_packet_queued) {
+        /*
+         * The packet will be sent when the neighbor advertisement is
+         * received:
+         */
+        return 0;
+    }
+
+    return net_layer2_send_ethernet_frame(layer3_end_point_p->layer2_end_point_p,
+                                          &dest_mac_addr,
+                                          tx_packet_p,
+                                          FRAME_TYPE_IPv6_PACKET,
+                                          sizeof(struct ipv6_header) +
+                                              data_payload_length);
+}
+
+
+/**
+ * Finds the link-layer address option of a given type in a received
+ * neighbor discovery message
+ *
+ * @return pointer to the option, or NULL if not found
+ */
+static const struct icmpv6_link_layer_addr_option *
+find_ndp_link_layer_addr_option(const uint8_t *options_p, size_t options_length,
+                                uint8_t option_type)
+{
+    size_t i = 0;
+
+    while (i + 2 <= options_length) {
+        size_t option_length = options_p[i + 1] * 8;
+
+        if (option_length == 0 || i + option_length > options_length) {
+            /*
+             * Malformed option
+             */
+            break;
+        }
+
+        if (options_p[i] == option_type &&
+            option_length == sizeof(struct icmpv6_link_layer_addr_option)) {
+            return (const struct icmpv6_link_layer_addr_option *)&options_p[i];
+        }
+
+        i += option_length;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Processes a received ICMPv6 neighbor solicitation
+ */
+static void net_process_incoming_neighbor_solicitation(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct network_packet *rx_packet_p,
+    size_t icmpv6_msg_length)
+{
+    struct ipv6_end_point *ipv6_end_point_p = &layer3_end_point_p->ipv6;
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+    struct icmpv6_neighbor_solicitation *ns_msg_p =
+        GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+    struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
+    const struct icmpv6_link_layer_addr_option *option_p;
+
+    if (icmpv6_msg_length < sizeof(struct icmpv6_neighbor_solicitation) ||
+        IPV6_ADDR_IS_MULTICAST(&ns_msg_p->target_ip_addr) ||
+        !IPV6_ADDRESSES_EQUAL(&ns_msg_p->target_ip_addr,
+                              &ipv6_end_point_p->link_local_ip_addr)) {
+        return;
+    }
+
+    if (IPV6_ADDR_IS_UNSPECIFIED(&ipv6_header_p->source_ipv6_addr)) {
+        /*
+         * Duplicate address detection from another node:
+         */
+        if (ipv6_end_point_p->flags & IPV6_DETECT_DUP_ADDR) {
+            /*
+             * Another node is trying to use our tentative address too:
+             */
+            rtos_mutex_lock(&ipv6_end_point_p->mutex);
+            ipv6_end_point_p->flags |= IPV6_DUP_ADDR_DETECTED;
+            rtos_mutex_unlock(&ipv6_end_point_p->mutex);
+            rtos_semaphore_signal(&ipv6_end_point_p->flags_changed_semaphore);
+        } else if (ipv6_end_point_p->flags & IPV6_LINK_LOCAL_ADDR_READY) {
+            struct ethernet_mac_address dest_mac_addr;
+
+            map_ipv6_multicast_addr_to_ethernet_multicast_addr(
+                &g_ipv6_all_nodes_multicast_addr, &dest_mac_addr);
+            net_send_ipv6_neighbor_advertisement(layer3_end_point_p,
+                                                 &g_ipv6_all_nodes_multicast_addr,
+                                                 &dest_mac_addr,
+                                                 false);
+        }
+
+        return;
+    }
+
+    if (!(ipv6_end_point_p->flags & IPV6_LINK_LOCAL_ADDR_READY)) {
+        return;
+    }
+
+    /*
+     * Learn the link-layer address of the sender, which is likely to send us
+     * packets soon:
+     */
+    option_p = find_ndp_link_layer_addr_option(
+                    (const uint8_t *)ns_msg_p->options,
+                    icmpv6_msg_length - sizeof(struct icmpv6_neighbor_solicitation),
+                    ICMPV6_OPTION_SOURCE_LINK_LAYER_ADDR);
+    if (option_p != NULL) {
+        neighbor_cache_update(layer3_end_point_p,
+                              &ipv6_header_p->source_ipv6_addr,
+                              &option_p->mac_addr,
+                              true);
+    }
+
+    net_send_ipv6_neighbor_advertisement(layer3_end_point_p,
+                                         &ipv6_header_p->source_ipv6_addr,
+                                         &rx_frame_p->ethernet_header.source_mac_addr,
+                                         true);
+}
+
+
+/**
+ * Processes a received ICMPv6 neighbor advertisement
+ */
+static void net_process_incoming_neighbor_advertisement(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct network_packet *rx_packet_p,
+    size_t icmpv6_msg_length)
+{
+    struct ipv6_end_point *ipv6_end_point_p = &layer3_end_point_p->ipv6;
+    struct icmpv6_neighbor_advertisement *na_msg_p =
+        GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+    struct ethernet_frame *rx_frame_p =
+        (struct ethernet_frame *)rx_packet_p->data_buffer;
+    const struct icmpv6_link_layer_addr_option *option_p;
+
+    if (icmpv6_msg_length < sizeof(struct icmpv6_neighbor_advertisement) ||
+        IPV6_ADDR_IS_MULTICAST(&na_msg_p->target_ip_addr)) {
+        return;
+    }
+
+    if (IPV6_ADDRESSES_EQUAL(&na_msg_p->target_ip_addr,
+                             &ipv6_end_point_p->link_local_ip_addr)) {
+        /*
+         * Some other node claims our address:
+         */
+        rtos_mutex_lock(&ipv6_end_point_p->mutex);
+        ipv6_end_point_p->flags |= IPV6_DUP_ADDR_DETECTED;
+        rtos_mutex_unlock(&ipv6_end_point_p->mutex);
+        rtos_semaphore_signal(&ipv6_end_point_p->flags_changed_semaphore);
+        ERROR_PRINTF("Duplicate IPv6 link-local address detected\n");
+        return;
+    }
+
+    option_p = find_ndp_link_layer_addr_option(
+                    (const uint8_t *)na_msg_p->options,
+                    icmpv6_msg_length - sizeof(struct icmpv6_neighbor_advertisement),
+                    ICMPV6_OPTION_TARGET_LINK_LAYER_ADDR);
+
+    /*
+     * Unsolicited advertisements only update existing entries (RFC 4861):
+     */
+    neighbor_cache_update(layer3_end_point_p,
+                          &na_msg_p->target_ip_addr,
+                          option_p != NULL ? &option_p->mac_addr :
+                                &rx_frame_p->ethernet_header.source_mac_addr,
+                          false);
+}
+
+
+/**
+ * Send an ICMPv6 echo reply for a received echo request
+ */
+static void net_send_ipv6_ping_reply(struct network_packet *rx_packet_p,
+                                     size_t icmpv6_msg_length)
+{
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+    struct ipv6_address dest_ip_addr;
+
+    ipv6_address_copy(&dest_ip_addr, &ipv6_header_p->source_ipv6_addr);
+
+    if (icmpv6_msg_length < sizeof(struct icmpv6_echo_message) ||
+        IPV6_ADDR_IS_MULTICAST(&dest_ip_addr) ||
+        IPV6_ADDR_IS_UNSPECIFIED(&dest_ip_addr)) {
+        return;
+    }
+
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                              sizeof(struct ipv6_header) +
+                                              icmpv6_msg_length,
+                                          true);
+
+    if (tx_packet_p == NULL) {
+        return;
+    }
+
+    /*
+     * The identifier, sequence number and data of the echo request are
+     * echoed back unchanged:
+     */
+    struct icmpv6_header *icmpv6_header_p = GET_IPV6_DATA_PAYLOAD_AREA(tx_packet_p);
+
+    memcpy(icmpv6_header_p, GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p),
+           icmpv6_msg_length);
+    net_layer3_populate_icmpv6_header(icmpv6_header_p, ICMPV6_TYPE_ECHO_REPLY, 0);
+
+    (void)net_layer3_send_ipv6_packet(&dest_ip_addr,
+                                      tx_packet_p,
+                                      icmpv6_msg_length,
+                                      IPV6_NEXT_HEADER_ICMPV6);
+}
+
+
+/**
+ * Processes a received neighbor discovery message, already validated by
+ * ndp_packet_is_for_us()
+ */
+static void net_process_incoming_ndp_message(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct network_packet *rx_packet_p)
+{
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+    struct icmpv6_header *icmpv6_header_p = GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+    size_t icmpv6_msg_length = ntoh16(ipv6_header_p->payload_length);
+
+    if (icmpv6_header_p->msg_type == ICMPV6_TYPE_NEIGHBOR_SOLICITATION) {
+        net_process_incoming_neighbor_solicitation(layer3_end_point_p,
+                                                   rx_packet_p,
+                                                   icmpv6_msg_length);
+    } else {
+        D_ASSERT(icmpv6_header_p->msg_type == ICMPV6_TYPE_NEIGHBOR_ADVERTISEMENT);
+        net_process_incoming_neighbor_advertisement(layer3_end_point_p,
+                                                    rx_packet_p,
+                                                    icmpv6_msg_length);
+    }
+
+    net_recycle_rx_packet(rx_packet_p);
+}
+
+
+static void net_process_incoming_icmpv6_message(
+    struct net_layer3_end_point *layer3_end_point_p,
+    struct network_packet *rx_packet_p)
+{
+    bool signal_ping_reply_received = false;
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+    struct icmpv6_header *icmpv6_header_p = GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+    size_t icmpv6_msg_length = ntoh16(ipv6_header_p->payload_length);
+
+    D_ASSERT(icmpv6_msg_length >= sizeof(struct icmpv6_header));
+
+    switch (icmpv6_header_p->msg_type) {
+    case ICMPV6_TYPE_ECHO_REPLY:
+        rtos_mutex_lock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+        if (g_net_layer3.ipv6.expecting_ping_ipv6_reply &&
+            icmpv6_msg_length >= sizeof(struct icmpv6_echo_message)) {
+            net_packet_queue_add(&g_net_layer3.ipv6.rx_ipv6_ping_reply_packet_queue,
+                                 rx_packet_p);
+
+            g_net_layer3.ipv6.expecting_ping_ipv6_reply = false;
+            signal_ping_reply_received = true;
+        }
+
+        rtos_mutex_unlock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+        if (signal_ping_reply_received) {
+            rtos_semaphore_signal(&g_net_layer3.ipv6.ping_ipv6_reply_received_semaphore);
+            return;
+        }
+
+        /*
+         * Drop unmatched ping reply
+         */
+        break;
+
+    case ICMPV6_TYPE_ECHO_REQ:
+        if (layer3_end_point_p->ipv6.flags & IPV6_LINK_LOCAL_ADDR_READY) {
+            net_send_ipv6_ping_reply(rx_packet_p, icmpv6_msg_length);
+        }
+
+        break;
+
+    default:
+        /*
+         * NOTE: Router advertisements and multicast listener queries are
+         * silently ignored, as only link-local addresses are configured.
+         */
+        if (NET_LAYER3_TRACING_ON()) {
+            DEBUG_PRINTF("Net layer3: Received ICMPv6 message ignored: type %u\n",
+                         icmpv6_header_p->msg_type);
+        }
+    }
+
+    net_recycle_rx_packet(rx_packet_p);
+}
+
+
+/**
+ * ICMPv6 packet receiver task for a given IPv6 end point
+ */
+static void icmpv6_packet_receiver_task(void *arg)
+{
+    struct ipv6_end_point *const ipv6_end_point_p =
+        (struct ipv6_end_point *)arg;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        ENCLOSING_STRUCT(ipv6_end_point_p, struct net_layer3_end_point, ipv6);
+
+#   ifdef USE_MPU
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                NULL);
+#   endif
+
+    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+
+    for ( ; ; ) {
+        struct network_packet *rx_packet_p = NULL;
+
+        rx_packet_p =
+            net_packet_queue_remove(&ipv6_end_point_p->rx_icmpv6_packet_queue, 0);
+
+        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        NET_PACKET_CLEAR_STATE_FLAG(rx_packet_p, NET_PACKET_IN_ICMPV6_QUEUE);
+        net_process_incoming_icmpv6_message(layer3_end_point_p, rx_packet_p);
+    }
+
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
+}
+
+
+/**
+ * Neighbor discovery packet receiver task for a given IPv6 end point
+ */
+static void ndp_packet_receiver_task(void *arg)
+{
+    struct ipv6_end_point *const ipv6_end_point_p =
+        (struct ipv6_end_point *)arg;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        ENCLOSING_STRUCT(ipv6_end_point_p, struct net_layer3_end_point, ipv6);
+
+#   ifdef USE_MPU
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                NULL);
+#   endif
+
+    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+
+    for ( ; ; ) {
+        struct network_packet *rx_packet_p = NULL;
+
+        rx_packet_p =
+            net_packet_queue_remove(&ipv6_end_point_p->rx_ndp_packet_queue, 0);
+
+        D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+        NET_PACKET_CLEAR_STATE_FLAG(rx_packet_p, NET_PACKET_IN_NDP_QUEUE);
+        net_process_incoming_ndp_message(layer3_end_point_p, rx_packet_p);
+    }
+
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
+}
+
+
+/**
+ * Adds the Ethernet multicast address of the solicited-node multicast
+ * address of a local unicast IPv6 address to the Ethernet MAC's multicast
+ * filter, so that neighbor solicitations for that address are received
+ */
+static void add_solicited_node_multicast_mac_filter(
+    struct net_layer3_end_point *layer3_end_point_p,
+    const struct ipv6_address *unicast_addr_p)
+{
+    struct ethernet_mac_address enet_multicast_addr;
+    struct ipv6_end_point *const ipv6_end_point_p = &layer3_end_point_p->ipv6;
+
+    build_ipv6_solicited_node_multicast_addr(
+        unicast_addr_p, &ipv6_end_point_p->solicited_node_multicast_addr);
+    map_ipv6_multicast_addr_to_ethernet_multicast_addr(
+        &ipv6_end_point_p->solicited_node_multicast_addr, &enet_multicast_addr);
+    ethernet_mac_add_multicast_addr(
+        layer3_end_point_p->layer2_end_point_p->ethernet_mac_p,
+        &enet_multicast_addr);
+}
+
+
+/**
+ * Removes the solicited-node multicast filter added by
+ * add_solicited_node_multicast_mac_filter()
+ */
+static void remove_solicited_node_multicast_mac_filter(
+    struct net_layer3_end_point *layer3_end_point_p)
+{
+    struct ethernet_mac_address enet_multicast_addr;
+    struct ipv6_end_point *const ipv6_end_point_p = &layer3_end_point_p->ipv6;
+
+    map_ipv6_multicast_addr_to_ethernet_multicast_addr(
+        &ipv6_end_point_p->solicited_node_multicast_addr, &enet_multicast_addr);
+    ethernet_mac_remove_multicast_addr(
+        layer3_end_point_p->layer2_end_point_p->ethernet_mac_p,
+        &enet_multicast_addr);
+    ipv6_address_copy(&ipv6_end_point_p->solicited_node_multicast_addr,
+                      &g_ipv6_unspecified_addr);
+}
+
+
+/**
+ * IPv6 address autoconfiguration task for a given IPv6 end point. It builds
+ * the link-local address from the MAC address (modified EUI-64 interface ID),
+ * checks that no other node on the link uses it (duplicate address
+ * detection) and then terminates.
+ */
+static void ipv6_address_autoconfiguration_task(void *arg)
+{
+    struct ethernet_mac_address local_mac_address;
+    struct ethernet_mac_address enet_multicast_addr;
+    struct ipv6_end_point *const ipv6_end_point_p =
+        (struct ipv6_end_point *)arg;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        ENCLOSING_STRUCT(ipv6_end_point_p, struct net_layer3_end_point, ipv6);
+    struct net_layer2_end_point *const layer2_end_point_p =
+        layer3_end_point_p->layer2_end_point_p;
+
+#   ifdef USE_MPU
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                NULL);
+#   endif
+
+    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+
+    net_layer2_get_mac_addr(layer2_end_point_p, &local_mac_address);
+
+    /*
+     * Build modified EUI-64 interface ID and link-local address fe80::/64:
+     */
+    struct ipv6_address *link_local_addr_p = &ipv6_end_point_p->link_local_ip_addr;
+
+    link_local_addr_p->words[0] = 0;
+    link_local_addr_p->words[1] = 0;
+    link_local_addr_p->bytes[0] = 0xfe;
+    link_local_addr_p->bytes[1] = 0x80;
+    link_local_addr_p->bytes[8] = local_mac_address.bytes[0] ^ 0x02;
+    link_local_addr_p->bytes[9] = local_mac_address.bytes[1];
+    link_local_addr_p->bytes[10] = local_mac_address.bytes[2];
+    link_local_addr_p->bytes[11] = 0xff;
+    link_local_addr_p->bytes[12] = 0xfe;
+    link_local_addr_p->bytes[13] = local_mac_address.bytes[3];
+    link_local_addr_p->bytes[14] = local_mac_address.bytes[4];
+    link_local_addr_p->bytes[15] = local_mac_address.bytes[5];
+    ipv6_end_point_p->interface_id.words[0] = link_local_addr_p->words[2];
+    ipv6_end_point_p->interface_id.words[1] = link_local_addr_p->words[3];
+
+    /*
+     * Receive frames sent to the all-nodes and solicited-node multicast
+     * addresses:
+     */
+    map_ipv6_multicast_addr_to_ethernet_multicast_addr(
+        &g_ipv6_all_nodes_multicast_addr, &enet_multicast_addr);
+    ethernet_mac_add_multicast_addr(layer2_end_point_p->ethernet_mac_p,
+                                    &enet_multicast_addr);
+
+    add_solicited_node_multicast_mac_filter(layer3_end_point_p,
+                                            link_local_addr_p);
+
+    /*
+     * Duplicate address detection:
+     */
+    rtos_mutex_lock(&ipv6_end_point_p->mutex);
+    ipv6_end_point_p->flags |= IPV6_DETECT_DUP_ADDR;
+    ipv6_end_point_p->flags &= ~IPV6_DUP_ADDR_DETECTED;
+    rtos_mutex_unlock(&ipv6_end_point_p->mutex);
+
+    net_send_ipv6_neighbor_solicitation(layer3_end_point_p,
+                                        &g_ipv6_unspecified_addr,
+                                        link_local_addr_p,
+                                        NULL);
+
+    (void)rtos_semaphore_wait_timeout(&ipv6_end_point_p->flags_changed_semaphore,
+                                      IPV6_DUP_ADDR_DETECTION_TIMEOUT_IN_MS);
+
+    rtos_mutex_lock(&ipv6_end_point_p->mutex);
+    ipv6_end_point_p->flags &= ~IPV6_DETECT_DUP_ADDR;
+    if (!(ipv6_end_point_p->flags & IPV6_DUP_ADDR_DETECTED)) {
+        ipv6_end_point_p->flags |= IPV6_LINK_LOCAL_ADDR_READY;
+    }
+
+    rtos_mutex_unlock(&ipv6_end_point_p->mutex);
+
+    if (ipv6_end_point_p->flags & IPV6_LINK_LOCAL_ADDR_READY) {
+        INFO_PRINTF("Net layer3: Set local IPv6 link-local address to "
+                    "%x:%x:%x:%x:%x:%x:%x:%x\n",
+                    ntoh16(link_local_addr_p->hwords[0]),
+                    ntoh16(link_local_addr_p->hwords[1]),
+                    ntoh16(link_local_addr_p->hwords[2]),
+                    ntoh16(link_local_addr_p->hwords[3]),
+                    ntoh16(link_local_addr_p->hwords[4]),
+                    ntoh16(link_local_addr_p->hwords[5]),
+                    ntoh16(link_local_addr_p->hwords[6]),
+                    ntoh16(link_local_addr_p->hwords[7]));
+    } else {
+        ERROR_PRINTF("IPv6 link-local address already in use by another node\n");
+        remove_solicited_node_multicast_mac_filter(layer3_end_point_p);
+    }
+
+    rtos_task_exit();
+}
+
+
+/**
+ * IPv6-specific initialization of a layer-3 end point
+ *
+ * @param ipv6_end_point_p Pointer to IPv6 layer-3 end point
+ *
+ * NOTE: This function is to be invoked from net_layer3_end_point_init()
+ */
+void net_layer3_ipv6_end_point_init(struct ipv6_end_point *ipv6_end_point_p)
+{
+    ipv6_address_copy(&ipv6_end_point_p->link_local_ip_addr,
+                      &g_ipv6_unspecified_addr);
+    ipv6_end_point_p->interface_id.words[0] = 0;
+    ipv6_end_point_p->interface_id.words[1] = 0;
+    ipv6_address_copy(&ipv6_end_point_p->solicited_node_multicast_addr,
+                      &g_ipv6_unspecified_addr);
+    ipv6_end_point_p->flags = 0;
+
+    rtos_mutex_init(&ipv6_end_point_p->mutex, "IPv6 end point mutex");
+    rtos_semaphore_init(&ipv6_end_point_p->flags_changed_semaphore,
+                        "IPv6 flags changed semaphore",
+                        0);
+
+    net_packet_queue_init("ICMPv6 incoming packet queue",
+                          true,
+                          &ipv6_end_point_p->rx_icmpv6_packet_queue);
+
+    net_packet_queue_init("NDP incoming packet queue",
+                          true,
+                          &ipv6_end_point_p->rx_ndp_packet_queue);
+
+    /*
+     * Initialize IPv6 neighbor cache for the layer-3 end point
+     */
+    neighbor_cache_init(&ipv6_end_point_p->neighbor_cache);
+}
+
+
+/**
+ * Start RTOS tasks for an IPv6 layer-3 end point
+ *
+ * @param ipv6_end_point_p    Pointer to IPv6 end point
+ *
+ * NOTE: This function is to be invoked from net_layer3_end_point_start_tasks()
+ */
+void net_layer3_ipv6_end_point_start_tasks(struct ipv6_end_point *ipv6_end_point_p)
+{
+    /*
+     * Create neighbor discovery packet receiver task, with higher priority
+     * than the ICMPv6 packet receiver task:
+     */
+    rtos_task_create(&ipv6_end_point_p->ndp_packet_receiver_task,
+                     "NDP packet receiver task",
+                     ndp_packet_receiver_task,
+                     ipv6_end_point_p,
+                     RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 1));
+
+    /*
+     * Create ICMPv6 packet receiver task:
+     */
+    rtos_task_create(&ipv6_end_point_p->icmpv6_packet_receiver_task,
+                     "ICMPv6 packet receiver task",
+                     icmpv6_packet_receiver_task,
+                     ipv6_end_point_p,
+                     RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 2));
+
+    /*
+     * Create IPv6 address autoconfiguration task:
+     */
+    rtos_task_create(&ipv6_end_point_p->address_autoconfiguration_task,
+                     "IPv6 address autoconfiguration task",
+                     ipv6_address_autoconfiguration_task,
+                     ipv6_end_point_p,
+                     RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 2));
+}
+
+
+/**
+ * Tells if a received IPv6 packet is addressed to a given local IPv6 end
+ * point
+ */
+static bool ipv6_packet_is_for_us(const struct ipv6_end_point *ipv6_end_point_p,
+                                  const struct ipv6_address *dest_ip_addr_p)
+{
+    if (IPV6_ADDR_IS_MULTICAST(dest_ip_addr_p)) {
+        /*
+         * NOTE: The solicited-node multicast address is set as soon as the
+         * link-local address is built, while it is still tentative, so that
+         * duplicate address detection solicitations are received.
+         */
+        return IPV6_ADDRESSES_EQUAL(dest_ip_addr_p,
+                                    &g_ipv6_all_nodes_multicast_addr) ||
+               (!IPV6_ADDR_IS_UNSPECIFIED(&ipv6_end_point_p->solicited_node_multicast_addr) &&
+                IPV6_ADDRESSES_EQUAL(dest_ip_addr_p,
+                                     &ipv6_end_point_p->solicited_node_multicast_addr));
+    }
+
+    return IPV6_ADDRESSES_EQUAL(dest_ip_addr_p,
+                                &ipv6_end_point_p->link_local_ip_addr);
+}
+
+
+/**
+ * Tells if a received ICMPv6 message is a neighbor discovery message that
+ * needs to be processed, so that the NDP packet receiver task is only woken
+ * up for neighbor discovery traffic addressed to us
+ *
+ * @param ipv6_end_point_p  Pointer to the local IPv6 end point
+ * @param rx_packet_p       Received ICMPv6 packet
+ * @param is_ndp_p          Area where it is returned whether the message is
+ *                          a neighbor solicitation or advertisement
+ *
+ * @return true, if the message is a neighbor discovery message to process
+ * @return false, otherwise
+ */
+static bool ndp_packet_is_for_us(const struct ipv6_end_point *ipv6_end_point_p,
+                                 struct network_packet *rx_packet_p,
+                                 bool *is_ndp_p)
+{
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+    struct icmpv6_header *icmpv6_header_p = GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+    size_t icmpv6_msg_length = ntoh16(ipv6_header_p->payload_length);
+
+    *is_ndp_p = false;
+    switch (icmpv6_header_p->msg_type) {
+    case ICMPV6_TYPE_NEIGHBOR_SOLICITATION: {
+        struct icmpv6_neighbor_solicitation *ns_msg_p =
+            (struct icmpv6_neighbor_solicitation *)icmpv6_header_p;
+
+        *is_ndp_p = true;
+        if (icmpv6_msg_length < sizeof(struct icmpv6_neighbor_solicitation) ||
+            !IPV6_ADDRESSES_EQUAL(&ns_msg_p->target_ip_addr,
+                                  &ipv6_end_point_p->link_local_ip_addr)) {
+            return false;
+        }
+
+        break;
+    }
+
+    case ICMPV6_TYPE_NEIGHBOR_ADVERTISEMENT:
+        *is_ndp_p = true;
+        if (icmpv6_msg_length < sizeof(struct icmpv6_neighbor_advertisement)) {
+            return false;
+        }
+
+        break;
+
+    default:
+        return false;
+    }
+
+    /*
+     * Neighbor discovery messages must come from the local link:
+     */
+    return ipv6_header_p->hop_limit == IPV6_NDP_HOP_LIMIT &&
+           icmpv6_header_p->msg_code == 0;
+}
+
+
+void net_layer3_receive_ipv6_packet(struct network_packet *rx_packet_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(rx_packet_p, sizeof *rx_packet_p, 0);
+#   endif
+
+    NET_RX_PACKET_LATENCY_STAGE(rx_packet_p, PERF_PROBE_RX_LATENCY_LAYER2_TO_LAYER3);
+
+    struct net_layer2_end_point *const layer2_end_point_p =
+        rx_packet_p->layer2_end_point_p;
+    struct net_layer3_end_point *const layer3_end_point_p =
+        layer2_end_point_p->layer3_end_point_p;
+    struct ipv6_end_point *const ipv6_end_point_p = &layer3_end_point_p->ipv6;
+
+    D_ASSERT(layer2_end_point_p->signature == NET_LAYER2_END_POINT_SIGNATURE);
+    D_ASSERT(layer3_end_point_p->signature == NET_LAYER3_END_POINT_SIGNATURE);
+
+    bool packet_dropped = true;
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv6.received_ipv6_packets_count);
+
+    if (rx_packet_p->total_length <
+            sizeof(struct ethernet_header) + sizeof(struct ipv6_header) ||
+        GET_IPV6_VERSION(ipv6_header_p) != 6 ||
+        sizeof(struct ethernet_header) + sizeof(struct ipv6_header) +
+            ntoh16(ipv6_header_p->payload_length) > rx_packet_p->total_length) {
+        net_recycle_rx_packet(rx_packet_p);
+        goto exit;
+    }
+
+    if (NET_LAYER3_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer3: IPv6 packet received:\n"
+                     "\tsource IPv6 address %x:%x:%x:%x:%x:%x:%x:%x\n"
+                     "\tNext header %#x, Payload length: %u\n",
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[0]),
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[1]),
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[2]),
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[3]),
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[4]),
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[5]),
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[6]),
+                     ntoh16(ipv6_header_p->source_ipv6_addr.hwords[7]),
+                     ipv6_header_p->next_header,
+                     ntoh16(ipv6_header_p->payload_length));
+    }
+
+    if (!ipv6_packet_is_for_us(ipv6_end_point_p, &ipv6_header_p->dest_ipv6_addr)) {
+        net_recycle_rx_packet(rx_packet_p);
+        goto exit;
+    }
+
+    /*
+     * NOTE: Protocol checksums are validated by the Ethernet MAC hardware. We
+     * just need to check the result. Packets with extension headers are not
+     * supported.
+     */
+    switch (ipv6_header_p->next_header) {
+    case IPV6_NEXT_HEADER_ICMPV6: {
+        bool is_ndp;
+
+        if (NET_RX_PACKET_PROTOCOL_CHECKSUM_BAD(rx_packet_p) ||
+            ntoh16(ipv6_header_p->payload_length) < sizeof(struct icmpv6_header)) {
+            net_recycle_rx_packet(rx_packet_p);
+            break;
+        }
+
+        if (ndp_packet_is_for_us(ipv6_end_point_p, rx_packet_p, &is_ndp)) {
+            if (ipv6_end_point_p->rx_ndp_packet_queue.length >=
+                    NDP_RX_PACKET_QUEUE_MAX_LENGTH) {
+                net_recycle_rx_packet(rx_packet_p);
+                break;
+            }
+
+            NET_PACKET_SET_STATE_FLAG(rx_packet_p, NET_PACKET_IN_NDP_QUEUE);
+            net_packet_queue_add(&ipv6_end_point_p->rx_ndp_packet_queue,
+                                 rx_packet_p);
+            packet_dropped = false;
+            break;
+        }
+
+        if (is_ndp ||
+            ipv6_end_point_p->rx_icmpv6_packet_queue.length >=
+                ICMPV6_RX_PACKET_QUEUE_MAX_LENGTH) {
+            net_recycle_rx_packet(rx_packet_p);
+            break;
+        }
+
+        NET_PACKET_SET_STATE_FLAG(rx_packet_p, NET_PACKET_IN_ICMPV6_QUEUE);
+        net_packet_queue_add(&ipv6_end_point_p->rx_icmpv6_packet_queue,
+                             rx_packet_p);
+        packet_dropped = false;
+        break;
+    }
+
+    case IPV6_NEXT_HEADER_UDP:
+        if (!(ipv6_end_point_p->flags & IPV6_LINK_LOCAL_ADDR_READY) ||
+            ntoh16(ipv6_header_p->payload_length) < sizeof(struct udp_header)) {
+            net_recycle_rx_packet(rx_packet_p);
+            break;
+        }
+
+        net_layer4_process_incoming_udp_datagram(rx_packet_p);
+        packet_dropped = false;
+        break;
+
+    default:
+        if (NET_LAYER3_TRACING_ON()) {
+            DEBUG_PRINTF("Net layer3: Received IPv6 packet with unsupported "
+                         "next header: %#x\n",
+                         ipv6_header_p->next_header);
+        }
+
+        net_recycle_rx_packet(rx_packet_p);
+    }
+
+exit:
+    if (packet_dropped) {
+        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer3.ipv6.rx_packets_dropped_count);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Retrieve the link-local IPv6 address of the first local IPv6 end point
+ *
+ * @param ip_addr_p    Pointer to area where IPv6 address is to be returned
+ *
+ * @return true, if the address is ready to be used
+ * @return false, if the address is not ready yet (duplicate address detection
+ *         not done or failed)
+ */
+bool net_layer3_get_local_ipv6_address(struct ipv6_address *ip_addr_p)
+{
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    struct ipv6_end_point *const ipv6_end_point_p =
+        &g_net_layer3.local_layer3_end_points[0].ipv6;
+    bool addr_ready = (ipv6_end_point_p->flags & IPV6_LINK_LOCAL_ADDR_READY) != 0;
+
+    ipv6_address_copy(ip_addr_p, &ipv6_end_point_p->link_local_ip_addr);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return addr_ready;
+}
+
+
+error_t net_layer3_send_ipv6_ping_request(
+    const struct ipv6_address *dest_ip_addr_p,
+    uint16_t identifier,
+    uint16_t seq_num)
+{
+    error_t error;
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(dest_ip_addr_p, sizeof *dest_ip_addr_p, 0);
+#   endif
+
+    rtos_mutex_lock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+    while (g_net_layer3.ipv6.expecting_ping_ipv6_reply) {
+        rtos_mutex_unlock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+        rtos_semaphore_wait(&g_net_layer3.ipv6.ping_ipv6_reply_received_semaphore);
+        rtos_mutex_lock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+    }
+
+    g_net_layer3.ipv6.expecting_ping_ipv6_reply = true;
+    rtos_mutex_unlock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(ICMPV6_ECHO_FRAME_LENGTH, true);
+
+    D_ASSERT(tx_packet_p != NULL);
+    struct icmpv6_echo_message *echo_msg_p = GET_IPV6_DATA_PAYLOAD_AREA(tx_packet_p);
+
+    net_layer3_populate_icmpv6_header(&echo_msg_p->header, ICMPV6_TYPE_ECHO_REQ, 0);
+    echo_msg_p->identifier = identifier;
+    echo_msg_p->seq_num = seq_num;
+    error = net_layer3_send_ipv6_packet(dest_ip_addr_p,
+                                        tx_packet_p,
+                                        sizeof(struct icmpv6_echo_message),
+                                        IPV6_NEXT_HEADER_ICMPV6);
+    if (error != 0) {
+        rtos_mutex_lock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+        g_net_layer3.ipv6.expecting_ping_ipv6_reply = false;
+        rtos_mutex_unlock(&g_net_layer3.ipv6.expecting_ping_ipv6_reply_mutex);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+error_t net_layer3_receive_ipv6_ping_reply(
+    uint32_t timeout_ms,
+    struct ipv6_address *remote_ip_addr_p,
+    uint16_t *identifier_p,
+    uint16_t *seq_num_p)
+{
+    error_t error;
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer3,
+                                sizeof g_net_layer3,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    struct network_packet *rx_packet_p = net_packet_queue_remove(
+        &g_net_layer3.ipv6.rx_ipv6_ping_reply_packet_queue, timeout_ms);
+
+    if (rx_packet_p == NULL) {
+        error = CAPTURE_ERROR("No Rx packet available", timeout_ms, 0);
+        goto exit;
+    }
+
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+    struct icmpv6_echo_message *echo_msg_p = GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+
+    ipv6_address_copy(remote_ip_addr_p, &ipv6_header_p->source_ipv6_addr);
+    *identifier_p = echo_msg_p->identifier;
+    *seq_num_p = echo_msg_p->seq_num;
+    net_recycle_rx_packet(rx_packet_p);
+    error = 0;
+
+exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
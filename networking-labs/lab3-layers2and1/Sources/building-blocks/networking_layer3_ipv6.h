@@ -14,11 +14,100 @@
 #include "io_utils.h"
 #include "compile_time_checks.h"
 #include "network_packet.h"
+#include "net_config.h"
+
+/**
+ * Number of hash buckets of the IPv6 neighbor cache table (must be a power
+ * of 2)
+ */
+#define NEIGHBOR_CACHE_NUM_BUCKETS    NET_CONFIG_NEIGHBOR_CACHE_NUM_BUCKETS
+
+C_ASSERT(IS_POWER_OF_2(NEIGHBOR_CACHE_NUM_BUCKETS));
+
+/**
+ * Number of entries per hash bucket of the IPv6 neighbor cache table
+ */
+#define NEIGHBOR_CACHE_BUCKET_NUM_ENTRIES    2
 
 /**
  * Number of entries for the IPv6 Neighbor cache table
  */
-#define NEIGHBOR_CACHE_NUM_ENTRIES  16
+#define NEIGHBOR_CACHE_NUM_ENTRIES \
+        (NEIGHBOR_CACHE_NUM_BUCKETS * NEIGHBOR_CACHE_BUCKET_NUM_ENTRIES)
+
+/**
+ * Maximum number of times that a lock-free neighbor cache lookup is retried,
+ * because the bucket was concurrently updated, before falling back to
+ * a lookup with the neighbor cache mutex held
+ */
+#define NEIGHBOR_CACHE_LOCK_FREE_LOOKUP_MAX_RETRIES  4
+
+/**
+ * Time in ticks that a neighbor is considered reachable after its link-layer
+ * address was confirmed (20 minutes, as for ARP cache entries)
+ */
+#define NEIGHBOR_CACHE_ENTRY_LIFETIME_IN_TICKS \
+    MILLISECONDS_TO_TICKS(20u * 60 * 1000)
+
+/**
+ * Age in ticks after which a neighbor cache entry that is being used is
+ * refreshed with a unicast neighbor solicitation, while its current mapping
+ * is still used (the last minute of its lifetime)
+ */
+#define NEIGHBOR_CACHE_ENTRY_REFRESH_AGE_IN_TICKS \
+    (NEIGHBOR_CACHE_ENTRY_LIFETIME_IN_TICKS - MILLISECONDS_TO_TICKS(60u * 1000))
+
+/**
+ * Minimum time in milliseconds to wait for a neighbor advertisement after
+ * sending a neighbor solicitation, before sending another one for the same
+ * destination IPv6 address (RFC 4861 RETRANS_TIMER)
+ */
+#define NEIGHBOR_SOLICITATION_RESEND_INTERVAL_IN_MS    1000
+
+/**
+ * Maximum number of Tx packets that can be queued in a neighbor cache entry,
+ * waiting for the entry to be resolved. When the queue is full, the oldest
+ * packet is dropped.
+ */
+#define NEIGHBOR_PENDING_TX_QUEUE_MAX_PACKETS    4
+
+/**
+ * Maximum number of ICMPv6 packets waiting to be processed by the ICMPv6
+ * packet receiver task of an IPv6 end point. Further ICMPv6 packets are
+ * dropped.
+ */
+#define ICMPV6_RX_PACKET_QUEUE_MAX_LENGTH   4
+
+/**
+ * Maximum number of neighbor discovery (neighbor solicitation/advertisement)
+ * packets waiting to be processed by the NDP packet receiver task of an IPv6
+ * end point. Further NDP packets are dropped.
+ */
+#define NDP_RX_PACKET_QUEUE_MAX_LENGTH      8
+
+/**
+ * Time in milliseconds to wait for a neighbor advertisement that reveals a
+ * duplicate link-local address, after sending the duplicate address
+ * detection neighbor solicitation (RFC 4862 RetransTimer)
+ */
+#define IPV6_DUP_ADDR_DETECTION_TIMEOUT_IN_MS   1000
+
+/**
+ * Default hop limit of outgoing IPv6 packets
+ */
+#define IPV6_DEFAULT_HOP_LIMIT  64
+
+/**
+ * Hop limit of outgoing neighbor discovery messages. Received neighbor
+ * discovery messages with a different hop limit are dropped (RFC 4861).
+ */
+#define IPV6_NDP_HOP_LIMIT      255
+
+/**
+ * IPv6 next header values
+ */
+#define IPV6_NEXT_HEADER_UDP        0x11
+#define IPV6_NEXT_HEADER_ICMPV6     0x3a
 
 /**
  * Timeout in milliseconds to wait for a neighbor advertisement after sending a
@@ -54,17 +143,111 @@ struct ipv6_address {
 
 	/**
 	 * Address seen as four 32-bit words
+	 *
+	 * NOTE: There is no 64-bit view, as the Cortex-M4 has no 64-bit
+	 * registers. Addresses are only word-aligned and are always handled
+	 * as four 32-bit words.
 	 */
         uint32_t words[4];
-
-	/**
-	 * Address seen as two 64-bit double-words
-	 */
-	uint64_t dwords[2];
     };
-}  __attribute__ ((aligned(sizeof(uint64_t))));
+}  __attribute__ ((aligned(sizeof(uint32_t))));
+
+C_ASSERT(sizeof(struct ipv6_address) == sizeof(uint32_t) * 4);
+C_ASSERT(__alignof__(struct ipv6_address) == sizeof(uint32_t));
+
+/**
+ * Interface Id of an IPv6 address (low-order 64 bits) in network byte order
+ */
+struct ipv6_interface_id {
+    uint32_t words[2];
+};
+
+C_ASSERT(sizeof(struct ipv6_interface_id) == sizeof(uint32_t) * 2);
+
+/**
+ * Check if two IPv6 addresses are equal, with word compares and a single
+ * branch
+ */
+static inline bool ipv6_addresses_equal(const struct ipv6_address *ipv6_addr1_p,
+                                        const struct ipv6_address *ipv6_addr2_p)
+{
+    return ((ipv6_addr1_p->words[0] ^ ipv6_addr2_p->words[0]) |
+            (ipv6_addr1_p->words[1] ^ ipv6_addr2_p->words[1]) |
+            (ipv6_addr1_p->words[2] ^ ipv6_addr2_p->words[2]) |
+            (ipv6_addr1_p->words[3] ^ ipv6_addr2_p->words[3])) == 0;
+}
+
+
+/**
+ * Check if an IPv6 address is the unspecified address (::)
+ */
+static inline bool ipv6_address_is_unspecified(const struct ipv6_address *ipv6_addr_p)
+{
+    return (ipv6_addr_p->words[0] | ipv6_addr_p->words[1] |
+            ipv6_addr_p->words[2] | ipv6_addr_p->words[3]) == 0;
+}
+
+
+/**
+ * Copy an IPv6 address, as four word stores
+ */
+static inline void ipv6_address_copy(struct ipv6_address *dest_ipv6_addr_p,
+                                     const struct ipv6_address *src_ipv6_addr_p)
+{
+    dest_ipv6_addr_p->words[0] = src_ipv6_addr_p->words[0];
+    dest_ipv6_addr_p->words[1] = src_ipv6_addr_p->words[1];
+    dest_ipv6_addr_p->words[2] = src_ipv6_addr_p->words[2];
+    dest_ipv6_addr_p->words[3] = src_ipv6_addr_p->words[3];
+}
+
+
+/**
+ * Hash an IPv6 address into a table of 'num_buckets' buckets (must be a
+ * power of 2)
+ *
+ * NOTE: The low-order 64 bits (interface ID) are the ones that vary the
+ * most among on-link neighbors, which mostly share the same prefix.
+ */
+static inline uint32_t ipv6_address_hash(const struct ipv6_address *ipv6_addr_p,
+                                         uint32_t num_buckets)
+{
+    uint32_t hash = ipv6_addr_p->words[2] ^ ipv6_addr_p->words[3];
+
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+    return hash & (num_buckets - 1);
+}
+
+
+/**
+ * Check if two IPv6 addresses are equal
+ */
+#define IPV6_ADDRESSES_EQUAL(_ipv6_addr1_p, _ipv6_addr2_p) \
+        ipv6_addresses_equal(_ipv6_addr1_p, _ipv6_addr2_p)
+
+/**
+ * Check if an IPv6 address is the unspecified address (::)
+ */
+#define IPV6_ADDR_IS_UNSPECIFIED(_ipv6_addr_p) \
+        ipv6_address_is_unspecified(_ipv6_addr_p)
+
+/**
+ * Check if an IPv6 address is a multicast address (ff00::/8)
+ */
+#define IPV6_ADDR_IS_MULTICAST(_ipv6_addr_p) \
+        ((_ipv6_addr_p)->bytes[0] == 0xff)
 
-C_ASSERT(sizeof(struct ipv6_address) == sizeof(uint64_t) * 2);
+/**
+ * Check if an IPv6 address is the solicited-node multicast address
+ * (ff02::1:ffxx:xxxx) of a given IPv6 unicast address
+ */
+#define IPV6_ADDR_IS_SOLICITED_NODE_MULTICAST(_ipv6_addr_p, _unicast_addr_p) \
+        ((_ipv6_addr_p)->words[0] == hton32(UINT32_C(0xff020000)) &&       \
+         (_ipv6_addr_p)->words[1] == 0 &&                                  \
+         (_ipv6_addr_p)->words[2] == hton32(UINT32_C(0x1)) &&              \
+         (_ipv6_addr_p)->bytes[12] == 0xff &&                              \
+         (_ipv6_addr_p)->bytes[13] == (_unicast_addr_p)->bytes[13] &&      \
+         (_ipv6_addr_p)->hwords[7] == (_unicast_addr_p)->hwords[7])
 
 /**
  * Header of an IPv6 packet in network byte order
@@ -109,8 +292,38 @@ struct ipv6_header {
 };
 
 C_ASSERT(sizeof(struct ipv6_header) == 40);
-C_ASSERT(offsetof(struct ipv6_header, source_ipv6_addr) % sizeof(uint64_t) == 0);
-C_ASSERT(offsetof(struct ipv6_header, dest_ipv6_addr) % sizeof(uint64_t) == 0);
+
+/**
+ * Returns pointer to the IPv6 header of an IPv6 packet
+ */
+#define GET_IPV6_HEADER(_net_packet_p) \
+        ((struct ipv6_header *)((_net_packet_p)->data_buffer +    \
+                sizeof(struct ethernet_header)))
+
+/**
+ * Returns pointer to the data payload area of an IPv6 packet without
+ * extension headers
+ */
+#define GET_IPV6_DATA_PAYLOAD_AREA(_net_packet_p)   \
+        ((void *)((_net_packet_p)->data_buffer +    \
+          (sizeof(struct ethernet_header) + \
+                   sizeof(struct ipv6_header))))
+
+/**
+ * Get IP version from the first byte of an IPv6 header
+ */
+#define GET_IPV6_VERSION(_ipv6_header_p) \
+        GET_BIT_FIELD((_ipv6_header_p)->first_word.bytes[0], \
+                      IPv6_VERSION_MASK, IPv6_VERSION_SHIFT)
+C_ASSERT(offsetof(struct ipv6_header, source_ipv6_addr) % sizeof(uint32_t) == 0);
+C_ASSERT(offsetof(struct ipv6_header, dest_ipv6_addr) % sizeof(uint32_t) == 0);
+
+/*
+ * The IPv6 header follows the 16-byte Ethernet header (which includes the
+ * 2-byte alignment pad), so its addresses are word-aligned in packet buffers:
+ */
+C_ASSERT((sizeof(struct ethernet_header) +
+          offsetof(struct ipv6_header, source_ipv6_addr)) % sizeof(uint32_t) == 0);
 
 /**
  * IPv6 ICMPv6 header layout
@@ -157,6 +370,8 @@ struct icmpv6_neighbor_solicitation {
 
 C_ASSERT(sizeof(struct icmpv6_neighbor_solicitation) == 24);
 C_ASSERT(offsetof(struct icmpv6_neighbor_solicitation, target_ip_addr) == 8);
+C_ASSERT(offsetof(struct icmpv6_neighbor_solicitation, target_ip_addr) %
+         sizeof(uint32_t) == 0);
 C_ASSERT(offsetof(struct icmpv6_neighbor_solicitation, options) == 24);
 
 /**
@@ -181,8 +396,28 @@ struct icmpv6_neighbor_advertisement {
 
 C_ASSERT(sizeof(struct icmpv6_neighbor_advertisement) == 24);
 C_ASSERT(offsetof(struct icmpv6_neighbor_advertisement, target_ip_addr) == 8);
+C_ASSERT(offsetof(struct icmpv6_neighbor_advertisement, target_ip_addr) %
+         sizeof(uint32_t) == 0);
 C_ASSERT(offsetof(struct icmpv6_neighbor_advertisement, options) == 24);
 
+/**
+ * ICMPv6 neighbor discovery link-layer address option, for Ethernet
+ */
+struct icmpv6_link_layer_addr_option {
+    uint8_t type;
+#   define ICMPV6_OPTION_SOURCE_LINK_LAYER_ADDR 1
+#   define ICMPV6_OPTION_TARGET_LINK_LAYER_ADDR 2
+
+    /**
+     * Length of the option in units of 8 bytes
+     */
+    uint8_t length;
+
+    struct ethernet_mac_address mac_addr;
+};
+
+C_ASSERT(sizeof(struct icmpv6_link_layer_addr_option) == 8);
+
 /**
  * ICMPv6 echo request/reply message layout
  */
@@ -204,8 +439,29 @@ enum neighbor_cache_entry_states {
     NEIGHBOR_ENTRY_PROBE,
 };
 
+/**
+ * IPv6 packet waiting for the resolution of its next-hop MAC address
+ */
+struct neighbor_pending_tx_packet {
+    /**
+     * Tx packet, owned by the networking stack (it has
+     * NET_PACKET_FREE_AFTER_TX_COMPLETE set)
+     */
+    struct network_packet *tx_packet_p;
+
+    /**
+     * Length of the IPv6 packet (IPv6 header + IPv6 payload)
+     */
+    uint16_t ipv6_packet_length;
+};
+
 /**
  * IPv6 neighbor cache entry
+ *
+ * NOTE: Only the states NEIGHBOR_ENTRY_INVALID, NEIGHBOR_ENTRY_INCOMPLETE
+ * (neighbor solicitation sent but no advertisement received yet) and
+ * NEIGHBOR_ENTRY_REACHABLE are used. Reachability is refreshed the same way
+ * as for ARP cache entries, rather than with the full NUD state machine.
  */
 struct neighbor_cache_entry {
     struct ipv6_address dest_ipv6_addr;
@@ -215,36 +471,79 @@ struct neighbor_cache_entry {
     /**
      * Timestamp in ticks when the last neighbor solicitation for this entry was sent.
      * It is used to determine if we have waited too long for the neighbor advertisement,
-     * and need to send another neighbor solicitation.
+     * and need to send another neighbor solicitation. For a reachable entry,
+     * it is used to rate-limit refresh neighbor solicitations.
      */
     uint32_t neighbor_solicitation_time_stamp;
 
+    /**
+     * Timestamp in ticks when the neighbor's link-layer address was last
+     * confirmed. It is used to determine when the entry has expired.
+     */
+    uint32_t entry_filled_time_stamp;
+
     /**
      * Timestamp in ticks when the last lookup was done for this entry. It is
      * used to determine the least recently used entry, for cache entry
      * replacement.
      */
     uint32_t last_lookup_time_stamp;
+
+    /**
+     * Number of neighbor solicitations sent for the current resolution of
+     * this entry
+     */
+    uint8_t neighbor_solicitation_count;
+
+    /**
+     * Number of entries used in pending_tx_packets[]. Only meaningful in
+     * state NEIGHBOR_ENTRY_INCOMPLETE.
+     */
+    uint8_t num_pending_tx_packets;
+
+    /**
+     * Tx packets waiting for this entry to be resolved, in FIFO order. They
+     * are transmitted when the neighbor advertisement is received.
+     */
+    struct neighbor_pending_tx_packet pending_tx_packets[NEIGHBOR_PENDING_TX_QUEUE_MAX_PACKETS];
 };
 
+C_ASSERT(NEIGHBOR_PENDING_TX_QUEUE_MAX_PACKETS <= UINT8_MAX);
+C_ASSERT(NEIGHBOR_SOLICITATION_MAX_RETRIES <= UINT8_MAX);
+
 /**
- * IPv6 Neighbor cache
+ * IPv6 neighbor cache hash bucket
  */
-struct neighbor_cache {
+struct neighbor_cache_bucket {
     /**
-     * Mutex to serialize access to the Neighbor cache
+     * Sequence count for lock-free readers (seqlock). It is odd while an
+     * updater (holding the neighbor cache mutex) is modifying the bucket's
+     * entries.
      */
-    struct rtos_mutex mutex;
+    volatile uint32_t sequence_count;
 
     /**
-     * Condvar signaled when the neighbor cache is updated
+     * Entries of the bucket
      */
-    struct rtos_semaphore cache_updated_semaphore;
+    struct neighbor_cache_entry entries[NEIGHBOR_CACHE_BUCKET_NUM_ENTRIES];
+};
 
+/**
+ * IPv6 Neighbor cache, as a hash table keyed by IPv6 address, with the same
+ * design as the IPv4 ARP cache. Neighbor cache hits are served without taking
+ * the mutex.
+ */
+struct neighbor_cache {
     /**
-     * Array of cache entries
+     * Mutex to serialize updates to the Neighbor cache, including the pending
+     * Tx packet queues of its entries
      */
-    struct neighbor_cache_entry entries[NEIGHBOR_CACHE_NUM_ENTRIES];
+    struct rtos_mutex mutex;
+
+    /**
+     * Hash buckets
+     */
+    struct neighbor_cache_bucket buckets[NEIGHBOR_CACHE_NUM_BUCKETS];
 };
 
 /**
@@ -259,7 +558,7 @@ struct ipv6_end_point {
     /**
      * Inteface Id (modified EUI-64 Id)
      */
-    uint64_t interface_id;
+    struct ipv6_interface_id interface_id;
 
     /**
      * Flags
@@ -280,10 +579,24 @@ struct ipv6_end_point {
     struct rtos_semaphore flags_changed_semaphore;
 
     /**
-     * Queue of received ICMPv6 packets
+     * Solicited-node multicast address of the link-local address. Its
+     * Ethernet multicast address is added to the Ethernet MAC's multicast
+     * filter when the link-local address is configured.
+     */
+    struct ipv6_address solicited_node_multicast_addr;
+
+    /**
+     * Queue of received ICMPv6 packets, other than neighbor discovery ones
      */
     struct net_packet_queue rx_icmpv6_packet_queue;
 
+    /**
+     * Queue of received neighbor solicitations and advertisements. It is
+     * served by a higher priority task than rx_icmpv6_packet_queue, so that
+     * neighbor discovery is not delayed behind echo requests.
+     */
+    struct net_packet_queue rx_ndp_packet_queue;
+
     /**
      * Neighbor cache
      */
@@ -298,6 +611,11 @@ struct ipv6_end_point {
      * ICMPv6 packet receiver task
      */
     struct rtos_task icmpv6_packet_receiver_task;
+
+    /**
+     * Neighbor discovery packet receiver task
+     */
+    struct rtos_task ndp_packet_receiver_task;
 };
 
 /**
@@ -313,7 +631,25 @@ struct net_layer3_ipv6 {
     /**
      * Number of IPv6 packets received
      */
-    uint32_t received_ipv6_packets_count;
+    volatile uint32_t received_ipv6_packets_count;
+
+    /**
+     * Number of received IPv6 packets dropped (included in
+     * received_ipv6_packets_count)
+     */
+    volatile uint32_t rx_packets_dropped_count;
+
+    /**
+     * Number of IPv6 packets sent
+     */
+    volatile uint32_t sent_packets_count;
+
+    /**
+     * Number of IPv6 packets dropped while waiting for the resolution of their
+     * next-hop MAC address (pending queue overflow, neighbor cache entry
+     * evicted or destination unreachable)
+     */
+    volatile uint32_t neighbor_pending_tx_packets_dropped_count;
 
     /**
      * Queue of received IPPv6 ping replies
@@ -340,4 +676,22 @@ void net_layer3_ipv6_end_point_start_tasks(struct ipv6_end_point *ipv6_end_point
 
 void net_layer3_receive_ipv6_packet(struct network_packet *rx_packet_p);
 
+error_t net_layer3_send_ipv6_packet(const struct ipv6_address *dest_ip_addr_p,
+                                    struct network_packet *tx_packet_p,
+                                    size_t data_payload_length,
+                                    uint_fast8_t next_header);
+
+bool net_layer3_get_local_ipv6_address(struct ipv6_address *ip_addr_p);
+
+error_t net_layer3_send_ipv6_ping_request(
+    const struct ipv6_address *dest_ip_addr_p,
+    uint16_t identifier,
+    uint16_t seq_num);
+
+error_t net_layer3_receive_ipv6_ping_reply(
+    uint32_t timeout_ms,
+    struct ipv6_address *remote_ip_addr_p,
+    uint16_t *identifier_p,
+    uint16_t *seq_num_p);
+
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER3_IPV6_H_ */
@@ -17,11 +17,6 @@
 struct net_layer4 g_net_layer4 = {
     .initialized = false,
     .tracing_on = false,
-	.udp = {
-		.rx_packets_accepted_count = 0,
-		.rx_packets_dropped_count = 0,
-		.sent_packets_over_ipv4_count = 0,
-	},
 };
 
 /**
@@ -43,6 +38,7 @@ void net_layer4_init(void)
     D_ASSERT(!g_net_layer4.initialized);
 
     net_layer4_udp_init(&g_net_layer4.udp);
+    net_layer4_tcp_init(&g_net_layer4.tcp);
 
     g_net_layer4.initialized = true;
 
@@ -65,13 +61,83 @@ void net_layer4_end_point_init(struct net_layer4_end_point *layer4_end_point_p,
 {
 	layer4_end_point_p->next_p = NULL;
 	layer4_end_point_p->list_p = NULL;
+	layer4_end_point_p->hash_chain_next_p = NULL;
     layer4_end_point_p->protocol = protocol;
     layer4_end_point_p->layer4_port = 0; /* unbound */
+    layer4_end_point_p->num_lent_rx_packets = 0;
+    layer4_end_point_p->max_held_rx_packets =
+        NET_LAYER4_END_POINT_DEFAULT_MAX_HELD_RX_PACKETS;
+    layer4_end_point_p->rx_packets_accepted_count = 0;
+    layer4_end_point_p->rx_packets_dropped_count = 0;
+    layer4_end_point_p->connected_flow_p = NULL;
+    layer4_end_point_p->connected_peer_ipv4_addr = IPV4_NULL_ADDR;
+    layer4_end_point_p->connected_peer_port = 0; /* not connected */
+    layer4_end_point_p->poll_group_p = NULL;
+    layer4_end_point_p->rx_callback_p = NULL;
+    layer4_end_point_p->rx_callback_arg = NULL;
+    layer4_end_point_p->rx_callback_cycle_budget = 0;
+    layer4_end_point_p->shared_port = false;
+    layer4_end_point_p->load_balancing = NET_LAYER4_BALANCE_BY_SOURCE_HASH;
+    layer4_end_point_p->round_robin_count = 0;
+    for (unsigned int i = 0;
+         i < NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS; i ++) {
+        layer4_end_point_p->ipv4_multicast_groups[i] = IPV4_NULL_ADDR;
+    }
+
     net_packet_queue_init("Layer4 end point Rx packet queue", true,
                           &layer4_end_point_p->rx_packet_queue);
 }
 
 
+/**
+ * Sets the maximum number of received packets that a layer-4 end point can
+ * hold at any given time (queued in its Rx queue plus lent to the application)
+ *
+ * @param layer4_end_point_p    Pointer to layer-4 end point
+ * @param max_held_rx_packets   New maximum, between 1 and
+ *                              NET_LAYER4_END_POINT_MAX_HELD_RX_PACKETS_LIMIT
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_end_point_set_max_held_rx_packets(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint16_t max_held_rx_packets)
+{
+    if (max_held_rx_packets == 0 ||
+        max_held_rx_packets > NET_LAYER4_END_POINT_MAX_HELD_RX_PACKETS_LIMIT) {
+        return CAPTURE_ERROR("Invalid layer-4 end point Rx packets limit",
+                             layer4_end_point_p, max_held_rx_packets);
+    }
+
+    /*
+     * NOTE: A single halfword store, so the Rx path can read it without a lock.
+     * Packets already held in excess of a lowered limit are not dropped.
+     */
+    layer4_end_point_p->max_held_rx_packets = max_held_rx_packets;
+    return 0;
+}
+
+
+/**
+ * Gets the Rx statistics of a layer-4 end point
+ *
+ * @param layer4_end_point_p    Pointer to layer-4 end point
+ * @param stats_p               Area where the statistics are to be returned
+ */
+void net_layer4_end_point_get_stats(const struct net_layer4_end_point *layer4_end_point_p,
+                                    struct net_layer4_end_point_stats *stats_p)
+{
+    stats_p->rx_packets_accepted_count = layer4_end_point_p->rx_packets_accepted_count;
+    stats_p->rx_packets_dropped_count = layer4_end_point_p->rx_packets_dropped_count;
+    stats_p->rx_queue_length = layer4_end_point_p->rx_packet_queue.length;
+    stats_p->rx_queue_length_high_water_mark =
+        layer4_end_point_p->rx_packet_queue.length_high_water_mark;
+    stats_p->num_lent_rx_packets = layer4_end_point_p->num_lent_rx_packets;
+    stats_p->max_held_rx_packets = layer4_end_point_p->max_held_rx_packets;
+}
+
+
 /**
  * Initializes a list of layer-4 end points
  *
@@ -203,6 +269,203 @@ void net_layer4_end_point_list_remove(struct net_layer4_end_point_list *list_p,
 }
 
 
+/**
+ * Initializes a poll group of layer-4 end points
+ *
+ * @param poll_group_p  Pointer to the poll group
+ * @param name_p        Name of the poll group (null-terminated string)
+ */
+void net_layer4_poll_group_init(struct net_layer4_poll_group *poll_group_p,
+                                const char *name_p)
+{
+    poll_group_p->signature = NET_LAYER4_POLL_GROUP_SIGNATURE;
+    poll_group_p->num_end_points = 0;
+    poll_group_p->next_scan_index = 0;
+    for (unsigned int i = 0; i < NET_LAYER4_POLL_GROUP_MAX_END_POINTS; i ++) {
+        poll_group_p->end_points[i] = NULL;
+    }
+
+    rtos_semaphore_init(&poll_group_p->semaphore, name_p, 0);
+    rtos_mutex_init(&poll_group_p->mutex, name_p);
+}
+
+
+/**
+ * Adds a layer-4 end point to a poll group. An end point can be in at most
+ * one poll group at a time.
+ *
+ * @param poll_group_p          Pointer to the poll group
+ * @param layer4_end_point_p    Pointer to the end point to add
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_poll_group_add(struct net_layer4_poll_group *poll_group_p,
+                                  struct net_layer4_end_point *layer4_end_point_p)
+{
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(poll_group_p->signature == NET_LAYER4_POLL_GROUP_SIGNATURE);
+
+    rtos_mutex_lock(&poll_group_p->mutex);
+
+    if (layer4_end_point_p->poll_group_p != NULL) {
+        error = CAPTURE_ERROR("Layer-4 end point already in a poll group",
+                              layer4_end_point_p,
+                              layer4_end_point_p->poll_group_p);
+        goto exit;
+    }
+
+    if (poll_group_p->num_end_points == NET_LAYER4_POLL_GROUP_MAX_END_POINTS) {
+        error = CAPTURE_ERROR("Poll group full", poll_group_p,
+                              layer4_end_point_p);
+        goto exit;
+    }
+
+    poll_group_p->end_points[poll_group_p->num_end_points] = layer4_end_point_p;
+    poll_group_p->num_end_points ++;
+    layer4_end_point_p->poll_group_p = poll_group_p;
+
+    /*
+     * Packets already queued for the end point would not wake up the group:
+     */
+    if (layer4_end_point_p->rx_packet_queue.length != 0) {
+        rtos_semaphore_signal(&poll_group_p->semaphore);
+    }
+
+exit:
+    rtos_mutex_unlock(&poll_group_p->mutex);
+    return error;
+}
+
+
+/**
+ * Removes a layer-4 end point from a poll group
+ *
+ * @param poll_group_p          Pointer to the poll group
+ * @param layer4_end_point_p    Pointer to the end point to remove
+ */
+void net_layer4_poll_group_remove(struct net_layer4_poll_group *poll_group_p,
+                                  struct net_layer4_end_point *layer4_end_point_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(poll_group_p->signature == NET_LAYER4_POLL_GROUP_SIGNATURE);
+
+    rtos_mutex_lock(&poll_group_p->mutex);
+
+    for (unsigned int i = 0; i < poll_group_p->num_end_points; i ++) {
+        if (poll_group_p->end_points[i] == layer4_end_point_p) {
+            poll_group_p->num_end_points --;
+            poll_group_p->end_points[i] =
+                poll_group_p->end_points[poll_group_p->num_end_points];
+            poll_group_p->end_points[poll_group_p->num_end_points] = NULL;
+            layer4_end_point_p->poll_group_p = NULL;
+            break;
+        }
+    }
+
+    if (poll_group_p->next_scan_index >= poll_group_p->num_end_points) {
+        poll_group_p->next_scan_index = 0;
+    }
+
+    rtos_mutex_unlock(&poll_group_p->mutex);
+}
+
+
+/**
+ * Scans the members of a poll group for end points with received packets
+ * queued. It must be called with the group's mutex held.
+ *
+ * @return number of ready end points stored in ready_end_points[]
+ */
+static unsigned int poll_group_scan(struct net_layer4_poll_group *poll_group_p,
+                                    struct net_layer4_end_point *ready_end_points[],
+                                    unsigned int max_ready_end_points)
+{
+    unsigned int num_ready = 0;
+    unsigned int num_end_points = poll_group_p->num_end_points;
+    unsigned int i = poll_group_p->next_scan_index;
+
+    for (unsigned int n = 0; n < num_end_points; n ++) {
+        struct net_layer4_end_point *layer4_end_point_p =
+            poll_group_p->end_points[i];
+
+        i ++;
+        if (i == num_end_points) {
+            i = 0;
+        }
+
+        if (layer4_end_point_p->rx_packet_queue.length != 0) {
+            ready_end_points[num_ready] = layer4_end_point_p;
+            num_ready ++;
+            if (num_ready == max_ready_end_points) {
+                break;
+            }
+        }
+    }
+
+    poll_group_p->next_scan_index = i;
+    return num_ready;
+}
+
+
+/**
+ * Waits until at least one end point of a poll group has received packets
+ * queued. The ready end points can then be read without blocking.
+ *
+ * @param poll_group_p          Pointer to the poll group
+ * @param timeout_ms            0, or timeout (in milliseconds) for waiting
+ * @param ready_end_points      Area where the ready end points are returned
+ * @param max_ready_end_points  Number of entries in ready_end_points[]
+ *
+ * @return number of ready end points returned in ready_end_points[], or 0
+ *         on timeout
+ */
+unsigned int net_layer4_poll_group_wait(struct net_layer4_poll_group *poll_group_p,
+                                        uint32_t timeout_ms,
+                                        struct net_layer4_end_point *ready_end_points[],
+                                        unsigned int max_ready_end_points)
+{
+    unsigned int num_ready;
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(poll_group_p->signature == NET_LAYER4_POLL_GROUP_SIGNATURE);
+    D_ASSERT(max_ready_end_points != 0);
+
+    for ( ; ; ) {
+        rtos_mutex_lock(&poll_group_p->mutex);
+        num_ready = poll_group_scan(poll_group_p, ready_end_points,
+                                    max_ready_end_points);
+        rtos_mutex_unlock(&poll_group_p->mutex);
+        if (num_ready != 0) {
+            break;
+        }
+
+        /*
+         * NOTE: The semaphore may have been signaled for packets that were
+         * already consumed, so after waking up, the members are scanned
+         * again.
+         */
+        if (timeout_ms == 0) {
+            rtos_semaphore_wait(&poll_group_p->semaphore);
+        } else {
+            uint32_t elapsed_ms = RTOS_TICKS_TO_MILLISECONDS(
+                RTOS_TICKS_DELTA(start_ticks, rtos_get_ticks_since_boot()));
+
+            if (elapsed_ms >= timeout_ms ||
+                !rtos_semaphore_wait_timeout(&poll_group_p->semaphore,
+                                             timeout_ms - elapsed_ms)) {
+                break;
+            }
+        }
+    }
+
+    return num_ready;
+}
+
+
 void net_layer4_start_tracing(void)
 {
 	g_net_layer4.tracing_on = true;
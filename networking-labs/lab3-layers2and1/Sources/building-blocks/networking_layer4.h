@@ -10,8 +10,10 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "runtime_log.h"
 #include "net_layer4_end_point.h"
 #include "networking_layer4_udp.h"
+#include "networking_layer4_tcp.h"
 
 /**
  * First ephemeral port. All port number greater or equal
@@ -38,6 +40,11 @@ struct net_layer4 {
      */
     struct net_layer4_udp udp;
 
+    /**
+     * TCP specific
+     */
+    struct net_layer4_tcp tcp;
+
     /*
      * NOTE: Other protocol-specific layer-4 structures
      * can be added here as needed
@@ -52,6 +59,27 @@ void net_layer4_init(void);
 void net_layer4_end_point_init(struct net_layer4_end_point *layer4_end_point_p,
 		                       enum net_layer4_protocols protocol);
 
+error_t net_layer4_end_point_set_max_held_rx_packets(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint16_t max_held_rx_packets);
+
+void net_layer4_end_point_get_stats(const struct net_layer4_end_point *layer4_end_point_p,
+                                    struct net_layer4_end_point_stats *stats_p);
+
+void net_layer4_poll_group_init(struct net_layer4_poll_group *poll_group_p,
+                                const char *name_p);
+
+error_t net_layer4_poll_group_add(struct net_layer4_poll_group *poll_group_p,
+                                  struct net_layer4_end_point *layer4_end_point_p);
+
+void net_layer4_poll_group_remove(struct net_layer4_poll_group *poll_group_p,
+                                  struct net_layer4_end_point *layer4_end_point_p);
+
+unsigned int net_layer4_poll_group_wait(struct net_layer4_poll_group *poll_group_p,
+                                        uint32_t timeout_ms,
+                                        struct net_layer4_end_point *ready_end_points[],
+                                        unsigned int max_ready_end_points);
+
 void net_layer4_end_point_list_init(struct net_layer4_end_point_list *list_p,
                                     enum net_layer4_protocols protocol);
 
@@ -71,4 +99,12 @@ void net_layer4_stop_tracing(void);
 
 extern struct net_layer4 g_net_layer4;
 
+/**
+ * Tells if networking layer 4 tracing is on (always false if it is compiled
+ * out, see RUNTIME_LOG_MODULES_MASK)
+ */
+#define NET_LAYER4_TRACING_ON() \
+        RUNTIME_LOG_TRACING_ON(RUNTIME_LOG_MODULE_NET_LAYER4, \
+                               g_net_layer4.tracing_on)
+
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER4_H_ */
@@ -0,0 +1,2111 @@
+/**
+ * @file networking_layer4_tcp.c
+ *
+ * Networking layer 4 implementation: TCP
+ *
+ * Small TCP over IPv4, meant for bulk transfers on a local network:
+ * - Sent segments are kept in their Tx packets until acknowledged, so that
+ *   retransmissions do not copy data. Data that stays unchanged in memory
+ *   (e.g., memory-mapped flash) can also be sent without being copied to
+ *   Tx packets, as Ethernet Tx payload fragments. At most
+ *   NET_TCP_MAX_UNACKED_SEGMENTS segments are in flight, within the peer's
+ *   receive window and the congestion window (slow start, congestion
+ *   avoidance and fast retransmit).
+ * - Received in-order segments stay in their Rx packets until read by the
+ *   application. The advertised receive window is derived from the Rx
+ *   packets that the connection's end point can still hold. Out-of-order
+ *   segments are dropped.
+ * - ACKs are delayed until a second segment is received or
+ *   NET_TCP_DELAYED_ACK_TIMEOUT_MS elapses.
+ * - TCP checksums are computed and validated by the Ethernet MAC hardware.
+ * - Each connection has a single timer in the network timer wheel, armed for
+ *   its earliest pending timeout.
+ *
+ * @author German Rivera
+ */
+#include "networking_layer4.h"
+#include "networking_layer2.h"
+#include "networking.h"
+#include "runtime_checks.h"
+#include "runtime_log.h"
+#include "atomic_utils.h"
+#include <string.h>
+
+/**
+ * Parsed fields of a received TCP segment
+ */
+struct tcp_rx_segment {
+    const struct tcp_header *tcp_header_p;
+    struct ipv4_address source_ip_addr;
+    uint16_t source_port;
+    uint16_t dest_port;
+    uint32_t seq_num;
+    uint32_t ack_num;
+    uint16_t window;
+    uint8_t flags;
+    uint16_t header_length;
+    uint16_t data_offset;
+    uint16_t data_length;
+};
+
+
+static inline struct net_tcp_connection *
+tcp_connection_from_end_point(struct net_layer4_end_point *layer4_end_point_p)
+{
+    struct net_tcp_connection *connection_p =
+        ENCLOSING_STRUCT(layer4_end_point_p, struct net_tcp_connection, end_point);
+
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+    return connection_p;
+}
+
+
+/**
+ * Wakes up the application tasks waiting on a TCP connection
+ */
+static void tcp_signal_event(struct net_tcp_connection *connection_p)
+{
+    struct net_layer4_poll_group *poll_group_p =
+        connection_p->end_point.poll_group_p;
+
+    rtos_semaphore_signal(&connection_p->event_semaphore);
+    if (poll_group_p != NULL) {
+        rtos_semaphore_signal(&poll_group_p->semaphore);
+    }
+}
+
+
+/**
+ * Waits for an event on a TCP connection, within an overall timeout that
+ * started at start_ticks
+ *
+ * @return true, if an event was signaled
+ * @return false, if the overall timeout expired
+ */
+static bool tcp_wait_for_event(struct net_tcp_connection *connection_p,
+                               uint32_t start_ticks,
+                               uint32_t timeout_ms)
+{
+    if (timeout_ms == 0) {
+        rtos_semaphore_wait(&connection_p->event_semaphore);
+        return true;
+    }
+
+    uint32_t elapsed_ms = RTOS_TICKS_TO_MILLISECONDS(
+        RTOS_TICKS_DELTA(start_ticks, rtos_get_ticks_since_boot()));
+
+    if (elapsed_ms >= timeout_ms) {
+        return false;
+    }
+
+    return rtos_semaphore_wait_timeout(&connection_p->event_semaphore,
+                                       timeout_ms - elapsed_ms);
+}
+
+
+/**
+ * Returns the receive window to advertise for a TCP connection, based on the
+ * number of Rx packets that its end point can still hold
+ */
+static uint16_t tcp_receive_window(const struct net_tcp_connection *connection_p)
+{
+    const struct net_layer4_end_point *end_point_p = &connection_p->end_point;
+    uint32_t num_held_rx_packets = end_point_p->rx_packet_queue.length +
+                                   end_point_p->num_lent_rx_packets;
+
+    if (num_held_rx_packets >= end_point_p->max_held_rx_packets) {
+        return 0;
+    }
+
+    uint32_t window = (end_point_p->max_held_rx_packets - num_held_rx_packets) *
+                      NET_TCP_MSS;
+
+    return (window > UINT16_MAX) ? UINT16_MAX : window;
+}
+
+
+/**
+ * Returns a Tx packet that was allocated with the given
+ * free_after_tx_complete flag to the Tx packet pool, or hands it over to the
+ * Ethernet MAC driver to be freed when its transmission completes.
+ */
+static void tcp_free_tx_packet(struct network_packet *tx_packet_p)
+{
+    bool free_now;
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    /*
+     * NOTE: The Ethernet MAC driver clears NET_PACKET_IN_TX_TRANSIT with
+     * interrupts disabled.
+     */
+    if (tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT) {
+        NET_PACKET_SET_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        free_now = false;
+    } else {
+        free_now = true;
+    }
+
+    restore_cpu_interrupts(int_mask);
+    if (free_now) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+    }
+}
+
+
+/**
+ * Fills in the TCP header of an outgoing segment and sends it over IPv4. If
+ * zero_copy_data_p is not NULL, the segment's data is sent from there as an
+ * Ethernet Tx payload fragment, instead of from the Tx packet.
+ *
+ * NOTE: tcp_header_p->checksum is filled by the Ethernet MAC hardware. We just
+ * need to initialize it to 0.
+ */
+static error_t tcp_send_ipv4_segment(const struct ipv4_address *dest_ip_addr_p,
+                                     uint16_t source_port, /* big endian */
+                                     uint16_t dest_port, /* big endian */
+                                     uint32_t seq_num,
+                                     uint32_t ack_num,
+                                     uint_fast8_t flags,
+                                     uint16_t window,
+                                     struct network_packet *tx_packet_p,
+                                     const void *zero_copy_data_p,
+                                     size_t data_length)
+{
+    struct tcp_header *tcp_header_p =
+        (struct tcp_header *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+    size_t header_length = sizeof(struct tcp_header);
+
+    if (flags & TCP_FLAG_SYN) {
+        uint8_t *options_p = (uint8_t *)(tcp_header_p + 1);
+
+        options_p[0] = TCP_OPTION_MSS;
+        options_p[1] = TCP_OPTION_MSS_LENGTH;
+        options_p[2] = (uint8_t)(NET_TCP_MSS >> 8);
+        options_p[3] = (uint8_t)NET_TCP_MSS;
+        header_length += TCP_OPTION_MSS_LENGTH;
+    }
+
+    tcp_header_p->source_port = source_port;
+    tcp_header_p->dest_port = dest_port;
+    tcp_header_p->seq_num = hton32(seq_num);
+    tcp_header_p->ack_num = hton32(ack_num);
+    tcp_header_p->data_offset = 0;
+    SET_BIT_FIELD(tcp_header_p->data_offset, TCP_DATA_OFFSET_MASK,
+                  TCP_DATA_OFFSET_SHIFT, header_length / 4);
+    tcp_header_p->flags = flags;
+    tcp_header_p->window = hton16(window);
+    tcp_header_p->checksum = 0;
+    tcp_header_p->urgent_pointer = 0;
+
+    if (NET_LAYER4_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer4: TCP segment sent: "
+                     "source port %u, destination port %u, flags %#x, "
+                     "seq %#x, ack %#x, length %u\n",
+                     ntoh16(source_port), ntoh16(dest_port), flags,
+                     seq_num, ack_num, data_length);
+    }
+
+    if (zero_copy_data_p != NULL) {
+        struct ethernet_tx_fragment fragment = {
+            .data_p = zero_copy_data_p,
+            .length = data_length,
+        };
+
+        D_ASSERT(data_length != 0);
+        return net_layer3_send_ipv4_packet_gather(dest_ip_addr_p,
+                                                  tx_packet_p,
+                                                  header_length,
+                                                  &fragment,
+                                                  1,
+                                                  IP_PACKET_TYPE_TCP);
+    }
+
+    return net_layer3_send_ipv4_packet(dest_ip_addr_p,
+                                       tx_packet_p,
+                                       header_length + data_length,
+                                       IP_PACKET_TYPE_TCP);
+}
+
+
+/**
+ * Sends a segment of a TCP connection. If the segment carries an ACK, it
+ * acknowledges everything received so far and advertises the current receive
+ * window. Must be called with the connection's mutex held.
+ */
+static error_t tcp_transmit(struct net_tcp_connection *connection_p,
+                            struct network_packet *tx_packet_p,
+                            uint32_t seq_num,
+                            uint_fast8_t flags,
+                            const void *zero_copy_data_p,
+                            size_t data_length)
+{
+    uint32_t ack_num = 0;
+    uint16_t window = 0;
+
+    D_ASSERT(rtos_mutex_is_mine(&connection_p->mutex));
+    if (flags & TCP_FLAG_ACK) {
+        ack_num = connection_p->receive_next;
+        window = tcp_receive_window(connection_p);
+        connection_p->last_advertised_window = window;
+        connection_p->num_unacked_rx_segments = 0;
+    }
+
+    ATOMIC_POST_INCREMENT_UINT32(&connection_p->segments_sent_count);
+    return tcp_send_ipv4_segment(&connection_p->peer_ip_addr,
+                                 connection_p->end_point.layer4_port,
+                                 connection_p->peer_port,
+                                 seq_num,
+                                 ack_num,
+                                 flags,
+                                 window,
+                                 tx_packet_p,
+                                 zero_copy_data_p,
+                                 data_length);
+}
+
+
+/**
+ * Sends a segment without data that does not need to be retransmitted (ACK
+ * or RST) for a TCP connection. Must be called with the connection's mutex
+ * held.
+ */
+static void tcp_send_control_segment(struct net_tcp_connection *connection_p,
+                                     uint_fast8_t flags)
+{
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                              sizeof(struct ipv4_header) +
+                                              sizeof(struct tcp_header),
+                                          true);
+
+    if (tx_packet_p == NULL) {
+        /*
+         * The ACK will be sent by the delayed ACK timer or piggybacked on a
+         * later segment:
+         */
+        return;
+    }
+
+    error_t error = tcp_transmit(connection_p, tx_packet_p,
+                                 connection_p->send_next, flags, NULL, 0);
+
+    if (error != 0) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+    }
+}
+
+
+/**
+ * Sends a TCP reset in response to a received segment that does not belong
+ * to any connection (RFC 793, section 3.4)
+ */
+static void tcp_send_reset_for_segment(const struct tcp_rx_segment *segment_p)
+{
+    uint32_t seq_num;
+    uint32_t ack_num;
+    uint_fast8_t flags;
+
+    if (segment_p->flags & TCP_FLAG_RST) {
+        return;
+    }
+
+    if (segment_p->flags & TCP_FLAG_ACK) {
+        seq_num = segment_p->ack_num;
+        ack_num = 0;
+        flags = TCP_FLAG_RST;
+    } else {
+        seq_num = 0;
+        ack_num = segment_p->seq_num + segment_p->data_length +
+                  ((segment_p->flags & TCP_FLAG_SYN) ? 1 : 0) +
+                  ((segment_p->flags & TCP_FLAG_FIN) ? 1 : 0);
+        flags = TCP_FLAG_RST | TCP_FLAG_ACK;
+    }
+
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                              sizeof(struct ipv4_header) +
+                                              sizeof(struct tcp_header),
+                                          true);
+
+    if (tx_packet_p == NULL) {
+        return;
+    }
+
+    error_t error = tcp_send_ipv4_segment(&segment_p->source_ip_addr,
+                                          segment_p->dest_port,
+                                          segment_p->source_port,
+                                          seq_num,
+                                          ack_num,
+                                          flags,
+                                          0,
+                                          tx_packet_p,
+                                          NULL,
+                                          0);
+    if (error != 0) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+    } else {
+        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer4.tcp.resets_sent_count);
+    }
+}
+
+
+/**
+ * Returns the number of sequence numbers taken by a sent TCP segment
+ */
+static inline uint32_t tcp_tx_segment_seq_length(
+    const struct net_tcp_tx_segment *tx_segment_p)
+{
+    return tx_segment_p->data_length +
+           ((tx_segment_p->flags & TCP_FLAG_SYN) ? 1 : 0) +
+           ((tx_segment_p->flags & TCP_FLAG_FIN) ? 1 : 0);
+}
+
+
+/**
+ * Returns the milliseconds left until a timeout that started at start_ticks
+ */
+static uint32_t tcp_time_left_ms(uint32_t start_ticks,
+                                 uint32_t timeout_ms,
+                                 uint32_t current_ticks)
+{
+    uint32_t elapsed_ms = RTOS_TICKS_TO_MILLISECONDS(
+        RTOS_TICKS_DELTA(start_ticks, current_ticks));
+
+    return (elapsed_ms >= timeout_ms) ? 0 : timeout_ms - elapsed_ms;
+}
+
+
+/**
+ * Arms the timer of a TCP connection for its earliest pending timeout, or
+ * cancels it if there is none. Must be called with the connection's mutex
+ * held, after anything that may have changed the connection's timeouts.
+ */
+static void tcp_update_timer(struct net_tcp_connection *connection_p)
+{
+    uint32_t current_ticks = rtos_get_ticks_since_boot();
+    uint32_t timeout_ms = UINT32_MAX;
+    uint32_t time_left_ms;
+
+    D_ASSERT(rtos_mutex_is_mine(&connection_p->mutex));
+
+    if (connection_p->state == NET_TCP_TIME_WAIT) {
+        timeout_ms = tcp_time_left_ms(connection_p->time_wait_start_ticks,
+                                      NET_TCP_TIME_WAIT_MS, current_ticks);
+    } else if (connection_p->state != NET_TCP_CLOSED) {
+        if (connection_p->num_unacked_rx_segments != 0) {
+            timeout_ms = tcp_time_left_ms(connection_p->ack_pending_start_ticks,
+                                          NET_TCP_DELAYED_ACK_TIMEOUT_MS,
+                                          current_ticks);
+        }
+
+        if (connection_p->rto_armed) {
+            time_left_ms = tcp_time_left_ms(connection_p->rto_start_ticks,
+                                            connection_p->rto_ms,
+                                            current_ticks);
+            if (time_left_ms < timeout_ms) {
+                timeout_ms = time_left_ms;
+            }
+        }
+
+        if (connection_p->fin_pending && NET_TCP_TIMER_PERIOD_MS < timeout_ms) {
+            timeout_ms = NET_TCP_TIMER_PERIOD_MS;
+        }
+    }
+
+    if (timeout_ms == UINT32_MAX) {
+        timer_wheel_timer_cancel(&g_net_timer_wheel, &connection_p->timer);
+    } else {
+        timer_wheel_timer_arm(&g_net_timer_wheel, &connection_p->timer,
+                              timeout_ms);
+    }
+}
+
+
+/**
+ * Sends a new segment of a TCP connection and keeps it until it is
+ * acknowledged. The Tx packet must have been allocated with
+ * free_after_tx_complete set to false. If zero_copy_data_p is not NULL, it
+ * points to the segment's data, which must not change until acknowledged.
+ * Must be called with the connection's mutex held.
+ */
+static void tcp_queue_tx_segment(struct net_tcp_connection *connection_p,
+                                 struct network_packet *tx_packet_p,
+                                 uint_fast8_t flags,
+                                 const void *zero_copy_data_p,
+                                 size_t data_length)
+{
+    D_ASSERT(connection_p->num_tx_segments < NET_TCP_MAX_UNACKED_SEGMENTS);
+    D_ASSERT(!(tx_packet_p->state_flags & NET_PACKET_FREE_AFTER_TX_COMPLETE));
+
+    uint_fast8_t index = (connection_p->tx_segments_head +
+                          connection_p->num_tx_segments) %
+                         NET_TCP_MAX_UNACKED_SEGMENTS;
+    struct net_tcp_tx_segment *tx_segment_p = &connection_p->tx_segments[index];
+
+    tx_segment_p->tx_packet_p = tx_packet_p;
+    tx_segment_p->zero_copy_data_p = zero_copy_data_p;
+    tx_segment_p->seq_num = connection_p->send_next;
+    tx_segment_p->data_length = data_length;
+    tx_segment_p->flags = flags;
+    tx_segment_p->retransmitted = false;
+    tx_segment_p->tx_time_stamp = rtos_get_ticks_since_boot();
+    connection_p->num_tx_segments ++;
+    connection_p->send_next += tcp_tx_segment_seq_length(tx_segment_p);
+
+    if (!connection_p->rto_armed) {
+        connection_p->rto_start_ticks = tx_segment_p->tx_time_stamp;
+        connection_p->rto_armed = true;
+    }
+
+    /*
+     * If the send fails (e.g., no Tx packet to wait for an ARP reply), the
+     * segment is sent again by the retransmission timer:
+     */
+    (void)tcp_transmit(connection_p, tx_packet_p, tx_segment_p->seq_num,
+                       flags, zero_copy_data_p, data_length);
+    tcp_update_timer(connection_p);
+}
+
+
+/**
+ * Retransmits the oldest unacknowledged segment of a TCP connection. Must be
+ * called with the connection's mutex held.
+ *
+ * @return true, if the segment was retransmitted
+ * @return false, if the previous transmission of the segment has not
+ *         completed yet
+ */
+static bool tcp_retransmit_oldest_segment(struct net_tcp_connection *connection_p)
+{
+    D_ASSERT(connection_p->num_tx_segments != 0);
+
+    struct net_tcp_tx_segment *tx_segment_p =
+        &connection_p->tx_segments[connection_p->tx_segments_head];
+
+    if (tx_segment_p->tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT) {
+        /*
+         * In ETHERNET_MAC_TX_LAZY_RECLAIM_MODE, the segment's Tx packet is
+         * not reclaimed until more frames are sent, which may not happen on
+         * an idle link:
+         */
+        net_layer2_reclaim_lazy_tx_packets();
+        if (tx_segment_p->tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT) {
+            /*
+             * Previous transmission not completed yet:
+             */
+            return false;
+        }
+    }
+
+    tx_segment_p->retransmitted = true;
+    ATOMIC_POST_INCREMENT_UINT32(&connection_p->segments_retransmitted_count);
+    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer4.tcp.retransmitted_segments_count);
+    (void)tcp_transmit(connection_p, tx_segment_p->tx_packet_p,
+                       tx_segment_p->seq_num, tx_segment_p->flags,
+                       tx_segment_p->zero_copy_data_p,
+                       tx_segment_p->data_length);
+    return true;
+}
+
+
+/**
+ * Queues the local FIN of a TCP connection, if there is room for it.
+ * Otherwise, it is queued when some sent segment is acknowledged. Must be
+ * called with the connection's mutex held.
+ */
+static void tcp_send_fin(struct net_tcp_connection *connection_p)
+{
+    connection_p->fin_pending = true;
+    if (connection_p->num_tx_segments == NET_TCP_MAX_UNACKED_SEGMENTS) {
+        return;
+    }
+
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                              sizeof(struct ipv4_header) +
+                                              sizeof(struct tcp_header),
+                                          false);
+    if (tx_packet_p == NULL) {
+        return;
+    }
+
+    connection_p->fin_pending = false;
+    connection_p->fin_sent = true;
+    tcp_queue_tx_segment(connection_p, tx_packet_p,
+                         TCP_FLAG_FIN | TCP_FLAG_ACK, NULL, 0);
+}
+
+
+/**
+ * Tells if the local FIN of a TCP connection has been acknowledged
+ */
+static inline bool tcp_fin_acked(const struct net_tcp_connection *connection_p)
+{
+    return connection_p->fin_sent &&
+           connection_p->send_unacked == connection_p->send_next;
+}
+
+
+/**
+ * Releases the sent segments and the received data of a TCP connection.
+ * Must be called with the connection's mutex held.
+ */
+static void tcp_release_buffers(struct net_tcp_connection *connection_p)
+{
+    struct network_packet *rx_packet_p;
+
+    while (connection_p->num_tx_segments != 0) {
+        tcp_free_tx_packet(
+            connection_p->tx_segments[connection_p->tx_segments_head].tx_packet_p);
+        connection_p->tx_segments_head =
+            (connection_p->tx_segments_head + 1) % NET_TCP_MAX_UNACKED_SEGMENTS;
+        connection_p->num_tx_segments --;
+    }
+
+    connection_p->rto_armed = false;
+    if (connection_p->rx_current_packet_p != NULL) {
+        net_recycle_rx_packet(connection_p->rx_current_packet_p);
+        connection_p->rx_current_packet_p = NULL;
+        ATOMIC_POST_DECREMENT_UINT32(&connection_p->end_point.num_lent_rx_packets);
+    }
+
+    while ((rx_packet_p =
+                net_packet_queue_try_remove(&connection_p->end_point.rx_packet_queue)) !=
+           NULL) {
+        net_recycle_rx_packet(rx_packet_p);
+    }
+}
+
+
+/**
+ * Moves a TCP connection to the CLOSED state. Must be called with the
+ * connection's mutex held.
+ */
+static void tcp_enter_closed_state(struct net_tcp_connection *connection_p,
+                                   bool reset)
+{
+    struct net_tcp_tx_segment *tx_segment_p;
+
+    while (connection_p->num_tx_segments != 0) {
+        tx_segment_p = &connection_p->tx_segments[connection_p->tx_segments_head];
+        tcp_free_tx_packet(tx_segment_p->tx_packet_p);
+        connection_p->tx_segments_head =
+            (connection_p->tx_segments_head + 1) % NET_TCP_MAX_UNACKED_SEGMENTS;
+        connection_p->num_tx_segments --;
+    }
+
+    connection_p->rto_armed = false;
+    connection_p->num_unacked_rx_segments = 0;
+    connection_p->fin_pending = false;
+    if (reset) {
+        connection_p->reset = true;
+    }
+
+    connection_p->state = NET_TCP_CLOSED;
+    tcp_update_timer(connection_p);
+    tcp_signal_event(connection_p);
+}
+
+
+/**
+ * Resets the variables of a TCP connection, to be reused. Must be called
+ * with the connection's mutex held.
+ */
+static void tcp_reset_connection_vars(struct net_tcp_connection *connection_p)
+{
+    tcp_release_buffers(connection_p);
+    connection_p->state = NET_TCP_CLOSED;
+    connection_p->peer_ip_addr.value = IPV4_NULL_ADDR;
+    connection_p->peer_port = 0;
+    connection_p->send_mss = NET_TCP_DEFAULT_PEER_MSS;
+    connection_p->send_window = 0;
+    connection_p->num_dup_acks = 0;
+    connection_p->tx_segments_head = 0;
+    connection_p->rto_ms = NET_TCP_INITIAL_RTO_MS;
+    connection_p->smoothed_rtt_ms = 0;
+    connection_p->rtt_variance_ms = 0;
+    connection_p->num_retransmissions = 0;
+    connection_p->receive_next = 0;
+    connection_p->last_advertised_window = 0;
+    connection_p->num_unacked_rx_segments = 0;
+    connection_p->fin_pending = false;
+    connection_p->fin_sent = false;
+    connection_p->fin_received = false;
+    connection_p->reset = false;
+}
+
+
+/**
+ * Initializes the send sequence variables of a TCP connection
+ */
+static void tcp_init_send_sequence(struct net_tcp_connection *connection_p)
+{
+    /*
+     * NOTE: The ISS advances with time and with every new connection, so that
+     * segments of a previous incarnation of a connection are unlikely to have
+     * acceptable sequence numbers.
+     */
+    uint32_t iss = (rtos_get_ticks_since_boot() << 10) +
+                   ATOMIC_POST_INCREMENT_UINT32(&g_net_layer4.tcp.iss_counter) *
+                       UINT32_C(64000);
+
+    connection_p->send_iss = iss;
+    connection_p->send_unacked = iss;
+    connection_p->send_next = iss;
+    connection_p->congestion_window = 2 * connection_p->send_mss;
+    connection_p->slow_start_threshold = UINT16_MAX;
+}
+
+
+/**
+ * Parses the MSS option of a received SYN segment
+ *
+ * @return MSS to use for segments sent to the peer
+ */
+static uint16_t tcp_parse_mss_option(const struct tcp_rx_segment *segment_p)
+{
+    const uint8_t *option_p = (const uint8_t *)(segment_p->tcp_header_p + 1);
+    const uint8_t *options_end_p =
+        (const uint8_t *)segment_p->tcp_header_p + segment_p->header_length;
+    uint16_t mss = NET_TCP_DEFAULT_PEER_MSS;
+
+    while (option_p < options_end_p) {
+        if (*option_p == TCP_OPTION_END_OF_LIST) {
+            break;
+        }
+
+        if (*option_p == TCP_OPTION_NOP) {
+            option_p ++;
+            continue;
+        }
+
+        if (option_p + 1 >= options_end_p || option_p[1] < 2 ||
+            option_p + option_p[1] > options_end_p) {
+            break;
+        }
+
+        if (option_p[0] == TCP_OPTION_MSS &&
+            option_p[1] == TCP_OPTION_MSS_LENGTH) {
+            mss = ((uint16_t)option_p[2] << 8) | option_p[3];
+        }
+
+        option_p += option_p[1];
+    }
+
+    if (mss > NET_TCP_MSS) {
+        mss = NET_TCP_MSS;
+    } else if (mss == 0) {
+        mss = NET_TCP_DEFAULT_PEER_MSS;
+    }
+
+    return mss;
+}
+
+
+/**
+ * Updates the RTT estimate and the retransmission timeout of a TCP
+ * connection (RFC 6298)
+ */
+static void tcp_update_rto(struct net_tcp_connection *connection_p,
+                           uint32_t rtt_ms)
+{
+    if (connection_p->smoothed_rtt_ms == 0) {
+        connection_p->smoothed_rtt_ms = rtt_ms;
+        connection_p->rtt_variance_ms = rtt_ms / 2;
+    } else {
+        uint32_t delta_ms = (rtt_ms > connection_p->smoothed_rtt_ms) ?
+                            rtt_ms - connection_p->smoothed_rtt_ms :
+                            connection_p->smoothed_rtt_ms - rtt_ms;
+
+        connection_p->rtt_variance_ms =
+            (3 * connection_p->rtt_variance_ms + delta_ms) / 4;
+        connection_p->smoothed_rtt_ms =
+            (7 * connection_p->smoothed_rtt_ms + rtt_ms) / 8;
+    }
+
+    uint32_t rto_ms = connection_p->smoothed_rtt_ms +
+                      4 * connection_p->rtt_variance_ms;
+
+    if (rto_ms < NET_TCP_MIN_RTO_MS) {
+        rto_ms = NET_TCP_MIN_RTO_MS;
+    } else if (rto_ms > NET_TCP_MAX_RTO_MS) {
+        rto_ms = NET_TCP_MAX_RTO_MS;
+    }
+
+    connection_p->rto_ms = rto_ms;
+}
+
+
+/**
+ * Sets the slow start threshold of a TCP connection after a loss
+ */
+static void tcp_reduce_slow_start_threshold(struct net_tcp_connection *connection_p)
+{
+    uint32_t flight_size = connection_p->send_next - connection_p->send_unacked;
+    uint32_t threshold = flight_size / 2;
+
+    if (threshold < 2 * connection_p->send_mss) {
+        threshold = 2 * connection_p->send_mss;
+    }
+
+    connection_p->slow_start_threshold = threshold;
+}
+
+
+/**
+ * Processes the ACK number and window of a received TCP segment. Must be
+ * called with the connection's mutex held.
+ */
+static void tcp_process_ack(struct net_tcp_connection *connection_p,
+                            const struct tcp_rx_segment *segment_p)
+{
+    uint32_t ack_num = segment_p->ack_num;
+
+    if (TCP_SEQ_GT(ack_num, connection_p->send_next)) {
+        /*
+         * ACK for data not sent yet:
+         */
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+        return;
+    }
+
+    if (TCP_SEQ_GT(ack_num, connection_p->send_unacked)) {
+        uint32_t current_ticks = rtos_get_ticks_since_boot();
+
+        connection_p->send_unacked = ack_num;
+        connection_p->send_window = segment_p->window;
+        connection_p->num_dup_acks = 0;
+        connection_p->num_retransmissions = 0;
+
+        while (connection_p->num_tx_segments != 0) {
+            struct net_tcp_tx_segment *tx_segment_p =
+                &connection_p->tx_segments[connection_p->tx_segments_head];
+
+            if (TCP_SEQ_GT(tx_segment_p->seq_num +
+                               tcp_tx_segment_seq_length(tx_segment_p),
+                           ack_num)) {
+                break;
+            }
+
+            /*
+             * Karn's algorithm: only segments that were not retransmitted
+             * give RTT samples
+             */
+            if (!tx_segment_p->retransmitted) {
+                tcp_update_rto(connection_p,
+                               RTOS_TICKS_TO_MILLISECONDS(
+                                   RTOS_TICKS_DELTA(tx_segment_p->tx_time_stamp,
+                                                    current_ticks)));
+            }
+
+            tcp_free_tx_packet(tx_segment_p->tx_packet_p);
+            connection_p->tx_segments_head =
+                (connection_p->tx_segments_head + 1) % NET_TCP_MAX_UNACKED_SEGMENTS;
+            connection_p->num_tx_segments --;
+        }
+
+        if (connection_p->congestion_window < connection_p->slow_start_threshold) {
+            connection_p->congestion_window += connection_p->send_mss;
+        } else {
+            connection_p->congestion_window +=
+                ((uint32_t)connection_p->send_mss * connection_p->send_mss) /
+                connection_p->congestion_window + 1;
+        }
+
+        if (connection_p->num_tx_segments == 0) {
+            connection_p->rto_armed = false;
+        } else {
+            connection_p->rto_start_ticks = current_ticks;
+            connection_p->rto_armed = true;
+        }
+
+        if (connection_p->fin_pending) {
+            tcp_send_fin(connection_p);
+        }
+
+        tcp_signal_event(connection_p);
+    } else if (ack_num == connection_p->send_unacked &&
+               connection_p->num_tx_segments != 0 &&
+               segment_p->data_length == 0 &&
+               segment_p->window == connection_p->send_window) {
+        connection_p->num_dup_acks ++;
+        if (connection_p->num_dup_acks == NET_TCP_DUP_ACK_THRESHOLD) {
+            /*
+             * Fast retransmit:
+             */
+            tcp_reduce_slow_start_threshold(connection_p);
+            connection_p->congestion_window = connection_p->slow_start_threshold;
+            (void)tcp_retransmit_oldest_segment(connection_p);
+        }
+    } else if (segment_p->window != connection_p->send_window) {
+        /*
+         * Window update:
+         */
+        connection_p->send_window = segment_p->window;
+        tcp_signal_event(connection_p);
+    }
+}
+
+
+/**
+ * Processes the data and FIN of a received in-order TCP segment. Must be
+ * called with the connection's mutex held.
+ *
+ * @return true, if the Rx packet was queued for the application
+ * @return false, if the caller has to recycle the Rx packet
+ */
+static bool tcp_process_segment_data(struct net_tcp_connection *connection_p,
+                                     struct network_packet *rx_packet_p,
+                                     const struct tcp_rx_segment *segment_p)
+{
+    struct net_layer4_end_point *end_point_p = &connection_p->end_point;
+    bool fin = (segment_p->flags & TCP_FLAG_FIN) != 0;
+    bool rx_packet_queued = false;
+
+    if (segment_p->data_length == 0 && !fin) {
+        return false;
+    }
+
+    if (connection_p->state != NET_TCP_ESTABLISHED &&
+        connection_p->state != NET_TCP_FIN_WAIT_1 &&
+        connection_p->state != NET_TCP_FIN_WAIT_2) {
+        /*
+         * Peer's FIN already received. Just acknowledge retransmissions:
+         */
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+        return false;
+    }
+
+    if (segment_p->seq_num != connection_p->receive_next) {
+        /*
+         * Out-of-order or duplicate segment: send a duplicate ACK, so that
+         * the peer retransmits the missing data soon.
+         */
+        ATOMIC_POST_INCREMENT_UINT32(
+            &connection_p->out_of_order_segments_dropped_count);
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+        return false;
+    }
+
+    if (segment_p->data_length != 0) {
+        if (end_point_p->rx_packet_queue.length +
+                end_point_p->num_lent_rx_packets >=
+            end_point_p->max_held_rx_packets) {
+            /*
+             * Peer ignored our receive window:
+             */
+            ATOMIC_POST_INCREMENT_UINT32(&end_point_p->rx_packets_dropped_count);
+            tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+            return false;
+        }
+
+        net_packet_queue_add(&end_point_p->rx_packet_queue, rx_packet_p);
+        rx_packet_queued = true;
+        ATOMIC_POST_INCREMENT_UINT32(&end_point_p->rx_packets_accepted_count);
+        connection_p->receive_next += segment_p->data_length;
+        if (connection_p->num_unacked_rx_segments == 0) {
+            connection_p->ack_pending_start_ticks = rtos_get_ticks_since_boot();
+        }
+
+        connection_p->num_unacked_rx_segments ++;
+    }
+
+    if (fin) {
+        connection_p->receive_next ++;
+        connection_p->fin_received = true;
+        switch (connection_p->state) {
+        case NET_TCP_ESTABLISHED:
+            connection_p->state = NET_TCP_CLOSE_WAIT;
+            break;
+
+        case NET_TCP_FIN_WAIT_1:
+            if (tcp_fin_acked(connection_p)) {
+                connection_p->state = NET_TCP_TIME_WAIT;
+                connection_p->time_wait_start_ticks = rtos_get_ticks_since_boot();
+            } else {
+                connection_p->state = NET_TCP_CLOSING;
+            }
+            break;
+
+        case NET_TCP_FIN_WAIT_2:
+            connection_p->state = NET_TCP_TIME_WAIT;
+            connection_p->time_wait_start_ticks = rtos_get_ticks_since_boot();
+            break;
+
+        default:
+            D_ASSERT(false);
+        }
+
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+    } else if (connection_p->num_unacked_rx_segments >= 2) {
+        /*
+         * Acknowledge at least every second full segment (RFC 1122):
+         */
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+    }
+
+    tcp_signal_event(connection_p);
+    return rx_packet_queued;
+}
+
+
+/**
+ * Processes a received TCP segment for a connection. Must be called with the
+ * connection's mutex held.
+ *
+ * @return true, if the Rx packet was queued for the application
+ * @return false, if the caller has to recycle the Rx packet
+ */
+static bool tcp_process_segment(struct net_tcp_connection *connection_p,
+                                struct network_packet *rx_packet_p,
+                                const struct tcp_rx_segment *segment_p)
+{
+    uint_fast8_t flags = segment_p->flags;
+
+    switch (connection_p->state) {
+    case NET_TCP_CLOSED:
+        tcp_send_reset_for_segment(segment_p);
+        return false;
+
+    case NET_TCP_LISTEN: {
+        if (flags & TCP_FLAG_RST) {
+            return false;
+        }
+
+        if (flags & TCP_FLAG_ACK) {
+            tcp_send_reset_for_segment(segment_p);
+            return false;
+        }
+
+        if (!(flags & TCP_FLAG_SYN)) {
+            return false;
+        }
+
+        struct network_packet *tx_packet_p =
+            net_layer2_try_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                                  sizeof(struct ipv4_header) +
+                                                  sizeof(struct tcp_header) +
+                                                  TCP_OPTION_MSS_LENGTH,
+                                              false);
+        if (tx_packet_p == NULL) {
+            /*
+             * The peer will retransmit its SYN:
+             */
+            return false;
+        }
+
+        connection_p->peer_ip_addr = segment_p->source_ip_addr;
+        connection_p->peer_port = segment_p->source_port;
+        connection_p->receive_irs = segment_p->seq_num;
+        connection_p->receive_next = segment_p->seq_num + 1;
+        connection_p->send_mss = tcp_parse_mss_option(segment_p);
+        connection_p->send_window = segment_p->window;
+        tcp_init_send_sequence(connection_p);
+        connection_p->state = NET_TCP_SYN_RECEIVED;
+        tcp_queue_tx_segment(connection_p, tx_packet_p,
+                             TCP_FLAG_SYN | TCP_FLAG_ACK, NULL, 0);
+        return false;
+    }
+
+    case NET_TCP_SYN_SENT:
+        if ((flags & TCP_FLAG_ACK) &&
+            (TCP_SEQ_LEQ(segment_p->ack_num, connection_p->send_iss) ||
+             TCP_SEQ_GT(segment_p->ack_num, connection_p->send_next))) {
+            tcp_send_reset_for_segment(segment_p);
+            return false;
+        }
+
+        if (flags & TCP_FLAG_RST) {
+            if (flags & TCP_FLAG_ACK) {
+                /*
+                 * Connection refused:
+                 */
+                tcp_enter_closed_state(connection_p, true);
+            }
+
+            return false;
+        }
+
+        if (!(flags & TCP_FLAG_SYN) || !(flags & TCP_FLAG_ACK)) {
+            /*
+             * NOTE: Simultaneous open is not supported.
+             */
+            return false;
+        }
+
+        connection_p->receive_irs = segment_p->seq_num;
+        connection_p->receive_next = segment_p->seq_num + 1;
+        connection_p->send_mss = tcp_parse_mss_option(segment_p);
+        tcp_process_ack(connection_p, segment_p);
+        connection_p->state = NET_TCP_ESTABLISHED;
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+        tcp_signal_event(connection_p);
+        return false;
+
+    default:
+        break;
+    }
+
+    /*
+     * Synchronized states:
+     */
+    if (segment_p->source_ip_addr.value != connection_p->peer_ip_addr.value ||
+        segment_p->source_port != connection_p->peer_port) {
+        tcp_send_reset_for_segment(segment_p);
+        return false;
+    }
+
+    if (flags & TCP_FLAG_RST) {
+        /*
+         * Only a reset with the expected sequence number is accepted, so that
+         * a blind reset is unlikely to succeed (RFC 5961):
+         */
+        if (segment_p->seq_num == connection_p->receive_next) {
+            tcp_enter_closed_state(connection_p, true);
+        } else {
+            tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+        }
+
+        return false;
+    }
+
+    if (flags & TCP_FLAG_SYN) {
+        /*
+         * Retransmitted SYN or SYN in a synchronized state:
+         */
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+        return false;
+    }
+
+    if (!(flags & TCP_FLAG_ACK)) {
+        return false;
+    }
+
+    if (connection_p->state == NET_TCP_SYN_RECEIVED) {
+        if (TCP_SEQ_LEQ(segment_p->ack_num, connection_p->send_unacked) ||
+            TCP_SEQ_GT(segment_p->ack_num, connection_p->send_next)) {
+            tcp_send_reset_for_segment(segment_p);
+            return false;
+        }
+
+        connection_p->state = NET_TCP_ESTABLISHED;
+        tcp_signal_event(connection_p);
+    }
+
+    tcp_process_ack(connection_p, segment_p);
+
+    switch (connection_p->state) {
+    case NET_TCP_FIN_WAIT_1:
+        if (tcp_fin_acked(connection_p)) {
+            connection_p->state = NET_TCP_FIN_WAIT_2;
+        }
+        break;
+
+    case NET_TCP_CLOSING:
+        if (tcp_fin_acked(connection_p)) {
+            connection_p->state = NET_TCP_TIME_WAIT;
+            connection_p->time_wait_start_ticks = rtos_get_ticks_since_boot();
+        }
+        return false;
+
+    case NET_TCP_LAST_ACK:
+        if (tcp_fin_acked(connection_p)) {
+            tcp_enter_closed_state(connection_p, false);
+        }
+        return false;
+
+    case NET_TCP_TIME_WAIT:
+        /*
+         * Retransmitted FIN:
+         */
+        if (flags & TCP_FLAG_FIN) {
+            tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+            connection_p->time_wait_start_ticks = rtos_get_ticks_since_boot();
+        }
+        return false;
+
+    default:
+        break;
+    }
+
+    return tcp_process_segment_data(connection_p, rx_packet_p, segment_p);
+}
+
+
+/**
+ * Runs the timers of a TCP connection. Must be called with the
+ * connection's mutex held.
+ */
+static void tcp_run_connection_timers(struct net_tcp_connection *connection_p,
+                                      uint32_t current_ticks)
+{
+    if (connection_p->state == NET_TCP_TIME_WAIT) {
+        if (RTOS_TICKS_DELTA(connection_p->time_wait_start_ticks, current_ticks) >=
+                MILLISECONDS_TO_TICKS(NET_TCP_TIME_WAIT_MS)) {
+            tcp_enter_closed_state(connection_p, false);
+        }
+
+        return;
+    }
+
+    if (connection_p->num_unacked_rx_segments != 0 &&
+        RTOS_TICKS_DELTA(connection_p->ack_pending_start_ticks, current_ticks) >=
+            MILLISECONDS_TO_TICKS(NET_TCP_DELAYED_ACK_TIMEOUT_MS)) {
+        tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+    }
+
+    if (connection_p->fin_pending) {
+        tcp_send_fin(connection_p);
+    }
+
+    if (connection_p->rto_armed &&
+        RTOS_TICKS_DELTA(connection_p->rto_start_ticks, current_ticks) >=
+            MILLISECONDS_TO_TICKS(connection_p->rto_ms)) {
+        /*
+         * NOTE: While the peer's window is closed, the oldest segment works
+         * as a window probe, which is retransmitted indefinitely.
+         */
+        if (connection_p->num_retransmissions >= NET_TCP_MAX_RETRANSMISSIONS &&
+            connection_p->send_window != 0) {
+            ERROR_PRINTF("TCP connection on port %u aborted: too many retransmissions\n",
+                         ntoh16(connection_p->end_point.layer4_port));
+            if (connection_p->state != NET_TCP_SYN_SENT) {
+                tcp_send_control_segment(connection_p, TCP_FLAG_RST | TCP_FLAG_ACK);
+            }
+
+            tcp_enter_closed_state(connection_p, true);
+            return;
+        }
+
+        connection_p->rto_start_ticks = current_ticks;
+        if (!tcp_retransmit_oldest_segment(connection_p)) {
+            /*
+             * The segment is still waiting to be transmitted (e.g., the
+             * link is down), so it has not been lost: wait for another
+             * RTO, without counting a retransmission or backing off.
+             */
+            return;
+        }
+
+        if (connection_p->num_retransmissions < NET_TCP_MAX_RETRANSMISSIONS) {
+            connection_p->num_retransmissions ++;
+        }
+
+        tcp_reduce_slow_start_threshold(connection_p);
+        connection_p->congestion_window = connection_p->send_mss;
+        connection_p->num_dup_acks = 0;
+        connection_p->rto_ms *= 2;
+        if (connection_p->rto_ms > NET_TCP_MAX_RTO_MS) {
+            connection_p->rto_ms = NET_TCP_MAX_RTO_MS;
+        }
+    }
+}
+
+
+/**
+ * Callback of the timer of a TCP connection. It runs from the network timer
+ * wheel's task.
+ */
+static void tcp_timer_callback(struct timer_wheel_timer *timer_p, void *arg)
+{
+    struct net_tcp_connection *connection_p = arg;
+
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+    D_ASSERT(timer_p == &connection_p->timer);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&connection_p->mutex);
+    tcp_run_connection_timers(connection_p, rtos_get_ticks_since_boot());
+    tcp_update_timer(connection_p);
+    rtos_mutex_unlock(&connection_p->mutex);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Initializes Networking layer-4 for TCP
+ *
+ * @param layer4_tcp_p: Pointer to TCP-specific networking layer-4
+ */
+void net_layer4_tcp_init(struct net_layer4_tcp *layer4_tcp_p)
+{
+    layer4_tcp_p->next_ephemeral_port = NET_FIRST_EPHEMERAL_PORT;
+    layer4_tcp_p->iss_counter = 0;
+    net_layer4_end_point_list_init(&layer4_tcp_p->local_tcp_end_point_list,
+                                   NET_LAYER4_TCP);
+    rtos_mutex_init(&layer4_tcp_p->mutex, "layer-4 TCP mutex");
+}
+
+
+/**
+ * Initializes a TCP connection object
+ *
+ * @param connection_p  Pointer to the TCP connection
+ */
+void net_layer4_tcp_connection_init(struct net_tcp_connection *connection_p)
+{
+    connection_p->signature = NET_TCP_CONNECTION_SIGNATURE;
+    net_layer4_end_point_init(&connection_p->end_point, NET_LAYER4_TCP);
+    connection_p->num_tx_segments = 0;
+    connection_p->rx_current_packet_p = NULL;
+    connection_p->segments_sent_count = 0;
+    connection_p->segments_retransmitted_count = 0;
+    connection_p->segments_received_count = 0;
+    connection_p->out_of_order_segments_dropped_count = 0;
+    rtos_semaphore_init(&connection_p->event_semaphore,
+                        "TCP connection event semaphore", 0);
+    rtos_mutex_init(&connection_p->mutex, "TCP connection mutex");
+    timer_wheel_timer_init(&connection_p->timer, tcp_timer_callback,
+                           connection_p);
+
+    rtos_mutex_lock(&connection_p->mutex);
+    tcp_reset_connection_vars(connection_p);
+    rtos_mutex_unlock(&connection_p->mutex);
+}
+
+
+/**
+ * Binds a TCP connection to a local port and sets its initial state. Its
+ * end point is added to the list of local TCP end points, so that received
+ * segments are delivered to it.
+ *
+ * @param connection_p  Pointer to the TCP connection
+ * @param tcp_port      TCP port number to use, or 0 if an ephemeral port is
+ *                      to be chosen.
+ * @param state         Initial state (NET_TCP_LISTEN or NET_TCP_SYN_SENT)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t tcp_bind_connection(struct net_tcp_connection *connection_p,
+                                   uint16_t tcp_port, /* big endian */
+                                   enum net_tcp_states state)
+{
+    struct net_layer4_tcp *layer4_tcp_p = &g_net_layer4.tcp;
+    struct net_layer4_end_point *end_point_p = &connection_p->end_point;
+    error_t error = 0;
+
+    rtos_mutex_lock(&layer4_tcp_p->mutex);
+
+    if (end_point_p->list_p != NULL) {
+        if (connection_p->state != NET_TCP_CLOSED) {
+            error = CAPTURE_ERROR("TCP connection already in use", connection_p,
+                                  connection_p->state);
+            goto exit;
+        }
+
+        net_layer4_end_point_list_remove(&layer4_tcp_p->local_tcp_end_point_list,
+                                         end_point_p);
+        end_point_p->layer4_port = 0;
+    }
+
+    if (tcp_port == 0) {
+        uint_fast16_t num_tries = UINT16_MAX - NET_FIRST_EPHEMERAL_PORT + 1;
+
+        do {
+            if (num_tries == 0) {
+                error = CAPTURE_ERROR("No more TCP ephemeral ports available",
+                                      0, 0);
+                goto exit;
+            }
+
+            tcp_port = hton16(layer4_tcp_p->next_ephemeral_port);
+            layer4_tcp_p->next_ephemeral_port ++;
+            if (layer4_tcp_p->next_ephemeral_port == 0) {
+                layer4_tcp_p->next_ephemeral_port = NET_FIRST_EPHEMERAL_PORT;
+            }
+
+            num_tries --;
+        } while (net_layer4_end_point_list_lookup(
+                    &layer4_tcp_p->local_tcp_end_point_list, tcp_port) != NULL);
+    } else {
+        struct net_layer4_end_point *existing_end_point_p =
+            net_layer4_end_point_list_lookup(&layer4_tcp_p->local_tcp_end_point_list,
+                                             tcp_port);
+
+        if (existing_end_point_p != NULL) {
+            if (tcp_connection_from_end_point(existing_end_point_p)->state !=
+                NET_TCP_CLOSED) {
+                error = CAPTURE_ERROR("TCP port already in use", ntoh16(tcp_port),
+                                      existing_end_point_p);
+                goto exit;
+            }
+
+            /*
+             * Closed connections stay in the list until their port is
+             * reused:
+             */
+            net_layer4_end_point_list_remove(&layer4_tcp_p->local_tcp_end_point_list,
+                                             existing_end_point_p);
+            existing_end_point_p->layer4_port = 0;
+        }
+    }
+
+    rtos_mutex_lock(&connection_p->mutex);
+    tcp_reset_connection_vars(connection_p);
+    connection_p->state = state;
+    rtos_mutex_unlock(&connection_p->mutex);
+
+    end_point_p->layer4_port = tcp_port;
+    net_layer4_end_point_list_add(&layer4_tcp_p->local_tcp_end_point_list,
+                                  end_point_p);
+
+exit:
+    rtos_mutex_unlock(&layer4_tcp_p->mutex);
+    return error;
+}
+
+
+/**
+ * Starts listening for a connection from a peer on a given TCP port
+ *
+ * @param connection_p  Pointer to the TCP connection
+ * @param tcp_port      TCP port number (big endian)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_tcp_listen(struct net_tcp_connection *connection_p,
+                              uint16_t tcp_port /* big endian */)
+{
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(connection_p, sizeof *connection_p, 0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+
+    if (tcp_port == 0) {
+        error = CAPTURE_ERROR("Invalid TCP port to listen on", 0, 0);
+    } else {
+        error = tcp_bind_connection(connection_p, tcp_port, NET_TCP_LISTEN);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Waits until a peer has connected to a listening TCP connection
+ *
+ * @param connection_p  Pointer to the listening TCP connection
+ * @param timeout_ms    0, or timeout (in milliseconds) for waiting
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_tcp_accept(struct net_tcp_connection *connection_p,
+                              uint32_t timeout_ms)
+{
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+
+    for ( ; ; ) {
+        enum net_tcp_states state = connection_p->state;
+
+        if (state == NET_TCP_ESTABLISHED || state == NET_TCP_CLOSE_WAIT) {
+            return 0;
+        }
+
+        if (state != NET_TCP_LISTEN && state != NET_TCP_SYN_RECEIVED) {
+            return CAPTURE_ERROR("TCP connection not listening", connection_p,
+                                 state);
+        }
+
+        if (!tcp_wait_for_event(connection_p, start_ticks, timeout_ms)) {
+            return CAPTURE_ERROR("TCP accept timeout", connection_p, timeout_ms);
+        }
+    }
+}
+
+
+/**
+ * Connects to a TCP peer
+ *
+ * @param connection_p      Pointer to the TCP connection
+ * @param dest_ip_addr_p    Peer's IPv4 address (unicast, not local)
+ * @param dest_port         Peer's TCP port (big endian)
+ * @param timeout_ms        0, or timeout (in milliseconds) for waiting for
+ *                          the connection to be established
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_tcp_connect(struct net_tcp_connection *connection_p,
+                               const struct ipv4_address *dest_ip_addr_p,
+                               uint16_t dest_port, /* big endian */
+                               uint32_t timeout_ms)
+{
+    struct ipv4_address local_ip_addr;
+    struct ipv4_address subnet_mask;
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+
+    net_layer3_get_local_ipv4_address(&local_ip_addr, &subnet_mask);
+
+    /*
+     * NOTE: Loopback is not supported, as looped-back segments would be
+     * processed synchronously, with the connection's mutex held.
+     */
+    if (dest_port == 0 ||
+        dest_ip_addr_p->value == IPV4_NULL_ADDR ||
+        dest_ip_addr_p->value == IPV4_BROADCAST_ADDR ||
+        dest_ip_addr_p->value == local_ip_addr.value ||
+        IPV4_ADDR_IS_MULTICAST(dest_ip_addr_p) ||
+        IPV4_ADDR_IS_LOOPBACK(dest_ip_addr_p)) {
+        return CAPTURE_ERROR("Invalid TCP peer", dest_ip_addr_p->value,
+                             ntoh16(dest_port));
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(connection_p, sizeof *connection_p, 0);
+#   endif
+
+    error = tcp_bind_connection(connection_p, 0, NET_TCP_CLOSED);
+    if (error != 0) {
+        goto common_exit;
+    }
+
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                          sizeof(struct ipv4_header) +
+                                          sizeof(struct tcp_header) +
+                                          TCP_OPTION_MSS_LENGTH,
+                                      false);
+
+    rtos_mutex_lock(&connection_p->mutex);
+    connection_p->peer_ip_addr = *dest_ip_addr_p;
+    connection_p->peer_port = dest_port;
+    tcp_init_send_sequence(connection_p);
+    connection_p->state = NET_TCP_SYN_SENT;
+    tcp_queue_tx_segment(connection_p, tx_packet_p, TCP_FLAG_SYN, NULL, 0);
+    rtos_mutex_unlock(&connection_p->mutex);
+
+    while (connection_p->state == NET_TCP_SYN_SENT) {
+        if (!tcp_wait_for_event(connection_p, start_ticks, timeout_ms)) {
+            net_layer4_tcp_abort(connection_p);
+            error = CAPTURE_ERROR("TCP connect timeout", dest_ip_addr_p->value,
+                                  ntoh16(dest_port));
+            goto common_exit;
+        }
+    }
+
+    if (connection_p->state != NET_TCP_ESTABLISHED &&
+        connection_p->state != NET_TCP_CLOSE_WAIT) {
+        error = CAPTURE_ERROR("TCP connection refused", dest_ip_addr_p->value,
+                              ntoh16(dest_port));
+    }
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Sends data over a TCP connection, one segment of up to the peer's MSS at a
+ * time. Each segment is kept in its Tx packet until acknowledged. It blocks
+ * while the send window or the unacknowledged segments limit is reached.
+ *
+ * @param connection_p  Pointer to the TCP connection
+ * @param data_p        Data to send
+ * @param data_length   Length of the data
+ * @param timeout_ms    0, or timeout (in milliseconds) for sending all the
+ *                      data
+ * @param zero_copy     If false, the data is copied to the Tx packets.
+ *                      If true, only the headers are in the Tx packets, and
+ *                      the data is transmitted from where it is.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t tcp_send_data(struct net_tcp_connection *connection_p,
+                             const void *data_p,
+                             size_t data_length,
+                             uint32_t timeout_ms,
+                             bool zero_copy)
+{
+    const uint8_t *next_data_p = data_p;
+    size_t remaining_length = data_length;
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+    error_t error = 0;
+
+    while (remaining_length != 0) {
+        bool no_tx_packet = false;
+
+        rtos_mutex_lock(&connection_p->mutex);
+        if (connection_p->state != NET_TCP_ESTABLISHED &&
+            connection_p->state != NET_TCP_CLOSE_WAIT) {
+            rtos_mutex_unlock(&connection_p->mutex);
+            return CAPTURE_ERROR("TCP connection not open for sending",
+                                 connection_p, connection_p->state);
+        }
+
+        uint32_t window = connection_p->send_window;
+        uint32_t in_flight = connection_p->send_next - connection_p->send_unacked;
+
+        if (window > connection_p->congestion_window) {
+            window = connection_p->congestion_window;
+        }
+
+        uint32_t usable_window = (window > in_flight) ? window - in_flight : 0;
+
+        if (usable_window == 0 && in_flight == 0) {
+            /*
+             * Peer's window closed: send one byte as a window probe
+             */
+            usable_window = 1;
+        }
+
+        if (connection_p->num_tx_segments < NET_TCP_MAX_UNACKED_SEGMENTS &&
+            usable_window != 0) {
+            size_t segment_length = remaining_length;
+
+            if (segment_length > connection_p->send_mss) {
+                segment_length = connection_p->send_mss;
+            }
+
+            if (segment_length > usable_window) {
+                segment_length = usable_window;
+            }
+
+            struct network_packet *tx_packet_p =
+                net_layer2_try_allocate_tx_packet(sizeof(struct ethernet_header) +
+                                                      sizeof(struct ipv4_header) +
+                                                      sizeof(struct tcp_header) +
+                                                      (zero_copy ? 0 : segment_length),
+                                                  false);
+            if (tx_packet_p != NULL) {
+                if (!zero_copy) {
+                    struct tcp_header *tcp_header_p =
+                        (struct tcp_header *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+
+                    memcpy(tcp_header_p + 1, next_data_p, segment_length);
+                }
+
+                remaining_length -= segment_length;
+                tcp_queue_tx_segment(connection_p, tx_packet_p,
+                                     TCP_FLAG_ACK |
+                                        (remaining_length == 0 ? TCP_FLAG_PSH : 0),
+                                     zero_copy ? next_data_p : NULL,
+                                     segment_length);
+                next_data_p += segment_length;
+                rtos_mutex_unlock(&connection_p->mutex);
+                continue;
+            }
+
+            no_tx_packet = true;
+        }
+
+        rtos_mutex_unlock(&connection_p->mutex);
+        if (no_tx_packet) {
+            /*
+             * Tx packets freed by others do not signal the connection:
+             */
+            rtos_task_delay(NET_TCP_TIMER_PERIOD_MS);
+        } else if (!tcp_wait_for_event(connection_p, start_ticks, timeout_ms)) {
+            error = CAPTURE_ERROR("TCP send timeout", connection_p,
+                                  data_length - remaining_length);
+            break;
+        }
+
+        if (timeout_ms != 0 &&
+            RTOS_TICKS_TO_MILLISECONDS(
+                RTOS_TICKS_DELTA(start_ticks, rtos_get_ticks_since_boot())) >=
+               timeout_ms) {
+            error = CAPTURE_ERROR("TCP send timeout", connection_p,
+                                  data_length - remaining_length);
+            break;
+        }
+    }
+
+    return error;
+}
+
+
+/**
+ * Sends data over a TCP connection. The data is copied to Tx packets, one
+ * full-size segment per packet, which are kept until acknowledged. It blocks
+ * while the send window or the unacknowledged segments limit is reached.
+ *
+ * @param connection_p  Pointer to the TCP connection
+ * @param data_p        Data to send
+ * @param data_length   Length of the data
+ * @param timeout_ms    0, or timeout (in milliseconds) for sending all the
+ *                      data
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_tcp_send(struct net_tcp_connection *connection_p,
+                            const void *data_p,
+                            size_t data_length,
+                            uint32_t timeout_ms)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+
+    return tcp_send_data(connection_p, data_p, data_length, timeout_ms, false);
+}
+
+
+/**
+ * Sends data over a TCP connection without copying it to Tx packets: the Tx
+ * packets only hold the protocol headers, and the data is transmitted by
+ * the Ethernet MAC's DMA straight from where it is, as a Tx payload
+ * fragment. This is meant for streaming const data, such as memory-mapped
+ * flash regions (e.g., a log area written by nor_flash_write()).
+ *
+ * The data must not change until it has been acknowledged by the peer, as
+ * it may need to be retransmitted, so this function returns only after all
+ * the data has been acknowledged (or on failure).
+ *
+ * @param connection_p  Pointer to the TCP connection
+ * @param data_p        Data to send
+ * @param data_length   Length of the data
+ * @param timeout_ms    0, or timeout (in milliseconds) for sending all the
+ *                      data and having it acknowledged
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_tcp_send_zero_copy(struct net_tcp_connection *connection_p,
+                                      const void *data_p,
+                                      size_t data_length,
+                                      uint32_t timeout_ms)
+{
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+
+    error = tcp_send_data(connection_p, data_p, data_length, timeout_ms, true);
+    if (error != 0) {
+        goto exit;
+    }
+
+    /*
+     * Wait until no sent segment references the caller's data:
+     */
+    for ( ; ; ) {
+        bool data_in_flight = false;
+
+        rtos_mutex_lock(&connection_p->mutex);
+        for (uint_fast8_t i = 0; i < connection_p->num_tx_segments; i ++) {
+            uint_fast8_t index = (connection_p->tx_segments_head + i) %
+                                 NET_TCP_MAX_UNACKED_SEGMENTS;
+
+            if (connection_p->tx_segments[index].zero_copy_data_p != NULL) {
+                data_in_flight = true;
+                break;
+            }
+        }
+
+        bool reset = connection_p->reset;
+
+        rtos_mutex_unlock(&connection_p->mutex);
+        if (reset) {
+            error = CAPTURE_ERROR("TCP connection reset", connection_p, 0);
+            break;
+        }
+
+        if (!data_in_flight) {
+            break;
+        }
+
+        if (!tcp_wait_for_event(connection_p, start_ticks, timeout_ms)) {
+            error = CAPTURE_ERROR("TCP zero-copy send timeout", connection_p,
+                                  data_length);
+            break;
+        }
+    }
+
+exit:
+    if (error != 0) {
+        /*
+         * The caller's data cannot be referenced after returning:
+         */
+        net_layer4_tcp_abort(connection_p);
+    }
+
+    return error;
+}
+
+
+/**
+ * Receives data from a TCP connection. It waits until some data is
+ * available, and then returns as much data as is available, up to
+ * buffer_size bytes.
+ *
+ * @param connection_p          Pointer to the TCP connection
+ * @param buffer_p              Buffer where the data is to be copied
+ * @param buffer_size           Size of the buffer
+ * @param timeout_ms            0, or timeout (in milliseconds) for waiting
+ *                              for data
+ * @param received_length_p     Area where the number of bytes received is
+ *                              returned. 0 means that the peer closed the
+ *                              connection and all its data has been read.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_tcp_receive(struct net_tcp_connection *connection_p,
+                               void *buffer_p,
+                               size_t buffer_size,
+                               uint32_t timeout_ms,
+                               size_t *received_length_p)
+{
+    uint8_t *next_byte_p = buffer_p;
+    size_t received_length = 0;
+    uint32_t start_ticks = rtos_get_ticks_since_boot();
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+    D_ASSERT(buffer_size != 0);
+
+    for ( ; ; ) {
+        bool window_was_small;
+
+        rtos_mutex_lock(&connection_p->mutex);
+        while (received_length < buffer_size) {
+            struct network_packet *rx_packet_p = connection_p->rx_current_packet_p;
+
+            if (rx_packet_p == NULL) {
+                rx_packet_p =
+                    net_packet_queue_try_remove(&connection_p->end_point.rx_packet_queue);
+                if (rx_packet_p == NULL) {
+                    break;
+                }
+
+                net_packet_set_owner(rx_packet_p);
+
+                const struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+                const struct tcp_header *tcp_header_p =
+                    (const struct tcp_header *)GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+
+                connection_p->rx_current_offset =
+                    sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+                    GET_BIT_FIELD(tcp_header_p->data_offset, TCP_DATA_OFFSET_MASK,
+                                  TCP_DATA_OFFSET_SHIFT) * 4;
+                connection_p->rx_current_end =
+                    sizeof(struct ethernet_header) + ntoh16(ipv4_header_p->total_length);
+                connection_p->rx_current_packet_p = rx_packet_p;
+                ATOMIC_POST_INCREMENT_UINT32(&connection_p->end_point.num_lent_rx_packets);
+            }
+
+            size_t copy_length = connection_p->rx_current_end -
+                                 connection_p->rx_current_offset;
+
+            if (copy_length > buffer_size - received_length) {
+                copy_length = buffer_size - received_length;
+            }
+
+            memcpy(next_byte_p,
+                   rx_packet_p->data_buffer + connection_p->rx_current_offset,
+                   copy_length);
+            next_byte_p += copy_length;
+            received_length += copy_length;
+            connection_p->rx_current_offset += copy_length;
+            if (connection_p->rx_current_offset == connection_p->rx_current_end) {
+                net_recycle_rx_packet(rx_packet_p);
+                connection_p->rx_current_packet_p = NULL;
+                ATOMIC_POST_DECREMENT_UINT32(
+                    &connection_p->end_point.num_lent_rx_packets);
+
+                /*
+                 * Let the peer know as soon as a closed window opens up:
+                 */
+                window_was_small =
+                    connection_p->last_advertised_window < connection_p->send_mss;
+                if (window_was_small &&
+                    tcp_receive_window(connection_p) >= connection_p->send_mss &&
+                    connection_p->state != NET_TCP_CLOSED) {
+                    tcp_send_control_segment(connection_p, TCP_FLAG_ACK);
+                }
+            }
+        }
+
+        bool fin_received = connection_p->fin_received;
+        bool reset = connection_p->reset;
+        enum net_tcp_states state = connection_p->state;
+
+        rtos_mutex_unlock(&connection_p->mutex);
+
+        if (received_length != 0 || fin_received) {
+            break;
+        }
+
+        if (reset) {
+            error = CAPTURE_ERROR("TCP connection reset", connection_p, 0);
+            break;
+        }
+
+        if (state != NET_TCP_ESTABLISHED &&
+            state != NET_TCP_FIN_WAIT_1 &&
+            state != NET_TCP_FIN_WAIT_2) {
+            error = CAPTURE_ERROR("TCP connection not open for receiving",
+                                  connection_p, state);
+            break;
+        }
+
+        if (!tcp_wait_for_event(connection_p, start_ticks, timeout_ms)) {
+            error = CAPTURE_ERROR("TCP receive timeout", connection_p,
+                                  timeout_ms);
+            break;
+        }
+    }
+
+    *received_length_p = received_length;
+    return error;
+}
+
+
+/**
+ * Closes a TCP connection. If the connection is established, a FIN is sent
+ * to the peer, and the connection goes through the regular closing states in
+ * the background. Received data not read yet is discarded.
+ *
+ * @param connection_p  Pointer to the TCP connection
+ */
+void net_layer4_tcp_close(struct net_tcp_connection *connection_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+
+    rtos_mutex_lock(&connection_p->mutex);
+
+    switch (connection_p->state) {
+    case NET_TCP_LISTEN:
+    case NET_TCP_SYN_SENT:
+        tcp_enter_closed_state(connection_p, false);
+        break;
+
+    case NET_TCP_SYN_RECEIVED:
+    case NET_TCP_ESTABLISHED:
+        connection_p->state = NET_TCP_FIN_WAIT_1;
+        tcp_send_fin(connection_p);
+        break;
+
+    case NET_TCP_CLOSE_WAIT:
+        connection_p->state = NET_TCP_LAST_ACK;
+        tcp_send_fin(connection_p);
+        break;
+
+    default:
+        break;
+    }
+
+    /*
+     * Only received data is released. Sent segments are still needed for
+     * retransmissions:
+     */
+    struct network_packet *rx_packet_p;
+
+    if (connection_p->rx_current_packet_p != NULL) {
+        net_recycle_rx_packet(connection_p->rx_current_packet_p);
+        connection_p->rx_current_packet_p = NULL;
+        ATOMIC_POST_DECREMENT_UINT32(&connection_p->end_point.num_lent_rx_packets);
+    }
+
+    while ((rx_packet_p =
+                net_packet_queue_try_remove(&connection_p->end_point.rx_packet_queue)) !=
+           NULL) {
+        net_recycle_rx_packet(rx_packet_p);
+    }
+
+    tcp_update_timer(connection_p);
+    rtos_mutex_unlock(&connection_p->mutex);
+}
+
+
+/**
+ * Aborts a TCP connection, sending a reset to the peer if the connection is
+ * synchronized
+ *
+ * @param connection_p  Pointer to the TCP connection
+ */
+void net_layer4_tcp_abort(struct net_tcp_connection *connection_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(connection_p->signature == NET_TCP_CONNECTION_SIGNATURE);
+
+    rtos_mutex_lock(&connection_p->mutex);
+
+    if (connection_p->state != NET_TCP_CLOSED &&
+        connection_p->state != NET_TCP_LISTEN &&
+        connection_p->state != NET_TCP_SYN_SENT) {
+        tcp_send_control_segment(connection_p, TCP_FLAG_RST | TCP_FLAG_ACK);
+    }
+
+    tcp_enter_closed_state(connection_p, true);
+    tcp_release_buffers(connection_p);
+    rtos_mutex_unlock(&connection_p->mutex);
+}
+
+
+void net_layer4_process_incoming_tcp_segment(struct network_packet *rx_packet_p)
+{
+    struct tcp_rx_segment segment;
+    bool rx_packet_queued = false;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+        struct mpu_region_range old_comp_region;
+
+        rtos_thread_set_comp_region(&g_net_layer4,
+                                    sizeof g_net_layer4,
+                                    0,
+                                    &old_comp_region);
+
+        rtos_thread_set_tmp_region(rx_packet_p, sizeof *rx_packet_p, 0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+
+    struct net_layer4_tcp *layer4_tcp_p = &g_net_layer4.tcp;
+    const struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    size_t ip_header_length =
+        GET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                      IP_HEADER_LENGTH_MASK, IP_HEADER_LENGTH_SHIFT) * 4;
+    size_t ip_total_length = ntoh16(ipv4_header_p->total_length);
+
+    ATOMIC_POST_INCREMENT_UINT32(&layer4_tcp_p->rx_segments_count);
+
+    /*
+     * NOTE: Received segments are read assuming an IPv4 header without
+     * options, as for UDP.
+     */
+    if (GET_IP_VERSION(ipv4_header_p) != 4 ||
+        ip_header_length != sizeof(struct ipv4_header) ||
+        ip_total_length < ip_header_length + sizeof(struct tcp_header) ||
+        rx_packet_p->total_length < sizeof(struct ethernet_header) + ip_total_length) {
+        goto drop;
+    }
+
+    /*
+     * NOTE: The TCP checksum is validated by the Ethernet MAC hardware. We
+     * just need to check the result.
+     */
+    if (NET_RX_PACKET_PROTOCOL_CHECKSUM_BAD(rx_packet_p)) {
+        ATOMIC_POST_INCREMENT_UINT32(
+            &layer4_tcp_p->rx_segments_dropped_bad_checksum_count);
+        goto drop;
+    }
+
+    segment.tcp_header_p =
+        (const struct tcp_header *)GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+    segment.header_length =
+        GET_BIT_FIELD(segment.tcp_header_p->data_offset, TCP_DATA_OFFSET_MASK,
+                      TCP_DATA_OFFSET_SHIFT) * 4;
+    if (segment.header_length < sizeof(struct tcp_header) ||
+        segment.header_length > ip_total_length - ip_header_length) {
+        goto drop;
+    }
+
+    segment.source_ip_addr = ipv4_header_p->source_ip_addr;
+    segment.source_port = segment.tcp_header_p->source_port;
+    segment.dest_port = segment.tcp_header_p->dest_port;
+    segment.seq_num = ntoh32(segment.tcp_header_p->seq_num);
+    segment.ack_num = ntoh32(segment.tcp_header_p->ack_num);
+    segment.window = ntoh16(segment.tcp_header_p->window);
+    segment.flags = segment.tcp_header_p->flags;
+    segment.data_offset = sizeof(struct ethernet_header) + ip_header_length +
+                          segment.header_length;
+    segment.data_length = ip_total_length - ip_header_length -
+                          segment.header_length;
+
+    if (NET_LAYER4_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer4: TCP segment received: "
+                     "source port %u, destination port %u, flags %#x, "
+                     "seq %#x, ack %#x, length %u\n",
+                     ntoh16(segment.source_port), ntoh16(segment.dest_port),
+                     segment.flags, segment.seq_num, segment.ack_num,
+                     segment.data_length);
+    }
+
+    rtos_mutex_lock(&layer4_tcp_p->mutex);
+    struct net_layer4_end_point *end_point_p =
+        net_layer4_end_point_list_lookup(&layer4_tcp_p->local_tcp_end_point_list,
+                                         segment.dest_port);
+    rtos_mutex_unlock(&layer4_tcp_p->mutex);
+
+    if (end_point_p == NULL) {
+        tcp_send_reset_for_segment(&segment);
+        goto drop;
+    }
+
+    struct net_tcp_connection *connection_p =
+        tcp_connection_from_end_point(end_point_p);
+
+    rtos_mutex_lock(&connection_p->mutex);
+    ATOMIC_POST_INCREMENT_UINT32(&connection_p->segments_received_count);
+    rx_packet_queued = tcp_process_segment(connection_p, rx_packet_p, &segment);
+    tcp_update_timer(connection_p);
+    rtos_mutex_unlock(&connection_p->mutex);
+
+    if (!rx_packet_queued) {
+        net_recycle_rx_packet(rx_packet_p);
+    }
+
+    goto exit;
+
+drop:
+    net_recycle_rx_packet(rx_packet_p);
+    ATOMIC_POST_INCREMENT_UINT32(&layer4_tcp_p->rx_segments_dropped_count);
+
+exit:
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
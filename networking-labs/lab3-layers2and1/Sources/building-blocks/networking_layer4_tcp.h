@@ -0,0 +1,459 @@
+/**
+ * @file networking_layer4_tcp.h
+ *
+ * Networking layer 4 interface: TCP
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER4_TCP_H_
+#define SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER4_TCP_H_
+
+#include "networking_layer3.h"
+#include "net_layer4_end_point.h"
+#include "rtos_wrapper.h"
+#include "timer_wheel.h"
+
+/**
+ * TCP maximum segment size (MSS) used by the local end of a connection: a
+ * full Ethernet frame, without IPv4 or TCP options
+ */
+#define NET_TCP_MSS \
+        (ETHERNET_MAX_FRAME_DATA_SIZE - sizeof(struct ipv4_header) - \
+         sizeof(struct tcp_header))
+
+/**
+ * TCP MSS assumed for the peer, if it does not send the MSS option
+ */
+#define NET_TCP_DEFAULT_PEER_MSS    536
+
+/**
+ * Maximum number of sent TCP segments of a connection that can be waiting to
+ * be acknowledged. Each one holds a full-size Tx packet until it is
+ * acknowledged, so that it can be retransmitted without copying.
+ */
+#define NET_TCP_MAX_UNACKED_SEGMENTS    3
+
+C_ASSERT(NET_TCP_MAX_UNACKED_SEGMENTS < NET_MAX_LARGE_TX_PACKETS);
+
+/**
+ * Interval in milliseconds between retries of operations that could not be
+ * done for lack of Tx packets
+ */
+#define NET_TCP_TIMER_PERIOD_MS     50
+
+/**
+ * Maximum time in milliseconds that the ACK of a received segment is
+ * delayed, waiting for a second segment or for outgoing data to carry it
+ */
+#define NET_TCP_DELAYED_ACK_TIMEOUT_MS  100
+
+/**
+ * Initial, minimum and maximum TCP retransmission timeouts in milliseconds
+ */
+#define NET_TCP_INITIAL_RTO_MS      1000
+#define NET_TCP_MIN_RTO_MS          200
+#define NET_TCP_MAX_RTO_MS          16000
+
+/**
+ * Maximum number of consecutive retransmissions of a segment before the
+ * connection is aborted
+ */
+#define NET_TCP_MAX_RETRANSMISSIONS     8
+
+/**
+ * Number of duplicate ACKs that trigger a fast retransmission
+ */
+#define NET_TCP_DUP_ACK_THRESHOLD       3
+
+/**
+ * Time in milliseconds that a connection stays in the TIME-WAIT state.
+ * It is much shorter than the 2 * MSL of RFC 793, as this stack is meant for
+ * transfers on a local network.
+ */
+#define NET_TCP_TIME_WAIT_MS        2000
+
+/**
+ * Compare TCP sequence numbers modulo 2^32
+ */
+#define TCP_SEQ_LT(_seq1, _seq2)    ((int32_t)((_seq1) - (_seq2)) < 0)
+#define TCP_SEQ_LEQ(_seq1, _seq2)   ((int32_t)((_seq1) - (_seq2)) <= 0)
+#define TCP_SEQ_GT(_seq1, _seq2)    ((int32_t)((_seq1) - (_seq2)) > 0)
+#define TCP_SEQ_GEQ(_seq1, _seq2)   ((int32_t)((_seq1) - (_seq2)) >= 0)
+
+/**
+ * TCP header layout
+ * (A TCP segment is encapsulated in an IP packet)
+ */
+struct tcp_header {
+    /**
+     * Source port number
+     * (hton16() must be invoked before writing this field.
+     *  ntoh16() must be invoked after reading this field.)
+     */
+    uint16_t source_port;
+
+    /**
+     * Destination port number
+     * (hton16() must be invoked before writing this field.
+     *  ntoh16() must be invoked after reading this field.)
+     */
+    uint16_t dest_port;
+
+    /**
+     * Sequence number of the first data byte of the segment
+     * (hton32() must be invoked before writing this field.
+     *  ntoh32() must be invoked after reading this field.)
+     */
+    uint32_t seq_num;
+
+    /**
+     * Next sequence number expected from the other end, if TCP_FLAG_ACK is
+     * set
+     * (hton32() must be invoked before writing this field.
+     *  ntoh32() must be invoked after reading this field.)
+     */
+    uint32_t ack_num;
+
+    /**
+     * Header length in 32-bit words (upper 4 bits)
+     */
+    uint8_t data_offset;
+#   define TCP_DATA_OFFSET_MASK     MULTI_BIT_MASK(7, 4)
+#   define TCP_DATA_OFFSET_SHIFT    4
+
+    uint8_t flags;
+#   define TCP_FLAG_FIN     BIT(0)
+#   define TCP_FLAG_SYN     BIT(1)
+#   define TCP_FLAG_RST     BIT(2)
+#   define TCP_FLAG_PSH     BIT(3)
+#   define TCP_FLAG_ACK     BIT(4)
+#   define TCP_FLAG_URG     BIT(5)
+
+    /**
+     * Receive window in bytes
+     * (hton16() must be invoked before writing this field.
+     *  ntoh16() must be invoked after reading this field.)
+     */
+    uint16_t window;
+
+    /**
+     * TCP segment checksum
+     */
+    uint16_t checksum;
+
+    /**
+     * Urgent pointer (not supported)
+     */
+    uint16_t urgent_pointer;
+};
+
+C_ASSERT(sizeof(struct tcp_header) == 20);
+
+C_ASSERT(sizeof(struct tcp_header) + NET_TCP_MSS <= NET_MAX_IPV4_PACKET_PAYLOAD_SIZE);
+
+/**
+ * TCP MSS option (only option sent, and only in SYN segments)
+ */
+#define TCP_OPTION_END_OF_LIST  UINT8_C(0)
+#define TCP_OPTION_NOP          UINT8_C(1)
+#define TCP_OPTION_MSS          UINT8_C(2)
+#define TCP_OPTION_MSS_LENGTH   4
+
+/**
+ * TCP connection states (RFC 793)
+ */
+enum net_tcp_states {
+    NET_TCP_CLOSED = 0,
+    NET_TCP_LISTEN,
+    NET_TCP_SYN_SENT,
+    NET_TCP_SYN_RECEIVED,
+    NET_TCP_ESTABLISHED,
+    NET_TCP_FIN_WAIT_1,
+    NET_TCP_FIN_WAIT_2,
+    NET_TCP_CLOSE_WAIT,
+    NET_TCP_CLOSING,
+    NET_TCP_LAST_ACK,
+    NET_TCP_TIME_WAIT,
+};
+
+/**
+ * Sent TCP segment waiting to be acknowledged
+ */
+struct net_tcp_tx_segment {
+    /**
+     * Tx packet holding the segment's headers and, unless zero_copy_data_p
+     * is not NULL, its data (owned by the connection)
+     */
+    struct network_packet *tx_packet_p;
+
+    /**
+     * Segment's data outside of the Tx packet (e.g., in memory-mapped flash),
+     * transmitted as a payload fragment, or NULL if the data is in the Tx
+     * packet
+     */
+    const void *zero_copy_data_p;
+
+    /**
+     * Sequence number of the segment
+     */
+    uint32_t seq_num;
+
+    /**
+     * Length of the segment's data
+     */
+    uint16_t data_length;
+
+    /**
+     * TCP flags of the segment (TCP_FLAG_SYN and TCP_FLAG_FIN take one
+     * sequence number each)
+     */
+    uint8_t flags;
+
+    /**
+     * Flag indicating if the segment has been retransmitted (its ACK is not
+     * used as an RTT sample)
+     */
+    bool retransmitted;
+
+    /**
+     * Timestamp in ticks when the segment was first sent
+     */
+    uint32_t tx_time_stamp;
+};
+
+/**
+ * TCP connection. The embedded layer-4 end point holds the local port and
+ * queues the received in-order segments that carry data, which are handed
+ * to the application without copying them out of their Rx packets.
+ *
+ * NOTE: A listening connection serves only the first peer that connects to
+ * it. After it is closed, it can listen again.
+ */
+struct net_tcp_connection {
+#   define NET_TCP_CONNECTION_SIGNATURE  GEN_SIGNATURE('T', 'C', 'P', 'C')
+    uint32_t signature;
+
+    /**
+     * Connection state
+     */
+    volatile enum net_tcp_states state;
+
+    /**
+     * Local end point (its protocol is NET_LAYER4_TCP)
+     */
+    struct net_layer4_end_point end_point;
+
+    /**
+     * Peer's IPv4 address and TCP port (big endian)
+     */
+    struct ipv4_address peer_ip_addr;
+    uint16_t peer_port;
+
+    /**
+     * MSS to use for segments sent to the peer
+     */
+    uint16_t send_mss;
+
+    /*
+     * Send sequence variables (RFC 793)
+     */
+    uint32_t send_iss;
+    uint32_t send_unacked;
+    uint32_t send_next;
+    uint32_t send_window;
+
+    /**
+     * Congestion window and slow start threshold in bytes
+     */
+    uint32_t congestion_window;
+    uint32_t slow_start_threshold;
+
+    /**
+     * Number of consecutive duplicate ACKs received
+     */
+    uint8_t num_dup_acks;
+
+    /**
+     * Sent segments waiting to be acknowledged: circular array with
+     * num_tx_segments entries starting at tx_segments_head
+     */
+    uint8_t num_tx_segments;
+    uint8_t tx_segments_head;
+    struct net_tcp_tx_segment tx_segments[NET_TCP_MAX_UNACKED_SEGMENTS];
+
+    /*
+     * Retransmission timer state
+     */
+    uint32_t rto_ms;
+    uint32_t smoothed_rtt_ms;
+    uint32_t rtt_variance_ms;
+    uint32_t rto_start_ticks;
+    uint8_t num_retransmissions;
+    bool rto_armed;
+
+    /*
+     * Receive sequence variables (RFC 793)
+     */
+    uint32_t receive_irs;
+    uint32_t receive_next;
+
+    /**
+     * Receive window last advertised to the peer
+     */
+    uint16_t last_advertised_window;
+
+    /**
+     * Number of received segments not yet acknowledged, and timestamp in
+     * ticks of the first of them (for delayed ACKs)
+     */
+    uint8_t num_unacked_rx_segments;
+    uint32_t ack_pending_start_ticks;
+
+    /**
+     * Flags indicating that the local FIN has to be sent, as soon as there is
+     * room for it in tx_segments[], and that it has been sent
+     */
+    bool fin_pending;
+    bool fin_sent;
+
+    /**
+     * Flag indicating that the peer's FIN has been received
+     */
+    volatile bool fin_received;
+
+    /**
+     * Flag indicating that the connection was reset or aborted
+     */
+    volatile bool reset;
+
+    /**
+     * Rx packet currently being read by net_layer4_tcp_receive(), and
+     * offsets of the next data byte to read and of the end of its data in
+     * its data buffer
+     */
+    struct network_packet *rx_current_packet_p;
+    uint16_t rx_current_offset;
+    uint16_t rx_current_end;
+
+    /**
+     * Timestamp in ticks when the TIME-WAIT state was entered
+     */
+    uint32_t time_wait_start_ticks;
+
+    /**
+     * Network timer wheel timer armed for the earliest pending timeout of
+     * the connection (delayed ACK, retransmission, TIME-WAIT or FIN retry)
+     */
+    struct timer_wheel_timer timer;
+
+    /**
+     * Counting semaphore signaled on every event that the application may be
+     * waiting for: state changes, data received and send space available
+     */
+    struct rtos_semaphore event_semaphore;
+
+    /**
+     * Mutex to serialize access to this connection. It may be acquired
+     * with the TCP layer mutex held, but not the other way.
+     */
+    struct rtos_mutex mutex;
+
+    /*
+     * Connection counters
+     */
+    volatile uint32_t segments_sent_count;
+    volatile uint32_t segments_retransmitted_count;
+    volatile uint32_t segments_received_count;
+    volatile uint32_t out_of_order_segments_dropped_count;
+};
+
+/**
+ * Networking layer-4 for TCP
+ */
+struct net_layer4_tcp {
+    /**
+     * Next ephemeral port to assign to a local TCP connection
+     */
+    uint16_t next_ephemeral_port;
+
+    /**
+     * Counter used to generate initial send sequence numbers
+     */
+    volatile uint32_t iss_counter;
+
+    /**
+     * Number of received TCP segments
+     */
+    volatile uint32_t rx_segments_count;
+
+    /**
+     * Number of received TCP segments dropped
+     */
+    volatile uint32_t rx_segments_dropped_count;
+
+    /**
+     * Number of received TCP segments dropped because the Ethernet MAC
+     * found a wrong TCP checksum (included in rx_segments_dropped_count)
+     */
+    volatile uint32_t rx_segments_dropped_bad_checksum_count;
+
+    /**
+     * Number of TCP resets sent
+     */
+    volatile uint32_t resets_sent_count;
+
+    /**
+     * Number of TCP segments retransmitted
+     */
+    volatile uint32_t retransmitted_segments_count;
+
+    /**
+     * List of local end points of bound TCP connections. Closed connections
+     * stay in the list until they or their port are bound again.
+     */
+    struct net_layer4_end_point_list local_tcp_end_point_list;
+
+    /**
+     * Mutex to serialize access to this struct
+     */
+    struct rtos_mutex mutex;
+};
+
+void net_layer4_tcp_init(struct net_layer4_tcp *layer4_tcp_p);
+
+void net_layer4_tcp_connection_init(struct net_tcp_connection *connection_p);
+
+error_t net_layer4_tcp_listen(struct net_tcp_connection *connection_p,
+                              uint16_t tcp_port /* big endian */);
+
+error_t net_layer4_tcp_accept(struct net_tcp_connection *connection_p,
+                              uint32_t timeout_ms);
+
+error_t net_layer4_tcp_connect(struct net_tcp_connection *connection_p,
+                               const struct ipv4_address *dest_ip_addr_p,
+                               uint16_t dest_port, /* big endian */
+                               uint32_t timeout_ms);
+
+error_t net_layer4_tcp_send(struct net_tcp_connection *connection_p,
+                            const void *data_p,
+                            size_t data_length,
+                            uint32_t timeout_ms);
+
+error_t net_layer4_tcp_receive(struct net_tcp_connection *connection_p,
+                               void *buffer_p,
+                               size_t buffer_size,
+                               uint32_t timeout_ms,
+                               size_t *received_length_p);
+
+error_t net_layer4_tcp_send_zero_copy(struct net_tcp_connection *connection_p,
+                                      const void *data_p,
+                                      size_t data_length,
+                                      uint32_t timeout_ms);
+
+void net_layer4_tcp_close(struct net_tcp_connection *connection_p);
+
+void net_layer4_tcp_abort(struct net_tcp_connection *connection_p);
+
+void net_layer4_process_incoming_tcp_segment(struct network_packet *rx_packet_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER4_TCP_H_ */
@@ -8,6 +8,348 @@
 #include "networking_layer4.h"
 #include "runtime_checks.h"
 #include "runtime_log.h"
+#include "perf_probes.h"
+#include "internet_checksum.h"
+
+
+/**
+ * Returns the bucket of the UDP port hash table for a given UDP port
+ */
+static inline struct net_udp_port_hash_bucket *
+udp_port_hash_bucket(struct net_layer4_udp *layer4_udp_p,
+                     uint16_t udp_port /* big endian */)
+{
+    /*
+     * NOTE: Both bytes of the port are folded, so that consecutive
+     * ephemeral ports spread over the buckets regardless of byte order.
+     */
+    uint_fast16_t hash = (udp_port ^ (udp_port >> 8)) &
+                         (NET_UDP_PORT_HASH_TABLE_NUM_BUCKETS - 1);
+
+    return &layer4_udp_p->port_hash_table[hash];
+}
+
+
+/**
+ * Marks the beginning of an update of a UDP port hash bucket, for lock-free
+ * readers. Must be called with the UDP mutex held.
+ */
+static inline void udp_port_hash_bucket_update_begin(
+    struct net_udp_port_hash_bucket *bucket_p)
+{
+    D_ASSERT(bucket_p->sequence_count % 2 == 0);
+    bucket_p->sequence_count ++;
+    __DMB();
+}
+
+
+/**
+ * Marks the end of an update of a UDP port hash bucket, for lock-free
+ * readers. Must be called with the UDP mutex held.
+ */
+static inline void udp_port_hash_bucket_update_end(
+    struct net_udp_port_hash_bucket *bucket_p)
+{
+    __DMB();
+    D_ASSERT(bucket_p->sequence_count % 2 != 0);
+    bucket_p->sequence_count ++;
+}
+
+
+/**
+ * Adds a bound UDP end point to the UDP port hash table. Must be called with
+ * the UDP mutex held.
+ */
+static void udp_port_hash_table_add(struct net_layer4_udp *layer4_udp_p,
+                                    struct net_layer4_end_point *layer4_end_point_p)
+{
+    struct net_udp_port_hash_bucket *bucket_p =
+        udp_port_hash_bucket(layer4_udp_p, layer4_end_point_p->layer4_port);
+
+    D_ASSERT(rtos_mutex_is_mine(&layer4_udp_p->mutex));
+    D_ASSERT(layer4_end_point_p->hash_chain_next_p == NULL);
+
+    udp_port_hash_bucket_update_begin(bucket_p);
+    layer4_end_point_p->hash_chain_next_p = bucket_p->head_p;
+    bucket_p->head_p = layer4_end_point_p;
+    udp_port_hash_bucket_update_end(bucket_p);
+}
+
+
+/**
+ * Removes a bound UDP end point from the UDP port hash table. Must be called
+ * with the UDP mutex held.
+ */
+static void udp_port_hash_table_remove(struct net_layer4_udp *layer4_udp_p,
+                                       struct net_layer4_end_point *layer4_end_point_p)
+{
+    struct net_udp_port_hash_bucket *bucket_p =
+        udp_port_hash_bucket(layer4_udp_p, layer4_end_point_p->layer4_port);
+    struct net_layer4_end_point *volatile *link_p = &bucket_p->head_p;
+
+    D_ASSERT(rtos_mutex_is_mine(&layer4_udp_p->mutex));
+
+    while (*link_p != NULL && *link_p != layer4_end_point_p) {
+        link_p = &(*link_p)->hash_chain_next_p;
+    }
+
+    if (*link_p == NULL) {
+        ERROR_PRINTF("UDP end point %#x not in port hash table\n",
+                     layer4_end_point_p);
+        return;
+    }
+
+    udp_port_hash_bucket_update_begin(bucket_p);
+    *link_p = layer4_end_point_p->hash_chain_next_p;
+    layer4_end_point_p->hash_chain_next_p = NULL;
+    udp_port_hash_bucket_update_end(bucket_p);
+}
+
+
+/**
+ * Looks up the UDP end point bound to a given UDP port in the UDP port hash
+ * table. Must be called with the UDP mutex held.
+ */
+static struct net_layer4_end_point *
+udp_port_hash_table_lookup(struct net_layer4_udp *layer4_udp_p,
+                           uint16_t udp_port /* big endian */)
+{
+    struct net_udp_port_hash_bucket *bucket_p =
+        udp_port_hash_bucket(layer4_udp_p, udp_port);
+
+    D_ASSERT(rtos_mutex_is_mine(&layer4_udp_p->mutex));
+
+    for (struct net_layer4_end_point *layer4_end_point_p = bucket_p->head_p;
+         layer4_end_point_p != NULL;
+         layer4_end_point_p = layer4_end_point_p->hash_chain_next_p) {
+        if (layer4_end_point_p->layer4_port == udp_port) {
+            return layer4_end_point_p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Looks up the UDP end point bound to a given UDP port in the UDP port hash
+ * table, without taking the UDP mutex. If the bucket keeps being updated
+ * while it is being read, it falls back to a lookup with the UDP mutex held.
+ */
+static struct net_layer4_end_point *
+udp_port_hash_table_lock_free_lookup(struct net_layer4_udp *layer4_udp_p,
+                                     uint16_t udp_port /* big endian */)
+{
+    struct net_udp_port_hash_bucket *bucket_p =
+        udp_port_hash_bucket(layer4_udp_p, udp_port);
+    struct net_layer4_end_point *layer4_end_point_p;
+
+    for (unsigned int retries = 0;
+         retries < NET_UDP_PORT_LOCK_FREE_LOOKUP_MAX_RETRIES;
+         retries ++) {
+        uint32_t sequence_count = bucket_p->sequence_count;
+        uint_fast16_t chain_length = 0;
+        bool chain_too_long = false;
+
+        if (sequence_count % 2 != 0) {
+            continue;
+        }
+
+        __DMB();
+        for (layer4_end_point_p = bucket_p->head_p;
+             layer4_end_point_p != NULL;
+             layer4_end_point_p = layer4_end_point_p->hash_chain_next_p) {
+            if (layer4_end_point_p->layer4_port == udp_port) {
+                break;
+            }
+
+            /*
+             * A concurrent update can make us follow stale links, so the
+             * walk is bounded by the number of bound end points:
+             */
+            chain_length ++;
+            if (chain_length > layer4_udp_p->local_udp_end_point_list.length) {
+                chain_too_long = true;
+                break;
+            }
+        }
+
+        __DMB();
+        if (bucket_p->sequence_count == sequence_count && !chain_too_long) {
+            return layer4_end_point_p;
+        }
+    }
+
+    rtos_mutex_lock(&layer4_udp_p->mutex);
+    layer4_end_point_p = udp_port_hash_table_lookup(layer4_udp_p, udp_port);
+    rtos_mutex_unlock(&layer4_udp_p->mutex);
+    return layer4_end_point_p;
+}
+
+
+/**
+ * Collects the UDP end points bound to a given UDP port, in the order they
+ * are found in the UDP port hash table (most recently bound first). Must be
+ * called with the UDP mutex held.
+ *
+ * @return number of end points collected (at most
+ *         NET_UDP_MAX_FAN_OUT_END_POINTS)
+ */
+static uint_fast8_t
+udp_port_hash_table_collect(struct net_layer4_udp *layer4_udp_p,
+                            uint16_t udp_port /* big endian */,
+                            struct net_layer4_end_point *end_points[])
+{
+    struct net_udp_port_hash_bucket *bucket_p =
+        udp_port_hash_bucket(layer4_udp_p, udp_port);
+    uint_fast8_t num_end_points = 0;
+
+    D_ASSERT(rtos_mutex_is_mine(&layer4_udp_p->mutex));
+
+    for (struct net_layer4_end_point *layer4_end_point_p = bucket_p->head_p;
+         layer4_end_point_p != NULL &&
+         num_end_points < NET_UDP_MAX_FAN_OUT_END_POINTS;
+         layer4_end_point_p = layer4_end_point_p->hash_chain_next_p) {
+        if (layer4_end_point_p->layer4_port == udp_port) {
+            end_points[num_end_points] = layer4_end_point_p;
+            num_end_points ++;
+        }
+    }
+
+    return num_end_points;
+}
+
+
+/**
+ * Collects the UDP end points bound to a given UDP port, without taking the
+ * UDP mutex. If the bucket keeps being updated while it is being read, it
+ * falls back to collecting them with the UDP mutex held.
+ *
+ * @return number of end points collected (at most
+ *         NET_UDP_MAX_FAN_OUT_END_POINTS)
+ */
+static uint_fast8_t
+udp_port_hash_table_lock_free_collect(struct net_layer4_udp *layer4_udp_p,
+                                      uint16_t udp_port /* big endian */,
+                                      struct net_layer4_end_point *end_points[])
+{
+    struct net_udp_port_hash_bucket *bucket_p =
+        udp_port_hash_bucket(layer4_udp_p, udp_port);
+    uint_fast8_t num_end_points;
+
+    for (unsigned int retries = 0;
+         retries < NET_UDP_PORT_LOCK_FREE_LOOKUP_MAX_RETRIES;
+         retries ++) {
+        uint32_t sequence_count = bucket_p->sequence_count;
+        uint_fast16_t chain_length = 0;
+        bool chain_too_long = false;
+
+        if (sequence_count % 2 != 0) {
+            continue;
+        }
+
+        num_end_points = 0;
+        __DMB();
+        for (struct net_layer4_end_point *layer4_end_point_p = bucket_p->head_p;
+             layer4_end_point_p != NULL &&
+             num_end_points < NET_UDP_MAX_FAN_OUT_END_POINTS;
+             layer4_end_point_p = layer4_end_point_p->hash_chain_next_p) {
+            if (layer4_end_point_p->layer4_port == udp_port) {
+                end_points[num_end_points] = layer4_end_point_p;
+                num_end_points ++;
+            }
+
+            chain_length ++;
+            if (chain_length > layer4_udp_p->local_udp_end_point_list.length) {
+                chain_too_long = true;
+                break;
+            }
+        }
+
+        __DMB();
+        if (bucket_p->sequence_count == sequence_count && !chain_too_long) {
+            return num_end_points;
+        }
+    }
+
+    rtos_mutex_lock(&layer4_udp_p->mutex);
+    num_end_points = udp_port_hash_table_collect(layer4_udp_p, udp_port,
+                                                 end_points);
+    rtos_mutex_unlock(&layer4_udp_p->mutex);
+    return num_end_points;
+}
+
+
+/**
+ * Allocates a free ephemeral port from the ephemeral ports-in-use bitmap,
+ * searching from the rotating cursor. Full bitmap words are skipped
+ * without looking at their individual bits.
+ *
+ * NOTE: The caller must be holding the UDP mutex
+ *
+ * @param layer4_udp_p  Pointer to UDP-specific networking layer-4
+ *
+ * @return ephemeral port number (host byte order), on success
+ * @return 0, if all ephemeral ports are in use
+ */
+static uint16_t udp_allocate_ephemeral_port(struct net_layer4_udp *layer4_udp_p)
+{
+    C_ASSERT(NET_FIRST_EPHEMERAL_PORT + NET_UDP_NUM_EPHEMERAL_PORTS - 1 <=
+             UINT16_MAX);
+
+    unsigned int cursor = layer4_udp_p->ephemeral_port_cursor;
+    unsigned int first_word_index = cursor / 32;
+
+    /*
+     * The first word is visited twice: first only its bits at or after the
+     * cursor, and at the end of the wrap-around all its bits:
+     */
+    for (unsigned int i = 0; i <= NET_UDP_EPHEMERAL_PORTS_BITMAP_NUM_WORDS; i ++) {
+        unsigned int word_index =
+            (first_word_index + i) % NET_UDP_EPHEMERAL_PORTS_BITMAP_NUM_WORDS;
+        uint32_t free_bits = ~layer4_udp_p->ephemeral_ports_in_use[word_index];
+
+        if (i == 0) {
+            free_bits &= ~(BIT(cursor % 32) - 1);
+        }
+
+        if (free_bits != 0) {
+            unsigned int port_index = word_index * 32 + __builtin_ctz(free_bits);
+
+            layer4_udp_p->ephemeral_ports_in_use[word_index] |=
+                BIT(port_index % 32);
+            layer4_udp_p->ephemeral_port_cursor =
+                (port_index + 1) % NET_UDP_NUM_EPHEMERAL_PORTS;
+            return NET_FIRST_EPHEMERAL_PORT + port_index;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Releases an ephemeral port back to the ephemeral ports-in-use bitmap.
+ *
+ * NOTE: The caller must be holding the UDP mutex
+ *
+ * @param layer4_udp_p  Pointer to UDP-specific networking layer-4
+ * @param port          ephemeral port number (host byte order)
+ */
+static void udp_free_ephemeral_port(struct net_layer4_udp *layer4_udp_p,
+                                    uint16_t port)
+{
+    unsigned int port_index = port - NET_FIRST_EPHEMERAL_PORT;
+
+    D_ASSERT(port >= NET_FIRST_EPHEMERAL_PORT &&
+             port_index < NET_UDP_NUM_EPHEMERAL_PORTS);
+    D_ASSERT(layer4_udp_p->ephemeral_ports_in_use[port_index / 32] &
+             BIT(port_index % 32));
+
+    layer4_udp_p->ephemeral_ports_in_use[port_index / 32] &=
+        ~BIT(port_index % 32);
+}
+
 
 /**
  * Initializes Networking layer-4 for UDP
@@ -16,10 +358,19 @@
  */
 void net_layer4_udp_init(struct net_layer4_udp *layer4_udp_p)
 {
-    layer4_udp_p->next_ephemeral_port = NET_FIRST_EPHEMERAL_PORT;
+    for (unsigned int i = 0; i < NET_UDP_EPHEMERAL_PORTS_BITMAP_NUM_WORDS; i ++) {
+        layer4_udp_p->ephemeral_ports_in_use[i] = 0;
+    }
+
+    layer4_udp_p->ephemeral_port_cursor = 0;
     net_layer4_end_point_list_init(&layer4_udp_p->local_udp_end_point_list,
                                    NET_LAYER4_UDP);
 
+    for (unsigned int i = 0; i < NET_UDP_PORT_HASH_TABLE_NUM_BUCKETS; i ++) {
+        layer4_udp_p->port_hash_table[i].sequence_count = 0;
+        layer4_udp_p->port_hash_table[i].head_p = NULL;
+    }
+
     rtos_mutex_init(&layer4_udp_p->mutex, "layer-4 UDP mutex");
 }
 
@@ -74,34 +425,49 @@ error_t net_layer4_udp_end_point_bind(
     rtos_mutex_lock(&layer4_udp_p->mutex);
 
     if (udp_port == 0) {
-        if (layer4_udp_p->next_ephemeral_port == 0) {
+        uint16_t ephemeral_port = udp_allocate_ephemeral_port(layer4_udp_p);
+
+        if (ephemeral_port == 0) {
             error = CAPTURE_ERROR("No more UDP ephemeral ports available",
                                   0, 0);
             goto common_exit;
         }
 
-        udp_port = hton16(layer4_udp_p->next_ephemeral_port);
-        layer4_udp_p->next_ephemeral_port ++;
+        udp_port = hton16(ephemeral_port);
     } else {
-        if (udp_port >= NET_FIRST_EPHEMERAL_PORT) {
+        if (ntoh16(udp_port) >= NET_FIRST_EPHEMERAL_PORT) {
             error = CAPTURE_ERROR("Non-zero UDP port cannot be in the ephemeral ports range",
                                   udp_port, layer4_end_point_p);
             goto common_exit;
         }
 
         struct net_layer4_end_point *existing_udp_end_point_p =
-            net_layer4_end_point_list_lookup(&layer4_udp_p->local_udp_end_point_list, udp_port);
+            udp_port_hash_table_lookup(layer4_udp_p, udp_port);
 
-        if (existing_udp_end_point_p != NULL) {
+        if (existing_udp_end_point_p != NULL &&
+            !(layer4_end_point_p->shared_port &&
+              existing_udp_end_point_p->shared_port)) {
             error = CAPTURE_ERROR("UDP port already in use", udp_port,
                                   existing_udp_end_point_p);
             goto common_exit;
         }
+
+        if (existing_udp_end_point_p != NULL) {
+            struct net_layer4_end_point *end_points[NET_UDP_MAX_FAN_OUT_END_POINTS];
+
+            if (udp_port_hash_table_collect(layer4_udp_p, udp_port, end_points) ==
+                NET_UDP_MAX_FAN_OUT_END_POINTS) {
+                error = CAPTURE_ERROR("Too many UDP end points sharing port",
+                                      udp_port, layer4_end_point_p);
+                goto common_exit;
+            }
+        }
     }
 
     layer4_end_point_p->layer4_port = udp_port;
     net_layer4_end_point_list_add(&layer4_udp_p->local_udp_end_point_list,
                                    layer4_end_point_p);
+    udp_port_hash_table_add(layer4_udp_p, layer4_end_point_p);
     error = 0;
 
 common_exit:
@@ -117,128 +483,162 @@ common_exit:
 
 
 /**
- * Unbinds a UDP end point from a given UDP port number
+ * Sets whether a UDP end point can share its port with other UDP end points.
+ * It must be called before binding the end point.
  *
- * @param layer4_end_point_p    Pointer to UDP end point to bind
+ * @param layer4_end_point_p    Pointer to unbound UDP end point
+ * @param shared_port           true, to allow other end points that set this
+ *                              flag too to bind to the same port
+ *
+ * @return 0, on success
+ * @return error code, on failure
  */
-void net_layer4_udp_end_point_unbind(struct net_layer4_end_point *layer4_end_point_p)
+error_t net_layer4_udp_end_point_set_shared_port(
+    struct net_layer4_end_point *layer4_end_point_p,
+    bool shared_port)
 {
+    error_t error;
+
     D_ASSERT(CALLER_IS_THREAD());
 
 #   ifdef USE_MPU
     struct mpu_region_range old_comp_region;
 
-    rtos_thread_set_comp_region(&g_net_layer4,
-                                sizeof g_net_layer4,
+    rtos_thread_set_comp_region(layer4_end_point_p,
+                                sizeof *layer4_end_point_p,
                                 0,
                                 &old_comp_region);
-
-    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
-                               0);
 #   endif
 
-    D_ASSERT(g_net_layer4.initialized);
     D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
 
-    struct net_layer4_udp *layer4_udp_p = &g_net_layer4.udp;
-
-    rtos_mutex_lock(&layer4_udp_p->mutex);
-
-    net_layer4_end_point_list_remove(&layer4_udp_p->local_udp_end_point_list,
-                                     layer4_end_point_p);
+    if (layer4_end_point_p->layer4_port != 0) {
+        error = CAPTURE_ERROR("UDP end point already bound",
+                              layer4_end_point_p->layer4_port,
+                              layer4_end_point_p);
+        goto exit;
+    }
 
-    layer4_end_point_p->layer4_port = 0; /* unbound */
-    rtos_mutex_unlock(&layer4_udp_p->mutex);
+    layer4_end_point_p->shared_port = shared_port;
+    error = 0;
 
+exit:
 #   ifdef USE_MPU
-    rtos_thread_unset_tmp_region();
     rtos_thread_restore_comp_region(&old_comp_region);
 #   endif
+
+    return error;
 }
 
 
-error_t net_layer4_send_udp_datagram_over_ipv4(
+/**
+ * Sets how a UDP end point that shares its port distributes the unicast
+ * datagrams received for the port among the end points bound to it. The
+ * policy of the end point bound last to the port is the one used.
+ *
+ * @param layer4_end_point_p    Pointer to UDP end point
+ * @param load_balancing        NET_LAYER4_BALANCE_BY_SOURCE_HASH, to always
+ *                              deliver the datagrams of the same source
+ *                              address and port to the same end point, or
+ *                              NET_LAYER4_BALANCE_ROUND_ROBIN
+ */
+void net_layer4_udp_end_point_set_load_balancing(
     struct net_layer4_end_point *layer4_end_point_p,
-    const struct ipv4_address *dest_ip_addr_p,
-    uint16_t dest_port, /* big endian */
-    struct network_packet *tx_packet_p,
-    size_t data_payload_length)
+    uint8_t load_balancing)
 {
-    error_t error;
-
-    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+    D_ASSERT(load_balancing == NET_LAYER4_BALANCE_BY_SOURCE_HASH ||
+             load_balancing == NET_LAYER4_BALANCE_ROUND_ROBIN);
 
 #   ifdef USE_MPU
     struct mpu_region_range old_comp_region;
 
-    rtos_thread_set_comp_region(&g_net_layer4,
-                                sizeof g_net_layer4,
+    rtos_thread_set_comp_region(layer4_end_point_p,
+                                sizeof *layer4_end_point_p,
                                 0,
                                 &old_comp_region);
-
-    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
-                               0);
 #   endif
 
-    D_ASSERT(g_net_layer4.initialized);
-    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
-    D_ASSERT(data_payload_length <= NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE);
-
     /*
-     * Populate UDP header:
+     * NOTE: It is a single byte read without any lock on the Rx path
      */
+    layer4_end_point_p->load_balancing = load_balancing;
 
-    struct udp_header *udp_header_p =
-        (struct udp_header *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
 
-    udp_header_p->source_port = layer4_end_point_p->layer4_port;
-    udp_header_p->dest_port = dest_port;
-    udp_header_p->datagram_length = hton16(sizeof(struct udp_header) +
-                                           data_payload_length);
 
-    /*
-     * NOTE: udp_header_p->datagram_checksum is filled by the Ethernet MAC
-     * hardware. We just need to initialize it to 0.
-     */
-    udp_header_p->datagram_checksum = 0;
+/**
+ * Registers or unregisters a callback to which the datagrams received for a
+ * UDP end point are delivered directly, from the context of the networking Rx
+ * task, instead of being queued for an application task to receive them.
+ * This saves a queue round trip and a context switch per datagram, so it is
+ * meant for small request/response handlers. The callback runs
+ * to completion on the Rx path, so it must not block, and it must return
+ * within the given cycle budget. Otherwise, the callback is unregistered and
+ * further datagrams are queued as usual.
+ *
+ * Datagrams kept by the callback count towards the end point's maximum number
+ * of held Rx packets, as lent datagrams do.
+ *
+ * NOTE: While a callback is registered, no datagrams are queued for the end
+ * point, so net_layer4_udp_receive_zero_copy() and the other receive calls
+ * will not return any.
+ *
+ * @param layer4_end_point_p    Pointer to UDP end point
+ * @param rx_callback_p         Callback to register, or NULL to unregister
+ *                              the current one
+ * @param arg                   Argument to pass to the callback
+ * @param cycle_budget          Maximum number of CPU cycles that one
+ *                              invocation of the callback can take
+ */
+void net_layer4_udp_end_point_set_rx_callback(
+    struct net_layer4_end_point *layer4_end_point_p,
+    net_udp_rx_callback_t *rx_callback_p,
+    void *arg,
+    uint32_t cycle_budget)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+    D_ASSERT(rx_callback_p == NULL || cycle_budget != 0);
 
-    if (g_net_layer4.tracing_on) {
-        DEBUG_PRINTF("Net layer4: UDP datagram sent: "
-                     "source port %u, destination port %u, length %u\n",
-                     ntoh16(udp_header_p->source_port),
-                     ntoh16(udp_header_p->dest_port),
-                     ntoh16(udp_header_p->datagram_length));
-    }
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(layer4_end_point_p,
+                                sizeof *layer4_end_point_p,
+                                0,
+                                &old_comp_region);
+#   endif
 
     /*
-     * Send IP packet:
+     * NOTE: rx_callback_p is read without any lock on the Rx path, so it is
+     * cleared first and set last:
      */
-    error = net_layer3_send_ipv4_packet(dest_ip_addr_p,
-                                        tx_packet_p,
-                                        sizeof(struct udp_header) +
-                                            data_payload_length,
-                                        IP_PACKET_TYPE_UDP);
-
-    ATOMIC_POST_INCREMENT_UINT32(&g_net_layer4.udp.sent_packets_over_ipv4_count);
+    layer4_end_point_p->rx_callback_p = NULL;
+    __DMB();
+    if (rx_callback_p != NULL) {
+        layer4_end_point_p->rx_callback_arg = arg;
+        layer4_end_point_p->rx_callback_cycle_budget = cycle_budget;
+        __DMB();
+        layer4_end_point_p->rx_callback_p = rx_callback_p;
+    }
 
 #   ifdef USE_MPU
-    rtos_thread_unset_tmp_region();
     rtos_thread_restore_comp_region(&old_comp_region);
 #   endif
-
-    return error;
 }
 
 
-error_t net_layer4_receive_udp_datagram_over_ipv4(
-    struct net_layer4_end_point *layer4_end_point_p,
-    uint32_t timeout_ms,
-    struct ipv4_address *source_ip_addr_p,
-    uint16_t *source_port_p,
-    struct network_packet **rx_packet_pp)
+/**
+ * Unbinds a UDP end point from a given UDP port number
+ *
+ * @param layer4_end_point_p    Pointer to UDP end point to bind
+ */
+void net_layer4_udp_end_point_unbind(struct net_layer4_end_point *layer4_end_point_p)
 {
-    error_t error;
-
     D_ASSERT(CALLER_IS_THREAD());
 
 #   ifdef USE_MPU
@@ -256,31 +656,1113 @@ error_t net_layer4_receive_udp_datagram_over_ipv4(
     D_ASSERT(g_net_layer4.initialized);
     D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
 
-    struct network_packet *rx_packet_p =
-        net_packet_queue_remove(&layer4_end_point_p->rx_packet_queue,
-                                timeout_ms);
+    struct net_layer4_udp *layer4_udp_p = &g_net_layer4.udp;
+    struct ipv4_address joined_groups[NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS];
+    unsigned int num_joined_groups = 0;
 
-    if (rx_packet_p == NULL) {
-        *rx_packet_pp = NULL;
+    struct net_layer4_poll_group *poll_group_p = layer4_end_point_p->poll_group_p;
+
+    if (poll_group_p != NULL) {
+        net_layer4_poll_group_remove(poll_group_p, layer4_end_point_p);
+    }
+
+    net_layer4_udp_end_point_disconnect(layer4_end_point_p);
+    rtos_mutex_lock(&layer4_udp_p->mutex);
+
+    udp_port_hash_table_remove(layer4_udp_p, layer4_end_point_p);
+    net_layer4_end_point_list_remove(&layer4_udp_p->local_udp_end_point_list,
+                                     layer4_end_point_p);
+
+    if (ntoh16(layer4_end_point_p->layer4_port) >= NET_FIRST_EPHEMERAL_PORT) {
+        udp_free_ephemeral_port(layer4_udp_p,
+                                ntoh16(layer4_end_point_p->layer4_port));
+    }
+
+    layer4_end_point_p->layer4_port = 0; /* unbound */
+
+    for (unsigned int i = 0;
+         i < NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS; i ++) {
+        if (layer4_end_point_p->ipv4_multicast_groups[i] != IPV4_NULL_ADDR) {
+            joined_groups[num_joined_groups].value =
+                layer4_end_point_p->ipv4_multicast_groups[i];
+            num_joined_groups ++;
+            layer4_end_point_p->ipv4_multicast_groups[i] = IPV4_NULL_ADDR;
+        }
+    }
+
+    rtos_mutex_unlock(&layer4_udp_p->mutex);
+
+    /*
+     * Leave the multicast groups still joined by the end point:
+     */
+    for (unsigned int i = 0; i < num_joined_groups; i ++) {
+        net_layer3_leave_ipv4_multicast_group(&joined_groups[i]);
+    }
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Joins an IPv4 multicast group for a UDP end point, so that datagrams sent
+ * to that group and to the end point's UDP port are delivered to it
+ *
+ * @param layer4_end_point_p    Pointer to UDP end point
+ * @param multicast_addr_p      IPv4 multicast group address
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_udp_end_point_join_ipv4_multicast_group(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *multicast_addr_p)
+{
+    uint32_t *free_group_p = NULL;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    struct net_layer4_udp *layer4_udp_p = &g_net_layer4.udp;
+
+    rtos_mutex_lock(&layer4_udp_p->mutex);
+
+    for (unsigned int i = 0;
+         i < NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS; i ++) {
+        uint32_t *group_p = &layer4_end_point_p->ipv4_multicast_groups[i];
+
+        if (*group_p == multicast_addr_p->value) {
+            rtos_mutex_unlock(&layer4_udp_p->mutex);
+            error = CAPTURE_ERROR("IPv4 multicast group already joined",
+                                  multicast_addr_p->value, layer4_end_point_p);
+            goto common_exit;
+        }
+
+        if (*group_p == IPV4_NULL_ADDR && free_group_p == NULL) {
+            free_group_p = group_p;
+        }
+    }
+
+    if (free_group_p == NULL) {
+        rtos_mutex_unlock(&layer4_udp_p->mutex);
+        error = CAPTURE_ERROR("Too many IPv4 multicast groups joined by UDP end point",
+                              multicast_addr_p->value, layer4_end_point_p);
+        goto common_exit;
+    }
+
+    *free_group_p = multicast_addr_p->value;
+    rtos_mutex_unlock(&layer4_udp_p->mutex);
+
+    /*
+     * NOTE: The UDP mutex is not held while joining the group at layer 3,
+     * as that may block waiting for a Tx packet to send the IGMP report.
+     */
+    error = net_layer3_join_ipv4_multicast_group(multicast_addr_p);
+    if (error != 0) {
+        rtos_mutex_lock(&layer4_udp_p->mutex);
+        *free_group_p = IPV4_NULL_ADDR;
+        rtos_mutex_unlock(&layer4_udp_p->mutex);
+    }
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Leaves an IPv4 multicast group for a UDP end point
+ *
+ * @param layer4_end_point_p    Pointer to UDP end point
+ * @param multicast_addr_p      IPv4 multicast group address
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_udp_end_point_leave_ipv4_multicast_group(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *multicast_addr_p)
+{
+    bool group_found = false;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    struct net_layer4_udp *layer4_udp_p = &g_net_layer4.udp;
+
+    rtos_mutex_lock(&layer4_udp_p->mutex);
+
+    for (unsigned int i = 0;
+         i < NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS; i ++) {
+        if (layer4_end_point_p->ipv4_multicast_groups[i] == multicast_addr_p->value) {
+            layer4_end_point_p->ipv4_multicast_groups[i] = IPV4_NULL_ADDR;
+            group_found = true;
+            break;
+        }
+    }
+
+    rtos_mutex_unlock(&layer4_udp_p->mutex);
+
+    if (!group_found) {
+        error = CAPTURE_ERROR("IPv4 multicast group not joined",
+                              multicast_addr_p->value, layer4_end_point_p);
+        goto common_exit;
+    }
+
+    net_layer3_leave_ipv4_multicast_group(multicast_addr_p);
+    error = 0;
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+error_t net_layer4_send_udp_datagram_over_ipv4(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *dest_ip_addr_p,
+    uint16_t dest_port, /* big endian */
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length)
+{
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+    D_ASSERT(data_payload_length <= NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE);
+
+    /*
+     * Populate UDP header:
+     */
+
+    struct udp_header *udp_header_p =
+        (struct udp_header *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+
+    udp_header_p->source_port = layer4_end_point_p->layer4_port;
+    udp_header_p->dest_port = dest_port;
+    udp_header_p->datagram_length = hton16(sizeof(struct udp_header) +
+                                           data_payload_length);
+
+    /*
+     * NOTE: udp_header_p->datagram_checksum is filled by the Ethernet MAC
+     * hardware. We just need to initialize it to 0.
+     */
+    udp_header_p->datagram_checksum = 0;
+
+    if (NET_LAYER4_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer4: UDP datagram sent: "
+                     "source port %u, destination port %u, length %u\n",
+                     ntoh16(udp_header_p->source_port),
+                     ntoh16(udp_header_p->dest_port),
+                     ntoh16(udp_header_p->datagram_length));
+    }
+
+    /*
+     * Send IP packet:
+     */
+    error = net_layer3_send_ipv4_packet(dest_ip_addr_p,
+                                        tx_packet_p,
+                                        sizeof(struct udp_header) +
+                                            data_payload_length,
+                                        IP_PACKET_TYPE_UDP);
+
+    COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_SENT_OVER_IPV4);
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Sends a UDP datagram over a "connected" IPv4 flow, whose Ethernet and IPv4
+ * headers are copied from the flow's prebuilt header template
+ *
+ * @param layer4_end_point_p    Pointer to the local UDP end point
+ * @param flow_p                Pointer to the IPv4 flow to the destination
+ *                              (its protocol type must be IP_PACKET_TYPE_UDP)
+ * @param dest_port             Destination UDP port (big endian)
+ * @param tx_packet_p           Tx packet with the datagram data filled in
+ * @param data_payload_length   Length of the datagram data
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_send_udp_datagram_over_ipv4_flow(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_ipv4_flow *flow_p,
+    uint16_t dest_port, /* big endian */
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length)
+{
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+    D_ASSERT(flow_p->ip_packet_type == IP_PACKET_TYPE_UDP);
+    D_ASSERT(data_payload_length <= NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE);
+
+    struct udp_header *udp_header_p =
+        (struct udp_header *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packet_p);
+
+    udp_header_p->source_port = layer4_end_point_p->layer4_port;
+    udp_header_p->dest_port = dest_port;
+    udp_header_p->datagram_length = hton16(sizeof(struct udp_header) +
+                                           data_payload_length);
+
+    /*
+     * NOTE: udp_header_p->datagram_checksum is filled by the Ethernet MAC
+     * hardware. We just need to initialize it to 0.
+     */
+    udp_header_p->datagram_checksum = 0;
+
+    error = net_layer3_send_ipv4_flow_packet(flow_p,
+                                             tx_packet_p,
+                                             sizeof(struct udp_header) +
+                                                 data_payload_length);
+
+    COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_SENT_OVER_IPV4);
+    return error;
+}
+
+
+/**
+ * Connects a bound UDP end point to a peer. The route, next-hop MAC address
+ * and Ethernet + IPv4 headers to the peer are cached in the given IPv4 flow,
+ * so that net_layer4_send_udp_datagram_connected() skips the per-packet
+ * layer-3 resolution. Once connected, datagrams received by the end point
+ * from any other source are dropped.
+ *
+ * @param layer4_end_point_p    Pointer to the bound UDP end point
+ * @param flow_p                Pointer to the caller-provided IPv4 flow object
+ *                              to use for the connection. It must outlive the
+ *                              connection.
+ * @param peer_ip_addr_p        Peer's IPv4 address (unicast)
+ * @param peer_port             Peer's UDP port (big endian)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_udp_end_point_connect(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_ipv4_flow *flow_p,
+    const struct ipv4_address *peer_ip_addr_p,
+    uint16_t peer_port /* big endian */)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    if (layer4_end_point_p->layer4_port == 0) {
+        return CAPTURE_ERROR("UDP end point not bound", layer4_end_point_p, 0);
+    }
+
+    if (peer_port == 0 ||
+        peer_ip_addr_p->value == IPV4_NULL_ADDR ||
+        peer_ip_addr_p->value == IPV4_BROADCAST_ADDR ||
+        IPV4_ADDR_IS_MULTICAST(peer_ip_addr_p)) {
+        return CAPTURE_ERROR("Invalid UDP peer", peer_ip_addr_p->value,
+                             ntoh16(peer_port));
+    }
+
+    net_layer3_ipv4_flow_init(flow_p, peer_ip_addr_p, IP_PACKET_TYPE_UDP);
+
+    /*
+     * The Rx path may be checking the old peer concurrently, so the peer port
+     * is cleared before the peer address is changed, and set only after:
+     */
+    layer4_end_point_p->connected_peer_port = 0;
+    __DMB();
+    layer4_end_point_p->connected_flow_p = flow_p;
+    layer4_end_point_p->connected_peer_ipv4_addr = peer_ip_addr_p->value;
+    __DMB();
+    layer4_end_point_p->connected_peer_port = peer_port;
+    return 0;
+}
+
+
+/**
+ * Disconnects a UDP end point from its peer, if it is connected. After this,
+ * it receives datagrams from any source again.
+ *
+ * @param layer4_end_point_p    Pointer to the UDP end point
+ */
+void net_layer4_udp_end_point_disconnect(struct net_layer4_end_point *layer4_end_point_p)
+{
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    layer4_end_point_p->connected_peer_port = 0;
+    __DMB();
+    layer4_end_point_p->connected_flow_p = NULL;
+    layer4_end_point_p->connected_peer_ipv4_addr = IPV4_NULL_ADDR;
+}
+
+
+/**
+ * Sends a UDP datagram to the peer of a connected UDP end point, using the
+ * cached headers of the connection's IPv4 flow
+ *
+ * @param layer4_end_point_p    Pointer to the connected UDP end point
+ * @param tx_packet_p           Tx packet with the datagram data filled in
+ * @param data_payload_length   Length of the datagram data
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_send_udp_datagram_connected(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length)
+{
+    uint16_t peer_port = layer4_end_point_p->connected_peer_port;
+
+    if (peer_port == 0) {
+        return CAPTURE_ERROR("UDP end point not connected",
+                             layer4_end_point_p, 0);
+    }
+
+    return net_layer4_send_udp_datagram_over_ipv4_flow(
+                layer4_end_point_p,
+                layer4_end_point_p->connected_flow_p,
+                peer_port,
+                tx_packet_p,
+                data_payload_length);
+}
+
+
+/**
+ * Sends a UDP datagram over IPv4 whose data is copied from a caller buffer.
+ * The datagram does not need to fit in one Ethernet frame. If it does not
+ * fit, it is sent as multiple IPv4 fragments.
+ *
+ * NOTE: The Ethernet MAC does not compute the UDP checksum of fragmented
+ * datagrams, so their checksum is computed in software.
+ *
+ * @param layer4_end_point_p    Pointer to the local UDP end point
+ * @param dest_ip_addr_p        Destination IPv4 address
+ * @param dest_port             Destination UDP port (big endian)
+ * @param data_p                Datagram data
+ * @param data_length           Length of the datagram data
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_send_large_udp_datagram_over_ipv4(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *dest_ip_addr_p,
+    uint16_t dest_port, /* big endian */
+    const void *data_p,
+    size_t data_length)
+{
+    struct udp_header udp_header;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    if (sizeof(struct udp_header) + data_length > UINT16_MAX) {
+        return CAPTURE_ERROR("UDP datagram too long", data_length, 0);
+    }
+
+    udp_header.source_port = layer4_end_point_p->layer4_port;
+    udp_header.dest_port = dest_port;
+    udp_header.datagram_length = hton16(sizeof(struct udp_header) +
+                                        data_length);
+    udp_header.datagram_checksum = 0;
+
+    if (sizeof(struct udp_header) + data_length >
+        NET_IPV4_FRAGMENT_MAX_PAYLOAD_SIZE) {
+        struct ipv4_address source_ip_addr;
+        uint32_t sum;
+
+        /*
+         * Sum the IPv4 pseudo-header, the UDP header and the data:
+         */
+        net_layer3_get_ipv4_source_address(dest_ip_addr_p, &source_ip_addr);
+        sum = internet_checksum_add32(0, source_ip_addr.value);
+        sum = internet_checksum_add32(sum, dest_ip_addr_p->value);
+        sum = internet_checksum_add16(sum, hton16(IP_PACKET_TYPE_UDP));
+        sum = internet_checksum_add16(sum, udp_header.datagram_length);
+        sum = internet_checksum_add(sum, &udp_header, sizeof udp_header);
+        sum = internet_checksum_add(sum, data_p, data_length);
+        udp_header.datagram_checksum = internet_checksum_finish(sum);
+
+        /*
+         * A computed checksum of 0 is sent as all ones, as 0 means "no
+         * checksum" (RFC 768):
+         */
+        if (udp_header.datagram_checksum == 0) {
+            udp_header.datagram_checksum = UINT16_MAX;
+        }
+    }
+
+    if (NET_LAYER4_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer4: large UDP datagram sent: "
+                     "source port %u, destination port %u, length %u\n",
+                     ntoh16(udp_header.source_port),
+                     ntoh16(udp_header.dest_port),
+                     ntoh16(udp_header.datagram_length));
+    }
+
+    error = net_layer3_send_large_ipv4_packet(dest_ip_addr_p,
+                                              IP_PACKET_TYPE_UDP,
+                                              &udp_header,
+                                              sizeof udp_header,
+                                              data_p,
+                                              data_length);
+
+    COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_SENT_OVER_IPV4);
+    return error;
+}
+
+
+error_t net_layer4_receive_udp_datagram_over_ipv4(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint32_t timeout_ms,
+    struct ipv4_address *source_ip_addr_p,
+    uint16_t *source_port_p,
+    struct network_packet **rx_packet_pp)
+{
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    struct network_packet *rx_packet_p =
+        net_packet_queue_remove(&layer4_end_point_p->rx_packet_queue,
+                                timeout_ms);
+
+    if (rx_packet_p == NULL) {
+        *rx_packet_pp = NULL;
+        error = CAPTURE_ERROR("No Rx packet available", timeout_ms, 0);
+        goto common_exit;
+    }
+
+    net_packet_set_owner(rx_packet_p);
+    NET_RX_PACKET_LATENCY_END(rx_packet_p);
+
+    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+
+    if (GET_IP_VERSION(ipv4_header_p) != 4) {
+        /*
+         * Datagram received over IPv6 on a port read as IPv4:
+         */
+        net_recycle_rx_packet(rx_packet_p);
+        *rx_packet_pp = NULL;
+        error = CAPTURE_ERROR("Received UDP datagram is not over IPv4",
+                              layer4_end_point_p->layer4_port, 0);
+        goto common_exit;
+    }
+
+    D_ASSERT(ipv4_header_p->protocol_type == IP_PACKET_TYPE_UDP);
+
+    struct udp_header *udp_header_p =
+        (struct udp_header *)GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+
+    D_ASSERT(udp_header_p->dest_port == layer4_end_point_p->layer4_port);
+
+    source_ip_addr_p->value = ipv4_header_p->source_ip_addr.value;
+    *source_port_p = udp_header_p->source_port;
+    *rx_packet_pp = rx_packet_p;
+    error = 0;
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+error_t net_layer4_send_udp_datagram_over_ipv6(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv6_address *dest_ip_addr_p,
+    uint16_t dest_port, /* big endian */
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length)
+{
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+    D_ASSERT(data_payload_length <= NET_MAX_IPV6_UDP_PACKET_PAYLOAD_SIZE);
+
+    /*
+     * Populate UDP header:
+     */
+
+    struct udp_header *udp_header_p =
+        (struct udp_header *)GET_IPV6_DATA_PAYLOAD_AREA(tx_packet_p);
+
+    udp_header_p->source_port = layer4_end_point_p->layer4_port;
+    udp_header_p->dest_port = dest_port;
+    udp_header_p->datagram_length = hton16(sizeof(struct udp_header) +
+                                           data_payload_length);
+
+    /*
+     * NOTE: udp_header_p->datagram_checksum is filled by the Ethernet MAC
+     * hardware. We just need to initialize it to 0.
+     */
+    udp_header_p->datagram_checksum = 0;
+
+    if (NET_LAYER4_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer4: UDP datagram sent over IPv6: "
+                     "source port %u, destination port %u, length %u\n",
+                     ntoh16(udp_header_p->source_port),
+                     ntoh16(udp_header_p->dest_port),
+                     ntoh16(udp_header_p->datagram_length));
+    }
+
+    /*
+     * Send IP packet:
+     */
+    error = net_layer3_send_ipv6_packet(dest_ip_addr_p,
+                                        tx_packet_p,
+                                        sizeof(struct udp_header) +
+                                            data_payload_length,
+                                        IPV6_NEXT_HEADER_UDP);
+
+    COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_SENT_OVER_IPV6);
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+error_t net_layer4_receive_udp_datagram_over_ipv6(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint32_t timeout_ms,
+    struct ipv6_address *source_ip_addr_p,
+    uint16_t *source_port_p,
+    struct network_packet **rx_packet_pp)
+{
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    struct network_packet *rx_packet_p =
+        net_packet_queue_remove(&layer4_end_point_p->rx_packet_queue,
+                                timeout_ms);
+
+    if (rx_packet_p == NULL) {
+        *rx_packet_pp = NULL;
+        error = CAPTURE_ERROR("No Rx packet available", timeout_ms, 0);
+        goto common_exit;
+    }
+
+    net_packet_set_owner(rx_packet_p);
+    NET_RX_PACKET_LATENCY_END(rx_packet_p);
+
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+
+    if (GET_IPV6_VERSION(ipv6_header_p) != 6) {
+        /*
+         * Datagram received over IPv4 on a port read as IPv6:
+         */
+        net_recycle_rx_packet(rx_packet_p);
+        *rx_packet_pp = NULL;
+        error = CAPTURE_ERROR("Received UDP datagram is not over IPv6",
+                              layer4_end_point_p->layer4_port, 0);
+        goto common_exit;
+    }
+
+    D_ASSERT(ipv6_header_p->next_header == IPV6_NEXT_HEADER_UDP);
+
+    struct udp_header *udp_header_p =
+        (struct udp_header *)GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+
+    D_ASSERT(udp_header_p->dest_port == layer4_end_point_p->layer4_port);
+
+    ipv6_address_copy(source_ip_addr_p, &ipv6_header_p->source_ipv6_addr);
+    *source_port_p = udp_header_p->source_port;
+    *rx_packet_pp = rx_packet_p;
+    error = 0;
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Fills a lent UDP datagram descriptor for a received UDP datagram
+ */
+static void udp_rx_datagram_init(struct net_layer4_end_point *layer4_end_point_p,
+                                 struct network_packet *rx_packet_p,
+                                 struct net_udp_rx_datagram *rx_datagram_p)
+{
+    struct udp_header *udp_header_p;
+
+    net_packet_set_owner(rx_packet_p);
+    NET_RX_PACKET_LATENCY_END(rx_packet_p);
+    ATOMIC_POST_INCREMENT_UINT32(&layer4_end_point_p->num_lent_rx_packets);
+
+    /*
+     * NOTE: The IP version field is at the same place in IPv4 and IPv6
+     * headers:
+     */
+    if (GET_IP_VERSION(GET_IPV4_HEADER(rx_packet_p)) == 6) {
+        struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(rx_packet_p);
+
+        D_ASSERT(ipv6_header_p->next_header == IPV6_NEXT_HEADER_UDP);
+        udp_header_p = GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
+        rx_datagram_p->ip_version = 6;
+        ipv6_address_copy(&rx_datagram_p->source_ip_addr.ipv6,
+                          &ipv6_header_p->source_ipv6_addr);
+    } else {
+        struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+
+        D_ASSERT(ipv4_header_p->protocol_type == IP_PACKET_TYPE_UDP);
+        udp_header_p = GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+        rx_datagram_p->ip_version = 4;
+        rx_datagram_p->source_ip_addr.ipv4.value =
+            ipv4_header_p->source_ip_addr.value;
+    }
+
+    D_ASSERT(udp_header_p->dest_port == layer4_end_point_p->layer4_port);
+
+    uint8_t *payload_p = (uint8_t *)(udp_header_p + 1);
+    size_t datagram_length = ntoh16(udp_header_p->datagram_length);
+
+    /*
+     * Clip the payload slice to the received frame, in case the datagram
+     * length field is bogus:
+     */
+    size_t max_payload_length =
+        rx_packet_p->total_length - (payload_p - rx_packet_p->data_buffer);
+
+    if (datagram_length < sizeof(struct udp_header)) {
+        datagram_length = sizeof(struct udp_header);
+    }
+
+    rx_datagram_p->payload_length = datagram_length - sizeof(struct udp_header);
+    if (rx_datagram_p->payload_length > max_payload_length) {
+        rx_datagram_p->payload_length = max_payload_length;
+    }
+
+    rx_datagram_p->rx_packet_p = rx_packet_p;
+    rx_datagram_p->payload_p = payload_p;
+    rx_datagram_p->source_port = udp_header_p->source_port;
+}
+
+
+/**
+ * Receives a UDP datagram over IPv4 or IPv6 without copying it: the Rx
+ * packet is lent to the caller, who must return it by calling
+ * net_layer4_udp_release_rx_datagram() once done with the payload.
+ *
+ * @param layer4_end_point_p    Pointer to bound UDP end point
+ * @param timeout_ms            Maximum time to wait for a datagram, or 0 to
+ *                              wait forever
+ * @param rx_datagram_p         Area where the received datagram (payload
+ *                              slice, source address and port) is returned
+ *
+ * @return 0, on success
+ * @return error code, on failure. In particular, if the end point already has
+ *         its maximum number of held Rx packets lent, no datagram
+ *         is received until some of them are released.
+ */
+error_t net_layer4_udp_receive_zero_copy(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint32_t timeout_ms,
+    struct net_udp_rx_datagram *rx_datagram_p)
+{
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    rx_datagram_p->rx_packet_p = NULL;
+    if (layer4_end_point_p->num_lent_rx_packets >=
+            layer4_end_point_p->max_held_rx_packets) {
+        error = CAPTURE_ERROR("Too many Rx datagrams held by UDP end point",
+                              layer4_end_point_p,
+                              layer4_end_point_p->num_lent_rx_packets);
+        goto common_exit;
+    }
+
+    struct network_packet *rx_packet_p =
+        net_packet_queue_remove(&layer4_end_point_p->rx_packet_queue,
+                                timeout_ms);
+
+    if (rx_packet_p == NULL) {
         error = CAPTURE_ERROR("No Rx packet available", timeout_ms, 0);
         goto common_exit;
     }
 
-    struct ipv4_header *ipv4_header_p = GET_IPV4_HEADER(rx_packet_p);
+    udp_rx_datagram_init(layer4_end_point_p, rx_packet_p, rx_datagram_p);
+    error = 0;
 
-    D_ASSERT(ipv4_header_p->protocol_type == IP_PACKET_TYPE_UDP);
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
 
-    struct udp_header *udp_header_p =
-        (struct udp_header *)GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+    return error;
+}
 
-    D_ASSERT(udp_header_p->dest_port == layer4_end_point_p->layer4_port);
 
-    source_ip_addr_p->value = ipv4_header_p->source_ip_addr.value;
-    *source_port_p = udp_header_p->source_port;
-    *rx_packet_pp = rx_packet_p;
+/**
+ * Receives up to a given number of UDP datagrams in one call, without
+ * copying them, as net_layer4_udp_receive_zero_copy() does for one datagram.
+ * It waits only for the first datagram: the others are the ones already
+ * queued for the end point. The MPU region switch is done only once for the
+ * whole batch.
+ *
+ * @param layer4_end_point_p    Pointer to bound UDP end point
+ * @param timeout_ms            Maximum time to wait for the first datagram,
+ *                              or 0 to wait forever
+ * @param rx_datagrams          Area where the received datagrams are returned
+ * @param max_datagrams         Number of entries of rx_datagrams[] (at most
+ *                              NET_UDP_MAX_BATCH_DATAGRAMS)
+ * @param num_datagrams_p       Area where the number of datagrams received is
+ *                              returned. It can be less than max_datagrams
+ *                              if fewer datagrams were queued, or to stay
+ *                              within the end point's hold quota.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_udp_receive_zero_copy_batch(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint32_t timeout_ms,
+    struct net_udp_rx_datagram rx_datagrams[],
+    uint_fast8_t max_datagrams,
+    uint_fast8_t *num_datagrams_p)
+{
+    error_t error;
+    uint_fast8_t num_datagrams = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(max_datagrams != 0 && max_datagrams <= NET_UDP_MAX_BATCH_DATAGRAMS);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    if (layer4_end_point_p->num_lent_rx_packets >=
+            layer4_end_point_p->max_held_rx_packets) {
+        error = CAPTURE_ERROR("Too many Rx datagrams held by UDP end point",
+                              layer4_end_point_p,
+                              layer4_end_point_p->num_lent_rx_packets);
+        goto common_exit;
+    }
+
+    uint_fast8_t quota = layer4_end_point_p->max_held_rx_packets -
+                         layer4_end_point_p->num_lent_rx_packets;
+
+    if (max_datagrams > quota) {
+        max_datagrams = quota;
+    }
+
+    struct network_packet *rx_packet_p =
+        net_packet_queue_remove(&layer4_end_point_p->rx_packet_queue,
+                                timeout_ms);
+
+    if (rx_packet_p == NULL) {
+        error = CAPTURE_ERROR("No Rx packet available", timeout_ms, 0);
+        goto common_exit;
+    }
+
+    do {
+        udp_rx_datagram_init(layer4_end_point_p, rx_packet_p,
+                             &rx_datagrams[num_datagrams]);
+        num_datagrams ++;
+        if (num_datagrams == max_datagrams) {
+            break;
+        }
+
+        rx_packet_p =
+            net_packet_queue_try_remove(&layer4_end_point_p->rx_packet_queue);
+    } while (rx_packet_p != NULL);
+
     error = 0;
 
 common_exit:
+    *num_datagrams_p = num_datagrams;
+
+#   ifdef USE_MPU
+    rtos_thread_unset_tmp_region();
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Returns a UDP datagram lent by net_layer4_udp_receive_zero_copy(), so that
+ * its Rx packet is recycled. The payload slice must not be accessed after
+ * this call.
+ *
+ * @param layer4_end_point_p    Pointer to the UDP end point the datagram was
+ *                              received from
+ * @param rx_datagram_p         Datagram to release
+ */
+void net_layer4_udp_release_rx_datagram(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_udp_rx_datagram *rx_datagram_p)
+{
+    struct network_packet *rx_packet_p = rx_datagram_p->rx_packet_p;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+    D_ASSERT(rx_packet_p != NULL);
+    D_ASSERT(rx_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+    D_ASSERT(layer4_end_point_p->num_lent_rx_packets != 0);
+
+    rx_datagram_p->rx_packet_p = NULL;
+    rx_datagram_p->payload_p = NULL;
+    rx_datagram_p->payload_length = 0;
+    ATOMIC_POST_DECREMENT_UINT32(&layer4_end_point_p->num_lent_rx_packets);
+    net_recycle_rx_packet(rx_packet_p);
+}
+
+
+/**
+ * Returns a batch of UDP datagrams lent by
+ * net_layer4_udp_receive_zero_copy_batch()
+ *
+ * @param layer4_end_point_p    Pointer to the UDP end point the datagrams
+ *                              were received from
+ * @param rx_datagrams          Datagrams to release
+ * @param num_datagrams         Number of entries in rx_datagrams[]
+ */
+void net_layer4_udp_release_rx_datagrams(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_udp_rx_datagram rx_datagrams[],
+    uint_fast8_t num_datagrams)
+{
+    for (uint_fast8_t i = 0; i < num_datagrams; i ++) {
+        net_layer4_udp_release_rx_datagram(layer4_end_point_p, &rx_datagrams[i]);
+    }
+}
+
+
+/**
+ * Sends a batch of UDP datagrams over IPv4 to the same destination IPv4
+ * address and UDP port. The MPU region switch, the layer-3 route and MAC
+ * address resolution, and the Ethernet MAC Tx ring re-activation are done
+ * only once for the whole batch.
+ *
+ * @param layer4_end_point_p    Pointer to bound UDP end point
+ * @param dest_ip_addr_p        Destination IPv4 address
+ * @param dest_port             Destination UDP port (big endian)
+ * @param tx_packets            Tx packets to send, in order, with their UDP
+ *                              data payloads already filled in
+ * @param data_payload_lengths  UDP data payload length of each entry of
+ *                              tx_packets[]
+ * @param num_datagrams         Number of entries in tx_packets[] (at most
+ *                              NET_UDP_MAX_BATCH_DATAGRAMS)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t net_layer4_send_udp_datagrams_over_ipv4(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *dest_ip_addr_p,
+    uint16_t dest_port, /* big endian */
+    struct network_packet *tx_packets[],
+    const size_t data_payload_lengths[],
+    uint_fast8_t num_datagrams)
+{
+    size_t ip_payload_lengths[NET_UDP_MAX_BATCH_DATAGRAMS];
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(num_datagrams != 0 && num_datagrams <= NET_UDP_MAX_BATCH_DATAGRAMS);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(&g_net_layer4,
+                                sizeof g_net_layer4,
+                                0,
+                                &old_comp_region);
+
+    rtos_thread_set_tmp_region(layer4_end_point_p, sizeof *layer4_end_point_p,
+                               0);
+#   endif
+
+    D_ASSERT(g_net_layer4.initialized);
+    D_ASSERT(layer4_end_point_p->protocol == NET_LAYER4_UDP);
+
+    for (uint_fast8_t i = 0; i < num_datagrams; i ++) {
+        D_ASSERT(data_payload_lengths[i] <= NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE);
+
+        struct udp_header *udp_header_p =
+            (struct udp_header *)GET_IPV4_DATA_PAYLOAD_AREA(tx_packets[i]);
+
+        udp_header_p->source_port = layer4_end_point_p->layer4_port;
+        udp_header_p->dest_port = dest_port;
+        udp_header_p->datagram_length = hton16(sizeof(struct udp_header) +
+                                               data_payload_lengths[i]);
+
+        /*
+         * NOTE: udp_header_p->datagram_checksum is filled by the Ethernet MAC
+         * hardware. We just need to initialize it to 0.
+         */
+        udp_header_p->datagram_checksum = 0;
+        ip_payload_lengths[i] = sizeof(struct udp_header) + data_payload_lengths[i];
+    }
+
+    if (NET_LAYER4_TRACING_ON()) {
+        DEBUG_PRINTF("Net layer4: Batch of %u UDP datagrams sent: "
+                     "source port %u, destination port %u\n",
+                     num_datagrams,
+                     ntoh16(layer4_end_point_p->layer4_port),
+                     ntoh16(dest_port));
+    }
+
+    error = net_layer3_send_ipv4_packets(dest_ip_addr_p,
+                                         tx_packets,
+                                         ip_payload_lengths,
+                                         num_datagrams,
+                                         IP_PACKET_TYPE_UDP);
+
+    for (uint_fast8_t i = 0; i < num_datagrams; i ++) {
+        COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_SENT_OVER_IPV4);
+    }
+
 #   ifdef USE_MPU
     rtos_thread_unset_tmp_region();
     rtos_thread_restore_comp_region(&old_comp_region);
@@ -290,31 +1772,286 @@ common_exit:
 }
 
 
+/**
+ * Tells if a UDP end point joined a given IPv4 multicast group.
+ *
+ * NOTE: Each multicast group slot is a single word, so it can be read
+ * without holding the UDP mutex.
+ */
+static bool udp_end_point_joined_ipv4_multicast_group(
+    const struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *multicast_addr_p)
+{
+    for (unsigned int i = 0;
+         i < NET_LAYER4_END_POINT_MAX_IPV4_MULTICAST_GROUPS; i ++) {
+        if (layer4_end_point_p->ipv4_multicast_groups[i] ==
+                multicast_addr_p->value) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
 /**
  * Lookup local UDP end point bound to a given UDP port number
  *
- * @param layer4_udp_p    Pointer to UDP layer
- * @param udp_port        UDP port number
+ * @param layer4_udp_p      Pointer to UDP layer
+ * @param udp_port          UDP port number
+ * @param dest_ip_addr_p    Destination IPv4 address of the datagram, or
+ *                          NULL for datagrams received over IPv6
+ * @param not_joined_p      Output flag set to true if the datagram was sent
+ *                          to an IPv4 multicast group not joined by the UDP
+ *                          end point found
  *
- * @return Pointer to wanted UDP end point, if found
+ * @return Pointer to wanted UDP end point, if found and, for datagrams sent
+ *         to an IPv4 multicast group, if the end point joined that group
  * @return NULL, otherwise
  */
 static struct net_layer4_end_point *
-lookup_local_udp_end_point(struct net_layer4_udp *layer4_udp_p, uint16_t udp_port)
+lookup_local_udp_end_point(struct net_layer4_udp *layer4_udp_p, uint16_t udp_port,
+                           const struct ipv4_address *dest_ip_addr_p,
+                           bool *not_joined_p)
 {
     struct net_layer4_end_point *layer4_end_point_p;
 
-    rtos_mutex_lock(&layer4_udp_p->mutex);
+    *not_joined_p = false;
+    layer4_end_point_p = udp_port_hash_table_lock_free_lookup(layer4_udp_p,
+                                                              udp_port);
 
-    layer4_end_point_p =
-        net_layer4_end_point_list_lookup(&layer4_udp_p->local_udp_end_point_list,
-                                         udp_port);
+    if (layer4_end_point_p != NULL && dest_ip_addr_p != NULL &&
+        IPV4_ADDR_IS_MULTICAST(dest_ip_addr_p) &&
+        !udp_end_point_joined_ipv4_multicast_group(layer4_end_point_p,
+                                                   dest_ip_addr_p)) {
+        *not_joined_p = true;
+        layer4_end_point_p = NULL;
+    }
 
-    rtos_mutex_unlock(&layer4_udp_p->mutex);
     return layer4_end_point_p;
 }
 
 
+/**
+ * Delivers a received UDP datagram to the Rx callback of a local UDP end
+ * point, and unregisters the callback if it took more than its cycle budget
+ */
+static void udp_deliver_rx_packet_to_callback(
+    struct net_layer4_end_point *layer4_end_point_p,
+    net_udp_rx_callback_t *rx_callback_p,
+    struct network_packet *rx_packet_p)
+{
+    struct net_udp_rx_datagram rx_datagram;
+
+    NET_RX_PACKET_LATENCY_STAGE(rx_packet_p,
+                                PERF_PROBE_RX_LATENCY_LAYER3_TO_UDP_QUEUE);
+    udp_rx_datagram_init(layer4_end_point_p, rx_packet_p, &rx_datagram);
+    ATOMIC_POST_INCREMENT_UINT32(&layer4_end_point_p->rx_packets_accepted_count);
+    COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_ACCEPTED);
+
+    uint32_t start_cycles = get_dwt_cycles();
+    bool keep = rx_callback_p(layer4_end_point_p, &rx_datagram,
+                              layer4_end_point_p->rx_callback_arg);
+    uint32_t cycles = get_dwt_cycles() - start_cycles;
+
+    if (!keep) {
+        net_layer4_udp_release_rx_datagram(layer4_end_point_p, &rx_datagram);
+    }
+
+    if (cycles > layer4_end_point_p->rx_callback_cycle_budget) {
+        layer4_end_point_p->rx_callback_p = NULL;
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer4.udp.rx_callbacks_over_budget_count);
+        ERROR_PRINTF("UDP Rx callback for port %u took %u cycles "
+                     "(budget %u): unregistered\n",
+                     ntoh16(layer4_end_point_p->layer4_port), cycles,
+                     layer4_end_point_p->rx_callback_cycle_budget);
+    }
+}
+
+
+/**
+ * Delivers a received UDP datagram to a local UDP end point, or drops it if
+ * the end point is connected to another peer or already holds its maximum
+ * number of Rx packets
+ */
+static void udp_deliver_rx_packet(struct net_layer4_end_point *layer4_end_point_p,
+                                  struct network_packet *rx_packet_p,
+                                  const struct udp_header *udp_header_p,
+                                  const struct ipv4_address *dest_ipv4_addr_p)
+{
+    uint16_t peer_port = layer4_end_point_p->connected_peer_port;
+
+    if (peer_port != 0) {
+        __DMB();
+        if (dest_ipv4_addr_p == NULL ||
+            udp_header_p->source_port != peer_port ||
+            GET_IPV4_HEADER(rx_packet_p)->source_ip_addr.value !=
+                layer4_end_point_p->connected_peer_ipv4_addr) {
+            net_recycle_rx_packet(rx_packet_p);
+            ATOMIC_POST_INCREMENT_UINT32(&layer4_end_point_p->rx_packets_dropped_count);
+            ATOMIC_POST_INCREMENT_UINT32(
+                &g_net_layer4.udp.rx_packets_dropped_not_from_peer_count);
+            COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_DROPPED);
+            return;
+        }
+    }
+
+    if (layer4_end_point_p->rx_packet_queue.length +
+            layer4_end_point_p->num_lent_rx_packets >=
+        layer4_end_point_p->max_held_rx_packets) {
+        net_recycle_rx_packet(rx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(&layer4_end_point_p->rx_packets_dropped_count);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer4.udp.rx_packets_dropped_over_quota_count);
+        COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_DROPPED);
+        return;
+    }
+
+    net_udp_rx_callback_t *rx_callback_p = layer4_end_point_p->rx_callback_p;
+
+    if (rx_callback_p != NULL) {
+        __DMB();
+        udp_deliver_rx_packet_to_callback(layer4_end_point_p, rx_callback_p,
+                                          rx_packet_p);
+        return;
+    }
+
+    NET_RX_PACKET_LATENCY_STAGE(rx_packet_p,
+                                PERF_PROBE_RX_LATENCY_LAYER3_TO_UDP_QUEUE);
+    net_packet_queue_add(&layer4_end_point_p->rx_packet_queue, rx_packet_p);
+
+    struct net_layer4_poll_group *poll_group_p =
+        layer4_end_point_p->poll_group_p;
+
+    if (poll_group_p != NULL) {
+        rtos_semaphore_signal(&poll_group_p->semaphore);
+    }
+
+    ATOMIC_POST_INCREMENT_UINT32(&layer4_end_point_p->rx_packets_accepted_count);
+    COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_ACCEPTED);
+}
+
+
+/**
+ * Delivers a received IPv4 multicast or broadcast UDP datagram to all the
+ * local UDP end points bound to its destination port that are to receive it,
+ * if the port is shared. The first end points get clones of the Rx packet
+ * that share its data buffer, and the last one gets the Rx packet itself.
+ *
+ * @return true, if the Rx packet was consumed
+ * @return false, if the port is not shared or the datagram is not multicast
+ *         nor broadcast, so it is to be delivered as a unicast datagram
+ */
+static bool udp_fan_out_rx_packet(struct net_layer4_udp *layer4_udp_p,
+                                  struct network_packet *rx_packet_p,
+                                  const struct udp_header *udp_header_p,
+                                  const struct ipv4_address *dest_ipv4_addr_p)
+{
+    struct net_layer4_end_point *end_points[NET_UDP_MAX_FAN_OUT_END_POINTS];
+    uint_fast8_t num_bound_end_points;
+    uint_fast8_t num_end_points = 0;
+
+    if (dest_ipv4_addr_p == NULL ||
+        !(IPV4_ADDR_IS_MULTICAST(dest_ipv4_addr_p) ||
+          dest_ipv4_addr_p->value == IPV4_BROADCAST_ADDR)) {
+        return false;
+    }
+
+    num_bound_end_points =
+        udp_port_hash_table_lock_free_collect(layer4_udp_p, udp_header_p->dest_port,
+                                              end_points);
+
+    if (num_bound_end_points == 0 || !end_points[0]->shared_port) {
+        return false;
+    }
+
+    for (uint_fast8_t i = 0; i < num_bound_end_points; i ++) {
+        if (IPV4_ADDR_IS_MULTICAST(dest_ipv4_addr_p) &&
+            !udp_end_point_joined_ipv4_multicast_group(end_points[i],
+                                                       dest_ipv4_addr_p)) {
+            continue;
+        }
+
+        end_points[num_end_points] = end_points[i];
+        num_end_points ++;
+    }
+
+    if (num_end_points == 0) {
+        net_recycle_rx_packet(rx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer4.udp.rx_packets_dropped_not_joined_count);
+        COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_DROPPED);
+        return true;
+    }
+
+    for (uint_fast8_t i = 0; i < num_end_points - 1; i ++) {
+        struct network_packet *clone_p = net_layer2_clone_rx_packet(rx_packet_p);
+
+        if (clone_p == NULL) {
+            ATOMIC_POST_INCREMENT_UINT32(&end_points[i]->rx_packets_dropped_count);
+            COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_DROPPED);
+            continue;
+        }
+
+        udp_deliver_rx_packet(end_points[i], clone_p, udp_header_p,
+                              dest_ipv4_addr_p);
+    }
+
+    udp_deliver_rx_packet(end_points[num_end_points - 1], rx_packet_p,
+                          udp_header_p, dest_ipv4_addr_p);
+    return true;
+}
+
+
+/**
+ * Chooses the UDP end point that is to receive a unicast datagram, among the
+ * end points bound to its shared destination port, according to the load
+ * balancing policy of the end point bound last to the port
+ *
+ * @param layer4_end_point_p    End point found for the datagram's
+ *                              destination port
+ *
+ * @return Pointer to the chosen end point
+ */
+static struct net_layer4_end_point *
+udp_balance_rx_packet(struct net_layer4_udp *layer4_udp_p,
+                      struct net_layer4_end_point *layer4_end_point_p,
+                      const struct network_packet *rx_packet_p,
+                      const struct udp_header *udp_header_p)
+{
+    struct net_layer4_end_point *end_points[NET_UDP_MAX_FAN_OUT_END_POINTS];
+    uint_fast8_t num_end_points =
+        udp_port_hash_table_lock_free_collect(layer4_udp_p, udp_header_p->dest_port,
+                                              end_points);
+    uint32_t index;
+
+    if (num_end_points <= 1) {
+        return layer4_end_point_p;
+    }
+
+    if (end_points[0]->load_balancing == NET_LAYER4_BALANCE_ROUND_ROBIN) {
+        index = ATOMIC_POST_INCREMENT_UINT32(&end_points[0]->round_robin_count);
+    } else {
+        /*
+         * NOTE: The IP version field is at the same place in IPv4 and IPv6
+         * headers. For IPv6, the low word of the source address is hashed.
+         */
+        if (GET_IP_VERSION(GET_IPV4_HEADER(rx_packet_p)) == 6) {
+            index = GET_IPV6_HEADER(rx_packet_p)->source_ipv6_addr.words[3];
+        } else {
+            index = GET_IPV4_HEADER(rx_packet_p)->source_ip_addr.value;
+        }
+
+        index ^= udp_header_p->source_port;
+        index ^= index >> 16;
+        index ^= index >> 8;
+    }
+
+    return end_points[index % num_end_points];
+}
+
+
 void net_layer4_process_incoming_udp_datagram(struct network_packet *rx_packet_p)
 {
     D_ASSERT(CALLER_IS_THREAD());
@@ -334,13 +2071,34 @@ void net_layer4_process_incoming_udp_datagram(struct network_packet *rx_packet_p
 
     struct net_layer4_udp *layer4_udp_p = &g_net_layer4.udp;
 
-    D_ASSERT(rx_packet_p->total_length >=
-               sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
-               sizeof(struct udp_header));
+    /*
+     * NOTE: The IP version field is at the same place in IPv4 and IPv6
+     * headers:
+     */
+    struct udp_header *udp_header_p;
+    const struct ipv4_address *dest_ipv4_addr_p;
+
+    if (GET_IP_VERSION(GET_IPV4_HEADER(rx_packet_p)) == 6) {
+        D_ASSERT(rx_packet_p->total_length >=
+                   sizeof(struct ethernet_header) + sizeof(struct ipv6_header) +
+                   sizeof(struct udp_header));
+
+        udp_header_p = GET_IPV6_DATA_PAYLOAD_AREA(rx_packet_p);
 
-    struct udp_header *udp_header_p = GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+        /*
+         * IPv6 multicast groups cannot be joined by UDP end points:
+         */
+        dest_ipv4_addr_p = NULL;
+    } else {
+        D_ASSERT(rx_packet_p->total_length >=
+                   sizeof(struct ethernet_header) + sizeof(struct ipv4_header) +
+                   sizeof(struct udp_header));
+
+        udp_header_p = GET_IPV4_DATA_PAYLOAD_AREA(rx_packet_p);
+        dest_ipv4_addr_p = &GET_IPV4_HEADER(rx_packet_p)->dest_ip_addr;
+    }
 
-    if (g_net_layer4.tracing_on) {
+    if (NET_LAYER4_TRACING_ON()) {
         DEBUG_PRINTF("Net layer4: UDP datagram received: "
                      "source port %u, destination port %u, length %u\n",
                      ntoh16(udp_header_p->source_port),
@@ -348,23 +2106,65 @@ void net_layer4_process_incoming_udp_datagram(struct network_packet *rx_packet_p
                      ntoh16(udp_header_p->datagram_length));
     }
 
+    /*
+     * NOTE: The UDP checksum is validated by the Ethernet MAC hardware. We
+     * just need to check the result.
+     */
+    if (NET_RX_PACKET_PROTOCOL_CHECKSUM_BAD(rx_packet_p)) {
+        ERROR_PRINTF("Received UDP datagram with wrong checksum (port %u)\n",
+                     ntoh16(udp_header_p->dest_port));
+
+        net_recycle_rx_packet(rx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer4.udp.rx_packets_dropped_bad_checksum_count);
+        COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_DROPPED);
+        goto exit;
+    }
+
+    if (udp_fan_out_rx_packet(layer4_udp_p, rx_packet_p, udp_header_p,
+                              dest_ipv4_addr_p)) {
+        goto exit;
+    }
+
     /*
      * Lookup local UDP end point by destination port:
      */
+    bool not_joined;
+    PERF_PROBE_BEGIN(PERF_PROBE_UDP_DEMUX);
     struct net_layer4_end_point *layer4_end_point_p =
-        lookup_local_udp_end_point(layer4_udp_p, udp_header_p->dest_port);
+        lookup_local_udp_end_point(layer4_udp_p, udp_header_p->dest_port,
+                                   dest_ipv4_addr_p, &not_joined);
+
+    PERF_PROBE_END(PERF_PROBE_UDP_DEMUX);
 
     if (layer4_end_point_p != NULL) {
-        net_packet_queue_add(&layer4_end_point_p->rx_packet_queue, rx_packet_p);
-        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer4.udp.rx_packets_accepted_count);
+        if (layer4_end_point_p->shared_port) {
+            layer4_end_point_p = udp_balance_rx_packet(layer4_udp_p,
+                                                       layer4_end_point_p,
+                                                       rx_packet_p, udp_header_p);
+        }
+
+        udp_deliver_rx_packet(layer4_end_point_p, rx_packet_p, udp_header_p,
+                              dest_ipv4_addr_p);
+    } else if (not_joined) {
+        /*
+         * The Ethernet MAC's multicast hash filter is imprecise and it is
+         * shared by all UDP end points, so datagrams for multicast groups
+         * not joined by this port's end point are filtered here.
+         */
+        net_recycle_rx_packet(rx_packet_p);
+        ATOMIC_POST_INCREMENT_UINT32(
+            &g_net_layer4.udp.rx_packets_dropped_not_joined_count);
+        COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_DROPPED);
     } else {
         ERROR_PRINTF("Received UDP datagram ignored: unknown port %u\n",
                      ntoh16(udp_header_p->dest_port));
 
         net_recycle_rx_packet(rx_packet_p);
-        ATOMIC_POST_INCREMENT_UINT32(&g_net_layer4.udp.rx_packets_dropped_count);
+        COUNTER_SET_INCREMENT(g_net_layer4.udp.counters, NET_UDP_COUNTER_RX_DROPPED);
     }
 
+exit:
 #   ifdef USE_MPU
     rtos_thread_unset_tmp_region();
     rtos_thread_restore_comp_region(&old_comp_region);
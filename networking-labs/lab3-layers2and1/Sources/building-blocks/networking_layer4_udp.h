@@ -24,6 +24,50 @@
 #define NET_MAX_IPV6_UDP_PACKET_PAYLOAD_SIZE \
         (NET_MAX_IPV6_PACKET_PAYLOAD_SIZE - sizeof(struct udp_header))
 
+/**
+ * Maximum number of UDP datagrams that can be sent or received in one call
+ * to the batched UDP send/receive functions
+ */
+#define NET_UDP_MAX_BATCH_DATAGRAMS     NET_IPV4_MAX_TX_BATCH_PACKETS
+
+/**
+ * Number of buckets of the UDP port hash table (must be a power of 2)
+ */
+#define NET_UDP_PORT_HASH_TABLE_NUM_BUCKETS 16
+
+C_ASSERT(IS_POWER_OF_2(NET_UDP_PORT_HASH_TABLE_NUM_BUCKETS));
+
+/**
+ * Maximum number of times that a lock-free UDP port lookup is retried,
+ * because the bucket was concurrently updated, before falling back to
+ * a lookup with the UDP mutex held
+ */
+#define NET_UDP_PORT_LOCK_FREE_LOOKUP_MAX_RETRIES   4
+
+/**
+ * Maximum number of UDP end points that can be bound to the same shared
+ * port. Multicast and broadcast datagrams are delivered to all of them, and
+ * unicast datagrams are balanced among them.
+ */
+#define NET_UDP_MAX_FAN_OUT_END_POINTS  4
+
+C_ASSERT(NET_UDP_MAX_FAN_OUT_END_POINTS <= NET_MAX_RX_PACKET_CLONES + 1);
+
+/**
+ * Number of UDP ephemeral ports that can be assigned, starting at
+ * NET_FIRST_EPHEMERAL_PORT (must be a multiple of 32). It is smaller than
+ * the whole ephemeral range to keep the ports-in-use bitmap small.
+ */
+#define NET_UDP_NUM_EPHEMERAL_PORTS     1024
+
+C_ASSERT(NET_UDP_NUM_EPHEMERAL_PORTS % 32 == 0);
+
+/**
+ * Number of 32-bit words of the UDP ephemeral ports-in-use bitmap
+ */
+#define NET_UDP_EPHEMERAL_PORTS_BITMAP_NUM_WORDS \
+        (NET_UDP_NUM_EPHEMERAL_PORTS / 32)
+
 /**
  * UDP header layout
  * (A UDP datagram is encapsulated in an IP packet)
@@ -58,35 +102,108 @@ struct udp_header {
 
 C_ASSERT(sizeof(struct udp_header) == 8);
 
+/**
+ * Bucket of the UDP port hash table
+ */
+struct net_udp_port_hash_bucket {
+    /**
+     * Sequence count for lock-free lookups: it is odd while the bucket is
+     * being updated. Lookups that see it change retry.
+     */
+    volatile uint32_t sequence_count;
+
+    /**
+     * First UDP end point in the bucket's chain, or NULL if none
+     */
+    struct net_layer4_end_point *volatile head_p;
+};
+
+/**
+ * Counters of the UDP counter set
+ */
+enum net_udp_counters {
+    NET_UDP_COUNTER_RX_ACCEPTED = 0,
+    NET_UDP_COUNTER_RX_DROPPED,
+    NET_UDP_COUNTER_SENT_OVER_IPV4,
+    NET_UDP_COUNTER_SENT_OVER_IPV6,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_NET_UDP_COUNTERS
+};
+
+DECLARE_COUNTER_SET(net_udp_counter_set, NUM_NET_UDP_COUNTERS);
+
 /**
  * Networking layer-4 for UDP
  */
 struct net_layer4_udp {
 	/**
-	 * Next ephemeral port to assign to a local UDP end point.
+	 * Bitmap of ephemeral ports in use. Bit i of word j is set if
+	 * port NET_FIRST_EPHEMERAL_PORT + j * 32 + i is bound.
+	 */
+	uint32_t ephemeral_ports_in_use[NET_UDP_EPHEMERAL_PORTS_BITMAP_NUM_WORDS];
+
+	/**
+	 * Index (relative to NET_FIRST_EPHEMERAL_PORT) of the ephemeral port at
+	 * which the search for the next free ephemeral port starts. It rotates
+	 * through the range, so that a recently released port is not reused
+	 * right away.
+	 */
+	uint16_t ephemeral_port_cursor;
+
+	/**
+	 * Numbers of received UDP datagrams accepted and dropped, and of UDP
+	 * datagrams sent over IPv4 and over IPv6
+	 */
+	struct net_udp_counter_set counters;
+
+	/**
+	 * Number of received UDP datagrams dropped because the Ethernet MAC
+	 * found a wrong UDP checksum (included in NET_UDP_COUNTER_RX_DROPPED)
+	 */
+	volatile uint32_t rx_packets_dropped_bad_checksum_count;
+
+	/**
+	 * Number of received UDP datagrams dropped because they were sent to an
+	 * IPv4 multicast group not joined by the UDP end point bound to their
+	 * destination port (included in NET_UDP_COUNTER_RX_DROPPED)
 	 */
-	uint16_t next_ephemeral_port;
+	volatile uint32_t rx_packets_dropped_not_joined_count;
 
 	/**
-	 * Number of received UDP datagrams accepted
+	 * Number of received UDP datagrams dropped because the UDP end point
+	 * bound to their destination port already held its maximum number of
+	 * Rx packets (included in NET_UDP_COUNTER_RX_DROPPED)
 	 */
-	volatile uint32_t rx_packets_accepted_count;
+	volatile uint32_t rx_packets_dropped_over_quota_count;
 
 	/**
-	 * Number of received UDP datagrams dropped
+	 * Number of received UDP datagrams dropped because the UDP end point
+	 * bound to their destination port is connected to a different peer
+	 * (included in NET_UDP_COUNTER_RX_DROPPED)
 	 */
-	volatile uint32_t rx_packets_dropped_count;
+	volatile uint32_t rx_packets_dropped_not_from_peer_count;
 
 	/**
-	 * Number of UDP datagrams sent over IPv4
+	 * Number of Rx callbacks unregistered because an invocation took more
+	 * than the callback's cycle budget
 	 */
-	volatile uint32_t sent_packets_over_ipv4_count;
+	volatile uint32_t rx_callbacks_over_budget_count;
 
 	/**
 	 * List of existing local UDP end points
      */
 	struct net_layer4_end_point_list local_udp_end_point_list;
 
+	/**
+	 * Hash table of bound UDP end points, indexed by UDP port. It is
+	 * updated with 'mutex' held, but it is looked up lock-free on the Rx
+	 * path.
+	 */
+	struct net_udp_port_hash_bucket port_hash_table[NET_UDP_PORT_HASH_TABLE_NUM_BUCKETS];
+
     /**
      * Mutex to serialize access to this struct
      */
@@ -94,6 +211,47 @@ struct net_layer4_udp {
 };
 
 
+/**
+ * Received UDP datagram lent to the application by
+ * net_layer4_udp_receive_zero_copy(). The payload slice points into the Rx
+ * packet buffer, so it is only valid until the datagram is returned with
+ * net_layer4_udp_release_rx_datagram().
+ */
+struct net_udp_rx_datagram {
+    /**
+     * Rx packet holding the datagram
+     */
+    struct network_packet *rx_packet_p;
+
+    /**
+     * Pointer to the first byte of the datagram's data payload
+     */
+    const void *payload_p;
+
+    /**
+     * Length in bytes of the datagram's data payload
+     */
+    size_t payload_length;
+
+    /**
+     * Source UDP port in network byte order
+     */
+    uint16_t source_port;
+
+    /**
+     * Version of the IP protocol the datagram was received over (4 or 6)
+     */
+    uint8_t ip_version;
+
+    /**
+     * Source IP address (the member used depends on 'ip_version')
+     */
+    union {
+        struct ipv4_address ipv4;
+        struct ipv6_address ipv6;
+    } source_ip_addr;
+};
+
 /**
  * Returns pointer to the data payload area of an IPv4 UDP datagram
  */
@@ -136,6 +294,46 @@ static inline size_t get_ipv4_udp_data_payload_length(
 }
 
 
+/**
+ * Returns pointer to the data payload area of an IPv6 UDP datagram
+ */
+static inline void *get_ipv6_udp_data_payload_area(
+    struct network_packet *net_packet_p)
+{
+    if (net_packet_p->signature == NET_RX_PACKET_SIGNATURE) {
+        struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(net_packet_p);
+
+        D_ASSERT(GET_IPV6_VERSION(ipv6_header_p) == 6);
+        D_ASSERT(ipv6_header_p->next_header == IPV6_NEXT_HEADER_UDP);
+    } else {
+        D_ASSERT(net_packet_p->signature == NET_TX_PACKET_SIGNATURE);
+    }
+
+    return (void *)((uint8_t *)GET_IPV6_DATA_PAYLOAD_AREA(net_packet_p) +
+            sizeof(struct udp_header));
+}
+
+
+/**
+ * Returns the data payload length of an IPv6 incoming UDP datagram
+ */
+static inline size_t get_ipv6_udp_data_payload_length(
+    struct network_packet *net_packet_p)
+{
+    D_ASSERT(net_packet_p->signature == NET_RX_PACKET_SIGNATURE);
+
+    struct ipv6_header *ipv6_header_p = GET_IPV6_HEADER(net_packet_p);
+
+    D_ASSERT(GET_IPV6_VERSION(ipv6_header_p) == 6);
+    D_ASSERT(ipv6_header_p->next_header == IPV6_NEXT_HEADER_UDP);
+
+    struct udp_header *udp_header_p =
+        (struct udp_header *)GET_IPV6_DATA_PAYLOAD_AREA(net_packet_p);
+
+    return ntoh16(udp_header_p->datagram_length) - sizeof(struct udp_header);
+}
+
+
 void net_layer4_udp_init(struct net_layer4_udp *layer4_udp_p);
 
 void net_layer4_udp_end_point_init(struct net_layer4_end_point *layer4_end_point_p);
@@ -146,6 +344,28 @@ error_t net_layer4_udp_end_point_bind(
 
 void net_layer4_udp_end_point_unbind(struct net_layer4_end_point *layer4_end_point_p);
 
+error_t net_layer4_udp_end_point_set_shared_port(
+    struct net_layer4_end_point *layer4_end_point_p,
+    bool shared_port);
+
+void net_layer4_udp_end_point_set_load_balancing(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint8_t load_balancing);
+
+void net_layer4_udp_end_point_set_rx_callback(
+    struct net_layer4_end_point *layer4_end_point_p,
+    net_udp_rx_callback_t *rx_callback_p,
+    void *arg,
+    uint32_t cycle_budget);
+
+error_t net_layer4_udp_end_point_join_ipv4_multicast_group(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *multicast_addr_p);
+
+error_t net_layer4_udp_end_point_leave_ipv4_multicast_group(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *multicast_addr_p);
+
 error_t net_layer4_send_udp_datagram_over_ipv4(
     struct net_layer4_end_point *layer4_end_point_p,
     const struct ipv4_address *dest_ip_addr_p,
@@ -153,6 +373,33 @@ error_t net_layer4_send_udp_datagram_over_ipv4(
     struct network_packet *tx_packet_p,
     size_t data_payload_length);
 
+error_t net_layer4_send_udp_datagram_over_ipv4_flow(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_ipv4_flow *flow_p,
+    uint16_t dest_port, /* big endian */
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length);
+
+error_t net_layer4_udp_end_point_connect(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_ipv4_flow *flow_p,
+    const struct ipv4_address *peer_ip_addr_p,
+    uint16_t peer_port /* big endian */);
+
+void net_layer4_udp_end_point_disconnect(struct net_layer4_end_point *layer4_end_point_p);
+
+error_t net_layer4_send_udp_datagram_connected(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length);
+
+error_t net_layer4_send_large_udp_datagram_over_ipv4(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *dest_ip_addr_p,
+    uint16_t dest_port, /* big endian */
+    const void *data_p,
+    size_t data_length);
+
 error_t net_layer4_receive_udp_datagram_over_ipv4(
     struct net_layer4_end_point *layer4_end_point_p,
     uint32_t timeout_ms,
@@ -160,6 +407,49 @@ error_t net_layer4_receive_udp_datagram_over_ipv4(
     uint16_t *source_port_p,
     struct network_packet **rx_packet_pp);
 
+error_t net_layer4_send_udp_datagram_over_ipv6(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv6_address *dest_ip_addr_p,
+    uint16_t dest_port, /* big endian */
+    struct network_packet *tx_packet_p,
+    size_t data_payload_length);
+
+error_t net_layer4_receive_udp_datagram_over_ipv6(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint32_t timeout_ms,
+    struct ipv6_address *source_ip_addr_p,
+    uint16_t *source_port_p,
+    struct network_packet **rx_packet_pp);
+
+error_t net_layer4_udp_receive_zero_copy(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint32_t timeout_ms,
+    struct net_udp_rx_datagram *rx_datagram_p);
+
+void net_layer4_udp_release_rx_datagram(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_udp_rx_datagram *rx_datagram_p);
+
+error_t net_layer4_send_udp_datagrams_over_ipv4(
+    struct net_layer4_end_point *layer4_end_point_p,
+    const struct ipv4_address *dest_ip_addr_p,
+    uint16_t dest_port, /* big endian */
+    struct network_packet *tx_packets[],
+    const size_t data_payload_lengths[],
+    uint_fast8_t num_datagrams);
+
+error_t net_layer4_udp_receive_zero_copy_batch(
+    struct net_layer4_end_point *layer4_end_point_p,
+    uint32_t timeout_ms,
+    struct net_udp_rx_datagram rx_datagrams[],
+    uint_fast8_t max_datagrams,
+    uint_fast8_t *num_datagrams_p);
+
+void net_layer4_udp_release_rx_datagrams(
+    struct net_layer4_end_point *layer4_end_point_p,
+    struct net_udp_rx_datagram rx_datagrams[],
+    uint_fast8_t num_datagrams);
+
 void net_layer4_process_incoming_udp_datagram(struct network_packet *rx_packet_p);
 
 #endif /* SOURCES_BUILDING_BLOCKS_NETWORKING_LAYER4_UDP_H_ */
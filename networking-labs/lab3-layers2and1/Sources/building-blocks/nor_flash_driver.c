@@ -10,6 +10,7 @@
 #include "runtime_checks.h"
 #include "io_utils.h"
 #include "mem_utils.h"
+#include "atomic_utils.h"
 #include "rtos_wrapper.h"
 #include "interrupt_vector_table.h"
 #include "cortex_m_startup.h"
@@ -19,6 +20,7 @@ enum nor_flash_commands {
 #if defined(KL25Z_MCU)
     NOR_FLASH_CMD_PROGRAM_LONG_WORD =    0x06,
 #elif defined(K64F_MCU)
+    NOR_FLASH_CMD_PROGRAM_PHRASE =       0x07,
     NOR_FLASH_CMD_PROGRAM_SECTION =      0x0b,
 #else
 #error "No Microcontroller defined"
@@ -45,6 +47,35 @@ struct nor_flash_device_var {
      * Flag indicating if the NOR flash device has been initialized for writing
      */
     bool initialized;
+
+#if defined(K64F_MCU)
+    /**
+     * Flag indicating if program-section commands are to be used when
+     * possible, instead of one program-phrase command per phrase
+     */
+    bool program_section_enabled;
+
+    /**
+     * FIFO queue of background jobs. The head job is the one in progress.
+     * It is protected by disabling interrupts, as it is updated from the
+     * command-complete ISR.
+     */
+    struct nor_flash_job *jobs_head_p;
+    struct nor_flash_job *jobs_tail_p;
+
+    /**
+     * Job and semaphore used by nor_flash_erase() and nor_flash_program()
+     * to run a background job and wait for it, serialized by sync_mutex
+     */
+    struct rtos_mutex sync_mutex;
+    struct nor_flash_job sync_job;
+    struct rtos_semaphore sync_semaphore;
+
+    uint32_t num_queued_jobs;
+    uint32_t max_queued_jobs;
+    uint32_t jobs_count;
+    uint32_t failed_jobs_count;
+#endif
 };
 
 /**
@@ -53,6 +84,9 @@ struct nor_flash_device_var {
  */
 static struct nor_flash_device_var g_nor_flash_device_var = {
     .initialized = false,
+#if defined(K64F_MCU)
+    .program_section_enabled = true,
+#endif
 };
 
 /**
@@ -73,6 +107,20 @@ void nor_flash_init(void)
 {
     struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
 
+#if defined(K64F_MCU)
+    nor_flash_var_p->jobs_head_p = NULL;
+    nor_flash_var_p->jobs_tail_p = NULL;
+    nor_flash_var_p->num_queued_jobs = 0;
+    nor_flash_var_p->max_queued_jobs = 0;
+    nor_flash_var_p->jobs_count = 0;
+    nor_flash_var_p->failed_jobs_count = 0;
+    rtos_mutex_init(&nor_flash_var_p->sync_mutex, "NOR flash mutex");
+    rtos_semaphore_init(&nor_flash_var_p->sync_semaphore,
+                        "NOR flash semaphore", 0);
+    nor_flash_job_init(&nor_flash_var_p->sync_job);
+    nvic_setup_irq(FTFE_IRQn, NOR_FLASH_INTERRUPT_PRIORITY);
+#endif
+
     nor_flash_var_p->initialized = true;
 }
 
@@ -109,6 +157,7 @@ RAM_FUNC static error_t nor_flash_execute_command(void)
         reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT);
     } while ((reg_value & FTFE_FSTAT_CCIF_MASK) == 0);
 
+    flash_cache_invalidate();
     restore_cpu_interrupts(int_mask);
 
     if (reg_value & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_MGSTAT0_MASK)) {
@@ -121,7 +170,13 @@ RAM_FUNC static error_t nor_flash_execute_command(void)
 }
 
 
-static error_t nor_flash_erase_sector(uintptr_t addr)
+/**
+ * Clears the error flags left by the previous NOR flash command, if any,
+ * and loads the given command and its flash address in the FCCOB0-FCCOB3
+ * registers
+ */
+static void nor_flash_load_command(enum nor_flash_commands command,
+                                   uintptr_t addr)
 {
     uint32_t reg_value;
     FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
@@ -131,22 +186,29 @@ static error_t nor_flash_erase_sector(uintptr_t addr)
      */
     reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT);
     D_ASSERT(reg_value & FTFE_FSTAT_CCIF_MASK);
-    if (reg_value & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK)) {
+    if (reg_value & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK |
+                     FTFE_FSTAT_RDCOLERR_MASK)) {
         WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT,
-                            FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK);
+                            FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK |
+                            FTFE_FSTAT_RDCOLERR_MASK);
     }
 
     /*
      * Populate NOR flash command registers:
      */
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB0, NOR_FLASH_CMD_ERASE_SECTOR);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB0, command);
     reg_value = GET_BIT_FIELD(addr, MULTI_BIT_MASK(23, 16), 16);
     WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB1, reg_value);
     reg_value = GET_BIT_FIELD(addr, MULTI_BIT_MASK(15, 8), 8);
     WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB2, reg_value);
     reg_value = GET_BIT_FIELD(addr, MULTI_BIT_MASK(7, 0), 0);
     WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB3, reg_value);
+}
 
+
+static error_t nor_flash_erase_sector(uintptr_t addr)
+{
+    nor_flash_load_command(NOR_FLASH_CMD_ERASE_SECTOR, addr);
     return nor_flash_execute_command();
 }
 
@@ -155,29 +217,10 @@ static error_t nor_flash_erase_sector(uintptr_t addr)
 static error_t nor_flash_write_word(uint32_t *dest_word_p, uint32_t word_value)
 {
 	uint32_t reg_value;
-	uintptr_t addr = (uintptr_t)dest_word_p;
     FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
 
-    /*
-     * Clear error flags (w1c) from previous command, if any:
-     */
-    reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT);
-    D_ASSERT(reg_value & FTFE_FSTAT_CCIF_MASK);
-    if (reg_value & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK)) {
-        WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT,
-                            FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK);
-    }
-
-    /*
-     * Populate NOR flash command registers:
-     */
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB0, NOR_FLASH_CMD_PROGRAM_LONG_WORD);
-    reg_value = GET_BIT_FIELD(addr, MULTI_BIT_MASK(23, 16), 16);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB1, reg_value);
-    reg_value = GET_BIT_FIELD(addr, MULTI_BIT_MASK(15, 8), 8);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB2, reg_value);
-    reg_value = GET_BIT_FIELD(addr, MULTI_BIT_MASK(7, 0), 0);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB3, reg_value);
+    nor_flash_load_command(NOR_FLASH_CMD_PROGRAM_LONG_WORD,
+                           (uintptr_t)dest_word_p);
     reg_value = GET_BIT_FIELD(word_value, MULTI_BIT_MASK(31, 24), 24);
     WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB4, reg_value);
     reg_value = GET_BIT_FIELD(word_value, MULTI_BIT_MASK(23, 16), 16);
@@ -198,60 +241,510 @@ static error_t nor_flash_write_word(uint32_t *dest_word_p, uint32_t word_value)
 #define NOR_FLASH_PROG_ACCEL_BUFFER_ADDR    UINT32_C(0x14000000)
 
 /**
- * Programs a section of NOR flash
+ * Size in bytes of the NOR flash programming acceleration buffer (FlexRAM
+ * not used as EEPROM)
+ */
+#define NOR_FLASH_PROG_ACCEL_BUFFER_SIZE    (4 * 1024)
+
+/**
+ * Alignment and size granularity in bytes of a section programmed by a
+ * program-section command
+ */
+#define NOR_FLASH_SECTION_ALIGNMENT         16
+
+C_ASSERT(NOR_FLASH_PROGRAM_UNIT_SIZE == 2 * sizeof(uint32_t));
+
+/**
+ * Loads the command to program a phrase (64 bits) of NOR flash
  */
-static error_t nor_flash_program_section(uintptr_t dest_addr, const void *src_addr,
-		                                 uint32_t section_size)
+static void nor_flash_load_program_phrase(uintptr_t dest_addr,
+                                          const uint32_t *src_words)
+{
+	uint32_t reg_value;
+    FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
+
+    D_ASSERT(dest_addr % NOR_FLASH_PROGRAM_UNIT_SIZE == 0);
+
+    nor_flash_load_command(NOR_FLASH_CMD_PROGRAM_PHRASE, dest_addr);
+
+    /*
+     * The 4 bytes of each word go in big-endian order in the FCCOB
+     * registers (FCCOB7 and FCCOBB take the bytes at the lowest address):
+     */
+    reg_value = GET_BIT_FIELD(src_words[0], MULTI_BIT_MASK(31, 24), 24);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB4, reg_value);
+    reg_value = GET_BIT_FIELD(src_words[0], MULTI_BIT_MASK(23, 16), 16);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB5, reg_value);
+    reg_value = GET_BIT_FIELD(src_words[0], MULTI_BIT_MASK(15, 8), 8);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB6, reg_value);
+    reg_value = GET_BIT_FIELD(src_words[0], MULTI_BIT_MASK(7, 0), 0);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB7, reg_value);
+    reg_value = GET_BIT_FIELD(src_words[1], MULTI_BIT_MASK(31, 24), 24);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB8, reg_value);
+    reg_value = GET_BIT_FIELD(src_words[1], MULTI_BIT_MASK(23, 16), 16);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB9, reg_value);
+    reg_value = GET_BIT_FIELD(src_words[1], MULTI_BIT_MASK(15, 8), 8);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOBA, reg_value);
+    reg_value = GET_BIT_FIELD(src_words[1], MULTI_BIT_MASK(7, 0), 0);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOBB, reg_value);
+}
+
+
+/**
+ * Loads the command to program a section of NOR flash with a single
+ * program-section command, and copies the section's data to the
+ * programming acceleration buffer
+ *
+ * @param dest_addr     Destination address. It must be aligned to
+ *                      NOR_FLASH_SECTION_ALIGNMENT.
+ * @param src_addr      Source address. It must be word (4 byte) aligned.
+ * @param section_size  Section size in bytes. It must be a multiple of
+ *                      NOR_FLASH_SECTION_ALIGNMENT, no larger than
+ *                      NOR_FLASH_PROG_ACCEL_BUFFER_SIZE.
+ */
+static void nor_flash_load_program_section(uintptr_t dest_addr,
+                                           const void *src_addr,
+                                           uint32_t section_size)
 {
 	uint32_t reg_value;
 	uint32_t num_128bit_chunks;
     FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
 
     C_ASSERT(NOR_FLASH_PROG_ACCEL_BUFFER_ADDR % sizeof(uint32_t) == 0);
-    D_ASSERT(VALID_RAM_POINTER(src_addr, sizeof(uint32_t)));
-    D_ASSERT(section_size % sizeof(uint32_t) == 0);
+    D_ASSERT((uintptr_t)src_addr % sizeof(uint32_t) == 0);
+    D_ASSERT(dest_addr % NOR_FLASH_SECTION_ALIGNMENT == 0);
+    D_ASSERT(section_size % NOR_FLASH_SECTION_ALIGNMENT == 0);
+    D_ASSERT(section_size <= NOR_FLASH_PROG_ACCEL_BUFFER_SIZE);
 
     /*
      * Copy source section to the NOR flash programming acceleration buffer:
      */
     memcpy32((uint32_t *)NOR_FLASH_PROG_ACCEL_BUFFER_ADDR, (uint32_t *)src_addr, section_size);
 
+    nor_flash_load_command(NOR_FLASH_CMD_PROGRAM_SECTION, dest_addr);
+
+    num_128bit_chunks = section_size / NOR_FLASH_SECTION_ALIGNMENT;
+    reg_value = GET_BIT_FIELD(num_128bit_chunks, MULTI_BIT_MASK(15, 8), 8);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB4, reg_value);
+    reg_value = GET_BIT_FIELD(num_128bit_chunks, MULTI_BIT_MASK(7, 0), 0);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB5, reg_value);
+}
+
+
+/**
+ * Loads the command to program the next chunk of a data block: the
+ * longest section that can be programmed with one program-section command,
+ * or else one phrase.
+ *
+ * @return size in bytes of the chunk
+ */
+static uint32_t nor_flash_load_program_chunk(uintptr_t dest_addr,
+                                             const uint32_t *src_word_p,
+                                             size_t size)
+{
+    FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
+    uint32_t chunk_size;
+
+    D_ASSERT(size % NOR_FLASH_PROGRAM_UNIT_SIZE == 0);
+    if (g_nor_flash_device.var_p->program_section_enabled &&
+        (READ_MMIO_REGISTER(&nor_flash_mmio_p->FCNFG) & FTFE_FCNFG_RAMRDY_MASK) != 0 &&
+        dest_addr % NOR_FLASH_SECTION_ALIGNMENT == 0 &&
+        size >= NOR_FLASH_SECTION_ALIGNMENT) {
+        /*
+         * Program sections do not cross sector boundaries:
+         */
+        uint32_t sector_bytes_left =
+            NOR_FLASH_SECTOR_SIZE - dest_addr % NOR_FLASH_SECTOR_SIZE;
+
+        chunk_size = size - size % NOR_FLASH_SECTION_ALIGNMENT;
+        if (chunk_size > NOR_FLASH_PROG_ACCEL_BUFFER_SIZE) {
+            chunk_size = NOR_FLASH_PROG_ACCEL_BUFFER_SIZE;
+        }
+
+        if (chunk_size > sector_bytes_left) {
+            chunk_size = sector_bytes_left;
+        }
+
+        nor_flash_load_program_section(dest_addr, src_word_p, chunk_size);
+    } else {
+        chunk_size = NOR_FLASH_PROGRAM_UNIT_SIZE;
+        nor_flash_load_program_phrase(dest_addr, src_word_p);
+    }
+
+    return chunk_size;
+}
+
+
+/**
+ * Enables or disables the use of program-section commands by
+ * nor_flash_program(). When disabled, nor_flash_program() issues one
+ * program-phrase command per phrase (used to benchmark both).
+ *
+ * @return previous setting
+ */
+bool nor_flash_enable_program_section(bool enabled)
+{
+    struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
+    bool old_enabled = nor_flash_var_p->program_section_enabled;
+
+    nor_flash_var_p->program_section_enabled = enabled;
+    return old_enabled;
+}
+
+#else
+#error "No Microcontroller defined"
+#endif
+
+/**
+ * Checks that a NOR flash area to be erased or programmed does not overlap
+ * with code
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t nor_flash_check_writable(uintptr_t dest_addr)
+{
+    uintptr_t highest_code_address = MCU_FLASH_BASE_ADDR + get_flash_used();
+
+    D_ASSERT(VALID_FLASH_ADDRESS(dest_addr));
+    D_ASSERT(g_nor_flash_device.var_p->initialized);
+
+    if (dest_addr <= highest_code_address) {
+        /*
+         * Destination address overlaps with code
+         */
+        return CAPTURE_ERROR("NOR flash cannot be written at given address",
+                             dest_addr, highest_code_address);
+    }
+
+    return 0;
+}
+
+
+#if defined(K64F_MCU)
+
+/**
+ * Size in bytes of each of the two program flash blocks (a command can run
+ * on one block while code is fetched from the other)
+ */
+#define NOR_FLASH_BLOCK_SIZE    (MCU_FLASH_SIZE / 2)
+
+/**
+ * Checks if a NOR flash area can be erased or programmed in the
+ * background, that is, if it is in a program flash block that does not
+ * contain any code or constant data. Then, code can keep running from
+ * flash while the flash commands run (read-while-write).
+ */
+static bool nor_flash_can_write_in_background(uintptr_t dest_addr)
+{
+    uintptr_t code_end_addr = MCU_FLASH_BASE_ADDR + get_flash_used();
+
+    return dest_addr >= ROUND_UP(code_end_addr, NOR_FLASH_BLOCK_SIZE);
+}
+
+
+/**
+ * Launches the NOR flash command currently loaded in the FCCOBx registers,
+ * without waiting for its completion. The command-complete interrupt
+ * is enabled, to be notified of its completion.
+ */
+static void nor_flash_launch_command(void)
+{
+    uint32_t reg_value;
+    FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
+
     /*
-     * Clear error flags (w1c) from previous command, if any:
+     * Launch the command by clearing FSTAT register's CCIF bit (w1c):
      */
-    reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT);
-    D_ASSERT(reg_value & FTFE_FSTAT_CCIF_MASK);
-    if (reg_value & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK)) {
-        WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT,
-                            FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK);
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT, FTFE_FSTAT_CCIF_MASK);
+
+    reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FCNFG);
+    reg_value |= FTFE_FCNFG_CCIE_MASK;
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCNFG, reg_value);
+}
+
+
+/**
+ * Launches the command for the next step of a background job: the erase of
+ * its next sector, or the programming of its next chunk
+ */
+static void nor_flash_job_start_step(struct nor_flash_job *job_p)
+{
+    uint32_t step_size;
+
+    D_ASSERT(job_p->remaining_size != 0);
+    if (job_p->type == NOR_FLASH_JOB_ERASE) {
+        nor_flash_load_command(NOR_FLASH_CMD_ERASE_SECTOR, job_p->dest_cursor);
+        step_size = NOR_FLASH_SECTOR_SIZE;
+    } else {
+        step_size = nor_flash_load_program_chunk(job_p->dest_cursor,
+                                                 job_p->src_cursor_p,
+                                                 job_p->remaining_size);
+        job_p->src_cursor_p += step_size / sizeof(uint32_t);
+    }
+
+    job_p->dest_cursor += step_size;
+    job_p->remaining_size -= step_size;
+    nor_flash_launch_command();
+}
+
+
+/**
+ * Initializes a NOR flash background job
+ */
+void nor_flash_job_init(struct nor_flash_job *job_p)
+{
+    job_p->signature = NOR_FLASH_JOB_SIGNATURE;
+    job_p->done = true;
+    job_p->error = 0;
+    job_p->next_p = NULL;
+}
+
+
+/**
+ * Queues a background job, starting it right away if no other job is in
+ * progress
+ */
+static error_t nor_flash_job_start(struct nor_flash_job *job_p,
+                                   enum nor_flash_job_types type,
+                                   uintptr_t dest_addr,
+                                   const void *src_addr,
+                                   size_t size,
+                                   nor_flash_job_callback_t *callback_p,
+                                   void *callback_arg)
+{
+    error_t error;
+    struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
+
+    D_ASSERT(job_p->signature == NOR_FLASH_JOB_SIGNATURE);
+    D_ASSERT(job_p->done);
+    D_ASSERT(size != 0);
+
+    error = nor_flash_check_writable(dest_addr);
+    if (error != 0) {
+        return error;
+    }
+
+    if (!nor_flash_can_write_in_background(dest_addr)) {
+        return CAPTURE_ERROR("NOR flash area cannot be written in the background",
+                             dest_addr, get_flash_used());
     }
 
+    job_p->type = type;
+    job_p->done = false;
+    job_p->error = 0;
+    job_p->dest_cursor = dest_addr;
+    job_p->src_cursor_p = src_addr;
+    job_p->remaining_size = size;
+    job_p->callback_p = callback_p;
+    job_p->callback_arg = callback_arg;
+    job_p->next_p = NULL;
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (nor_flash_var_p->jobs_tail_p == NULL) {
+        nor_flash_var_p->jobs_head_p = job_p;
+        nor_flash_var_p->jobs_tail_p = job_p;
+        nor_flash_job_start_step(job_p);
+    } else {
+        nor_flash_var_p->jobs_tail_p->next_p = job_p;
+        nor_flash_var_p->jobs_tail_p = job_p;
+    }
+
+    nor_flash_var_p->num_queued_jobs ++;
+    if (nor_flash_var_p->num_queued_jobs > nor_flash_var_p->max_queued_jobs) {
+        nor_flash_var_p->max_queued_jobs = nor_flash_var_p->num_queued_jobs;
+    }
+
+    restore_cpu_interrupts(int_mask);
+    return 0;
+}
+
+
+/**
+ * Starts erasing, in the background, the NOR flash sectors that contain the
+ * given NOR flash area. The area must be in a program flash block that does
+ * not contain any code or constant data, so that code can keep running from
+ * flash while the sectors are erased. The completion callback is invoked
+ * from the command-complete ISR.
+ *
+ * @param job_p         Pointer to the job
+ * @param dest_addr     Start address of the area. It must be NOR flash
+ *                      sector aligned.
+ * @param size          Size of the area in bytes
+ * @param callback_p    Completion callback (optional)
+ * @param callback_arg  Argument for callback_p
+ *
+ * @return 0, if the job was queued
+ * @return error code, otherwise
+ */
+error_t nor_flash_job_start_erase(struct nor_flash_job *job_p,
+                                  uintptr_t dest_addr,
+                                  size_t size,
+                                  nor_flash_job_callback_t *callback_p,
+                                  void *callback_arg)
+{
+    D_ASSERT((dest_addr & (NOR_FLASH_SECTOR_SIZE - 1)) == 0);
+
+    return nor_flash_job_start(job_p, NOR_FLASH_JOB_ERASE, dest_addr, NULL,
+                               ROUND_UP(size, NOR_FLASH_SECTOR_SIZE),
+                               callback_p, callback_arg);
+}
+
+
+/**
+ * Starts programming, in the background, a data block in an already erased
+ * NOR flash area (see nor_flash_program()). The area must be in a program
+ * flash block that does not contain any code or constant data. The data
+ * block must not be modified until the job is complete. The completion
+ * callback is invoked from the command-complete ISR.
+ *
+ * @param job_p         Pointer to the job
+ * @param dest_addr     Destination address in NOR flash. It must be aligned
+ *                      to NOR_FLASH_PROGRAM_UNIT_SIZE.
+ * @param src_addr      Source address of the data block. It must be word
+ *                      (4 byte) aligned.
+ * @param src_size      Size of the data block in bytes. It must be a
+ *                      multiple of NOR_FLASH_PROGRAM_UNIT_SIZE.
+ * @param callback_p    Completion callback (optional)
+ * @param callback_arg  Argument for callback_p
+ *
+ * @return 0, if the job was queued
+ * @return error code, otherwise
+ */
+error_t nor_flash_job_start_program(struct nor_flash_job *job_p,
+                                    uintptr_t dest_addr,
+                                    const void *src_addr,
+                                    size_t src_size,
+                                    nor_flash_job_callback_t *callback_p,
+                                    void *callback_arg)
+{
+    D_ASSERT(dest_addr % NOR_FLASH_PROGRAM_UNIT_SIZE == 0);
+    D_ASSERT((uintptr_t)src_addr % sizeof(uint32_t) == 0);
+    D_ASSERT(src_size % NOR_FLASH_PROGRAM_UNIT_SIZE == 0);
+
+    return nor_flash_job_start(job_p, NOR_FLASH_JOB_PROGRAM, dest_addr,
+                               src_addr, src_size, callback_p, callback_arg);
+}
+
+
+static void nor_flash_sync_job_callback(struct nor_flash_job *job_p, void *arg)
+{
+    rtos_semaphore_signal(&g_nor_flash_device.var_p->sync_semaphore);
+}
+
+
+/**
+ * Runs a background job and blocks the calling task (not the CPU) until the
+ * job is complete. It must be called from a task.
+ */
+static error_t nor_flash_run_sync_job(enum nor_flash_job_types type,
+                                      uintptr_t dest_addr,
+                                      const void *src_addr,
+                                      size_t size)
+{
+    error_t error;
+    struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
+    struct nor_flash_job *const job_p = &nor_flash_var_p->sync_job;
+
+    rtos_mutex_lock(&nor_flash_var_p->sync_mutex);
+    if (type == NOR_FLASH_JOB_ERASE) {
+        error = nor_flash_job_start_erase(job_p, dest_addr, size,
+                                          nor_flash_sync_job_callback, NULL);
+    } else {
+        error = nor_flash_job_start_program(job_p, dest_addr, src_addr, size,
+                                            nor_flash_sync_job_callback, NULL);
+    }
+
+    if (error == 0) {
+        rtos_semaphore_wait(&nor_flash_var_p->sync_semaphore);
+        error = job_p->error;
+    }
+
+    rtos_mutex_unlock(&nor_flash_var_p->sync_mutex);
+    return error;
+}
+
+
+/**
+ * Returns the number of background jobs completed, how many of them failed
+ * and the maximum number of jobs ever queued
+ */
+void nor_flash_get_job_stats(uint32_t *jobs_count_p, uint32_t *failed_jobs_count_p,
+                             uint32_t *max_queued_jobs_p)
+{
+    struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
+
+    *jobs_count_p = nor_flash_var_p->jobs_count;
+    *failed_jobs_count_p = nor_flash_var_p->failed_jobs_count;
+    *max_queued_jobs_p = nor_flash_var_p->max_queued_jobs;
+}
+
+
+/**
+ * ISR for the NOR flash command-complete interrupt. It launches the next
+ * step of the job in progress, or completes the job and starts the next
+ * queued job.
+ */
+void nor_flash_irq_handler(void)
+{
+    uint32_t reg_value;
+    FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
+    struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
+
+    rtos_enter_isr();
+
     /*
-     * Populate NOR flash command registers:
+     * CCIF stays set while no command is running, so the interrupt must be
+     * disabled until the next command is launched:
      */
+    reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FCNFG);
+    reg_value &= ~FTFE_FCNFG_CCIE_MASK;
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCNFG, reg_value);
+
+    uint32_t fstat_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT);
+
+    flash_cache_invalidate();
+    uint32_t int_mask = disable_cpu_interrupts();
+    struct nor_flash_job *job_p = nor_flash_var_p->jobs_head_p;
+
+    D_ASSERT(job_p != NULL);
+    D_ASSERT(job_p->signature == NOR_FLASH_JOB_SIGNATURE);
+    if (fstat_value & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK |
+                       FTFE_FSTAT_MGSTAT0_MASK | FTFE_FSTAT_RDCOLERR_MASK)) {
+        job_p->error = CAPTURE_ERROR("NOR flash command finished with error",
+                                     fstat_value, job_p->dest_cursor);
+        nor_flash_var_p->failed_jobs_count ++;
+    } else if (job_p->remaining_size != 0) {
+        nor_flash_job_start_step(job_p);
+        job_p = NULL;
+    }
 
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB0, NOR_FLASH_CMD_PROGRAM_SECTION);
+    if (job_p != NULL) {
+        nor_flash_var_p->jobs_head_p = job_p->next_p;
+        if (nor_flash_var_p->jobs_head_p == NULL) {
+            nor_flash_var_p->jobs_tail_p = NULL;
+        } else {
+            nor_flash_job_start_step(nor_flash_var_p->jobs_head_p);
+        }
 
-    reg_value = GET_BIT_FIELD(dest_addr, MULTI_BIT_MASK(23, 16), 16);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB1, reg_value);
-    reg_value = GET_BIT_FIELD(dest_addr, MULTI_BIT_MASK(15, 8), 8);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB2, reg_value);
-    reg_value = GET_BIT_FIELD(dest_addr, MULTI_BIT_MASK(7, 0), 0);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB3, reg_value);
+        nor_flash_var_p->num_queued_jobs --;
+        nor_flash_var_p->jobs_count ++;
+    }
 
-    num_128bit_chunks = HOW_MANY(section_size, 16);
-    D_ASSERT(num_128bit_chunks <= UINT16_MAX);
-    reg_value = GET_BIT_FIELD(num_128bit_chunks, MULTI_BIT_MASK(15, 8), 8);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB4, reg_value);
-    reg_value = GET_BIT_FIELD(num_128bit_chunks, MULTI_BIT_MASK(7, 0), 0);
-    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCCOB5, reg_value);
+    restore_cpu_interrupts(int_mask);
+    if (job_p != NULL) {
+        job_p->done = true;
+        if (job_p->callback_p != NULL) {
+            job_p->callback_p(job_p, job_p->callback_arg);
+        }
+    }
 
-    return nor_flash_execute_command();
+    rtos_exit_isr();
 }
 
-#else
-#error "No Microcontroller defined"
-#endif
+#endif /* K64F_MCU */
+
 
 /**
  * Writes a data block to NOR flash at the given address. The write is done
@@ -263,7 +756,7 @@ static error_t nor_flash_program_section(uintptr_t dest_addr, const void *src_ad
  * @param src_addr  Source address of the data block in RAM. It must be word
  *                     (4 byte) aligned.
  * @param src_size  Size of the data block in bytes. It must be a multiple of
- *                  4 bytes (32-bit word size).
+ *                  NOR_FLASH_PROGRAM_UNIT_SIZE.
  *
  * @return 0, on success
  * @return error code, on failure
@@ -272,31 +765,57 @@ error_t nor_flash_write(uintptr_t dest_addr,
                         const void *src_addr,
                         size_t src_size)
 {
-    uintptr_t sector_addr;
     error_t error;
-    struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
-    uint32_t num_sectors = HOW_MANY(src_size, NOR_FLASH_SECTOR_SIZE);
-    uintptr_t highest_code_address = MCU_FLASH_BASE_ADDR + get_flash_used();
 
-    D_ASSERT(VALID_FLASH_ADDRESS(dest_addr));
+    error = nor_flash_erase(dest_addr, src_size);
+    if (error != 0) {
+        return error;
+    }
+
+    return nor_flash_program(dest_addr, src_addr, src_size);
+}
+
+
+/**
+ * Erases the NOR flash sectors that contain the given NOR flash area
+ *
+ * When called from a task with interrupts enabled, for an area that can be
+ * written in the background (see nor_flash_job_start_erase()), the calling
+ * task is
+ * blocked until the sectors are erased, but interrupts stay enabled and
+ * other tasks keep running. Otherwise, each sector erase is polled with
+ * interrupts disabled.
+ *
+ * @param dest_addr Start address of the area. It must be NOR flash sector
+ *                  aligned.
+ * @param size      Size of the area in bytes
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t nor_flash_erase(uintptr_t dest_addr, size_t size)
+{
+    error_t error;
+    uintptr_t sector_addr = dest_addr;
+    uint32_t num_sectors = HOW_MANY(size, NOR_FLASH_SECTOR_SIZE);
+
     D_ASSERT((dest_addr & (NOR_FLASH_SECTOR_SIZE - 1)) == 0);
-    D_ASSERT(VALID_RAM_POINTER(src_addr, sizeof(uint32_t)));
-    D_ASSERT(src_size != 0);
-    D_ASSERT(nor_flash_var_p->initialized);
+    D_ASSERT(size != 0);
 
-    if (dest_addr <= highest_code_address) {
-        /*
-         * Destination address overlaps with code
-         */
-        error = CAPTURE_ERROR("NOR flash cannot be written at given address",
-                              dest_addr, highest_code_address);
+    error = nor_flash_check_writable(dest_addr);
+    if (error != 0) {
         return error;
     }
 
-    /*
-     * Erase sectors to be written:
-     */
-    sector_addr = dest_addr;
+#if defined(K64F_MCU)
+    if (CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED() &&
+        nor_flash_can_write_in_background(dest_addr)) {
+        return nor_flash_run_sync_job(NOR_FLASH_JOB_ERASE, dest_addr, NULL, size);
+    }
+
+    D_ASSERT(g_nor_flash_device.var_p->jobs_head_p == NULL);
+#endif
+
     for (uint32_t i = 0; i < num_sectors; i ++) {
         error = nor_flash_erase_sector(sector_addr);
         if (error != 0) {
@@ -306,9 +825,55 @@ error_t nor_flash_write(uintptr_t dest_addr,
         sector_addr += NOR_FLASH_SECTOR_SIZE;
     }
 
-    /*
-     * Write data to NOR flash:
-     */
+    return 0;
+}
+
+
+/**
+ * Programs a data block in an already erased NOR flash area, without erasing
+ * it first. Since erased NOR flash bits are 1s, and programming can only
+ * change 1s to 0s, each programming unit of the area can be programmed only
+ * once between erases.
+ *
+ * When called from a task with interrupts enabled, for an area that can be
+ * written in the background (see nor_flash_job_start_program()), the calling
+ * task is
+ * blocked until the data block is programmed, but interrupts stay enabled
+ * and other tasks keep running. Otherwise, each command's completion is
+ * polled with interrupts disabled.
+ *
+ * On K64F, the part of the data block that is aligned to
+ * NOR_FLASH_SECTION_ALIGNMENT is programmed with program-section commands,
+ * through the programming acceleration buffer in FlexRAM, in chunks of up to
+ * NOR_FLASH_PROG_ACCEL_BUFFER_SIZE bytes. This takes one command (and one
+ * completion poll) per chunk, instead of per phrase. The rest is programmed
+ * with program-phrase commands, which is also the fallback if FlexRAM is not
+ * available as RAM (for example, if it is configured as EEPROM).
+ *
+ * @param dest_addr Destination address in NOR flash. It must be aligned to
+ *                  NOR_FLASH_PROGRAM_UNIT_SIZE.
+ * @param src_addr  Source address of the data block in RAM. It must be word
+ *                  (4 byte) aligned.
+ * @param src_size  Size of the data block in bytes. It must be a multiple of
+ *                  NOR_FLASH_PROGRAM_UNIT_SIZE.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t nor_flash_program(uintptr_t dest_addr,
+                          const void *src_addr,
+                          size_t src_size)
+{
+    error_t error;
+
+    D_ASSERT(dest_addr % NOR_FLASH_PROGRAM_UNIT_SIZE == 0);
+    D_ASSERT(VALID_RAM_POINTER(src_addr, sizeof(uint32_t)));
+    D_ASSERT(src_size != 0);
+
+    error = nor_flash_check_writable(dest_addr);
+    if (error != 0) {
+        return error;
+    }
 
 #if defined(KL25Z_MCU)
     uint32_t num_words = src_size / sizeof(uint32_t);
@@ -327,9 +892,28 @@ error_t nor_flash_write(uintptr_t dest_addr,
     }
 
 #elif defined(K64F_MCU)
-    error = nor_flash_program_section(dest_addr, src_addr, src_size);
-    if (error != 0) {
-        return error;
+    const uint32_t *src_word_p = src_addr;
+
+    if (CALLER_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED() &&
+        nor_flash_can_write_in_background(dest_addr)) {
+        return nor_flash_run_sync_job(NOR_FLASH_JOB_PROGRAM, dest_addr,
+                                      src_addr, src_size);
+    }
+
+    D_ASSERT(g_nor_flash_device.var_p->jobs_head_p == NULL);
+    while (src_size != 0) {
+        uint32_t chunk_size = nor_flash_load_program_chunk(dest_addr,
+                                                           src_word_p,
+                                                           src_size);
+
+        error = nor_flash_execute_command();
+        if (error != 0) {
+            return error;
+        }
+
+        dest_addr += chunk_size;
+        src_word_p += chunk_size / sizeof(uint32_t);
+        src_size -= chunk_size;
     }
 
 #else
@@ -338,3 +922,48 @@ error_t nor_flash_write(uintptr_t dest_addr,
 
     return 0;
 }
+
+
+/**
+ * Writes a data block to NOR flash, as nor_flash_write() does, from a fatal
+ * error handler or a fault handler, with CPU interrupts disabled. On K64F,
+ * the flash command in progress, if any, is allowed to complete, and the
+ * background jobs still queued are abandoned, as they will never complete.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t nor_flash_panic_write(uintptr_t dest_addr,
+                              const void *src_addr,
+                              size_t src_size)
+{
+    struct nor_flash_device_var *const nor_flash_var_p = g_nor_flash_device.var_p;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_DISABLED());
+    if (!nor_flash_var_p->initialized) {
+        return CAPTURE_ERROR("NOR flash not initialized", dest_addr, 0);
+    }
+
+#if defined(K64F_MCU)
+    uint32_t reg_value;
+    FTFE_Type *const nor_flash_mmio_p = g_nor_flash_device.mmio_p;
+
+    /*
+     * NOTE: Background jobs only write flash blocks that contain no code, so
+     * this loop can run from flash:
+     */
+    do {
+        reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FSTAT);
+    } while ((reg_value & FTFE_FSTAT_CCIF_MASK) == 0);
+
+    reg_value = READ_MMIO_REGISTER(&nor_flash_mmio_p->FCNFG);
+    reg_value &= ~FTFE_FCNFG_CCIE_MASK;
+    WRITE_MMIO_REGISTER(&nor_flash_mmio_p->FCNFG, reg_value);
+
+    nor_flash_var_p->jobs_head_p = NULL;
+    nor_flash_var_p->jobs_tail_p = NULL;
+    nor_flash_var_p->num_queued_jobs = 0;
+#endif
+
+    return nor_flash_write(dest_addr, src_addr, src_size);
+}
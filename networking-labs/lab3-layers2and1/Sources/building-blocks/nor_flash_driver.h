@@ -11,6 +11,7 @@
 #include "runtime_checks.h"
 #include "microcontroller.h"
 #include <stddef.h>
+#include <stdbool.h>
 
 /**
  * Sector size (in bytes) of the MCU's program flash memory
@@ -23,6 +24,18 @@
 #error "No Microcontroller defined"
 #endif
 
+/**
+ * Size (in bytes) of the smallest unit of NOR flash that can be programmed.
+ * A programming unit can only be programmed once between erases.
+ */
+#if defined(KL25Z_MCU)
+#define NOR_FLASH_PROGRAM_UNIT_SIZE    4
+#elif defined(K64F_MCU)
+#define NOR_FLASH_PROGRAM_UNIT_SIZE    8    /* phrase */
+#else
+#error "No Microcontroller defined"
+#endif
+
 /**
  * Address of last NOR flash sector
  */
@@ -30,9 +43,44 @@
 		(MCU_FLASH_BASE_ADDR + MCU_FLASH_SIZE - NOR_FLASH_SECTOR_SIZE)
 
 /**
- * Address of application configuration data in NOR flash
+ * Addresses of the two NOR flash sectors used by the key/value store
+ * (see nor_flash_kv_store.h)
  */
-#define NOR_FLASH_APP_CONFIG_ADDR	NOR_FLASH_LAST_SECTOR_ADDR
+#define NOR_FLASH_KV_STORE_SECTOR0_ADDR \
+		(NOR_FLASH_LAST_SECTOR_ADDR - NOR_FLASH_SECTOR_SIZE)
+
+#define NOR_FLASH_KV_STORE_SECTOR1_ADDR	NOR_FLASH_LAST_SECTOR_ADDR
+
+/**
+ * Address of a NOR flash sector reserved as scratch area for the NOR flash
+ * programming benchmark
+ */
+#define NOR_FLASH_SCRATCH_SECTOR_ADDR \
+		(NOR_FLASH_KV_STORE_SECTOR0_ADDR - NOR_FLASH_SECTOR_SIZE)
+
+/**
+ * Number of NOR flash sectors of the crash dump ring (see crash_dump.h)
+ */
+#define NOR_FLASH_CRASH_DUMP_NUM_SECTORS	2
+
+/**
+ * Address of the first NOR flash sector of the crash dump ring
+ */
+#define NOR_FLASH_CRASH_DUMP_AREA_ADDR \
+		(NOR_FLASH_SCRATCH_SECTOR_ADDR - \
+		 NOR_FLASH_CRASH_DUMP_NUM_SECTORS * NOR_FLASH_SECTOR_SIZE)
+
+/**
+ * NOR flash area where firmware images received over the network are staged
+ * (see ota_receiver.h): the second half of flash, up to the sectors reserved
+ * above. Firmware images must fit in the first half of flash, so that the
+ * staging area can be written while code runs from flash.
+ */
+#define NOR_FLASH_OTA_STAGING_AREA_ADDR \
+		(MCU_FLASH_BASE_ADDR + MCU_FLASH_SIZE / 2)
+
+#define NOR_FLASH_OTA_STAGING_AREA_SIZE \
+		(NOR_FLASH_CRASH_DUMP_AREA_ADDR - NOR_FLASH_OTA_STAGING_AREA_ADDR)
 
 
 void nor_flash_init(void);
@@ -41,4 +89,101 @@ error_t nor_flash_write(uintptr_t dest_addr,
                         const void *src_addr,
                         size_t src_size);
 
+error_t nor_flash_erase(uintptr_t dest_addr, size_t size);
+
+error_t nor_flash_program(uintptr_t dest_addr,
+                          const void *src_addr,
+                          size_t src_size);
+
+error_t nor_flash_panic_write(uintptr_t dest_addr,
+                              const void *src_addr,
+                              size_t src_size);
+
+#if defined(K64F_MCU)
+bool nor_flash_enable_program_section(bool enabled);
+
+/**
+ * Types of NOR flash background jobs
+ */
+enum nor_flash_job_types {
+    NOR_FLASH_JOB_ERASE,
+    NOR_FLASH_JOB_PROGRAM,
+};
+
+struct nor_flash_job;
+
+/**
+ * Signature of a NOR flash job completion callback. It is invoked from the
+ * NOR flash command-complete ISR.
+ */
+typedef void nor_flash_job_callback_t(struct nor_flash_job *job_p, void *arg);
+
+/**
+ * NOR flash background job: an erase or program operation done one flash
+ * command at a time from the command-complete ISR, while the CPU does other
+ * work
+ */
+struct nor_flash_job {
+#   define NOR_FLASH_JOB_SIGNATURE  GEN_SIGNATURE('F', 'J', 'O', 'B')
+    uint32_t signature;
+
+    enum nor_flash_job_types type;
+
+    /**
+     * Flag set when the job is complete
+     */
+    volatile bool done;
+
+    /**
+     * Outcome of the job (0 on success), valid once done is set
+     */
+    error_t error;
+
+    /**
+     * Remaining part of the job
+     */
+    uintptr_t dest_cursor;
+    const uint32_t *src_cursor_p;
+    size_t remaining_size;
+
+    /**
+     * Completion callback (optional)
+     */
+    nor_flash_job_callback_t *callback_p;
+    void *callback_arg;
+
+    /**
+     * Next job in the queue of background jobs
+     */
+    struct nor_flash_job *next_p;
+};
+
+void nor_flash_job_init(struct nor_flash_job *job_p);
+
+error_t nor_flash_job_start_erase(struct nor_flash_job *job_p,
+                                  uintptr_t dest_addr,
+                                  size_t size,
+                                  nor_flash_job_callback_t *callback_p,
+                                  void *callback_arg);
+
+error_t nor_flash_job_start_program(struct nor_flash_job *job_p,
+                                    uintptr_t dest_addr,
+                                    const void *src_addr,
+                                    size_t src_size,
+                                    nor_flash_job_callback_t *callback_p,
+                                    void *callback_arg);
+
+/**
+ * Tells if a job started with nor_flash_job_start_erase() or
+ * nor_flash_job_start_program() is complete
+ */
+static inline bool nor_flash_job_is_done(const struct nor_flash_job *job_p)
+{
+    return job_p->done;
+}
+
+void nor_flash_get_job_stats(uint32_t *jobs_count_p, uint32_t *failed_jobs_count_p,
+                             uint32_t *max_queued_jobs_p);
+#endif
+
 #endif /* SOURCES_BUILDING_BLOCKS_NOR_FLASH_DRIVER_H_ */
@@ -0,0 +1,553 @@
+/**
+ * @file nor_flash_kv_store.c
+ *
+ * NOR flash key/value store implementation
+ *
+ * @author German Rivera
+ */
+#include "nor_flash_kv_store.h"
+#include "runtime_checks.h"
+#include "runtime_log.h"
+#include <string.h>
+
+/**
+ * Header of a key/value store sector
+ */
+struct nor_flash_kv_sector_header {
+#   define NOR_FLASH_KV_SECTOR_SIGNATURE  GEN_SIGNATURE('K', 'V', 'S', 'H')
+    uint32_t signature;
+
+    /**
+     * Incremented on every compaction. The valid sector with the highest
+     * sequence number is the active sector.
+     */
+    uint32_t sequence_num;
+
+    /**
+     * mem_checksum() of the preceding fields
+     */
+    uint32_t checksum;
+
+    uint32_t reserved;
+};
+
+/**
+ * Offset of the first record in a key/value store sector
+ */
+#define NOR_FLASH_KV_LOG_START_OFFSET \
+        ROUND_UP(sizeof(struct nor_flash_kv_sector_header), \
+                 NOR_FLASH_PROGRAM_UNIT_SIZE)
+
+C_ASSERT(NOR_FLASH_KV_MAX_RECORD_SIZE % sizeof(uint32_t) == 0);
+C_ASSERT(NOR_FLASH_KV_LOG_START_OFFSET <= NOR_FLASH_KV_MAX_RECORD_SIZE);
+C_ASSERT(NOR_FLASH_SECTOR_SIZE <= UINT16_MAX);
+
+/**
+ * Key/value store used for the application's persistent state
+ */
+struct nor_flash_kv_store g_nor_flash_kv_store;
+
+
+static inline size_t kv_record_size(size_t value_size)
+{
+    return ROUND_UP(sizeof(struct nor_flash_kv_record_header) + value_size,
+                    NOR_FLASH_PROGRAM_UNIT_SIZE);
+}
+
+
+static inline const struct nor_flash_kv_record_header *
+kv_record_at(const struct nor_flash_kv_store *kv_store_p,
+             uint_fast8_t sector, uint32_t offset)
+{
+    return (const struct nor_flash_kv_record_header *)
+                (kv_store_p->sector_addrs[sector] + offset);
+}
+
+
+/**
+ * Calculates the CRC of a record, over the record header's fields that
+ * follow the crc field, and the record's value
+ */
+static inline uint32_t kv_record_crc(const struct nor_flash_kv_record_header *header_p)
+{
+    return mem_checksum(&header_p->key,
+                        sizeof(*header_p) -
+                            offsetof(struct nor_flash_kv_record_header, key) +
+                            header_p->value_size);
+}
+
+
+/**
+ * Checks if the header of a key/value store sector is valid
+ *
+ * @return true, if valid (its sequence number is returned in *sequence_num_p)
+ * @return false, otherwise
+ */
+static bool kv_sector_header_is_valid(uintptr_t sector_addr,
+                                      uint32_t *sequence_num_p)
+{
+    const struct nor_flash_kv_sector_header *header_p = (void *)sector_addr;
+
+    if (header_p->signature != NOR_FLASH_KV_SECTOR_SIGNATURE ||
+        header_p->checksum !=
+            mem_checksum(header_p,
+                         offsetof(struct nor_flash_kv_sector_header, checksum))) {
+        return false;
+    }
+
+    *sequence_num_p = header_p->sequence_num;
+    return true;
+}
+
+
+static struct nor_flash_kv_index_entry *
+kv_index_lookup(struct nor_flash_kv_store *kv_store_p, uint16_t key)
+{
+    for (uint_fast8_t i = 0; i < kv_store_p->num_keys; i ++) {
+        if (kv_store_p->index[i].key == key) {
+            return &kv_store_p->index[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Updates the RAM index of a key/value store for a new record of a key
+ *
+ * @return true, on success
+ * @return false, if the index is full
+ */
+static bool kv_index_update(struct nor_flash_kv_store *kv_store_p,
+                            uint16_t key,
+                            uint32_t record_offset,
+                            size_t value_size)
+{
+    struct nor_flash_kv_index_entry *entry_p = kv_index_lookup(kv_store_p, key);
+
+    if (value_size == 0) {
+        /*
+         * The key was deleted:
+         */
+        if (entry_p != NULL) {
+            kv_store_p->num_keys --;
+            *entry_p = kv_store_p->index[kv_store_p->num_keys];
+        }
+
+        return true;
+    }
+
+    if (entry_p == NULL) {
+        if (kv_store_p->num_keys == NOR_FLASH_KV_MAX_NUM_KEYS) {
+            return false;
+        }
+
+        entry_p = &kv_store_p->index[kv_store_p->num_keys];
+        entry_p->key = key;
+        kv_store_p->num_keys ++;
+    }
+
+    entry_p->record_offset = record_offset;
+    return true;
+}
+
+
+/**
+ * Scans the log of the active sector of a key/value store, to populate its
+ * RAM index and find where the next record is to be appended
+ *
+ * @return true, if the whole log is valid
+ * @return false, if a corrupted record was found (for example, a record
+ *         whose append was interrupted by a reset). In this case, the
+ *         records that precede the corrupted record are indexed, and the
+ *         active sector needs to be compacted before appending to it.
+ */
+static bool kv_scan_log(struct nor_flash_kv_store *kv_store_p)
+{
+    uint32_t offset = NOR_FLASH_KV_LOG_START_OFFSET;
+    bool log_valid = true;
+
+    kv_store_p->num_keys = 0;
+    while (offset + sizeof(struct nor_flash_kv_record_header) <= NOR_FLASH_SECTOR_SIZE) {
+        const struct nor_flash_kv_record_header *header_p =
+            kv_record_at(kv_store_p, kv_store_p->active_sector, offset);
+
+        if (header_p->crc == UINT32_MAX &&
+            header_p->key == NOR_FLASH_KV_ERASED_KEY &&
+            header_p->value_size == UINT16_MAX) {
+            /*
+             * Erased flash: end of the log
+             */
+            break;
+        }
+
+        if (header_p->key == NOR_FLASH_KV_ERASED_KEY ||
+            header_p->value_size > NOR_FLASH_KV_MAX_VALUE_SIZE ||
+            offset + kv_record_size(header_p->value_size) > NOR_FLASH_SECTOR_SIZE ||
+            header_p->crc != kv_record_crc(header_p) ||
+            !kv_index_update(kv_store_p, header_p->key, offset,
+                             header_p->value_size)) {
+            log_valid = false;
+            break;
+        }
+
+        offset += kv_record_size(header_p->value_size);
+    }
+
+    kv_store_p->write_offset = offset;
+    return log_valid;
+}
+
+
+/**
+ * Programs a record in a sector of a key/value store
+ *
+ * @param value_p   Pointer to the value. It can point to RAM or to flash.
+ */
+static error_t kv_program_record(struct nor_flash_kv_store *kv_store_p,
+                                 uint_fast8_t sector,
+                                 uint32_t offset,
+                                 uint16_t key,
+                                 const void *value_p,
+                                 size_t value_size)
+{
+    struct nor_flash_kv_record_header *header_p =
+        (struct nor_flash_kv_record_header *)kv_store_p->record_buffer;
+    size_t record_size = kv_record_size(value_size);
+
+    /*
+     * Padding is left as erased flash:
+     */
+    memset(kv_store_p->record_buffer, 0xff, record_size);
+    header_p->key = key;
+    header_p->value_size = value_size;
+    if (value_size != 0) {
+        memcpy(header_p + 1, value_p, value_size);
+    }
+
+    header_p->crc = kv_record_crc(header_p);
+
+    return nor_flash_program(kv_store_p->sector_addrs[sector] + offset,
+                             kv_store_p->record_buffer, record_size);
+}
+
+
+/**
+ * Programs the header of a key/value store sector, which makes the sector
+ * valid
+ */
+static error_t kv_program_sector_header(struct nor_flash_kv_store *kv_store_p,
+                                        uint_fast8_t sector,
+                                        uint32_t sequence_num)
+{
+    struct nor_flash_kv_sector_header *header_p =
+        (struct nor_flash_kv_sector_header *)kv_store_p->record_buffer;
+
+    memset(kv_store_p->record_buffer, 0xff, NOR_FLASH_KV_LOG_START_OFFSET);
+    header_p->signature = NOR_FLASH_KV_SECTOR_SIGNATURE;
+    header_p->sequence_num = sequence_num;
+    header_p->checksum =
+        mem_checksum(header_p, offsetof(struct nor_flash_kv_sector_header, checksum));
+
+    return nor_flash_program(kv_store_p->sector_addrs[sector],
+                             kv_store_p->record_buffer,
+                             NOR_FLASH_KV_LOG_START_OFFSET);
+}
+
+
+/**
+ * Copies the live records of a key/value store into its spare sector, and
+ * makes it the active sector. The spare sector's header is programmed last,
+ * so that if a reset happens before the compaction completes, the old active
+ * sector is still the active sector at boot.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t kv_compact(struct nor_flash_kv_store *kv_store_p)
+{
+    error_t error;
+    uint16_t new_record_offsets[NOR_FLASH_KV_MAX_NUM_KEYS];
+    uint_fast8_t spare_sector = kv_store_p->active_sector ^ 1;
+    uint32_t offset = NOR_FLASH_KV_LOG_START_OFFSET;
+
+    error = nor_flash_erase(kv_store_p->sector_addrs[spare_sector],
+                            NOR_FLASH_SECTOR_SIZE);
+    if (error != 0) {
+        return error;
+    }
+
+    for (uint_fast8_t i = 0; i < kv_store_p->num_keys; i ++) {
+        const struct nor_flash_kv_record_header *header_p =
+            kv_record_at(kv_store_p, kv_store_p->active_sector,
+                         kv_store_p->index[i].record_offset);
+
+        error = kv_program_record(kv_store_p, spare_sector, offset,
+                                  header_p->key, header_p + 1,
+                                  header_p->value_size);
+        if (error != 0) {
+            return error;
+        }
+
+        new_record_offsets[i] = offset;
+        offset += kv_record_size(header_p->value_size);
+    }
+
+    error = kv_program_sector_header(kv_store_p, spare_sector,
+                                     kv_store_p->sequence_num + 1);
+    if (error != 0) {
+        return error;
+    }
+
+    for (uint_fast8_t i = 0; i < kv_store_p->num_keys; i ++) {
+        kv_store_p->index[i].record_offset = new_record_offsets[i];
+    }
+
+    kv_store_p->active_sector = spare_sector;
+    kv_store_p->sequence_num ++;
+    kv_store_p->write_offset = offset;
+    kv_store_p->compactions_count ++;
+    return 0;
+}
+
+
+/**
+ * Initializes a key/value store from the contents of its NOR flash sectors.
+ * If neither sector is valid, the store is formatted as empty.
+ *
+ * NOTE: nor_flash_init() must have been called before.
+ *
+ * @param kv_store_p    Pointer to the key/value store
+ * @param sector0_addr  Address of the first NOR flash sector of the store
+ * @param sector1_addr  Address of the second NOR flash sector of the store
+ */
+void nor_flash_kv_store_init(struct nor_flash_kv_store *kv_store_p,
+                             uintptr_t sector0_addr,
+                             uintptr_t sector1_addr)
+{
+    error_t error = 0;
+    uint32_t sequence_nums[2];
+    bool sector_valid[2];
+
+    D_ASSERT(sector0_addr % NOR_FLASH_SECTOR_SIZE == 0);
+    D_ASSERT(sector1_addr % NOR_FLASH_SECTOR_SIZE == 0);
+    D_ASSERT(sector0_addr != sector1_addr);
+
+    kv_store_p->signature = NOR_FLASH_KV_STORE_SIGNATURE;
+    kv_store_p->usable = false;
+    kv_store_p->sector_addrs[0] = sector0_addr;
+    kv_store_p->sector_addrs[1] = sector1_addr;
+    kv_store_p->num_keys = 0;
+    kv_store_p->appends_count = 0;
+    kv_store_p->unchanged_updates_count = 0;
+    kv_store_p->compactions_count = 0;
+    rtos_mutex_init(&kv_store_p->mutex, "NOR flash KV store mutex");
+
+    for (uint_fast8_t i = 0; i < 2; i ++) {
+        sector_valid[i] = kv_sector_header_is_valid(kv_store_p->sector_addrs[i],
+                                                    &sequence_nums[i]);
+    }
+
+    if (!sector_valid[0] && !sector_valid[1]) {
+        /*
+         * Format the store:
+         */
+        kv_store_p->active_sector = 0;
+        kv_store_p->sequence_num = 1;
+        kv_store_p->write_offset = NOR_FLASH_KV_LOG_START_OFFSET;
+        error = nor_flash_erase(sector0_addr, NOR_FLASH_SECTOR_SIZE);
+        if (error == 0) {
+            error = kv_program_sector_header(kv_store_p, 0,
+                                             kv_store_p->sequence_num);
+        }
+    } else {
+        if (sector_valid[0] && sector_valid[1]) {
+            kv_store_p->active_sector =
+                (sequence_nums[1] > sequence_nums[0]) ? 1 : 0;
+        } else {
+            kv_store_p->active_sector = sector_valid[1] ? 1 : 0;
+        }
+
+        kv_store_p->sequence_num = sequence_nums[kv_store_p->active_sector];
+        if (!kv_scan_log(kv_store_p)) {
+            error = kv_compact(kv_store_p);
+        }
+    }
+
+    if (error != 0) {
+        ERROR_PRINTF("NOR flash key/value store could not be initialized "
+                     "(error %#x)\n", error);
+        return;
+    }
+
+    kv_store_p->usable = true;
+}
+
+
+/**
+ * Looks up the value of a key in a key/value store
+ *
+ * @param kv_store_p        Pointer to the key/value store
+ * @param key               Key to look up
+ * @param value_buf_p       Buffer where the value is to be copied
+ * @param value_buf_size    Size in bytes of value_buf_p. If the value is
+ *                          larger, only its first value_buf_size bytes are
+ *                          copied.
+ *
+ * @return size in bytes of the key's value, or 0 if the key was not found
+ */
+size_t nor_flash_kv_store_get(struct nor_flash_kv_store *kv_store_p,
+                              uint16_t key,
+                              void *value_buf_p,
+                              size_t value_buf_size)
+{
+    size_t value_size = 0;
+
+    D_ASSERT(kv_store_p->signature == NOR_FLASH_KV_STORE_SIGNATURE);
+
+    rtos_mutex_lock(&kv_store_p->mutex);
+
+    struct nor_flash_kv_index_entry *entry_p = kv_index_lookup(kv_store_p, key);
+
+    if (entry_p != NULL) {
+        const struct nor_flash_kv_record_header *header_p =
+            kv_record_at(kv_store_p, kv_store_p->active_sector,
+                         entry_p->record_offset);
+
+        value_size = header_p->value_size;
+        memcpy(value_buf_p, header_p + 1,
+               value_size < value_buf_size ? value_size : value_buf_size);
+    }
+
+    rtos_mutex_unlock(&kv_store_p->mutex);
+    return value_size;
+}
+
+
+/**
+ * Appends a record for a key to a key/value store, compacting the store
+ * first if the record does not fit in the active sector
+ */
+static error_t kv_append(struct nor_flash_kv_store *kv_store_p,
+                         uint16_t key,
+                         const void *value_p,
+                         size_t value_size)
+{
+    error_t error;
+    size_t record_size = kv_record_size(value_size);
+
+    D_ASSERT(rtos_mutex_is_mine(&kv_store_p->mutex));
+
+    if (!kv_store_p->usable) {
+        return CAPTURE_ERROR("NOR flash key/value store not usable", key, 0);
+    }
+
+    if (kv_store_p->write_offset + record_size > NOR_FLASH_SECTOR_SIZE) {
+        error = kv_compact(kv_store_p);
+        if (error != 0) {
+            return error;
+        }
+
+        if (kv_store_p->write_offset + record_size > NOR_FLASH_SECTOR_SIZE) {
+            return CAPTURE_ERROR("NOR flash key/value store full",
+                                 key, value_size);
+        }
+    }
+
+    error = kv_program_record(kv_store_p, kv_store_p->active_sector,
+                              kv_store_p->write_offset, key,
+                              value_p, value_size);
+    if (error != 0) {
+        /*
+         * The partially programmed record will be found to be corrupted on
+         * the next boot. Until then, stop appending to the store.
+         */
+        kv_store_p->usable = false;
+        return error;
+    }
+
+    (void)kv_index_update(kv_store_p, key, kv_store_p->write_offset, value_size);
+    kv_store_p->write_offset += record_size;
+    kv_store_p->appends_count ++;
+    return 0;
+}
+
+
+/**
+ * Sets the value of a key in a key/value store. If the key already has the
+ * given value, nothing is written to flash.
+ *
+ * @param kv_store_p    Pointer to the key/value store
+ * @param key           Key to set. It cannot be NOR_FLASH_KV_ERASED_KEY.
+ * @param value_p       Pointer to the value
+ * @param value_size    Size in bytes of the value. It must be between 1 and
+ *                      NOR_FLASH_KV_MAX_VALUE_SIZE.
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t nor_flash_kv_store_put(struct nor_flash_kv_store *kv_store_p,
+                               uint16_t key,
+                               const void *value_p,
+                               size_t value_size)
+{
+    error_t error = 0;
+
+    D_ASSERT(kv_store_p->signature == NOR_FLASH_KV_STORE_SIGNATURE);
+    D_ASSERT(key != NOR_FLASH_KV_ERASED_KEY);
+    D_ASSERT(value_size != 0 && value_size <= NOR_FLASH_KV_MAX_VALUE_SIZE);
+
+    rtos_mutex_lock(&kv_store_p->mutex);
+
+    struct nor_flash_kv_index_entry *entry_p = kv_index_lookup(kv_store_p, key);
+
+    if (entry_p != NULL) {
+        const struct nor_flash_kv_record_header *header_p =
+            kv_record_at(kv_store_p, kv_store_p->active_sector,
+                         entry_p->record_offset);
+
+        if (header_p->value_size == value_size &&
+            memcmp(header_p + 1, value_p, value_size) == 0) {
+            kv_store_p->unchanged_updates_count ++;
+            goto exit;
+        }
+    } else if (kv_store_p->num_keys == NOR_FLASH_KV_MAX_NUM_KEYS) {
+        error = CAPTURE_ERROR("Too many keys in NOR flash key/value store",
+                              key, kv_store_p->num_keys);
+        goto exit;
+    }
+
+    error = kv_append(kv_store_p, key, value_p, value_size);
+
+exit:
+    rtos_mutex_unlock(&kv_store_p->mutex);
+    return error;
+}
+
+
+/**
+ * Removes a key from a key/value store
+ *
+ * @param kv_store_p    Pointer to the key/value store
+ * @param key           Key to remove
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+error_t nor_flash_kv_store_delete(struct nor_flash_kv_store *kv_store_p,
+                                  uint16_t key)
+{
+    error_t error = 0;
+
+    D_ASSERT(kv_store_p->signature == NOR_FLASH_KV_STORE_SIGNATURE);
+
+    rtos_mutex_lock(&kv_store_p->mutex);
+
+    if (kv_index_lookup(kv_store_p, key) != NULL) {
+        error = kv_append(kv_store_p, key, NULL, 0);
+    }
+
+    rtos_mutex_unlock(&kv_store_p->mutex);
+    return error;
+}
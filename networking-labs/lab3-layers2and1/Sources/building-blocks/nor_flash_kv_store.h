@@ -0,0 +1,180 @@
+/**
+ * @file nor_flash_kv_store.h
+ *
+ * NOR flash key/value store interface
+ *
+ * The key/value store is a log of records kept in one of two NOR flash
+ * sectors (the active sector). Updating a key appends a record with the new
+ * value at the end of the log, so updates only program the flash words taken
+ * by the new record, without erasing anything. The last record of each key
+ * supersedes any earlier ones, and a RAM index tracks where the last record
+ * of each key is. When the log fills the active sector, the live records are
+ * compacted into the other sector (the spare sector), which then becomes the
+ * active sector. So, a sector is only erased once per compaction, instead of
+ * once per update.
+ *
+ * Each record carries a CRC covering its key and value. A sector header,
+ * written last during compaction, carries a sequence number that identifies
+ * the active sector at boot, so that a reset in the middle of an append or of
+ * a compaction never loses the previously committed values.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_NOR_FLASH_KV_STORE_H_
+#define SOURCES_BUILDING_BLOCKS_NOR_FLASH_KV_STORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "nor_flash_driver.h"
+#include "rtos_wrapper.h"
+#include "mem_utils.h"
+
+/**
+ * Maximum number of distinct keys in a key/value store
+ */
+#define NOR_FLASH_KV_MAX_NUM_KEYS   16
+
+/**
+ * Maximum size in bytes of a value in a key/value store
+ */
+#define NOR_FLASH_KV_MAX_VALUE_SIZE 128
+
+/**
+ * Header of a record in a key/value store's log. The record's value
+ * follows the header, padded to a multiple of NOR_FLASH_PROGRAM_UNIT_SIZE.
+ */
+struct nor_flash_kv_record_header {
+    /**
+     * mem_checksum() of the rest of the header and of the value
+     */
+    uint32_t crc;
+
+    /**
+     * Record's key. NOR_FLASH_KV_ERASED_KEY means that this is the end of
+     * the log.
+     */
+    uint16_t key;
+#   define NOR_FLASH_KV_ERASED_KEY  UINT16_C(0xffff)
+
+    /**
+     * Size in bytes of the value. 0 means that the key was deleted.
+     */
+    uint16_t value_size;
+};
+
+/**
+ * Size in bytes of the largest record of a key/value store
+ */
+#define NOR_FLASH_KV_MAX_RECORD_SIZE \
+        ROUND_UP(sizeof(struct nor_flash_kv_record_header) +                \
+                 NOR_FLASH_KV_MAX_VALUE_SIZE, NOR_FLASH_PROGRAM_UNIT_SIZE)
+
+/**
+ * Keys of the key/value store
+ */
+enum nor_flash_kv_keys {
+    NOR_FLASH_KV_KEY_APP_CONFIG = 0x0001,
+
+    /*
+     * Descriptor of the last verified firmware image staged by the OTA
+     * receiver (struct ota_image_descriptor)
+     */
+    NOR_FLASH_KV_KEY_OTA_IMAGE = 0x0002,
+
+    /*
+     * Cached DHCP lease of each local IPv4 end point:
+     * NOR_FLASH_KV_KEY_DHCP_LEASE + index of the end point
+     */
+    NOR_FLASH_KV_KEY_DHCP_LEASE = 0x0100,
+};
+
+/**
+ * NOR flash key/value store
+ */
+struct nor_flash_kv_store {
+#   define NOR_FLASH_KV_STORE_SIGNATURE  GEN_SIGNATURE('N', 'F', 'K', 'V')
+    uint32_t signature;
+
+    /**
+     * Flag indicating if the store could be initialized. If false, the
+     * store behaves as if it was empty and updates fail.
+     */
+    bool usable;
+
+    /**
+     * Addresses of the store's two NOR flash sectors
+     */
+    uintptr_t sector_addrs[2];
+
+    /**
+     * Index in sector_addrs[] of the active sector
+     */
+    uint8_t active_sector;
+
+    /**
+     * Sequence number in the header of the active sector
+     */
+    uint32_t sequence_num;
+
+    /**
+     * Offset in the active sector where the next record is to be appended
+     */
+    uint32_t write_offset;
+
+    /**
+     * RAM index of the last record of each live key
+     */
+    struct nor_flash_kv_index_entry {
+        uint16_t key;
+        uint16_t record_offset;
+    } index[NOR_FLASH_KV_MAX_NUM_KEYS];
+
+    uint8_t num_keys;
+
+    /**
+     * RAM staging buffer for records to be programmed
+     */
+    uint32_t record_buffer[NOR_FLASH_KV_MAX_RECORD_SIZE / sizeof(uint32_t)];
+
+    /**
+     * Mutex to serialize access to the store
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Number of records appended
+     */
+    uint32_t appends_count;
+
+    /**
+     * Number of updates skipped, because the value was not changed
+     */
+    uint32_t unchanged_updates_count;
+
+    /**
+     * Number of compactions into the spare sector
+     */
+    uint32_t compactions_count;
+};
+
+extern struct nor_flash_kv_store g_nor_flash_kv_store;
+
+void nor_flash_kv_store_init(struct nor_flash_kv_store *kv_store_p,
+                             uintptr_t sector0_addr,
+                             uintptr_t sector1_addr);
+
+size_t nor_flash_kv_store_get(struct nor_flash_kv_store *kv_store_p,
+                              uint16_t key,
+                              void *value_buf_p,
+                              size_t value_buf_size);
+
+error_t nor_flash_kv_store_put(struct nor_flash_kv_store *kv_store_p,
+                               uint16_t key,
+                               const void *value_p,
+                               size_t value_size);
+
+error_t nor_flash_kv_store_delete(struct nor_flash_kv_store *kv_store_p,
+                                  uint16_t key);
+
+#endif /* SOURCES_BUILDING_BLOCKS_NOR_FLASH_KV_STORE_H_ */
@@ -0,0 +1,673 @@
+/**
+ * @file ota_receiver.c
+ *
+ * Over-the-air (OTA) firmware update receiver implementation
+ *
+ * @author German Rivera
+ */
+#include "ota_receiver.h"
+#include "networking_layer4.h"
+#include "networking_layer2.h"
+#include "nor_flash_driver.h"
+#include "nor_flash_kv_store.h"
+#include "crc_32.h"
+#include "rtos_wrapper.h"
+#include "time_utils.h"
+#include "arm_cortex_m_defs.h"
+#include "mem_utils.h"
+#include <string.h>
+
+/**
+ * Number of entries of the OTA receiver ring, that is, maximum number of
+ * data messages whose payload can be programmed into flash, or waiting to
+ * be programmed, while more messages are received. Each entry holds an Rx
+ * packet lent by the UDP end point, so it must be less than the end point's
+ * maximum number of held Rx packets, to leave room for packets still queued.
+ */
+#define OTA_RECEIVER_RING_SIZE          4
+
+C_ASSERT(OTA_RECEIVER_RING_SIZE < NET_LAYER4_END_POINT_DEFAULT_MAX_HELD_RX_PACKETS);
+
+/**
+ * Maximum time in milliseconds without receiving any message from the
+ * sender, before a session in progress is aborted
+ */
+#define OTA_RECEIVER_SESSION_TIMEOUT_MS 5000
+
+/**
+ * States of an OTA receiver session
+ */
+enum ota_receiver_states {
+    OTA_RECEIVER_IDLE = 0,
+    OTA_RECEIVER_RECEIVING,
+    OTA_RECEIVER_VERIFIED,
+    OTA_RECEIVER_FAILED,
+};
+
+/**
+ * Entry of the OTA receiver ring
+ */
+struct ota_receiver_slot {
+    /**
+     * Received datagram, lent by the UDP end point until the payload has
+     * been programmed
+     */
+    struct net_udp_rx_datagram datagram;
+
+    /**
+     * Background job programming the datagram's payload
+     */
+    struct nor_flash_job job;
+};
+
+/**
+ * OTA receiver state
+ */
+struct ota_receiver {
+    bool initialized;
+
+    enum ota_receiver_states state;
+
+    /**
+     * Sender of the current session
+     */
+    struct ipv4_address sender_ip_addr;
+    uint16_t sender_port; /* big endian */
+
+    uint16_t session_id;
+
+    /**
+     * Size of the image being received
+     */
+    uint32_t image_size;
+
+    /**
+     * Image offset of the next data message expected
+     */
+    uint32_t next_offset;
+
+    /**
+     * Start time of the current session
+     */
+    uint64_t session_start_ns;
+
+    /**
+     * Ring of datagrams being programmed, in order of image offset. The
+     * jobs complete in that order, as the NOR flash driver runs background
+     * jobs in FIFO order.
+     */
+    struct ota_receiver_slot ring[OTA_RECEIVER_RING_SIZE];
+
+    /**
+     * Index in ring[] of the oldest entry in use
+     */
+    uint8_t ring_head;
+
+    /**
+     * Number of entries of ring[] in use
+     */
+    uint8_t ring_count;
+
+    /**
+     * Job to erase the part of the staging area needed for an image
+     */
+    struct nor_flash_job erase_job;
+
+    /**
+     * Semaphore signaled when a job of this receiver completes
+     */
+    struct rtos_semaphore job_semaphore;
+
+    struct ota_receiver_stats stats;
+
+    /**
+     * Mutex to serialize access to this structure
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Local UDP end point
+     */
+    struct net_layer4_end_point end_point;
+
+    /**
+     * Receiver task
+     */
+    struct rtos_task task;
+};
+
+static struct ota_receiver g_ota_receiver = {
+    .initialized = false,
+    .state = OTA_RECEIVER_IDLE,
+};
+
+
+/**
+ * Completion callback of the OTA receiver's NOR flash jobs. It is invoked
+ * from the NOR flash command-complete ISR.
+ */
+static void ota_receiver_job_callback(struct nor_flash_job *job_p, void *arg)
+{
+    struct ota_receiver *receiver_p = arg;
+
+    rtos_semaphore_signal(&receiver_p->job_semaphore);
+}
+
+
+/**
+ * Waits for a NOR flash job started by the OTA receiver to complete
+ *
+ * @return outcome of the job (0 on success)
+ */
+static error_t ota_receiver_wait_job(struct ota_receiver *receiver_p,
+                                     struct nor_flash_job *job_p)
+{
+    /*
+     * Each job signals the semaphore once, and jobs complete in the order
+     * they were started. So, the signal consumed here is job_p's, even if
+     * job_p was already done.
+     */
+    rtos_semaphore_wait(&receiver_p->job_semaphore);
+    D_ASSERT(nor_flash_job_is_done(job_p));
+    return job_p->error;
+}
+
+
+/**
+ * Terminates the current session, as failed
+ */
+static void ota_receiver_fail_session(struct ota_receiver *receiver_p)
+{
+    if (receiver_p->state == OTA_RECEIVER_RECEIVING) {
+        receiver_p->state = OTA_RECEIVER_FAILED;
+        receiver_p->stats.sessions_failed ++;
+    }
+}
+
+
+/**
+ * Waits for the programming of the oldest entry of the ring to complete,
+ * and returns its datagram to the UDP end point
+ */
+static void ota_receiver_retire_oldest_slot(struct ota_receiver *receiver_p)
+{
+    struct ota_receiver_slot *slot_p = &receiver_p->ring[receiver_p->ring_head];
+    error_t error;
+
+    D_ASSERT(receiver_p->ring_count != 0);
+    error = ota_receiver_wait_job(receiver_p, &slot_p->job);
+    if (error != 0) {
+        ota_receiver_fail_session(receiver_p);
+    }
+
+    net_layer4_udp_release_rx_datagram(&receiver_p->end_point, &slot_p->datagram);
+    receiver_p->ring_head = (receiver_p->ring_head + 1) % OTA_RECEIVER_RING_SIZE;
+    receiver_p->ring_count --;
+}
+
+
+/**
+ * Retires the entries of the ring whose programming has completed. If
+ * wait_all is true, it waits for all entries to complete.
+ */
+static void ota_receiver_retire_slots(struct ota_receiver *receiver_p,
+                                      bool wait_all)
+{
+    while (receiver_p->ring_count != 0) {
+        struct ota_receiver_slot *slot_p =
+            &receiver_p->ring[receiver_p->ring_head];
+
+        if (!wait_all && !nor_flash_job_is_done(&slot_p->job)) {
+            break;
+        }
+
+        ota_receiver_retire_oldest_slot(receiver_p);
+    }
+}
+
+
+/**
+ * Sends an acknowledgment for a received message. If no Tx packet is
+ * available, no acknowledgment is sent, and the sender will retransmit.
+ */
+static void ota_receiver_send_ack(struct ota_receiver *receiver_p,
+                                  const struct net_udp_rx_datagram *datagram_p,
+                                  uint16_t session_id,
+                                  enum ota_status_codes status)
+{
+    error_t error;
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(NET_PACKET_SMALL_DATA_BUFFER_SIZE, true);
+
+    if (tx_packet_p == NULL) {
+        receiver_p->stats.ack_send_failures ++;
+        return;
+    }
+
+    struct ota_message_header *header_p =
+        get_ipv4_udp_data_payload_area(tx_packet_p);
+
+    header_p->magic = hton32(OTA_MESSAGE_MAGIC);
+    header_p->version = OTA_MESSAGE_VERSION;
+    header_p->type = OTA_MSG_ACK;
+    header_p->session_id = hton16(session_id);
+    header_p->offset = hton32(receiver_p->next_offset);
+    header_p->arg = hton32(status);
+
+    error = net_layer4_send_udp_datagram_over_ipv4(&receiver_p->end_point,
+                                                   &datagram_p->source_ip_addr.ipv4,
+                                                   datagram_p->source_port,
+                                                   tx_packet_p,
+                                                   sizeof(*header_p));
+    if (error != 0) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+        receiver_p->stats.ack_send_failures ++;
+    }
+}
+
+
+/**
+ * Tells if a message belongs to the session in progress
+ */
+static bool ota_receiver_is_session_message(const struct ota_receiver *receiver_p,
+                                            const struct net_udp_rx_datagram *datagram_p,
+                                            uint16_t session_id)
+{
+    return receiver_p->state != OTA_RECEIVER_IDLE &&
+           session_id == receiver_p->session_id &&
+           datagram_p->source_ip_addr.ipv4.value == receiver_p->sender_ip_addr.value &&
+           datagram_p->source_port == receiver_p->sender_port;
+}
+
+
+/**
+ * Handles an OTA_MSG_START message: starts a new session, erasing the part
+ * of the staging area needed for the image. A retransmitted OTA_MSG_START
+ * for the session in progress is just acknowledged again.
+ */
+static enum ota_status_codes ota_receiver_handle_start(
+    struct ota_receiver *receiver_p,
+    const struct net_udp_rx_datagram *datagram_p,
+    uint16_t session_id,
+    uint32_t image_size)
+{
+    error_t error;
+
+    if (ota_receiver_is_session_message(receiver_p, datagram_p, session_id) &&
+        receiver_p->state == OTA_RECEIVER_RECEIVING) {
+        return OTA_STATUS_OK;
+    }
+
+    ota_receiver_fail_session(receiver_p);
+    ota_receiver_retire_slots(receiver_p, true);
+
+    receiver_p->state = OTA_RECEIVER_IDLE;
+    receiver_p->next_offset = 0;
+    if (image_size == 0) {
+        return OTA_STATUS_INVALID_REQUEST;
+    }
+
+    if (image_size > NOR_FLASH_OTA_STAGING_AREA_SIZE) {
+        return OTA_STATUS_IMAGE_TOO_LARGE;
+    }
+
+    receiver_p->session_id = session_id;
+    receiver_p->sender_ip_addr = datagram_p->source_ip_addr.ipv4;
+    receiver_p->sender_port = datagram_p->source_port;
+    receiver_p->image_size = image_size;
+    receiver_p->session_start_ns = get_monotonic_ns();
+    receiver_p->state = OTA_RECEIVER_RECEIVING;
+    receiver_p->stats.sessions_started ++;
+
+    error = nor_flash_job_start_erase(&receiver_p->erase_job,
+                                      NOR_FLASH_OTA_STAGING_AREA_ADDR,
+                                      image_size,
+                                      ota_receiver_job_callback,
+                                      receiver_p);
+    if (error == 0) {
+        error = ota_receiver_wait_job(receiver_p, &receiver_p->erase_job);
+    }
+
+    if (error != 0) {
+        ota_receiver_fail_session(receiver_p);
+        return OTA_STATUS_FLASH_ERROR;
+    }
+
+    return OTA_STATUS_OK;
+}
+
+
+/**
+ * Handles an OTA_MSG_DATA message: if it is the next one expected, starts
+ * programming its payload into flash and keeps its datagram in the ring
+ * until then.
+ *
+ * @return true, if the datagram was kept in the ring
+ * @return false, otherwise
+ */
+static bool ota_receiver_handle_data(struct ota_receiver *receiver_p,
+                                     struct ota_receiver_slot *slot_p,
+                                     uint16_t session_id,
+                                     uint32_t offset,
+                                     enum ota_status_codes *status_p)
+{
+    error_t error;
+    const struct ota_message_header *header_p = slot_p->datagram.payload_p;
+    const void *data_p = header_p + 1;
+    size_t data_length = slot_p->datagram.payload_length - sizeof(*header_p);
+
+    if (!ota_receiver_is_session_message(receiver_p, &slot_p->datagram, session_id) ||
+        receiver_p->state != OTA_RECEIVER_RECEIVING) {
+        *status_p = OTA_STATUS_NO_SESSION;
+        return false;
+    }
+
+    /*
+     * Go-back-N: data not at the next offset expected is dropped, and the
+     * acknowledgment tells the sender where to resume:
+     */
+    if (offset != receiver_p->next_offset) {
+        receiver_p->stats.out_of_order_datagrams ++;
+        *status_p = OTA_STATUS_OK;
+        return false;
+    }
+
+    /*
+     * The payload is programmed right from the Rx packet buffer, so it must
+     * be word aligned, as it is when the IP header has no options:
+     */
+    if (data_length == 0 || data_length % NOR_FLASH_PROGRAM_UNIT_SIZE != 0 ||
+        (uintptr_t)data_p % sizeof(uint32_t) != 0 ||
+        offset + data_length > ROUND_UP(receiver_p->image_size,
+                                        NOR_FLASH_PROGRAM_UNIT_SIZE)) {
+        ota_receiver_fail_session(receiver_p);
+        *status_p = OTA_STATUS_INVALID_REQUEST;
+        return false;
+    }
+
+    error = nor_flash_job_start_program(&slot_p->job,
+                                        NOR_FLASH_OTA_STAGING_AREA_ADDR + offset,
+                                        data_p,
+                                        data_length,
+                                        ota_receiver_job_callback,
+                                        receiver_p);
+    if (error != 0) {
+        ota_receiver_fail_session(receiver_p);
+        *status_p = OTA_STATUS_FLASH_ERROR;
+        return false;
+    }
+
+    receiver_p->next_offset += data_length;
+    receiver_p->stats.bytes_programmed += data_length;
+    *status_p = OTA_STATUS_OK;
+    return true;
+}
+
+
+/**
+ * Handles an OTA_MSG_END message: waits for the programming of the image
+ * to complete, and verifies the image read back from flash. If it is good,
+ * its descriptor is saved in the NOR flash key/value store.
+ */
+static enum ota_status_codes ota_receiver_handle_end(
+    struct ota_receiver *receiver_p,
+    const struct net_udp_rx_datagram *datagram_p,
+    uint16_t session_id,
+    uint32_t image_size,
+    uint32_t image_crc)
+{
+    error_t error;
+
+    if (!ota_receiver_is_session_message(receiver_p, datagram_p, session_id)) {
+        return OTA_STATUS_NO_SESSION;
+    }
+
+    if (receiver_p->state == OTA_RECEIVER_VERIFIED) {
+        return OTA_STATUS_OK;
+    }
+
+    ota_receiver_retire_slots(receiver_p, true);
+    if (receiver_p->state != OTA_RECEIVER_RECEIVING) {
+        return OTA_STATUS_FLASH_ERROR;
+    }
+
+    if (image_size != receiver_p->image_size ||
+        receiver_p->next_offset < receiver_p->image_size) {
+        ota_receiver_fail_session(receiver_p);
+        return OTA_STATUS_INVALID_REQUEST;
+    }
+
+    /*
+     * Verify what was actually programmed, feeding the CRC module from
+     * flash with DMA:
+     */
+    crc_32_accelerator_begin();
+    crc_32_accelerator_update_dma((void *)NOR_FLASH_OTA_STAGING_AREA_ADDR,
+                                  image_size);
+    if (crc_32_accelerator_final() != image_crc) {
+        ota_receiver_fail_session(receiver_p);
+        return OTA_STATUS_CRC_MISMATCH;
+    }
+
+    struct ota_image_descriptor image_descriptor = {
+        .image_addr = NOR_FLASH_OTA_STAGING_AREA_ADDR,
+        .image_size = image_size,
+        .image_crc = image_crc,
+        .session_id = session_id,
+    };
+
+    error = nor_flash_kv_store_put(&g_nor_flash_kv_store,
+                                   NOR_FLASH_KV_KEY_OTA_IMAGE,
+                                   &image_descriptor,
+                                   sizeof image_descriptor);
+    if (error != 0) {
+        ota_receiver_fail_session(receiver_p);
+        return OTA_STATUS_FLASH_ERROR;
+    }
+
+    receiver_p->state = OTA_RECEIVER_VERIFIED;
+    receiver_p->stats.images_verified ++;
+    receiver_p->stats.last_image_size = image_size;
+    receiver_p->stats.last_transfer_time_ms =
+        (get_monotonic_ns() - receiver_p->session_start_ns) / 1000000;
+    return OTA_STATUS_OK;
+}
+
+
+/**
+ * Processes a datagram received in the next free entry of the ring
+ */
+static void ota_receiver_process_datagram(struct ota_receiver *receiver_p,
+                                          struct ota_receiver_slot *slot_p)
+{
+    enum ota_status_codes status;
+    const struct ota_message_header *header_p = slot_p->datagram.payload_p;
+
+    if (slot_p->datagram.ip_version != 4 ||
+        slot_p->datagram.payload_length < sizeof(*header_p) ||
+        ntoh32(header_p->magic) != OTA_MESSAGE_MAGIC ||
+        header_p->version != OTA_MESSAGE_VERSION) {
+        receiver_p->stats.invalid_datagrams ++;
+        net_layer4_udp_release_rx_datagram(&receiver_p->end_point,
+                                           &slot_p->datagram);
+        return;
+    }
+
+    uint16_t session_id = ntoh16(header_p->session_id);
+    uint32_t offset = ntoh32(header_p->offset);
+    uint32_t arg = ntoh32(header_p->arg);
+
+    switch (header_p->type) {
+    case OTA_MSG_START:
+        status = ota_receiver_handle_start(receiver_p, &slot_p->datagram,
+                                           session_id, arg);
+        break;
+
+    case OTA_MSG_DATA:
+        if (ota_receiver_handle_data(receiver_p, slot_p, session_id, offset,
+                                     &status)) {
+            receiver_p->ring_count ++;
+            ota_receiver_send_ack(receiver_p, &slot_p->datagram, session_id,
+                                  status);
+            return;
+        }
+
+        break;
+
+    case OTA_MSG_END:
+        status = ota_receiver_handle_end(receiver_p, &slot_p->datagram,
+                                         session_id, offset, arg);
+        break;
+
+    default:
+        receiver_p->stats.invalid_datagrams ++;
+        status = OTA_STATUS_INVALID_REQUEST;
+    }
+
+    ota_receiver_send_ack(receiver_p, &slot_p->datagram, session_id, status);
+    net_layer4_udp_release_rx_datagram(&receiver_p->end_point, &slot_p->datagram);
+}
+
+
+/**
+ * OTA receiver task
+ */
+static void ota_receiver_task_func(void *arg)
+{
+    error_t error;
+    struct ota_receiver *receiver_p = arg;
+
+    D_ASSERT(receiver_p == &g_ota_receiver);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    /*
+     * This task accesses the receiver state all the time, so its MPU
+     * region is never restored:
+     */
+    rtos_thread_set_comp_region(receiver_p,
+                                sizeof *receiver_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    for ( ; ; ) {
+        uint32_t timeout_ms = 0;
+
+        rtos_mutex_lock(&receiver_p->mutex);
+        if (receiver_p->ring_count == OTA_RECEIVER_RING_SIZE) {
+            ota_receiver_retire_oldest_slot(receiver_p);
+        }
+
+        ota_receiver_retire_slots(receiver_p, false);
+        if (receiver_p->state == OTA_RECEIVER_RECEIVING) {
+            timeout_ms = OTA_RECEIVER_SESSION_TIMEOUT_MS;
+        }
+
+        rtos_mutex_unlock(&receiver_p->mutex);
+
+        struct ota_receiver_slot *slot_p =
+            &receiver_p->ring[(receiver_p->ring_head + receiver_p->ring_count) %
+                              OTA_RECEIVER_RING_SIZE];
+
+        error = net_layer4_udp_receive_zero_copy(&receiver_p->end_point,
+                                                 timeout_ms,
+                                                 &slot_p->datagram);
+
+        rtos_mutex_lock(&receiver_p->mutex);
+        if (error != 0) {
+            /*
+             * The sender went silent:
+             */
+            ota_receiver_fail_session(receiver_p);
+            ota_receiver_retire_slots(receiver_p, true);
+        } else {
+            ota_receiver_process_datagram(receiver_p, slot_p);
+        }
+
+        rtos_mutex_unlock(&receiver_p->mutex);
+    }
+}
+
+
+/**
+ * Starts the OTA receiver task, listening on OTA_RECEIVER_PORT
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t ota_receiver_start(void)
+{
+    struct ota_receiver *const receiver_p = &g_ota_receiver;
+    error_t error;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(!receiver_p->initialized);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(receiver_p,
+                                sizeof *receiver_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_init(&receiver_p->mutex, "OTA receiver mutex");
+    rtos_semaphore_init(&receiver_p->job_semaphore, "OTA receiver job semaphore", 0);
+    nor_flash_job_init(&receiver_p->erase_job);
+    for (uint_fast8_t i = 0; i < OTA_RECEIVER_RING_SIZE; i ++) {
+        nor_flash_job_init(&receiver_p->ring[i].job);
+    }
+
+    net_layer4_udp_end_point_init(&receiver_p->end_point);
+    error = net_layer4_udp_end_point_bind(&receiver_p->end_point,
+                                          hton16(OTA_RECEIVER_PORT));
+    if (error != 0) {
+        goto common_exit;
+    }
+
+    /*
+     * Keep firmware updates possible while the board is flooded:
+     */
+    error = net_layer2_add_rx_critical_udp_port(hton16(OTA_RECEIVER_PORT));
+    if (error != 0) {
+        goto common_exit;
+    }
+
+    receiver_p->initialized = true;
+    rtos_task_create(&receiver_p->task,
+                     "OTA receiver task",
+                     ota_receiver_task_func,
+                     receiver_p,
+                     RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Takes a snapshot of the OTA receiver statistics
+ *
+ * @param stats_p   Area where the snapshot is to be returned
+ */
+void ota_receiver_get_stats(struct ota_receiver_stats *stats_p)
+{
+    struct ota_receiver *const receiver_p = &g_ota_receiver;
+
+    if (!receiver_p->initialized) {
+        memset(stats_p, 0, sizeof *stats_p);
+        return;
+    }
+
+    rtos_mutex_lock(&receiver_p->mutex);
+    *stats_p = receiver_p->stats;
+    rtos_mutex_unlock(&receiver_p->mutex);
+}
@@ -0,0 +1,192 @@
+/**
+ * @file ota_receiver.h
+ *
+ * Over-the-air (OTA) firmware update receiver interface
+ *
+ * The OTA receiver is a background task that receives a firmware image in
+ * UDP datagrams and stages it in the NOR flash OTA staging area
+ * (NOR_FLASH_OTA_STAGING_AREA_ADDR). The payload of each datagram is
+ * programmed into flash right from the Rx packet buffer, with a background
+ * NOR flash job, while the following datagrams are being received, so that
+ * the transfer is limited by the flash programming speed, not by the network.
+ *
+ * The sender starts a session with an OTA_MSG_START message, which makes
+ * the receiver erase the part of the staging area needed for the image.
+ * Then it streams the image in OTA_MSG_DATA messages, with a window of
+ * unacknowledged messages in flight (go-back-N): the receiver only accepts
+ * data at the next expected offset, and every OTA_MSG_ACK message carries
+ * that offset. Finally, the sender sends an OTA_MSG_END message carrying the
+ * CRC of the image, and the receiver verifies the image read back from flash
+ * with the CRC hardware module. If the image is good, its descriptor
+ * (struct ota_image_descriptor) is saved in the NOR flash key/value store,
+ * for a bootloader to install it.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_OTA_RECEIVER_H_
+#define SOURCES_BUILDING_BLOCKS_OTA_RECEIVER_H_
+
+#include <stdint.h>
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+
+/**
+ * Local UDP port of the OTA receiver
+ */
+#define OTA_RECEIVER_PORT   8892
+
+/**
+ * Types of OTA messages
+ */
+enum ota_message_types {
+    /*
+     * Sender -> receiver: start a session. 'arg' is the image size.
+     */
+    OTA_MSG_START = 1,
+
+    /*
+     * Sender -> receiver: image data at 'offset', following the header.
+     * Its length must be a multiple of NOR_FLASH_PROGRAM_UNIT_SIZE, so the
+     * last chunk of the image must be padded with 0xff bytes.
+     */
+    OTA_MSG_DATA,
+
+    /*
+     * Sender -> receiver: end of the image. 'offset' is the image size and
+     * 'arg' is the CRC-32 of the image, as computed by
+     * crc_32_accelerator_run() (polynomial 0x04c11db7, reflected, seed
+     * 0xffffffff, no final XOR).
+     */
+    OTA_MSG_END,
+
+    /*
+     * Receiver -> sender: 'offset' is the next image offset expected and
+     * 'arg' is an OTA status (enum ota_status_codes)
+     */
+    OTA_MSG_ACK,
+};
+
+/**
+ * OTA status codes carried by OTA_MSG_ACK messages
+ */
+enum ota_status_codes {
+    OTA_STATUS_OK = 0,
+    OTA_STATUS_INVALID_REQUEST,
+    OTA_STATUS_NO_SESSION,
+    OTA_STATUS_IMAGE_TOO_LARGE,
+    OTA_STATUS_FLASH_ERROR,
+    OTA_STATUS_CRC_MISMATCH,
+};
+
+/**
+ * Header of an OTA message. All fields are big endian.
+ */
+struct ota_message_header {
+#   define OTA_MESSAGE_MAGIC  GEN_SIGNATURE('O', 'T', 'A', 'U')
+    uint32_t magic;
+
+#   define OTA_MESSAGE_VERSION  1
+    uint8_t version;
+
+    /**
+     * Message type (enum ota_message_types)
+     */
+    uint8_t type;
+
+    /**
+     * Session identifier chosen by the sender
+     */
+    uint16_t session_id;
+
+    /**
+     * Image offset (meaning depends on the message type)
+     */
+    uint32_t offset;
+
+    /**
+     * Message argument (meaning depends on the message type)
+     */
+    uint32_t arg;
+};
+
+C_ASSERT(sizeof(struct ota_message_header) == 16);
+
+/**
+ * Descriptor of a verified firmware image in the OTA staging area, saved
+ * in the NOR flash key/value store under NOR_FLASH_KV_KEY_OTA_IMAGE
+ */
+struct ota_image_descriptor {
+    /**
+     * Address of the image in NOR flash
+     */
+    uint32_t image_addr;
+
+    /**
+     * Image size in bytes
+     */
+    uint32_t image_size;
+
+    /**
+     * CRC-32 of the image
+     */
+    uint32_t image_crc;
+
+    /**
+     * Identifier of the session that staged the image
+     */
+    uint16_t session_id;
+};
+
+/**
+ * OTA receiver statistics
+ */
+struct ota_receiver_stats {
+    /**
+     * Number of sessions started
+     */
+    uint32_t sessions_started;
+
+    /**
+     * Number of images received and verified
+     */
+    uint32_t images_verified;
+
+    /**
+     * Number of sessions that failed or timed out
+     */
+    uint32_t sessions_failed;
+
+    /**
+     * Number of image bytes programmed into flash
+     */
+    uint32_t bytes_programmed;
+
+    /**
+     * Number of data messages received out of order (and dropped)
+     */
+    uint32_t out_of_order_datagrams;
+
+    /**
+     * Number of datagrams that were not valid OTA messages
+     */
+    uint32_t invalid_datagrams;
+
+    /**
+     * Number of acknowledgments not sent, because no Tx packet was
+     * available or the datagram could not be sent
+     */
+    uint32_t ack_send_failures;
+
+    /**
+     * Size and transfer time (from OTA_MSG_START to the end of the
+     * verification) of the last image verified
+     */
+    uint32_t last_image_size;
+    uint32_t last_transfer_time_ms;
+};
+
+error_t ota_receiver_start(void);
+
+void ota_receiver_get_stats(struct ota_receiver_stats *stats_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_OTA_RECEIVER_H_ */
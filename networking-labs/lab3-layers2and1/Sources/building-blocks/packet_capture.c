@@ -0,0 +1,245 @@
+/**
+ * @file packet_capture.c
+ *
+ * Packet capture implementation
+ *
+ * @author German Rivera
+ */
+#include "packet_capture.h"
+#include "network_packet.h"
+#include "networking_layer2_ethernet.h"
+#include "networking_layer3.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+#include "time_utils.h"
+#include "serial_console.h"
+#include <string.h>
+
+/**
+ * Packet capture state
+ */
+struct packet_capture {
+    /**
+     * Flag indicating if frames are to be captured
+     */
+    volatile bool enabled;
+
+    /**
+     * Capture filter
+     */
+    struct packet_capture_filter filter;
+
+    /**
+     * Number of frames captured so far. The next frame is captured in
+     * entry (next_index % PACKET_CAPTURE_NUM_RECORDS) of records[].
+     */
+    volatile uint32_t next_index;
+
+    /**
+     * Circular buffer of captured frames
+     */
+    struct packet_capture_record records[PACKET_CAPTURE_NUM_RECORDS];
+};
+
+static struct packet_capture g_packet_capture;
+
+
+/**
+ * Tells if a frame matches the capture filter. Only the bytes of the frame
+ * in the packet's data buffer are looked at.
+ *
+ * @param filter_p  capture filter
+ * @param frame_p   first byte of the frame (destination MAC address)
+ * @param length    number of bytes of the frame available at frame_p
+ */
+static bool packet_capture_filter_match(const struct packet_capture_filter *filter_p,
+                                        const uint8_t *frame_p,
+                                        size_t length)
+{
+    size_t offset = 2 * sizeof(struct ethernet_mac_address);
+    uint16_t ether_type;
+
+    if (filter_p->ether_type == 0 && filter_p->port == 0) {
+        return true;
+    }
+
+    if (length < offset + sizeof(uint16_t)) {
+        return false;
+    }
+
+    ether_type = ((uint16_t)frame_p[offset] << 8) | frame_p[offset + 1];
+    offset += sizeof(uint16_t);
+    if (ether_type == FRAME_TYPE_VLAN_TAGGED_FRAME) {
+        if (length < offset + sizeof(struct ethernet_vlan_tag)) {
+            return false;
+        }
+
+        ether_type = ((uint16_t)frame_p[offset + 2] << 8) | frame_p[offset + 3];
+        offset += sizeof(struct ethernet_vlan_tag);
+    }
+
+    if (filter_p->ether_type != 0 && ether_type != filter_p->ether_type) {
+        return false;
+    }
+
+    if (filter_p->port == 0) {
+        return true;
+    }
+
+    if (ether_type != FRAME_TYPE_IPv4_PACKET ||
+        length < offset + sizeof(struct ipv4_header)) {
+        return false;
+    }
+
+    const struct ipv4_header *ipv4_header_p =
+        (const struct ipv4_header *)(frame_p + offset);
+
+    if (ipv4_header_p->protocol_type != IP_PACKET_TYPE_UDP &&
+        ipv4_header_p->protocol_type != IP_PACKET_TYPE_TCP) {
+        return false;
+    }
+
+    /*
+     * TCP and UDP headers both start with the source and destination ports:
+     */
+    offset += GET_BIT_FIELD(ipv4_header_p->version_and_header_length,
+                            IP_HEADER_LENGTH_MASK,
+                            IP_HEADER_LENGTH_SHIFT) * sizeof(uint32_t);
+    if (length < offset + 2 * sizeof(uint16_t)) {
+        return false;
+    }
+
+    uint16_t source_port = ((uint16_t)frame_p[offset] << 8) | frame_p[offset + 1];
+    uint16_t dest_port = ((uint16_t)frame_p[offset + 2] << 8) | frame_p[offset + 3];
+
+    return source_port == filter_p->port || dest_port == filter_p->port;
+}
+
+
+/**
+ * Captures an Ethernet frame, if capture is enabled and the frame matches
+ * the capture filter. It is meant to be invoked through the
+ * PACKET_CAPTURE() macro. It does not disable interrupts: each caller
+ * atomically claims its own entry of the buffer.
+ *
+ * @param is_tx     true for a transmitted frame, false for a received one
+ * @param packet_p  network packet holding the frame. For frames transmitted
+ *                  with payload fragments, only the part of the frame in
+ *                  the packet's data buffer is captured.
+ * @param length    total length of the frame, including the alignment
+ *                  padding of the Ethernet header
+ */
+void packet_capture_frame(bool is_tx,
+                          const struct network_packet *packet_p,
+                          size_t length)
+{
+    struct packet_capture *const capture_p = &g_packet_capture;
+    const size_t padding = sizeof(((struct ethernet_header *)0)->alignment_padding);
+
+    if (!capture_p->enabled) {
+        return;
+    }
+
+    D_ASSERT(length >= packet_p->total_length &&
+             packet_p->total_length >= sizeof(struct ethernet_header));
+
+    const uint8_t *frame_p = packet_p->data_buffer + padding;
+    size_t available_length = packet_p->total_length - padding;
+
+    if (!packet_capture_filter_match(&capture_p->filter, frame_p,
+                                     available_length)) {
+        return;
+    }
+
+    uint32_t index = ATOMIC_POST_INCREMENT_UINT32(&capture_p->next_index);
+    struct packet_capture_record *record_p =
+        &capture_p->records[index & (PACKET_CAPTURE_NUM_RECORDS - 1)];
+
+    if (available_length > PACKET_CAPTURE_SNAP_LENGTH) {
+        available_length = PACKET_CAPTURE_SNAP_LENGTH;
+    }
+
+    record_p->timestamp_ns = get_monotonic_ns();
+    record_p->frame_length = length - padding;
+    record_p->captured_length = available_length;
+    record_p->is_tx = is_tx;
+    memcpy(record_p->data, frame_p, available_length);
+}
+
+
+/**
+ * Starts capturing frames, discarding the frames captured before
+ *
+ * @param filter_p  capture filter
+ */
+void packet_capture_start(const struct packet_capture_filter *filter_p)
+{
+    struct packet_capture *const capture_p = &g_packet_capture;
+
+    capture_p->enabled = false;
+    capture_p->filter = *filter_p;
+    capture_p->next_index = 0;
+    capture_p->enabled = true;
+}
+
+
+/**
+ * Stops capturing frames. The frames captured so far are kept, so that
+ * they can be dumped.
+ */
+void packet_capture_stop(void)
+{
+    g_packet_capture.enabled = false;
+}
+
+
+/**
+ * Dumps the capture buffer to the serial console, from the oldest frame to
+ * the newest one. Capture is paused while the dump is in progress.
+ *
+ * The dump format is:
+ *   PCAP BEGIN snaplen=<snap length> frames=<num frames> lost=<num lost frames>
+ *   FRAME <timestamp ns (hex)> <rx or tx> <frame length> <captured bytes (hex)>
+ *   ...
+ *   PCAP END
+ */
+void packet_capture_dump(void)
+{
+    struct packet_capture *const capture_p = &g_packet_capture;
+    bool was_enabled = capture_p->enabled;
+    uint32_t num_records;
+    uint32_t num_lost_records = 0;
+
+    capture_p->enabled = false;
+    uint32_t next_index = capture_p->next_index;
+
+    num_records = next_index;
+    if (num_records > PACKET_CAPTURE_NUM_RECORDS) {
+        num_lost_records = num_records - PACKET_CAPTURE_NUM_RECORDS;
+        num_records = PACKET_CAPTURE_NUM_RECORDS;
+    }
+
+    console_printf("PCAP BEGIN snaplen=%u frames=%u lost=%u\n",
+                   PACKET_CAPTURE_SNAP_LENGTH, num_records, num_lost_records);
+
+    for (uint32_t index = next_index - num_records; index != next_index;
+         index ++) {
+        const struct packet_capture_record *record_p =
+            &capture_p->records[index & (PACKET_CAPTURE_NUM_RECORDS - 1)];
+
+        console_printf("FRAME %x%08x %s %u ",
+                       (uint32_t)(record_p->timestamp_ns >> 32),
+                       (uint32_t)record_p->timestamp_ns,
+                       record_p->is_tx ? "tx" : "rx",
+                       record_p->frame_length);
+
+        for (uint_fast8_t i = 0; i < record_p->captured_length; i ++) {
+            console_printf("%02x", record_p->data[i]);
+        }
+
+        console_putchar('\n');
+    }
+
+    console_printf("PCAP END\n");
+    capture_p->enabled = was_enabled;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file packet_capture.h
+ *
+ * Packet capture interface
+ *
+ * The packet capture keeps the first PACKET_CAPTURE_SNAP_LENGTH bytes of the
+ * most recent Ethernet frames received and transmitted by layer 2 in a
+ * circular buffer in RAM, each one timestamped with get_monotonic_ns().
+ * A capture filter, by EtherType or by TCP/UDP port, bounds the overhead
+ * to the frames of interest. The dump produced by packet_capture_dump() can
+ * be converted to a pcap file, for Wireshark or tcpdump, with
+ * scripts/capture_to_pcap.pl.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_PACKET_CAPTURE_H_
+#define SOURCES_BUILDING_BLOCKS_PACKET_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "compile_time_checks.h"
+
+/**
+ * Set PACKET_CAPTURE_ON to 0 to compile out the capture points of layer 2
+ */
+#ifndef PACKET_CAPTURE_ON
+#define PACKET_CAPTURE_ON   1
+#endif
+
+/**
+ * Maximum number of bytes captured from each frame
+ */
+#define PACKET_CAPTURE_SNAP_LENGTH      96
+
+/**
+ * Number of entries of the capture buffer (must be a power of 2)
+ */
+#define PACKET_CAPTURE_NUM_RECORDS      64
+
+C_ASSERT((PACKET_CAPTURE_NUM_RECORDS & (PACKET_CAPTURE_NUM_RECORDS - 1)) == 0);
+
+struct network_packet;
+
+/**
+ * Capture filter. Only frames that match all the non-zero fields are
+ * captured.
+ */
+struct packet_capture_filter {
+    /**
+     * EtherType of the frame (looked up after the VLAN tag, if any), or 0
+     * for any
+     */
+    uint16_t ether_type;
+
+    /**
+     * Source or destination TCP or UDP port of an IPv4 packet, or 0 for
+     * any
+     */
+    uint16_t port;
+};
+
+/**
+ * Entry of the capture buffer
+ */
+struct packet_capture_record {
+    /**
+     * get_monotonic_ns() value when the frame was captured
+     */
+    uint64_t timestamp_ns;
+
+    /**
+     * Length of the frame on the wire, without the FCS
+     */
+    uint16_t frame_length;
+
+    /**
+     * Number of bytes of the frame in data[]
+     */
+    uint8_t captured_length;
+
+    /**
+     * true for transmitted frames, false for received frames
+     */
+    bool is_tx;
+
+    uint8_t data[PACKET_CAPTURE_SNAP_LENGTH];
+};
+
+#if PACKET_CAPTURE_ON
+
+/**
+ * Captures an Ethernet frame, if capture is enabled and the frame matches
+ * the capture filter
+ *
+ * @param _is_tx        true for a transmitted frame, false for a received one
+ * @param _packet_p     network packet holding the frame
+ * @param _length       total length of the frame, including the alignment
+ *                      padding of the Ethernet header
+ */
+#define PACKET_CAPTURE(_is_tx, _packet_p, _length) \
+        packet_capture_frame(_is_tx, _packet_p, _length)
+
+#else
+
+#define PACKET_CAPTURE(_is_tx, _packet_p, _length)  do { } while (0)
+
+#endif /* PACKET_CAPTURE_ON */
+
+void packet_capture_frame(bool is_tx,
+                          const struct network_packet *packet_p,
+                          size_t length);
+
+void packet_capture_start(const struct packet_capture_filter *filter_p);
+
+void packet_capture_stop(void);
+
+void packet_capture_dump(void);
+
+#endif /* SOURCES_BUILDING_BLOCKS_PACKET_CAPTURE_H_ */
@@ -0,0 +1,180 @@
+/**
+ * @file perf_probes.c
+ *
+ * Performance probes implementation
+ *
+ * @author German Rivera
+ */
+#include "perf_probes.h"
+#include "runtime_checks.h"
+#include "compile_time_checks.h"
+#include "atomic_utils.h"
+#include "mem_utils.h"
+#include "serial_console.h"
+#include <string.h>
+
+/**
+ * Names of the performance probes
+ */
+static const char *const g_perf_probe_names[] = {
+    [PERF_PROBE_ENET_RX_RING_DRAIN] = "ENET Rx ring drain",
+    [PERF_PROBE_LAYER2_RX_DISPATCH] = "Layer-2 Rx dispatch",
+    [PERF_PROBE_ARP_LOOKUP] = "ARP lookup",
+    [PERF_PROBE_UDP_DEMUX] = "UDP demux",
+    [PERF_PROBE_CONSOLE_OUTPUT] = "Console output",
+    [PERF_PROBE_RX_LATENCY_MAC_TO_LAYER2] = "Rx latency: MAC drain to layer 2 (Rx queue)",
+    [PERF_PROBE_RX_LATENCY_LAYER2_TO_LAYER3] = "Rx latency: layer 2 to layer 3",
+    [PERF_PROBE_RX_LATENCY_LAYER3_TO_UDP_QUEUE] = "Rx latency: layer 3 to UDP enqueue",
+    [PERF_PROBE_RX_LATENCY_UDP_QUEUE_TO_APP] = "Rx latency: UDP enqueue to app dequeue",
+    [PERF_PROBE_RX_LATENCY_MAC_TO_APP] = "Rx latency: MAC drain to app dequeue",
+};
+
+C_ASSERT(ARRAY_SIZE(g_perf_probe_names) == NUM_PERF_PROBES);
+
+/**
+ * Statistics of all the performance probes
+ */
+static struct perf_probe_stats g_perf_probes[NUM_PERF_PROBES];
+
+
+static void perf_probe_stats_reset(struct perf_probe_stats *stats_p)
+{
+    memset(stats_p, 0, sizeof *stats_p);
+    stats_p->min_cycles = UINT32_MAX;
+}
+
+
+/**
+ * Initializes the performance probes and starts the DWT cycle counter
+ */
+void perf_probes_init(void)
+{
+    init_dwt_cycles_counter();
+    perf_probes_reset();
+}
+
+
+/**
+ * Records the duration of a code path measured by a performance probe. It
+ * is meant to be invoked through the PERF_PROBE_END() macro. It can be
+ * called from any context, including interrupt handlers.
+ *
+ * @param probe         Performance probe
+ * @param begin_cycles  DWT cycle count at the beginning of the code path
+ */
+void perf_probe_record(enum perf_probes probe, uint32_t begin_cycles)
+{
+    perf_probe_record_cycles(probe, perf_probe_get_cycles() - begin_cycles);
+}
+
+
+/**
+ * Records a duration already measured by the caller in a performance
+ * probe. It can be called from any context, including interrupt handlers.
+ *
+ * @param probe     Performance probe
+ * @param cycles    Duration in DWT cycles
+ */
+void perf_probe_record_cycles(enum perf_probes probe, uint32_t cycles)
+{
+    uint_fast8_t bucket;
+    uint32_t int_mask;
+
+    D_ASSERT(probe < NUM_PERF_PROBES);
+
+    if (cycles == 0) {
+        bucket = 0;
+    } else {
+        bucket = 31 - __builtin_clz(cycles);
+        if (bucket >= PERF_PROBE_NUM_HISTOGRAM_BUCKETS) {
+            bucket = PERF_PROBE_NUM_HISTOGRAM_BUCKETS - 1;
+        }
+    }
+
+    struct perf_probe_stats *stats_p = &g_perf_probes[probe];
+
+    int_mask = disable_cpu_interrupts();
+    stats_p->count ++;
+    stats_p->total_cycles += cycles;
+    if (cycles < stats_p->min_cycles) {
+        stats_p->min_cycles = cycles;
+    }
+
+    if (cycles > stats_p->max_cycles) {
+        stats_p->max_cycles = cycles;
+    }
+
+    stats_p->histogram[bucket] ++;
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Takes a snapshot of the statistics of a performance probe
+ *
+ * @param probe     Performance probe
+ * @param stats_p   Area where the snapshot is to be returned
+ */
+void perf_probes_get_stats(enum perf_probes probe,
+                           struct perf_probe_stats *stats_p)
+{
+    uint32_t int_mask;
+
+    D_ASSERT(probe < NUM_PERF_PROBES);
+
+    int_mask = disable_cpu_interrupts();
+    *stats_p = g_perf_probes[probe];
+    restore_cpu_interrupts(int_mask);
+}
+
+
+/**
+ * Dumps the statistics of all the performance probes to the serial console
+ */
+void perf_probes_dump(void)
+{
+    struct perf_probe_stats stats;
+
+    console_printf("Performance probes (durations in CPU cycles):\n");
+    for (uint_fast8_t i = 0; i < NUM_PERF_PROBES; i ++) {
+        perf_probes_get_stats(i, &stats);
+        if (stats.count == 0) {
+            console_printf("%s: no samples\n", g_perf_probe_names[i]);
+            continue;
+        }
+
+        console_printf("%s: count %u, min %u, max %u, avg %u\n",
+                       g_perf_probe_names[i], stats.count, stats.min_cycles,
+                       stats.max_cycles,
+                       (uint32_t)(stats.total_cycles / stats.count));
+
+        for (uint_fast8_t j = 0; j < PERF_PROBE_NUM_HISTOGRAM_BUCKETS; j ++) {
+            if (stats.histogram[j] == 0) {
+                continue;
+            }
+
+            if (j == PERF_PROBE_NUM_HISTOGRAM_BUCKETS - 1) {
+                console_printf("\t>= %u: %u\n", UINT32_C(1) << j,
+                               stats.histogram[j]);
+            } else {
+                console_printf("\t[%u, %u): %u\n", UINT32_C(1) << j,
+                               UINT32_C(1) << (j + 1), stats.histogram[j]);
+            }
+        }
+    }
+}
+
+
+/**
+ * Resets the statistics of all the performance probes
+ */
+void perf_probes_reset(void)
+{
+    uint32_t int_mask;
+
+    for (uint_fast8_t i = 0; i < NUM_PERF_PROBES; i ++) {
+        int_mask = disable_cpu_interrupts();
+        perf_probe_stats_reset(&g_perf_probes[i]);
+        restore_cpu_interrupts(int_mask);
+    }
+}
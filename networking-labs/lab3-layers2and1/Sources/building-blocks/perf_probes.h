@@ -0,0 +1,119 @@
+/**
+ * @file perf_probes.h
+ *
+ * Performance probes interface
+ *
+ * A performance probe measures, in CPU cycles, the duration of a code path
+ * delimited by PERF_PROBE_BEGIN() and PERF_PROBE_END(), and accumulates
+ * min/max/average and a log2 histogram of the measured durations. Cycles are
+ * counted with the DWT cycle counter, which, unlike the SysTick-based
+ * get_cpu_clock_cycles(), does not wrap around every few milliseconds.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_PERF_PROBES_H_
+#define SOURCES_BUILDING_BLOCKS_PERF_PROBES_H_
+
+#include <stdint.h>
+#include "microcontroller.h"
+#include "time_utils.h"
+
+/**
+ * Set PERF_PROBES_ON to 0 to compile out all the performance probes
+ */
+#ifndef PERF_PROBES_ON
+#define PERF_PROBES_ON      1
+#endif
+
+/**
+ * Number of buckets of the histogram of a performance probe. Bucket i
+ * counts durations in the range [2^i, 2^(i+1)) cycles, except for the last
+ * bucket, which counts all the durations longer than that.
+ */
+#define PERF_PROBE_NUM_HISTOGRAM_BUCKETS    20
+
+/**
+ * Performance probes
+ */
+enum perf_probes {
+    PERF_PROBE_ENET_RX_RING_DRAIN = 0,
+    PERF_PROBE_LAYER2_RX_DISPATCH,
+    PERF_PROBE_ARP_LOOKUP,
+    PERF_PROBE_UDP_DEMUX,
+    PERF_PROBE_CONSOLE_OUTPUT,
+
+    /*
+     * Rx packet latency stages (see NET_RX_PACKET_LATENCY_STAGE()):
+     */
+    PERF_PROBE_RX_LATENCY_MAC_TO_LAYER2,
+    PERF_PROBE_RX_LATENCY_LAYER2_TO_LAYER3,
+    PERF_PROBE_RX_LATENCY_LAYER3_TO_UDP_QUEUE,
+    PERF_PROBE_RX_LATENCY_UDP_QUEUE_TO_APP,
+    PERF_PROBE_RX_LATENCY_MAC_TO_APP,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_PERF_PROBES
+};
+
+/**
+ * Statistics accumulated by a performance probe
+ */
+struct perf_probe_stats {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t histogram[PERF_PROBE_NUM_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Reads the DWT cycle counter
+ */
+#define perf_probe_get_cycles()     get_dwt_cycles()
+
+#if PERF_PROBES_ON
+
+/**
+ * Marks the beginning of the code path measured by a given probe. It
+ * declares a local variable, so it must be placed where a declaration is
+ * allowed, and only once per probe in the enclosing function.
+ *
+ * @param _probe    enum perf_probes value
+ */
+#define PERF_PROBE_BEGIN(_probe) \
+        uint32_t _perf_probe_begin_cycles_##_probe = perf_probe_get_cycles()
+
+/**
+ * Marks the end of the code path measured by a given probe. It can be
+ * placed in more than one exit path after a PERF_PROBE_BEGIN() for the
+ * same probe.
+ *
+ * @param _probe    enum perf_probes value
+ */
+#define PERF_PROBE_END(_probe) \
+        perf_probe_record(_probe, _perf_probe_begin_cycles_##_probe)
+
+#else
+
+#define PERF_PROBE_BEGIN(_probe)    do { } while (0)
+
+#define PERF_PROBE_END(_probe)      do { } while (0)
+
+#endif /* PERF_PROBES_ON */
+
+void perf_probes_init(void);
+
+void perf_probe_record(enum perf_probes probe, uint32_t begin_cycles);
+
+void perf_probe_record_cycles(enum perf_probes probe, uint32_t cycles);
+
+void perf_probes_get_stats(enum perf_probes probe,
+                           struct perf_probe_stats *stats_p);
+
+void perf_probes_dump(void);
+
+void perf_probes_reset(void);
+
+#endif /* SOURCES_BUILDING_BLOCKS_PERF_PROBES_H_ */
@@ -9,9 +9,47 @@
 #include "power_utils.h"
 #include "io_utils.h"
 #include "microcontroller.h"
+#include "atomic_utils.h"
+#include "runtime_checks.h"
+#include "time_utils.h"
+
+/**
+ * Exit latency of each CPU idle state in microseconds: time from the
+ * wakeup interrupt being raised to its ISR starting to run. Exiting Stop
+ * mode includes waiting for the PLL to relock.
+ */
+#define CPU_IDLE_WAIT_EXIT_LATENCY_US   UINT32_C(1)
+#define CPU_IDLE_STOP_EXIT_LATENCY_US   UINT32_C(200)
+
+/**
+ * Minimum time until the next RTOS tick, in microseconds, for entering
+ * CPU_IDLE_STATE_WAIT to be worth it
+ */
+#define CPU_IDLE_WAIT_MIN_RESIDENCY_US  UINT32_C(2)
 
 static volatile bool g_sleep_deep_enabled = false;
 
+/**
+ * CPU idle governor state
+ */
+static struct cpu_idle_governor {
+    /**
+     * Maximum wakeup latency that the governor can add to the handling of
+     * interrupts that arrive while the CPU is idle
+     */
+    volatile uint32_t wakeup_latency_budget_us;
+
+    /**
+     * Number of drivers currently vetoing CPU_IDLE_STATE_STOP, as their
+     * devices cannot run or wake up the CPU in Stop mode
+     */
+    volatile uint32_t deep_sleep_vetoes;
+
+    struct cpu_idle_stats stats;
+} g_cpu_idle_governor = {
+    .wakeup_latency_budget_us = CPU_IDLE_DEFAULT_WAKEUP_LATENCY_BUDGET_US,
+};
+
 /**
  * Stops the calling CPU core, putting it in deep sleep mode
  */
@@ -39,3 +77,147 @@ void enable_deep_sleep(void)
 {
 	g_sleep_deep_enabled = true;
 }
+
+
+/**
+ * Picks the deepest CPU idle state whose exit latency fits in the wakeup
+ * latency budget and that does not overrun the next timer deadline.
+ *
+ * The uC/OS-III tick is periodic, so every RTOS timer deadline falls on a
+ * tick, and the next deadline is at most the next SysTick interrupt. As the
+ * SysTick clock is gated in Stop mode, CPU_IDLE_STATE_STOP would overrun it,
+ * so it can only be picked after the application has declared, with
+ * enable_deep_sleep(), that the RTOS tick can be suspended while idle.
+ *
+ * @param time_to_deadline_us time left until the next RTOS tick
+ *
+ * @return selected idle state
+ */
+static enum cpu_idle_states cpu_idle_select_state(uint32_t time_to_deadline_us)
+{
+    struct cpu_idle_governor *const governor_p = &g_cpu_idle_governor;
+    uint32_t budget_us = governor_p->wakeup_latency_budget_us;
+
+    if (budget_us < CPU_IDLE_WAIT_EXIT_LATENCY_US ||
+        time_to_deadline_us < CPU_IDLE_WAIT_MIN_RESIDENCY_US) {
+        return CPU_IDLE_STATE_POLL;
+    }
+
+    if (!g_sleep_deep_enabled || budget_us < CPU_IDLE_STOP_EXIT_LATENCY_US) {
+        return CPU_IDLE_STATE_WAIT;
+    }
+
+    if (governor_p->deep_sleep_vetoes != 0) {
+        governor_p->stats.stop_vetoed_count ++;
+        return CPU_IDLE_STATE_WAIT;
+    }
+
+    return CPU_IDLE_STATE_STOP;
+}
+
+
+/**
+ * CPU idle governor. It is to be called from the RTOS idle task, every time
+ * around its loop, with interrupts enabled. It puts the CPU in the idle state
+ * picked by cpu_idle_select_state(), until the next interrupt.
+ *
+ * NOTE: Interrupts are masked with PRIMASK while going to sleep, so that no
+ * interrupt can slip in between picking the idle state and executing WFI.
+ * A pending interrupt still wakes up the CPU, and it runs as soon as PRIMASK
+ * is cleared. The raw intrinsics are used instead of disable_cpu_interrupts(),
+ * so that the time spent sleeping does not count as interrupts-disabled time.
+ */
+void cpu_idle_governor_run(void)
+{
+    struct cpu_idle_governor *const governor_p = &g_cpu_idle_governor;
+    uint32_t reg_value;
+
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+    __disable_irq();
+
+    uint32_t time_to_deadline_us = SysTick->VAL / MCU_CPU_CLOCK_FREQ_IN_MHZ;
+    enum cpu_idle_states idle_state = cpu_idle_select_state(time_to_deadline_us);
+
+    governor_p->stats.entries[idle_state] ++;
+    if (idle_state == CPU_IDLE_STATE_POLL) {
+        __enable_irq();
+        return;
+    }
+
+    reg_value = READ_MMIO_REGISTER(&SCB->SCR);
+    if (idle_state == CPU_IDLE_STATE_STOP) {
+        /*
+         * Select normal Stop mode in the SMC, and read the register back, to
+         * make sure that the write has completed before executing WFI:
+         */
+        uint8_t pmctrl_value = READ_MMIO_REGISTER(&SMC_PMCTRL);
+
+        pmctrl_value &= ~SMC_PMCTRL_STOPM_MASK;
+        WRITE_MMIO_REGISTER(&SMC_PMCTRL, pmctrl_value);
+        (void)READ_MMIO_REGISTER(&SMC_PMCTRL);
+        reg_value |= SCB_SCR_SLEEPDEEP_Msk;
+    } else {
+        reg_value &= ~SCB_SCR_SLEEPDEEP_Msk;
+    }
+
+    WRITE_MMIO_REGISTER(&SCB->SCR, reg_value);
+
+    /*
+     * Interrupts are still masked, so the wakeup interrupt's ISR does not
+     * run until after the cycle counter is read back:
+     */
+    uint32_t start_cycles = get_dwt_cycles();
+
+    __DSB();
+    __WFI();
+    __ISB();
+    governor_p->stats.sleep_cycles += (uint32_t)(get_dwt_cycles() - start_cycles);
+    __enable_irq();
+}
+
+
+/**
+ * Sets the maximum wakeup latency that the CPU idle governor can add to the
+ * handling of interrupts that arrive while the CPU is idle. A budget of 0
+ * keeps the CPU always running.
+ *
+ * @param budget_us wakeup latency budget in microseconds
+ */
+void cpu_idle_set_wakeup_latency_budget_us(uint32_t budget_us)
+{
+    g_cpu_idle_governor.wakeup_latency_budget_us = budget_us;
+}
+
+
+uint32_t cpu_idle_get_wakeup_latency_budget_us(void)
+{
+    return g_cpu_idle_governor.wakeup_latency_budget_us;
+}
+
+
+/**
+ * Prevents the CPU idle governor from picking CPU_IDLE_STATE_STOP, until a
+ * matching call to cpu_idle_deep_sleep_veto_release(). It is to be called by
+ * drivers of devices that cannot run or wake up the CPU in Stop mode, while
+ * the device is active. Vetoes nest.
+ */
+void cpu_idle_deep_sleep_veto_acquire(void)
+{
+    (void)atomic_fetch_add_uint32(&g_cpu_idle_governor.deep_sleep_vetoes, 1);
+}
+
+
+void cpu_idle_deep_sleep_veto_release(void)
+{
+    D_ASSERT(g_cpu_idle_governor.deep_sleep_vetoes != 0);
+    (void)atomic_fetch_sub_uint32(&g_cpu_idle_governor.deep_sleep_vetoes, 1);
+}
+
+
+void cpu_idle_get_stats(struct cpu_idle_stats *stats_p)
+{
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    *stats_p = g_cpu_idle_governor.stats;
+    restore_cpu_interrupts(old_primask);
+}
@@ -8,8 +8,81 @@
 #ifndef SOURCES_BUILDING_BLOCKS_POWER_UTILS_H_
 #define SOURCES_BUILDING_BLOCKS_POWER_UTILS_H_
 
+#include <stdint.h>
+
+/**
+ * Default wakeup latency budget of the CPU idle governor in microseconds.
+ * It is below the exit latency of CPU_IDLE_STATE_STOP, so that, by default,
+ * the idle governor does not add latency to the handling of interrupts.
+ */
+#define CPU_IDLE_DEFAULT_WAKEUP_LATENCY_BUDGET_US   UINT32_C(50)
+
+/**
+ * Idle states that the CPU idle governor can pick from, from shallowest to
+ * deepest
+ */
+enum cpu_idle_states {
+    /*
+     * Do not sleep, just return to the RTOS idle loop
+     */
+    CPU_IDLE_STATE_POLL = 0,
+
+    /*
+     * WFI in Wait mode: only the core clock is gated. All peripherals,
+     * including SysTick, ENET and the UARTs, keep running and can wake
+     * up the CPU.
+     */
+    CPU_IDLE_STATE_WAIT,
+
+    /*
+     * WFI in (normal) Stop mode: the core, system and bus clocks are gated,
+     * including SysTick's.
+     */
+    CPU_IDLE_STATE_STOP,
+
+    NUM_CPU_IDLE_STATES
+};
+
+/**
+ * CPU idle governor statistics
+ */
+struct cpu_idle_stats {
+    /**
+     * Number of times each idle state was entered
+     */
+    uint32_t entries[NUM_CPU_IDLE_STATES];
+
+    /**
+     * Number of times CPU_IDLE_STATE_STOP could not be entered, because
+     * some driver vetoed it
+     */
+    uint32_t stop_vetoed_count;
+
+    /**
+     * CPU cycles spent halted in WFI, as measured by the DWT cycle counter,
+     * from executing WFI until the wakeup interrupt is about to be taken
+     * (ISR time is not included). The cycle counter keeps running in Wait
+     * mode, but it is stopped with the core clock in Stop mode, so time
+     * spent in CPU_IDLE_STATE_STOP is not counted here (nor is it counted
+     * by get_monotonic_cycles()).
+     */
+    uint64_t sleep_cycles;
+};
+
 void stop_cpu(void);
 
 void enable_deep_sleep(void);
 
+void cpu_idle_governor_run(void);
+
+void cpu_idle_set_wakeup_latency_budget_us(uint32_t budget_us);
+
+uint32_t cpu_idle_get_wakeup_latency_budget_us(void);
+
+void cpu_idle_deep_sleep_veto_acquire(void);
+
+void cpu_idle_deep_sleep_veto_release(void);
+
+void cpu_idle_get_stats(struct cpu_idle_stats *stats_p);
+
 #endif /* SOURCES_BUILDING_BLOCKS_POWER_UTILS_H_ */
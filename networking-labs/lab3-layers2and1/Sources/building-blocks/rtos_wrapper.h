@@ -16,6 +16,15 @@
 #include "compile_time_checks.h"
 #include "runtime_checks.h"
 #include "mem_utils.h"
+#include "time_utils.h"
+#include "trace_recorder.h"
+#include "hr_timer.h"
+
+/**
+ * RTOS backend this wrapper is built for. Code shared by labs that run on
+ * different RTOSes can test this at compile time.
+ */
+#define RTOS_BACKEND_UCOS_III   1
 
 /**
  * For uCOS-III, application task priorities must be in the range
@@ -31,6 +40,15 @@ C_ASSERT(HIGHEST_APP_TASK_PRIORITY < LOWEST_APP_TASK_PRIORITY);
  */
 #define APP_TASK_STACK_SIZE UINT32_C(256)
 
+/**
+ * Size in bytes of the guard area right below each application task's
+ * stack. It must be a power of 2, as it is the address range covered by
+ * one DWT watchpoint comparator.
+ */
+#define RTOS_TASK_STACK_GUARD_SIZE  UINT32_C(32)
+
+C_ASSERT((RTOS_TASK_STACK_GUARD_SIZE & (RTOS_TASK_STACK_GUARD_SIZE - 1)) == 0);
+
 /**
  * Number of milliseconds per RTOS timer tick
  */
@@ -48,6 +66,37 @@ C_ASSERT(1000 % OS_CFG_TMR_TASK_RATE_HZ == 0);
 #define MILLISECONDS_TO_TICKS(_milli_secs) \
         ((uint32_t)HOW_MANY(_milli_secs, MS_PER_TIMER_TICK))
 
+/**
+ * Frequency of the RTOS tick interrupt (ticks per second)
+ */
+#define RTOS_TICK_RATE_HZ   OS_CFG_TICK_RATE_HZ
+
+/**
+ * Convert a number of RTOS tick interrupt ticks (as returned by
+ * rtos_get_ticks_since_boot()) to milliseconds
+ */
+#define RTOS_TICKS_TO_MILLISECONDS(_ticks) \
+        ((uint32_t)(((uint64_t)(_ticks) * 1000) / RTOS_TICK_RATE_HZ))
+
+/**
+ * Task priority arithmetic that does not depend on the RTOS's priority
+ * ordering. For uCOS-III, lower number means higher priority:
+ * - RTOS_TASK_PRIORITY_LOWER(): priority _levels below _prio
+ * - RTOS_TASK_PRIORITY_HIGHER(): priority _levels above _prio
+ * - RTOS_TASK_PRIORITY_IS_AT_LEAST(): _prio is the same as or higher
+ *   than _ref_prio
+ * - RTOS_TASK_PRIORITY_IS_AT_MOST(): _prio is the same as or lower than
+ *   _ref_prio
+ */
+#define RTOS_TASK_PRIORITY_LOWER(_prio, _levels)    ((_prio) + (_levels))
+#define RTOS_TASK_PRIORITY_HIGHER(_prio, _levels)   ((_prio) - (_levels))
+#define RTOS_TASK_PRIORITY_IS_AT_LEAST(_prio, _ref_prio) \
+        ((_prio) <= (_ref_prio))
+#define RTOS_TASK_PRIORITY_IS_AT_MOST(_prio, _ref_prio) \
+        ((_prio) >= (_ref_prio))
+
+struct mem_arena;
+
 /**
  * Wrapper for an RTOS task object
  */
@@ -71,7 +120,19 @@ struct rtos_task
      */
     volatile bool tsk_created;
 
-    uint32_t    tsk_stack_overflow_marker;
+    /**
+     * Order in which the task was created (0 for the first task created)
+     */
+    uint8_t tsk_index;
+
+    /**
+     * Guard area right below the task's stack, filled with
+     * STACK_OVERFLOW_MARKER. While the task runs, a DWT write watchpoint
+     * covers it, so that a stack overflow traps on the first write past the
+     * end of the stack (see rtos_task_switch_hook()).
+     */
+    uint32_t    tsk_stack_guard[RTOS_TASK_STACK_GUARD_SIZE / sizeof(uint32_t)]
+                    __attribute__ ((aligned(RTOS_TASK_STACK_GUARD_SIZE)));
 
     /**
      * Task's stack
@@ -84,6 +145,123 @@ struct rtos_task
      * Maximum number of stack entries used (high water mark)
      */
     uint32_t tsk_max_stack_entries_used;
+
+    /**
+     * DWT cycles the task has spent running (updated at context switches)
+     */
+    uint64_t tsk_cpu_cycles;
+
+    /**
+     * Scratch memory arena of the task, for temporary buffers, or NULL if
+     * the task has none (see rtos_task_set_scratch_arena())
+     */
+    struct mem_arena *tsk_scratch_arena_p;
+
+    /**
+     * Semaphore on which the task blocks in rtos_task_sleep(). It is separate
+     * from the task's built-in semaphore, which backs rtos_signals, so that a
+     * sleep does not consume signals meant for the task.
+     */
+    OS_SEM      tsk_sleep_semaphore;
+};
+
+/**
+ * Maximum number of RTOS tasks whose CPU utilization is tracked
+ */
+#define RTOS_MAX_NUM_TASKS      32
+
+/**
+ * CPU utilization statistics of a task, as returned by
+ * rtos_get_task_cpu_stats(). Pseudo-entries with a NULL task_p account
+ * for the RTOS idle task and for the RTOS internal tasks.
+ */
+struct rtos_task_cpu_stats {
+    const char *name_p;
+    struct rtos_task *task_p;
+
+    /**
+     * DWT cycles the task has spent running since the last reset. It
+     * includes the time spent in ISRs that interrupted the task.
+     */
+    uint64_t cpu_cycles;
+
+    /**
+     * DWT cycles accounted to all the tasks since the last reset
+     */
+    uint64_t total_cpu_cycles;
+};
+
+/**
+ * Duration statistics of the ISR of an IRQ, collected by rtos_enter_isr()
+ * and rtos_exit_isr()
+ */
+struct rtos_isr_stats {
+    const char *name_p;
+    IRQn_Type irq;
+
+    /**
+     * Number of ISR invocations
+     */
+    uint32_t count;
+
+    /**
+     * Longest ISR duration in CPU cycles
+     */
+    uint32_t max_cycles;
+
+    /**
+     * Distribution of ISR durations
+     */
+    struct cycles_histogram histogram;
+
+    /**
+     * CPU cycles timestamp of the entry to the ISR in progress
+     */
+    uint32_t start_cycles;
+};
+
+/**
+ * Set RTOS_MUTEX_STATS_ON to 0 to compile out the mutex contention
+ * statistics collected by rtos_mutex_lock() and rtos_mutex_unlock()
+ */
+#ifndef RTOS_MUTEX_STATS_ON
+#define RTOS_MUTEX_STATS_ON     1
+#endif
+
+/**
+ * Contention statistics of an RTOS mutex. Wait and hold times are measured
+ * in DWT cycles.
+ */
+struct rtos_mutex_stats {
+    const char *name_p;
+
+    /**
+     * Number of times the mutex has been acquired
+     */
+    uint32_t acquisitions;
+
+    /**
+     * Number of acquisitions that found the mutex owned by another task
+     */
+    uint32_t contended;
+
+    /**
+     * Number of contended acquisitions in which the owner had a lower
+     * priority than the waiter, so it was boosted by priority inheritance
+     */
+    uint32_t priority_inversions;
+
+    /**
+     * Total and longest time spent waiting in contended acquisitions
+     */
+    uint64_t total_wait_cycles;
+    uint32_t max_wait_cycles;
+
+    /**
+     * Longest time the mutex has been held, and the task that held it
+     */
+    uint32_t max_hold_cycles;
+    const char *max_holder_name_p;
 };
 
 /**
@@ -95,6 +273,20 @@ struct rtos_mutex
     uint32_t    mtx_signature;
 
     OS_MUTEX    mtx_os_mutex;
+
+#if RTOS_MUTEX_STATS_ON
+    struct rtos_mutex_stats mtx_stats;
+
+    /**
+     * DWT cycles timestamp of the acquisition by the current owner
+     */
+    uint32_t mtx_acquired_cycles;
+
+    /**
+     * Next mutex in the list of all mutexes (see rtos_get_mutex_stats())
+     */
+    struct rtos_mutex *mtx_next_p;
+#endif
 };
 
 /**
@@ -108,8 +300,52 @@ struct rtos_semaphore
     OS_SEM      sem_os_semaphore;
 };
 
+/**
+ * Wrapper for a single-waiter signal. It is a cheaper alternative to an
+ * rtos_semaphore, for the case where only one known task ever waits on it,
+ * as it is backed by the waiter task's built-in semaphore (see
+ * rtos_task_semaphore_wait()). Signals are counted, as for a counting
+ * semaphore.
+ *
+ * NOTE: Since a task has only one built-in semaphore, a task must not wait
+ * on more than one rtos_signal, and must not be passed to
+ * rtos_task_semaphore_signal().
+ */
+struct rtos_signal
+{
+#   define      SIGNAL_SIGNATURE  GEN_SIGNATURE('S', 'I', 'G', 'N')
+    uint32_t    sig_signature;
+
+    /**
+     * Task that waits on the signal, or NULL, if it is not known yet, in
+     * which case it is the first task that calls rtos_signal_wait().
+     */
+    struct rtos_task *volatile sig_waiter_task_p;
+
+    /**
+     * Number of times the signal was signaled before the waiter task was
+     * known
+     */
+    volatile uint32_t sig_early_count;
+};
+
+struct rtos_timer;
+
+/**
+ * Signature of a timer callback function
+ */
+typedef void rtos_timer_callback_t(struct rtos_timer *rtos_timer_p, void *arg);
+
 /**
  * Wrapper for an RTOS timer object
+ *
+ * Timers initialized with rtos_timer_init() are RTOS timers: their callbacks
+ * run in the RTOS timer task, with MS_PER_TIMER_TICK resolution. Timers
+ * initialized with rtos_timer_init_isr_context() are backed by a
+ * high-resolution timer (hr_timer.h): their callbacks run in the PIT1
+ * interrupt handler, with microsecond resolution and without waking up the
+ * RTOS timer task, so they must be short and can only call RTOS services
+ * that can be called from ISRs.
  */
 struct rtos_timer
 {
@@ -121,6 +357,21 @@ struct rtos_timer
 
 #   define      TIMER_SIGNATURE  GEN_SIGNATURE('T', 'I', 'M', 'R')
     uint32_t    tmr_signature;
+
+    /**
+     * Flag indicating if the timer's callback runs in ISR context, from
+     * tmr_hr_timer, instead of in the RTOS timer task
+     */
+    bool        tmr_isr_context;
+
+    /**
+     * Fields used only for ISR-context timers
+     */
+    struct hr_timer tmr_hr_timer;
+    uint32_t    tmr_timeout_us;
+    uint32_t    tmr_period_us;
+    rtos_timer_callback_t *tmr_callback_p;
+    void        *tmr_callback_arg;
 };
 
 C_ASSERT(offsetof(struct rtos_timer, tmr_os_timer) == 0);
@@ -135,11 +386,6 @@ typedef OS_PRIO rtos_task_priority_t;
  */
 typedef void rtos_task_function_t(void *arg);
 
-/**
- * Signature of a timer callback function
- */
-typedef void rtos_timer_callback_t(struct rtos_timer *rtos_timer_p, void *arg);
-
 void rtos_init(void);
 
 void rtos_scheduler_start(void);
@@ -158,6 +404,9 @@ struct rtos_task *rtos_task_self(void);
 
 void rtos_task_change_self_priority(rtos_task_priority_t new_task_prio);
 
+void rtos_task_set_scratch_arena(struct rtos_task *rtos_task_p,
+                                 struct mem_arena *arena_p);
+
 void rtos_task_exit(void);
 
 void rtos_task_delay(uint32_t ms);
@@ -166,6 +415,10 @@ void rtos_task_semaphore_wait(void);
 
 void rtos_task_semaphore_signal(struct rtos_task *rtos_task_p);
 
+void rtos_task_sleep(void);
+
+void rtos_task_wake_up(struct rtos_task *rtos_task_p);
+
 void rtos_mutex_init(struct rtos_mutex *rtos_mutex_p,
                      const char *mutex_name_p);
  
@@ -175,19 +428,33 @@ void rtos_mutex_unlock(struct rtos_mutex *rtos_mutex_p);
 
 bool rtos_mutex_is_mine(const struct rtos_mutex *rtos_mutex_p);
 
+bool rtos_get_mutex_stats(unsigned int index, struct rtos_mutex_stats *stats_p);
+
+void rtos_reset_mutex_stats(void);
+
 void rtos_semaphore_init(struct rtos_semaphore *rtos_semaphore_p,
                          const char *semaphore_name_p,
                          uint32_t initial_count);
  
 void rtos_semaphore_wait(struct rtos_semaphore *rtos_semaphore_p);
  
+bool rtos_semaphore_try_wait(struct rtos_semaphore *rtos_semaphore_p);
+
 bool rtos_semaphore_wait_timeout(struct rtos_semaphore *rtos_semaphore_p,
 		                         uint32_t timeout_ms);
 
-void rtos_semaphore_signal(struct rtos_semaphore *rtos_semaphore_p);
-
 void rtos_semaphore_broadcast(struct rtos_semaphore *rtos_semaphore_p);
 
+void rtos_signal_init(struct rtos_signal *rtos_signal_p,
+                      struct rtos_task *waiter_task_p);
+
+void rtos_signal_wait(struct rtos_signal *rtos_signal_p);
+
+bool rtos_signal_wait_timeout(struct rtos_signal *rtos_signal_p,
+                              uint32_t timeout_ms);
+
+void rtos_signal_signal(struct rtos_signal *rtos_signal_p);
+
 void rtos_timer_init(struct rtos_timer *rtos_timer_p,
                      const char *timer_name_p,
                      uint32_t milliseconds,
@@ -195,18 +462,159 @@ void rtos_timer_init(struct rtos_timer *rtos_timer_p,
                      rtos_timer_callback_t *timer_callback_p,
                      void *arg);
 
+void rtos_timer_init_isr_context(struct rtos_timer *rtos_timer_p,
+                                 const char *timer_name_p,
+                                 uint32_t microseconds,
+                                 bool periodic,
+                                 rtos_timer_callback_t *timer_callback_p,
+                                 void *arg);
+
 void rtos_timer_start(struct rtos_timer *rtos_timer_p);
 
 void rtos_timer_stop(struct rtos_timer *rtos_timer_p);
 
 void rtos_task_check_stack(struct rtos_task *task_p);
 
+uint32_t rtos_task_get_stack_usage(struct rtos_task *task_p);
+
+void rtos_task_stack_guard_check(void);
+
 void rtos_enter_isr(void);
 
 void rtos_exit_isr(void);
 
-uint32_t rtos_get_ticks_since_boot(void);
+bool rtos_get_isr_stats(unsigned int index, struct rtos_isr_stats *stats_p);
+
+void rtos_reset_isr_stats(void);
+
+bool rtos_get_task_cpu_stats(unsigned int index,
+                             struct rtos_task_cpu_stats *stats_p);
+
+void rtos_reset_task_cpu_stats(void);
+
+uint64_t rtos_get_idle_task_cpu_cycles(void);
+
+/*
+ * Fast paths inlined into their callers. They are called from hot paths
+ * (packet processing, ISRs and timestamping), where the cost of an
+ * out-of-line call through the wrapper is a significant fraction of the
+ * cost of the operation itself.
+ */
+
+/**
+ * Returns the calling task. Unlike rtos_task_self(), it must be called
+ * from a task.
+ *
+ * @return task object pointer
+ */
+static inline struct rtos_task *rtos_task_get_current(void)
+{
+    struct rtos_task *task_p = ENCLOSING_STRUCT(OSTCBCurPtr, struct rtos_task,
+                                                tsk_tcb);
+
+    D_ASSERT(task_p->tsk_signature == TASK_SIGNATURE);
+    return task_p;
+}
+
+
+/**
+ * Returns the priority of the calling task. It must be called from a task.
+ *
+ * @return task priority (lower number means higher priority)
+ */
+static inline rtos_task_priority_t rtos_task_get_current_priority(void)
+{
+    return OSTCBCurPtr->Prio;
+}
+
+
+/**
+ * Returns the task that was running when the current exception happened.
+ * It is to be called from an exception handler.
+ *
+ * @return task object pointer, or NULL if the running task was not created
+ *         with rtos_task_create() (for example, the RTOS idle task)
+ */
+static inline struct rtos_task *rtos_task_get_interrupted(void)
+{
+    return OSTCBCurPtr->ExtPtr;
+}
+
+
+/**
+ * Returns the index (tsk_index) of the running task, or of the task that
+ * was running when the current exception happened.
+ *
+ * @return task index, or RTOS_MAX_NUM_TASKS if the RTOS has not started
+ *         yet or the running task was not created with rtos_task_create()
+ */
+static inline uint_fast8_t rtos_task_get_running_index(void)
+{
+    if (OSTCBCurPtr == NULL) {
+        return RTOS_MAX_NUM_TASKS;
+    }
+
+    struct rtos_task *task_p = OSTCBCurPtr->ExtPtr;
+
+    if (task_p == NULL || task_p->tsk_index >= RTOS_MAX_NUM_TASKS) {
+        return RTOS_MAX_NUM_TASKS;
+    }
+
+    return task_p->tsk_index;
+}
 
-uint32_t rtos_get_time_since_boot(void);
+
+/**
+ * Returns the scratch memory arena of the calling task. It must be called
+ * from a task that has a scratch arena.
+ *
+ * @return pointer to the arena
+ */
+static inline struct mem_arena *rtos_task_get_scratch_arena(void)
+{
+    struct mem_arena *arena_p = rtos_task_get_current()->tsk_scratch_arena_p;
+
+    D_ASSERT(arena_p != NULL);
+    return arena_p;
+}
+
+
+/**
+ * Signal an RTOS-level semaphore. It wakes up the highest priority waiter.
+ * It can be called from ISRs.
+ */
+static inline void rtos_semaphore_signal(struct rtos_semaphore *rtos_semaphore_p)
+{
+    OS_ERR  os_err;
+
+    D_ASSERT(rtos_semaphore_p->sem_signature == SEMAPHORE_SIGNATURE);
+
+    TRACE_RECORD(TRACE_EVENT_SEM_SIGNAL, rtos_semaphore_p, 0);
+    OSSemPost(&rtos_semaphore_p->sem_os_semaphore, OS_OPT_POST_1, &os_err);
+    if (os_err != OS_ERR_NONE) {
+        error_t error = CAPTURE_ERROR("OSSemPost() failed", os_err, rtos_semaphore_p);
+        fatal_error_handler(error);
+    }
+}
+
+
+/**
+ * Return time since boot in ticks. It reads the uCOS-III tick counter
+ * directly, as a 32-bit aligned load is atomic, instead of going through
+ * OSTimeGet() and its critical section.
+ */
+static inline uint32_t rtos_get_ticks_since_boot(void)
+{
+    return *(volatile OS_TICK *)&OSTickCtr;
+}
+
+
+/**
+ * Return time since boot in seconds
+ */
+static inline uint32_t rtos_get_time_since_boot(void)
+{
+    return rtos_get_ticks_since_boot() / RTOS_TICK_RATE_HZ;
+}
 
 #endif /*  __RTOS_WRAPPER_H */
@@ -13,8 +13,12 @@
 #include "microcontroller.h"
 #include "hw_timer_driver.h"
 #include "runtime_log.h"
+#include "trace_recorder.h"
+#include "power_utils.h"
+#include "watchdog.h"
 #include <ucosiii/os_app_hooks.h>
 #include <stddef.h>
+#include <string.h>
 #include <board.h>
 
 /**
@@ -23,6 +27,143 @@
  */
 #define APP_TASK_STACK_UNFILLED_LIMIT   (APP_TASK_STACK_SIZE / 10)
 
+/**
+ * ISR duration statistics of the IRQs whose ISR durations are tracked
+ */
+static struct rtos_isr_stats g_rtos_isr_stats[] = {
+    { .name_p = "ENET Tx", .irq = ENET_Transmit_IRQn },
+    { .name_p = "ENET Rx", .irq = ENET_Receive_IRQn },
+    { .name_p = "UART0", .irq = UART0_RX_TX_IRQn },
+    { .name_p = "UART4", .irq = UART4_RX_TX_IRQn },
+    { .name_p = "LPTMR0", .irq = LPTMR0_IRQn },
+};
+
+/**
+ * CPU utilization accounting state
+ */
+struct rtos_cpu_accounting {
+    /**
+     * Tasks created with rtos_task_create(), indexed by tsk_index
+     */
+    struct rtos_task *volatile tasks[RTOS_MAX_NUM_TASKS];
+
+    /**
+     * DWT cycles timestamp of the last context switch
+     */
+    uint32_t last_switch_cycles;
+
+    /**
+     * DWT cycles spent in the uC/OS-III idle task
+     */
+    uint64_t idle_task_cycles;
+
+    /**
+     * DWT cycles spent in other uC/OS-III internal tasks (not created with
+     * rtos_task_create())
+     */
+    uint64_t internal_tasks_cycles;
+};
+
+static struct rtos_cpu_accounting g_rtos_cpu_accounting;
+
+#if RTOS_MUTEX_STATS_ON
+/**
+ * List of all the mutexes initialized with rtos_mutex_init(), most recently
+ * initialized first. Mutexes are never destroyed, so entries are never
+ * removed.
+ */
+static struct rtos_mutex *volatile g_rtos_mutexes_list_head_p = NULL;
+#endif
+
+
+/**
+ * Value of the DWT FUNCTION register for a watchpoint on data writes
+ */
+#define RTOS_DWT_FUNCTION_WRITE_WATCHPOINT  UINT32_C(0x6)
+
+/**
+ * Initializes the DWT comparator used as the stack guard watchpoint. Writes
+ * to the address range covered by the comparator generate a debug monitor
+ * exception (or halt the CPU, if a debugger has halting debug enabled).
+ *
+ * NOTE: The K64F has no ARMv7-M MPU, and its system MPU grants any access
+ * allowed by any region descriptor, so a no-access guard region cannot be
+ * carved out of the RAM that the background region makes accessible.
+ */
+static void rtos_stack_guard_init(void)
+{
+    DWT->FUNCTION0 = 0;
+    DWT->MASK0 = __builtin_ctz(RTOS_TASK_STACK_GUARD_SIZE);
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_MON_EN_Msk;
+}
+
+
+/**
+ * uC/OS-III context switch hook. It charges the DWT cycles elapsed since the
+ * last context switch to the task being switched out (OSTCBCurPtr),
+ * records the switch to the task being switched in (OSTCBHighRdyPtr) in the
+ * event trace, and arms the stack guard watchpoint for the task being
+ * switched in.
+ *
+ * NOTE: It is invoked from the PendSV handler, with interrupts disabled.
+ */
+static void rtos_task_switch_hook(void)
+{
+    struct rtos_cpu_accounting *const accounting_p = &g_rtos_cpu_accounting;
+    uint32_t now_cycles = get_dwt_cycles();
+    uint32_t delta_cycles = now_cycles - accounting_p->last_switch_cycles;
+    struct rtos_task *task_p = OSTCBCurPtr->ExtPtr;
+
+    accounting_p->last_switch_cycles = now_cycles;
+    if (task_p != NULL) {
+        task_p->tsk_cpu_cycles += delta_cycles;
+    } else if (OSTCBCurPtr == &OSIdleTaskTCB) {
+        accounting_p->idle_task_cycles += delta_cycles;
+    } else {
+        accounting_p->internal_tasks_cycles += delta_cycles;
+    }
+
+#   if TRACE_RECORDER_ON
+    struct rtos_task *next_task_p = OSTCBHighRdyPtr->ExtPtr;
+    uint32_t next_task_index;
+
+    if (next_task_p != NULL) {
+        next_task_index = next_task_p->tsk_index;
+    } else if (OSTCBHighRdyPtr == &OSIdleTaskTCB) {
+        next_task_index = TRACE_TASK_INDEX_IDLE;
+    } else {
+        next_task_index = TRACE_TASK_INDEX_RTOS_INTERNAL;
+    }
+
+    TRACE_RECORD(TRACE_EVENT_TASK_SWITCH, next_task_index, 0);
+#   endif
+
+    /*
+     * Move the stack guard watchpoint to the stack of the task being
+     * switched in. uC/OS-III internal tasks do not have a stack guard.
+     */
+    struct rtos_task *switched_in_task_p = OSTCBHighRdyPtr->ExtPtr;
+
+    DWT->FUNCTION0 = 0;
+    if (switched_in_task_p != NULL) {
+        DWT->COMP0 = (uint32_t)switched_in_task_p->tsk_stack_guard;
+        DWT->FUNCTION0 = RTOS_DWT_FUNCTION_WRITE_WATCHPOINT;
+    }
+}
+
+
+/**
+ * RTOS idle task hook. It restarts the watchdog, if all the tasks it
+ * monitors are alive, and then lets the CPU idle governor put the CPU to
+ * sleep.
+ */
+static void rtos_idle_task_hook(void)
+{
+    watchdog_restart();
+    cpu_idle_governor_run();
+}
+
+
 /**
  * Initializes RTOS
  */
@@ -43,6 +184,20 @@ void rtos_init(void)
     }
 
     App_OS_SetAllHooks();
+
+    /*
+     * Hook CPU utilization accounting and the stack guard watchpoint into
+     * the context switches:
+     */
+    init_dwt_cycles_counter();
+    rtos_stack_guard_init();
+    OS_AppTaskSwHookPtr = rtos_task_switch_hook;
+
+    /*
+     * Restart the watchdog and let the CPU idle governor put the CPU to
+     * sleep from the idle task:
+     */
+    OS_AppIdleTaskHookPtr = rtos_idle_task_hook;
 }
 
 
@@ -53,6 +208,12 @@ void rtos_scheduler_start(void)
 {
     OS_ERR os_err;
 
+    /*
+     * Do not charge the time spent before the scheduler starts to the
+     * first task that runs:
+     */
+    g_rtos_cpu_accounting.last_switch_cycles = get_dwt_cycles();
+
     OSStart(&os_err);
 
     if (os_err != OS_ERR_NONE) {
@@ -69,6 +230,12 @@ static void rtos_tick_timer_callback(void *arg)
 {
     D_ASSERT(arg == NULL);
 
+    /*
+     * Sample the monotonic clock on every tick, so that it never misses a
+     * wrap-around of the DWT cycle counter:
+     */
+    (void)get_monotonic_cycles();
+
     /*
      * Call uC/OS-III's tick timer processing:
      */
@@ -90,11 +257,45 @@ void rtos_tick_timer_init(void)
 }
 
 
+/**
+ * Returns the IRQ being serviced, from the exception number in IPSR
+ */
+static inline IRQn_Type rtos_current_irq(void)
+{
+    return (IRQn_Type)((int)(__get_IPSR() & 0x1ff) - 16);
+}
+
+
+/**
+ * Returns the ISR duration statistics of a given IRQ, or NULL if its ISR
+ * durations are not tracked
+ */
+static struct rtos_isr_stats *rtos_find_isr_stats(IRQn_Type irq)
+{
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_rtos_isr_stats); i ++) {
+        if (g_rtos_isr_stats[i].irq == irq) {
+            return &g_rtos_isr_stats[i];
+        }
+    }
+
+    return NULL;
+}
+
+
 /**
  * Notify RTOS that we are entering an ISR
  */
 void rtos_enter_isr(void)
 {
+    IRQn_Type irq = rtos_current_irq();
+    struct rtos_isr_stats *isr_stats_p = rtos_find_isr_stats(irq);
+
+    TRACE_RECORD(TRACE_EVENT_ISR_ENTER, irq, 0);
+
+    if (isr_stats_p != NULL) {
+        isr_stats_p->start_cycles = get_cpu_clock_cycles();
+    }
+
     /*
      * Tell uC/OS-III that we are in an ISR:
      */
@@ -109,6 +310,28 @@ void rtos_enter_isr(void)
  */
 void rtos_exit_isr(void)
 {
+    IRQn_Type irq = rtos_current_irq();
+    struct rtos_isr_stats *isr_stats_p = rtos_find_isr_stats(irq);
+
+    /*
+     * NOTE: An ISR cannot be preempted by another invocation of itself,
+     * so only higher priority ISRs can run between the two halves of this
+     * measurement (and they are counted as part of this ISR's duration).
+     */
+    if (isr_stats_p != NULL) {
+        uint32_t delta_cycles = cpu_clock_cycles_diff(isr_stats_p->start_cycles,
+                                                      get_cpu_clock_cycles());
+
+        isr_stats_p->count ++;
+        if (delta_cycles > isr_stats_p->max_cycles) {
+            isr_stats_p->max_cycles = delta_cycles;
+        }
+
+        cycles_histogram_record(&isr_stats_p->histogram, delta_cycles);
+    }
+
+    TRACE_RECORD(TRACE_EVENT_ISR_EXIT, irq, 0);
+
     /*
      * Tell uC/OS-III that we are exiting an ISR:
      */
@@ -116,6 +339,144 @@ void rtos_exit_isr(void)
 }
 
 
+/**
+ * Takes a snapshot of the ISR duration statistics of one of the IRQs whose
+ * ISR durations are tracked
+ *
+ * @param index     Index of the tracked IRQ (0 .. number of tracked IRQs - 1)
+ * @param stats_p   Area where the statistics are to be returned
+ *
+ * @return true, if index is valid
+ * @return false, otherwise
+ */
+bool rtos_get_isr_stats(unsigned int index, struct rtos_isr_stats *stats_p)
+{
+    if (index >= ARRAY_SIZE(g_rtos_isr_stats)) {
+        return false;
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    *stats_p = g_rtos_isr_stats[index];
+    restore_cpu_interrupts(int_mask);
+    return true;
+}
+
+
+/**
+ * Clears the ISR duration statistics
+ */
+void rtos_reset_isr_stats(void)
+{
+    for (unsigned int i = 0; i < ARRAY_SIZE(g_rtos_isr_stats); i ++) {
+        struct rtos_isr_stats *isr_stats_p = &g_rtos_isr_stats[i];
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        isr_stats_p->count = 0;
+        isr_stats_p->max_cycles = 0;
+        for (uint_fast8_t j = 0; j < CYCLES_HISTOGRAM_NUM_BUCKETS; j ++) {
+            isr_stats_p->histogram.buckets[j] = 0;
+        }
+
+        restore_cpu_interrupts(int_mask);
+    }
+}
+
+
+/**
+ * Returns a snapshot of the CPU utilization statistics of a task. Tasks are
+ * enumerated in creation order, followed by two pseudo-entries for the RTOS
+ * idle task and for the RTOS internal tasks.
+ *
+ * @param index     Index of the entry to return
+ * @param stats_p   Area where the statistics are to be returned
+ *
+ * @return true, if index is valid
+ * @return false, otherwise
+ */
+bool rtos_get_task_cpu_stats(unsigned int index,
+                             struct rtos_task_cpu_stats *stats_p)
+{
+    struct rtos_cpu_accounting *const accounting_p = &g_rtos_cpu_accounting;
+    uint64_t total_cycles;
+    unsigned int num_tasks;
+
+    for (num_tasks = 0; num_tasks < RTOS_MAX_NUM_TASKS; num_tasks ++) {
+        if (accounting_p->tasks[num_tasks] == NULL) {
+            break;
+        }
+    }
+
+    if (index > num_tasks + 1) {
+        return false;
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    total_cycles = accounting_p->idle_task_cycles +
+                   accounting_p->internal_tasks_cycles;
+    for (unsigned int i = 0; i < num_tasks; i ++) {
+        total_cycles += accounting_p->tasks[i]->tsk_cpu_cycles;
+    }
+
+    stats_p->total_cpu_cycles = total_cycles;
+    if (index < num_tasks) {
+        struct rtos_task *task_p = accounting_p->tasks[index];
+
+        stats_p->name_p = task_p->tsk_name_p;
+        stats_p->task_p = task_p;
+        stats_p->cpu_cycles = task_p->tsk_cpu_cycles;
+    } else if (index == num_tasks) {
+        stats_p->name_p = "RTOS idle task";
+        stats_p->task_p = NULL;
+        stats_p->cpu_cycles = accounting_p->idle_task_cycles;
+    } else {
+        stats_p->name_p = "RTOS internal tasks";
+        stats_p->task_p = NULL;
+        stats_p->cpu_cycles = accounting_p->internal_tasks_cycles;
+    }
+
+    restore_cpu_interrupts(int_mask);
+    return true;
+}
+
+
+/**
+ * Returns the DWT cycles the RTOS idle task has spent running since the
+ * last reset of the CPU utilization statistics
+ */
+uint64_t rtos_get_idle_task_cpu_cycles(void)
+{
+    uint32_t int_mask = disable_cpu_interrupts();
+    uint64_t idle_task_cycles = g_rtos_cpu_accounting.idle_task_cycles;
+
+    restore_cpu_interrupts(int_mask);
+    return idle_task_cycles;
+}
+
+
+/**
+ * Clears the CPU utilization statistics of all tasks
+ */
+void rtos_reset_task_cpu_stats(void)
+{
+    struct rtos_cpu_accounting *const accounting_p = &g_rtos_cpu_accounting;
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    for (unsigned int i = 0; i < RTOS_MAX_NUM_TASKS; i ++) {
+        if (accounting_p->tasks[i] == NULL) {
+            break;
+        }
+
+        accounting_p->tasks[i]->tsk_cpu_cycles = 0;
+    }
+
+    accounting_p->idle_task_cycles = 0;
+    accounting_p->internal_tasks_cycles = 0;
+    restore_cpu_interrupts(int_mask);
+}
+
+
 /**
  * Create an RTOS-level task
  */
@@ -125,6 +486,7 @@ void rtos_task_create(struct rtos_task *rtos_task_p,
                       void *task_arg_p,
                       rtos_task_priority_t task_prio)
 {
+    static volatile uint32_t next_task_index = 0;
     OS_ERR  os_err;
     error_t error;
 
@@ -137,9 +499,34 @@ void rtos_task_create(struct rtos_task *rtos_task_p,
     rtos_task_p->tsk_signature = TASK_SIGNATURE;
     rtos_task_p->tsk_name_p = task_name_p;
     rtos_task_p->tsk_created = true;
-    rtos_task_p->tsk_stack_overflow_marker = STACK_OVERFLOW_MARKER;
+    rtos_task_p->tsk_index = ATOMIC_POST_INCREMENT_UINT32(&next_task_index);
+    for (uint32_t i = 0; i < ARRAY_SIZE(rtos_task_p->tsk_stack_guard); i++) {
+        rtos_task_p->tsk_stack_guard[i] = STACK_OVERFLOW_MARKER;
+    }
+
     rtos_task_p->tsk_stack_underflow_marker = STACK_UNDERFLOW_MARKER;
     rtos_task_p->tsk_max_stack_entries_used = 0;
+    rtos_task_p->tsk_cpu_cycles = 0;
+    rtos_task_p->tsk_scratch_arena_p = NULL;
+    OSSemCreate(&rtos_task_p->tsk_sleep_semaphore, (char *)task_name_p, 0,
+                &os_err);
+    if (os_err != OS_ERR_NONE) {
+        error = CAPTURE_ERROR("OSSemCreate() failed", os_err, rtos_task_p);
+        fatal_error_handler(error);
+    }
+
+    if (rtos_task_p->tsk_index < RTOS_MAX_NUM_TASKS) {
+        g_rtos_cpu_accounting.tasks[rtos_task_p->tsk_index] = rtos_task_p;
+    }
+
+    /*
+     * Paint the whole stack before uCOS-III builds the task's initial
+     * context frame at the top of it, so that rtos_task_get_stack_usage()
+     * can find how deep the stack has ever grown:
+     */
+    for (uint32_t i = 0; i < APP_TASK_STACK_SIZE; i++) {
+        rtos_task_p->tsk_stack[i] = STACK_PAINT_PATTERN;
+    }
 
     /*
      * Create the uCOS-III task
@@ -156,9 +543,9 @@ void rtos_task_create(struct rtos_task *rtos_task_p,
                  0,
                  // time_quanta:
                  0,
-                 // p_ext:
-                 NULL,
-                 OS_OPT_TASK_STK_CHK | OS_OPT_TASK_STK_CLR,
+                 // p_ext (used by rtos_task_switch_hook()):
+                 rtos_task_p,
+                 OS_OPT_TASK_STK_CHK,
                  &os_err);
 
     if (os_err != OS_ERR_NONE) {
@@ -183,12 +570,25 @@ struct rtos_task *rtos_task_self(void)
 	}
 
 	D_ASSERT(CPU_MODE_IS_THREAD());
+    return rtos_task_get_current();
+}
 
-    struct rtos_task *task_p = ENCLOSING_STRUCT(OSTCBCurPtr, struct rtos_task,
-                                                tsk_tcb);
 
-    D_ASSERT(task_p->tsk_signature == TASK_SIGNATURE);
-    return task_p;
+/**
+ * Assigns a scratch memory arena to a task. Temporary buffers that the task
+ * would otherwise allocate on its stack can then be allocated from the
+ * arena, obtained with rtos_task_get_scratch_arena(), so that the task's
+ * stack can be smaller. The arena must not be shared with any other task.
+ *
+ * @param rtos_task_p   Pointer to the task (already created)
+ * @param arena_p       Pointer to the arena
+ */
+void rtos_task_set_scratch_arena(struct rtos_task *rtos_task_p,
+                                 struct mem_arena *arena_p)
+{
+    D_ASSERT(rtos_task_p->tsk_signature == TASK_SIGNATURE);
+    D_ASSERT(rtos_task_p->tsk_created);
+    rtos_task_p->tsk_scratch_arena_p = arena_p;
 }
 
 
@@ -225,6 +625,8 @@ void rtos_task_kill(struct rtos_task *rtos_task_p)
         error_t error = CAPTURE_ERROR("OSTaskDel() failed", os_err, rtos_task_p);
         fatal_error_handler(error);
     }
+
+    (void)OSSemDel(&rtos_task_p->tsk_sleep_semaphore, OS_OPT_DEL_ALWAYS, &os_err);
 }
 
 
@@ -275,6 +677,34 @@ void rtos_task_semaphore_wait(void)
 }
 
 
+/**
+ * Block calling task on its built-in semaphore, with a timeout
+ *
+ * @return true, if the semaphore was signaled
+ * @return false, if the wait timed out
+ */
+static bool rtos_task_semaphore_wait_timeout(uint32_t timeout_ms)
+{
+    OS_ERR os_err;
+
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+    D_ASSERT(timeout_ms >= MS_PER_TIMER_TICK);
+
+    OSTaskSemPend(timeout_ms / MS_PER_TIMER_TICK, OS_OPT_PEND_BLOCKING, NULL,
+                  &os_err);
+    if (os_err == OS_ERR_TIMEOUT) {
+        return false;
+    }
+
+    if (os_err != OS_ERR_NONE) {
+        error_t error = CAPTURE_ERROR("OSTaskSemPend() failed", os_err, OSTCBCurPtr);
+        fatal_error_handler(error);
+    }
+
+    return true;
+}
+
+
 /**
  * Wake up a task by signaling its built-in semaphore
  */
@@ -292,6 +722,45 @@ void rtos_task_semaphore_signal(struct rtos_task *rtos_task_p)
 }
 
 
+/**
+ * Blocks the calling task until it is woken up by rtos_task_wake_up().
+ * Wake-ups are counted, so a wake-up that happens before the task goes to
+ * sleep is not lost.
+ */
+void rtos_task_sleep(void)
+{
+    struct rtos_task *const rtos_task_p = rtos_task_self();
+    OS_ERR os_err;
+
+    D_ASSERT(rtos_task_p != NULL);
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    OSSemPend(&rtos_task_p->tsk_sleep_semaphore, 0, OS_OPT_PEND_BLOCKING,
+              NULL, &os_err);
+    if (os_err != OS_ERR_NONE) {
+        error_t error = CAPTURE_ERROR("OSSemPend() failed", os_err, rtos_task_p);
+        fatal_error_handler(error);
+    }
+}
+
+
+/**
+ * Wakes up a task blocked in rtos_task_sleep(). It can be called from ISRs.
+ */
+void rtos_task_wake_up(struct rtos_task *rtos_task_p)
+{
+    OS_ERR os_err;
+
+    D_ASSERT(rtos_task_p->tsk_signature == TASK_SIGNATURE);
+
+    OSSemPost(&rtos_task_p->tsk_sleep_semaphore, OS_OPT_POST_1, &os_err);
+    if (os_err != OS_ERR_NONE) {
+        error_t error = CAPTURE_ERROR("OSSemPost() failed", os_err, rtos_task_p);
+        fatal_error_handler(error);
+    }
+}
+
+
 /**
  * Initializes an RTOS-level mutex
  */
@@ -311,6 +780,18 @@ void rtos_mutex_init(struct rtos_mutex *rtos_mutex_p,
         error_t error = CAPTURE_ERROR("OSMutexCreate() failed", os_err, rtos_mutex_p);
         fatal_error_handler(error);
     }
+
+#if RTOS_MUTEX_STATS_ON
+    memset(&rtos_mutex_p->mtx_stats, 0, sizeof rtos_mutex_p->mtx_stats);
+    rtos_mutex_p->mtx_stats.name_p = mutex_name_p;
+    rtos_mutex_p->mtx_acquired_cycles = 0;
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    rtos_mutex_p->mtx_next_p = g_rtos_mutexes_list_head_p;
+    g_rtos_mutexes_list_head_p = rtos_mutex_p;
+    restore_cpu_interrupts(int_mask);
+#endif
 }
 
 
@@ -324,6 +805,19 @@ void rtos_mutex_lock(struct rtos_mutex *rtos_mutex_p)
     D_ASSERT(rtos_mutex_p->mtx_signature == MUTEX_SIGNATURE);
     D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
 
+#if RTOS_MUTEX_STATS_ON
+    /*
+     * Sample the owner before pending. This is racy, but it can only
+     * misclassify an acquisition whose owner released the mutex in the
+     * window between this check and OSMutexPend(), which is harmless for
+     * statistics:
+     */
+    OS_TCB *owner_tcb_p = rtos_mutex_p->mtx_os_mutex.OwnerTCBPtr;
+    bool contended = (owner_tcb_p != NULL);
+    bool priority_inversion = (contended && owner_tcb_p->Prio > OSTCBCurPtr->Prio);
+    uint32_t start_cycles = get_dwt_cycles();
+#endif
+
     OSMutexPend(&rtos_mutex_p->mtx_os_mutex,
                 0, // timeout
                 OS_OPT_PEND_BLOCKING,
@@ -334,6 +828,30 @@ void rtos_mutex_lock(struct rtos_mutex *rtos_mutex_p)
         error_t error = CAPTURE_ERROR("OSMutexPend() failed", os_err, rtos_mutex_p);
         fatal_error_handler(error);
     }
+
+#if RTOS_MUTEX_STATS_ON
+    /*
+     * The statistics are protected by the mutex itself, from here until
+     * rtos_mutex_unlock() releases it:
+     */
+    struct rtos_mutex_stats *stats_p = &rtos_mutex_p->mtx_stats;
+
+    rtos_mutex_p->mtx_acquired_cycles = get_dwt_cycles();
+    stats_p->acquisitions ++;
+    if (contended) {
+        uint32_t wait_cycles = rtos_mutex_p->mtx_acquired_cycles - start_cycles;
+
+        stats_p->contended ++;
+        if (priority_inversion) {
+            stats_p->priority_inversions ++;
+        }
+
+        stats_p->total_wait_cycles += wait_cycles;
+        if (wait_cycles > stats_p->max_wait_cycles) {
+            stats_p->max_wait_cycles = wait_cycles;
+        }
+    }
+#endif
 }
 
 
@@ -347,6 +865,16 @@ void rtos_mutex_unlock(struct rtos_mutex *rtos_mutex_p)
     D_ASSERT(rtos_mutex_p->mtx_signature == MUTEX_SIGNATURE);
     D_ASSERT(CPU_MODE_IS_THREAD());
 
+#if RTOS_MUTEX_STATS_ON
+    struct rtos_mutex_stats *stats_p = &rtos_mutex_p->mtx_stats;
+    uint32_t hold_cycles = get_dwt_cycles() - rtos_mutex_p->mtx_acquired_cycles;
+
+    if (hold_cycles > stats_p->max_hold_cycles) {
+        stats_p->max_hold_cycles = hold_cycles;
+        stats_p->max_holder_name_p = OSTCBCurPtr->NamePtr;
+    }
+#endif
+
     OSMutexPost(&rtos_mutex_p->mtx_os_mutex, OS_OPT_POST_NONE, &os_err);
 
     if (os_err != OS_ERR_NONE) {
@@ -365,6 +893,71 @@ bool rtos_mutex_is_mine(const struct rtos_mutex *rtos_mutex_p)
 }
 
 
+/**
+ * Returns a snapshot of the contention statistics of a mutex. Mutexes are
+ * enumerated from the most recently initialized one.
+ *
+ * NOTE: The snapshot is taken without acquiring the mutex, so its fields
+ * may be slightly inconsistent with each other if the mutex is in use.
+ *
+ * @param index     Index of the entry to return
+ * @param stats_p   Area where the statistics are to be returned
+ *
+ * @return true, if index is valid
+ * @return false, otherwise (or if RTOS_MUTEX_STATS_ON is 0)
+ */
+bool rtos_get_mutex_stats(unsigned int index, struct rtos_mutex_stats *stats_p)
+{
+#if RTOS_MUTEX_STATS_ON
+    struct rtos_mutex *rtos_mutex_p = g_rtos_mutexes_list_head_p;
+
+    for ( ; rtos_mutex_p != NULL && index != 0; index --) {
+        rtos_mutex_p = rtos_mutex_p->mtx_next_p;
+    }
+
+    if (rtos_mutex_p == NULL) {
+        return false;
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    *stats_p = rtos_mutex_p->mtx_stats;
+    restore_cpu_interrupts(int_mask);
+    return true;
+#else
+    (void)index;
+    (void)stats_p;
+    return false;
+#endif
+}
+
+
+/**
+ * Clears the contention statistics of all mutexes
+ */
+void rtos_reset_mutex_stats(void)
+{
+#if RTOS_MUTEX_STATS_ON
+    struct rtos_mutex *rtos_mutex_p;
+
+    for (rtos_mutex_p = g_rtos_mutexes_list_head_p; rtos_mutex_p != NULL;
+         rtos_mutex_p = rtos_mutex_p->mtx_next_p) {
+        struct rtos_mutex_stats *stats_p = &rtos_mutex_p->mtx_stats;
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        stats_p->acquisitions = 0;
+        stats_p->contended = 0;
+        stats_p->priority_inversions = 0;
+        stats_p->total_wait_cycles = 0;
+        stats_p->max_wait_cycles = 0;
+        stats_p->max_hold_cycles = 0;
+        stats_p->max_holder_name_p = NULL;
+        restore_cpu_interrupts(int_mask);
+    }
+#endif
+}
+
+
 /**
  * Initializes an RTOS-level semaphore
  */
@@ -399,12 +992,15 @@ void rtos_semaphore_wait(struct rtos_semaphore *rtos_semaphore_p)
     D_ASSERT(rtos_semaphore_p->sem_signature == SEMAPHORE_SIGNATURE);
     D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
 
+    TRACE_RECORD(TRACE_EVENT_SEM_WAIT, rtos_semaphore_p, 0);
     OSSemPend(&rtos_semaphore_p->sem_os_semaphore,
               0,  // timeout
               OS_OPT_PEND_BLOCKING,
               NULL,
               &os_err);
 
+    TRACE_RECORD(TRACE_EVENT_SEM_WAIT_DONE, rtos_semaphore_p, 0);
+
     if (os_err != OS_ERR_NONE) {
         error_t error = CAPTURE_ERROR("OSSemPend() failed", os_err, rtos_semaphore_p);
         fatal_error_handler(error);
@@ -430,12 +1026,19 @@ bool rtos_semaphore_wait_timeout(struct rtos_semaphore *rtos_semaphore_p,
     D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
     D_ASSERT(timeout_ms >= MS_PER_TIMER_TICK);
 
+    TRACE_RECORD(TRACE_EVENT_SEM_WAIT, rtos_semaphore_p, 0);
     OSSemPend(&rtos_semaphore_p->sem_os_semaphore,
               timeout_ms / MS_PER_TIMER_TICK,
               OS_OPT_PEND_BLOCKING,
               NULL,
               &os_err);
 
+    /*
+     * arg2 tells if the wait timed out:
+     */
+    TRACE_RECORD(TRACE_EVENT_SEM_WAIT_DONE, rtos_semaphore_p,
+                 os_err == OS_ERR_TIMEOUT);
+
     if (os_err == OS_ERR_TIMEOUT) {
         return false;
     }
@@ -452,19 +1055,37 @@ bool rtos_semaphore_wait_timeout(struct rtos_semaphore *rtos_semaphore_p,
 
 
 /**
- * Signal an RTOS-level semaphore. It wakes up the highest priority waiter
+ * Takes an RTOS-level semaphore if it is available, without waiting
+ *
+ * @param rtos_semaphore_p  pointer to the semaphore
+ *
+ * @return true     if the semaphore was taken
+ * @return false    if the semaphore was not available
  */
-void rtos_semaphore_signal(struct rtos_semaphore *rtos_semaphore_p)
+bool rtos_semaphore_try_wait(struct rtos_semaphore *rtos_semaphore_p)
 {
     OS_ERR  os_err;
 
     D_ASSERT(rtos_semaphore_p->sem_signature == SEMAPHORE_SIGNATURE);
 
-    OSSemPost(&rtos_semaphore_p->sem_os_semaphore, OS_OPT_POST_1, &os_err);
+    OSSemPend(&rtos_semaphore_p->sem_os_semaphore,
+              0,
+              OS_OPT_PEND_NON_BLOCKING,
+              NULL,
+              &os_err);
+
+    if (os_err == OS_ERR_PEND_WOULD_BLOCK) {
+        return false;
+    }
+
     if (os_err != OS_ERR_NONE) {
-        error_t error = CAPTURE_ERROR("OSSemPost() failed", os_err, rtos_semaphore_p);
+        error_t error = CAPTURE_ERROR("OSSemPend() failed", os_err,
+                                      rtos_semaphore_p);
         fatal_error_handler(error);
+        /*UNREACHABLE*/
     }
+
+    return true;
 }
 
 
@@ -477,6 +1098,7 @@ void rtos_semaphore_broadcast(struct rtos_semaphore *rtos_semaphore_p)
 
     D_ASSERT(rtos_semaphore_p->sem_signature == SEMAPHORE_SIGNATURE);
 
+    TRACE_RECORD(TRACE_EVENT_SEM_SIGNAL, rtos_semaphore_p, 0);
     OSSemPost(&rtos_semaphore_p->sem_os_semaphore, OS_OPT_POST_ALL, &os_err);
     if (os_err != OS_ERR_NONE) {
         error_t error = CAPTURE_ERROR("OSSemPost() failed", os_err, rtos_semaphore_p);
@@ -485,6 +1107,108 @@ void rtos_semaphore_broadcast(struct rtos_semaphore *rtos_semaphore_p)
 }
 
 
+/**
+ * Initializes a single-waiter signal
+ *
+ * @param rtos_signal_p pointer to the signal object
+ * @param waiter_task_p task that waits on the signal, or NULL, if it is not
+ *        known yet. In that case, the first task that calls
+ *        rtos_signal_wait() becomes the waiter task.
+ */
+void rtos_signal_init(struct rtos_signal *rtos_signal_p,
+                      struct rtos_task *waiter_task_p)
+{
+    D_ASSERT(rtos_signal_p != NULL);
+    D_ASSERT(waiter_task_p == NULL ||
+             waiter_task_p->tsk_signature == TASK_SIGNATURE);
+
+    rtos_signal_p->sig_signature = SIGNAL_SIGNATURE;
+    rtos_signal_p->sig_waiter_task_p = waiter_task_p;
+    rtos_signal_p->sig_early_count = 0;
+}
+
+
+/**
+ * Makes the calling task the waiter task of a single-waiter signal, if the
+ * waiter task was not known yet. Signals sent before that are transferred
+ * to the task's built-in semaphore.
+ */
+static void rtos_signal_set_waiter(struct rtos_signal *rtos_signal_p)
+{
+    struct rtos_task *const task_p = rtos_task_self();
+    uint32_t early_count;
+
+    D_ASSERT(rtos_signal_p->sig_signature == SIGNAL_SIGNATURE);
+    if (rtos_signal_p->sig_waiter_task_p == task_p) {
+        return;
+    }
+
+    D_ASSERT(rtos_signal_p->sig_waiter_task_p == NULL);
+    uint32_t old_primask = disable_cpu_interrupts();
+    rtos_signal_p->sig_waiter_task_p = task_p;
+    early_count = rtos_signal_p->sig_early_count;
+    rtos_signal_p->sig_early_count = 0;
+    restore_cpu_interrupts(old_primask);
+
+    for ( ; early_count != 0; early_count --) {
+        rtos_task_semaphore_signal(task_p);
+    }
+}
+
+
+/**
+ * Waits on a single-waiter signal. It must always be called by the same
+ * task.
+ */
+void rtos_signal_wait(struct rtos_signal *rtos_signal_p)
+{
+    rtos_signal_set_waiter(rtos_signal_p);
+    rtos_task_semaphore_wait();
+}
+
+
+/**
+ * Waits on a single-waiter signal, with a timeout. It must always be called
+ * by the same task.
+ *
+ * @return true, if the signal was signaled
+ * @return false, if the wait timed out
+ */
+bool rtos_signal_wait_timeout(struct rtos_signal *rtos_signal_p,
+                              uint32_t timeout_ms)
+{
+    rtos_signal_set_waiter(rtos_signal_p);
+    return rtos_task_semaphore_wait_timeout(timeout_ms);
+}
+
+
+/**
+ * Signals a single-waiter signal. It can be called from a task or from an
+ * ISR.
+ */
+void rtos_signal_signal(struct rtos_signal *rtos_signal_p)
+{
+    struct rtos_task *task_p;
+
+    D_ASSERT(rtos_signal_p->sig_signature == SIGNAL_SIGNATURE);
+    task_p = rtos_signal_p->sig_waiter_task_p;
+    if (task_p == NULL) {
+        uint32_t old_primask = disable_cpu_interrupts();
+
+        task_p = rtos_signal_p->sig_waiter_task_p;
+        if (task_p == NULL) {
+            rtos_signal_p->sig_early_count ++;
+            restore_cpu_interrupts(old_primask);
+            return;
+        }
+
+        restore_cpu_interrupts(old_primask);
+    }
+
+    rtos_task_semaphore_signal(task_p);
+}
+
+
 /**
  * Initializes an RTOS-level timer
  */
@@ -503,6 +1227,7 @@ void rtos_timer_init(struct rtos_timer *rtos_timer_p,
 
     D_ASSERT(rtos_timer_p != NULL);
     rtos_timer_p->tmr_signature = TIMER_SIGNATURE;
+    rtos_timer_p->tmr_isr_context = false;
 
     if (periodic) {
         OSTmrCreate(&rtos_timer_p->tmr_os_timer,
@@ -531,6 +1256,57 @@ void rtos_timer_init(struct rtos_timer *rtos_timer_p,
 }
 
 
+/**
+ * Callback of the high-resolution timer of an ISR-context RTOS-level timer
+ */
+static void rtos_timer_isr_context_callback(struct hr_timer *hr_timer_p,
+                                            void *arg)
+{
+    struct rtos_timer *rtos_timer_p = arg;
+
+    D_ASSERT(rtos_timer_p->tmr_signature == TIMER_SIGNATURE);
+    D_ASSERT(hr_timer_p == &rtos_timer_p->tmr_hr_timer);
+    rtos_timer_p->tmr_callback_p(rtos_timer_p, rtos_timer_p->tmr_callback_arg);
+}
+
+
+/**
+ * Initializes an RTOS-level timer whose callback is invoked in ISR context,
+ * from the high-resolution timer service, instead of from the RTOS timer
+ * task. The callback must be short and must not block. The timer can be
+ * started only after hr_timer_service_init() has been called.
+ *
+ * @param rtos_timer_p      Pointer to the timer
+ * @param timer_name_p      Timer name (not used, since ISR-context timers
+ *                          are not known to the RTOS)
+ * @param microseconds      Timeout and, for periodic timers, period in
+ *                          microseconds (at most HR_TIMER_MAX_TIMEOUT_US)
+ * @param periodic          Flag indicating if the timer is periodic
+ * @param timer_callback_p  Function to call when the timer expires
+ * @param arg               Argument for timer_callback_p
+ */
+void rtos_timer_init_isr_context(struct rtos_timer *rtos_timer_p,
+                                 const char *timer_name_p,
+                                 uint32_t microseconds,
+                                 bool periodic,
+                                 rtos_timer_callback_t *timer_callback_p,
+                                 void *arg)
+{
+    D_ASSERT(rtos_timer_p != NULL);
+    D_ASSERT(timer_callback_p != NULL);
+    D_ASSERT(microseconds != 0 && microseconds <= HR_TIMER_MAX_TIMEOUT_US);
+
+    rtos_timer_p->tmr_signature = TIMER_SIGNATURE;
+    rtos_timer_p->tmr_isr_context = true;
+    rtos_timer_p->tmr_timeout_us = microseconds;
+    rtos_timer_p->tmr_period_us = periodic ? microseconds : 0;
+    rtos_timer_p->tmr_callback_p = timer_callback_p;
+    rtos_timer_p->tmr_callback_arg = arg;
+    hr_timer_init(&rtos_timer_p->tmr_hr_timer, rtos_timer_isr_context_callback,
+                  rtos_timer_p);
+}
+
+
 /**
  * Starts an RTOS-level timer
  */
@@ -540,6 +1316,13 @@ void rtos_timer_start(struct rtos_timer *rtos_timer_p)
     bool timer_started;
 
     D_ASSERT(rtos_timer_p->tmr_signature == TIMER_SIGNATURE);
+    if (rtos_timer_p->tmr_isr_context) {
+        hr_timer_start(&rtos_timer_p->tmr_hr_timer,
+                       rtos_timer_p->tmr_timeout_us,
+                       rtos_timer_p->tmr_period_us);
+        return;
+    }
+
     timer_started = OSTmrStart(&rtos_timer_p->tmr_os_timer, &os_err);
     if (os_err != OS_ERR_NONE) {
         error_t error = CAPTURE_ERROR("OSTmrStart() failed", os_err, rtos_timer_p);
@@ -559,6 +1342,11 @@ void rtos_timer_stop(struct rtos_timer *rtos_timer_p)
     bool timer_stopped;
 
     D_ASSERT(rtos_timer_p->tmr_signature == TIMER_SIGNATURE);
+    if (rtos_timer_p->tmr_isr_context) {
+        hr_timer_stop(&rtos_timer_p->tmr_hr_timer);
+        return;
+    }
+
     timer_stopped = OSTmrStop(&rtos_timer_p->tmr_os_timer, OS_OPT_TMR_NONE,
                               NULL, &os_err);
     if (os_err != OS_ERR_NONE) {
@@ -571,29 +1359,54 @@ void rtos_timer_stop(struct rtos_timer *rtos_timer_p)
 
 
 /**
- * Check if stack overflow has occurred on the task stack.
- * It updates task-p->tsk_max_stack_entries_used.
+ * Measures the high water mark of a task's stack, by scanning the stack
+ * from its far end (the stack grows towards lower addresses) until an entry
+ * that no longer holds the paint pattern is found. It updates
+ * task_p->tsk_max_stack_entries_used.
+ *
+ * NOTE: An entry that the task happened to write with the paint pattern
+ * value itself is counted as unused, so the result may under-report usage
+ * by a few entries in the worst case.
+ *
+ * @param task_p    Pointer to the task
+ *
+ * @return maximum number of stack entries ever used by the task
  */
-void rtos_task_check_stack(struct rtos_task *task_p)
+uint32_t rtos_task_get_stack_usage(struct rtos_task *task_p)
 {
-    OS_ERR os_err;
-    CPU_STK_SIZE  free_entries;
-    CPU_STK_SIZE  used_entries;
-
-    D_ASSERT(task_p->tsk_created);
+    uint32_t unused_entries = 0;
 
-    OSTaskStkChk(&task_p->tsk_tcb, &free_entries, &used_entries, &os_err);
-    if (os_err != OS_ERR_NONE) {
-        error_t error = CAPTURE_ERROR("OSTaskStkChk() failed", os_err, task_p);
-        fatal_error_handler(error);
+    D_ASSERT(task_p->tsk_signature == TASK_SIGNATURE);
+    while (unused_entries < APP_TASK_STACK_SIZE &&
+           task_p->tsk_stack[unused_entries] == STACK_PAINT_PATTERN) {
+        unused_entries++;
     }
 
+    uint32_t used_entries = APP_TASK_STACK_SIZE - unused_entries;
+
     if (used_entries > task_p->tsk_max_stack_entries_used) {
         task_p->tsk_max_stack_entries_used = used_entries;
     }
 
+    return task_p->tsk_max_stack_entries_used;
+}
+
+
+/**
+ * Check if stack overflow has occurred on the task stack.
+ * It updates task_p->tsk_max_stack_entries_used.
+ */
+void rtos_task_check_stack(struct rtos_task *task_p)
+{
+    uint32_t used_entries;
+
+    D_ASSERT(task_p->tsk_created);
+
+    used_entries = rtos_task_get_stack_usage(task_p);
+
     if (used_entries >= APP_TASK_STACK_SIZE ||
-        task_p->tsk_stack_overflow_marker != STACK_OVERFLOW_MARKER) {
+        task_p->tsk_stack_guard[ARRAY_SIZE(task_p->tsk_stack_guard) - 1] !=
+            STACK_OVERFLOW_MARKER) {
         /*
          * Stack overflow detected
          */
@@ -618,28 +1431,28 @@ void rtos_task_check_stack(struct rtos_task *task_p)
 
 
 /**
- * Return Time since boot in ticks
+ * Checks if the stack guard watchpoint has been hit, that is, if the
+ * running task has overflowed its stack. If so, it reports a fatal error,
+ * as the task has already written past the end of its stack. Otherwise, it
+ * just returns.
+ *
+ * NOTE: This function is to be called from the debug monitor exception
+ * handler. Reading DWT FUNCTION0 clears its MATCHED flag.
  */
-uint32_t rtos_get_ticks_since_boot(void)
+void rtos_task_stack_guard_check(void)
 {
-    OS_ERR os_err;
-    OS_TICK ticks;
-
-    ticks = OSTimeGet(&os_err);
-    if (os_err != OS_ERR_NONE) {
-        error_t error = CAPTURE_ERROR("OSTimeGet() failed", os_err, ticks);
-        fatal_error_handler(error);
-        /*UNREACHABLE*/
+    if ((DWT->FUNCTION0 & DWT_FUNCTION_MATCHED_Msk) == 0) {
+        return;
     }
 
-    return ticks;
-}
+    struct rtos_task *task_p = OSTCBCurPtr->ExtPtr;
 
+    D_ASSERT(task_p != NULL && task_p->tsk_signature == TASK_SIGNATURE);
+    ERROR_PRINTF("\n*** Stack overflow detected for task '%s'\n",
+                 task_p->tsk_name_p);
 
-/**
- * Return Time since boot in seconds
- */
-uint32_t rtos_get_time_since_boot(void)
-{
-    return rtos_get_ticks_since_boot() / OSCfg_TickRate_Hz;
+    error_t error = CAPTURE_ERROR("Stack overflow", task_p, DWT->COMP0);
+    fatal_error_handler(error);
 }
+
+
@@ -11,6 +11,7 @@
 #include "atomic_utils.h"
 #include "microcontroller.h"
 #include "runtime_log.h"
+#include "crash_dump.h"
 
 /**
  * Handles debug-assertion violations
@@ -43,6 +44,8 @@ void debug_assert_failure(const char *cond_str, const char *func_name,
                    cond_str, func_name, file_name, line);
 
     ERROR_PRINTF("Assertion failed at %s:%d\n", file_name, line);
+    crash_dump_capture(CRASH_CAUSE_ASSERTION_FAILURE,
+                       GET_CALL_ADDRESS(__builtin_return_address(0)));
 
     /*
      * If running under the debugger, break into it. Otherwise,
@@ -118,6 +121,7 @@ void fatal_error_handler(error_t error)
     g_handling_fatal_error = true;
     color_led_set(LED_COLOR_RED);
     console_printf("\n*** Fatal error %#x ***\n", error);
+    crash_dump_capture(CRASH_CAUSE_FATAL_ERROR, error);
 
     /*
      * If running under the debugger, break into it. Otherwise,
@@ -105,6 +105,12 @@ void debug_assert_failure(const char *cond_str, const char *func_name,
  */
 #define STACK_UNDERFLOW_MARKER   GEN_SIGNATURE('S', 'T', 'K', 'U')
 
+/**
+ * Value every entry of a task stack is painted with when the task is
+ * created, so that its high water mark can be measured later
+ */
+#define STACK_PAINT_PATTERN   GEN_SIGNATURE('S', 'T', 'K', 'P')
+
 /**
  * Runtime error code type. It encodes the code location where
  * the error originated.
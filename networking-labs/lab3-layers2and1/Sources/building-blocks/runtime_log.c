@@ -16,16 +16,31 @@
 #include "arm_cortex_m_defs.h"
 #include "rtos_wrapper.h"
 #include "serial_console.h"
+#include "text_format.h"
 #include <stdarg.h>
-#include <print_scan.h>
+#include <string.h>
 
 /*
  * Sizes (in bytes) of the runtime log buffers
  */
-#define DEBUG_LOG_BUFFER_SIZE     (2 * UINT32_C(1024))
+#define DEBUG_LOG_BUFFER_SIZE     (4 * UINT32_C(1024))
 #define ERROR_LOG_BUFFER_SIZE     (1 * UINT32_C(1024))
 #define INFO_LOG_BUFFER_SIZE      (1 * UINT32_C(1024))
 
+/*
+ * Number of rings of each runtime log. A log with more than one ring keeps
+ * ring 0 for entries written from interrupt handlers or with interrupts
+ * disabled, and spreads tasks over the other rings, so that tasks logging
+ * to different rings do not contend for the same mutex.
+ */
+#define DEBUG_LOG_NUM_RINGS       4
+#define ERROR_LOG_NUM_RINGS       1
+#define INFO_LOG_NUM_RINGS        1
+
+#define RUNTIME_LOG_MAX_RINGS     DEBUG_LOG_NUM_RINGS
+
+C_ASSERT(DEBUG_LOG_BUFFER_SIZE % DEBUG_LOG_NUM_RINGS == 0);
+
 /**
  * Max number of stack trace entries to be captured for
  * a runtime log entry.
@@ -33,12 +48,25 @@
 #define RUNTIME_LOG_MAX_STACK_TRACE_ENTRIES    8
 
 /**
- * A runtime log
+ * Size (in bytes) of the span where the text of a runtime log entry is
+ * formatted, before being copied to the log ring
  */
-struct runtime_log {
+#define RUNTIME_LOG_FORMAT_CHUNK_SIZE          32
+
+/**
+ * Number of entries of the binary runtime log (must be a power of 2)
+ */
+#define RUNTIME_BINARY_LOG_NUM_ENTRIES          64
+
+C_ASSERT((RUNTIME_BINARY_LOG_NUM_ENTRIES & (RUNTIME_BINARY_LOG_NUM_ENTRIES - 1)) == 0);
+
+/**
+ * Ring buffer of a runtime log
+ */
+struct runtime_log_ring {
     /**
      * Buffer where the most recent output generated by runtime_log_printf()
-     * is stored
+     * for this ring is stored
      */
     char *buffer_p;
 
@@ -47,6 +75,26 @@ struct runtime_log {
      */
     uint16_t buffer_size;
 
+    /**
+     * Next position to fill in buffer
+     */
+    uint16_t cursor;
+
+    /**
+     * Number of times the ring buffer has wrapped around.
+     */
+    uint32_t wrap_count;
+
+    /**
+     * Mutex to serialize writes to the ring from tasks
+     */
+    struct rtos_mutex mutex;
+};
+
+/**
+ * A runtime log
+ */
+struct runtime_log {
     /**
      * Logging flags
      */
@@ -54,24 +102,70 @@ struct runtime_log {
 #   define PRINT_STACK_TRACE    BIT(0)
 
     /**
-     * Next position to fill in buffer
+     * Number of entries of rings[] in use
      */
-    uint16_t cursor;
+    uint16_t num_rings;
 
     /**
-     * Sequence number for next message to store in buffer
+     * Sequence number for next message to store in the log. It is shared
+     * by all the log's rings, so that their entries can be merged in the
+     * order in which they were written, when the log is dumped.
      */
-    uint16_t seq_num;
+    volatile uint32_t seq_num;
 
     /**
-     * Number of times the log buffer has wrapped around.
+     * Ring buffers where the log's entries are stored
      */
-    uint32_t wrap_count;
+    struct runtime_log_ring rings[RUNTIME_LOG_MAX_RINGS];
+};
 
+/**
+ * Entry of the binary runtime log
+ */
+struct runtime_binary_log_entry {
     /**
-     * Mutex to serialize writes to the log
+     * Sequence number of the entry plus 1, or 0 if the entry is being
+     * written. It is written last, so that a reader can tell if the rest of
+     * the entry is consistent.
      */
-    struct rtos_mutex mutex;
+    volatile uint32_t seq_num_plus_1;
+
+    /**
+     * Format string (not copied)
+     */
+    const char *fmt_p;
+
+    /**
+     * Timestamps
+     */
+    uint32_t ticks;
+    uint32_t cpu_cycles;
+
+    /**
+     * Task that wrote the entry
+     */
+    struct rtos_task *task_p;
+
+    /**
+     * Raw arguments for fmt_p
+     */
+    uint32_t args[RUNTIME_BINARY_LOG_MAX_ARGS];
+};
+
+/**
+ * Binary runtime log: ring of fixed-size entries. Writers reserve an entry
+ * by atomically incrementing next_seq_num, so writers never wait for each
+ * other, not even when a writer is preempted by an interrupt handler that
+ * also logs.
+ */
+struct runtime_binary_log {
+    /**
+     * Sequence number of the next entry to reserve. The entry index in the
+     * ring is the sequence number modulo the number of entries.
+     */
+    volatile uint32_t next_seq_num;
+
+    struct runtime_binary_log_entry entries[RUNTIME_BINARY_LOG_NUM_ENTRIES];
 };
 
 /**
@@ -92,25 +186,42 @@ static struct {
      * Array of runtime logs:
      */
     struct runtime_log logs[NUM_RUNTIME_LOGS];
+
+    /**
+     * Binary runtime log
+     */
+    struct runtime_binary_log binary_log;
 } g_runtime_logs __attribute__ ((section(".runtime_logs")));
 
 
 static void runtime_log_init(struct runtime_log *runtime_log_p,
                              char *buffer_p,
                              uint_fast16_t buffer_size,
+                             uint_fast16_t num_rings,
                              uint_fast16_t flags,
                              uint32_t cpu_reset_count)
 {
+    D_ASSERT(num_rings >= 1 && num_rings <= RUNTIME_LOG_MAX_RINGS);
+
+    uint_fast16_t ring_size = buffer_size / num_rings;
+
     if (cpu_reset_count == 0) {
-        runtime_log_p->buffer_p = buffer_p;
-        runtime_log_p->buffer_size = buffer_size;
         runtime_log_p->flags = flags;
-        runtime_log_p->cursor = 0;
+        runtime_log_p->num_rings = num_rings;
         runtime_log_p->seq_num = 0;
-        runtime_log_p->wrap_count = 0;
+        for (uint_fast16_t i = 0; i < num_rings; i ++) {
+            struct runtime_log_ring *ring_p = &runtime_log_p->rings[i];
+
+            ring_p->buffer_p = buffer_p + i * ring_size;
+            ring_p->buffer_size = ring_size;
+            ring_p->cursor = 0;
+            ring_p->wrap_count = 0;
+        }
     }
 
-    rtos_mutex_init(&runtime_log_p->mutex, "runtime log mutex");
+    for (uint_fast16_t i = 0; i < num_rings; i ++) {
+        rtos_mutex_init(&runtime_log_p->rings[i].mutex, "runtime log mutex");
+    }
 }
 
 
@@ -122,23 +233,27 @@ void init_runtime_logs(void)
     static const struct {
         char *buffer_p;
         uint16_t buffer_size;
+        uint16_t num_rings;
         uint16_t flags;
     } logs_config[] = {
         [RUNTIME_DEBUG_LOG] = {
             .buffer_p = g_runtime_logs.debug_log_buffer,
             .buffer_size = sizeof(g_runtime_logs.debug_log_buffer),
+            .num_rings = DEBUG_LOG_NUM_RINGS,
             .flags = PRINT_STACK_TRACE,
         },
 
         [RUNTIME_ERROR_LOG] = {
             .buffer_p = g_runtime_logs.error_log_buffer,
             .buffer_size = sizeof(g_runtime_logs.error_log_buffer),
+            .num_rings = ERROR_LOG_NUM_RINGS,
             .flags = PRINT_STACK_TRACE,
         },
 
         [RUNTIME_INFO_LOG] = {
             .buffer_p = g_runtime_logs.info_log_buffer,
             .buffer_size = sizeof(g_runtime_logs.info_log_buffer),
+            .num_rings = INFO_LOG_NUM_RINGS,
             .flags = 0x0,
         },
     };
@@ -147,10 +262,18 @@ void init_runtime_logs(void)
 
     uint32_t cpu_reset_count = read_cpu_reset_counter();
 
+    if (cpu_reset_count == 0) {
+        g_runtime_logs.binary_log.next_seq_num = 0;
+        for (uint_fast8_t i = 0; i < RUNTIME_BINARY_LOG_NUM_ENTRIES; i ++) {
+            g_runtime_logs.binary_log.entries[i].seq_num_plus_1 = 0;
+        }
+    }
+
     for (uint_fast8_t i = 0; i < NUM_RUNTIME_LOGS; i ++) {
         runtime_log_init(&g_runtime_logs.logs[i],
                          logs_config[i].buffer_p,
                          logs_config[i].buffer_size,
+                         logs_config[i].num_rings,
                          logs_config[i].flags,
                          cpu_reset_count);
 
@@ -162,30 +285,60 @@ void init_runtime_logs(void)
 }
 
 
-/**
- * Callback function invoked from the KSDK _doprint() function
- */
 static int runtime_log_putchar(int c, void *putchar_arg_p)
 {
-    struct runtime_log *runtime_log_p = putchar_arg_p;
-    uint_fast16_t cursor = runtime_log_p->cursor;
+    struct runtime_log_ring *ring_p = putchar_arg_p;
+    uint_fast16_t cursor = ring_p->cursor;
 
-    runtime_log_p->buffer_p[cursor] = c;
+    ring_p->buffer_p[cursor] = c;
     cursor ++;
-    if (cursor == runtime_log_p->buffer_size) {
+    if (cursor == ring_p->buffer_size) {
         cursor = 0;
-        runtime_log_p->wrap_count ++;
+        ring_p->wrap_count ++;
     }
 
-    runtime_log_p->cursor = cursor;
+    ring_p->cursor = cursor;
     return 0;
 }
 
 
+/**
+ * Flush function for the format span of runtime_log_vprintf(). It copies
+ * the formatted text to the log ring, with at most two memcpy's (one before
+ * and one after the wrap-around point).
+ */
+static void runtime_log_span_flush(struct format_span *span_p)
+{
+    struct runtime_log_ring *ring_p = span_p->flush_arg_p;
+    const char *chars_p = span_p->buffer_p;
+    size_t num_chars = span_p->length;
+
+    while (num_chars != 0) {
+        size_t chunk_size = ring_p->buffer_size - ring_p->cursor;
+
+        if (chunk_size > num_chars) {
+            chunk_size = num_chars;
+        }
+
+        memcpy(&ring_p->buffer_p[ring_p->cursor], chars_p, chunk_size);
+        ring_p->cursor += chunk_size;
+        if (ring_p->cursor == ring_p->buffer_size) {
+            ring_p->cursor = 0;
+            ring_p->wrap_count ++;
+        }
+
+        chars_p += chunk_size;
+        num_chars -= chunk_size;
+    }
+
+    span_p->length = 0;
+}
+
+
 /**
  * Prints a 32-bit unsigned integer in decimal
  */
-static void runtime_log_print_uint32_decimal(struct runtime_log *runtime_log_p,
+static void runtime_log_print_uint32_decimal(struct runtime_log_ring *ring_p,
                                              uint32_t value)
 {
     char buffer[11];
@@ -199,7 +352,7 @@ static void runtime_log_print_uint32_decimal(struct runtime_log *runtime_log_p,
     } while (value > 0);
 
     while (*s != '\0') {
-        runtime_log_putchar(*s, runtime_log_p);
+        runtime_log_putchar(*s, ring_p);
         s ++;
     }
 }
@@ -209,15 +362,15 @@ static void runtime_log_print_uint32_decimal(struct runtime_log *runtime_log_p,
  * Prints a 32-bit unsigned integer in hexadecimal
  */
 static void runtime_log_print_uint32_hexdecimal(
-                struct runtime_log *runtime_log_p,
+                struct runtime_log_ring *ring_p,
                 uint32_t value)
 {
     char buffer[9];
     uint_fast8_t  hex_digit;
     char *s = &buffer[sizeof(buffer) - 1];
 
-    runtime_log_putchar('0', runtime_log_p);
-    runtime_log_putchar('x', runtime_log_p);
+    runtime_log_putchar('0', ring_p);
+    runtime_log_putchar('x', ring_p);
     *s = '\0';
     do {
         s--;
@@ -232,13 +385,13 @@ static void runtime_log_print_uint32_hexdecimal(
     } while (value > 0);
 
     while (*s != '\0') {
-        runtime_log_putchar(*s, runtime_log_p);
+        runtime_log_putchar(*s, ring_p);
         s ++;
     }
 }
 
 
-static void runtime_log_print_stack_trace(struct runtime_log *runtime_log_p,
+static void runtime_log_print_stack_trace(struct runtime_log_ring *ring_p,
                                           uint_fast8_t num_entries_to_skip)
 {
     uintptr_t trace_buff[RUNTIME_LOG_MAX_STACK_TRACE_ENTRIES];
@@ -249,10 +402,50 @@ static void runtime_log_print_stack_trace(struct runtime_log *runtime_log_p,
                         &num_trace_entries);
 
     for (uint_fast8_t i = 0; i < num_trace_entries; i ++) {
-        runtime_log_putchar('\t', runtime_log_p);
-        runtime_log_print_uint32_hexdecimal(runtime_log_p, trace_buff[i]);
-        runtime_log_putchar('\n', runtime_log_p);
+        runtime_log_putchar('\t', ring_p);
+        runtime_log_print_uint32_hexdecimal(ring_p, trace_buff[i]);
+        runtime_log_putchar('\n', ring_p);
+    }
+}
+
+
+/**
+ * Selects the ring of a runtime log where the caller's next entry goes
+ *
+ * @param runtime_log_p     Pointer to the runtime log
+ * @param use_mutex_p       Output: true if the ring's mutex must be held
+ *                          while writing the entry, false if CPU interrupts
+ *                          must be disabled instead
+ *
+ * @return pointer to the selected ring
+ */
+static struct runtime_log_ring *runtime_log_select_ring(
+                                    struct runtime_log *runtime_log_p,
+                                    bool *use_mutex_p)
+{
+    if (CPU_INTERRUPTS_ARE_DISABLED() || CPU_MODE_IS_HANDLER()) {
+        *use_mutex_p = false;
+        return &runtime_log_p->rings[0];
+    }
+
+    if (runtime_log_p->num_rings == 1) {
+        *use_mutex_p = true;
+        return &runtime_log_p->rings[0];
+    }
+
+    struct rtos_task *task_p = rtos_task_self();
+
+    if (task_p == NULL) {
+        /*
+         * Caller runs before the RTOS has been started:
+         */
+        *use_mutex_p = false;
+        return &runtime_log_p->rings[0];
     }
+
+    *use_mutex_p = true;
+    return &runtime_log_p->rings[1 + task_p->tsk_index %
+                                     (runtime_log_p->num_rings - 1)];
 }
 
 
@@ -260,40 +453,50 @@ static void runtime_log_vprintf(struct runtime_log *runtime_log_p,
                                 const char *fmt,
                                 va_list va)
 {
+    struct runtime_log_ring *ring_p;
     bool use_mutex;
     uint32_t int_mask;
+    char chunk[RUNTIME_LOG_FORMAT_CHUNK_SIZE];
+    struct format_span span;
 
-    if (CPU_INTERRUPTS_ARE_DISABLED() || CPU_MODE_IS_HANDLER()) {
-        use_mutex = false;
-        int_mask = disable_cpu_interrupts();
+    ring_p = runtime_log_select_ring(runtime_log_p, &use_mutex);
+    if (use_mutex) {
+        rtos_mutex_lock(&ring_p->mutex);
     } else  {
-        use_mutex = true;
-        rtos_mutex_lock(&runtime_log_p->mutex);
+        int_mask = disable_cpu_interrupts();
     }
 
-    runtime_log_print_uint32_decimal(runtime_log_p, runtime_log_p->seq_num);
-    runtime_log_putchar(':', runtime_log_p);
+    /*
+     * The sequence number is taken while holding the ring, so that the
+     * entries of each ring are stored in sequence number order:
+     */
+    uint32_t seq_num = ATOMIC_POST_INCREMENT_UINT32(&runtime_log_p->seq_num);
+
+    runtime_log_putchar(RUNTIME_LOG_ENTRY_START, ring_p);
+    runtime_log_print_uint32_decimal(ring_p, seq_num);
+    runtime_log_putchar(':', ring_p);
 
-    runtime_log_print_uint32_decimal(runtime_log_p, rtos_get_ticks_since_boot());
-    runtime_log_putchar(':', runtime_log_p);
+    runtime_log_print_uint32_decimal(ring_p, rtos_get_ticks_since_boot());
+    runtime_log_putchar(':', ring_p);
 
-    runtime_log_print_uint32_decimal(runtime_log_p, get_cpu_clock_cycles());
-    runtime_log_putchar(':', runtime_log_p);
+    runtime_log_print_uint32_decimal(ring_p, get_cpu_clock_cycles());
+    runtime_log_putchar(':', ring_p);
 
     struct rtos_task *task_p = rtos_task_self();
 
-    runtime_log_print_uint32_hexdecimal(runtime_log_p, (uintptr_t)task_p);
-    runtime_log_putchar(':', runtime_log_p);
+    runtime_log_print_uint32_hexdecimal(ring_p, (uintptr_t)task_p);
+    runtime_log_putchar(':', ring_p);
 
-    (void)_doprint(runtime_log_p, runtime_log_putchar, -1, (char *)fmt, va);
+    format_span_init(&span, chunk, sizeof chunk, runtime_log_span_flush, ring_p);
+    (void)text_format_vprintf(&span, fmt, va);
+    format_span_flush(&span);
 
     if (runtime_log_p->flags & PRINT_STACK_TRACE) {
-        runtime_log_print_stack_trace(runtime_log_p, 3);
+        runtime_log_print_stack_trace(ring_p, 3);
     }
 
-    runtime_log_p->seq_num ++;
     if (use_mutex) {
-        rtos_mutex_unlock(&runtime_log_p->mutex);
+        rtos_mutex_unlock(&ring_p->mutex);
     } else {
         restore_cpu_interrupts(int_mask);
     }
@@ -320,17 +523,277 @@ void runtime_log_printf(enum runtime_logs log, const char *fmt, ...)
 
 
 /**
- * Dumps the contents of the given runtime log buffer to the serial console
+ * Records an entry in the binary runtime log. It is meant to be invoked
+ * through the BINARY_LOG() macro. It can be called from any context,
+ * including interrupt handlers.
+ *
+ * @param fmt       format string (must be a string literal)
+ * @param num_args  number of 32-bit arguments that follow
+ *                  (at most RUNTIME_BINARY_LOG_MAX_ARGS)
+ */
+void runtime_log_binary(const char *fmt, uint_fast8_t num_args, ...)
+{
+    struct runtime_binary_log *binary_log_p = &g_runtime_logs.binary_log;
+    va_list va;
+    uint_fast8_t i;
+
+    D_ASSERT(num_args <= RUNTIME_BINARY_LOG_MAX_ARGS);
+
+    uint32_t seq_num = ATOMIC_POST_INCREMENT_UINT32(&binary_log_p->next_seq_num);
+    struct runtime_binary_log_entry *entry_p =
+        &binary_log_p->entries[seq_num & (RUNTIME_BINARY_LOG_NUM_ENTRIES - 1)];
+
+    entry_p->seq_num_plus_1 = 0;
+    __DMB();
+    entry_p->fmt_p = fmt;
+    entry_p->ticks = rtos_get_ticks_since_boot();
+    entry_p->cpu_cycles = get_cpu_clock_cycles();
+    entry_p->task_p = rtos_task_self();
+
+    va_start(va, num_args);
+    for (i = 0; i < num_args; i ++) {
+        entry_p->args[i] = va_arg(va, uint32_t);
+    }
+
+    va_end(va);
+    for ( ; i < RUNTIME_BINARY_LOG_MAX_ARGS; i ++) {
+        entry_p->args[i] = 0;
+    }
+
+    __DMB();
+    entry_p->seq_num_plus_1 = seq_num + 1;
+}
+
+
+/**
+ * Dumps the contents of the binary runtime log to the serial console,
+ * formatting its entries. Entries that are overwritten or still being
+ * written while they are dumped are skipped.
+ */
+void runtime_log_dump_binary(void)
+{
+    struct runtime_binary_log *binary_log_p = &g_runtime_logs.binary_log;
+    struct runtime_binary_log_entry entry;
+    uint32_t next_seq_num = binary_log_p->next_seq_num;
+    uint32_t seq_num;
+
+    if (next_seq_num > RUNTIME_BINARY_LOG_NUM_ENTRIES) {
+        seq_num = next_seq_num - RUNTIME_BINARY_LOG_NUM_ENTRIES;
+    } else {
+        seq_num = 0;
+    }
+
+    console_printf("Binary log (%u entries recorded):\n"
+                   "(sequence number:ticks since boot:CPU cycles:task pointer:message)\n",
+                   next_seq_num);
+
+    for ( ; seq_num != next_seq_num; seq_num ++) {
+        struct runtime_binary_log_entry *entry_p =
+            &binary_log_p->entries[seq_num & (RUNTIME_BINARY_LOG_NUM_ENTRIES - 1)];
+
+        if (entry_p->seq_num_plus_1 != seq_num + 1) {
+            continue;
+        }
+
+        entry = *entry_p;
+        __DMB();
+        if (entry_p->seq_num_plus_1 != seq_num + 1) {
+            /*
+             * Entry overwritten while being copied:
+             */
+            continue;
+        }
+
+        console_printf("%u:%u:%u:%#x:", seq_num, entry.ticks, entry.cpu_cycles,
+                       (uintptr_t)entry.task_p);
+
+        C_ASSERT(RUNTIME_BINARY_LOG_MAX_ARGS == 4);
+        console_printf(entry.fmt_p, entry.args[0], entry.args[1],
+                       entry.args[2], entry.args[3]);
+    }
+
+    console_putchar('\n');
+}
+
+
+/**
+ * Names of the runtime logs, as printed in their dumps
+ */
+static const char *const g_runtime_log_names[] = {
+    [RUNTIME_DEBUG_LOG] = "Debug",
+    [RUNTIME_ERROR_LOG] = "Error",
+    [RUNTIME_INFO_LOG] = "Info",
+};
+
+C_ASSERT(ARRAY_SIZE(g_runtime_log_names) == NUM_RUNTIME_LOGS);
+
+/**
+ * State of the traversal of a runtime log ring, from its oldest entry to its
+ * newest entry, when dumping the runtime log
+ */
+struct runtime_log_ring_reader {
+    const struct runtime_log_ring *ring_p;
+
+    /**
+     * Index in the ring buffer of the oldest byte stored in the ring
+     */
+    uint16_t start;
+
+    /**
+     * Number of bytes stored in the ring
+     */
+    uint16_t length;
+
+    /**
+     * Offset, from the oldest byte, of the start of the current entry, or
+     * 'length' if there are no entries left
+     */
+    uint16_t offset;
+
+    /**
+     * Sequence number of the current entry
+     */
+    uint32_t seq_num;
+};
+
+
+static char runtime_log_ring_reader_get_char(
+                const struct runtime_log_ring_reader *reader_p,
+                uint_fast16_t offset)
+{
+    const struct runtime_log_ring *ring_p = reader_p->ring_p;
+    uint_fast16_t i = reader_p->start + offset;
+
+    if (i >= ring_p->buffer_size) {
+        i -= ring_p->buffer_size;
+    }
+
+    return ring_p->buffer_p[i];
+}
+
+
+/**
+ * Moves a ring reader to the first entry that starts at or after a given
+ * offset, and parses that entry's sequence number
+ */
+static void runtime_log_ring_reader_seek(struct runtime_log_ring_reader *reader_p,
+                                         uint_fast16_t offset)
+{
+    while (offset < reader_p->length &&
+           runtime_log_ring_reader_get_char(reader_p, offset) !=
+                RUNTIME_LOG_ENTRY_START) {
+        offset ++;
+    }
+
+    reader_p->offset = offset;
+    reader_p->seq_num = 0;
+    for (offset ++; offset < reader_p->length; offset ++) {
+        char c = runtime_log_ring_reader_get_char(reader_p, offset);
+
+        if (c < '0' || c > '9') {
+            break;
+        }
+
+        reader_p->seq_num = reader_p->seq_num * 10 + (c - '0');
+    }
+}
+
+
+static void runtime_log_ring_reader_init(struct runtime_log_ring_reader *reader_p,
+                                         const struct runtime_log_ring *ring_p)
+{
+    reader_p->ring_p = ring_p;
+    if (ring_p->wrap_count == 0) {
+        reader_p->start = 0;
+        reader_p->length = ring_p->cursor;
+    } else {
+        reader_p->start = ring_p->cursor;
+        reader_p->length = ring_p->buffer_size;
+    }
+
+    /*
+     * If the ring has wrapped, its oldest entry may have been partially
+     * overwritten, so it is skipped:
+     */
+    runtime_log_ring_reader_seek(reader_p, 0);
+}
+
+
+/**
+ * Returns the offset of the end of the current entry of a ring reader
+ */
+static uint_fast16_t runtime_log_ring_reader_entry_end(
+                        const struct runtime_log_ring_reader *reader_p)
+{
+    uint_fast16_t offset;
+
+    for (offset = reader_p->offset + 1; offset < reader_p->length; offset ++) {
+        if (runtime_log_ring_reader_get_char(reader_p, offset) ==
+                RUNTIME_LOG_ENTRY_START) {
+            break;
+        }
+    }
+
+    return offset;
+}
+
+
+/**
+ * Prints the current entry of a ring reader to the serial console and moves
+ * the reader to the next entry
+ */
+static void runtime_log_ring_reader_dump_entry(
+                struct runtime_log_ring_reader *reader_p)
+{
+    uint_fast16_t end_offset = runtime_log_ring_reader_entry_end(reader_p);
+
+    for (uint_fast16_t offset = reader_p->offset + 1; offset < end_offset;
+         offset ++) {
+        console_putchar(runtime_log_ring_reader_get_char(reader_p, offset));
+    }
+
+    runtime_log_ring_reader_seek(reader_p, end_offset);
+}
+
+
+/**
+ * Returns the ring reader whose current entry is the oldest one, or NULL
+ * if all the readers have reached the end of their rings
+ */
+static struct runtime_log_ring_reader *runtime_log_find_oldest_entry(
+                                        struct runtime_log_ring_reader readers[],
+                                        uint_fast16_t num_readers)
+{
+    struct runtime_log_ring_reader *oldest_reader_p = NULL;
+
+    for (uint_fast16_t i = 0; i < num_readers; i ++) {
+        struct runtime_log_ring_reader *reader_p = &readers[i];
+
+        if (reader_p->offset == reader_p->length) {
+            continue;
+        }
+
+        if (oldest_reader_p == NULL ||
+            (int32_t)(reader_p->seq_num - oldest_reader_p->seq_num) < 0) {
+            oldest_reader_p = reader_p;
+        }
+    }
+
+    return oldest_reader_p;
+}
+
+
+/**
+ * Dumps the contents of the given runtime log buffer to the serial console.
+ * The entries of all the log's rings are merged in the order in which they
+ * were written.
  *
  * @param log    index of the log to be dumped
  */
 void runtime_log_dump(enum runtime_logs log)
 {
-    static const char *const log_names[] = {
-        [RUNTIME_DEBUG_LOG] = "Debug",
-        [RUNTIME_ERROR_LOG] = "Error",
-        [RUNTIME_INFO_LOG] = "Info",
-    };
+    struct runtime_log_ring_reader readers[RUNTIME_LOG_MAX_RINGS];
+    uint32_t wrap_count = 0;
 
     if (log >= NUM_RUNTIME_LOGS) {
         console_printf("Invalid runtime log index: %d\n", log);
@@ -338,21 +801,246 @@ void runtime_log_dump(enum runtime_logs log)
     }
 
     struct runtime_log *runtime_log_p = &g_runtime_logs.logs[log];
-    char *end_p;
+    uint_fast16_t num_rings = runtime_log_p->num_rings;
+
+    for (uint_fast16_t i = 0; i < num_rings; i ++) {
+        runtime_log_ring_reader_init(&readers[i], &runtime_log_p->rings[i]);
+        wrap_count += runtime_log_p->rings[i].wrap_count;
+    }
 
     console_printf("%s log (wrap count: %u):\n"
                    "(sequence number:ticks since boot:CPU cycles:task pointer:message)\n",
-                   log_names[log], runtime_log_p->wrap_count);
+                   g_runtime_log_names[log], wrap_count);
 
-    if (runtime_log_p->wrap_count == 0) {
-        end_p = runtime_log_p->buffer_p + runtime_log_p->cursor;
-    } else {
-        end_p = runtime_log_p->buffer_p + runtime_log_p->buffer_size;
-    }
+    for ( ; ; ) {
+        struct runtime_log_ring_reader *oldest_reader_p =
+            runtime_log_find_oldest_entry(readers, num_rings);
 
-    for (char *p = runtime_log_p->buffer_p; p != end_p; p ++) {
-        console_putchar(*p);
+        if (oldest_reader_p == NULL) {
+            break;
+        }
+
+        runtime_log_ring_reader_dump_entry(oldest_reader_p);
     }
 
     console_putchar('\n');
 }
+
+
+/**
+ * Dumps to the serial console only the entries of a runtime log that are not
+ * older than a given sequence number, in the order in which they were
+ * written, without the header printed by runtime_log_dump(). Called
+ * repeatedly with the cursor it returns, it prints only the entries added
+ * since the previous call, so that polling tools can fetch log deltas
+ * cheaply.
+ *
+ * As with runtime_log_dump(), writers are not held off, so an entry being
+ * written while the log is dumped may come out garbled.
+ *
+ * @param log           index of the log to be dumped
+ * @param seq_num_p     On input, sequence number of the first entry to dump.
+ *                      On output, sequence number of the entry that follows
+ *                      the last entry dumped, to be passed in the next call.
+ *
+ * @return number of entries, starting at the given sequence number, that
+ *         were overwritten before they could be dumped
+ */
+uint32_t runtime_log_dump_since(enum runtime_logs log, uint32_t *seq_num_p)
+{
+    struct runtime_log_ring_reader readers[RUNTIME_LOG_MAX_RINGS];
+    uint32_t next_seq_num = *seq_num_p;
+    uint32_t num_lost_entries = 0;
+
+    D_ASSERT(log < NUM_RUNTIME_LOGS);
+
+    struct runtime_log *runtime_log_p = &g_runtime_logs.logs[log];
+    uint_fast16_t num_rings = runtime_log_p->num_rings;
+
+    for (uint_fast16_t i = 0; i < num_rings; i ++) {
+        struct runtime_log_ring_reader *reader_p = &readers[i];
+
+        runtime_log_ring_reader_init(reader_p, &runtime_log_p->rings[i]);
+        while (reader_p->offset < reader_p->length &&
+               (int32_t)(reader_p->seq_num - next_seq_num) < 0) {
+            runtime_log_ring_reader_seek(reader_p, reader_p->offset + 1);
+        }
+    }
+
+    for ( ; ; ) {
+        struct runtime_log_ring_reader *reader_p =
+            runtime_log_find_oldest_entry(readers, num_rings);
+
+        if (reader_p == NULL) {
+            break;
+        }
+
+        num_lost_entries += reader_p->seq_num - next_seq_num;
+        next_seq_num = reader_p->seq_num + 1;
+        runtime_log_ring_reader_dump_entry(reader_p);
+    }
+
+    *seq_num_p = next_seq_num;
+    return num_lost_entries;
+}
+
+
+/**
+ * Returns the sequence number that the next entry of a runtime log will
+ * have
+ *
+ * @param log   index of the log
+ */
+uint32_t runtime_log_get_seq_num(enum runtime_logs log)
+{
+    D_ASSERT(log < NUM_RUNTIME_LOGS);
+    return g_runtime_logs.logs[log].seq_num;
+}
+
+
+/**
+ * Copies the entries of a runtime log, starting at a given sequence number,
+ * to a buffer, in the order in which they were written. Each entry copied
+ * starts with RUNTIME_LOG_ENTRY_START. Only whole entries are copied, except
+ * when the first entry does not fit in the buffer, in which case it is
+ * truncated.
+ *
+ * Writers to the log are held off while the entries are copied, so that no
+ * partially written entries are seen. So, this function can only be called
+ * from a task.
+ *
+ * @param log                   index of the log to be read
+ * @param seq_num_p             On input, sequence number of the first entry
+ *                              to copy. On output, sequence number of the
+ *                              entry that follows the last entry copied (or
+ *                              lost).
+ * @param buffer_p              Buffer where entries are to be copied
+ * @param buffer_size           Buffer size in bytes
+ * @param num_lost_entries_p    Output: number of entries, starting at the
+ *                              given sequence number, that were overwritten
+ *                              before they could be copied
+ *
+ * @return number of bytes copied to the buffer
+ */
+size_t runtime_log_read_entries(enum runtime_logs log,
+                                uint32_t *seq_num_p,
+                                char *buffer_p,
+                                size_t buffer_size,
+                                uint32_t *num_lost_entries_p)
+{
+    struct runtime_log_ring_reader readers[RUNTIME_LOG_MAX_RINGS];
+    uint32_t next_seq_num = *seq_num_p;
+    uint32_t num_lost_entries = 0;
+    size_t bytes_copied = 0;
+    uint_fast16_t i;
+    uint32_t int_mask;
+
+    D_ASSERT(CALLER_IS_THREAD());
+    D_ASSERT(log < NUM_RUNTIME_LOGS);
+    D_ASSERT(buffer_size != 0);
+
+    struct runtime_log *runtime_log_p = &g_runtime_logs.logs[log];
+    uint_fast16_t num_rings = runtime_log_p->num_rings;
+
+    /*
+     * Hold off writers from tasks and then writers from interrupt context
+     * (writers only hold one ring at a time, so there is no lock ordering
+     * issue):
+     */
+    for (i = 0; i < num_rings; i ++) {
+        rtos_mutex_lock(&runtime_log_p->rings[i].mutex);
+    }
+
+    int_mask = disable_cpu_interrupts();
+
+    for (i = 0; i < num_rings; i ++) {
+        struct runtime_log_ring_reader *reader_p = &readers[i];
+
+        runtime_log_ring_reader_init(reader_p, &runtime_log_p->rings[i]);
+        while (reader_p->offset < reader_p->length &&
+               (int32_t)(reader_p->seq_num - next_seq_num) < 0) {
+            runtime_log_ring_reader_seek(reader_p, reader_p->offset + 1);
+        }
+    }
+
+    for ( ; ; ) {
+        struct runtime_log_ring_reader *reader_p =
+            runtime_log_find_oldest_entry(readers, num_rings);
+
+        if (reader_p == NULL) {
+            /*
+             * Entries not found in any ring were overwritten:
+             */
+            num_lost_entries += runtime_log_p->seq_num - next_seq_num;
+            next_seq_num = runtime_log_p->seq_num;
+            break;
+        }
+
+        uint_fast16_t end_offset = runtime_log_ring_reader_entry_end(reader_p);
+        size_t entry_length = end_offset - reader_p->offset;
+
+        if (bytes_copied + entry_length > buffer_size) {
+            if (bytes_copied != 0) {
+                break;
+            }
+
+            entry_length = buffer_size;
+        }
+
+        for (size_t j = 0; j < entry_length; j ++) {
+            buffer_p[bytes_copied + j] =
+                runtime_log_ring_reader_get_char(reader_p, reader_p->offset + j);
+        }
+
+        bytes_copied += entry_length;
+        num_lost_entries += reader_p->seq_num - next_seq_num;
+        next_seq_num = reader_p->seq_num + 1;
+        runtime_log_ring_reader_seek(reader_p, end_offset);
+    }
+
+    restore_cpu_interrupts(int_mask);
+
+    for (i = num_rings; i > 0; i --) {
+        rtos_mutex_unlock(&runtime_log_p->rings[i - 1].mutex);
+    }
+
+    *seq_num_p = next_seq_num;
+    *num_lost_entries_p = num_lost_entries;
+    return bytes_copied;
+}
+
+
+/**
+ * Copies the text of the most recent entries of a runtime log to a buffer,
+ * oldest first, without holding off writers. It is meant to be called
+ * from a fatal error handler, with interrupts disabled, to save a log
+ * elsewhere. Only the log's ring 0, which has all the entries of single-ring
+ * logs, is copied. Each entry copied starts with RUNTIME_LOG_ENTRY_START.
+ *
+ * @param log           index of the log to be copied
+ * @param buffer_p      Buffer where entries are to be copied
+ * @param buffer_size   Buffer size in bytes
+ *
+ * @return number of bytes copied to the buffer
+ */
+size_t runtime_log_snapshot(enum runtime_logs log,
+                            char *buffer_p,
+                            size_t buffer_size)
+{
+    struct runtime_log_ring_reader reader;
+
+    D_ASSERT(log < NUM_RUNTIME_LOGS);
+
+    runtime_log_ring_reader_init(&reader, &g_runtime_logs.logs[log].rings[0]);
+    if (reader.length - reader.offset > buffer_size) {
+        runtime_log_ring_reader_seek(&reader, reader.length - buffer_size);
+    }
+
+    size_t num_bytes = reader.length - reader.offset;
+
+    for (size_t i = 0; i < num_bytes; i ++) {
+        buffer_p[i] = runtime_log_ring_reader_get_char(&reader, reader.offset + i);
+    }
+
+    return num_bytes;
+}
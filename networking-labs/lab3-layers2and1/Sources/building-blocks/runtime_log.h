@@ -8,23 +8,115 @@
 #ifndef SOURCES_BUILDING_BLOCKS_RUNTIME_LOG_H_
 #define SOURCES_BUILDING_BLOCKS_RUNTIME_LOG_H_
 
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Runtime log levels. Messages above the level selected at compile time
+ * with RUNTIME_LOG_LEVEL are compiled out, including the evaluation of
+ * their arguments.
+ */
+#define RUNTIME_LOG_LEVEL_NONE      0
+#define RUNTIME_LOG_LEVEL_ERROR     1
+#define RUNTIME_LOG_LEVEL_INFO      2
+#define RUNTIME_LOG_LEVEL_DEBUG     3
+
+#ifndef RUNTIME_LOG_LEVEL
+#define RUNTIME_LOG_LEVEL           RUNTIME_LOG_LEVEL_DEBUG
+#endif
+
+/*
+ * Modules that can generate trace messages at run time. Tracing for the
+ * modules not in RUNTIME_LOG_MODULES_MASK is compiled out, so that their
+ * run-time tracing checks disappear from the hot paths.
+ */
+#define RUNTIME_LOG_MODULE_NET_LAYER2   (UINT32_C(1) << 0)
+#define RUNTIME_LOG_MODULE_NET_LAYER3   (UINT32_C(1) << 1)
+#define RUNTIME_LOG_MODULE_NET_LAYER4   (UINT32_C(1) << 2)
+
+#ifndef RUNTIME_LOG_MODULES_MASK
+#define RUNTIME_LOG_MODULES_MASK    (RUNTIME_LOG_MODULE_NET_LAYER2 | \
+                                     RUNTIME_LOG_MODULE_NET_LAYER3 | \
+                                     RUNTIME_LOG_MODULE_NET_LAYER4)
+#endif
+
+/**
+ * Tells if tracing is on for a given module. It evaluates to a constant
+ * false, without reading the run-time flag, if the module's tracing is
+ * compiled out.
+ *
+ * @param _module       RUNTIME_LOG_MODULE_xxx value
+ * @param _tracing_on   module's run-time tracing flag
+ */
+#define RUNTIME_LOG_TRACING_ON(_module, _tracing_on) \
+        (RUNTIME_LOG_LEVEL >= RUNTIME_LOG_LEVEL_DEBUG && \
+         (RUNTIME_LOG_MODULES_MASK & (_module)) != 0 && \
+         (_tracing_on))
+
 /**
  * Prints a debug message to the runtime debug log
  */
 #define DEBUG_PRINTF(_fmt, ...) \
-        runtime_log_printf(RUNTIME_DEBUG_LOG, _fmt, ##__VA_ARGS__)
+        do {                                                            \
+            if (RUNTIME_LOG_LEVEL >= RUNTIME_LOG_LEVEL_DEBUG) {         \
+                runtime_log_printf(RUNTIME_DEBUG_LOG, _fmt, ##__VA_ARGS__); \
+            }                                                           \
+        } while (0)
 
 /**
  * Prints an error message to the runtime error log
  */
 #define ERROR_PRINTF(_fmt, ...) \
-        runtime_log_printf(RUNTIME_ERROR_LOG, _fmt, ##__VA_ARGS__)
+        do {                                                            \
+            if (RUNTIME_LOG_LEVEL >= RUNTIME_LOG_LEVEL_ERROR) {         \
+                runtime_log_printf(RUNTIME_ERROR_LOG, _fmt, ##__VA_ARGS__); \
+            }                                                           \
+        } while (0)
 
 /**
  * Prints an informational message to the runtime error log
  */
 #define INFO_PRINTF(_fmt, ...) \
-        runtime_log_printf(RUNTIME_INFO_LOG, _fmt, ##__VA_ARGS__)
+        do {                                                            \
+            if (RUNTIME_LOG_LEVEL >= RUNTIME_LOG_LEVEL_INFO) {          \
+                runtime_log_printf(RUNTIME_INFO_LOG, _fmt, ##__VA_ARGS__);  \
+            }                                                           \
+        } while (0)
+
+/**
+ * Maximum number of arguments of a binary log entry
+ */
+#define RUNTIME_BINARY_LOG_MAX_ARGS     4
+
+/**
+ * Records a message in the binary runtime log. Unlike the other runtime log
+ * macros, the message is not formatted at this time: only the format string
+ * pointer, a timestamp and up to RUNTIME_BINARY_LOG_MAX_ARGS 32-bit
+ * arguments are stored, with a single atomic reservation and without
+ * taking any lock or disabling interrupts. The message is formatted by
+ * runtime_log_dump_binary(). Therefore, the format string must be a string
+ * literal, and the arguments must be integers or pointers to data that does
+ * not change (for example, string literals).
+ */
+#define BINARY_LOG(_fmt, ...) \
+        runtime_log_binary(_fmt, RUNTIME_BINARY_LOG_NUM_ARGS(__VA_ARGS__), \
+                           ##__VA_ARGS__)
+
+/**
+ * Number of arguments passed to BINARY_LOG() (0 to
+ * RUNTIME_BINARY_LOG_MAX_ARGS)
+ */
+#define RUNTIME_BINARY_LOG_NUM_ARGS(...) \
+        _RUNTIME_BINARY_LOG_NUM_ARGS(_dummy, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+
+#define _RUNTIME_BINARY_LOG_NUM_ARGS(_0, _1, _2, _3, _4, _num_args, ...) \
+        _num_args
+
+/**
+ * Character that marks the start of each entry of a runtime log, as stored
+ * in its ring buffers and as returned by runtime_log_read_entries()
+ */
+#define RUNTIME_LOG_ENTRY_START   '\x1e'
 
 /**
  * Runtime logs
@@ -46,4 +138,22 @@ void runtime_log_printf(enum runtime_logs log, const char *fmt, ...);
 
 void runtime_log_dump(enum runtime_logs log);
 
+uint32_t runtime_log_dump_since(enum runtime_logs log, uint32_t *seq_num_p);
+
+uint32_t runtime_log_get_seq_num(enum runtime_logs log);
+
+size_t runtime_log_read_entries(enum runtime_logs log,
+                                uint32_t *seq_num_p,
+                                char *buffer_p,
+                                size_t buffer_size,
+                                uint32_t *num_lost_entries_p);
+
+size_t runtime_log_snapshot(enum runtime_logs log,
+                            char *buffer_p,
+                            size_t buffer_size);
+
+void runtime_log_binary(const char *fmt, uint_fast8_t num_args, ...);
+
+void runtime_log_dump_binary(void);
+
 #endif /* SOURCES_BUILDING_BLOCKS_RUNTIME_LOG_H_ */
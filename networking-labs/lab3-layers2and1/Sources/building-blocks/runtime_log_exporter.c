@@ -0,0 +1,373 @@
+/**
+ * @file runtime_log_exporter.c
+ *
+ * Runtime log exporter implementation
+ *
+ * @author German Rivera
+ */
+#include "runtime_log_exporter.h"
+#include "networking_layer4.h"
+#include "networking_layer2.h"
+#include "rtos_wrapper.h"
+#include "arm_cortex_m_defs.h"
+#include "mem_utils.h"
+#include <string.h>
+
+/**
+ * Period of the runtime log exporter task in milliseconds
+ */
+#define RUNTIME_LOG_EXPORTER_PERIOD_MS                  100
+
+/**
+ * Maximum number of datagrams sent per log in each period of the runtime
+ * log exporter task, to bound the bandwidth and CPU time used by the
+ * exporter
+ */
+#define RUNTIME_LOG_EXPORTER_MAX_DATAGRAMS_PER_PERIOD   4
+
+/**
+ * Local UDP port used by the runtime log exporter
+ */
+#define RUNTIME_LOG_EXPORTER_LOCAL_PORT                 8891
+
+/**
+ * Maximum number of bytes of log entries per datagram
+ */
+#define RUNTIME_LOG_EXPORTER_MAX_ENTRIES_SIZE \
+        (NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE - \
+         sizeof(struct runtime_log_export_header))
+
+/**
+ * Outcome of exporting a batch of log entries
+ */
+enum runtime_log_export_result {
+    /*
+     * No more entries to export for now
+     */
+    RUNTIME_LOG_EXPORT_DONE = 0,
+
+    /*
+     * A datagram was sent and there may be more entries to export
+     */
+    RUNTIME_LOG_EXPORT_MORE,
+
+    /*
+     * No Tx packet was available or the datagram could not be sent, so
+     * the export must be retried in the next period
+     */
+    RUNTIME_LOG_EXPORT_STALLED,
+};
+
+/**
+ * Runtime log exporter state
+ */
+struct runtime_log_exporter {
+    bool initialized;
+
+    /**
+     * Flag indicating if entries are to be exported
+     */
+    volatile bool enabled;
+
+    /**
+     * Address of the collector
+     */
+    struct ipv4_address collector_ip_addr;
+
+    /**
+     * UDP port of the collector (big endian)
+     */
+    uint16_t collector_port;
+
+    /**
+     * Sequence number of the next entry to export for each log
+     */
+    uint32_t next_seq_nums[NUM_RUNTIME_LOGS];
+
+    /**
+     * Flags indicating, for each log, if next_seq_nums[] is in sync with
+     * the log. Entries overwritten before the exporter was started, or
+     * while it was stopped, are not accounted as lost.
+     */
+    bool synced[NUM_RUNTIME_LOGS];
+
+    /**
+     * Number of entries of each log lost so far
+     */
+    uint32_t total_lost_entries[NUM_RUNTIME_LOGS];
+
+    /**
+     * Sequence number of the next datagram to send
+     */
+    uint32_t next_datagram_seq_num;
+
+    struct runtime_log_exporter_stats stats;
+
+    /**
+     * Mutex to serialize access to this structure
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Local UDP end point
+     */
+    struct net_layer4_end_point end_point;
+
+    /**
+     * Exporter task
+     */
+    struct rtos_task task;
+};
+
+static struct runtime_log_exporter g_runtime_log_exporter = {
+    .initialized = false,
+    .enabled = false,
+};
+
+
+/**
+ * Sends the next batch of entries of a given log to the collector in one
+ * UDP datagram. Must be called with the exporter's mutex held.
+ */
+static enum runtime_log_export_result runtime_log_exporter_export_batch(
+    struct runtime_log_exporter *exporter_p,
+    enum runtime_logs log)
+{
+    uint32_t num_lost_entries;
+    error_t error;
+
+    /*
+     * If no Tx packet is available, the network is busy: the entries stay
+     * in the log, and we retry in the next period:
+     */
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(NET_PACKET_DATA_BUFFER_SIZE, true);
+
+    if (tx_packet_p == NULL) {
+        exporter_p->stats.backpressure_stalls ++;
+        return RUNTIME_LOG_EXPORT_STALLED;
+    }
+
+    struct runtime_log_export_header *header_p =
+        get_ipv4_udp_data_payload_area(tx_packet_p);
+    uint32_t seq_num = exporter_p->next_seq_nums[log];
+    size_t entries_size = runtime_log_read_entries(log,
+                                                   &seq_num,
+                                                   (char *)(header_p + 1),
+                                                   RUNTIME_LOG_EXPORTER_MAX_ENTRIES_SIZE,
+                                                   &num_lost_entries);
+
+    if (!exporter_p->synced[log]) {
+        num_lost_entries = 0;
+        exporter_p->synced[log] = true;
+    }
+
+    uint32_t num_entries = seq_num - exporter_p->next_seq_nums[log] -
+                           num_lost_entries;
+
+    exporter_p->next_seq_nums[log] = seq_num;
+    exporter_p->total_lost_entries[log] += num_lost_entries;
+    exporter_p->stats.lost_entries += num_lost_entries;
+
+    if (entries_size == 0) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+        return RUNTIME_LOG_EXPORT_DONE;
+    }
+
+    header_p->magic = hton32(RUNTIME_LOG_EXPORT_MAGIC);
+    header_p->version = RUNTIME_LOG_EXPORT_VERSION;
+    header_p->log = log;
+    header_p->num_entries = hton16(num_entries);
+    header_p->datagram_seq_num = hton32(exporter_p->next_datagram_seq_num);
+    header_p->num_lost_entries = hton32(num_lost_entries);
+    header_p->total_lost_entries = hton32(exporter_p->total_lost_entries[log]);
+
+    error = net_layer4_send_udp_datagram_over_ipv4(&exporter_p->end_point,
+                                                   &exporter_p->collector_ip_addr,
+                                                   exporter_p->collector_port,
+                                                   tx_packet_p,
+                                                   sizeof(*header_p) + entries_size);
+    if (error != 0) {
+        NET_PACKET_CLEAR_STATE_FLAG(tx_packet_p, NET_PACKET_FREE_AFTER_TX_COMPLETE);
+        net_layer2_free_tx_packet(tx_packet_p);
+        exporter_p->stats.send_failures ++;
+        exporter_p->total_lost_entries[log] += num_entries;
+        exporter_p->stats.lost_entries += num_entries;
+        return RUNTIME_LOG_EXPORT_STALLED;
+    }
+
+    exporter_p->next_datagram_seq_num ++;
+    exporter_p->stats.datagrams_sent ++;
+    exporter_p->stats.exported_entries += num_entries;
+    return RUNTIME_LOG_EXPORT_MORE;
+}
+
+
+/**
+ * Runtime log exporter task
+ */
+static void runtime_log_exporter_task_func(void *arg)
+{
+    struct runtime_log_exporter *exporter_p = arg;
+
+    D_ASSERT(exporter_p == &g_runtime_log_exporter);
+
+    for ( ; ; ) {
+        rtos_task_delay(RUNTIME_LOG_EXPORTER_PERIOD_MS);
+
+#       ifdef USE_MPU
+        struct mpu_region_range old_comp_region;
+
+        rtos_thread_set_comp_region(exporter_p,
+                                    sizeof *exporter_p,
+                                    0,
+                                    &old_comp_region);
+#       endif
+
+        rtos_mutex_lock(&exporter_p->mutex);
+
+        for (uint_fast8_t log = 0; log < NUM_RUNTIME_LOGS && exporter_p->enabled;
+             log ++) {
+            enum runtime_log_export_result result = RUNTIME_LOG_EXPORT_DONE;
+
+            for (uint_fast8_t i = 0; i < RUNTIME_LOG_EXPORTER_MAX_DATAGRAMS_PER_PERIOD;
+                 i ++) {
+                result = runtime_log_exporter_export_batch(exporter_p, log);
+                if (result != RUNTIME_LOG_EXPORT_MORE) {
+                    break;
+                }
+            }
+
+            if (result == RUNTIME_LOG_EXPORT_STALLED) {
+                break;
+            }
+        }
+
+        rtos_mutex_unlock(&exporter_p->mutex);
+
+#       ifdef USE_MPU
+        rtos_thread_restore_comp_region(&old_comp_region);
+#       endif
+    }
+}
+
+
+/**
+ * Starts exporting the runtime logs to a given collector. The first time
+ * it is called, it creates the exporter task. If the exporter is already
+ * running, it just switches to the new collector.
+ *
+ * @param collector_ip_addr_p   IPv4 address of the collector
+ * @param collector_port        UDP port of the collector (big endian)
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t runtime_log_exporter_start(const struct ipv4_address *collector_ip_addr_p,
+                                   uint16_t collector_port /* big endian */)
+{
+    struct runtime_log_exporter *const exporter_p = &g_runtime_log_exporter;
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(exporter_p,
+                                sizeof *exporter_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    if (!exporter_p->initialized) {
+        rtos_mutex_init(&exporter_p->mutex, "Runtime log exporter mutex");
+        net_layer4_udp_end_point_init(&exporter_p->end_point);
+        error = net_layer4_udp_end_point_bind(&exporter_p->end_point,
+                                              hton16(RUNTIME_LOG_EXPORTER_LOCAL_PORT));
+        if (error != 0) {
+            goto common_exit;
+        }
+
+        exporter_p->initialized = true;
+        rtos_task_create(&exporter_p->task,
+                         "Runtime log exporter task",
+                         runtime_log_exporter_task_func,
+                         exporter_p,
+                         RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
+    }
+
+    rtos_mutex_lock(&exporter_p->mutex);
+    exporter_p->collector_ip_addr = *collector_ip_addr_p;
+    exporter_p->collector_port = collector_port;
+    if (!exporter_p->enabled) {
+        for (uint_fast8_t i = 0; i < NUM_RUNTIME_LOGS; i ++) {
+            exporter_p->synced[i] = false;
+        }
+
+        exporter_p->enabled = true;
+    }
+
+    rtos_mutex_unlock(&exporter_p->mutex);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Stops exporting the runtime logs. The exporter task stays idle until
+ * runtime_log_exporter_start() is called again.
+ */
+void runtime_log_exporter_stop(void)
+{
+    struct runtime_log_exporter *const exporter_p = &g_runtime_log_exporter;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    if (!exporter_p->initialized) {
+        return;
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(exporter_p,
+                                sizeof *exporter_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&exporter_p->mutex);
+    exporter_p->enabled = false;
+    rtos_mutex_unlock(&exporter_p->mutex);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Takes a snapshot of the runtime log exporter statistics
+ *
+ * @param stats_p   Area where the snapshot is to be returned
+ */
+void runtime_log_exporter_get_stats(struct runtime_log_exporter_stats *stats_p)
+{
+    struct runtime_log_exporter *const exporter_p = &g_runtime_log_exporter;
+
+    if (!exporter_p->initialized) {
+        memset(stats_p, 0, sizeof *stats_p);
+        return;
+    }
+
+    rtos_mutex_lock(&exporter_p->mutex);
+    *stats_p = exporter_p->stats;
+    rtos_mutex_unlock(&exporter_p->mutex);
+}
@@ -0,0 +1,109 @@
+/**
+ * @file runtime_log_exporter.h
+ *
+ * Runtime log exporter interface
+ *
+ * The runtime log exporter is a background task that periodically drains
+ * new entries from the runtime logs and sends them, in batches, in UDP
+ * datagrams to a remote collector. If the network cannot keep up, entries
+ * stay in the runtime log rings until they are overwritten, and then they
+ * are accounted as lost, so that the collector can tell that there are gaps.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_RUNTIME_LOG_EXPORTER_H_
+#define SOURCES_BUILDING_BLOCKS_RUNTIME_LOG_EXPORTER_H_
+
+#include <stdint.h>
+#include "runtime_log.h"
+#include "networking_layer3.h"
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+
+/**
+ * Default UDP port of the runtime log collector
+ */
+#define RUNTIME_LOG_EXPORTER_DEFAULT_COLLECTOR_PORT  8890
+
+/**
+ * Header of a runtime log export datagram. It is followed by the text of
+ * the log entries, each of which starts with RUNTIME_LOG_ENTRY_START.
+ * All fields are big endian.
+ */
+struct runtime_log_export_header {
+#   define RUNTIME_LOG_EXPORT_MAGIC  GEN_SIGNATURE('R', 'L', 'O', 'G')
+    uint32_t magic;
+
+#   define RUNTIME_LOG_EXPORT_VERSION  1
+    uint8_t version;
+
+    /**
+     * Runtime log the entries come from (enum runtime_logs)
+     */
+    uint8_t log;
+
+    /**
+     * Number of log entries in the datagram
+     */
+    uint16_t num_entries;
+
+    /**
+     * Sequence number of the datagram, so that the collector can detect
+     * lost datagrams
+     */
+    uint32_t datagram_seq_num;
+
+    /**
+     * Number of log entries that were overwritten, before they could be
+     * exported, right before the entries in this datagram
+     */
+    uint32_t num_lost_entries;
+
+    /**
+     * Total number of log entries of this log lost so far
+     */
+    uint32_t total_lost_entries;
+};
+
+C_ASSERT(sizeof(struct runtime_log_export_header) == 20);
+
+/**
+ * Runtime log exporter statistics
+ */
+struct runtime_log_exporter_stats {
+    /**
+     * Number of log entries exported
+     */
+    uint32_t exported_entries;
+
+    /**
+     * Number of log entries overwritten before they could be exported, or
+     * whose datagram could not be sent
+     */
+    uint32_t lost_entries;
+
+    /**
+     * Number of datagrams sent
+     */
+    uint32_t datagrams_sent;
+
+    /**
+     * Number of datagrams that could not be sent
+     */
+    uint32_t send_failures;
+
+    /**
+     * Number of times the export was deferred to the next period, because
+     * no Tx packet was available
+     */
+    uint32_t backpressure_stalls;
+};
+
+error_t runtime_log_exporter_start(const struct ipv4_address *collector_ip_addr_p,
+                                   uint16_t collector_port /* big endian */);
+
+void runtime_log_exporter_stop(void);
+
+void runtime_log_exporter_get_stats(struct runtime_log_exporter_stats *stats_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_RUNTIME_LOG_EXPORTER_H_ */
@@ -0,0 +1,283 @@
+/**
+ * @file sampling_profiler.c
+ *
+ * Sampling profiler implementation
+ *
+ * @author German Rivera
+ */
+#include "sampling_profiler.h"
+#include "stack_trace.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+#include "io_utils.h"
+#include "mem_utils.h"
+#include "serial_console.h"
+#include "interrupt_vector_table.h"
+#include "microcontroller.h"
+
+/**
+ * Maximum number of entries of the hash table probed for a stack trace,
+ * before giving up on recording a sample
+ */
+#define SAMPLING_PROFILER_MAX_PROBES    8
+
+C_ASSERT(MCU_BUS_CLOCK_FREQ_IN_HZ / SAMPLING_PROFILER_SAMPLE_RATE_HZ > 1);
+
+/**
+ * Entry of the stack trace hash table
+ */
+struct sampling_profiler_stack {
+    /**
+     * Number of samples with this stack trace (0 means the entry is free)
+     */
+    uint32_t count;
+
+    /**
+     * Number of entries of stack_trace[] filled
+     */
+    uint8_t depth;
+
+    /**
+     * Stack trace, starting with the sampled instruction
+     */
+    uintptr_t stack_trace[SAMPLING_PROFILER_MAX_DEPTH];
+};
+
+/**
+ * Sampling profiler state
+ */
+struct sampling_profiler {
+    /**
+     * Flag indicating if samples are being taken
+     */
+    volatile bool enabled;
+
+    /**
+     * Number of samples taken
+     */
+    uint32_t samples_count;
+
+    /**
+     * Number of samples for which no stack trace could be captured
+     */
+    uint32_t failed_samples_count;
+
+    /**
+     * Number of samples not recorded, because the hash table was too full
+     */
+    uint32_t dropped_samples_count;
+
+    /**
+     * Number of distinct stack traces recorded
+     */
+    uint32_t num_stacks;
+
+    /**
+     * Hash table of stack traces
+     */
+    struct sampling_profiler_stack stacks[SAMPLING_PROFILER_NUM_STACKS];
+};
+
+static struct sampling_profiler g_sampling_profiler;
+
+
+static uint32_t stack_trace_hash(const uintptr_t stack_trace[],
+                                 uint_fast8_t depth)
+{
+    uint32_t hash = 2166136261u;
+
+    for (uint_fast8_t i = 0; i < depth; i ++) {
+        hash = (hash ^ stack_trace[i]) * 16777619u;
+    }
+
+    return hash ^ (hash >> 16);
+}
+
+
+static bool stack_trace_equal(const struct sampling_profiler_stack *stack_p,
+                              const uintptr_t stack_trace[],
+                              uint_fast8_t depth)
+{
+    if (stack_p->depth != depth) {
+        return false;
+    }
+
+    for (uint_fast8_t i = 0; i < depth; i ++) {
+        if (stack_p->stack_trace[i] != stack_trace[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Takes a sample of the code interrupted by the sampling timer interrupt and
+ * records it in the stack trace hash table (linear probing)
+ */
+static void sampling_profiler_take_sample(void)
+{
+    struct sampling_profiler *const profiler_p = &g_sampling_profiler;
+    uintptr_t stack_trace[SAMPLING_PROFILER_MAX_DEPTH];
+    uint_fast8_t depth = SAMPLING_PROFILER_MAX_DEPTH;
+
+    profiler_p->samples_count ++;
+    stack_trace_capture_interrupted(stack_trace, &depth);
+    if (depth == 0) {
+        profiler_p->failed_samples_count ++;
+        return;
+    }
+
+    uint32_t hash = stack_trace_hash(stack_trace, depth);
+
+    for (uint_fast8_t i = 0; i < SAMPLING_PROFILER_MAX_PROBES; i ++) {
+        struct sampling_profiler_stack *stack_p =
+            &profiler_p->stacks[(hash + i) & (SAMPLING_PROFILER_NUM_STACKS - 1)];
+
+        if (stack_p->count == 0) {
+            for (uint_fast8_t j = 0; j < depth; j ++) {
+                stack_p->stack_trace[j] = stack_trace[j];
+            }
+
+            stack_p->depth = depth;
+            stack_p->count = 1;
+            profiler_p->num_stacks ++;
+            return;
+        }
+
+        if (stack_trace_equal(stack_p, stack_trace, depth)) {
+            stack_p->count ++;
+            return;
+        }
+    }
+
+    profiler_p->dropped_samples_count ++;
+}
+
+
+/**
+ * Initializes the sampling profiler. Sampling is started by
+ * sampling_profiler_enable().
+ */
+void sampling_profiler_init(void)
+{
+    uint32_t reg_value;
+
+    /*
+     * Enable clock for the PIT peripheral:
+     */
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC6);
+    reg_value |= SIM_SCGC6_PIT_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC6, reg_value);
+
+    /*
+     * Enable the PIT module, and stop its timers while the CPU is halted
+     * in the debugger:
+     */
+    WRITE_MMIO_REGISTER(&PIT_MCR, PIT_MCR_FRZ_MASK);
+
+    WRITE_MMIO_REGISTER(&PIT_LDVAL0,
+                        MCU_BUS_CLOCK_FREQ_IN_HZ / SAMPLING_PROFILER_SAMPLE_RATE_HZ - 1);
+    WRITE_MMIO_REGISTER(&PIT_TFLG0, PIT_TFLG_TIF_MASK);
+
+    /*
+     * The sampling timer interrupt has the highest priority, so that
+     * other interrupt handlers can be sampled too:
+     */
+    nvic_setup_irq(PIT0_IRQn, SAMPLING_PROFILER_INTERRUPT_PRIORITY);
+}
+
+
+/**
+ * Starts or stops taking samples
+ *
+ * @param enable    true to start, false to stop
+ */
+void sampling_profiler_enable(bool enable)
+{
+    g_sampling_profiler.enabled = enable;
+    WRITE_MMIO_REGISTER(&PIT_TCTRL0,
+                        enable ? (PIT_TCTRL_TIE_MASK | PIT_TCTRL_TEN_MASK) : 0);
+}
+
+
+/**
+ * Discards all samples taken so far
+ */
+void sampling_profiler_reset(void)
+{
+    struct sampling_profiler *const profiler_p = &g_sampling_profiler;
+    uint32_t old_primask = disable_cpu_interrupts();
+
+    for (uint_fast16_t i = 0; i < SAMPLING_PROFILER_NUM_STACKS; i ++) {
+        profiler_p->stacks[i].count = 0;
+    }
+
+    profiler_p->samples_count = 0;
+    profiler_p->failed_samples_count = 0;
+    profiler_p->dropped_samples_count = 0;
+    profiler_p->num_stacks = 0;
+    restore_cpu_interrupts(old_primask);
+}
+
+
+/**
+ * Dumps the recorded stack traces to the serial console. Sampling is paused
+ * while the dump is in progress.
+ *
+ * The dump format is:
+ *   PROFILE BEGIN rate_hz=<sample rate> samples=<num samples> failed=<num>
+ *                 dropped=<num>
+ *   STACK <count> <address (hex)> ...
+ *   ...
+ *   PROFILE END
+ *
+ * The addresses of a stack are listed from the sampled instruction to its
+ * outermost caller. A stack with a single exception return value (0xfffffff1
+ * and above) is a sample of code that was not running in a task.
+ */
+void sampling_profiler_dump(void)
+{
+    struct sampling_profiler *const profiler_p = &g_sampling_profiler;
+    bool was_enabled = profiler_p->enabled;
+
+    sampling_profiler_enable(false);
+    console_printf("PROFILE BEGIN rate_hz=%u samples=%u failed=%u dropped=%u\n",
+                   SAMPLING_PROFILER_SAMPLE_RATE_HZ,
+                   profiler_p->samples_count,
+                   profiler_p->failed_samples_count,
+                   profiler_p->dropped_samples_count);
+
+    for (uint_fast16_t i = 0; i < SAMPLING_PROFILER_NUM_STACKS; i ++) {
+        const struct sampling_profiler_stack *stack_p = &profiler_p->stacks[i];
+
+        if (stack_p->count == 0) {
+            continue;
+        }
+
+        console_printf("STACK %u", stack_p->count);
+        for (uint_fast8_t j = 0; j < stack_p->depth; j ++) {
+            console_printf(" %x", stack_p->stack_trace[j]);
+        }
+
+        console_printf("\n");
+    }
+
+    console_printf("PROFILE END\n");
+    sampling_profiler_enable(was_enabled);
+}
+
+
+/**
+ * Sampling timer interrupt handler
+ *
+ * NOTE: It does not call rtos_enter_isr()/rtos_exit_isr(), as it does not
+ * use any RTOS services, and so that it does not show up in the ISR
+ * statistics.
+ */
+void pit0_irq_handler(void)
+{
+    WRITE_MMIO_REGISTER(&PIT_TFLG0, PIT_TFLG_TIF_MASK);
+    sampling_profiler_take_sample();
+}
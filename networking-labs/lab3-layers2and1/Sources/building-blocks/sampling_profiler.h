@@ -0,0 +1,47 @@
+/**
+ * @file sampling_profiler.h
+ *
+ * Sampling profiler interface
+ *
+ * The sampling profiler takes a shallow stack trace of the interrupted code
+ * on every tick of a periodic timer interrupt (PIT channel 0), and counts
+ * how many times each distinct stack trace was seen, in a hash table in RAM.
+ * The dump produced by sampling_profiler_dump() can be converted to folded
+ * stacks, for flame graph tools, with scripts/profile_to_flamegraph.pl.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_SAMPLING_PROFILER_H_
+#define SOURCES_BUILDING_BLOCKS_SAMPLING_PROFILER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compile_time_checks.h"
+
+/**
+ * Sampling rate in Hz. It is not a divisor of the RTOS tick rate, so that
+ * samples do not happen in lockstep with the RTOS tick.
+ */
+#define SAMPLING_PROFILER_SAMPLE_RATE_HZ    997
+
+/**
+ * Maximum depth of the sampled stack traces
+ */
+#define SAMPLING_PROFILER_MAX_DEPTH         6
+
+/**
+ * Number of entries of the stack trace hash table (must be a power of 2)
+ */
+#define SAMPLING_PROFILER_NUM_STACKS        128
+
+C_ASSERT((SAMPLING_PROFILER_NUM_STACKS & (SAMPLING_PROFILER_NUM_STACKS - 1)) == 0);
+
+void sampling_profiler_init(void);
+
+void sampling_profiler_enable(bool enable);
+
+void sampling_profiler_reset(void);
+
+void sampling_profiler_dump(void);
+
+#endif /* SOURCES_BUILDING_BLOCKS_SAMPLING_PROFILER_H_ */
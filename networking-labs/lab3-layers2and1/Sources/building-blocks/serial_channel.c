@@ -0,0 +1,161 @@
+/**
+ * @file serial_channel.c
+ *
+ * Serial data channel services implementation
+ *
+ * @author German Rivera
+ */
+#include "serial_channel.h"
+#include "runtime_checks.h"
+#include "rtos_wrapper.h"
+#include "uart_driver.h"
+#include "atomic_utils.h"
+
+/**
+ * Maximum number of bytes moved at once by a channel's output task from
+ * the channel's output ring buffer to the UART
+ */
+#define SERIAL_CHANNEL_OUTPUT_CHUNK_SIZE    32
+
+
+/**
+ * Serial channel output task. It reads bytes from the channel's output
+ * buffer in FIFO order and sends them as is to the channel's UART, through
+ * the UART's interrupt-driven transmit queue.
+ *
+ * @param arg pointer to the serial channel
+ */
+static void serial_channel_output_task_func(void *arg)
+{
+    struct serial_channel *const channel_p = arg;
+    uint8_t chunk[SERIAL_CHANNEL_OUTPUT_CHUNK_SIZE];
+    size_t num_bytes;
+
+    D_ASSERT(channel_p->signature == SERIAL_CHANNEL_SIGNATURE);
+    for ( ; ; ) {
+        num_bytes = byte_ring_buffer_read_bulk(&channel_p->output_buffer,
+                                               chunk, sizeof chunk);
+        for (size_t i = 0; i < num_bytes; i ++) {
+            uart_putchar_with_interrupts(channel_p->uart_device_p, chunk[i]);
+        }
+    }
+}
+
+
+/**
+ * Initializes a serial channel
+ *
+ * @param channel_p pointer to the serial channel
+ * @param uart_device_p UART used by the channel. It must not be used by
+ *        the serial console or by another serial channel.
+ * @param baud_rate baud rate for the UART
+ * @param output_task_p pointer to an RTOS task object to be used to create
+ *        the channel's output task
+ * @param output_task_name_p name for the channel's output task
+ */
+void serial_channel_init(struct serial_channel *channel_p,
+                         const struct uart_device *uart_device_p,
+                         uint32_t baud_rate,
+                         struct rtos_task *output_task_p,
+                         const char *output_task_name_p)
+{
+    D_ASSERT(!channel_p->initialized);
+    D_ASSERT(uart_device_p->urt_signature == UART_DEVICE_SIGNATURE);
+    D_ASSERT(!output_task_p->tsk_created);
+
+    channel_p->signature = SERIAL_CHANNEL_SIGNATURE;
+    channel_p->uart_device_p = uart_device_p;
+    channel_p->output_bytes_dropped = 0;
+    uart_init(uart_device_p, baud_rate, UART_DEFAULT_MODE);
+    byte_ring_buffer_init(&channel_p->output_buffer,
+                          channel_p->output_buffer_data,
+                          sizeof channel_p->output_buffer_data);
+    channel_p->initialized = true;
+
+    /*
+     * The output task runs at a lower priority than the console output
+     * task, so that bulk data yields to interactive output:
+     */
+    rtos_task_create(output_task_p,
+                     output_task_name_p,
+                     serial_channel_output_task_func,
+                     channel_p,
+                     LOWEST_APP_TASK_PRIORITY);
+}
+
+
+/**
+ * Writes bytes to a serial channel. If there is no room in the channel's
+ * output buffer, the caller blocks until the output task frees enough room.
+ *
+ * @param channel_p pointer to the serial channel
+ * @param data_p pointer to the bytes to write
+ * @param num_bytes number of bytes to write
+ */
+void serial_channel_write(struct serial_channel *channel_p,
+                          const void *data_p, size_t num_bytes)
+{
+    D_ASSERT(channel_p->signature == SERIAL_CHANNEL_SIGNATURE);
+    D_ASSERT(channel_p->initialized);
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+    byte_ring_buffer_write_bulk(&channel_p->output_buffer, data_p, num_bytes);
+}
+
+
+/**
+ * Writes bytes to a serial channel, without blocking the caller. Bytes
+ * that do not fit in the channel's output buffer are dropped.
+ *
+ * @param channel_p pointer to the serial channel
+ * @param data_p pointer to the bytes to write
+ * @param num_bytes number of bytes to write
+ *
+ * @return number of bytes written
+ */
+size_t serial_channel_write_non_blocking(struct serial_channel *channel_p,
+                                         const void *data_p, size_t num_bytes)
+{
+    size_t num_written;
+
+    D_ASSERT(channel_p->signature == SERIAL_CHANNEL_SIGNATURE);
+    D_ASSERT(channel_p->initialized);
+
+    num_written = byte_ring_buffer_write_bulk_non_blocking(&channel_p->output_buffer,
+                                                           data_p, num_bytes);
+    if (num_written < num_bytes) {
+        (void)atomic_fetch_add_uint32(&channel_p->output_bytes_dropped,
+                                      num_bytes - num_written);
+    }
+
+    return num_written;
+}
+
+
+/**
+ * Reads the next byte received on a serial channel. It blocks the caller
+ * until a byte is received.
+ *
+ * @param channel_p pointer to the serial channel
+ *
+ * @return byte received
+ */
+uint8_t serial_channel_getchar(struct serial_channel *channel_p)
+{
+    D_ASSERT(channel_p->signature == SERIAL_CHANNEL_SIGNATURE);
+    D_ASSERT(channel_p->initialized);
+
+    return uart_getchar(channel_p->uart_device_p);
+}
+
+
+/**
+ * Returns the number of bytes dropped by serial_channel_write_non_blocking()
+ * for a serial channel
+ */
+uint32_t serial_channel_get_output_bytes_dropped(
+    const struct serial_channel *channel_p)
+{
+    D_ASSERT(channel_p->signature == SERIAL_CHANNEL_SIGNATURE);
+    return channel_p->output_bytes_dropped;
+}
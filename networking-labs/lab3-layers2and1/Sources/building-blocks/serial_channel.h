@@ -0,0 +1,76 @@
+/**
+ * @file serial_channel.h
+ *
+ * Serial data channel services interface
+ *
+ * A serial channel is a raw byte stream over its own UART, with its own
+ * output ring buffer and output task, independent of the serial console.
+ * It is meant for bulk data (for example, telemetry), so that it never
+ * competes with interactive console output.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_SERIAL_CHANNEL_H_
+#define SOURCES_BUILDING_BLOCKS_SERIAL_CHANNEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "byte_ring_buffer.h"
+#include "compile_time_checks.h"
+#include "mem_utils.h"
+
+/**
+ * Size (in bytes) of the output ring buffer of a serial channel
+ */
+#define SERIAL_CHANNEL_OUTPUT_BUFFER_SIZE    512
+
+C_ASSERT(IS_POWER_OF_2(SERIAL_CHANNEL_OUTPUT_BUFFER_SIZE));
+
+/*
+ * Incomplete struct declarations to avoid includes
+ */
+struct uart_device;
+struct rtos_task;
+
+/**
+ * State variables of a serial channel
+ */
+struct serial_channel {
+#   define SERIAL_CHANNEL_SIGNATURE  GEN_SIGNATURE('S', 'C', 'H', 'N')
+    uint32_t signature;
+    bool initialized;
+    const struct uart_device *uart_device_p;
+
+    /**
+     * Bytes written to the channel, waiting to be sent to the UART by
+     * the channel's output task
+     */
+    struct byte_ring_buffer output_buffer;
+    uint8_t output_buffer_data[SERIAL_CHANNEL_OUTPUT_BUFFER_SIZE];
+
+    /**
+     * Number of bytes dropped by serial_channel_write_non_blocking(),
+     * because the output buffer was full
+     */
+    volatile uint32_t output_bytes_dropped;
+};
+
+void serial_channel_init(struct serial_channel *channel_p,
+                         const struct uart_device *uart_device_p,
+                         uint32_t baud_rate,
+                         struct rtos_task *output_task_p,
+                         const char *output_task_name_p);
+
+void serial_channel_write(struct serial_channel *channel_p,
+                          const void *data_p, size_t num_bytes);
+
+size_t serial_channel_write_non_blocking(struct serial_channel *channel_p,
+                                         const void *data_p, size_t num_bytes);
+
+uint8_t serial_channel_getchar(struct serial_channel *channel_p);
+
+uint32_t serial_channel_get_output_bytes_dropped(
+    const struct serial_channel *channel_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_SERIAL_CHANNEL_H_ */
@@ -7,12 +7,18 @@
  */
 #include "serial_console.h"
 #include "runtime_checks.h"
+#include "compile_time_checks.h"
+#include "mem_utils.h"
+#include "io_utils.h"
 #include "rtos_wrapper.h"
 #include "byte_ring_buffer.h"
 #include "uart_driver.h"
 #include "microcontroller.h"
+#include "perf_probes.h"
+#include "atomic_utils.h"
+#include "text_format.h"
 #include <stdarg.h>
-#include <print_scan.h>
+#include <string.h>
 
 /**
  * Baud rate for the console UART
@@ -24,6 +30,98 @@
  */
 #define CONSOLE_OUTPUT_BUFFER_SIZE    256
 
+C_ASSERT(IS_POWER_OF_2(CONSOLE_OUTPUT_BUFFER_SIZE));
+
+/**
+ * Maximum number of bytes moved at once by the console output task from
+ * the console output ring buffer to the UART
+ */
+#define CONSOLE_OUTPUT_CHUNK_SIZE     32
+
+/**
+ * Escape byte (DLE) in the console output ring buffer: the byte that
+ * follows it is sent to the UART as is, without '\n' translation. Only
+ * console_write_binary() generates it.
+ */
+#define CONSOLE_OUTPUT_ESCAPE         0x10
+
+/**
+ * Size (in bytes) of the span where console_printf() formats its output,
+ * before sending it to the console
+ */
+#define CONSOLE_PRINTF_CHUNK_SIZE     32
+
+/**
+ * Maximum length of the text generated by a call to
+ * console_printf_non_blocking()
+ */
+#define CONSOLE_NON_BLOCKING_PRINTF_MAX_SIZE   128
+
+/**
+ * Maximum length of the marker written to the console output buffer after
+ * output has been truncated
+ */
+#define CONSOLE_TRUNCATION_MARKER_MAX_SIZE     32
+
+/**
+ * Cell attribute flag (in addition to the CONSOLE_ATTR_ flags) for
+ * characters of the VT100 line drawing character set
+ */
+#define SCREEN_ATTR_LINE_DRAWING      0x80
+
+/**
+ * Mask of the CONSOLE_ATTR_ flags
+ */
+#define SCREEN_ATTR_TEXT_MASK         0x0f
+
+/**
+ * Maximum number of unchanged cells between two changed cells that
+ * console_screen_refresh() re-sends, rather than sending a cursor
+ * positioning sequence, which is roughly this long
+ */
+#define SCREEN_MAX_REWRITE_GAP        6
+
+/**
+ * Size (in bytes) of the buffer where console_screen_refresh() coalesces
+ * its output before sending it to the console
+ */
+#define SCREEN_OUTPUT_BUFFER_SIZE     64
+
+/**
+ * Number of bits per entry of a screen line dirty bitmap
+ */
+#define BITS_PER_DIRTY_WORD           32
+
+/**
+ * Cell of the shadow screen buffer
+ */
+struct screen_cell {
+    uint8_t c;
+    uint8_t attributes;
+};
+
+/**
+ * Shadow screen buffer. It holds what the top CONSOLE_SCREEN_NUM_LINES lines
+ * of the screen are meant to display, and which cells have changed since
+ * the last time they were sent to the console.
+ */
+struct console_screen {
+    struct screen_cell cells[CONSOLE_SCREEN_NUM_LINES][CONSOLE_SCREEN_NUM_COLUMNS];
+
+    /**
+     * Per-cell dirty bitmaps, one per line
+     */
+    uint32_t dirty_bitmaps[CONSOLE_SCREEN_NUM_LINES]
+                          [CONSOLE_SCREEN_NUM_COLUMNS / BITS_PER_DIRTY_WORD];
+
+    /**
+     * Flag indicating that at least one cell is dirty
+     */
+    bool dirty;
+};
+
+C_ASSERT(CONSOLE_SCREEN_NUM_COLUMNS % BITS_PER_DIRTY_WORD == 0);
+
 /**
  * State variables of a serial console
  */
@@ -38,11 +136,42 @@ struct serial_console {
      * Mutex to serialize access to the serial console from multiple tasks
      */
     struct rtos_mutex mutex;
+
+    struct console_screen screen;
+
+    /**
+     * Overflow policy for console_printf_non_blocking()
+     */
+    enum console_overflow_policies overflow_policy;
+
+    /**
+     * Number of bytes truncated by console_printf_non_blocking() for which
+     * a truncation marker has not been written yet
+     */
+    volatile uint32_t output_bytes_truncated;
+
+    /**
+     * Total number of bytes dropped or discarded by
+     * console_printf_non_blocking()
+     */
+    volatile uint32_t output_bytes_dropped;
+
+    /**
+     * Format span where the text output of redirect_task_p goes, instead of
+     * to the UART (NULL if output is not redirected)
+     */
+    struct format_span *redirect_span_p;
+
+    /**
+     * Task whose text output is redirected
+     */
+    struct rtos_task *redirect_task_p;
 };
 
 static struct serial_console g_console = {
     .initialized = false,
     .do_async_output = false,
+    .overflow_policy = CONSOLE_OVERFLOW_TRUNCATE,
     .uart_device_p = &g_uart_devices[0],
 };
 
@@ -66,6 +195,17 @@ static struct serial_console g_console = {
 #define VERTICAL_LINE        '\x78'
 #define HORIZONTAL_LINE        '\x71'
 
+/**
+ * Current position where characters are written in the shadow screen
+ * buffer (1-based, as for VT100 cursor positioning)
+ */
+struct screen_cursor {
+    uint8_t line;
+    uint8_t column;
+    uint8_t attributes;
+};
+
+
 
 static void console_uart_putchar(uint8_t c)
 {
@@ -78,19 +218,52 @@ static void console_uart_putchar(uint8_t c)
 }
 
 
+/**
+ * Sets all cells of the shadow screen buffer to blank, matching a
+ * cleared screen
+ */
+static void screen_reset(struct console_screen *screen_p)
+{
+    for (uint_fast8_t line = 0; line < CONSOLE_SCREEN_NUM_LINES; line ++) {
+        for (uint_fast8_t column = 0; column < CONSOLE_SCREEN_NUM_COLUMNS; column ++) {
+            screen_p->cells[line][column].c = ' ';
+            screen_p->cells[line][column].attributes = 0;
+        }
+    }
+
+    memset(screen_p->dirty_bitmaps, 0, sizeof screen_p->dirty_bitmaps);
+    screen_p->dirty = false;
+}
+
+
 /**
  * Console output task. It reads characters from the
  * console output buffer in FIFO order and send them to
- * the UART.
+ * the UART, through the UART's interrupt-driven transmit queue.
+ * The task blocks, rather than polling the UART, while output drains.
  */
 static void console_output_task_func(void *arg)
 {
-    uint8_t c;
+    uint8_t chunk[CONSOLE_OUTPUT_CHUNK_SIZE];
+    size_t num_bytes;
+    bool escape_pending = false;
 
     D_ASSERT(g_console.do_async_output);
     for ( ; ; ) {
-        c = byte_ring_buffer_read(&g_console.output_buffer);
-        console_uart_putchar(c);
+        num_bytes = byte_ring_buffer_read_bulk(&g_console.output_buffer,
+                                               chunk, sizeof chunk);
+        for (size_t i = 0; i < num_bytes; i ++) {
+            if (escape_pending) {
+                escape_pending = false;
+            } else if (chunk[i] == CONSOLE_OUTPUT_ESCAPE) {
+                escape_pending = true;
+                continue;
+            } else if (chunk[i] == '\n') {
+                uart_putchar_with_interrupts(g_console.uart_device_p, '\r');
+            }
+
+            uart_putchar_with_interrupts(g_console.uart_device_p, chunk[i]);
+        }
     }
 }
 
@@ -112,6 +285,7 @@ void console_init(struct rtos_task *console_output_task_p)
     uart_init(g_console.uart_device_p, CONSOLE_UART_BAUD, UART_DEFAULT_MODE);
 
     rtos_mutex_init(&g_console.mutex, "serial console mutex");
+    screen_reset(&g_console.screen);
     g_console.initialized = true;
 
     /*
@@ -136,7 +310,7 @@ void console_init(struct rtos_task *console_output_task_p)
                          "Console output task",
                          console_output_task_func,
                          NULL,
-                         LOWEST_APP_TASK_PRIORITY - 1);
+                         RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
     }
 }
 
@@ -165,6 +339,38 @@ bool console_is_locked(void)
 }
 
 
+/**
+ * Tells if the caller's text output is to be redirected to
+ * g_console.redirect_span_p
+ */
+static bool console_output_is_redirected(void)
+{
+    return g_console.redirect_span_p != NULL && CPU_MODE_IS_THREAD() &&
+           rtos_task_self() == g_console.redirect_task_p;
+}
+
+
+/**
+ * Redirects the text output of the calling task to a format span, instead
+ * of to the UART, or ends the redirection. It lets console commands be run
+ * on behalf of a remote client. Output of other tasks, and binary output,
+ * still goes to the UART.
+ *
+ * NOTE: The caller must hold the console lock while the output is
+ * redirected, so that only one task at a time redirects its output.
+ *
+ * @param span_p    format span where the output is to go, or NULL to end
+ *                  the redirection
+ */
+void console_redirect_output(struct format_span *span_p)
+{
+    D_ASSERT(console_is_locked());
+    D_ASSERT((span_p == NULL) != (g_console.redirect_span_p == NULL));
+    g_console.redirect_task_p = rtos_task_self();
+    g_console.redirect_span_p = span_p;
+}
+
+
 /**
  * Send a character to the UART
  */
@@ -172,6 +378,13 @@ void console_putchar(int c)
 {
     D_ASSERT(g_console.initialized);
 
+    if (console_output_is_redirected()) {
+        char ch = c;
+
+        format_span_put_chars(g_console.redirect_span_p, &ch, 1);
+        return;
+    }
+
     /*
      * If the console async output is enabled and the caller is a thread
      * with interrupts enabled, do a buffered write. Otherwise, write directly
@@ -186,26 +399,115 @@ void console_putchar(int c)
 }
 
 
+/**
+ * Send a sequence of characters to the UART
+ */
+static void console_write(const char *chars_p, size_t num_chars)
+{
+    D_ASSERT(g_console.initialized);
+
+    if (console_output_is_redirected()) {
+        format_span_put_chars(g_console.redirect_span_p, chars_p, num_chars);
+        return;
+    }
+
+    /*
+     * For a buffered write, enqueue all the characters at once:
+     */
+    if (g_console.do_async_output && CPU_INTERRUPTS_ARE_ENABLED() &&
+        CPU_MODE_IS_THREAD()) {
+        byte_ring_buffer_write_bulk(&g_console.output_buffer,
+                                    (const uint8_t *)chars_p, num_chars);
+        return;
+    }
+
+    for (size_t i = 0; i < num_chars; i ++) {
+        console_uart_putchar(chars_p[i]);
+    }
+}
+
+
+/**
+ * Send binary data to the UART, without the '\n' to "\r\n" translation
+ * done for text. The caller must be holding the console lock, so that the
+ * data is not interleaved with text output from other tasks.
+ *
+ * @param data_p    pointer to the data
+ * @param num_bytes number of bytes to send
+ */
+void console_write_binary(const void *data_p, size_t num_bytes)
+{
+    const uint8_t *bytes_p = data_p;
+    uint8_t escaped_chunk[2 * CONSOLE_OUTPUT_CHUNK_SIZE];
+    size_t escaped_length = 0;
+
+    D_ASSERT(g_console.initialized);
+    if (!(g_console.do_async_output && CPU_INTERRUPTS_ARE_ENABLED() &&
+          CPU_MODE_IS_THREAD())) {
+        for (size_t i = 0; i < num_bytes; i ++) {
+            uart_putchar(g_console.uart_device_p, bytes_p[i]);
+        }
+
+        return;
+    }
+
+    /*
+     * Escape the bytes that the console output task would otherwise
+     * interpret:
+     */
+    for (size_t i = 0; i < num_bytes; i ++) {
+        if (bytes_p[i] == '\n' || bytes_p[i] == CONSOLE_OUTPUT_ESCAPE) {
+            escaped_chunk[escaped_length] = CONSOLE_OUTPUT_ESCAPE;
+            escaped_length ++;
+        }
+
+        escaped_chunk[escaped_length] = bytes_p[i];
+        escaped_length ++;
+        if (escaped_length >= sizeof escaped_chunk - 1) {
+            byte_ring_buffer_write_bulk(&g_console.output_buffer,
+                                        escaped_chunk, escaped_length);
+            escaped_length = 0;
+        }
+    }
+
+    if (escaped_length != 0) {
+        byte_ring_buffer_write_bulk(&g_console.output_buffer,
+                                    escaped_chunk, escaped_length);
+    }
+}
+
+
 /**
  * Send a string to the UART
  */
 void console_puts(const char *s)
 {
-    while (*s != '\0') {
-        console_putchar(*s);
-        s ++;
-    }
+    console_write(s, strlen(s));
 }
 
+
 /**
- * Callback function invoked from the KSDK _doprint() function
+ * Flush function for the format spans of console_printf() and
+ * console_pos_printf()
  */
-static int console_putc(int c, void *dummy_arg)
+static void console_span_flush(struct format_span *span_p)
+{
+    console_write(span_p->buffer_p, span_p->length);
+    span_p->length = 0;
+}
+
+
+static void console_vprintf(const char *fmt_s, va_list ap)
 {
-    console_putchar(c);
-    return 0;
+    char chunk[CONSOLE_PRINTF_CHUNK_SIZE];
+    struct format_span span;
+
+    format_span_init(&span, chunk, sizeof chunk, console_span_flush, NULL);
+    (void)text_format_vprintf(&span, fmt_s, ap);
+    format_span_flush(&span);
 }
 
+
 /**
  * printf service that sends output to the serial console, at
  * the current cursor position
@@ -213,12 +515,141 @@ static int console_putc(int c, void *dummy_arg)
 void console_printf(const char *fmt_s, ...)
 {
     va_list  ap;
+    PERF_PROBE_BEGIN(PERF_PROBE_CONSOLE_OUTPUT);
 
     va_start(ap, fmt_s);
-    (void)_doprint(NULL, console_putc, -1, (char *)fmt_s, ap);
+    console_vprintf(fmt_s, ap);
     va_end(ap);
+
+    PERF_PROBE_END(PERF_PROBE_CONSOLE_OUTPUT);
 }
 
+/**
+ * printf service that sends output to the serial console, at the current
+ * cursor position, without ever blocking the caller. If the formatted text
+ * does not fit in the console output buffer, it is handled according to
+ * the console overflow policy (see console_set_overflow_policy()). It is
+ * meant to be used by time-critical tasks.
+ *
+ * NOTE: Text longer than CONSOLE_NON_BLOCKING_PRINTF_MAX_SIZE is truncated.
+ */
+void console_printf_non_blocking(const char *fmt_s, ...)
+{
+    va_list  ap;
+    char text[CONSOLE_NON_BLOCKING_PRINTF_MAX_SIZE];
+    struct format_span span;
+    size_t num_dropped;
+
+    D_ASSERT(g_console.initialized);
+    PERF_PROBE_BEGIN(PERF_PROBE_CONSOLE_OUTPUT);
+
+    format_span_init(&span, text, sizeof text, NULL, NULL);
+    va_start(ap, fmt_s);
+    (void)text_format_vprintf(&span, fmt_s, ap);
+    va_end(ap);
+
+    if (!g_console.do_async_output) {
+        /*
+         * Without an output buffer, console output never blocks:
+         */
+        for (size_t i = 0; i < span.length; i ++) {
+            console_uart_putchar(text[i]);
+        }
+
+        goto exit;
+    }
+
+    num_dropped = span.num_dropped;
+    switch (g_console.overflow_policy) {
+    case CONSOLE_OVERFLOW_DROP_NEWEST:
+        num_dropped += span.length -
+                       byte_ring_buffer_write_bulk_non_blocking(
+                            &g_console.output_buffer,
+                            (uint8_t *)text,
+                            span.length);
+        break;
+
+    case CONSOLE_OVERFLOW_DROP_OLDEST:
+        num_dropped += byte_ring_buffer_write_bulk_overwrite(
+                            &g_console.output_buffer,
+                            (uint8_t *)text,
+                            span.length);
+        break;
+
+    case CONSOLE_OVERFLOW_TRUNCATE: {
+        uint32_t num_truncated = g_console.output_bytes_truncated;
+
+        if (num_truncated != 0) {
+            /*
+             * Write the marker for output truncated before, if it fits.
+             * Otherwise, drop the new output too:
+             */
+            char marker[CONSOLE_TRUNCATION_MARKER_MAX_SIZE];
+            struct format_span marker_span;
+
+            format_span_init(&marker_span, marker, sizeof marker, NULL, NULL);
+            (void)text_format_printf(&marker_span, "...%u bytes dropped\n",
+                                     num_truncated);
+            if (!byte_ring_buffer_write_bulk_if_room(&g_console.output_buffer,
+                                                     (uint8_t *)marker,
+                                                     marker_span.length)) {
+                num_dropped += span.length;
+                (void)atomic_fetch_add_uint32(&g_console.output_bytes_truncated,
+                                              num_dropped);
+                break;
+            }
+
+            (void)atomic_fetch_sub_uint32(&g_console.output_bytes_truncated,
+                                          num_truncated);
+        }
+
+        size_t num_truncated_now =
+            span.length -
+            byte_ring_buffer_write_bulk_non_blocking(&g_console.output_buffer,
+                                                     (uint8_t *)text,
+                                                     span.length);
+
+        num_dropped += num_truncated_now;
+        (void)atomic_fetch_add_uint32(&g_console.output_bytes_truncated,
+                                      num_dropped);
+        break;
+    }
+
+    default:
+        D_ASSERT(false);
+    }
+
+    if (num_dropped != 0) {
+        (void)atomic_fetch_add_uint32(&g_console.output_bytes_dropped,
+                                      num_dropped);
+    }
+
+exit:
+    PERF_PROBE_END(PERF_PROBE_CONSOLE_OUTPUT);
+}
+
+
+/**
+ * Sets what console_printf_non_blocking() does with output that does not
+ * fit in the console output buffer
+ */
+void console_set_overflow_policy(enum console_overflow_policies policy)
+{
+    D_ASSERT(policy <= CONSOLE_OVERFLOW_TRUNCATE);
+    g_console.overflow_policy = policy;
+}
+
+
+/**
+ * Returns the total number of bytes dropped or discarded so far by
+ * console_printf_non_blocking()
+ */
+uint32_t console_get_output_bytes_dropped(void)
+{
+    return g_console.output_bytes_dropped;
+}
+
+
 /**
  * Set cursor and attributes and save the old cursor and attributes
  */
@@ -284,7 +715,7 @@ void console_pos_printf(uint8_t line, uint8_t column, uint32_t attributes,
      * Print formatted text:
      */
     va_start(ap, fmt_s);
-    (void)_doprint(NULL, console_putc, -1, (char *)fmt_s, ap);
+    console_vprintf(fmt_s, ap);
     va_end(ap);
 
     console_restore_cursor_and_attributes();
@@ -333,6 +764,7 @@ void console_clear(void)
     console_puts(ESC "(B" ESC ")0" SI);
 
     console_turn_off_cursor();
+    screen_reset(&g_console.screen);
 }
 
 
@@ -385,6 +817,279 @@ void console_draw_box(uint8_t line, uint8_t column, uint8_t height, uint8_t widt
     console_restore_cursor_and_attributes();
 }
 
+/**
+ * Writes a character at the given cursor position of the shadow screen
+ * buffer and advances the cursor. The cell is marked dirty only if its
+ * contents change. Characters that fall outside of the shadow screen
+ * area are dropped.
+ */
+static void screen_put_char(struct screen_cursor *cursor_p, uint8_t c)
+{
+    struct console_screen *const screen_p = &g_console.screen;
+
+    if (c == '\n' || c == '\r') {
+        return;
+    }
+
+    if (cursor_p->line == 0 || cursor_p->line > CONSOLE_SCREEN_NUM_LINES ||
+        cursor_p->column == 0 || cursor_p->column > CONSOLE_SCREEN_NUM_COLUMNS) {
+        return;
+    }
+
+    uint_fast8_t line = cursor_p->line - 1;
+    uint_fast8_t column = cursor_p->column - 1;
+    struct screen_cell *cell_p = &screen_p->cells[line][column];
+
+    if (cell_p->c != c || cell_p->attributes != cursor_p->attributes) {
+        cell_p->c = c;
+        cell_p->attributes = cursor_p->attributes;
+        screen_p->dirty_bitmaps[line][column / BITS_PER_DIRTY_WORD] |=
+            BIT(column % BITS_PER_DIRTY_WORD);
+        screen_p->dirty = true;
+    }
+
+    cursor_p->column ++;
+}
+
+
+/**
+ * Flush function for the format span of console_screen_pos_printf(). It
+ * writes the formatted text to the shadow screen buffer.
+ */
+static void screen_span_flush(struct format_span *span_p)
+{
+    for (size_t i = 0; i < span_p->length; i ++) {
+        screen_put_char(span_p->flush_arg_p, span_p->buffer_p[i]);
+    }
+
+    span_p->length = 0;
+}
+
+
+/**
+ * printf service that writes to the shadow screen buffer, at the specified
+ * (line, column) position. The text is sent to the console the next time
+ * console_screen_refresh() is called.
+ */
+void console_screen_pos_printf(uint8_t line, uint8_t column, uint32_t attributes,
+                               const char *fmt_s, ...)
+{
+    va_list  ap;
+    char chunk[CONSOLE_PRINTF_CHUNK_SIZE];
+    struct format_span span;
+    struct screen_cursor cursor = {
+        .line = line,
+        .column = column,
+        .attributes = attributes & SCREEN_ATTR_TEXT_MASK,
+    };
+
+    format_span_init(&span, chunk, sizeof chunk, screen_span_flush, &cursor);
+    va_start(ap, fmt_s);
+    (void)text_format_vprintf(&span, fmt_s, ap);
+    va_end(ap);
+    format_span_flush(&span);
+}
+
+
+/**
+ * Writes a string to the shadow screen buffer, at the specified
+ * (line, column) position.
+ */
+void console_screen_pos_puts(uint8_t line, uint8_t column, uint32_t attributes,
+                             const char *s)
+{
+    struct screen_cursor cursor = {
+        .line = line,
+        .column = column,
+        .attributes = attributes & SCREEN_ATTR_TEXT_MASK,
+    };
+
+    while (*s != '\0') {
+        screen_put_char(&cursor, *s);
+        s ++;
+    }
+}
+
+
+/**
+ * Draws a box in the shadow screen buffer
+ */
+void console_screen_draw_box(uint8_t line, uint8_t column, uint8_t height,
+                             uint8_t width, uint32_t attributes)
+{
+    struct screen_cursor cursor = {
+        .line = line,
+        .column = column,
+        .attributes = (attributes & SCREEN_ATTR_TEXT_MASK) | SCREEN_ATTR_LINE_DRAWING,
+    };
+
+    screen_put_char(&cursor, UPPER_LEFT_CORNER);
+    for (uint8_t j = 0; j < width - 2; j++) {
+        screen_put_char(&cursor, HORIZONTAL_LINE);
+    }
+
+    screen_put_char(&cursor, UPPER_RIGHT_CORNER);
+
+    for (uint8_t i = 1; i < height - 1; i++) {
+        cursor.line = line + i;
+        cursor.column = column;
+        screen_put_char(&cursor, VERTICAL_LINE);
+        cursor.column = column + width - 1;
+        screen_put_char(&cursor, VERTICAL_LINE);
+    }
+
+    cursor.line = line + height - 1;
+    cursor.column = column;
+    screen_put_char(&cursor, LOWER_LEFT_CORNER);
+    for (uint8_t j = 0; j < width - 2; j++) {
+        screen_put_char(&cursor, HORIZONTAL_LINE);
+    }
+
+    screen_put_char(&cursor, LOWER_RIGHT_CORNER);
+}
+
+
+static void screen_output_puts(struct format_span *output_p, const char *s)
+{
+    format_span_put_chars(output_p, s, strlen(s));
+}
+
+
+/**
+ * Appends to a screen output buffer the VT100 control sequences to switch
+ * from the given old cell attributes to the given new ones
+ *
+ * @param old_attributes    current attributes or -1 if unknown
+ * @param new_attributes    new attributes
+ */
+static void screen_output_set_attributes(struct format_span *output_p,
+                                         int old_attributes,
+                                         uint_fast8_t new_attributes)
+{
+    uint_fast8_t text_attributes;
+
+    if (old_attributes < 0 ||
+        (old_attributes & ~new_attributes & SCREEN_ATTR_TEXT_MASK) != 0) {
+        /*
+         * Attributes can only be turned off all at once:
+         */
+        screen_output_puts(output_p, ESC "[0m");
+        text_attributes = new_attributes & SCREEN_ATTR_TEXT_MASK;
+    } else {
+        text_attributes = new_attributes & ~old_attributes & SCREEN_ATTR_TEXT_MASK;
+    }
+
+    if (text_attributes & CONSOLE_ATTR_BOLD) {
+        screen_output_puts(output_p, ESC "[1m");
+    }
+
+    if (text_attributes & CONSOLE_ATTR_UNDERLINED) {
+        screen_output_puts(output_p, ESC "[4m");
+    }
+
+    if (text_attributes & CONSOLE_ATTR_BLINK) {
+        screen_output_puts(output_p, ESC "[5m");
+    }
+
+    if (text_attributes & CONSOLE_ATTR_REVERSE) {
+        screen_output_puts(output_p, ESC "[7m");
+    }
+
+    if (old_attributes < 0 ||
+        ((old_attributes ^ new_attributes) & SCREEN_ATTR_LINE_DRAWING) != 0) {
+        screen_output_puts(output_p,
+                           (new_attributes & SCREEN_ATTR_LINE_DRAWING) ?
+                                ENTER_LINE_DRAWING_MODE : EXIT_LINE_DRAWING_MODE);
+    }
+}
+
+
+/**
+ * Sends to the console the cells of the shadow screen buffer that changed
+ * since the last refresh. Only runs of changed cells are sent: the cursor
+ * is positioned once per run, and short gaps of unchanged cells between
+ * runs in the same line are re-sent rather than skipped with another cursor
+ * positioning sequence. The whole refresh is bracketed by a single cursor
+ * save/restore, and its output is handed to the console in chunks, rather
+ * than one character at a time.
+ *
+ * NOTE: The caller must be holding the console lock.
+ */
+void console_screen_refresh(void)
+{
+    struct console_screen *const screen_p = &g_console.screen;
+    char output_buffer[SCREEN_OUTPUT_BUFFER_SIZE];
+    struct format_span output;
+    int current_attributes = -1;
+    uint_fast8_t cursor_line = 0;
+    uint_fast8_t cursor_column = 0;
+
+    if (!screen_p->dirty) {
+        return;
+    }
+
+    format_span_init(&output, output_buffer, sizeof output_buffer,
+                     console_span_flush, NULL);
+    screen_output_puts(&output, ESC "7");
+    for (uint_fast8_t line = 0; line < CONSOLE_SCREEN_NUM_LINES; line ++) {
+        uint32_t *dirty_bitmap = screen_p->dirty_bitmaps[line];
+
+        for (uint_fast8_t column = 0; column < CONSOLE_SCREEN_NUM_COLUMNS; column ++) {
+            uint_fast8_t word_index = column / BITS_PER_DIRTY_WORD;
+
+            if (dirty_bitmap[word_index] == 0) {
+                /*
+                 * Skip to the last column covered by this word:
+                 */
+                column |= BITS_PER_DIRTY_WORD - 1;
+                continue;
+            }
+
+            if ((dirty_bitmap[word_index] & BIT(column % BITS_PER_DIRTY_WORD)) == 0) {
+                continue;
+            }
+
+            dirty_bitmap[word_index] &= ~BIT(column % BITS_PER_DIRTY_WORD);
+
+            uint_fast8_t first_column = column;
+
+            if (cursor_line == line + 1 && cursor_column <= column + 1 &&
+                column + 1 - cursor_column <= SCREEN_MAX_REWRITE_GAP) {
+                /*
+                 * Re-send the unchanged cells in between:
+                 */
+                first_column = cursor_column - 1;
+            } else {
+                (void)text_format_printf(&output, ESC "[%u;%uH", line + 1, column + 1);
+            }
+
+            for (uint_fast8_t i = first_column; i <= column; i ++) {
+                const struct screen_cell *cell_p = &screen_p->cells[line][i];
+
+                if (cell_p->attributes != current_attributes) {
+                    screen_output_set_attributes(&output, current_attributes,
+                                                 cell_p->attributes);
+                    current_attributes = cell_p->attributes;
+                }
+
+                format_span_put_chars(&output, (const char *)&cell_p->c, 1);
+            }
+
+            cursor_line = line + 1;
+            cursor_column = column + 2;
+        }
+    }
+
+    /*
+     * Restoring the cursor also restores the attributes and the character
+     * set that were in effect before the refresh:
+     */
+    screen_output_puts(&output, ESC "8");
+    format_span_flush(&output);
+    screen_p->dirty = false;
+}
+
+
 /**
  * Reads the next character received on the console UART, waiting if necessary.
  *
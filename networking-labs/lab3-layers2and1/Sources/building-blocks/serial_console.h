@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /*
  * Values that can be or-ed to form the 'attributes'
@@ -21,10 +22,40 @@
 #define CONSOLE_ATTR_BLINK         0x4
 #define CONSOLE_ATTR_REVERSE       0x8
 
+/*
+ * Dimensions of the area at the top of the screen that is covered by the
+ * shadow screen buffer (see console_screen_refresh())
+ */
+#define CONSOLE_SCREEN_NUM_LINES    21
+#define CONSOLE_SCREEN_NUM_COLUMNS  160
+
+/**
+ * What console_printf_non_blocking() does with output that does not fit in
+ * the console output buffer
+ */
+enum console_overflow_policies {
+    /*
+     * Drop the part of the new output that does not fit
+     */
+    CONSOLE_OVERFLOW_DROP_NEWEST = 0,
+
+    /*
+     * Discard the oldest buffered output to make room for the new output
+     */
+    CONSOLE_OVERFLOW_DROP_OLDEST,
+
+    /*
+     * Like CONSOLE_OVERFLOW_DROP_NEWEST, but the next output that fits is
+     * preceded by a "...<N> bytes dropped" marker
+     */
+    CONSOLE_OVERFLOW_TRUNCATE,
+};
+
 /*
  * Incomplete struct declarations to avoid includes
  */
 struct rtos_task;
+struct format_span;
 
 void console_init(struct rtos_task *console_output_task_p);
 
@@ -38,8 +69,18 @@ void console_putchar(int c);
 
 void console_puts(const char *s);
 
+void console_write_binary(const void *data_p, size_t num_bytes);
+
 void console_printf(const char *fmt_s, ...);
 
+void console_printf_non_blocking(const char *fmt_s, ...);
+
+void console_redirect_output(struct format_span *span_p);
+
+void console_set_overflow_policy(enum console_overflow_policies policy);
+
+uint32_t console_get_output_bytes_dropped(void);
+
 void console_pos_printf(uint8_t line, uint8_t column, uint32_t attributes,
                         const char *fmt_s, ...);
 
@@ -62,6 +103,17 @@ void console_set_scroll_region(uint8_t top_line, uint8_t bottom_line);
 void console_draw_box(uint8_t line, uint8_t column, uint8_t height, uint8_t width,
                       uint32_t attributes);
 
+void console_screen_pos_printf(uint8_t line, uint8_t column, uint32_t attributes,
+                               const char *fmt_s, ...);
+
+void console_screen_pos_puts(uint8_t line, uint8_t column, uint32_t attributes,
+                             const char *s);
+
+void console_screen_draw_box(uint8_t line, uint8_t column, uint8_t height,
+                             uint8_t width, uint32_t attributes);
+
+void console_screen_refresh(void);
+
 int console_getchar(void);
 
 int console_getchar_non_blocking(void);
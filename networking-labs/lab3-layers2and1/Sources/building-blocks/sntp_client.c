@@ -0,0 +1,589 @@
+/**
+ * @file sntp_client.c
+ *
+ * SNTP client implementation
+ *
+ * @author German Rivera
+ */
+#include "sntp_client.h"
+#include "networking_layer4.h"
+#include "networking_layer2.h"
+#include "ethernet_mac.h"
+#include "rtos_wrapper.h"
+#include "time_utils.h"
+#include "arm_cortex_m_defs.h"
+#include "mem_utils.h"
+#include <string.h>
+
+/**
+ * Local UDP port used by the SNTP client
+ */
+#define SNTP_CLIENT_LOCAL_PORT                  8893
+
+/**
+ * Period in milliseconds between SNTP requests, once the wall-clock offset
+ * has been set
+ */
+#define SNTP_CLIENT_POLL_INTERVAL_MS            8000
+
+/**
+ * Period in milliseconds between SNTP requests, until the wall-clock offset
+ * is set for the first time
+ */
+#define SNTP_CLIENT_INITIAL_POLL_INTERVAL_MS    1000
+
+/**
+ * Maximum time in milliseconds to wait for the reply to an SNTP request.
+ * It keeps the Tx and Rx hardware timestamps of a request, and the time
+ * at which they are converted, within one period of the IEEE 1588 timer.
+ */
+#define SNTP_CLIENT_REPLY_TIMEOUT_MS            500
+
+C_ASSERT(SNTP_CLIENT_REPLY_TIMEOUT_MS * UINT32_C(1000000) <=
+         ETHERNET_MAC_IEEE_1588_TIMER_PERIOD_NS / 2);
+
+/**
+ * Maximum round trip in nanoseconds of a sample to be used. The error of
+ * the offset measured by a sample is bounded by half its round trip.
+ */
+#define SNTP_CLIENT_MAX_ROUND_TRIP_NS           UINT32_C(50000000)
+
+/**
+ * Offset error in nanoseconds above which the wall-clock offset is stepped
+ * to the measured offset, instead of being slewed towards it
+ */
+#define SNTP_CLIENT_STEP_THRESHOLD_NS           INT64_C(128000000)
+
+/**
+ * The wall-clock offset is slewed by 1/SNTP_CLIENT_SLEW_DIVISOR of the
+ * error of each sample, to filter out the jitter of the round trips
+ */
+#define SNTP_CLIENT_SLEW_DIVISOR                4
+
+/**
+ * Seconds from the NTP epoch (1900) to the Unix epoch (1970)
+ */
+#define NTP_TO_UNIX_EPOCH_SECONDS               UINT32_C(2208988800)
+
+/**
+ * Local times of an SNTP exchange, in get_monotonic_ns() time base
+ */
+struct sntp_client_local_times {
+    /**
+     * Time at which the request was sent
+     */
+    uint64_t tx_ns;
+
+    /**
+     * Time at which the reply was received
+     */
+    uint64_t rx_ns;
+};
+
+/**
+ * SNTP client state
+ */
+struct sntp_client {
+    bool initialized;
+
+    /**
+     * Flag indicating if requests are to be sent
+     */
+    volatile bool enabled;
+
+    /**
+     * Flag indicating if the local times of an exchange are to be taken from
+     * IEEE 1588 hardware timestamps
+     */
+    bool use_hw_timestamps;
+
+    /**
+     * Address of the time server
+     */
+    struct ipv4_address server_ip_addr;
+
+    /**
+     * Tx packet of the last request. It is not freed after transmission, so
+     * that its hardware timestamp can be read. It is freed before sending
+     * the next request, or kept for one more period if it is still in
+     * transit.
+     */
+    struct network_packet *tx_packet_p;
+
+    struct sntp_client_stats stats;
+
+    /**
+     * Mutex to serialize access to this structure
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Local UDP end point
+     */
+    struct net_layer4_end_point end_point;
+
+    /**
+     * SNTP client task
+     */
+    struct rtos_task task;
+};
+
+static struct sntp_client g_sntp_client = {
+    .initialized = false,
+    .enabled = false,
+};
+
+
+/**
+ * Converts an NTP timestamp to nanoseconds since the Unix epoch. NTP
+ * seconds lower than NTP_TO_UNIX_EPOCH_SECONDS are taken to be from the
+ * NTP era that starts in 2036.
+ */
+static uint64_t ntp_timestamp_to_unix_ns(const struct ntp_timestamp *timestamp_p)
+{
+    uint64_t seconds = ntoh32(timestamp_p->seconds);
+    uint64_t fraction = ntoh32(timestamp_p->fraction);
+
+    if (seconds < NTP_TO_UNIX_EPOCH_SECONDS) {
+        seconds += UINT64_C(1) << 32;
+    }
+
+    return (seconds - NTP_TO_UNIX_EPOCH_SECONDS) * 1000000000 +
+           ((fraction * 1000000000) >> 32);
+}
+
+
+/**
+ * Frees the Tx packet of the last request, if it is no longer in transit
+ *
+ * @return true, if there is no Tx packet of a previous request in use
+ * @return false, otherwise
+ */
+static bool sntp_client_free_tx_packet(struct sntp_client *client_p)
+{
+    struct network_packet *tx_packet_p = client_p->tx_packet_p;
+
+    if (tx_packet_p == NULL) {
+        return true;
+    }
+
+    if (tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT) {
+        return false;
+    }
+
+    net_layer2_free_tx_packet(tx_packet_p);
+    client_p->tx_packet_p = NULL;
+    return true;
+}
+
+
+/**
+ * Sends an SNTP request to the server
+ *
+ * @param local_times_p   Area where the time the request was sent is
+ *                        returned
+ * @param nonce_p         Area where the request's transmit timestamp is
+ *                        returned, for the server to echo it back
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+static error_t sntp_client_send_request(struct sntp_client *client_p,
+                                        const struct ipv4_address *server_ip_addr_p,
+                                        bool use_hw_timestamps,
+                                        struct sntp_client_local_times *local_times_p,
+                                        struct ntp_timestamp *nonce_p)
+{
+    error_t error;
+
+    if (!sntp_client_free_tx_packet(client_p)) {
+        return CAPTURE_ERROR("Previous SNTP request still in transit",
+                             client_p->tx_packet_p, 0);
+    }
+
+    struct network_packet *tx_packet_p =
+        net_layer2_try_allocate_tx_packet(NET_PACKET_SMALL_DATA_BUFFER_SIZE, false);
+
+    if (tx_packet_p == NULL) {
+        return CAPTURE_ERROR("No Tx packet available for SNTP request", 0, 0);
+    }
+
+    struct sntp_message *request_p = get_ipv4_udp_data_payload_area(tx_packet_p);
+    uint64_t nonce_ns = get_monotonic_ns();
+
+    memset(request_p, 0, sizeof *request_p);
+    request_p->li_vn_mode = (SNTP_VERSION << SNTP_VN_SHIFT) |
+                            (SNTP_MODE_CLIENT << SNTP_MODE_SHIFT);
+
+    /*
+     * The transmit timestamp is only used by the server as an opaque value
+     * to copy into the reply's originate timestamp, so the local time is
+     * sent, to match replies with requests:
+     */
+    request_p->transmit_timestamp.seconds = hton32((uint32_t)(nonce_ns >> 32));
+    request_p->transmit_timestamp.fraction = hton32((uint32_t)nonce_ns);
+    *nonce_p = request_p->transmit_timestamp;
+
+    if (use_hw_timestamps) {
+        net_packet_request_tx_timestamp(tx_packet_p);
+    }
+
+    local_times_p->tx_ns = get_monotonic_ns();
+    error = net_layer4_send_udp_datagram_over_ipv4(&client_p->end_point,
+                                                   server_ip_addr_p,
+                                                   hton16(SNTP_SERVER_PORT),
+                                                   tx_packet_p,
+                                                   sizeof *request_p);
+    if (error != 0) {
+        net_layer2_free_tx_packet(tx_packet_p);
+        return error;
+    }
+
+    client_p->tx_packet_p = tx_packet_p;
+    return 0;
+}
+
+
+/**
+ * Tells if a received datagram is a valid reply to the last request
+ */
+static bool sntp_client_is_valid_reply(const struct net_udp_rx_datagram *datagram_p,
+                                       const struct ipv4_address *server_ip_addr_p,
+                                       const struct ntp_timestamp *nonce_p)
+{
+    const struct sntp_message *reply_p = datagram_p->payload_p;
+
+    if (datagram_p->ip_version != 4 ||
+        datagram_p->source_ip_addr.ipv4.value != server_ip_addr_p->value ||
+        datagram_p->source_port != hton16(SNTP_SERVER_PORT) ||
+        datagram_p->payload_length < sizeof *reply_p) {
+        return false;
+    }
+
+    uint_fast8_t leap_indicator = GET_BIT_FIELD(reply_p->li_vn_mode,
+                                                SNTP_LI_MASK, SNTP_LI_SHIFT);
+    uint_fast8_t mode = GET_BIT_FIELD(reply_p->li_vn_mode,
+                                      SNTP_MODE_MASK, SNTP_MODE_SHIFT);
+
+    return mode == SNTP_MODE_SERVER &&
+           leap_indicator != SNTP_LI_ALARM &&
+           reply_p->stratum != 0 && reply_p->stratum <= SNTP_MAX_STRATUM &&
+           reply_p->originate_timestamp.seconds == nonce_p->seconds &&
+           reply_p->originate_timestamp.fraction == nonce_p->fraction &&
+           reply_p->transmit_timestamp.seconds != 0;
+}
+
+
+/**
+ * Replaces the local times of an exchange by the times given by the IEEE
+ * 1588 hardware timestamps of the request and the reply, if both were
+ * taken. The hardware timestamps are converted to the get_monotonic_ns()
+ * time base by sampling both clocks back-to-back.
+ *
+ * @return true, if the hardware timestamps were used
+ * @return false, otherwise
+ */
+static bool sntp_client_use_hw_timestamps(const struct sntp_client *client_p,
+                                          const struct network_packet *rx_packet_p,
+                                          struct sntp_client_local_times *local_times_p)
+{
+    uint32_t tx_timestamp;
+    uint32_t rx_timestamp;
+
+    /*
+     * The request's Tx packet may still be in transit, if the reply came
+     * before the Tx completion was processed, or it may have been copied
+     * while waiting for an ARP reply, in which case it has no timestamp:
+     */
+    if ((client_p->tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT) ||
+        !net_packet_get_timestamp(client_p->tx_packet_p, &tx_timestamp) ||
+        !net_packet_get_timestamp(rx_packet_p, &rx_timestamp)) {
+        return false;
+    }
+
+    const struct ethernet_mac_device *ethernet_mac_p =
+        rx_packet_p->layer2_end_point_p->ethernet_mac_p;
+    uint32_t int_mask = disable_cpu_interrupts();
+    uint32_t now_timestamp = ethernet_mac_get_ieee_1588_time(ethernet_mac_p);
+    uint64_t now_ns = get_monotonic_ns();
+
+    restore_cpu_interrupts(int_mask);
+
+    local_times_p->rx_ns =
+        now_ns - ETHERNET_MAC_IEEE_1588_TIME_DELTA_NS(rx_timestamp, now_timestamp);
+    local_times_p->tx_ns =
+        local_times_p->rx_ns -
+        ETHERNET_MAC_IEEE_1588_TIME_DELTA_NS(tx_timestamp, rx_timestamp);
+    return true;
+}
+
+
+/**
+ * Disciplines the wall-clock offset with the offset measured by an SNTP
+ * exchange. Must be called with the client's mutex held.
+ */
+static void sntp_client_discipline(struct sntp_client *client_p,
+                                   const struct sntp_message *reply_p,
+                                   const struct sntp_client_local_times *local_times_p)
+{
+    uint64_t server_rx_ns = ntp_timestamp_to_unix_ns(&reply_p->receive_timestamp);
+    uint64_t server_tx_ns = ntp_timestamp_to_unix_ns(&reply_p->transmit_timestamp);
+    int64_t round_trip_ns = (int64_t)(local_times_p->rx_ns - local_times_p->tx_ns) -
+                            (int64_t)(server_tx_ns - server_rx_ns);
+
+    if (round_trip_ns < 0) {
+        round_trip_ns = 0;
+    }
+
+    if (round_trip_ns > SNTP_CLIENT_MAX_ROUND_TRIP_NS) {
+        client_p->stats.slow_replies ++;
+        return;
+    }
+
+    int64_t offset_ns = ((int64_t)(server_rx_ns - local_times_p->tx_ns) +
+                         (int64_t)(server_tx_ns - local_times_p->rx_ns)) / 2;
+    int64_t offset_error_ns = offset_ns - get_wall_time_offset_ns();
+
+    if (!wall_time_is_set() ||
+        offset_error_ns > SNTP_CLIENT_STEP_THRESHOLD_NS ||
+        offset_error_ns < -SNTP_CLIENT_STEP_THRESHOLD_NS) {
+        set_wall_time_offset_ns(offset_ns);
+        client_p->stats.steps ++;
+    } else {
+        set_wall_time_offset_ns(get_wall_time_offset_ns() +
+                                offset_error_ns / SNTP_CLIENT_SLEW_DIVISOR);
+    }
+
+    client_p->stats.samples ++;
+    client_p->stats.last_round_trip_ns = round_trip_ns;
+    if (offset_error_ns > INT32_MAX) {
+        client_p->stats.last_offset_error_ns = INT32_MAX;
+    } else if (offset_error_ns < INT32_MIN) {
+        client_p->stats.last_offset_error_ns = INT32_MIN;
+    } else {
+        client_p->stats.last_offset_error_ns = offset_error_ns;
+    }
+}
+
+
+/**
+ * Sends an SNTP request and processes its reply
+ */
+static void sntp_client_poll(struct sntp_client *client_p)
+{
+    error_t error;
+    struct sntp_client_local_times local_times;
+    struct ntp_timestamp nonce;
+    struct net_udp_rx_datagram datagram;
+
+    rtos_mutex_lock(&client_p->mutex);
+    struct ipv4_address server_ip_addr = client_p->server_ip_addr;
+    bool use_hw_timestamps = client_p->use_hw_timestamps;
+
+    error = sntp_client_send_request(client_p, &server_ip_addr,
+                                     use_hw_timestamps, &local_times, &nonce);
+    if (error != 0) {
+        client_p->stats.send_failures ++;
+        rtos_mutex_unlock(&client_p->mutex);
+        return;
+    }
+
+    client_p->stats.requests_sent ++;
+    rtos_mutex_unlock(&client_p->mutex);
+
+    /*
+     * Datagrams that are not a reply to this request (for example, late
+     * replies to previous requests) are skipped:
+     */
+    for ( ; ; ) {
+        uint32_t elapsed_ms =
+            (uint32_t)((get_monotonic_ns() - local_times.tx_ns) / 1000000);
+
+        if (elapsed_ms >= SNTP_CLIENT_REPLY_TIMEOUT_MS) {
+            error = CAPTURE_ERROR("SNTP request timed out", 0, 0);
+            break;
+        }
+
+        error = net_layer4_udp_receive_zero_copy(&client_p->end_point,
+                                                 SNTP_CLIENT_REPLY_TIMEOUT_MS -
+                                                    elapsed_ms,
+                                                 &datagram);
+        if (error != 0) {
+            break;
+        }
+
+        local_times.rx_ns = get_monotonic_ns();
+        if (sntp_client_is_valid_reply(&datagram, &server_ip_addr, &nonce)) {
+            break;
+        }
+
+        rtos_mutex_lock(&client_p->mutex);
+        client_p->stats.invalid_replies ++;
+        rtos_mutex_unlock(&client_p->mutex);
+        net_layer4_udp_release_rx_datagram(&client_p->end_point, &datagram);
+    }
+
+    rtos_mutex_lock(&client_p->mutex);
+    if (error != 0) {
+        client_p->stats.timeouts ++;
+    } else {
+        if (use_hw_timestamps &&
+            sntp_client_use_hw_timestamps(client_p, datagram.rx_packet_p,
+                                          &local_times)) {
+            client_p->stats.hw_timestamped_samples ++;
+        }
+
+        sntp_client_discipline(client_p, datagram.payload_p, &local_times);
+        net_layer4_udp_release_rx_datagram(&client_p->end_point, &datagram);
+    }
+
+    rtos_mutex_unlock(&client_p->mutex);
+}
+
+
+/**
+ * SNTP client task
+ */
+static void sntp_client_task_func(void *arg)
+{
+    struct sntp_client *client_p = arg;
+
+    D_ASSERT(client_p == &g_sntp_client);
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    /*
+     * This task accesses the client state all the time, so its MPU
+     * region is never restored:
+     */
+    rtos_thread_set_comp_region(client_p,
+                                sizeof *client_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    for ( ; ; ) {
+        if (client_p->enabled) {
+            sntp_client_poll(client_p);
+        }
+
+        rtos_task_delay(wall_time_is_set() ? SNTP_CLIENT_POLL_INTERVAL_MS :
+                                             SNTP_CLIENT_INITIAL_POLL_INTERVAL_MS);
+    }
+}
+
+
+/**
+ * Starts synchronizing the wall-clock time with a given SNTP server. The
+ * first time it is called, it creates the SNTP client task. If the client
+ * is already running, it just switches to the new server.
+ *
+ * @param server_ip_addr_p      IPv4 address of the SNTP server
+ * @param use_hw_timestamps     true, to take the local times of the SNTP
+ *                              exchanges from IEEE 1588 hardware timestamps
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t sntp_client_start(const struct ipv4_address *server_ip_addr_p,
+                          bool use_hw_timestamps)
+{
+    struct sntp_client *const client_p = &g_sntp_client;
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(client_p,
+                                sizeof *client_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    if (!client_p->initialized) {
+        rtos_mutex_init(&client_p->mutex, "SNTP client mutex");
+        net_layer4_udp_end_point_init(&client_p->end_point);
+        error = net_layer4_udp_end_point_bind(&client_p->end_point,
+                                              hton16(SNTP_CLIENT_LOCAL_PORT));
+        if (error != 0) {
+            goto common_exit;
+        }
+
+        client_p->initialized = true;
+        rtos_task_create(&client_p->task,
+                         "SNTP client task",
+                         sntp_client_task_func,
+                         client_p,
+                         RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
+    }
+
+    rtos_mutex_lock(&client_p->mutex);
+    client_p->server_ip_addr = *server_ip_addr_p;
+    client_p->use_hw_timestamps = use_hw_timestamps;
+    client_p->enabled = true;
+    rtos_mutex_unlock(&client_p->mutex);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Stops synchronizing the wall-clock time. The wall-clock offset keeps its
+ * last value, and the SNTP client task stays idle until sntp_client_start()
+ * is called again.
+ */
+void sntp_client_stop(void)
+{
+    struct sntp_client *const client_p = &g_sntp_client;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    if (!client_p->initialized) {
+        return;
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(client_p,
+                                sizeof *client_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&client_p->mutex);
+    client_p->enabled = false;
+    rtos_mutex_unlock(&client_p->mutex);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Takes a snapshot of the SNTP client statistics
+ *
+ * @param stats_p   Area where the snapshot is to be returned
+ */
+void sntp_client_get_stats(struct sntp_client_stats *stats_p)
+{
+    struct sntp_client *const client_p = &g_sntp_client;
+
+    if (!client_p->initialized) {
+        memset(stats_p, 0, sizeof *stats_p);
+        return;
+    }
+
+    rtos_mutex_lock(&client_p->mutex);
+    *stats_p = client_p->stats;
+    rtos_mutex_unlock(&client_p->mutex);
+}
@@ -0,0 +1,159 @@
+/**
+ * @file sntp_client.h
+ *
+ * SNTP client interface
+ *
+ * The SNTP client is a background task that periodically sends an SNTP
+ * request (RFC 4330) to a time server, and uses the server's receive and
+ * transmit timestamps to discipline the wall-clock offset returned by
+ * get_wall_time_ns(), so that the timestamps taken in different boards can
+ * be compared. Optionally, the request's transmission time and the reply's
+ * arrival time are taken from the IEEE 1588 hardware timestamps of the
+ * Ethernet MAC, which leave out the time spent by the packets in the
+ * networking stack.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_SNTP_CLIENT_H_
+#define SOURCES_BUILDING_BLOCKS_SNTP_CLIENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "networking_layer3.h"
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+
+/**
+ * UDP port of SNTP servers
+ */
+#define SNTP_SERVER_PORT    123
+
+/**
+ * NTP timestamp: seconds and fraction of a second since 1900-01-01 00:00 UTC.
+ * All fields are big endian.
+ */
+struct ntp_timestamp {
+    uint32_t seconds;
+    uint32_t fraction;
+};
+
+/**
+ * SNTP message layout (without the optional authentication fields).
+ * All fields are big endian.
+ */
+struct sntp_message {
+    /**
+     * Leap indicator (2 bits), version number (3 bits) and mode (3 bits)
+     */
+    uint8_t li_vn_mode;
+#   define SNTP_LI_MASK             0xc0
+#   define SNTP_LI_SHIFT            6
+#   define SNTP_LI_ALARM            3
+#   define SNTP_VN_MASK             0x38
+#   define SNTP_VN_SHIFT            3
+#   define SNTP_VERSION             4
+#   define SNTP_MODE_MASK           0x07
+#   define SNTP_MODE_SHIFT          0
+#   define SNTP_MODE_CLIENT         3
+#   define SNTP_MODE_SERVER         4
+
+    /**
+     * Stratum of the server (0 means "kiss-o'-death")
+     */
+    uint8_t stratum;
+#   define SNTP_MAX_STRATUM         15
+
+    int8_t poll;
+    int8_t precision;
+    uint32_t root_delay;
+    uint32_t root_dispersion;
+    uint32_t reference_id;
+    struct ntp_timestamp reference_timestamp;
+
+    /**
+     * Time at which the request departed the client (copied by the server
+     * from the request's transmit timestamp)
+     */
+    struct ntp_timestamp originate_timestamp;
+
+    /**
+     * Time at which the request arrived at the server
+     */
+    struct ntp_timestamp receive_timestamp;
+
+    /**
+     * Time at which the message departed the sender
+     */
+    struct ntp_timestamp transmit_timestamp;
+};
+
+C_ASSERT(sizeof(struct sntp_message) == 48);
+
+/**
+ * SNTP client statistics
+ */
+struct sntp_client_stats {
+    /**
+     * Number of requests sent
+     */
+    uint32_t requests_sent;
+
+    /**
+     * Number of requests that could not be sent
+     */
+    uint32_t send_failures;
+
+    /**
+     * Number of requests not replied before the reply timeout
+     */
+    uint32_t timeouts;
+
+    /**
+     * Number of datagrams received that were not a valid reply to the last
+     * request
+     */
+    uint32_t invalid_replies;
+
+    /**
+     * Number of replies discarded, because their round trip was too long
+     * to give an accurate offset
+     */
+    uint32_t slow_replies;
+
+    /**
+     * Number of replies used to discipline the wall-clock offset
+     */
+    uint32_t samples;
+
+    /**
+     * Number of samples whose local times came from IEEE 1588 hardware
+     * timestamps
+     */
+    uint32_t hw_timestamped_samples;
+
+    /**
+     * Number of times the wall-clock offset was stepped, rather than slewed
+     */
+    uint32_t steps;
+
+    /**
+     * Difference between the offset measured by the last sample and the
+     * wall-clock offset before it was disciplined, in nanoseconds
+     */
+    int32_t last_offset_error_ns;
+
+    /**
+     * Round trip of the last sample, excluding the server's processing
+     * time, in nanoseconds
+     */
+    uint32_t last_round_trip_ns;
+};
+
+error_t sntp_client_start(const struct ipv4_address *server_ip_addr_p,
+                          bool use_hw_timestamps);
+
+void sntp_client_stop(void);
+
+void sntp_client_get_stats(struct sntp_client_stats *stats_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_SNTP_CLIENT_H_ */
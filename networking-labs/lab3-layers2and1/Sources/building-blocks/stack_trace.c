@@ -10,6 +10,35 @@
 #include "io_utils.h"
 #include "cortex_m_startup.h"
 #include "rtos_wrapper.h"
+#include "atomic_utils.h"
+#include "compile_time_checks.h"
+
+/**
+ * Maximum number of instructions scanned backwards looking for a function
+ * prolog. This bounds the cost of unwinding a frame with a bogus return
+ * address, and it must be larger than the largest function.
+ */
+#define STACK_TRACE_MAX_PROLOG_SCAN_INSTRUCTIONS    4096
+
+/**
+ * Number of entries of the decoded function prolog cache (must be a power
+ * of 2)
+ */
+#define STACK_TRACE_PROLOG_CACHE_SIZE               64
+
+C_ASSERT((STACK_TRACE_PROLOG_CACHE_SIZE & (STACK_TRACE_PROLOG_CACHE_SIZE - 1)) == 0);
+
+/**
+ * Maximum number of stack frames of an exception handler that
+ * stack_trace_capture_interrupted() unwinds to get to the interrupted code
+ */
+#define STACK_TRACE_MAX_HANDLER_FRAMES  8
+
+/**
+ * Indices of the stacked lr and pc registers in a Cortex-M exception frame
+ */
+#define EXCEPTION_FRAME_LR_INDEX    5
+#define EXCEPTION_FRAME_PC_INDEX    6
 
 static uint_fast8_t get_pushed_r7_stack_index(
                         thumb_instruction_t push_instruction)
@@ -32,7 +61,36 @@ static uint_fast8_t get_pushed_r7_stack_index(
 
 
 /**
- * Finds the previous stack frame while unwinding the current execution stack.
+ * Decoded function prolog, as needed to find the calling function's stack
+ * frame from a frame pointer (r7) value
+ */
+struct function_prolog {
+    /**
+     * Number of stack entries to add to the frame pointer to get the
+     * address where the 'push {...r7}' stored the first register
+     */
+    int16_t frame_pointer_offset;
+
+    /**
+     * Stack index of the pushed r7, relative to the first pushed register
+     */
+    uint8_t pushed_r7_index;
+
+    /**
+     * Flag indicating if the 'push {...r7}' also pushed the lr register
+     */
+    bool pushed_lr;
+
+    /**
+     * Address of the 'push {...r7}' instruction
+     */
+    const thumb_instruction_t *push_instruction_p;
+};
+
+
+/**
+ * Decodes the prolog of the function that contains a given instruction, by
+ * scanning instructions backwards from it.
  *
  * NOTE: This function assumes that function prologs have the following code
  * pattern ([] means optional):
@@ -40,34 +98,19 @@ static uint_fast8_t get_pushed_r7_stack_index(
  *  push {[r4,] [r5,] [r6,] r7 [, lr]}   ([] means optional)
  *  [sub sp, #imm7]
  *  add r7, sp, #imm8
+ *
+ * @param program_counter   Address of the last instruction executed in the
+ *                          function
+ * @param prolog_p          Area where the decoded prolog is returned
+ *
+ * @return true, if the prolog was found, false otherwise
  */
-static bool find_previous_stack_frame(
-                const thumb_instruction_t *program_counter,
-                const uint32_t *stack_bottom_end_p,
-                const uint32_t **frame_pointer_p,
-                uintptr_t *prev_return_address_p)
+static bool decode_function_prolog(const thumb_instruction_t *program_counter,
+                                   struct function_prolog *prolog_p)
 {
     thumb_instruction_t instruction;
-    uint_fast8_t stack_index;
-    const uint32_t *prev_frame_pointer;
-    uintptr_t prev_return_address;
-    const uint32_t *frame_pointer = *frame_pointer_p;
-    uint_fast16_t stop_count = UINT16_MAX;
-
-    if (program_counter == NULL) {
-        uintptr_t return_address;
-
-        CAPTURE_ARM_LR_REGISTER(return_address);
-        program_counter = (thumb_instruction_t *)GET_CALL_ADDRESS(return_address);
-    }
-
-    if (((uintptr_t)program_counter & 0x1) != 0) {
-        return false;
-    }
-
-    if (!VALID_RAM_POINTER(frame_pointer, sizeof(uint32_t))) {
-        return false;
-    }
+    int_fast16_t frame_pointer_offset = 0;
+    uint_fast16_t stop_count = STACK_TRACE_MAX_PROLOG_SCAN_INSTRUCTIONS;
 
     /*
      * Scan instructions backwards looking for one of the 3 instructions in the
@@ -101,7 +144,7 @@ static bool find_previous_stack_frame(
          * convert it to an stack entry index we need to divide it by 4,
          * so, the '/ 4' and the '<< 2' cancel each other.
          */
-        frame_pointer -= (instruction & ADD_SP_IMMEDITATE_OPERAND_MASK);
+        frame_pointer_offset -= (instruction & ADD_SP_IMMEDITATE_OPERAND_MASK);
         program_counter --;
 
         /*
@@ -136,7 +179,7 @@ static bool find_previous_stack_frame(
          * convert it to an stack entry index we need to divide it by 4,
          * so, the '/ 4' and the '<< 2' cancel each other.
          */
-        frame_pointer += (instruction & SUB_SP_IMMEDITATE_OPERAND_MASK);
+        frame_pointer_offset += (instruction & SUB_SP_IMMEDITATE_OPERAND_MASK);
         program_counter --;
 
         /*
@@ -165,20 +208,201 @@ static bool find_previous_stack_frame(
         return false;
     }
 
-    stack_index = get_pushed_r7_stack_index(instruction);
-    if (frame_pointer + stack_index >= stack_bottom_end_p) {
+    prolog_p->frame_pointer_offset = frame_pointer_offset;
+    prolog_p->pushed_r7_index = get_pushed_r7_stack_index(instruction);
+    prolog_p->pushed_lr = ((instruction & PUSH_OPERAND_INCLUDES_LR_MASK) != 0);
+    prolog_p->push_instruction_p = program_counter;
+    return true;
+}
+
+
+/*
+ * Bit fields of a decoded function prolog packed in a 32-bit word, for the
+ * prolog cache. The frame pointer offset is stored biased, as it can be
+ * negative. The 'push {...r7}' is stored as its distance in instructions
+ * from the program counter where the prolog scan started.
+ */
+#define PACKED_PROLOG_FRAME_POINTER_OFFSET_MASK     MULTI_BIT_MASK(8, 0)
+#define PACKED_PROLOG_FRAME_POINTER_OFFSET_SHIFT    0
+#define PACKED_PROLOG_FRAME_POINTER_OFFSET_BIAS     256
+#define PACKED_PROLOG_PUSHED_R7_INDEX_MASK          MULTI_BIT_MASK(11, 9)
+#define PACKED_PROLOG_PUSHED_R7_INDEX_SHIFT         9
+#define PACKED_PROLOG_PUSHED_LR_MASK                BIT(12)
+#define PACKED_PROLOG_PUSH_DISTANCE_MASK            MULTI_BIT_MASK(28, 13)
+#define PACKED_PROLOG_PUSH_DISTANCE_SHIFT           13
+
+C_ASSERT(ADD_SP_IMMEDITATE_OPERAND_MASK < PACKED_PROLOG_FRAME_POINTER_OFFSET_BIAS);
+C_ASSERT(SUB_SP_IMMEDITATE_OPERAND_MASK + PACKED_PROLOG_FRAME_POINTER_OFFSET_BIAS <=
+         (PACKED_PROLOG_FRAME_POINTER_OFFSET_MASK >> PACKED_PROLOG_FRAME_POINTER_OFFSET_SHIFT));
+C_ASSERT(STACK_TRACE_MAX_PROLOG_SCAN_INSTRUCTIONS <=
+         (PACKED_PROLOG_PUSH_DISTANCE_MASK >> PACKED_PROLOG_PUSH_DISTANCE_SHIFT));
+
+/**
+ * Entry of the decoded function prolog cache
+ */
+struct prolog_cache_entry {
+    /**
+     * Program counter from which the prolog was decoded (NULL if the entry
+     * is free)
+     */
+    const thumb_instruction_t *volatile program_counter;
+
+    /**
+     * Decoded prolog, packed as per the PACKED_PROLOG_... bit fields
+     */
+    volatile uint32_t packed_prolog;
+};
+
+/**
+ * Cache of decoded function prologs, so that capturing stack traces that go
+ * through the same call sites over and over again does not require scanning
+ * instructions every time. It is direct-mapped, and indexed by a hash of the
+ * program counter from which the prolog is decoded.
+ */
+static struct {
+    struct prolog_cache_entry entries[STACK_TRACE_PROLOG_CACHE_SIZE];
+    volatile uint32_t hits;
+    volatile uint32_t misses;
+} g_prolog_cache;
+
+
+static inline struct prolog_cache_entry *prolog_cache_lookup_entry(
+    const thumb_instruction_t *program_counter)
+{
+    uint32_t hash = ((uintptr_t)program_counter >> 1) * UINT32_C(2654435761);
+
+    return &g_prolog_cache.entries[hash >> 26];
+}
+
+C_ASSERT(STACK_TRACE_PROLOG_CACHE_SIZE == 1 << (32 - 26));
+
+
+/**
+ * Decodes the prolog of the function that contains a given instruction,
+ * using the prolog cache.
+ *
+ * NOTE: This is called from any context, including exception handlers that
+ * interrupt other callers. A cache entry is filled with interrupts disabled,
+ * with its program counter written last. A reader checks the program counter
+ * before and after reading the packed prolog, so that it never uses a packed
+ * prolog overwritten for another program counter.
+ */
+static bool decode_function_prolog_cached(const thumb_instruction_t *program_counter,
+                                          struct function_prolog *prolog_p)
+{
+    struct prolog_cache_entry *const entry_p =
+        prolog_cache_lookup_entry(program_counter);
+
+    if (entry_p->program_counter == program_counter) {
+        uint32_t packed_prolog = entry_p->packed_prolog;
+
+        if (entry_p->program_counter == program_counter) {
+            prolog_p->frame_pointer_offset =
+                (int16_t)GET_BIT_FIELD(packed_prolog,
+                                       PACKED_PROLOG_FRAME_POINTER_OFFSET_MASK,
+                                       PACKED_PROLOG_FRAME_POINTER_OFFSET_SHIFT) -
+                PACKED_PROLOG_FRAME_POINTER_OFFSET_BIAS;
+            prolog_p->pushed_r7_index =
+                GET_BIT_FIELD(packed_prolog,
+                              PACKED_PROLOG_PUSHED_R7_INDEX_MASK,
+                              PACKED_PROLOG_PUSHED_R7_INDEX_SHIFT);
+            prolog_p->pushed_lr = ((packed_prolog & PACKED_PROLOG_PUSHED_LR_MASK) != 0);
+            prolog_p->push_instruction_p = program_counter -
+                GET_BIT_FIELD(packed_prolog,
+                              PACKED_PROLOG_PUSH_DISTANCE_MASK,
+                              PACKED_PROLOG_PUSH_DISTANCE_SHIFT);
+            g_prolog_cache.hits ++;
+            return true;
+        }
+    }
+
+    g_prolog_cache.misses ++;
+    if (!decode_function_prolog(program_counter, prolog_p)) {
         return false;
     }
 
-    prev_frame_pointer = (uint32_t *)frame_pointer[stack_index];
-    if (!VALID_RAM_POINTER(prev_frame_pointer, sizeof(uint32_t)) ||
-        prev_frame_pointer <= frame_pointer ||
-        prev_frame_pointer >= stack_bottom_end_p) {
+    uint32_t packed_prolog = 0;
+
+    SET_BIT_FIELD(packed_prolog, PACKED_PROLOG_FRAME_POINTER_OFFSET_MASK,
+                  PACKED_PROLOG_FRAME_POINTER_OFFSET_SHIFT,
+                  prolog_p->frame_pointer_offset +
+                    PACKED_PROLOG_FRAME_POINTER_OFFSET_BIAS);
+    SET_BIT_FIELD(packed_prolog, PACKED_PROLOG_PUSHED_R7_INDEX_MASK,
+                  PACKED_PROLOG_PUSHED_R7_INDEX_SHIFT,
+                  prolog_p->pushed_r7_index);
+    SET_BIT_FIELD(packed_prolog, PACKED_PROLOG_PUSH_DISTANCE_MASK,
+                  PACKED_PROLOG_PUSH_DISTANCE_SHIFT,
+                  program_counter - prolog_p->push_instruction_p);
+    if (prolog_p->pushed_lr) {
+        packed_prolog |= PACKED_PROLOG_PUSHED_LR_MASK;
+    }
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    entry_p->program_counter = NULL;
+    entry_p->packed_prolog = packed_prolog;
+    entry_p->program_counter = program_counter;
+    restore_cpu_interrupts(int_mask);
+    return true;
+}
+
+
+/**
+ * Returns the number of hits and misses of the decoded function prolog cache
+ */
+void stack_trace_get_prolog_cache_stats(uint32_t *hits_p, uint32_t *misses_p)
+{
+    *hits_p = g_prolog_cache.hits;
+    *misses_p = g_prolog_cache.misses;
+}
+
+
+/**
+ * Finds the previous stack frame while unwinding the current execution stack.
+ *
+ * NOTE: If the previous return address is an exception return, the previous
+ * frame pointer is the one of the interrupted code, which may be in a
+ * different stack. In that case, it is returned without checking it against
+ * the current stack.
+ */
+static bool find_previous_stack_frame(
+                const thumb_instruction_t *program_counter,
+                const uint32_t *stack_bottom_end_p,
+                const uint32_t **frame_pointer_p,
+                uintptr_t *prev_return_address_p)
+{
+    struct function_prolog prolog;
+    const uint32_t *prev_frame_pointer;
+    uintptr_t prev_return_address;
+    const uint32_t *frame_pointer = *frame_pointer_p;
+
+    if (program_counter == NULL) {
+        uintptr_t return_address;
+
+        CAPTURE_ARM_LR_REGISTER(return_address);
+        program_counter = (thumb_instruction_t *)GET_CALL_ADDRESS(return_address);
+    }
+
+    if (((uintptr_t)program_counter & 0x1) != 0) {
+        return false;
+    }
+
+    if (!VALID_RAM_POINTER(frame_pointer, sizeof(uint32_t))) {
+        return false;
+    }
+
+    if (!decode_function_prolog_cached(program_counter, &prolog)) {
+        return false;
+    }
+
+    frame_pointer += prolog.frame_pointer_offset;
+    if (frame_pointer + prolog.pushed_r7_index >= stack_bottom_end_p) {
         return false;
     }
 
-    if (instruction & PUSH_OPERAND_INCLUDES_LR_MASK) {
-        prev_return_address = frame_pointer[stack_index + 1];
+    prev_frame_pointer = (uint32_t *)frame_pointer[prolog.pushed_r7_index];
+    if (prolog.pushed_lr) {
+        prev_return_address = frame_pointer[prolog.pushed_r7_index + 1];
         if ((prev_return_address & 0x1) == 0) {
             return false;
         }
@@ -186,7 +410,14 @@ static bool find_previous_stack_frame(
         /*
          * Inline function with stack frame case
          */
-        prev_return_address = (uintptr_t)(program_counter - 1);
+        prev_return_address = (uintptr_t)(prolog.push_instruction_p - 1);
+    }
+
+    if (!IS_CPU_EXCEPTION_RETURN(prev_return_address) &&
+        (!VALID_RAM_POINTER(prev_frame_pointer, sizeof(uint32_t)) ||
+         prev_frame_pointer <= frame_pointer ||
+         prev_frame_pointer >= stack_bottom_end_p)) {
+        return false;
     }
 
     *frame_pointer_p = prev_frame_pointer;
@@ -322,3 +553,101 @@ void stack_trace_capture(uint_fast8_t num_entries_to_skip,
 
     *num_entries_p = num_entries;
 }
+
+
+/**
+ * Captures the stack trace of the code interrupted by the current exception.
+ * It is to be called from an interrupt handler, or from a function called by
+ * it, with the interrupted code being a task. The first stack trace entry is
+ * the interrupted instruction.
+ *
+ * If the interrupted code was not a task (another exception handler, or code
+ * running before the RTOS scheduler was started), the only entry returned is
+ * the exception return value of the current exception.
+ *
+ * @param trace_buff        Area to store the captured stack trace
+ * @param num_entries_p     On entry, the capacity of trace_buff. Upon return,
+ *                          the number of stack trace entries
+ */
+void stack_trace_capture_interrupted(uintptr_t trace_buff[],
+                                     uint_fast8_t *num_entries_p)
+{
+    const uint32_t *frame_pointer;
+    const thumb_instruction_t *program_counter = NULL;
+    uintptr_t return_address = 0;
+    uint_fast8_t max_num_entries = *num_entries_p;
+    uint_fast8_t i;
+
+    D_ASSERT(CPU_MODE_IS_HANDLER());
+    D_ASSERT(max_num_entries != 0);
+    *num_entries_p = 0;
+    CAPTURE_ARM_FRAME_POINTER_REGISTER(frame_pointer);
+
+    /*
+     * Unwind the exception handler's own stack frames, in the main stack, up
+     * to the exception return. The frame pointer saved in the outermost frame
+     * is the one of the interrupted code:
+     */
+    for (i = 0; i < STACK_TRACE_MAX_HANDLER_FRAMES; i ++) {
+        if (!find_previous_stack_frame(program_counter, __StackTop,
+                                       &frame_pointer, &return_address)) {
+            return;
+        }
+
+        if (IS_CPU_EXCEPTION_RETURN(return_address)) {
+            break;
+        }
+
+        program_counter =
+            (const thumb_instruction_t *)GET_CALL_ADDRESS(return_address) - 1;
+    }
+
+    if (i == STACK_TRACE_MAX_HANDLER_FRAMES) {
+        return;
+    }
+
+    const struct rtos_task *task_p = rtos_task_get_interrupted();
+
+    if ((return_address & CPU_EXC_RETURN_USING_PSP_MASK) == 0 || task_p == NULL) {
+        trace_buff[0] = return_address;
+        *num_entries_p = 1;
+        return;
+    }
+
+    const uint32_t *exception_frame_p = (const uint32_t *)__get_PSP();
+    uintptr_t interrupted_pc = exception_frame_p[EXCEPTION_FRAME_PC_INDEX];
+    uintptr_t interrupted_lr = exception_frame_p[EXCEPTION_FRAME_LR_INDEX];
+    const uint32_t *stack_bottom_end_p =
+        (uint32_t *)&task_p->tsk_stack[APP_TASK_STACK_SIZE];
+    const uint32_t *stack_top_end_p = (uint32_t *)task_p->tsk_stack;
+    uint8_t num_entries = max_num_entries - 1;
+
+    trace_buff[0] = interrupted_pc;
+    *num_entries_p = 1;
+    if (max_num_entries == 1) {
+        return;
+    }
+
+    /*
+     * Continue unwinding in the interrupted task's stack. If the interrupted
+     * function does not have a stack frame (or had not set it up yet), fall
+     * back to the stacked lr as the only caller:
+     */
+    if (frame_pointer >= stack_top_end_p && frame_pointer < stack_bottom_end_p &&
+        find_previous_stack_frame((const thumb_instruction_t *)interrupted_pc - 1,
+                                  stack_bottom_end_p,
+                                  &frame_pointer,
+                                  &return_address)) {
+        unwind_execution_stack(0,
+                               return_address,
+                               frame_pointer,
+                               stack_bottom_end_p,
+                               &trace_buff[1],
+                               &num_entries);
+        *num_entries_p = 1 + num_entries;
+    } else if ((interrupted_lr & 0x1) != 0 &&
+               !IS_CPU_EXCEPTION_RETURN(interrupted_lr)) {
+        trace_buff[1] = GET_CALL_ADDRESS(interrupted_lr);
+        *num_entries_p = 2;
+    }
+}
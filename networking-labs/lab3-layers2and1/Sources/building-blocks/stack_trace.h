@@ -14,4 +14,9 @@ void stack_trace_capture(uint_fast8_t num_entries_to_skip,
 	                     uintptr_t trace_buff[],
 	                     uint_fast8_t *num_entries_p);
 
+void stack_trace_capture_interrupted(uintptr_t trace_buff[],
+                                     uint_fast8_t *num_entries_p);
+
+void stack_trace_get_prolog_cache_stats(uint32_t *hits_p, uint32_t *misses_p);
+
 #endif /* SOURCES_BUILDING_BLOCKS_STACK_TRACE_H_ */
@@ -0,0 +1,427 @@
+/**
+ * @file telemetry_beacon.c
+ *
+ * Telemetry beacon implementation
+ *
+ * @author German Rivera
+ */
+#include "telemetry_beacon.h"
+#include "networking.h"
+#include "networking_layer4.h"
+#include "networking_layer2.h"
+#include "hr_timer.h"
+#include "atomic_utils.h"
+#include "rtos_wrapper.h"
+#include "time_utils.h"
+#include "arm_cortex_m_defs.h"
+#include "mem_utils.h"
+#include <string.h>
+
+/**
+ * Local UDP port used by the telemetry beacon
+ */
+#define TELEMETRY_BEACON_LOCAL_PORT     8895
+
+/**
+ * Length of the Ethernet frame of a telemetry beacon
+ */
+#define TELEMETRY_BEACON_FRAME_LENGTH \
+        (sizeof(struct ethernet_header) + sizeof(struct ipv4_header) + \
+         sizeof(struct udp_header) + sizeof(struct telemetry_beacon))
+
+/**
+ * Telemetry beacon sender state
+ */
+struct telemetry_beacon_sender {
+    bool initialized;
+
+    /**
+     * Flag indicating if beacons are to be sent
+     */
+    volatile bool enabled;
+
+    /**
+     * Period between beacons in milliseconds
+     */
+    volatile uint32_t period_ms;
+
+    /**
+     * UDP port of the multicast group (big endian)
+     */
+    uint16_t group_port;
+
+    /**
+     * Sequence number of the next beacon to send
+     */
+    uint32_t next_seq_num;
+
+    /**
+     * get_monotonic_cycles() and rtos_get_idle_task_cpu_cycles() values
+     * when the previous beacon was sent, to measure the CPU load in
+     * between. last_cycles is 0 if no beacon has been sent yet.
+     */
+    uint64_t last_cycles;
+    uint64_t last_idle_cycles;
+
+    struct telemetry_beacon_stats stats;
+
+    /**
+     * Tx packet from which all beacons are sent. It is allocated once and
+     * never freed, and the fixed fields of its beacon are filled in only
+     * when the beacon is started.
+     */
+    struct network_packet *tx_packet_p;
+
+    /**
+     * IPv4 flow to the multicast group, which caches the prebuilt Ethernet
+     * and IPv4 headers of the beacons
+     */
+    struct net_ipv4_flow flow;
+
+    /**
+     * Mutex to serialize access to this structure
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Local UDP end point
+     */
+    struct net_layer4_end_point end_point;
+
+    /**
+     * Telemetry beacon task
+     */
+    struct rtos_task task;
+};
+
+static struct telemetry_beacon_sender g_telemetry_beacon_sender = {
+    .initialized = false,
+    .enabled = false,
+};
+
+
+static void telemetry_beacon_copy_packet_counts(
+    const struct net_layer_packet_counts *counts_p,
+    struct telemetry_beacon_packet_counts *beacon_counts_p)
+{
+    beacon_counts_p->rx_accepted = hton32(counts_p->rx_packets_accepted_count);
+    beacon_counts_p->rx_dropped = hton32(counts_p->rx_packets_dropped_count);
+    beacon_counts_p->sent = hton32(counts_p->sent_packets_count);
+}
+
+
+static void telemetry_beacon_copy_pool_occupancy(
+    const struct net_packet_pool_stats *pool_stats_p,
+    struct telemetry_beacon_pool_occupancy *beacon_pool_p)
+{
+    beacon_pool_p->total_packets = hton16(pool_stats_p->total_packets);
+    beacon_pool_p->free_packets = hton16(pool_stats_p->free_packets);
+    beacon_pool_p->in_use_high_water_mark =
+        hton16(pool_stats_p->in_use_high_water_mark);
+}
+
+
+/**
+ * Returns the CPU load since the previous beacon, in hundredths of a
+ * percent. Must be called with the sender's mutex held.
+ */
+static uint16_t telemetry_beacon_get_cpu_load(struct telemetry_beacon_sender *sender_p)
+{
+    uint64_t now_cycles = get_monotonic_cycles();
+    uint64_t idle_cycles = rtos_get_idle_task_cpu_cycles();
+    uint16_t cpu_load = TELEMETRY_BEACON_CPU_LOAD_UNKNOWN;
+
+    /*
+     * If the CPU utilization stats were reset since the previous beacon,
+     * the idle cycles count went back, and the load cannot be measured
+     * this time:
+     */
+    if (sender_p->last_cycles != 0 && now_cycles > sender_p->last_cycles &&
+        idle_cycles >= sender_p->last_idle_cycles) {
+        uint64_t elapsed_cycles = now_cycles - sender_p->last_cycles;
+        uint64_t idle_delta_cycles = idle_cycles - sender_p->last_idle_cycles;
+
+        if (idle_delta_cycles > elapsed_cycles) {
+            idle_delta_cycles = elapsed_cycles;
+        }
+
+        cpu_load = 10000 - (uint16_t)((idle_delta_cycles * 10000) / elapsed_cycles);
+    }
+
+    sender_p->last_cycles = now_cycles;
+    sender_p->last_idle_cycles = idle_cycles;
+    return cpu_load;
+}
+
+
+/**
+ * Fills in the fields of the beacon that do not change from one beacon to
+ * the next. Must be called with the sender's mutex held, and with the
+ * beacon's Tx packet not in transit.
+ */
+static void telemetry_beacon_fill_fixed_fields(struct telemetry_beacon_sender *sender_p)
+{
+    struct telemetry_beacon *beacon_p =
+        get_ipv4_udp_data_payload_area(sender_p->tx_packet_p);
+    struct ethernet_mac_address mac_addr;
+
+    net_layer2_get_mac_addr(&g_net_layer2.local_layer2_end_points[0], &mac_addr);
+    memset(beacon_p, 0, sizeof *beacon_p);
+    beacon_p->magic = hton32(TELEMETRY_BEACON_MAGIC);
+    beacon_p->version = TELEMETRY_BEACON_VERSION;
+    beacon_p->period_ms = hton16(sender_p->period_ms);
+    memcpy(beacon_p->mac_addr, mac_addr.bytes, sizeof beacon_p->mac_addr);
+}
+
+
+/**
+ * Sends the next beacon. If the previous beacon is still in transit, this
+ * beacon is skipped, as there is only one Tx packet for beacons. Must be
+ * called with the sender's mutex held.
+ */
+static void telemetry_beacon_send(struct telemetry_beacon_sender *sender_p)
+{
+    struct network_packet *tx_packet_p = sender_p->tx_packet_p;
+    struct net_stats_snapshot snapshot;
+    struct net_packet_pool_stats pool_stats;
+    struct hr_timer_stats hr_timer_stats;
+    struct rtos_isr_stats isr_stats;
+    uint32_t max_interrupts_disabled_us;
+    uintptr_t code_addr;
+    uint32_t max_isr_cycles = 0;
+    error_t error;
+
+    if (tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT) {
+        sender_p->stats.tx_busy_skips ++;
+        return;
+    }
+
+    struct telemetry_beacon *beacon_p = get_ipv4_udp_data_payload_area(tx_packet_p);
+
+    networking_get_stats_snapshot(&snapshot);
+    beacon_p->flags = snapshot.link_is_up ? TELEMETRY_BEACON_LINK_UP_MASK : 0;
+    beacon_p->seq_num = hton32(sender_p->next_seq_num);
+    beacon_p->uptime_sec = hton32(rtos_get_time_since_boot());
+    beacon_p->cpu_load = hton16(telemetry_beacon_get_cpu_load(sender_p));
+    telemetry_beacon_copy_packet_counts(&snapshot.layer2, &beacon_p->layer2);
+    telemetry_beacon_copy_packet_counts(&snapshot.ipv4, &beacon_p->ipv4);
+    telemetry_beacon_copy_packet_counts(&snapshot.udp, &beacon_p->udp);
+
+    net_layer2_get_tx_packet_pool_stats(&pool_stats);
+    telemetry_beacon_copy_pool_occupancy(&pool_stats, &beacon_p->tx_pool);
+    net_layer2_end_point_get_rx_packet_pool_stats(
+        &g_net_layer2.local_layer2_end_points[0], &pool_stats);
+    telemetry_beacon_copy_pool_occupancy(&pool_stats, &beacon_p->rx_pool);
+
+    get_max_interrupts_disabled_stats_us(&max_interrupts_disabled_us, &code_addr);
+    hr_timer_get_stats(&hr_timer_stats);
+    for (unsigned int i = 0; rtos_get_isr_stats(i, &isr_stats); i ++) {
+        if (isr_stats.max_cycles > max_isr_cycles) {
+            max_isr_cycles = isr_stats.max_cycles;
+        }
+    }
+
+    beacon_p->max_interrupts_disabled_us = hton32(max_interrupts_disabled_us);
+    beacon_p->max_timer_late_us =
+        hton32(CPU_CLOCK_CYCLES_TO_MICROSECONDS(hr_timer_stats.max_late_cycles));
+    beacon_p->max_isr_us = hton32(CPU_CLOCK_CYCLES_TO_MICROSECONDS(max_isr_cycles));
+
+    error = net_layer4_send_udp_datagram_over_ipv4_flow(&sender_p->end_point,
+                                                        &sender_p->flow,
+                                                        sender_p->group_port,
+                                                        tx_packet_p,
+                                                        sizeof *beacon_p);
+    if (error != 0) {
+        sender_p->stats.send_failures ++;
+        return;
+    }
+
+    sender_p->next_seq_num ++;
+    sender_p->stats.beacons_sent ++;
+}
+
+
+/**
+ * Telemetry beacon task
+ */
+static void telemetry_beacon_task_func(void *arg)
+{
+    struct telemetry_beacon_sender *sender_p = arg;
+
+    D_ASSERT(sender_p == &g_telemetry_beacon_sender);
+
+    for ( ; ; ) {
+        rtos_task_delay(sender_p->period_ms);
+
+#       ifdef USE_MPU
+        struct mpu_region_range old_comp_region;
+
+        rtos_thread_set_comp_region(sender_p,
+                                    sizeof *sender_p,
+                                    0,
+                                    &old_comp_region);
+#       endif
+
+        rtos_mutex_lock(&sender_p->mutex);
+        if (sender_p->enabled) {
+            telemetry_beacon_send(sender_p);
+        }
+
+        rtos_mutex_unlock(&sender_p->mutex);
+
+#       ifdef USE_MPU
+        rtos_thread_restore_comp_region(&old_comp_region);
+#       endif
+    }
+}
+
+
+/**
+ * Starts sending telemetry beacons to a given IPv4 multicast group. The
+ * first time it is called, it allocates the beacons' Tx packet and creates
+ * the telemetry beacon task. If beacons are already being sent, it just
+ * switches to the new group and period.
+ *
+ * @param group_ip_addr_p   IPv4 multicast group address
+ * @param group_port        UDP port of the multicast group (big endian)
+ * @param period_ms         Period between beacons in milliseconds (at least
+ *                          TELEMETRY_BEACON_MIN_PERIOD_MS)
+ *
+ * @return 0, on success
+ * @return error code, otherwise
+ */
+error_t telemetry_beacon_start(const struct ipv4_address *group_ip_addr_p,
+                               uint16_t group_port, /* big endian */
+                               uint32_t period_ms)
+{
+    struct telemetry_beacon_sender *const sender_p = &g_telemetry_beacon_sender;
+    error_t error = 0;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    if (!IPV4_ADDR_IS_MULTICAST(group_ip_addr_p) || group_port == 0) {
+        return CAPTURE_ERROR("Invalid telemetry beacon group",
+                             group_ip_addr_p->value, ntoh16(group_port));
+    }
+
+    if (period_ms < TELEMETRY_BEACON_MIN_PERIOD_MS || period_ms > UINT16_MAX) {
+        return CAPTURE_ERROR("Invalid telemetry beacon period", period_ms, 0);
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(sender_p,
+                                sizeof *sender_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    if (!sender_p->initialized) {
+        sender_p->tx_packet_p =
+            net_layer2_try_allocate_tx_packet(TELEMETRY_BEACON_FRAME_LENGTH, false);
+        if (sender_p->tx_packet_p == NULL) {
+            error = CAPTURE_ERROR("No Tx packet available for telemetry beacon",
+                                  0, 0);
+            goto common_exit;
+        }
+
+        rtos_mutex_init(&sender_p->mutex, "Telemetry beacon mutex");
+        net_layer4_udp_end_point_init(&sender_p->end_point);
+        error = net_layer4_udp_end_point_bind(&sender_p->end_point,
+                                              hton16(TELEMETRY_BEACON_LOCAL_PORT));
+        if (error != 0) {
+            net_layer2_free_tx_packet(sender_p->tx_packet_p);
+            sender_p->tx_packet_p = NULL;
+            goto common_exit;
+        }
+
+        sender_p->period_ms = period_ms;
+        sender_p->initialized = true;
+        rtos_task_create(&sender_p->task,
+                         "Telemetry beacon task",
+                         telemetry_beacon_task_func,
+                         sender_p,
+                         RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
+    }
+
+    rtos_mutex_lock(&sender_p->mutex);
+
+    /*
+     * The fixed fields cannot be changed while the last beacon is in
+     * transit, so wait for its transmission to complete:
+     */
+    while (sender_p->tx_packet_p->state_flags & NET_PACKET_IN_TX_TRANSIT) {
+        rtos_task_delay(1);
+    }
+
+    sender_p->group_port = group_port;
+    sender_p->period_ms = period_ms;
+    net_layer3_ipv4_flow_init(&sender_p->flow, group_ip_addr_p,
+                              IP_PACKET_TYPE_UDP);
+    telemetry_beacon_fill_fixed_fields(sender_p);
+    sender_p->last_cycles = 0;
+    sender_p->enabled = true;
+    rtos_mutex_unlock(&sender_p->mutex);
+
+common_exit:
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+
+    return error;
+}
+
+
+/**
+ * Stops sending telemetry beacons. The beacons' Tx packet stays allocated,
+ * and the telemetry beacon task stays idle until telemetry_beacon_start()
+ * is called again.
+ */
+void telemetry_beacon_stop(void)
+{
+    struct telemetry_beacon_sender *const sender_p = &g_telemetry_beacon_sender;
+
+    D_ASSERT(CALLER_IS_THREAD());
+
+    if (!sender_p->initialized) {
+        return;
+    }
+
+#   ifdef USE_MPU
+    struct mpu_region_range old_comp_region;
+
+    rtos_thread_set_comp_region(sender_p,
+                                sizeof *sender_p,
+                                0,
+                                &old_comp_region);
+#   endif
+
+    rtos_mutex_lock(&sender_p->mutex);
+    sender_p->enabled = false;
+    rtos_mutex_unlock(&sender_p->mutex);
+
+#   ifdef USE_MPU
+    rtos_thread_restore_comp_region(&old_comp_region);
+#   endif
+}
+
+
+/**
+ * Takes a snapshot of the telemetry beacon statistics
+ *
+ * @param stats_p   Area where the snapshot is to be returned
+ */
+void telemetry_beacon_get_stats(struct telemetry_beacon_stats *stats_p)
+{
+    struct telemetry_beacon_sender *const sender_p = &g_telemetry_beacon_sender;
+
+    if (!sender_p->initialized) {
+        memset(stats_p, 0, sizeof *stats_p);
+        return;
+    }
+
+    rtos_mutex_lock(&sender_p->mutex);
+    *stats_p = sender_p->stats;
+    rtos_mutex_unlock(&sender_p->mutex);
+}
@@ -0,0 +1,177 @@
+/**
+ * @file telemetry_beacon.h
+ *
+ * Telemetry beacon interface
+ *
+ * The telemetry beacon is a background task that periodically sends a
+ * compact binary summary of the node's health (layer 2/3/4 packet counters,
+ * packet pool occupancy, CPU load and interrupt latency maxima) in one UDP
+ * datagram to an IPv4 multicast group, so that a single collector joined to
+ * the group can watch all the nodes of a network segment, without polling
+ * each one.
+ *
+ * To keep the per-beacon cost low, the beacon is always sent from the same
+ * preallocated Tx packet, whose fixed fields are filled in only once, and
+ * the Ethernet and IPv4 headers are copied from the prebuilt header template
+ * of an IPv4 flow to the multicast group.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_TELEMETRY_BEACON_H_
+#define SOURCES_BUILDING_BLOCKS_TELEMETRY_BEACON_H_
+
+#include <stdint.h>
+#include "networking_layer3.h"
+#include "compile_time_checks.h"
+#include "runtime_checks.h"
+
+/**
+ * Default IPv4 multicast group of the telemetry beacons (239.255.0.1, in
+ * the organization-local scope)
+ */
+#define TELEMETRY_BEACON_DEFAULT_GROUP_ADDR_INITIALIZER \
+        { .bytes = { 239, 255, 0, 1 } }
+
+/**
+ * Default UDP port of the telemetry beacons
+ */
+#define TELEMETRY_BEACON_DEFAULT_PORT       8894
+
+/**
+ * Default and minimum periods between beacons in milliseconds
+ */
+#define TELEMETRY_BEACON_DEFAULT_PERIOD_MS  1000
+#define TELEMETRY_BEACON_MIN_PERIOD_MS      100
+
+/**
+ * Value of the cpu_load field when the CPU load could not be measured
+ */
+#define TELEMETRY_BEACON_CPU_LOAD_UNKNOWN   UINT16_MAX
+
+/**
+ * Packet counters of a networking layer in a telemetry beacon.
+ * All fields are big endian.
+ */
+struct telemetry_beacon_packet_counts {
+    uint32_t rx_accepted;
+    uint32_t rx_dropped;
+    uint32_t sent;
+};
+
+C_ASSERT(sizeof(struct telemetry_beacon_packet_counts) == 12);
+
+/**
+ * Occupancy of a packet pool in a telemetry beacon. All fields are big
+ * endian.
+ */
+struct telemetry_beacon_pool_occupancy {
+    uint16_t total_packets;
+    uint16_t free_packets;
+    uint16_t in_use_high_water_mark;
+};
+
+C_ASSERT(sizeof(struct telemetry_beacon_pool_occupancy) == 6);
+
+/**
+ * Payload of a telemetry beacon datagram. Packet counters are free-running
+ * totals, so that the collector can compute rates from consecutive beacons
+ * and is not affected by lost beacons. Maxima are the largest values seen
+ * since boot or since the corresponding stats were last reset. All fields
+ * are big endian.
+ */
+struct telemetry_beacon {
+#   define TELEMETRY_BEACON_MAGIC  GEN_SIGNATURE('T', 'L', 'M', 'B')
+    uint32_t magic;
+
+#   define TELEMETRY_BEACON_VERSION  1
+    uint8_t version;
+
+    uint8_t flags;
+#   define TELEMETRY_BEACON_LINK_UP_MASK    BIT(0)
+
+    /**
+     * Period between beacons in milliseconds
+     */
+    uint16_t period_ms;
+
+    /**
+     * Sequence number of the beacon, so that the collector can detect lost
+     * beacons and node resets
+     */
+    uint32_t seq_num;
+
+    /**
+     * Time since boot in seconds
+     */
+    uint32_t uptime_sec;
+
+    /**
+     * MAC address of the node, which identifies the node even if its IPv4
+     * address changes
+     */
+    uint8_t mac_addr[6];
+
+    /**
+     * CPU load since the previous beacon, in hundredths of a percent (time
+     * not spent in the RTOS idle task), or TELEMETRY_BEACON_CPU_LOAD_UNKNOWN
+     */
+    uint16_t cpu_load;
+
+    struct telemetry_beacon_packet_counts layer2;
+    struct telemetry_beacon_packet_counts ipv4;
+    struct telemetry_beacon_packet_counts udp;
+
+    struct telemetry_beacon_pool_occupancy tx_pool;
+    struct telemetry_beacon_pool_occupancy rx_pool;
+
+    /**
+     * Longest time that interrupts have been disabled, in microseconds. It
+     * bounds the latency of all interrupts.
+     */
+    uint32_t max_interrupts_disabled_us;
+
+    /**
+     * Largest delay between the deadline of a high-resolution timer and
+     * the invocation of its callback, in microseconds. It is the measured
+     * worst-case latency of the PIT1 interrupt.
+     */
+    uint32_t max_timer_late_us;
+
+    /**
+     * Longest duration of any ISR, in microseconds
+     */
+    uint32_t max_isr_us;
+};
+
+C_ASSERT(sizeof(struct telemetry_beacon) == 84);
+
+/**
+ * Telemetry beacon statistics
+ */
+struct telemetry_beacon_stats {
+    /**
+     * Number of beacons sent
+     */
+    uint32_t beacons_sent;
+
+    /**
+     * Number of beacons that could not be sent
+     */
+    uint32_t send_failures;
+
+    /**
+     * Number of beacons skipped, because the previous beacon was still in
+     * transit
+     */
+    uint32_t tx_busy_skips;
+};
+
+error_t telemetry_beacon_start(const struct ipv4_address *group_ip_addr_p,
+                               uint16_t group_port, /* big endian */
+                               uint32_t period_ms);
+
+void telemetry_beacon_stop(void);
+
+void telemetry_beacon_get_stats(struct telemetry_beacon_stats *stats_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_TELEMETRY_BEACON_H_ */
@@ -0,0 +1,499 @@
+/**
+ * @file text_format.c
+ *
+ * printf-style text formatter implementation
+ *
+ * @author German Rivera
+ */
+#include "text_format.h"
+#include "runtime_checks.h"
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * Maximum number of characters of a 32-bit integer converted to text
+ * (10 decimal digits)
+ */
+#define MAX_NUMBER_DIGITS   10
+
+/*
+ * Format flags
+ */
+#define FMT_FLAG_LEFT_JUSTIFY   0x1
+#define FMT_FLAG_ZERO_PAD       0x2
+#define FMT_FLAG_ALTERNATE      0x4
+#define FMT_FLAG_PLUS_SIGN      0x8
+#define FMT_FLAG_SPACE_SIGN     0x10
+
+/**
+ * Pairs of decimal digits for numbers 00 to 99, to convert two decimal
+ * digits per division
+ */
+static const char g_decimal_digit_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char g_lower_hex_digits[16] = "0123456789abcdef";
+
+static const char g_upper_hex_digits[16] = "0123456789ABCDEF";
+
+
+/**
+ * Divides a 32-bit unsigned integer by 100, using a multiplication by the
+ * reciprocal (a single UMULL), instead of a UDIV instruction. The result
+ * is exact for all 32-bit values.
+ */
+static inline uint32_t div_by_100(uint32_t value)
+{
+    return (uint32_t)(((uint64_t)value * UINT64_C(0x51eb851f)) >> 37);
+}
+
+
+/**
+ * Initializes a format span
+ *
+ * @param span_p        pointer to the format span
+ * @param buffer_p      buffer where the formatted text is to be written
+ * @param buffer_size   size of the buffer in bytes
+ * @param flush_func_p  function to drain the buffer when it gets full, or
+ *                      NULL, to drop text that does not fit in the buffer
+ * @param flush_arg_p   argument for the flush function
+ */
+void format_span_init(struct format_span *span_p,
+                      char *buffer_p,
+                      size_t buffer_size,
+                      format_span_flush_func_t *flush_func_p,
+                      void *flush_arg_p)
+{
+    D_ASSERT(buffer_p != NULL && buffer_size != 0);
+
+    span_p->buffer_p = buffer_p;
+    span_p->buffer_size = buffer_size;
+    span_p->length = 0;
+    span_p->flush_func_p = flush_func_p;
+    span_p->flush_arg_p = flush_arg_p;
+    span_p->num_dropped = 0;
+    span_p->num_generated = 0;
+}
+
+
+/**
+ * Makes room in a format span, if it is full
+ *
+ * @return true, if there is room in the buffer
+ * @return false, otherwise
+ */
+static bool format_span_make_room(struct format_span *span_p)
+{
+    if (span_p->length < span_p->buffer_size) {
+        return true;
+    }
+
+    if (span_p->flush_func_p == NULL) {
+        return false;
+    }
+
+    span_p->flush_func_p(span_p);
+    D_ASSERT(span_p->length == 0);
+    return true;
+}
+
+
+/**
+ * Appends a sequence of characters to a format span, copying as many
+ * characters at once as fit in the buffer
+ *
+ * @param span_p    pointer to the span
+ * @param chars_p   characters to append
+ * @param num_chars number of characters to append
+ */
+void format_span_put_chars(struct format_span *span_p,
+                           const char *chars_p, size_t num_chars)
+{
+    span_p->num_generated += num_chars;
+    while (num_chars != 0) {
+        if (!format_span_make_room(span_p)) {
+            span_p->num_dropped += num_chars;
+            return;
+        }
+
+        size_t chunk_size = span_p->buffer_size - span_p->length;
+
+        if (chunk_size > num_chars) {
+            chunk_size = num_chars;
+        }
+
+        memcpy(&span_p->buffer_p[span_p->length], chars_p, chunk_size);
+        span_p->length += chunk_size;
+        chars_p += chunk_size;
+        num_chars -= chunk_size;
+    }
+}
+
+
+/**
+ * Appends a sequence of copies of a given character to a format span
+ */
+static void format_span_put_repeated_char(struct format_span *span_p,
+                                          char c, size_t count)
+{
+    span_p->num_generated += count;
+    while (count != 0) {
+        if (!format_span_make_room(span_p)) {
+            span_p->num_dropped += count;
+            return;
+        }
+
+        size_t chunk_size = span_p->buffer_size - span_p->length;
+
+        if (chunk_size > count) {
+            chunk_size = count;
+        }
+
+        memset(&span_p->buffer_p[span_p->length], c, chunk_size);
+        span_p->length += chunk_size;
+        count -= chunk_size;
+    }
+}
+
+
+/**
+ * Converts a 32-bit unsigned integer to decimal text, two digits at a time.
+ * The digits are written backwards, ending right before end_p.
+ *
+ * @return pointer to the first digit
+ */
+static char *uint32_to_decimal(uint32_t value, char *end_p)
+{
+    char *s = end_p;
+
+    while (value >= 100) {
+        uint32_t quotient = div_by_100(value);
+        const char *pair_p = &g_decimal_digit_pairs[(value - quotient * 100) * 2];
+
+        s -= 2;
+        s[0] = pair_p[0];
+        s[1] = pair_p[1];
+        value = quotient;
+    }
+
+    if (value >= 10) {
+        s -= 2;
+        s[0] = g_decimal_digit_pairs[value * 2];
+        s[1] = g_decimal_digit_pairs[value * 2 + 1];
+    } else {
+        s --;
+        *s = '0' + value;
+    }
+
+    return s;
+}
+
+
+/**
+ * Converts a 32-bit unsigned integer to hexadecimal text. The digits are
+ * written backwards, ending right before end_p.
+ *
+ * @return pointer to the first digit
+ */
+static char *uint32_to_hexadecimal(uint32_t value, char *end_p,
+                                   const char *hex_digits)
+{
+    char *s = end_p;
+
+    do {
+        s --;
+        *s = hex_digits[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+
+    return s;
+}
+
+
+/**
+ * Appends formatted text to a format span, padding it to the given field
+ * width
+ *
+ * @param span_p        pointer to the span
+ * @param prefix_s      sign or "0x" prefix (placed before zero padding)
+ * @param chars_p       characters to append
+ * @param num_chars     number of characters to append
+ * @param width         minimum field width
+ * @param flags         format flags
+ */
+static void format_field(struct format_span *span_p,
+                         const char *prefix_s,
+                         const char *chars_p,
+                         size_t num_chars,
+                         size_t width,
+                         uint_fast8_t flags)
+{
+    size_t prefix_length = strlen(prefix_s);
+    size_t num_pad_chars = 0;
+
+    if (width > prefix_length + num_chars) {
+        num_pad_chars = width - (prefix_length + num_chars);
+    }
+
+    if (flags & FMT_FLAG_LEFT_JUSTIFY) {
+        format_span_put_chars(span_p, prefix_s, prefix_length);
+        format_span_put_chars(span_p, chars_p, num_chars);
+        format_span_put_repeated_char(span_p, ' ', num_pad_chars);
+    } else if (flags & FMT_FLAG_ZERO_PAD) {
+        format_span_put_chars(span_p, prefix_s, prefix_length);
+        format_span_put_repeated_char(span_p, '0', num_pad_chars);
+        format_span_put_chars(span_p, chars_p, num_chars);
+    } else {
+        format_span_put_repeated_char(span_p, ' ', num_pad_chars);
+        format_span_put_chars(span_p, prefix_s, prefix_length);
+        format_span_put_chars(span_p, chars_p, num_chars);
+    }
+}
+
+
+/**
+ * Drains the contents of a format span, if it has a flush function and it
+ * is not empty
+ *
+ * @param span_p    pointer to the span
+ */
+void format_span_flush(struct format_span *span_p)
+{
+    if (span_p->flush_func_p != NULL && span_p->length != 0) {
+        span_p->flush_func_p(span_p);
+        D_ASSERT(span_p->length == 0);
+    }
+}
+
+
+/**
+ * Formats text into a format span, in the way of vprintf(). If the span
+ * has a flush function, it is invoked every time the buffer gets full.
+ * Text left in the buffer at the end is not flushed, so that the output of
+ * several calls can be coalesced. Call format_span_flush() to drain it.
+ *
+ * @param span_p    pointer to the span
+ * @param fmt_s     format string
+ * @param ap        arguments for the format string
+ *
+ * @return number of characters generated (including dropped characters)
+ */
+size_t text_format_vprintf(struct format_span *span_p, const char *fmt_s,
+                           va_list ap)
+{
+    char digits[MAX_NUMBER_DIGITS];
+    char *const digits_end_p = &digits[MAX_NUMBER_DIGITS];
+    size_t initial_count = span_p->num_generated;
+    const char *s = fmt_s;
+
+    while (*s != '\0') {
+        const char *literal_p = s;
+
+        while (*s != '\0' && *s != '%') {
+            s ++;
+        }
+
+        if (s != literal_p) {
+            format_span_put_chars(span_p, literal_p, s - literal_p);
+            if (*s == '\0') {
+                break;
+            }
+        }
+
+        uint_fast8_t flags = 0;
+        size_t width = 0;
+        size_t precision = SIZE_MAX;
+
+        s ++;
+        for ( ; ; s ++) {
+            if (*s == '-') {
+                flags |= FMT_FLAG_LEFT_JUSTIFY;
+            } else if (*s == '0') {
+                flags |= FMT_FLAG_ZERO_PAD;
+            } else if (*s == '#') {
+                flags |= FMT_FLAG_ALTERNATE;
+            } else if (*s == '+') {
+                flags |= FMT_FLAG_PLUS_SIGN;
+            } else if (*s == ' ') {
+                flags |= FMT_FLAG_SPACE_SIGN;
+            } else {
+                break;
+            }
+        }
+
+        if (*s == '*') {
+            int arg_width = va_arg(ap, int);
+
+            if (arg_width < 0) {
+                flags |= FMT_FLAG_LEFT_JUSTIFY;
+                arg_width = -arg_width;
+            }
+
+            width = arg_width;
+            s ++;
+        } else {
+            while (*s >= '0' && *s <= '9') {
+                width = width * 10 + (*s - '0');
+                s ++;
+            }
+        }
+
+        if (*s == '.') {
+            s ++;
+            precision = 0;
+            if (*s == '*') {
+                int arg_precision = va_arg(ap, int);
+
+                precision = arg_precision < 0 ? SIZE_MAX : (size_t)arg_precision;
+                s ++;
+            } else {
+                while (*s >= '0' && *s <= '9') {
+                    precision = precision * 10 + (*s - '0');
+                    s ++;
+                }
+            }
+        }
+
+        while (*s == 'l' || *s == 'h' || *s == 'z') {
+            s ++;
+        }
+
+        char conversion = *s;
+        const char *prefix_s = "";
+        char *digits_p;
+
+        switch (conversion) {
+        case 'd':
+        case 'i': {
+            int32_t value = va_arg(ap, int);
+            uint32_t abs_value;
+
+            if (value < 0) {
+                prefix_s = "-";
+                abs_value = -(uint32_t)value;
+            } else {
+                if (flags & FMT_FLAG_PLUS_SIGN) {
+                    prefix_s = "+";
+                } else if (flags & FMT_FLAG_SPACE_SIGN) {
+                    prefix_s = " ";
+                }
+
+                abs_value = value;
+            }
+
+            digits_p = uint32_to_decimal(abs_value, digits_end_p);
+            format_field(span_p, prefix_s, digits_p, digits_end_p - digits_p,
+                         width, flags);
+            break;
+        }
+
+        case 'u':
+            digits_p = uint32_to_decimal(va_arg(ap, unsigned int), digits_end_p);
+            format_field(span_p, prefix_s, digits_p, digits_end_p - digits_p,
+                         width, flags);
+            break;
+
+        case 'x':
+        case 'X':
+        case 'p': {
+            uint32_t value;
+
+            if (conversion == 'p') {
+                value = (uintptr_t)va_arg(ap, void *);
+                flags |= FMT_FLAG_ALTERNATE;
+            } else {
+                value = va_arg(ap, unsigned int);
+            }
+
+            if ((flags & FMT_FLAG_ALTERNATE) && value != 0) {
+                prefix_s = (conversion == 'X') ? "0X" : "0x";
+            }
+
+            digits_p = uint32_to_hexadecimal(value, digits_end_p,
+                                             conversion == 'X' ?
+                                                g_upper_hex_digits :
+                                                g_lower_hex_digits);
+            format_field(span_p, prefix_s, digits_p, digits_end_p - digits_p,
+                         width, flags);
+            break;
+        }
+
+        case 's': {
+            const char *str_p = va_arg(ap, const char *);
+            size_t str_length = 0;
+
+            if (str_p == NULL) {
+                str_p = "(null)";
+            }
+
+            while (str_length < precision && str_p[str_length] != '\0') {
+                str_length ++;
+            }
+
+            format_field(span_p, prefix_s, str_p, str_length, width,
+                         flags & ~FMT_FLAG_ZERO_PAD);
+            break;
+        }
+
+        case 'c': {
+            char c = (char)va_arg(ap, int);
+
+            format_field(span_p, prefix_s, &c, 1, width,
+                         flags & ~FMT_FLAG_ZERO_PAD);
+            break;
+        }
+
+        case '%':
+            format_span_put_chars(span_p, "%", 1);
+            break;
+
+        case '\0':
+            /*
+             * Format string ends with an incomplete conversion:
+             */
+            s --;
+            break;
+
+        default:
+            /*
+             * Unsupported conversion: print it as is
+             */
+            format_span_put_chars(span_p, "%", 1);
+            format_span_put_chars(span_p, &conversion, 1);
+            break;
+        }
+
+        s ++;
+    }
+
+    return span_p->num_generated - initial_count;
+}
+
+
+/**
+ * Formats text into a format span, in the way of printf()
+ *
+ * @param span_p    pointer to the span
+ * @param fmt_s     format string
+ *
+ * @return number of characters generated (including dropped characters)
+ */
+size_t text_format_printf(struct format_span *span_p, const char *fmt_s, ...)
+{
+    va_list ap;
+    size_t count;
+
+    va_start(ap, fmt_s);
+    count = text_format_vprintf(span_p, fmt_s, ap);
+    va_end(ap);
+    return count;
+}
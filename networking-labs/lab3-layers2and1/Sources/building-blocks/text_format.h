@@ -0,0 +1,88 @@
+/**
+ * @file text_format.h
+ *
+ * printf-style text formatter interface
+ *
+ * This formatter replaces the KSDK _doprint() for console and runtime log
+ * output. Instead of invoking a callback per character, it writes into a
+ * caller-provided span, which is drained in chunks. It supports only the
+ * subset of printf formats used in this code base:
+ * - conversions: %d, %i, %u, %x, %X, %p, %s, %c and %%
+ * - flags: '-', '0', '#', '+' and ' '
+ * - field width (number or '*') and precision for %s
+ * - 'l', 'h' and 'z' length modifiers (ignored, as int is 32 bits)
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_TEXT_FORMAT_H_
+#define SOURCES_BUILDING_BLOCKS_TEXT_FORMAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+struct format_span;
+
+/**
+ * Function invoked to drain the contents of a format span
+ */
+typedef void format_span_flush_func_t(struct format_span *span_p);
+
+/**
+ * Output span for text_format_vprintf()
+ */
+struct format_span {
+    /**
+     * Buffer where the formatted text is written (not null-terminated)
+     */
+    char *buffer_p;
+
+    size_t buffer_size;
+
+    /**
+     * Number of characters currently in buffer_p
+     */
+    size_t length;
+
+    /**
+     * Function called when the buffer is full, and by
+     * format_span_flush(). It must consume the buffer contents and set
+     * length to 0. If NULL, text that does not fit in the buffer is dropped.
+     */
+    format_span_flush_func_t *flush_func_p;
+
+    /**
+     * Argument for the flush function
+     */
+    void *flush_arg_p;
+
+    /**
+     * Number of characters dropped, because the buffer was full and there
+     * was no flush function
+     */
+    size_t num_dropped;
+
+    /**
+     * Total number of characters generated into this span (including
+     * dropped characters)
+     */
+    size_t num_generated;
+};
+
+void format_span_init(struct format_span *span_p,
+                      char *buffer_p,
+                      size_t buffer_size,
+                      format_span_flush_func_t *flush_func_p,
+                      void *flush_arg_p);
+
+void format_span_put_chars(struct format_span *span_p,
+                           const char *chars_p, size_t num_chars);
+
+void format_span_flush(struct format_span *span_p);
+
+size_t text_format_vprintf(struct format_span *span_p, const char *fmt_s,
+                           va_list ap);
+
+size_t text_format_printf(struct format_span *span_p, const char *fmt_s, ...);
+
+#endif /* SOURCES_BUILDING_BLOCKS_TEXT_FORMAT_H_ */
@@ -10,6 +10,44 @@
 #include "microcontroller.h"
 #include "atomic_utils.h"
 
+/**
+ * State used to extend the 32-bit DWT cycle counter to 64 bits
+ */
+struct monotonic_clock {
+    /**
+     * Upper 32 bits of the 64-bit cycle count
+     */
+    uint32_t high_cycles;
+
+    /**
+     * Value of the DWT cycle counter the last time it was read by
+     * get_monotonic_cycles()
+     */
+    uint32_t last_dwt_cycles;
+};
+
+static struct monotonic_clock g_monotonic_clock;
+
+/**
+ * Wall-clock time, kept as an offset from the monotonic time, so that it
+ * costs just one addition on top of get_monotonic_ns(). The offset is set
+ * by a time synchronization client (see sntp_client.c). It is only
+ * accessed with interrupts disabled, as 64-bit accesses are not atomic.
+ */
+struct wall_clock {
+    /**
+     * Nanoseconds since the Unix epoch minus get_monotonic_ns()
+     */
+    int64_t offset_ns;
+
+    /**
+     * Flag indicating if offset_ns has been set
+     */
+    bool offset_set;
+};
+
+static struct wall_clock g_wall_clock;
+
 
 /**
  * Calculate difference between two CPU clock cycle values
@@ -55,6 +93,23 @@ void init_cpu_clock_cycles_counter(void)
 }
 
 
+/**
+ * Starts the DWT cycle counter, if it is not already running. The counter is
+ * not reset if it is already running, so that the samples taken by its
+ * existing users stay valid.
+ */
+void init_dwt_cycles_counter(void)
+{
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0) {
+        return;
+    }
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
 /**
  * Calculates the distance in cycles between two CPU clock cycle count samples,
  * doing a correction to compensate for the overhead of taking the
@@ -96,3 +151,105 @@ void delay_us(uint32_t us)
 		n--;
 	}
 }
+
+
+/**
+ * Returns a 64-bit monotonic count of CPU clock cycles, which does not wrap
+ * around in practice. It extends the 32-bit DWT cycle counter by detecting
+ * its wrap-arounds, so it can be called from both task and ISR context.
+ *
+ * @pre init_dwt_cycles_counter() must have been called, and this function
+ *      must be called at least once per DWT counter wrap-around (every
+ *      2^32 cycles, that is, about 35 seconds at 120 MHz). The RTOS tick
+ *      hook does this.
+ *
+ * @return number of CPU cycles since the DWT cycle counter was started
+ */
+uint64_t get_monotonic_cycles(void)
+{
+    struct monotonic_clock *const clock_p = &g_monotonic_clock;
+    uint32_t int_mask = disable_cpu_interrupts();
+    uint32_t dwt_cycles = get_dwt_cycles();
+
+    if (dwt_cycles < clock_p->last_dwt_cycles) {
+        clock_p->high_cycles ++;
+    }
+
+    clock_p->last_dwt_cycles = dwt_cycles;
+
+    uint64_t cycles = ((uint64_t)clock_p->high_cycles << 32) | dwt_cycles;
+
+    restore_cpu_interrupts(int_mask);
+    return cycles;
+}
+
+
+/**
+ * Returns a 64-bit monotonic time in nanoseconds (see
+ * get_monotonic_cycles()). Its resolution is one CPU clock cycle.
+ *
+ * @return nanoseconds since the DWT cycle counter was started
+ */
+uint64_t get_monotonic_ns(void)
+{
+    return CPU_CLOCK_CYCLES_TO_NANOSECONDS(get_monotonic_cycles());
+}
+
+
+/**
+ * Returns the wall-clock time in nanoseconds since the Unix epoch, for
+ * timestamps that need to be compared across boards. It can be called from
+ * both task and ISR context. Unlike get_monotonic_ns(), it may jump when
+ * the wall-clock offset is adjusted, so it must not be used to measure
+ * durations.
+ *
+ * @return nanoseconds since the Unix epoch, if the wall-clock offset has
+ *         been set, or get_monotonic_ns() otherwise
+ */
+uint64_t get_wall_time_ns(void)
+{
+    uint32_t int_mask = disable_cpu_interrupts();
+    int64_t offset_ns = g_wall_clock.offset_ns;
+
+    restore_cpu_interrupts(int_mask);
+    return get_monotonic_ns() + offset_ns;
+}
+
+
+/**
+ * Tells if the wall-clock offset has been set
+ */
+bool wall_time_is_set(void)
+{
+    return g_wall_clock.offset_set;
+}
+
+
+/**
+ * Returns the wall-clock offset: nanoseconds since the Unix epoch minus
+ * get_monotonic_ns()
+ */
+int64_t get_wall_time_offset_ns(void)
+{
+    uint32_t int_mask = disable_cpu_interrupts();
+    int64_t offset_ns = g_wall_clock.offset_ns;
+
+    restore_cpu_interrupts(int_mask);
+    return offset_ns;
+}
+
+
+/**
+ * Sets the wall-clock offset
+ *
+ * @param offset_ns     nanoseconds since the Unix epoch minus
+ *                      get_monotonic_ns()
+ */
+void set_wall_time_offset_ns(int64_t offset_ns)
+{
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    g_wall_clock.offset_ns = offset_ns;
+    g_wall_clock.offset_set = true;
+    restore_cpu_interrupts(int_mask);
+}
@@ -9,6 +9,7 @@
 #define SOURCES_BUILDING_BLOCKS_TIME_UTILS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "microcontroller.h"
 
 /**
@@ -41,13 +42,66 @@
 #define CPU_CLOCK_CYCLES_TO_MILLISECONDS(_cycles) \
         (CPU_CLOCK_CYCLES_TO_MICROSECONDS(_cycles) / 1000)
 
+/**
+ * Convert from CPU clock cycles to nanoseconds, for 64-bit cycle counts
+ * as returned by get_monotonic_cycles()
+ */
+#define CPU_CLOCK_CYCLES_TO_NANOSECONDS(_cycles) \
+        (((uint64_t)(_cycles) * 1000) / MCU_CPU_CLOCK_FREQ_IN_MHZ)
+
+/**
+ * Number of buckets of a CPU cycles histogram. Bucket i counts durations in
+ * the range [2^i, 2^(i+1)) cycles, except for the last bucket, which counts
+ * all the durations longer than that.
+ */
+#define CYCLES_HISTOGRAM_NUM_BUCKETS    24
+
+/**
+ * Log2 histogram of durations measured in CPU clock cycles
+ */
+struct cycles_histogram {
+    uint32_t buckets[CYCLES_HISTOGRAM_NUM_BUCKETS];
+};
+
+/**
+ * Records a duration in a CPU cycles histogram
+ */
+static inline void cycles_histogram_record(struct cycles_histogram *histogram_p,
+                                           uint32_t cycles)
+{
+    uint_fast8_t bucket = 0;
+
+    if (cycles != 0) {
+        bucket = 31 - __builtin_clz(cycles);
+        if (bucket >= CYCLES_HISTOGRAM_NUM_BUCKETS) {
+            bucket = CYCLES_HISTOGRAM_NUM_BUCKETS - 1;
+        }
+    }
+
+    histogram_p->buckets[bucket] ++;
+}
+
 
 void init_cpu_clock_cycles_counter(void);
 
+void init_dwt_cycles_counter(void);
+
 uint32_t cpu_clock_cycles_diff(uint32_t begin_cycles, uint32_t end_cycles);
 
 void delay_us(uint32_t us);
 
+uint64_t get_monotonic_cycles(void);
+
+uint64_t get_monotonic_ns(void);
+
+uint64_t get_wall_time_ns(void);
+
+bool wall_time_is_set(void);
+
+int64_t get_wall_time_offset_ns(void);
+
+void set_wall_time_offset_ns(int64_t offset_ns);
+
 
 /**
  * Get the current value of the CPU clock cycle counter
@@ -59,4 +113,14 @@ void delay_us(uint32_t us);
 #define get_cpu_clock_cycles() \
 		(SYSTICK_MAX_RELOAD_VALUE - SysTick->VAL)
 
+/**
+ * Get the current value of the DWT cycle counter. Unlike the SysTick-based
+ * counter, it is 32 bits wide, so it wraps around only every few tens of
+ * seconds.
+ *
+ * @pre Before this macro is invoked for the first time,
+ *      init_dwt_cycles_counter() needs to be called.
+ */
+#define get_dwt_cycles()    (DWT->CYCCNT)
+
 #endif /* SOURCES_BUILDING_BLOCKS_TIME_UTILS_H_ */
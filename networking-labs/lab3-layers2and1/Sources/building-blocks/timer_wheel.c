@@ -0,0 +1,323 @@
+/**
+ * @file timer_wheel.c
+ *
+ * Hierarchical timer wheel implementation
+ *
+ * @author German Rivera
+ */
+#include "timer_wheel.h"
+#include "runtime_checks.h"
+#include "runtime_log.h"
+#include "mem_utils.h"
+
+/**
+ * Returns the slot index of a given tick at a given level
+ */
+static inline uint_fast8_t timer_wheel_slot_index(uint32_t tick,
+                                                  uint_fast8_t level)
+{
+    return (tick >> (level * TIMER_WHEEL_SLOT_BITS)) &
+           (TIMER_WHEEL_SLOTS_PER_LEVEL - 1);
+}
+
+
+/**
+ * Inserts a timer in the slot that corresponds to its expiration tick.
+ * Must be called with the timer wheel's mutex held.
+ */
+static void timer_wheel_insert(struct timer_wheel *timer_wheel_p,
+                               struct timer_wheel_timer *timer_p)
+{
+    uint32_t delta = timer_p->expiration_tick - timer_wheel_p->current_tick;
+    uint_fast8_t level = 0;
+
+    D_ASSERT(delta <= TIMER_WHEEL_MAX_TIMEOUT_TICKS);
+
+    /*
+     * A timer goes to the lowest level whose slots it does not outlast:
+     */
+    while (delta >= BIT((level + 1) * TIMER_WHEEL_SLOT_BITS)) {
+        level ++;
+    }
+
+    struct timer_wheel_timer **slot_p =
+        &timer_wheel_p->slots[level][timer_wheel_slot_index(timer_p->expiration_tick,
+                                                            level)];
+
+    timer_p->prev_p = NULL;
+    timer_p->next_p = *slot_p;
+    if (*slot_p != NULL) {
+        (*slot_p)->prev_p = timer_p;
+    }
+
+    *slot_p = timer_p;
+    timer_p->slot_p = slot_p;
+    timer_p->armed = true;
+}
+
+
+/**
+ * Removes an armed timer from its slot. Must be called with the
+ * corresponding timer wheel's mutex held.
+ */
+static void timer_wheel_remove(struct timer_wheel_timer *timer_p)
+{
+    D_ASSERT(timer_p->armed);
+
+    if (timer_p->prev_p != NULL) {
+        timer_p->prev_p->next_p = timer_p->next_p;
+    } else {
+        D_ASSERT(*timer_p->slot_p == timer_p);
+        *timer_p->slot_p = timer_p->next_p;
+    }
+
+    if (timer_p->next_p != NULL) {
+        timer_p->next_p->prev_p = timer_p->prev_p;
+    }
+
+    timer_p->next_p = NULL;
+    timer_p->prev_p = NULL;
+    timer_p->slot_p = NULL;
+    timer_p->armed = false;
+}
+
+
+/**
+ * Advances a timer wheel by one tick, and invokes the callbacks of the
+ * timers that expire at the new tick
+ */
+static void timer_wheel_advance(struct timer_wheel *timer_wheel_p)
+{
+    struct timer_wheel_timer *timer_p;
+
+    rtos_mutex_lock(&timer_wheel_p->mutex);
+
+    timer_wheel_p->current_tick ++;
+
+    /*
+     * Cascade timers from upper levels whose lower level wrapped around:
+     */
+    for (uint_fast8_t level = 1; level < TIMER_WHEEL_NUM_LEVELS; level ++) {
+        if ((timer_wheel_p->current_tick &
+             (BIT(level * TIMER_WHEEL_SLOT_BITS) - 1)) != 0) {
+            break;
+        }
+
+        struct timer_wheel_timer **slot_p =
+            &timer_wheel_p->slots[level][timer_wheel_slot_index(
+                                            timer_wheel_p->current_tick, level)];
+
+        while ((timer_p = *slot_p) != NULL) {
+            timer_wheel_remove(timer_p);
+            timer_wheel_insert(timer_wheel_p, timer_p);
+        }
+    }
+
+    /*
+     * Expire timers of the current level-0 slot. The mutex is released
+     * while running each callback, so that callbacks can arm and cancel
+     * timers:
+     */
+    struct timer_wheel_timer **slot_p =
+        &timer_wheel_p->slots[0][timer_wheel_slot_index(timer_wheel_p->current_tick,
+                                                        0)];
+
+    while ((timer_p = *slot_p) != NULL) {
+        D_ASSERT(timer_p->signature == TIMER_WHEEL_TIMER_SIGNATURE);
+        D_ASSERT(timer_p->expiration_tick == timer_wheel_p->current_tick);
+
+        timer_wheel_remove(timer_p);
+        timer_wheel_p->num_armed_timers --;
+        timer_wheel_p->expired_timers_count ++;
+
+        timer_wheel_callback_t *callback_p = timer_p->callback_p;
+        void *callback_arg = timer_p->callback_arg;
+
+        rtos_mutex_unlock(&timer_wheel_p->mutex);
+        callback_p(timer_p, callback_arg);
+        rtos_mutex_lock(&timer_wheel_p->mutex);
+    }
+
+    rtos_mutex_unlock(&timer_wheel_p->mutex);
+}
+
+
+/**
+ * Callback of the RTOS timer that drives a timer wheel. It just wakes up
+ * the timer wheel's task, which does the actual work, without holding up
+ * the RTOS timer service.
+ */
+static void timer_wheel_tick_callback(struct rtos_timer *rtos_timer_p, void *arg)
+{
+    struct timer_wheel *timer_wheel_p = arg;
+
+    D_ASSERT(rtos_timer_p->tmr_signature == TIMER_SIGNATURE);
+    D_ASSERT(timer_wheel_p->signature == TIMER_WHEEL_SIGNATURE);
+
+    rtos_semaphore_signal(&timer_wheel_p->tick_semaphore);
+}
+
+
+/**
+ * Timer wheel task
+ */
+static void timer_wheel_task(void *arg)
+{
+    struct timer_wheel *timer_wheel_p = arg;
+
+    D_ASSERT(timer_wheel_p->signature == TIMER_WHEEL_SIGNATURE);
+
+    for ( ; ; ) {
+        rtos_semaphore_wait(&timer_wheel_p->tick_semaphore);
+        timer_wheel_advance(timer_wheel_p);
+    }
+
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
+}
+
+
+/**
+ * Initializes a timer wheel
+ *
+ * @param timer_wheel_p     Pointer to the timer wheel
+ * @param name_p            Name of the timer wheel
+ * @param tick_ms           Duration of a timer wheel tick in milliseconds
+ *                          (resolution of the wheel's timers)
+ */
+void timer_wheel_init(struct timer_wheel *timer_wheel_p,
+                      const char *name_p,
+                      uint32_t tick_ms)
+{
+    D_ASSERT(tick_ms >= MS_PER_TIMER_TICK);
+
+    timer_wheel_p->signature = TIMER_WHEEL_SIGNATURE;
+    timer_wheel_p->tick_ms = tick_ms;
+    timer_wheel_p->current_tick = 0;
+    timer_wheel_p->num_armed_timers = 0;
+    timer_wheel_p->expired_timers_count = 0;
+    for (uint_fast8_t level = 0; level < TIMER_WHEEL_NUM_LEVELS; level ++) {
+        for (uint_fast8_t i = 0; i < TIMER_WHEEL_SLOTS_PER_LEVEL; i ++) {
+            timer_wheel_p->slots[level][i] = NULL;
+        }
+    }
+
+    rtos_semaphore_init(&timer_wheel_p->tick_semaphore, name_p, 0);
+    rtos_mutex_init(&timer_wheel_p->mutex, name_p);
+    rtos_timer_init(&timer_wheel_p->tick_timer,
+                    name_p,
+                    tick_ms,
+                    true,
+                    timer_wheel_tick_callback,
+                    timer_wheel_p);
+}
+
+
+/**
+ * Starts a timer wheel: creates its task and starts its RTOS timer
+ *
+ * @param timer_wheel_p     Pointer to the timer wheel
+ * @param task_prio         Priority of the timer wheel's task
+ */
+void timer_wheel_start(struct timer_wheel *timer_wheel_p,
+                       rtos_task_priority_t task_prio)
+{
+    D_ASSERT(timer_wheel_p->signature == TIMER_WHEEL_SIGNATURE);
+
+    rtos_task_create(&timer_wheel_p->task,
+                     "Timer wheel task",
+                     timer_wheel_task,
+                     timer_wheel_p,
+                     task_prio);
+
+    rtos_timer_start(&timer_wheel_p->tick_timer);
+}
+
+
+/**
+ * Initializes a timer wheel timer
+ *
+ * @param timer_p       Pointer to the timer
+ * @param callback_p    Function to call when the timer expires
+ * @param callback_arg  Argument for callback_p
+ */
+void timer_wheel_timer_init(struct timer_wheel_timer *timer_p,
+                            timer_wheel_callback_t *callback_p,
+                            void *callback_arg)
+{
+    D_ASSERT(callback_p != NULL);
+
+    timer_p->signature = TIMER_WHEEL_TIMER_SIGNATURE;
+    timer_p->armed = false;
+    timer_p->expiration_tick = 0;
+    timer_p->callback_p = callback_p;
+    timer_p->callback_arg = callback_arg;
+    timer_p->next_p = NULL;
+    timer_p->prev_p = NULL;
+    timer_p->slot_p = NULL;
+}
+
+
+/**
+ * Arms a timer wheel timer. If the timer is already armed, it is re-armed
+ * with the new timeout.
+ *
+ * @param timer_wheel_p     Pointer to the timer wheel
+ * @param timer_p           Pointer to the timer
+ * @param timeout_ms        Timeout in milliseconds. It is rounded up to a
+ *                          whole number of timer wheel ticks (at least one).
+ */
+void timer_wheel_timer_arm(struct timer_wheel *timer_wheel_p,
+                           struct timer_wheel_timer *timer_p,
+                           uint32_t timeout_ms)
+{
+    uint32_t timeout_ticks;
+
+    D_ASSERT(timer_wheel_p->signature == TIMER_WHEEL_SIGNATURE);
+    D_ASSERT(timer_p->signature == TIMER_WHEEL_TIMER_SIGNATURE);
+
+    if (timeout_ms == 0) {
+        timeout_ticks = 1;
+    } else {
+        timeout_ticks = HOW_MANY(timeout_ms, timer_wheel_p->tick_ms);
+        if (timeout_ticks > TIMER_WHEEL_MAX_TIMEOUT_TICKS) {
+            timeout_ticks = TIMER_WHEEL_MAX_TIMEOUT_TICKS;
+        }
+    }
+
+    rtos_mutex_lock(&timer_wheel_p->mutex);
+
+    if (timer_p->armed) {
+        timer_wheel_remove(timer_p);
+    } else {
+        timer_wheel_p->num_armed_timers ++;
+    }
+
+    timer_p->expiration_tick = timer_wheel_p->current_tick + timeout_ticks;
+    timer_wheel_insert(timer_wheel_p, timer_p);
+
+    rtos_mutex_unlock(&timer_wheel_p->mutex);
+}
+
+
+/**
+ * Cancels a timer wheel timer, if it is armed
+ *
+ * @param timer_wheel_p     Pointer to the timer wheel
+ * @param timer_p           Pointer to the timer
+ */
+void timer_wheel_timer_cancel(struct timer_wheel *timer_wheel_p,
+                              struct timer_wheel_timer *timer_p)
+{
+    D_ASSERT(timer_wheel_p->signature == TIMER_WHEEL_SIGNATURE);
+    D_ASSERT(timer_p->signature == TIMER_WHEEL_TIMER_SIGNATURE);
+
+    rtos_mutex_lock(&timer_wheel_p->mutex);
+
+    if (timer_p->armed) {
+        timer_wheel_remove(timer_p);
+        timer_wheel_p->num_armed_timers --;
+    }
+
+    rtos_mutex_unlock(&timer_wheel_p->mutex);
+}
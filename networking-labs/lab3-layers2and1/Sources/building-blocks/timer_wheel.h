@@ -0,0 +1,168 @@
+/**
+ * @file timer_wheel.h
+ *
+ * Hierarchical timer wheel interface
+ *
+ * A timer wheel multiplexes any number of software timers on top of a
+ * single periodic RTOS timer. Arming and cancelling a timer are O(1)
+ * operations, and do not touch the RTOS timer list. Timer callbacks are
+ * invoked from the timer wheel's own task, so they can lock mutexes.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_TIMER_WHEEL_H_
+#define SOURCES_BUILDING_BLOCKS_TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "rtos_wrapper.h"
+#include "io_utils.h"
+
+/**
+ * Number of levels of a timer wheel
+ */
+#define TIMER_WHEEL_NUM_LEVELS          4
+
+/**
+ * log2 of the number of slots per level of a timer wheel
+ */
+#define TIMER_WHEEL_SLOT_BITS           6
+
+/**
+ * Number of slots per level of a timer wheel
+ */
+#define TIMER_WHEEL_SLOTS_PER_LEVEL     BIT(TIMER_WHEEL_SLOT_BITS)
+
+/**
+ * Maximum timeout of a timer, in timer wheel ticks. Longer timeouts are
+ * truncated to this value.
+ */
+#define TIMER_WHEEL_MAX_TIMEOUT_TICKS \
+        (BIT(TIMER_WHEEL_NUM_LEVELS * TIMER_WHEEL_SLOT_BITS) - 1)
+
+struct timer_wheel_timer;
+
+/**
+ * Signature of a timer wheel timer callback function
+ */
+typedef void timer_wheel_callback_t(struct timer_wheel_timer *timer_p, void *arg);
+
+/**
+ * Timer wheel timer
+ *
+ * NOTE: A callback invocation that is already in progress cannot be
+ * cancelled, so a callback may run right after its timer was cancelled or
+ * re-armed. Callbacks are expected to check, under the lock that protects
+ * the timer's owner, whether there is anything to do.
+ */
+struct timer_wheel_timer {
+#   define TIMER_WHEEL_TIMER_SIGNATURE  GEN_SIGNATURE('T', 'W', 'T', 'M')
+    uint32_t signature;
+
+    /**
+     * Flag indicating if the timer is currently armed (in a slot)
+     */
+    bool armed;
+
+    /**
+     * Timer wheel tick at which the timer expires
+     */
+    uint32_t expiration_tick;
+
+    /**
+     * Function to call when the timer expires
+     */
+    timer_wheel_callback_t *callback_p;
+
+    /**
+     * Argument for callback_p
+     */
+    void *callback_arg;
+
+    /**
+     * Links in the list of timers of the same slot
+     */
+    struct timer_wheel_timer *next_p;
+    struct timer_wheel_timer *prev_p;
+
+    /**
+     * Head of the list of the slot where the timer is, while it is armed
+     */
+    struct timer_wheel_timer **slot_p;
+};
+
+/**
+ * Hierarchical timer wheel. Level 0 has one slot per tick; each slot of
+ * level n covers a full turn of level n-1. Timers in a slot of level n > 0
+ * are moved down ("cascaded") when level n-1 wraps around.
+ */
+struct timer_wheel {
+#   define TIMER_WHEEL_SIGNATURE  GEN_SIGNATURE('T', 'W', 'H', 'L')
+    uint32_t signature;
+
+    /**
+     * Duration of a timer wheel tick in milliseconds
+     */
+    uint32_t tick_ms;
+
+    /**
+     * Number of timer wheel ticks since the timer wheel was started
+     */
+    uint32_t current_tick;
+
+    /**
+     * Number of timers currently armed
+     */
+    uint32_t num_armed_timers;
+
+    /**
+     * Number of timers that have expired
+     */
+    volatile uint32_t expired_timers_count;
+
+    /**
+     * Heads of the lists of timers of each slot
+     */
+    struct timer_wheel_timer *slots[TIMER_WHEEL_NUM_LEVELS][TIMER_WHEEL_SLOTS_PER_LEVEL];
+
+    /**
+     * Periodic RTOS timer that drives the timer wheel
+     */
+    struct rtos_timer tick_timer;
+
+    /**
+     * Counting semaphore signaled once per tick by tick_timer
+     */
+    struct rtos_semaphore tick_semaphore;
+
+    /**
+     * Mutex to serialize access to the wheel's slots
+     */
+    struct rtos_mutex mutex;
+
+    /**
+     * Task that advances the timer wheel and runs the callbacks of expired
+     * timers
+     */
+    struct rtos_task task;
+};
+
+void timer_wheel_init(struct timer_wheel *timer_wheel_p,
+                      const char *name_p,
+                      uint32_t tick_ms);
+
+void timer_wheel_start(struct timer_wheel *timer_wheel_p,
+                       rtos_task_priority_t task_prio);
+
+void timer_wheel_timer_init(struct timer_wheel_timer *timer_p,
+                            timer_wheel_callback_t *callback_p,
+                            void *callback_arg);
+
+void timer_wheel_timer_arm(struct timer_wheel *timer_wheel_p,
+                           struct timer_wheel_timer *timer_p,
+                           uint32_t timeout_ms);
+
+void timer_wheel_timer_cancel(struct timer_wheel *timer_wheel_p,
+                              struct timer_wheel_timer *timer_p);
+
+#endif /* SOURCES_BUILDING_BLOCKS_TIMER_WHEEL_H_ */
@@ -0,0 +1,154 @@
+/**
+ * @file trace_recorder.c
+ *
+ * Event trace recorder implementation
+ *
+ * @author German Rivera
+ */
+#include "trace_recorder.h"
+#include "runtime_checks.h"
+#include "atomic_utils.h"
+#include "mem_utils.h"
+#include "rtos_wrapper.h"
+#include "serial_console.h"
+#include "microcontroller.h"
+
+/**
+ * Names of the trace event types, as they appear in the trace dump
+ */
+static const char *const g_trace_event_type_names[] = {
+    [TRACE_EVENT_TASK_SWITCH] = "switch",
+    [TRACE_EVENT_SEM_WAIT] = "sem_wait",
+    [TRACE_EVENT_SEM_WAIT_DONE] = "sem_wait_done",
+    [TRACE_EVENT_SEM_SIGNAL] = "sem_signal",
+    [TRACE_EVENT_ISR_ENTER] = "isr_enter",
+    [TRACE_EVENT_ISR_EXIT] = "isr_exit",
+    [TRACE_EVENT_PACKET_QUEUE_ADD] = "pq_add",
+    [TRACE_EVENT_PACKET_QUEUE_REMOVE] = "pq_remove",
+};
+
+C_ASSERT(ARRAY_SIZE(g_trace_event_type_names) == NUM_TRACE_EVENT_TYPES);
+
+/**
+ * Trace recorder state
+ */
+struct trace_recorder {
+    /**
+     * Flag indicating if events are to be recorded
+     */
+    volatile bool enabled;
+
+    /**
+     * Number of events recorded so far. The next event is recorded in
+     * entry (next_index % TRACE_RECORDER_NUM_EVENTS) of events[].
+     */
+    volatile uint32_t next_index;
+
+    /**
+     * Circular buffer of events
+     */
+    struct trace_event events[TRACE_RECORDER_NUM_EVENTS];
+};
+
+static struct trace_recorder g_trace_recorder = {
+    .enabled = true,
+    .next_index = 0,
+};
+
+
+/**
+ * Records an event in the trace buffer. It is meant to be invoked through
+ * the TRACE_RECORD() macro. It can be called from any context, including
+ * interrupt handlers and the context switch hook, and it does not disable
+ * interrupts: each caller atomically claims its own entry of the buffer.
+ *
+ * @param type  event type
+ * @param arg   event-specific argument
+ * @param arg2  secondary event-specific argument
+ */
+void trace_recorder_record(enum trace_event_types type, uint32_t arg,
+                           uint16_t arg2)
+{
+    struct trace_recorder *const recorder_p = &g_trace_recorder;
+
+    D_ASSERT(type < NUM_TRACE_EVENT_TYPES);
+    if (!recorder_p->enabled) {
+        return;
+    }
+
+    uint32_t index = ATOMIC_POST_INCREMENT_UINT32(&recorder_p->next_index);
+    struct trace_event *event_p =
+        &recorder_p->events[index & (TRACE_RECORDER_NUM_EVENTS - 1)];
+
+    event_p->cycles = get_dwt_cycles();
+    event_p->arg = arg;
+    event_p->type = type;
+    event_p->arg2 = arg2;
+}
+
+
+/**
+ * Enables or disables the recording of events
+ *
+ * @param enable    true to enable, false to disable
+ */
+void trace_recorder_enable(bool enable)
+{
+    g_trace_recorder.enabled = enable;
+}
+
+
+/**
+ * Dumps the trace buffer to the serial console, from the oldest event to
+ * the newest one. Recording is paused while the dump is in progress, so
+ * that the dump itself does not overwrite the events being dumped.
+ *
+ * The dump format is:
+ *   TRACE BEGIN cpu_mhz=<CPU MHz> events=<num events> lost=<num lost events>
+ *   TASK <task index> <task name>
+ *   ...
+ *   EV <cycles (hex)> <event type name> <arg (hex)> <arg2>
+ *   ...
+ *   TRACE END
+ */
+void trace_recorder_dump(void)
+{
+    struct trace_recorder *const recorder_p = &g_trace_recorder;
+    struct rtos_task_cpu_stats task_stats;
+    bool was_enabled = recorder_p->enabled;
+    uint32_t num_events;
+    uint32_t num_lost_events = 0;
+
+    recorder_p->enabled = false;
+    uint32_t next_index = recorder_p->next_index;
+
+    num_events = next_index;
+    if (num_events > TRACE_RECORDER_NUM_EVENTS) {
+        num_lost_events = num_events - TRACE_RECORDER_NUM_EVENTS;
+        num_events = TRACE_RECORDER_NUM_EVENTS;
+    }
+
+    console_printf("TRACE BEGIN cpu_mhz=%u events=%u lost=%u\n",
+                   MCU_CPU_CLOCK_FREQ_IN_MHZ, num_events, num_lost_events);
+
+    for (unsigned int i = 0; rtos_get_task_cpu_stats(i, &task_stats); i ++) {
+        if (task_stats.task_p != NULL) {
+            console_printf("TASK %u %s\n", task_stats.task_p->tsk_index,
+                           task_stats.name_p);
+        }
+    }
+
+    for (uint32_t index = next_index - num_events; index != next_index;
+         index ++) {
+        const struct trace_event *event_p =
+            &recorder_p->events[index & (TRACE_RECORDER_NUM_EVENTS - 1)];
+
+        D_ASSERT(event_p->type < NUM_TRACE_EVENT_TYPES);
+        console_printf("EV %x %s %x %u\n", event_p->cycles,
+                       g_trace_event_type_names[event_p->type],
+                       event_p->arg, event_p->arg2);
+    }
+
+    console_printf("TRACE END\n");
+    recorder_p->enabled = was_enabled;
+}
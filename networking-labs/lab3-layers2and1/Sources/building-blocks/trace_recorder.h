@@ -0,0 +1,134 @@
+/**
+ * @file trace_recorder.h
+ *
+ * Event trace recorder interface
+ *
+ * The trace recorder keeps the most recent scheduling-related events
+ * (context switches, semaphore waits and signals, ISR entries and exits, and
+ * network packet queue operations) in a circular buffer in RAM, each one
+ * timestamped with the DWT cycle counter. The dump produced by
+ * trace_recorder_dump() can be converted to a Chrome/Perfetto timeline with
+ * scripts/trace_to_timeline.pl.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_TRACE_RECORDER_H_
+#define SOURCES_BUILDING_BLOCKS_TRACE_RECORDER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compile_time_checks.h"
+#include "time_utils.h"
+
+/**
+ * Set TRACE_RECORDER_ON to 0 to compile out all the trace recording points
+ */
+#ifndef TRACE_RECORDER_ON
+#define TRACE_RECORDER_ON   1
+#endif
+
+/**
+ * Number of entries of the trace buffer (must be a power of 2)
+ */
+#define TRACE_RECORDER_NUM_EVENTS   512
+
+C_ASSERT((TRACE_RECORDER_NUM_EVENTS & (TRACE_RECORDER_NUM_EVENTS - 1)) == 0);
+
+/**
+ * Task index recorded in a TRACE_EVENT_TASK_SWITCH event, when switching
+ * to the RTOS idle task
+ */
+#define TRACE_TASK_INDEX_IDLE           0xff
+
+/**
+ * Task index recorded in a TRACE_EVENT_TASK_SWITCH event, when switching
+ * to an RTOS internal task (not created with rtos_task_create())
+ */
+#define TRACE_TASK_INDEX_RTOS_INTERNAL  0xfe
+
+/**
+ * Trace event types
+ */
+enum trace_event_types {
+    /*
+     * arg: index of the task switched in
+     */
+    TRACE_EVENT_TASK_SWITCH = 0,
+
+    /*
+     * arg: address of the semaphore
+     */
+    TRACE_EVENT_SEM_WAIT,
+    TRACE_EVENT_SEM_WAIT_DONE,
+    TRACE_EVENT_SEM_SIGNAL,
+
+    /*
+     * arg: IRQ number
+     */
+    TRACE_EVENT_ISR_ENTER,
+    TRACE_EVENT_ISR_EXIT,
+
+    /*
+     * arg: address of the queue, arg2: queue length after the operation
+     */
+    TRACE_EVENT_PACKET_QUEUE_ADD,
+    TRACE_EVENT_PACKET_QUEUE_REMOVE,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_TRACE_EVENT_TYPES
+};
+
+/**
+ * Entry of the trace buffer
+ */
+struct trace_event {
+    /**
+     * DWT cycle count when the event happened
+     */
+    uint32_t cycles;
+
+    /**
+     * Event-specific argument
+     */
+    uint32_t arg;
+
+    uint8_t type;
+
+    uint8_t reserved;
+
+    /**
+     * Secondary event-specific argument
+     */
+    uint16_t arg2;
+};
+
+C_ASSERT(sizeof(struct trace_event) == 12);
+
+#if TRACE_RECORDER_ON
+
+/**
+ * Records an event in the trace buffer
+ *
+ * @param _type     enum trace_event_types value
+ * @param _arg      event-specific argument
+ * @param _arg2     secondary event-specific argument
+ */
+#define TRACE_RECORD(_type, _arg, _arg2) \
+        trace_recorder_record(_type, (uint32_t)(_arg), _arg2)
+
+#else
+
+#define TRACE_RECORD(_type, _arg, _arg2)    do { } while (0)
+
+#endif /* TRACE_RECORDER_ON */
+
+void trace_recorder_record(enum trace_event_types type, uint32_t arg,
+                           uint16_t arg2);
+
+void trace_recorder_enable(bool enable);
+
+void trace_recorder_dump(void);
+
+#endif /* SOURCES_BUILDING_BLOCKS_TRACE_RECORDER_H_ */
@@ -7,11 +7,16 @@
  */
 #include "uart_driver.h"
 #include "atomic_utils.h"
+#include "compile_time_checks.h"
 #include "io_utils.h"
 #include "runtime_checks.h"
 #include "mem_utils.h"
 #include "byte_ring_buffer.h"
+#include "ring_template.h"
+#include "rtos_wrapper.h"
 #include "interrupt_vector_table.h"
+#include "memory_protection_unit.h"
+#include "power_utils.h"
 
 /**
  * Serial communication parameters for the serial port used as the console
@@ -19,6 +24,34 @@
  */
 #define UART_RECEIVE_QUEUE_SIZE_IN_BYTES    UINT16_C(16)
 
+/**
+ * Size of the transmit queue drained by the UART's Tx interrupt
+ */
+#define UART_TRANSMIT_QUEUE_SIZE_IN_BYTES   UINT16_C(64)
+
+/**
+ * Largest Rx FIFO size among the UARTs
+ */
+#define UART_MAX_RX_FIFO_SIZE               8
+
+/**
+ * Size of the circular buffer filled by DMA, for a UART in DMA Rx mode
+ */
+#define UART_RX_DMA_BUFFER_SIZE             UINT16_C(256)
+
+/**
+ * DMAMUX request sources for UART receivers (see K64F reference manual,
+ * table 3-24)
+ */
+#define UART0_RX_DMA_REQUEST_SOURCE     2
+#define UART4_DMA_REQUEST_SOURCE        10
+
+/**
+ * Ring type of the transmit queue
+ */
+DECLARE_RING_TYPE(uart_transmit_ring, uint8_t,
+                  UART_TRANSMIT_QUEUE_SIZE_IN_BYTES);
+
 /**
  * Non-const fields of a UART device (to be placed in SRAM)
  */
@@ -26,8 +59,59 @@ struct uart_device_var {
     bool urt_initialized;
     uint32_t urt_received_bytes_dropped;
     uint32_t urt_errors;
-    struct byte_ring_buffer urt_receive_queue;
+    struct spsc_byte_ring_buffer urt_receive_queue;
     uint8_t urt_receive_queue_data[UART_RECEIVE_QUEUE_SIZE_IN_BYTES];
+
+    /**
+     * Transmit queue filled by uart_putchar_with_interrupts() and drained
+     * into the Tx FIFO by the Tx interrupt handler
+     */
+    struct uart_transmit_ring urt_transmit_queue;
+
+    /**
+     * Flag set by a writer waiting for room in the transmit queue
+     */
+    volatile bool urt_transmit_queue_writer_waiting;
+
+    /**
+     * Semaphore signaled by the Tx interrupt handler when room becomes
+     * available in the transmit queue for a waiting writer
+     */
+    struct rtos_semaphore urt_transmit_queue_semaphore;
+
+    /**
+     * Flag indicating that received bytes are being moved by DMA into
+     * urt_rx_dma_buffer[], instead of by the Rx interrupt handler into
+     * urt_receive_queue
+     */
+    bool urt_rx_dma_enabled;
+
+    /**
+     * Circular buffer filled by the Rx DMA channel
+     */
+    uint8_t urt_rx_dma_buffer[UART_RX_DMA_BUFFER_SIZE];
+
+    /**
+     * Index of the next byte to consume from urt_rx_dma_buffer[]
+     */
+    uint16_t urt_rx_dma_read_index;
+
+    /**
+     * Flag set by a reader waiting for bytes to be received over DMA
+     */
+    volatile bool urt_rx_dma_reader_waiting;
+
+    /**
+     * Semaphore signaled by the idle-line and DMA interrupt handlers for a
+     * waiting reader
+     */
+    struct rtos_semaphore urt_rx_dma_semaphore;
+
+    /**
+     * Number of idle-line interrupts received in DMA Rx mode
+     */
+    uint32_t urt_rx_dma_idle_line_events;
+
     uint8_t urt_tx_fifo_size;
     uint8_t urt_rx_fifo_size;
     bool urt_fifos_enabled;
@@ -71,6 +155,9 @@ const struct uart_device g_uart_devices[] =
 	    .urt_source_clock_freq_in_hz = MCU_SYSTEM_CLOCK_FREQ_IN_HZ, /* see table 5-2 */
         .urt_rx_tx_irq_num = UART0_RX_TX_IRQn,
         .urt_error_irq_num = UART0_ERR_IRQn,
+        .urt_rx_dma_channel = 0,
+        .urt_rx_dma_request_source = UART0_RX_DMA_REQUEST_SOURCE,
+        .urt_rx_dma_irq_num = DMA0_IRQn,
     },
 
 	[4] = {
@@ -85,6 +172,9 @@ const struct uart_device g_uart_devices[] =
         .urt_source_clock_freq_in_hz = MCU_BUS_CLOCK_FREQ_IN_HZ, /* see table 5-2 */
         .urt_rx_tx_irq_num = UART4_RX_TX_IRQn,
         .urt_error_irq_num = UART4_ERR_IRQn,
+        .urt_rx_dma_channel = 1,
+        .urt_rx_dma_request_source = UART4_DMA_REQUEST_SOURCE,
+        .urt_rx_dma_irq_num = DMA1_IRQn,
     },
 };
 
@@ -191,6 +281,8 @@ void uart_init(
         uart_var_p->urt_rx_fifo_size = 1 << (fifo_size_field + 1);
     }
 
+    D_ASSERT(uart_var_p->urt_rx_fifo_size <= UART_MAX_RX_FIFO_SIZE);
+
     /*
      * Configure Tx and RX FIFOs:
      * - Rx FIFO water mark = 1 (generate interrupt when Rx FIFO is not empty)
@@ -223,9 +315,17 @@ void uart_init(
     /*
      * Initialize receive queue:
      */
-    byte_ring_buffer_init(&uart_var_p->urt_receive_queue,
-                          uart_var_p->urt_receive_queue_data,
-                          sizeof uart_var_p->urt_receive_queue_data);
+    spsc_byte_ring_buffer_init(&uart_var_p->urt_receive_queue,
+                               uart_var_p->urt_receive_queue_data,
+                               sizeof uart_var_p->urt_receive_queue_data);
+
+    /*
+     * Initialize transmit queue:
+     */
+    uart_transmit_ring_init(&uart_var_p->urt_transmit_queue);
+    uart_var_p->urt_transmit_queue_writer_waiting = false;
+    rtos_semaphore_init(&uart_var_p->urt_transmit_queue_semaphore,
+                        "UART transmit queue semaphore", 0);
 
     /*
      * Enable generation of Rx interrupts and disable generation of
@@ -249,6 +349,11 @@ void uart_init(
     reg_value |= (UART_C2_TE_MASK | UART_C2_RE_MASK);
     WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C2, reg_value);
 
+    /*
+     * The UART is clocked from the system or bus clock, which are gated in
+     * Stop mode, so received characters would be lost:
+     */
+    cpu_idle_deep_sleep_veto_acquire();
     uart_var_p->urt_initialized = true;
 }
 
@@ -269,6 +374,7 @@ void uart_stop(
     reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->C2);
     reg_value &= ~(UART_C2_TE_MASK | UART_C2_RE_MASK);
     WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C2, reg_value);
+    cpu_idle_deep_sleep_veto_release();
 
     /*
      * Disable clock for the UART:
@@ -281,12 +387,113 @@ void uart_stop(
 }
 
 
-static void uart_rx_tx_irq_handler(
+/**
+ * Moves bytes from the transmit queue to the Tx FIFO, until the FIFO is full
+ * or the queue is empty. Once the queue is empty, it disables the Tx
+ * interrupt. It is invoked from the Rx/Tx interrupt handler.
+ */
+static void uart_fill_tx_fifo(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    UART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_regs_p;
+    uint_fast8_t tx_fifo_length = READ_MMIO_REGISTER(&uart_mmio_registers_p->TCFIFO);
+    bool room_made = false;
+
+    D_ASSERT(tx_fifo_length <= uart_var_p->urt_tx_fifo_size);
+
+    /*
+     * NOTE: S1 was already read with TDRE set, so writing to D clears TDRE.
+     */
+    while (tx_fifo_length < uart_var_p->urt_tx_fifo_size) {
+        uint8_t byte;
+
+        if (!uart_transmit_ring_get(&uart_var_p->urt_transmit_queue, &byte)) {
+            break;
+        }
+
+        WRITE_MMIO_REGISTER(&uart_mmio_registers_p->D, byte);
+        tx_fifo_length ++;
+        room_made = true;
+    }
+
+    if (uart_transmit_ring_is_empty(&uart_var_p->urt_transmit_queue)) {
+        reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->C2);
+        reg_value &= ~UART_C2_TIE_MASK;
+        WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C2, reg_value);
+    }
+
+    if (room_made && uart_var_p->urt_transmit_queue_writer_waiting) {
+        uart_var_p->urt_transmit_queue_writer_waiting = false;
+        rtos_semaphore_signal(&uart_var_p->urt_transmit_queue_semaphore);
+    }
+}
+
+
+/**
+ * Returns the index in urt_rx_dma_buffer[] of the next byte to be written
+ * by the Rx DMA channel
+ */
+static uint16_t uart_rx_dma_get_write_index(const struct uart_device *uart_device_p)
+{
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    uint32_t dest_addr =
+        READ_MMIO_REGISTER(&DMA0->TCD[uart_device_p->urt_rx_dma_channel].DADDR);
+    uint32_t write_index = dest_addr - (uint32_t)uart_var_p->urt_rx_dma_buffer;
+
+    D_ASSERT(write_index <= UART_RX_DMA_BUFFER_SIZE);
+    if (write_index == UART_RX_DMA_BUFFER_SIZE) {
+        write_index = 0;
+    }
+
+    return write_index;
+}
+
+
+/**
+ * Wakes up the reader waiting for bytes received over DMA, if any.
+ * It is invoked from the idle-line and DMA interrupt handlers.
+ */
+static void uart_rx_dma_wake_reader(const struct uart_device *uart_device_p)
+{
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+
+    if (uart_var_p->urt_rx_dma_reader_waiting) {
+        uart_var_p->urt_rx_dma_reader_waiting = false;
+        rtos_semaphore_signal(&uart_var_p->urt_rx_dma_semaphore);
+    }
+}
+
+
+/**
+ * Handles the idle-line interrupt for a UART in DMA Rx mode. An idle line
+ * after a burst of received bytes tells that a complete message is likely
+ * sitting in the DMA buffer.
+ */
+static void uart_rx_dma_idle_line_handler(const struct uart_device *uart_device_p)
+{
+    struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
+    UART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_regs_p;
+
+    /*
+     * IDLE is cleared by reading D after reading S1. The Rx FIFO was
+     * already drained by DMA, so this read underflows the Rx FIFO, and we
+     * have to clear the underflow flag as well:
+     */
+    (void)READ_MMIO_REGISTER(&uart_mmio_registers_p->D);
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->SFIFO, UART_SFIFO_RXUF_MASK);
+
+    uart_var_p->urt_rx_dma_idle_line_events ++;
+    uart_rx_dma_wake_reader(uart_device_p);
+}
+
+
+RAM_FUNC static void uart_rx_tx_irq_handler(
     const struct uart_device *uart_device_p)
 {
     uint32_t reg_value;
     uint_fast8_t i;
-    bool entry_written;
+    uint8_t rx_bytes[UART_MAX_RX_FIFO_SIZE];
     struct uart_device_var *uart_var_p = uart_device_p->urt_var_p;
     UART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_regs_p;
 
@@ -296,9 +503,32 @@ static void uart_rx_tx_irq_handler(
     reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->S1);
 
     /*
-     * This interrupt was triggered by "Receive data register full":
+     * Check if this interrupt was triggered by "Transmit data register
+     * empty", while the Tx interrupt is enabled:
      */
-    D_ASSERT(reg_value & UART_S1_RDRF_MASK);
+    if ((reg_value & UART_S1_TDRE_MASK) != 0 &&
+        (READ_MMIO_REGISTER(&uart_mmio_registers_p->C2) & UART_C2_TIE_MASK) != 0) {
+        uart_fill_tx_fifo(uart_device_p);
+    }
+
+    if (uart_var_p->urt_rx_dma_enabled) {
+        /*
+         * Received bytes are moved by DMA, so this interrupt can only be
+         * for the idle-line condition:
+         */
+        if ((reg_value & UART_S1_IDLE_MASK) != 0) {
+            uart_rx_dma_idle_line_handler(uart_device_p);
+        }
+
+        return;
+    }
+
+    /*
+     * Check if this interrupt was triggered by "Receive data register full":
+     */
+    if ((reg_value & UART_S1_RDRF_MASK) == 0) {
+        return;
+    }
 
     uint_fast8_t rx_fifo_length =
 		READ_MMIO_REGISTER(&uart_mmio_registers_p->RCFIFO);
@@ -311,13 +541,7 @@ static void uart_rx_tx_irq_handler(
 	     * Drain the Rx FIFO but leave one byte in it:
 	     */
 	    for (i = 0; i < rx_fifo_length - 1; i++) {
-            reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->D);
-            entry_written = byte_ring_buffer_write_non_blocking(&uart_var_p->urt_receive_queue,
-            		                                            reg_value);
-            if (!entry_written) {
-                uart_var_p->urt_received_bytes_dropped ++;
-                break;
-            }
+            rx_bytes[i] = READ_MMIO_REGISTER(&uart_mmio_registers_p->D);
         }
 
         /*
@@ -326,14 +550,20 @@ static void uart_rx_tx_irq_handler(
          * - read first the S1 register
          * - then read the D register
          */
-        if (i == rx_fifo_length - 1) {
-            (void)READ_MMIO_REGISTER(&uart_mmio_registers_p->S1);
-
-            reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->D);
-            entry_written = byte_ring_buffer_write_non_blocking(&uart_var_p->urt_receive_queue,
-            		                                            reg_value);
-            if (!entry_written) {
-                uart_var_p->urt_received_bytes_dropped ++;
+        (void)READ_MMIO_REGISTER(&uart_mmio_registers_p->S1);
+        rx_bytes[i] = READ_MMIO_REGISTER(&uart_mmio_registers_p->D);
+
+        /*
+         * Enqueue the bytes drained from the FIFO. The receive queue has
+         * a single producer (this ISR) and a single consumer (the reader
+         * task), so this does not mask interrupts, and the reader is woken
+         * up at most once:
+         */
+        for (i = 0; i < rx_fifo_length; i++) {
+            if (!spsc_byte_ring_buffer_write_non_blocking(&uart_var_p->urt_receive_queue,
+                                                          rx_bytes[i])) {
+                uart_var_p->urt_received_bytes_dropped += rx_fifo_length - i;
+                break;
             }
         }
 
@@ -357,10 +587,24 @@ static void uart_error_irq_handler(
 }
 
 
+/**
+ * Handles the half-full and full interrupts of the Rx DMA channel of a
+ * UART, so that a reader is woken up before the DMA buffer wraps around,
+ * if the line does not go idle during a long burst.
+ */
+static void uart_rx_dma_irq_handler(const struct uart_device *uart_device_p)
+{
+    D_ASSERT(uart_device_p->urt_var_p->urt_rx_dma_enabled);
+
+    WRITE_MMIO_REGISTER(&DMA0->CINT, uart_device_p->urt_rx_dma_channel);
+    uart_rx_dma_wake_reader(uart_device_p);
+}
+
+
 /**
  * ISR for the UART0's Rx/Tx interrupt
  */
-void uart0_rx_tx_irq_handler(void)
+RAM_FUNC void uart0_rx_tx_irq_handler(void)
 {
     D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
 
@@ -386,7 +630,7 @@ void uart0_error_irq_handler(void)
 /**
  * ISR for the UART0's Rx/Tx interrupt
  */
-void uart4_rx_tx_irq_handler(void)
+RAM_FUNC void uart4_rx_tx_irq_handler(void)
 {
     D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
 
@@ -409,6 +653,221 @@ void uart4_error_irq_handler(void)
 }
 
 
+/**
+ * ISR for the UART0's Rx DMA channel interrupt
+ */
+void uart0_rx_dma_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    uart_rx_dma_irq_handler(&g_uart_devices[0]);
+    rtos_exit_isr();
+}
+
+
+/**
+ * ISR for the UART4's Rx DMA channel interrupt
+ */
+void uart4_rx_dma_irq_handler(void)
+{
+    D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
+
+    rtos_enter_isr();
+    uart_rx_dma_irq_handler(&g_uart_devices[4]);
+    rtos_exit_isr();
+}
+
+
+/**
+ * Switches a UART to DMA Rx mode. In this mode, an eDMA channel moves the
+ * received bytes into a circular buffer, without CPU intervention, and the
+ * UART generates an interrupt only when the Rx line goes idle after a burst
+ * of bytes. Received bytes are then read with uart_rx_dma_get_span() and
+ * uart_rx_dma_consume(), instead of uart_getchar().
+ *
+ * NOTE: The reader must keep up with the sender, as the DMA channel
+ * overwrites bytes that have not been consumed when it wraps around
+ * the buffer.
+ */
+void uart_rx_dma_start(const struct uart_device *uart_device_p)
+{
+    uint32_t reg_value;
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    UART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_regs_p;
+    uint8_t dma_channel = uart_device_p->urt_rx_dma_channel;
+
+    D_ASSERT(uart_var_p->urt_initialized);
+    D_ASSERT(!uart_var_p->urt_rx_dma_enabled);
+    D_ASSERT(CPU_MODE_IS_THREAD());
+
+    uart_var_p->urt_rx_dma_read_index = 0;
+    uart_var_p->urt_rx_dma_reader_waiting = false;
+    uart_var_p->urt_rx_dma_idle_line_events = 0;
+    rtos_semaphore_init(&uart_var_p->urt_rx_dma_semaphore,
+                        "UART Rx DMA semaphore", 0);
+
+    /*
+     * Disable generation of Rx interrupts, while switching to DMA mode:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->C2);
+    reg_value &= ~(UART_C2_RIE_MASK | UART_C2_ILIE_MASK);
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C2, reg_value);
+
+    /*
+     * Enable clocks for the DMA engine and the DMA request multiplexer:
+     */
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC6);
+    reg_value |= SIM_SCGC6_DMAMUX_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC6, reg_value);
+    reg_value = READ_MMIO_REGISTER(&SIM_SCGC7);
+    reg_value |= SIM_SCGC7_DMA_MASK;
+    WRITE_MMIO_REGISTER(&SIM_SCGC7, reg_value);
+
+#ifdef USE_MPU
+    /*
+     * Enable access to the Rx DMA buffer for the DMA engine:
+     */
+    mpu_register_dma_region(MPU_BUS_MASTER_DMA, uart_var_p->urt_rx_dma_buffer,
+                            sizeof uart_var_p->urt_rx_dma_buffer);
+#else
+    mpu_disable();
+#endif
+
+    /*
+     * Configure the DMA channel to copy one byte from the UART's data
+     * register to the buffer per DMA request, going back to the beginning
+     * of the buffer after each major loop (circular buffer), and to
+     * generate interrupts at half and at the end of the major loop:
+     */
+    WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel], 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SADDR,
+                        (uint32_t)&uart_mmio_registers_p->D);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SOFF, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].ATTR,
+                        DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].NBYTES_MLNO, 1);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].SLAST, 0);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DADDR,
+                        (uint32_t)uart_var_p->urt_rx_dma_buffer);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DOFF, 1);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CITER_ELINKNO,
+                        DMA_CITER_ELINKNO_CITER(UART_RX_DMA_BUFFER_SIZE));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].BITER_ELINKNO,
+                        DMA_BITER_ELINKNO_BITER(UART_RX_DMA_BUFFER_SIZE));
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].DLAST_SGA,
+                        -(int32_t)UART_RX_DMA_BUFFER_SIZE);
+    WRITE_MMIO_REGISTER(&DMA0->TCD[dma_channel].CSR,
+                        DMA_CSR_INTHALF_MASK | DMA_CSR_INTMAJOR_MASK);
+    WRITE_MMIO_REGISTER(&DMAMUX->CHCFG[dma_channel],
+                        DMAMUX_CHCFG_ENBL_MASK |
+                        DMAMUX_CHCFG_SOURCE(uart_device_p->urt_rx_dma_request_source));
+    WRITE_MMIO_REGISTER(&DMA0->SERQ, dma_channel);
+
+    nvic_setup_irq(uart_device_p->urt_rx_dma_irq_num, UART_INTERRUPT_PRIORITY);
+
+    uart_var_p->urt_rx_dma_enabled = true;
+
+    /*
+     * Start counting idle characters after the stop bit, so that the idle
+     * condition is not detected in the middle of a burst of bytes:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->C1);
+    reg_value |= UART_C1_ILT_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C1, reg_value);
+
+    /*
+     * Route "receive data register full" to DMA requests, and enable the
+     * idle-line interrupt:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->C5);
+    reg_value |= UART_C5_RDMAS_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C5, reg_value);
+
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->C2);
+    reg_value |= UART_C2_RIE_MASK | UART_C2_ILIE_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C2, reg_value);
+}
+
+
+/**
+ * Returns the longest contiguous span of received bytes not yet consumed,
+ * for a UART in DMA Rx mode, waiting until at least one byte is available.
+ * The bytes stay in the buffer until uart_rx_dma_consume() is called.
+ *
+ * @param uart_device_p pointer to the UART device
+ * @param span_p        area where the pointer to the first byte of the span
+ *                      is to be returned
+ * @param timeout_ms    0, or timeout (in milliseconds) for waiting for
+ *                      bytes to be received
+ *
+ * @return number of bytes in the span, or 0 if timeout
+ */
+size_t uart_rx_dma_get_span(const struct uart_device *uart_device_p,
+                            const uint8_t **span_p,
+                            uint32_t timeout_ms)
+{
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    uint16_t read_index = uart_var_p->urt_rx_dma_read_index;
+    uint16_t write_index;
+
+    D_ASSERT(uart_var_p->urt_rx_dma_enabled);
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+    for ( ; ; ) {
+        uint32_t int_mask = disable_cpu_interrupts();
+
+        write_index = uart_rx_dma_get_write_index(uart_device_p);
+        if (write_index != read_index) {
+            restore_cpu_interrupts(int_mask);
+            break;
+        }
+
+        uart_var_p->urt_rx_dma_reader_waiting = true;
+        restore_cpu_interrupts(int_mask);
+        if (timeout_ms != 0) {
+            if (!rtos_semaphore_wait_timeout(&uart_var_p->urt_rx_dma_semaphore,
+                                             timeout_ms)) {
+                uart_var_p->urt_rx_dma_reader_waiting = false;
+                return 0;
+            }
+        } else {
+            rtos_semaphore_wait(&uart_var_p->urt_rx_dma_semaphore);
+        }
+    }
+
+    *span_p = &uart_var_p->urt_rx_dma_buffer[read_index];
+    if (write_index > read_index) {
+        return write_index - read_index;
+    } else {
+        return UART_RX_DMA_BUFFER_SIZE - read_index;
+    }
+}
+
+
+/**
+ * Marks as consumed bytes returned by uart_rx_dma_get_span()
+ *
+ * @param uart_device_p pointer to the UART device
+ * @param num_bytes     number of bytes consumed (at most the size of the
+ *                      span returned by the last uart_rx_dma_get_span() call)
+ */
+void uart_rx_dma_consume(const struct uart_device *uart_device_p,
+                         size_t num_bytes)
+{
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    uint32_t read_index = uart_var_p->urt_rx_dma_read_index + num_bytes;
+
+    D_ASSERT(uart_var_p->urt_rx_dma_enabled);
+    D_ASSERT(read_index <= UART_RX_DMA_BUFFER_SIZE);
+    if (read_index == UART_RX_DMA_BUFFER_SIZE) {
+        read_index = 0;
+    }
+
+    uart_var_p->urt_rx_dma_read_index = read_index;
+}
+
+
 /**
  * Send a character over a UART serial port, doing polling until the
  * character gets transmitted.
@@ -437,6 +896,53 @@ void uart_putchar(const struct uart_device *uart_device_p, uint8_t c)
 }
 
 
+/**
+ * Send a character over a UART serial port, through the UART's transmit
+ * queue, which is drained into the UART's Tx FIFO by the Tx interrupt
+ * handler. If the transmit queue is full, the caller blocks until the Tx
+ * interrupt handler makes room in it, so the CPU is not held polling.
+ *
+ * NOTE: Calls to this function for a given UART must be serialized (for
+ * the console, only the console output task calls it).
+ */
+void uart_putchar_with_interrupts(const struct uart_device *uart_device_p,
+                                  uint8_t c)
+{
+    struct uart_device_var *const uart_var_p = uart_device_p->urt_var_p;
+    UART_Type *uart_mmio_registers_p = uart_device_p->urt_mmio_regs_p;
+    uint32_t reg_value;
+    uint32_t int_mask;
+
+    D_ASSERT(uart_var_p->urt_initialized);
+    D_ASSERT(CPU_MODE_IS_THREAD() && CPU_INTERRUPTS_ARE_ENABLED());
+
+    for ( ; ; ) {
+        int_mask = disable_cpu_interrupts();
+        if (uart_transmit_ring_put(&uart_var_p->urt_transmit_queue, c)) {
+            break;
+        }
+
+        /*
+         * Transmit queue full: wait for the Tx interrupt handler to make room
+         * in it:
+         */
+        uart_var_p->urt_transmit_queue_writer_waiting = true;
+        restore_cpu_interrupts(int_mask);
+        rtos_semaphore_wait(&uart_var_p->urt_transmit_queue_semaphore);
+    }
+
+    /*
+     * Enable generation of Tx interrupts, so that the Tx interrupt handler
+     * drains the transmit queue:
+     */
+    reg_value = READ_MMIO_REGISTER(&uart_mmio_registers_p->C2);
+    reg_value |= UART_C2_TIE_MASK;
+    WRITE_MMIO_REGISTER(&uart_mmio_registers_p->C2, reg_value);
+
+    restore_cpu_interrupts(int_mask);
+}
+
+
 /**
  * Receive a character from a UART serial port, blocking the caller
  * if there are no characters to read
@@ -448,7 +954,7 @@ uint8_t uart_getchar(const struct uart_device *uart_device_p)
 
     D_ASSERT(uart_var_p->urt_initialized);
     D_ASSERT(CPU_INTERRUPTS_ARE_ENABLED());
-    c = byte_ring_buffer_read(&uart_var_p->urt_receive_queue);
+    c = spsc_byte_ring_buffer_read(&uart_var_p->urt_receive_queue);
     return c;
 }
 
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <MK64F12.h>
 #include "runtime_checks.h"
 #include "pin_config.h"
@@ -35,6 +36,18 @@ struct uart_device {
     uint32_t urt_source_clock_freq_in_hz;
 	IRQn_Type urt_rx_tx_irq_num;
 	IRQn_Type urt_error_irq_num;
+
+    /**
+     * eDMA channel used in DMA Rx mode
+     */
+    uint8_t urt_rx_dma_channel;
+
+    /**
+     * DMAMUX request source of the UART's receiver
+     */
+    uint8_t urt_rx_dma_request_source;
+
+    IRQn_Type urt_rx_dma_irq_num;
 };
 
 
@@ -49,12 +62,24 @@ void uart_putchar(
     const struct uart_device *uart_device_p,
     uint8_t c);
 
+void uart_putchar_with_interrupts(const struct uart_device *uart_device_p,
+                                  uint8_t c);
+
 uint8_t uart_getchar(const struct uart_device *uart_device_p);
 
 uint8_t uart_getchar_with_polling(const struct uart_device *uart_device_p);
 
 int uart_getchar_non_blocking(const struct uart_device *uart_device_p);
 
+void uart_rx_dma_start(const struct uart_device *uart_device_p);
+
+size_t uart_rx_dma_get_span(const struct uart_device *uart_device_p,
+                            const uint8_t **span_p,
+                            uint32_t timeout_ms);
+
+void uart_rx_dma_consume(const struct uart_device *uart_device_p,
+                         size_t num_bytes);
+
 extern const struct uart_device g_uart_devices[];
 
 #endif /* SOURCES_BUILDING_BLOCKS_UART_DRIVER_H_ */
@@ -8,7 +8,43 @@
 #include "watchdog.h"
 #include "io_utils.h"
 #include "atomic_utils.h"
+#include "runtime_checks.h"
+#include "rtos_wrapper.h"
 #include <MK64F12.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Value of 'starved_heartbeat_index' when no heartbeat has missed its
+ * deadline
+ */
+#define WATCHDOG_NO_STARVED_HEARTBEAT   UINT8_MAX
+
+/**
+ * Heartbeat slot of a task monitored by the watchdog
+ */
+struct watchdog_heartbeat_slot {
+    /**
+     * Name of the heartbeat (normally, the name of the task)
+     */
+    const char *name_p;
+
+    /**
+     * Maximum number of RTOS ticks allowed between two signals
+     */
+    uint32_t deadline_ticks;
+
+    /**
+     * RTOS tick count at the last call to watchdog_heartbeat_signal()
+     */
+    volatile uint32_t last_signal_ticks;
+
+    /**
+     * Flag set by watchdog_heartbeat_suspend(), and cleared by
+     * watchdog_heartbeat_signal(), while the deadline is not checked
+     */
+    volatile bool suspended;
+};
 
 /**
  * Watchdog control block type
@@ -35,8 +71,30 @@ struct watchdog {
      * triggered by the watchdog timing out.
      */
     uint32_t old_signaled_liveness_events;
+
+    /**
+     * Number of entries of heartbeats[] registered
+     */
+    volatile uint8_t num_heartbeats;
+
+    /**
+     * Index of the first heartbeat found to have missed its deadline, or
+     * WATCHDOG_NO_STARVED_HEARTBEAT. Once set, the watchdog is no longer
+     * restarted.
+     */
+    uint8_t starved_heartbeat_index;
+
+    /**
+     * Name of the starved heartbeat before the last CPU reset triggered
+     * by the watchdog timing out, or NULL.
+     */
+    const char *old_starved_heartbeat_name_p;
+
+    struct watchdog_heartbeat_slot heartbeats[WATCHDOG_MAX_HEARTBEATS];
 };
 
+C_ASSERT(WATCHDOG_MAX_HEARTBEATS < WATCHDOG_NO_STARVED_HEARTBEAT);
+
 /**
  * Watchdog control block
  *
@@ -62,13 +120,23 @@ void watchdog_init(void)
     if (reg_value & RCM_SRS0_WDOG_MASK) {
         g_watchdog.old_expected_liveness_events = g_watchdog.expected_liveness_events;
         g_watchdog.old_signaled_liveness_events = g_watchdog.signaled_liveness_events;
+        if (g_watchdog.starved_heartbeat_index < g_watchdog.num_heartbeats &&
+            g_watchdog.num_heartbeats <= WATCHDOG_MAX_HEARTBEATS) {
+            g_watchdog.old_starved_heartbeat_name_p =
+                g_watchdog.heartbeats[g_watchdog.starved_heartbeat_index].name_p;
+        } else {
+            g_watchdog.old_starved_heartbeat_name_p = NULL;
+        }
     } else {
         g_watchdog.old_expected_liveness_events = 0x0;
         g_watchdog.old_signaled_liveness_events = 0x0;
+        g_watchdog.old_starved_heartbeat_name_p = NULL;
     }
 
     g_watchdog.expected_liveness_events = 0x0;
     g_watchdog.signaled_liveness_events = 0x0;
+    g_watchdog.num_heartbeats = 0;
+    g_watchdog.starved_heartbeat_index = WATCHDOG_NO_STARVED_HEARTBEAT;
 
     /*
      * NOTE: First, we need to unlock the Watchdog, and to do so, two
@@ -92,15 +160,49 @@ void watchdog_init(void)
 }
 
 
+/**
+ * Checks the deadlines of all the registered heartbeats, in a single pass
+ * with interrupts disabled, so that all heartbeats are checked against the
+ * same RTOS tick count.
+ *
+ * @return true, if all heartbeats are within their deadlines
+ */
+static bool watchdog_check_heartbeats(void)
+{
+    struct watchdog *const watchdog_p = &g_watchdog;
+    bool all_alive = true;
+
+    uint32_t int_mask = disable_cpu_interrupts();
+    uint32_t now_ticks = rtos_get_ticks_since_boot();
+
+    for (uint_fast8_t i = 0; i < watchdog_p->num_heartbeats; i ++) {
+        const struct watchdog_heartbeat_slot *slot_p = &watchdog_p->heartbeats[i];
+
+        if (!slot_p->suspended &&
+            RTOS_TICKS_DELTA(slot_p->last_signal_ticks, now_ticks) >
+                slot_p->deadline_ticks) {
+            watchdog_p->starved_heartbeat_index = i;
+            all_alive = false;
+            break;
+        }
+    }
+
+    restore_cpu_interrupts(int_mask);
+    return all_alive;
+}
+
+
 /**
  * Restarts the watchdog timer if all the expected liveness events have
- * been signaled.
+ * been signaled, and all the registered heartbeats have been signaled
+ * within their deadlines.
  *
  * NOTE: This function is to be invoked from the idle task.
  *
- * GERMAN: This implementation is not very robust as it will not detect if all tasks
+ * GERMAN: Liveness events alone will not detect if all tasks
  * (except the idle task) are stuck, since if no task is runnable, then the
  * idle task still can run as long as the timer interrupt is still firing.
+ * Heartbeats of tasks that wait with a timeout catch that.
  */
 void watchdog_restart(void)
 {
@@ -109,6 +211,11 @@ void watchdog_restart(void)
         return;
     }
 
+    if (g_watchdog.starved_heartbeat_index != WATCHDOG_NO_STARVED_HEARTBEAT ||
+        !watchdog_check_heartbeats()) {
+        return;
+    }
+
     g_watchdog.signaled_liveness_events = 0x0;
 
     uint32_t int_mask = disable_cpu_interrupts();
@@ -157,3 +264,92 @@ void watchdog_get_before_reset_info(uint32_t *old_expected_liveness_events_p,
     *old_expected_liveness_events_p = g_watchdog.old_expected_liveness_events;
     *old_signaled_liveness_events_p = g_watchdog.old_signaled_liveness_events;
 }
+
+
+/**
+ * Registers a task heartbeat with the watchdog. From then on, the task must
+ * call watchdog_heartbeat_signal() at least once every deadline_ms, or
+ * watchdog_heartbeat_suspend() before waiting for an unbounded time, or the
+ * watchdog will no longer be restarted.
+ *
+ * @param name_p        Heartbeat name (normally, the task name)
+ * @param deadline_ms   Maximum time allowed between two signals
+ *
+ * @return Index of the heartbeat, to be passed to watchdog_heartbeat_signal()
+ */
+uint_fast8_t watchdog_heartbeat_register(const char *name_p, uint32_t deadline_ms)
+{
+    struct watchdog *const watchdog_p = &g_watchdog;
+    uint_fast8_t heartbeat_index;
+
+    D_ASSERT(deadline_ms != 0);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    heartbeat_index = watchdog_p->num_heartbeats;
+    if (heartbeat_index == WATCHDOG_MAX_HEARTBEATS) {
+        restore_cpu_interrupts(int_mask);
+        error_t error = CAPTURE_ERROR("Too many watchdog heartbeats",
+                                      (uintptr_t)name_p, 0);
+        fatal_error_handler(error);
+    }
+
+    struct watchdog_heartbeat_slot *const slot_p =
+        &watchdog_p->heartbeats[heartbeat_index];
+
+    slot_p->name_p = name_p;
+    slot_p->deadline_ticks =
+        (uint32_t)(((uint64_t)deadline_ms * RTOS_TICK_RATE_HZ + 999) / 1000);
+    slot_p->last_signal_ticks = rtos_get_ticks_since_boot();
+    slot_p->suspended = false;
+
+    /*
+     * Make the slot visible to watchdog_check_heartbeats() only after it has
+     * been filled:
+     */
+    watchdog_p->num_heartbeats = heartbeat_index + 1;
+
+    restore_cpu_interrupts(int_mask);
+    return heartbeat_index;
+}
+
+
+/**
+ * Notifies that the task of a given heartbeat is alive. This is just two
+ * plain stores, so that it can be called from every loop iteration.
+ *
+ * @param heartbeat_index Index returned by watchdog_heartbeat_register()
+ */
+void watchdog_heartbeat_signal(uint_fast8_t heartbeat_index)
+{
+    struct watchdog_heartbeat_slot *const slot_p =
+        &g_watchdog.heartbeats[heartbeat_index];
+
+    D_ASSERT(heartbeat_index < g_watchdog.num_heartbeats);
+    slot_p->last_signal_ticks = rtos_get_ticks_since_boot();
+    slot_p->suspended = false;
+}
+
+
+/**
+ * Stops checking the deadline of a given heartbeat, until the next call to
+ * watchdog_heartbeat_signal(). It is to be called by a task right before
+ * waiting for an unbounded time.
+ *
+ * @param heartbeat_index Index returned by watchdog_heartbeat_register()
+ */
+void watchdog_heartbeat_suspend(uint_fast8_t heartbeat_index)
+{
+    D_ASSERT(heartbeat_index < g_watchdog.num_heartbeats);
+    g_watchdog.heartbeats[heartbeat_index].suspended = true;
+}
+
+
+/**
+ * Returns the name of the heartbeat that missed its deadline before the
+ * last CPU reset triggered by the watchdog, or NULL if none.
+ */
+const char *watchdog_get_before_reset_starved_heartbeat(void)
+{
+    return g_watchdog.old_starved_heartbeat_name_p;
+}
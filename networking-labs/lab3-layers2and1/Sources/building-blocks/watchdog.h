@@ -11,6 +11,11 @@
 #include <stdint.h>
 #include "io_utils.h"
 
+/**
+ * Maximum number of task heartbeats that can be registered
+ */
+#define WATCHDOG_MAX_HEARTBEATS     16
+
 /*
  * Liveness events masks
  *
@@ -30,4 +35,12 @@ void watchdog_signal_liveness_event(uint32_t event_mask);
 void watchdog_get_before_reset_info(uint32_t *old_expected_liveness_events_p,
                                     uint32_t *old_signaled_liveness_events_p);
 
+uint_fast8_t watchdog_heartbeat_register(const char *name_p, uint32_t deadline_ms);
+
+void watchdog_heartbeat_signal(uint_fast8_t heartbeat_index);
+
+void watchdog_heartbeat_suspend(uint_fast8_t heartbeat_index);
+
+const char *watchdog_get_before_reset_starved_heartbeat(void);
+
 #endif /* SOURCES_BUILDING_BLOCKS_WATCHDOG_H_ */
@@ -0,0 +1,191 @@
+/**
+ * @file work_queue.c
+ *
+ * Prioritized work queue implementation
+ *
+ * @author German Rivera
+ */
+#include "work_queue.h"
+#include "runtime_checks.h"
+#include "runtime_log.h"
+#include "atomic_utils.h"
+
+
+/**
+ * Removes the highest-priority queued item from a work queue
+ *
+ * @return pointer to the item removed, or NULL if the queue is empty
+ */
+static struct work_item *work_queue_dequeue(struct work_queue *work_queue_p)
+{
+    struct work_item *work_item_p = NULL;
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    for (uint_fast8_t i = 0; i < NUM_WORK_ITEM_PRIORITIES; i ++) {
+        work_item_p = work_queue_p->lists[i].head_p;
+        if (work_item_p != NULL) {
+            work_queue_p->lists[i].head_p = work_item_p->next_p;
+            if (work_item_p->next_p == NULL) {
+                work_queue_p->lists[i].tail_p = NULL;
+            }
+
+            work_item_p->next_p = NULL;
+            work_item_p->queued = false;
+            work_queue_p->num_queued_items --;
+            break;
+        }
+    }
+
+    restore_cpu_interrupts(int_mask);
+    return work_item_p;
+}
+
+
+/**
+ * Work queue worker task
+ */
+static void work_queue_worker_task(void *arg)
+{
+    struct work_queue *work_queue_p = arg;
+
+    D_ASSERT(work_queue_p->signature == WORK_QUEUE_SIGNATURE);
+
+    for ( ; ; ) {
+        rtos_semaphore_wait(&work_queue_p->items_semaphore);
+
+        struct work_item *work_item_p = work_queue_dequeue(work_queue_p);
+
+        D_ASSERT(work_item_p != NULL);
+        D_ASSERT(work_item_p->signature == WORK_ITEM_SIGNATURE);
+        work_queue_p->items_run_count ++;
+        work_item_p->func_p(work_item_p, work_item_p->func_arg);
+    }
+
+    ERROR_PRINTF("task %s should not have terminated\n",
+                 rtos_task_self()->tsk_name_p);
+}
+
+
+/**
+ * Initializes a work queue. Items can be posted to it right away, but they
+ * are not run until work_queue_start() is called.
+ *
+ * @param work_queue_p      Pointer to the work queue
+ * @param name_p            Name of the work queue
+ */
+void work_queue_init(struct work_queue *work_queue_p, const char *name_p)
+{
+    work_queue_p->signature = WORK_QUEUE_SIGNATURE;
+    work_queue_p->name_p = name_p;
+    for (uint_fast8_t i = 0; i < NUM_WORK_ITEM_PRIORITIES; i ++) {
+        work_queue_p->lists[i].head_p = NULL;
+        work_queue_p->lists[i].tail_p = NULL;
+    }
+
+    work_queue_p->worker_tasks_p = NULL;
+    work_queue_p->num_workers = 0;
+    work_queue_p->num_queued_items = 0;
+    work_queue_p->max_queued_items = 0;
+    work_queue_p->items_run_count = 0;
+    work_queue_p->coalesced_posts_count = 0;
+    rtos_semaphore_init(&work_queue_p->items_semaphore, name_p, 0);
+}
+
+
+/**
+ * Starts a work queue: creates its worker tasks
+ *
+ * @param work_queue_p      Pointer to the work queue
+ * @param worker_tasks_p    Array of num_workers task objects for the
+ *                          worker tasks
+ * @param num_workers       Number of worker tasks. With more than one
+ *                          worker, items may run concurrently, so a
+ *                          work item function must protect any state
+ *                          it shares with other work items.
+ * @param task_prio         Priority of the worker tasks
+ */
+void work_queue_start(struct work_queue *work_queue_p,
+                      struct rtos_task *worker_tasks_p,
+                      uint8_t num_workers,
+                      rtos_task_priority_t task_prio)
+{
+    D_ASSERT(work_queue_p->signature == WORK_QUEUE_SIGNATURE);
+    D_ASSERT(work_queue_p->num_workers == 0);
+    D_ASSERT(num_workers != 0 && num_workers <= WORK_QUEUE_MAX_NUM_WORKERS);
+
+    work_queue_p->worker_tasks_p = worker_tasks_p;
+    work_queue_p->num_workers = num_workers;
+    for (uint_fast8_t i = 0; i < num_workers; i ++) {
+        rtos_task_create(&worker_tasks_p[i],
+                         work_queue_p->name_p,
+                         work_queue_worker_task,
+                         work_queue_p,
+                         task_prio);
+    }
+}
+
+
+/**
+ * Initializes a work item
+ *
+ * @param work_item_p   Pointer to the work item
+ * @param func_p        Function to run when the item is dequeued
+ * @param func_arg      Argument for func_p
+ */
+void work_item_init(struct work_item *work_item_p,
+                    work_item_func_t *func_p,
+                    void *func_arg)
+{
+    D_ASSERT(func_p != NULL);
+
+    work_item_p->signature = WORK_ITEM_SIGNATURE;
+    work_item_p->queued = false;
+    work_item_p->func_p = func_p;
+    work_item_p->func_arg = func_arg;
+    work_item_p->next_p = NULL;
+}
+
+
+/**
+ * Posts a work item to a work queue. It can be called from ISRs.
+ *
+ * @param work_queue_p  Pointer to the work queue
+ * @param work_item_p   Pointer to the work item
+ * @param priority      Priority of the item
+ *
+ * @return true, if the item was queued
+ * @return false, if the item was already queued (and was left where it was)
+ */
+bool work_queue_post(struct work_queue *work_queue_p,
+                     struct work_item *work_item_p,
+                     enum work_item_priorities priority)
+{
+    D_ASSERT(work_queue_p->signature == WORK_QUEUE_SIGNATURE);
+    D_ASSERT(work_item_p->signature == WORK_ITEM_SIGNATURE);
+    D_ASSERT(priority < NUM_WORK_ITEM_PRIORITIES);
+
+    uint32_t int_mask = disable_cpu_interrupts();
+
+    if (work_item_p->queued) {
+        work_queue_p->coalesced_posts_count ++;
+        restore_cpu_interrupts(int_mask);
+        return false;
+    }
+
+    work_item_p->queued = true;
+    if (work_queue_p->lists[priority].tail_p == NULL) {
+        work_queue_p->lists[priority].head_p = work_item_p;
+    } else {
+        work_queue_p->lists[priority].tail_p->next_p = work_item_p;
+    }
+
+    work_queue_p->lists[priority].tail_p = work_item_p;
+    work_queue_p->num_queued_items ++;
+    if (work_queue_p->num_queued_items > work_queue_p->max_queued_items) {
+        work_queue_p->max_queued_items = work_queue_p->num_queued_items;
+    }
+
+    restore_cpu_interrupts(int_mask);
+    rtos_semaphore_signal(&work_queue_p->items_semaphore);
+    return true;
+}
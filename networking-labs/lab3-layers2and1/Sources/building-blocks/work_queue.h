@@ -0,0 +1,150 @@
+/**
+ * @file work_queue.h
+ *
+ * Prioritized work queue interface
+ *
+ * A work queue runs small work items, posted from tasks or ISRs, on a few
+ * worker tasks shared by all the work queue's users. Low-rate activities
+ * that would otherwise need their own task (and their own full stack) can
+ * be turned into work items, posted from an ISR, an RTOS timer callback or
+ * another task.
+ *
+ * Work items are caller-allocated and are never copied: posting a work item
+ * links the item itself in the queue. A work item can be in the queue at
+ * most once; posting an item that is already queued has no effect, so
+ * several posts of the same item before it runs are coalesced into one run.
+ *
+ * @author German Rivera
+ */
+#ifndef SOURCES_BUILDING_BLOCKS_WORK_QUEUE_H_
+#define SOURCES_BUILDING_BLOCKS_WORK_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "rtos_wrapper.h"
+
+/**
+ * Maximum number of worker tasks of a work queue
+ */
+#define WORK_QUEUE_MAX_NUM_WORKERS  4
+
+/**
+ * Priorities of work items. Queued items of a higher priority are always
+ * run before queued items of a lower priority. Items of the same priority
+ * are run in FIFO order.
+ */
+enum work_item_priorities {
+    WORK_ITEM_PRIORITY_HIGH = 0,
+    WORK_ITEM_PRIORITY_NORMAL,
+    WORK_ITEM_PRIORITY_LOW,
+
+    /*
+     * Last entry reserved for number of entries in the enum
+     */
+    NUM_WORK_ITEM_PRIORITIES
+};
+
+struct work_item;
+
+/**
+ * Signature of a work item function
+ */
+typedef void work_item_func_t(struct work_item *work_item_p, void *arg);
+
+/**
+ * Work item
+ */
+struct work_item {
+#   define WORK_ITEM_SIGNATURE  GEN_SIGNATURE('W', 'I', 'T', 'M')
+    uint32_t signature;
+
+    /**
+     * Flag indicating if the item is currently in a work queue. It is
+     * cleared right before the item's function is invoked, so the function
+     * can re-post its own item.
+     */
+    volatile bool queued;
+
+    /**
+     * Function to run
+     */
+    work_item_func_t *func_p;
+
+    /**
+     * Argument for func_p
+     */
+    void *func_arg;
+
+    /**
+     * Next item in the work queue's list of the item's priority
+     */
+    struct work_item *next_p;
+};
+
+/**
+ * Work queue
+ */
+struct work_queue {
+#   define WORK_QUEUE_SIGNATURE  GEN_SIGNATURE('W', 'Q', 'U', 'E')
+    uint32_t signature;
+
+    const char *name_p;
+
+    /**
+     * FIFO lists of queued items, one per priority. They are protected by
+     * disabling interrupts, as items can be posted from ISRs.
+     */
+    struct {
+        struct work_item *head_p;
+        struct work_item *tail_p;
+    } lists[NUM_WORK_ITEM_PRIORITIES];
+
+    /**
+     * Counting semaphore signaled once per queued item
+     */
+    struct rtos_semaphore items_semaphore;
+
+    /**
+     * Worker tasks, provided by the caller of work_queue_start()
+     */
+    struct rtos_task *worker_tasks_p;
+
+    uint8_t num_workers;
+
+    /**
+     * Number of items currently queued
+     */
+    volatile uint32_t num_queued_items;
+
+    /**
+     * Maximum value that num_queued_items ever reached
+     */
+    volatile uint32_t max_queued_items;
+
+    /**
+     * Number of work items run
+     */
+    volatile uint32_t items_run_count;
+
+    /**
+     * Number of posts of items that were already queued
+     */
+    volatile uint32_t coalesced_posts_count;
+};
+
+void work_queue_init(struct work_queue *work_queue_p, const char *name_p);
+
+void work_queue_start(struct work_queue *work_queue_p,
+                      struct rtos_task *worker_tasks_p,
+                      uint8_t num_workers,
+                      rtos_task_priority_t task_prio);
+
+void work_item_init(struct work_item *work_item_p,
+                    work_item_func_t *func_p,
+                    void *func_arg);
+
+bool work_queue_post(struct work_queue *work_queue_p,
+                     struct work_item *work_item_p,
+                     enum work_item_priorities priority);
+
+#endif /* SOURCES_BUILDING_BLOCKS_WORK_QUEUE_H_ */
@@ -6,6 +6,8 @@
  * @author: German Rivera
  */
 #include <building-blocks/serial_console.h>
+#include <building-blocks/serial_channel.h>
+#include <building-blocks/uart_driver.h>
 #include <building-blocks/color_led.h>
 #include <building-blocks/runtime_checks.h>
 #include <building-blocks/time_utils.h>
@@ -13,28 +15,54 @@
 #include <building-blocks/command_line.h>
 #include <building-blocks/atomic_utils.h>
 #include <building-blocks/mem_utils.h>
+#include <building-blocks/crc_32.h>
+#include <building-blocks/dma_memcpy.h>
 #include <building-blocks/microcontroller.h>
 #include <building-blocks/pin_config.h>
 #include <building-blocks/cpu_reset_counter.h>
 #include <building-blocks/cortex_m_startup.h>
 #include <building-blocks/watchdog.h>
 #include <building-blocks/nor_flash_driver.h>
+#include <building-blocks/nor_flash_kv_store.h>
 #include <building-blocks/runtime_log.h>
+#include <building-blocks/runtime_log_exporter.h>
+#include <building-blocks/ota_receiver.h>
+#include <building-blocks/sntp_client.h>
+#include <building-blocks/telemetry_beacon.h>
+#include <building-blocks/dns_resolver.h>
+#include <building-blocks/crash_dump.h>
+#include <building-blocks/perf_probes.h>
+#include <building-blocks/trace_recorder.h>
+#include <building-blocks/packet_capture.h>
+#include <building-blocks/text_format.h>
 #include <building-blocks/networking.h>
 #include <building-blocks/networking_layer2.h>
 #include <building-blocks/networking_layer3.h>
 #include <building-blocks/networking_layer4.h>
+#include <building-blocks/work_queue.h>
+#include <building-blocks/mem_pool.h>
+#include <building-blocks/mem_arena.h>
+#include <building-blocks/power_utils.h>
+#include <building-blocks/sampling_profiler.h>
+#include <building-blocks/stack_trace.h>
+#include <building-blocks/hr_timer.h>
+#include <building-blocks/net_benchmark.h>
+#include <building-blocks/micro_benchmark.h>
 #include <board.h>
 #include <string.h>
+#include <stdlib.h>
 #include <fsl_clock_manager.h>
+#include <print_scan.h>
 
 /**
- * Stacks checker task period in milliseconds
+ * Safety margin (percent of the measured peak usage) and rounding granularity
+ * (in stack entries) used to suggest a stack size for each task
  */
-#define STACKS_CHECKING_PERIOD_MS    50
+#define STACK_SIZING_MARGIN_PERCENT  25
+#define STACK_SIZING_GRANULARITY     8
 
 /**
- * Heartbeat timer period in milliseconds
+ * Heartbeat LED on/off time in milliseconds
  */
 #define HEARTBEAT_PERIOD_MS        500
 
@@ -43,6 +71,60 @@
  */
 #define NETWORK_STATS_POLLING_PERIOD_MS    250
 
+/**
+ * Maximum refresh period in milliseconds of the network stats display
+ * (see 'set stats refresh')
+ */
+#define NETWORK_STATS_MAX_REFRESH_PERIOD_MS    10000
+
+/**
+ * Baud rate for the telemetry serial channel
+ */
+#define TELEMETRY_CHANNEL_UART_BAUD        230400
+
+/**
+ * Maximum length of a telemetry record
+ */
+#define TELEMETRY_RECORD_MAX_SIZE          96
+
+/**
+ * Sizes of the scratch memory arenas of the main task (command handlers) and
+ * of the housekeeping worker task
+ */
+#define MAIN_TASK_SCRATCH_ARENA_SIZE        1024
+#define HOUSEKEEPING_SCRATCH_ARENA_SIZE     256
+
+/**
+ * Maximum length of the JSON stats record sent by the UDP server in reply
+ * to a "stats" datagram. It is also the size of the UDP server task's
+ * scratch memory arena, where the record is formatted.
+ */
+#define STATS_JSON_MAX_SIZE                 3072
+
+/**
+ * Version of the layout of the JSON stats record. It must be incremented
+ * whenever a field is renamed or removed, so that parsers of the record
+ * can tell.
+ */
+#define STATS_JSON_SCHEMA_VERSION           1
+
+/**
+ * UDP port of the remote console, where each datagram received is run as a
+ * command line (see scripts/remote_console.pl)
+ */
+#define REMOTE_CONSOLE_UDP_PORT             8886
+
+/**
+ * Max size of a remote console command line, including null terminator
+ */
+#define REMOTE_CONSOLE_LINE_MAX_SIZE        81
+
+/**
+ * Size of the buffer where remote console command output is accumulated.
+ * Output is sent back to the client in datagrams of up to this size.
+ */
+#define REMOTE_CONSOLE_OUTPUT_CHUNK_SIZE    512
+
 /**
  * Task creation parameters:
  */
@@ -63,33 +145,96 @@ static const struct ipv4_address g_local_ipv4_addr = {
  * Task instances
  */
 static struct rtos_task g_main_task;
-static struct rtos_task g_network_stats_task;
-static struct rtos_task g_stacks_checker_task;
+static struct rtos_task g_housekeeping_worker_task;
 static struct rtos_task g_console_output_task;
 static struct rtos_task g_udp_server_task;
+static struct rtos_task g_telemetry_channel_output_task;
+static struct rtos_task g_remote_console_task;
 
 /**
  * Array of pointers to all tasks
  */
 static struct rtos_task *g_all_app_tasks[] = {
     &g_main_task,
-    &g_network_stats_task,
-    &g_stacks_checker_task,
+    &g_housekeeping_worker_task,
     &g_console_output_task,
     &g_udp_server_task,
+    &g_telemetry_channel_output_task,
+    &g_remote_console_task,
 };
 
 #define NUM_APP_TASKS    (sizeof(g_all_app_tasks) / sizeof(g_all_app_tasks[0]))
 
 /**
- * Periodic timer to toggle the heartbeat LED
+ * Serial channel where network stats telemetry records are sent, on its
+ * own UART, so that it does not compete with console output
+ */
+static struct serial_channel g_telemetry_channel;
+
+/**
+ * Work queue shared by the low-rate periodic activities of the application
+ * (such as the network stats display), so that they do not need a
+ * task (and a stack) each
+ */
+static struct work_queue g_housekeeping_work_queue;
+
+/**
+ * Work items run on g_housekeeping_work_queue, and the periodic timers
+ * that post them
+ */
+static struct work_item g_networking_bringup_work_item;
+static struct work_item g_network_stats_work_item;
+static struct rtos_timer g_network_stats_timer;
+
+/**
+ * Flag set when the networking stack has been brought up in the
+ * background, by networking_bringup_work_func()
+ */
+static volatile bool g_networking_started = false;
+
+/**
+ * Scratch memory arenas, for temporary buffers of the main task and of the
+ * housekeeping worker task, that would otherwise be on their stacks
+ */
+static struct mem_arena g_main_task_scratch_arena;
+static struct mem_arena g_housekeeping_scratch_arena;
+static struct mem_arena g_udp_server_scratch_arena;
+static struct mem_arena g_remote_console_scratch_arena;
+static MEM_ARENA_STORAGE(g_main_task_scratch_storage, MAIN_TASK_SCRATCH_ARENA_SIZE);
+static MEM_ARENA_STORAGE(g_housekeeping_scratch_storage, HOUSEKEEPING_SCRATCH_ARENA_SIZE);
+static MEM_ARENA_STORAGE(g_udp_server_scratch_storage, STATS_JSON_MAX_SIZE);
+
+/**
+ * The remote console task runs the same command handlers as the main task,
+ * so it needs the same scratch arena size
+ */
+static MEM_ARENA_STORAGE(g_remote_console_scratch_storage, MAIN_TASK_SCRATCH_ARENA_SIZE);
+
+/**
+ * Heartbeat LED blink pattern. It is played by the LED's timer-paced DMA
+ * channels, so the heartbeat takes no CPU time.
+ */
+static const uint16_t g_heartbeat_blink_phases_ms[] = {
+    HEARTBEAT_PERIOD_MS, HEARTBEAT_PERIOD_MS,
+};
+
+/**
+ * Ethernet MAC Rx/Tx throughput in the last network stats polling period
+ * (in bytes per second)
  */
-static struct rtos_timer g_heartbeat_timer;
+static volatile uint32_t g_ethernet_rx_bytes_per_sec;
+static volatile uint32_t g_ethernet_tx_bytes_per_sec;
 
 /**
- * Heartbeat LED color
+ * CPU utilization in the last network stats refresh period, in hundredths
+ * of a percent (time the CPU was not asleep in the CPU idle governor's
+ * WFI), layer-2 packet rates in that period (in packets per second), and
+ * busy CPU cycles per layer-2 packet (received or sent) in that period
  */
-static volatile led_color_t g_heartbeat_led_color = LED_COLOR_BLUE;
+static volatile uint32_t g_cpu_busy_per_10k;
+static volatile uint32_t g_layer2_rx_packets_per_sec;
+static volatile uint32_t g_layer2_tx_packets_per_sec;
+static volatile uint32_t g_cpu_busy_cycles_per_packet;
 
 
 /**
@@ -97,54 +242,502 @@ static volatile led_color_t g_heartbeat_led_color = LED_COLOR_BLUE;
  */
 static void init_network_stats_display(void)
 {
-    console_pos_printf(5, 1, 0, "Ethernet link");
-    console_draw_box(4, 14, 3, 6, 0);
-    console_pos_printf(5, 21, 0, "Ethernet MAC address");
-    console_draw_box(4, 41, 3, 19, 0);
-    console_pos_printf(8, 1, 0, "IPv4 address");
-    console_draw_box(7, 13, 3, 17, 0);
-    console_pos_printf(8, 31, 0, "IPv4 subnet mask");
-    console_draw_box(7, 47, 3, 17, 0);
-
-    console_pos_printf(11, 1, 0, "Received packets accepted at layer 2 - Enet");
-    console_draw_box(10, 44, 3, 12, 0);
-    console_pos_printf(11, 57, 0, "Received packets dropped at layer 2 - Enet");
-    console_draw_box(10, 100, 3, 12, 0);
-    console_pos_printf(11, 113, 0, "Sent packets at layer 2 - Enet");
-    console_draw_box(10, 143, 3, 12, 0);
-
-    console_pos_printf(14, 1, 0, "Received packets accepted at layer 3 - IPv4");
-    console_draw_box(13, 44, 3, 12, 0);
-    console_pos_printf(14, 57, 0, "Received packets dropped at layer 3 - IPv4");
-    console_draw_box(13, 100, 3, 12, 0);
-    console_pos_printf(14, 113, 0, "Sent packets at layer 3 - IPv4");
-    console_draw_box(13, 143, 3, 12, 0);
-
-    console_pos_printf(17, 1, 0, "Received packets accepted at layer 4 - UDP ");
-    console_draw_box(16, 44, 3, 12, 0);
-    console_pos_printf(17, 57, 0, "Received packets dropped at layer 4 - UDP ");
-    console_draw_box(16, 100, 3, 12, 0);
-    console_pos_printf(17, 113, 0, "Sent packets at layer 4 - UDP ");
-    console_draw_box(16, 143, 3, 12, 0);
-
-    console_pos_printf(20, 1, 0, "Last UDP message received");
-    console_draw_box(19, 26, 3, 82, 0);
+    console_screen_pos_printf(5, 1, 0, "Ethernet link");
+    console_screen_draw_box(4, 14, 3, 6, 0);
+    console_screen_pos_printf(5, 21, 0, "Ethernet MAC address");
+    console_screen_draw_box(4, 41, 3, 19, 0);
+    console_screen_pos_printf(8, 1, 0, "IPv4 address");
+    console_screen_draw_box(7, 13, 3, 17, 0);
+    console_screen_pos_printf(8, 31, 0, "IPv4 subnet mask");
+    console_screen_draw_box(7, 47, 3, 17, 0);
+
+    console_screen_pos_printf(11, 1, 0, "Received packets accepted at layer 2 - Enet");
+    console_screen_draw_box(10, 44, 3, 12, 0);
+    console_screen_pos_printf(11, 57, 0, "Received packets dropped at layer 2 - Enet");
+    console_screen_draw_box(10, 100, 3, 12, 0);
+    console_screen_pos_printf(11, 113, 0, "Sent packets at layer 2 - Enet");
+    console_screen_draw_box(10, 143, 3, 12, 0);
+
+    console_screen_pos_printf(14, 1, 0, "Received packets accepted at layer 3 - IPv4");
+    console_screen_draw_box(13, 44, 3, 12, 0);
+    console_screen_pos_printf(14, 57, 0, "Received packets dropped at layer 3 - IPv4");
+    console_screen_draw_box(13, 100, 3, 12, 0);
+    console_screen_pos_printf(14, 113, 0, "Sent packets at layer 3 - IPv4");
+    console_screen_draw_box(13, 143, 3, 12, 0);
+
+    console_screen_pos_printf(17, 1, 0, "Received packets accepted at layer 4 - UDP ");
+    console_screen_draw_box(16, 44, 3, 12, 0);
+    console_screen_pos_printf(17, 57, 0, "Received packets dropped at layer 4 - UDP ");
+    console_screen_draw_box(16, 100, 3, 12, 0);
+    console_screen_pos_printf(17, 113, 0, "Sent packets at layer 4 - UDP ");
+    console_screen_draw_box(16, 143, 3, 12, 0);
+
+    console_screen_pos_printf(20, 1, 0, "Last UDP message received");
+    console_screen_draw_box(19, 26, 3, 82, 0);
+
+    console_screen_pos_printf(23, 1, 0, "UDP soak test");
+    console_screen_draw_box(22, 26, 3, 100, 0);
 }
 
 
 static void heartbeat_set_led_color(led_color_t color)
 {
-    uint32_t old_primask = disable_cpu_interrupts();
+    color_led_blink(color, g_heartbeat_blink_phases_ms,
+                    ARRAY_SIZE(g_heartbeat_blink_phases_ms));
+}
+
+
+/**
+ * Writes a JSON string to a format span, escaping the characters that
+ * cannot appear unescaped in a JSON string
+ */
+static void stats_json_put_string(struct format_span *span_p, const char *s)
+{
+    format_span_put_chars(span_p, "\"", 1);
+    for ( ; *s != '\0'; s ++) {
+        if (*s == '"' || *s == '\\') {
+            format_span_put_chars(span_p, "\\", 1);
+        }
+
+        format_span_put_chars(span_p, s, 1);
+    }
+
+    format_span_put_chars(span_p, "\"", 1);
+}
+
+
+static void stats_json_put_packet_pool(struct format_span *span_p,
+                                       const char *pool_name_p,
+                                       const struct net_packet_pool_stats *stats_p)
+{
+    (void)text_format_printf(span_p,
+                             "\"%s\":{\"total\":%u,\"free\":%u,\"in_transit\":%u,"
+                             "\"queued\":%u,\"held_by_app\":%u,\"max_in_use\":%u},",
+                             pool_name_p, stats_p->total_packets,
+                             stats_p->free_packets, stats_p->in_transit_packets,
+                             stats_p->queued_packets, stats_p->held_by_app_packets,
+                             stats_p->in_use_high_water_mark);
+}
+
+
+/**
+ * Formats all the statistics counters as a single-line JSON object, for
+ * the 'stats json' command and for "stats" datagrams sent to the UDP
+ * server. Field names are stable across firmware builds (see
+ * STATS_JSON_SCHEMA_VERSION), so that performance can be tracked over
+ * builds by parsing this record.
+ */
+static void stats_format_json(struct format_span *span_p)
+{
+    uint32_t max_time_us;
+    uintptr_t code_addr;
+
+    get_max_interrupts_disabled_stats_us(&max_time_us, &code_addr);
+    (void)text_format_printf(span_p,
+                             "{\"schema\":%u,\"uptime_s\":%u,\"reset_count\":%u,"
+                             "\"irq_disabled_max_us\":%u,\"console_bytes_dropped\":%u,",
+                             STATS_JSON_SCHEMA_VERSION, rtos_get_time_since_boot(),
+                             read_cpu_reset_counter(), max_time_us,
+                             console_get_output_bytes_dropped());
+
+    if (g_networking_started) {
+        struct net_stats_snapshot snapshot;
+        struct ethernet_mac_stats mac_stats;
+        struct net_packet_pool_stats pool_stats;
+
+        networking_get_stats_snapshot(&snapshot);
+        (void)text_format_printf(span_p,
+                                 "\"layer2\":{\"rx_accepted\":%u,\"rx_dropped\":%u,\"tx\":%u},"
+                                 "\"ipv4\":{\"rx_accepted\":%u,\"rx_dropped\":%u,\"tx\":%u},"
+                                 "\"udp\":{\"rx_accepted\":%u,\"rx_dropped\":%u,\"tx\":%u},",
+                                 snapshot.layer2.rx_packets_accepted_count,
+                                 snapshot.layer2.rx_packets_dropped_count,
+                                 snapshot.layer2.sent_packets_count,
+                                 snapshot.ipv4.rx_packets_accepted_count,
+                                 snapshot.ipv4.rx_packets_dropped_count,
+                                 snapshot.ipv4.sent_packets_count,
+                                 snapshot.udp.rx_packets_accepted_count,
+                                 snapshot.udp.rx_packets_dropped_count,
+                                 snapshot.udp.sent_packets_count);
+        (void)text_format_printf(span_p,
+                                 "\"cpu_busy\":{\"per_10k\":%u,\"rx_packets_per_sec\":%u,"
+                                 "\"tx_packets_per_sec\":%u,\"cycles_per_packet\":%u},",
+                                 g_cpu_busy_per_10k, g_layer2_rx_packets_per_sec,
+                                 g_layer2_tx_packets_per_sec,
+                                 g_cpu_busy_cycles_per_packet);
+
+        ethernet_mac_get_stats(g_net_layer2.local_layer2_end_points[0].ethernet_mac_p,
+                               &mac_stats);
+        (void)text_format_printf(span_p,
+                                 "\"mac\":{\"rx_frames\":%u,\"rx_octets\":%u,"
+                                 "\"rx_bytes_per_sec\":%u,\"rx_crc_errors\":%u,"
+                                 "\"rx_overruns\":%u,\"rx_drops\":%u,\"tx_frames\":%u,"
+                                 "\"tx_octets\":%u,\"tx_bytes_per_sec\":%u,"
+                                 "\"tx_collisions\":%u,\"tx_underruns\":%u},",
+                                 mac_stats.rx_frames, mac_stats.rx_octets,
+                                 g_ethernet_rx_bytes_per_sec, mac_stats.rx_crc_errors,
+                                 mac_stats.rx_overruns, mac_stats.rx_drops,
+                                 mac_stats.tx_frames, mac_stats.tx_octets,
+                                 g_ethernet_tx_bytes_per_sec, mac_stats.tx_collisions,
+                                 mac_stats.tx_underruns);
+
+        net_layer2_get_tx_packet_pool_stats(&pool_stats);
+        stats_json_put_packet_pool(span_p, "tx_packets", &pool_stats);
+        net_layer2_end_point_get_rx_packet_pool_stats(&g_net_layer2.local_layer2_end_points[0],
+                                                      &pool_stats);
+        stats_json_put_packet_pool(span_p, "rx_packets", &pool_stats);
+
+        struct net_layer2_rx_copybreak_stats copybreak_stats;
+
+        net_layer2_end_point_get_rx_copybreak_stats(&g_net_layer2.local_layer2_end_points[0],
+                                                    &copybreak_stats);
+        stats_json_put_packet_pool(span_p, "rx_copybreak_packets",
+                                   &copybreak_stats.pool_stats);
+        (void)text_format_printf(span_p,
+                                 "\"rx_copybreak\":{\"copied\":%u,\"misses\":%u},",
+                                 copybreak_stats.copied_count,
+                                 copybreak_stats.misses_count);
+
+        uint32_t rx_shed_counts[NUM_NET_LAYER2_RX_SHED_CLASSES];
+
+        net_layer2_get_rx_shed_counts(rx_shed_counts);
+        (void)text_format_printf(span_p, "\"rx_shed\":{\"udp\":%u,\"other\":%u},",
+                                 rx_shed_counts[NET_LAYER2_RX_SHED_CLASS_UDP],
+                                 rx_shed_counts[NET_LAYER2_RX_SHED_CLASS_OTHER]);
+
+        static const char *const tx_class_names[NUM_NET_LAYER2_TX_CLASSES] = {
+            [NET_LAYER2_TX_CLASS_HIGH_PRIORITY] = "high_priority",
+            [NET_LAYER2_TX_CLASS_NORMAL] = "normal",
+            [NET_LAYER2_TX_CLASS_BULK] = "bulk",
+        };
+        struct net_layer2_tx_class_stats tx_class_stats[NUM_NET_LAYER2_TX_CLASSES];
+
+        net_layer2_end_point_get_tx_class_stats(&g_net_layer2.local_layer2_end_points[0],
+                                                tx_class_stats);
+        (void)text_format_printf(span_p, "\"tx_classes\":{");
+        for (uint_fast8_t i = 0; i < NUM_NET_LAYER2_TX_CLASSES; i ++) {
+            (void)text_format_printf(span_p,
+                                     "%s\"%s\":{\"sent\":%u,\"deferred\":%u,"
+                                     "\"queued\":%u,\"queued_max\":%u}",
+                                     i == 0 ? "" : ",", tx_class_names[i],
+                                     tx_class_stats[i].sent_count,
+                                     tx_class_stats[i].deferred_count,
+                                     tx_class_stats[i].queued_count,
+                                     tx_class_stats[i].queued_high_water_mark);
+        }
+
+        (void)text_format_printf(span_p, "},");
+    }
+
+    (void)text_format_printf(span_p, "\"mem_pools\":[");
+    for (const struct mem_pool *mem_pool_p = mem_pool_get_next(NULL);
+         mem_pool_p != NULL;
+         mem_pool_p = mem_pool_get_next(mem_pool_p)) {
+        struct mem_pool_stats mem_pool_stats;
+
+        mem_pool_get_stats(mem_pool_p, &mem_pool_stats);
+        (void)text_format_printf(span_p, "%s{\"name\":",
+                                 mem_pool_p == mem_pool_get_next(NULL) ? "" : ",");
+        stats_json_put_string(span_p, mem_pool_p->name_p);
+        (void)text_format_printf(span_p,
+                                 ",\"blocks\":%u,\"free\":%u,\"min_free\":%u,"
+                                 "\"alloc_failures\":%u}",
+                                 mem_pool_stats.num_blocks,
+                                 mem_pool_stats.num_free_blocks,
+                                 mem_pool_stats.min_free_blocks,
+                                 mem_pool_stats.alloc_failures_count);
+    }
+
+    (void)text_format_printf(span_p, "],\"tasks\":[");
+
+    struct rtos_task_cpu_stats cpu_stats;
 
-    g_heartbeat_led_color = color;
-    color_led_set(color);
+    for (unsigned int i = 0; rtos_get_task_cpu_stats(i, &cpu_stats); i++) {
+        uint32_t per_mille = 0;
 
-    restore_cpu_interrupts(old_primask);
+        if (cpu_stats.total_cpu_cycles != 0) {
+            per_mille = (uint32_t)((cpu_stats.cpu_cycles * 1000) /
+                                   cpu_stats.total_cpu_cycles);
+        }
+
+        (void)text_format_printf(span_p, "%s{\"name\":", i == 0 ? "" : ",");
+        stats_json_put_string(span_p, cpu_stats.name_p);
+        (void)text_format_printf(span_p, ",\"cpu_per_mille\":%u,\"max_stack_entries\":%u}",
+                                 per_mille,
+                                 cpu_stats.task_p != NULL ?
+                                    rtos_task_get_stack_usage(cpu_stats.task_p) : 0);
+    }
+
+    (void)text_format_printf(span_p, "],\"locks\":[");
+
+    struct rtos_mutex_stats mutex_stats;
+    bool first_mutex = true;
+
+    for (unsigned int i = 0; rtos_get_mutex_stats(i, &mutex_stats); i ++) {
+        if (mutex_stats.acquisitions == 0) {
+            continue;
+        }
+
+        (void)text_format_printf(span_p, "%s{\"name\":", first_mutex ? "" : ",");
+        stats_json_put_string(span_p, mutex_stats.name_p);
+        (void)text_format_printf(span_p,
+                                 ",\"acquisitions\":%u,\"contended\":%u,"
+                                 "\"priority_inversions\":%u,\"max_wait_us\":%u,"
+                                 "\"max_hold_us\":%u}",
+                                 mutex_stats.acquisitions, mutex_stats.contended,
+                                 mutex_stats.priority_inversions,
+                                 CPU_CLOCK_CYCLES_TO_MICROSECONDS(mutex_stats.max_wait_cycles),
+                                 CPU_CLOCK_CYCLES_TO_MICROSECONDS(mutex_stats.max_hold_cycles));
+        first_mutex = false;
+    }
+
+    (void)text_format_printf(span_p, "]}\n");
 }
 
 
 static struct net_layer4_end_point g_udp_server_end_point;
 
+static struct net_layer4_end_point g_remote_console_end_point;
+
+/**
+ * Header at the beginning of the datagrams of a UDP soak test, in network
+ * byte order (see 'udp_bench.pl soak')
+ */
+struct udp_soak_test_header {
+#   define UDP_SOAK_TEST_MAGIC  GEN_SIGNATURE('S', 'O', 'A', 'K')
+    uint32_t magic;
+
+    /**
+     * Sequence number of the datagram, starting at 0
+     */
+    uint32_t seq_num;
+
+    /**
+     * Sender's timestamp in microseconds
+     */
+    uint32_t timestamp_us;
+};
+
+/**
+ * Number of sequence numbers below the highest one received, for which
+ * duplicates and reordered datagrams are told apart
+ */
+#define UDP_SOAK_TEST_SEQ_WINDOW    32
+
+/**
+ * UDP soak test statistics. They are only updated by the UDP server task.
+ */
+static struct udp_soak_test {
+    /**
+     * Flag indicating if soak test datagrams are to be tracked
+     */
+    volatile bool enabled;
+
+    /**
+     * Flag set by the 'soak reset' command, for the UDP server task to
+     * reset the statistics before tracking the next datagram
+     */
+    volatile bool reset_requested;
+
+    /**
+     * Flag indicating if a soak test datagram has been received since the
+     * last reset
+     */
+    bool started;
+
+    uint32_t first_seq_num;
+    uint32_t highest_seq_num;
+
+    /**
+     * Bit i is set if sequence number (highest_seq_num - i) has been
+     * received
+     */
+    uint32_t seq_window;
+
+    /**
+     * Distinct datagrams received
+     */
+    uint32_t received_count;
+
+    uint32_t duplicate_count;
+    uint32_t reordered_count;
+
+    /**
+     * Arrival time and sender's timestamp of the last datagram received,
+     * in microseconds
+     */
+    uint32_t last_arrival_us;
+    uint32_t last_timestamp_us;
+
+    /**
+     * Inter-arrival jitter estimate (RFC 3550, section 6.4.1), in
+     * 1/16 microseconds
+     */
+    uint32_t jitter_x16_us;
+
+    /**
+     * Longest time between two consecutive datagrams, in microseconds
+     */
+    uint32_t max_gap_us;
+} g_udp_soak_test;
+
+
+/**
+ * Updates the soak test statistics with a received soak test datagram
+ */
+static void udp_soak_test_track(const struct udp_soak_test_header *header_p)
+{
+    struct udp_soak_test *const soak_p = &g_udp_soak_test;
+    uint32_t arrival_us = (uint32_t)(get_monotonic_ns() / 1000);
+    uint32_t seq_num = ntoh32(header_p->seq_num);
+    uint32_t timestamp_us = ntoh32(header_p->timestamp_us);
+
+    if (soak_p->reset_requested) {
+        soak_p->started = false;
+        soak_p->reset_requested = false;
+    }
+
+    if (!soak_p->started) {
+        soak_p->started = true;
+        soak_p->first_seq_num = seq_num;
+        soak_p->highest_seq_num = seq_num;
+        soak_p->seq_window = 1;
+        soak_p->received_count = 1;
+        soak_p->duplicate_count = 0;
+        soak_p->reordered_count = 0;
+        soak_p->jitter_x16_us = 0;
+        soak_p->max_gap_us = 0;
+        soak_p->last_arrival_us = arrival_us;
+        soak_p->last_timestamp_us = timestamp_us;
+        return;
+    }
+
+    int32_t distance = (int32_t)(seq_num - soak_p->highest_seq_num);
+
+    if (distance > 0) {
+        soak_p->seq_window = (distance < UDP_SOAK_TEST_SEQ_WINDOW) ?
+                                (soak_p->seq_window << distance) | 1 : 1;
+        soak_p->highest_seq_num = seq_num;
+    } else if (distance > -UDP_SOAK_TEST_SEQ_WINDOW) {
+        uint32_t bit_mask = BIT(-distance);
+
+        if (soak_p->seq_window & bit_mask) {
+            soak_p->duplicate_count ++;
+            return;
+        }
+
+        soak_p->seq_window |= bit_mask;
+        soak_p->reordered_count ++;
+    } else {
+        /*
+         * Too old to tell if it is a duplicate:
+         */
+        soak_p->reordered_count ++;
+    }
+
+    soak_p->received_count ++;
+
+    uint32_t gap_us = arrival_us - soak_p->last_arrival_us;
+    int32_t transit_delta_us = (int32_t)(gap_us -
+                                         (timestamp_us - soak_p->last_timestamp_us));
+
+    if (transit_delta_us < 0) {
+        transit_delta_us = -transit_delta_us;
+    }
+
+    soak_p->jitter_x16_us += transit_delta_us - (soak_p->jitter_x16_us + 8) / 16;
+    if (gap_us > soak_p->max_gap_us) {
+        soak_p->max_gap_us = gap_us;
+    }
+
+    soak_p->last_arrival_us = arrival_us;
+    soak_p->last_timestamp_us = timestamp_us;
+}
+
+
+/**
+ * Number of soak test datagrams lost so far: the ones in the range of
+ * sequence numbers received that have not been received
+ */
+static uint32_t udp_soak_test_get_lost_count(const struct udp_soak_test *soak_p)
+{
+    uint32_t expected_count = soak_p->highest_seq_num - soak_p->first_seq_num + 1;
+
+    return (expected_count > soak_p->received_count) ?
+                expected_count - soak_p->received_count : 0;
+}
+
+
+/**
+ * Sends the JSON stats record to the given UDP client. The record is
+ * formatted in the calling task's scratch arena.
+ *
+ * @param client_ip_addr_p  IPv4 address of the client
+ * @param client_port       UDP port of the client (big endian)
+ *
+ * @return 0, on success
+ * @return error code, on failure
+ */
+static error_t udp_server_send_stats_json(const struct ipv4_address *client_ip_addr_p,
+                                          uint16_t client_port)
+{
+    struct mem_arena *scratch_arena_p = rtos_task_get_scratch_arena();
+    mem_arena_mark_t mark = mem_arena_get_mark(scratch_arena_p);
+    char *record_buffer = mem_arena_alloc(scratch_arena_p, STATS_JSON_MAX_SIZE, 1);
+    struct format_span span;
+    error_t error;
+
+    if (record_buffer == NULL) {
+        return CAPTURE_ERROR("No memory for JSON stats record", STATS_JSON_MAX_SIZE, 0);
+    }
+
+    format_span_init(&span, record_buffer, STATS_JSON_MAX_SIZE, NULL, NULL);
+    stats_format_json(&span);
+    if (span.num_dropped != 0) {
+        error = CAPTURE_ERROR("JSON stats record too long", span.num_generated, 0);
+        goto exit;
+    }
+
+    error = net_layer4_send_large_udp_datagram_over_ipv4(&g_udp_server_end_point,
+                                                         client_ip_addr_p,
+                                                         client_port,
+                                                         record_buffer,
+                                                         span.length);
+exit:
+    mem_arena_reset_to_mark(scratch_arena_p, mark);
+    return error;
+}
+
+
+/**
+ * LED color commands accepted by the UDP server. They are only looked up,
+ * so they have no handlers. Entry i selects g_udp_led_colors[i].
+ */
+static const struct command_table_entry g_udp_led_color_commands[] = {
+    { .name = "red" },
+    { .name = "green" },
+    { .name = "blue" },
+    { .name = "yellow" },
+    { .name = "cyan" },
+    { .name = "magenta" },
+    { .name = "white" },
+};
+
+static const led_color_t g_udp_led_colors[] = {
+    LED_COLOR_RED,
+    LED_COLOR_GREEN,
+    LED_COLOR_BLUE,
+    LED_COLOR_YELLOW,
+    LED_COLOR_CYAN,
+    LED_COLOR_MAGENTA,
+    LED_COLOR_WHITE,
+};
+
+C_ASSERT(ARRAY_SIZE(g_udp_led_colors) == ARRAY_SIZE(g_udp_led_color_commands));
+
+static struct command_table g_udp_led_color_command_table;
+
+
 static void udp_server_task_func(void *arg)
 {
 #   define MY_UDP_SERVER_PORT    8887
@@ -155,7 +748,13 @@ static void udp_server_task_func(void *arg)
 
     D_ASSERT(arg == NULL);
 
-    struct network_packet *tx_packet_p = net_layer2_allocate_tx_packet(false);
+    mem_arena_init(&g_udp_server_scratch_arena, "UDP server scratch",
+                   g_udp_server_scratch_storage,
+                   sizeof g_udp_server_scratch_storage);
+    rtos_task_set_scratch_arena(&g_udp_server_task, &g_udp_server_scratch_arena);
+
+    struct network_packet *tx_packet_p =
+        net_layer2_allocate_tx_packet(NET_PACKET_DATA_BUFFER_SIZE, false);
 
     net_layer4_udp_end_point_init(&g_udp_server_end_point);
 
@@ -182,8 +781,8 @@ static void udp_server_task_func(void *arg)
                                                           &client_port,
                                                           &rx_packet_p);
         if (error != 0) {
-            console_printf("ERROR: receiving UDP datagram failed (error %#x)\n",
-                           error);
+            console_printf_non_blocking("ERROR: receiving UDP datagram failed (error %#x)\n",
+                                        error);
             goto exit;
         }
 
@@ -200,6 +799,44 @@ static void udp_server_task_func(void *arg)
          */
         net_recycle_rx_packet(rx_packet_p);
 
+        /*
+         * Soak test datagrams are echoed back unchanged, without being
+         * displayed, so that the console does not limit the datagram rate:
+         */
+        if (g_udp_soak_test.enabled &&
+            in_msg_size >= sizeof(struct udp_soak_test_header) &&
+            ntoh32(((struct udp_soak_test_header *)out_msg_p)->magic) ==
+                UDP_SOAK_TEST_MAGIC) {
+            udp_soak_test_track((struct udp_soak_test_header *)out_msg_p);
+            error = net_layer4_send_udp_datagram_over_ipv4(&g_udp_server_end_point,
+                                                           &client_ip_addr,
+                                                           client_port,
+                                                           tx_packet_p,
+                                                           in_msg_size);
+            if (error != 0) {
+                console_printf_non_blocking("ERROR: sending UDP datagram failed (error %#x)\n",
+                                            error);
+                goto exit;
+            }
+
+            continue;
+        }
+
+        /*
+         * A "stats" datagram is answered with the JSON stats record, so that
+         * a host script can collect it periodically:
+         */
+        if (in_msg_size == sizeof "stats" - 1 &&
+            memcmp(out_msg_p, "stats", in_msg_size) == 0) {
+            error = udp_server_send_stats_json(&client_ip_addr, client_port);
+            if (error != 0) {
+                console_printf_non_blocking("ERROR: sending UDP stats failed (error %#x)\n",
+                                            error);
+            }
+
+            continue;
+        }
+
         if (in_msg_size > 80) {
             /*
              * Truncate message text, to print the first 80 characters
@@ -216,26 +853,18 @@ static void udp_server_task_func(void *arg)
              * Process command in the message, if any:
              */
             const char *cmd_s = (char *)out_msg_p;
+            const struct command_table_entry *entry_p =
+                command_table_lookup(&g_udp_led_color_command_table, cmd_s);
 
-            if (strcmp(cmd_s, "red") == 0) {
-                heartbeat_set_led_color(LED_COLOR_RED);
-            } else if (strcmp(cmd_s, "green") == 0) {
-                heartbeat_set_led_color(LED_COLOR_GREEN);
-            } else if (strcmp(cmd_s, "blue") == 0) {
-                heartbeat_set_led_color(LED_COLOR_BLUE);
-            } else if (strcmp(cmd_s, "yellow") == 0) {
-                heartbeat_set_led_color(LED_COLOR_YELLOW);
-            } else if (strcmp(cmd_s, "cyan") == 0) {
-                heartbeat_set_led_color(LED_COLOR_CYAN);
-            } else if (strcmp(cmd_s, "magenta") == 0) {
-                heartbeat_set_led_color(LED_COLOR_MAGENTA);
-            } else if (strcmp(cmd_s, "white") == 0) {
-                heartbeat_set_led_color(LED_COLOR_WHITE);
+            if (entry_p != NULL) {
+                heartbeat_set_led_color(
+                    g_udp_led_colors[entry_p - g_udp_led_color_commands]);
             }
         }
 
         console_lock();
-        console_pos_printf(20, 27, 0, "%-80s", out_msg_p);
+        console_screen_pos_printf(20, 27, 0, "%-80s", out_msg_p);
+        console_screen_refresh();
         console_unlock();
 
         /*
@@ -264,8 +893,8 @@ static void udp_server_task_func(void *arg)
                                                        tx_packet_p,
                                                        in_msg_size + 1);
         if (error != 0) {
-            console_printf("ERROR: sending UDP datagram failed (error %#x)\n",
-                           error);
+            console_printf_non_blocking("ERROR: sending UDP datagram failed (error %#x)\n",
+                                        error);
             goto exit;
         }
     }
@@ -276,16 +905,14 @@ exit:
 }
 
 
-static void stats_update_link_state(bool *link_is_up_p)
+static void stats_update_link_state(const struct net_stats_snapshot *old_snapshot_p,
+                                    const struct net_stats_snapshot *new_snapshot_p)
 {
     led_color_t led_color;
     const char *link_state_s;
-    bool new_link_is_up =
-        net_layer2_end_point_link_is_up(&g_net_layer2.local_layer2_end_points[0]);
 
-    if (*link_is_up_p != new_link_is_up) {
-        *link_is_up_p = new_link_is_up;
-        if (new_link_is_up) {
+    if (old_snapshot_p->link_is_up != new_snapshot_p->link_is_up) {
+        if (new_snapshot_p->link_is_up) {
             link_state_s = "up  ";
             led_color = LED_COLOR_GREEN;
         } else {
@@ -293,182 +920,321 @@ static void stats_update_link_state(bool *link_is_up_p)
             led_color = LED_COLOR_RED;
         }
 
-        console_pos_puts(5, 15, 0, link_state_s);
+        console_screen_pos_puts(5, 15, 0, link_state_s);
         heartbeat_set_led_color(led_color);
     }
 }
 
 
-static void stats_update_ipv4_addr(
-    struct ipv4_address *ipv4_addr_p,
-    struct ipv4_address *subnet_mask_p)
+static void stats_update_ipv4_addr(const struct net_stats_snapshot *old_snapshot_p,
+                                   const struct net_stats_snapshot *new_snapshot_p)
 {
-    struct ipv4_address new_ipv4_addr;
-    struct ipv4_address new_subnet_mask;
-
-    net_layer3_get_local_ipv4_address(&new_ipv4_addr, &new_subnet_mask);
-    if (ipv4_addr_p->value != new_ipv4_addr.value ||
-        subnet_mask_p->value != new_subnet_mask.value) {
-        ipv4_addr_p->value = new_ipv4_addr.value;
-        subnet_mask_p->value = new_subnet_mask.value;
-
-        console_pos_printf(8, 14, 0, "%u.%u.%u.%u\n",
-                           new_ipv4_addr.bytes[0],
-                           new_ipv4_addr.bytes[1],
-                           new_ipv4_addr.bytes[2],
-                           new_ipv4_addr.bytes[3]);
-
-        console_pos_printf(8, 48, 0, "%u.%u.%u.%u\n",
-                           new_subnet_mask.bytes[0],
-                           new_subnet_mask.bytes[1],
-                           new_subnet_mask.bytes[2],
-                           new_subnet_mask.bytes[3]);
+    const struct ipv4_address *const ipv4_addr_p = &new_snapshot_p->local_ipv4_addr;
+    const struct ipv4_address *const subnet_mask_p = &new_snapshot_p->subnet_mask;
+
+    if (old_snapshot_p->local_ipv4_addr.value != ipv4_addr_p->value ||
+        old_snapshot_p->subnet_mask.value != subnet_mask_p->value) {
+        console_screen_pos_printf(8, 14, 0, "%u.%u.%u.%u\n",
+                                  ipv4_addr_p->bytes[0],
+                                  ipv4_addr_p->bytes[1],
+                                  ipv4_addr_p->bytes[2],
+                                  ipv4_addr_p->bytes[3]);
+
+        console_screen_pos_printf(8, 48, 0, "%u.%u.%u.%u\n",
+                                  subnet_mask_p->bytes[0],
+                                  subnet_mask_p->bytes[1],
+                                  subnet_mask_p->bytes[2],
+                                  subnet_mask_p->bytes[3]);
     }
 }
 
 
-static void stats_update_layer2_packet_count(
-    uint32_t *rx_packet_accepted_count_p,
-    uint32_t *rx_packet_dropped_count_p,
-    uint32_t *tx_packet_count_p)
+/**
+ * Updates the packet counters of a networking layer in the network stats
+ * display, redrawing only the counters that changed
+ *
+ * @param line              screen line of the layer's counters
+ * @param old_counts_p      counters currently displayed
+ * @param new_counts_p      counters to display
+ */
+static void stats_update_packet_counts(uint8_t line,
+                                       const struct net_layer_packet_counts *old_counts_p,
+                                       const struct net_layer_packet_counts *new_counts_p)
 {
-    uint32_t new_rx_packet_accepted_count = g_net_layer2.rx_packets_accepted_count;
-    uint32_t new_rx_packet_dropped_count = g_net_layer2.rx_packets_dropped_count;
-    uint32_t new_tx_packet_count = g_net_layer2.sent_packets_count;
-
-    if (*rx_packet_accepted_count_p != new_rx_packet_accepted_count) {
-        *rx_packet_accepted_count_p = new_rx_packet_accepted_count;
-        console_pos_printf(11, 45, 0, "%10u", new_rx_packet_accepted_count);
+    if (old_counts_p->rx_packets_accepted_count != new_counts_p->rx_packets_accepted_count) {
+        console_screen_pos_printf(line, 45, 0, "%10u",
+                                  new_counts_p->rx_packets_accepted_count);
     }
 
-    if (*rx_packet_dropped_count_p != new_rx_packet_dropped_count) {
-        *rx_packet_dropped_count_p = new_rx_packet_dropped_count;
-        console_pos_printf(11, 101, 0, "%10u", new_rx_packet_dropped_count);
+    if (old_counts_p->rx_packets_dropped_count != new_counts_p->rx_packets_dropped_count) {
+        console_screen_pos_printf(line, 101, 0, "%10u",
+                                  new_counts_p->rx_packets_dropped_count);
     }
 
-    if (*tx_packet_count_p != new_tx_packet_count) {
-        *tx_packet_count_p = new_tx_packet_count;
-        console_pos_printf(11, 144, 0, "%10u", new_tx_packet_count);
+    if (old_counts_p->sent_packets_count != new_counts_p->sent_packets_count) {
+        console_screen_pos_printf(line, 144, 0, "%10u",
+                                  new_counts_p->sent_packets_count);
     }
 }
 
 
-static void stats_update_layer3_ipv4_packet_count(
-    uint32_t *rx_packet_accepted_count_p,
-    uint32_t *rx_packet_dropped_count_p,
-    uint32_t *tx_packet_count_p)
+static void stats_update_udp_soak_test(void)
 {
-    uint32_t new_rx_packet_accepted_count = g_net_layer3.ipv4.rx_packets_accepted_count;
-    uint32_t new_rx_packet_dropped_count = g_net_layer3.ipv4.rx_packets_dropped_count;
-    uint32_t new_tx_packet_count = g_net_layer3.ipv4.sent_packets_count;
+    const struct udp_soak_test *const soak_p = &g_udp_soak_test;
 
-    if (*rx_packet_accepted_count_p != new_rx_packet_accepted_count) {
-        *rx_packet_accepted_count_p = new_rx_packet_accepted_count;
-        console_pos_printf(14, 45, 0, "%10u", new_rx_packet_accepted_count);
+    if (!soak_p->enabled || !soak_p->started) {
+        return;
     }
 
-    if (*rx_packet_dropped_count_p != new_rx_packet_dropped_count) {
-        *rx_packet_dropped_count_p = new_rx_packet_dropped_count;
-        console_pos_printf(14, 101, 0, "%10u", new_rx_packet_dropped_count);
+    console_screen_pos_printf(23, 27, 0,
+                              "rcvd %10u lost %8u reord %8u dup %8u jitter %6u us max gap %8u us",
+                              soak_p->received_count,
+                              udp_soak_test_get_lost_count(soak_p),
+                              soak_p->reordered_count, soak_p->duplicate_count,
+                              soak_p->jitter_x16_us / 16, soak_p->max_gap_us);
+}
+
+
+/**
+ * Sends a network stats telemetry record over the telemetry serial channel,
+ * as a line of comma-separated values. If the telemetry channel is backed
+ * up, the record is dropped, rather than blocking the stats task.
+ */
+static void send_network_telemetry(const struct net_stats_snapshot *snapshot_p)
+{
+    struct mem_arena *scratch_arena_p = rtos_task_get_scratch_arena();
+    mem_arena_mark_t mark = mem_arena_get_mark(scratch_arena_p);
+    char *record_buffer = mem_arena_alloc(scratch_arena_p,
+                                          TELEMETRY_RECORD_MAX_SIZE, 1);
+    struct format_span span;
+
+    if (record_buffer == NULL) {
+        return;
     }
 
-    if (*tx_packet_count_p != new_tx_packet_count) {
-        *tx_packet_count_p = new_tx_packet_count;
-        console_pos_printf(14, 144, 0, "%10u", new_tx_packet_count);
+    format_span_init(&span, record_buffer, TELEMETRY_RECORD_MAX_SIZE, NULL, NULL);
+    (void)text_format_printf(&span, "%u,%u,%u,%u,%u,%u,%u\r\n",
+                             RTOS_TICKS_TO_MILLISECONDS(rtos_get_ticks_since_boot()),
+                             snapshot_p->layer2.rx_packets_accepted_count,
+                             snapshot_p->layer2.sent_packets_count,
+                             snapshot_p->ipv4.rx_packets_accepted_count,
+                             snapshot_p->ipv4.sent_packets_count,
+                             snapshot_p->udp.rx_packets_accepted_count,
+                             snapshot_p->udp.sent_packets_count);
+    if (span.num_dropped == 0) {
+        (void)serial_channel_write_non_blocking(&g_telemetry_channel,
+                                                record_buffer, span.length);
     }
+
+    mem_arena_reset_to_mark(scratch_arena_p, mark);
+}
+
+
+/**
+ * Updates the Ethernet MAC throughput from the MAC's hardware counters
+ *
+ * @param last_mac_stats_p  MAC counters read by the previous call
+ * @param period_ms         milliseconds since the previous call
+ */
+static void stats_update_ethernet_throughput(
+    struct ethernet_mac_stats *last_mac_stats_p,
+    uint32_t period_ms)
+{
+    struct ethernet_mac_stats mac_stats;
+    struct ethernet_mac_stats delta_mac_stats;
+
+    ethernet_mac_get_stats(g_net_layer2.local_layer2_end_points[0].ethernet_mac_p,
+                           &mac_stats);
+    ethernet_mac_stats_delta(last_mac_stats_p, &mac_stats, &delta_mac_stats);
+    *last_mac_stats_p = mac_stats;
+
+    g_ethernet_rx_bytes_per_sec =
+        (uint32_t)(((uint64_t)delta_mac_stats.rx_octets * 1000) / period_ms);
+    g_ethernet_tx_bytes_per_sec =
+        (uint32_t)(((uint64_t)delta_mac_stats.tx_octets * 1000) / period_ms);
 }
 
 
-static void stats_update_layer4_udp_packet_count(
-    uint32_t *rx_packet_accepted_count_p,
-    uint32_t *rx_packet_dropped_count_p,
-    uint32_t *tx_packet_count_p)
+/**
+ * Updates the CPU utilization and the CPU cost per packet, between two
+ * snapshots of the networking stats. Busy cycles are all the cycles not
+ * spent asleep in WFI (see struct cpu_idle_stats), whether they were spent
+ * handling packets or not, so the cost per packet is an upper bound, which
+ * is tight only when the node is mostly doing networking.
+ *
+ * @param last_sleep_cycles_p   sleep cycles read by the previous call
+ * @param old_snapshot_p        snapshot taken by the previous call
+ * @param new_snapshot_p        snapshot just taken
+ */
+static void stats_update_cpu_accounting(
+    uint64_t *last_sleep_cycles_p,
+    const struct net_stats_snapshot *old_snapshot_p,
+    const struct net_stats_snapshot *new_snapshot_p)
 {
-    uint32_t new_rx_packet_accepted_count = g_net_layer4.udp.rx_packets_accepted_count;
-    uint32_t new_rx_packet_dropped_count = g_net_layer4.udp.rx_packets_dropped_count;
-    uint32_t new_tx_packet_count = g_net_layer4.udp.sent_packets_over_ipv4_count;
+    struct cpu_idle_stats cpu_idle_stats;
+    uint64_t elapsed_cycles = new_snapshot_p->timestamp_cycles -
+                              old_snapshot_p->timestamp_cycles;
+
+    cpu_idle_get_stats(&cpu_idle_stats);
+    uint64_t sleep_cycles = cpu_idle_stats.sleep_cycles - *last_sleep_cycles_p;
 
-    if (*rx_packet_accepted_count_p != new_rx_packet_accepted_count) {
-        *rx_packet_accepted_count_p = new_rx_packet_accepted_count;
-        console_pos_printf(17, 45, 0, "%10u", new_rx_packet_accepted_count);
+    *last_sleep_cycles_p = cpu_idle_stats.sleep_cycles;
+    if (elapsed_cycles == 0) {
+        return;
     }
 
-    if (*rx_packet_dropped_count_p != new_rx_packet_dropped_count) {
-        *rx_packet_dropped_count_p = new_rx_packet_dropped_count;
-        console_pos_printf(17, 101, 0, "%10u", new_rx_packet_dropped_count);
+    /*
+     * The idle stats are read after the snapshot, so they may include a
+     * little sleep past its timestamp:
+     */
+    if (sleep_cycles > elapsed_cycles) {
+        sleep_cycles = elapsed_cycles;
     }
 
-    if (*tx_packet_count_p != new_tx_packet_count) {
-        *tx_packet_count_p = new_tx_packet_count;
-        console_pos_printf(17, 144, 0, "%10u", new_tx_packet_count);
+    uint64_t busy_cycles = elapsed_cycles - sleep_cycles;
+    uint32_t rx_packets =
+        (new_snapshot_p->layer2.rx_packets_accepted_count +
+         new_snapshot_p->layer2.rx_packets_dropped_count) -
+        (old_snapshot_p->layer2.rx_packets_accepted_count +
+         old_snapshot_p->layer2.rx_packets_dropped_count);
+    uint32_t tx_packets = new_snapshot_p->layer2.sent_packets_count -
+                          old_snapshot_p->layer2.sent_packets_count;
+    uint64_t elapsed_us = CPU_CLOCK_CYCLES_TO_MICROSECONDS(elapsed_cycles);
+
+    g_cpu_busy_per_10k = (uint32_t)((busy_cycles * 10000) / elapsed_cycles);
+    if (elapsed_us != 0) {
+        g_layer2_rx_packets_per_sec =
+            (uint32_t)(((uint64_t)rx_packets * 1000000) / elapsed_us);
+        g_layer2_tx_packets_per_sec =
+            (uint32_t)(((uint64_t)tx_packets * 1000000) / elapsed_us);
     }
+
+    g_cpu_busy_cycles_per_packet =
+        (rx_packets + tx_packets == 0) ?
+            0 : (uint32_t)(busy_cycles / ((uint64_t)rx_packets + tx_packets));
 }
 
 
-static void network_stats_task_func(void *arg)
+/**
+ * State kept by the network stats display across runs of
+ * g_network_stats_work_item
+ */
+static struct network_stats_state {
+    bool initialized;
+
+    /**
+     * Display refresh period, in multiples of NETWORK_STATS_POLLING_PERIOD_MS
+     */
+    uint32_t refresh_polling_periods;
+
+    /**
+     * Polling periods elapsed since the last display refresh
+     */
+    uint32_t elapsed_polling_periods;
+
+    /**
+     * Stats currently displayed
+     */
+    struct net_stats_snapshot snapshot;
+
+    struct ethernet_mac_stats last_mac_stats;
+
+    /**
+     * CPU idle governor's sleep cycles when the displayed stats were taken
+     */
+    uint64_t last_sleep_cycles;
+} g_network_stats_state = {
+    .refresh_polling_periods = 1,
+};
+
+
+/**
+ * Draws the static parts of the network stats display
+ */
+static void network_stats_display_init(struct network_stats_state *state_p)
 {
-    bool link_is_up = false;
     struct ethernet_mac_address local_mac_addr;
-    struct ipv4_address ipv4_addr;
-    struct ipv4_address subnet_mask;
-
-    D_ASSERT(arg == NULL);
+    struct ipv4_address *const ipv4_addr_p = &state_p->snapshot.local_ipv4_addr;
+    struct ipv4_address *const subnet_mask_p = &state_p->snapshot.subnet_mask;
 
+    memset(&state_p->snapshot, 0, sizeof state_p->snapshot);
+    memset(&state_p->last_mac_stats, 0, sizeof state_p->last_mac_stats);
     console_lock();
     init_network_stats_display();
-    console_pos_puts(5, 15, 0, "down");
+    console_screen_pos_puts(5, 15, 0, "down");
     heartbeat_set_led_color(LED_COLOR_RED);
 
     net_layer2_get_mac_addr(&g_net_layer2.local_layer2_end_points[0], &local_mac_addr);
-    console_pos_printf(5, 42, 0, "%02x:%02x:%02x:%02x:%02x:%02x\n",
-                       local_mac_addr.bytes[0],
-                       local_mac_addr.bytes[1],
-                       local_mac_addr.bytes[2],
-                       local_mac_addr.bytes[3],
-                       local_mac_addr.bytes[4],
-                       local_mac_addr.bytes[5]);
-
-    net_layer3_get_local_ipv4_address(&ipv4_addr, &subnet_mask);
-    console_pos_printf(8, 14, 0, "%u.%u.%u.%u\n",
-                       ipv4_addr.bytes[0],
-                       ipv4_addr.bytes[1],
-                       ipv4_addr.bytes[2],
-                       ipv4_addr.bytes[3]);
-
-    console_pos_printf(8, 48, 0, "%u.%u.%u.%u\n",
-                       subnet_mask.bytes[0],
-                       subnet_mask.bytes[1],
-                       subnet_mask.bytes[2],
-                       subnet_mask.bytes[3]);
+    console_screen_pos_printf(5, 42, 0, "%02x:%02x:%02x:%02x:%02x:%02x\n",
+                              local_mac_addr.bytes[0],
+                              local_mac_addr.bytes[1],
+                              local_mac_addr.bytes[2],
+                              local_mac_addr.bytes[3],
+                              local_mac_addr.bytes[4],
+                              local_mac_addr.bytes[5]);
+
+    net_layer3_get_local_ipv4_address(ipv4_addr_p, subnet_mask_p);
+    console_screen_pos_printf(8, 14, 0, "%u.%u.%u.%u\n",
+                              ipv4_addr_p->bytes[0],
+                              ipv4_addr_p->bytes[1],
+                              ipv4_addr_p->bytes[2],
+                              ipv4_addr_p->bytes[3]);
+
+    console_screen_pos_printf(8, 48, 0, "%u.%u.%u.%u\n",
+                              subnet_mask_p->bytes[0],
+                              subnet_mask_p->bytes[1],
+                              subnet_mask_p->bytes[2],
+                              subnet_mask_p->bytes[3]);
+    console_screen_refresh();
     console_unlock();
+    state_p->initialized = true;
+}
 
-    uint32_t layer2_rx_packet_accepted_count = 0;
-    uint32_t layer2_rx_packet_dropped_count = 0;
-    uint32_t layer2_tx_packet_count = 0;
-    uint32_t ipv4_rx_packet_accepted_count = 0;
-    uint32_t ipv4_rx_packet_dropped_count = 0;
-    uint32_t ipv4_tx_packet_count = 0;
-    uint32_t udp_rx_packet_accepted_count = 0;
-    uint32_t udp_rx_packet_dropped_count = 0;
-    uint32_t udp_tx_packet_count = 0;
 
-    for ( ; ; ) {
-        console_lock();
-        stats_update_link_state(&link_is_up);
-        stats_update_ipv4_addr(&ipv4_addr, &subnet_mask);
-        stats_update_layer2_packet_count(&layer2_rx_packet_accepted_count,
-                                         &layer2_rx_packet_dropped_count,
-                                         &layer2_tx_packet_count);
-        stats_update_layer3_ipv4_packet_count(&ipv4_rx_packet_accepted_count,
-                                              &ipv4_rx_packet_dropped_count,
-                                              &ipv4_tx_packet_count);
-        stats_update_layer4_udp_packet_count(&udp_rx_packet_accepted_count,
-                                             &udp_rx_packet_dropped_count,
-                                             &udp_tx_packet_count);
-        console_unlock();
-
-        rtos_task_delay(NETWORK_STATS_POLLING_PERIOD_MS);
+/**
+ * Network stats display work item function. It runs on
+ * g_housekeeping_work_queue every NETWORK_STATS_POLLING_PERIOD_MS, and
+ * refreshes the display every state_p->refresh_polling_periods runs.
+ *
+ * The display is rendered from one snapshot of the stats of all networking
+ * layers (see networking_get_stats_snapshot()), taken before the console
+ * lock is acquired, and the lock is acquired only once per refresh. So, the
+ * displayed counters are consistent with each other, and the display
+ * overhead is bounded by the refresh period, regardless of the packet rate.
+ */
+static void network_stats_work_func(struct work_item *work_item_p, void *arg)
+{
+    struct network_stats_state *state_p = arg;
+    struct net_stats_snapshot new_snapshot;
+
+    D_ASSERT(work_item_p == &g_network_stats_work_item);
+    state_p->elapsed_polling_periods ++;
+    if (!state_p->initialized) {
+        network_stats_display_init(state_p);
+    } else if (state_p->elapsed_polling_periods < state_p->refresh_polling_periods) {
+        return;
     }
+
+    stats_update_ethernet_throughput(&state_p->last_mac_stats,
+                                     state_p->elapsed_polling_periods *
+                                        NETWORK_STATS_POLLING_PERIOD_MS);
+    state_p->elapsed_polling_periods = 0;
+    networking_get_stats_snapshot(&new_snapshot);
+    stats_update_cpu_accounting(&state_p->last_sleep_cycles,
+                                &state_p->snapshot, &new_snapshot);
+
+    console_lock();
+    stats_update_link_state(&state_p->snapshot, &new_snapshot);
+    stats_update_ipv4_addr(&state_p->snapshot, &new_snapshot);
+    stats_update_packet_counts(11, &state_p->snapshot.layer2, &new_snapshot.layer2);
+    stats_update_packet_counts(14, &state_p->snapshot.ipv4, &new_snapshot.ipv4);
+    stats_update_packet_counts(17, &state_p->snapshot.udp, &new_snapshot.udp);
+    stats_update_udp_soak_test();
+    console_screen_refresh();
+    console_unlock();
+
+    state_p->snapshot = new_snapshot;
+    send_network_telemetry(&new_snapshot);
 }
 
 
@@ -478,13 +1244,40 @@ static void cmd_print_help(void)
         "Available commands are:\n"
         "\thang - Cause an artificial hang\n"
         "\treset - Reset microcontroller\n"
-        "\tstats (or st) - prints stats\n"
-        "\tlog <log name: info, error, debug> - Dumps the given runtime log\n"
+        "\tstats (or st) [json] - prints stats (as a one-line JSON object)\n"
+        "\tstacks - prints the stack high water mark of each task\n"
+        "\tlog <log name: info, error, debug, binary> - Dumps the given runtime log\n"
+        "\tlog <log name: info, error, debug> since <sequence number> - Dumps the log entries from the given sequence number on\n"
+        "\tlog <log name: info, error, debug> follow [<seconds>] - Prints new log entries as they are added\n"
+        "\tlog crash - Dumps the last crash record and the crash dumps in flash\n"
+        "\tlog export [<collector IPv4 address or host name> [<UDP port>] | off] - Exports the runtime logs over UDP\n"
         "\tset ip4 addr <IPv4 address>/<subnet prefix>\n"
         "\tset trace <net, layer2, layer3 or layer4> <on or off>\n"
+        "\ttrace rec <on or off> - Starts or stops the event trace recorder\n"
+        "\ttrace dump - Dumps the event trace (see scripts/trace_to_timeline.pl)\n"
+        "\tcapture on [ethertype <hex EtherType> | port <TCP/UDP port>] - Starts capturing Ethernet frames\n"
+        "\tcapture <off or dump> - Stops capturing or dumps the captured frames (see scripts/capture_to_pcap.pl)\n"
         "\tset loopback <on or off>\n"
+        "\tset promiscuous <on or off>\n"
+        "\tset stats refresh <milliseconds> - Sets the refresh period of the network stats display\n"
         "\tget ip4 addr\n"
-        "\tping <IPv4 address>\n"
+        "\tping <IPv4 address or host name>\n"
+        "\tsntp [<server IPv4 address or host name> [hw] | off] - Synchronizes the wall-clock time with an SNTP server\n"
+        "\tbeacon [<multicast group IPv4 address> [<UDP port> [<period ms>]] | off] - Sends periodic telemetry beacons to a multicast group\n"
+        "\tdns [server <IPv4 address> | <host name>] - Sets the DNS server, resolves a host name, or prints the DNS resolver stats\n"
+        "\tperf [reset] - Dumps (or resets) the performance probes\n"
+        "\tperf printf - Compares the cycles taken by the KSDK and the in-tree printf formatters\n"
+        "\tperf crc - Compares the cycles taken by the software and hardware CRC-32s\n"
+        "\tperf memcpy - Compares the cycles taken by newlib and in-tree memcpy/memset\n"
+        "\tperf flash - Compares the NOR flash programming rates of program-phrase and program-section commands\n"
+        "\tperf irq - Dumps interrupt latency and ISR duration histograms\n"
+        "\tlocks [reset] - Dumps (or resets) the mutex contention statistics\n"
+        "\tprof <on, off, reset or dump> - Controls the sampling profiler (see scripts/profile_to_flamegraph.pl)\n"
+        "\tbench udp <tx, rx or rtt> <peer IPv4 address> <datagram size> <count> - Runs a UDP benchmark against scripts/udp_bench.pl\n"
+        "\tbench ping <peer IPv4 address> <count> <interval ms> [<max outstanding>] - Runs a ping flood\n"
+        "\tbench inject <arp,icmp,udp,junk or all> <count> <rate pps> - Injects synthetic Rx frames (rate 0: no limit)\n"
+        "\tsoak <on, off or reset> - Tracks loss, reordering and jitter of UDP server soak test datagrams (see scripts/udp_bench.pl)\n"
+        "\tbench micro - Measures the CPU cycles per call of building-block primitives\n"
         "\thelp (or h) - prints this message\n";
 
     D_ASSERT(console_is_locked());
@@ -516,6 +1309,133 @@ static void cmd_reset(void)
 /**
  * Prints stats
  */
+static void print_packet_pool_stats(const char *pool_name_p,
+                                    const struct net_packet_pool_stats *stats_p)
+{
+    console_printf("%s: %u total, %u free, %u in transit, %u queued, "
+                   "%u held by app, %u max in use\n",
+                   pool_name_p, stats_p->total_packets, stats_p->free_packets,
+                   stats_p->in_transit_packets, stats_p->queued_packets,
+                   stats_p->held_by_app_packets, stats_p->in_use_high_water_mark);
+}
+
+
+static void print_held_packet(const struct network_packet *packet_p,
+                              uint32_t hold_time_ms,
+                              void *arg)
+{
+    struct rtos_task *owner_task_p = packet_p->owner_task_p;
+
+    console_printf("%s packet %#x held for %u ms by %s (state flags: %#x)\n",
+                   packet_p->signature == NET_TX_PACKET_SIGNATURE ? "Tx" : "Rx",
+                   packet_p, hold_time_ms,
+                   owner_task_p != NULL ? owner_task_p->tsk_name_p : "ISR",
+                   packet_p->state_flags);
+}
+
+
+/**
+ * Prints the statistics of the networking stack
+ */
+static void print_networking_stats(void)
+{
+    struct ethernet_mac_address local_mac_addr;
+    struct ipv4_address local_ipv4_addr;
+    struct ipv4_address ipv4_subnet_mask;
+
+    net_layer2_get_mac_addr(&g_net_layer2.local_layer2_end_points[0], &local_mac_addr);
+    console_printf("Local Ethernet MAC address: %x:%x:%x:%x:%x:%x\n",
+                   local_mac_addr.bytes[0],
+                   local_mac_addr.bytes[1],
+                   local_mac_addr.bytes[2],
+                   local_mac_addr.bytes[3],
+                   local_mac_addr.bytes[4],
+                   local_mac_addr.bytes[5]);
+
+    net_layer3_get_local_ipv4_address(&local_ipv4_addr, &ipv4_subnet_mask);
+    console_printf("Local IPv4 address: %u.%u.%u.%u (subnet mask: %u.%u.%u.%u)\n",
+                   local_ipv4_addr.bytes[0],
+                   local_ipv4_addr.bytes[1],
+                   local_ipv4_addr.bytes[2],
+                   local_ipv4_addr.bytes[3],
+                   ipv4_subnet_mask.bytes[0],
+                   ipv4_subnet_mask.bytes[1],
+                   ipv4_subnet_mask.bytes[2],
+                   ipv4_subnet_mask.bytes[3]);
+
+    bool ethernet_link =
+        net_layer2_end_point_link_is_up(&g_net_layer2.local_layer2_end_points[0]);
+
+    console_printf("Ethernet link state: %s (%u link changes)\n",
+                   ethernet_link ? "up" : "down",
+                   g_net_layer2.local_layer2_end_points[0].link_change_count);
+
+    struct ethernet_mac_stats mac_stats;
+
+    ethernet_mac_get_stats(g_net_layer2.local_layer2_end_points[0].ethernet_mac_p,
+                           &mac_stats);
+    console_printf("Ethernet Rx: %u frames, %u bytes, %u bytes/s, "
+                   "%u CRC errors, %u overruns, %u drops\n",
+                   mac_stats.rx_frames, mac_stats.rx_octets,
+                   g_ethernet_rx_bytes_per_sec, mac_stats.rx_crc_errors,
+                   mac_stats.rx_overruns, mac_stats.rx_drops);
+    console_printf("Ethernet Tx: %u frames, %u bytes, %u bytes/s, "
+                   "%u collisions, %u collision errors, %u underruns\n",
+                   mac_stats.tx_frames, mac_stats.tx_octets,
+                   g_ethernet_tx_bytes_per_sec, mac_stats.tx_collisions,
+                   mac_stats.tx_collision_errors, mac_stats.tx_underruns);
+
+    struct net_packet_pool_stats pool_stats;
+
+    net_layer2_get_tx_packet_pool_stats(&pool_stats);
+    print_packet_pool_stats("Tx packets", &pool_stats);
+    net_layer2_end_point_get_rx_packet_pool_stats(&g_net_layer2.local_layer2_end_points[0],
+                                                  &pool_stats);
+    print_packet_pool_stats("Rx packets", &pool_stats);
+
+    struct net_layer2_rx_copybreak_stats copybreak_stats;
+
+    net_layer2_end_point_get_rx_copybreak_stats(&g_net_layer2.local_layer2_end_points[0],
+                                                &copybreak_stats);
+    print_packet_pool_stats("Rx copybreak packets", &copybreak_stats.pool_stats);
+    console_printf("Rx frames copied (copybreak): %u, not copied (no free packet): %u\n",
+                   copybreak_stats.copied_count, copybreak_stats.misses_count);
+
+    uint32_t rx_shed_counts[NUM_NET_LAYER2_RX_SHED_CLASSES];
+
+    net_layer2_get_rx_shed_counts(rx_shed_counts);
+    console_printf("Rx frames shed under overload: %u UDP, %u other\n",
+                   rx_shed_counts[NET_LAYER2_RX_SHED_CLASS_UDP],
+                   rx_shed_counts[NET_LAYER2_RX_SHED_CLASS_OTHER]);
+
+    struct net_layer2_tx_class_stats tx_class_stats[NUM_NET_LAYER2_TX_CLASSES];
+
+    net_layer2_end_point_get_tx_class_stats(&g_net_layer2.local_layer2_end_points[0],
+                                            tx_class_stats);
+    console_printf("Tx frames sent (deferred, max queued): "
+                   "high priority %u (%u, %u), normal %u (%u, %u), bulk %u (%u, %u)\n",
+                   tx_class_stats[NET_LAYER2_TX_CLASS_HIGH_PRIORITY].sent_count,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_HIGH_PRIORITY].deferred_count,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_HIGH_PRIORITY].queued_high_water_mark,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_NORMAL].sent_count,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_NORMAL].deferred_count,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_NORMAL].queued_high_water_mark,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_BULK].sent_count,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_BULK].deferred_count,
+                   tx_class_stats[NET_LAYER2_TX_CLASS_BULK].queued_high_water_mark);
+
+    uint_fast16_t num_held_packets =
+        net_layer2_find_packets_held_too_long(NET_LAYER2_PACKET_HELD_TOO_LONG_MS,
+                                              print_held_packet,
+                                              NULL);
+
+    if (num_held_packets != 0) {
+        console_printf("%u packets held for more than %u ms\n",
+                       num_held_packets, NET_LAYER2_PACKET_HELD_TOO_LONG_MS);
+    }
+}
+
+
 static void cmd_print_stats(void)
 {
     static const char *const reset_cause_strings[] = {
@@ -532,17 +1452,30 @@ static void cmd_print_stats(void)
     uint32_t max_time_us;
     uintptr_t code_addr;
     enum cpu_reset_causes reset_cause;
-    struct ethernet_mac_address local_mac_addr;
-    struct ipv4_address local_ipv4_addr;
-    struct ipv4_address ipv4_subnet_mask;
 
     D_ASSERT(console_is_locked());
     console_printf("Elapsed time since last boot: %u s\n", rtos_get_time_since_boot());
     console_printf("Startup time: %u us\n", get_starup_time_us());
+
+    const char *boot_phase_name_p;
+    uint32_t boot_phase_time_us;
+
+    for (uint_fast8_t i = 0;
+         get_boot_phase_time_us(i, &boot_phase_name_p, &boot_phase_time_us);
+         i ++) {
+        console_printf("    %-40s %8u us\n", boot_phase_name_p, boot_phase_time_us);
+    }
+
     get_max_interrupts_disabled_stats_us(&max_time_us, &code_addr);
     console_printf("Maximum interrupts disabled time: %u us (in code near address %#x)\n",
                    max_time_us, code_addr);
     console_printf("Reset count: %u\n", read_cpu_reset_counter());
+    console_printf("Console output bytes dropped: %u\n",
+                   console_get_output_bytes_dropped());
+    console_printf("Command frames dropped: %u\n",
+                   command_line_get_frames_dropped());
+    console_printf("Telemetry channel bytes dropped: %u\n",
+                   serial_channel_get_output_bytes_dropped(&g_telemetry_channel));
     reset_cause = find_cpu_reset_cause();
     D_ASSERT(reset_cause != INVALID_RESET_CAUSE &&
              reset_cause < ARRAY_SIZE(reset_cause_strings));
@@ -559,6 +1492,14 @@ static void cmd_print_stats(void)
                        "                  Signaled liveness events mask: %#x\n",
                        old_expected_liveness_events,
                        old_signaled_liveness_events);
+
+        const char *starved_heartbeat_name_p =
+            watchdog_get_before_reset_starved_heartbeat();
+
+        if (starved_heartbeat_name_p != NULL) {
+            console_printf("                  Starved heartbeat: %s\n",
+                           starved_heartbeat_name_p);
+        }
     }
 
     console_printf("Flash used: %u bytes\n", get_flash_used());
@@ -566,31 +1507,113 @@ static void cmd_print_stats(void)
     console_printf("CPU core clock frequency: %u MHz\n", CLOCK_SYS_GetCoreClockFreq() / 1000000u);
     console_printf("System clock frequency: %u MHz\n", CLOCK_SYS_GetSystemClockFreq() / 1000000u);
     console_printf("Bus clock frequency: %u MHz\n", CLOCK_SYS_GetBusClockFreq() / 1000000u);
+    console_printf("Flash clock frequency: %u MHz\n", CLOCK_SYS_GetFlashClockFreq() / 1000000u);
+
+    for (uint_fast8_t i = 0; i < 2; i ++) {
+        struct flash_bank_cache_config flash_cache_config;
+
+        flash_cache_get_config(i, &flash_cache_config);
+        console_printf("Flash bank %u: %u read wait states, speculation buffer %s, "
+                       "I-prefetch %s, D-prefetch %s, I-cache %s, D-cache %s\n",
+                       i, flash_cache_config.read_wait_states,
+                       flash_cache_config.single_entry_buffer_enabled ? "on" : "off",
+                       flash_cache_config.instruction_prefetch_enabled ? "on" : "off",
+                       flash_cache_config.data_prefetch_enabled ? "on" : "off",
+                       flash_cache_config.instruction_cache_enabled ? "on" : "off",
+                       flash_cache_config.data_cache_enabled ? "on" : "off");
+    }
 
-    net_layer2_get_mac_addr(&g_net_layer2.local_layer2_end_points[0], &local_mac_addr);
-    console_printf("Local Ethernet MAC address: %x:%x:%x:%x:%x:%x\n",
-                   local_mac_addr.bytes[0],
-                   local_mac_addr.bytes[1],
-                   local_mac_addr.bytes[2],
-                   local_mac_addr.bytes[3],
-                   local_mac_addr.bytes[4],
-                   local_mac_addr.bytes[5]);
+    struct cpu_idle_stats cpu_idle_stats;
+
+    cpu_idle_get_stats(&cpu_idle_stats);
+    console_printf("CPU idle: wakeup latency budget %u us, poll %u, wait %u, "
+                   "stop %u (vetoed %u)\n",
+                   cpu_idle_get_wakeup_latency_budget_us(),
+                   cpu_idle_stats.entries[CPU_IDLE_STATE_POLL],
+                   cpu_idle_stats.entries[CPU_IDLE_STATE_WAIT],
+                   cpu_idle_stats.entries[CPU_IDLE_STATE_STOP],
+                   cpu_idle_stats.stop_vetoed_count);
+
+    uint64_t cycles_since_boot = get_monotonic_cycles();
+
+    console_printf("CPU asleep in WFI: %u%% since boot (Stop mode time not counted)\n",
+                   cycles_since_boot == 0 ?
+                       0 : (uint32_t)((cpu_idle_stats.sleep_cycles * 100) /
+                                      cycles_since_boot));
+    console_printf("CPU busy: %u.%02u%% in the last stats period, "
+                   "layer-2 Rx %u packets/s, Tx %u packets/s, "
+                   "%u busy cycles per packet\n",
+                   g_cpu_busy_per_10k / 100, g_cpu_busy_per_10k % 100,
+                   g_layer2_rx_packets_per_sec, g_layer2_tx_packets_per_sec,
+                   g_cpu_busy_cycles_per_packet);
+
+    uint32_t prolog_cache_hits;
+    uint32_t prolog_cache_misses;
+
+    stack_trace_get_prolog_cache_stats(&prolog_cache_hits, &prolog_cache_misses);
+    console_printf("Stack trace prolog cache: %u hits, %u misses\n",
+                   prolog_cache_hits, prolog_cache_misses);
+
+    struct hr_timer_stats hr_timer_stats;
+
+    hr_timer_get_stats(&hr_timer_stats);
+    console_printf("High-resolution timers: %u armed, %u expirations, "
+                   "%u interrupts, %u overruns, max late %u cycles\n",
+                   hr_timer_stats.num_armed_timers,
+                   hr_timer_stats.expirations_count,
+                   hr_timer_stats.interrupts_count,
+                   hr_timer_stats.overruns_count,
+                   hr_timer_stats.max_late_cycles);
+
+    if (g_networking_started) {
+        print_networking_stats();
+    } else {
+        console_printf("Networking: starting\n");
+    }
 
-    net_layer3_get_local_ipv4_address(&local_ipv4_addr, &ipv4_subnet_mask);
-    console_printf("Local IPv4 address: %u.%u.%u.%u (subnet mask: %u.%u.%u.%u)\n",
-                   local_ipv4_addr.bytes[0],
-                   local_ipv4_addr.bytes[1],
-                   local_ipv4_addr.bytes[2],
-                   local_ipv4_addr.bytes[3],
-                   ipv4_subnet_mask.bytes[0],
-                   ipv4_subnet_mask.bytes[1],
-                   ipv4_subnet_mask.bytes[2],
-                   ipv4_subnet_mask.bytes[3]);
+    for (const struct mem_pool *mem_pool_p = mem_pool_get_next(NULL);
+         mem_pool_p != NULL;
+         mem_pool_p = mem_pool_get_next(mem_pool_p)) {
+        struct mem_pool_stats mem_pool_stats;
+
+        mem_pool_get_stats(mem_pool_p, &mem_pool_stats);
+        console_printf("Memory pool %s: %u blocks of %u bytes, %u free, "
+                       "%u min free, %u allocs, %u alloc failures\n",
+                       mem_pool_p->name_p, mem_pool_stats.num_blocks,
+                       mem_pool_stats.block_size, mem_pool_stats.num_free_blocks,
+                       mem_pool_stats.min_free_blocks, mem_pool_stats.alloc_count,
+                       mem_pool_stats.alloc_failures_count);
+    }
 
-    bool ethernet_link =
-        net_layer2_end_point_link_is_up(&g_net_layer2.local_layer2_end_points[0]);
+    for (const struct mem_arena *mem_arena_p = mem_arena_get_next(NULL);
+         mem_arena_p != NULL;
+         mem_arena_p = mem_arena_get_next(mem_arena_p)) {
+        console_printf("Memory arena %s: %u bytes, %u bytes used, "
+                       "%u bytes max used, %u alloc failures\n",
+                       mem_arena_p->name_p, mem_arena_p->size,
+                       mem_arena_p->cursor, mem_arena_p->high_water_mark,
+                       mem_arena_p->alloc_failures_count);
+    }
 
-    console_printf("Ethernet link state: %s\n", ethernet_link ? "up" : "down");
+    console_printf("NOR flash KV store: %u keys, %u of %u bytes used in sector %u, "
+                   "%u appends, %u unchanged updates, %u compactions\n",
+                   g_nor_flash_kv_store.num_keys, g_nor_flash_kv_store.write_offset,
+                   NOR_FLASH_SECTOR_SIZE, g_nor_flash_kv_store.active_sector,
+                   g_nor_flash_kv_store.appends_count,
+                   g_nor_flash_kv_store.unchanged_updates_count,
+                   g_nor_flash_kv_store.compactions_count);
+
+    struct ota_receiver_stats ota_stats;
+
+    ota_receiver_get_stats(&ota_stats);
+    console_printf("OTA receiver: %u sessions, %u images verified, %u failed, "
+                   "%u bytes programmed, %u out-of-order, %u invalid, "
+                   "%u ack failures, last image %u bytes in %u ms\n",
+                   ota_stats.sessions_started, ota_stats.images_verified,
+                   ota_stats.sessions_failed, ota_stats.bytes_programmed,
+                   ota_stats.out_of_order_datagrams, ota_stats.invalid_datagrams,
+                   ota_stats.ack_send_failures, ota_stats.last_image_size,
+                   ota_stats.last_transfer_time_ms);
 
     console_puts("\nTask                                 Max stack entries used\n"
                    "===========================================================\n");
@@ -600,25 +1623,197 @@ static void cmd_print_stats(void)
 
         if (task_p->tsk_created) {
             console_printf("%-35s  %u\n", task_p->tsk_name_p,
-                           task_p->tsk_max_stack_entries_used);
+                           rtos_task_get_stack_usage(task_p));
+        }
+    }
+
+    console_puts("\nTask                                 CPU utilization\n"
+                   "====================================================\n");
+
+    struct rtos_task_cpu_stats cpu_stats;
+
+    for (unsigned int i = 0; rtos_get_task_cpu_stats(i, &cpu_stats); i++) {
+        uint32_t per_mille = 0;
+
+        if (cpu_stats.total_cpu_cycles != 0) {
+            per_mille = (uint32_t)((cpu_stats.cpu_cycles * 1000) /
+                                   cpu_stats.total_cpu_cycles);
         }
+
+        console_printf("%-35s  %u.%u%%\n", cpu_stats.name_p,
+                       per_mille / 10, per_mille % 10);
+    }
+}
+
+
+/**
+ * Maximum time in milliseconds that a command waits for a host name to be
+ * resolved
+ */
+#define CMD_HOST_NAME_RESOLVE_TIMEOUT_MS    5000
+
+/**
+ * Translates a command argument that is either an IPv4 address or a host
+ * name into an IPv4 address
+ *
+ * @return true, on success
+ * @return false, otherwise (an error message is printed)
+ */
+static bool cmd_parse_host(const char *host_p, struct ipv4_address *ip_addr_p)
+{
+    error_t error = dns_resolver_resolve(host_p, CMD_HOST_NAME_RESOLVE_TIMEOUT_MS,
+                                         ip_addr_p);
+
+    if (error != 0) {
+        console_printf("Invalid IPv4 address or unknown host name: '%s'\n",
+                       host_p);
+        return false;
+    }
+
+    return true;
+}
+
+
+static void cmd_log_export(int argc, const char *argv[])
+{
+    struct ipv4_address collector_ip_addr;
+    uint16_t collector_port = RUNTIME_LOG_EXPORTER_DEFAULT_COLLECTOR_PORT;
+    error_t error;
+
+    if (argc == 0) {
+        struct runtime_log_exporter_stats stats;
+
+        runtime_log_exporter_get_stats(&stats);
+        console_printf("Runtime log export: %u entries exported, %u entries lost, "
+                       "%u datagrams sent, %u send failures, %u stalls\n",
+                       stats.exported_entries, stats.lost_entries,
+                       stats.datagrams_sent, stats.send_failures,
+                       stats.backpressure_stalls);
+        return;
+    }
+
+    if (argc == 1 && strcmp(argv[0], "off") == 0) {
+        runtime_log_exporter_stop();
+        return;
+    }
+
+    if (argc > 2) {
+        console_printf("Invalid syntax for command 'log export'\n");
+        return;
+    }
+
+    if (!cmd_parse_host(argv[0], &collector_ip_addr)) {
+        return;
     }
+
+    if (argc == 2) {
+        collector_port = atoi(argv[1]);
+    }
+
+    error = runtime_log_exporter_start(&collector_ip_addr, hton16(collector_port));
+    if (error != 0) {
+        console_printf("ERROR: starting runtime log export failed (error %#x)\n",
+                       error);
+    }
+}
+
+
+/**
+ * Default duration of 'log <log name> follow' in seconds
+ */
+#define LOG_FOLLOW_DEFAULT_DURATION_SEC 10
+
+/**
+ * Polling period of 'log <log name> follow' in milliseconds
+ */
+#define LOG_FOLLOW_POLL_PERIOD_MS       200
+
+
+/**
+ * Runs 'log <log name> since <sequence number>': dumps only the entries of
+ * the log from the given sequence number on, and prints the sequence number
+ * to pass in the next poll
+ */
+static void cmd_dump_log_since(enum runtime_logs log, const char *seq_num_str)
+{
+    uint32_t seq_num = strtoul(seq_num_str, NULL, 0);
+    uint32_t num_lost_entries = runtime_log_dump_since(log, &seq_num);
+
+    console_printf("\nNext sequence number: %u (%u entries lost)\n",
+                   seq_num, num_lost_entries);
+}
+
+
+/**
+ * Runs 'log <log name> follow [<seconds>]': prints the entries added to the
+ * log from now on, for the given number of seconds
+ */
+static void cmd_follow_log(enum runtime_logs log, uint32_t duration_sec)
+{
+    uint32_t seq_num = runtime_log_get_seq_num(log);
+    uint64_t end_ns = get_monotonic_ns() + (uint64_t)duration_sec * 1000000000;
+
+    console_printf("Following log for %u seconds, from sequence number %u\n",
+                   duration_sec, seq_num);
+    do {
+        uint32_t num_lost_entries = runtime_log_dump_since(log, &seq_num);
+
+        if (num_lost_entries != 0) {
+            console_printf("(%u entries lost)\n", num_lost_entries);
+        }
+
+        rtos_task_delay(LOG_FOLLOW_POLL_PERIOD_MS);
+    } while (get_monotonic_ns() < end_ns);
+
+    console_printf("\nNext sequence number: %u\n", seq_num);
 }
 
 
 static void cmd_dump_log(int argc, const char *argv[])
 {
-    if (argc != 1) {
+    enum runtime_logs log;
+
+    if (argc >= 1 && strcmp(argv[0], "export") == 0) {
+        cmd_log_export(argc - 1, argv + 1);
+        return;
+    }
+
+    if (argc < 1 || argc > 3) {
         console_printf("Invalid syntax for command 'log'\n");
         return;
     }
 
     if (strcmp(argv[0], "debug") == 0) {
-        runtime_log_dump(RUNTIME_DEBUG_LOG);
+        log = RUNTIME_DEBUG_LOG;
     } else if (strcmp(argv[0], "error") == 0) {
-        runtime_log_dump(RUNTIME_ERROR_LOG);
+        log = RUNTIME_ERROR_LOG;
     } else if (strcmp(argv[0], "info") == 0) {
-        runtime_log_dump(RUNTIME_INFO_LOG);
+        log = RUNTIME_INFO_LOG;
+    } else {
+        log = NUM_RUNTIME_LOGS;
+    }
+
+    if (argc > 1) {
+        if (log == NUM_RUNTIME_LOGS) {
+            console_printf("The log '%s' has no sequence number cursor\n", argv[0]);
+        } else if (argc == 3 && strcmp(argv[1], "since") == 0) {
+            cmd_dump_log_since(log, argv[2]);
+        } else if (strcmp(argv[1], "follow") == 0) {
+            cmd_follow_log(log, argc == 3 ? (uint32_t)atoi(argv[2]) :
+                                            LOG_FOLLOW_DEFAULT_DURATION_SEC);
+        } else {
+            console_printf("Invalid syntax for command 'log'\n");
+        }
+
+        return;
+    }
+
+    if (log != NUM_RUNTIME_LOGS) {
+        runtime_log_dump(log);
+    } else if (strcmp(argv[0], "binary") == 0) {
+        runtime_log_dump_binary();
+    } else if (strcmp(argv[0], "crash") == 0) {
+        crash_dump_print();
     } else {
         console_printf("The log '%s' is not recognized\n", argv[0]);
     }
@@ -732,6 +1927,46 @@ static void cmd_trace_net(int argc, const char *argv[])
 }
 
 
+static void cmd_trace_rec(int argc, const char *argv[])
+{
+    if (argc != 1) {
+        console_printf("Invalid syntax for command 'trace rec'\n");
+        return;
+    }
+
+    if (strcmp(argv[0], "on") == 0) {
+        trace_recorder_enable(true);
+    } else if (strcmp(argv[0], "off") == 0) {
+        trace_recorder_enable(false);
+    } else {
+        console_printf("Subcommand '%s' is not recognized\n", argv[0]);
+    }
+}
+
+
+static void cmd_trace_dump(int argc, const char *argv[])
+{
+    if (argc != 0) {
+        console_printf("Invalid syntax for command 'trace dump'\n");
+        return;
+    }
+
+    trace_recorder_dump();
+}
+
+
+static const struct command_table_entry g_trace_commands[] = {
+    { .name = "layer2", .handler = cmd_trace_layer2 },
+    { .name = "layer3", .handler = cmd_trace_layer3 },
+    { .name = "layer4", .handler = cmd_trace_layer4 },
+    { .name = "net", .handler = cmd_trace_net },
+    { .name = "rec", .handler = cmd_trace_rec },
+    { .name = "dump", .handler = cmd_trace_dump },
+};
+
+static struct command_table g_trace_command_table;
+
+
 static void cmd_trace(int argc, const char *argv[])
 {
     if (argc < 1) {
@@ -739,20 +1974,46 @@ static void cmd_trace(int argc, const char *argv[])
         return;
     }
 
-    if (strcmp(argv[0], "layer2") == 0) {
-        cmd_trace_layer2(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "layer3") == 0) {
-        cmd_trace_layer3(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "layer4") == 0) {
-        cmd_trace_layer4(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "net") == 0) {
-        cmd_trace_net(argc - 1, argv + 1);
-    } else {
+    if (!command_table_dispatch(&g_trace_command_table, argc, argv)) {
         console_printf("Subcommand '%s' is not recognized\n", argv[0]);
     }
 }
 
 
+static void cmd_capture(int argc, const char *argv[])
+{
+    struct packet_capture_filter filter = { 0 };
+
+    if (argc == 1 && strcmp(argv[0], "off") == 0) {
+        packet_capture_stop();
+        return;
+    }
+
+    if (argc == 1 && strcmp(argv[0], "dump") == 0) {
+        packet_capture_dump();
+        return;
+    }
+
+    if ((argc != 1 && argc != 3) || strcmp(argv[0], "on") != 0) {
+        console_printf("Invalid syntax for command 'capture'\n");
+        return;
+    }
+
+    if (argc == 3) {
+        if (strcmp(argv[1], "ethertype") == 0) {
+            filter.ether_type = strtoul(argv[2], NULL, 16);
+        } else if (strcmp(argv[1], "port") == 0) {
+            filter.port = atoi(argv[2]);
+        } else {
+            console_printf("Invalid capture filter '%s'\n", argv[1]);
+            return;
+        }
+    }
+
+    packet_capture_start(&filter);
+}
+
+
 static void cmd_loopback(int argc, const char *argv[])
 {
     if (argc != 1) {
@@ -772,6 +2033,65 @@ static void cmd_loopback(int argc, const char *argv[])
 }
 
 
+static void cmd_promiscuous(int argc, const char *argv[])
+{
+    if (argc != 1) {
+        console_printf("Invalid syntax for command 'promiscuous'\n");
+        return;
+    }
+
+    if (strcmp(argv[0], "on") == 0) {
+        net_layer2_end_point_set_promiscuous(&g_net_layer2.local_layer2_end_points[0],
+                                             true);
+    } else if (strcmp(argv[0], "off") == 0) {
+        net_layer2_end_point_set_promiscuous(&g_net_layer2.local_layer2_end_points[0],
+                                             false);
+    } else {
+        console_printf("Subcommand '%s' is not recognized\n", argv[0]);
+    }
+}
+
+
+/**
+ * Sets the refresh period of the network stats display, rounded up to a
+ * multiple of NETWORK_STATS_POLLING_PERIOD_MS
+ */
+static void cmd_set_stats(int argc, const char *argv[])
+{
+    int refresh_period_ms;
+
+    if (argc != 2 || strcmp(argv[0], "refresh") != 0) {
+        console_printf("Invalid syntax for command 'set stats'\n");
+        return;
+    }
+
+    refresh_period_ms = atoi(argv[1]);
+    if (refresh_period_ms <= 0 ||
+        refresh_period_ms > NETWORK_STATS_MAX_REFRESH_PERIOD_MS) {
+        console_printf("Invalid refresh period: %s (must be between 1 and %u ms)\n",
+                       argv[1], NETWORK_STATS_MAX_REFRESH_PERIOD_MS);
+        return;
+    }
+
+    g_network_stats_state.refresh_polling_periods =
+        HOW_MANY(refresh_period_ms, NETWORK_STATS_POLLING_PERIOD_MS);
+    console_printf("Network stats display refreshed every %u ms\n",
+                   g_network_stats_state.refresh_polling_periods *
+                    NETWORK_STATS_POLLING_PERIOD_MS);
+}
+
+
+static const struct command_table_entry g_set_commands[] = {
+    { .name = "ip4", .handler = cmd_set_ip4 },
+    { .name = "trace", .handler = cmd_trace },
+    { .name = "loopback", .handler = cmd_loopback },
+    { .name = "promiscuous", .handler = cmd_promiscuous },
+    { .name = "stats", .handler = cmd_set_stats },
+};
+
+static struct command_table g_set_command_table;
+
+
 static void cmd_set(int argc, const char *argv[])
 {
     if (argc < 1) {
@@ -779,13 +2099,7 @@ static void cmd_set(int argc, const char *argv[])
         return;
     }
 
-    if (strcmp(argv[0], "ip4") == 0) {
-        cmd_set_ip4(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "trace") == 0) {
-        cmd_trace(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "loopback") == 0) {
-        cmd_loopback(argc - 1, argv + 1);
-    } else {
+    if (!command_table_dispatch(&g_set_command_table, argc, argv)) {
         console_printf("Subcommand '%s' is not recognized\n", argv[0]);
     }
 }
@@ -860,12 +2174,13 @@ static void cmd_ping(int argc, const char *argv[])
          return;
      }
 
-    if (!net_layer3_parse_ipv4_addr(argv[0], &dest_ip_addr, NULL)) {
-        console_printf("Invalid syntax for IPv4 address: '%s'\n", argv[0]);
+    if (!cmd_parse_host(argv[0], &dest_ip_addr)) {
         return;
     }
 
     for (uint_fast8_t i = 0; i < 8; i ++) {
+        uint64_t start_ns = get_monotonic_ns();
+
         error = net_layer3_send_ipv4_ping_request(&dest_ip_addr, identifier,
                                                   req_seq_num);
         if (error != 0) {
@@ -893,12 +2208,19 @@ static void cmd_ping(int argc, const char *argv[])
         D_ASSERT(reply_identifier == identifier);
         D_ASSERT(reply_seq_num == req_seq_num);
 
-        console_printf("Ping %d replied by %u.%u.%u.%u\n",
+        /*
+         * The round trip is bounded by the 3 s receive timeout, so it
+         * fits in 32 bits:
+         */
+        uint32_t rtt_ns = (uint32_t)(get_monotonic_ns() - start_ns);
+
+        console_printf("Ping %d replied by %u.%u.%u.%u, time %u.%03u ms\n",
                        reply_seq_num,
                        remote_ip_addr.bytes[0],
                        remote_ip_addr.bytes[1],
                        remote_ip_addr.bytes[2],
-                       remote_ip_addr.bytes[3]);
+                       remote_ip_addr.bytes[3],
+                       rtt_ns / 1000000, (rtt_ns / 1000) % 1000);
 
         req_seq_num ++;
         rtos_task_delay(500);
@@ -906,78 +2228,1518 @@ static void cmd_ping(int argc, const char *argv[])
 }
 
 
-
-static void command_parser(int argc, const char *argv[])
+static void print_cycles_histogram(const struct cycles_histogram *histogram_p)
 {
-    if (argc == 0) {
+    for (uint_fast8_t i = 0; i < CYCLES_HISTOGRAM_NUM_BUCKETS; i ++) {
+        if (histogram_p->buckets[i] == 0) {
+            continue;
+        }
+
+        if (i == CYCLES_HISTOGRAM_NUM_BUCKETS - 1) {
+            console_printf("\t>= %u cycles: %u\n", UINT32_C(1) << i,
+                           histogram_p->buckets[i]);
+        } else {
+            console_printf("\t[%u, %u) cycles: %u\n", UINT32_C(1) << i,
+                           UINT32_C(1) << (i + 1), histogram_p->buckets[i]);
+        }
+    }
+}
+
+
+static void cmd_perf_irq(void)
+{
+    struct mem_arena *scratch_arena_p = rtos_task_get_scratch_arena();
+    mem_arena_mark_t mark = mem_arena_get_mark(scratch_arena_p);
+    struct cycles_histogram *histogram_p =
+        mem_arena_alloc(scratch_arena_p, sizeof(struct cycles_histogram), 0);
+    struct interrupts_disabled_call_site *top_call_sites =
+        mem_arena_alloc(scratch_arena_p,
+                        sizeof(struct interrupts_disabled_call_site) *
+                            INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES,
+                        0);
+    struct rtos_isr_stats isr_stats;
+
+    if (histogram_p == NULL || top_call_sites == NULL) {
+        console_printf("Not enough scratch memory\n");
+        mem_arena_reset_to_mark(scratch_arena_p, mark);
+        return;
+    }
+
+    get_interrupts_disabled_histogram(histogram_p, top_call_sites);
+    console_printf("Interrupts disabled spans:\n");
+    print_cycles_histogram(histogram_p);
+    console_printf("Longest interrupts disabled call sites:\n");
+    for (uint_fast8_t i = 0; i < INTERRUPTS_DISABLED_NUM_TOP_CALL_SITES; i ++) {
+        if (top_call_sites[i].code_addr == 0) {
+            break;
+        }
+
+        console_printf("\t%#x: %u cycles (%u us)\n",
+                       top_call_sites[i].code_addr,
+                       top_call_sites[i].max_cycles,
+                       CPU_CLOCK_CYCLES_TO_MICROSECONDS(top_call_sites[i].max_cycles));
+    }
+
+    for (unsigned int i = 0; rtos_get_isr_stats(i, &isr_stats); i ++) {
+        console_printf("%s ISR: count %u, max %u cycles (%u us)\n",
+                       isr_stats.name_p, isr_stats.count, isr_stats.max_cycles,
+                       CPU_CLOCK_CYCLES_TO_MICROSECONDS(isr_stats.max_cycles));
+        print_cycles_histogram(&isr_stats.histogram);
+    }
+
+    mem_arena_reset_to_mark(scratch_arena_p, mark);
+}
+
+
+/**
+ * Number of times each case of the printf benchmark is run
+ */
+#define PRINTF_BENCHMARK_ITERATIONS     64
+
+/**
+ * Size of the buffers where the printf benchmark formats its output
+ */
+#define PRINTF_BENCHMARK_BUFFER_SIZE    128
+
+/**
+ * Output buffer for the KSDK _doprint() in the printf benchmark
+ */
+struct printf_benchmark_sink {
+    size_t length;
+    char buffer[PRINTF_BENCHMARK_BUFFER_SIZE];
+};
+
+
+static int printf_benchmark_putc(int c, void *arg)
+{
+    struct printf_benchmark_sink *sink_p = arg;
+
+    if (sink_p->length < sizeof sink_p->buffer) {
+        sink_p->buffer[sink_p->length] = c;
+        sink_p->length ++;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Formats text with the KSDK _doprint(), with a per-character callback
+ *
+ * @return number of CPU cycles taken
+ */
+static uint32_t printf_benchmark_doprint(const char *fmt_s, ...)
+{
+    static struct printf_benchmark_sink sink;
+    va_list ap;
+    uint32_t start_cycles;
+    uint32_t cycles;
+
+    sink.length = 0;
+    va_start(ap, fmt_s);
+    start_cycles = get_dwt_cycles();
+    (void)_doprint(&sink, printf_benchmark_putc, -1, (char *)fmt_s, ap);
+    cycles = get_dwt_cycles() - start_cycles;
+    va_end(ap);
+    return cycles;
+}
+
+
+/**
+ * Formats text with the in-tree formatter, into a format span
+ *
+ * @return number of CPU cycles taken
+ */
+static uint32_t printf_benchmark_text_format(const char *fmt_s, ...)
+{
+    static char buffer[PRINTF_BENCHMARK_BUFFER_SIZE];
+    struct format_span span;
+    va_list ap;
+    uint32_t start_cycles;
+    uint32_t cycles;
+
+    va_start(ap, fmt_s);
+    start_cycles = get_dwt_cycles();
+    format_span_init(&span, buffer, sizeof buffer, NULL, NULL);
+    (void)text_format_vprintf(&span, fmt_s, ap);
+    cycles = get_dwt_cycles() - start_cycles;
+    va_end(ap);
+    return cycles;
+}
+
+
+static void print_printf_benchmark_result(const char *case_name_p,
+                                          uint32_t doprint_cycles,
+                                          uint32_t text_format_cycles)
+{
+    uint32_t saved_percent = 0;
+
+    if (text_format_cycles < doprint_cycles) {
+        saved_percent = ((doprint_cycles - text_format_cycles) * 100) /
+                        doprint_cycles;
+    }
+
+    console_printf("%-12s %10u %12u %7u%%\n", case_name_p, doprint_cycles,
+                   text_format_cycles, saved_percent);
+}
+
+
+/**
+ * Runs a case of the printf benchmark, and prints the average cycles per
+ * call of each formatter
+ */
+#define PRINTF_BENCHMARK_CASE(_case_name, _fmt_s, ...)                        \
+        do {                                                                 \
+            uint32_t _doprint_cycles = 0;                                    \
+            uint32_t _text_format_cycles = 0;                                \
+                                                                             \
+            for (uint_fast8_t _i = 0; _i < PRINTF_BENCHMARK_ITERATIONS; _i ++) { \
+                _doprint_cycles +=                                           \
+                    printf_benchmark_doprint(_fmt_s, __VA_ARGS__);           \
+                _text_format_cycles +=                                       \
+                    printf_benchmark_text_format(_fmt_s, __VA_ARGS__);       \
+            }                                                                \
+                                                                             \
+            print_printf_benchmark_result(                                   \
+                _case_name,                                                  \
+                _doprint_cycles / PRINTF_BENCHMARK_ITERATIONS,               \
+                _text_format_cycles / PRINTF_BENCHMARK_ITERATIONS);          \
+        } while (0)
+
+
+/**
+ * Compares the CPU cycles taken by the KSDK _doprint() and by the in-tree
+ * text formatter, for the formats used by the console and the runtime logs
+ */
+static void cmd_perf_printf(void)
+{
+    console_printf("Average cycles per call (%u calls per case):\n",
+                   PRINTF_BENCHMARK_ITERATIONS);
+    console_printf("%-12s %10s %12s %8s\n", "case", "_doprint", "text_format",
+                   "saved");
+    PRINTF_BENCHMARK_CASE("%u", "%u", 4000000000u);
+    PRINTF_BENCHMARK_CASE("%10u", "%10u", 12345u);
+    PRINTF_BENCHMARK_CASE("%#x", "%#x", 0x2000f3c4u);
+    PRINTF_BENCHMARK_CASE("%02x (MAC)", "%02x:%02x:%02x:%02x:%02x:%02x",
+                          0x00, 0x04, 0x9f, 0x01, 0xa2, 0x3b);
+    PRINTF_BENCHMARK_CASE("%u (IPv4)", "%u.%u.%u.%u", 192, 168, 8, 110);
+    PRINTF_BENCHMARK_CASE("%s", "%-35s  %u\n", "Network stats display task",
+                          1234u);
+    PRINTF_BENCHMARK_CASE("stats line", "%s: %u total, %u free, %u in transit\n",
+                          "Rx packets", 64u, 58u, 6u);
+}
+
+
+/**
+ * Size of the buffer checksummed by the CRC benchmark (a max-size Ethernet
+ * frame)
+ */
+#define CRC_BENCHMARK_BUFFER_SIZE   1514
+
+/**
+ * Runs a case of the CRC benchmark: compares the CPU cycles taken by the
+ * bit-at-a-time CRC-32 and by the table-driven mem_checksum() on the first
+ * 'size' bytes of a buffer, starting at the given offset
+ */
+static void crc_benchmark_case(const uint8_t *buffer_p, uint32_t offset,
+                               uint32_t size)
+{
+    uint32_t start_cycles;
+    uint32_t bitwise_cycles;
+    uint32_t table_cycles;
+    uint32_t bitwise_crc;
+    uint32_t table_crc;
+
+    start_cycles = get_dwt_cycles();
+    bitwise_crc = mem_checksum_bitwise(buffer_p + offset, size);
+    bitwise_cycles = get_dwt_cycles() - start_cycles;
+
+    start_cycles = get_dwt_cycles();
+    table_crc = mem_checksum(buffer_p + offset, size);
+    table_cycles = get_dwt_cycles() - start_cycles;
+
+    console_printf("%6u %6u %10u %12u %7u.%02ux %s\n",
+                   size, offset, bitwise_cycles, table_cycles,
+                   bitwise_cycles / table_cycles,
+                   (bitwise_cycles % table_cycles) * 100 / table_cycles,
+                   bitwise_crc == table_crc ? "ok" : "MISMATCH");
+}
+
+
+/**
+ * Runs a case of the CRC accelerator benchmark: compares the CPU cycles
+ * taken by the CRC hardware module when fed by the CPU and when fed by DMA,
+ * and checks that both give the same result as feeding the same data in
+ * uneven chunks
+ */
+static void crc_accelerator_benchmark_case(const uint8_t *buffer_p,
+                                           uint32_t offset, uint32_t size)
+{
+    const uint8_t *data_p = buffer_p + offset;
+    uint32_t start_cycles;
+    uint32_t cpu_cycles;
+    uint32_t dma_cycles;
+    uint32_t cpu_crc;
+    uint32_t dma_crc;
+    uint32_t chunked_crc;
+
+    start_cycles = get_dwt_cycles();
+    cpu_crc = crc_32_accelerator_run(data_p, size);
+    cpu_cycles = get_dwt_cycles() - start_cycles;
+
+    start_cycles = get_dwt_cycles();
+    crc_32_accelerator_begin();
+    crc_32_accelerator_update_dma(data_p, size);
+    dma_crc = crc_32_accelerator_final();
+    dma_cycles = get_dwt_cycles() - start_cycles;
+
+    crc_32_accelerator_begin();
+    crc_32_accelerator_update(data_p, size / 3);
+    crc_32_accelerator_update_dma(data_p + size / 3, size / 2);
+    crc_32_accelerator_update(data_p + size / 3 + size / 2,
+                              size - size / 3 - size / 2);
+    chunked_crc = crc_32_accelerator_final();
+
+    console_printf("%6u %6u %10u %10u %s\n", size, offset, cpu_cycles,
+                   dma_cycles,
+                   cpu_crc == dma_crc && cpu_crc == chunked_crc ?
+                        "ok" : "MISMATCH");
+}
+
+
+/**
+ * Compares the CPU cycles taken by the bit-at-a-time CRC-32 and by the
+ * implementation of mem_checksum() selected by MEM_CHECKSUM_CRC_ALGORITHM,
+ * and then the CPU-fed and DMA-fed CRC hardware module
+ */
+static void cmd_perf_crc(void)
+{
+    static uint8_t buffer[CRC_BENCHMARK_BUFFER_SIZE + sizeof(uint32_t)];
+
+    for (uint32_t i = 0; i < sizeof buffer; i ++) {
+        buffer[i] = (uint8_t)(i * 31 + (i >> 8));
+    }
+
+    console_printf("mem_checksum() algorithm %u (%u lookup tables)\n",
+                   MEM_CHECKSUM_CRC_ALGORITHM, MEM_CHECKSUM_CRC_NUM_TABLES);
+    console_printf("%6s %6s %10s %12s %11s\n", "size", "offset", "bitwise",
+                   "mem_checksum", "speedup");
+    crc_benchmark_case(buffer, 0, 8);
+    crc_benchmark_case(buffer, 0, 64);
+    crc_benchmark_case(buffer, 1, 64);
+    crc_benchmark_case(buffer, 0, 548);
+    crc_benchmark_case(buffer, 0, CRC_BENCHMARK_BUFFER_SIZE);
+    crc_benchmark_case(buffer, 3, CRC_BENCHMARK_BUFFER_SIZE);
+
+    console_printf("\nCRC accelerator:\n");
+    console_printf("%6s %6s %10s %10s\n", "size", "offset", "CPU-fed",
+                   "DMA-fed");
+    crc_accelerator_benchmark_case(buffer, 0, 64);
+    crc_accelerator_benchmark_case(buffer, 0, 548);
+    crc_accelerator_benchmark_case(buffer, 0, CRC_BENCHMARK_BUFFER_SIZE);
+    crc_accelerator_benchmark_case(buffer, 3, CRC_BENCHMARK_BUFFER_SIZE);
+}
+
+
+/**
+ * Size of the buffers copied and filled by the memcpy benchmark
+ */
+#define MEMCPY_BENCHMARK_BUFFER_SIZE    1520
+
+/**
+ * Runs a case of the memcpy benchmark: compares the CPU cycles taken by the
+ * newlib memcpy()/memset(), by mem_copy()/mem_fill() and by dma_memcpy()
+ * for the given size and destination and source offsets from a 4-byte
+ * aligned address
+ */
+static void memcpy_benchmark_case(uint32_t size, uint32_t dst_offset,
+                                  uint32_t src_offset)
+{
+    static uint32_t src_buffer[MEMCPY_BENCHMARK_BUFFER_SIZE / sizeof(uint32_t)];
+    static uint32_t dst_buffer[MEMCPY_BENCHMARK_BUFFER_SIZE / sizeof(uint32_t)];
+    uint8_t *const dst_p = (uint8_t *)dst_buffer + dst_offset;
+    const uint8_t *const src_p = (uint8_t *)src_buffer + src_offset;
+    uint32_t start_cycles;
+    uint32_t memcpy_cycles;
+    uint32_t mem_copy_cycles;
+    uint32_t memset_cycles;
+    uint32_t mem_fill_cycles;
+    uint32_t dma_memcpy_cycles;
+
+    D_ASSERT(size + sizeof(uint32_t) <= MEMCPY_BENCHMARK_BUFFER_SIZE);
+
+    start_cycles = get_dwt_cycles();
+    memcpy(dst_p, src_p, size);
+    memcpy_cycles = get_dwt_cycles() - start_cycles;
+
+    start_cycles = get_dwt_cycles();
+    mem_copy(dst_p, src_p, size);
+    mem_copy_cycles = get_dwt_cycles() - start_cycles;
+
+    start_cycles = get_dwt_cycles();
+    memset(dst_p, 0xa5, size);
+    memset_cycles = get_dwt_cycles() - start_cycles;
+
+    start_cycles = get_dwt_cycles();
+    mem_fill(dst_p, 0xa5, size);
+    mem_fill_cycles = get_dwt_cycles() - start_cycles;
+
+    start_cycles = get_dwt_cycles();
+    dma_memcpy(dst_p, src_p, size);
+    dma_memcpy_cycles = get_dwt_cycles() - start_cycles;
+
+    console_printf("%6u %4u %4u %8u %8u %8u %8u %10u %s\n", size, dst_offset,
+                   src_offset, memcpy_cycles, mem_copy_cycles, memset_cycles,
+                   mem_fill_cycles, dma_memcpy_cycles,
+                   memcmp(dst_p, src_p, size) == 0 ? "ok" : "MISMATCH");
+}
+
+
+/**
+ * Compares the CPU cycles taken by the newlib memcpy()/memset(), by the
+ * in-tree mem_copy()/mem_fill() and by a blocking dma_memcpy(), for aligned
+ * and unaligned blocks
+ */
+static void cmd_perf_memcpy(void)
+{
+    uint32_t dma_copies;
+    uint32_t cpu_copies;
+    uint32_t max_queued;
+
+    console_printf("%6s %4s %4s %8s %8s %8s %8s %10s\n", "size", "dst", "src",
+                   "memcpy", "mem_copy", "memset", "mem_fill", "dma_memcpy");
+    memcpy_benchmark_case(16, 0, 0);
+    memcpy_benchmark_case(64, 0, 0);
+    memcpy_benchmark_case(64, 1, 1);
+    memcpy_benchmark_case(64, 0, 3);
+    memcpy_benchmark_case(256, 0, 0);
+    memcpy_benchmark_case(256, 2, 1);
+    memcpy_benchmark_case(1514, 0, 0);
+    memcpy_benchmark_case(1514, 2, 2);
+    memcpy_benchmark_case(1514, 0, 2);
+
+    dma_memcpy_get_stats(&dma_copies, &cpu_copies, &max_queued);
+    console_printf("dma_memcpy: %u copies by DMA, %u by CPU, max queued %u\n",
+                   dma_copies, cpu_copies, max_queued);
+}
+
+
+/**
+ * Runs a case of the NOR flash programming benchmark: erases the scratch
+ * NOR flash sector, programs it with the given data, and prints the bytes
+ * per second achieved
+ */
+static void nor_flash_benchmark_case(const char *method_name_p,
+                                     bool use_program_section,
+                                     const uint32_t *data_p, uint32_t size)
+{
+    error_t error;
+    uint32_t start_cycles;
+    uint32_t erase_cycles;
+    uint32_t program_cycles;
+    bool old_program_section_enabled =
+        nor_flash_enable_program_section(use_program_section);
+
+    start_cycles = get_dwt_cycles();
+    error = nor_flash_erase(NOR_FLASH_SCRATCH_SECTOR_ADDR, NOR_FLASH_SECTOR_SIZE);
+    erase_cycles = get_dwt_cycles() - start_cycles;
+    if (error != 0) {
+        console_printf("ERROR: NOR flash erase failed (error %#x)\n", error);
+        goto exit;
+    }
+
+    start_cycles = get_dwt_cycles();
+    error = nor_flash_program(NOR_FLASH_SCRATCH_SECTOR_ADDR, data_p, size);
+    program_cycles = get_dwt_cycles() - start_cycles;
+    if (error != 0) {
+        console_printf("ERROR: NOR flash program failed (error %#x)\n", error);
+        goto exit;
+    }
+
+    console_printf("%-16s %6u %10u %12u %10u %s\n", method_name_p, size,
+                   CPU_CLOCK_CYCLES_TO_MICROSECONDS(erase_cycles),
+                   CPU_CLOCK_CYCLES_TO_MICROSECONDS(program_cycles),
+                   (uint32_t)(((uint64_t)size * MCU_CPU_CLOCK_FREQ_IN_HZ) /
+                              program_cycles),
+                   memcmp((void *)NOR_FLASH_SCRATCH_SECTOR_ADDR, data_p, size) == 0 ?
+                        "ok" : "MISMATCH");
+
+exit:
+    (void)nor_flash_enable_program_section(old_program_section_enabled);
+}
+
+
+/**
+ * Compares the NOR flash programming rates of one program-phrase command
+ * per phrase and of program-section commands through the FlexRAM
+ * programming acceleration buffer, using the scratch NOR flash sector
+ */
+static void cmd_perf_flash(void)
+{
+    static uint32_t buffer[NOR_FLASH_SECTOR_SIZE / sizeof(uint32_t)];
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(buffer); i ++) {
+        buffer[i] = i * 0x9e3779b9;
+    }
+
+    console_printf("%-16s %6s %10s %12s %10s\n", "method", "size",
+                   "erase (us)", "program (us)", "bytes/s");
+    nor_flash_benchmark_case("program phrase", false, buffer, 256);
+    nor_flash_benchmark_case("program section", true, buffer, 256);
+    nor_flash_benchmark_case("program phrase", false, buffer, sizeof buffer);
+    nor_flash_benchmark_case("program section", true, buffer, sizeof buffer);
+
+    uint32_t jobs_count;
+    uint32_t failed_jobs_count;
+    uint32_t max_queued_jobs;
+
+    nor_flash_get_job_stats(&jobs_count, &failed_jobs_count, &max_queued_jobs);
+    console_printf("NOR flash background jobs: %u completed, %u failed, "
+                   "max queued %u\n",
+                   jobs_count, failed_jobs_count, max_queued_jobs);
+}
+
+
+static void cmd_perf_reset(void)
+{
+    perf_probes_reset();
+    reset_interrupts_disabled_histogram();
+    rtos_reset_isr_stats();
+    rtos_reset_task_cpu_stats();
+}
+
+
+static void cmd_perf(int argc, const char *argv[])
+{
+    if (argc == 0) {
+        perf_probes_dump();
+    } else if (argc == 1 && strcmp(argv[0], "irq") == 0) {
+        cmd_perf_irq();
+    } else if (argc == 1 && strcmp(argv[0], "printf") == 0) {
+        cmd_perf_printf();
+    } else if (argc == 1 && strcmp(argv[0], "crc") == 0) {
+        cmd_perf_crc();
+    } else if (argc == 1 && strcmp(argv[0], "memcpy") == 0) {
+        cmd_perf_memcpy();
+    } else if (argc == 1 && strcmp(argv[0], "flash") == 0) {
+        cmd_perf_flash();
+    } else if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+        cmd_perf_reset();
+    } else {
+        console_printf("Invalid syntax for command 'perf'\n");
+    }
+}
+
+
+/**
+ * Dumps the contention statistics of the mutexes that have been acquired
+ * at least once since the last reset
+ */
+static void cmd_locks_dump(void)
+{
+    struct rtos_mutex_stats stats;
+
+    console_printf("%-30s %8s %8s %6s %10s %10s %10s  %s\n",
+                   "Mutex", "Acquired", "Contend", "PI", "Avg wait",
+                   "Max wait", "Max hold", "Longest holder");
+    console_puts("=============================================================="
+                 "=====================================================\n");
+
+    for (unsigned int i = 0; rtos_get_mutex_stats(i, &stats); i ++) {
+        uint32_t avg_wait_cycles = 0;
+
+        if (stats.acquisitions == 0) {
+            continue;
+        }
+
+        if (stats.contended != 0) {
+            avg_wait_cycles = (uint32_t)(stats.total_wait_cycles /
+                                         stats.contended);
+        }
+
+        console_printf("%-30s %8u %8u %6u %7u us %7u us %7u us  %s\n",
+                       stats.name_p, stats.acquisitions, stats.contended,
+                       stats.priority_inversions,
+                       CPU_CLOCK_CYCLES_TO_MICROSECONDS(avg_wait_cycles),
+                       CPU_CLOCK_CYCLES_TO_MICROSECONDS(stats.max_wait_cycles),
+                       CPU_CLOCK_CYCLES_TO_MICROSECONDS(stats.max_hold_cycles),
+                       stats.max_holder_name_p != NULL ?
+                            stats.max_holder_name_p : "");
+    }
+}
+
+
+static void cmd_locks(int argc, const char *argv[])
+{
+    if (argc == 0) {
+        cmd_locks_dump();
+    } else if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+        rtos_reset_mutex_stats();
+    } else {
+        console_printf("Invalid syntax for command 'locks'\n");
+    }
+}
+
+
+static void cmd_prof(int argc, const char *argv[])
+{
+    if (argc != 1) {
+        console_printf("Invalid syntax for command 'prof'\n");
+        return;
+    }
+
+    if (strcmp(argv[0], "on") == 0) {
+        sampling_profiler_enable(true);
+    } else if (strcmp(argv[0], "off") == 0) {
+        sampling_profiler_enable(false);
+    } else if (strcmp(argv[0], "reset") == 0) {
+        sampling_profiler_reset();
+    } else if (strcmp(argv[0], "dump") == 0) {
+        sampling_profiler_dump();
+    } else {
+        console_printf("Subcommand '%s' is not recognized\n", argv[0]);
+    }
+}
+
+
+static void cmd_soak(int argc, const char *argv[])
+{
+    struct udp_soak_test *const soak_p = &g_udp_soak_test;
+
+    if (argc != 1) {
+        console_printf("Invalid syntax for command 'soak'\n");
+        return;
+    }
+
+    if (strcmp(argv[0], "on") == 0) {
+        soak_p->reset_requested = true;
+        soak_p->enabled = true;
+    } else if (strcmp(argv[0], "off") == 0) {
+        soak_p->enabled = false;
+    } else if (strcmp(argv[0], "reset") == 0) {
+        soak_p->reset_requested = true;
+    } else {
+        console_printf("Subcommand '%s' is not recognized\n", argv[0]);
+    }
+}
+
+
+static void cmd_sntp(int argc, const char *argv[])
+{
+    struct ipv4_address server_ip_addr;
+    bool use_hw_timestamps = false;
+    error_t error;
+
+    if (argc == 0) {
+        struct sntp_client_stats stats;
+        uint64_t wall_time_ns = get_wall_time_ns();
+
+        sntp_client_get_stats(&stats);
+        console_printf("SNTP client: %u requests, %u send failures, %u timeouts, "
+                       "%u invalid replies, %u slow replies, %u samples "
+                       "(%u hw timestamped), %u steps, last offset error %d ns, "
+                       "last round trip %u ns\n",
+                       stats.requests_sent, stats.send_failures, stats.timeouts,
+                       stats.invalid_replies, stats.slow_replies, stats.samples,
+                       stats.hw_timestamped_samples, stats.steps,
+                       stats.last_offset_error_ns, stats.last_round_trip_ns);
+        console_printf("Wall-clock time: %u.%09u s%s\n",
+                       (uint32_t)(wall_time_ns / 1000000000),
+                       (uint32_t)(wall_time_ns % 1000000000),
+                       wall_time_is_set() ? " since the Unix epoch" :
+                                            " (not synchronized)");
+        return;
+    }
+
+    if (argc == 1 && strcmp(argv[0], "off") == 0) {
+        sntp_client_stop();
+        return;
+    }
+
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "hw") != 0)) {
+        console_printf("Invalid syntax for command 'sntp'\n");
+        return;
+    }
+
+    if (!cmd_parse_host(argv[0], &server_ip_addr)) {
+        return;
+    }
+
+    if (argc == 2) {
+        use_hw_timestamps = true;
+    }
+
+    error = sntp_client_start(&server_ip_addr, use_hw_timestamps);
+    if (error != 0) {
+        console_printf("ERROR: starting SNTP client failed (error %#x)\n",
+                       error);
+    }
+}
+
+
+static void cmd_beacon(int argc, const char *argv[])
+{
+    static const struct ipv4_address default_group_ip_addr =
+        TELEMETRY_BEACON_DEFAULT_GROUP_ADDR_INITIALIZER;
+    struct ipv4_address group_ip_addr = default_group_ip_addr;
+    uint16_t group_port = TELEMETRY_BEACON_DEFAULT_PORT;
+    uint32_t period_ms = TELEMETRY_BEACON_DEFAULT_PERIOD_MS;
+    error_t error;
+
+    if (argc == 0) {
+        struct telemetry_beacon_stats stats;
+
+        telemetry_beacon_get_stats(&stats);
+        console_printf("Telemetry beacon: %u sent, %u send failures, "
+                       "%u skipped (Tx busy)\n",
+                       stats.beacons_sent, stats.send_failures,
+                       stats.tx_busy_skips);
+        return;
+    }
+
+    if (argc == 1 && strcmp(argv[0], "off") == 0) {
+        telemetry_beacon_stop();
+        return;
+    }
+
+    if (argc > 3 || !net_layer3_parse_ipv4_addr(argv[0], &group_ip_addr, NULL)) {
+        console_printf("Invalid syntax for command 'beacon'\n");
+        return;
+    }
+
+    if (argc >= 2) {
+        group_port = atoi(argv[1]);
+    }
+
+    if (argc == 3) {
+        period_ms = atoi(argv[2]);
+    }
+
+    error = telemetry_beacon_start(&group_ip_addr, hton16(group_port), period_ms);
+    if (error != 0) {
+        console_printf("ERROR: starting telemetry beacon failed (error %#x)\n",
+                       error);
+    }
+}
+
+
+static void cmd_dns(int argc, const char *argv[])
+{
+    struct ipv4_address ip_addr;
+    error_t error;
+
+    if (argc == 0) {
+        struct dns_resolver_stats stats;
+
+        dns_resolver_get_stats(&stats);
+        console_printf("DNS resolver: %u lookups, %u cache hits, "
+                       "%u negative cache hits, %u evictions, %u queries sent, "
+                       "%u send failures, %u invalid replies, %u resolved, "
+                       "%u not found, %u failures\n",
+                       stats.lookups, stats.cache_hits, stats.negative_cache_hits,
+                       stats.cache_evictions, stats.queries_sent,
+                       stats.send_failures, stats.invalid_replies,
+                       stats.names_resolved, stats.names_not_found,
+                       stats.resolution_failures);
+        return;
+    }
+
+    if (argc == 2 && strcmp(argv[0], "server") == 0) {
+        if (!net_layer3_parse_ipv4_addr(argv[1], &ip_addr, NULL)) {
+            console_printf("Invalid syntax for IPv4 address: '%s'\n", argv[1]);
+            return;
+        }
+
+        error = dns_resolver_start(&ip_addr);
+        if (error != 0) {
+            console_printf("ERROR: starting DNS resolver failed (error %#x)\n",
+                           error);
+        }
+
+        return;
+    }
+
+    if (argc != 1) {
+        console_printf("Invalid syntax for command 'dns'\n");
+        return;
+    }
+
+    if (cmd_parse_host(argv[0], &ip_addr)) {
+        console_printf("%s is %u.%u.%u.%u\n", argv[0],
+                       ip_addr.bytes[0], ip_addr.bytes[1],
+                       ip_addr.bytes[2], ip_addr.bytes[3]);
+    }
+}
+
+
+static void cmd_bench_print_result(const struct net_benchmark_result *result_p)
+{
+    uint32_t kbps = 0;
+    uint32_t pps = 0;
+    uint32_t cycles_per_packet = 0;
+
+    if (result_p->elapsed_ns != 0) {
+        kbps = (uint32_t)(result_p->bytes * 8 * 1000000 / result_p->elapsed_ns);
+        pps = (uint32_t)((uint64_t)result_p->packets * 1000000000 /
+                         result_p->elapsed_ns);
+    }
+
+    if (result_p->packets != 0) {
+        cycles_per_packet = (uint32_t)(result_p->busy_cycles / result_p->packets);
+    }
+
+    console_printf("%u datagrams (%u lost) in %u us: %u.%03u Mbps, %u pps, "
+                   "%u CPU cycles per datagram\n",
+                   result_p->packets, result_p->lost_packets,
+                   (uint32_t)(result_p->elapsed_ns / 1000),
+                   kbps / 1000, kbps % 1000, pps, cycles_per_packet);
+}
+
+
+static void cmd_bench_print_rtt(const struct net_benchmark_result *result_p)
+{
+    console_printf("RTT (us): min %u, avg %u, p50 %u, p90 %u, p99 %u, max %u\n",
+                   result_p->rtt_min_ns / 1000, result_p->rtt_avg_ns / 1000,
+                   result_p->rtt_p50_ns / 1000, result_p->rtt_p90_ns / 1000,
+                   result_p->rtt_p99_ns / 1000, result_p->rtt_max_ns / 1000);
+}
+
+
+static void cmd_bench_ping(int argc, const char *argv[])
+{
+    struct ipv4_address peer_ip_addr;
+    struct net_benchmark_result result;
+    uint32_t max_outstanding = 1;
+    error_t error;
+
+    if (argc != 3 && argc != 4) {
+        console_printf("Invalid syntax for command 'bench ping'\n");
+        return;
+    }
+
+    if (!net_layer3_parse_ipv4_addr(argv[0], &peer_ip_addr, NULL)) {
+        console_printf("Invalid syntax for IPv4 address: '%s'\n", argv[0]);
+        return;
+    }
+
+    if (argc == 4) {
+        max_outstanding = atoi(argv[3]);
+    }
+
+    error = net_benchmark_ping_flood(&peer_ip_addr, atoi(argv[1]), atoi(argv[2]),
+                                     max_outstanding, &result);
+    if (error != 0) {
+        console_printf("ERROR: benchmark failed (error %#x)\n", error);
+        return;
+    }
+
+    uint32_t num_sent = result.packets + result.lost_packets;
+
+    console_printf("%u pings sent, %u replied, %u lost (%u%%) in %u us\n",
+                   num_sent, result.packets, result.lost_packets,
+                   num_sent != 0 ? result.lost_packets * 100 / num_sent : 0,
+                   (uint32_t)(result.elapsed_ns / 1000));
+    if (result.packets != 0) {
+        cmd_bench_print_rtt(&result);
+    }
+}
+
+
+/**
+ * Names of the frame types of 'bench inject', indexed by
+ * enum net_benchmark_inject_frame_types
+ */
+static const char *const g_bench_inject_frame_type_names[] = {
+    [NET_BENCHMARK_INJECT_ARP] = "arp",
+    [NET_BENCHMARK_INJECT_ICMP] = "icmp",
+    [NET_BENCHMARK_INJECT_UDP] = "udp",
+    [NET_BENCHMARK_INJECT_JUNK] = "junk",
+};
+
+C_ASSERT(ARRAY_SIZE(g_bench_inject_frame_type_names) ==
+         NET_BENCHMARK_NUM_INJECT_FRAME_TYPES);
+
+/**
+ * Performance probes reported by 'bench inject', one per stage of the Rx
+ * path of the injected frames
+ */
+static const struct {
+    enum perf_probes probe;
+    const char *name_p;
+} g_bench_inject_probes[] = {
+    { PERF_PROBE_RX_LATENCY_MAC_TO_LAYER2, "Layer-2 Rx queue" },
+    { PERF_PROBE_LAYER2_RX_DISPATCH, "Layer-2 dispatch" },
+    { PERF_PROBE_RX_LATENCY_LAYER2_TO_LAYER3, "Layer 2 to layer 3" },
+    { PERF_PROBE_RX_LATENCY_LAYER3_TO_UDP_QUEUE, "Layer 3 to UDP delivery" },
+    { PERF_PROBE_UDP_DEMUX, "UDP demux" },
+};
+
+
+/**
+ * Parses a comma-separated list of 'bench inject' frame type names, or
+ * 'all'
+ *
+ * @return mask of frame types, or 0 if the list is not valid
+ */
+static uint32_t cmd_bench_parse_inject_frame_types(const char *list_p)
+{
+    uint32_t mask = 0;
+
+    if (strcmp(list_p, "all") == 0) {
+        return NET_BENCHMARK_INJECT_ALL_FRAME_TYPES;
+    }
+
+    while (*list_p != '\0') {
+        const char *end_p = strchr(list_p, ',');
+        size_t length = (end_p != NULL) ? (size_t)(end_p - list_p) : strlen(list_p);
+        uint_fast8_t i;
+
+        for (i = 0; i < NET_BENCHMARK_NUM_INJECT_FRAME_TYPES; i ++) {
+            if (strlen(g_bench_inject_frame_type_names[i]) == length &&
+                strncmp(list_p, g_bench_inject_frame_type_names[i], length) == 0) {
+                break;
+            }
+        }
+
+        if (i == NET_BENCHMARK_NUM_INJECT_FRAME_TYPES) {
+            return 0;
+        }
+
+        mask |= BIT(i);
+        list_p += length;
+        if (*list_p == ',') {
+            list_p ++;
+        }
+    }
+
+    return mask;
+}
+
+
+static void cmd_bench_inject(int argc, const char *argv[])
+{
+    struct net_benchmark_inject_result result;
+    struct perf_probe_stats stats;
+    uint32_t frame_types_mask;
+    uint32_t num_injected = 0;
+    error_t error;
+
+    if (argc != 3) {
+        console_printf("Invalid syntax for command 'bench inject'\n");
+        return;
+    }
+
+    frame_types_mask = cmd_bench_parse_inject_frame_types(argv[0]);
+    if (frame_types_mask == 0) {
+        console_printf("Invalid frame types: '%s'\n", argv[0]);
+        return;
+    }
+
+    error = net_benchmark_rx_inject(frame_types_mask, atoi(argv[1]), atoi(argv[2]),
+                                    &result);
+    if (error != 0) {
+        console_printf("ERROR: benchmark failed (error %#x)\n", error);
         return;
     }
 
-    console_putchar('\n');
-    if (strcmp(argv[0], "help") == 0 ||
-        strcmp(argv[0], "h") == 0) {
-        cmd_print_help();
-    } else if (strcmp(argv[0], "hang") == 0) {
-        cmd_hang();
-    } else if (strcmp(argv[0], "reset") == 0) {
-        cmd_reset();
-    } else if (strcmp(argv[0], "stats") == 0 ||
-               strcmp(argv[0], "st") == 0) {
-        cmd_print_stats();
-    } else if (strcmp(argv[0], "log") == 0) {
-        cmd_dump_log(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "set") == 0) {
-        cmd_set(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "get") == 0) {
-        cmd_get(argc - 1, argv + 1);
-    } else if (strcmp(argv[0], "ping") == 0) {
-        cmd_ping(argc - 1, argv + 1);
+    for (uint_fast8_t i = 0; i < NET_BENCHMARK_NUM_INJECT_FRAME_TYPES; i ++) {
+        num_injected += result.injected[i];
+    }
+
+    console_printf("%u frames injected (arp %u, icmp %u, udp %u, junk %u) in %u us, "
+                   "%u CPU cycles per frame\n",
+                   num_injected,
+                   result.injected[NET_BENCHMARK_INJECT_ARP],
+                   result.injected[NET_BENCHMARK_INJECT_ICMP],
+                   result.injected[NET_BENCHMARK_INJECT_UDP],
+                   result.injected[NET_BENCHMARK_INJECT_JUNK],
+                   (uint32_t)(result.elapsed_ns / 1000),
+                   num_injected != 0 ? (uint32_t)(result.busy_cycles / num_injected) : 0);
+    console_printf("%u waits for Rx packets, %u frames unfinished\n",
+                   result.rx_packet_waits, result.unfinished);
+    console_printf("Layer 2: %u dropped\n", result.layer2_dropped);
+    console_printf("IPv4: %u accepted, %u dropped\n",
+                   result.ipv4_accepted, result.ipv4_dropped);
+    console_printf("UDP: %u accepted, %u dropped\n",
+                   result.udp_accepted, result.udp_dropped);
+
+    console_printf("Rx path stages (durations in CPU cycles):\n");
+    for (uint_fast8_t i = 0; i < ARRAY_SIZE(g_bench_inject_probes); i ++) {
+        perf_probes_get_stats(g_bench_inject_probes[i].probe, &stats);
+        if (stats.count == 0) {
+            console_printf("\t%s: no samples\n", g_bench_inject_probes[i].name_p);
+            continue;
+        }
+
+        console_printf("\t%s: count %u, min %u, max %u, avg %u\n",
+                       g_bench_inject_probes[i].name_p, stats.count,
+                       stats.min_cycles, stats.max_cycles,
+                       (uint32_t)(stats.total_cycles / stats.count));
+    }
+}
+
+
+static void cmd_bench(int argc, const char *argv[])
+{
+    struct ipv4_address peer_ip_addr;
+    struct net_benchmark_result result;
+    size_t datagram_size;
+    uint32_t count;
+    error_t error;
+
+    if (argc == 1 && strcmp(argv[0], "micro") == 0) {
+        micro_benchmark_run_all();
+        return;
+    }
+
+    if (argc >= 1 && strcmp(argv[0], "ping") == 0) {
+        cmd_bench_ping(argc - 1, argv + 1);
+        return;
+    }
+
+    if (argc >= 1 && strcmp(argv[0], "inject") == 0) {
+        cmd_bench_inject(argc - 1, argv + 1);
+        return;
+    }
+
+    if (argc != 5 || strcmp(argv[0], "udp") != 0) {
+        console_printf("Invalid syntax for command 'bench'\n");
+        return;
+    }
+
+    if (!net_layer3_parse_ipv4_addr(argv[2], &peer_ip_addr, NULL)) {
+        console_printf("Invalid syntax for IPv4 address: '%s'\n", argv[2]);
+        return;
+    }
+
+    datagram_size = atoi(argv[3]);
+    count = atoi(argv[4]);
+    if (strcmp(argv[1], "tx") == 0) {
+        error = net_benchmark_udp_tx(&peer_ip_addr, datagram_size, count, &result);
+    } else if (strcmp(argv[1], "rx") == 0) {
+        console_printf("Waiting for datagrams from the peer...\n");
+        error = net_benchmark_udp_rx(&peer_ip_addr, datagram_size, count, &result);
+    } else if (strcmp(argv[1], "rtt") == 0) {
+        error = net_benchmark_udp_rtt(&peer_ip_addr, datagram_size, count, &result);
+    } else {
+        console_printf("Subcommand '%s' is not recognized\n", argv[1]);
+        return;
+    }
+
+    if (error != 0) {
+        console_printf("ERROR: benchmark failed (error %#x)\n", error);
+        return;
+    }
+
+    cmd_bench_print_result(&result);
+    if (strcmp(argv[1], "rtt") == 0 && result.packets != 0) {
+        cmd_bench_print_rtt(&result);
+    }
+}
+
+
+
+/**
+ * Command IDs of the binary command frames handled by command_frame_handler()
+ */
+enum app_command_frame_ids {
+    /*
+     * Echoes the payload back
+     */
+    APP_COMMAND_FRAME_PING = 0,
+
+    /*
+     * Returns the network stats counters, as a sequence of little-endian
+     * 32-bit values, in this order: layer 2 Rx packets accepted, layer 2 Rx
+     * packets dropped, layer 2 packets sent, IPv4 Rx packets accepted, IPv4
+     * Rx packets dropped, IPv4 packets sent, UDP Rx packets accepted, UDP Rx
+     * packets dropped, UDP packets sent, Ethernet Rx bytes/s, Ethernet Tx
+     * bytes/s and console output bytes dropped
+     */
+    APP_COMMAND_FRAME_GET_NET_STATS,
+
+    /*
+     * Same as the 'perf reset' command
+     */
+    APP_COMMAND_FRAME_PERF_RESET,
+};
+
+
+static uint8_t *store_uint32_little_endian(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+    return p + 4;
+}
+
+
+/**
+ * Handler of binary command frames (see command_line.h)
+ */
+static uint8_t command_frame_handler(uint8_t command_id,
+                                     const uint8_t *payload_p,
+                                     size_t payload_length,
+                                     uint8_t *response_data_p,
+                                     size_t *response_data_size_p)
+{
+    switch (command_id) {
+    case APP_COMMAND_FRAME_PING:
+        if (payload_length > *response_data_size_p) {
+            *response_data_size_p = 0;
+            return COMMAND_FRAME_STATUS_INVALID_PAYLOAD;
+        }
+
+        memcpy(response_data_p, payload_p, payload_length);
+        *response_data_size_p = payload_length;
+        return COMMAND_FRAME_STATUS_OK;
+
+    case APP_COMMAND_FRAME_GET_NET_STATS: {
+        struct net_stats_snapshot snapshot;
+
+        networking_get_stats_snapshot(&snapshot);
+
+        const uint32_t net_stats[] = {
+            snapshot.layer2.rx_packets_accepted_count,
+            snapshot.layer2.rx_packets_dropped_count,
+            snapshot.layer2.sent_packets_count,
+            snapshot.ipv4.rx_packets_accepted_count,
+            snapshot.ipv4.rx_packets_dropped_count,
+            snapshot.ipv4.sent_packets_count,
+            snapshot.udp.rx_packets_accepted_count,
+            snapshot.udp.rx_packets_dropped_count,
+            snapshot.udp.sent_packets_count,
+            g_ethernet_rx_bytes_per_sec,
+            g_ethernet_tx_bytes_per_sec,
+            console_get_output_bytes_dropped(),
+        };
+        uint8_t *p = response_data_p;
+
+        D_ASSERT(sizeof net_stats <= *response_data_size_p);
+        for (uint_fast8_t i = 0; i < ARRAY_SIZE(net_stats); i ++) {
+            p = store_uint32_little_endian(p, net_stats[i]);
+        }
+
+        *response_data_size_p = p - response_data_p;
+        return COMMAND_FRAME_STATUS_OK;
+    }
+
+    case APP_COMMAND_FRAME_PERF_RESET:
+        cmd_perf_reset();
+        *response_data_size_p = 0;
+        return COMMAND_FRAME_STATUS_OK;
+
+    default:
+        *response_data_size_p = 0;
+        return COMMAND_FRAME_STATUS_UNKNOWN_COMMAND;
+    }
+}
+
+
+/**
+ * Flush function for the format span of cmd_print_stats_json()
+ */
+static void stats_json_console_flush(struct format_span *span_p)
+{
+    console_write_binary(span_p->buffer_p, span_p->length);
+    span_p->length = 0;
+}
+
+
+static void cmd_print_stats_json(void)
+{
+    char chunk[128];
+    struct format_span span;
+
+    format_span_init(&span, chunk, sizeof chunk, stats_json_console_flush, NULL);
+    stats_format_json(&span);
+    format_span_flush(&span);
+}
+
+
+/**
+ * Prints the peak stack usage of every task, as measured from the stack
+ * paint pattern, and the stack size each task would need with a
+ * STACK_SIZING_MARGIN_PERCENT safety margin on top of its peak usage.
+ */
+static void cmd_print_stacks(void)
+{
+    uint32_t total_reclaimable_entries = 0;
+
+    console_printf("\nTask                                 Size  Peak  Peak%%  Suggested\n"
+                     "=================================================================\n");
+
+    for (uint8_t i = 0; i < NUM_APP_TASKS; i++) {
+        struct rtos_task *task_p = g_all_app_tasks[i];
+
+        if (!task_p->tsk_created) {
+            continue;
+        }
+
+        uint32_t used_entries = rtos_task_get_stack_usage(task_p);
+        uint32_t suggested_entries =
+            ROUND_UP(used_entries +
+                     HOW_MANY(used_entries * STACK_SIZING_MARGIN_PERCENT, 100),
+                     STACK_SIZING_GRANULARITY);
+
+        if (suggested_entries < APP_TASK_STACK_SIZE) {
+            total_reclaimable_entries += APP_TASK_STACK_SIZE - suggested_entries;
+        }
+
+        console_printf("%-35s  %4u  %4u  %4u%%  %9u\n",
+                       task_p->tsk_name_p, APP_TASK_STACK_SIZE, used_entries,
+                       (used_entries * 100) / APP_TASK_STACK_SIZE,
+                       suggested_entries);
+    }
+
+    console_printf("\nStack entries reclaimable with suggested sizes: %u (%u bytes)\n",
+                   total_reclaimable_entries,
+                   total_reclaimable_entries * sizeof(CPU_STK));
+}
+
+
+static void cmd_help(int argc, const char *argv[])
+{
+    cmd_print_help();
+}
+
+
+static void cmd_hang_handler(int argc, const char *argv[])
+{
+    cmd_hang();
+}
+
+
+static void cmd_reset_handler(int argc, const char *argv[])
+{
+    cmd_reset();
+}
+
+
+static void cmd_stats(int argc, const char *argv[])
+{
+    if (argc == 1 && strcmp(argv[0], "json") == 0) {
+        cmd_print_stats_json();
     } else {
+        cmd_print_stats();
+    }
+}
+
+
+static void cmd_stacks(int argc, const char *argv[])
+{
+    cmd_print_stacks();
+}
+
+
+/**
+ * Commands that can be run at any time
+ */
+static const struct command_table_entry g_commands[] = {
+    { .name = "help", .handler = cmd_help },
+    { .name = "h", .handler = cmd_help },
+    { .name = "hang", .handler = cmd_hang_handler },
+    { .name = "reset", .handler = cmd_reset_handler },
+    { .name = "stats", .handler = cmd_stats },
+    { .name = "st", .handler = cmd_stats },
+    { .name = "stacks", .handler = cmd_stacks },
+    { .name = "log", .handler = cmd_dump_log },
+    { .name = "perf", .handler = cmd_perf },
+    { .name = "locks", .handler = cmd_locks },
+    { .name = "prof", .handler = cmd_prof },
+    { .name = "capture", .handler = cmd_capture },
+    { .name = "soak", .handler = cmd_soak },
+};
+
+/**
+ * Commands that can only be run once networking has been started
+ */
+static const struct command_table_entry g_networking_commands[] = {
+    { .name = "set", .handler = cmd_set },
+    { .name = "get", .handler = cmd_get },
+    { .name = "ping", .handler = cmd_ping },
+    { .name = "sntp", .handler = cmd_sntp },
+    { .name = "beacon", .handler = cmd_beacon },
+    { .name = "dns", .handler = cmd_dns },
+    { .name = "bench", .handler = cmd_bench },
+};
+
+static struct command_table g_command_table;
+
+static struct command_table g_networking_command_table;
+
+
+static void command_parser(int argc, const char *argv[])
+{
+    if (argc == 0) {
+        return;
+    }
+
+    console_putchar('\n');
+    if (command_table_dispatch(&g_command_table, argc, argv)) {
+        return;
+    }
+
+    const struct command_table_entry *entry_p =
+        command_table_lookup(&g_networking_command_table, argv[0]);
+
+    if (entry_p == NULL) {
         console_printf("The command '%s' is not recognized\n",
                        argv[0]);
+    } else if (!g_networking_started) {
+        console_printf("Networking is still starting, try again later\n");
+    } else {
+        entry_p->handler(argc - 1, argv + 1);
+    }
+}
+
+
+/**
+ * Builds the hash tables of all command tables
+ */
+static void init_command_tables(void)
+{
+    command_table_init(&g_command_table, g_commands, ARRAY_SIZE(g_commands));
+    command_table_init(&g_networking_command_table, g_networking_commands,
+                       ARRAY_SIZE(g_networking_commands));
+    command_table_init(&g_set_command_table, g_set_commands,
+                       ARRAY_SIZE(g_set_commands));
+    command_table_init(&g_trace_command_table, g_trace_commands,
+                       ARRAY_SIZE(g_trace_commands));
+    command_table_init(&g_udp_led_color_command_table, g_udp_led_color_commands,
+                       ARRAY_SIZE(g_udp_led_color_commands));
+}
+
+
+/**
+ * Client of the remote console whose command is being run
+ */
+struct remote_console_client {
+    struct ipv4_address ip_addr;
+    uint16_t port; /* big endian */
+};
+
+
+/**
+ * Flush function for the format span where the console output of remote
+ * console commands is redirected. It sends the output to the client.
+ */
+static void remote_console_span_flush(struct format_span *span_p)
+{
+    const struct remote_console_client *client_p = span_p->flush_arg_p;
+
+    if (span_p->length != 0) {
+        error_t error =
+            net_layer4_send_large_udp_datagram_over_ipv4(&g_remote_console_end_point,
+                                                         &client_p->ip_addr,
+                                                         client_p->port,
+                                                         span_p->buffer_p,
+                                                         span_p->length);
+        if (error != 0) {
+            console_printf_non_blocking("ERROR: sending remote console output failed (error %#x)\n",
+                                        error);
+        }
     }
+
+    span_p->length = 0;
 }
 
 
 /**
- * Low priority task that checks the stacks of all tasks continuously.
+ * Remote console task. Each UDP datagram received on REMOTE_CONSOLE_UDP_PORT
+ * is run as a command line, by the same parser as the serial console. The
+ * command output is sent back to the client, followed by an empty datagram
+ * that marks its end.
  */
-static void stacks_checker_task_func(void *arg)
+static void remote_console_task_func(void *arg)
 {
+    static char output_buffer[REMOTE_CONSOLE_OUTPUT_CHUNK_SIZE];
+    char line[REMOTE_CONSOLE_LINE_MAX_SIZE];
+    struct remote_console_client client;
+    struct format_span span;
+    error_t error;
+
     D_ASSERT(arg == NULL);
 
+    mem_arena_init(&g_remote_console_scratch_arena, "remote console scratch",
+                   g_remote_console_scratch_storage,
+                   sizeof g_remote_console_scratch_storage);
+    rtos_task_set_scratch_arena(&g_remote_console_task,
+                                &g_remote_console_scratch_arena);
+
+    net_layer4_udp_end_point_init(&g_remote_console_end_point);
+    error = net_layer4_udp_end_point_bind(&g_remote_console_end_point,
+                                          hton16(REMOTE_CONSOLE_UDP_PORT));
+    if (error != 0) {
+        console_printf("ERROR: binding remote console to port %u failed (error %#x)\n",
+                       REMOTE_CONSOLE_UDP_PORT, error);
+        goto exit;
+    }
+
     for ( ; ; ) {
-        for (uint8_t i = 0; i < NUM_APP_TASKS; i++) {
-            struct rtos_task *task_p = g_all_app_tasks[i];
+        struct network_packet *rx_packet_p = NULL;
 
-            if (task_p->tsk_created) {
-                rtos_task_check_stack(task_p);
-            }
+        error = net_layer4_receive_udp_datagram_over_ipv4(&g_remote_console_end_point,
+                                                          0,
+                                                          &client.ip_addr,
+                                                          &client.port,
+                                                          &rx_packet_p);
+        if (error != 0) {
+            console_printf_non_blocking("ERROR: receiving remote console datagram failed (error %#x)\n",
+                                        error);
+            goto exit;
+        }
+
+        size_t line_length = get_ipv4_udp_data_payload_length(rx_packet_p);
+
+        if (line_length > sizeof line - 1) {
+            line_length = sizeof line - 1;
+        }
+
+        memcpy(line, get_ipv4_udp_data_payload_area(rx_packet_p), line_length);
+        net_recycle_rx_packet(rx_packet_p);
+
+        /*
+         * Strip the line terminator, if any:
+         */
+        while (line_length != 0 &&
+               (line[line_length - 1] == '\n' || line[line_length - 1] == '\r')) {
+            line_length --;
         }
 
-        rtos_task_delay(STACKS_CHECKING_PERIOD_MS);
+        line[line_length] = '\0';
+
+        format_span_init(&span, output_buffer, sizeof output_buffer,
+                         remote_console_span_flush, &client);
+        console_lock();
+        console_redirect_output(&span);
+        command_line_execute(line, command_parser);
+        format_span_flush(&span);
+        console_redirect_output(NULL);
+        console_unlock();
+
+        /*
+         * Empty datagram to tell the client that the command is done:
+         */
+        error = net_layer4_send_large_udp_datagram_over_ipv4(&g_remote_console_end_point,
+                                                             &client.ip_addr,
+                                                             client.port,
+                                                             output_buffer, 0);
+        if (error != 0) {
+            console_printf_non_blocking("ERROR: sending remote console datagram failed (error %#x)\n",
+                                        error);
+        }
     }
+
+exit:
+    console_printf("Task %s terminated\n", rtos_task_self()->tsk_name_p);
 }
 
 
 /**
- * Hearbeat timer callback. It toggles the heartbeat LED
+ * Networking bring-up work item function. It runs once on
+ * g_housekeeping_work_queue, right after boot, so that the command line
+ * does not have to wait for the Ethernet PHY and the networking tasks
+ * to be initialized.
  */
-static void heartbeat_timer_callback(struct rtos_timer *timer_p, void *arg)
+static void networking_bringup_work_func(struct work_item *work_item_p, void *arg)
 {
-    D_ASSERT(timer_p->tmr_signature == TIMER_SIGNATURE);
-    volatile led_color_t *led_color_p = arg;
+    error_t error;
+    uint32_t phase_begin_cycles = get_cpu_clock_cycles();
+
+    D_ASSERT(work_item_p == &g_networking_bringup_work_item);
+    D_ASSERT(arg == NULL);
+
+    networking_init();
+
+    /*
+     * Set default local IPv4 address:
+     */
+    net_layer3_set_local_ipv4_address(&g_local_ipv4_addr, 24);
+
+    error = ota_receiver_start();
+    if (error != 0) {
+        console_printf("ERROR: starting OTA receiver failed (error %#x)\n", error);
+    }
+
+    rtos_task_create(&g_udp_server_task,
+                        "UDP server task",
+                        udp_server_task_func,
+                        NULL,
+                        RTOS_TASK_PRIORITY_LOWER(HIGHEST_APP_TASK_PRIORITY, 3));
+
+    /*
+     * The remote console runs commands at the same priority as the serial
+     * command line:
+     */
+    rtos_task_create(&g_remote_console_task,
+                     "Remote console task",
+                     remote_console_task_func,
+                     NULL,
+                     RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
+
+    g_networking_started = true;
+    boot_phase_end("Networking (in background)", phase_begin_cycles);
+
+    /*
+     * Draw the network stats display right away, rather than one
+     * period from now:
+     */
+    (void)work_queue_post(&g_housekeeping_work_queue,
+                          &g_network_stats_work_item,
+                          WORK_ITEM_PRIORITY_NORMAL);
+    rtos_timer_start(&g_network_stats_timer);
+}
+
 
-    color_led_toggle(*led_color_p);
+/**
+ * Callback of the periodic timers that post the housekeeping work items.
+ * It runs in ISR context (see rtos_timer_init_isr_context()), as posting a
+ * work item does not block.
+ */
+static void housekeeping_timer_callback(struct rtos_timer *timer_p, void *arg)
+{
+    struct work_item *work_item_p = arg;
+
+    D_ASSERT(timer_p->tmr_signature == TIMER_SIGNATURE);
+    (void)work_queue_post(&g_housekeeping_work_queue, work_item_p,
+                          WORK_ITEM_PRIORITY_NORMAL);
 }
 
 
-static void init_heartbeat_timer(void)
+/**
+ * Starts the housekeeping work queue, and the periodic timers that post
+ * its work items
+ */
+static void init_housekeeping_work_queue(void)
 {
-    rtos_timer_init(&g_heartbeat_timer, "Heartbeat timer", HEARTBEAT_PERIOD_MS,
-                    true, heartbeat_timer_callback, (void *)&g_heartbeat_led_color);
+    work_queue_init(&g_housekeeping_work_queue, "Housekeeping worker task");
+    work_item_init(&g_networking_bringup_work_item, networking_bringup_work_func,
+                   NULL);
+    work_item_init(&g_network_stats_work_item, network_stats_work_func,
+                   &g_network_stats_state);
+    work_queue_start(&g_housekeeping_work_queue, &g_housekeeping_worker_task,
+                     1, RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
 
-    rtos_timer_start(&g_heartbeat_timer);
+    /*
+     * NOTE: The worker task cannot run before its scratch arena is set, as
+     * the calling task (main task) has a higher priority.
+     */
+    mem_arena_init(&g_housekeeping_scratch_arena, "housekeeping scratch",
+                   g_housekeeping_scratch_storage,
+                   sizeof g_housekeeping_scratch_storage);
+    rtos_task_set_scratch_arena(&g_housekeeping_worker_task,
+                                &g_housekeeping_scratch_arena);
+
+    rtos_timer_init_isr_context(&g_network_stats_timer, "Network stats timer",
+                                NETWORK_STATS_POLLING_PERIOD_MS * 1000, true,
+                                housekeeping_timer_callback,
+                                &g_network_stats_work_item);
+
+    (void)work_queue_post(&g_housekeeping_work_queue,
+                          &g_networking_bringup_work_item,
+                          WORK_ITEM_PRIORITY_NORMAL);
 }
 
 
@@ -989,6 +3751,11 @@ static void main_task_func(void *arg)
 {
     D_ASSERT(arg == NULL);
 
+    mem_arena_init(&g_main_task_scratch_arena, "main task scratch",
+                   g_main_task_scratch_storage,
+                   sizeof g_main_task_scratch_storage);
+    rtos_task_set_scratch_arena(&g_main_task, &g_main_task_scratch_arena);
+
     /*
      * Initializes uCOSIII uC/CPU services:
      *
@@ -1006,18 +3773,35 @@ static void main_task_func(void *arg)
     rtos_tick_timer_init();
 
     /*
-     * Initialize devices used:
+     * Initialize devices used, console first, so that the command line is
+     * usable as soon as possible:
      */
+    uint32_t phase_begin_cycles = get_cpu_clock_cycles();
+
     pin_config_init();
-    color_led_init();
     console_init(&g_console_output_task);
+    boot_phase_end("Pins and console", phase_begin_cycles);
+
+    phase_begin_cycles = get_cpu_clock_cycles();
+    color_led_init();
+    perf_probes_init();
+    sampling_profiler_init();
+    hr_timer_service_init();
+    dma_memcpy_init();
+    serial_channel_init(&g_telemetry_channel, &g_uart_devices[4],
+                        TELEMETRY_CHANNEL_UART_BAUD,
+                        &g_telemetry_channel_output_task,
+                        "Telemetry channel output task");
     nor_flash_init();
-    networking_init();
+    nor_flash_kv_store_init(&g_nor_flash_kv_store,
+                            NOR_FLASH_KV_STORE_SECTOR0_ADDR,
+                            NOR_FLASH_KV_STORE_SECTOR1_ADDR);
 
     /*
-     * Start timer for heartbeat LED:
+     * Start heartbeat LED:
      */
-    init_heartbeat_timer();
+    heartbeat_set_led_color(LED_COLOR_BLUE);
+    boot_phase_end("Other devices and flash", phase_begin_cycles);
 
     /*
      * Display greeting:
@@ -1027,39 +3811,28 @@ static void main_task_func(void *arg)
                    "Reference solution\n");
 
     /*
-     * Set default local IPv4 address:
+     * The UDP server uses command tables too, so they are built before
+     * the networking stack is brought up:
      */
-    net_layer3_set_local_ipv4_address(&g_local_ipv4_addr, 24);
+    init_command_tables();
 
     /*
-     * Create other tasks:
+     * Create other tasks. The networking stack is brought up by the
+     * housekeeping worker task, in the background:
      */
-    rtos_task_create(&g_network_stats_task,
-                     "Network stats display task",
-                     network_stats_task_func,
-                     NULL,
-                     LOWEST_APP_TASK_PRIORITY - 1);
-
-    rtos_task_create(&g_stacks_checker_task,
-                     "Stacks checker task",
-                     stacks_checker_task_func,
-                     NULL,
-                     LOWEST_APP_TASK_PRIORITY);
+    init_housekeeping_work_queue();
 
-    rtos_task_create(&g_udp_server_task,
-                        "UDP server task",
-                        udp_server_task_func,
-                        NULL,
-                        HIGHEST_APP_TASK_PRIORITY + 3);
     /*
      * Handle command-line input at a lower priority:
      */
 
-    rtos_task_change_self_priority(LOWEST_APP_TASK_PRIORITY - 1);
+    rtos_task_change_self_priority(
+        RTOS_TASK_PRIORITY_HIGHER(LOWEST_APP_TASK_PRIORITY, 1));
     console_lock();
-    console_set_scroll_region(22, 0);
-    console_set_cursor_and_attributes(22, 1, 0, false);
+    console_set_scroll_region(25, 0);
+    console_set_cursor_and_attributes(25, 1, 0, false);
     command_line_init("lab2>", command_parser);
+    command_line_set_frame_handler(command_frame_handler);
     console_unlock();
 
     for ( ; ; ) {
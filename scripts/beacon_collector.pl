@@ -0,0 +1,159 @@
+#!/usr/bin/perl
+#
+# Collector of the telemetry beacons that boards send to an IPv4 multicast
+# group (the 'beacon' command of networking-labs/lab3-layers2and1/Sources/main.c,
+# see building-blocks/telemetry_beacon.h). It joins the group and prints
+# each beacon received as a one-line JSON record, prefixed with the host
+# time and the board's source IPv4 address. Beacons lost in transit, and
+# board resets, are detected from the beacons' sequence numbers, for each
+# board separately.
+#
+# Invocation syntax:
+# beacon_collector.pl [<multicast group IPv4 address> [<UDP port> [<local interface IPv4 address>]]]
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+use IO::Socket::INET;
+use Socket qw(IPPROTO_IP IP_ADD_MEMBERSHIP INADDR_ANY inet_aton inet_ntoa
+              pack_ip_mreq sockaddr_in);
+use Time::HiRes qw(time);
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME [<multicast group IPv4 address> [<UDP port> [<local interface IPv4 address>]]]";
+
+#
+# Default multicast group and UDP port of the beacons
+# (TELEMETRY_BEACON_DEFAULT_GROUP_ADDR_INITIALIZER and
+# TELEMETRY_BEACON_DEFAULT_PORT in telemetry_beacon.h)
+#
+my $DEFAULT_GROUP = "239.255.0.1";
+my $DEFAULT_PORT = 8894;
+
+#
+# Magic number, version and length of a beacon (struct telemetry_beacon)
+#
+my $BEACON_MAGIC = 0x544c4d42;  # 'TLMB'
+my $BEACON_VERSION = 1;
+my $BEACON_SIZE = 84;
+
+#
+# Layout of a beacon, as an unpack() template
+#
+my $BEACON_TEMPLATE = "N C C n N N a6 n N9 n6 N3";
+
+#
+# Value of the cpu_load field when the CPU load could not be measured
+#
+my $CPU_LOAD_UNKNOWN = 0xffff;
+
+#
+# Sequence number of the last beacon received from each board, by MAC
+# address
+#
+my %last_seq_nums;
+
+sub format_beacon {
+    my ($source_ip_addr, $datagram) = @_;
+    my ($magic, $version, $flags, $period_ms, $seq_num, $uptime_sec, $mac_addr,
+        $cpu_load, @fields) = unpack($BEACON_TEMPLATE, $datagram);
+    my ($l2_rx, $l2_drop, $l2_tx, $ip_rx, $ip_drop, $ip_tx,
+        $udp_rx, $udp_drop, $udp_tx,
+        $tx_total, $tx_free, $tx_hwm, $rx_total, $rx_free, $rx_hwm,
+        $max_irq_off_us, $max_timer_late_us, $max_isr_us) = @fields;
+
+    return undef if $magic != $BEACON_MAGIC || $version != $BEACON_VERSION;
+
+    my $mac = join(":", map { sprintf("%02x", $_) } unpack("C6", $mac_addr));
+    my $lost = 0;
+    my $reset = 0;
+
+    if (exists $last_seq_nums{$mac}) {
+        my $gap = ($seq_num - $last_seq_nums{$mac} - 1) & 0xffffffff;
+
+        if ($seq_num <= $last_seq_nums{$mac}) {
+            $reset = 1;
+        } else {
+            $lost = $gap;
+        }
+    }
+
+    $last_seq_nums{$mac} = $seq_num;
+
+    my $cpu_load_str = ($cpu_load == $CPU_LOAD_UNKNOWN) ?
+                       "null" : sprintf("%.2f", $cpu_load / 100);
+
+    return sprintf("{\"host_time\":%.3f,\"ip\":\"%s\",\"mac\":\"%s\"," .
+                   "\"seq\":%u,\"lost\":%u,\"reset\":%s,\"period_ms\":%u," .
+                   "\"uptime_sec\":%u,\"link_up\":%s,\"cpu_load_pct\":%s," .
+                   "\"layer2\":{\"rx\":%u,\"dropped\":%u,\"tx\":%u}," .
+                   "\"ipv4\":{\"rx\":%u,\"dropped\":%u,\"tx\":%u}," .
+                   "\"udp\":{\"rx\":%u,\"dropped\":%u,\"tx\":%u}," .
+                   "\"tx_pool\":{\"total\":%u,\"free\":%u,\"hwm\":%u}," .
+                   "\"rx_pool\":{\"total\":%u,\"free\":%u,\"hwm\":%u}," .
+                   "\"max_irq_off_us\":%u,\"max_timer_late_us\":%u," .
+                   "\"max_isr_us\":%u}",
+                   time(), $source_ip_addr, $mac, $seq_num, $lost,
+                   $reset ? "true" : "false", $period_ms, $uptime_sec,
+                   ($flags & 0x1) ? "true" : "false", $cpu_load_str,
+                   $l2_rx, $l2_drop, $l2_tx, $ip_rx, $ip_drop, $ip_tx,
+                   $udp_rx, $udp_drop, $udp_tx,
+                   $tx_total, $tx_free, $tx_hwm, $rx_total, $rx_free, $rx_hwm,
+                   $max_irq_off_us, $max_timer_late_us, $max_isr_us);
+}
+
+#
+# Main program
+#
+{
+    if (@ARGV > 3) {
+        my $num_args = @ARGV;
+        die "*** Error: Invalid number of arguments: $num_args (@ARGV)\n$USAGE_STR\n";
+    }
+
+    my ($group, $port, $local_if_addr) = @ARGV;
+
+    $group //= $DEFAULT_GROUP;
+    $port //= $DEFAULT_PORT;
+
+    my $group_addr = inet_aton($group) or
+        die "$PROG_NAME: *** Error: invalid multicast group address: $group\n";
+    my $local_if = defined $local_if_addr ? inet_aton($local_if_addr) : INADDR_ANY;
+
+    defined $local_if or
+        die "$PROG_NAME: *** Error: invalid local interface address: $local_if_addr\n";
+
+    my $socket = IO::Socket::INET->new(LocalPort => $port,
+                                       Proto => "udp",
+                                       ReuseAddr => 1) or
+        die "$PROG_NAME: *** Error: opening UDP socket on port $port failed: $!\n";
+
+    setsockopt($socket, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+               pack_ip_mreq($group_addr, $local_if)) or
+        die "$PROG_NAME: *** Error: joining multicast group $group failed: $!\n";
+
+    $| = 1;
+    for ( ; ; ) {
+        my $datagram;
+        my $peer = $socket->recv($datagram, 1500);
+
+        next if !defined $peer || length($datagram) < $BEACON_SIZE;
+
+        my (undef, $source_addr) = sockaddr_in($peer);
+        my $record = format_beacon(inet_ntoa($source_addr), $datagram);
+
+        if (!defined $record) {
+            print STDERR "$PROG_NAME: ignoring invalid beacon from " .
+                         inet_ntoa($source_addr) . "\n";
+            next;
+        }
+
+        print "$record\n";
+    }
+}
@@ -0,0 +1,144 @@
+#!/usr/bin/perl
+#
+# Tool to report how the copies of each building block have diverged across
+# the labs of the repository. For every file found in the Sources/building-blocks
+# directory of more than one lab, it groups the labs whose copies are the same
+# (ignoring line endings), so that a fix made in one lab can be ported to the
+# labs that share the same version of the file, and the labs that need a
+# manual merge can be spotted.
+#
+# Invocation syntax:
+# building_blocks_report.pl [-d] [<building block file name> ...]
+#
+# -d: print only the files that are not the same in all the labs that have
+#     a copy of them
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+use File::Find;
+use File::Spec;
+use Digest::MD5 qw(md5_hex);
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME [-d] [<building block file name> ...]";
+
+#
+# Top-level directory of the repository
+#
+my $REPO_DIR = File::Spec->rel2abs(dirname($0) . "/..");
+
+#
+# Finds the building-blocks directories of all the labs
+#
+# Returns a reference to a hash that maps each lab name to its
+# building-blocks directory
+#
+sub find_labs {
+    my %labs;
+
+    find({ wanted => sub {
+               return unless -d $_ && $_ eq "building-blocks" &&
+                             basename($File::Find::dir) eq "Sources";
+
+               my $lab_dir = dirname($File::Find::dir);
+               my $lab_name = File::Spec->abs2rel($lab_dir, $REPO_DIR);
+
+               $labs{$lab_name} = $File::Find::name;
+               $File::Find::prune = 1;
+           },
+           no_chdir => 0 },
+         $REPO_DIR);
+
+    return \%labs;
+}
+
+#
+# Computes the digest of a source file, ignoring line endings
+#
+sub source_digest {
+    my ($file_path) = @_;
+
+    open(my $fh, "<", $file_path) or
+        die "$PROG_NAME: *** Error: cannot open $file_path: $!\n";
+    binmode($fh);
+    local $/;
+    my $contents = <$fh>;
+    close($fh);
+
+    $contents =~ s/\r\n/\n/g;
+    return md5_hex($contents);
+}
+
+#
+# Main program
+#
+{
+    my $only_diverged = 0;
+
+    if (@ARGV != 0 && $ARGV[0] eq "-d") {
+        $only_diverged = 1;
+        shift @ARGV;
+    }
+
+    if (grep { /^-/ } @ARGV) {
+        die "*** Error: Invalid arguments: @ARGV\n$USAGE_STR\n";
+    }
+
+    my $labs_ref = find_labs();
+    my %copies;
+
+    for my $lab_name (sort keys %$labs_ref) {
+        my $dir = $labs_ref->{$lab_name};
+
+        opendir(my $dh, $dir) or
+            die "$PROG_NAME: *** Error: cannot open $dir: $!\n";
+        for my $file_name (grep { /\.[ch]$/ && -f "$dir/$_" } readdir($dh)) {
+            push @{$copies{$file_name}{source_digest("$dir/$file_name")}},
+                 $lab_name;
+        }
+
+        closedir($dh);
+    }
+
+    my @file_names = (@ARGV != 0) ? @ARGV : sort keys %copies;
+    my $num_shared = 0;
+    my $num_diverged = 0;
+
+    for my $file_name (@file_names) {
+        my $versions_ref = $copies{$file_name};
+
+        if (!defined $versions_ref) {
+            print STDERR "$PROG_NAME: $file_name not found in any lab\n";
+            next;
+        }
+
+        my @versions = sort { @{$versions_ref->{$b}} <=> @{$versions_ref->{$a}} }
+                       keys %$versions_ref;
+        my $num_copies = 0;
+
+        $num_copies += @{$versions_ref->{$_}} for @versions;
+        next if $num_copies < 2 && @ARGV == 0;
+
+        $num_shared ++;
+        $num_diverged ++ if @versions > 1;
+        next if $only_diverged && @versions == 1;
+
+        printf("%s: %u copies, %u versions\n", $file_name, $num_copies,
+               scalar(@versions));
+        for (my $i = 0; $i < @versions; $i ++) {
+            printf("\tversion %u: %s\n", $i + 1,
+                   join(", ", @{$versions_ref->{$versions[$i]}}));
+        }
+    }
+
+    printf("%u of %u shared building blocks have diverged\n", $num_diverged,
+           $num_shared) if @ARGV == 0;
+    exit 0;
+}
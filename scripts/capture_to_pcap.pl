@@ -0,0 +1,94 @@
+#!/usr/bin/perl
+#
+# Tool to convert a packet capture dump (output of the 'capture dump'
+# console command) to a pcap file, which can be opened with Wireshark or
+# read with 'tcpdump -r'
+#
+# Invocation syntax:
+# capture_to_pcap.pl <text file with capture dump> <output pcap file>
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+no warnings "portable";
+use File::Basename;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <capture dump file> <pcap file>";
+
+#
+# pcap global header fields (microsecond timestamps, Ethernet link type)
+#
+my $PCAP_MAGIC = 0xa1b2c3d4;
+my $PCAP_VERSION_MAJOR = 2;
+my $PCAP_VERSION_MINOR = 4;
+my $PCAP_LINKTYPE_ETHERNET = 1;
+
+#
+# Main program
+#
+{
+    my ($capture_dump_file, $pcap_file);
+    my @frames;
+    my $snap_length;
+    my $in_capture = 0;
+
+    if (@ARGV != 2) {
+        my $num_args = @ARGV;
+        die "*** Error: Invalid number of arguments: $num_args (@ARGV)\n$USAGE_STR\n";
+    }
+
+    ($capture_dump_file, $pcap_file) = @ARGV;
+
+    open my $in_handle, "<", $capture_dump_file or
+        die "$PROG_NAME: *** Error: opening $capture_dump_file failed\n";
+
+    while (<$in_handle>) {
+        s/\r//g;
+        if (/PCAP BEGIN snaplen=(\d+)/) {
+            $in_capture = 1;
+            $snap_length = $1;
+            @frames = ();
+        } elsif (!$in_capture) {
+            next;
+        } elsif (/PCAP END/) {
+            $in_capture = 0;
+        } elsif (/^FRAME ([0-9a-fA-F]+) (rx|tx) (\d+) ([0-9a-fA-F]*)/) {
+            push @frames, { timestamp_ns => hex($1), frame_length => $3,
+                            data => pack("H*", $4) };
+        }
+    }
+
+    close $in_handle;
+    if (!defined $snap_length) {
+        die "$PROG_NAME: *** Error: no capture dump found in $capture_dump_file\n";
+    }
+
+    open my $out_handle, ">:raw", $pcap_file or
+        die "$PROG_NAME: *** Error: creating $pcap_file failed\n";
+
+    print $out_handle pack("LSSlLLL", $PCAP_MAGIC, $PCAP_VERSION_MAJOR,
+                           $PCAP_VERSION_MINOR, 0, 0, $snap_length,
+                           $PCAP_LINKTYPE_ETHERNET);
+
+    #
+    # Timestamps are nanoseconds since boot of the board:
+    #
+    for my $frame (@frames) {
+        my $timestamp_us = int($frame->{timestamp_ns} / 1000);
+
+        print $out_handle pack("LLLL", int($timestamp_us / 1000000),
+                               $timestamp_us % 1000000,
+                               length($frame->{data}), $frame->{frame_length});
+        print $out_handle $frame->{data};
+    }
+
+    close $out_handle;
+    printf("%u frames written to %s\n", scalar(@frames), $pcap_file);
+    exit 0;
+}
@@ -0,0 +1,84 @@
+#!/usr/bin/perl
+#
+# Tool to collect the JSON stats records of a board, by sending "stats"
+# datagrams to the board's UDP server. Each record received is printed on
+# its own line, prefixed with the host time and the firmware build label
+# given in the command line, so that the output of runs for different
+# firmware builds can be compared.
+#
+# Invocation syntax:
+# collect_stats.pl <board IPv4 address> <build label> [<period in seconds> [<count>]]
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+use IO::Socket::INET;
+use IO::Select;
+use Time::HiRes qw(time sleep);
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <board IPv4 address> <build label> [<period in seconds> [<count>]]";
+
+#
+# UDP port of the board's UDP server
+#
+my $UDP_SERVER_PORT = 8887;
+
+#
+# Maximum length of a JSON stats record (STATS_JSON_MAX_SIZE in main.c)
+#
+my $STATS_JSON_MAX_SIZE = 3072;
+
+#
+# Seconds to wait for the reply to a "stats" datagram
+#
+my $REPLY_TIMEOUT = 2.0;
+
+#
+# Main program
+#
+{
+    if (@ARGV < 2 || @ARGV > 4) {
+        my $num_args = @ARGV;
+        die "*** Error: Invalid number of arguments: $num_args (@ARGV)\n$USAGE_STR\n";
+    }
+
+    my ($board_ip_addr, $build_label, $period, $count) = @ARGV;
+
+    $period //= 0;
+    $count //= ($period > 0) ? 0 : 1;
+    if ($build_label =~ /["\\]/) {
+        die "$PROG_NAME: *** Error: build label cannot contain '\"' or '\\'\n";
+    }
+
+    my $socket = IO::Socket::INET->new(PeerAddr => $board_ip_addr,
+                                       PeerPort => $UDP_SERVER_PORT,
+                                       Proto => "udp") or
+        die "$PROG_NAME: *** Error: opening UDP socket to $board_ip_addr failed: $!\n";
+    my $select = IO::Select->new($socket);
+
+    $| = 1;
+    for (my $i = 0; $count == 0 || $i < $count; $i ++) {
+        my $record;
+
+        sleep($period) if $i != 0;
+        $socket->send("stats");
+        if (!$select->can_read($REPLY_TIMEOUT) ||
+            !defined $socket->recv($record, $STATS_JSON_MAX_SIZE)) {
+            print STDERR "$PROG_NAME: no reply from $board_ip_addr\n";
+            next;
+        }
+
+        $record =~ s/\s+$//;
+        printf("{\"host_time\":%.3f,\"build\":\"%s\",\"board\":%s}\n",
+               time(), $build_label, $record);
+    }
+
+    exit 0;
+}
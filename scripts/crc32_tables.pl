@@ -0,0 +1,123 @@
+#!/usr/bin/perl
+#
+# Tool to generate the lookup tables used by the table-driven
+# implementations of mem_checksum() (crc32_tables.c in building-blocks)
+#
+# Invocation syntax:
+# crc32_tables.pl > crc32_tables.c
+#
+# The tables are for the CRC-32 variant computed by mem_checksum(): bits are
+# processed LSB first, shifting the CRC right and XORing in the polynomial
+# 0x04c11db7 as is (not bit-reversed). Table 0 gives the effect of shifting
+# one byte through the CRC register, and table k gives the effect of
+# shifting a byte followed by k zero bytes, as needed by slice-by-N.
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME > crc32_tables.c";
+
+my $CRC_32_POLYNOMIAL = 0x04c11db7;
+
+#
+# Number of slice-by-N tables generated (slice-by-8 needs 8)
+#
+my $NUM_TABLES = 8;
+
+#
+# Shifts the given number of bits of zeros through a CRC register value
+#
+sub crc_shift_bits {
+    my ($crc, $num_bits) = @_;
+
+    for (my $i = 0; $i < $num_bits; $i++) {
+        if ($crc & 1) {
+            $crc = ($crc >> 1) ^ $CRC_32_POLYNOMIAL;
+        } else {
+            $crc >>= 1;
+        }
+    }
+
+    return $crc;
+}
+
+sub print_table {
+    my ($entries_ref, $indent) = @_;
+    my @entries = @$entries_ref;
+
+    for (my $i = 0; $i < @entries; $i += 4) {
+        my $last = $i + 3 < $#entries ? $i + 3 : $#entries;
+
+        print $indent, join(", ", map { sprintf("0x%08x", $_) } @entries[$i .. $last]);
+        print $last == $#entries ? "\n" : ",\n";
+    }
+}
+
+die "$USAGE_STR\n" if @ARGV != 0;
+
+my @nibble_table = map { crc_shift_bits($_, 4) } (0 .. 15);
+my @tables;
+
+$tables[0] = [map { crc_shift_bits($_, 8) } (0 .. 255)];
+for (my $k = 1; $k < $NUM_TABLES; $k++) {
+    $tables[$k] = [map {
+        my $prev = $tables[$k - 1][$_];
+        ($prev >> 8) ^ $tables[0][$prev & 0xff];
+    } (0 .. 255)];
+}
+
+print <<"END";
+/**
+ * \@file crc32_tables.c
+ *
+ * Lookup tables for the table-driven implementations of mem_checksum()
+ *
+ * NOTE: This file is generated by scripts/$PROG_NAME. Do not edit it.
+ * Only the tables needed by MEM_CHECKSUM_CRC_ALGORITHM are compiled in.
+ *
+ * \@author German Rivera
+ */
+#include "mem_utils.h"
+
+#if MEM_CHECKSUM_CRC_ALGORITHM == MEM_CHECKSUM_CRC_NIBBLE_TABLE
+
+const uint32_t g_crc32_nibble_table[16] = {
+END
+print_table(\@nibble_table, "    ");
+print <<"END";
+};
+
+#elif MEM_CHECKSUM_CRC_ALGORITHM != MEM_CHECKSUM_CRC_BITWISE
+
+const uint32_t g_crc32_tables[MEM_CHECKSUM_CRC_NUM_TABLES][256] = {
+END
+
+for (my $k = 0; $k < $NUM_TABLES; $k++) {
+    if ($k == 1) {
+        print "#if MEM_CHECKSUM_CRC_NUM_TABLES >= 4\n";
+    } elsif ($k == 4) {
+        print "#if MEM_CHECKSUM_CRC_NUM_TABLES >= 8\n";
+    }
+
+    print "    [$k] = {\n";
+    print_table($tables[$k], "        ");
+    print "    },\n";
+
+    if ($k == 3 || $k == 7) {
+        print "#endif\n";
+    }
+}
+
+print <<"END";
+};
+
+#endif
+END
@@ -0,0 +1,70 @@
+#!/usr/bin/perl
+#
+# Tool to generate the lookup table used to compute the Ethernet MAC hash
+# table indices of MAC addresses (ethernet_crc32_table.c in building-blocks)
+#
+# Invocation syntax:
+# ethernet_crc32_table.pl > ethernet_crc32_table.c
+#
+# The table is for the CRC-32 computed by the Ethernet MAC to index its
+# GAUR/GALR and IAUR/IALR hash tables: the IEEE 802.3 CRC-32, with bits
+# processed LSB first, shifting the CRC right and XORing in the bit-reversed
+# polynomial 0xedb88320. Entry i gives the effect of shifting byte i through
+# the CRC register.
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME > ethernet_crc32_table.c";
+
+my $CRC_32_REVERSED_POLYNOMIAL = 0xedb88320;
+
+die "$USAGE_STR\n" if @ARGV != 0;
+
+my @table = map {
+    my $crc = $_;
+
+    for (my $i = 0; $i < 8; $i++) {
+        if ($crc & 1) {
+            $crc = ($crc >> 1) ^ $CRC_32_REVERSED_POLYNOMIAL;
+        } else {
+            $crc >>= 1;
+        }
+    }
+
+    $crc;
+} (0 .. 255);
+
+print <<"END";
+/**
+ * \@file ethernet_crc32_table.c
+ *
+ * Lookup table for computing the Ethernet MAC hash table index of a MAC
+ * address (see ethernet_mac_hash_index())
+ *
+ * NOTE: This file is generated by scripts/$PROG_NAME.
+ * Do not edit it.
+ *
+ * \@author German Rivera
+ */
+#include <stdint.h>
+
+const uint32_t g_ethernet_crc32_table[256] = {
+END
+
+for (my $i = 0; $i < @table; $i += 4) {
+    my $last = $i + 3 < $#table ? $i + 3 : $#table;
+
+    print "    ", join(", ", map { sprintf("0x%08x", $_) } @table[$i .. $last]);
+    print $last == $#table ? "\n" : ",\n";
+}
+
+print "};\n";
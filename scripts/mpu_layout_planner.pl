@@ -0,0 +1,190 @@
+#!/usr/bin/perl
+#
+# Tool to plan, at link time, the placement in SRAM of the data objects
+# that are protected with their own MPU data region (objects declared with
+# MPU_PROTECTED_DATA()), for ARMv7-M MPUs. It generates the linker script
+# fragment that memory_layout.ld includes in the .data output section.
+#
+# Invocation syntax:
+# mpu_layout_planner.pl <object or library files> > mpu_layout.ld
+#
+# An ARMv7-M MPU region must have a power-of-2 size and be aligned to its
+# size, but regions of 256 bytes or more are divided in 8 subregions that
+# can be disabled individually. So, an object of size S only needs to be
+# aligned to the subregion size of the smallest region that covers it, as
+# long as it does not cross a boundary of that region. Objects are packed
+# in those slots, largest regions first, and smaller objects are placed in
+# the subregions left unused by larger ones, instead of padding every
+# object to a power-of-2 size.
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <object or library files> > mpu_layout.ld";
+
+#
+# Minimum size (and alignment) of an MPU region and of a subregion
+#
+my $MPU_REGION_ALIGNMENT = 32;
+
+#
+# Smallest MPU region that has subregions
+#
+my $MPU_MIN_REGION_SIZE_WITH_SUBREGIONS = 256;
+
+my $NUM_SUBREGIONS = 8;
+
+my $SECTION_PREFIX = ".mpu_protected_data.";
+
+die "$USAGE_STR\n" if @ARGV == 0;
+
+my $objdump = $ENV{OBJDUMP} // "arm-none-eabi-objdump";
+
+sub round_up {
+    my ($value, $alignment) = @_;
+
+    return int(($value + $alignment - 1) / $alignment) * $alignment;
+}
+
+sub round_up_to_power_of_2 {
+    my ($value) = @_;
+    my $power_of_2 = $MPU_REGION_ALIGNMENT;
+
+    $power_of_2 *= 2 while $power_of_2 < $value;
+    return $power_of_2;
+}
+
+#
+# Collect the protected objects from the section headers of the input files
+#
+my %objects;
+
+open my $objdump_handle, "-|", "$objdump -h @ARGV" or
+    die "$PROG_NAME: *** Error: running $objdump failed\n";
+
+while (<$objdump_handle>) {
+    if (/^\s*\d+\s+\Q$SECTION_PREFIX\E(\S+)\s+([0-9a-fA-F]+)\s+\S+\s+\S+\s+\S+\s+2\*\*(\d+)/) {
+        my ($name, $size, $alignment) = ($1, hex($2), 2 ** $3);
+
+        die "$PROG_NAME: *** Error: $name defined more than once\n"
+            if exists $objects{$name};
+
+        $objects{$name} = { name => $name, size => $size,
+                            alignment => $alignment };
+    }
+}
+
+close $objdump_handle or
+    die "$PROG_NAME: *** Error: running $objdump failed\n";
+
+#
+# Compute the MPU slot of each object: the region that covers it, the
+# alignment of its first byte and the number of bytes that it takes
+#
+for my $object (values %objects) {
+    my $size = $object->{size} == 0 ? 1 : $object->{size};
+    my $region_size = round_up_to_power_of_2($size);
+    my $slot_alignment;
+
+    if ($region_size >= $MPU_MIN_REGION_SIZE_WITH_SUBREGIONS) {
+        $slot_alignment = $region_size / $NUM_SUBREGIONS;
+    } else {
+        $slot_alignment = $region_size;
+    }
+
+    if ($object->{alignment} > $slot_alignment) {
+        $slot_alignment = $object->{alignment};
+    }
+
+    $object->{region_size} = $region_size;
+    $object->{slot_alignment} = $slot_alignment;
+    $object->{slot_size} = round_up($size, $slot_alignment);
+}
+
+#
+# Place the objects, first-fit, largest regions first. Offsets are relative
+# to the start of the protected data area, which is aligned to the largest
+# region size.
+#
+my @placed;
+my $max_region_size = $MPU_REGION_ALIGNMENT;
+
+sub overlaps_placed_object {
+    my ($offset, $size) = @_;
+
+    for my $other (@placed) {
+        return 1 if $offset < $other->{offset} + $other->{slot_size} &&
+                    $other->{offset} < $offset + $size;
+    }
+
+    return 0;
+}
+
+for my $object (sort { $b->{region_size} <=> $a->{region_size} ||
+                       $b->{size} <=> $a->{size} ||
+                       $a->{name} cmp $b->{name} } values %objects) {
+    my $offset = 0;
+
+    for ( ; ; $offset += $object->{slot_alignment}) {
+        my $region_offset = $offset % $object->{region_size};
+
+        next if $region_offset + $object->{slot_size} > $object->{region_size} &&
+                $object->{slot_size} <= $object->{region_size};
+        last if !overlaps_placed_object($offset, $object->{slot_size});
+    }
+
+    $object->{offset} = $offset;
+    push @placed, $object;
+    if ($object->{region_size} > $max_region_size) {
+        $max_region_size = $object->{region_size};
+    }
+}
+
+@placed = sort { $a->{offset} <=> $b->{offset} } @placed;
+
+my $area_size = 0;
+my $used_bytes = 0;
+
+for my $object (@placed) {
+    my $end_offset = $object->{offset} + $object->{slot_size};
+
+    $area_size = $end_offset if $end_offset > $area_size;
+    $used_bytes += $object->{size};
+}
+
+$area_size = round_up($area_size, $MPU_REGION_ALIGNMENT);
+
+#
+# Generate the linker script fragment
+#
+print <<"END";
+/*
+ * MPU-protected data objects layout
+ *
+ * NOTE: This file is generated by scripts/$PROG_NAME.
+ * Do not edit it.
+ *
+ * Protected data area: $area_size bytes, $used_bytes bytes used by objects
+ */
+. = ALIGN($max_region_size);
+__mpu_protected_data_start = .;
+END
+
+for my $object (@placed) {
+    printf(". = __mpu_protected_data_start + 0x%x;\n", $object->{offset});
+    printf("KEEP(*(%s%s))\n", $SECTION_PREFIX, $object->{name});
+    printf("ASSERT(. <= __mpu_protected_data_start + 0x%x, " .
+           "\"%s grew after its MPU slot was planned\");\n",
+           $object->{offset} + $object->{slot_size}, $object->{name});
+}
+
+printf(". = __mpu_protected_data_start + 0x%x;\n", $area_size);
+print "__mpu_protected_data_end = .;\n";
@@ -0,0 +1,134 @@
+#!/usr/bin/perl
+#
+# Tool to convert a sampling profiler dump (output of the 'prof dump' console
+# command) to folded stacks, one line per distinct stack trace:
+#
+#   <outermost function>;...;<sampled function> <number of samples>
+#
+# which is the input format of flame graph tools, such as flamegraph.pl
+# (https://github.com/brendangregg/FlameGraph) or https://www.speedscope.app
+#
+# Invocation syntax:
+# profile_to_flamegraph.pl <ELF file> <text file with profile dump> > profile.folded
+#
+# Set the ADDR2LINE environment variable to use a different addr2line than
+# arm-none-eabi-addr2line.
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <ELF file> <profile dump file>";
+
+#
+# Lowest exception return value (see arm_cortex_m_defs.h). Samples with a
+# single exception return value are samples of code not running in a task.
+#
+my $CPU_EXC_RETURN_LOWEST = 0xffffffe1;
+
+#
+# Translates a list of code addresses to function names, with a single
+# addr2line invocation
+#
+sub addrs_to_function_names {
+    my ($elf_file, @addrs) = @_;
+    my $addr2line = $ENV{ADDR2LINE} // "arm-none-eabi-addr2line";
+    my $addr_list = join(" ", map { sprintf("%#x", $_) } @addrs);
+    my %names;
+
+    open my $handle, "-|", "$addr2line -e $elf_file -f -C $addr_list" or
+        die "$PROG_NAME: *** Error: running $addr2line on $elf_file failed\n";
+
+    for my $addr (@addrs) {
+        my $function_name = <$handle>;
+        my $file_line = <$handle>;
+
+        last if !defined $function_name || !defined $file_line;
+        chomp $function_name;
+        $names{$addr} = $function_name eq "??" ?
+                            sprintf("%#x", $addr) : $function_name;
+    }
+
+    close $handle;
+    return %names;
+}
+
+#
+# Main program
+#
+{
+    my ($elf_file, $profile_dump_file);
+    my @stacks;
+    my %addrs;
+    my $in_profile = 0;
+
+    if (@ARGV != 2) {
+        my $num_args = @ARGV;
+        die "*** Error: Invalid number of arguments: $num_args (@ARGV)\n$USAGE_STR\n";
+    }
+
+    ($elf_file, $profile_dump_file) = @ARGV;
+
+    open my $in_handle, "<", $profile_dump_file or
+        die "$PROG_NAME: *** Error: opening $profile_dump_file failed\n";
+
+    while (<$in_handle>) {
+        s/\r//g;
+        if (/PROFILE BEGIN/) {
+            $in_profile = 1;
+            @stacks = ();
+        } elsif (!$in_profile) {
+            next;
+        } elsif (/PROFILE END/) {
+            $in_profile = 0;
+        } elsif (/^STACK (\d+)((?: [0-9a-fA-F]+)+)/) {
+            my $count = $1;
+            my @stack = map { hex($_) } split(" ", $2);
+
+            push @stacks, { count => $count, addrs => \@stack };
+            for my $addr (@stack) {
+                $addrs{$addr} = 1 if $addr < $CPU_EXC_RETURN_LOWEST;
+            }
+        }
+    }
+
+    close $in_handle;
+    if (@stacks == 0) {
+        die "$PROG_NAME: *** Error: no profile dump found in $profile_dump_file\n";
+    }
+
+    my %names = addrs_to_function_names($elf_file, sort { $a <=> $b } keys %addrs);
+    my %folded_counts;
+
+    #
+    # Stacks are dumped starting with the sampled instruction. Folded stacks
+    # start with the outermost caller. Different stacks may fold to the same
+    # function names, as they can differ only in the call sites:
+    #
+    for my $stack (@stacks) {
+        my @frames = @{$stack->{addrs}};
+        my $folded;
+
+        if (@frames == 1 && $frames[0] >= $CPU_EXC_RETURN_LOWEST) {
+            $folded = "[not in a task]";
+        } else {
+            $folded = join(";", map { $names{$_} // sprintf("%#x", $_) }
+                                    reverse @frames);
+        }
+
+        $folded_counts{$folded} += $stack->{count};
+    }
+
+    for my $folded (sort keys %folded_counts) {
+        print "$folded $folded_counts{$folded}\n";
+    }
+
+    exit 0;
+}
@@ -0,0 +1,106 @@
+#!/usr/bin/perl
+#
+# Tool to run console commands on a board over UDP, through the board's
+# remote console. Each command line is sent in its own datagram, and the
+# command output is printed as it arrives, until the empty datagram that
+# marks its end.
+#
+# If a command is given in the command line, it is run and the tool exits.
+# Otherwise, command lines are read from standard input.
+#
+# Invocation syntax:
+# remote_console.pl <board IPv4 address> [<command> [<argument> ...]]
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+use IO::Socket::INET;
+use IO::Select;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <board IPv4 address> [<command> [<argument> ...]]";
+
+#
+# UDP port of the board's remote console (REMOTE_CONSOLE_UDP_PORT in main.c)
+#
+my $REMOTE_CONSOLE_PORT = 8886;
+
+#
+# Maximum length of a command line (REMOTE_CONSOLE_LINE_MAX_SIZE - 1 in
+# main.c)
+#
+my $COMMAND_LINE_MAX_LENGTH = 80;
+
+#
+# Maximum length of a datagram of command output
+#
+my $OUTPUT_DATAGRAM_MAX_SIZE = 65507;
+
+#
+# Seconds to wait for the next datagram of command output
+#
+my $REPLY_TIMEOUT = 5.0;
+
+#
+# Sends a command line to the board and prints its output
+#
+sub run_command {
+    my ($socket, $select, $command_line) = @_;
+    my $output;
+
+    if (length($command_line) > $COMMAND_LINE_MAX_LENGTH) {
+        print STDERR "$PROG_NAME: command line truncated to $COMMAND_LINE_MAX_LENGTH characters\n";
+    }
+
+    $socket->send($command_line);
+    for ( ; ; ) {
+        if (!$select->can_read($REPLY_TIMEOUT) ||
+            !defined $socket->recv($output, $OUTPUT_DATAGRAM_MAX_SIZE)) {
+            print STDERR "$PROG_NAME: no reply from the board\n";
+            return 0;
+        }
+
+        last if $output eq "";
+        print $output;
+    }
+
+    return 1;
+}
+
+#
+# Main program
+#
+{
+    if (@ARGV < 1) {
+        die "*** Error: Invalid number of arguments\n$USAGE_STR\n";
+    }
+
+    my ($board_ip_addr, @command) = @ARGV;
+
+    my $socket = IO::Socket::INET->new(PeerAddr => $board_ip_addr,
+                                       PeerPort => $REMOTE_CONSOLE_PORT,
+                                       Proto => "udp") or
+        die "$PROG_NAME: *** Error: opening UDP socket to $board_ip_addr failed: $!\n";
+    my $select = IO::Select->new($socket);
+
+    $| = 1;
+    if (@command != 0) {
+        exit(run_command($socket, $select, join(" ", @command)) ? 0 : 1);
+    }
+
+    print "$board_ip_addr> ";
+    while (my $command_line = <STDIN>) {
+        chomp $command_line;
+        run_command($socket, $select, $command_line) if $command_line ne "";
+        print "$board_ip_addr> ";
+    }
+
+    print "\n";
+    exit 0;
+}
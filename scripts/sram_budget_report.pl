@@ -0,0 +1,89 @@
+#!/usr/bin/perl
+#
+# Tool to print an SRAM budget report for an ELF file: how much of the
+# SRAM is taken by the statically allocated RTOS objects (task stacks and
+# control blocks, and timers), by the other statically allocated data and
+# by the largest symbols. It is run by the build after linking.
+#
+# Invocation syntax:
+# sram_budget_report.pl <ELF file> [<SRAM base address> <SRAM size in KB>]
+#
+# The default SRAM range is the one of the STM32F401 (0x20000000, 96KB).
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <ELF file> [<SRAM base address> <SRAM size in KB>]";
+
+#
+# Number of largest symbols listed in the report
+#
+my $NUM_TOP_SYMBOLS = 10;
+
+#
+# Data symbols that make up the RTOS object arena (see rtos_wrapper_FreeRTOS.c)
+#
+my $RTOS_ARENA_SYMBOL_REGEX = qr/^g_rtos_(task|timer)_arena$/;
+
+if (@ARGV != 1 && @ARGV != 3) {
+    die "$USAGE_STR\n";
+}
+
+my $elf_file = $ARGV[0];
+my $sram_base = (@ARGV == 3) ? hex($ARGV[1]) : 0x20000000;
+my $sram_size = ((@ARGV == 3) ? $ARGV[2] : 96) * 1024;
+my $nm = $ENV{NM} // "arm-none-eabi-nm";
+
+open my $nm_handle, "-|", "$nm -S $elf_file" or
+    die "$PROG_NAME: *** Error: running $nm on $elf_file failed\n";
+
+my $rtos_arena_bytes = 0;
+my $other_bytes = 0;
+my @sram_symbols;
+
+while (<$nm_handle>) {
+    if (/^([0-9a-fA-F]+)\s+([0-9a-fA-F]+)\s+[bBdD]\s+(\S+)/) {
+        my ($addr, $size, $name) = (hex($1), hex($2), $3);
+
+        next if $addr < $sram_base || $addr >= $sram_base + $sram_size;
+
+        push @sram_symbols, [$name, $size];
+        if ($name =~ $RTOS_ARENA_SYMBOL_REGEX) {
+            $rtos_arena_bytes += $size;
+        } else {
+            $other_bytes += $size;
+        }
+    }
+}
+
+close $nm_handle;
+
+my $total_bytes = $rtos_arena_bytes + $other_bytes;
+
+printf("SRAM budget for %s (%u bytes of SRAM):\n", basename($elf_file),
+       $sram_size);
+printf("  RTOS object arena: %8u bytes (%5.1f%%)\n", $rtos_arena_bytes,
+       100.0 * $rtos_arena_bytes / $sram_size);
+printf("  Other static data: %8u bytes (%5.1f%%)\n", $other_bytes,
+       100.0 * $other_bytes / $sram_size);
+printf("  Left for stacks:   %8d bytes (%5.1f%%)\n", $sram_size - $total_bytes,
+       100.0 * ($sram_size - $total_bytes) / $sram_size);
+
+print "Largest symbols in SRAM:\n";
+my @sorted_symbols = sort { $b->[1] <=> $a->[1] } @sram_symbols;
+splice(@sorted_symbols, $NUM_TOP_SYMBOLS) if @sorted_symbols > $NUM_TOP_SYMBOLS;
+for my $symbol (@sorted_symbols) {
+    printf("  %-40s %8u bytes\n", $symbol->[0], $symbol->[1]);
+}
+
+if ($total_bytes > $sram_size) {
+    die "$PROG_NAME: *** Error: static data does not fit in SRAM\n";
+}
@@ -0,0 +1,224 @@
+#!/usr/bin/perl
+#
+# Tool to convert an event trace dump (output of the 'trace dump' console
+# command) to a timeline in the Chrome trace event JSON format, which can be
+# opened with chrome://tracing or https://ui.perfetto.dev
+#
+# Invocation syntax:
+# trace_to_timeline.pl <text file with trace dump> [<ELF file>] > trace.json
+#
+# If the ELF file is given, the addresses of the semaphores and packet
+# queues in the trace are printed as symbol+offset.
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <trace dump file> [<ELF file>]";
+
+#
+# Task indices used in 'switch' events for tasks not created with
+# rtos_task_create() (must match trace_recorder.h)
+#
+my $TRACE_TASK_INDEX_IDLE = 0xff;
+my $TRACE_TASK_INDEX_RTOS_INTERNAL = 0xfe;
+
+#
+# Timeline track (thread id) for ISRs
+#
+my $ISR_TRACK = 1000;
+
+#
+# Sorted list of [address, name] of the data symbols of the ELF file
+#
+my @data_symbols;
+
+sub load_data_symbols {
+    my ($elf_file) = @_;
+    my $nm = $ENV{NM} // "arm-none-eabi-nm";
+
+    open my $nm_handle, "-|", "$nm -n $elf_file" or
+        die "$PROG_NAME: *** Error: running $nm on $elf_file failed\n";
+
+    while (<$nm_handle>) {
+        if (/^([0-9a-fA-F]+)\s+[bBdD]\s+(\S+)/) {
+            push @data_symbols, [hex($1), $2];
+        }
+    }
+
+    close $nm_handle;
+}
+
+sub addr_to_name {
+    my ($addr) = @_;
+    my $sym;
+
+    for my $entry (@data_symbols) {
+        last if $entry->[0] > $addr;
+        $sym = $entry;
+    }
+
+    if (!defined $sym) {
+        return sprintf("%#x", $addr);
+    }
+
+    my $offset = $addr - $sym->[0];
+
+    return $offset == 0 ? $sym->[1] : sprintf("%s+%#x", $sym->[1], $offset);
+}
+
+sub json_string {
+    my ($str) = @_;
+
+    $str =~ s/\\/\\\\/g;
+    $str =~ s/"/\\"/g;
+    return "\"$str\"";
+}
+
+#
+# Main program
+#
+{
+    my ($trace_dump_file, $elf_file);
+    my $cpu_mhz;
+    my %task_names = (
+        $TRACE_TASK_INDEX_IDLE => "RTOS idle task",
+        $TRACE_TASK_INDEX_RTOS_INTERNAL => "RTOS internal tasks",
+    );
+    my @events;
+    my $in_trace = 0;
+
+    if (@ARGV < 1 || @ARGV > 2) {
+        my $num_args = @ARGV;
+        die "*** Error: Invalid number of arguments: $num_args (@ARGV)\n$USAGE_STR\n";
+    }
+
+    ($trace_dump_file, $elf_file) = @ARGV;
+    if (defined $elf_file) {
+        load_data_symbols($elf_file);
+    }
+
+    open my $in_handle, "<", $trace_dump_file or
+        die "$PROG_NAME: *** Error: opening $trace_dump_file failed\n";
+
+    #
+    # Parse the trace dump, unwrapping the 32-bit cycle counts. Deltas are
+    # taken as signed, as an event recorded from an ISR can have an earlier
+    # timestamp than the event recorded right before it:
+    #
+    my ($last_raw_cycles, $cycles);
+
+    while (<$in_handle>) {
+        s/\r//g;
+        if (/TRACE BEGIN cpu_mhz=(\d+)/) {
+            $cpu_mhz = $1;
+            $in_trace = 1;
+            @events = ();
+            undef $last_raw_cycles;
+        } elsif (!$in_trace) {
+            next;
+        } elsif (/TRACE END/) {
+            $in_trace = 0;
+        } elsif (/^TASK (\d+) (.*)$/) {
+            $task_names{$1} = $2;
+        } elsif (/^EV ([0-9a-fA-F]+) (\w+) ([0-9a-fA-F]+) (\d+)/) {
+            my $raw_cycles = hex($1);
+
+            if (!defined $last_raw_cycles) {
+                $cycles = 0;
+            } else {
+                my $delta = ($raw_cycles - $last_raw_cycles) & 0xffffffff;
+
+                $delta -= 2**32 if $delta >= 2**31;
+                $cycles += $delta;
+            }
+
+            $last_raw_cycles = $raw_cycles;
+            push @events, { cycles => $cycles, type => $2,
+                            arg => hex($3), arg2 => $4 };
+        }
+    }
+
+    close $in_handle;
+    if (!defined $cpu_mhz) {
+        die "$PROG_NAME: *** Error: no trace dump found in $trace_dump_file\n";
+    }
+
+    @events = sort { $a->{cycles} <=> $b->{cycles} } @events;
+
+    #
+    # Generate the timeline: one track per task, with a slice for each
+    # interval the task was running, plus one track for ISRs. Semaphore and
+    # packet queue events are shown as instant events in the track of the
+    # task (or ISR) that caused them:
+    #
+    my @json_events;
+    my ($current_task, $slice_start_us);
+    my $isr_depth = 0;
+
+    for my $task (sort { $a <=> $b } keys %task_names) {
+        push @json_events,
+             sprintf('{"name":"thread_name","ph":"M","pid":1,"tid":%u,' .
+                     '"args":{"name":%s}}', $task, json_string($task_names{$task}));
+    }
+
+    push @json_events,
+         sprintf('{"name":"thread_name","ph":"M","pid":1,"tid":%u,' .
+                 '"args":{"name":"ISRs"}}', $ISR_TRACK);
+
+    for my $event (@events) {
+        my $ts_us = $event->{cycles} / $cpu_mhz;
+        my $type = $event->{type};
+
+        if ($type eq "switch") {
+            if (defined $current_task) {
+                push @json_events,
+                     sprintf('{"name":%s,"ph":"X","pid":1,"tid":%u,' .
+                             '"ts":%.3f,"dur":%.3f}',
+                             json_string($task_names{$current_task} //
+                                         "task $current_task"),
+                             $current_task, $slice_start_us,
+                             $ts_us - $slice_start_us);
+            }
+
+            $current_task = $event->{arg};
+            $slice_start_us = $ts_us;
+        } elsif ($type eq "isr_enter" || $type eq "isr_exit") {
+            my $phase = $type eq "isr_enter" ? "B" : "E";
+
+            if ($phase eq "B") {
+                $isr_depth ++;
+            } elsif ($isr_depth == 0) {
+                # Exit of an ISR whose entry was overwritten in the buffer
+                next;
+            } else {
+                $isr_depth --;
+            }
+
+            push @json_events,
+                 sprintf('{"name":"IRQ %d","ph":"%s","pid":1,"tid":%u,"ts":%.3f}',
+                         $event->{arg} >= 2**31 ? $event->{arg} - 2**32 : $event->{arg},
+                         $phase, $ISR_TRACK, $ts_us);
+        } else {
+            my $tid = $isr_depth != 0 ? $ISR_TRACK : $current_task;
+
+            next if !defined $tid;
+            push @json_events,
+                 sprintf('{"name":%s,"ph":"i","s":"t","pid":1,"tid":%u,' .
+                         '"ts":%.3f,"args":{"object":%s,"arg2":%u}}',
+                         json_string($type), $tid, $ts_us,
+                         json_string(addr_to_name($event->{arg})),
+                         $event->{arg2});
+        }
+    }
+
+    print "{\"traceEvents\":[\n", join(",\n", @json_events), "\n]}\n";
+    exit 0;
+}
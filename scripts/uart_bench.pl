@@ -0,0 +1,222 @@
+#!/usr/bin/perl
+#
+# Host side of the lab2-uart echo benchmark (the 'bench' command of
+# lab2-uart/Sources/main.c). For each baud rate given, it asks the board to
+# start a run, streams a pseudo-random byte sequence at that baud rate,
+# checks the bytes echoed back, and prints the sustained echo rate and the
+# errors seen on each side.
+#
+# The serial port is configured with stty(1), so this tool needs a Linux
+# host.
+#
+# Invocation syntax:
+# uart_bench.pl <serial device> <irq|dma> <byte count> <baud rate> [<baud rate> ...]
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+use Fcntl;
+use IO::Handle;
+use IO::Select;
+use Time::HiRes qw(time sleep);
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME <serial device> <irq|dma> <byte count> <baud rate> [<baud rate> ...]";
+
+#
+# Baud rate of the board's command line (BOARD_DEBUG_UART_BAUD)
+#
+my $CONSOLE_BAUD = 115200;
+
+#
+# Seconds without echoed bytes after which all echoes are considered
+# received. It must be shorter than UART_BENCH_IDLE_TIMEOUT_MS in
+# uart_bench.h, so that we are back at the console baud rate before the
+# board prints the counters of the run.
+#
+my $ECHO_IDLE_TIMEOUT = 0.5;
+
+#
+# Seconds to wait for a reply line from the board
+#
+my $REPLY_TIMEOUT = 5.0;
+
+#
+# Bytes written to the serial port at a time
+#
+my $WRITE_CHUNK_SIZE = 64;
+
+sub set_baud_rate {
+    my ($device, $baud_rate) = @_;
+
+    system("stty", "-F", $device, $baud_rate, "raw", "-echo", "-ixon",
+           "-ixoff", "-crtscts", "cs8", "-cstopb", "-parenb") == 0 or
+        die "$PROG_NAME: *** Error: setting $device to $baud_rate baud failed\n";
+}
+
+#
+# Reads lines from the board until one starts with one of the given
+# prefixes, and returns it
+#
+sub wait_for_line {
+    my ($fh, $select, $prefix_regex) = @_;
+    my $line = "";
+    my $deadline = time() + $REPLY_TIMEOUT;
+
+    while (time() < $deadline) {
+        next if !$select->can_read($deadline - time());
+
+        my $buf;
+        my $n = sysread($fh, $buf, 256);
+
+        next if !defined $n || $n == 0;
+
+        $line .= $buf;
+        while ($line =~ s/^([^\n]*)\n//) {
+            my $l = $1;
+
+            $l =~ s/\r//g;
+            return $l if $l =~ /^(?:$prefix_regex)/;
+        }
+    }
+
+    die "$PROG_NAME: *** Error: timeout waiting for a reply from the board\n";
+}
+
+#
+# Generates the byte sequence sent in a run. Consecutive bytes differ, and
+# the sequence does not repeat every 256 bytes, so dropped or duplicated
+# bytes show up as mismatches.
+#
+sub gen_data {
+    my ($byte_count) = @_;
+    my $seed = 1;
+    my $data = "";
+
+    for (1 .. $byte_count) {
+        $seed = ($seed * 1103515245 + 12345) & 0x7fffffff;
+        $data .= chr(($seed >> 16) & 0xff);
+    }
+
+    return $data;
+}
+
+#
+# Streams the data at the current baud rate, and collects the echoed bytes
+#
+sub stream_data {
+    my ($fh, $select, $data) = @_;
+    my $sent = 0;
+    my $echoed = "";
+    my $start_time = time();
+    my $last_echo_time = $start_time;
+
+    for (;;) {
+        my $write_select = IO::Select->new();
+
+        $write_select->add($fh) if $sent < length($data);
+
+        my ($readable, $writable) =
+            IO::Select->select($select, $write_select, undef, 0.05);
+
+        if ($readable && @$readable) {
+            my $buf;
+            my $n = sysread($fh, $buf, 4096);
+
+            if (defined $n && $n > 0) {
+                $echoed .= $buf;
+                $last_echo_time = time();
+            }
+        }
+
+        if ($writable && @$writable) {
+            my $n = syswrite($fh, $data, $WRITE_CHUNK_SIZE, $sent);
+
+            $sent += $n if defined $n;
+        }
+
+        last if $sent == length($data) &&
+                time() - $last_echo_time >= $ECHO_IDLE_TIMEOUT;
+    }
+
+    return ($echoed, $last_echo_time - $start_time);
+}
+
+sub run_baud_rate {
+    my ($device, $fh, $select, $mode, $data, $baud_rate) = @_;
+
+    set_baud_rate($device, $CONSOLE_BAUD);
+    syswrite($fh, "bench $mode $baud_rate\r");
+
+    my $reply = wait_for_line($fh, $select, "READY|ERROR");
+
+    if ($reply =~ /^ERROR/) {
+        print "$baud_rate: board: $reply\n";
+        return;
+    }
+
+    #
+    # Give the board time to drain READY and switch its baud rate:
+    #
+    sleep(0.05);
+    set_baud_rate($device, $baud_rate);
+
+    my ($echoed, $elapsed) = stream_data($fh, $select, $data);
+
+    set_baud_rate($device, $CONSOLE_BAUD);
+
+    my $result = wait_for_line($fh, $select, "RESULT|ERROR");
+    my $received = length($echoed);
+    my $missing = length($data) > $received ? length($data) - $received : 0;
+    my $mismatches = 0;
+
+    for my $i (0 .. $received - 1) {
+        $mismatches ++ if $i >= length($data) ||
+                          substr($echoed, $i, 1) ne substr($data, $i, 1);
+    }
+
+    $elapsed = 1e-6 if $elapsed <= 0;
+
+    #
+    # Each byte takes 10 bit times on the line (8N1):
+    #
+    my $rate = $received / $elapsed;
+
+    printf("%7u baud: %u bytes echoed of %u (%u missing, %u mismatched) " .
+           "in %.3f s: %.0f bytes/s (%.1f%% of line rate)\n",
+           $baud_rate, $received, length($data), $missing, $mismatches,
+           $elapsed, $rate, $rate * 10 * 100 / $baud_rate);
+    print "              board: $result\n";
+}
+
+#
+# Main program
+#
+{
+    if (@ARGV < 4 || $ARGV[1] !~ /^(?:irq|dma)$/ || $ARGV[2] !~ /^\d+$/) {
+        die "*** Error: Invalid arguments: @ARGV\n$USAGE_STR\n";
+    }
+
+    my ($device, $mode, $byte_count, @baud_rates) = @ARGV;
+
+    sysopen(my $fh, $device, O_RDWR | O_NOCTTY) or
+        die "$PROG_NAME: *** Error: opening $device failed: $!\n";
+
+    binmode($fh);
+
+    my $select = IO::Select->new($fh);
+    my $data = gen_data($byte_count);
+
+    for my $baud_rate (@baud_rates) {
+        run_baud_rate($device, $fh, $select, $mode, $data, $baud_rate);
+    }
+
+    close($fh);
+    exit 0;
+}
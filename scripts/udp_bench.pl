@@ -0,0 +1,281 @@
+#!/usr/bin/perl
+#
+# Host side of the on-target UDP benchmarks (the 'bench udp' console
+# command). It runs in one of the following modes:
+#
+#   sink  - Counts the datagrams sent by 'bench udp tx' and prints the
+#           throughput and loss of each run
+#   blast - Sends datagrams to the board, for 'bench udp rx'
+#   echo  - Sends back the echo requests of 'bench udp rtt'
+#   soak  - Sends soak test datagrams to the board's UDP server at a fixed
+#           rate, until interrupted, for the 'soak' console command
+#
+# Invocation syntax:
+# udp_bench.pl sink
+# udp_bench.pl blast <board IPv4 address> <datagram size> <count>
+# udp_bench.pl echo
+# udp_bench.pl soak <board IPv4 address> <datagrams per second> [<datagram size>]
+#
+# Author: German Rivera
+#
+use strict;
+use warnings;
+use File::Basename;
+use IO::Socket::INET;
+use IO::Select;
+use Time::HiRes qw(time sleep);
+
+#
+# Name of this tool
+#
+my $PROG_NAME = basename($0);
+
+my $USAGE_STR = "Usage: $PROG_NAME sink | blast <board IPv4 address> <datagram size> <count> | echo |\n" .
+                "       soak <board IPv4 address> <datagrams per second> [<datagram size>]";
+
+#
+# UDP port used by the benchmarks (NET_BENCHMARK_PORT in net_benchmark.h)
+#
+my $BENCH_PORT = 5001;
+
+#
+# Benchmark message header (struct net_benchmark_header in net_benchmark.h):
+# magic, type, reserved, run ID, sequence number and timestamp, big endian.
+# NET_BENCHMARK_MAGIC is GEN_SIGNATURE('B', 'N', 'C', 'H').
+#
+my $HEADER_FORMAT = "NCCnNN";
+my $HEADER_SIZE = 16;
+my $BENCH_MAGIC = 0x48434e42;
+
+my $MSG_DATA = 1;
+my $MSG_ECHO_REQUEST = 2;
+my $MSG_ECHO_REPLY = 3;
+
+#
+# Maximum UDP payload size of a benchmark datagram
+# (NET_MAX_IPV4_UDP_PACKET_PAYLOAD_SIZE)
+#
+my $MAX_DATAGRAM_SIZE = 1472;
+
+#
+# UDP port of the board's UDP server, and soak test datagram header (struct
+# udp_soak_test_header in main.c): magic, sequence number and timestamp,
+# big endian. UDP_SOAK_TEST_MAGIC is GEN_SIGNATURE('S', 'O', 'A', 'K').
+#
+my $UDP_SERVER_PORT = 8887;
+my $SOAK_HEADER_FORMAT = "NNN";
+my $SOAK_HEADER_SIZE = 12;
+my $SOAK_MAGIC = 0x4b414f53;
+
+#
+# Seconds between soak test progress messages
+#
+my $SOAK_REPORT_PERIOD = 10;
+
+#
+# Seconds without datagrams after which a sink run is considered finished
+#
+my $SINK_IDLE_TIMEOUT = 1.0;
+
+sub open_socket {
+    my $socket = IO::Socket::INET->new(LocalPort => $BENCH_PORT,
+                                       Proto => "udp") or
+        die "$PROG_NAME: *** Error: binding UDP port $BENCH_PORT failed: $!\n";
+
+    return $socket;
+}
+
+sub print_run {
+    my ($run_id, $packets, $bytes, $lost, $elapsed) = @_;
+
+    $elapsed = 1e-6 if $elapsed <= 0;
+    printf("Run %u: %u datagrams (%u lost) in %.3f s: %.3f Mbps, %.0f pps\n",
+           $run_id, $packets, $lost, $elapsed, $bytes * 8 / $elapsed / 1e6,
+           $packets / $elapsed);
+}
+
+#
+# Counts the datagrams of each 'bench udp tx' run. Datagrams carry sequence
+# numbers starting at 0, so losses are the gaps up to the highest sequence
+# number received.
+#
+sub run_sink {
+    my $socket = open_socket();
+    my $select = IO::Select->new($socket);
+    my $run;
+
+    print "Waiting for datagrams on UDP port $BENCH_PORT...\n";
+    for (;;) {
+        my $datagram;
+
+        if (defined $run && !$select->can_read($SINK_IDLE_TIMEOUT)) {
+            print_run($run->{run_id}, $run->{packets}, $run->{bytes},
+                      $run->{max_seq_num} + 1 - $run->{packets},
+                      $run->{last_time} - $run->{first_time});
+            undef $run;
+            next;
+        }
+
+        $socket->recv($datagram, 65535) or next;
+        next if length($datagram) < $HEADER_SIZE;
+
+        my ($magic, $type, undef, $run_id, $seq_num) =
+            unpack($HEADER_FORMAT, $datagram);
+
+        next if $magic != $BENCH_MAGIC || $type != $MSG_DATA;
+
+        my $now = time();
+
+        if (defined $run && $run->{run_id} != $run_id) {
+            print_run($run->{run_id}, $run->{packets}, $run->{bytes},
+                      $run->{max_seq_num} + 1 - $run->{packets},
+                      $run->{last_time} - $run->{first_time});
+            undef $run;
+        }
+
+        if (!defined $run) {
+            $run = { run_id => $run_id, packets => 0, bytes => 0,
+                     max_seq_num => 0, first_time => $now };
+        }
+
+        $run->{packets} ++;
+        $run->{bytes} += length($datagram);
+        $run->{last_time} = $now;
+        $run->{max_seq_num} = $seq_num if $seq_num > $run->{max_seq_num};
+    }
+}
+
+#
+# Sends datagrams to the board, for 'bench udp rx', as fast as the host
+# can send them
+#
+sub run_blast {
+    my ($board_ip_addr, $datagram_size, $count) = @_;
+
+    if ($datagram_size < $HEADER_SIZE || $datagram_size > $MAX_DATAGRAM_SIZE) {
+        die "$PROG_NAME: *** Error: datagram size must be between " .
+            "$HEADER_SIZE and $MAX_DATAGRAM_SIZE\n";
+    }
+
+    my $socket = IO::Socket::INET->new(PeerAddr => $board_ip_addr,
+                                       PeerPort => $BENCH_PORT,
+                                       LocalPort => $BENCH_PORT,
+                                       Proto => "udp") or
+        die "$PROG_NAME: *** Error: opening UDP socket to $board_ip_addr failed: $!\n";
+
+    my $run_id = int(rand(65536));
+    my $padding = "\0" x ($datagram_size - $HEADER_SIZE);
+    my $start_time = time();
+
+    for my $seq_num (0 .. $count - 1) {
+        my $timestamp_us = int((time() - $start_time) * 1e6) & 0xffffffff;
+        my $datagram = pack($HEADER_FORMAT, $BENCH_MAGIC, $MSG_DATA, 0,
+                            $run_id, $seq_num, $timestamp_us) . $padding;
+
+        #
+        # Retry when the host's socket buffer is full:
+        #
+        until (defined $socket->send($datagram)) {
+            sleep(0.001);
+        }
+    }
+
+    print_run($run_id, $count, $count * $datagram_size, 0, time() - $start_time);
+}
+
+#
+# Sends back the echo requests of 'bench udp rtt', as echo replies
+#
+sub run_echo {
+    my $socket = open_socket();
+    my $replies = 0;
+
+    print "Echoing requests on UDP port $BENCH_PORT...\n";
+    for (;;) {
+        my $datagram;
+        my $peer_addr = $socket->recv($datagram, 65535);
+
+        next if !defined $peer_addr || length($datagram) < $HEADER_SIZE;
+
+        my ($magic, $type) = unpack("NC", $datagram);
+
+        next if $magic != $BENCH_MAGIC || $type != $MSG_ECHO_REQUEST;
+
+        substr($datagram, 4, 1) = pack("C", $MSG_ECHO_REPLY);
+        send($socket, $datagram, 0, $peer_addr);
+        $replies ++;
+        print "$replies echo replies sent\n" if $replies % 1000 == 0;
+    }
+}
+
+#
+# Sends soak test datagrams to the board at a fixed rate, until interrupted.
+# The echoed datagrams are not read, as the board tracks the statistics.
+#
+sub run_soak {
+    my ($board_ip_addr, $rate, $datagram_size) = @_;
+
+    $datagram_size //= 64;
+    if ($rate <= 0) {
+        die "$PROG_NAME: *** Error: invalid rate: $rate\n";
+    }
+
+    if ($datagram_size < $SOAK_HEADER_SIZE || $datagram_size > $MAX_DATAGRAM_SIZE) {
+        die "$PROG_NAME: *** Error: datagram size must be between " .
+            "$SOAK_HEADER_SIZE and $MAX_DATAGRAM_SIZE\n";
+    }
+
+    my $socket = IO::Socket::INET->new(PeerAddr => $board_ip_addr,
+                                       PeerPort => $UDP_SERVER_PORT,
+                                       Proto => "udp") or
+        die "$PROG_NAME: *** Error: opening UDP socket to $board_ip_addr failed: $!\n";
+
+    my $padding = "\0" x ($datagram_size - $SOAK_HEADER_SIZE);
+    my $start_time = time();
+    my $next_report_time = $start_time + $SOAK_REPORT_PERIOD;
+
+    print "Sending $rate datagrams per second to $board_ip_addr, " .
+          "port $UDP_SERVER_PORT (Ctrl-C to stop)...\n";
+
+    #
+    # Each datagram is sent at its scheduled time, so that the rate does not
+    # drift with the time taken to send:
+    #
+    for (my $seq_num = 0; ; $seq_num ++) {
+        my $send_time = $start_time + $seq_num / $rate;
+        my $now = time();
+
+        sleep($send_time - $now) if $send_time > $now;
+
+        my $timestamp_us = int((time() - $start_time) * 1e6) & 0xffffffff;
+
+        $socket->send(pack($SOAK_HEADER_FORMAT, $SOAK_MAGIC,
+                           $seq_num & 0xffffffff, $timestamp_us) . $padding);
+
+        if ($now >= $next_report_time) {
+            printf("%u datagrams sent in %.0f s\n", $seq_num + 1, $now - $start_time);
+            $next_report_time += $SOAK_REPORT_PERIOD;
+        }
+    }
+}
+
+#
+# Main program
+#
+{
+    my $mode = shift @ARGV // "";
+
+    if ($mode eq "sink" && @ARGV == 0) {
+        run_sink();
+    } elsif ($mode eq "blast" && @ARGV == 3) {
+        run_blast(@ARGV);
+    } elsif ($mode eq "echo" && @ARGV == 0) {
+        run_echo();
+    } elsif ($mode eq "soak" && (@ARGV == 2 || @ARGV == 3)) {
+        run_soak(@ARGV);
+    } else {
+        die "*** Error: Invalid arguments: $mode @ARGV\n$USAGE_STR\n";
+    }
+
+    exit 0;
+}
@@ -0,0 +1,15 @@
+#
+# module-level build makefile for the building blocks that are shared
+# by the labs, instead of being copied into each lab's building-blocks
+# directory. Each lab builds its own copy of this library, compiled
+# against that lab's building-blocks headers.
+#
+# Author: German Rivera
+#
+
+local_src := $(subdirectory)/byte_ring_buffer.c \
+             $(subdirectory)/cpu_reset_counter.c \
+             $(subdirectory)/crc32_tables.c \
+             $(subdirectory)/printf_utils.c
+
+$(eval $(call make-library, $(subdirectory)/shared-building-blocks.a, $(local_src)))